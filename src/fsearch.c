@@ -18,6 +18,11 @@
 
 #define G_LOG_DOMAIN "fsearch-application"
 
+// seconds between saving the changes found by the filesystem monitor
+#define DATABASE_SAVE_CHANGES_INTERVAL 60
+// milliseconds to wait for more events after the database file changed, before it gets reloaded
+#define DATABASE_FILE_RELOAD_DELAY 1000
+
 #ifdef HAVE_CONFIG_H
 #include <config.h>
 #endif
@@ -25,10 +30,18 @@
 #include "fsearch.h"
 #include "fsearch_clipboard.h"
 #include "fsearch_config.h"
+#include "fsearch_daemon.h"
 #include "fsearch_database.h"
+#include "fsearch_database_monitor.h"
+#include "fsearch_database_search.h"
+#include "fsearch_database_view.h"
+#include "fsearch_dbus_search.h"
+#include "fsearch_file_content.h"
 #include "fsearch_file_utils.h"
 #include "fsearch_limits.h"
+#include "fsearch_path_writer.h"
 #include "fsearch_preferences_ui.h"
+#include "fsearch_query.h"
 #include "fsearch_ui_utils.h"
 #include "fsearch_window.h"
 #include "icon_resources.h"
@@ -37,13 +50,16 @@
 #include <glib.h>
 #include <glib/gi18n.h>
 #include <limits.h>
+#include <signal.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 struct _FsearchApplication {
     GtkApplication parent;
     FsearchDatabase *db;
+    FsearchDatabaseMonitor *db_monitor;
     FsearchConfig *config;
     FsearchThreadPool *pool;
 
@@ -55,8 +71,18 @@ struct _FsearchApplication {
     guint file_manager_watch_id;
     bool has_file_manager_on_bus;
 
+    // the search interface of the primary instance for other programs
+    FsearchDbusSearch *dbus_search;
+
     FsearchDatabaseState db_state;
     guint db_timeout_id;
+    // the timers of the indexes which are scanned on their own schedule (see FsearchIndex.update_interval)
+    GArray *index_timeout_ids;
+    // periodically persists the changes found by db_monitor
+    guint db_save_changes_timeout_id;
+    // picks up database files written by other processes (e.g. `fsearch --update-database`)
+    GFileMonitor *db_file_monitor;
+    guint db_file_reload_timeout_id;
 
     GCancellable *db_thread_cancellable;
     int num_database_update_active;
@@ -78,16 +104,27 @@ enum {
 
 typedef enum FsearchDatabaseActionType {
     FSEARCH_DATABASE_ACTION_SCAN,
+    // a scan which yields CPU and I/O to everything else
+    FSEARCH_DATABASE_ACTION_SCAN_LOW_IMPACT,
+    // scan a single index, all others are taken from the current database
+    FSEARCH_DATABASE_ACTION_SCAN_INDEX,
     FSEARCH_DATABASE_ACTION_LOAD,
+    // load the database file again after another process replaced it, without interrupting the windows
+    FSEARCH_DATABASE_ACTION_RELOAD,
     NUM_FSEARCH_DATABASE_ACTION_TYPES,
 } FsearchDatabaseActionType;
 
 typedef struct {
     FsearchDatabaseActionType action;
-    void (*update_func)(FsearchApplication *, FsearchDatabase *);
+    // the index FSEARCH_DATABASE_ACTION_SCAN_INDEX scans, NULL for all other actions
+    char *index_path;
+    // returns false if the database couldn't be scanned or loaded
+    bool (*update_func)(FsearchApplication *, FsearchDatabase *, const char *index_path);
     void (*started_cb)(void *);
     void *started_cb_data;
     void (*finished_cb)(void *);
+    // runs after finished_cb handed the database over to the application, if update_func succeeded
+    void (*published_func)(FsearchApplication *, FsearchDatabase *);
     void (*cancelled_cb)(void *);
     void *cancelled_cb_data;
 } DatabaseUpdateContext;
@@ -99,6 +136,12 @@ G_DEFINE_TYPE(FsearchApplication, fsearch_application, GTK_TYPE_APPLICATION)
 static void
 action_set_enabled(const char *action_name, gboolean enabled);
 
+static void
+database_scan_or_load_enqueue(FsearchDatabaseActionType action);
+
+static void
+database_scan_index_enqueue(const char *index_path);
+
 static gboolean
 on_database_scan_enqueue(gpointer data);
 
@@ -109,12 +152,57 @@ static gboolean
 on_database_auto_update(gpointer user_data) {
     FsearchApplication *self = FSEARCH_APPLICATION(user_data);
     g_debug("[app] scheduled database update started");
-    g_action_group_activate_action(G_ACTION_GROUP(self), "update_database", NULL);
+    if (self->config->update_database_every_low_impact) {
+        if (g_action_group_get_action_enabled(G_ACTION_GROUP(self), "update_database")) {
+            database_scan_or_load_enqueue(FSEARCH_DATABASE_ACTION_SCAN_LOW_IMPACT);
+        }
+    }
+    else {
+        g_action_group_activate_action(G_ACTION_GROUP(self), "update_database", NULL);
+    }
     return G_SOURCE_CONTINUE;
 }
 
+static gboolean
+on_index_auto_update(gpointer user_data) {
+    const char *index_path = user_data;
+    FsearchApplication *self = FSEARCH_APPLICATION_DEFAULT;
+    // a running update is waited for, the index gets its turn at the next interval
+    if (g_action_group_get_action_enabled(G_ACTION_GROUP(self), "update_database")) {
+        g_debug("[app] scheduled update of %s started", index_path);
+        database_scan_index_enqueue(index_path);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static void
+index_auto_update_clear(FsearchApplication *fsearch) {
+    for (uint32_t i = 0; fsearch->index_timeout_ids && i < fsearch->index_timeout_ids->len; i++) {
+        g_source_remove(g_array_index(fsearch->index_timeout_ids, guint, i));
+    }
+    g_clear_pointer(&fsearch->index_timeout_ids, g_array_unref);
+}
+
+static void
+index_auto_update_init(FsearchApplication *fsearch) {
+    index_auto_update_clear(fsearch);
+    fsearch->index_timeout_ids = g_array_new(FALSE, FALSE, sizeof(guint));
+    for (GList *l = fsearch->config->indexes; l != NULL; l = l->next) {
+        FsearchIndex *index = l->data;
+        if (!index->enabled || index->update_interval == 0) {
+            continue;
+        }
+        const guint seconds = MIN(index->update_interval, G_MAXUINT / 60) * 60;
+        g_debug("[app] update %s every %u seconds", index->path, seconds);
+        const guint id =
+            g_timeout_add_seconds_full(G_PRIORITY_DEFAULT, seconds, on_index_auto_update, g_strdup(index->path), g_free);
+        g_array_append_val(fsearch->index_timeout_ids, id);
+    }
+}
+
 static void
 database_auto_update_init(FsearchApplication *fsearch) {
+    index_auto_update_init(fsearch);
     if (fsearch->db_timeout_id != 0) {
         g_source_remove(fsearch->db_timeout_id);
         fsearch->db_timeout_id = 0;
@@ -169,20 +257,81 @@ prepare_windows_for_db_update(FsearchApplication *app) {
     }
 }
 
+static void
+database_monitor_rescan_cb(gpointer user_data) {
+    g_idle_add(on_database_scan_enqueue, NULL);
+}
+
+// The database is only read: it's kept up to date by someone else or it's made of other database files
+static bool
+database_is_read_only(FsearchApplication *app) {
+    return app->config->system_database || app->config->database_segments;
+}
+
+static void
+database_save_changes(FsearchApplication *app, bool wait) {
+    if (!app->db || database_is_read_only(app)) {
+        return;
+    }
+    g_autofree gchar *db_path = fsearch_application_get_database_dir();
+    if (!db_path) {
+        return;
+    }
+    db_lock(app->db);
+    if (wait) {
+        // while the database is saved in the background, changes are only kept in memory
+        db_wait_for_save(app->db);
+    }
+    db_save_changes(app->db, db_path);
+    if (wait) {
+        db_wait_for_save(app->db);
+    }
+    db_unlock(app->db);
+}
+
 static gboolean
-on_database_update_finished(gpointer user_data) {
-    FsearchApplication *self = FSEARCH_APPLICATION_DEFAULT;
-    FsearchDatabase *db = user_data;
+on_database_save_changes(gpointer user_data) {
+    database_save_changes(user_data, false);
+    return G_SOURCE_CONTINUE;
+}
+
+static void
+database_monitor_update(FsearchApplication *app) {
+    g_clear_pointer(&app->db_monitor, db_monitor_free);
+    if (app->db_save_changes_timeout_id != 0) {
+        g_source_remove(app->db_save_changes_timeout_id);
+        app->db_save_changes_timeout_id = 0;
+    }
+    // the changes to a read-only database would only be kept by this instance
+    if (app->config->monitor_filesystem && app->db && !database_is_read_only(app)) {
+        app->db_monitor = db_monitor_new(app->db, database_monitor_rescan_cb, app);
+    }
+    if (app->db_monitor) {
+        app->db_save_changes_timeout_id =
+            g_timeout_add_seconds(DATABASE_SAVE_CHANGES_INTERVAL, on_database_save_changes, app);
+    }
+}
+
+static void
+database_update_finish(FsearchApplication *self, FsearchDatabase *db, bool reload) {
     if (self->is_shutting_down) {
         g_debug("[app] update finished, but app is shutting down");
         g_clear_pointer(&db, db_unref);
-        return G_SOURCE_REMOVE;
+        return;
     }
     fsearch_application_state_lock(self);
-    if (!g_cancellable_is_cancelled(self->db_thread_cancellable)) {
-        prepare_windows_for_db_update(self);
+    bool replaced = false;
+    if (!g_cancellable_is_cancelled(self->db_thread_cancellable) && db) {
+        // with a reload the windows keep showing the old results until they switch over to the new database,
+        // which also takes the selection along
+        if (!reload) {
+            prepare_windows_for_db_update(self);
+        }
+        g_clear_pointer(&self->db_monitor, db_monitor_free);
         g_clear_pointer(&self->db, db_unref);
         self->db = g_steal_pointer(&db);
+        database_monitor_update(self);
+        replaced = true;
     }
     else if (db) {
         g_clear_pointer(&db, db_unref);
@@ -194,7 +343,20 @@ on_database_update_finished(gpointer user_data) {
         action_set_enabled("cancel_update_database", FALSE);
     }
     fsearch_application_state_unlock(self);
-    g_signal_emit(self, fsearch_signals[FSEARCH_SIGNAL_DATABASE_UPDATE_FINISHED], 0);
+    if (replaced || !reload) {
+        g_signal_emit(self, fsearch_signals[FSEARCH_SIGNAL_DATABASE_UPDATE_FINISHED], 0);
+    }
+}
+
+static gboolean
+on_database_update_finished(gpointer user_data) {
+    database_update_finish(FSEARCH_APPLICATION_DEFAULT, user_data, false);
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean
+on_database_reload_finished(gpointer user_data) {
+    database_update_finish(FSEARCH_APPLICATION_DEFAULT, user_data, true);
     return G_SOURCE_REMOVE;
 }
 
@@ -205,6 +367,11 @@ database_update_finished_cb(gpointer user_data) {
     g_idle_add(on_database_update_finished, user_data);
 }
 
+static void
+database_reload_finished_cb(gpointer user_data) {
+    g_idle_add(on_database_reload_finished, user_data);
+}
+
 static gboolean
 on_database_load_started(gpointer user_data) {
     FsearchApplication *self = FSEARCH_APPLICATION(user_data);
@@ -233,71 +400,246 @@ database_scan_started_cb(gpointer user_data) {
     g_idle_add(on_database_scan_started, self);
 }
 
-static void
-database_scan_and_save(FsearchApplication *app, FsearchDatabase *db) {
-    const bool scan_successful =
-        db_scan(db, app->db_thread_cancellable, app->config->show_indexing_status ? database_notify_status_cb : NULL);
-    if (scan_successful && !g_cancellable_is_cancelled(app->db_thread_cancellable)) {
-        g_autofree gchar *db_path = fsearch_application_get_database_dir();
-        if (db_path) {
-            if (app->config->show_indexing_status) {
-                database_notify_status_cb(_("Saving…"));
-            }
-            db_save(db, db_path);
+// The database file the application loads, a system wide one replaces the one of the user
+static char *
+database_get_file_path(FsearchConfig *config) {
+    if (config->system_database) {
+        return g_strdup(config->system_database);
+    }
+    return fsearch_application_get_database_file_path();
+}
+
+static bool
+database_scan(FsearchApplication *app, FsearchDatabase *db, const char *index_path) {
+    void (*status_cb)(const char *) = app->config->show_indexing_status ? database_notify_status_cb : NULL;
+
+    // the database can be searched as soon as the names are sorted, the other orders follow in
+    // database_sort_remaining_and_save
+    db_set_progressive_load(db, true);
+
+    // indexes which have updates disabled are taken from the current database
+    fsearch_application_state_lock(app);
+    FsearchDatabase *reference = db_ref(app->db);
+    fsearch_application_state_unlock(app);
+
+    bool scan_successful = false;
+    if (reference && index_path) {
+        scan_successful = db_rescan_index(db, reference, index_path, app->db_thread_cancellable, status_cb);
+    }
+    else if (reference && app->config->update_database_incrementally) {
+        scan_successful = db_scan_incremental(db, reference, app->db_thread_cancellable, status_cb);
+    }
+    else if (reference) {
+        scan_successful = db_rescan(db, reference, app->db_thread_cancellable, status_cb);
+    }
+    else {
+        scan_successful = db_scan(db, app->db_thread_cancellable, status_cb);
+    }
+
+    if (scan_successful && reference) {
+        // the current database might still be writing the same file, which gets replaced once the new one is sorted
+        db_lock(reference);
+        db_wait_for_save(reference);
+        db_unlock(reference);
+    }
+    g_clear_pointer(&reference, db_unref);
+    return scan_successful;
+}
+
+static bool
+database_load(FsearchApplication *app, FsearchDatabase *db, const char *index_path) {
+    g_autofree char *db_file_path = database_get_file_path(app->config);
+    if (!db_file_path) {
+        return false;
+    }
+    // the database can be searched as soon as the names are loaded, the rest follows in database_load_remaining
+    db_set_progressive_load(db, true);
+    const bool loaded = db_load(db, db_file_path, app->config->show_indexing_status ? database_notify_status_cb : NULL);
+    // a workstation might not have a database of its own, when all files are on the servers
+    const bool has_segments = db_add_segments(db, app->config->database_segments) > 0;
+    if (!loaded && !has_segments) {
+        if (!app->config->update_database_on_launch && !database_is_read_only(app)) {
+            // load failed -> trigger rescan
+            g_idle_add(on_database_scan_enqueue, NULL);
         }
+        return false;
     }
+    return true;
 }
 
-static void
-database_load(FsearchApplication *app, FsearchDatabase *db) {
-    g_autofree char *db_file_path = fsearch_application_get_database_file_path();
+static bool
+database_reload(FsearchApplication *app, FsearchDatabase *db, const char *index_path) {
+    g_autofree char *db_file_path = database_get_file_path(app->config);
     if (!db_file_path) {
-        return;
+        return false;
     }
-    if (!db_load(db, db_file_path, app->config->show_indexing_status ? database_notify_status_cb : NULL)
-        && !app->config->update_database_on_launch) {
-        // load failed -> trigger rescan
-        g_idle_add(on_database_scan_enqueue, NULL);
+    db_set_progressive_load(db, true);
+    const bool loaded = db_load(db, db_file_path, NULL);
+    return db_add_segments(db, app->config->database_segments) > 0 || loaded;
+}
+
+static gboolean
+on_database_load_remaining_finished(gpointer user_data) {
+    FsearchDatabase *db = user_data;
+    // the views show the sizes and modification times now
+    db_foreach_view(db, (GFunc)db_view_notify_database_changed, NULL);
+    g_clear_pointer(&db, db_unref);
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean
+on_database_duplicates_found(gpointer user_data) {
+    FsearchApplication *self = FSEARCH_APPLICATION(user_data);
+    fsearch_application_state_lock(self);
+    FsearchDatabase *db = db_ref(self->db);
+    fsearch_application_state_unlock(self);
+    if (db) {
+        // the views which wait for the duplicates search again, the others get their results from the search cache
+        db_foreach_view(db, (GFunc)db_view_notify_database_changed, NULL);
     }
+    g_clear_pointer(&db, db_unref);
+    return G_SOURCE_REMOVE;
 }
 
 static void
-database_scan_or_load_enqueue(FsearchDatabaseActionType action) {
+database_duplicates_found_cb(gpointer user_data) {
+    g_idle_add(on_database_duplicates_found, user_data);
+}
+
+static void
+database_load_remaining(FsearchApplication *app, FsearchDatabase *db) {
+    if (db_load_remaining(db, app->db_thread_cancellable)) {
+        g_idle_add(on_database_load_remaining_finished, db_ref(db));
+    }
+}
+
+static void
+database_sort_remaining_and_save(FsearchApplication *app, FsearchDatabase *db) {
+    // the file only lacks the orders which weren't sorted yet if this gets cancelled, loading it sorts them again
+    db_load_remaining(db, app->db_thread_cancellable);
+
+    g_autofree gchar *db_path = fsearch_application_get_database_dir();
+    if (db_path) {
+        // the database is in use already, so it's saved in the background
+        db_lock(db);
+        db_save_in_background(db, db_path);
+        db_unlock(db);
+    }
+}
+
+static void
+database_update_enqueue(FsearchDatabaseActionType action, const char *index_path) {
     FsearchApplication *app = FSEARCH_APPLICATION_DEFAULT;
     action_set_enabled("update_database", FALSE);
     action_set_enabled("cancel_update_database", TRUE);
 
+    if (database_is_read_only(app) && action != FSEARCH_DATABASE_ACTION_LOAD) {
+        // a read-only database is kept up to date by someone else, updating it means reading it again
+        action = FSEARCH_DATABASE_ACTION_RELOAD;
+    }
+
     g_cancellable_reset(app->db_thread_cancellable);
     app->num_database_update_active++;
 
     DatabaseUpdateContext *ctx = calloc(1, sizeof(DatabaseUpdateContext));
     g_assert(ctx);
 
+    ctx->action = action;
+    ctx->index_path = action == FSEARCH_DATABASE_ACTION_SCAN_INDEX ? g_strdup(index_path) : NULL;
     switch (action) {
     case FSEARCH_DATABASE_ACTION_SCAN:
-        ctx->update_func = database_scan_and_save;
+    case FSEARCH_DATABASE_ACTION_SCAN_LOW_IMPACT:
+    case FSEARCH_DATABASE_ACTION_SCAN_INDEX:
+        ctx->update_func = database_scan;
         ctx->started_cb = database_scan_started_cb;
+        ctx->published_func = database_sort_remaining_and_save;
         break;
     case FSEARCH_DATABASE_ACTION_LOAD:
         ctx->update_func = database_load;
         ctx->started_cb = database_load_started_cb;
+        ctx->published_func = database_load_remaining;
+        break;
+    case FSEARCH_DATABASE_ACTION_RELOAD:
+        ctx->update_func = database_reload;
+        ctx->published_func = database_load_remaining;
         break;
     default:
         g_assert_not_reached();
     }
 
     ctx->started_cb_data = app;
-    ctx->finished_cb = database_update_finished_cb;
+    ctx->finished_cb =
+        action == FSEARCH_DATABASE_ACTION_RELOAD ? database_reload_finished_cb : database_update_finished_cb;
 
     g_thread_pool_push(app->db_pool, g_steal_pointer(&ctx), NULL);
 }
 
+static void
+database_scan_or_load_enqueue(FsearchDatabaseActionType action) {
+    database_update_enqueue(action, NULL);
+}
+
+static void
+database_scan_index_enqueue(const char *index_path) {
+    database_update_enqueue(FSEARCH_DATABASE_ACTION_SCAN_INDEX, index_path);
+}
+
 static gboolean
 on_database_scan_enqueue(gpointer data) {
     database_scan_or_load_enqueue(FSEARCH_DATABASE_ACTION_SCAN);
     return G_SOURCE_REMOVE;
 }
 
+static gboolean
+on_database_file_reload_timeout(gpointer user_data) {
+    FsearchApplication *app = FSEARCH_APPLICATION(user_data);
+    app->db_file_reload_timeout_id = 0;
+    if (app->num_database_update_active > 0 || !app->db) {
+        // the running update replaces the database anyway
+        return G_SOURCE_REMOVE;
+    }
+    g_autofree char *db_file_path = database_get_file_path(app->config);
+    db_lock(app->db);
+    const bool replaced = db_file_was_replaced(app->db, db_file_path);
+    db_unlock(app->db);
+    if (replaced) {
+        g_debug("[app] database file was replaced by another process, reloading it");
+        database_scan_or_load_enqueue(FSEARCH_DATABASE_ACTION_RELOAD);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+static void
+on_database_file_changed(GFileMonitor *monitor,
+                         GFile *file,
+                         GFile *other_file,
+                         GFileMonitorEvent event_type,
+                         gpointer user_data) {
+    FsearchApplication *app = FSEARCH_APPLICATION(user_data);
+    // the file gets written to a temporary file first, which is then renamed to replace it
+    if (event_type != G_FILE_MONITOR_EVENT_CREATED && event_type != G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT) {
+        return;
+    }
+    // a single replacement triggers several events
+    if (app->db_file_reload_timeout_id != 0) {
+        g_source_remove(app->db_file_reload_timeout_id);
+    }
+    app->db_file_reload_timeout_id = g_timeout_add(DATABASE_FILE_RELOAD_DELAY, on_database_file_reload_timeout, app);
+}
+
+static void
+database_file_monitor_init(FsearchApplication *app) {
+    g_autofree char *db_file_path = database_get_file_path(app->config);
+    g_autoptr(GFile) db_file = g_file_new_for_path(db_file_path);
+    g_autoptr(GError) error = NULL;
+    app->db_file_monitor = g_file_monitor_file(db_file, G_FILE_MONITOR_NONE, NULL, &error);
+    if (!app->db_file_monitor) {
+        g_debug("[app] failed to monitor the database file: %s", error->message);
+        return;
+    }
+    g_signal_connect(app->db_file_monitor, "changed", G_CALLBACK(on_database_file_changed), app);
+}
+
 static void
 database_pool_func(gpointer data, gpointer user_data) {
     FsearchApplication *app = FSEARCH_APPLICATION(user_data);
@@ -312,22 +654,47 @@ database_pool_func(gpointer data, gpointer user_data) {
     g_timer_start(timer);
 
     fsearch_application_state_lock(app);
+    // the new database picks up the thread pool with the current config, the old one keeps its pool until it's gone
+    fsearch_thread_pool_set_default_config(app->config->num_threads, app->config->pin_threads);
     FsearchDatabase *db = db_new(app->config->indexes,
                                  app->config->exclude_locations,
                                  app->config->exclude_files,
                                  app->config->exclude_hidden_items);
     fsearch_application_state_unlock(app);
-
-    ctx->update_func(app, db);
+    db_set_low_impact(db, ctx->action == FSEARCH_DATABASE_ACTION_SCAN_LOW_IMPACT);
+    db_set_compress(db, app->config->compress_database);
+    db_set_lazy_sort_indexes(db, app->config->lazy_sort_indexes);
+    db_set_search_cache_size(db, (size_t)app->config->search_cache_size * 1024 * 1024);
+    db_set_memory_budget(db, config_get_memory_budget(app->config));
+    fsearch_file_content_set_cache_size(app->config->content_cache_size);
+    db_set_trigram_index(db, app->config->trigram_index);
+    db_set_index_flags(db, config_get_index_flags(app->config));
+    db_set_num_scan_threads(db, app->config->num_scan_threads);
+    db_set_scan_timeouts(db, app->config->scan_timeout * 1000, app->config->scan_index_timeout * 1000);
+    db_set_filter_by_access(db, app->config->system_database != NULL);
+    db_set_duplicates_found_func(db, database_duplicates_found_cb, app);
+
+    const bool updated = ctx->update_func(app, db, ctx->index_path);
+    g_clear_pointer(&ctx->index_path, g_free);
+    if (!updated && ctx->action == FSEARCH_DATABASE_ACTION_RELOAD) {
+        // keep the current database
+        g_clear_pointer(&db, db_unref);
+    }
 
     g_timer_stop(timer);
     const double seconds = g_timer_elapsed(timer, NULL);
 
     g_debug("[app] database update finished in %.2f ms", seconds * 1000);
 
+    // finished_cb takes over the database
+    FsearchDatabase *published = ctx->published_func && updated && db ? db_ref(db) : NULL;
     if (ctx->finished_cb) {
         ctx->finished_cb(db);
     }
+    if (published) {
+        ctx->published_func(app, published);
+        g_clear_pointer(&published, db_unref);
+    }
 }
 
 static void
@@ -457,6 +824,7 @@ on_preferences_ui_finished(FsearchConfig *new_config) {
                                               .listview_config_changed = true,
                                               .search_config_changed = true};
 
+    const bool monitor_config_changed = !app->config || app->config->monitor_filesystem != new_config->monitor_filesystem;
     if (app->config) {
         config_diff = config_cmp(app->config, new_config);
         g_clear_pointer(&app->config, config_free);
@@ -466,6 +834,9 @@ on_preferences_ui_finished(FsearchConfig *new_config) {
 
     g_object_set(gtk_settings_get_default(), "gtk-application-prefer-dark-theme", new_config->enable_dark_theme, NULL);
     database_auto_update_init(app);
+    if (monitor_config_changed) {
+        database_monitor_update(app);
+    }
 
     if (config_diff.database_config_changed) {
         database_scan_or_load_enqueue(FSEARCH_DATABASE_ACTION_SCAN);
@@ -511,6 +882,75 @@ action_update_database_activated(GSimpleAction *action, GVariant *parameter, gpo
     database_scan_or_load_enqueue(FSEARCH_DATABASE_ACTION_SCAN);
 }
 
+static void
+action_scan_statistics_activated(GSimpleAction *action, GVariant *parameter, gpointer app) {
+    g_assert(FSEARCH_IS_APPLICATION(app));
+    FsearchApplication *self = FSEARCH_APPLICATION(app);
+    FsearchApplicationWindow *window = get_first_application_window(self);
+    if (!window) {
+        return;
+    }
+
+    fsearch_application_state_lock(self);
+    FsearchDatabaseScanStats *scan_stats = self->db ? db_get_scan_stats(self->db) : NULL;
+    fsearch_application_state_unlock(self);
+
+    g_autoptr(GString) report = scan_stats ? db_scan_stats_to_string(scan_stats) : NULL;
+    g_clear_pointer(&scan_stats, db_scan_stats_unref);
+
+    GtkWidget *dialog = gtk_message_dialog_new(GTK_WINDOW(window),
+                                               GTK_DIALOG_DESTROY_WITH_PARENT,
+                                               GTK_MESSAGE_INFO,
+                                               GTK_BUTTONS_CLOSE,
+                                               "%s",
+                                               _("Scan Statistics"));
+    gtk_message_dialog_format_secondary_text(
+        GTK_MESSAGE_DIALOG(dialog),
+        "%s",
+        report ? report->str : _("No statistics available. They're collected when the database gets updated."));
+    gtk_window_set_title(GTK_WINDOW(dialog), "");
+    g_signal_connect(dialog, "response", G_CALLBACK(gtk_widget_destroy), NULL);
+    gtk_widget_show(dialog);
+}
+
+static void
+action_memory_statistics_activated(GSimpleAction *action, GVariant *parameter, gpointer app) {
+    g_assert(FSEARCH_IS_APPLICATION(app));
+    FsearchApplication *self = FSEARCH_APPLICATION(app);
+    FsearchApplicationWindow *window = get_first_application_window(self);
+    if (!window) {
+        return;
+    }
+
+    FsearchDatabaseMemoryStats stats;
+    db_memory_stats_init(&stats);
+    fsearch_application_state_lock(self);
+    if (self->db) {
+        db_lock(self->db);
+        db_get_memory_stats(self->db, &stats);
+        db_unlock(self->db);
+    }
+    fsearch_application_state_unlock(self);
+    for (GList *w = gtk_application_get_windows(GTK_APPLICATION(self)); w; w = w->next) {
+        if (FSEARCH_IS_APPLICATION_WINDOW(w->data)) {
+            fsearch_application_window_get_memory_stats(w->data, &stats);
+        }
+    }
+    g_autoptr(GString) report = db_memory_stats_to_string(&stats);
+    db_memory_stats_clear(&stats);
+
+    GtkWidget *dialog = gtk_message_dialog_new(GTK_WINDOW(window),
+                                               GTK_DIALOG_DESTROY_WITH_PARENT,
+                                               GTK_MESSAGE_INFO,
+                                               GTK_BUTTONS_CLOSE,
+                                               "%s",
+                                               _("Memory Statistics"));
+    gtk_message_dialog_format_secondary_text(GTK_MESSAGE_DIALOG(dialog), "%s", report->str);
+    gtk_window_set_title(GTK_WINDOW(dialog), "");
+    g_signal_connect(dialog, "response", G_CALLBACK(gtk_widget_destroy), NULL);
+    gtk_widget_show(dialog);
+}
+
 static void
 action_new_window_activated(GSimpleAction *action, GVariant *parameter, gpointer app) {
     GtkWindow *window = GTK_WINDOW(fsearch_application_window_new(FSEARCH_APPLICATION(app)));
@@ -549,6 +989,13 @@ fsearch_application_shutdown(GApplication *app) {
         fsearch->file_manager_watch_id = 0;
     }
 
+    index_auto_update_clear(fsearch);
+    g_clear_object(&fsearch->db_file_monitor);
+    if (fsearch->db_file_reload_timeout_id != 0) {
+        g_source_remove(fsearch->db_file_reload_timeout_id);
+        fsearch->db_file_reload_timeout_id = 0;
+    }
+
     if (fsearch->db_pool) {
         g_debug("[app] waiting for database thread to exit...");
         fsearch->is_shutting_down = true;
@@ -560,6 +1007,13 @@ fsearch_application_shutdown(GApplication *app) {
     // close the preview
     fsearch_preview_call_close();
 
+    g_clear_pointer(&fsearch->dbus_search, fsearch_dbus_search_free);
+    g_clear_pointer(&fsearch->db_monitor, db_monitor_free);
+    if (fsearch->db_save_changes_timeout_id != 0) {
+        g_source_remove(fsearch->db_save_changes_timeout_id);
+        fsearch->db_save_changes_timeout_id = 0;
+    }
+    database_save_changes(fsearch, true);
     g_clear_pointer(&fsearch->db, db_unref);
     g_clear_object(&fsearch->db_thread_cancellable);
 
@@ -573,6 +1027,27 @@ fsearch_application_shutdown(GApplication *app) {
     G_APPLICATION_CLASS(fsearch_application_parent_class)->shutdown(app);
 }
 
+static gboolean
+fsearch_application_dbus_register(GApplication *app,
+                                  GDBusConnection *connection,
+                                  const gchar *object_path,
+                                  GError **error) {
+    if (!G_APPLICATION_CLASS(fsearch_application_parent_class)->dbus_register(app, connection, object_path, error)) {
+        return FALSE;
+    }
+    FsearchApplication *fsearch = FSEARCH_APPLICATION(app);
+    g_clear_pointer(&fsearch->dbus_search, fsearch_dbus_search_free);
+    fsearch->dbus_search = fsearch_dbus_search_new(fsearch, connection, object_path);
+    return TRUE;
+}
+
+static void
+fsearch_application_dbus_unregister(GApplication *app, GDBusConnection *connection, const gchar *object_path) {
+    FsearchApplication *fsearch = FSEARCH_APPLICATION(app);
+    g_clear_pointer(&fsearch->dbus_search, fsearch_dbus_search_free);
+    G_APPLICATION_CLASS(fsearch_application_parent_class)->dbus_unregister(app, connection, object_path);
+}
+
 static void
 fsearch_application_finalize(GObject *object) {
     G_OBJECT_CLASS(fsearch_application_parent_class)->finalize(object);
@@ -682,6 +1157,7 @@ fsearch_application_startup(GApplication *app) {
 
     fsearch->db_pool = g_thread_pool_new(database_pool_func, app, 1, TRUE, NULL);
     fsearch->is_shutting_down = false;
+    database_file_monitor_init(fsearch);
 }
 
 static GActionEntry fsearch_app_entries[] = {
@@ -695,6 +1171,8 @@ static GActionEntry fsearch_app_entries[] = {
     {"forum", action_forum_activated, NULL, NULL, NULL},
     {"update_database", action_update_database_activated, NULL, NULL, NULL},
     {"cancel_update_database", action_cancel_update_database_activated, NULL, NULL, NULL},
+    {"scan_statistics", action_scan_statistics_activated, NULL, NULL, NULL},
+    {"memory_statistics", action_memory_statistics_activated, NULL, NULL, NULL},
     {"preferences", action_preferences_activated, "u", NULL, NULL},
     {"quit", action_quit_activated, NULL, NULL, NULL}};
 
@@ -830,8 +1308,20 @@ on_name_lost(GDBusConnection *connection, const gchar *name, gpointer user_data)
     }
 }
 
+static void
+print_database_memory_stats(FsearchDatabase *db) {
+    FsearchDatabaseMemoryStats stats;
+    db_memory_stats_init(&stats);
+    db_lock(db);
+    db_get_memory_stats(db, &stats);
+    db_unlock(db);
+    g_autoptr(GString) report = db_memory_stats_to_string(&stats);
+    db_memory_stats_clear(&stats);
+    g_print("%s\n", report->str);
+}
+
 static int
-database_scan_in_local_instance() {
+database_scan_in_local_instance(bool print_scan_stats, bool print_memory_stats) {
     FsearchConfig *config = calloc(1, sizeof(FsearchConfig));
     g_assert(config);
 
@@ -846,8 +1336,16 @@ database_scan_in_local_instance() {
     g_autoptr(GTimer) timer = g_timer_new();
     g_timer_start(timer);
 
+    fsearch_thread_pool_set_default_config(config->num_threads, config->pin_threads);
     FsearchDatabase *db =
         db_new(config->indexes, config->exclude_locations, config->exclude_files, config->exclude_hidden_items);
+    db_set_compress(db, config->compress_database);
+    db_set_lazy_sort_indexes(db, config->lazy_sort_indexes);
+    db_set_memory_budget(db, config_get_memory_budget(config));
+    db_set_trigram_index(db, config->trigram_index);
+    db_set_index_flags(db, config_get_index_flags(config));
+    db_set_num_scan_threads(db, config->num_scan_threads);
+    db_set_scan_timeouts(db, config->scan_timeout * 1000, config->scan_index_timeout * 1000);
 
     int res = EXIT_FAILURE;
     if (db_scan(db, NULL, NULL)) {
@@ -857,6 +1355,16 @@ database_scan_in_local_instance() {
         }
     }
 
+    FsearchDatabaseScanStats *scan_stats = print_scan_stats ? db_get_scan_stats(db) : NULL;
+    if (scan_stats) {
+        g_autoptr(GString) report = db_scan_stats_to_string(scan_stats);
+        g_print("%s\n", report->str);
+        g_clear_pointer(&scan_stats, db_scan_stats_unref);
+    }
+    if (print_memory_stats) {
+        print_database_memory_stats(db);
+    }
+
     g_clear_pointer(&db, db_unref);
     g_clear_pointer(&config, config_free);
 
@@ -874,7 +1382,273 @@ database_scan_in_local_instance() {
 }
 
 static int
-fsearch_application_local_database_scan() {
+database_load_memory_stats_in_local_instance(void) {
+    FsearchDatabase *db = db_new(NULL, NULL, NULL, false);
+    g_autofree char *db_file_path = fsearch_application_get_database_file_path();
+    const bool loaded = db_file_path && db_load(db, db_file_path, NULL);
+    if (loaded) {
+        print_database_memory_stats(db);
+    }
+    else {
+        g_printerr("[fsearch] failed to load the database\n");
+    }
+    g_clear_pointer(&db, db_unref);
+    return loaded ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+typedef struct {
+    GMutex mutex;
+    GCond cond;
+    bool search_finished;
+} FsearchQueryStatsContext;
+
+static void
+on_query_stats_view_notify(FsearchDatabaseView *view, FsearchDatabaseViewNotify id, gpointer user_data) {
+    FsearchQueryStatsContext *ctx = user_data;
+    if (id != DATABASE_VIEW_NOTIFY_SEARCH_FINISHED) {
+        return;
+    }
+    g_mutex_lock(&ctx->mutex);
+    ctx->search_finished = true;
+    g_cond_signal(&ctx->cond);
+    g_mutex_unlock(&ctx->mutex);
+}
+
+static FsearchQueryFlags
+get_query_flags_for_config(FsearchConfig *config) {
+    FsearchQueryFlags flags = 0;
+    if (config->match_case) {
+        flags |= QUERY_FLAG_MATCH_CASE;
+    }
+    if (config->auto_match_case) {
+        flags |= QUERY_FLAG_AUTO_MATCH_CASE;
+    }
+    if (config->enable_regex) {
+        flags |= QUERY_FLAG_REGEX;
+    }
+    if (config->search_in_path) {
+        flags |= QUERY_FLAG_SEARCH_IN_PATH;
+    }
+    if (config->auto_search_in_path) {
+        flags |= QUERY_FLAG_AUTO_SEARCH_IN_PATH;
+    }
+    return flags;
+}
+
+// Searches the saved database for search_term with the search options of the config, the way a window would, and
+// prints where the time of the search went as JSON
+static int
+database_query_stats_in_local_instance(const char *search_term) {
+    FsearchConfig *config = calloc(1, sizeof(FsearchConfig));
+    g_assert(config);
+    if (!config_load(config) && !config_load_default(config)) {
+        g_printerr("[fsearch] failed to load config\n");
+        g_clear_pointer(&config, config_free);
+        return EXIT_FAILURE;
+    }
+    fsearch_thread_pool_set_default_config(config->num_threads, config->pin_threads);
+
+    FsearchDatabase *db = db_new(NULL, NULL, NULL, false);
+    db_set_filter_by_access(db, config->system_database != NULL);
+    g_autofree char *db_file_path = database_get_file_path(config);
+    const bool loaded = db_file_path && db_load(db, db_file_path, NULL);
+    if (db_add_segments(db, config->database_segments) == 0 && !loaded) {
+        g_printerr("[fsearch] failed to load the database\n");
+        g_clear_pointer(&db, db_unref);
+        g_clear_pointer(&config, config_free);
+        return EXIT_FAILURE;
+    }
+
+    // the statistics are about the search, not about looking for the duplicates dupe: needs
+    FsearchQuery *query =
+        fsearch_query_new(search_term, NULL, config->filters, get_query_flags_for_config(config), "[stats]");
+    if (query->wants_duplicates) {
+        db_wait_for_duplicates(db);
+    }
+    g_clear_pointer(&query, fsearch_query_unref);
+
+    FsearchQueryStatsContext ctx = {};
+    g_mutex_init(&ctx.mutex);
+    g_cond_init(&ctx.cond);
+
+    FsearchDatabaseView *view = db_view_new(search_term,
+                                            get_query_flags_for_config(config),
+                                            NULL,
+                                            config->filters,
+                                            DATABASE_INDEX_TYPE_NAME,
+                                            GTK_SORT_ASCENDING,
+                                            on_query_stats_view_notify,
+                                            &ctx);
+    db_view_register_database(view, db);
+
+    g_mutex_lock(&ctx.mutex);
+    while (!ctx.search_finished) {
+        g_cond_wait(&ctx.cond, &ctx.mutex);
+    }
+    g_mutex_unlock(&ctx.mutex);
+
+    FsearchQueryStats stats = {};
+    db_view_lock(view);
+    db_view_get_query_stats(view, &stats);
+    db_view_unlock(view);
+    g_autoptr(GString) json = fsearch_query_stats_to_json(&stats, search_term);
+    g_print("%s\n", json->str);
+
+    g_clear_pointer(&view, db_view_unref);
+    g_clear_pointer(&db, db_unref);
+    g_clear_pointer(&config, config_free);
+    g_mutex_clear(&ctx.mutex);
+    g_cond_clear(&ctx.cond);
+    return EXIT_SUCCESS;
+}
+
+typedef struct {
+    FsearchPathWriter *writer;
+    GCancellable *cancellable;
+    uint32_t limit;
+    uint32_t num_printed;
+    uint32_t num_printed_folders;
+    uint32_t num_printed_files;
+} FsearchSearchPrintContext;
+
+// Prints the entries from start on, returns false once the limit is reached or the output can't be written anymore
+static bool
+search_print_entries(FsearchSearchPrintContext *ctx, DynamicArray *entries, uint32_t *start) {
+    const uint32_t num_entries = entries ? darray_get_num_items(entries) : 0;
+    for (; *start < num_entries; (*start)++) {
+        if ((ctx->limit && ctx->num_printed >= ctx->limit)
+            || !fsearch_path_writer_append(ctx->writer, darray_get_item(entries, *start))) {
+            g_cancellable_cancel(ctx->cancellable);
+            return false;
+        }
+        ctx->num_printed++;
+    }
+    return true;
+}
+
+static void
+search_print_result(FsearchSearchPrintContext *ctx, DatabaseSearchResult *result) {
+    // results are the folders followed by the files, partial ones only have files when all folders are known
+    if (search_print_entries(ctx, result->folders, &ctx->num_printed_folders)) {
+        search_print_entries(ctx, result->files, &ctx->num_printed_files);
+    }
+}
+
+static bool
+on_search_print_progress(DatabaseSearchResult *result, gpointer user_data) {
+    search_print_result(user_data, result);
+    // flush, so a reader sees the first results while the search is still running
+    fsearch_path_writer_flush(((FsearchSearchPrintContext *)user_data)->writer);
+    g_clear_pointer(&result->folders, darray_unref);
+    g_clear_pointer(&result->files, darray_unref);
+    g_clear_pointer(&result, free);
+    return true;
+}
+
+// Searches the saved database for search_term with the search options of the config and prints the paths of the
+// results in the order of their names, each followed by separator. Results are printed while the search runs.
+static int
+database_search_in_local_instance(const char *search_term, char separator, uint32_t limit) {
+    FsearchConfig *config = calloc(1, sizeof(FsearchConfig));
+    g_assert(config);
+    if (!config_load(config) && !config_load_default(config)) {
+        g_printerr("[fsearch] failed to load config\n");
+        g_clear_pointer(&config, config_free);
+        return EXIT_FAILURE;
+    }
+    fsearch_thread_pool_set_default_config(config->num_threads, config->pin_threads);
+
+    FsearchDatabase *db = db_new(NULL, NULL, NULL, false);
+    // a system wide database holds entries the user might not be allowed to list
+    db_set_filter_by_access(db, config->system_database != NULL);
+    g_autofree char *db_file_path = database_get_file_path(config);
+    if (!db_file_path || !db_load(db, db_file_path, NULL)) {
+        g_printerr("[fsearch] failed to load the database\n");
+        g_clear_pointer(&db, db_unref);
+        g_clear_pointer(&config, config_free);
+        return EXIT_FAILURE;
+    }
+
+    // a reader which quits early (e.g. head) makes writing fail, which stops the search
+    signal(SIGPIPE, SIG_IGN);
+    g_autoptr(GCancellable) cancellable = g_cancellable_new();
+    FsearchSearchPrintContext ctx = {
+        .writer = fsearch_path_writer_new(STDOUT_FILENO, separator),
+        .cancellable = cancellable,
+        .limit = limit,
+    };
+
+    FsearchQuery *query =
+        fsearch_query_new(search_term, NULL, config->filters, get_query_flags_for_config(config), "[cli]");
+    // the first limit folders and files are enough to know the first limit results
+    query->limit = limit;
+    if (query->wants_duplicates) {
+        db_wait_for_duplicates(db);
+    }
+
+    db_lock_shared(db);
+    FsearchDatabaseIndexType sort_order = DATABASE_INDEX_TYPE_NAME;
+    DynamicArray *folders = NULL;
+    DynamicArray *files = NULL;
+    db_get_entries_sorted(db, DATABASE_INDEX_TYPE_NAME, &sort_order, &folders, &files);
+    if (fsearch_query_matches_everything(query)) {
+        DatabaseSearchResult *result = db_search_empty(folders, files, sort_order);
+        db_filter_result_by_access(db, result);
+        search_print_result(&ctx, result);
+        g_clear_pointer(&result->folders, darray_unref);
+        g_clear_pointer(&result->files, darray_unref);
+        g_clear_pointer(&result, free);
+    }
+    else {
+        DatabaseSearchResult *result = db_search_query(db,
+                                                       query,
+                                                       db_get_thread_pool(db),
+                                                       folders,
+                                                       files,
+                                                       sort_order,
+                                                       false,
+                                                       on_search_print_progress,
+                                                       &ctx,
+                                                       cancellable);
+        if (result) {
+            search_print_result(&ctx, result);
+            g_clear_pointer(&result->folders, darray_unref);
+            g_clear_pointer(&result->files, darray_unref);
+            g_clear_pointer(&result, free);
+        }
+    }
+    db_unlock_shared(db);
+    g_clear_pointer(&folders, darray_unref);
+    g_clear_pointer(&files, darray_unref);
+
+    fsearch_path_writer_flush(ctx.writer);
+    g_clear_pointer(&ctx.writer, fsearch_path_writer_free);
+    g_clear_pointer(&query, fsearch_query_unref);
+    g_clear_pointer(&db, db_unref);
+    g_clear_pointer(&config, config_free);
+    return EXIT_SUCCESS;
+}
+
+// Serves searches over a unix socket until the process gets SIGINT or SIGTERM
+static int
+database_daemon_in_local_instance(const char *socket_path) {
+    FsearchConfig *config = calloc(1, sizeof(FsearchConfig));
+    g_assert(config);
+    if (!config_load(config) && !config_load_default(config)) {
+        g_printerr("[fsearch] failed to load config\n");
+        g_clear_pointer(&config, config_free);
+        return EXIT_FAILURE;
+    }
+
+    g_autofree char *default_socket_path = socket_path ? NULL : fsearch_daemon_get_default_socket_path();
+    g_autofree char *db_file_path = database_get_file_path(config);
+    const int res = fsearch_daemon_run(config, db_file_path, socket_path ? socket_path : default_socket_path);
+    g_clear_pointer(&config, config_free);
+    return res;
+}
+
+static int
+fsearch_application_local_database_scan(bool print_scan_stats, bool print_memory_stats) {
     // First detect if the another instance of fsearch is already registered
     // If yes, trigger update there, so the UI is aware of the update and can display its progress
     FsearchApplicationDatabaseWorker worker_ctx = {};
@@ -892,18 +1666,50 @@ fsearch_application_local_database_scan() {
 
     if (worker_ctx.update_called_on_primary) {
         // triggered update in primary instance, we're done here
+        if (print_scan_stats || print_memory_stats) {
+            g_printerr("[fsearch] database update runs in the running instance, its statistics are available there\n");
+        }
         return 0;
     }
     else {
         // no primary instance found, perform update
-        return database_scan_in_local_instance();
+        return database_scan_in_local_instance(print_scan_stats, print_memory_stats);
     }
 }
 
 static gint
 fsearch_application_handle_local_options(GApplication *application, GVariantDict *options) {
     if (g_variant_dict_contains(options, "update-database")) {
-        return fsearch_application_local_database_scan();
+        return fsearch_application_local_database_scan(g_variant_dict_contains(options, "scan-stats"),
+                                                       g_variant_dict_contains(options, "memory-stats"));
+    }
+    if (g_variant_dict_contains(options, "memory-stats")) {
+        return database_load_memory_stats_in_local_instance();
+    }
+    if (g_variant_dict_contains(options, "query-stats")) {
+        const gchar *search_term = NULL;
+        if (!g_variant_dict_lookup(options, "search", "&s", &search_term)) {
+            g_printerr("[fsearch] --query-stats needs the pattern to search for with --search\n");
+            return EXIT_FAILURE;
+        }
+        return database_query_stats_in_local_instance(search_term);
+    }
+    if (g_variant_dict_contains(options, "print") || g_variant_dict_contains(options, "print0")) {
+        const gchar *search_term = NULL;
+        if (!g_variant_dict_lookup(options, "search", "&s", &search_term)) {
+            g_printerr("[fsearch] --print needs the pattern to search for with --search\n");
+            return EXIT_FAILURE;
+        }
+        gint limit = 0;
+        g_variant_dict_lookup(options, "limit", "i", &limit);
+        return database_search_in_local_instance(search_term,
+                                                 g_variant_dict_contains(options, "print0") ? '\0' : '\n',
+                                                 (uint32_t)MAX(limit, 0));
+    }
+    if (g_variant_dict_contains(options, "daemon")) {
+        const gchar *socket_path = NULL;
+        g_variant_dict_lookup(options, "socket", "&s", &socket_path);
+        return database_daemon_in_local_instance(socket_path);
     }
     if (g_variant_dict_contains(options, "version")) {
         g_autoptr(GString) version = get_application_version();
@@ -921,6 +1727,35 @@ fsearch_application_add_option_entries(FsearchApplication *self) {
         {"preferences", 0, 0, G_OPTION_ARG_NONE, NULL, N_("Show the application preferences")},
         {"search", 's', 0, G_OPTION_ARG_STRING, NULL, N_("Set the search pattern"), "PATTERN"},
         {"update-database", 'u', 0, G_OPTION_ARG_NONE, NULL, N_("Update the database and exit")},
+        {"scan-stats", 0, 0, G_OPTION_ARG_NONE, NULL, N_("Print scan statistics after updating the database")},
+        {"memory-stats",
+         0,
+         0,
+         G_OPTION_ARG_NONE,
+         NULL,
+         N_("Print the memory used by the database after loading or updating it")},
+        {"query-stats",
+         0,
+         0,
+         G_OPTION_ARG_NONE,
+         NULL,
+         N_("Print how long the search for the pattern of --search takes as JSON and exit")},
+        {"print", 0, 0, G_OPTION_ARG_NONE, NULL, N_("Print the paths of the results of --search and exit")},
+        {"print0",
+         0,
+         0,
+         G_OPTION_ARG_NONE,
+         NULL,
+         N_("Print the paths of the results of --search separated by NUL characters and exit")},
+        {"limit", 0, 0, G_OPTION_ARG_INT, NULL, N_("Print at most the first N results"), "N"},
+        {"daemon", 0, 0, G_OPTION_ARG_NONE, NULL, N_("Serve searches over a unix socket without a window")},
+        {"socket",
+         0,
+         0,
+         G_OPTION_ARG_STRING,
+         NULL,
+         N_("The socket of --daemon, $XDG_RUNTIME_DIR/fsearch/fsearch.sock by default"),
+         "PATH"},
         {"version", 'v', 0, G_OPTION_ARG_NONE, NULL, N_("Print version information and exit")},
         {NULL}};
 
@@ -954,6 +1789,8 @@ fsearch_application_class_init(FsearchApplicationClass *klass) {
     g_app_class->shutdown = fsearch_application_shutdown;
     g_app_class->command_line = fsearch_application_command_line;
     g_app_class->handle_local_options = fsearch_application_handle_local_options;
+    g_app_class->dbus_register = fsearch_application_dbus_register;
+    g_app_class->dbus_unregister = fsearch_application_dbus_unregister;
 
     gtk_app_class->window_added = fsearch_application_win_added;
     gtk_app_class->window_removed = fsearch_application_win_removed;
@@ -1011,7 +1848,13 @@ fsearch_application_get_db_state(FsearchApplication *fsearch) {
 uint32_t
 fsearch_application_get_num_db_entries(FsearchApplication *fsearch) {
     g_assert(FSEARCH_IS_APPLICATION(fsearch));
-    return fsearch->db ? db_get_num_entries(fsearch->db) : 0;
+    if (!fsearch->db) {
+        return 0;
+    }
+    FsearchDatabaseVersion *version = db_pin_version(fsearch->db);
+    const uint32_t num_entries = version->num_folders + version->num_files;
+    g_clear_pointer(&version, db_version_unref);
+    return num_entries;
 }
 
 FsearchDatabase *
@@ -0,0 +1,104 @@
+#include "fsearch_access_filter.h"
+#include "fsearch_database_entry.h"
+
+#include <glib.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+struct FsearchAccessFilter {
+    // the folders which were checked, mapped to FOLDER_LISTABLE or FOLDER_HIDDEN
+    GHashTable *folders;
+    GString *path;
+    GMutex mutex;
+};
+
+enum {
+    FOLDER_LISTABLE = 1,
+    FOLDER_HIDDEN,
+};
+
+FsearchAccessFilter *
+fsearch_access_filter_new(void) {
+    FsearchAccessFilter *filter = calloc(1, sizeof(FsearchAccessFilter));
+    g_assert(filter);
+    filter->folders = g_hash_table_new(g_direct_hash, g_direct_equal);
+    filter->path = g_string_sized_new(256);
+    g_mutex_init(&filter->mutex);
+    return filter;
+}
+
+void
+fsearch_access_filter_free(FsearchAccessFilter *filter) {
+    if (!filter) {
+        return;
+    }
+    g_clear_pointer(&filter->folders, g_hash_table_unref);
+    g_string_free(g_steal_pointer(&filter->path), TRUE);
+    g_mutex_clear(&filter->mutex);
+    g_clear_pointer(&filter, free);
+}
+
+void
+fsearch_access_filter_clear(FsearchAccessFilter *filter) {
+    g_assert(filter);
+    g_mutex_lock(&filter->mutex);
+    g_hash_table_remove_all(filter->folders);
+    g_mutex_unlock(&filter->mutex);
+}
+
+// A folder can be listed if it and all folders above can be read and searched. access() alone only requires the ones
+// above to be searchable, but the paths of the entries in a folder which can't be read would still reveal its
+// contents. Must be called with the mutex held.
+static bool
+folder_is_listable(FsearchAccessFilter *filter, FsearchDatabaseEntryFolder *folder) {
+    const int state = GPOINTER_TO_INT(g_hash_table_lookup(filter->folders, folder));
+    if (state != 0) {
+        return state == FOLDER_LISTABLE;
+    }
+    FsearchDatabaseEntryFolder *parent = db_entry_get_parent((FsearchDatabaseEntry *)folder);
+    bool listable = !parent || folder_is_listable(filter, parent);
+    if (listable) {
+        g_string_truncate(filter->path, 0);
+        db_entry_append_full_path((FsearchDatabaseEntry *)folder, filter->path);
+        listable = access(filter->path->str, R_OK | X_OK) == 0;
+    }
+    g_hash_table_insert(filter->folders, folder, GINT_TO_POINTER(listable ? FOLDER_LISTABLE : FOLDER_HIDDEN));
+    return listable;
+}
+
+// Must be called with the mutex held
+static bool
+is_visible(FsearchAccessFilter *filter, FsearchDatabaseEntry *entry) {
+    FsearchDatabaseEntryFolder *parent = db_entry_get_parent(entry);
+    return !parent || folder_is_listable(filter, parent);
+}
+
+DynamicArray *
+fsearch_access_filter_apply(FsearchAccessFilter *filter, DynamicArray *entries) {
+    g_assert(filter);
+    if (!entries) {
+        return NULL;
+    }
+
+    const uint32_t num_entries = darray_get_num_items(entries);
+    DynamicArray *visible_entries = NULL;
+
+    g_mutex_lock(&filter->mutex);
+    for (uint32_t i = 0; i < num_entries; i++) {
+        FsearchDatabaseEntry *entry = darray_get_item(entries, i);
+        const bool visible = is_visible(filter, entry);
+        if (!visible && !visible_entries) {
+            // the entries before are all visible
+            visible_entries = darray_new(num_entries);
+            for (uint32_t j = 0; j < i; j++) {
+                darray_add_item(visible_entries, darray_get_item(entries, j));
+            }
+        }
+        else if (visible && visible_entries) {
+            darray_add_item(visible_entries, entry);
+        }
+    }
+    g_mutex_unlock(&filter->mutex);
+
+    return visible_entries ? visible_entries : darray_ref(entries);
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "fsearch_array.h"
+
+// Hides the entries the user can't list from results, i.e. the ones in folders they lack read or search permission
+// for (or which are below such folders). This matters for databases which were scanned by someone else, e.g. a
+// system wide one. Whether a folder can be listed is only checked once, until fsearch_access_filter_clear drops
+// what was checked. It can be used by several threads at the same time.
+typedef struct FsearchAccessFilter FsearchAccessFilter;
+
+FsearchAccessFilter *
+fsearch_access_filter_new(void);
+
+void
+fsearch_access_filter_free(FsearchAccessFilter *filter);
+
+// Forgets which folders can be listed, e.g. because the database changed and their permissions might have as well
+void
+fsearch_access_filter_clear(FsearchAccessFilter *filter);
+
+// Returns the entries of entries which the user can see, in the same order. That's a new reference of entries if
+// all of them can be seen.
+DynamicArray *
+fsearch_access_filter_apply(FsearchAccessFilter *filter, DynamicArray *entries);
@@ -19,25 +19,87 @@
 #define G_LOG_DOMAIN "fsearch-dynamic-array"
 
 #include "fsearch_array.h"
+#include "fsearch_thread_pool.h"
 #include <glib.h>
-#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/param.h>
 
 #define MAX_SORT_THREADS 8
+// the least number of items each run of darray_sort_multi_threaded gets
+#define SORT_MIN_ITEMS_PER_RUN 16384
+// the runs are split into parts at samples of their items
+#define SORT_SAMPLES_PER_RUN 64
+// how many items are merged between checks for cancellation and progress reports
+#define SORT_CHECK_INTERVAL 65536
+// darray_sort_by_key sorts by one byte of the keys after another
+#define RADIX_SORT_BUCKETS 256
+#define RADIX_SORT_PASSES 8
+// the least number of items each thread of darray_sort_by_key gets
+#define RADIX_SORT_MIN_ITEMS_PER_THREAD 65536
+// runs of items with the same key which are longer than that are sorted by all threads together
+#define RADIX_SORT_MAX_TIE_ITEMS_PER_THREAD 65536
+
+// The allocated items, which copies and slices of an array share until one of them gets changed
+typedef struct DynamicArrayBuffer {
+    void **items;
+    volatile int ref_count;
+} DynamicArrayBuffer;
 
 struct DynamicArray {
     // number of items in array
     uint32_t num_items;
     // total size of array
     uint32_t max_items;
-    // data
+    // data, points into buffer->items
     void **data;
+    // NULL for the temporary views of the sort functions, which change the items of another array in place
+    DynamicArrayBuffer *buffer;
 
     volatile int ref_count;
 };
 
+static DynamicArrayBuffer *
+darray_buffer_new(size_t num_items) {
+    DynamicArrayBuffer *buffer = calloc(1, sizeof(DynamicArrayBuffer));
+    g_assert(buffer);
+    buffer->items = calloc(MAX(num_items, 1), sizeof(void *));
+    g_assert(buffer->items);
+    buffer->ref_count = 1;
+    return buffer;
+}
+
+static void
+darray_buffer_unref(DynamicArrayBuffer *buffer) {
+    if (buffer && g_atomic_int_dec_and_test(&buffer->ref_count)) {
+        g_clear_pointer(&buffer->items, free);
+        g_clear_pointer(&buffer, free);
+    }
+}
+
+// Gives array its own items, which start at its buffer, before it gets changed. The items are only copied over if
+// keep_items is set, otherwise the caller is going to overwrite all of them.
+static void
+darray_make_writable(DynamicArray *array, bool keep_items) {
+    if (!array->buffer || (array->data == array->buffer->items && g_atomic_int_get(&array->buffer->ref_count) == 1)) {
+        return;
+    }
+    DynamicArrayBuffer *buffer = darray_buffer_new(array->max_items);
+    if (keep_items) {
+        memcpy(buffer->items, array->data, array->num_items * sizeof(void *));
+    }
+    g_clear_pointer(&array->buffer, darray_buffer_unref);
+    array->buffer = buffer;
+    array->data = buffer->items;
+}
+
+static DynamicArray *
+new_array_from_data(void **data, uint32_t num_items) {
+    DynamicArray *array = darray_new(num_items);
+    darray_add_items(array, data, num_items);
+    return array;
+}
+
 static void
 darray_free(DynamicArray *array) {
     if (array == NULL) {
@@ -46,7 +108,8 @@ darray_free(DynamicArray *array) {
 
     g_debug("[darray_free] freed");
 
-    g_clear_pointer(&array->data, free);
+    array->data = NULL;
+    g_clear_pointer(&array->buffer, darray_buffer_unref);
     g_clear_pointer(&array, free);
 }
 
@@ -71,15 +134,53 @@ darray_unref(DynamicArray *array) {
     }
 }
 
+// Shared by the threads of darray_sort_multi_threaded_with_progress
 typedef struct {
-    DynamicArray *m1;
-    DynamicArray *m2;
-    DynamicArray *dest;
-    gpointer user_data;
-    DynamicArrayCompareDataFunc comp_func;
+    DynamicArrayProgressFunc func;
+    void *func_data;
+    GMutex mutex;
+    // every item is merged once per level of the merge sort of its run and once more when the runs are merged
+    uint64_t num_merged;
+    uint64_t num_to_merge;
+    uint32_t percent;
+} DynamicArraySortProgress;
 
+typedef struct {
+    DynamicArrayCompareDataFunc comp_func;
+    void *comp_data;
+    GCancellable *cancellable;
+    // optional, shared by all threads of the sort
+    DynamicArraySortProgress *progress;
+    // the merged items which weren't added to progress yet
+    uint64_t num_unreported;
 } DynamicArraySortContext;
 
+static bool
+sort_is_cancelled(DynamicArraySortContext *ctx) {
+    return ctx->cancellable && g_cancellable_is_cancelled(ctx->cancellable);
+}
+
+static void
+sort_add_progress(DynamicArraySortContext *ctx, uint64_t num_merged) {
+    DynamicArraySortProgress *progress = ctx->progress;
+    if (!progress) {
+        return;
+    }
+    ctx->num_unreported += num_merged;
+    if (ctx->num_unreported < SORT_CHECK_INTERVAL) {
+        return;
+    }
+    g_mutex_lock(&progress->mutex);
+    progress->num_merged += ctx->num_unreported;
+    ctx->num_unreported = 0;
+    const uint32_t percent = (uint32_t)MIN(progress->num_merged * 100 / MAX(progress->num_to_merge, 1), 100);
+    if (percent > progress->percent) {
+        progress->percent = percent;
+        progress->func(percent, progress->func_data);
+    }
+    g_mutex_unlock(&progress->mutex);
+}
+
 static void
 insertion_sort(DynamicArray *array, DynamicArrayCompareDataFunc comp_func, void *data) {
     for (uint32_t i = 0; i < array->num_items; ++i) {
@@ -99,10 +200,8 @@ merge(DynamicArray *src,
       uint32_t start_idx,
       uint32_t center_idx,
       uint32_t end_idx,
-      GCancellable *cancellable,
-      DynamicArrayCompareDataFunc comp_func,
-      gpointer comp_data) {
-    if (cancellable && g_cancellable_is_cancelled(cancellable)) {
+      DynamicArraySortContext *ctx) {
+    if (sort_is_cancelled(ctx)) {
         return;
     }
 
@@ -110,7 +209,11 @@ merge(DynamicArray *src,
     uint32_t j = center_idx;
 
     for (uint32_t k = start_idx; k < end_idx; k++) {
-        if (i < center_idx && (j >= end_idx || comp_func(&src->data[i], &src->data[j], comp_data) < 1)) {
+        // the merges at the top take long enough to check in between
+        if ((k - start_idx) % SORT_CHECK_INTERVAL == SORT_CHECK_INTERVAL - 1 && sort_is_cancelled(ctx)) {
+            return;
+        }
+        if (i < center_idx && (j >= end_idx || ctx->comp_func(&src->data[i], &src->data[j], ctx->comp_data) < 1)) {
             dest->data[k] = src->data[i];
             i = i + 1;
         }
@@ -119,83 +222,27 @@ merge(DynamicArray *src,
             j = j + 1;
         }
     }
+    sort_add_progress(ctx, end_idx - start_idx);
 }
 
 static void
-split_merge(DynamicArray *src,
-            DynamicArray *dest,
-            uint32_t start_idx,
-            uint32_t end_idx,
-            GCancellable *cancellable,
-            DynamicArrayCompareDataFunc comp_func,
-            gpointer comp_data) {
+split_merge(DynamicArray *src, DynamicArray *dest, uint32_t start_idx, uint32_t end_idx, DynamicArraySortContext *ctx) {
     if (end_idx - 1 <= start_idx) {
         return;
     }
-    if (cancellable && g_cancellable_is_cancelled(cancellable)) {
+    if (sort_is_cancelled(ctx)) {
         return;
     }
 
     uint32_t center_idx = (end_idx + start_idx) / 2;
-    split_merge(dest, src, start_idx, center_idx, cancellable, comp_func, comp_data);
-    split_merge(dest, src, center_idx, end_idx, cancellable, comp_func, comp_data);
-    merge(src, dest, start_idx, center_idx, end_idx, cancellable, comp_func, comp_data);
-}
-
-static void
-merge_sort(DynamicArray *to_sort,
-           DynamicArray *tmp,
-           GCancellable *cancellable,
-           DynamicArrayCompareDataFunc comp_func,
-           gpointer comp_data) {
-    split_merge(tmp, to_sort, 0, to_sort->num_items, cancellable, comp_func, comp_data);
-}
-
-static void
-sort_thread(gpointer data, gpointer user_data) {
-    DynamicArraySortContext *ctx = data;
-    DynamicArray *tmp = darray_copy(ctx->dest);
-    merge_sort(ctx->dest, tmp, user_data, (DynamicArrayCompareDataFunc)ctx->comp_func, ctx->user_data);
-    g_clear_pointer(&tmp, darray_unref);
+    split_merge(dest, src, start_idx, center_idx, ctx);
+    split_merge(dest, src, center_idx, end_idx, ctx);
+    merge(src, dest, start_idx, center_idx, end_idx, ctx);
 }
 
 static void
-merge_thread(gpointer data, gpointer user_data) {
-    DynamicArraySortContext *ctx = data;
-    int i = 0;
-    int j = 0;
-    const uint32_t n1 = ctx->m1->num_items;
-    const uint32_t n2 = ctx->m2->num_items;
-
-    while (true) {
-        void *d1 = darray_get_item(ctx->m1, i);
-        void *d2 = darray_get_item(ctx->m2, j);
-
-        if (i < n1 && j < n2) {
-            const int res = ctx->comp_func(&d1, &d2, user_data);
-            if (res <= 0) {
-                darray_add_item(ctx->dest, d1);
-                i++;
-            }
-            else {
-                darray_add_item(ctx->dest, d2);
-                j++;
-            }
-        }
-        else {
-            if (i < n1) {
-                darray_add_items(ctx->dest, &ctx->m1->data[i], ctx->m1->num_items - i);
-                return;
-            }
-            else if (j < n2) {
-                darray_add_items(ctx->dest, &ctx->m2->data[j], ctx->m2->num_items - j);
-                return;
-            }
-            else {
-                return;
-            }
-        }
-    }
+merge_sort(DynamicArray *to_sort, DynamicArray *tmp, DynamicArraySortContext *ctx) {
+    split_merge(tmp, to_sort, 0, to_sort->num_items, ctx);
 }
 
 DynamicArray *
@@ -206,8 +253,8 @@ darray_new(size_t num_items) {
     new->max_items = num_items;
     new->num_items = 0;
 
-    new->data = calloc(num_items, sizeof(void *));
-    g_assert(new->data);
+    new->buffer = darray_buffer_new(num_items);
+    new->data = new->buffer->items;
 
     new->ref_count = 1;
 
@@ -218,15 +265,17 @@ static void
 darray_expand(DynamicArray *array, size_t min) {
     g_assert(array);
     g_assert(array->data);
+    g_assert(array->buffer);
 
     const size_t old_max_items = array->max_items;
     const size_t expand_rate = MAX(array->max_items / 2, min - old_max_items);
     array->max_items += expand_rate;
 
-    void *new_data = realloc(array->data, array->max_items * sizeof(void *));
+    void *new_data = realloc(array->buffer->items, array->max_items * sizeof(void *));
     g_assert(new_data);
+    array->buffer->items = new_data;
     array->data = new_data;
-    memset(array->data + old_max_items, 0, expand_rate + 1);
+    memset(array->data + old_max_items, 0, expand_rate * sizeof(void *));
 }
 
 void
@@ -235,6 +284,7 @@ darray_add_items(DynamicArray *array, void **items, uint32_t num_items) {
     g_assert(array->data);
     g_assert(items);
 
+    darray_make_writable(array, true);
     if (array->num_items + num_items > array->max_items) {
         darray_expand(array, array->num_items + num_items);
     }
@@ -243,12 +293,24 @@ darray_add_items(DynamicArray *array, void **items, uint32_t num_items) {
     array->num_items += num_items;
 }
 
+void
+darray_add_array(DynamicArray *dest, DynamicArray *source) {
+    g_assert(dest);
+    g_assert(source);
+
+    if (source->num_items == 0) {
+        return;
+    }
+    darray_add_items(dest, source->data, source->num_items);
+}
+
 void
 darray_add_item(DynamicArray *array, void *data) {
     g_assert(array);
     g_assert(array->data);
     // g_assert(data );
 
+    darray_make_writable(array, true);
     if (array->num_items >= array->max_items) {
         darray_expand(array, array->num_items + 1);
     }
@@ -324,65 +386,210 @@ darray_get_size(DynamicArray *array) {
     return array->max_items;
 }
 
-static DynamicArray *
-new_array_from_data(void **data, uint32_t num_items) {
-    DynamicArray *array = darray_new(num_items);
-    darray_add_items(array, data, num_items);
-    return array;
+// Takes ownership of items, which replace those of array
+static void
+darray_take_items(DynamicArray *array, void **items, uint32_t num_items) {
+    if (!array->buffer) {
+        // a view into another array, whose items have to stay where they are
+        memcpy(array->data, items, num_items * sizeof(void *));
+        free(items);
+        return;
+    }
+    DynamicArrayBuffer *buffer = calloc(1, sizeof(DynamicArrayBuffer));
+    g_assert(buffer);
+    buffer->items = items;
+    buffer->ref_count = 1;
+    g_clear_pointer(&array->buffer, darray_buffer_unref);
+    array->buffer = buffer;
+    array->data = items;
+    array->num_items = num_items;
+    array->max_items = num_items;
 }
 
-static GArray *
-merge_sorted(GArray *merge_me, DynamicArrayCompareDataFunc comp_func, GCancellable *cancellable) {
-    if (merge_me->len == 1) {
-        return merge_me;
-    }
-    if (cancellable && g_cancellable_is_cancelled(cancellable)) {
-        return merge_me;
+// What one task of darray_sort_multi_threaded_with_progress works on: first one of the runs the items are split into
+// and then one part of the result, which gets merged from all runs
+typedef struct {
+    DynamicArraySortContext ctx;
+    uint32_t idx;
+    uint32_t num_runs;
+    void **src;
+    void **dest;
+    // the runs start at splits[0], the part each task merges starts at splits[idx] and ends at splits[idx + 1],
+    // one position for every run
+    uint32_t **splits;
+} DynamicArraySortTask;
+
+// A position in a run, to find the parts the runs are split into
+typedef struct {
+    void **item;
+    uint32_t run;
+    uint32_t pos;
+} DynamicArraySortSample;
+
+// The comparators never say two items are equal, they only tell whether the second one goes before the first. To
+// sort stable the item of the earlier run always has to be the first one, like the items of the left half in merge.
+static bool
+sort_goes_before(DynamicArraySortContext *ctx, void **a, uint32_t run_a, void **b, uint32_t run_b) {
+    if (run_a <= run_b) {
+        return ctx->comp_func(a, b, ctx->comp_data) < 1;
     }
-    const uint32_t num_threads = merge_me->len / 2;
-
-    g_debug("[sort] merge with %d thread(s)", num_threads);
-
-    GArray *merged_data = g_array_sized_new(TRUE, TRUE, sizeof(DynamicArraySortContext), num_threads);
-    GThreadPool *merge_pool = g_thread_pool_new(merge_thread, NULL, (gint)num_threads, FALSE, NULL);
-
-    for (int i = 0; i < num_threads; ++i) {
-        DynamicArraySortContext *c1 = &g_array_index(merge_me, DynamicArraySortContext, 2 * i);
-        DynamicArraySortContext *c2 = &g_array_index(merge_me, DynamicArraySortContext, 2 * i + 1);
-        DynamicArray *i1 = c1->dest;
-        DynamicArray *i2 = c2->dest;
+    return ctx->comp_func(b, a, ctx->comp_data) > 0;
+}
 
-        DynamicArraySortContext merge_ctx = {};
-        merge_ctx.m1 = i1;
-        merge_ctx.m2 = i2;
-        merge_ctx.comp_func = comp_func;
-        merge_ctx.dest = darray_new(i1->num_items + i2->num_items);
+static int32_t
+sort_compare_samples(DynamicArraySortSample **a, DynamicArraySortSample **b, DynamicArraySortContext *ctx) {
+    const DynamicArraySortSample *s1 = *a;
+    const DynamicArraySortSample *s2 = *b;
+    if (s1->run == s2->run) {
+        return s1->pos < s2->pos ? -1 : 1;
+    }
+    return sort_goes_before(ctx, s1->item, s1->run, s2->item, s2->run) ? -1 : 1;
+}
 
-        g_array_insert_val(merged_data, i, merge_ctx);
+static void
+sort_run_thread(void *data) {
+    DynamicArraySortTask *task = data;
+    const uint32_t start = task->splits[0][task->idx];
+    const uint32_t num_items = task->splits[task->num_runs][task->idx] - start;
+    // the run is sorted in src, dest is only needed for the merges in between
+    memcpy(task->dest + start, task->src + start, num_items * sizeof(void *));
+    DynamicArray run = {.num_items = num_items, .max_items = num_items, .data = task->src + start, .ref_count = 1};
+    DynamicArray tmp = {.num_items = num_items, .max_items = num_items, .data = task->dest + start, .ref_count = 1};
+    if (num_items < 64) {
+        insertion_sort(&run, task->ctx.comp_func, task->ctx.comp_data);
+        return;
+    }
+    merge_sort(&run, &tmp, &task->ctx);
+}
 
-        g_thread_pool_push(merge_pool, &g_array_index(merged_data, DynamicArraySortContext, i), NULL);
+static void
+sort_heap_sift_down(DynamicArraySortTask *task, uint32_t *heap, uint32_t num_heap, const uint32_t *pos, uint32_t i) {
+    while (true) {
+        uint32_t first = i;
+        for (uint32_t child = 2 * i + 1; child <= 2 * i + 2 && child < num_heap; child++) {
+            void **first_item = &task->src[pos[heap[first]]];
+            void **child_item = &task->src[pos[heap[child]]];
+            if (!sort_goes_before(&task->ctx, first_item, heap[first], child_item, heap[child])) {
+                first = child;
+            }
+        }
+        if (first == i) {
+            return;
+        }
+        const uint32_t run = heap[i];
+        heap[i] = heap[first];
+        heap[first] = run;
+        i = first;
     }
+}
 
-    g_thread_pool_free(g_steal_pointer(&merge_pool), FALSE, TRUE);
+static void
+sort_merge_thread(void *data) {
+    DynamicArraySortTask *task = data;
+    uint32_t pos[MAX_SORT_THREADS] = {};
+    uint32_t end[MAX_SORT_THREADS] = {};
+    uint32_t heap[MAX_SORT_THREADS] = {};
+    uint32_t num_heap = 0;
+    uint32_t k = 0;
+    for (uint32_t run = 0; run < task->num_runs; run++) {
+        pos[run] = task->splits[task->idx][run];
+        end[run] = task->splits[task->idx + 1][run];
+        // the part starts after the items which go before it in all runs
+        k += pos[run] - task->splits[0][run];
+    }
+    // a heap of the runs which have items left, ordered by their next item
+    for (uint32_t run = 0; run < task->num_runs; run++) {
+        if (pos[run] < end[run]) {
+            heap[num_heap++] = run;
+        }
+    }
+    for (uint32_t i = num_heap / 2; i-- > 0;) {
+        sort_heap_sift_down(task, heap, num_heap, pos, i);
+    }
 
-    for (int i = 0; i < merge_me->len; i++) {
-        DynamicArraySortContext *c = &g_array_index(merge_me, DynamicArraySortContext, i);
-        if (c && c->dest) {
-            g_clear_pointer(&c->dest, darray_free);
+    const uint32_t start = k;
+    while (num_heap > 0) {
+        if ((k - start) % SORT_CHECK_INTERVAL == SORT_CHECK_INTERVAL - 1) {
+            if (sort_is_cancelled(&task->ctx)) {
+                return;
+            }
+            sort_add_progress(&task->ctx, SORT_CHECK_INTERVAL);
+        }
+        const uint32_t run = heap[0];
+        task->dest[k++] = task->src[pos[run]++];
+        if (pos[run] == end[run]) {
+            heap[0] = heap[--num_heap];
         }
+        sort_heap_sift_down(task, heap, num_heap, pos, 0);
     }
+}
 
-    return merge_sorted(merged_data, comp_func, cancellable);
+// The index of the first item in [start, end) of run which doesn't go before the one of sample
+static uint32_t
+sort_find_split(DynamicArraySortContext *ctx,
+                void **src,
+                uint32_t run,
+                uint32_t start,
+                uint32_t end,
+                const DynamicArraySortSample *sample) {
+    if (run == sample->run) {
+        return sample->pos;
+    }
+    while (start < end) {
+        const uint32_t center = start + (end - start) / 2;
+        if (sort_goes_before(ctx, &src[center], run, sample->item, sample->run)) {
+            start = center + 1;
+        }
+        else {
+            end = center;
+        }
+    }
+    return start;
 }
 
-static int
-get_ideal_thread_count() {
-    // int num_processors = 1;
-    const int num_processors = (int)g_get_num_processors();
+// Splits the result into one part per task, which can be merged independently
+static void
+sort_split_runs(DynamicArraySortContext *ctx, void **src, uint32_t **splits, uint32_t num_runs) {
+    DynamicArraySortSample samples[MAX_SORT_THREADS * SORT_SAMPLES_PER_RUN];
+    DynamicArray *sorted_samples = darray_new(G_N_ELEMENTS(samples));
+    for (uint32_t run = 0; run < num_runs; run++) {
+        const uint32_t start = splits[0][run];
+        const uint32_t num_items = splits[num_runs][run] - start;
+        for (uint32_t i = 0; i < SORT_SAMPLES_PER_RUN && num_items > 0; i++) {
+            DynamicArraySortSample *sample = &samples[run * SORT_SAMPLES_PER_RUN + i];
+            sample->run = run;
+            sample->pos = start + (uint32_t)((uint64_t)num_items * i / SORT_SAMPLES_PER_RUN);
+            sample->item = &src[sample->pos];
+            darray_add_item(sorted_samples, sample);
+        }
+    }
+    darray_sort(sorted_samples, (DynamicArrayCompareDataFunc)sort_compare_samples, NULL, ctx);
+
+    const uint32_t num_samples = sorted_samples->num_items;
+    for (uint32_t part = 1; part < num_runs; part++) {
+        const DynamicArraySortSample *sample = sorted_samples->data[(uint64_t)num_samples * part / num_runs];
+        for (uint32_t run = 0; run < num_runs; run++) {
+            const uint32_t split = sort_find_split(ctx, src, run, splits[0][run], splits[num_runs][run], sample);
+            splits[part][run] = MAX(split, splits[part - 1][run]);
+        }
+    }
+    g_clear_pointer(&sorted_samples, darray_unref);
+}
 
-    const int e = floor(log2(num_processors));
-    const int num_threads = (int)pow(2, e);
-    return MAX(num_threads, MAX_SORT_THREADS);
+// Runs func on each of the num_tasks tasks, which are task_size bytes apart, on the threads of pool
+static void
+sort_run_tasks(FsearchThreadPool *pool, FsearchThreadPoolFunc func, void *tasks, size_t task_size, uint32_t num_tasks) {
+    if (!pool || num_tasks < 2) {
+        for (uint32_t i = 0; i < num_tasks; i++) {
+            func((char *)tasks + i * task_size);
+        }
+        return;
+    }
+    FsearchTaskGroup *group = fsearch_task_group_new(pool, NULL);
+    for (uint32_t i = 0; i < num_tasks; i++) {
+        fsearch_task_group_push(group, func, (char *)tasks + i * task_size);
+    }
+    g_clear_pointer(&group, fsearch_task_group_free);
 }
 
 void
@@ -390,43 +597,306 @@ darray_sort_multi_threaded(DynamicArray *array,
                            DynamicArrayCompareDataFunc comp_func,
                            GCancellable *cancellable,
                            void *data) {
-    const int num_threads = get_ideal_thread_count();
-    if (num_threads < 2 || num_threads > array->num_items) {
+    darray_sort_multi_threaded_with_progress(array, comp_func, cancellable, data, NULL, NULL);
+}
+
+void
+darray_sort_multi_threaded_with_progress(DynamicArray *array,
+                                         DynamicArrayCompareDataFunc comp_func,
+                                         GCancellable *cancellable,
+                                         void *data,
+                                         DynamicArrayProgressFunc progress_func,
+                                         void *progress_data) {
+    g_assert(array);
+    g_assert(comp_func);
+
+    const uint32_t num_items = array->num_items;
+    const uint32_t num_runs = CLAMP(num_items / SORT_MIN_ITEMS_PER_RUN, 1, MAX_SORT_THREADS);
+    if (num_runs < 2) {
         return darray_sort(array, comp_func, NULL, data);
     }
 
-    g_debug("[sort] sorting with %d threads", num_threads);
+    FsearchThreadPool *pool = fsearch_thread_pool_get_default();
+    g_debug("[sort] sorting %d runs with up to %d threads",
+            num_runs,
+            MIN(num_runs, fsearch_thread_pool_get_num_threads(pool)));
+
+    DynamicArraySortProgress progress = {.func = progress_func, .func_data = progress_data};
+    g_mutex_init(&progress.mutex);
+
+    // the positions of the parts in the runs, the last one is where the runs end
+    uint32_t split_positions[MAX_SORT_THREADS + 1][MAX_SORT_THREADS] = {};
+    uint32_t *splits[MAX_SORT_THREADS + 1] = {};
+    for (uint32_t part = 0; part <= num_runs; part++) {
+        splits[part] = split_positions[part];
+    }
+    for (uint32_t run = 0; run < num_runs; run++) {
+        const uint32_t start = (uint32_t)((uint64_t)num_items * run / num_runs);
+        const uint32_t end = (uint32_t)((uint64_t)num_items * (run + 1) / num_runs);
+        splits[0][run] = start;
+        splits[num_runs][run] = end;
+        for (uint32_t n = end - start; n > 1; n = (n + 1) / 2) {
+            progress.num_to_merge += end - start;
+        }
+    }
+    progress.num_to_merge += num_items;
+
+    // the items are only replaced once they're sorted, so a cancelled sort leaves them as they are
+    void **src = malloc(num_items * sizeof(void *));
+    g_assert(src);
+    memcpy(src, array->data, num_items * sizeof(void *));
+    void **dest = malloc(num_items * sizeof(void *));
+    g_assert(dest);
+
+    DynamicArraySortTask tasks[MAX_SORT_THREADS] = {};
+    for (uint32_t i = 0; i < num_runs; i++) {
+        tasks[i].ctx.comp_func = comp_func;
+        tasks[i].ctx.comp_data = data;
+        tasks[i].ctx.cancellable = cancellable;
+        tasks[i].ctx.progress = progress_func ? &progress : NULL;
+        tasks[i].idx = i;
+        tasks[i].num_runs = num_runs;
+        tasks[i].src = src;
+        tasks[i].dest = dest;
+        tasks[i].splits = splits;
+    }
+    sort_run_tasks(pool, sort_run_thread, tasks, sizeof(DynamicArraySortTask), num_runs);
+
+    // instead of merging two runs after another, all of them get merged at once into one part of the result per task
+    bool cancelled = cancellable && g_cancellable_is_cancelled(cancellable);
+    if (!cancelled) {
+        sort_split_runs(&tasks[0].ctx, src, splits, num_runs);
+        sort_run_tasks(pool, sort_merge_thread, tasks, sizeof(DynamicArraySortTask), num_runs);
+        cancelled = cancellable && g_cancellable_is_cancelled(cancellable);
+    }
+    if (!cancelled) {
+        darray_take_items(array, g_steal_pointer(&dest), num_items);
+    }
+    g_clear_pointer(&dest, free);
+    g_clear_pointer(&src, free);
+    g_mutex_clear(&progress.mutex);
+    g_clear_pointer(&pool, fsearch_thread_pool_unref);
+}
+
+typedef struct {
+    uint64_t key;
+    void *item;
+} DynamicArrayKeyedItem;
+
+// The part [start, end) of the items one thread of darray_sort_by_key is responsible for
+typedef struct {
+    DynamicArray *array;
+    DynamicArrayKeyFunc key_func;
+    DynamicArrayCompareDataFunc tie_func;
+    GCancellable *cancellable;
+    DynamicArrayKeyedItem *src;
+    DynamicArrayKeyedItem *dest;
+    uint32_t start;
+    uint32_t end;
+    uint32_t shift;
+    // whether ties with more items than one thread should handle are left to a multi-threaded sort
+    bool skip_long_ties;
+    // the number of items with each digit, then the position in dest where the next one of them goes
+    uint32_t counts[RADIX_SORT_BUCKETS];
+    // the number of items with each value of every byte of their keys
+    uint32_t byte_counts[RADIX_SORT_PASSES][RADIX_SORT_BUCKETS];
+} DynamicArrayRadixContext;
+
+static void
+radix_get_keys_thread(void *data) {
+    DynamicArrayRadixContext *ctx = data;
+    for (uint32_t i = ctx->start; i < ctx->end; i++) {
+        void *item = ctx->array->data[i];
+        const uint64_t key = ctx->key_func(item);
+        ctx->src[i].key = key;
+        ctx->src[i].item = item;
+        for (uint32_t pass = 0; pass < RADIX_SORT_PASSES; pass++) {
+            ctx->byte_counts[pass][(key >> (pass * 8)) & 0xff]++;
+        }
+    }
+}
+
+static void
+radix_count_thread(void *data) {
+    DynamicArrayRadixContext *ctx = data;
+    memset(ctx->counts, 0, sizeof(ctx->counts));
+    for (uint32_t i = ctx->start; i < ctx->end; i++) {
+        ctx->counts[(ctx->src[i].key >> ctx->shift) & 0xff]++;
+    }
+}
+
+static void
+radix_scatter_thread(void *data) {
+    DynamicArrayRadixContext *ctx = data;
+    for (uint32_t i = ctx->start; i < ctx->end; i++) {
+        ctx->dest[ctx->counts[(ctx->src[i].key >> ctx->shift) & 0xff]++] = ctx->src[i];
+    }
+}
+
+static uint32_t
+radix_get_tie_end(const DynamicArrayKeyedItem *items, uint32_t start, uint32_t num_items) {
+    uint32_t end = start + 1;
+    while (end < num_items && items[end].key == items[start].key) {
+        end++;
+    }
+    return end;
+}
+
+static void
+radix_sort_ties_thread(void *data) {
+    DynamicArrayRadixContext *ctx = data;
+    for (uint32_t i = ctx->start; i < ctx->end;) {
+        const uint32_t tie_end = radix_get_tie_end(ctx->src, i, ctx->end);
+        const uint32_t num_ties = tie_end - i;
+        if (num_ties > 1 && (!ctx->skip_long_ties || num_ties <= RADIX_SORT_MAX_TIE_ITEMS_PER_THREAD)) {
+            if (ctx->cancellable && g_cancellable_is_cancelled(ctx->cancellable)) {
+                return;
+            }
+            // sort the items in place, darray_sort only needs them to look like an array
+            DynamicArray ties = {.num_items = num_ties, .max_items = num_ties, .data = ctx->array->data + i, .ref_count = 1};
+            darray_sort(&ties, ctx->tie_func, NULL, NULL);
+        }
+        i = tie_end;
+    }
+}
+
+static void
+radix_sort_ties(FsearchThreadPool *pool,
+                DynamicArray *array,
+                DynamicArrayKeyedItem *items,
+                DynamicArrayRadixContext *ctxs,
+                uint32_t num_threads,
+                GCancellable *cancellable) {
+    const uint32_t num_items = array->num_items;
+    for (uint32_t i = 0; i < num_threads; i++) {
+        ctxs[i].src = items;
+        ctxs[i].skip_long_ties = num_threads > 1;
+    }
+    // the threads get whole runs of items with the same key
+    for (uint32_t i = 1; i < num_threads; i++) {
+        uint32_t start = MAX(ctxs[i].start, ctxs[i - 1].start);
+        while (start > 0 && start < num_items && items[start].key == items[start - 1].key) {
+            start++;
+        }
+        ctxs[i].start = start;
+        ctxs[i - 1].end = start;
+    }
+    ctxs[num_threads - 1].end = num_items;
+    sort_run_tasks(pool, radix_sort_ties_thread, ctxs, sizeof(DynamicArrayRadixContext), num_threads);
+    if (num_threads == 1) {
+        return;
+    }
 
-    const int num_items_per_thread = (int)(array->num_items / num_threads);
-    GThreadPool *sort_pool = g_thread_pool_new(sort_thread, cancellable, num_threads, FALSE, NULL);
+    // e.g. lots of names with the same prefix would otherwise keep a single thread busy
+    for (uint32_t i = 0; i < num_items;) {
+        if (cancellable && g_cancellable_is_cancelled(cancellable)) {
+            return;
+        }
+        const uint32_t tie_end = radix_get_tie_end(items, i, num_items);
+        const uint32_t num_ties = tie_end - i;
+        if (num_ties > RADIX_SORT_MAX_TIE_ITEMS_PER_THREAD) {
+            DynamicArray *ties = new_array_from_data(array->data + i, num_ties);
+            darray_sort_multi_threaded(ties, ctxs[0].tie_func, cancellable, NULL);
+            if (!(cancellable && g_cancellable_is_cancelled(cancellable))) {
+                memcpy(array->data + i, ties->data, num_ties * sizeof(void *));
+            }
+            g_clear_pointer(&ties, darray_unref);
+        }
+        i = tie_end;
+    }
+}
 
-    g_autoptr(GArray) sort_ctx_array = g_array_sized_new(TRUE, TRUE, sizeof(DynamicArraySortContext), num_threads);
+void
+darray_sort_by_key(DynamicArray *array,
+                   DynamicArrayKeyFunc key_func,
+                   DynamicArrayCompareDataFunc tie_func,
+                   bool multi_threaded,
+                   GCancellable *cancellable) {
+    g_assert(array);
+    g_assert(key_func);
 
-    int start = 0;
-    for (int i = 0; i < num_threads; ++i) {
-        DynamicArraySortContext sort_ctx;
-        sort_ctx.dest = new_array_from_data(array->data + start,
-                                            i == num_threads - 1 ? array->num_items - start : num_items_per_thread);
-        sort_ctx.comp_func = comp_func;
-        sort_ctx.user_data = data;
-        start += num_items_per_thread;
-        g_array_insert_val(sort_ctx_array, i, sort_ctx);
-        g_thread_pool_push(sort_pool, &g_array_index(sort_ctx_array, DynamicArraySortContext, i), NULL);
+    const uint32_t num_items = array->num_items;
+    if (num_items < 2) {
+        return;
     }
-    g_thread_pool_free(g_steal_pointer(&sort_pool), FALSE, TRUE);
+    FsearchThreadPool *pool = multi_threaded ? fsearch_thread_pool_get_default() : NULL;
+    const uint32_t max_threads = pool ? MIN(fsearch_thread_pool_get_num_threads(pool), MAX_SORT_THREADS) : 1;
+    const uint32_t num_threads = CLAMP(num_items / RADIX_SORT_MIN_ITEMS_PER_THREAD, 1, max_threads);
+    g_debug("[sort] radix sort with %d thread(s): %d", num_threads, num_items);
+
+    DynamicArrayKeyedItem *src = malloc(num_items * sizeof(DynamicArrayKeyedItem));
+    g_assert(src);
+    DynamicArrayKeyedItem *dest = malloc(num_items * sizeof(DynamicArrayKeyedItem));
+    g_assert(dest);
+    DynamicArrayRadixContext *ctxs = calloc(num_threads, sizeof(DynamicArrayRadixContext));
+    g_assert(ctxs);
+    for (uint32_t i = 0; i < num_threads; i++) {
+        ctxs[i].array = array;
+        ctxs[i].key_func = key_func;
+        ctxs[i].tie_func = tie_func;
+        ctxs[i].cancellable = cancellable;
+        ctxs[i].src = src;
+        ctxs[i].start = (uint32_t)((uint64_t)num_items * i / num_threads);
+        ctxs[i].end = (uint32_t)((uint64_t)num_items * (i + 1) / num_threads);
+    }
+    // the keys are only looked up once, the passes don't have to touch the items
+    sort_run_tasks(pool, radix_get_keys_thread, ctxs, sizeof(DynamicArrayRadixContext), num_threads);
 
-    g_autoptr(GArray) result = merge_sorted(sort_ctx_array, comp_func, cancellable);
+    bool cancelled = false;
+    for (uint32_t pass = 0; pass < RADIX_SORT_PASSES; pass++) {
+        if (cancellable && g_cancellable_is_cancelled(cancellable)) {
+            cancelled = true;
+            break;
+        }
+        // bytes which are the same for all keys (e.g. the upper bytes of small sizes) don't change the order
+        bool is_same_for_all = false;
+        for (uint32_t digit = 0; digit < RADIX_SORT_BUCKETS && !is_same_for_all; digit++) {
+            uint32_t num_with_digit = 0;
+            for (uint32_t i = 0; i < num_threads; i++) {
+                num_with_digit += ctxs[i].byte_counts[pass][digit];
+            }
+            is_same_for_all = num_with_digit == num_items;
+        }
+        if (is_same_for_all) {
+            continue;
+        }
 
-    if (result) {
-        g_clear_pointer(&array->data, free);
+        for (uint32_t i = 0; i < num_threads; i++) {
+            ctxs[i].src = src;
+            ctxs[i].dest = dest;
+            ctxs[i].shift = pass * 8;
+        }
+        sort_run_tasks(pool, radix_count_thread, ctxs, sizeof(DynamicArrayRadixContext), num_threads);
+        // the items with smaller digits go first, those with the same digit keep the order of the threads
+        uint32_t offset = 0;
+        for (uint32_t digit = 0; digit < RADIX_SORT_BUCKETS; digit++) {
+            for (uint32_t i = 0; i < num_threads; i++) {
+                const uint32_t count = ctxs[i].counts[digit];
+                ctxs[i].counts[digit] = offset;
+                offset += count;
+            }
+        }
+        sort_run_tasks(pool, radix_scatter_thread, ctxs, sizeof(DynamicArrayRadixContext), num_threads);
 
-        DynamicArraySortContext *c = &g_array_index(result, DynamicArraySortContext, 0);
-        array->data = g_steal_pointer(&c->dest->data);
-        array->num_items = c->dest->num_items;
-        array->max_items = c->dest->max_items;
+        DynamicArrayKeyedItem *tmp = src;
+        src = dest;
+        dest = tmp;
+    }
 
-        g_clear_pointer(&c->dest, free);
+    if (!cancelled) {
+        // all items are replaced, so a shared array doesn't have to copy them first
+        darray_make_writable(array, false);
+        for (uint32_t i = 0; i < num_items; i++) {
+            array->data[i] = src[i].item;
+        }
+        if (tie_func) {
+            radix_sort_ties(pool, array, src, ctxs, num_threads, cancellable);
+        }
     }
+    g_clear_pointer(&ctxs, free);
+    g_clear_pointer(&dest, free);
+    g_clear_pointer(&src, free);
+    g_clear_pointer(&pool, fsearch_thread_pool_unref);
 }
 
 void
@@ -435,14 +905,17 @@ darray_sort(DynamicArray *array, DynamicArrayCompareDataFunc comp_func, GCancell
     g_assert(array->data);
     g_assert(comp_func);
 
+    darray_make_writable(array, true);
     if (array->num_items < 64) {
         g_debug("[sort] insertion sort: %d\n", array->num_items);
         insertion_sort(array, comp_func, data);
     }
     else {
         g_debug("[sort] merge sort: %d\n", array->num_items);
-        DynamicArray *src = darray_copy(array);
-        merge_sort(array, src, cancellable, comp_func, data);
+        // merge_sort writes into both arrays, so they can't share their items
+        DynamicArray *src = new_array_from_data(array->data, array->num_items);
+        DynamicArraySortContext ctx = {.comp_func = comp_func, .comp_data = data, .cancellable = cancellable};
+        merge_sort(array, src, &ctx);
         g_clear_pointer(&src, darray_unref);
     }
 }
@@ -495,23 +968,71 @@ darray_binary_search_with_data(DynamicArray *array,
     return result;
 }
 
+// The index of the first item which doesn't compare smaller than item (or greater or equal, if after_equal is set)
+static uint32_t
+binary_search_bound(DynamicArray *array, void *item, DynamicArrayCompareDataFunc comp_func, void *data, bool after_equal) {
+    uint32_t left = 0;
+    uint32_t right = array->num_items;
+    while (left < right) {
+        const uint32_t middle = left + (right - left) / 2;
+        const int32_t match = comp_func(&array->data[middle], &item, data);
+        if (match < 0 || (after_equal && match == 0)) {
+            left = middle + 1;
+        }
+        else {
+            right = middle;
+        }
+    }
+    return left;
+}
+
+bool
+darray_binary_search_range_with_data(DynamicArray *array,
+                                     void *item,
+                                     DynamicArrayCompareDataFunc comp_func,
+                                     void *data,
+                                     uint32_t *start,
+                                     uint32_t *end) {
+    g_assert(array);
+    g_assert(array->data);
+    g_assert(comp_func);
+    g_assert(start);
+    g_assert(end);
+
+    *start = binary_search_bound(array, item, comp_func, data, false);
+    *end = binary_search_bound(array, item, comp_func, data, true);
+    return *start < *end;
+}
+
 DynamicArray *
 darray_copy(DynamicArray *array) {
     if (!array) {
         return NULL;
     }
-    DynamicArray *new = calloc(1, sizeof(DynamicArray));
-    g_assert(new);
+    return darray_new_slice(array, 0, array->num_items);
+}
 
-    new->max_items = array->max_items;
-    new->num_items = array->num_items;
+DynamicArray *
+darray_new_slice(DynamicArray *array, uint32_t start, uint32_t num_items) {
+    g_assert(array);
+    g_assert(array->buffer);
+    g_assert(start <= array->num_items && num_items <= array->num_items - start);
 
-    new->data = calloc(new->max_items, sizeof(void *));
-    g_assert(new->data);
+    DynamicArray *new = calloc(1, sizeof(DynamicArray));
+    g_assert(new);
 
+    new->max_items = num_items;
+    new->num_items = num_items;
+    g_atomic_int_inc(&array->buffer->ref_count);
+    new->buffer = array->buffer;
+    new->data = array->data + start;
     new->ref_count = 1;
 
-    memcpy(new->data, array->data, new->max_items * sizeof(void *));
-
     return new;
 }
+
+const void *
+darray_get_items_id(DynamicArray *array) {
+    g_assert(array);
+    return array->buffer;
+}
@@ -27,6 +27,7 @@ typedef struct DynamicArray DynamicArray;
 
 typedef int32_t (*DynamicArrayCompareFunc)(void *a, void *b);
 typedef int32_t (*DynamicArrayCompareDataFunc)(void *a, void *b, void *data);
+typedef uint64_t (*DynamicArrayKeyFunc)(void *item);
 
 bool
 darray_binary_search_with_data(DynamicArray *array,
@@ -35,15 +36,48 @@ darray_binary_search_with_data(DynamicArray *array,
                                void *data,
                                uint32_t *matched_index);
 
+// Finds the range [start, end) of all items which compare equal to item, with two binary searches. Returns false if
+// there are none.
+bool
+darray_binary_search_range_with_data(DynamicArray *array,
+                                     void *item,
+                                     DynamicArrayCompareDataFunc comp_func,
+                                     void *data,
+                                     uint32_t *start,
+                                     uint32_t *end);
+
 void
 darray_sort_multi_threaded(DynamicArray *array,
                            DynamicArrayCompareDataFunc comp_func,
                            GCancellable *cancellable,
                            void *data);
 
+// Gets called from one of the sort threads whenever another percent of the items is sorted
+typedef void (*DynamicArrayProgressFunc)(uint32_t percent, void *user_data);
+
+// Same as darray_sort_multi_threaded, but reports the progress to progress_func (if it's set). A cancelled sort
+// leaves the array as it was.
+void
+darray_sort_multi_threaded_with_progress(DynamicArray *array,
+                                         DynamicArrayCompareDataFunc comp_func,
+                                         GCancellable *cancellable,
+                                         void *data,
+                                         DynamicArrayProgressFunc progress_func,
+                                         void *progress_data);
+
 void
 darray_sort(DynamicArray *array, DynamicArrayCompareDataFunc comp_func, GCancellable *cancellable, void *data);
 
+// Sorts the items by the keys key_func returns for them in ascending order, with a radix sort which gets each key only
+// once. It's stable, items with the same key keep their order unless tie_func is set, then they're sorted with it.
+// The array is left as it was if it gets cancelled while the keys are sorted.
+void
+darray_sort_by_key(DynamicArray *array,
+                   DynamicArrayKeyFunc key_func,
+                   DynamicArrayCompareDataFunc tie_func,
+                   bool multi_threaded,
+                   GCancellable *cancellable);
+
 uint32_t
 darray_get_size(DynamicArray *array);
 
@@ -66,6 +100,9 @@ darray_get_item_idx(DynamicArray *array, void *item, DynamicArrayCompareDataFunc
 void
 darray_add_items(DynamicArray *array, void **items, uint32_t num_items);
 
+void
+darray_add_array(DynamicArray *dest, DynamicArray *source);
+
 void
 darray_add_item(DynamicArray *array, void *data);
 
@@ -78,5 +115,14 @@ darray_unref(DynamicArray *array);
 DynamicArray *
 darray_ref(DynamicArray *array);
 
+// The copy shares the items of array until one of them gets changed, so it's cheap to make
 DynamicArray *
 darray_copy(DynamicArray *array);
+
+// Like darray_copy, but only for num_items items of array, starting at start
+DynamicArray *
+darray_new_slice(DynamicArray *array, uint32_t start, uint32_t num_items);
+
+// Arrays with the same id share their items, e.g. to not count them twice in the memory stats
+const void *
+darray_get_items_id(DynamicArray *array);
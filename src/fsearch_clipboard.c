@@ -23,8 +23,13 @@
 #include <stdbool.h>
 #include <string.h>
 
+// The paths of all folders are only worth building for selections with at least that many entries
+#define CLIPBOARD_FOLDER_PATHS_MIN_ENTRIES 10000
+
 static GdkDragAction clipboard_action = GDK_ACTION_DEFAULT;
-static GList *clipboard_file_list = NULL;
+static FsearchPathListFormat clipboard_format = FSEARCH_PATH_LIST_URIS;
+static FsearchDatabase *clipboard_db = NULL;
+static DynamicArray *clipboard_entries = NULL;
 
 enum { URI_LIST = 1, NAUTILUS_WORKAROUND, GNOME_COPIED_FILES, KDE_CUT_SELECTION, N_CLIPBOARD_TARGETS };
 
@@ -36,15 +41,38 @@ static GtkTargetEntry targets[] = {{"text/uri-list", 0, URI_LIST},
 static void
 clipboard_clean_data(GtkClipboard *clipboard, gpointer user_data) {
     /* g_debug("clean clipboard!"); */
-    if (clipboard_file_list) {
-        g_list_free_full(g_steal_pointer(&clipboard_file_list), (GDestroyNotify)g_free);
-    }
+    g_clear_pointer(&clipboard_entries, darray_unref);
+    g_clear_pointer(&clipboard_db, db_unref);
     clipboard_action = GDK_ACTION_DEFAULT;
 }
 
+static void
+clipboard_set_entries(FsearchDatabase *db, DynamicArray *entries) {
+    clipboard_db = db_ref(db);
+    clipboard_entries = darray_ref(entries);
+}
+
+// Builds the text when it's requested, with the entries which were put on the clipboard
+static void
+clipboard_append_entries(GString *str, FsearchPathListFormat format, const char *separator) {
+    g_autoptr(GTimer) timer = g_timer_new();
+    db_lock_shared(clipboard_db);
+    FsearchDatabaseFolderPaths *folder_paths = darray_get_num_items(clipboard_entries)
+                                                      >= CLIPBOARD_FOLDER_PATHS_MIN_ENTRIES
+                                                 ? db_get_folder_paths(clipboard_db)
+                                                 : NULL;
+    fsearch_path_list_append(str, clipboard_entries, folder_paths, format, separator);
+    g_clear_pointer(&folder_paths, db_folder_paths_unref);
+    db_unlock_shared(clipboard_db);
+    g_debug("[clipboard] built %d entries (%" G_GSIZE_FORMAT " bytes) in %f s",
+            darray_get_num_items(clipboard_entries),
+            str->len,
+            g_timer_elapsed(timer, NULL));
+}
+
 static void
 clipboard_get_data(GtkClipboard *clipboard, GtkSelectionData *selection_data, guint info, gpointer user_data) {
-    if (!clipboard_file_list) {
+    if (!clipboard_entries || darray_get_num_items(clipboard_entries) == 0) {
         return;
     }
 
@@ -77,19 +105,7 @@ clipboard_get_data(GtkClipboard *clipboard, GtkSelectionData *selection_data, gu
         return;
     }
 
-    for (GList *l = clipboard_file_list; l; l = l->next) {
-        g_autofree gchar *file_name = g_filename_to_uri((char *)l->data, NULL, NULL);
-        g_string_append(list, file_name);
-
-        if (l->next != NULL) {
-            if (info == URI_LIST) {
-                g_string_append(list, "\r\n");
-            }
-            else {
-                g_string_append_c(list, '\n');
-            }
-        }
-    }
+    clipboard_append_entries(list, FSEARCH_PATH_LIST_URIS, info == URI_LIST ? "\r\n" : "\n");
     if (info == NAUTILUS_WORKAROUND) {
         g_string_append_c(list, '\n');
     }
@@ -101,11 +117,42 @@ clipboard_get_data(GtkClipboard *clipboard, GtkSelectionData *selection_data, gu
                            (gint)list->len + 1);
 }
 
+static void
+clipboard_get_text(GtkClipboard *clipboard, GtkSelectionData *selection_data, guint info, gpointer user_data) {
+    if (!clipboard_entries) {
+        return;
+    }
+    g_autoptr(GString) text = g_string_sized_new(8192);
+    clipboard_append_entries(text, clipboard_format, "\n");
+    gtk_selection_data_set_text(selection_data, text->str, (gint)text->len);
+}
+
 void
-clipboard_copy_file_list(GList *file_list, bool copy) {
+clipboard_copy_entries(FsearchDatabase *db, DynamicArray *entries, bool copy) {
+    g_assert(db);
+    g_assert(entries);
     GtkClipboard *clip = gtk_clipboard_get(GDK_SELECTION_CLIPBOARD);
     gtk_clipboard_set_with_data(clip, targets, G_N_ELEMENTS(targets), clipboard_get_data, clipboard_clean_data, NULL);
 
-    clipboard_file_list = file_list;
+    clipboard_set_entries(db, entries);
     clipboard_action = copy ? GDK_ACTION_COPY : GDK_ACTION_MOVE;
 }
+
+void
+clipboard_copy_entries_as_text(FsearchDatabase *db, DynamicArray *entries, FsearchPathListFormat format) {
+    g_assert(db);
+    g_assert(entries);
+    GtkClipboard *clip = gtk_clipboard_get(GDK_SELECTION_CLIPBOARD);
+    GtkTargetList *target_list = gtk_target_list_new(NULL, 0);
+    gtk_target_list_add_text_targets(target_list, 0);
+    gint num_text_targets = 0;
+    GtkTargetEntry *text_targets = gtk_target_table_new_from_list(target_list, &num_text_targets);
+    gtk_clipboard_set_with_data(clip, text_targets, num_text_targets, clipboard_get_text, clipboard_clean_data, NULL);
+    // like gtk_clipboard_set_text, a clipboard manager can keep the text after the application quit
+    gtk_clipboard_set_can_store(clip, NULL, 0);
+    gtk_target_table_free(text_targets, num_text_targets);
+    gtk_target_list_unref(target_list);
+
+    clipboard_set_entries(db, entries);
+    clipboard_format = format;
+}
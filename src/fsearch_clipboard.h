@@ -21,5 +21,15 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 #include <glib.h>
 #include <stdbool.h>
 
+#include "fsearch_array.h"
+#include "fsearch_database.h"
+#include "fsearch_path_list.h"
+
+// Puts entries (which belong to db) on the clipboard as files to be copied or moved. Their URIs are only built when
+// another application asks for them, see fsearch_path_list_append.
+void
+clipboard_copy_entries(FsearchDatabase *db, DynamicArray *entries, bool copy);
+
+// Puts the text of entries on the clipboard, one line per entry. Like clipboard_copy_entries it's built on demand.
 void
-clipboard_copy_file_list(GList *file_list, bool copy);
+clipboard_copy_entries_as_text(FsearchDatabase *db, DynamicArray *entries, FsearchPathListFormat format);
@@ -167,10 +167,13 @@ config_load_indexes(GKeyFile *key_file, GList *indexes, const char *prefix) {
         bool update = config_load_boolean(key_file, "Database", key, true);
         snprintf(key, sizeof(key), "%s_one_filesystem_%d", prefix, pos);
         bool one_filesystem = config_load_boolean(key_file, "Database", key, false);
+        snprintf(key, sizeof(key), "%s_update_interval_%d", prefix, pos);
+        const uint32_t update_interval = config_load_integer(key_file, "Database", key, 0);
 
         pos++;
         if (path) {
             FsearchIndex *index = fsearch_index_new(FSEARCH_INDEX_FOLDER_TYPE, path, enabled, update, one_filesystem, 0);
+            index->update_interval = update_interval;
             indexes = g_list_append(indexes, index);
         }
         else {
@@ -232,6 +235,7 @@ config_load(FsearchConfig *config) {
         config->enable_dark_theme = config_load_boolean(key_file, "Interface", "enable_dark_theme", false);
         config->show_menubar = config_load_boolean(key_file, "Interface", "show_menubar", true);
         config->show_statusbar = config_load_boolean(key_file, "Interface", "show_statusbar", true);
+        config->show_performance_stats = config_load_boolean(key_file, "Interface", "show_performance_stats", false);
         config->show_filter = config_load_boolean(key_file, "Interface", "show_filter", true);
         config->show_search_button = config_load_boolean(key_file, "Interface", "show_search_button", false);
         config->show_base_2_units = config_load_boolean(key_file, "Interface", "show_base_2_units", false);
@@ -308,6 +312,35 @@ config_load(FsearchConfig *config) {
         config->update_database_every_hours = config_load_integer(key_file, "Database", "update_database_every_hours", 0);
         config->update_database_every_minutes =
             config_load_integer(key_file, "Database", "update_database_every_minutes", 15);
+        config->update_database_every_low_impact =
+            config_load_boolean(key_file, "Database", "update_database_every_low_impact", false);
+        config->update_database_incrementally =
+            config_load_boolean(key_file, "Database", "update_database_incrementally", true);
+        config->compress_database = config_load_boolean(key_file, "Database", "compress_database", false);
+        config->lazy_sort_indexes = config_load_boolean(key_file, "Database", "lazy_sort_indexes", false);
+        config->search_cache_size = config_load_integer(key_file, "Database", "search_cache_size", 64);
+        config->content_cache_size = config_load_integer(key_file, "Database", "content_cache_size", 10000);
+        config->trigram_index = config_load_boolean(key_file, "Database", "trigram_index", false);
+        config->low_memory_mode = config_load_boolean(key_file, "Database", "low_memory_mode", false);
+        config->memory_budget = config_load_integer(key_file, "Database", "memory_budget", 256);
+        config->lazy_metadata = config_load_boolean(key_file, "Database", "lazy_metadata", false);
+        config->index_owner = config_load_boolean(key_file, "Database", "index_owner", false);
+        config->index_permissions = config_load_boolean(key_file, "Database", "index_permissions", false);
+        config->index_access_time = config_load_boolean(key_file, "Database", "index_access_time", false);
+        config->index_creation_time = config_load_boolean(key_file, "Database", "index_creation_time", false);
+        config->index_status_change_time =
+            config_load_boolean(key_file, "Database", "index_status_change_time", false);
+        config->monitor_filesystem = config_load_boolean(key_file, "Database", "monitor_filesystem", true);
+        config->num_threads = config_load_integer(key_file, "Database", "num_threads", 0);
+        config->num_scan_threads = config_load_integer(key_file, "Database", "num_scan_threads", 0);
+        config->scan_timeout = config_load_integer(key_file, "Database", "scan_timeout", 30);
+        config->scan_index_timeout = config_load_integer(key_file, "Database", "scan_index_timeout", 0);
+        config->pin_threads = config_load_boolean(key_file, "Database", "pin_threads", false);
+        config->system_database = config_load_string(key_file, "Database", "system_database", NULL);
+        g_autofree char *database_segments_str = config_load_string(key_file, "Database", "database_segments", NULL);
+        if (database_segments_str && database_segments_str[0] != '\0') {
+            config->database_segments = g_strsplit(database_segments_str, ";", -1);
+        }
         config->exclude_hidden_items =
             config_load_boolean(key_file, "Database", "exclude_hidden_files_and_folders", false);
         config->follow_symlinks = config_load_boolean(key_file, "Database", "follow_symbolic_links", false);
@@ -360,6 +393,7 @@ config_load_default(FsearchConfig *config) {
     config->double_click_path = false;
     config->show_menubar = true;
     config->show_statusbar = true;
+    config->show_performance_stats = false;
     config->show_filter = true;
     config->show_search_button = false;
     config->show_base_2_units = false;
@@ -406,6 +440,27 @@ config_load_default(FsearchConfig *config) {
     config->update_database_every = false;
     config->update_database_every_hours = 0;
     config->update_database_every_minutes = 15;
+    config->update_database_every_low_impact = false;
+    config->update_database_incrementally = true;
+    config->compress_database = false;
+    config->lazy_sort_indexes = false;
+    config->search_cache_size = 64;
+    config->content_cache_size = 10000;
+    config->trigram_index = false;
+    config->low_memory_mode = false;
+    config->memory_budget = 256;
+    config->lazy_metadata = false;
+    config->index_owner = false;
+    config->index_permissions = false;
+    config->index_access_time = false;
+    config->index_creation_time = false;
+    config->index_status_change_time = false;
+    config->monitor_filesystem = true;
+    config->num_threads = 0;
+    config->num_scan_threads = 0;
+    config->scan_timeout = 30;
+    config->scan_index_timeout = 0;
+    config->pin_threads = false;
     config->exclude_hidden_items = false;
     config->follow_symlinks = false;
 
@@ -482,6 +537,9 @@ config_save_indexes(GKeyFile *key_file, GList *indexes, const char *prefix) {
         snprintf(key, sizeof(key), "%s_one_filesystem_%d", prefix, pos);
         g_key_file_set_boolean(key_file, "Database", key, index->one_filesystem);
 
+        snprintf(key, sizeof(key), "%s_update_interval_%d", prefix, pos);
+        g_key_file_set_integer(key_file, "Database", key, (gint)index->update_interval);
+
         pos++;
     }
 }
@@ -534,6 +592,7 @@ config_save(FsearchConfig *config) {
     g_key_file_set_boolean(key_file, "Interface", "enable_dark_theme", config->enable_dark_theme);
     g_key_file_set_boolean(key_file, "Interface", "show_menubar", config->show_menubar);
     g_key_file_set_boolean(key_file, "Interface", "show_statusbar", config->show_statusbar);
+    g_key_file_set_boolean(key_file, "Interface", "show_performance_stats", config->show_performance_stats);
     g_key_file_set_boolean(key_file, "Interface", "show_filter", config->show_filter);
     g_key_file_set_boolean(key_file, "Interface", "show_search_button", config->show_search_button);
     g_key_file_set_boolean(key_file, "Interface", "show_base_2_units", config->show_base_2_units);
@@ -601,6 +660,40 @@ config_save(FsearchConfig *config) {
     g_key_file_set_boolean(key_file, "Database", "update_database_every", config->update_database_every);
     g_key_file_set_integer(key_file, "Database", "update_database_every_hours", config->update_database_every_hours);
     g_key_file_set_integer(key_file, "Database", "update_database_every_minutes", config->update_database_every_minutes);
+    g_key_file_set_boolean(key_file,
+                           "Database",
+                           "update_database_every_low_impact",
+                           config->update_database_every_low_impact);
+    g_key_file_set_boolean(key_file,
+                           "Database",
+                           "update_database_incrementally",
+                           config->update_database_incrementally);
+    g_key_file_set_boolean(key_file, "Database", "compress_database", config->compress_database);
+    g_key_file_set_boolean(key_file, "Database", "lazy_sort_indexes", config->lazy_sort_indexes);
+    g_key_file_set_integer(key_file, "Database", "search_cache_size", config->search_cache_size);
+    g_key_file_set_integer(key_file, "Database", "content_cache_size", config->content_cache_size);
+    g_key_file_set_boolean(key_file, "Database", "trigram_index", config->trigram_index);
+    g_key_file_set_boolean(key_file, "Database", "low_memory_mode", config->low_memory_mode);
+    g_key_file_set_integer(key_file, "Database", "memory_budget", config->memory_budget);
+    g_key_file_set_boolean(key_file, "Database", "lazy_metadata", config->lazy_metadata);
+    g_key_file_set_boolean(key_file, "Database", "index_owner", config->index_owner);
+    g_key_file_set_boolean(key_file, "Database", "index_permissions", config->index_permissions);
+    g_key_file_set_boolean(key_file, "Database", "index_access_time", config->index_access_time);
+    g_key_file_set_boolean(key_file, "Database", "index_creation_time", config->index_creation_time);
+    g_key_file_set_boolean(key_file, "Database", "index_status_change_time", config->index_status_change_time);
+    g_key_file_set_boolean(key_file, "Database", "monitor_filesystem", config->monitor_filesystem);
+    g_key_file_set_integer(key_file, "Database", "num_threads", config->num_threads);
+    g_key_file_set_integer(key_file, "Database", "num_scan_threads", config->num_scan_threads);
+    g_key_file_set_integer(key_file, "Database", "scan_timeout", config->scan_timeout);
+    g_key_file_set_integer(key_file, "Database", "scan_index_timeout", config->scan_index_timeout);
+    g_key_file_set_boolean(key_file, "Database", "pin_threads", config->pin_threads);
+    if (config->system_database) {
+        g_key_file_set_string(key_file, "Database", "system_database", config->system_database);
+    }
+    if (config->database_segments) {
+        g_autofree char *database_segments_str = g_strjoinv(";", config->database_segments);
+        g_key_file_set_string(key_file, "Database", "database_segments", database_segments_str);
+    }
     g_key_file_set_boolean(key_file, "Database", "exclude_hidden_files_and_folders", config->exclude_hidden_items);
     g_key_file_set_boolean(key_file, "Database", "follow_symbolic_links", config->follow_symlinks);
 
@@ -675,6 +768,7 @@ config_indexes_compare(void *i1, void *i2) {
     if (index1->one_filesystem != index2->one_filesystem) {
         return false;
     }
+    // a different update_interval only changes the schedule, the database stays the same
     if (g_strcmp0(index1->path, index2->path) != 0) {
         return false;
     }
@@ -754,14 +848,57 @@ config_cmp(FsearchConfig *c1, FsearchConfig *c2) {
     bool exclude_locations_changed =
         !config_list_compare(c1->exclude_locations, c2->exclude_locations, config_excludes_compare);
 
+    const bool system_database_changed = g_strcmp0(c1->system_database, c2->system_database) != 0;
+    bool database_segments_changed = false;
+    if (c1->database_segments && c2->database_segments) {
+        database_segments_changed = !g_strv_equal((const gchar *const *)c1->database_segments,
+                                                  (const gchar *const *)c2->database_segments);
+    }
+    else if (c1->database_segments || c2->database_segments) {
+        database_segments_changed = true;
+    }
+
     if (c1->exclude_hidden_items != c2->exclude_hidden_items || exclude_files_changed || exclude_locations_changed
-        || indexes_changed) {
+        || indexes_changed || system_database_changed || database_segments_changed
+        || config_get_index_flags(c1) != config_get_index_flags(c2)
+        || config_get_memory_budget(c1) != config_get_memory_budget(c2)) {
         result.database_config_changed = true;
     }
 
     return result;
 }
 
+size_t
+config_get_memory_budget(FsearchConfig *config) {
+    g_assert(config);
+    return config->low_memory_mode ? (size_t)MAX(config->memory_budget, 1) * 1024 * 1024 : 0;
+}
+
+FsearchDatabaseIndexFlags
+config_get_index_flags(FsearchConfig *config) {
+    g_assert(config);
+    FsearchDatabaseIndexFlags flags = DATABASE_INDEX_FLAG_NAME;
+    if (!config->lazy_metadata) {
+        flags |= DATABASE_INDEX_FLAG_SIZE | DATABASE_INDEX_FLAG_MODIFICATION_TIME;
+    }
+    if (config->index_owner) {
+        flags |= DATABASE_INDEX_FLAG_OWNER;
+    }
+    if (config->index_permissions) {
+        flags |= DATABASE_INDEX_FLAG_PERMISSIONS;
+    }
+    if (config->index_access_time) {
+        flags |= DATABASE_INDEX_FLAG_ACCESS_TIME;
+    }
+    if (config->index_creation_time) {
+        flags |= DATABASE_INDEX_FLAG_CREATION_TIME;
+    }
+    if (config->index_status_change_time) {
+        flags |= DATABASE_INDEX_FLAG_STATUS_CHANGE_TIME;
+    }
+    return flags;
+}
+
 FsearchConfig *
 config_copy(FsearchConfig *config) {
     FsearchConfig *copy = calloc(1, sizeof(FsearchConfig));
@@ -775,6 +912,12 @@ config_copy(FsearchConfig *config) {
     if (config->sort_by) {
         copy->sort_by = g_strdup(config->sort_by);
     }
+    if (config->system_database) {
+        copy->system_database = g_strdup(config->system_database);
+    }
+    if (config->database_segments) {
+        copy->database_segments = g_strdupv(config->database_segments);
+    }
     if (config->indexes) {
         copy->indexes = g_list_copy_deep(config->indexes, (GCopyFunc)fsearch_index_copy, NULL);
     }
@@ -796,6 +939,8 @@ config_free(FsearchConfig *config) {
 
     g_clear_pointer(&config->folder_open_cmd, free);
     g_clear_pointer(&config->sort_by, free);
+    g_clear_pointer(&config->system_database, free);
+    g_clear_pointer(&config->database_segments, g_strfreev);
     g_clear_pointer(&config->filters, fsearch_filter_manager_free);
     if (config->indexes) {
         g_list_free_full(g_steal_pointer(&config->indexes), (GDestroyNotify)fsearch_index_free);
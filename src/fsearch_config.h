@@ -22,6 +22,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "fsearch_database_index.h"
 #include "fsearch_filter_manager.h"
 
 typedef struct _FsearchConfig FsearchConfig;
@@ -79,6 +80,8 @@ struct _FsearchConfig {
     // View menu
     bool show_menubar;
     bool show_statusbar;
+    // search, sort and drawing times in the statusbar
+    bool show_performance_stats;
     bool show_filter;
     bool show_search_button;
 
@@ -111,6 +114,48 @@ struct _FsearchConfig {
     bool update_database_every;
     uint32_t update_database_every_hours;
     uint32_t update_database_every_minutes;
+    // scheduled updates run with low CPU and I/O priority
+    bool update_database_every_low_impact;
+    bool update_database_incrementally;
+    // store the database file compressed
+    bool compress_database;
+    // only load or sort the entries by something else than their name, once it's needed
+    bool lazy_sort_indexes;
+    // memory the results of recent searches may use (in MiB), 0 disables caching them
+    uint32_t search_cache_size;
+    // the number of files whose content: results are remembered until they change, 0 disables it
+    uint32_t content_cache_size;
+    // index the trigrams of all names, which speeds up searches for longer terms at the cost of memory
+    bool trigram_index;
+    // for small machines: only keep the name order of the database and fit the caches into memory_budget (in MiB)
+    bool low_memory_mode;
+    uint32_t memory_budget;
+    // only index the names, the sizes and modification times of the rows which are shown get looked up instead
+    bool lazy_metadata;
+    // also index the owners, permissions and the other timestamps of all entries, for the owner:, group:, perm:, da:,
+    // datechanged: and dc: functions
+    bool index_owner;
+    bool index_permissions;
+    bool index_access_time;
+    bool index_creation_time;
+    bool index_status_change_time;
+    bool monitor_filesystem;
+    // the number of threads which search, sort and load the database, 0 uses one per processor
+    uint32_t num_threads;
+    // the number of threads which scan the indexes, 0 uses as many as num_threads
+    uint32_t num_scan_threads;
+    // seconds a single filesystem call and the scan of a whole index may take, before the index keeps its previous
+    // entries instead; 0 waits as long as it takes
+    uint32_t scan_timeout;
+    uint32_t scan_index_timeout;
+    // keep every thread on a processor of its own, close to its caches and the memory it touched first
+    bool pin_threads;
+    // a database file which someone else keeps up to date (e.g. a system wide one), NULL to scan our own. It's only
+    // read, and the entries which the user can't list are hidden.
+    char *system_database;
+    // database files of other machines (e.g. built on the file servers), which are searched along with the own one.
+    // They're only read, so the database isn't updated and saved by this instance anymore.
+    char **database_segments;
 
     bool exclude_hidden_items;
     bool follow_symlinks;
@@ -136,6 +181,14 @@ config_save(FsearchConfig *config);
 void
 config_build_dir(char *path, size_t len);
 
+// The index flags of databases built with config
+FsearchDatabaseIndexFlags
+config_get_index_flags(FsearchConfig *config);
+
+// The memory budget of databases built with config in bytes, 0 if the low memory mode is off
+size_t
+config_get_memory_budget(FsearchConfig *config);
+
 FsearchConfigCompareResult
 config_cmp(FsearchConfig *c1, FsearchConfig *c2);
 
@@ -0,0 +1,444 @@
+#define G_LOG_DOMAIN "fsearch-daemon"
+
+#include "fsearch_daemon.h"
+#include "fsearch_daemon_protocol.h"
+#include "fsearch_database.h"
+#include "fsearch_database_monitor.h"
+#include "fsearch_database_search.h"
+#include "fsearch_file_content.h"
+#include "fsearch_query.h"
+#include "fsearch_thread_pool.h"
+
+#include <gio/gio.h>
+#include <gio/gunixsocketaddress.h>
+#include <glib-unix.h>
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+// The longest request line which gets read, longer ones are answered with an error and close the connection
+#define FSEARCH_DAEMON_MAX_REQUEST_LENGTH (64 * 1024)
+// The number of connections which are served at the same time
+#define FSEARCH_DAEMON_MAX_CONNECTIONS 16
+
+typedef struct {
+    FsearchConfig *config;
+    GMainLoop *loop;
+
+    GMutex mutex;
+    // replaced when a rescan finishes, searches keep a reference to the one they started with
+    FsearchDatabase *db;
+    FsearchDatabaseMonitor *monitor;
+    GThread *rescan_thread;
+    bool rescan_running;
+    bool rescan_pending;
+} FsearchDaemon;
+
+static void
+daemon_monitor_rescan_cb(gpointer user_data);
+
+static FsearchDatabase *
+daemon_new_database(FsearchConfig *config) {
+    FsearchDatabase *db =
+        db_new(config->indexes, config->exclude_locations, config->exclude_files, config->exclude_hidden_items);
+    db_set_compress(db, config->compress_database);
+    db_set_lazy_sort_indexes(db, config->lazy_sort_indexes);
+    db_set_search_cache_size(db, (size_t)config->search_cache_size * 1024 * 1024);
+    db_set_memory_budget(db, config_get_memory_budget(config));
+    fsearch_file_content_set_cache_size(config->content_cache_size);
+    db_set_trigram_index(db, config->trigram_index);
+    db_set_index_flags(db, config_get_index_flags(config));
+    db_set_num_scan_threads(db, config->num_scan_threads);
+    db_set_scan_timeouts(db, config->scan_timeout * 1000, config->scan_index_timeout * 1000);
+    // a system wide database holds entries the clients might not be allowed to list
+    db_set_filter_by_access(db, config->system_database != NULL);
+    return db;
+}
+
+// Must be called with the mutex held
+static void
+daemon_monitor_update(FsearchDaemon *daemon) {
+    g_clear_pointer(&daemon->monitor, db_monitor_free);
+    // the segments and a system wide database are only read, they're kept up to date by someone else
+    if (daemon->config->monitor_filesystem && daemon->db && !daemon->config->database_segments
+        && !daemon->config->system_database) {
+        daemon->monitor = db_monitor_new(daemon->db, daemon_monitor_rescan_cb, daemon);
+    }
+}
+
+static FsearchDatabase *
+daemon_get_database(FsearchDaemon *daemon) {
+    g_mutex_lock(&daemon->mutex);
+    FsearchDatabase *db = daemon->db ? db_ref(daemon->db) : NULL;
+    g_mutex_unlock(&daemon->mutex);
+    return db;
+}
+
+static gpointer
+daemon_rescan_thread(gpointer user_data) {
+    FsearchDaemon *daemon = user_data;
+
+    bool rescan = true;
+    while (rescan) {
+        FsearchDatabase *reference = daemon_get_database(daemon);
+        FsearchDatabase *db = daemon_new_database(daemon->config);
+        const bool scanned = reference ? db_scan_incremental(db, reference, NULL, NULL) : db_scan(db, NULL, NULL);
+        g_clear_pointer(&reference, db_unref);
+
+        g_mutex_lock(&daemon->mutex);
+        if (scanned) {
+            g_clear_pointer(&daemon->monitor, db_monitor_free);
+            g_clear_pointer(&daemon->db, db_unref);
+            daemon->db = g_steal_pointer(&db);
+            daemon_monitor_update(daemon);
+            g_debug("rescan finished");
+        }
+        rescan = daemon->rescan_pending;
+        daemon->rescan_pending = false;
+        daemon->rescan_running = rescan;
+        g_mutex_unlock(&daemon->mutex);
+
+        g_clear_pointer(&db, db_unref);
+    }
+    return NULL;
+}
+
+static gboolean
+on_daemon_rescan(gpointer user_data) {
+    FsearchDaemon *daemon = user_data;
+    g_mutex_lock(&daemon->mutex);
+    if (daemon->rescan_running) {
+        // the running rescan might have missed the changes, so it runs once more
+        daemon->rescan_pending = true;
+        g_mutex_unlock(&daemon->mutex);
+        return G_SOURCE_REMOVE;
+    }
+    daemon->rescan_running = true;
+    GThread *finished_thread = g_steal_pointer(&daemon->rescan_thread);
+    g_mutex_unlock(&daemon->mutex);
+
+    // rescans are only started from the main loop, so rescan_thread is only replaced here
+    if (finished_thread) {
+        g_thread_join(finished_thread);
+    }
+    GThread *thread = g_thread_new("fsearch_daemon_rescan", daemon_rescan_thread, daemon);
+    g_mutex_lock(&daemon->mutex);
+    daemon->rescan_thread = thread;
+    g_mutex_unlock(&daemon->mutex);
+    return G_SOURCE_REMOVE;
+}
+
+static void
+daemon_monitor_rescan_cb(gpointer user_data) {
+    g_idle_add(on_daemon_rescan, user_data);
+}
+
+static void
+daemon_search(FsearchDaemon *daemon, FsearchDaemonRequest *request, GString *response) {
+    FsearchDatabase *db = daemon_get_database(daemon);
+    if (!db) {
+        g_string_append(response, "ERROR no database\n");
+        return;
+    }
+
+    FsearchQuery *query =
+        fsearch_query_new(request->query_text, NULL, daemon->config->filters, request->flags, "daemon");
+    const bool matches_everything = fsearch_query_matches_everything(query);
+    // the results after the page are only needed to know if there are more of them, pages past the range of the
+    // limit search for all of them
+    const uint64_t page_end = (uint64_t)request->offset + request->limit + 1;
+    if (!request->descending && !matches_everything && page_end <= UINT32_MAX) {
+        query->limit = (uint32_t)page_end;
+    }
+
+    if (!db_has_entries_sorted_by_type(db, request->sort_order)) {
+        db_lock(db);
+        db_ensure_entries_sorted(db, request->sort_order, NULL);
+        db_unlock(db);
+    }
+
+    db_lock_shared(db);
+    FsearchDatabaseIndexType sort_order = DATABASE_INDEX_TYPE_NAME;
+    DynamicArray *folders = NULL;
+    DynamicArray *files = NULL;
+    db_get_entries_sorted(db, request->sort_order, &sort_order, &folders, &files);
+
+    DatabaseSearchResult *result = NULL;
+    if (matches_everything) {
+        result = db_search_empty(folders, files, sort_order);
+        db_filter_result_by_access(db, result);
+    }
+    else {
+        result =
+            db_search_query(db, query, db_get_thread_pool(db), folders, files, sort_order, false, NULL, NULL, NULL);
+    }
+    g_clear_pointer(&folders, darray_unref);
+    g_clear_pointer(&files, darray_unref);
+
+    if (result && result->duplicates_pending) {
+        // the search started looking for them, the client can ask again later
+        g_string_append(response, "ERROR the duplicates are still being looked for\n");
+    }
+    else {
+        const uint32_t num_folders = result && result->folders ? darray_get_num_items(result->folders) : 0;
+        const uint32_t num_files = result && result->files ? darray_get_num_items(result->files) : 0;
+        const uint64_t num_results = (uint64_t)num_folders + num_files;
+        const uint64_t start = MIN(request->offset, num_results);
+        const uint64_t end = MIN(start + request->limit, num_results);
+
+        g_string_append_printf(response, "OK %" G_GUINT64_FORMAT " %d\n", end - start, end < num_results ? 1 : 0);
+        // the results are folders first, descending orders are the reverse of that
+        for (uint64_t i = start; i < end; i++) {
+            const uint64_t idx = request->descending ? num_results - 1 - i : i;
+            FsearchDatabaseEntry *entry = idx < num_folders ? darray_get_item(result->folders, idx)
+                                                            : darray_get_item(result->files, idx - num_folders);
+            fsearch_daemon_append_path(response, entry);
+        }
+    }
+    db_unlock_shared(db);
+
+    if (result) {
+        g_clear_pointer(&result->folders, darray_unref);
+        g_clear_pointer(&result->files, darray_unref);
+        g_clear_pointer(&result, free);
+    }
+    g_clear_pointer(&query, fsearch_query_unref);
+    g_clear_pointer(&db, db_unref);
+}
+
+// Reads the next line of input into line, without the newline. It's never buffered beyond
+// FSEARCH_DAEMON_MAX_REQUEST_LENGTH, longer lines set too_long instead. Returns false at the end of the input, if it
+// can't be read or is too long.
+static bool
+daemon_read_line(GBufferedInputStream *input, GString *line, bool *too_long) {
+    g_string_truncate(line, 0);
+    *too_long = false;
+    while (true) {
+        gsize available = 0;
+        const char *buffer = g_buffered_input_stream_peek_buffer(input, &available);
+        if (available == 0) {
+            if (g_buffered_input_stream_fill(input, -1, NULL, NULL) <= 0) {
+                // the last line doesn't need a newline
+                return line->len > 0;
+            }
+            continue;
+        }
+        const char *newline = memchr(buffer, '\n', available);
+        const gsize length = newline ? (gsize)(newline - buffer) : available;
+        if (line->len + length > FSEARCH_DAEMON_MAX_REQUEST_LENGTH) {
+            *too_long = true;
+            return false;
+        }
+        g_string_append_len(line, buffer, (gssize)length);
+        g_input_stream_skip(G_INPUT_STREAM(input), newline ? length + 1 : length, NULL, NULL);
+        if (newline) {
+            return true;
+        }
+    }
+}
+
+static gboolean
+on_daemon_connection(GThreadedSocketService *service,
+                     GSocketConnection *connection,
+                     GObject *source_object,
+                     gpointer user_data) {
+    FsearchDaemon *daemon = user_data;
+    GInputStream *input = g_io_stream_get_input_stream(G_IO_STREAM(connection));
+    GOutputStream *output = g_io_stream_get_output_stream(G_IO_STREAM(connection));
+    g_autoptr(GInputStream) buffered_input = g_buffered_input_stream_new(input);
+
+    // the options of a search start out with the ones of the config
+    const FsearchDaemonRequest defaults = {
+        .limit = FSEARCH_DAEMON_DEFAULT_LIMIT,
+        .sort_order = DATABASE_INDEX_TYPE_NAME,
+        .flags = (daemon->config->match_case ? QUERY_FLAG_MATCH_CASE : 0)
+               | (daemon->config->auto_match_case ? QUERY_FLAG_AUTO_MATCH_CASE : 0)
+               | (daemon->config->enable_regex ? QUERY_FLAG_REGEX : 0)
+               | (daemon->config->search_in_path ? QUERY_FLAG_SEARCH_IN_PATH : 0)
+               | (daemon->config->auto_search_in_path ? QUERY_FLAG_AUTO_SEARCH_IN_PATH : 0),
+    };
+
+    g_autoptr(GString) response = g_string_sized_new(4096);
+    g_autoptr(GString) line = g_string_sized_new(256);
+    bool too_long = false;
+    while (daemon_read_line(G_BUFFERED_INPUT_STREAM(buffered_input), line, &too_long)) {
+        if (line->len > 0 && line->str[line->len - 1] == '\r') {
+            g_string_truncate(line, line->len - 1);
+        }
+
+        g_string_truncate(response, 0);
+        FsearchDaemonRequest request = defaults;
+        const char *error_message = NULL;
+        if (!fsearch_daemon_request_parse(line->str, &request, &error_message)) {
+            g_string_append_printf(response, "ERROR %s\n", error_message);
+        }
+        else if (request.type == FSEARCH_DAEMON_REQUEST_PING) {
+            g_string_append(response, "PONG\n");
+        }
+        else {
+            daemon_search(daemon, &request, response);
+        }
+        fsearch_daemon_request_clear(&request);
+
+        if (!g_output_stream_write_all(output, response->str, response->len, NULL, NULL, NULL)) {
+            return TRUE;
+        }
+    }
+    if (too_long) {
+        const char *error = "ERROR the request is too long\n";
+        g_output_stream_write_all(output, error, strlen(error), NULL, NULL, NULL);
+    }
+    return TRUE;
+}
+
+static gboolean
+on_daemon_quit_signal(gpointer user_data) {
+    g_main_loop_quit(user_data);
+    return G_SOURCE_CONTINUE;
+}
+
+static bool
+daemon_load_database(FsearchDaemon *daemon, const char *database_file_path) {
+    FsearchDatabase *db = daemon_new_database(daemon->config);
+    const bool loaded = database_file_path && db_load(db, database_file_path, NULL);
+    if (db_add_segments(db, daemon->config->database_segments) > 0) {
+        g_print("[fsearch] searching %u database segments\n", db_get_num_segments(db));
+    }
+    else if (!loaded && daemon->config->system_database) {
+        g_clear_pointer(&db, db_unref);
+        return false;
+    }
+    else if (!loaded) {
+        g_print("[fsearch] the database couldn't be loaded, scan the file system\n");
+        if (!db_scan(db, NULL, NULL)) {
+            g_clear_pointer(&db, db_unref);
+            return false;
+        }
+    }
+    g_mutex_lock(&daemon->mutex);
+    daemon->db = db;
+    daemon_monitor_update(daemon);
+    g_mutex_unlock(&daemon->mutex);
+    return true;
+}
+
+// Returns true if the socket at address is left over from a daemon which didn't exit cleanly, i.e. nothing accepts
+// connections on it anymore
+static bool
+daemon_socket_is_stale(GSocketAddress *address) {
+    g_autoptr(GError) error = NULL;
+    g_autoptr(GSocket) socket =
+        g_socket_new(G_SOCKET_FAMILY_UNIX, G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_DEFAULT, NULL);
+    if (!socket || g_socket_connect(socket, address, NULL, &error)) {
+        return false;
+    }
+    return g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CONNECTION_REFUSED);
+}
+
+static GSocketService *
+daemon_listen(FsearchDaemon *daemon, const char *socket_path) {
+    g_autofree char *socket_dir = g_path_get_dirname(socket_path);
+    if (g_mkdir_with_parents(socket_dir, 0700) != 0) {
+        g_printerr("[fsearch] failed to create %s\n", socket_dir);
+        return NULL;
+    }
+
+    g_autoptr(GSocketAddress) address = g_unix_socket_address_new(socket_path);
+    // a socket which is left over from a daemon which didn't exit cleanly would make binding fail, the one of a
+    // running daemon must be kept
+    if (g_file_test(socket_path, G_FILE_TEST_EXISTS)) {
+        if (!daemon_socket_is_stale(address)) {
+            g_printerr("[fsearch] a daemon is already running on %s\n", socket_path);
+            return NULL;
+        }
+        g_unlink(socket_path);
+    }
+
+    GSocketService *service = g_threaded_socket_service_new(FSEARCH_DAEMON_MAX_CONNECTIONS);
+    g_autoptr(GError) error = NULL;
+    // the socket is created with the permissions of the umask, which must not let others connect to it, not even
+    // for the moment until it's chmod()ed
+    const mode_t old_umask = umask(077);
+    const bool listening = g_socket_listener_add_address(G_SOCKET_LISTENER(service),
+                                                         address,
+                                                         G_SOCKET_TYPE_STREAM,
+                                                         G_SOCKET_PROTOCOL_DEFAULT,
+                                                         NULL,
+                                                         NULL,
+                                                         &error);
+    umask(old_umask);
+    if (!listening) {
+        g_printerr("[fsearch] failed to listen on %s: %s\n", socket_path, error->message);
+        g_clear_object(&service);
+        return NULL;
+    }
+    if (g_chmod(socket_path, 0600) != 0) {
+        g_printerr("[fsearch] failed to restrict the permissions of %s: %s\n", socket_path, g_strerror(errno));
+        g_socket_listener_close(G_SOCKET_LISTENER(service));
+        g_clear_object(&service);
+        g_unlink(socket_path);
+        return NULL;
+    }
+    g_signal_connect(service, "run", G_CALLBACK(on_daemon_connection), daemon);
+    return service;
+}
+
+int
+fsearch_daemon_run(FsearchConfig *config, const char *database_file_path, const char *socket_path) {
+    g_assert(config);
+    g_assert(socket_path);
+
+    FsearchDaemon *daemon = calloc(1, sizeof(FsearchDaemon));
+    g_assert(daemon);
+    daemon->config = config;
+    daemon->loop = g_main_loop_new(NULL, FALSE);
+    g_mutex_init(&daemon->mutex);
+
+    fsearch_thread_pool_set_default_config(config->num_threads, config->pin_threads);
+
+    int res = EXIT_FAILURE;
+    GSocketService *service = NULL;
+    if (!daemon_load_database(daemon, database_file_path)) {
+        g_printerr("[fsearch] failed to load the database\n");
+    }
+    else if ((service = daemon_listen(daemon, socket_path))) {
+        const guint sigint_id = g_unix_signal_add(SIGINT, on_daemon_quit_signal, daemon->loop);
+        const guint sigterm_id = g_unix_signal_add(SIGTERM, on_daemon_quit_signal, daemon->loop);
+        g_print("[fsearch] listening on %s\n", socket_path);
+        g_main_loop_run(daemon->loop);
+        g_source_remove(sigint_id);
+        g_source_remove(sigterm_id);
+
+        g_socket_service_stop(service);
+        g_socket_listener_close(G_SOCKET_LISTENER(service));
+        g_unlink(socket_path);
+        res = EXIT_SUCCESS;
+    }
+    g_clear_object(&service);
+
+    g_mutex_lock(&daemon->mutex);
+    GThread *rescan_thread = g_steal_pointer(&daemon->rescan_thread);
+    daemon->rescan_pending = false;
+    g_mutex_unlock(&daemon->mutex);
+    if (rescan_thread) {
+        g_thread_join(rescan_thread);
+    }
+
+    g_mutex_lock(&daemon->mutex);
+    g_clear_pointer(&daemon->monitor, db_monitor_free);
+    g_clear_pointer(&daemon->db, db_unref);
+    g_mutex_unlock(&daemon->mutex);
+
+    g_clear_pointer(&daemon->loop, g_main_loop_unref);
+    g_mutex_clear(&daemon->mutex);
+    g_clear_pointer(&daemon, free);
+    return res;
+}
+
+char *
+fsearch_daemon_get_default_socket_path(void) {
+    return g_build_filename(g_get_user_runtime_dir(), "fsearch", "fsearch.sock", NULL);
+}
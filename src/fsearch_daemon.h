@@ -0,0 +1,13 @@
+#pragma once
+
+#include "fsearch_config.h"
+
+// Serves searches of the database over a unix socket, without a window, see fsearch_daemon_protocol.h for the
+// protocol. The database is loaded from database_file_path (or scanned if it can't be loaded) and kept up to date
+// with the file system monitor if it's enabled in config. Runs until SIGINT or SIGTERM and returns the exit status.
+int
+fsearch_daemon_run(FsearchConfig *config, const char *database_file_path, const char *socket_path);
+
+// $XDG_RUNTIME_DIR/fsearch/fsearch.sock
+char *
+fsearch_daemon_get_default_socket_path(void);
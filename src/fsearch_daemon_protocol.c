@@ -0,0 +1,174 @@
+#include "fsearch_daemon_protocol.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    const char *name;
+    FsearchQueryFlags flag;
+} FsearchDaemonFlag;
+
+static const FsearchDaemonFlag flags[] = {
+    {"match_case", QUERY_FLAG_MATCH_CASE},
+    {"regex", QUERY_FLAG_REGEX},
+    {"search_in_path", QUERY_FLAG_SEARCH_IN_PATH},
+    {"files_only", QUERY_FLAG_FILES_ONLY},
+    {"folders_only", QUERY_FLAG_FOLDERS_ONLY},
+};
+
+static bool
+parse_uint32(const char *value, uint32_t max, uint32_t *result) {
+    if (!g_ascii_isdigit(value[0])) {
+        return false;
+    }
+    char *end = NULL;
+    const guint64 number = g_ascii_strtoull(value, &end, 10);
+    if (*end != '\0' || number > max) {
+        return false;
+    }
+    *result = (uint32_t)number;
+    return true;
+}
+
+static bool
+parse_bool(const char *value, bool *result) {
+    if (!strcmp(value, "1")) {
+        *result = true;
+        return true;
+    }
+    if (!strcmp(value, "0")) {
+        *result = false;
+        return true;
+    }
+    return false;
+}
+
+static bool
+parse_option(const char *option, FsearchDaemonRequest *request, const char **error_message) {
+    const char *separator = strchr(option, '=');
+    if (!separator) {
+        *error_message = "option without value";
+        return false;
+    }
+    g_autofree char *key = g_strndup(option, separator - option);
+    const char *value = separator + 1;
+
+    if (!strcmp(key, "offset")) {
+        if (!parse_uint32(value, UINT32_MAX, &request->offset)) {
+            *error_message = "invalid offset";
+            return false;
+        }
+        return true;
+    }
+    if (!strcmp(key, "limit")) {
+        if (!parse_uint32(value, FSEARCH_DAEMON_MAX_LIMIT, &request->limit)) {
+            *error_message = "invalid limit";
+            return false;
+        }
+        return true;
+    }
+    if (!strcmp(key, "sort")) {
+        if (!db_index_type_from_short_name(value, &request->sort_order)) {
+            *error_message = "invalid sort order";
+            return false;
+        }
+        return true;
+    }
+    if (!strcmp(key, "order")) {
+        if (!strcmp(value, "asc")) {
+            request->descending = false;
+            return true;
+        }
+        if (!strcmp(value, "desc")) {
+            request->descending = true;
+            return true;
+        }
+        *error_message = "invalid order";
+        return false;
+    }
+    for (uint32_t i = 0; i < G_N_ELEMENTS(flags); i++) {
+        if (strcmp(key, flags[i].name)) {
+            continue;
+        }
+        bool enabled = false;
+        if (!parse_bool(value, &enabled)) {
+            *error_message = "invalid flag value";
+            return false;
+        }
+        if (enabled) {
+            request->flags |= flags[i].flag;
+        }
+        else {
+            request->flags &= ~flags[i].flag;
+        }
+        return true;
+    }
+    *error_message = "unknown option";
+    return false;
+}
+
+bool
+fsearch_daemon_request_parse(const char *line, FsearchDaemonRequest *request, const char **error_message) {
+    g_assert(line);
+    g_assert(request);
+    g_assert(error_message);
+
+    if (!strcmp(line, "PING")) {
+        request->type = FSEARCH_DAEMON_REQUEST_PING;
+        return true;
+    }
+
+    const char *tab = strchr(line, '\t');
+    if (!tab) {
+        *error_message = strncmp(line, "SEARCH", strlen("SEARCH")) ? "unknown request" : "missing query";
+        return false;
+    }
+
+    g_autofree char *head = g_strndup(line, tab - line);
+    g_auto(GStrv) words = g_strsplit(head, " ", -1);
+    if (!words[0] || strcmp(words[0], "SEARCH")) {
+        *error_message = "unknown request";
+        return false;
+    }
+    for (uint32_t i = 1; words[i]; i++) {
+        if (words[i][0] == '\0') {
+            // multiple spaces between options
+            continue;
+        }
+        if (!parse_option(words[i], request, error_message)) {
+            return false;
+        }
+    }
+
+    request->type = FSEARCH_DAEMON_REQUEST_SEARCH;
+    g_free(request->query_text);
+    request->query_text = g_strdup(tab + 1);
+    return true;
+}
+
+void
+fsearch_daemon_request_clear(FsearchDaemonRequest *request) {
+    g_clear_pointer(&request->query_text, g_free);
+}
+
+void
+fsearch_daemon_append_path(GString *response, FsearchDatabaseEntry *entry) {
+    g_autoptr(GString) path = g_string_sized_new(256);
+    db_entry_append_full_path(entry, path);
+    for (const char *c = path->str; *c != '\0'; c++) {
+        switch (*c) {
+        case '\\':
+            g_string_append(response, "\\\\");
+            break;
+        case '\n':
+            g_string_append(response, "\\n");
+            break;
+        case '\r':
+            g_string_append(response, "\\r");
+            break;
+        default:
+            g_string_append_c(response, *c);
+        }
+    }
+    g_string_append_c(response, '\n');
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "fsearch_database_entry.h"
+#include "fsearch_database_index.h"
+#include "fsearch_query_flags.h"
+
+#include <glib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// The line protocol of `fsearch --daemon`. Every request is a single line:
+//
+//   SEARCH [offset=N] [limit=N] [sort=name|path|size|modified|type|extension] [order=asc|desc] [match_case=0|1]
+//          [regex=0|1] [search_in_path=0|1] [folders_only=0|1] [files_only=0|1]<TAB>query text
+//   PING
+//
+// A search is answered with "OK <num_paths> <more>", where more is 1 if there are results after the returned ones,
+// followed by num_paths lines with the full paths of the results. Backslashes, carriage returns and newlines in
+// paths are escaped as \\, \r and \n. Requests which can't be served get "ERROR <message>", PING gets "PONG".
+
+// The number of results a search returns without a limit, and the most it returns with one
+#define FSEARCH_DAEMON_DEFAULT_LIMIT 100
+#define FSEARCH_DAEMON_MAX_LIMIT 100000
+
+typedef enum {
+    FSEARCH_DAEMON_REQUEST_SEARCH,
+    FSEARCH_DAEMON_REQUEST_PING,
+} FsearchDaemonRequestType;
+
+typedef struct FsearchDaemonRequest {
+    FsearchDaemonRequestType type;
+    char *query_text;
+    uint32_t offset;
+    uint32_t limit;
+    FsearchDatabaseIndexType sort_order;
+    bool descending;
+    FsearchQueryFlags flags;
+} FsearchDaemonRequest;
+
+// Returns false and sets error_message (a static string) if line isn't a valid request. The options which are
+// missing from a search keep the values request had, so it can be initialized with the defaults of the daemon.
+bool
+fsearch_daemon_request_parse(const char *line, FsearchDaemonRequest *request, const char **error_message);
+
+void
+fsearch_daemon_request_clear(FsearchDaemonRequest *request);
+
+// Appends the full path of entry as a line of a response
+void
+fsearch_daemon_append_path(GString *response, FsearchDatabaseEntry *entry);
@@ -23,8 +23,8 @@
 #define G_LOG_DOMAIN "fsearch-database"
 
 #include <dirent.h>
+#include <errno.h>
 #include <fcntl.h>
-#include <fnmatch.h>
 #include <glib/gi18n.h>
 
 #ifdef HAVE_MALLOC_TRIM
@@ -35,30 +35,318 @@
 #include <stdio.h>
 #include <string.h>
 #include <sys/file.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#ifdef HAVE_GETDENTS64
+#include <sys/syscall.h>
+#endif
+#ifdef HAVE_IO_URING
+#include <liburing.h>
+#include <sys/sysmacros.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
 #include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 #include "fsearch_database.h"
+#include "fsearch_access_filter.h"
+#include "fsearch_database_columns.h"
 #include "fsearch_database_entry.h"
+#include "fsearch_database_extensions.h"
+#include "fsearch_database_file_types.h"
+#include "fsearch_database_folded_names.h"
+#include "fsearch_database_metadata.h"
+#include "fsearch_database_search.h"
+#include "fsearch_database_trigrams.h"
+#include "fsearch_database_scan_stats.h"
+#include "fsearch_exclude_matcher.h"
 #include "fsearch_exclude_path.h"
 #include "fsearch_index.h"
+#include "fsearch_limits.h"
 #include "fsearch_memory_pool.h"
+#include "fsearch_string_arena.h"
 #include "fsearch_task.h"
+#include "fsearch_trace.h"
 
 #define NUM_DB_ENTRIES_FOR_POOL_BLOCK 10000
-
-#define DATABASE_MAJOR_VERSION 0
-#define DATABASE_MINOR_VERSION 9
+#define DIRENT_BUFFER_SIZE (64 * 1024)
+#define SCAN_STAT_BATCH_SIZE 256
+// the number of filters whose matches db_get_filter_matches keeps
+#define MAX_CACHED_FILTER_MATCHES 8
+// below that many entries their indices are updated on the calling thread
+#define DATABASE_UPDATE_INDICES_RANGE_SIZE (64 * 1024)
+
+#define DATABASE_MAJOR_VERSION 1
+#define DATABASE_MINOR_VERSION 3
+// the first minor version with the scan time in its header
+#define DATABASE_MINOR_VERSION_SCAN_TIME 3
 #define DATABASE_MAGIC_NUMBER "FSDB"
 
+// Version of the files written before the database was memory mapped, they can still be loaded
+#define DATABASE_LEGACY_MAJOR_VERSION 0
+#define DATABASE_LEGACY_MINOR_VERSION 9
+
+// The file consists of a DatabaseFileHeader, followed by a table of DatabaseFileSection and the sections.
+// Every section starts at a multiple of DATABASE_SECTION_ALIGNMENT, so the arrays in it can be accessed in place
+// when the file is mapped into memory. All values are stored in host byte order.
+//
+// Compressed files only consist of a DatabaseFileHeader with DATABASE_FILE_FLAG_COMPRESSED set, followed by a table
+// of DatabaseFileBlock and the blocks. Each block holds DATABASE_FILE_BLOCK_SIZE bytes (except for the last one)
+// of the uncompressed file and can be decompressed on its own.
+#define DATABASE_SECTION_ALIGNMENT 64
+#define DATABASE_SAVE_BUFFER_SIZE (1 << 20)
+#define DATABASE_FILE_BLOCK_SIZE (1 << 20)
+#define DATABASE_FILE_COMPRESSION_LEVEL 3
+
+#define DATABASE_FILE_FLAG_COMPRESSED (1 << 0)
+
+typedef struct DatabaseFileHeader {
+    char magic[4];
+    uint8_t major_version;
+    uint8_t minor_version;
+    uint16_t flags;
+    uint64_t index_flags;
+    uint32_t num_folders;
+    uint32_t num_files;
+    uint32_t num_sections;
+    // only used by compressed files
+    uint32_t num_blocks;
+    // when the scan which found the entries started (seconds since the epoch), the header of older files ends before
+    int64_t scan_time;
+} DatabaseFileHeader;
+
+#define DATABASE_FILE_MIN_HEADER_SIZE offsetof(DatabaseFileHeader, scan_time)
+
+static size_t
+db_file_header_get_size(const DatabaseFileHeader *header) {
+    return header->minor_version >= DATABASE_MINOR_VERSION_SCAN_TIME ? sizeof(DatabaseFileHeader)
+                                                                      : DATABASE_FILE_MIN_HEADER_SIZE;
+}
+
+static bool
+db_file_header_is_complete(const uint8_t *data, size_t size) {
+    return size >= DATABASE_FILE_MIN_HEADER_SIZE
+        && size >= db_file_header_get_size((const DatabaseFileHeader *)data);
+}
+
+typedef struct DatabaseFileSection {
+    uint32_t id;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+} DatabaseFileSection;
+
+typedef struct DatabaseFileBlock {
+    uint64_t offset;
+    uint32_t size;
+    // the same as size if the block is stored uncompressed
+    uint32_t compressed_size;
+} DatabaseFileBlock;
+
+// The sections of folders and files both come in the same order: names (NUL terminated, in order of the entries),
+// parent folder indices (uint32), sizes (uint64) and modification times (int64). Sizes and modification times
+// are only present if they're part of the index flags.
+typedef enum {
+    DATABASE_SECTION_FOLDER_NAMES = 1,
+    DATABASE_SECTION_FILE_NAMES = 5,
+    // the indexes and excludes the database was scanned with, a DatabaseFileIndex or DatabaseFileExclude each,
+    // followed by the path (without a terminating NUL)
+    DATABASE_SECTION_INDEXES = 0x10,
+    DATABASE_SECTION_EXCLUDES = 0x11,
+    // the folded names of folders and files (see FsearchDatabaseFoldedNames), a DatabaseFileFoldedNames followed
+    // by the NUL terminated names in the order of the entries, empty if it's the same as the name
+    DATABASE_SECTION_FOLDED_FOLDER_NAMES = 0x12,
+    DATABASE_SECTION_FOLDED_FILE_NAMES = 0x13,
+    // the trigram index of folders and files (see FsearchDatabaseTrigrams), a DatabaseFileTrigrams followed by the
+    // keys (uint32), the number of entries which contain each key (uint32), the offsets of their posting lists
+    // (uint64, one more than there are keys) and the posting lists
+    DATABASE_SECTION_FOLDER_TRIGRAMS = 0x14,
+    DATABASE_SECTION_FILE_TRIGRAMS = 0x15,
+    // the ids of the folders (see db_entry_folder_get_id), a DatabaseFileFolderIds followed by the ids (uint32) in
+    // the order of the folders
+    DATABASE_SECTION_FOLDER_IDS = 0x16,
+    // offsets (uint64) of every DATABASE_FILE_CHUNK_SIZE'th name into the names section, combined with the id
+    // of the names section, so the names can be decoded in chunks on multiple threads
+    DATABASE_SECTION_NAME_CHUNKS = 0x80,
+    // sorted arrays (uint32 entry indices), combined with the FsearchDatabaseIndexType of their sort order
+    DATABASE_SECTION_SORTED_FOLDERS = 0x100,
+    DATABASE_SECTION_SORTED_FILES = 0x200,
+    // the metadata columns of folders and files (see FsearchDatabaseMetadata), combined with their
+    // FsearchDatabaseMetadataColumn. A DatabaseFileMetadataColumn followed by the ids (uint32, padded to 8 bytes) and
+    // the packed values (uint64 words). Timestamps are stored as zigzag encoded varints of their difference to the
+    // modification time of the entry instead (or to 0 without modification times), most of them only take a byte.
+    DATABASE_SECTION_FOLDER_METADATA = 0x400,
+    DATABASE_SECTION_FILE_METADATA = 0x800,
+} DatabaseSectionId;
+
+typedef struct DatabaseFileFoldedNames {
+    // the names are only used if they were folded with the same options
+    uint32_t fold_options;
+    uint32_t reserved;
+} DatabaseFileFoldedNames;
+
+typedef struct DatabaseFileTrigrams {
+    uint32_t num_keys;
+    uint32_t reserved;
+} DatabaseFileTrigrams;
+
+typedef struct DatabaseFileFolderIds {
+    uint32_t next_id;
+    uint32_t reserved;
+} DatabaseFileFolderIds;
+
+typedef struct DatabaseFileMetadataColumn {
+    // only the uid and gid columns have ids
+    uint32_t num_ids;
+    // the number of bits of each packed value, 0 if they're varint encoded timestamps
+    uint32_t bits;
+} DatabaseFileMetadataColumn;
+
+#define DATABASE_SECTION_OFFSET_PARENTS 1
+#define DATABASE_SECTION_OFFSET_SIZES 2
+#define DATABASE_SECTION_OFFSET_MTIMES 3
+#define DATABASE_SECTION_INDEX_TYPE_MASK 0xff
+#define DATABASE_FILE_MAX_SECTIONS (16 + 2 * NUM_DATABASE_INDEX_TYPES + 2 * NUM_DATABASE_METADATA_COLUMNS)
+#define DATABASE_FILE_CHUNK_SIZE 65536
+// parent index of root folders
+#define DATABASE_FILE_NO_PARENT UINT32_MAX
+
+#define DATABASE_FILE_INDEX_FLAG_ENABLED (1 << 0)
+#define DATABASE_FILE_INDEX_FLAG_UPDATE (1 << 1)
+#define DATABASE_FILE_INDEX_FLAG_ONE_FILESYSTEM (1 << 2)
+
+typedef struct DatabaseFileIndex {
+    uint8_t type;
+    uint8_t flags;
+    uint16_t reserved;
+    uint32_t path_len;
+    int64_t last_updated;
+} DatabaseFileIndex;
+
+typedef enum {
+    DATABASE_FILE_EXCLUDE_PATH = 1,
+    DATABASE_FILE_EXCLUDE_PATTERN,
+    // hidden files and folders, without a path
+    DATABASE_FILE_EXCLUDE_HIDDEN,
+} DatabaseFileExcludeType;
+
+typedef struct DatabaseFileExclude {
+    uint8_t type;
+    uint8_t enabled;
+    uint16_t reserved;
+    uint32_t path_len;
+} DatabaseFileExclude;
+
+// The part of the memory budget of the low memory mode which the results of recent searches may use at most, the
+// rest is left to the entries
+#define DATABASE_LOW_MEMORY_SEARCH_CACHE_SHARE 8
+
+// Changes which were applied after the database file was saved are appended to a journal next to it.
+// It consists of a DatabaseJournalHeader, followed by DatabaseJournalRecord, each of them followed by the
+// path of the entry (without a terminating NUL). When the journal reaches DATABASE_JOURNAL_MAX_SIZE_RATIO of the
+// size of the database file, the whole database gets saved again. The records of version 1 end before the uid.
+#define DATABASE_JOURNAL_SUFFIX ".journal"
+#define DATABASE_JOURNAL_MAGIC_NUMBER "FSDJ"
+#define DATABASE_JOURNAL_VERSION 2
+#define DATABASE_JOURNAL_MAX_SIZE_RATIO 0.1
+
+// Identifies a database file, so a journal can't be applied to a different one
+typedef struct DatabaseFileId {
+    uint64_t ino;
+    uint64_t size;
+    int64_t mtime;
+} DatabaseFileId;
+
+typedef struct DatabaseJournalHeader {
+    char magic[4];
+    uint8_t version;
+    uint8_t reserved[3];
+    DatabaseFileId base_file_id;
+} DatabaseJournalHeader;
+
+typedef enum {
+    DATABASE_JOURNAL_RECORD_ADD = 1,
+    DATABASE_JOURNAL_RECORD_REMOVE,
+    DATABASE_JOURNAL_RECORD_UPDATE,
+} DatabaseJournalRecordType;
+
+// the record has the metadata columns of the entry
+#define DATABASE_JOURNAL_RECORD_FLAG_METADATA (1 << 0)
+
+typedef struct DatabaseJournalRecord {
+    uint8_t type;
+    uint8_t is_folder;
+    uint16_t flags;
+    uint32_t path_len;
+    int64_t size;
+    int64_t mtime;
+    uint32_t uid;
+    uint32_t gid;
+    uint32_t mode;
+    uint32_t reserved;
+    int64_t atime;
+    int64_t ctime;
+    int64_t btime;
+} DatabaseJournalRecord;
+
+// The metadata of an entry, until db_update_metadata stores it in the metadata of the database
+typedef struct DatabaseMetadataRecord {
+    FsearchDatabaseEntry *entry;
+    FsearchDatabaseEntryMetadata values;
+} DatabaseMetadataRecord;
+
 struct FsearchDatabase {
     DynamicArray *sorted_files[NUM_DATABASE_INDEX_TYPES];
     DynamicArray *sorted_folders[NUM_DATABASE_INDEX_TYPES];
-
+    // the columns which were last requested by db_get_columns and db_get_folder_paths, until the entries change
+    FsearchDatabaseColumns *folder_columns;
+    FsearchDatabaseColumns *file_columns;
+    FsearchDatabaseFolderPaths *folder_paths;
+    // the ranks of the sorted arrays which were requested by db_get_ranks, until the entries change
+    FsearchDatabaseRanks *folder_ranks[NUM_DATABASE_INDEX_TYPES];
+    FsearchDatabaseRanks *file_ranks[NUM_DATABASE_INDEX_TYPES];
+    // the folded names which were last requested by db_get_folded_names. They're kept when the entries change,
+    // so the next ones can take the names of all entries which are still the same from them.
+    FsearchDatabaseFoldedNames *folded_names;
+    // the extension ids which were last built by db_sort or requested by db_get_extensions, until the entries change
+    FsearchDatabaseExtensions *extensions;
+    // the types of the files, built from the extension ids when the files are first sorted by type
+    FsearchDatabaseFileTypes *file_types;
+    // the files with the same contents which were last found by db_get_duplicates, until the entries change
+    FsearchDuplicates *duplicates;
+    // looks for them in the background, see db_get_duplicates
+    struct DatabaseDuplicatesJob *duplicates_job;
+    // guards duplicates_job and whether it's done, which gets signalled with duplicates_cond
+    GMutex duplicates_mutex;
+    GCond duplicates_cond;
+    void (*duplicates_found_func)(gpointer);
+    gpointer duplicates_found_func_data;
+    // the results of recent searches, until the entries change
+    FsearchDatabaseSearchCache *search_cache;
+    // the trigram index which was last requested by db_get_trigrams, until the entries change
+    FsearchDatabaseTrigrams *trigrams;
+    // the DatabaseSearchFilterMatches of the filters which were last requested by db_get_filter_matches (the most
+    // recent one last), until the entries change
+    GPtrArray *filter_matches;
+    // the owners, permissions and other timestamps of the entries in the name arrays, NULL if none of them are indexed
+    FsearchDatabaseMetadata *metadata;
+    // DatabaseMetadataRecord of the entries which were scanned or changed since, they're added by db_update_metadata
+    GArray *metadata_records;
+
+    // The entries don't own their names, they either point into file_contents or names. That's why the pools are
+    // freed without visiting each entry.
     FsearchMemoryPool *file_pool;
     FsearchMemoryPool *folder_pool;
+    FsearchStringArena *names;
+    // the id of the next folder which isn't part of a previous database, see db_entry_folder_get_id
+    uint32_t next_folder_id;
 
     GList *db_views;
     FsearchThreadPool *thread_pool;
@@ -68,21 +356,159 @@ struct FsearchDatabase {
     GList *indexes;
     GList *excludes;
     char **exclude_files;
+    // compiled form of excludes and exclude_files, which is used to filter entries
+    FsearchExcludeMatcher *exclude_matcher;
 
     bool exclude_hidden;
+    // scan and sort with as little impact on the rest of the system as possible
+    bool low_impact;
     time_t timestamp;
+    // statistics of the last scan, NULL if the database was loaded from a file
+    FsearchDatabaseScanStats *scan_stats;
+    // the loaded database file (mapped or decompressed), entry names point into it
+    GBytes *file_contents;
+    // hides the entries the user can't list from search results, NULL if all of them are shown
+    FsearchAccessFilter *access_filter;
+    // compress the database file when it's saved
+    bool compress;
+    // the database file which was loaded or saved last, the journal refers to it
+    DatabaseFileId base_file_id;
+    // encoded DatabaseJournalRecord of the changes which were applied since then and aren't part of the journal yet
+    GByteArray *journal;
+    // a sort order was added with db_set_entries_sorted, which isn't part of the database file yet
+    bool sorted_arrays_changed;
+    // only sort by name up front, all other orders get loaded or sorted when db_ensure_entries_sorted needs them
+    bool lazy_sort_indexes;
+    // the low memory mode is on if it isn't 0, see db_set_memory_budget
+    size_t memory_budget;
+    // the size the search cache was set to, the low memory mode might allow less
+    size_t search_cache_size;
+    // the sorted sections of file_contents weren't loaded yet and still match the name arrays
+    bool sorted_sections_pending;
+    // db_load only decodes what's needed to search, db_load_remaining does the rest
+    bool progressive_load;
+    // db_sort only sorted by path and name, db_load_remaining sorts the other orders
+    bool sort_orders_pending;
+    // the sizes and modification times in file_contents weren't loaded into the entries yet
+    bool metadata_pending;
+    // the folded names in file_contents weren't loaded yet and still match the name arrays
+    bool folded_names_pending;
+    // keep a trigram index of the names, so searches for longer terms only have to check a few candidates
+    bool trigram_index;
+    // the trigrams in file_contents weren't loaded yet and still match the name arrays
+    bool trigrams_pending;
+    // the number of threads which scan the indexes, 0 uses as many as the thread pool has
+    uint32_t num_scan_threads;
+    // in ms, see db_set_scan_timeouts
+    uint32_t scan_call_timeout;
+    uint32_t scan_root_timeout;
+    // the databases which were added with db_add_segment, they own the memory of their entries
+    GPtrArray *segments;
+
+    // changes made by db_sync_entry, which haven't been applied to the sorted arrays yet
+    struct DatabaseChanges *changes;
+    // what's currently being written by db_save_in_background
+    struct DatabaseSnapshot *snapshot;
 
     volatile int ref_count;
 
-    GMutex mutex;
+    // searches only need the shared lock, everything else takes the exclusive one
+    GRWLock lock;
+    // guards what the getters build on demand (e.g. db_get_columns), since searches of several views can hold the
+    // shared lock at the same time
+    GRecMutex cache_mutex;
+
+    // the sorted arrays as they were when the lock was released last, readers pin it without locking
+    FsearchDatabaseVersion *version;
+    // the number of readers in db_pin_version, the previous version is only released once there are none
+    volatile gint num_pinning;
+    // serializes the writers of version
+    GMutex version_mutex;
+    uint64_t next_version_id;
+};
+
+typedef struct DatabaseDuplicatesJob {
+    FsearchDatabase *db;
+    // the candidates it reads, so it doesn't need the entries or any lock of the database
+    FsearchDuplicatesSnapshot *snapshot;
+    FsearchDuplicates *result;
+    // cancelled once the entries change, the result is out of date then
+    GCancellable *cancellable;
+    GThread *thread;
+    bool done;
+    void (*found_func)(gpointer);
+    gpointer found_func_data;
+} DatabaseDuplicatesJob;
+
+typedef struct DatabaseChanges {
+    // new entries, they're not part of the sorted arrays yet
+    DynamicArray *added_files;
+    DynamicArray *added_folders;
+    // lookup for the new entries by parent and name
+    GHashTable *added_entries;
+
+    // entries whose size or modification time changed, they need to be moved in the respective sorted arrays
+    DynamicArray *updated_files;
+    DynamicArray *updated_folders;
+
+    // entries which were marked as removed, without the contents of removed folders
+    DynamicArray *removed_entries;
+    // entry -> FsearchDatabaseEntryMetadata of added and updated entries, if the database has metadata columns
+    GHashTable *metadata;
+
+    uint32_t num_removed_files;
+    uint32_t num_removed_folders;
+    bool folder_sizes_changed;
+} DatabaseChanges;
+
+enum {
+    DATABASE_ENTRY_MARK_NONE = 0,
+    // the entry (and all of its children) will be removed from the sorted arrays
+    DATABASE_ENTRY_MARK_REMOVED,
+    // the entry needs to be moved to its new position in the size and modification time arrays
+    DATABASE_ENTRY_MARK_UPDATED,
 };
 
 enum {
     WALK_OK = 0,
     WALK_BADIO,
     WALK_CANCEL,
+    // a filesystem call or the whole root took longer than the scan timeouts allow
+    WALK_TIMEOUT,
 };
 
+static void
+db_changes_free(DatabaseChanges *changes);
+
+static DynamicArray *
+db_merge_changes(DynamicArray *entries, DynamicArray *added, DynamicArrayCompareDataFunc compare_func, bool skip_updated);
+
+static DynamicArrayCompareDataFunc
+db_get_compare_func(FsearchDatabaseIndexType type);
+
+static void
+db_file_id_init(DatabaseFileId *id, const struct stat *st);
+
+static void
+db_publish_version(FsearchDatabase *db);
+
+static void
+db_duplicates_job_free(DatabaseDuplicatesJob *job);
+
+static void
+db_journal_load(FsearchDatabase *db, const char *file_path);
+
+static void
+thread_lower_priority(void);
+
+static FsearchIndex *
+db_find_index(FsearchDatabase *db, const char *path);
+
+static void
+db_entry_set_name_in_arena(FsearchDatabaseEntry *entry, FsearchStringArena *names, const char *name) {
+    db_entry_set_name_borrowed(entry, fsearch_string_arena_add(names, name));
+}
+
 bool
 db_register_view(FsearchDatabase *db, gpointer view) {
     if (g_list_find(db->db_views, view)) {
@@ -103,12 +529,42 @@ db_unregister_view(FsearchDatabase *db, gpointer view) {
     return true;
 }
 
+static void
+db_clear_columns(FsearchDatabase *db) {
+    g_clear_pointer(&db->folder_columns, db_columns_unref);
+    g_clear_pointer(&db->file_columns, db_columns_unref);
+    g_clear_pointer(&db->folder_paths, db_folder_paths_unref);
+    for (uint32_t i = 0; i < NUM_DATABASE_INDEX_TYPES; i++) {
+        g_clear_pointer(&db->folder_ranks[i], db_ranks_unref);
+        g_clear_pointer(&db->file_ranks[i], db_ranks_unref);
+    }
+    g_clear_pointer(&db->extensions, db_extensions_unref);
+    g_clear_pointer(&db->file_types, db_file_types_unref);
+    g_clear_pointer(&db->duplicates, fsearch_duplicates_unref);
+    if (db->duplicates_job) {
+        g_cancellable_cancel(db->duplicates_job->cancellable);
+    }
+    if (db->filter_matches) {
+        g_ptr_array_set_size(db->filter_matches, 0);
+    }
+    db_search_cache_clear(db->search_cache);
+}
+
 static void
 db_sorted_entries_free(FsearchDatabase *db) {
+    db_clear_columns(db);
     for (uint32_t i = 0; i < NUM_DATABASE_INDEX_TYPES; i++) {
         g_clear_pointer(&db->sorted_files[i], darray_unref);
         g_clear_pointer(&db->sorted_folders[i], darray_unref);
     }
+    g_clear_pointer(&db->folded_names, db_folded_names_unref);
+    g_clear_pointer(&db->trigrams, db_trigrams_unref);
+    g_clear_pointer(&db->metadata, db_metadata_unref);
+    g_array_set_size(db->metadata_records, 0);
+    db->sorted_sections_pending = false;
+    db->metadata_pending = false;
+    db->folded_names_pending = false;
+    db->trigrams_pending = false;
 }
 
 static bool
@@ -119,28 +575,91 @@ is_cancelled(GCancellable *cancellable) {
     return false;
 }
 
+// The low memory mode keeps only the name order, like lazy_sort_indexes
+static bool
+db_sorts_lazily(FsearchDatabase *db) {
+    return db->lazy_sort_indexes || db->memory_budget > 0;
+}
+
+static void
+db_sort_array(FsearchDatabase *db,
+              DynamicArray *array,
+              DynamicArrayCompareDataFunc compare_func,
+              GCancellable *cancellable) {
+    if (db->low_impact) {
+        // leave the other cores to the rest of the system
+        darray_sort(array, compare_func, cancellable, NULL);
+        return;
+    }
+    darray_sort_multi_threaded(array, compare_func, cancellable, NULL);
+}
+
+// Sizes and times are signed, flipping the sign bit keeps negative ones in front when they're compared as unsigned keys
+static uint64_t
+db_entry_get_size_key(FsearchDatabaseEntry *entry) {
+    return (uint64_t)db_entry_get_size(entry) ^ ((uint64_t)1 << 63);
+}
+
+static uint64_t
+db_entry_get_mtime_key(FsearchDatabaseEntry *entry) {
+    return (uint64_t)db_entry_get_mtime(entry) ^ ((uint64_t)1 << 63);
+}
+
+static DynamicArrayKeyFunc
+db_get_key_func(FsearchDatabaseIndexType sort_type) {
+    switch (sort_type) {
+    case DATABASE_INDEX_TYPE_NAME:
+        return (DynamicArrayKeyFunc)db_entry_get_name_sort_key;
+    case DATABASE_INDEX_TYPE_SIZE:
+        return (DynamicArrayKeyFunc)db_entry_get_size_key;
+    case DATABASE_INDEX_TYPE_MODIFICATION_TIME:
+        return (DynamicArrayKeyFunc)db_entry_get_mtime_key;
+    default:
+        return NULL;
+    }
+}
+
+// Numeric orders are sorted by their keys, which is stable like the merge sort, so entries with the same key stay
+// in the order of array (i.e. by name) either way
+static void
+db_sort_array_by_type(FsearchDatabase *db,
+                      DynamicArray *array,
+                      FsearchDatabaseIndexType sort_type,
+                      GCancellable *cancellable) {
+    DynamicArrayKeyFunc key_func = db_get_key_func(sort_type);
+    if (key_func) {
+        // names are only sorted by their prefix, those with the same one still need to be compared
+        darray_sort_by_key(array,
+                           key_func,
+                           sort_type == DATABASE_INDEX_TYPE_NAME ? db_get_compare_func(sort_type) : NULL,
+                           !db->low_impact,
+                           cancellable);
+        return;
+    }
+    db_sort_array(db, array, db_get_compare_func(sort_type), cancellable);
+}
+
 static void
 db_sort_entries(FsearchDatabase *db, DynamicArray *entries, DynamicArray **sorted_entries, GCancellable *cancellable) {
     // first sort by path
-    darray_sort_multi_threaded(entries, (DynamicArrayCompareDataFunc)db_entry_compare_entries_by_path, cancellable, NULL);
+    db_sort_array(db, entries, (DynamicArrayCompareDataFunc)db_entry_compare_entries_by_path, cancellable);
     if (is_cancelled(cancellable)) {
         return;
     }
-    sorted_entries[DATABASE_INDEX_TYPE_PATH] = darray_copy(entries);
+    if (!db_sorts_lazily(db)) {
+        sorted_entries[DATABASE_INDEX_TYPE_PATH] = darray_copy(entries);
+    }
 
     // then by name
-    darray_sort(entries, (DynamicArrayCompareDataFunc)db_entry_compare_entries_by_name, cancellable, NULL);
-    if (is_cancelled(cancellable)) {
+    db_sort_array_by_type(db, entries, DATABASE_INDEX_TYPE_NAME, cancellable);
+    if (is_cancelled(cancellable) || db_sorts_lazily(db) || db->progressive_load) {
         return;
     }
 
     // now build individual lists sorted by all of the indexed metadata
     if ((db->index_flags & DATABASE_INDEX_FLAG_SIZE) != 0) {
         sorted_entries[DATABASE_INDEX_TYPE_SIZE] = darray_copy(entries);
-        darray_sort_multi_threaded(sorted_entries[DATABASE_INDEX_TYPE_SIZE],
-                                   (DynamicArrayCompareDataFunc)db_entry_compare_entries_by_size,
-                                   cancellable,
-                                   NULL);
+        db_sort_array_by_type(db, sorted_entries[DATABASE_INDEX_TYPE_SIZE], DATABASE_INDEX_TYPE_SIZE, cancellable);
         if (is_cancelled(cancellable)) {
             return;
         }
@@ -148,16 +667,212 @@ db_sort_entries(FsearchDatabase *db, DynamicArray *entries, DynamicArray **sorte
 
     if ((db->index_flags & DATABASE_INDEX_FLAG_MODIFICATION_TIME) != 0) {
         sorted_entries[DATABASE_INDEX_TYPE_MODIFICATION_TIME] = darray_copy(entries);
-        darray_sort_multi_threaded(sorted_entries[DATABASE_INDEX_TYPE_MODIFICATION_TIME],
-                                   (DynamicArrayCompareDataFunc)db_entry_compare_entries_by_modification_time,
-                                   cancellable,
-                                   NULL);
+        db_sort_array_by_type(db,
+                              sorted_entries[DATABASE_INDEX_TYPE_MODIFICATION_TIME],
+                              DATABASE_INDEX_TYPE_MODIFICATION_TIME,
+                              cancellable);
         if (is_cancelled(cancellable)) {
             return;
         }
     }
 }
 
+static void
+db_entries_update_indices_range(uint32_t start, uint32_t end, void *data) {
+    DynamicArray *entries = data;
+    for (uint32_t i = start; i < end; i++) {
+        FsearchDatabaseEntry *entry = darray_get_item(entries, i);
+        if (!entry) {
+            continue;
+        }
+        db_entry_set_idx(entry, i);
+    }
+}
+
+static void
+db_entries_update_indices(FsearchDatabase *db, DynamicArray *entries) {
+    if (!entries) {
+        return;
+    }
+    // every entry gets touched once, for millions of them that's mostly waiting for memory
+    fsearch_thread_pool_parallel_for(db->thread_pool,
+                                     darray_get_num_items(entries),
+                                     DATABASE_UPDATE_INDICES_RANGE_SIZE,
+                                     db_entries_update_indices_range,
+                                     entries,
+                                     NULL);
+}
+
+static void
+db_entry_update_folder_indices(FsearchDatabase *db) {
+    if (!db) {
+        return;
+    }
+    db_entries_update_indices(db, db->sorted_folders[DATABASE_INDEX_TYPE_NAME]);
+}
+
+static void
+db_entry_update_file_indices(FsearchDatabase *db) {
+    if (!db) {
+        return;
+    }
+    db_entries_update_indices(db, db->sorted_files[DATABASE_INDEX_TYPE_NAME]);
+}
+
+static bool
+db_has_metadata_columns(FsearchDatabase *db) {
+    return (db->index_flags & DATABASE_INDEX_FLAGS_METADATA) != 0;
+}
+
+// The creation time isn't part of struct stat, only statx reports it (on filesystems which record it)
+static time_t
+db_get_creation_time(int dir_fd, const char *name, int flags) {
+#ifdef HAVE_STATX
+    struct statx stx;
+    if (statx(dir_fd, name, flags, STATX_BTIME, &stx) == 0 && (stx.stx_mask & STATX_BTIME) != 0) {
+        return (time_t)stx.stx_btime.tv_sec;
+    }
+#endif
+    return 0;
+}
+
+// name is relative to dir_fd, it's only used to look up the creation time if that's indexed
+static void
+db_entry_metadata_init(FsearchDatabase *db,
+                       FsearchDatabaseEntryMetadata *values,
+                       const struct stat *st,
+                       int dir_fd,
+                       const char *name,
+                       int flags) {
+    values->uid = st->st_uid;
+    values->gid = st->st_gid;
+    values->mode = (uint16_t)st->st_mode;
+    values->atime = st->st_atime;
+    values->ctime = st->st_ctime;
+    values->btime =
+        (db->index_flags & DATABASE_INDEX_FLAG_CREATION_TIME) != 0 ? db_get_creation_time(dir_fd, name, flags) : 0;
+}
+
+static void
+db_add_metadata_record(GArray *records, FsearchDatabaseEntry *entry, const FsearchDatabaseEntryMetadata *values) {
+    const DatabaseMetadataRecord record = {.entry = entry, .values = *values};
+    g_array_append_val(records, record);
+}
+
+// Builds the metadata of the name arrays again. The values of the entries which are part of sources are taken from
+// them, those in metadata_records are added on top. Has to happen before the indexes of the entries change, the
+// sources look them up by their index.
+static void
+db_update_metadata(FsearchDatabase *db, FsearchDatabaseMetadata **sources, uint32_t num_sources) {
+    DynamicArray *folders = db->sorted_folders[DATABASE_INDEX_TYPE_NAME];
+    DynamicArray *files = db->sorted_files[DATABASE_INDEX_TYPE_NAME];
+    if (!db_has_metadata_columns(db) || !folders || !files) {
+        g_clear_pointer(&db->metadata, db_metadata_unref);
+        g_array_set_size(db->metadata_records, 0);
+        return;
+    }
+
+    g_autoptr(GTimer) timer = g_timer_new();
+    FsearchDatabaseMetadata *metadata = db_metadata_new(db->index_flags, folders, files);
+    for (uint32_t i = 0; i < num_sources; i++) {
+        db_metadata_copy(metadata, sources[i]);
+    }
+    db_entry_update_folder_indices(db);
+    db_entry_update_file_indices(db);
+    for (uint32_t i = 0; i < db->metadata_records->len; i++) {
+        DatabaseMetadataRecord *record = &g_array_index(db->metadata_records, DatabaseMetadataRecord, i);
+        const bool is_folder = db_entry_is_folder(record->entry);
+        DynamicArray *entries = is_folder ? folders : files;
+        const uint32_t idx = db_entry_get_idx(record->entry);
+        // entries which were removed again aren't part of the name arrays
+        if (idx < darray_get_num_items(entries) && darray_get_item(entries, idx) == record->entry) {
+            db_metadata_set(metadata, is_folder, idx, &record->values);
+        }
+    }
+    db_metadata_seal(metadata);
+    g_array_set_size(db->metadata_records, 0);
+    g_clear_pointer(&db->metadata, db_metadata_unref);
+    db->metadata = metadata;
+    g_debug("[db_update_metadata] stored the metadata of %d entries in %f s",
+            darray_get_num_items(folders) + darray_get_num_items(files),
+            g_timer_elapsed(timer, NULL));
+}
+
+// Folders which are new to the database get an id none of its previous folders had
+static void
+db_assign_folder_ids(FsearchDatabase *db, DynamicArray *folders) {
+    const uint32_t num_folders = folders ? darray_get_num_items(folders) : 0;
+    for (uint32_t i = 0; i < num_folders; i++) {
+        FsearchDatabaseEntryFolder *folder = darray_get_item(folders, i);
+        if (db_entry_folder_get_id(folder) != 0) {
+            continue;
+        }
+        if (db->next_folder_id == 0) {
+            // it wrapped around, ids are only a hint, which has to be verified anyway
+            db->next_folder_id = 1;
+        }
+        db_entry_folder_set_id(folder, db->next_folder_id++);
+    }
+}
+
+static FsearchDatabaseExtensions *
+db_ensure_extensions(FsearchDatabase *db) {
+    DynamicArray *files = db->sorted_files[DATABASE_INDEX_TYPE_NAME];
+    if (!files) {
+        return NULL;
+    }
+    if (!db->extensions || db->extensions->files != files) {
+        g_autoptr(GTimer) timer = g_timer_new();
+        g_clear_pointer(&db->extensions, db_extensions_unref);
+        db->extensions = db_extensions_new(files);
+        // the ids are looked up by the index of the files, which has to be their position in the name array
+        db_entry_update_file_indices(db);
+        g_debug("[db_extensions] interned %d extensions of %d files in %f s",
+                db_extensions_get_num_ids(db->extensions),
+                darray_get_num_items(files),
+                g_timer_elapsed(timer, NULL));
+    }
+    return db->extensions;
+}
+
+static FsearchDatabaseFileTypes *
+db_ensure_file_types(FsearchDatabase *db) {
+    FsearchDatabaseExtensions *extensions = db_ensure_extensions(db);
+    if (!extensions) {
+        return NULL;
+    }
+    if (!db->file_types || db->file_types->extensions != extensions) {
+        g_autoptr(GTimer) timer = g_timer_new();
+        g_clear_pointer(&db->file_types, db_file_types_unref);
+        db->file_types = db_file_types_new(extensions);
+        g_debug("[db_file_types] found %d types of %d files in %f s",
+                db_file_types_get_num_ids(db->file_types),
+                darray_get_num_items(extensions->files),
+                g_timer_elapsed(timer, NULL));
+    }
+    return db->file_types;
+}
+
+// The path ranks of folders are only comparable if they were computed together, so the folders which end up in the
+// same database (e.g. the scanned ones and those kept from the previous database) are ranked at once
+static void
+db_update_folder_ranks(DynamicArray **folder_arrays, uint32_t num_arrays) {
+    g_autoptr(GTimer) timer = g_timer_new();
+    uint32_t num_folders = 0;
+    for (uint32_t i = 0; i < num_arrays; i++) {
+        num_folders += folder_arrays[i] ? darray_get_num_items(folder_arrays[i]) : 0;
+    }
+    DynamicArray *folders = darray_new(MAX(num_folders, 1));
+    for (uint32_t i = 0; i < num_arrays; i++) {
+        if (folder_arrays[i]) {
+            darray_add_array(folders, folder_arrays[i]);
+        }
+    }
+    db_entry_folders_update_ranks(folders);
+    g_clear_pointer(&folders, darray_unref);
+    g_debug("[db_sort] ranked %d folders by path: %f s", num_folders, g_timer_elapsed(timer, NULL));
+}
+
 static void
 db_sort(FsearchDatabase *db, GCancellable *cancellable) {
     g_assert(db);
@@ -167,19 +882,16 @@ db_sort(FsearchDatabase *db, GCancellable *cancellable) {
     // first we sort all the files
     DynamicArray *files = db->sorted_files[DATABASE_INDEX_TYPE_NAME];
     if (files) {
+        FSEARCH_TRACE2(db_sort_start, false, darray_get_num_items(files));
         db_sort_entries(db, files, db->sorted_files, cancellable);
+        FSEARCH_TRACE2(db_sort_end, false, is_cancelled(cancellable));
         if (is_cancelled(cancellable)) {
             return;
         }
 
         // now build extension sort array
-        db->sorted_files[DATABASE_INDEX_TYPE_EXTENSION] = darray_copy(files);
-        darray_sort_multi_threaded(db->sorted_files[DATABASE_INDEX_TYPE_EXTENSION],
-                                   (DynamicArrayCompareDataFunc)db_entry_compare_entries_by_extension,
-                                   cancellable,
-                                   NULL);
-        if (is_cancelled(cancellable)) {
-            return;
+        if (!db_sorts_lazily(db) && !db->progressive_load) {
+            db->sorted_files[DATABASE_INDEX_TYPE_EXTENSION] = db_extensions_sort_files(db_ensure_extensions(db));
         }
 
         const double seconds = g_timer_elapsed(timer, NULL);
@@ -190,17 +902,22 @@ db_sort(FsearchDatabase *db, GCancellable *cancellable) {
     // then we sort all the folders
     DynamicArray *folders = db->sorted_folders[DATABASE_INDEX_TYPE_NAME];
     if (folders) {
+        FSEARCH_TRACE2(db_sort_start, true, darray_get_num_items(folders));
         db_sort_entries(db, folders, db->sorted_folders, cancellable);
+        FSEARCH_TRACE2(db_sort_end, true, is_cancelled(cancellable));
         if (is_cancelled(cancellable)) {
             return;
         }
 
         // Folders don't have a file extension -> use the name array instead
-        db->sorted_folders[DATABASE_INDEX_TYPE_EXTENSION] = darray_ref(folders);
+        if (!db_sorts_lazily(db) && !db->progressive_load) {
+            db->sorted_folders[DATABASE_INDEX_TYPE_EXTENSION] = darray_ref(folders);
+        }
 
         const double seconds = g_timer_elapsed(timer, NULL);
         g_debug("[db_sort] sorted folders: %f s", seconds);
     }
+    db->sort_orders_pending = db->progressive_load && !db_sorts_lazily(db);
 }
 
 static void
@@ -209,34 +926,6 @@ db_update_timestamp(FsearchDatabase *db) {
     db->timestamp = time(NULL);
 }
 
-static void
-db_entry_update_folder_indices(FsearchDatabase *db) {
-    if (!db || !db->sorted_folders[DATABASE_INDEX_TYPE_NAME]) {
-        return;
-    }
-    const uint32_t num_folders = darray_get_num_items(db->sorted_folders[DATABASE_INDEX_TYPE_NAME]);
-    for (uint32_t i = 0; i < num_folders; i++) {
-        FsearchDatabaseEntryFolder *folder = darray_get_item(db->sorted_folders[DATABASE_INDEX_TYPE_NAME], i);
-        if (!folder) {
-            continue;
-        }
-        db_entry_set_idx((FsearchDatabaseEntry *)folder, i);
-    }
-}
-
-static uint8_t
-get_name_offset(const char *old, const char *new) {
-    if (!old || !new) {
-        return 0;
-    }
-
-    uint8_t offset = 0;
-    while (old[offset] == new[offset] && old[offset] != '\0' && new[offset] != '\0' && offset < 255) {
-        offset++;
-    }
-    return offset;
-}
-
 static FILE *
 db_file_open_locked(const char *file_path, const char *mode) {
     FILE *file_pointer = fopen(file_path, mode);
@@ -245,8 +934,11 @@ db_file_open_locked(const char *file_path, const char *mode) {
         return NULL;
     }
 
+    // files which are only read can be loaded by any number of processes at the same time, e.g. a system wide
+    // database which is shared by all users. Saving writes a new file, which replaces the old one once it's complete.
+    const bool read_only = mode[0] == 'r' && !strchr(mode, '+');
     int file_descriptor = fileno(file_pointer);
-    if (flock(file_descriptor, LOCK_EX | LOCK_NB) == -1) {
+    if (flock(file_descriptor, (read_only ? LOCK_SH : LOCK_EX) | LOCK_NB) == -1) {
         g_debug("[db_file] database file is already locked by a different process: %s", file_path);
 
         g_clear_pointer(&file_pointer, fclose);
@@ -265,6 +957,7 @@ static const uint8_t *
 db_load_entry_super_elements_from_memory(const uint8_t *data_block,
                                          FsearchDatabaseIndexFlags index_flags,
                                          FsearchDatabaseEntry *entry,
+                                         FsearchStringArena *names,
                                          GString *previous_entry_name) {
     // name_offset: character position after which previous_entry_name and entry_name differ
     uint8_t name_offset = *data_block++;
@@ -284,7 +977,7 @@ db_load_entry_super_elements_from_memory(const uint8_t *data_block,
 
     // now we can build the new full file name
     g_string_append(previous_entry_name, name);
-    db_entry_set_name(entry, previous_entry_name->str);
+    db_entry_set_name_in_arena(entry, names, previous_entry_name->str);
 
     if ((index_flags & DATABASE_INDEX_FLAG_SIZE) != 0) {
         // size: size of file/folder
@@ -311,7 +1004,10 @@ read_element_from_file(void *restrict ptr, size_t size, FILE *restrict stream) {
 }
 
 static bool
-db_load_entry_super_elements(FILE *fp, FsearchDatabaseEntry *entry, GString *previous_entry_name) {
+db_load_entry_super_elements(FILE *fp,
+                             FsearchDatabaseEntry *entry,
+                             FsearchStringArena *names,
+                             GString *previous_entry_name) {
     // name_offset: character position after which previous_entry_name and entry_name differ
     uint8_t name_offset = 0;
     if (!read_element_from_file(&name_offset, 1, fp)) {
@@ -341,7 +1037,7 @@ db_load_entry_super_elements(FILE *fp, FsearchDatabaseEntry *entry, GString *pre
 
     // now we can build the new full file name
     g_string_append(previous_entry_name, name);
-    db_entry_set_name(entry, previous_entry_name->str);
+    db_entry_set_name_in_arena(entry, names, previous_entry_name->str);
 
     // size: size of file/folder
     uint64_t size = 0;
@@ -355,7 +1051,7 @@ db_load_entry_super_elements(FILE *fp, FsearchDatabaseEntry *entry, GString *pre
 }
 
 static bool
-db_load_header(FILE *fp) {
+db_load_header(FILE *fp, uint8_t *major_version) {
     char magic[5] = "";
     if (!read_element_from_file(magic, strlen(DATABASE_MAGIC_NUMBER), fp)) {
         return false;
@@ -370,7 +1066,7 @@ db_load_header(FILE *fp) {
     if (!read_element_from_file(&majorver, 1, fp)) {
         return false;
     }
-    if (majorver != DATABASE_MAJOR_VERSION) {
+    if (majorver != DATABASE_MAJOR_VERSION && majorver != DATABASE_LEGACY_MAJOR_VERSION) {
         g_debug("[db_load] invalid major version: %d", majorver);
         g_debug("[db_load] expected major version: %d", DATABASE_MAJOR_VERSION);
         return false;
@@ -380,12 +1076,15 @@ db_load_header(FILE *fp) {
     if (!read_element_from_file(&minorver, 1, fp)) {
         return false;
     }
-    if (minorver > DATABASE_MINOR_VERSION) {
+    const uint8_t max_minorver =
+        majorver == DATABASE_LEGACY_MAJOR_VERSION ? DATABASE_LEGACY_MINOR_VERSION : DATABASE_MINOR_VERSION;
+    if (minorver > max_minorver) {
         g_debug("[db_load] invalid minor version: %d", minorver);
-        g_debug("[db_load] expected minor version: <= %d", DATABASE_MINOR_VERSION);
+        g_debug("[db_load] expected minor version: <= %d", max_minorver);
         return false;
     }
 
+    *major_version = majorver;
     return true;
 }
 
@@ -401,6 +1100,7 @@ db_load_parent_idx(FILE *fp, uint32_t *parent_idx) {
 static bool
 db_load_folders(FILE *fp,
                 FsearchDatabaseIndexFlags index_flags,
+                FsearchStringArena *names,
                 DynamicArray *folders,
                 uint32_t num_folders,
                 uint64_t folder_block_size) {
@@ -426,7 +1126,7 @@ db_load_folders(FILE *fp,
         uint16_t db_index = 0;
         fb = copy_bytes_and_return_new_src(&db_index, fb, 2);
 
-        fb = db_load_entry_super_elements_from_memory(fb, index_flags, entry, previous_entry_name);
+        fb = db_load_entry_super_elements_from_memory(fb, index_flags, entry, names, previous_entry_name);
 
         // parent_idx: index of parent folder
         uint32_t parent_idx = 0;
@@ -461,6 +1161,7 @@ static bool
 db_load_files(FILE *fp,
               FsearchDatabaseIndexFlags index_flags,
               FsearchMemoryPool *pool,
+              FsearchStringArena *names,
               DynamicArray *folders,
               DynamicArray *files,
               uint32_t num_files,
@@ -482,7 +1183,7 @@ db_load_files(FILE *fp,
         db_entry_set_type(entry, DATABASE_ENTRY_TYPE_FILE);
         db_entry_set_idx(entry, idx);
 
-        fb = db_load_entry_super_elements_from_memory(fb, index_flags, entry, previous_entry_name);
+        fb = db_load_entry_super_elements_from_memory(fb, index_flags, entry, names, previous_entry_name);
 
         // parent_idx: index of parent folder
         uint32_t parent_idx = 0;
@@ -571,1080 +1272,6663 @@ db_load_sorted_arrays(FILE *fp, DynamicArray **sorted_folders, DynamicArray **so
     return true;
 }
 
-bool
-db_load(FsearchDatabase *db, const char *file_path, void (*status_cb)(const char *)) {
-    g_assert(file_path);
-    g_assert(db);
-
-    FILE *fp = db_file_open_locked(file_path, "rb");
-    if (!fp) {
-        return false;
-    }
+static void
+db_run_on_all_threads(FsearchThreadPool *pool, FsearchThreadPoolFunc func, gpointer data) {
+    fsearch_thread_pool_run(pool, pool ? fsearch_thread_pool_get_num_threads(pool) : 1, func, data);
+}
 
-    DynamicArray *folders = NULL;
-    DynamicArray *files = NULL;
-    DynamicArray *sorted_folders[NUM_DATABASE_INDEX_TYPES] = {NULL};
-    DynamicArray *sorted_files[NUM_DATABASE_INDEX_TYPES] = {NULL};
+#ifdef HAVE_ZSTD
+typedef struct DatabaseFileDecompressContext {
+    const uint8_t *data;
+    size_t size;
+    const DatabaseFileBlock *blocks;
+    uint32_t num_blocks;
+    uint8_t *image;
 
-    if (!db_load_header(fp)) {
-        goto load_fail;
-    }
+    volatile gint next_block;
+    volatile gint failed;
+} DatabaseFileDecompressContext;
 
-    uint64_t index_flags = 0;
-    if (!read_element_from_file(&index_flags, 8, fp)) {
-        goto load_fail;
+static void
+db_file_decompress_thread(gpointer data) {
+    DatabaseFileDecompressContext *ctx = data;
+    while (!g_atomic_int_get(&ctx->failed)) {
+        const uint32_t idx = (uint32_t)g_atomic_int_add(&ctx->next_block, 1);
+        if (idx >= ctx->num_blocks) {
+            break;
+        }
+        const DatabaseFileBlock *block = &ctx->blocks[idx];
+        uint8_t *dest = ctx->image + (size_t)idx * DATABASE_FILE_BLOCK_SIZE;
+        const uint8_t *src = ctx->data + block->offset;
+        if (block->compressed_size == block->size) {
+            memcpy(dest, src, block->size);
+            continue;
+        }
+        const size_t res = ZSTD_decompress(dest, block->size, src, block->compressed_size);
+        if (ZSTD_isError(res) || res != block->size) {
+            g_debug("[db_load] failed to decompress block %d: %s", idx, ZSTD_isError(res) ? ZSTD_getErrorName(res) : "");
+            g_atomic_int_set(&ctx->failed, 1);
+        }
     }
+}
 
-    uint32_t num_folders = 0;
-    if (!read_element_from_file(&num_folders, 4, fp)) {
-        goto load_fail;
+// Decompresses all blocks of a compressed database file in parallel and returns the uncompressed file
+static GBytes *
+db_file_decompress(FsearchDatabase *db, const uint8_t *data, size_t size) {
+    const DatabaseFileHeader *header = (const DatabaseFileHeader *)data;
+    const uint32_t num_blocks = header->num_blocks;
+    const size_t header_size = db_file_header_get_size(header);
+    if ((size - header_size) / sizeof(DatabaseFileBlock) < num_blocks) {
+        g_debug("[db_load] invalid number of blocks: %d", num_blocks);
+        return NULL;
     }
 
-    uint32_t num_files = 0;
-    if (!read_element_from_file(&num_files, 4, fp)) {
-        goto load_fail;
+    const DatabaseFileBlock *blocks = (const DatabaseFileBlock *)(data + header_size);
+    uint64_t image_size = 0;
+    for (uint32_t i = 0; i < num_blocks; i++) {
+        // only the last block may be smaller, so the blocks can be placed without looking at the others
+        const bool is_last = i == num_blocks - 1;
+        if ((is_last ? blocks[i].size > DATABASE_FILE_BLOCK_SIZE : blocks[i].size != DATABASE_FILE_BLOCK_SIZE)
+            || blocks[i].offset > size || blocks[i].compressed_size > size - blocks[i].offset
+            || blocks[i].compressed_size > blocks[i].size) {
+            g_debug("[db_load] invalid block: %d", i);
+            return NULL;
+        }
+        image_size += blocks[i].size;
     }
-    g_debug("[db_load] load %d folders, %d files", num_folders, num_files);
-
-    uint64_t folder_block_size = 0;
-    if (!read_element_from_file(&folder_block_size, 8, fp)) {
-        goto load_fail;
+    if (image_size < DATABASE_FILE_MIN_HEADER_SIZE) {
+        g_debug("[db_load] compressed database file is too small");
+        return NULL;
     }
 
-    uint64_t file_block_size = 0;
-    if (!read_element_from_file(&file_block_size, 8, fp)) {
-        goto load_fail;
+    DatabaseFileDecompressContext ctx = {
+        .data = data,
+        .size = size,
+        .blocks = blocks,
+        .num_blocks = num_blocks,
+        .image = g_try_malloc(image_size),
+    };
+    if (!ctx.image) {
+        g_debug("[db_load] failed to allocate %" G_GUINT64_FORMAT " bytes", image_size);
+        return NULL;
     }
-    g_debug("[db_load] folder size: %lu, file size: %lu", folder_block_size, file_block_size);
-
-    // TODO: implement index loading
-    uint32_t num_indexes = 0;
-    if (!read_element_from_file(&num_indexes, 4, fp)) {
-        goto load_fail;
+    db_run_on_all_threads(db->thread_pool, db_file_decompress_thread, &ctx);
+    if (ctx.failed) {
+        g_free(ctx.image);
+        return NULL;
     }
+    return g_bytes_new_take(ctx.image, image_size);
+}
+#endif
 
-    // TODO: implement exclude loading
-    uint32_t num_excludes = 0;
-    if (!read_element_from_file(&num_excludes, 4, fp)) {
-        goto load_fail;
+typedef struct DatabaseFileMapping {
+    const uint8_t *data;
+    size_t size;
+    const DatabaseFileHeader *header;
+    const DatabaseFileSection *sections;
+} DatabaseFileMapping;
+
+// Returns the contents of the section with the given id or NULL if the file doesn't have a valid one.
+// If size isn't 0, the section must have exactly this size.
+static const void *
+db_file_mapping_get_section(DatabaseFileMapping *mapping, uint32_t id, uint64_t size, uint64_t *size_out) {
+    for (uint32_t i = 0; i < mapping->header->num_sections; i++) {
+        const DatabaseFileSection *section = &mapping->sections[i];
+        if (section->id != id) {
+            continue;
+        }
+        if (section->offset % DATABASE_SECTION_ALIGNMENT != 0 || section->offset > mapping->size
+            || section->size > mapping->size - section->offset || (size > 0 && section->size != size)) {
+            g_debug("[db_load] invalid section: %x", id);
+            return NULL;
+        }
+        if (size_out) {
+            *size_out = section->size;
+        }
+        return mapping->data + section->offset;
     }
+    return NULL;
+}
 
-    // pre-allocate the folders array so we can later map parent indices to the corresponding pointers
-    sorted_folders[DATABASE_INDEX_TYPE_NAME] = darray_new(num_folders);
-    folders = sorted_folders[DATABASE_INDEX_TYPE_NAME];
+// The sections of one entry type, resolved and validated before they're decoded
+typedef struct DatabaseLoadEntries {
+    DynamicArray *folders;
+    DynamicArray *entries;
+    uint32_t num_entries;
+
+    // the entries follow each other in their pool, starting at first_entry, so every chunk can set up its own ones
+    uint8_t *first_entry;
+    size_t entry_size;
+    FsearchDatabaseEntryType entry_type;
+    // the entries in order, they're added to entries once all of them are set up
+    void **items;
+
+    const char *names;
+    uint64_t names_size;
+    // offsets of the first name of every chunk into names
+    const uint64_t *name_chunks;
+    uint32_t num_chunks;
+    uint32_t chunk_size;
+    const uint32_t *parents;
+    const uint64_t *sizes;
+    const int64_t *mtimes;
+
+    volatile gint next_chunk;
+    volatile gint failed;
+} DatabaseLoadEntries;
 
-    for (uint32_t i = 0; i < num_folders; i++) {
-        FsearchDatabaseEntryFolder *folder = fsearch_memory_pool_malloc(db->folder_pool);
-        FsearchDatabaseEntry *entry = (FsearchDatabaseEntry *)folder;
-        db_entry_set_idx(entry, i);
-        db_entry_set_type(entry, DATABASE_ENTRY_TYPE_FOLDER);
-        db_entry_set_parent(entry, NULL);
-        darray_add_item(folders, folder);
+static bool
+db_load_mapped_sections(DatabaseFileMapping *mapping,
+                        FsearchDatabaseIndexFlags index_flags,
+                        uint32_t names_id,
+                        DatabaseLoadEntries *ctx) {
+    const uint32_t num_entries = ctx->num_entries;
+    ctx->names = db_file_mapping_get_section(mapping, names_id, 0, &ctx->names_size);
+    if (!ctx->names || (num_entries > 0 && (ctx->names_size == 0 || ctx->names[ctx->names_size - 1] != '\0'))) {
+        g_debug("[db_load] failed to load names");
+        return false;
     }
-
-    if (status_cb) {
-        status_cb(_("Loading folders…"));
+    ctx->parents =
+        db_file_mapping_get_section(mapping, names_id + DATABASE_SECTION_OFFSET_PARENTS, (uint64_t)num_entries * 4, NULL);
+    if (!ctx->parents && num_entries > 0) {
+        g_debug("[db_load] failed to load parents");
+        return false;
     }
-    // load folders
-    if (!db_load_folders(fp, index_flags, folders, num_folders, folder_block_size)) {
-        goto load_fail;
+    if ((index_flags & DATABASE_INDEX_FLAG_SIZE) != 0) {
+        ctx->sizes = db_file_mapping_get_section(mapping,
+                                                 names_id + DATABASE_SECTION_OFFSET_SIZES,
+                                                 (uint64_t)num_entries * 8,
+                                                 NULL);
+        if (!ctx->sizes && num_entries > 0) {
+            g_debug("[db_load] failed to load sizes");
+            return false;
+        }
+    }
+    if ((index_flags & DATABASE_INDEX_FLAG_MODIFICATION_TIME) != 0) {
+        ctx->mtimes = db_file_mapping_get_section(mapping,
+                                                  names_id + DATABASE_SECTION_OFFSET_MTIMES,
+                                                  (uint64_t)num_entries * 8,
+                                                  NULL);
+        if (!ctx->mtimes && num_entries > 0) {
+            g_debug("[db_load] failed to load modification times");
+            return false;
+        }
     }
 
-    if (status_cb) {
-        status_cb(_("Loading files…"));
-    }
-    // load files
-    sorted_files[DATABASE_INDEX_TYPE_NAME] = darray_new(num_files);
-    files = sorted_files[DATABASE_INDEX_TYPE_NAME];
-    if (!db_load_files(fp, index_flags, db->file_pool, folders, files, num_files, file_block_size)) {
-        goto load_fail;
+    // files written before the chunk table was added can only be decoded from start to end
+    ctx->num_chunks = 1;
+    ctx->chunk_size = num_entries;
+    const uint32_t num_chunks = (num_entries + DATABASE_FILE_CHUNK_SIZE - 1) / DATABASE_FILE_CHUNK_SIZE;
+    ctx->name_chunks = db_file_mapping_get_section(mapping,
+                                                   names_id | DATABASE_SECTION_NAME_CHUNKS,
+                                                   (uint64_t)num_chunks * 8,
+                                                   NULL);
+    if (ctx->name_chunks && num_chunks > 0) {
+        for (uint32_t i = 0; i < num_chunks; i++) {
+            if (ctx->name_chunks[i] >= ctx->names_size || (i > 0 && ctx->name_chunks[i] <= ctx->name_chunks[i - 1])) {
+                g_debug("[db_load] invalid name chunk offset: %d", i);
+                return false;
+            }
+        }
+        ctx->num_chunks = num_chunks;
+        ctx->chunk_size = DATABASE_FILE_CHUNK_SIZE;
     }
-
-    if (!db_load_sorted_arrays(fp, sorted_folders, sorted_files)) {
-        goto load_fail;
+    else {
+        ctx->name_chunks = NULL;
     }
+    return true;
+}
 
-    db_sorted_entries_free(db);
+static FsearchDatabaseEntry *
+db_load_mapped_new_entry(DatabaseLoadEntries *ctx, uint32_t idx) {
+    FsearchDatabaseEntry *entry = (FsearchDatabaseEntry *)(ctx->first_entry + (size_t)idx * ctx->entry_size);
+    db_entry_set_idx(entry, idx);
+    db_entry_set_type(entry, ctx->entry_type);
+    ctx->items[idx] = entry;
+    return entry;
+}
 
-    for (uint32_t i = 0; i < NUM_DATABASE_INDEX_TYPES; i++) {
-        db->sorted_files[i] = sorted_files[i];
-        db->sorted_folders[i] = sorted_folders[i];
+static void
+db_load_mapped_new_entries_range(uint32_t start, uint32_t end, void *data) {
+    DatabaseLoadEntries *ctx = data;
+    for (uint32_t i = start; i < end; i++) {
+        db_load_mapped_new_entry(ctx, i);
     }
+}
 
-    db->index_flags = index_flags;
-
-    g_clear_pointer(&fp, fclose);
+static bool
+db_load_mapped_chunk(DatabaseLoadEntries *ctx, uint32_t chunk) {
+    const uint32_t start = chunk * ctx->chunk_size;
+    const uint32_t end = MIN(start + ctx->chunk_size, ctx->num_entries);
+    const uint32_t num_folders = darray_get_num_items(ctx->folders);
+
+    const char *name = ctx->names + (ctx->name_chunks ? ctx->name_chunks[chunk] : 0);
+    const char *names_end = ctx->names + ctx->names_size;
+    for (uint32_t i = start; i < end; i++) {
+        if (name >= names_end) {
+            g_debug("[db_load] not enough names: %d of %d", i, ctx->num_entries);
+            return false;
+        }
+        // the entry is set up here, while it's in the cache anyway, unless it had to exist before
+        FsearchDatabaseEntry *entry = ctx->items ? db_load_mapped_new_entry(ctx, i) : darray_get_item(ctx->entries, i);
+        // the names stay in the mapping, no need to copy them
+        db_entry_set_name_borrowed(entry, name);
+        name += strlen(name) + 1;
+
+        if (ctx->sizes) {
+            db_entry_set_size(entry, (off_t)ctx->sizes[i]);
+        }
+        if (ctx->mtimes) {
+            db_entry_set_mtime(entry, (time_t)ctx->mtimes[i]);
+        }
 
+        const uint32_t parent_idx = ctx->parents[i];
+        if (parent_idx == DATABASE_FILE_NO_PARENT && db_entry_is_folder(entry)) {
+            // root folder of an index
+            continue;
+        }
+        FsearchDatabaseEntryFolder *parent = parent_idx < num_folders ? darray_get_item(ctx->folders, parent_idx) : NULL;
+        if (!parent || parent == (FsearchDatabaseEntryFolder *)entry) {
+            g_debug("[db_load] invalid parent index: %d", parent_idx);
+            return false;
+        }
+        // other chunks may have entries with the same parent
+        db_entry_set_parent_concurrent(entry, parent);
+    }
     return true;
+}
 
-load_fail:
-    g_debug("[db_load] load failed");
-
-    g_clear_pointer(&fp, fclose);
-
-    for (uint32_t i = 0; i < NUM_DATABASE_INDEX_TYPES; i++) {
-        g_clear_pointer(&sorted_folders[i], darray_unref);
-        g_clear_pointer(&sorted_files[i], darray_unref);
+static void
+db_load_mapped_chunks_thread(gpointer data) {
+    DatabaseLoadEntries *ctx = data;
+    while (!g_atomic_int_get(&ctx->failed)) {
+        const uint32_t chunk = (uint32_t)g_atomic_int_add(&ctx->next_chunk, 1);
+        if (chunk >= ctx->num_chunks) {
+            break;
+        }
+        if (!db_load_mapped_chunk(ctx, chunk)) {
+            g_atomic_int_set(&ctx->failed, 1);
+        }
     }
-
-    return false;
 }
 
-size_t
-write_data_to_file(FILE *fp, const void *data, size_t data_size, size_t num_elements, bool *write_failed) {
-    if (data_size == 0 || num_elements == 0) {
-        return 0;
+// Creates the num_entries entries of type (from pool) and adds them to entries, folders are the ones they can have as
+// parents. Those get set up before any of them is decoded, because they can be the parents of entries in other
+// chunks, files are set up by the chunks they're in.
+static bool
+db_load_mapped_entries(FsearchDatabase *db,
+                       DatabaseFileMapping *mapping,
+                       FsearchDatabaseIndexFlags index_flags,
+                       uint32_t names_id,
+                       FsearchMemoryPool *pool,
+                       FsearchDatabaseEntryType type,
+                       DynamicArray *folders,
+                       DynamicArray *entries,
+                       uint32_t num_entries,
+                       bool load_metadata) {
+    DatabaseLoadEntries ctx = {
+        .folders = folders,
+        .entries = entries,
+        .num_entries = num_entries,
+        .entry_type = type,
+        .entry_size = type == DATABASE_ENTRY_TYPE_FOLDER ? db_entry_get_sizeof_folder_entry()
+                                                         : db_entry_get_sizeof_file_entry(),
+    };
+    FSEARCH_TRACE1(db_load_section_start, names_id);
+    if (!db_load_mapped_sections(mapping, index_flags, names_id, &ctx)) {
+        FSEARCH_TRACE2(db_load_section_end, names_id, 0);
+        return false;
     }
-    if (fwrite(data, data_size, num_elements, fp) != num_elements) {
-        *write_failed = true;
-        return 0;
+    if (!load_metadata) {
+        // the sections are valid, db_load_pending_metadata takes them from there
+        ctx.sizes = NULL;
+        ctx.mtimes = NULL;
     }
-    return data_size * num_elements;
-}
 
-static size_t
-db_save_entry_super_elements(FILE *fp,
-                             FsearchDatabaseIndexFlags index_flags,
-                             FsearchDatabaseEntry *entry,
-                             uint32_t parent_idx,
-                             GString *previous_entry_name,
-                             GString *new_entry_name,
-                             bool *write_failed) {
-    // init new_entry_name with the name of the current entry
-    g_string_erase(new_entry_name, 0, -1);
-    g_string_append(new_entry_name, db_entry_get_name_raw(entry));
-
-    size_t bytes_written = 0;
-    // name_offset: character position after which previous_entry_name and new_entry_name differ
-    const uint8_t name_offset = get_name_offset(previous_entry_name->str, new_entry_name->str);
-    bytes_written += write_data_to_file(fp, &name_offset, 1, 1, write_failed);
-    if (*write_failed == true) {
-        g_debug("[db_save] failed to save name offset");
-        goto out;
+    ctx.first_entry = fsearch_memory_pool_malloc_items(pool, num_entries);
+    ctx.items = calloc(MAX(num_entries, 1), sizeof(void *));
+    g_assert(ctx.items);
+    if (type == DATABASE_ENTRY_TYPE_FOLDER) {
+        fsearch_thread_pool_parallel_for(db->thread_pool,
+                                         num_entries,
+                                         DATABASE_FILE_CHUNK_SIZE,
+                                         db_load_mapped_new_entries_range,
+                                         &ctx,
+                                         NULL);
+        darray_add_items(entries, ctx.items, num_entries);
+        g_clear_pointer(&ctx.items, free);
     }
 
-    // name_len: length of the new name characters
-    const uint8_t name_len = new_entry_name->len - name_offset;
-    bytes_written += write_data_to_file(fp, &name_len, 1, 1, write_failed);
-    if (*write_failed == true) {
-        g_debug("[db_save] failed to save name length");
-        goto out;
+    if (ctx.num_chunks <= 1) {
+        db_load_mapped_chunks_thread(&ctx);
     }
-
-    // append new unique characters to previous_entry_name starting at name_offset
-    g_string_erase(previous_entry_name, name_offset, -1);
-    g_string_append(previous_entry_name, new_entry_name->str + name_offset);
-
-    if (name_len > 0) {
-        // name: new characters to be written to file
-        const char *name = previous_entry_name->str + name_offset;
-        bytes_written += write_data_to_file(fp, name, name_len, 1, write_failed);
-        if (*write_failed == true) {
-            g_debug("[db_save] failed to save name");
-            goto out;
-        }
+    else {
+        // every thread takes the next chunk until all of them are decoded, so slow chunks
+        // (e.g. ones with long names) don't hold up the others
+        db_run_on_all_threads(db->thread_pool, db_load_mapped_chunks_thread, &ctx);
     }
-
-    if ((index_flags & DATABASE_INDEX_FLAG_SIZE) != 0) {
-        // size: file or folder size (folder size: sum of all children sizes)
-        const uint64_t size = db_entry_get_size(entry);
-        bytes_written += write_data_to_file(fp, &size, 8, 1, write_failed);
-        if (*write_failed == true) {
-            g_debug("[db_save] failed to save size");
-            goto out;
-        }
+    if (ctx.items && !ctx.failed) {
+        darray_add_items(entries, ctx.items, num_entries);
     }
+    g_clear_pointer(&ctx.items, free);
+    FSEARCH_TRACE2(db_load_section_end, names_id, ctx.failed ? 0 : num_entries);
+    return !ctx.failed;
+}
 
-    if ((index_flags & DATABASE_INDEX_FLAG_MODIFICATION_TIME) != 0) {
-        // mtime: modification time of file/folder
-        const uint64_t mtime = db_entry_get_mtime(entry);
-        bytes_written += write_data_to_file(fp, &mtime, 8, 1, write_failed);
-        if (*write_failed == true) {
-            g_debug("[db_save] failed to save modification time");
-            goto out;
-        }
+static DynamicArray *
+db_load_mapped_sorted_entries(DatabaseFileMapping *mapping, uint32_t id, DynamicArray *entries) {
+    const uint32_t num_entries = darray_get_num_items(entries);
+    const uint32_t *indexes = db_file_mapping_get_section(mapping, id, (uint64_t)num_entries * 4, NULL);
+    if (!indexes && num_entries > 0) {
+        return NULL;
     }
-
-    // parent_idx: index of parent folder
-    bytes_written += write_data_to_file(fp, &parent_idx, 4, 1, write_failed);
-    if (*write_failed == true) {
-        g_debug("[db_save] failed to save parent_idx");
-        goto out;
+    FSEARCH_TRACE1(db_load_section_start, id);
+    DynamicArray *sorted_entries = darray_new(num_entries);
+    for (uint32_t i = 0; i < num_entries; i++) {
+        void *entry = indexes[i] < num_entries ? darray_get_item(entries, indexes[i]) : NULL;
+        if (!entry) {
+            g_clear_pointer(&sorted_entries, darray_unref);
+            break;
+        }
+        darray_add_item(sorted_entries, entry);
     }
-
-out:
-    return bytes_written;
+    FSEARCH_TRACE2(db_load_section_end, id, sorted_entries ? num_entries : 0);
+    return sorted_entries;
 }
 
-static size_t
-db_save_header(FILE *fp, bool *write_failed) {
-    size_t bytes_written = 0;
-
-    const char magic[] = DATABASE_MAGIC_NUMBER;
-    bytes_written += write_data_to_file(fp, magic, strlen(magic), 1, write_failed);
-    if (*write_failed == true) {
-        g_debug("[db_save] failed to save magic number");
-        goto out;
-    }
+// The contents of the file were validated by db_load already
+static void
+db_file_mapping_init_from_contents(GBytes *contents, DatabaseFileMapping *mapping) {
+    mapping->data = g_bytes_get_data(contents, &mapping->size);
+    mapping->header = (const DatabaseFileHeader *)mapping->data;
+    mapping->sections = (const DatabaseFileSection *)(mapping->data + db_file_header_get_size(mapping->header));
+}
 
-    const uint8_t majorver = DATABASE_MAJOR_VERSION;
-    bytes_written += write_data_to_file(fp, &majorver, 1, 1, write_failed);
-    if (*write_failed == true) {
-        g_debug("[db_save] failed to save major version number");
-        goto out;
+static const uint32_t *
+db_file_contents_get_sorted_section(GBytes *contents, uint32_t id, uint32_t num_entries) {
+    if (!contents) {
+        return NULL;
     }
+    DatabaseFileMapping mapping = {};
+    db_file_mapping_init_from_contents(contents, &mapping);
+    return db_file_mapping_get_section(&mapping, id, (uint64_t)num_entries * 4, NULL);
+}
 
-    const uint8_t minorver = DATABASE_MINOR_VERSION;
-    bytes_written += write_data_to_file(fp, &minorver, 1, 1, write_failed);
-    if (*write_failed == true) {
-        g_debug("[db_save] failed to save minor version number");
-        goto out;
-    }
+// Returns the indexes of a sorted section which wasn't loaded yet
+static const uint32_t *
+db_get_pending_sorted_section(FsearchDatabase *db, uint32_t id, uint32_t num_entries) {
+    return db->sorted_sections_pending ? db_file_contents_get_sorted_section(db->file_contents, id, num_entries) : NULL;
+}
 
-out:
-    return bytes_written;
+static void
+db_file_append_record(GByteArray *section, const void *record, size_t record_size, const char *path) {
+    g_byte_array_append(section, record, record_size);
+    g_byte_array_append(section, (const guint8 *)path, strlen(path));
 }
 
-static size_t
-db_save_files(FILE *fp, FsearchDatabaseIndexFlags index_flags, DynamicArray *files, uint32_t num_files, bool *write_failed) {
-    size_t bytes_written = 0;
+static GByteArray *
+db_file_encode_indexes(FsearchDatabase *db) {
+    GByteArray *section = g_byte_array_new();
+    for (GList *l = db->indexes; l != NULL; l = l->next) {
+        FsearchIndex *index = l->data;
+        if (!index->path) {
+            continue;
+        }
+        const DatabaseFileIndex record = {
+            .type = index->type,
+            .flags = (index->enabled ? DATABASE_FILE_INDEX_FLAG_ENABLED : 0)
+                   | (index->update ? DATABASE_FILE_INDEX_FLAG_UPDATE : 0)
+                   | (index->one_filesystem ? DATABASE_FILE_INDEX_FLAG_ONE_FILESYSTEM : 0),
+            .path_len = strlen(index->path),
+            .last_updated = index->last_updated,
+        };
+        db_file_append_record(section, &record, sizeof(record), index->path);
+    }
+    return section;
+}
 
-    g_autoptr(GString) name_prev = g_string_sized_new(256);
-    g_autoptr(GString) name_new = g_string_sized_new(256);
+// The excludes are encoded in a fixed order (paths sorted, patterns as configured), so the section of a file
+// can be compared to the one of the current configuration as it is
+static GByteArray *
+db_file_encode_excludes(FsearchDatabase *db) {
+    GByteArray *section = g_byte_array_new();
+    for (GList *l = db->excludes; l != NULL; l = l->next) {
+        FsearchExcludePath *exclude = l->data;
+        if (!exclude->path) {
+            continue;
+        }
+        const DatabaseFileExclude record = {
+            .type = DATABASE_FILE_EXCLUDE_PATH,
+            .enabled = exclude->enabled,
+            .path_len = strlen(exclude->path),
+        };
+        db_file_append_record(section, &record, sizeof(record), exclude->path);
+    }
+    for (uint32_t i = 0; db->exclude_files && db->exclude_files[i]; i++) {
+        const DatabaseFileExclude record = {
+            .type = DATABASE_FILE_EXCLUDE_PATTERN,
+            .enabled = true,
+            .path_len = strlen(db->exclude_files[i]),
+        };
+        db_file_append_record(section, &record, sizeof(record), db->exclude_files[i]);
+    }
+    if (db->exclude_hidden) {
+        const DatabaseFileExclude record = {
+            .type = DATABASE_FILE_EXCLUDE_HIDDEN,
+            .enabled = true,
+        };
+        db_file_append_record(section, &record, sizeof(record), "");
+    }
+    return section;
+}
 
-    for (uint32_t i = 0; i < num_files; i++) {
-        FsearchDatabaseEntry *entry = darray_get_item(files, i);
+// Restores when the indexes were updated last. Everything else about them is taken from the configuration,
+// so this only happens if the file was scanned with the same excludes.
+static void
+db_load_mapped_indexes(FsearchDatabase *db, DatabaseFileMapping *mapping) {
+    uint64_t excludes_size = 0;
+    const uint8_t *excludes = db_file_mapping_get_section(mapping, DATABASE_SECTION_EXCLUDES, 0, &excludes_size);
+    uint64_t indexes_size = 0;
+    const uint8_t *indexes = db_file_mapping_get_section(mapping, DATABASE_SECTION_INDEXES, 0, &indexes_size);
+    if (!excludes || !indexes) {
+        return;
+    }
+    g_autoptr(GByteArray) current_excludes = db_file_encode_excludes(db);
+    if (current_excludes->len != excludes_size || memcmp(current_excludes->data, excludes, excludes_size) != 0) {
+        g_debug("[db_load] database was scanned with different excludes");
+        return;
+    }
 
-        // let's also update the idx of the file here while we're at it to make sure we have the correct
-        // idx set when we store the fast sort indexes
-        db_entry_set_idx(entry, i);
+    uint64_t offset = 0;
+    while (indexes_size - offset >= sizeof(DatabaseFileIndex)) {
+        DatabaseFileIndex record;
+        memcpy(&record, indexes + offset, sizeof(record));
+        offset += sizeof(record);
+        if (record.path_len > indexes_size - offset) {
+            g_debug("[db_load] invalid index at: %" G_GUINT64_FORMAT, offset);
+            return;
+        }
+        g_autofree char *path = g_strndup((const char *)indexes + offset, record.path_len);
+        offset += record.path_len;
 
-        FsearchDatabaseEntryFolder *parent = db_entry_get_parent(entry);
-        const uint32_t parent_idx = db_entry_get_idx((FsearchDatabaseEntry *)parent);
-        bytes_written +=
-            db_save_entry_super_elements(fp, index_flags, entry, parent_idx, name_prev, name_new, write_failed);
-        if (*write_failed == true)
-            return bytes_written;
+        FsearchIndex *index = db_find_index(db, path);
+        if (index && index->one_filesystem == ((record.flags & DATABASE_FILE_INDEX_FLAG_ONE_FILESYSTEM) != 0)) {
+            index->last_updated = (time_t)record.last_updated;
+        }
     }
-    return bytes_written;
 }
 
-static uint32_t *
-build_sorted_entry_index_list(DynamicArray *entries, uint32_t num_entries) {
-    if (num_entries < 1) {
-        return NULL;
+// Loads the sizes and modification times which db_load left in the file. Has to happen before anything reads or
+// changes them, while the name arrays are still in the order of the file.
+static void
+db_load_pending_metadata(FsearchDatabase *db) {
+    if (!db->metadata_pending) {
+        return;
     }
-    uint32_t *indexes = calloc(num_entries + 1, sizeof(uint32_t));
-    g_assert(indexes);
+    db->metadata_pending = false;
+    db_clear_columns(db);
 
-    for (int i = 0; i < num_entries; i++) {
-        FsearchDatabaseEntry *entry = darray_get_item(entries, i);
-        indexes[i] = db_entry_get_idx(entry);
+    g_autoptr(GTimer) timer = g_timer_new();
+    DatabaseFileMapping mapping = {};
+    db_file_mapping_init_from_contents(db->file_contents, &mapping);
+    for (uint32_t i = 0; i < 2; i++) {
+        const DatabaseSectionId names_id = i == 0 ? DATABASE_SECTION_FOLDER_NAMES : DATABASE_SECTION_FILE_NAMES;
+        DynamicArray *entries =
+            i == 0 ? db->sorted_folders[DATABASE_INDEX_TYPE_NAME] : db->sorted_files[DATABASE_INDEX_TYPE_NAME];
+        const uint32_t num_entries = darray_get_num_items(entries);
+        const uint64_t *sizes = NULL;
+        const int64_t *mtimes = NULL;
+        if ((db->index_flags & DATABASE_INDEX_FLAG_SIZE) != 0) {
+            sizes = db_file_mapping_get_section(&mapping,
+                                                names_id + DATABASE_SECTION_OFFSET_SIZES,
+                                                (uint64_t)num_entries * 8,
+                                                NULL);
+        }
+        if ((db->index_flags & DATABASE_INDEX_FLAG_MODIFICATION_TIME) != 0) {
+            mtimes = db_file_mapping_get_section(&mapping,
+                                                 names_id + DATABASE_SECTION_OFFSET_MTIMES,
+                                                 (uint64_t)num_entries * 8,
+                                                 NULL);
+        }
+        for (uint32_t j = 0; j < num_entries; j++) {
+            FsearchDatabaseEntry *entry = darray_get_item(entries, j);
+            if (sizes) {
+                db_entry_set_size(entry, (off_t)sizes[j]);
+            }
+            if (mtimes) {
+                db_entry_set_mtime(entry, (time_t)mtimes[j]);
+            }
+        }
     }
-    return indexes;
+    g_debug("[db_load] loaded sizes and modification times in %f s", g_timer_elapsed(timer, NULL));
 }
 
-static size_t
-db_save_sorted_entries(FILE *fp, DynamicArray *entries, uint32_t num_entries, bool *write_failed) {
-    if (num_entries < 1) {
-        // nothing to write, we're done here
-        return 0;
+static bool
+db_load_mapped_folded_names(DatabaseFileMapping *mapping,
+                            uint32_t id,
+                            uint32_t fold_options,
+                            uint32_t num_entries,
+                            const char **names) {
+    uint64_t size = 0;
+    const uint8_t *data = db_file_mapping_get_section(mapping, id, 0, &size);
+    if (!data || size < sizeof(DatabaseFileFoldedNames)
+        || ((const DatabaseFileFoldedNames *)data)->fold_options != fold_options) {
+        return false;
     }
-
-    g_autofree uint32_t *sorted_entry_index_list = build_sorted_entry_index_list(entries, num_entries);
-    if (!sorted_entry_index_list) {
-        *write_failed = true;
-        g_debug("[db_save] failed to create sorted index list");
-        return 0;
+    uint64_t offset = sizeof(DatabaseFileFoldedNames);
+    for (uint32_t i = 0; i < num_entries; i++) {
+        const char *name = (const char *)data + offset;
+        const char *end = offset < size ? memchr(name, '\0', size - offset) : NULL;
+        if (!end) {
+            g_debug("[db_load] invalid section: %x", id);
+            return false;
+        }
+        names[i] = *name ? name : NULL;
+        offset += end - name + 1;
     }
+    return true;
+}
 
-    size_t bytes_written = write_data_to_file(fp, sorted_entry_index_list, 4, num_entries, write_failed);
-    if (*write_failed == true) {
-        g_debug("[db_save] failed to save sorted index list");
+// The folded names in file_contents, they're only used if they were folded with the options of the current locale
+static void
+db_load_pending_folded_names(FsearchDatabase *db) {
+    if (!db->folded_names_pending) {
+        return;
+    }
+    db->folded_names_pending = false;
+    DynamicArray *folders = db->sorted_folders[DATABASE_INDEX_TYPE_NAME];
+    DynamicArray *files = db->sorted_files[DATABASE_INDEX_TYPE_NAME];
+    if (!folders || !files || !db->file_contents) {
+        return;
     }
 
-    return bytes_written;
+    g_autoptr(GTimer) timer = g_timer_new();
+    DatabaseFileMapping mapping = {};
+    db_file_mapping_init_from_contents(db->file_contents, &mapping);
+    FsearchDatabaseFoldedNames *names = db_folded_names_new(folders, files, fsearch_utf_get_fold_options());
+    if (!db_load_mapped_folded_names(&mapping,
+                                     DATABASE_SECTION_FOLDED_FOLDER_NAMES,
+                                     names->fold_options,
+                                     darray_get_num_items(folders),
+                                     names->folder_names)
+        || !db_load_mapped_folded_names(&mapping,
+                                        DATABASE_SECTION_FOLDED_FILE_NAMES,
+                                        names->fold_options,
+                                        darray_get_num_items(files),
+                                        names->file_names)) {
+        g_clear_pointer(&names, db_folded_names_unref);
+        return;
+    }
+    names->contents = g_bytes_ref(db->file_contents);
+    g_clear_pointer(&db->folded_names, db_folded_names_unref);
+    db->folded_names = names;
+    g_debug("[db_load] loaded folded names in %f s", g_timer_elapsed(timer, NULL));
 }
 
-static size_t
-db_save_sorted_arrays(FILE *fp, FsearchDatabase *db, uint32_t num_files, uint32_t num_folders, bool *write_failed) {
-    size_t bytes_written = 0;
-    uint32_t num_sorted_arrays = 0;
-    for (uint32_t i = 1; i < NUM_DATABASE_INDEX_TYPES; i++) {
-        if (db->sorted_folders[i] && db->sorted_files[i]) {
-            num_sorted_arrays++;
-        }
+static bool
+db_load_mapped_trigrams(DatabaseFileMapping *mapping, uint32_t id, uint32_t num_entries, FsearchDatabaseTrigramList *list) {
+    uint64_t size = 0;
+    const uint8_t *data = db_file_mapping_get_section(mapping, id, 0, &size);
+    if (!data || size < sizeof(DatabaseFileTrigrams)) {
+        return false;
     }
+    const uint64_t num_keys = ((const DatabaseFileTrigrams *)data)->num_keys;
+    const uint64_t offsets_offset = sizeof(DatabaseFileTrigrams) + num_keys * 8;
+    const uint64_t postings_offset = offsets_offset + (num_keys + 1) * 8;
+    const uint64_t *offsets = (const uint64_t *)(data + offsets_offset);
+    if (postings_offset > size || offsets[num_keys] != size - postings_offset) {
+        g_debug("[db_load] invalid section: %x", id);
+        return false;
+    }
+    list->num_entries = num_entries;
+    list->num_keys = (uint32_t)num_keys;
+    list->keys = (const uint32_t *)(data + sizeof(DatabaseFileTrigrams));
+    list->num_postings = list->keys + num_keys;
+    list->offsets = offsets;
+    list->postings = data + postings_offset;
+    return true;
+}
 
-    bytes_written += write_data_to_file(fp, &num_sorted_arrays, 4, 1, write_failed);
-    if (*write_failed == true) {
-        g_debug("[db_save] failed to save number of sorted arrays: %d", num_sorted_arrays);
-        goto out;
+// The trigram index in file_contents, if the database was saved with one
+static void
+db_load_pending_trigrams(FsearchDatabase *db) {
+    if (!db->trigrams_pending) {
+        return;
+    }
+    db->trigrams_pending = false;
+    DynamicArray *folders = db->sorted_folders[DATABASE_INDEX_TYPE_NAME];
+    DynamicArray *files = db->sorted_files[DATABASE_INDEX_TYPE_NAME];
+    if (!folders || !files || !db->file_contents) {
+        return;
     }
 
-    if (num_sorted_arrays < 1) {
-        goto out;
+    DatabaseFileMapping mapping = {};
+    db_file_mapping_init_from_contents(db->file_contents, &mapping);
+    FsearchDatabaseTrigramList folder_trigrams = {};
+    FsearchDatabaseTrigramList file_trigrams = {};
+    if (!db_load_mapped_trigrams(&mapping,
+                                 DATABASE_SECTION_FOLDER_TRIGRAMS,
+                                 darray_get_num_items(folders),
+                                 &folder_trigrams)
+        || !db_load_mapped_trigrams(&mapping,
+                                    DATABASE_SECTION_FILE_TRIGRAMS,
+                                    darray_get_num_items(files),
+                                    &file_trigrams)) {
+        return;
+    }
+    FsearchDatabaseTrigrams *trigrams =
+        db_trigrams_new_from_lists(folders, files, &folder_trigrams, &file_trigrams, db->file_contents);
+    if (!trigrams) {
+        g_debug("[db_load] invalid trigrams");
+        return;
     }
+    g_clear_pointer(&db->trigrams, db_trigrams_unref);
+    db->trigrams = trigrams;
+    g_debug("[db_load] loaded trigrams");
+}
 
-    for (uint32_t id = 1; id < NUM_DATABASE_INDEX_TYPES; id++) {
-        DynamicArray *folders = db->sorted_folders[id];
-        DynamicArray *files = db->sorted_files[id];
-        if (!files || !folders) {
-            continue;
-        }
+typedef struct DatabaseFoldNamesContext {
+    DynamicArray *entries;
+    uint32_t num_entries;
+    const char **names;
+    // the names of entries which are part of previous are copied from there
+    const FsearchDatabaseFoldedNames *previous;
+    // the threads fold into their own arenas, which are merged into this one once they're done
+    FsearchStringArena *arena;
+    GMutex mutex;
 
-        // id: this is the id of the sorted files
-        bytes_written += write_data_to_file(fp, &id, 4, 1, write_failed);
-        if (*write_failed == true) {
-            g_debug("[db_save] failed to save sorted arrays id: %d", id);
-            goto out;
-        }
+    volatile gint next_chunk;
+} DatabaseFoldNamesContext;
 
-        bytes_written += db_save_sorted_entries(fp, folders, num_folders, write_failed);
-        if (*write_failed == true) {
-            g_debug("[db_save] failed to save sorted folders");
-            goto out;
+static void
+db_fold_names_thread(gpointer data) {
+    DatabaseFoldNamesContext *ctx = data;
+
+    FsearchUtfBuilder builder = {};
+    fsearch_utf_builder_init(&builder, 4 * PATH_MAX);
+    char *buffer = g_malloc(4 * PATH_MAX);
+    FsearchStringArena *arena = fsearch_string_arena_new();
+    while (true) {
+        const uint64_t start = (uint64_t)g_atomic_int_add(&ctx->next_chunk, 1) * DATABASE_FILE_CHUNK_SIZE;
+        if (start >= ctx->num_entries) {
+            break;
         }
-        bytes_written += db_save_sorted_entries(fp, files, num_files, write_failed);
-        if (*write_failed == true) {
-            g_debug("[db_save] failed to save sorted files");
-            goto out;
+        const uint32_t end = (uint32_t)MIN(start + DATABASE_FILE_CHUNK_SIZE, ctx->num_entries);
+        for (uint32_t i = (uint32_t)start; i < end; i++) {
+            FsearchDatabaseEntry *entry = darray_get_item(ctx->entries, i);
+            const char *folded = NULL;
+            if (!ctx->previous || !db_folded_names_lookup(ctx->previous, entry, &folded)) {
+                folded = db_folded_names_fold(&builder, db_entry_get_name_raw_for_display(entry), buffer, 4 * PATH_MAX);
+            }
+            ctx->names[i] = folded ? fsearch_string_arena_add(arena, folded) : NULL;
         }
     }
 
-out:
-    return bytes_written;
+    g_mutex_lock(&ctx->mutex);
+    fsearch_string_arena_merge(ctx->arena, arena);
+    g_mutex_unlock(&ctx->mutex);
+    g_clear_pointer(&buffer, g_free);
+    fsearch_utf_builder_clear(&builder);
 }
 
-static size_t
-db_save_folders(FILE *fp,
-                FsearchDatabaseIndexFlags index_flags,
-                DynamicArray *folders,
-                uint32_t num_folders,
-                bool *write_failed) {
-    size_t bytes_written = 0;
-
-    g_autoptr(GString) name_prev = g_string_sized_new(256);
-    g_autoptr(GString) name_new = g_string_sized_new(256);
+// Folds the names of all entries on all threads
+static FsearchDatabaseFoldedNames *
+db_fold_names(FsearchDatabase *db,
+              DynamicArray *folders,
+              DynamicArray *files,
+              const FsearchDatabaseFoldedNames *previous) {
+    FsearchDatabaseFoldedNames *names = db_folded_names_new(folders, files, fsearch_utf_get_fold_options());
+    if (previous && previous->fold_options != names->fold_options) {
+        previous = NULL;
+    }
+    for (uint32_t i = 0; i < 2; i++) {
+        DatabaseFoldNamesContext ctx = {
+            .entries = i == 0 ? folders : files,
+            .names = i == 0 ? names->folder_names : names->file_names,
+            .previous = previous,
+            .arena = names->arena,
+        };
+        ctx.num_entries = darray_get_num_items(ctx.entries);
+        g_mutex_init(&ctx.mutex);
+        db_run_on_all_threads(db->thread_pool, db_fold_names_thread, &ctx);
+        g_mutex_clear(&ctx.mutex);
+    }
+    return names;
+}
 
+static void
+db_load_mapped_folder_ids(FsearchDatabase *db, DatabaseFileMapping *mapping, DynamicArray *folders) {
+    const uint32_t num_folders = darray_get_num_items(folders);
+    const uint8_t *section = db_file_mapping_get_section(mapping,
+                                                         DATABASE_SECTION_FOLDER_IDS,
+                                                         sizeof(DatabaseFileFolderIds) + (uint64_t)num_folders * 4,
+                                                         NULL);
+    if (!section) {
+        return;
+    }
+    DatabaseFileFolderIds header = {};
+    memcpy(&header, section, sizeof(header));
+    const uint32_t *ids = (const uint32_t *)(section + sizeof(header));
     for (uint32_t i = 0; i < num_folders; i++) {
-        FsearchDatabaseEntry *entry = darray_get_item(folders, i);
-
-        // TODO: actually store the folders db_index instead of always 0
-        const uint16_t db_index = 0;
-        bytes_written += write_data_to_file(fp, &db_index, 2, 1, write_failed);
-        if (*write_failed == true) {
-            g_debug("[db_save] failed to save folder's database index: %d", db_index);
-            return bytes_written;
-        }
-
-        FsearchDatabaseEntryFolder *parent = db_entry_get_parent(entry);
-        const uint32_t parent_idx = parent ? db_entry_get_idx((FsearchDatabaseEntry *)parent) : db_entry_get_idx(entry);
-        bytes_written +=
-            db_save_entry_super_elements(fp, index_flags, entry, parent_idx, name_prev, name_new, write_failed);
-        if (*write_failed == true) {
-            return bytes_written;
-        }
+        db_entry_folder_set_id(darray_get_item(folders, i), ids[i]);
     }
-
-    return bytes_written;
+    db->next_folder_id = header.next_id;
 }
 
-static size_t
-db_save_indexes(FILE *fp, FsearchDatabase *db, bool *write_failed) {
-    size_t bytes_written = 0;
-
-    // TODO: actually implement storing all index information
-    const uint32_t num_indexes = 0;
-    bytes_written += write_data_to_file(fp, &num_indexes, 4, 1, write_failed);
-    if (*write_failed == true) {
-        g_debug("[db_save] failed to save number of indexes: %d", num_indexes);
-        goto out;
+static bool
+db_file_read_varint(const uint8_t *data, uint64_t size, uint64_t *pos, uint64_t *value) {
+    *value = 0;
+    for (uint32_t shift = 0; shift < 64 && *pos < size; shift += 7) {
+        const uint8_t byte = data[(*pos)++];
+        *value |= (uint64_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
     }
-out:
-    return bytes_written;
+    return false;
 }
 
-static size_t
-db_save_excludes(FILE *fp, FsearchDatabase *db, bool *write_failed) {
-    size_t bytes_written = 0;
+static bool
+db_load_mapped_metadata_column(DatabaseFileMapping *mapping,
+                               FsearchDatabaseMetadata *metadata,
+                               bool is_folder,
+                               FsearchDatabaseMetadataColumn column,
+                               const int64_t *mtimes) {
+    const uint32_t id = (is_folder ? DATABASE_SECTION_FOLDER_METADATA : DATABASE_SECTION_FILE_METADATA) | column;
+    uint64_t size = 0;
+    const uint8_t *data = db_file_mapping_get_section(mapping, id, 0, &size);
+    DatabaseFileMetadataColumn header = {};
+    if (!data || size < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    const uint64_t ids_size = ((uint64_t)header.num_ids * 4 + 7) & ~(uint64_t)7;
+    if (header.bits > 32 || ids_size > size - sizeof(header)) {
+        return false;
+    }
+    const uint32_t *ids = (const uint32_t *)(data + sizeof(header));
+    const uint8_t *values = data + sizeof(header) + ids_size;
+    const uint64_t values_size = size - sizeof(header) - ids_size;
+    const uint32_t num_entries = darray_get_num_items(is_folder ? metadata->folders : metadata->files);
+    if (header.bits > 0) {
+        const uint64_t num_words = ((uint64_t)num_entries * header.bits + 63) / 64;
+        return values_size == num_words * 8
+            && db_metadata_set_column(metadata,
+                                      is_folder,
+                                      column,
+                                      ids,
+                                      header.num_ids,
+                                      header.bits,
+                                      (const uint64_t *)values);
+    }
+    if (!db_metadata_column_is_time(column) || header.num_ids > 0) {
+        return false;
+    }
 
-    // TODO: actually implement storing all exclude information
-    const uint32_t num_excludes = 0;
-    bytes_written += write_data_to_file(fp, &num_excludes, 4, 1, write_failed);
-    if (*write_failed == true) {
-        g_debug("[db_save] failed to save number of indexes: %d", num_excludes);
-        goto out;
+    g_autofree uint64_t *words = calloc(MAX(((uint64_t)num_entries + 1) / 2, 1), sizeof(uint64_t));
+    g_assert(words);
+    uint64_t pos = 0;
+    for (uint32_t i = 0; i < num_entries; i++) {
+        uint64_t encoded = 0;
+        if (!db_file_read_varint(values, values_size, &pos, &encoded)) {
+            return false;
+        }
+        const int64_t delta = (int64_t)(encoded >> 1) ^ -(int64_t)(encoded & 1);
+        const int64_t time = (int64_t)((uint64_t)(mtimes ? mtimes[i] : 0) + (uint64_t)delta);
+        words[i / 2] |= (uint64_t)CLAMP(time, 0, UINT32_MAX) << (32 * (i % 2));
     }
-out:
-    return bytes_written;
+    return pos == values_size && db_metadata_set_column(metadata, is_folder, column, NULL, 0, 32, words);
 }
 
-static size_t
-db_save_exclude_pattern(FILE *fp, FsearchDatabase *db, bool *write_failed) {
-    // TODO
-    return 0;
+// Returns NULL if index_flags has no metadata columns or they can't be loaded
+static FsearchDatabaseMetadata *
+db_load_mapped_metadata(DatabaseFileMapping *mapping,
+                        FsearchDatabaseIndexFlags index_flags,
+                        DynamicArray *folders,
+                        DynamicArray *files) {
+    FsearchDatabaseMetadata *metadata = db_metadata_new(index_flags, folders, files);
+    if (!metadata) {
+        return NULL;
+    }
+    for (uint32_t i = 0; i < 2; i++) {
+        const DatabaseSectionId names_id = i == 0 ? DATABASE_SECTION_FOLDER_NAMES : DATABASE_SECTION_FILE_NAMES;
+        const uint32_t num_entries = darray_get_num_items(i == 0 ? folders : files);
+        // the timestamps are relative to the modification times
+        const int64_t *mtimes = NULL;
+        if ((index_flags & DATABASE_INDEX_FLAG_MODIFICATION_TIME) != 0) {
+            mtimes = db_file_mapping_get_section(mapping,
+                                                 names_id + DATABASE_SECTION_OFFSET_MTIMES,
+                                                 (uint64_t)num_entries * 8,
+                                                 NULL);
+            if (!mtimes && num_entries > 0) {
+                g_clear_pointer(&metadata, db_metadata_unref);
+                return NULL;
+            }
+        }
+        for (uint32_t column = 0; column < NUM_DATABASE_METADATA_COLUMNS; column++) {
+            if (db_metadata_has_column(metadata, column)
+                && !db_load_mapped_metadata_column(mapping, metadata, i == 0, column, mtimes)) {
+                g_debug("[db_load] failed to load metadata column: %d", column);
+                g_clear_pointer(&metadata, db_metadata_unref);
+                return NULL;
+            }
+        }
+    }
+    db_metadata_seal(metadata);
+    return metadata;
 }
 
-bool
-db_save(FsearchDatabase *db, const char *path) {
-    g_assert(path);
-    g_assert(db);
-
-    g_debug("[db_save] saving database to file...");
-
-    if (!g_file_test(path, G_FILE_TEST_IS_DIR)) {
-        g_debug("[db_save] database path doesn't exist: %s", path);
+static bool
+db_load_mapped(FsearchDatabase *db,
+               FILE *fp,
+               FsearchDatabaseIndexFlags *index_flags_out,
+               time_t *scan_time_out,
+               FsearchDatabaseMetadata **metadata_out,
+               DynamicArray **sorted_folders,
+               DynamicArray **sorted_files,
+               void (*status_cb)(const char *)) {
+    g_autoptr(GError) error = NULL;
+    GMappedFile *mapped_file = g_mapped_file_new_from_fd(fileno(fp), FALSE, &error);
+    if (!mapped_file) {
+        g_debug("[db_load] failed to map database file: %s", error->message);
         return false;
     }
+    // the entries reference the contents from now on, so they have to stay around as long as the database,
+    // even if loading fails
+    g_clear_pointer(&db->file_contents, g_bytes_unref);
+    db->file_contents = g_mapped_file_get_bytes(mapped_file);
+    g_clear_pointer(&mapped_file, g_mapped_file_unref);
 
-    g_autoptr(GTimer) timer = g_timer_new();
-    g_timer_start(timer);
-
-    g_autoptr(GString) path_full = g_string_new(path);
-    g_string_append_c(path_full, G_DIR_SEPARATOR);
-    g_string_append(path_full, "fsearch.db");
-
-    g_autoptr(GString) path_full_temp = g_string_new(path_full->str);
-    g_string_append(path_full_temp, ".tmp");
-
-    g_debug("[db_save] trying to open temporary database file: %s", path_full_temp->str);
-
-    FILE *fp = db_file_open_locked(path_full_temp->str, "wb");
-    if (!fp) {
-        g_debug("[db_save] failed to open temporary database file: %s", path_full_temp->str);
-        goto save_fail;
+    gsize size = 0;
+    const uint8_t *data = g_bytes_get_data(db->file_contents, &size);
+    if (!db_file_header_is_complete(data, size)) {
+        g_debug("[db_load] database file is too small");
+        return false;
+    }
+#ifdef POSIX_MADV_WILLNEED
+    // everything gets touched while loading, so read ahead as much as possible
+    posix_madvise((void *)data, size, POSIX_MADV_WILLNEED);
+#endif
+    if ((((const DatabaseFileHeader *)data)->flags & DATABASE_FILE_FLAG_COMPRESSED) != 0) {
+#ifdef HAVE_ZSTD
+        GBytes *image = db_file_decompress(db, data, size);
+        if (!image) {
+            return false;
+        }
+        // the names point into the decompressed file, the compressed one isn't needed anymore
+        g_clear_pointer(&db->file_contents, g_bytes_unref);
+        db->file_contents = image;
+        data = g_bytes_get_data(db->file_contents, &size);
+        if (!db_file_header_is_complete(data, size)) {
+            g_debug("[db_load] decompressed database file is too small");
+            return false;
+        }
+#else
+        g_debug("[db_load] database file is compressed, but FSearch was built without zstd support");
+        return false;
+#endif
     }
 
-    g_debug("[db_save] updating folder indices...");
-    db_entry_update_folder_indices(db);
-
-    bool write_failed = false;
-
-    size_t bytes_written = 0;
-
-    g_debug("[db_save] saving database header...");
-    bytes_written += db_save_header(fp, &write_failed);
-    if (write_failed == true) {
-        goto save_fail;
+    DatabaseFileMapping mapping = {
+        .data = data,
+        .size = size,
+    };
+    mapping.header = (const DatabaseFileHeader *)mapping.data;
+    if ((mapping.header->flags & DATABASE_FILE_FLAG_COMPRESSED) != 0) {
+        g_debug("[db_load] invalid flags: %d", mapping.header->flags);
+        return false;
+    }
+    const size_t header_size = db_file_header_get_size(mapping.header);
+    mapping.sections = (const DatabaseFileSection *)(mapping.data + header_size);
+    if (mapping.header->num_sections > DATABASE_FILE_MAX_SECTIONS
+        || header_size + mapping.header->num_sections * sizeof(DatabaseFileSection) > mapping.size) {
+        g_debug("[db_load] invalid number of sections: %d", mapping.header->num_sections);
+        return false;
     }
 
-    g_debug("[db_save] saving database index flags...");
-    const uint64_t index_flags = db->index_flags;
-    bytes_written += write_data_to_file(fp, &index_flags, 8, 1, &write_failed);
-    if (write_failed == true) {
-        goto save_fail;
+    FsearchDatabaseIndexFlags index_flags = mapping.header->index_flags;
+    if (mapping.header->minor_version >= DATABASE_MINOR_VERSION_SCAN_TIME) {
+        *scan_time_out = (time_t)mapping.header->scan_time;
     }
+    const uint32_t num_folders = mapping.header->num_folders;
+    const uint32_t num_files = mapping.header->num_files;
+    g_debug("[db_load] load %d folders, %d files", num_folders, num_files);
 
-    DynamicArray *files = db->sorted_files[DATABASE_INDEX_TYPE_NAME];
-    DynamicArray *folders = db->sorted_folders[DATABASE_INDEX_TYPE_NAME];
+    // the folders array maps the parent indices to the corresponding pointers
+    sorted_folders[DATABASE_INDEX_TYPE_NAME] = darray_new(num_folders);
+    DynamicArray *folders = sorted_folders[DATABASE_INDEX_TYPE_NAME];
 
-    const uint32_t num_folders = darray_get_num_items(folders);
-    g_debug("[db_save] saving number of folders: %d", num_folders);
-    bytes_written += write_data_to_file(fp, &num_folders, 4, 1, &write_failed);
-    if (write_failed == true) {
-        goto save_fail;
+    if (status_cb) {
+        status_cb(_("Loading folders…"));
+    }
+    // names and parents are all it takes to search, everything else can follow once the database is in use
+    const bool load_metadata = !db->progressive_load;
+    if (!db_load_mapped_entries(db,
+                                &mapping,
+                                index_flags,
+                                DATABASE_SECTION_FOLDER_NAMES,
+                                db->folder_pool,
+                                DATABASE_ENTRY_TYPE_FOLDER,
+                                folders,
+                                folders,
+                                num_folders,
+                                load_metadata)) {
+        return false;
     }
 
-    const uint32_t num_files = darray_get_num_items(files);
-    g_debug("[db_save] saving number of files: %d", num_files);
-    bytes_written += write_data_to_file(fp, &num_files, 4, 1, &write_failed);
-    if (write_failed == true) {
-        goto save_fail;
+    if (status_cb) {
+        status_cb(_("Loading files…"));
+    }
+    sorted_files[DATABASE_INDEX_TYPE_NAME] = darray_new(num_files);
+    DynamicArray *files = sorted_files[DATABASE_INDEX_TYPE_NAME];
+    if (!db_load_mapped_entries(db,
+                                &mapping,
+                                index_flags,
+                                DATABASE_SECTION_FILE_NAMES,
+                                db->file_pool,
+                                DATABASE_ENTRY_TYPE_FILE,
+                                folders,
+                                files,
+                                num_files,
+                                load_metadata)) {
+        return false;
+    }
+
+    for (uint32_t type = DATABASE_INDEX_TYPE_NAME + 1;
+         type < NUM_DATABASE_INDEX_TYPES && !db_sorts_lazily(db) && !db->progressive_load;
+         type++) {
+        if (!db_file_mapping_get_section(&mapping, DATABASE_SECTION_SORTED_FOLDERS | type, 0, NULL)) {
+            continue;
+        }
+        sorted_folders[type] = db_load_mapped_sorted_entries(&mapping, DATABASE_SECTION_SORTED_FOLDERS | type, folders);
+        sorted_files[type] = db_load_mapped_sorted_entries(&mapping, DATABASE_SECTION_SORTED_FILES | type, files);
+        if (!sorted_folders[type] || !sorted_files[type]) {
+            g_debug("[db_load] failed to load sorted array: %d", type);
+            return false;
+        }
+    }
+    db_load_mapped_indexes(db, &mapping);
+    db_load_mapped_folder_ids(db, &mapping, folders);
+
+    *metadata_out = db_load_mapped_metadata(&mapping, index_flags, folders, files);
+    if (!*metadata_out) {
+        // the entries are still fine without them, the next scan adds them again
+        index_flags &= ~DATABASE_INDEX_FLAGS_METADATA;
+    }
+    *index_flags_out = index_flags;
+    return true;
+}
+
+static bool
+db_load_legacy(FsearchDatabase *db,
+               FILE *fp,
+               FsearchDatabaseIndexFlags *index_flags_out,
+               DynamicArray **sorted_folders,
+               DynamicArray **sorted_files,
+               void (*status_cb)(const char *)) {
+    uint64_t index_flags = 0;
+    if (!read_element_from_file(&index_flags, 8, fp)) {
+        return false;
     }
 
+    uint32_t num_folders = 0;
+    if (!read_element_from_file(&num_folders, 4, fp)) {
+        return false;
+    }
+
+    uint32_t num_files = 0;
+    if (!read_element_from_file(&num_files, 4, fp)) {
+        return false;
+    }
+    g_debug("[db_load] load %d folders, %d files", num_folders, num_files);
+
     uint64_t folder_block_size = 0;
-    const uint64_t folder_block_size_offset = bytes_written;
-    g_debug("[db_save] saving folder block size...");
-    bytes_written += write_data_to_file(fp, &folder_block_size, 8, 1, &write_failed);
-    if (write_failed == true) {
-        goto save_fail;
+    if (!read_element_from_file(&folder_block_size, 8, fp)) {
+        return false;
     }
 
     uint64_t file_block_size = 0;
-    const uint64_t file_block_size_offset = bytes_written;
-    g_debug("[db_save] saving file block size...");
-    bytes_written += write_data_to_file(fp, &file_block_size, 8, 1, &write_failed);
-    if (write_failed == true) {
-        goto save_fail;
+    if (!read_element_from_file(&file_block_size, 8, fp)) {
+        return false;
     }
+    g_debug("[db_load] folder size: %lu, file size: %lu", folder_block_size, file_block_size);
 
-    g_debug("[db_save] saving indices...");
-    bytes_written += db_save_indexes(fp, db, &write_failed);
-    if (write_failed == true) {
-        goto save_fail;
+    // TODO: implement index loading
+    uint32_t num_indexes = 0;
+    if (!read_element_from_file(&num_indexes, 4, fp)) {
+        return false;
     }
-    g_debug("[db_save] saving excludes...");
-    bytes_written += db_save_excludes(fp, db, &write_failed);
-    if (write_failed == true) {
-        goto save_fail;
+
+    // TODO: implement exclude loading
+    uint32_t num_excludes = 0;
+    if (!read_element_from_file(&num_excludes, 4, fp)) {
+        return false;
     }
-    g_debug("[db_save] saving exclude pattern...");
-    bytes_written += db_save_exclude_pattern(fp, db, &write_failed);
-    if (write_failed == true) {
-        goto save_fail;
+
+    // pre-allocate the folders array so we can later map parent indices to the corresponding pointers
+    sorted_folders[DATABASE_INDEX_TYPE_NAME] = darray_new(num_folders);
+    DynamicArray *folders = sorted_folders[DATABASE_INDEX_TYPE_NAME];
+
+    fsearch_memory_pool_reserve(db->folder_pool, num_folders);
+    for (uint32_t i = 0; i < num_folders; i++) {
+        FsearchDatabaseEntryFolder *folder = fsearch_memory_pool_malloc(db->folder_pool);
+        FsearchDatabaseEntry *entry = (FsearchDatabaseEntry *)folder;
+        db_entry_set_idx(entry, i);
+        db_entry_set_type(entry, DATABASE_ENTRY_TYPE_FOLDER);
+        db_entry_set_parent(entry, NULL);
+        darray_add_item(folders, folder);
     }
-    g_debug("[db_save] saving folders...");
-    folder_block_size = db_save_folders(fp, index_flags, folders, num_folders, &write_failed);
-    bytes_written += folder_block_size;
-    if (write_failed == true) {
-        goto save_fail;
+
+    if (status_cb) {
+        status_cb(_("Loading folders…"));
     }
-    g_debug("[db_save] saving files...");
-    file_block_size = db_save_files(fp, index_flags, files, num_files, &write_failed);
-    bytes_written += file_block_size;
-    if (write_failed == true) {
-        goto save_fail;
+    // load folders
+    if (!db_load_folders(fp, index_flags, db->names, folders, num_folders, folder_block_size)) {
+        return false;
     }
-    g_debug("[db_save] saving sorted arrays...");
-    bytes_written += db_save_sorted_arrays(fp, db, num_files, num_folders, &write_failed);
-    if (write_failed == true) {
-        goto save_fail;
+
+    if (status_cb) {
+        status_cb(_("Loading files…"));
+    }
+    // load files
+    sorted_files[DATABASE_INDEX_TYPE_NAME] = darray_new(num_files);
+    DynamicArray *files = sorted_files[DATABASE_INDEX_TYPE_NAME];
+    fsearch_memory_pool_reserve(db->file_pool, num_files);
+    if (!db_load_files(fp, index_flags, db->file_pool, db->names, folders, files, num_files, file_block_size)) {
+        return false;
     }
 
-    // now that we know the size of the file/folder block we've written, store it in the file header
-    if (fseek(fp, (long int)folder_block_size_offset, SEEK_SET) != 0) {
-        goto save_fail;
+    if (!db_load_sorted_arrays(fp, sorted_folders, sorted_files)) {
+        return false;
     }
-    g_debug("[db_save] updating file and folder block size: %lu, %lu", folder_block_size, file_block_size);
-    bytes_written += write_data_to_file(fp, &folder_block_size, 8, 1, &write_failed);
-    if (write_failed == true) {
-        goto save_fail;
+
+    *index_flags_out = index_flags;
+    return true;
+}
+
+bool
+db_load(FsearchDatabase *db, const char *file_path, void (*status_cb)(const char *)) {
+    g_assert(file_path);
+    g_assert(db);
+
+    FILE *fp = db_file_open_locked(file_path, "rb");
+    if (!fp) {
+        return false;
     }
-    bytes_written += write_data_to_file(fp, &file_block_size, 8, 1, &write_failed);
-    if (write_failed == true) {
-        goto save_fail;
+    FSEARCH_TRACE1(db_load_start, file_path);
+
+    DynamicArray *sorted_folders[NUM_DATABASE_INDEX_TYPES] = {NULL};
+    DynamicArray *sorted_files[NUM_DATABASE_INDEX_TYPES] = {NULL};
+    FsearchDatabaseIndexFlags index_flags = 0;
+    time_t scan_time = 0;
+    FsearchDatabaseMetadata *metadata = NULL;
+
+    uint8_t major_version = 0;
+    if (!db_load_header(fp, &major_version)) {
+        goto load_fail;
+    }
+    if (major_version == DATABASE_LEGACY_MAJOR_VERSION) {
+        if (!db_load_legacy(db, fp, &index_flags, sorted_folders, sorted_files, status_cb)) {
+            goto load_fail;
+        }
+    }
+    else if (!db_load_mapped(db, fp, &index_flags, &scan_time, &metadata, sorted_folders, sorted_files, status_cb)) {
+        goto load_fail;
     }
 
-    g_debug("[db_save] removing current database file...");
-    // remove current database file
-    unlink(path_full->str);
+    db_sorted_entries_free(db);
 
-    g_clear_pointer(&fp, fclose);
+    for (uint32_t i = 0; i < NUM_DATABASE_INDEX_TYPES; i++) {
+        db->sorted_files[i] = sorted_files[i];
+        db->sorted_folders[i] = sorted_folders[i];
+    }
 
-    g_debug("[db_save] renaming temporary database file: %s -> %s", path_full_temp->str, path_full->str);
-    // rename temporary fsearch.db.tmp to fsearch.db
-    if (rename(path_full_temp->str, path_full->str) != 0) {
-        goto save_fail;
+    db->index_flags = index_flags;
+    db->metadata = metadata;
+    // the sorted sections stay in the file until they're needed
+    const bool is_mapped = major_version != DATABASE_LEGACY_MAJOR_VERSION;
+    db->sorted_sections_pending = (db_sorts_lazily(db) || db->progressive_load) && is_mapped;
+    db->metadata_pending = db->progressive_load && is_mapped
+                        && (index_flags & (DATABASE_INDEX_FLAG_SIZE | DATABASE_INDEX_FLAG_MODIFICATION_TIME)) != 0;
+    db->folded_names_pending = is_mapped;
+    db->trigrams_pending = is_mapped;
+    // files without ids (or older ones) get new ones
+    db_assign_folder_ids(db, db->sorted_folders[DATABASE_INDEX_TYPE_NAME]);
+    // the folders in path order don't need to be sorted for that
+    db_entry_folders_update_ranks(db->sorted_folders[DATABASE_INDEX_TYPE_PATH]
+                                      ? db->sorted_folders[DATABASE_INDEX_TYPE_PATH]
+                                      : db->sorted_folders[DATABASE_INDEX_TYPE_NAME]);
+
+    // Rescans skip the folders which weren't modified since the scan started, so that's what the timestamp has to be.
+    // Older files don't store it, the time they were saved is the closest we've got.
+    struct stat db_file_st;
+    if (!fstat(fileno(fp), &db_file_st)) {
+        db->timestamp = scan_time != 0 ? scan_time : db_file_st.st_mtime;
+        db_file_id_init(&db->base_file_id, &db_file_st);
+    }
+    else if (scan_time != 0) {
+        db->timestamp = scan_time;
     }
 
-    const double seconds = g_timer_elapsed(timer, NULL);
-    g_timer_stop(timer);
+    g_clear_pointer(&fp, fclose);
 
-    g_debug("[db_save] database file saved in: %f ms", seconds * 1000);
+    db_journal_load(db, file_path);
+    db_publish_version(db);
 
+    FSEARCH_TRACE2(db_load_end, file_path, true);
     return true;
 
-save_fail:
-    g_warning("[db_save] saving failed");
+load_fail:
+    g_debug("[db_load] load failed");
+    FSEARCH_TRACE2(db_load_end, file_path, false);
 
     g_clear_pointer(&fp, fclose);
 
-    // remove temporary fsearch.db.tmp file
-    unlink(path_full_temp->str);
+    for (uint32_t i = 0; i < NUM_DATABASE_INDEX_TYPES; i++) {
+        g_clear_pointer(&sorted_folders[i], darray_unref);
+        g_clear_pointer(&sorted_files[i], darray_unref);
+    }
+    if (!db->sorted_files[DATABASE_INDEX_TYPE_NAME] && !db->sorted_folders[DATABASE_INDEX_TYPE_NAME]) {
+        // the pools only hold the partially loaded entries, which nothing references anymore
+        fsearch_memory_pool_reset(db->file_pool);
+        fsearch_memory_pool_reset(db->folder_pool);
+    }
 
     return false;
 }
 
-static bool
-file_is_excluded(const char *name, char **exclude_files) {
-    if (exclude_files) {
-        for (int i = 0; exclude_files[i]; ++i) {
-            if (!fnmatch(exclude_files[i], name, 0)) {
-                return true;
-            }
+// Everything which is needed to write the database file. The sorted arrays are never modified in place (they get
+// replaced by db_apply_changes) and entries aren't freed before the database, so a snapshot can be written
+// without holding the database lock.
+typedef struct DatabaseSnapshot {
+    DynamicArray *sorted_files[NUM_DATABASE_INDEX_TYPES];
+    DynamicArray *sorted_folders[NUM_DATABASE_INDEX_TYPES];
+    FsearchDatabaseIndexFlags index_flags;
+    // when the scan of the entries started
+    time_t timestamp;
+    bool compress;
+    // the blocks get compressed on the saving thread alone if there's no thread pool
+    FsearchThreadPool *thread_pool;
+    // the loaded file, if the sorted sections which weren't loaded yet have to be copied from it
+    GBytes *pending_file_contents;
+    // NULL if there are no folded names for the name arrays
+    FsearchDatabaseFoldedNames *folded_names;
+    // NULL if there's no trigram index of the name arrays
+    FsearchDatabaseTrigrams *trigrams;
+    // NULL if the name arrays have no metadata columns, they're encoded by db_save_sections
+    FsearchDatabaseMetadata *metadata;
+    GByteArray *metadata_columns[2][NUM_DATABASE_METADATA_COLUMNS];
+    uint32_t next_folder_id;
+    // Live changes update the size and modification time of entries in place. For snapshots which are written in
+    // the background, they're copied in the order of the name arrays (folders first, then files), so the file
+    // matches the journal.
+    uint64_t *sizes[2];
+    uint64_t *mtimes[2];
+    // encoded DATABASE_SECTION_INDEXES and DATABASE_SECTION_EXCLUDES
+    GByteArray *indexes;
+    GByteArray *excludes;
+    char *path;
+
+    // the journal records and sort orders this snapshot contains, the database gets them back if saving fails
+    GByteArray *journal;
+    bool sorted_arrays_changed;
+
+    GThread *thread;
+    volatile gint done;
+    bool result;
+    DatabaseFileId file_id;
+} DatabaseSnapshot;
+
+// All sections are written through a DatabaseFileWriter. For compressed files it collects the data in blocks of
+// DATABASE_FILE_BLOCK_SIZE, which get compressed in batches on all threads of the database.
+typedef struct DatabaseFileWriter {
+    FILE *fp;
+#ifdef HAVE_ZSTD
+    FsearchThreadPool *thread_pool;
+    // uncompressed data of the current batch
+    uint8_t *buffer;
+    size_t buffer_len;
+    size_t buffer_size;
+    // compressed data of the current batch, one per block
+    uint8_t **compressed;
+    size_t *compressed_len;
+    size_t compressed_size;
+
+    DatabaseFileBlock *blocks;
+    uint32_t num_blocks;
+    uint32_t max_blocks;
+    uint64_t offset;
+    volatile gint next_block;
+#endif
+} DatabaseFileWriter;
+
+#ifdef HAVE_ZSTD
+static void
+db_file_writer_compress_thread(gpointer data) {
+    DatabaseFileWriter *writer = data;
+    const uint32_t num_blocks = (writer->buffer_len + DATABASE_FILE_BLOCK_SIZE - 1) / DATABASE_FILE_BLOCK_SIZE;
+    while (true) {
+        const uint32_t block = (uint32_t)g_atomic_int_add(&writer->next_block, 1);
+        if (block >= num_blocks) {
+            break;
         }
+        const size_t start = (size_t)block * DATABASE_FILE_BLOCK_SIZE;
+        const size_t len = MIN(DATABASE_FILE_BLOCK_SIZE, writer->buffer_len - start);
+        const size_t res = ZSTD_compress(writer->compressed[block],
+                                         writer->compressed_size,
+                                         writer->buffer + start,
+                                         len,
+                                         DATABASE_FILE_COMPRESSION_LEVEL);
+        // blocks which don't get any smaller are stored as they are
+        writer->compressed_len[block] = ZSTD_isError(res) || res >= len ? 0 : res;
     }
-    return false;
 }
 
-static bool
-directory_is_excluded(const char *name, GList *excludes) {
-    while (excludes) {
-        FsearchExcludePath *fs_path = excludes->data;
-        if (!strcmp(name, fs_path->path)) {
-            if (fs_path->enabled) {
-                return true;
+static void
+db_file_writer_flush(DatabaseFileWriter *writer, bool *write_failed) {
+    if (writer->buffer_len == 0 || *write_failed) {
+        return;
+    }
+    g_atomic_int_set(&writer->next_block, 0);
+    db_run_on_all_threads(writer->thread_pool, db_file_writer_compress_thread, writer);
+
+    for (size_t start = 0; start < writer->buffer_len && !*write_failed; start += DATABASE_FILE_BLOCK_SIZE) {
+        const uint32_t block = start / DATABASE_FILE_BLOCK_SIZE;
+        const size_t len = MIN(DATABASE_FILE_BLOCK_SIZE, writer->buffer_len - start);
+        if (writer->num_blocks >= writer->max_blocks) {
+            g_debug("[db_save] more blocks than expected: %d", writer->num_blocks);
+            *write_failed = true;
+            return;
+        }
+        DatabaseFileBlock *b = &writer->blocks[writer->num_blocks++];
+        b->offset = writer->offset;
+        b->size = len;
+        b->compressed_size = writer->compressed_len[block] > 0 ? writer->compressed_len[block] : len;
+        const void *data = writer->compressed_len[block] > 0 ? writer->compressed[block] : writer->buffer + start;
+        if (fwrite(data, b->compressed_size, 1, writer->fp) != 1) {
+            *write_failed = true;
+        }
+        writer->offset += b->compressed_size;
+    }
+    writer->buffer_len = 0;
+}
+
+// Writes the header of a compressed file and makes all following writes go through the compressor.
+// image_size is the size of the uncompressed file.
+static void
+db_file_writer_start_compression(DatabaseFileWriter *writer,
+                                 FsearchThreadPool *thread_pool,
+                                 const DatabaseFileHeader *image_header,
+                                 uint64_t image_size,
+                                 bool *write_failed) {
+    const uint32_t num_blocks = (image_size + DATABASE_FILE_BLOCK_SIZE - 1) / DATABASE_FILE_BLOCK_SIZE;
+    const uint32_t num_threads = thread_pool ? MAX(fsearch_thread_pool_get_num_threads(thread_pool), 1) : 1;
+
+    DatabaseFileHeader header = *image_header;
+    header.flags = DATABASE_FILE_FLAG_COMPRESSED;
+    header.num_sections = 0;
+    header.num_blocks = num_blocks;
+    if (fwrite(&header, sizeof(header), 1, writer->fp) != 1) {
+        g_debug("[db_save] failed to write compressed file header");
+        *write_failed = true;
+    }
+
+    writer->thread_pool = thread_pool;
+    writer->buffer_size = (size_t)num_threads * DATABASE_FILE_BLOCK_SIZE;
+    writer->buffer = g_malloc(writer->buffer_size);
+    writer->compressed_size = ZSTD_compressBound(DATABASE_FILE_BLOCK_SIZE);
+    writer->compressed = g_new0(uint8_t *, num_threads);
+    writer->compressed_len = g_new0(size_t, num_threads);
+    for (uint32_t i = 0; i < num_threads; i++) {
+        writer->compressed[i] = g_malloc(writer->compressed_size);
+    }
+    writer->max_blocks = num_blocks;
+    writer->blocks = g_new0(DatabaseFileBlock, num_blocks);
+
+    // the block table is written once all blocks are compressed, until then it's only reserved
+    if (num_blocks > 0 && fwrite(writer->blocks, sizeof(DatabaseFileBlock), num_blocks, writer->fp) != num_blocks) {
+        *write_failed = true;
+    }
+    writer->offset = sizeof(header) + (uint64_t)num_blocks * sizeof(DatabaseFileBlock);
+}
+#endif
+
+static void
+db_file_writer_finish(DatabaseFileWriter *writer, bool *write_failed) {
+#ifdef HAVE_ZSTD
+    if (!writer->buffer) {
+        return;
+    }
+    db_file_writer_flush(writer, write_failed);
+    if (!*write_failed && writer->num_blocks != writer->max_blocks) {
+        g_debug("[db_save] expected %d blocks, got %d", writer->max_blocks, writer->num_blocks);
+        *write_failed = true;
+    }
+    if (!*write_failed && writer->num_blocks > 0
+        && (fseek(writer->fp, sizeof(DatabaseFileHeader), SEEK_SET) != 0
+            || fwrite(writer->blocks, sizeof(DatabaseFileBlock), writer->num_blocks, writer->fp) != writer->num_blocks)) {
+        *write_failed = true;
+    }
+
+    for (uint32_t i = 0; i < writer->buffer_size / DATABASE_FILE_BLOCK_SIZE; i++) {
+        g_free(writer->compressed[i]);
+    }
+    g_clear_pointer(&writer->compressed, g_free);
+    g_clear_pointer(&writer->compressed_len, g_free);
+    g_clear_pointer(&writer->blocks, g_free);
+    g_clear_pointer(&writer->buffer, g_free);
+#endif
+}
+
+static size_t
+write_data_to_file(DatabaseFileWriter *writer,
+                   const void *data,
+                   size_t data_size,
+                   size_t num_elements,
+                   bool *write_failed) {
+    if (data_size == 0 || num_elements == 0) {
+        return 0;
+    }
+#ifdef HAVE_ZSTD
+    if (writer->buffer) {
+        const uint8_t *src = data;
+        size_t len = data_size * num_elements;
+        while (len > 0 && !*write_failed) {
+            const size_t n = MIN(len, writer->buffer_size - writer->buffer_len);
+            memcpy(writer->buffer + writer->buffer_len, src, n);
+            writer->buffer_len += n;
+            src += n;
+            len -= n;
+            if (writer->buffer_len == writer->buffer_size) {
+                db_file_writer_flush(writer, write_failed);
             }
-            return false;
         }
-        excludes = excludes->next;
+        return *write_failed ? 0 : data_size * num_elements;
     }
-    return false;
+#endif
+    if (fwrite(data, data_size, num_elements, writer->fp) != num_elements) {
+        *write_failed = true;
+        return 0;
+    }
+    return data_size * num_elements;
 }
 
-typedef struct DatabaseWalkContext {
-    FsearchDatabase *db;
-    GString *path;
-    GTimer *timer;
-    GCancellable *cancellable;
-    void (*status_cb)(const char *);
+// Column of a section which holds one value per entry
+typedef enum {
+    DATABASE_COLUMN_PARENT,
+    DATABASE_COLUMN_SIZE,
+    DATABASE_COLUMN_MTIME,
+    DATABASE_COLUMN_IDX,
+    DATABASE_COLUMN_FOLDER_ID,
+} DatabaseColumn;
+
+static uint64_t
+db_file_align(uint64_t offset) {
+    return (offset + DATABASE_SECTION_ALIGNMENT - 1) & ~((uint64_t)DATABASE_SECTION_ALIGNMENT - 1);
+}
 
-    dev_t root_device_id;
-    bool one_filesystem;
-    bool exclude_hidden;
-} DatabaseWalkContext;
+static uint64_t
+db_get_names_size(DynamicArray *entries, uint32_t num_entries) {
+    uint64_t size = 0;
+    for (uint32_t i = 0; i < num_entries; i++) {
+        size += strlen(db_entry_get_name_raw(darray_get_item(entries, i))) + 1;
+    }
+    return size;
+}
 
-static int
-db_folder_scan_recursive(DatabaseWalkContext *walk_context, FsearchDatabaseEntryFolder *parent) {
-    if (walk_context->cancellable && g_cancellable_is_cancelled(walk_context->cancellable)) {
-        g_debug("[db_scan] cancelled");
-        return WALK_CANCEL;
+static void
+db_file_add_section(DatabaseFileSection *sections, uint32_t *num_sections, uint32_t id, uint64_t size) {
+    sections[*num_sections].id = id;
+    sections[*num_sections].size = size;
+    *num_sections += 1;
+}
+
+static void
+db_save_entry_sections(DatabaseSnapshot *snapshot,
+                       DatabaseSectionId names_id,
+                       DynamicArray *entries,
+                       uint32_t num_entries,
+                       DatabaseFileSection *sections,
+                       uint32_t *num_sections) {
+    db_file_add_section(sections, num_sections, names_id, db_get_names_size(entries, num_entries));
+    db_file_add_section(sections,
+                        num_sections,
+                        names_id | DATABASE_SECTION_NAME_CHUNKS,
+                        (uint64_t)(num_entries + DATABASE_FILE_CHUNK_SIZE - 1) / DATABASE_FILE_CHUNK_SIZE * 8);
+    db_file_add_section(sections, num_sections, names_id + DATABASE_SECTION_OFFSET_PARENTS, num_entries * 4);
+    if ((snapshot->index_flags & DATABASE_INDEX_FLAG_SIZE) != 0) {
+        db_file_add_section(sections, num_sections, names_id + DATABASE_SECTION_OFFSET_SIZES, (uint64_t)num_entries * 8);
+    }
+    if ((snapshot->index_flags & DATABASE_INDEX_FLAG_MODIFICATION_TIME) != 0) {
+        db_file_add_section(sections, num_sections, names_id + DATABASE_SECTION_OFFSET_MTIMES, (uint64_t)num_entries * 8);
     }
+}
 
-    GString *path = walk_context->path;
-    g_string_append_c(path, G_DIR_SEPARATOR);
+static uint64_t
+db_entry_get_column_value(FsearchDatabaseEntry *entry, DatabaseColumn column) {
+    switch (column) {
+    case DATABASE_COLUMN_PARENT: {
+        FsearchDatabaseEntryFolder *parent = db_entry_get_parent(entry);
+        return parent ? db_entry_get_idx((FsearchDatabaseEntry *)parent) : DATABASE_FILE_NO_PARENT;
+    }
+    case DATABASE_COLUMN_SIZE:
+        return (uint64_t)db_entry_get_size(entry);
+    case DATABASE_COLUMN_MTIME:
+        return (uint64_t)db_entry_get_mtime(entry);
+    case DATABASE_COLUMN_IDX:
+        return db_entry_get_idx(entry);
+    case DATABASE_COLUMN_FOLDER_ID:
+        return db_entry_folder_get_id((FsearchDatabaseEntryFolder *)entry);
+    }
+    return 0;
+}
 
-    // remember end of parent path
-    const gsize path_len = path->len;
+static void
+db_save_column(DatabaseFileWriter *writer, DynamicArray *entries, uint32_t num_entries, DatabaseColumn column, bool *write_failed) {
+    const bool is_64bit = column == DATABASE_COLUMN_SIZE || column == DATABASE_COLUMN_MTIME;
+    // values get collected in a buffer first, so there's only one write call for a whole batch
+    uint64_t buffer64[1024];
+    uint32_t buffer32[1024];
+    uint32_t num_buffered = 0;
+    for (uint32_t i = 0; i < num_entries && !*write_failed; i++) {
+        const uint64_t value = db_entry_get_column_value(darray_get_item(entries, i), column);
+        if (is_64bit) {
+            buffer64[num_buffered++] = value;
+        }
+        else {
+            buffer32[num_buffered++] = (uint32_t)value;
+        }
+        if (num_buffered == G_N_ELEMENTS(buffer64) || i == num_entries - 1) {
+            write_data_to_file(writer, is_64bit ? (void *)buffer64 : (void *)buffer32, is_64bit ? 8 : 4, num_buffered, write_failed);
+            num_buffered = 0;
+        }
+    }
+}
+
+static void
+db_save_names(DatabaseFileWriter *writer, DynamicArray *entries, uint32_t num_entries, bool *write_failed) {
+    for (uint32_t i = 0; i < num_entries && !*write_failed; i++) {
+        const char *name = db_entry_get_name_raw(darray_get_item(entries, i));
+        write_data_to_file(writer, name, strlen(name) + 1, 1, write_failed);
+    }
+}
+
+static void
+db_save_name_chunks(DatabaseFileWriter *writer, DynamicArray *entries, uint32_t num_entries, bool *write_failed) {
+    uint64_t offset = 0;
+    for (uint32_t i = 0; i < num_entries && !*write_failed; i++) {
+        if (i % DATABASE_FILE_CHUNK_SIZE == 0) {
+            write_data_to_file(writer, &offset, 8, 1, write_failed);
+        }
+        offset += strlen(db_entry_get_name_raw(darray_get_item(entries, i))) + 1;
+    }
+}
+
+static uint64_t
+db_get_folded_names_size(const char **names, uint32_t num_entries) {
+    uint64_t size = sizeof(DatabaseFileFoldedNames);
+    for (uint32_t i = 0; i < num_entries; i++) {
+        size += (names[i] ? strlen(names[i]) : 0) + 1;
+    }
+    return size;
+}
+
+static void
+db_save_folded_names(DatabaseFileWriter *writer, const FsearchDatabaseFoldedNames *names, bool is_folder, bool *write_failed) {
+    const DatabaseFileFoldedNames header = {.fold_options = names->fold_options};
+    write_data_to_file(writer, &header, sizeof(header), 1, write_failed);
+
+    const char **folded_names = is_folder ? names->folder_names : names->file_names;
+    const uint32_t num_entries = darray_get_num_items(is_folder ? names->folders : names->files);
+    for (uint32_t i = 0; i < num_entries && !*write_failed; i++) {
+        const char *name = folded_names[i] ? folded_names[i] : "";
+        write_data_to_file(writer, name, strlen(name) + 1, 1, write_failed);
+    }
+}
+
+static uint64_t
+db_get_trigrams_size(const FsearchDatabaseTrigramList *list) {
+    return sizeof(DatabaseFileTrigrams) + (uint64_t)list->num_keys * 8 + ((uint64_t)list->num_keys + 1) * 8
+         + list->offsets[list->num_keys];
+}
+
+static void
+db_save_trigrams(DatabaseFileWriter *writer, const FsearchDatabaseTrigramList *list, bool *write_failed) {
+    const DatabaseFileTrigrams header = {.num_keys = list->num_keys};
+    write_data_to_file(writer, &header, sizeof(header), 1, write_failed);
+    write_data_to_file(writer, list->keys, 4, list->num_keys, write_failed);
+    write_data_to_file(writer, list->num_postings, 4, list->num_keys, write_failed);
+    write_data_to_file(writer, list->offsets, 8, list->num_keys + 1, write_failed);
+    write_data_to_file(writer, list->postings, 1, list->offsets[list->num_keys], write_failed);
+}
+
+static uint64_t *
+db_snapshot_copy_column(DynamicArray *entries, DatabaseColumn column) {
+    const uint32_t num_entries = entries ? darray_get_num_items(entries) : 0;
+    uint64_t *values = g_new(uint64_t, MAX(num_entries, 1));
+    for (uint32_t i = 0; i < num_entries; i++) {
+        values[i] = db_entry_get_column_value(darray_get_item(entries, i), column);
+    }
+    return values;
+}
+
+static void
+db_file_append_varint(GByteArray *data, uint64_t value) {
+    uint8_t buffer[10];
+    uint32_t len = 0;
+    while (value >= 0x80) {
+        buffer[len++] = (uint8_t)(value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+    buffer[len++] = (uint8_t)value;
+    g_byte_array_append(data, buffer, len);
+}
+
+// mtimes are the modification times which are written with the entries, NULL if there are none
+static GByteArray *
+db_file_encode_metadata_column(const FsearchDatabaseMetadata *metadata,
+                               bool is_folder,
+                               FsearchDatabaseMetadataColumn column,
+                               const uint64_t *mtimes) {
+    const FsearchDatabaseMetadataValues *values = &metadata->columns[!is_folder][column];
+    const bool is_time = db_metadata_column_is_time(column);
+    const DatabaseFileMetadataColumn header = {.num_ids = values->num_ids, .bits = is_time ? 0 : values->bits};
+    GByteArray *data = g_byte_array_new();
+    g_byte_array_append(data, (const guint8 *)&header, sizeof(header));
+    g_byte_array_append(data, (const guint8 *)values->ids, values->num_ids * 4);
+    const uint8_t padding[8] = {};
+    g_byte_array_append(data, padding, (8 - data->len % 8) % 8);
+    if (!is_time) {
+        g_byte_array_append(data,
+                            (const guint8 *)values->words,
+                            db_metadata_get_num_words(metadata, is_folder, column) * 8);
+        return data;
+    }
+    const uint32_t num_entries = darray_get_num_items(is_folder ? metadata->folders : metadata->files);
+    for (uint32_t i = 0; i < num_entries; i++) {
+        const int64_t value = db_metadata_get_value(metadata, is_folder, column, i);
+        const int64_t delta = value - (mtimes ? mtimes[i] : 0);
+        db_file_append_varint(data, ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+    }
+    return data;
+}
+
+static void
+db_snapshot_encode_metadata(DatabaseSnapshot *snapshot) {
+    for (uint32_t i = 0; i < 2 && snapshot->metadata; i++) {
+        DynamicArray *entries = i == 0 ? snapshot->sorted_folders[DATABASE_INDEX_TYPE_NAME]
+                                       : snapshot->sorted_files[DATABASE_INDEX_TYPE_NAME];
+        const uint64_t *mtimes = NULL;
+        g_autofree uint64_t *entry_mtimes = NULL;
+        if ((snapshot->index_flags & DATABASE_INDEX_FLAG_MODIFICATION_TIME) != 0) {
+            mtimes = snapshot->mtimes[i];
+            if (!mtimes) {
+                mtimes = entry_mtimes = db_snapshot_copy_column(entries, DATABASE_COLUMN_MTIME);
+            }
+        }
+        for (uint32_t column = 0; column < NUM_DATABASE_METADATA_COLUMNS; column++) {
+            if (db_metadata_has_column(snapshot->metadata, column) && !snapshot->metadata_columns[i][column]) {
+                snapshot->metadata_columns[i][column] =
+                    db_file_encode_metadata_column(snapshot->metadata, i == 0, column, mtimes);
+            }
+        }
+    }
+}
+
+static bool
+db_snapshot_has_entries_sorted_by_type(DatabaseSnapshot *snapshot, FsearchDatabaseIndexType sort_type) {
+    return snapshot->sorted_folders[sort_type] && snapshot->sorted_files[sort_type];
+}
+
+static void
+db_save_section(DatabaseFileWriter *writer,
+                DatabaseSnapshot *snapshot,
+                const DatabaseFileSection *section,
+                bool *write_failed) {
+    if (section->id == DATABASE_SECTION_INDEXES || section->id == DATABASE_SECTION_EXCLUDES) {
+        GByteArray *data = section->id == DATABASE_SECTION_INDEXES ? snapshot->indexes : snapshot->excludes;
+        write_data_to_file(writer, data->data, 1, data->len, write_failed);
+        return;
+    }
+    if (section->id == DATABASE_SECTION_FOLDED_FOLDER_NAMES || section->id == DATABASE_SECTION_FOLDED_FILE_NAMES) {
+        db_save_folded_names(writer,
+                             snapshot->folded_names,
+                             section->id == DATABASE_SECTION_FOLDED_FOLDER_NAMES,
+                             write_failed);
+        return;
+    }
+    if (section->id == DATABASE_SECTION_FOLDER_TRIGRAMS || section->id == DATABASE_SECTION_FILE_TRIGRAMS) {
+        db_save_trigrams(writer,
+                         section->id == DATABASE_SECTION_FOLDER_TRIGRAMS ? &snapshot->trigrams->folder_trigrams
+                                                                         : &snapshot->trigrams->file_trigrams,
+                         write_failed);
+        return;
+    }
+    if (section->id == DATABASE_SECTION_FOLDER_IDS) {
+        const DatabaseFileFolderIds header = {.next_id = snapshot->next_folder_id};
+        write_data_to_file(writer, &header, sizeof(header), 1, write_failed);
+        DynamicArray *folders = snapshot->sorted_folders[DATABASE_INDEX_TYPE_NAME];
+        db_save_column(writer, folders, darray_get_num_items(folders), DATABASE_COLUMN_FOLDER_ID, write_failed);
+        return;
+    }
+    const uint32_t type = section->id & DATABASE_SECTION_INDEX_TYPE_MASK;
+    if (section->id & (DATABASE_SECTION_FOLDER_METADATA | DATABASE_SECTION_FILE_METADATA)) {
+        GByteArray *data = snapshot->metadata_columns[(section->id & DATABASE_SECTION_FILE_METADATA) != 0][type];
+        write_data_to_file(writer, data->data, 1, data->len, write_failed);
+        return;
+    }
+    if (section->id & (DATABASE_SECTION_SORTED_FOLDERS | DATABASE_SECTION_SORTED_FILES)) {
+        const bool is_folder = (section->id & DATABASE_SECTION_SORTED_FOLDERS) != 0;
+        const uint32_t num_entries = section->size / 4;
+        if (db_snapshot_has_entries_sorted_by_type(snapshot, type)) {
+            DynamicArray *entries = is_folder ? snapshot->sorted_folders[type] : snapshot->sorted_files[type];
+            db_save_column(writer, entries, num_entries, DATABASE_COLUMN_IDX, write_failed);
+        }
+        else {
+            // the entries are still in the order of the loaded file, so its indexes can be copied as they are
+            const uint32_t *indexes =
+                db_file_contents_get_sorted_section(snapshot->pending_file_contents, section->id, num_entries);
+            write_data_to_file(writer, indexes, 4, num_entries, write_failed);
+        }
+        return;
+    }
+
+    const uint32_t id = section->id & ~DATABASE_SECTION_NAME_CHUNKS;
+    const bool is_folder = id < DATABASE_SECTION_FILE_NAMES;
+    DynamicArray *entries = is_folder ? snapshot->sorted_folders[DATABASE_INDEX_TYPE_NAME]
+                                      : snapshot->sorted_files[DATABASE_INDEX_TYPE_NAME];
+    const uint32_t num_entries = darray_get_num_items(entries);
+    const DatabaseSectionId names_id = is_folder ? DATABASE_SECTION_FOLDER_NAMES : DATABASE_SECTION_FILE_NAMES;
+    if (section->id & DATABASE_SECTION_NAME_CHUNKS) {
+        db_save_name_chunks(writer, entries, num_entries, write_failed);
+        return;
+    }
+    switch (id - names_id) {
+    case 0:
+        db_save_names(writer, entries, num_entries, write_failed);
+        break;
+    case DATABASE_SECTION_OFFSET_PARENTS:
+        db_save_column(writer, entries, num_entries, DATABASE_COLUMN_PARENT, write_failed);
+        break;
+    case DATABASE_SECTION_OFFSET_SIZES:
+        if (snapshot->sizes[!is_folder]) {
+            write_data_to_file(writer, snapshot->sizes[!is_folder], 8, num_entries, write_failed);
+        }
+        else {
+            db_save_column(writer, entries, num_entries, DATABASE_COLUMN_SIZE, write_failed);
+        }
+        break;
+    case DATABASE_SECTION_OFFSET_MTIMES:
+        if (snapshot->mtimes[!is_folder]) {
+            write_data_to_file(writer, snapshot->mtimes[!is_folder], 8, num_entries, write_failed);
+        }
+        else {
+            db_save_column(writer, entries, num_entries, DATABASE_COLUMN_MTIME, write_failed);
+        }
+        break;
+    default:
+        g_assert_not_reached();
+    }
+}
+
+static bool
+db_save_sections(FILE *fp, DatabaseSnapshot *snapshot) {
+    DynamicArray *files = snapshot->sorted_files[DATABASE_INDEX_TYPE_NAME];
+    DynamicArray *folders = snapshot->sorted_folders[DATABASE_INDEX_TYPE_NAME];
+    const uint32_t num_folders = darray_get_num_items(folders);
+    const uint32_t num_files = darray_get_num_items(files);
+    GBytes *pending = snapshot->pending_file_contents;
+
+    DatabaseFileSection sections[DATABASE_FILE_MAX_SECTIONS] = {};
+    uint32_t num_sections = 0;
+    db_save_entry_sections(snapshot, DATABASE_SECTION_FOLDER_NAMES, folders, num_folders, sections, &num_sections);
+    db_save_entry_sections(snapshot, DATABASE_SECTION_FILE_NAMES, files, num_files, sections, &num_sections);
+    db_file_add_section(sections, &num_sections, DATABASE_SECTION_INDEXES, snapshot->indexes->len);
+    db_file_add_section(sections, &num_sections, DATABASE_SECTION_EXCLUDES, snapshot->excludes->len);
+    db_file_add_section(sections,
+                        &num_sections,
+                        DATABASE_SECTION_FOLDER_IDS,
+                        sizeof(DatabaseFileFolderIds) + (uint64_t)num_folders * 4);
+    if (snapshot->folded_names) {
+        db_file_add_section(sections,
+                            &num_sections,
+                            DATABASE_SECTION_FOLDED_FOLDER_NAMES,
+                            db_get_folded_names_size(snapshot->folded_names->folder_names, num_folders));
+        db_file_add_section(sections,
+                            &num_sections,
+                            DATABASE_SECTION_FOLDED_FILE_NAMES,
+                            db_get_folded_names_size(snapshot->folded_names->file_names, num_files));
+    }
+    if (snapshot->trigrams) {
+        db_file_add_section(sections,
+                            &num_sections,
+                            DATABASE_SECTION_FOLDER_TRIGRAMS,
+                            db_get_trigrams_size(&snapshot->trigrams->folder_trigrams));
+        db_file_add_section(sections,
+                            &num_sections,
+                            DATABASE_SECTION_FILE_TRIGRAMS,
+                            db_get_trigrams_size(&snapshot->trigrams->file_trigrams));
+    }
+    db_snapshot_encode_metadata(snapshot);
+    for (uint32_t i = 0; i < 2; i++) {
+        for (uint32_t column = 0; column < NUM_DATABASE_METADATA_COLUMNS; column++) {
+            if (snapshot->metadata_columns[i][column]) {
+                const uint32_t id = (i == 0 ? DATABASE_SECTION_FOLDER_METADATA : DATABASE_SECTION_FILE_METADATA) | column;
+                db_file_add_section(sections, &num_sections, id, snapshot->metadata_columns[i][column]->len);
+            }
+        }
+    }
+    for (uint32_t type = DATABASE_INDEX_TYPE_NAME + 1; type < NUM_DATABASE_INDEX_TYPES; type++) {
+        if (!db_snapshot_has_entries_sorted_by_type(snapshot, type)
+            && (!db_file_contents_get_sorted_section(pending, DATABASE_SECTION_SORTED_FOLDERS | type, num_folders)
+                || !db_file_contents_get_sorted_section(pending, DATABASE_SECTION_SORTED_FILES | type, num_files))) {
+            continue;
+        }
+        db_file_add_section(sections, &num_sections, DATABASE_SECTION_SORTED_FOLDERS | type, num_folders * 4);
+        db_file_add_section(sections, &num_sections, DATABASE_SECTION_SORTED_FILES | type, num_files * 4);
+    }
+
+    uint64_t offset = sizeof(DatabaseFileHeader) + num_sections * sizeof(DatabaseFileSection);
+    for (uint32_t i = 0; i < num_sections; i++) {
+        sections[i].offset = db_file_align(offset);
+        offset = sections[i].offset + sections[i].size;
+    }
+
+    DatabaseFileHeader header = {
+        .major_version = DATABASE_MAJOR_VERSION,
+        .minor_version = DATABASE_MINOR_VERSION,
+        .index_flags = snapshot->index_flags,
+        .num_folders = num_folders,
+        .num_files = num_files,
+        .num_sections = num_sections,
+        .scan_time = snapshot->timestamp,
+    };
+    memcpy(header.magic, DATABASE_MAGIC_NUMBER, sizeof(header.magic));
+
+    DatabaseFileWriter file_writer = {.fp = fp};
+    DatabaseFileWriter *writer = &file_writer;
+    bool write_failed = false;
+#ifdef HAVE_ZSTD
+    if (snapshot->compress) {
+        db_file_writer_start_compression(writer, snapshot->thread_pool, &header, offset, &write_failed);
+    }
+#endif
+    uint64_t bytes_written = write_data_to_file(writer, &header, sizeof(header), 1, &write_failed);
+    bytes_written += write_data_to_file(writer, sections, sizeof(DatabaseFileSection), num_sections, &write_failed);
+
+    const uint8_t padding[DATABASE_SECTION_ALIGNMENT] = {};
+    for (uint32_t i = 0; i < num_sections && !write_failed; i++) {
+        bytes_written += write_data_to_file(writer, padding, sections[i].offset - bytes_written, 1, &write_failed);
+        FSEARCH_TRACE1(db_save_section_start, sections[i].id);
+        db_save_section(writer, snapshot, &sections[i], &write_failed);
+        FSEARCH_TRACE2(db_save_section_end, sections[i].id, sections[i].size);
+        bytes_written += sections[i].size;
+        if (write_failed) {
+            g_debug("[db_save] failed to save section: %x", sections[i].id);
+        }
+    }
+    db_file_writer_finish(writer, &write_failed);
+    return !write_failed;
+}
+
+// Takes the snapshot, requires the database to be locked if it's used by others. With copy_metadata the database
+// may be changed while the snapshot is written.
+static DatabaseSnapshot *
+db_snapshot_new(FsearchDatabase *db, const char *path, bool copy_metadata) {
+    DatabaseSnapshot *snapshot = calloc(1, sizeof(DatabaseSnapshot));
+    g_assert(snapshot);
+
+    // the sizes and modification times are written from the entries
+    db_load_pending_metadata(db);
+    // the parents and sorted arrays are stored as indexes into the name arrays
+    db_entry_update_folder_indices(db);
+    db_entry_update_file_indices(db);
+    DynamicArray *files = db->sorted_files[DATABASE_INDEX_TYPE_NAME];
+
+    for (uint32_t i = 0; i < NUM_DATABASE_INDEX_TYPES; i++) {
+        snapshot->sorted_files[i] = db->sorted_files[i] ? darray_ref(db->sorted_files[i]) : NULL;
+        snapshot->sorted_folders[i] = db->sorted_folders[i] ? darray_ref(db->sorted_folders[i]) : NULL;
+    }
+    snapshot->index_flags = db->index_flags;
+    snapshot->timestamp = db->timestamp;
+    snapshot->compress = db->compress;
+    snapshot->next_folder_id = db->next_folder_id;
+    for (uint32_t i = 0; i < G_N_ELEMENTS(snapshot->sizes) && copy_metadata; i++) {
+        DynamicArray *entries = i == 0 ? db->sorted_folders[DATABASE_INDEX_TYPE_NAME] : files;
+        if ((db->index_flags & DATABASE_INDEX_FLAG_SIZE) != 0) {
+            snapshot->sizes[i] = db_snapshot_copy_column(entries, DATABASE_COLUMN_SIZE);
+        }
+        if ((db->index_flags & DATABASE_INDEX_FLAG_MODIFICATION_TIME) != 0) {
+            snapshot->mtimes[i] = db_snapshot_copy_column(entries, DATABASE_COLUMN_MTIME);
+        }
+    }
+    if (db->sorted_sections_pending && db->file_contents) {
+        snapshot->pending_file_contents = g_bytes_ref(db->file_contents);
+    }
+    db_load_pending_folded_names(db);
+    if (db->folded_names && db->folded_names->folders == db->sorted_folders[DATABASE_INDEX_TYPE_NAME]
+        && db->folded_names->files == files) {
+        snapshot->folded_names = db_folded_names_ref(db->folded_names);
+    }
+    if (db->trigram_index && db->memory_budget == 0) {
+        // the index is stored with the database, so it doesn't have to be built again after the next start
+        snapshot->trigrams = db_get_trigrams(db);
+    }
+    if (db->metadata && db->metadata->folders == db->sorted_folders[DATABASE_INDEX_TYPE_NAME]
+        && db->metadata->files == files) {
+        snapshot->metadata = db_metadata_ref(db->metadata);
+    }
+    else {
+        // the file can't claim to have columns it doesn't contain
+        snapshot->index_flags &= ~DATABASE_INDEX_FLAGS_METADATA;
+    }
+    snapshot->indexes = db_file_encode_indexes(db);
+    snapshot->excludes = db_file_encode_excludes(db);
+    snapshot->path = g_strdup(path);
+    snapshot->journal = g_steal_pointer(&db->journal);
+    snapshot->sorted_arrays_changed = db->sorted_arrays_changed;
+    db->sorted_arrays_changed = false;
+    return snapshot;
+}
+
+static void
+db_snapshot_free(DatabaseSnapshot *snapshot) {
+    for (uint32_t i = 0; i < NUM_DATABASE_INDEX_TYPES; i++) {
+        g_clear_pointer(&snapshot->sorted_files[i], darray_unref);
+        g_clear_pointer(&snapshot->sorted_folders[i], darray_unref);
+    }
+    g_clear_pointer(&snapshot->pending_file_contents, g_bytes_unref);
+    g_clear_pointer(&snapshot->folded_names, db_folded_names_unref);
+    g_clear_pointer(&snapshot->trigrams, db_trigrams_unref);
+    g_clear_pointer(&snapshot->metadata, db_metadata_unref);
+    for (uint32_t i = 0; i < 2; i++) {
+        for (uint32_t column = 0; column < NUM_DATABASE_METADATA_COLUMNS; column++) {
+            g_clear_pointer(&snapshot->metadata_columns[i][column], g_byte_array_unref);
+        }
+    }
+    for (uint32_t i = 0; i < G_N_ELEMENTS(snapshot->sizes); i++) {
+        g_clear_pointer(&snapshot->sizes[i], g_free);
+        g_clear_pointer(&snapshot->mtimes[i], g_free);
+    }
+    g_clear_pointer(&snapshot->indexes, g_byte_array_unref);
+    g_clear_pointer(&snapshot->excludes, g_byte_array_unref);
+    g_clear_pointer(&snapshot->path, g_free);
+    g_clear_pointer(&snapshot->journal, g_byte_array_unref);
+    g_clear_pointer(&snapshot, free);
+}
+
+static bool
+db_snapshot_save(DatabaseSnapshot *snapshot) {
+    g_autoptr(GTimer) timer = g_timer_new();
+    g_timer_start(timer);
+
+    g_autoptr(GString) path_full = g_string_new(snapshot->path);
+    g_string_append_c(path_full, G_DIR_SEPARATOR);
+    g_string_append(path_full, "fsearch.db");
+
+    g_autoptr(GString) path_full_temp = g_string_new(path_full->str);
+    g_string_append(path_full_temp, ".tmp");
+    FSEARCH_TRACE1(db_save_start, path_full->str);
+
+    g_debug("[db_save] trying to open temporary database file: %s", path_full_temp->str);
+
+    FILE *fp = db_file_open_locked(path_full_temp->str, "wb");
+    if (!fp) {
+        g_debug("[db_save] failed to open temporary database file: %s", path_full_temp->str);
+        goto save_fail;
+    }
+    setvbuf(fp, NULL, _IOFBF, DATABASE_SAVE_BUFFER_SIZE);
+
+    g_debug("[db_save] saving sections...");
+    if (!db_save_sections(fp, snapshot) || fflush(fp) != 0) {
+        goto save_fail;
+    }
+    // the file must be complete on disk before it replaces the old one, otherwise a crash could leave an empty
+    // database behind
+    if (fdatasync(fileno(fp)) != 0) {
+        g_debug("[db_save] failed to sync database file: %s", g_strerror(errno));
+    }
+
+    g_clear_pointer(&fp, fclose);
+
+    // The file is replaced and not overwritten in place, because running instances might still have the current
+    // one mapped into memory. When it's renamed they can keep using the old contents.
+    g_debug("[db_save] renaming temporary database file: %s -> %s", path_full_temp->str, path_full->str);
+    // rename temporary fsearch.db.tmp to fsearch.db
+    if (rename(path_full_temp->str, path_full->str) != 0) {
+        goto save_fail;
+    }
+
+    // the journal holds changes relative to the old file, the new one contains them already. It has to stay until
+    // the old file is replaced, if that fails the changes since it was saved are only in the journal. Should this
+    // be interrupted, the journal is ignored anyway because it doesn't belong to the new file.
+    char *journal_path = g_strconcat(path_full->str, DATABASE_JOURNAL_SUFFIX, NULL);
+    unlink(journal_path);
+    g_clear_pointer(&journal_path, g_free);
+
+    struct stat st;
+    if (stat(path_full->str, &st) == 0) {
+        db_file_id_init(&snapshot->file_id, &st);
+    }
+
+    const double seconds = g_timer_elapsed(timer, NULL);
+    g_timer_stop(timer);
+
+    g_debug("[db_save] database file saved in: %f ms", seconds * 1000);
+
+    FSEARCH_TRACE2(db_save_end, path_full->str, true);
+    snapshot->result = true;
+    return true;
+
+save_fail:
+    g_warning("[db_save] saving failed");
+
+    g_clear_pointer(&fp, fclose);
+
+    // remove temporary fsearch.db.tmp file
+    unlink(path_full_temp->str);
+
+    FSEARCH_TRACE2(db_save_end, path_full->str, false);
+    snapshot->result = false;
+    return false;
+}
+
+// Hands the result of a saved snapshot over to the database and frees it
+static void
+db_snapshot_finish(FsearchDatabase *db, DatabaseSnapshot *snapshot) {
+    if (snapshot->result) {
+        db->base_file_id = snapshot->file_id;
+    }
+    else {
+        // the changes of the snapshot still have to be saved, before the ones which were made in the meantime
+        if (snapshot->journal && db->journal) {
+            g_byte_array_append(snapshot->journal, db->journal->data, db->journal->len);
+        }
+        if (snapshot->journal) {
+            g_clear_pointer(&db->journal, g_byte_array_unref);
+            db->journal = g_steal_pointer(&snapshot->journal);
+        }
+        db->sorted_arrays_changed |= snapshot->sorted_arrays_changed;
+    }
+    g_clear_pointer(&snapshot, db_snapshot_free);
+}
+
+static gpointer
+db_snapshot_save_thread(gpointer data) {
+    DatabaseSnapshot *snapshot = data;
+    thread_lower_priority();
+    db_snapshot_save(snapshot);
+    g_atomic_int_set(&snapshot->done, 1);
+    return NULL;
+}
+
+static void
+db_finish_background_save(FsearchDatabase *db, bool wait) {
+    DatabaseSnapshot *snapshot = db->snapshot;
+    if (!snapshot || (!wait && !g_atomic_int_get(&snapshot->done))) {
+        return;
+    }
+    g_thread_join(snapshot->thread);
+    db->snapshot = NULL;
+    db_snapshot_finish(db, snapshot);
+}
+
+void
+db_wait_for_save(FsearchDatabase *db) {
+    g_assert(db);
+    db_finish_background_save(db, true);
+}
+
+bool
+db_save(FsearchDatabase *db, const char *path) {
+    g_assert(path);
+    g_assert(db);
+
+    g_debug("[db_save] saving database to file...");
+
+    if (db->segments) {
+        g_debug("[db_save] database has segments, it can't be saved");
+        return false;
+    }
+    if (!g_file_test(path, G_FILE_TEST_IS_DIR)) {
+        g_debug("[db_save] database path doesn't exist: %s", path);
+        return false;
+    }
+    // both write to the same files
+    db_wait_for_save(db);
+
+    DatabaseSnapshot *snapshot = db_snapshot_new(db, path, false);
+    snapshot->thread_pool = db->thread_pool;
+    const bool res = db_snapshot_save(snapshot);
+    db_snapshot_finish(db, snapshot);
+    return res;
+}
+
+bool
+db_save_in_background(FsearchDatabase *db, const char *path) {
+    g_assert(path);
+    g_assert(db);
+
+    db_finish_background_save(db, false);
+    if (db->snapshot) {
+        g_debug("[db_save] database is still being saved");
+        return false;
+    }
+    if (db->segments) {
+        g_debug("[db_save] database has segments, it can't be saved");
+        return false;
+    }
+    if (!g_file_test(path, G_FILE_TEST_IS_DIR)) {
+        g_debug("[db_save] database path doesn't exist: %s", path);
+        return false;
+    }
+
+    g_debug("[db_save] saving database to file in the background...");
+    // searches keep the thread pool busy, so the blocks get compressed by the saving thread
+    db->snapshot = db_snapshot_new(db, path, true);
+    db->snapshot->thread = g_thread_new("fsearch_db_save", db_snapshot_save_thread, db->snapshot);
+    return true;
+}
+
+static bool
+file_is_excluded(const char *name, FsearchExcludeMatcher *exclude_matcher) {
+    return fsearch_exclude_matcher_name_is_excluded(exclude_matcher, name);
+}
+
+static bool
+directory_is_excluded(const char *name, FsearchExcludeMatcher *exclude_matcher) {
+    return fsearch_exclude_matcher_path_is_excluded(exclude_matcher, name);
+}
+
+typedef struct DatabaseScanDirectory {
+    FsearchDatabaseEntryFolder *folder;
+    // the same folder in the reference database of an incremental scan, if there's one
+    FsearchDatabaseEntryFolder *reference;
+    // full path of the folder, without a trailing separator ("" for the root directory)
+    char *path;
+} DatabaseScanDirectory;
+
+typedef struct DatabaseScanReferenceChildren {
+    GPtrArray *files;
+    GPtrArray *folders;
+    // name -> folder, built on demand when the parent folder has changed
+    GHashTable *folders_by_name;
+    GMutex mutex;
+} DatabaseScanReferenceChildren;
+
+// The previous database which an incremental scan takes unchanged folders from
+typedef struct DatabaseScanReference {
+    FsearchDatabase *db;
+    // FsearchDatabaseEntryFolder * -> DatabaseScanReferenceChildren *
+    GHashTable *children;
+    GPtrArray *roots;
+    // folders which were modified at or after this time might have changed while they were scanned
+    time_t timestamp;
+    // the names of db are shared with the scanned database, entries taken from it point to the same names
+    bool share_names;
+    // the metadata of the name arrays of db, the unchanged files take theirs from it
+    FsearchDatabaseMetadata *metadata;
+} DatabaseScanReference;
+
+// Roots on the same device compete for the same disk (or network link), so only this many of them get scanned
+// at the same time. Roots on different devices are scanned concurrently.
+#define DATABASE_SCAN_MAX_ROOTS_PER_DEVICE 1
+
+// Limits of low impact scans
+#define DATABASE_LOW_IMPACT_THREADS_PER_ROOT 1
+#define DATABASE_LOW_IMPACT_DIRECTORIES_PER_SECOND 2000
+// pause while tasks spent more than this share (in percent) of the last 10 seconds waiting for memory
+#define DATABASE_LOW_IMPACT_MEMORY_PRESSURE 10.0
+#define DATABASE_LOW_IMPACT_MEMORY_PRESSURE_CHECK_INTERVAL G_TIME_SPAN_SECOND
+
+// Default timeouts (in ms) of db_set_scan_timeouts
+#define DATABASE_SCAN_DEFAULT_CALL_TIMEOUT (30 * 1000)
+#define DATABASE_SCAN_DEFAULT_ROOT_TIMEOUT 0
+// how often the workers of a root are checked for filesystem calls which take too long
+#define DATABASE_SCAN_WATCHDOG_INTERVAL (100 * G_TIME_SPAN_MILLISECOND)
+
+// State which is shared by the scans of all roots. Workers which got stuck on a filesystem call outlive the scan, so
+// they keep a reference of it (through their walk) until they return.
+typedef struct DatabaseScanContext {
+    FsearchDatabase *db;
+    DatabaseScanReference *reference;
+    GCancellable *cancellable;
+    void (*status_cb)(const char *);
+    FsearchDatabaseScanStats *stats;
+
+    // a single timer for all roots, so concurrent scans don't flood the status display
+    GTimer *status_timer;
+    GMutex status_mutex;
+
+    // protects the sorted arrays and memory pools of the database while the results of a root get merged
+    GMutex merge_mutex;
+
+    uint32_t num_workers_per_root;
+    volatile gint num_roots_scanned;
+
+    // rate limiting and memory pressure detection of low impact scans
+    bool low_impact;
+    GMutex throttle_mutex;
+    gint64 next_directory_time;
+    gint64 memory_pressure_check_time;
+    bool under_memory_pressure;
+
+    // in ms, 0 disables them, see db_set_scan_timeouts
+    uint32_t call_timeout;
+    uint32_t root_timeout;
+    // the FsearchIndex of the roots which timed out, protected by merge_mutex
+    GPtrArray *timed_out_indexes;
+    // the scan returned, so workers which are still around don't report their status anymore
+    bool finished;
+
+    volatile gint ref_count;
+} DatabaseScanContext;
+
+// The roots which are located on one device
+typedef struct DatabaseScanDevice {
+    DatabaseScanContext *scan_context;
+    dev_t device_id;
+    GPtrArray *indexes;
+    volatile gint next_index;
+} DatabaseScanDevice;
+
+typedef struct DatabaseWalkContext DatabaseWalkContext;
+
+#ifdef HAVE_IO_URING
+typedef struct DatabaseScanStatRequest {
+    struct statx stx;
+    char name[256];
+    size_t name_len;
+    int res;
+} DatabaseScanStatRequest;
+#endif
+
+typedef struct DatabaseScanWorker {
+    DatabaseWalkContext *walk_context;
+
+    // Directories which still need to be scanned. The owning worker pushes and pops at the tail (depth first),
+    // idle workers steal from the head, where the oldest and usually largest subtrees are located.
+    GQueue directories;
+    GMutex directories_mutex;
+
+    FsearchMemoryPool *file_pool;
+    FsearchMemoryPool *folder_pool;
+    FsearchStringArena *names;
+    DynamicArray *files;
+    DynamicArray *folders;
+    // DatabaseMetadataRecord of the added entries, NULL if the database has no metadata columns
+    GArray *metadata;
+
+    GString *path;
+    // child folders of the reference folder which is currently being scanned
+    GHashTable *reference_folders;
+    // merged into the statistics of the root once the walk is done
+    FsearchDatabaseScanRootStats stats;
+    // ms since the walk started (+ 1) at which the current filesystem call started, 0 while there's none
+    volatile gint busy_since;
+    // the directory which is being scanned, protected by state_mutex
+    DatabaseScanDirectory *directory;
+    GMutex state_mutex;
+#ifdef HAVE_GETDENTS64
+    char *dirent_buffer;
+#endif
+#ifdef HAVE_IO_URING
+    struct io_uring ring;
+    bool ring_initialized;
+    DatabaseScanStatRequest *stat_requests;
+    uint32_t num_stat_requests;
+#endif
+    uint32_t id;
+} DatabaseScanWorker;
+
+// The scan of one root. Each worker thread holds a reference, so a walk whose workers got abandoned is only freed once
+// the last of them returns from its stuck filesystem call.
+struct DatabaseWalkContext {
+    FsearchDatabase *db;
+    DatabaseScanContext *scan_context;
+    GCancellable *cancellable;
+
+    DatabaseScanWorker **workers;
+    uint32_t num_workers;
+
+    // number of directories which are either queued or currently being scanned
+    volatile gint num_pending;
+    volatile gint num_idle;
+    GMutex idle_mutex;
+    GCond idle_cond;
+
+    FsearchDatabaseEntryFolder *root;
+    char *root_path;
+    volatile gint root_result;
+    // the root doesn't exist, so there's nothing to merge
+    bool root_missing;
+
+    DatabaseScanReference *reference;
+
+    dev_t root_device_id;
+    bool one_filesystem;
+    bool exclude_hidden;
+    // size or modification time are indexed, so every entry needs to be stat'ed
+    bool needs_metadata;
+
+    // in µs
+    gint64 start_time;
+    // the walk took too long and its workers are told to stop, their results get discarded
+    volatile gint timed_out;
+    // the number of worker threads which returned
+    uint32_t num_finished;
+    GMutex finished_mutex;
+    GCond finished_cond;
+
+    volatile gint ref_count;
+};
+
+// Workers call these around everything which might block on the filesystem (open, read, stat), so the walk can tell
+// when one of them is stuck, e.g. on an unresponsive network mount. Returns the current time.
+static gint64
+db_scan_worker_begin_call(DatabaseScanWorker *worker) {
+    const gint64 now = g_get_monotonic_time();
+    g_atomic_int_set(&worker->busy_since, (gint)((now - worker->walk_context->start_time) / 1000) + 1);
+    return now;
+}
+
+// Adds the time since start_time to latency, if it isn't NULL
+static void
+db_scan_worker_end_call(DatabaseScanWorker *worker, FsearchDatabaseScanLatency *latency, gint64 start_time) {
+    g_atomic_int_set(&worker->busy_since, 0);
+    if (latency) {
+        db_scan_latency_add(latency, g_get_monotonic_time() - start_time);
+    }
+}
+
+static bool
+db_walk_is_stopped(DatabaseWalkContext *walk_context) {
+    return g_atomic_int_get(&walk_context->timed_out) || is_cancelled(walk_context->cancellable);
+}
+
+#ifdef HAVE_GETDENTS64
+struct linux_dirent64 {
+    ino64_t d_ino;
+    off64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+#endif
+
+typedef struct DatabaseDirectoryReader {
+    DatabaseScanWorker *worker;
+    int fd;
+    // reading the entries failed before all of them were read
+    bool failed;
+#ifdef HAVE_GETDENTS64
+    char *buffer;
+    long buffer_len;
+    long buffer_pos;
+#else
+    DIR *dir;
+#endif
+} DatabaseDirectoryReader;
+
+static bool
+db_directory_reader_open(DatabaseDirectoryReader *reader, const char *path, DatabaseScanWorker *worker) {
+    reader->worker = worker;
+    reader->failed = false;
+    const gint64 start_time = db_scan_worker_begin_call(worker);
+#ifdef HAVE_GETDENTS64
+    reader->fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    reader->buffer = worker->dirent_buffer;
+    reader->buffer_len = 0;
+    reader->buffer_pos = 0;
+#else
+    reader->dir = opendir(path);
+    reader->fd = reader->dir ? dirfd(reader->dir) : -1;
+#endif
+    db_scan_worker_end_call(worker, &worker->stats.open_latency, start_time);
+    return reader->fd >= 0;
+}
+
+static void
+db_directory_reader_close(DatabaseDirectoryReader *reader) {
+#ifdef HAVE_GETDENTS64
+    if (reader->fd >= 0) {
+        close(reader->fd);
+    }
+#else
+    g_clear_pointer(&reader->dir, closedir);
+#endif
+    reader->fd = -1;
+}
+
+// Returns the next directory entry and its type (DT_UNKNOWN if the filesystem doesn't provide one)
+// or NULL once all entries were read or reading them failed, which sets failed. The name is only valid until the next
+// call.
+static const char *
+db_directory_reader_next(DatabaseDirectoryReader *reader, unsigned char *type) {
+#ifdef HAVE_GETDENTS64
+    if (reader->buffer_pos >= reader->buffer_len) {
+        // fetch the next batch of entries
+        const gint64 start_time = db_scan_worker_begin_call(reader->worker);
+        reader->buffer_len = syscall(SYS_getdents64, reader->fd, reader->buffer, DIRENT_BUFFER_SIZE);
+        db_scan_worker_end_call(reader->worker, NULL, start_time);
+        reader->buffer_pos = 0;
+        if (reader->buffer_len < 0) {
+            reader->failed = true;
+            reader->buffer_len = 0;
+            return NULL;
+        }
+        if (reader->buffer_len == 0) {
+            return NULL;
+        }
+    }
+    struct linux_dirent64 *dent = (struct linux_dirent64 *)(reader->buffer + reader->buffer_pos);
+    reader->buffer_pos += dent->d_reclen;
+    *type = dent->d_type;
+    return dent->d_name;
+#else
+    const gint64 start_time = db_scan_worker_begin_call(reader->worker);
+    // readdir only sets errno when it fails, not at the end of the directory
+    errno = 0;
+    struct dirent *dent = readdir(reader->dir);
+    db_scan_worker_end_call(reader->worker, NULL, start_time);
+    if (!dent) {
+        reader->failed = errno != 0;
+        return NULL;
+    }
+#ifdef _DIRENT_HAVE_D_TYPE
+    *type = dent->d_type;
+#else
+    *type = DT_UNKNOWN;
+#endif
+    return dent->d_name;
+#endif
+}
+
+static DatabaseScanDirectory *
+db_scan_directory_new(FsearchDatabaseEntryFolder *folder,
+                      FsearchDatabaseEntryFolder *reference,
+                      const char *path,
+                      size_t path_len) {
+    DatabaseScanDirectory *dir = calloc(1, sizeof(DatabaseScanDirectory));
+    g_assert(dir);
+    dir->folder = folder;
+    dir->reference = reference;
+    if (reference) {
+        // it's the same folder as the one of the previous database
+        db_entry_folder_set_id(folder, db_entry_folder_get_id(reference));
+    }
+    dir->path = g_strndup(path, path_len);
+    return dir;
+}
+
+static DatabaseScanReferenceChildren *
+db_scan_reference_children_new(void) {
+    DatabaseScanReferenceChildren *children = calloc(1, sizeof(DatabaseScanReferenceChildren));
+    g_assert(children);
+    children->files = g_ptr_array_new();
+    children->folders = g_ptr_array_new();
+    g_mutex_init(&children->mutex);
+    return children;
+}
+
+static void
+db_scan_reference_children_free(DatabaseScanReferenceChildren *children) {
+    if (!children) {
+        return;
+    }
+    g_clear_pointer(&children->files, g_ptr_array_unref);
+    g_clear_pointer(&children->folders, g_ptr_array_unref);
+    g_clear_pointer(&children->folders_by_name, g_hash_table_unref);
+    g_mutex_clear(&children->mutex);
+    g_clear_pointer(&children, free);
+}
+
+static DatabaseScanReferenceChildren *
+db_scan_reference_get_children(DatabaseScanReference *reference, FsearchDatabaseEntryFolder *folder, bool create) {
+    DatabaseScanReferenceChildren *children = g_hash_table_lookup(reference->children, folder);
+    if (!children && create) {
+        children = db_scan_reference_children_new();
+        g_hash_table_insert(reference->children, folder, children);
+    }
+    return children;
+}
+
+static void
+db_scan_reference_free(DatabaseScanReference *reference) {
+    if (!reference) {
+        return;
+    }
+    g_clear_pointer(&reference->children, g_hash_table_unref);
+    g_clear_pointer(&reference->roots, g_ptr_array_unref);
+    g_clear_pointer(&reference->metadata, db_metadata_unref);
+    g_clear_pointer(&reference->db, db_unref);
+    g_clear_pointer(&reference, free);
+}
+
+static DatabaseScanReference *
+db_scan_reference_new(FsearchDatabase *db, FsearchDatabase *reference_db, bool share_names) {
+    const FsearchDatabaseIndexFlags required_flags = db->index_flags | DATABASE_INDEX_FLAG_MODIFICATION_TIME;
+    if ((reference_db->index_flags & required_flags) != required_flags
+        || (db->index_flags & DATABASE_INDEX_FLAG_MODIFICATION_TIME) == 0) {
+        // we can't tell whether a folder has changed or the reference lacks metadata we need
+        g_debug("[db_scan] reference database isn't suitable for an incremental scan");
+        return NULL;
+    }
+    DynamicArray *folders = reference_db->sorted_folders[DATABASE_INDEX_TYPE_NAME];
+    DynamicArray *files = reference_db->sorted_files[DATABASE_INDEX_TYPE_NAME];
+    if (!folders || !files) {
+        return NULL;
+    }
+
+    DatabaseScanReference *reference = calloc(1, sizeof(DatabaseScanReference));
+    g_assert(reference);
+    reference->db = db_ref(reference_db);
+    reference->timestamp = reference_db->timestamp;
+    reference->share_names = share_names;
+    reference->roots = g_ptr_array_new();
+    reference->children =
+        g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)db_scan_reference_children_free);
+    FsearchDatabaseMetadata *metadata = reference_db->metadata;
+    if (metadata && metadata->folders == folders && metadata->files == files) {
+        // the metadata is looked up by the index of the entries
+        db_entry_update_folder_indices(reference_db);
+        db_entry_update_file_indices(reference_db);
+        reference->metadata = db_metadata_ref(reference_db->metadata);
+    }
+
+    const uint32_t num_folders = darray_get_num_items(folders);
+    for (uint32_t i = 0; i < num_folders; i++) {
+        FsearchDatabaseEntry *folder = darray_get_item(folders, i);
+        FsearchDatabaseEntryFolder *parent = db_entry_get_parent(folder);
+        if (!parent) {
+            g_ptr_array_add(reference->roots, folder);
+            continue;
+        }
+        g_ptr_array_add(db_scan_reference_get_children(reference, parent, true)->folders, folder);
+    }
+
+    const uint32_t num_files = darray_get_num_items(files);
+    for (uint32_t i = 0; i < num_files; i++) {
+        FsearchDatabaseEntry *file = darray_get_item(files, i);
+        FsearchDatabaseEntryFolder *parent = db_entry_get_parent(file);
+        if (parent) {
+            g_ptr_array_add(db_scan_reference_get_children(reference, parent, true)->files, file);
+        }
+    }
+    return reference;
+}
+
+static FsearchDatabaseEntryFolder *
+db_scan_reference_get_root(DatabaseScanReference *reference, const char *name) {
+    if (!reference) {
+        return NULL;
+    }
+    for (uint32_t i = 0; i < reference->roots->len; i++) {
+        FsearchDatabaseEntry *root = g_ptr_array_index(reference->roots, i);
+        if (!strcmp(db_entry_get_name_raw(root), name)) {
+            return (FsearchDatabaseEntryFolder *)root;
+        }
+    }
+    return NULL;
+}
+
+static GHashTable *
+db_scan_reference_get_folders_by_name(DatabaseScanReference *reference, FsearchDatabaseEntryFolder *folder) {
+    DatabaseScanReferenceChildren *children = db_scan_reference_get_children(reference, folder, false);
+    if (!children || children->folders->len == 0) {
+        return NULL;
+    }
+    // each folder is only scanned once, but play it safe in case the same path shows up in multiple indexes
+    g_mutex_lock(&children->mutex);
+    if (!children->folders_by_name) {
+        children->folders_by_name = g_hash_table_new(g_str_hash, g_str_equal);
+        for (uint32_t i = 0; i < children->folders->len; i++) {
+            FsearchDatabaseEntry *child = g_ptr_array_index(children->folders, i);
+            g_hash_table_insert(children->folders_by_name, (gpointer)db_entry_get_name_raw(child), child);
+        }
+    }
+    g_mutex_unlock(&children->mutex);
+    return children->folders_by_name;
+}
+
+static void
+db_scan_directory_free(DatabaseScanDirectory *dir) {
+    if (!dir) {
+        return;
+    }
+    g_clear_pointer(&dir->path, g_free);
+    g_clear_pointer(&dir, free);
+}
+
+static FsearchMemoryPool *
+db_entry_pool_new(size_t entry_size) {
+    FsearchMemoryPool *pool = fsearch_memory_pool_new(NUM_DB_ENTRIES_FOR_POOL_BLOCK, entry_size, NULL);
+    // searching and sorting walk over all entries, huge pages save most of the TLB misses this causes
+    fsearch_memory_pool_set_use_huge_pages(pool, true);
+    return pool;
+}
+
+static DatabaseScanWorker *
+db_scan_worker_new(DatabaseWalkContext *walk_context, uint32_t id) {
+    DatabaseScanWorker *worker = calloc(1, sizeof(DatabaseScanWorker));
+    g_assert(worker);
+
+    worker->walk_context = walk_context;
+    worker->id = id;
+    g_queue_init(&worker->directories);
+    g_mutex_init(&worker->directories_mutex);
+    g_mutex_init(&worker->state_mutex);
+
+    worker->file_pool = db_entry_pool_new(db_entry_get_sizeof_file_entry());
+    worker->folder_pool = db_entry_pool_new(db_entry_get_sizeof_folder_entry());
+    worker->names = fsearch_string_arena_new();
+    worker->files = darray_new(1024);
+    worker->folders = darray_new(1024);
+    if (db_has_metadata_columns(walk_context->db)) {
+        worker->metadata = g_array_new(FALSE, FALSE, sizeof(DatabaseMetadataRecord));
+    }
+    worker->path = g_string_sized_new(PATH_MAX);
+#ifdef HAVE_GETDENTS64
+    worker->dirent_buffer = malloc(DIRENT_BUFFER_SIZE);
+    g_assert(worker->dirent_buffer);
+#endif
+    return worker;
+}
+
+static void
+db_scan_worker_free(DatabaseScanWorker *worker) {
+    if (!worker) {
+        return;
+    }
+    DatabaseScanDirectory *dir = NULL;
+    while ((dir = g_queue_pop_head(&worker->directories))) {
+        g_clear_pointer(&dir, db_scan_directory_free);
+    }
+    g_mutex_clear(&worker->directories_mutex);
+    g_mutex_clear(&worker->state_mutex);
+
+    g_clear_pointer(&worker->file_pool, fsearch_memory_pool_free_pool);
+    g_clear_pointer(&worker->folder_pool, fsearch_memory_pool_free_pool);
+    g_clear_pointer(&worker->names, fsearch_string_arena_free);
+    g_clear_pointer(&worker->files, darray_unref);
+    g_clear_pointer(&worker->folders, darray_unref);
+    g_clear_pointer(&worker->metadata, g_array_unref);
+    db_scan_root_stats_clear(&worker->stats);
+    if (worker->path) {
+        g_string_free(g_steal_pointer(&worker->path), TRUE);
+    }
+#ifdef HAVE_GETDENTS64
+    g_clear_pointer(&worker->dirent_buffer, free);
+#endif
+    g_clear_pointer(&worker, free);
+}
+
+static void
+db_scan_worker_push_directory(DatabaseScanWorker *worker, DatabaseScanDirectory *dir) {
+    DatabaseWalkContext *walk_context = worker->walk_context;
+
+    g_atomic_int_inc(&walk_context->num_pending);
+
+    g_mutex_lock(&worker->directories_mutex);
+    g_queue_push_tail(&worker->directories, dir);
+    g_mutex_unlock(&worker->directories_mutex);
+
+    if (g_atomic_int_get(&walk_context->num_idle) > 0) {
+        g_mutex_lock(&walk_context->idle_mutex);
+        g_cond_signal(&walk_context->idle_cond);
+        g_mutex_unlock(&walk_context->idle_mutex);
+    }
+}
+
+static DatabaseScanDirectory *
+db_scan_worker_pop_directory(DatabaseScanWorker *worker) {
+    g_mutex_lock(&worker->directories_mutex);
+    DatabaseScanDirectory *dir = g_queue_pop_tail(&worker->directories);
+    g_mutex_unlock(&worker->directories_mutex);
+    return dir;
+}
+
+static DatabaseScanDirectory *
+db_scan_worker_steal_directory(DatabaseScanWorker *worker) {
+    DatabaseWalkContext *walk_context = worker->walk_context;
+    for (uint32_t i = 1; i < walk_context->num_workers; i++) {
+        DatabaseScanWorker *victim = walk_context->workers[(worker->id + i) % walk_context->num_workers];
+        if (!g_mutex_trylock(&victim->directories_mutex)) {
+            continue;
+        }
+        DatabaseScanDirectory *dir = g_queue_pop_head(&victim->directories);
+        g_mutex_unlock(&victim->directories_mutex);
+        if (dir) {
+            return dir;
+        }
+    }
+    return NULL;
+}
+
+static bool
+memory_is_under_pressure(void) {
+    // pressure stall information: "some avg10=1.23 ...", the share of time in which tasks waited for memory
+    g_autofree char *pressure = NULL;
+    if (g_file_get_contents("/proc/pressure/memory", &pressure, NULL, NULL)) {
+        const char *avg10 = strstr(pressure, "avg10=");
+        if (avg10) {
+            return g_ascii_strtod(avg10 + strlen("avg10="), NULL) > DATABASE_LOW_IMPACT_MEMORY_PRESSURE;
+        }
+    }
+
+    // kernels without PSI: less than 5% of the memory is available
+    g_autofree char *meminfo = NULL;
+    if (!g_file_get_contents("/proc/meminfo", &meminfo, NULL, NULL)) {
+        return false;
+    }
+    const char *total = strstr(meminfo, "MemTotal:");
+    const char *available = strstr(meminfo, "MemAvailable:");
+    if (!total || !available) {
+        return false;
+    }
+    const guint64 total_kb = g_ascii_strtoull(total + strlen("MemTotal:"), NULL, 10);
+    const guint64 available_kb = g_ascii_strtoull(available + strlen("MemAvailable:"), NULL, 10);
+    return available_kb * 20 < total_kb;
+}
+
+static bool
+db_scan_is_under_memory_pressure(DatabaseScanContext *scan_context) {
+    g_mutex_lock(&scan_context->throttle_mutex);
+    const gint64 now = g_get_monotonic_time();
+    if (now - scan_context->memory_pressure_check_time >= DATABASE_LOW_IMPACT_MEMORY_PRESSURE_CHECK_INTERVAL) {
+        scan_context->memory_pressure_check_time = now;
+        scan_context->under_memory_pressure = memory_is_under_pressure();
+        if (scan_context->under_memory_pressure) {
+            g_debug("[db_scan] paused, system is under memory pressure");
+        }
+    }
+    const bool under_memory_pressure = scan_context->under_memory_pressure;
+    g_mutex_unlock(&scan_context->throttle_mutex);
+    return under_memory_pressure;
+}
+
+// Called by the workers before each directory is read. Low impact scans get paced to
+// DATABASE_LOW_IMPACT_DIRECTORIES_PER_SECOND across all workers and roots.
+static void
+db_scan_throttle(DatabaseScanContext *scan_context) {
+    if (!scan_context->low_impact) {
+        return;
+    }
+    while (db_scan_is_under_memory_pressure(scan_context) && !is_cancelled(scan_context->cancellable)) {
+        g_usleep(DATABASE_LOW_IMPACT_MEMORY_PRESSURE_CHECK_INTERVAL / 2);
+    }
+
+    g_mutex_lock(&scan_context->throttle_mutex);
+    const gint64 now = g_get_monotonic_time();
+    const gint64 start_time = MAX(now, scan_context->next_directory_time);
+    scan_context->next_directory_time = start_time + G_TIME_SPAN_SECOND / DATABASE_LOW_IMPACT_DIRECTORIES_PER_SECOND;
+    g_mutex_unlock(&scan_context->throttle_mutex);
+
+    if (start_time > now) {
+        g_usleep(start_time - now);
+    }
+}
+
+static void
+db_scan_notify_status(DatabaseWalkContext *walk_context, const char *path) {
+    DatabaseScanContext *scan_context = walk_context->scan_context;
+    if (!scan_context->status_cb) {
+        return;
+    }
+    // don't make workers wait for each other just to report the status
+    if (!g_mutex_trylock(&scan_context->status_mutex)) {
+        return;
+    }
+    const double elapsed_seconds = g_timer_elapsed(scan_context->status_timer, NULL);
+    if (!scan_context->finished && elapsed_seconds > 0.1) {
+        scan_context->status_cb(path);
+        g_timer_start(scan_context->status_timer);
+    }
+    g_mutex_unlock(&scan_context->status_mutex);
+}
+
+static int
+db_scan_stat_flags(void) {
+    int stat_flags = AT_SYMLINK_NOFOLLOW;
+#ifdef AT_NO_AUTOMOUNT
+    stat_flags |= AT_NO_AUTOMOUNT;
+#endif
+    return stat_flags;
+}
+
+static void
+db_scan_set_name(DatabaseScanWorker *worker, FsearchDatabaseEntry *entry, const char *name, bool name_is_shared) {
+    if (name_is_shared) {
+        db_entry_set_name_borrowed(entry, name);
+    }
+    else {
+        db_entry_set_name_in_arena(entry, worker->names, name);
+    }
+}
+
+// Adds a file or folder to the worker results. worker->path must hold the path of the parent folder
+// (including the trailing separator) up to parent_path_len. name is only copied if it isn't a shared name of the
+// reference. metadata is NULL if it isn't known.
+static void
+db_scan_add_entry(DatabaseScanWorker *worker,
+                  FsearchDatabaseEntryFolder *parent,
+                  gsize parent_path_len,
+                  const char *name,
+                  size_t name_len,
+                  bool name_is_shared,
+                  bool is_dir,
+                  off_t size,
+                  time_t mtime,
+                  const FsearchDatabaseEntryMetadata *metadata) {
+    DatabaseWalkContext *walk_context = worker->walk_context;
+    FsearchDatabase *db = walk_context->db;
+
+    // create full path of file/folder
+    GString *path = worker->path;
+    g_string_truncate(path, parent_path_len);
+    g_string_append_len(path, name, (gssize)name_len);
+
+    if (is_dir) {
+        if (directory_is_excluded(path->str, db->exclude_matcher)) {
+            g_debug("[db_scan] excluded directory: %s", path->str);
+            worker->stats.num_excluded++;
+            return;
+        }
+        FsearchDatabaseEntryFolder *reference =
+            worker->reference_folders ? g_hash_table_lookup(worker->reference_folders, name) : NULL;
+        FsearchDatabaseEntry *entry = fsearch_memory_pool_malloc(worker->folder_pool);
+        if (reference && walk_context->reference->share_names) {
+            // it's the same folder as before, so it can have the same name
+            db_entry_set_name_borrowed(entry, db_entry_get_name_raw((FsearchDatabaseEntry *)reference));
+        }
+        else {
+            db_scan_set_name(worker, entry, name, name_is_shared);
+        }
+        db_entry_set_type(entry, DATABASE_ENTRY_TYPE_FOLDER);
+        db_entry_set_mtime(entry, mtime);
+        db_entry_set_parent(entry, parent);
+
+        darray_add_item(worker->folders, entry);
+        if (worker->metadata && metadata) {
+            db_add_metadata_record(worker->metadata, entry, metadata);
+        }
+
+        db_scan_worker_push_directory(
+            worker,
+            db_scan_directory_new((FsearchDatabaseEntryFolder *)entry, reference, path->str, path->len));
+    }
+    else {
+        // The size of the parent folders gets summed up once all workers are done (see db_entry_folders_aggregate),
+        // because the parents might be scanned by another thread in the meantime.
+        FsearchDatabaseEntry *file_entry = fsearch_memory_pool_malloc(worker->file_pool);
+        db_scan_set_name(worker, file_entry, name, name_is_shared);
+        db_entry_set_size(file_entry, size);
+        db_entry_set_mtime(file_entry, mtime);
+        db_entry_set_type(file_entry, DATABASE_ENTRY_TYPE_FILE);
+        db_entry_set_parent(file_entry, parent);
+
+        darray_add_item(worker->files, file_entry);
+        if (worker->metadata && metadata) {
+            db_add_metadata_record(worker->metadata, file_entry, metadata);
+        }
+    }
+}
+
+static void
+db_scan_add_entry_with_stat(DatabaseScanWorker *worker,
+                            FsearchDatabaseEntryFolder *parent,
+                            gsize parent_path_len,
+                            int dir_fd,
+                            const char *name,
+                            size_t name_len) {
+    DatabaseWalkContext *walk_context = worker->walk_context;
+
+    struct stat st;
+    const gint64 start_time = db_scan_worker_begin_call(worker);
+    const int res = fstatat(dir_fd, name, &st, db_scan_stat_flags());
+    db_scan_worker_end_call(worker, &worker->stats.stat_latency, start_time);
+    if (res) {
+        g_debug("[db_scan] can't stat: %s%s", worker->path->str, name);
+        worker->stats.num_skipped++;
+        return;
+    }
+
+    const bool is_dir = S_ISDIR(st.st_mode);
+    if (walk_context->one_filesystem && walk_context->root_device_id != st.st_dev) {
+        g_debug("[db_scan] different filesystem, skipping: %s%s", worker->path->str, name);
+        worker->stats.num_skipped++;
+        return;
+    }
+    FsearchDatabaseEntryMetadata metadata = {};
+    if (worker->metadata) {
+        const gint64 metadata_start_time = db_scan_worker_begin_call(worker);
+        db_entry_metadata_init(walk_context->db, &metadata, &st, dir_fd, name, db_scan_stat_flags());
+        db_scan_worker_end_call(worker, NULL, metadata_start_time);
+    }
+    db_scan_add_entry(worker,
+                      parent,
+                      parent_path_len,
+                      name,
+                      name_len,
+                      false,
+                      is_dir,
+                      st.st_size,
+                      st.st_mtime,
+                      &metadata);
+}
+
+#ifdef HAVE_IO_URING
+static void
+db_scan_worker_init_ring(DatabaseScanWorker *worker) {
+    worker->stat_requests = calloc(SCAN_STAT_BATCH_SIZE, sizeof(DatabaseScanStatRequest));
+    g_assert(worker->stat_requests);
+
+    const int res = io_uring_queue_init(SCAN_STAT_BATCH_SIZE, &worker->ring, 0);
+    if (res < 0) {
+        g_debug("[db_scan] io_uring not available (%s), using fstatat", g_strerror(-res));
+        return;
+    }
+    worker->ring_initialized = true;
+}
+
+static void
+db_scan_worker_clear_ring(DatabaseScanWorker *worker) {
+    if (worker->ring_initialized) {
+        io_uring_queue_exit(&worker->ring);
+        worker->ring_initialized = false;
+    }
+    g_clear_pointer(&worker->stat_requests, free);
+}
+
+static unsigned int
+db_scan_statx_mask(DatabaseWalkContext *walk_context) {
+    // only request what's actually needed, on network filesystems some fields are expensive to fetch
+    unsigned int mask = STATX_TYPE;
+    if ((walk_context->db->index_flags & DATABASE_INDEX_FLAG_SIZE) != 0) {
+        mask |= STATX_SIZE;
+    }
+    if ((walk_context->db->index_flags & DATABASE_INDEX_FLAG_MODIFICATION_TIME) != 0) {
+        mask |= STATX_MTIME;
+    }
+    if ((walk_context->db->index_flags & DATABASE_INDEX_FLAG_OWNER) != 0) {
+        mask |= STATX_UID | STATX_GID;
+    }
+    if ((walk_context->db->index_flags & DATABASE_INDEX_FLAG_PERMISSIONS) != 0) {
+        mask |= STATX_MODE;
+    }
+    if ((walk_context->db->index_flags & DATABASE_INDEX_FLAG_ACCESS_TIME) != 0) {
+        mask |= STATX_ATIME;
+    }
+    if ((walk_context->db->index_flags & DATABASE_INDEX_FLAG_STATUS_CHANGE_TIME) != 0) {
+        mask |= STATX_CTIME;
+    }
+    if ((walk_context->db->index_flags & DATABASE_INDEX_FLAG_CREATION_TIME) != 0) {
+        mask |= STATX_BTIME;
+    }
+    return mask;
+}
+
+static void
+db_entry_metadata_init_from_statx(FsearchDatabaseEntryMetadata *values, const struct statx *stx) {
+    values->uid = stx->stx_uid;
+    values->gid = stx->stx_gid;
+    values->mode = stx->stx_mode;
+    values->atime = (time_t)stx->stx_atime.tv_sec;
+    values->ctime = (time_t)stx->stx_ctime.tv_sec;
+    // not all filesystems record it
+    values->btime = (stx->stx_mask & STATX_BTIME) != 0 ? (time_t)stx->stx_btime.tv_sec : 0;
+}
+
+// Submits statx requests for all batched entries at once and adds them to the worker results on completion.
+static void
+db_scan_stat_batch_flush(DatabaseScanWorker *worker, FsearchDatabaseEntryFolder *parent, gsize parent_path_len, int dir_fd) {
+    DatabaseWalkContext *walk_context = worker->walk_context;
+    const uint32_t num_requests = worker->num_stat_requests;
+    if (num_requests == 0) {
+        return;
+    }
+    worker->num_stat_requests = 0;
+
+    const unsigned int mask = db_scan_statx_mask(walk_context);
+    uint32_t num_submitted = 0;
+    for (uint32_t i = 0; i < num_requests; i++) {
+        DatabaseScanStatRequest *request = &worker->stat_requests[i];
+        request->res = -EAGAIN;
+        struct io_uring_sqe *sqe = io_uring_get_sqe(&worker->ring);
+        if (!sqe) {
+            break;
+        }
+        io_uring_prep_statx(sqe, dir_fd, request->name, db_scan_stat_flags(), mask, &request->stx);
+        io_uring_sqe_set_data(sqe, request);
+        num_submitted++;
+    }
+
+    if (num_submitted > 0) {
+        const gint64 start_time = db_scan_worker_begin_call(worker);
+        const int res = io_uring_submit_and_wait(&worker->ring, num_submitted);
+        // only the requests which were submitted complete, the others are still queued in the ring
+        const uint32_t num_in_flight = res > 0 ? MIN((uint32_t)res, num_submitted) : 0;
+        uint32_t num_completed = 0;
+        while (num_completed < num_in_flight) {
+            struct io_uring_cqe *cqe = NULL;
+            const int wait_res = io_uring_wait_cqe(&worker->ring, &cqe);
+            if (wait_res == -EINTR) {
+                continue;
+            }
+            if (wait_res < 0) {
+                break;
+            }
+            DatabaseScanStatRequest *request = io_uring_cqe_get_data(cqe);
+            request->res = cqe->res;
+            io_uring_cqe_seen(&worker->ring, cqe);
+            num_completed++;
+        }
+        db_scan_worker_end_call(worker, NULL, start_time);
+        if (num_completed < num_submitted) {
+            // The ring still holds requests which point at the ones the next batch reuses, their completions would end
+            // up in the wrong entries. It's dropped along with them, the rest of the batch and of the scan use fstatat.
+            g_debug("[db_scan] io_uring failed (%d of %d requests completed), using fstatat", num_completed, num_submitted);
+            io_uring_queue_exit(&worker->ring);
+            worker->ring_initialized = false;
+        }
+        // the requests of a batch complete together, so each of them gets an equal share of the wait time
+        const gint64 request_time = (g_get_monotonic_time() - start_time) / num_submitted;
+        for (uint32_t i = 0; i < num_completed; i++) {
+            db_scan_latency_add(&worker->stats.stat_latency, request_time);
+        }
+    }
+
+    for (uint32_t i = 0; i < num_requests; i++) {
+        DatabaseScanStatRequest *request = &worker->stat_requests[i];
+        if (request->res == -EINVAL || request->res == -EOPNOTSUPP || request->res == -EAGAIN) {
+            // kernel without IORING_OP_STATX or the request didn't make it into the ring
+            if (request->res != -EAGAIN && worker->ring_initialized) {
+                g_debug("[db_scan] io_uring doesn't support statx, using fstatat");
+                io_uring_queue_exit(&worker->ring);
+                worker->ring_initialized = false;
+            }
+            db_scan_add_entry_with_stat(worker, parent, parent_path_len, dir_fd, request->name, request->name_len);
+            continue;
+        }
+        if (request->res < 0) {
+            g_debug("[db_scan] can't stat: %s%s", worker->path->str, request->name);
+            worker->stats.num_skipped++;
+            continue;
+        }
+
+        const struct statx *stx = &request->stx;
+        const bool is_dir = S_ISDIR(stx->stx_mode);
+        if (walk_context->one_filesystem
+            && walk_context->root_device_id != makedev(stx->stx_dev_major, stx->stx_dev_minor)) {
+            g_debug("[db_scan] different filesystem, skipping: %s%s", worker->path->str, request->name);
+            worker->stats.num_skipped++;
+            continue;
+        }
+        FsearchDatabaseEntryMetadata metadata = {};
+        db_entry_metadata_init_from_statx(&metadata, stx);
+        db_scan_add_entry(worker,
+                          parent,
+                          parent_path_len,
+                          request->name,
+                          request->name_len,
+                          false,
+                          is_dir,
+                          (off_t)stx->stx_size,
+                          (time_t)stx->stx_mtime.tv_sec,
+                          &metadata);
+    }
+}
+
+static void
+db_scan_stat_batch_add(DatabaseScanWorker *worker, const char *name, size_t name_len) {
+    DatabaseScanStatRequest *request = &worker->stat_requests[worker->num_stat_requests++];
+    memcpy(request->name, name, name_len + 1);
+    request->name_len = name_len;
+}
+#endif
+
+static bool
+db_folder_is_unchanged(DatabaseWalkContext *walk_context, DatabaseScanDirectory *directory) {
+    if (!walk_context->reference || !directory->reference) {
+        return false;
+    }
+    const time_t mtime = db_entry_get_mtime((FsearchDatabaseEntry *)directory->folder);
+    const time_t reference_mtime = db_entry_get_mtime((FsearchDatabaseEntry *)directory->reference);
+    // mtime only has a resolution of one second, so folders which were modified in the same second
+    // the reference scan was started might have changed without a visible mtime change
+    return mtime != 0 && mtime == reference_mtime && mtime < walk_context->reference->timestamp;
+}
+
+// The folder wasn't modified since the reference scan, so its list of children is still the same.
+// Files are copied from the reference, only sub folders need to be stat'ed to find out whether they have changed.
+static int
+db_folder_scan_unchanged(DatabaseScanWorker *worker, DatabaseScanDirectory *directory, gsize path_len) {
+    DatabaseWalkContext *walk_context = worker->walk_context;
+    FsearchDatabase *db = walk_context->db;
+    FsearchDatabaseEntryFolder *parent = directory->folder;
+    DatabaseScanReferenceChildren *children =
+        db_scan_reference_get_children(walk_context->reference, directory->reference, false);
+    if (!children) {
+        return WALK_OK;
+    }
+
+    // open the folder before the files are added, that modifies worker->path
+    GString *path = worker->path;
+    int dir_fd = -1;
+    if (children->folders->len > 0) {
+        const gint64 start_time = db_scan_worker_begin_call(worker);
+        dir_fd = open(path->str, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        db_scan_worker_end_call(worker, &worker->stats.open_latency, start_time);
+        if (dir_fd < 0) {
+            g_debug("[db_scan] failed to open directory: %s", path->str);
+            worker->stats.num_skipped++;
+            return WALK_BADIO;
+        }
+    }
+
+    for (uint32_t i = 0; i < children->files->len; i++) {
+        FsearchDatabaseEntry *reference_file = g_ptr_array_index(children->files, i);
+        const char *name = db_entry_get_name_raw(reference_file);
+        if ((walk_context->exclude_hidden && name[0] == '.') || file_is_excluded(name, db->exclude_matcher)) {
+            worker->stats.num_excluded++;
+            continue;
+        }
+        FsearchDatabaseEntryMetadata metadata = {};
+        const bool has_metadata = walk_context->reference->metadata
+                               && db_metadata_lookup(walk_context->reference->metadata, reference_file, &metadata);
+        db_scan_add_entry(worker,
+                          parent,
+                          path_len,
+                          name,
+                          strlen(name),
+                          walk_context->reference->share_names,
+                          false,
+                          db_entry_get_size(reference_file),
+                          db_entry_get_mtime(reference_file),
+                          has_metadata ? &metadata : NULL);
+    }
+
+    if (children->folders->len == 0) {
+        return WALK_OK;
+    }
+
+    for (uint32_t i = 0; i < children->folders->len; i++) {
+        if (db_walk_is_stopped(walk_context)) {
+            close(dir_fd);
+            return WALK_CANCEL;
+        }
+        FsearchDatabaseEntryFolder *reference_folder = g_ptr_array_index(children->folders, i);
+        const char *name = db_entry_get_name_raw((FsearchDatabaseEntry *)reference_folder);
+        if ((walk_context->exclude_hidden && name[0] == '.') || file_is_excluded(name, db->exclude_matcher)) {
+            worker->stats.num_excluded++;
+            continue;
+        }
+
+        struct stat st;
+        const gint64 start_time = db_scan_worker_begin_call(worker);
+        const int res = fstatat(dir_fd, name, &st, db_scan_stat_flags());
+        db_scan_worker_end_call(worker, &worker->stats.stat_latency, start_time);
+        if (res || !S_ISDIR(st.st_mode)) {
+            g_debug("[db_scan] can't stat: %s%s", path->str, name);
+            worker->stats.num_skipped++;
+            continue;
+        }
+        if (walk_context->one_filesystem && walk_context->root_device_id != st.st_dev) {
+            worker->stats.num_skipped++;
+            continue;
+        }
+
+        g_string_truncate(path, path_len);
+        g_string_append(path, name);
+        if (directory_is_excluded(path->str, db->exclude_matcher)) {
+            worker->stats.num_excluded++;
+            continue;
+        }
+
+        FsearchDatabaseEntry *entry = fsearch_memory_pool_malloc(worker->folder_pool);
+        db_scan_set_name(worker, entry, name, walk_context->reference->share_names);
+        db_entry_set_type(entry, DATABASE_ENTRY_TYPE_FOLDER);
+        db_entry_set_mtime(entry, st.st_mtime);
+        db_entry_set_parent(entry, parent);
+
+        darray_add_item(worker->folders, entry);
+        if (worker->metadata) {
+            FsearchDatabaseEntryMetadata metadata = {};
+            const gint64 metadata_start_time = db_scan_worker_begin_call(worker);
+            db_entry_metadata_init(db, &metadata, &st, dir_fd, name, db_scan_stat_flags());
+            db_scan_worker_end_call(worker, NULL, metadata_start_time);
+            db_add_metadata_record(worker->metadata, entry, &metadata);
+        }
+
+        db_scan_worker_push_directory(
+            worker,
+            db_scan_directory_new((FsearchDatabaseEntryFolder *)entry, reference_folder, path->str, path->len));
+    }
+    close(dir_fd);
+    return WALK_OK;
+}
+
+// Stats the root of the walk, which happens on a worker, so an unresponsive root can't block anyone else
+static int
+db_folder_scan_root(DatabaseScanWorker *worker, DatabaseScanDirectory *directory) {
+    DatabaseWalkContext *walk_context = worker->walk_context;
+    const char *root_path = walk_context->root_path;
+
+    struct stat st = {};
+    struct stat root_st = {};
+    const gint64 start_time = db_scan_worker_begin_call(worker);
+    const bool is_dir = stat(root_path, &st) == 0 && S_ISDIR(st.st_mode);
+    const int res = is_dir ? lstat(root_path, &root_st) : -1;
+    db_scan_worker_end_call(worker, &worker->stats.stat_latency, start_time);
+    if (!is_dir) {
+        g_warning("[db_scan] %s doesn't exist", root_path);
+        walk_context->root_missing = true;
+        return WALK_BADIO;
+    }
+    if (res) {
+        g_debug("[db_scan] can't stat: %s", root_path);
+    }
+    // the other workers only get directories from this one, so they see it once they need it
+    walk_context->root_device_id = root_st.st_dev;
+
+    FsearchDatabaseEntry *root = (FsearchDatabaseEntry *)directory->folder;
+    db_entry_set_mtime(root, root_st.st_mtime);
+    if (worker->metadata) {
+        FsearchDatabaseEntryMetadata metadata = {};
+        const gint64 metadata_start_time = db_scan_worker_begin_call(worker);
+        db_entry_metadata_init(walk_context->db, &metadata, &root_st, AT_FDCWD, root_path, AT_SYMLINK_NOFOLLOW);
+        db_scan_worker_end_call(worker, NULL, metadata_start_time);
+        db_add_metadata_record(worker->metadata, root, &metadata);
+    }
+    return WALK_OK;
+}
+
+static int
+db_folder_scan(DatabaseScanWorker *worker, DatabaseScanDirectory *directory) {
+    DatabaseWalkContext *walk_context = worker->walk_context;
+    if (db_walk_is_stopped(walk_context)) {
+        g_debug("[db_scan] cancelled");
+        return WALK_CANCEL;
+    }
+
+    FsearchDatabaseEntryFolder *parent = directory->folder;
+    if (parent == walk_context->root) {
+        const int res = db_folder_scan_root(worker, directory);
+        if (res != WALK_OK) {
+            return res;
+        }
+    }
+
+    GString *path = worker->path;
+    g_string_assign(path, directory->path);
+    g_string_append_c(path, G_DIR_SEPARATOR);
+
+    // remember end of parent path
+    const gsize path_len = path->len;
+
+    if (db_folder_is_unchanged(walk_context, directory)) {
+        db_scan_notify_status(walk_context, path->str);
+        return db_folder_scan_unchanged(worker, directory, path_len);
+    }
+
+    worker->reference_folders = walk_context->reference && directory->reference
+                                  ? db_scan_reference_get_folders_by_name(walk_context->reference, directory->reference)
+                                  : NULL;
+
+    DatabaseDirectoryReader reader = {};
+    if (!db_directory_reader_open(&reader, path->str, worker)) {
+        g_debug("[db_scan] failed to open directory: %s", path->str);
+        worker->stats.num_skipped++;
+        return WALK_BADIO;
+    }
+
+    db_scan_notify_status(walk_context, path->str);
+
+    FsearchDatabase *db = walk_context->db;
+
+    const char *d_name = NULL;
+    unsigned char d_type = DT_UNKNOWN;
+    while ((d_name = db_directory_reader_next(&reader, &d_type))) {
+        if (db_walk_is_stopped(walk_context)) {
+            g_debug("[db_scan] cancelled");
+            db_directory_reader_close(&reader);
+            worker->reference_folders = NULL;
+            return WALK_CANCEL;
+        }
+        if (d_name[0] == '.') {
+            if (d_name[1] == '\0' || (d_name[1] == '.' && d_name[2] == '\0')) {
+                // skip "." and ".."
+                continue;
+            }
+            if (walk_context->exclude_hidden) {
+                // file is dotfile, skip
+                worker->stats.num_excluded++;
+                continue;
+            }
+        }
+        if (file_is_excluded(d_name, db->exclude_matcher)) {
+            // g_debug("[db_scan] excluded: %s", d_name);
+            worker->stats.num_excluded++;
+            continue;
+        }
+
+        const size_t d_name_len = strlen(d_name);
+        if (d_name_len >= 256) {
+            g_warning("[db_scan] file name too long, skipping: \"%s\" (len: %lu)", d_name, d_name_len);
+            worker->stats.num_skipped++;
+            continue;
+        }
+
+        const bool is_dir = d_type == DT_DIR;
+
+        // Only stat when it's really necessary:
+        // - the filesystem doesn't report the file type
+        // - size or modification time are part of the index
+        // - we need the device id to stay on one filesystem, files can be bind mounts from other filesystems too
+        if (d_type != DT_UNKNOWN && !walk_context->needs_metadata && !walk_context->one_filesystem) {
+            db_scan_add_entry(worker, parent, path_len, d_name, d_name_len, false, is_dir, 0, 0, NULL);
+            continue;
+        }
+
+#ifdef HAVE_IO_URING
+        if (worker->ring_initialized) {
+            db_scan_stat_batch_add(worker, d_name, d_name_len);
+            if (worker->num_stat_requests == SCAN_STAT_BATCH_SIZE) {
+                db_scan_stat_batch_flush(worker, parent, path_len, reader.fd);
+            }
+            continue;
+        }
+#endif
+        db_scan_add_entry_with_stat(worker, parent, path_len, reader.fd, d_name, d_name_len);
+    }
+
+#ifdef HAVE_IO_URING
+    db_scan_stat_batch_flush(worker, parent, path_len, reader.fd);
+#endif
+
+    if (reader.failed) {
+        // the entries which were read are kept, but the folder must not look unchanged to incremental scans or the
+        // rest of them would never be read
+        g_debug("[db_scan] failed to read directory: %s", path->str);
+        worker->stats.num_skipped++;
+        db_entry_set_mtime((FsearchDatabaseEntry *)parent, 0);
+    }
+
+    db_directory_reader_close(&reader);
+    worker->reference_folders = NULL;
+    return WALK_OK;
+}
+
+static void
+db_scan_worker(void *data) {
+    DatabaseScanWorker *worker = data;
+    g_assert(worker);
+    DatabaseWalkContext *walk_context = worker->walk_context;
+
+#ifdef HAVE_IO_URING
+    if (walk_context->needs_metadata) {
+        db_scan_worker_init_ring(worker);
+    }
+#endif
+
+    while (!db_walk_is_stopped(walk_context)) {
+        DatabaseScanDirectory *dir = db_scan_worker_pop_directory(worker);
+        if (!dir) {
+            dir = db_scan_worker_steal_directory(worker);
+        }
+        if (!dir) {
+            if (g_atomic_int_get(&walk_context->num_pending) == 0) {
+                // nothing queued and no one is scanning -> no more work will show up
+                break;
+            }
+            // wait until new directories get pushed,
+            // the timeout also covers missed wake ups and cancellation
+            g_mutex_lock(&walk_context->idle_mutex);
+            g_atomic_int_inc(&walk_context->num_idle);
+            if (g_atomic_int_get(&walk_context->num_pending) > 0) {
+                g_cond_wait_until(&walk_context->idle_cond,
+                                  &walk_context->idle_mutex,
+                                  g_get_monotonic_time() + 10 * G_TIME_SPAN_MILLISECOND);
+            }
+            g_atomic_int_add(&walk_context->num_idle, -1);
+            g_mutex_unlock(&walk_context->idle_mutex);
+            continue;
+        }
+
+        db_scan_throttle(walk_context->scan_context);
+
+        g_mutex_lock(&worker->state_mutex);
+        worker->directory = dir;
+        g_mutex_unlock(&worker->state_mutex);
+
+        const gint64 start_time = g_get_monotonic_time();
+        FSEARCH_TRACE1(scan_directory_start, dir->path);
+        const int res = db_folder_scan(worker, dir);
+        FSEARCH_TRACE2(scan_directory_end, dir->path, res);
+        db_scan_root_stats_add_directory_time(&worker->stats,
+                                              dir->path[0] ? dir->path : G_DIR_SEPARATOR_S,
+                                              g_get_monotonic_time() - start_time);
+        if (res != WALK_OK && dir->folder == walk_context->root) {
+            g_atomic_int_set(&walk_context->root_result, res);
+        }
+
+        g_mutex_lock(&worker->state_mutex);
+        worker->directory = NULL;
+        g_mutex_unlock(&worker->state_mutex);
+        g_clear_pointer(&dir, db_scan_directory_free);
+
+        if (g_atomic_int_dec_and_test(&walk_context->num_pending)) {
+            // the last directory was scanned -> wake up everyone, so they can finish
+            g_mutex_lock(&walk_context->idle_mutex);
+            g_cond_broadcast(&walk_context->idle_cond);
+            g_mutex_unlock(&walk_context->idle_mutex);
+        }
+    }
+
+#ifdef HAVE_IO_URING
+    db_scan_worker_clear_ring(worker);
+#endif
+}
+
+static const char *
+db_index_get_root_name(FsearchIndex *index) {
+    // the root directory is stored with an empty name
+    return strcmp(index->path, G_DIR_SEPARATOR_S) == 0 ? "" : index->path;
+}
+
+static FsearchIndex *
+db_find_index(FsearchDatabase *db, const char *path) {
+    for (GList *l = db->indexes; l != NULL; l = l->next) {
+        FsearchIndex *index = l->data;
+        if (index->path && strcmp(index->path, path) == 0) {
+            return index;
+        }
+    }
+    return NULL;
+}
+
+// Takes ownership of reference
+static DatabaseScanContext *
+db_scan_context_new(FsearchDatabase *db,
+                    DatabaseScanReference *reference,
+                    GCancellable *cancellable,
+                    void (*status_cb)(const char *)) {
+    DatabaseScanContext *scan_context = calloc(1, sizeof(DatabaseScanContext));
+    g_assert(scan_context);
+    scan_context->db = db_ref(db);
+    scan_context->reference = reference;
+    scan_context->cancellable = cancellable ? g_object_ref(cancellable) : NULL;
+    scan_context->status_cb = status_cb;
+    scan_context->stats = db_scan_stats_new();
+    scan_context->status_timer = g_timer_new();
+    scan_context->low_impact = db->low_impact;
+    scan_context->call_timeout = db->scan_call_timeout;
+    scan_context->root_timeout = db->scan_root_timeout;
+    scan_context->timed_out_indexes = g_ptr_array_new();
+    g_mutex_init(&scan_context->status_mutex);
+    g_mutex_init(&scan_context->merge_mutex);
+    g_mutex_init(&scan_context->throttle_mutex);
+    scan_context->ref_count = 1;
+    return scan_context;
+}
+
+static DatabaseScanContext *
+db_scan_context_ref(DatabaseScanContext *scan_context) {
+    g_atomic_int_inc(&scan_context->ref_count);
+    return scan_context;
+}
+
+static void
+db_scan_context_unref(DatabaseScanContext *scan_context) {
+    if (!scan_context || !g_atomic_int_dec_and_test(&scan_context->ref_count)) {
+        return;
+    }
+    g_clear_pointer(&scan_context->status_timer, g_timer_destroy);
+    g_mutex_clear(&scan_context->status_mutex);
+    g_mutex_clear(&scan_context->merge_mutex);
+    g_mutex_clear(&scan_context->throttle_mutex);
+    g_clear_pointer(&scan_context->timed_out_indexes, g_ptr_array_unref);
+    g_clear_pointer(&scan_context->stats, db_scan_stats_unref);
+    g_clear_pointer(&scan_context->reference, db_scan_reference_free);
+    g_clear_object(&scan_context->cancellable);
+    g_clear_pointer(&scan_context->db, db_unref);
+    g_clear_pointer(&scan_context, free);
+}
+
+static DatabaseWalkContext *
+db_walk_context_new(DatabaseScanContext *scan_context, const char *dname, bool one_filesystem) {
+    FsearchDatabase *db = scan_context->db;
+    DatabaseWalkContext *walk_context = calloc(1, sizeof(DatabaseWalkContext));
+    g_assert(walk_context);
+
+    walk_context->db = db;
+    walk_context->scan_context = db_scan_context_ref(scan_context);
+    walk_context->cancellable = scan_context->cancellable;
+    walk_context->num_workers = MAX(scan_context->num_workers_per_root, 1);
+    walk_context->root_path = g_strdup(dname);
+    walk_context->root_result = WALK_OK;
+    walk_context->reference = scan_context->reference;
+    walk_context->one_filesystem = one_filesystem;
+    walk_context->exclude_hidden = db->exclude_hidden;
+    walk_context->needs_metadata = (db->index_flags & (DATABASE_INDEX_FLAG_SIZE | DATABASE_INDEX_FLAG_MODIFICATION_TIME
+                                                       | DATABASE_INDEX_FLAGS_METADATA))
+                                != 0;
+    walk_context->start_time = g_get_monotonic_time();
+    g_mutex_init(&walk_context->idle_mutex);
+    g_cond_init(&walk_context->idle_cond);
+    g_mutex_init(&walk_context->finished_mutex);
+    g_cond_init(&walk_context->finished_cond);
+
+    walk_context->workers = calloc(walk_context->num_workers, sizeof(DatabaseScanWorker *));
+    g_assert(walk_context->workers);
+    for (uint32_t i = 0; i < walk_context->num_workers; i++) {
+        walk_context->workers[i] = db_scan_worker_new(walk_context, i);
+    }
+    walk_context->ref_count = 1;
+    return walk_context;
+}
+
+static DatabaseWalkContext *
+db_walk_context_ref(DatabaseWalkContext *walk_context) {
+    g_atomic_int_inc(&walk_context->ref_count);
+    return walk_context;
+}
+
+static void
+db_walk_context_unref(DatabaseWalkContext *walk_context) {
+    if (!walk_context || !g_atomic_int_dec_and_test(&walk_context->ref_count)) {
+        return;
+    }
+    for (uint32_t i = 0; i < walk_context->num_workers; i++) {
+        g_clear_pointer(&walk_context->workers[i], db_scan_worker_free);
+    }
+    g_clear_pointer(&walk_context->workers, free);
+    g_mutex_clear(&walk_context->idle_mutex);
+    g_cond_clear(&walk_context->idle_cond);
+    g_mutex_clear(&walk_context->finished_mutex);
+    g_cond_clear(&walk_context->finished_cond);
+    g_clear_pointer(&walk_context->root_path, g_free);
+    g_clear_pointer(&walk_context->scan_context, db_scan_context_unref);
+    g_clear_pointer(&walk_context, free);
+}
+
+static gpointer
+db_scan_worker_thread(gpointer data) {
+    DatabaseScanWorker *worker = data;
+    DatabaseWalkContext *walk_context = worker->walk_context;
+    db_scan_worker(worker);
+
+    g_mutex_lock(&walk_context->finished_mutex);
+    walk_context->num_finished++;
+    g_cond_signal(&walk_context->finished_cond);
+    g_mutex_unlock(&walk_context->finished_mutex);
+    // might be the last reference, if the walk was abandoned while this worker was stuck
+    db_walk_context_unref(walk_context);
+    return NULL;
+}
+
+// Returns the directory of a worker which is stuck in a filesystem call for longer than the call timeout, or of any
+// worker once the whole walk took longer than the root timeout. NULL if the walk can go on.
+static char *
+db_walk_get_stuck_directory(DatabaseWalkContext *walk_context, gint64 now) {
+    DatabaseScanContext *scan_context = walk_context->scan_context;
+    const gint64 elapsed = (now - walk_context->start_time) / 1000;
+    const bool root_timed_out = scan_context->root_timeout > 0 && elapsed >= scan_context->root_timeout;
+    for (uint32_t i = 0; i < walk_context->num_workers; i++) {
+        DatabaseScanWorker *worker = walk_context->workers[i];
+        const gint busy_since = g_atomic_int_get(&worker->busy_since);
+        const bool is_stuck =
+            busy_since > 0 && scan_context->call_timeout > 0 && elapsed - (busy_since - 1) >= scan_context->call_timeout;
+        if (!is_stuck && !root_timed_out) {
+            continue;
+        }
+        g_mutex_lock(&worker->state_mutex);
+        char *directory = NULL;
+        if (worker->directory) {
+            directory = g_strdup(worker->directory->path[0] ? worker->directory->path : G_DIR_SEPARATOR_S);
+        }
+        g_mutex_unlock(&worker->state_mutex);
+        if (directory) {
+            return directory;
+        }
+    }
+    return root_timed_out ? g_strdup(walk_context->root_path) : NULL;
+}
+
+// Waits until num_threads worker threads of the walk returned. Returns false if the walk got stuck for longer than the
+// timeouts allow, its workers are told to stop then and stuck_directory is set to where it got stuck.
+static bool
+db_walk_supervise(DatabaseWalkContext *walk_context, uint32_t num_threads, char **stuck_directory) {
+    DatabaseScanContext *scan_context = walk_context->scan_context;
+    const gint64 root_end_time = walk_context->start_time + (gint64)scan_context->root_timeout * 1000;
+
+    g_mutex_lock(&walk_context->finished_mutex);
+    while (walk_context->num_finished < num_threads) {
+        const gint64 now = g_get_monotonic_time();
+        *stuck_directory = db_walk_get_stuck_directory(walk_context, now);
+        if (*stuck_directory) {
+            break;
+        }
+        gint64 end_time = now + DATABASE_SCAN_WATCHDOG_INTERVAL;
+        if (scan_context->root_timeout > 0) {
+            end_time = MIN(end_time, root_end_time);
+        }
+        g_cond_wait_until(&walk_context->finished_cond, &walk_context->finished_mutex, end_time);
+    }
+    g_mutex_unlock(&walk_context->finished_mutex);
+    if (!*stuck_directory) {
+        return true;
+    }
+
+    g_atomic_int_set(&walk_context->timed_out, 1);
+    // the idle workers return right away
+    g_mutex_lock(&walk_context->idle_mutex);
+    g_cond_broadcast(&walk_context->idle_cond);
+    g_mutex_unlock(&walk_context->idle_mutex);
+    return false;
+}
+
+static int
+db_scan_folder(DatabaseScanContext *scan_context, const char *dname, bool one_filesystem) {
+    g_assert(dname);
+    g_assert(dname[0] == G_DIR_SEPARATOR);
+    g_debug("[db_scan] scan path: %s", dname);
+
+    const gint64 start_time = g_get_monotonic_time();
+    FsearchDatabaseScanRootStats *root_stats = db_scan_root_stats_new(dname);
+
+    FsearchDatabase *db = scan_context->db;
+
+    g_autoptr(GString) path = g_string_new(dname);
+    // remove leading path separator '/' for root directory
+    if (strcmp(path->str, G_DIR_SEPARATOR_S) == 0) {
+        g_string_erase(path, 0, 1);
+    }
+
+    DatabaseWalkContext *walk_context = db_walk_context_new(scan_context, dname, one_filesystem);
+    const uint32_t num_workers = walk_context->num_workers;
+    DatabaseScanWorker **workers = walk_context->workers;
+
+    // the root belongs to the first worker until the results get merged, it's stat'ed once the walk starts
+    FsearchDatabaseEntry *entry = fsearch_memory_pool_malloc(workers[0]->folder_pool);
+    db_entry_set_name_in_arena(entry, workers[0]->names, path->str);
+    db_entry_set_parent(entry, NULL);
+    db_entry_set_type(entry, DATABASE_ENTRY_TYPE_FOLDER);
+    darray_add_item(workers[0]->folders, entry);
+    walk_context->root = (FsearchDatabaseEntryFolder *)entry;
+
+    db_scan_worker_push_directory(workers[0],
+                                  db_scan_directory_new((FsearchDatabaseEntryFolder *)entry,
+                                                        db_scan_reference_get_root(scan_context->reference, path->str),
+                                                        path->str,
+                                                        path->len));
+
+    // other roots might be scanned at the same time, so the workers get their own threads
+    // instead of occupying the thread pool of the database. Without timeouts the first one runs on this thread,
+    // otherwise this thread watches them.
+    const bool is_supervised = scan_context->call_timeout > 0 || scan_context->root_timeout > 0;
+    const uint32_t first_thread = is_supervised ? 0 : 1;
+    GThread *threads[num_workers];
+    for (uint32_t i = first_thread; i < num_workers; i++) {
+        db_walk_context_ref(walk_context);
+        threads[i] = g_thread_new("fsearch_scan_worker", db_scan_worker_thread, workers[i]);
+    }
+    g_autofree char *stuck_directory = NULL;
+    if (is_supervised && !db_walk_supervise(walk_context, num_workers, &stuck_directory)) {
+        // A stuck worker might never return, so none of them are waited for. They share their entries, so
+        // the results of all of them are dropped together with the walk once the last one returns.
+        for (uint32_t i = 0; i < num_workers; i++) {
+            g_thread_unref(threads[i]);
+        }
+        g_clear_pointer(&walk_context, db_walk_context_unref);
+
+        g_warning("[db_scan] scanning %s timed out in %s", dname, stuck_directory);
+        root_stats->timed_out = true;
+        root_stats->timed_out_directory = g_steal_pointer(&stuck_directory);
+        root_stats->num_threads = num_workers;
+        root_stats->duration = g_get_monotonic_time() - start_time;
+        db_scan_stats_add_root(scan_context->stats, g_steal_pointer(&root_stats));
+        return WALK_TIMEOUT;
+    }
+    if (!is_supervised) {
+        db_scan_worker(workers[0]);
+    }
+    for (uint32_t i = first_thread; i < num_workers; i++) {
+        g_thread_join(threads[i]);
+    }
+
+    uint32_t num_files = 0;
+    uint32_t num_folders = 0;
+    DynamicArray *root_files = NULL;
+    DynamicArray *root_folders = NULL;
+    if (!walk_context->root_missing) {
+        for (uint32_t i = 0; i < num_workers; i++) {
+            num_files += darray_get_num_items(workers[i]->files);
+            num_folders += darray_get_num_items(workers[i]->folders);
+        }
+        root_files = darray_new(MAX(num_files, 1));
+        root_folders = darray_new(MAX(num_folders, 1));
+        for (uint32_t i = 0; i < num_workers; i++) {
+            darray_add_array(root_files, workers[i]->files);
+            darray_add_array(root_folders, workers[i]->folders);
+        }
+        // The parents of an entry might have been scanned by any of the workers, so the folder sizes are summed up
+        // once all of them are done. That happens before the merge, so the roots on other devices can do the same at
+        // the same time.
+        db_entry_folders_aggregate(root_folders, root_files);
+    }
+
+    // merge the results of all workers into the database
+    g_mutex_lock(&scan_context->merge_mutex);
+    if (root_files) {
+        darray_add_array(db->sorted_files[DATABASE_INDEX_TYPE_NAME], root_files);
+        darray_add_array(db->sorted_folders[DATABASE_INDEX_TYPE_NAME], root_folders);
+        g_clear_pointer(&root_files, darray_unref);
+        g_clear_pointer(&root_folders, darray_unref);
+    }
+    for (uint32_t i = 0; i < num_workers && !walk_context->root_missing; i++) {
+        DatabaseScanWorker *worker = workers[i];
+        if (worker->metadata) {
+            g_array_append_vals(db->metadata_records, worker->metadata->data, worker->metadata->len);
+        }
+
+        fsearch_memory_pool_merge(db->file_pool, g_steal_pointer(&worker->file_pool));
+        fsearch_memory_pool_merge(db->folder_pool, g_steal_pointer(&worker->folder_pool));
+        fsearch_string_arena_merge(db->names, g_steal_pointer(&worker->names));
+    }
+    g_mutex_unlock(&scan_context->merge_mutex);
+    for (uint32_t i = 0; i < num_workers; i++) {
+        db_scan_root_stats_merge(root_stats, &workers[i]->stats);
+    }
+
+    const int res = is_cancelled(scan_context->cancellable) ? WALK_CANCEL : g_atomic_int_get(&walk_context->root_result);
+    g_clear_pointer(&walk_context, db_walk_context_unref);
+
+    root_stats->num_files = num_files;
+    root_stats->num_folders = num_folders;
+    root_stats->num_threads = num_workers;
+    root_stats->completed = res == WALK_OK;
+    root_stats->duration = g_get_monotonic_time() - start_time;
+    db_scan_stats_add_root(scan_context->stats, g_steal_pointer(&root_stats));
+
+    if (res == WALK_OK) {
+        g_debug("[db_scan] scanned %s: %d files, %d folders (%d threads)", dname, num_files, num_folders, num_workers);
+    }
+    else if (res == WALK_CANCEL) {
+        g_debug("[db_scan] scan cancelled.");
+    }
+    else {
+        g_warning("[db_scan] walk error: %d", res);
+    }
+    return res;
+}
+
+// The entries of index get taken from the previous database
+static void
+db_scan_set_timed_out(DatabaseScanContext *scan_context, FsearchIndex *index) {
+    g_mutex_lock(&scan_context->merge_mutex);
+    g_ptr_array_add(scan_context->timed_out_indexes, index);
+    g_mutex_unlock(&scan_context->merge_mutex);
+}
+
+static gpointer
+db_scan_device(gpointer data) {
+    DatabaseScanDevice *device = data;
+    DatabaseScanContext *scan_context = device->scan_context;
+
+    while (!is_cancelled(scan_context->cancellable)) {
+        const guint i = (guint)g_atomic_int_add(&device->next_index, 1);
+        if (i >= device->indexes->len) {
+            break;
+        }
+        FsearchIndex *index = g_ptr_array_index(device->indexes, i);
+        const int res = db_scan_folder(scan_context, index->path, index->one_filesystem);
+        if (res == WALK_OK) {
+            index->last_updated = scan_context->db->timestamp;
+            g_atomic_int_inc(&scan_context->num_roots_scanned);
+        }
+        else if (res == WALK_TIMEOUT) {
+            db_scan_set_timed_out(scan_context, index);
+        }
+    }
+    return NULL;
+}
+
+static void
+db_scan_device_free(DatabaseScanDevice *device) {
+    if (!device) {
+        return;
+    }
+    g_clear_pointer(&device->indexes, g_ptr_array_unref);
+    g_clear_pointer(&device, free);
+}
+
+// A stat on a thread of its own, which the caller can give up on
+typedef struct DatabaseScanStatJob {
+    char *path;
+    struct stat st;
+    bool done;
+    GMutex mutex;
+    GCond cond;
+    volatile gint ref_count;
+} DatabaseScanStatJob;
+
+static void
+db_scan_stat_job_unref(DatabaseScanStatJob *job) {
+    if (!g_atomic_int_dec_and_test(&job->ref_count)) {
+        return;
+    }
+    g_clear_pointer(&job->path, g_free);
+    g_mutex_clear(&job->mutex);
+    g_cond_clear(&job->cond);
+    g_clear_pointer(&job, free);
+}
+
+static gpointer
+db_scan_stat_job_run(gpointer data) {
+    DatabaseScanStatJob *job = data;
+    struct stat st = {};
+    stat(job->path, &st);
+
+    g_mutex_lock(&job->mutex);
+    job->st = st;
+    job->done = true;
+    g_cond_signal(&job->cond);
+    g_mutex_unlock(&job->mutex);
+    db_scan_stat_job_unref(job);
+    return NULL;
+}
+
+// Stats path, unless that takes longer than timeout ms (0 waits as long as it takes). Returns false if it did.
+static bool
+db_scan_stat_with_timeout(const char *path, struct stat *st, uint32_t timeout) {
+    if (timeout == 0) {
+        stat(path, st);
+        return true;
+    }
+    DatabaseScanStatJob *job = calloc(1, sizeof(DatabaseScanStatJob));
+    g_assert(job);
+    job->path = g_strdup(path);
+    g_mutex_init(&job->mutex);
+    g_cond_init(&job->cond);
+    // one for the thread, one for us
+    job->ref_count = 2;
+    g_thread_unref(g_thread_new("fsearch_scan_stat", db_scan_stat_job_run, job));
+
+    const gint64 end_time = g_get_monotonic_time() + (gint64)timeout * G_TIME_SPAN_MILLISECOND;
+    g_mutex_lock(&job->mutex);
+    while (!job->done && g_cond_wait_until(&job->cond, &job->mutex, end_time)) {
+    }
+    const bool done = job->done;
+    if (done) {
+        *st = job->st;
+    }
+    g_mutex_unlock(&job->mutex);
+    db_scan_stat_job_unref(job);
+    return done;
+}
+
+static GPtrArray *
+db_scan_get_devices(FsearchDatabase *db, GHashTable *kept_indexes, DatabaseScanContext *scan_context) {
+    GPtrArray *devices = g_ptr_array_new_with_free_func((GDestroyNotify)db_scan_device_free);
+    for (GList *l = db->indexes; l != NULL; l = l->next) {
+        FsearchIndex *index = l->data;
+        if (!index->path || !index->enabled || g_hash_table_contains(kept_indexes, index)) {
+            continue;
+        }
+        // roots which can't be stat'ed end up on device 0, the scan itself reports the error
+        struct stat st = {};
+        if (!db_scan_stat_with_timeout(index->path, &st, scan_context->call_timeout)) {
+            g_warning("[db_scan] %s doesn't respond, skipping it", index->path);
+            FsearchDatabaseScanRootStats *root_stats = db_scan_root_stats_new(index->path);
+            root_stats->timed_out = true;
+            root_stats->timed_out_directory = g_strdup(index->path);
+            root_stats->duration = (gint64)scan_context->call_timeout * 1000;
+            db_scan_stats_add_root(scan_context->stats, root_stats);
+            db_scan_set_timed_out(scan_context, index);
+            continue;
+        }
+
+        DatabaseScanDevice *device = NULL;
+        for (uint32_t i = 0; i < devices->len && !device; i++) {
+            DatabaseScanDevice *d = g_ptr_array_index(devices, i);
+            if (d->device_id == st.st_dev) {
+                device = d;
+            }
+        }
+        if (!device) {
+            device = calloc(1, sizeof(DatabaseScanDevice));
+            g_assert(device);
+            device->scan_context = scan_context;
+            device->device_id = st.st_dev;
+            device->indexes = g_ptr_array_new();
+            g_ptr_array_add(devices, device);
+        }
+        g_ptr_array_add(device->indexes, index);
+    }
+    return devices;
+}
+
+static void
+db_scan_roots(FsearchDatabase *db, GHashTable *kept_indexes, DatabaseScanContext *scan_context) {
+    g_autoptr(GPtrArray) devices = db_scan_get_devices(db, kept_indexes, scan_context);
+
+    uint32_t num_scanners = 0;
+    for (uint32_t i = 0; i < devices->len; i++) {
+        DatabaseScanDevice *device = g_ptr_array_index(devices, i);
+        num_scanners += MIN(device->indexes->len, DATABASE_SCAN_MAX_ROOTS_PER_DEVICE);
+    }
+    if (num_scanners == 0) {
+        return;
+    }
+
+    // split the available threads among the roots which are scanned concurrently
+    const uint32_t num_threads = db->num_scan_threads ? db->num_scan_threads
+                                                      : MAX(fsearch_thread_pool_get_num_threads(db->thread_pool), 1);
+    scan_context->num_workers_per_root = (num_threads + num_scanners - 1) / num_scanners;
+    if (scan_context->low_impact) {
+        scan_context->num_workers_per_root = MIN(scan_context->num_workers_per_root, DATABASE_LOW_IMPACT_THREADS_PER_ROOT);
+    }
+
+    g_debug("[db_scan] scan %d devices with %d threads per root", devices->len, scan_context->num_workers_per_root);
+
+    // the first scanner runs on the calling thread
+    GThread *scanners[num_scanners];
+    DatabaseScanDevice *first_device = NULL;
+    uint32_t num_scanner_threads = 0;
+    for (uint32_t i = 0; i < devices->len; i++) {
+        DatabaseScanDevice *device = g_ptr_array_index(devices, i);
+        const uint32_t num_device_scanners = MIN(device->indexes->len, DATABASE_SCAN_MAX_ROOTS_PER_DEVICE);
+        for (uint32_t j = 0; j < num_device_scanners; j++) {
+            if (!first_device) {
+                first_device = device;
+                continue;
+            }
+            scanners[num_scanner_threads++] = g_thread_new("fsearch_scan_device", db_scan_device, device);
+        }
+    }
+    db_scan_device(first_device);
+    for (uint32_t i = 0; i < num_scanner_threads; i++) {
+        g_thread_join(scanners[i]);
+    }
+}
+
+static gint
+compare_index_path(FsearchIndex *p1, FsearchIndex *p2) {
+    return strcmp(p1->path, p2->path);
+}
+
+static gint
+compare_exclude_path(FsearchExcludePath *p1, FsearchExcludePath *p2) {
+    return strcmp(p1->path, p2->path);
+}
+
+FsearchDatabase *
+db_new(GList *indexes, GList *excludes, char **exclude_files, bool exclude_hidden) {
+    FsearchDatabase *db = g_new0(FsearchDatabase, 1);
+    g_assert(db);
+    g_rw_lock_init(&db->lock);
+    g_rec_mutex_init(&db->cache_mutex);
+    g_mutex_init(&db->version_mutex);
+    g_mutex_init(&db->duplicates_mutex);
+    g_cond_init(&db->duplicates_cond);
+    if (indexes) {
+        db->indexes = g_list_copy_deep(indexes, (GCopyFunc)fsearch_index_copy, NULL);
+
+        db->indexes = g_list_sort(db->indexes, (GCompareFunc)compare_index_path);
+    }
+    if (excludes) {
+        db->excludes = g_list_copy_deep(excludes, (GCopyFunc)fsearch_exclude_path_copy, NULL);
+        db->excludes = g_list_sort(db->excludes, (GCompareFunc)compare_exclude_path);
+    }
+    if (exclude_files) {
+        db->exclude_files = g_strdupv(exclude_files);
+    }
+    db->exclude_matcher = fsearch_exclude_matcher_new(db->excludes, db->exclude_files);
+
+    for (uint32_t i = 0; i < NUM_DATABASE_INDEX_TYPES; i++) {
+        db->sorted_files[i] = NULL;
+        db->sorted_folders[i] = NULL;
+    }
+    db->file_pool = db_entry_pool_new(db_entry_get_sizeof_file_entry());
+    db->folder_pool = db_entry_pool_new(db_entry_get_sizeof_folder_entry());
+    db->names = fsearch_string_arena_new();
+    db->next_folder_id = 1;
+    db->search_cache = db_search_cache_new(0);
+    db->filter_matches = g_ptr_array_new_with_free_func((GDestroyNotify)db_search_filter_matches_unref);
+    db->metadata_records = g_array_new(FALSE, FALSE, sizeof(DatabaseMetadataRecord));
+
+    db->thread_pool = fsearch_thread_pool_get_default();
+
+    db->exclude_hidden = exclude_hidden;
+    db->index_flags = DATABASE_INDEX_FLAG_NAME | DATABASE_INDEX_FLAG_SIZE | DATABASE_INDEX_FLAG_MODIFICATION_TIME;
+    db->scan_call_timeout = DATABASE_SCAN_DEFAULT_CALL_TIMEOUT;
+    db->scan_root_timeout = DATABASE_SCAN_DEFAULT_ROOT_TIMEOUT;
+    db_publish_version(db);
+    db->ref_count = 1;
+    return db;
+}
+
+static void
+db_free(FsearchDatabase *db) {
+    g_assert(db);
+
+    g_debug("[db_free] freeing...");
+    db_lock(db);
+    if (db->ref_count > 0) {
+        g_warning("[db_free] pending references on free: %d", db->ref_count);
+    }
+    // the snapshot references the entries
+    db_wait_for_save(db);
+
+    db_sorted_entries_free(db);
+    // the job got cancelled along with the sorted arrays
+    g_clear_pointer(&db->duplicates_job, db_duplicates_job_free);
+    g_clear_pointer(&db->metadata_records, g_array_unref);
+    g_clear_pointer(&db->search_cache, db_search_cache_free);
+    g_clear_pointer(&db->filter_matches, g_ptr_array_unref);
+    g_clear_pointer(&db->access_filter, fsearch_access_filter_free);
+    g_clear_pointer(&db->changes, db_changes_free);
+    g_clear_pointer(&db->journal, g_byte_array_unref);
+
+    g_clear_pointer(&db->file_pool, fsearch_memory_pool_free_pool);
+    g_clear_pointer(&db->folder_pool, fsearch_memory_pool_free_pool);
+    // only after the entries are gone, they might reference them
+    g_clear_pointer(&db->file_contents, g_bytes_unref);
+    g_clear_pointer(&db->names, fsearch_string_arena_free);
+    g_clear_pointer(&db->segments, g_ptr_array_unref);
+
+    if (db->indexes) {
+        g_list_free_full(g_steal_pointer(&db->indexes), (GDestroyNotify)fsearch_index_free);
+    }
+    if (db->excludes) {
+        g_list_free_full(g_steal_pointer(&db->excludes), (GDestroyNotify)fsearch_exclude_path_free);
+    }
+
+    g_clear_pointer(&db->exclude_files, g_strfreev);
+    g_clear_pointer(&db->exclude_matcher, fsearch_exclude_matcher_free);
+    g_clear_pointer(&db->scan_stats, db_scan_stats_unref);
+    g_clear_pointer(&db->thread_pool, fsearch_thread_pool_unref);
+
+    db_unlock(db);
+
+    g_clear_pointer(&db->version, db_version_unref);
+    g_rw_lock_clear(&db->lock);
+    g_rec_mutex_clear(&db->cache_mutex);
+    g_mutex_clear(&db->version_mutex);
+    g_mutex_clear(&db->duplicates_mutex);
+    g_cond_clear(&db->duplicates_cond);
+
+    g_clear_pointer(&db, free);
+
+#ifdef HAVE_MALLOC_TRIM
+    malloc_trim(0);
+#endif
+
+    g_debug("[db_free] freed");
+}
+
+void
+db_set_index_flags(FsearchDatabase *db, FsearchDatabaseIndexFlags index_flags) {
+    g_assert(db);
+    db->index_flags = index_flags | DATABASE_INDEX_FLAG_NAME;
+}
+
+void
+db_set_low_impact(FsearchDatabase *db, bool low_impact) {
+    g_assert(db);
+    db->low_impact = low_impact;
+}
+
+void
+db_set_compress(FsearchDatabase *db, bool compress) {
+    g_assert(db);
+    db->compress = compress;
+}
+
+void
+db_set_lazy_sort_indexes(FsearchDatabase *db, bool lazy_sort_indexes) {
+    g_assert(db);
+    db->lazy_sort_indexes = lazy_sort_indexes;
+}
+
+void
+db_set_progressive_load(FsearchDatabase *db, bool progressive_load) {
+    g_assert(db);
+    db->progressive_load = progressive_load;
+}
+
+static void
+db_update_search_cache_size(FsearchDatabase *db) {
+    const size_t max_size = db->memory_budget > 0
+                              ? MIN(db->search_cache_size, db->memory_budget / DATABASE_LOW_MEMORY_SEARCH_CACHE_SHARE)
+                              : db->search_cache_size;
+    db_search_cache_set_max_size(db->search_cache, max_size);
+}
+
+void
+db_set_search_cache_size(FsearchDatabase *db, size_t max_size) {
+    g_assert(db);
+    db->search_cache_size = max_size;
+    db_update_search_cache_size(db);
+}
+
+void
+db_set_memory_budget(FsearchDatabase *db, size_t memory_budget) {
+    g_assert(db);
+    db->memory_budget = memory_budget;
+    db_update_search_cache_size(db);
+    if (memory_budget > 0) {
+        g_clear_pointer(&db->trigrams, db_trigrams_unref);
+    }
+}
+
+void
+db_set_trigram_index(FsearchDatabase *db, bool trigram_index) {
+    g_assert(db);
+    db->trigram_index = trigram_index;
+    if (!trigram_index) {
+        g_clear_pointer(&db->trigrams, db_trigrams_unref);
+    }
+}
+
+void
+db_set_filter_by_access(FsearchDatabase *db, bool filter_by_access) {
+    g_assert(db);
+    if (!filter_by_access) {
+        g_clear_pointer(&db->access_filter, fsearch_access_filter_free);
+    }
+    else if (!db->access_filter) {
+        db->access_filter = fsearch_access_filter_new();
+    }
+}
+
+bool
+db_get_filter_by_access(FsearchDatabase *db) {
+    g_assert(db);
+    return db->access_filter != NULL;
+}
+
+void
+db_filter_result_by_access(FsearchDatabase *db, DatabaseSearchResult *result) {
+    g_assert(db);
+    if (!db->access_filter || !result) {
+        return;
+    }
+    DynamicArray *folders = fsearch_access_filter_apply(db->access_filter, result->folders);
+    g_clear_pointer(&result->folders, darray_unref);
+    result->folders = folders;
+    DynamicArray *files = fsearch_access_filter_apply(db->access_filter, result->files);
+    g_clear_pointer(&result->files, darray_unref);
+    result->files = files;
+    result->stats.num_results = (result->folders ? darray_get_num_items(result->folders) : 0)
+                              + (result->files ? darray_get_num_items(result->files) : 0);
+}
+
+void
+db_set_num_scan_threads(FsearchDatabase *db, uint32_t num_threads) {
+    g_assert(db);
+    db->num_scan_threads = MIN(num_threads, FSEARCH_THREAD_LIMIT);
+}
+
+void
+db_set_scan_timeouts(FsearchDatabase *db, uint32_t call_timeout, uint32_t root_timeout) {
+    g_assert(db);
+    db->scan_call_timeout = call_timeout;
+    db->scan_root_timeout = root_timeout;
+}
+
+FsearchDatabaseIndexFlags
+db_get_index_flags(FsearchDatabase *db) {
+    g_assert(db);
+    return db->index_flags;
+}
+
+time_t
+db_get_timestamp(FsearchDatabase *db) {
+    g_assert(db);
+    return db->timestamp;
+}
+
+uint32_t
+db_get_num_files(FsearchDatabase *db) {
+    g_assert(db);
+    return db->sorted_files[DATABASE_INDEX_TYPE_NAME] ? darray_get_num_items(db->sorted_files[DATABASE_INDEX_TYPE_NAME])
+                                                      : 0;
+}
+
+uint32_t
+db_get_num_folders(FsearchDatabase *db) {
+    g_assert(db);
+    return db->sorted_folders[DATABASE_INDEX_TYPE_NAME]
+             ? darray_get_num_items(db->sorted_folders[DATABASE_INDEX_TYPE_NAME])
+             : 0;
+}
+
+uint32_t
+db_get_num_entries(FsearchDatabase *db) {
+    g_assert(db);
+    return db_get_num_files(db) + db_get_num_folders(db);
+}
+
+static void
+db_publish_version(FsearchDatabase *db) {
+    g_mutex_lock(&db->version_mutex);
+    FsearchDatabaseVersion *previous = db->version;
+    if (previous && db_version_has_arrays(previous, db->sorted_folders, db->sorted_files)) {
+        g_mutex_unlock(&db->version_mutex);
+        return;
+    }
+    g_atomic_pointer_set(&db->version, db_version_new(db->sorted_folders, db->sorted_files, db->next_version_id++));
+    if (db->access_filter) {
+        // a rescan or the changes the monitor applied might come with new permissions
+        fsearch_access_filter_clear(db->access_filter);
+    }
+    // readers which loaded the previous version before it got replaced are about to take their reference
+    while (g_atomic_int_get(&db->num_pinning) > 0) {
+        g_thread_yield();
+    }
+    g_mutex_unlock(&db->version_mutex);
+
+    g_clear_pointer(&previous, db_version_unref);
+}
+
+FsearchDatabaseVersion *
+db_pin_version(FsearchDatabase *db) {
+    g_assert(db);
+    g_atomic_int_inc(&db->num_pinning);
+    FsearchDatabaseVersion *version = db_version_ref(g_atomic_pointer_get(&db->version));
+    g_atomic_int_dec_and_test(&db->num_pinning);
+    return version;
+}
+
+void
+db_unlock(FsearchDatabase *db) {
+    g_assert(db);
+    // whatever the writer replaced becomes visible to the readers of versions now
+    db_publish_version(db);
+    g_rw_lock_writer_unlock(&db->lock);
+}
+
+void
+db_lock(FsearchDatabase *db) {
+    g_assert(db);
+    g_rw_lock_writer_lock(&db->lock);
+}
+
+bool
+db_try_lock(FsearchDatabase *db) {
+    g_assert(db);
+    return g_rw_lock_writer_trylock(&db->lock);
+}
+
+void
+db_lock_shared(FsearchDatabase *db) {
+    g_assert(db);
+    g_rw_lock_reader_lock(&db->lock);
+}
+
+void
+db_unlock_shared(FsearchDatabase *db) {
+    g_assert(db);
+    g_rw_lock_reader_unlock(&db->lock);
+}
+
+static bool
+is_valid_sort_type(FsearchDatabaseIndexType sort_type) {
+    if (0 <= sort_type && sort_type < NUM_DATABASE_INDEX_TYPES) {
+        return true;
+    }
+    return false;
+}
+
+bool
+db_has_entries_sorted_by_type(FsearchDatabase *db, FsearchDatabaseIndexType sort_type) {
+    g_assert(db);
+
+    if (is_valid_sort_type(sort_type)) {
+        return db->sorted_folders[sort_type] && db->sorted_files[sort_type] ? true : false;
+    }
+    return false;
+}
+
+DynamicArray *
+db_get_folders_sorted_copy(FsearchDatabase *db, FsearchDatabaseIndexType sort_type) {
+    g_assert(db);
+    if (!is_valid_sort_type(sort_type)) {
+        return NULL;
+    }
+    DynamicArray *folders = db->sorted_folders[sort_type];
+    return folders ? darray_copy(folders) : NULL;
+}
+
+DynamicArray *
+db_get_files_sorted_copy(FsearchDatabase *db, FsearchDatabaseIndexType sort_type) {
+    g_assert(db);
+    if (!is_valid_sort_type(sort_type)) {
+        return NULL;
+    }
+    DynamicArray *files = db->sorted_files[sort_type];
+    return files ? darray_copy(files) : NULL;
+}
+
+DynamicArray *
+db_get_folders_copy(FsearchDatabase *db) {
+    return db_get_folders_sorted_copy(db, DATABASE_INDEX_TYPE_NAME);
+}
+
+DynamicArray *
+db_get_files_copy(FsearchDatabase *db) {
+    return db_get_files_sorted_copy(db, DATABASE_INDEX_TYPE_NAME);
+}
+
+bool
+db_get_entries_sorted(FsearchDatabase *db,
+                      FsearchDatabaseIndexType requested_sort_type,
+                      FsearchDatabaseIndexType *returned_sort_type,
+                      DynamicArray **folders,
+                      DynamicArray **files) {
+    g_assert(db);
+    g_assert(returned_sort_type);
+    g_assert(folders);
+    g_assert(files);
+    if (!is_valid_sort_type(requested_sort_type)) {
+        return false;
+    }
+
+    FsearchDatabaseIndexType sort_type = requested_sort_type;
+    if (!db_has_entries_sorted_by_type(db, requested_sort_type)) {
+        sort_type = DATABASE_INDEX_TYPE_NAME;
+    }
+
+    if (!db_has_entries_sorted_by_type(db, sort_type)) {
+        return false;
+    }
+
+    *folders = darray_ref(db->sorted_folders[sort_type]);
+    *files = darray_ref(db->sorted_files[sort_type]);
+    *returned_sort_type = sort_type;
+    return true;
+}
+
+static FsearchDatabaseColumns *
+db_get_columns_unlocked(FsearchDatabase *db, DynamicArray *entries) {
+    g_assert(db);
+    g_assert(entries);
+
+    FsearchDatabaseColumns **columns = NULL;
+    FsearchDatabaseEntryType type = DATABASE_ENTRY_TYPE_NONE;
+    for (uint32_t i = 0; i < NUM_DATABASE_INDEX_TYPES; i++) {
+        if (entries == db->sorted_folders[i]) {
+            columns = &db->folder_columns;
+            type = DATABASE_ENTRY_TYPE_FOLDER;
+            break;
+        }
+        if (entries == db->sorted_files[i]) {
+            columns = &db->file_columns;
+            type = DATABASE_ENTRY_TYPE_FILE;
+            break;
+        }
+    }
+    g_return_val_if_fail(columns, NULL);
+
+    if (!*columns || (*columns)->entries != entries) {
+        g_autoptr(GTimer) timer = g_timer_new();
+        g_clear_pointer(columns, db_columns_unref);
+        *columns = db_columns_new(entries, type);
+        g_debug("[db_get_columns] created columns of %d entries in %f s",
+                (*columns)->num_entries,
+                g_timer_elapsed(timer, NULL));
+    }
+    return db_columns_ref(*columns);
+}
+
+FsearchDatabaseColumns *
+db_get_columns(FsearchDatabase *db, DynamicArray *entries) {
+    g_assert(db);
+    g_rec_mutex_lock(&db->cache_mutex);
+    FsearchDatabaseColumns *columns = db_get_columns_unlocked(db, entries);
+    g_rec_mutex_unlock(&db->cache_mutex);
+    return columns;
+}
+
+FsearchDatabaseRanks *
+db_get_ranks(FsearchDatabase *db, DynamicArray *entries) {
+    g_assert(db);
+    g_assert(entries);
+
+    FsearchDatabaseRanks **ranks = NULL;
+    DynamicArray *names = NULL;
+    bool is_folder = false;
+    for (uint32_t i = 0; i < NUM_DATABASE_INDEX_TYPES; i++) {
+        if (entries == db->sorted_folders[i]) {
+            ranks = &db->folder_ranks[i];
+            names = db->sorted_folders[DATABASE_INDEX_TYPE_NAME];
+            is_folder = true;
+            break;
+        }
+        if (entries == db->sorted_files[i]) {
+            ranks = &db->file_ranks[i];
+            names = db->sorted_files[DATABASE_INDEX_TYPE_NAME];
+            break;
+        }
+    }
+    if (!ranks || !names) {
+        return NULL;
+    }
+
+    if (!*ranks || (*ranks)->entries != entries || (*ranks)->names != names) {
+        g_autoptr(GTimer) timer = g_timer_new();
+        g_clear_pointer(ranks, db_ranks_unref);
+        // the ranks are looked up by the index of the entries, which has to be their position in the name array
+        if (is_folder) {
+            db_entry_update_folder_indices(db);
+        }
+        else {
+            db_entry_update_file_indices(db);
+        }
+        *ranks = db_ranks_new(entries, names);
+        g_debug("[db_get_ranks] ranked %d entries in %f s", (*ranks)->num_entries, g_timer_elapsed(timer, NULL));
+    }
+    return db_ranks_ref(*ranks);
+}
+
+static FsearchDatabaseFolderPaths *
+db_get_folder_paths_unlocked(FsearchDatabase *db) {
+    g_assert(db);
+
+    DynamicArray *folders = db->sorted_folders[DATABASE_INDEX_TYPE_NAME];
+    if (!folders) {
+        return NULL;
+    }
+    if (!db->folder_paths || db->folder_paths->folders != folders) {
+        g_autoptr(GTimer) timer = g_timer_new();
+        g_clear_pointer(&db->folder_paths, db_folder_paths_unref);
+        db->folder_paths = db_folder_paths_new(folders);
+        g_debug("[db_get_folder_paths] created paths of %d folders (%" G_GSIZE_FORMAT " bytes) in %f s",
+                darray_get_num_items(folders),
+                db->folder_paths->buffer->len,
+                g_timer_elapsed(timer, NULL));
+    }
+    return db_folder_paths_ref(db->folder_paths);
+}
+
+FsearchDatabaseFolderPaths *
+db_get_folder_paths(FsearchDatabase *db) {
+    g_assert(db);
+    g_rec_mutex_lock(&db->cache_mutex);
+    FsearchDatabaseFolderPaths *folder_paths = db_get_folder_paths_unlocked(db);
+    g_rec_mutex_unlock(&db->cache_mutex);
+    return folder_paths;
+}
+
+static FsearchDatabaseExtensions *
+db_get_extensions_unlocked(FsearchDatabase *db) {
+    g_assert(db);
+    return db_extensions_ref(db_ensure_extensions(db));
+}
+
+FsearchDatabaseExtensions *
+db_get_extensions(FsearchDatabase *db) {
+    g_assert(db);
+    g_rec_mutex_lock(&db->cache_mutex);
+    FsearchDatabaseExtensions *extensions = db_get_extensions_unlocked(db);
+    g_rec_mutex_unlock(&db->cache_mutex);
+    return extensions;
+}
+
+static gpointer
+db_duplicates_job_thread(gpointer data) {
+    DatabaseDuplicatesJob *job = data;
+    // it only competes with the other readers of the disk, the threads it starts inherit that
+    thread_lower_priority();
+    g_autoptr(GTimer) timer = g_timer_new();
+    FsearchDuplicates *result = fsearch_duplicates_find_in_snapshot(g_steal_pointer(&job->snapshot), job->cancellable);
+    if (result) {
+        FsearchDuplicatesStats stats = {};
+        fsearch_duplicates_get_stats(result, &stats);
+        g_debug("[db_get_duplicates] found %d groups of %d files among %d candidates (%d hashes from the cache) in %f s",
+                fsearch_duplicates_get_num_groups(result),
+                fsearch_duplicates_get_num_files(result),
+                stats.num_candidates,
+                stats.num_cache_hits,
+                g_timer_elapsed(timer, NULL));
+    }
+
+    FsearchDatabase *db = job->db;
+    g_mutex_lock(&db->duplicates_mutex);
+    job->result = result;
+    job->done = true;
+    g_cond_broadcast(&db->duplicates_cond);
+    g_mutex_unlock(&db->duplicates_mutex);
+
+    // also when it got cancelled, the searches which still wait for duplicates start another job then
+    if (job->found_func) {
+        job->found_func(job->found_func_data);
+    }
+    return NULL;
+}
+
+static void
+db_duplicates_job_free(DatabaseDuplicatesJob *job) {
+    g_cancellable_cancel(job->cancellable);
+    g_thread_join(job->thread);
+    g_clear_pointer(&job->snapshot, fsearch_duplicates_snapshot_free);
+    g_clear_pointer(&job->result, fsearch_duplicates_unref);
+    g_clear_object(&job->cancellable);
+    g_clear_pointer(&job, free);
+}
+
+// Takes the paths and sizes of the files which could be duplicates and starts looking for them, the cache mutex and
+// the lock or the shared lock must be held
+static void
+db_start_duplicates_job(FsearchDatabase *db) {
+    DynamicArray *files_by_size = NULL;
+    if (db_has_entries_sorted_by_type(db, DATABASE_INDEX_TYPE_SIZE)) {
+        files_by_size = darray_ref(db->sorted_files[DATABASE_INDEX_TYPE_SIZE]);
+    }
+    else {
+        files_by_size = darray_copy(db->sorted_files[DATABASE_INDEX_TYPE_NAME]);
+        darray_sort_multi_threaded(files_by_size,
+                                   (DynamicArrayCompareDataFunc)db_entry_compare_entries_by_size,
+                                   NULL,
+                                   NULL);
+    }
+
+    DatabaseDuplicatesJob *job = calloc(1, sizeof(DatabaseDuplicatesJob));
+    g_assert(job);
+    job->db = db;
+    job->snapshot = fsearch_duplicates_snapshot_new(files_by_size);
+    job->cancellable = g_cancellable_new();
+    job->found_func = db->duplicates_found_func;
+    job->found_func_data = db->duplicates_found_func_data;
+    g_clear_pointer(&files_by_size, darray_unref);
+
+    g_mutex_lock(&db->duplicates_mutex);
+    job->thread = g_thread_new("fsearch_duplicates", db_duplicates_job_thread, job);
+    db->duplicates_job = job;
+    g_mutex_unlock(&db->duplicates_mutex);
+}
+
+// Takes over what the job found once it's done, unless the entries changed in the meantime. The cache mutex and the
+// lock or the shared lock must be held.
+static void
+db_finish_duplicates_job(FsearchDatabase *db) {
+    DatabaseDuplicatesJob *job = db->duplicates_job;
+    if (!job) {
+        return;
+    }
+    g_mutex_lock(&db->duplicates_mutex);
+    const bool done = job->done;
+    if (done) {
+        db->duplicates_job = NULL;
+    }
+    g_mutex_unlock(&db->duplicates_mutex);
+    if (!done) {
+        return;
+    }
+    if (!g_cancellable_is_cancelled(job->cancellable)) {
+        g_clear_pointer(&db->duplicates, fsearch_duplicates_unref);
+        db->duplicates = g_steal_pointer(&job->result);
+    }
+    g_clear_pointer(&job, db_duplicates_job_free);
+}
+
+FsearchDuplicates *
+db_get_duplicates(FsearchDatabase *db, bool *pending) {
+    g_assert(db);
+    g_assert(pending);
+    g_rec_mutex_lock(&db->cache_mutex);
+    db_finish_duplicates_job(db);
+    const bool has_files = db->sorted_files[DATABASE_INDEX_TYPE_NAME] != NULL;
+    // the sizes aren't known before the metadata is loaded
+    if (!db->duplicates && has_files && !db->metadata_pending && !db->duplicates_job) {
+        db_start_duplicates_job(db);
+    }
+    *pending = !db->duplicates && has_files;
+    FsearchDuplicates *duplicates = db->duplicates ? fsearch_duplicates_ref(db->duplicates) : NULL;
+    g_rec_mutex_unlock(&db->cache_mutex);
+    return duplicates;
+}
+
+void
+db_wait_for_duplicates(FsearchDatabase *db) {
+    g_assert(db);
+    while (true) {
+        db_lock_shared(db);
+        bool pending = false;
+        FsearchDuplicates *duplicates = db_get_duplicates(db, &pending);
+        g_clear_pointer(&duplicates, fsearch_duplicates_unref);
+        g_mutex_lock(&db->duplicates_mutex);
+        DatabaseDuplicatesJob *job = db->duplicates_job;
+        db_unlock_shared(db);
+        if (!pending || !job) {
+            g_mutex_unlock(&db->duplicates_mutex);
+            return;
+        }
+        // a job which got cancelled is taken over by the next call, which starts another one
+        while (db->duplicates_job == job && !job->done) {
+            g_cond_wait(&db->duplicates_cond, &db->duplicates_mutex);
+        }
+        g_mutex_unlock(&db->duplicates_mutex);
+    }
+}
+
+void
+db_set_duplicates_found_func(FsearchDatabase *db, void (*found_func)(gpointer), gpointer user_data) {
+    g_assert(db);
+    db->duplicates_found_func = found_func;
+    db->duplicates_found_func_data = user_data;
+}
+
+static FsearchDatabaseFoldedNames *
+db_get_folded_names_unlocked(FsearchDatabase *db) {
+    g_assert(db);
+
+    DynamicArray *folders = db->sorted_folders[DATABASE_INDEX_TYPE_NAME];
+    DynamicArray *files = db->sorted_files[DATABASE_INDEX_TYPE_NAME];
+    if (!folders || !files) {
+        return NULL;
+    }
+    db_load_pending_folded_names(db);
+    if (!db->folded_names || db->folded_names->folders != folders || db->folded_names->files != files
+        || db->folded_names->fold_options != fsearch_utf_get_fold_options()) {
+        g_autoptr(GTimer) timer = g_timer_new();
+        FsearchDatabaseFoldedNames *names = db_fold_names(db, folders, files, db->folded_names);
+        g_clear_pointer(&db->folded_names, db_folded_names_unref);
+        db->folded_names = names;
+        // the names are looked up by the index of the entries, which has to be their position in the name arrays
+        db_entry_update_folder_indices(db);
+        db_entry_update_file_indices(db);
+        g_debug("[db_get_folded_names] folded the names of %d entries in %f s",
+                darray_get_num_items(folders) + darray_get_num_items(files),
+                g_timer_elapsed(timer, NULL));
+    }
+    return db_folded_names_ref(db->folded_names);
+}
+
+FsearchDatabaseFoldedNames *
+db_get_folded_names(FsearchDatabase *db) {
+    g_assert(db);
+    g_rec_mutex_lock(&db->cache_mutex);
+    FsearchDatabaseFoldedNames *folded_names = db_get_folded_names_unlocked(db);
+    g_rec_mutex_unlock(&db->cache_mutex);
+    return folded_names;
+}
+
+static FsearchDatabaseTrigrams *
+db_get_trigrams_unlocked(FsearchDatabase *db) {
+    g_assert(db);
+
+    DynamicArray *folders = db->sorted_folders[DATABASE_INDEX_TYPE_NAME];
+    DynamicArray *files = db->sorted_files[DATABASE_INDEX_TYPE_NAME];
+    if (!db->trigram_index || db->memory_budget > 0 || !folders || !files) {
+        return NULL;
+    }
+    db_load_pending_trigrams(db);
+    if (!db->trigrams || db->trigrams->folders != folders || db->trigrams->files != files) {
+        g_autoptr(GTimer) timer = g_timer_new();
+        g_clear_pointer(&db->trigrams, db_trigrams_unref);
+        db->trigrams = db_trigrams_new(folders, files, db->thread_pool);
+        g_debug("[db_get_trigrams] indexed the trigrams of %d entries in %f s",
+                darray_get_num_items(folders) + darray_get_num_items(files),
+                g_timer_elapsed(timer, NULL));
+    }
+    return db_trigrams_ref(db->trigrams);
+}
+
+FsearchDatabaseTrigrams *
+db_get_trigrams(FsearchDatabase *db) {
+    g_assert(db);
+    g_rec_mutex_lock(&db->cache_mutex);
+    FsearchDatabaseTrigrams *trigrams = db_get_trigrams_unlocked(db);
+    g_rec_mutex_unlock(&db->cache_mutex);
+    return trigrams;
+}
+
+FsearchDatabaseMetadata *
+db_get_metadata(FsearchDatabase *db) {
+    g_assert(db);
+    g_rec_mutex_lock(&db->cache_mutex);
+    FsearchDatabaseMetadata *metadata = db->metadata;
+    if (metadata && (metadata->folders != db->sorted_folders[DATABASE_INDEX_TYPE_NAME]
+                     || metadata->files != db->sorted_files[DATABASE_INDEX_TYPE_NAME])) {
+        metadata = NULL;
+    }
+    metadata = metadata ? db_metadata_ref(metadata) : NULL;
+    g_rec_mutex_unlock(&db->cache_mutex);
+    return metadata;
+}
+
+static DatabaseSearchFilterMatches *
+db_get_filter_matches_unlocked(FsearchDatabase *db, FsearchQuery *query, GCancellable *cancellable) {
+    g_assert(db);
+    g_assert(query);
+
+    DynamicArray *folders = db->sorted_folders[DATABASE_INDEX_TYPE_NAME];
+    DynamicArray *files = db->sorted_files[DATABASE_INDEX_TYPE_NAME];
+    if (!query->compiled_filter || !query->filter_program || !folders || !files) {
+        return NULL;
+    }
+    for (uint32_t i = 0; i < db->filter_matches->len; i++) {
+        DatabaseSearchFilterMatches *matches = g_ptr_array_index(db->filter_matches, i);
+        if (matches->filter == query->compiled_filter && matches->folders == folders && matches->files == files) {
+            // it's the most recent one now
+            for (uint32_t j = i; j + 1 < db->filter_matches->len; j++) {
+                db->filter_matches->pdata[j] = db->filter_matches->pdata[j + 1];
+            }
+            db->filter_matches->pdata[db->filter_matches->len - 1] = matches;
+            return db_search_filter_matches_ref(matches);
+        }
+    }
+
+    g_autoptr(GTimer) timer = g_timer_new();
+    FsearchDatabaseColumns *folder_columns = query->wants_columns ? db_get_columns(db, folders) : NULL;
+    FsearchDatabaseColumns *file_columns = query->wants_columns ? db_get_columns(db, files) : NULL;
+    FsearchDatabaseFolderPaths *folder_paths = query->wants_folder_paths ? db_get_folder_paths(db) : NULL;
+    FsearchDatabaseFoldedNames *folded_names = query->wants_folded_names ? db_get_folded_names(db) : NULL;
+    FsearchDatabaseExtensions *extensions = query->wants_extensions ? db_get_extensions(db) : NULL;
+    FsearchDatabaseMetadata *metadata = query->wants_metadata ? db_get_metadata(db) : NULL;
+    DatabaseSearchFilterMatches *matches = db_search_filter_matches_new(query,
+                                                                        db->thread_pool,
+                                                                        folders,
+                                                                        files,
+                                                                        folder_columns,
+                                                                        file_columns,
+                                                                        folder_paths,
+                                                                        folded_names,
+                                                                        extensions,
+                                                                        metadata,
+                                                                        cancellable);
+    g_clear_pointer(&metadata, db_metadata_unref);
+    g_clear_pointer(&folder_columns, db_columns_unref);
+    g_clear_pointer(&file_columns, db_columns_unref);
+    g_clear_pointer(&folder_paths, db_folder_paths_unref);
+    g_clear_pointer(&folded_names, db_folded_names_unref);
+    g_clear_pointer(&extensions, db_extensions_unref);
+    if (!matches) {
+        return NULL;
+    }
+    // searches in other sort orders look up the entries by their index, which has to be their position in the name
+    // arrays
+    db_entry_update_folder_indices(db);
+    db_entry_update_file_indices(db);
+
+    if (db->filter_matches->len >= MAX_CACHED_FILTER_MATCHES) {
+        g_ptr_array_remove_index(db->filter_matches, 0);
+    }
+    g_ptr_array_add(db->filter_matches, db_search_filter_matches_ref(matches));
+    g_debug("[db_get_filter_matches] matched the filter against %d entries in %f s",
+            darray_get_num_items(folders) + darray_get_num_items(files),
+            g_timer_elapsed(timer, NULL));
+    return matches;
+}
+
+DatabaseSearchFilterMatches *
+db_get_filter_matches(FsearchDatabase *db, FsearchQuery *query, GCancellable *cancellable) {
+    g_assert(db);
+    g_rec_mutex_lock(&db->cache_mutex);
+    DatabaseSearchFilterMatches *matches = db_get_filter_matches_unlocked(db, query, cancellable);
+    g_rec_mutex_unlock(&db->cache_mutex);
+    return matches;
+}
+
+FsearchDatabaseSearchCache *
+db_get_search_cache(FsearchDatabase *db) {
+    g_assert(db);
+    return db->search_cache;
+}
+
+DatabaseSearchResult *
+db_search_query(FsearchDatabase *db,
+                FsearchQuery *query,
+                FsearchThreadPool *pool,
+                DynamicArray *folders,
+                DynamicArray *files,
+                FsearchDatabaseIndexType sort_order,
+                bool is_refinement,
+                DatabaseSearchProgressFunc progress_func,
+                gpointer progress_func_data,
+                GCancellable *cancellable) {
+    g_assert(db);
+    g_assert(query);
+
+    FsearchDatabaseColumns *folder_columns = NULL;
+    FsearchDatabaseColumns *file_columns = NULL;
+    FsearchDatabaseFolderPaths *folder_paths = NULL;
+    FsearchDatabaseFoldedNames *folded_names = NULL;
+    FsearchDatabaseExtensions *extensions = NULL;
+    FsearchDatabaseMetadata *metadata = NULL;
+    FsearchDatabaseTrigrams *trigrams = NULL;
+    FsearchDuplicates *duplicates = NULL;
+    if (query->wants_duplicates) {
+        bool duplicates_pending = false;
+        duplicates = db_get_duplicates(db, &duplicates_pending);
+        if (duplicates_pending) {
+            // which files dupe: matches isn't known yet, the caller gets told instead of getting no results
+            DatabaseSearchResult *result = calloc(1, sizeof(DatabaseSearchResult));
+            g_assert(result);
+            result->folders = darray_new(0);
+            result->files = darray_new(0);
+            result->sort_type = sort_order;
+            result->duplicates_pending = true;
+            return result;
+        }
+        fsearch_query_set_duplicates(query, duplicates);
+    }
+    // the columns only exist for the arrays of the database
+    if (query->wants_columns && folders && files && !is_refinement) {
+        folder_columns = db_get_columns(db, folders);
+        file_columns = db_get_columns(db, files);
+    }
+    if (query->wants_folder_paths) {
+        folder_paths = db_get_folder_paths(db);
+    }
+    if (query->wants_folded_names) {
+        folded_names = db_get_folded_names(db);
+    }
+    if (query->wants_extensions) {
+        extensions = db_get_extensions(db);
+    }
+    if (query->wants_metadata) {
+        metadata = db_get_metadata(db);
+    }
+    if (query->wants_trigrams && !is_refinement) {
+        trigrams = db_get_trigrams(db);
+    }
+    // only the results of a previous search aren't part of the database arrays
+    DatabaseSearchSortedEntries sorted_entries = {0};
+    const bool wants_sorted_entries = query->wants_sorted_entries && !is_refinement;
+    if (wants_sorted_entries) {
+        const FsearchDatabaseIndexType types[] = {DATABASE_INDEX_TYPE_NAME,
+                                                  DATABASE_INDEX_TYPE_SIZE,
+                                                  DATABASE_INDEX_TYPE_MODIFICATION_TIME};
+        for (uint32_t i = 0; i < G_N_ELEMENTS(types); i++) {
+            FsearchDatabaseIndexType type = types[i];
+            DynamicArray *sorted_folders = NULL;
+            DynamicArray *sorted_files = NULL;
+            if (db_get_entries_sorted(db, types[i], &type, &sorted_folders, &sorted_files) && type != types[i]) {
+                // the database isn't sorted by this attribute
+                g_clear_pointer(&sorted_folders, darray_unref);
+                g_clear_pointer(&sorted_files, darray_unref);
+            }
+            sorted_entries.folders[types[i]] = sorted_folders;
+            sorted_entries.files[types[i]] = sorted_files;
+        }
+    }
+    // switching between filters only has to match each of them once
+    const gint64 filter_start = g_get_monotonic_time();
+    DatabaseSearchFilterMatches *filter_matches = db_get_filter_matches(db, query, cancellable);
+    const double filter_time = (double)(g_get_monotonic_time() - filter_start) / 1000;
+    DatabaseSearchResult *result = db_search(query,
+                                             pool,
+                                             folders,
+                                             files,
+                                             folder_columns,
+                                             file_columns,
+                                             folder_paths,
+                                             folded_names,
+                                             extensions,
+                                             metadata,
+                                             trigrams,
+                                             wants_sorted_entries ? &sorted_entries : NULL,
+                                             filter_matches,
+                                             sort_order,
+                                             // partial results would show the entries which get filtered out
+                                             db->access_filter ? NULL : progress_func,
+                                             progress_func_data,
+                                             cancellable);
+    if (result) {
+        result->stats.filter_time = filter_time;
+        db_filter_result_by_access(db, result);
+    }
+    g_clear_pointer(&folder_columns, db_columns_unref);
+    g_clear_pointer(&file_columns, db_columns_unref);
+    g_clear_pointer(&folder_paths, db_folder_paths_unref);
+    g_clear_pointer(&folded_names, db_folded_names_unref);
+    g_clear_pointer(&extensions, db_extensions_unref);
+    g_clear_pointer(&metadata, db_metadata_unref);
+    g_clear_pointer(&trigrams, db_trigrams_unref);
+    g_clear_pointer(&duplicates, fsearch_duplicates_unref);
+    g_clear_pointer(&filter_matches, db_search_filter_matches_unref);
+    db_search_sorted_entries_clear(&sorted_entries);
+    return result;
+}
+
+DynamicArray *
+db_get_folders_sorted(FsearchDatabase *db, FsearchDatabaseIndexType sort_type) {
+    g_assert(db);
+    if (!is_valid_sort_type(sort_type)) {
+        return NULL;
+    }
+
+    DynamicArray *folders = db->sorted_folders[sort_type];
+    return darray_ref(folders);
+}
+
+DynamicArray *
+db_get_files_sorted(FsearchDatabase *db, FsearchDatabaseIndexType sort_type) {
+    g_assert(db);
+    if (!is_valid_sort_type(sort_type)) {
+        return NULL;
+    }
+
+    DynamicArray *files = db->sorted_files[sort_type];
+    return darray_ref(files);
+}
+
+static bool
+db_can_sort_by_type(FsearchDatabase *db, FsearchDatabaseIndexType sort_type) {
+    switch (sort_type) {
+    case DATABASE_INDEX_TYPE_PATH:
+    case DATABASE_INDEX_TYPE_EXTENSION:
+    case DATABASE_INDEX_TYPE_FILETYPE:
+        return true;
+    case DATABASE_INDEX_TYPE_SIZE:
+        return (db->index_flags & DATABASE_INDEX_FLAG_SIZE) != 0;
+    case DATABASE_INDEX_TYPE_MODIFICATION_TIME:
+        return (db->index_flags & DATABASE_INDEX_FLAG_MODIFICATION_TIME) != 0;
+    default:
+        return false;
+    }
+}
+
+static DynamicArray *
+db_get_entries_sorted_on_demand(FsearchDatabase *db,
+                                FsearchDatabaseIndexType sort_type,
+                                bool is_folder,
+                                GCancellable *cancellable) {
+    DynamicArray *entries =
+        is_folder ? db->sorted_folders[DATABASE_INDEX_TYPE_NAME] : db->sorted_files[DATABASE_INDEX_TYPE_NAME];
+    if (is_folder && (sort_type == DATABASE_INDEX_TYPE_EXTENSION || sort_type == DATABASE_INDEX_TYPE_FILETYPE)) {
+        // Folders don't have a file extension and all have the same type -> use the name array instead
+        return darray_ref(entries);
+    }
+
+    const uint32_t id = (is_folder ? DATABASE_SECTION_SORTED_FOLDERS : DATABASE_SECTION_SORTED_FILES) | sort_type;
+    if (db_get_pending_sorted_section(db, id, darray_get_num_items(entries))) {
+        DatabaseFileMapping mapping = {};
+        db_file_mapping_init_from_contents(db->file_contents, &mapping);
+        DynamicArray *sorted_entries = db_load_mapped_sorted_entries(&mapping, id, entries);
+        if (sorted_entries) {
+            return sorted_entries;
+        }
+    }
+
+    if (sort_type == DATABASE_INDEX_TYPE_EXTENSION) {
+        return db_extensions_sort_files(db_ensure_extensions(db));
+    }
+    if (sort_type == DATABASE_INDEX_TYPE_FILETYPE) {
+        // looking up the types is too expensive to repeat after every start, so the order gets saved
+        db->sorted_arrays_changed = true;
+        return db_file_types_sort_files(db_ensure_file_types(db));
+    }
+
+    db_load_pending_metadata(db);
+    DynamicArray *sorted_entries = darray_copy(entries);
+    db_sort_array_by_type(db, sorted_entries, sort_type, cancellable);
+    if (is_cancelled(cancellable)) {
+        g_clear_pointer(&sorted_entries, darray_unref);
+    }
+    return sorted_entries;
+}
+
+bool
+db_ensure_entries_sorted(FsearchDatabase *db, FsearchDatabaseIndexType sort_type, GCancellable *cancellable) {
+    g_assert(db);
+
+    if (!is_valid_sort_type(sort_type) || db_has_entries_sorted_by_type(db, sort_type)) {
+        return is_valid_sort_type(sort_type);
+    }
+    if (!db_can_sort_by_type(db, sort_type) || !db->sorted_files[DATABASE_INDEX_TYPE_NAME]
+        || !db->sorted_folders[DATABASE_INDEX_TYPE_NAME]) {
+        return false;
+    }
+
+    if (db->memory_budget > 0 && sort_type != DATABASE_INDEX_TYPE_NAME) {
+        // the low memory mode doesn't keep another copy of all entries, views sort their results instead
+        return false;
+    }
+
+    g_autoptr(GTimer) timer = g_timer_new();
+    DynamicArray *folders = db_get_entries_sorted_on_demand(db, sort_type, true, cancellable);
+    DynamicArray *files = folders ? db_get_entries_sorted_on_demand(db, sort_type, false, cancellable) : NULL;
+    if (!folders || !files) {
+        g_clear_pointer(&folders, darray_unref);
+        return false;
+    }
+    g_clear_pointer(&db->sorted_folders[sort_type], darray_unref);
+    g_clear_pointer(&db->sorted_files[sort_type], darray_unref);
+    db->sorted_folders[sort_type] = folders;
+    db->sorted_files[sort_type] = files;
+    g_debug("[db_sort] built sort order %d on demand in %f s", sort_type, g_timer_elapsed(timer, NULL));
+    return true;
+}
+
+// The orders db_sort builds along with the name order, unless they're left to db_load_remaining
+static bool
+db_is_sorted_after_scan(FsearchDatabase *db, FsearchDatabaseIndexType sort_type) {
+    switch (sort_type) {
+    case DATABASE_INDEX_TYPE_SIZE:
+    case DATABASE_INDEX_TYPE_MODIFICATION_TIME:
+        return db_can_sort_by_type(db, sort_type);
+    case DATABASE_INDEX_TYPE_EXTENSION:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool
+db_has_pending_sorted_sections(FsearchDatabase *db, FsearchDatabaseIndexType sort_type) {
+    return db_get_pending_sorted_section(db, DATABASE_SECTION_SORTED_FOLDERS | sort_type, db_get_num_folders(db))
+        && db_get_pending_sorted_section(db, DATABASE_SECTION_SORTED_FILES | sort_type, db_get_num_files(db));
+}
+
+static void
+db_load_pending_sorted_sections(FsearchDatabase *db) {
+    for (uint32_t type = DATABASE_INDEX_TYPE_NAME + 1; type < NUM_DATABASE_INDEX_TYPES; type++) {
+        if (!db_has_entries_sorted_by_type(db, type) && db_has_pending_sorted_sections(db, type)) {
+            db_ensure_entries_sorted(db, type, NULL);
+        }
+    }
+}
+
+bool
+db_load_remaining(FsearchDatabase *db, GCancellable *cancellable) {
+    g_assert(db);
+
+    db_lock(db);
+    bool loaded = db->metadata_pending;
+    db_load_pending_metadata(db);
+    db_unlock(db);
+
+    // one sort order at a time, so searches don't have to wait for all of them
+    for (uint32_t type = DATABASE_INDEX_TYPE_NAME + 1;
+         type < NUM_DATABASE_INDEX_TYPES && !db_sorts_lazily(db) && !is_cancelled(cancellable);
+         type++) {
+        db_lock(db);
+        if (!db_has_entries_sorted_by_type(db, type) && db_has_pending_sorted_sections(db, type)) {
+            loaded |= db_ensure_entries_sorted(db, type, cancellable);
+        }
+        else if (!db_has_entries_sorted_by_type(db, type) && db->sort_orders_pending
+                 && db_is_sorted_after_scan(db, type) && db_ensure_entries_sorted(db, type, cancellable)) {
+            // the database file might have been saved without it
+            db->sorted_arrays_changed = true;
+            loaded = true;
+        }
+        db_unlock(db);
+    }
+    if (!is_cancelled(cancellable)) {
+        db_lock(db);
+        db->sort_orders_pending = false;
+        db_unlock(db);
+    }
+    return loaded;
+}
+
+// Merges the sort orders which both have, the others are sorted again when they're needed. The entries of an empty
+// database are merged as if it had all sort orders.
+static void
+db_merge_segment_entries(DynamicArray **sorted_entries, DynamicArray **segment_entries, bool is_empty, bool is_folder) {
+    DynamicArray *empty = darray_new(1);
+    for (FsearchDatabaseIndexType type = 0; type < NUM_DATABASE_INDEX_TYPES; type++) {
+        DynamicArray *entries = sorted_entries[type] ? sorted_entries[type] : is_empty ? empty : NULL;
+        DynamicArrayCompareDataFunc compare_func = db_get_compare_func(type);
+        DynamicArray *merged = NULL;
+        if (is_folder && (type == DATABASE_INDEX_TYPE_EXTENSION || type == DATABASE_INDEX_TYPE_FILETYPE)) {
+            // Folders don't have a file extension or type, this is just a reference to the name array
+            merged = entries && segment_entries[type] ? darray_ref(sorted_entries[DATABASE_INDEX_TYPE_NAME]) : NULL;
+        }
+        else if (entries && segment_entries[type] && compare_func) {
+            merged = db_merge_changes(entries, segment_entries[type], compare_func, false);
+        }
+        g_clear_pointer(&sorted_entries[type], darray_unref);
+        sorted_entries[type] = merged;
+    }
+    g_clear_pointer(&empty, darray_unref);
+}
+
+bool
+db_add_segment(FsearchDatabase *db, const char *file_path) {
+    g_assert(db);
+    g_assert(file_path);
+
+    g_autoptr(GTimer) timer = g_timer_new();
+    FsearchDatabase *segment = db_new(NULL, NULL, NULL, false);
+    if (!db_load(segment, file_path, NULL) || !segment->sorted_folders[DATABASE_INDEX_TYPE_NAME]
+        || !segment->sorted_files[DATABASE_INDEX_TYPE_NAME]) {
+        g_debug("[db_segment] failed to load: %s", file_path);
+        g_clear_pointer(&segment, db_unref);
+        return false;
+    }
+
+    // everything which refers to the entries by their position in the name arrays has to be built again
+    db_load_pending_metadata(db);
+    if (!db_sorts_lazily(db)) {
+        db_load_pending_sorted_sections(db);
+    }
+    db->sorted_sections_pending = false;
+    db_load_pending_folded_names(db);
+    g_clear_pointer(&db->trigrams, db_trigrams_unref);
+    db->trigrams_pending = false;
+    db_clear_columns(db);
+
+    const bool is_empty = db_get_num_entries(db) == 0;
+    if (is_empty) {
+        db->index_flags = segment->index_flags;
+    }
+    else {
+        // sorting by what only some of the entries have doesn't make sense
+        db->index_flags &= segment->index_flags | DATABASE_INDEX_FLAG_NAME;
+    }
+
+    // the ids are only unique within the database file they were loaded from
+    DynamicArray *segment_folders = segment->sorted_folders[DATABASE_INDEX_TYPE_NAME];
+    for (uint32_t i = 0; i < darray_get_num_items(segment_folders); i++) {
+        db_entry_folder_set_id(darray_get_item(segment_folders, i), 0);
+    }
+    db_assign_folder_ids(db, segment_folders);
+    DynamicArray *folder_arrays[] = {db->sorted_folders[DATABASE_INDEX_TYPE_NAME], segment_folders};
+    db_update_folder_ranks(folder_arrays, G_N_ELEMENTS(folder_arrays));
+
+    db_merge_segment_entries(db->sorted_folders, segment->sorted_folders, is_empty, true);
+    db_merge_segment_entries(db->sorted_files, segment->sorted_files, is_empty, false);
+    FsearchDatabaseMetadata *metadata_sources[] = {db->metadata, segment->metadata};
+    db_update_metadata(db, metadata_sources, G_N_ELEMENTS(metadata_sources));
+    db_entry_update_folder_indices(db);
+    db_entry_update_file_indices(db);
+
+    if (!db->segments) {
+        db->segments = g_ptr_array_new_with_free_func((GDestroyNotify)db_unref);
+    }
+    g_ptr_array_add(db->segments, segment);
+
+    g_debug("[db_segment] added %d folders and %d files of %s in %f s",
+            db_get_num_folders(segment),
+            db_get_num_files(segment),
+            file_path,
+            g_timer_elapsed(timer, NULL));
+    return true;
+}
+
+uint32_t
+db_add_segments(FsearchDatabase *db, char **file_paths) {
+    g_assert(db);
+
+    uint32_t num_added = 0;
+    for (uint32_t i = 0; file_paths && file_paths[i]; i++) {
+        if (file_paths[i][0] == '\0') {
+            continue;
+        }
+        // the database can be searched in between
+        db_lock(db);
+        if (db_add_segment(db, file_paths[i])) {
+            num_added++;
+        }
+        db_unlock(db);
+    }
+    return num_added;
+}
+
+uint32_t
+db_get_num_segments(FsearchDatabase *db) {
+    g_assert(db);
+    return db->segments ? db->segments->len : 0;
+}
+
+void
+db_set_entries_sorted(FsearchDatabase *db, FsearchDatabaseIndexType sort_type, DynamicArray *files) {
+    g_assert(db);
+    g_assert(files);
+    g_return_if_fail(sort_type == DATABASE_INDEX_TYPE_FILETYPE);
+
+    if (!db->sorted_files[DATABASE_INDEX_TYPE_NAME] || !db->sorted_folders[DATABASE_INDEX_TYPE_NAME]
+        || darray_get_num_items(files) != db_get_num_files(db) || db->memory_budget > 0) {
+        return;
+    }
+    g_clear_pointer(&db->sorted_files[sort_type], darray_unref);
+    g_clear_pointer(&db->sorted_folders[sort_type], darray_unref);
+    db->sorted_files[sort_type] = darray_ref(files);
+    // all folders have the same type, so they're ordered by name
+    db->sorted_folders[sort_type] = darray_ref(db->sorted_folders[DATABASE_INDEX_TYPE_NAME]);
+    db->sorted_arrays_changed = true;
+}
+
+DynamicArray *
+db_get_files(FsearchDatabase *db) {
+    g_assert(db);
+    return db_get_files_sorted(db, DATABASE_INDEX_TYPE_NAME);
+}
+
+DynamicArray *
+db_get_folders(FsearchDatabase *db) {
+    g_assert(db);
+    return db_get_folders_sorted(db, DATABASE_INDEX_TYPE_NAME);
+}
+
+FsearchThreadPool *
+db_get_thread_pool(FsearchDatabase *db) {
+    g_assert(db);
+    return db->thread_pool;
+}
+
+// names is NULL if the names of the previous database are shared
+static FsearchDatabaseEntry *
+db_entry_copy_to_pool(FsearchMemoryPool *pool, FsearchStringArena *names, FsearchDatabaseEntry *entry) {
+    FsearchDatabaseEntry *copy = fsearch_memory_pool_malloc(pool);
+    if (names) {
+        // the name belongs to the previous database
+        db_entry_set_name_in_arena(copy, names, db_entry_get_name_raw(entry));
+    }
+    else {
+        db_entry_set_name_borrowed(copy, db_entry_get_name_raw(entry));
+    }
+    db_entry_set_type(copy, db_entry_get_type(entry));
+    db_entry_set_size(copy, db_entry_get_size(entry));
+    db_entry_set_mtime(copy, db_entry_get_mtime(entry));
+    return copy;
+}
+
+static DynamicArray *
+db_copy_sorted_entries(DynamicArray *entries, GHashTable *copies, uint32_t num_copies) {
+    DynamicArray *copied_entries = darray_new(MAX(num_copies, 128));
+    const uint32_t num_entries = entries ? darray_get_num_items(entries) : 0;
+    for (uint32_t i = 0; i < num_entries; i++) {
+        FsearchDatabaseEntry *copy = g_hash_table_lookup(copies, darray_get_item(entries, i));
+        if (copy) {
+            darray_add_item(copied_entries, copy);
+        }
+    }
+    return copied_entries;
+}
+
+// Whether a rescan can share the names of previous. They're copied once most of the names it stores aren't in use
+// anymore, otherwise every rescan would keep the names of everything that was ever removed.
+static bool
+db_can_share_names(FsearchDatabase *previous) {
+    if (previous->file_contents) {
+        // the names point into the loaded file, which holds everything else as well
+        return false;
+    }
+    size_t num_used = 0;
+    DynamicArray *arrays[] = {previous->sorted_folders[DATABASE_INDEX_TYPE_NAME],
+                              previous->sorted_files[DATABASE_INDEX_TYPE_NAME]};
+    for (uint32_t i = 0; i < G_N_ELEMENTS(arrays); i++) {
+        const uint32_t num_entries = arrays[i] ? darray_get_num_items(arrays[i]) : 0;
+        for (uint32_t j = 0; j < num_entries; j++) {
+            num_used += strlen(db_entry_get_name_raw(darray_get_item(arrays[i], j))) + 1;
+        }
+    }
+    const size_t num_stored = fsearch_string_arena_get_num_bytes(previous->names);
+    g_debug("[db_scan] %" G_GSIZE_FORMAT " of %" G_GSIZE_FORMAT " bytes of the previous names are in use",
+            num_used,
+            num_stored);
+    return num_used > 0 && num_used >= num_stored / 2;
+}
+
+// Indexes which have updates disabled are only scanned when they're requested explicitly
+// or can't be taken from the previous database
+static bool
+db_index_needs_scan(FsearchIndex *index, const char *index_path) {
+    return index_path ? strcmp(index->path, index_path) == 0 : index->update;
+}
+
+// The indexes which a rescan of index_path (or of all indexes which get updated, if it's NULL) doesn't scan again,
+// it takes them from the previous database if it can
+static GPtrArray *
+db_get_unscanned_indexes(FsearchDatabase *db, const char *index_path) {
+    GPtrArray *indexes = g_ptr_array_new();
+    for (GList *l = db->indexes; l != NULL; l = l->next) {
+        FsearchIndex *index = l->data;
+        if (index->path && index->enabled && !db_index_needs_scan(index, index_path)) {
+            g_ptr_array_add(indexes, index);
+        }
+    }
+    return indexes;
+}
 
-    DIR *dir = NULL;
-    if (!(dir = opendir(path->str))) {
-        g_debug("[db_scan] failed to open directory: %s", path->str);
-        return WALK_BADIO;
+// Copies all entries below the roots of indexes from previous and adds those indexes to
+// kept_indexes. The copies are added in the order of the sorted arrays of previous, so they only need to be merged
+// with the scanned entries later on instead of being sorted again.
+static void
+db_copy_index_entries(FsearchDatabase *db,
+                      FsearchDatabase *previous,
+                      GPtrArray *indexes,
+                      bool share_names,
+                      GHashTable *kept_indexes,
+                      DynamicArray **files,
+                      DynamicArray **folders) {
+    const FsearchDatabaseIndexFlags index_flags = db->index_flags;
+    DynamicArray *previous_folders = previous->sorted_folders[DATABASE_INDEX_TYPE_NAME];
+    DynamicArray *previous_files = previous->sorted_files[DATABASE_INDEX_TYPE_NAME];
+    if ((previous->index_flags & index_flags) != index_flags || !previous_folders || !previous_files) {
+        // the previous database lacks metadata we need
+        return;
     }
 
-    const int dir_fd = dirfd(dir);
+    const uint32_t num_previous_folders = darray_get_num_items(previous_folders);
+    g_autoptr(GPtrArray) previous_roots = g_ptr_array_new();
+    for (uint32_t i = 0; i < num_previous_folders; i++) {
+        FsearchDatabaseEntry *folder = darray_get_item(previous_folders, i);
+        if (!db_entry_get_parent(folder)) {
+            g_ptr_array_add(previous_roots, folder);
+        }
+    }
 
-    const double elapsed_seconds = g_timer_elapsed(walk_context->timer, NULL);
-    if (elapsed_seconds > 0.1) {
-        if (walk_context->status_cb) {
-            walk_context->status_cb(path->str);
+    g_autoptr(GHashTable) roots = g_hash_table_new(NULL, NULL);
+    for (uint32_t j = 0; j < indexes->len; j++) {
+        FsearchIndex *index = g_ptr_array_index(indexes, j);
+        const char *root_name = db_index_get_root_name(index);
+        for (uint32_t i = 0; i < previous_roots->len; i++) {
+            FsearchDatabaseEntry *root = g_ptr_array_index(previous_roots, i);
+            if (strcmp(db_entry_get_name_raw(root), root_name) == 0) {
+                g_hash_table_add(roots, root);
+                g_hash_table_add(kept_indexes, index);
+                FsearchIndex *previous_index = db_find_index(previous, index->path);
+                index->last_updated = previous_index ? previous_index->last_updated : previous->timestamp;
+                g_debug("[db_scan] keep index: %s", index->path);
+                break;
+            }
         }
-        g_timer_start(walk_context->timer);
+    }
+    const uint32_t num_roots = g_hash_table_size(roots);
+    if (num_roots == 0) {
+        return;
     }
 
-    FsearchDatabase *db = walk_context->db;
+    // previous entry -> copy
+    g_autoptr(GHashTable) copies = g_hash_table_new(NULL, NULL);
+    FsearchStringArena *names = share_names ? NULL : db->names;
 
-    struct dirent *dent = NULL;
-    while ((dent = readdir(dir))) {
-        if (walk_context->cancellable && g_cancellable_is_cancelled(walk_context->cancellable)) {
-            g_debug("[db_scan] cancelled");
-            g_clear_pointer(&dir, closedir);
-            return WALK_CANCEL;
+    folders[DATABASE_INDEX_TYPE_NAME] = darray_new(1024);
+    for (uint32_t i = 0; i < num_previous_folders; i++) {
+        FsearchDatabaseEntry *folder = darray_get_item(previous_folders, i);
+        FsearchDatabaseEntry *root = folder;
+        while (db_entry_get_parent(root)) {
+            root = (FsearchDatabaseEntry *)db_entry_get_parent(root);
         }
-        if (walk_context->exclude_hidden && dent->d_name[0] == '.') {
-            // file is dotfile, skip
-            // g_debug("[db_scan] exclude hidden: %s", dent->d_name);
+        if (!g_hash_table_contains(roots, root)) {
             continue;
         }
-        if (!strcmp(dent->d_name, ".") || !strcmp(dent->d_name, "..")) {
+        FsearchDatabaseEntry *copy = db_entry_copy_to_pool(db->folder_pool, names, folder);
+        db_entry_folder_set_id((FsearchDatabaseEntryFolder *)copy,
+                               db_entry_folder_get_id((FsearchDatabaseEntryFolder *)folder));
+        g_hash_table_insert(copies, folder, copy);
+        darray_add_item(folders[DATABASE_INDEX_TYPE_NAME], copy);
+    }
+    // link the copied folders, now that all of them exist
+    GHashTableIter iter;
+    gpointer folder = NULL;
+    gpointer copy = NULL;
+    g_hash_table_iter_init(&iter, copies);
+    while (g_hash_table_iter_next(&iter, &folder, &copy)) {
+        FsearchDatabaseEntryFolder *parent = db_entry_get_parent(folder);
+        db_entry_set_parent(copy, parent ? g_hash_table_lookup(copies, parent) : NULL);
+    }
+    const uint32_t num_folders = darray_get_num_items(folders[DATABASE_INDEX_TYPE_NAME]);
+
+    files[DATABASE_INDEX_TYPE_NAME] = darray_new(1024);
+    const uint32_t num_previous_files = darray_get_num_items(previous_files);
+    for (uint32_t i = 0; i < num_previous_files; i++) {
+        FsearchDatabaseEntry *file = darray_get_item(previous_files, i);
+        FsearchDatabaseEntryFolder *parent = g_hash_table_lookup(copies, db_entry_get_parent(file));
+        if (!parent) {
             continue;
         }
-        if (file_is_excluded(dent->d_name, db->exclude_files)) {
-            // g_debug("[db_scan] excluded: %s", dent->d_name);
+        FsearchDatabaseEntry *file_copy = db_entry_copy_to_pool(db->file_pool, names, file);
+        db_entry_set_parent(file_copy, parent);
+        g_hash_table_insert(copies, file, file_copy);
+        darray_add_item(files[DATABASE_INDEX_TYPE_NAME], file_copy);
+    }
+    const uint32_t num_files = darray_get_num_items(files[DATABASE_INDEX_TYPE_NAME]);
+
+    for (FsearchDatabaseIndexType type = 0; type < NUM_DATABASE_INDEX_TYPES; type++) {
+        if (type == DATABASE_INDEX_TYPE_NAME) {
             continue;
         }
+        if (previous->sorted_files[type]) {
+            files[type] = db_copy_sorted_entries(previous->sorted_files[type], copies, num_files);
+        }
+        // the extension array of folders is just a reference of the name array
+        if (previous->sorted_folders[type] && type != DATABASE_INDEX_TYPE_EXTENSION) {
+            folders[type] = db_copy_sorted_entries(previous->sorted_folders[type], copies, num_folders);
+        }
+    }
 
-        const size_t d_name_len = strlen(dent->d_name);
-        if (d_name_len >= 256) {
-            g_warning("[db_scan] file name too long, skipping: \"%s\" (len: %lu)", dent->d_name, d_name_len);
-            continue;
+    if (previous->metadata && db_has_metadata_columns(db)) {
+        // the copies get their metadata once the name arrays of db are complete
+        db_entry_update_folder_indices(previous);
+        db_entry_update_file_indices(previous);
+        FsearchDatabaseEntryMetadata values = {};
+        g_hash_table_iter_init(&iter, copies);
+        gpointer entry = NULL;
+        while (g_hash_table_iter_next(&iter, &entry, &copy)) {
+            if (db_metadata_lookup(previous->metadata, entry, &values)) {
+                db_add_metadata_record(db->metadata_records, copy, &values);
+            }
         }
+    }
 
-        // create full path of file/folder
-        g_string_truncate(path, path_len);
-        g_string_append(path, dent->d_name);
+    g_debug("[db_scan] kept %d files and %d folders of %d indexes", num_files, num_folders, num_roots);
+}
 
-        struct stat st;
-        int stat_flags = AT_SYMLINK_NOFOLLOW;
-#ifdef AT_NO_AUTOMOUNT
-        stat_flags |= AT_NO_AUTOMOUNT;
-#endif
-        if (fstatat(dir_fd, dent->d_name, &st, stat_flags)) {
-            g_debug("[db_scan] can't stat: %s", path->str);
-            continue;
+static void
+db_merge_index_entries(FsearchDatabase *db, DynamicArray **files, DynamicArray **folders) {
+    for (FsearchDatabaseIndexType type = 0; type < NUM_DATABASE_INDEX_TYPES; type++) {
+        DynamicArray **sorted_entries[2] = {&db->sorted_files[type], &db->sorted_folders[type]};
+        DynamicArray *kept_entries[2] = {files[type], folders[type]};
+        for (uint32_t i = 0; i < G_N_ELEMENTS(kept_entries); i++) {
+            if (!kept_entries[i] || !*sorted_entries[i]) {
+                continue;
+            }
+            DynamicArray *merged = db_merge_changes(*sorted_entries[i], kept_entries[i], db_get_compare_func(type), false);
+            darray_unref(*sorted_entries[i]);
+            *sorted_entries[i] = merged;
         }
+        g_clear_pointer(&files[type], darray_unref);
+        g_clear_pointer(&folders[type], darray_unref);
+    }
+    g_clear_pointer(&db->sorted_folders[DATABASE_INDEX_TYPE_EXTENSION], darray_unref);
+    db->sorted_folders[DATABASE_INDEX_TYPE_EXTENSION] = darray_ref(db->sorted_folders[DATABASE_INDEX_TYPE_NAME]);
+}
 
-        if (walk_context->one_filesystem && walk_context->root_device_id != st.st_dev) {
-            g_debug("[db_scan] different filesystem, skipping: %s", path->str);
-            continue;
-        }
+static bool
+db_scan_run(FsearchDatabase *db,
+            FsearchDatabase *previous,
+            bool incremental,
+            const char *index_path,
+            GCancellable *cancellable,
+            void (*status_cb)(const char *)) {
+    g_assert(db);
 
-        const bool is_dir = S_ISDIR(st.st_mode);
-        if (is_dir && directory_is_excluded(path->str, db->excludes)) {
-            g_debug("[db_scan] excluded directory: %s", path->str);
-            continue;
-        }
+    const gint64 start_time = g_get_monotonic_time();
 
-        if (is_dir) {
-            FsearchDatabaseEntry *entry = fsearch_memory_pool_malloc(db->folder_pool);
-            db_entry_set_name(entry, dent->d_name);
-            db_entry_set_type(entry, DATABASE_ENTRY_TYPE_FOLDER);
-            db_entry_set_mtime(entry, st.st_mtime);
-            db_entry_set_parent(entry, parent);
+    db_sorted_entries_free(db);
+    // everything which changes from now on will have a newer mtime
+    db_update_timestamp(db);
 
-            darray_add_item(db->sorted_folders[DATABASE_INDEX_TYPE_NAME], entry);
+    // names are always indexed, all other metadata only when requested
+    db->index_flags |= DATABASE_INDEX_FLAG_NAME;
 
-            db_folder_scan_recursive(walk_context, (FsearchDatabaseEntryFolder *)entry);
-        }
-        else {
-            FsearchDatabaseEntry *file_entry = fsearch_memory_pool_malloc(db->file_pool);
-            db_entry_set_name(file_entry, dent->d_name);
-            db_entry_set_size(file_entry, st.st_size);
-            db_entry_set_mtime(file_entry, st.st_mtime);
-            db_entry_set_type(file_entry, DATABASE_ENTRY_TYPE_FILE);
-            db_entry_set_parent(file_entry, parent);
-            db_entry_update_parent_size(file_entry);
+    db->sorted_files[DATABASE_INDEX_TYPE_NAME] = darray_new(1024);
+    db->sorted_folders[DATABASE_INDEX_TYPE_NAME] = darray_new(1024);
 
-            darray_add_item(db->sorted_files[DATABASE_INDEX_TYPE_NAME], file_entry);
+    if (previous == db) {
+        previous = NULL;
+    }
+
+    // the indexes which aren't scanned again are taken from the previous database as they are
+    DynamicArray *kept_files[NUM_DATABASE_INDEX_TYPES] = {};
+    DynamicArray *kept_folders[NUM_DATABASE_INDEX_TYPES] = {};
+    g_autoptr(GHashTable) kept_indexes = g_hash_table_new(NULL, NULL);
+    // the indexes whose scan timed out keep their entries of the previous database
+    DynamicArray *stale_files[NUM_DATABASE_INDEX_TYPES] = {};
+    DynamicArray *stale_folders[NUM_DATABASE_INDEX_TYPES] = {};
+
+    DatabaseScanReference *reference = NULL;
+    bool share_names = false;
+    if (previous) {
+        g_autoptr(GTimer) timer = g_timer_new();
+        db_lock(previous);
+        // the folders which are taken from previous keep their ids, all others get new ones
+        db->next_folder_id = MAX(db->next_folder_id, previous->next_folder_id);
+        // the kept entries are copied with their metadata
+        db_load_pending_metadata(previous);
+        // both databases use the same names for the entries which didn't change, instead of a copy each
+        share_names = db_can_share_names(previous);
+        if (share_names) {
+            fsearch_string_arena_share(db->names, previous->names);
+        }
+        g_autoptr(GPtrArray) unscanned_indexes = db_get_unscanned_indexes(db, index_path);
+        db_copy_index_entries(db, previous, unscanned_indexes, share_names, kept_indexes, kept_files, kept_folders);
+        if (incremental) {
+            reference = db_scan_reference_new(db, previous, share_names);
+        }
+        db_unlock(previous);
+        g_debug("[db_scan] prepared previous database in %f s", g_timer_elapsed(timer, NULL));
+    }
+
+    DatabaseScanContext *scan_context = db_scan_context_new(db, g_steal_pointer(&reference), cancellable, status_cb);
+
+    db_scan_roots(db, kept_indexes, scan_context);
+
+    // workers which got stuck hold on to the context, they must not report anything from now on
+    g_mutex_lock(&scan_context->status_mutex);
+    scan_context->finished = true;
+    g_mutex_unlock(&scan_context->status_mutex);
+
+    if (previous && scan_context->timed_out_indexes->len > 0 && !is_cancelled(cancellable)) {
+        db_lock(previous);
+        db_copy_index_entries(db,
+                              previous,
+                              scan_context->timed_out_indexes,
+                              share_names,
+                              kept_indexes,
+                              stale_files,
+                              stale_folders);
+        db_unlock(previous);
+        for (uint32_t i = 0; i < scan_context->timed_out_indexes->len; i++) {
+            FsearchIndex *index = g_ptr_array_index(scan_context->timed_out_indexes, i);
+            if (g_hash_table_contains(kept_indexes, index)) {
+                db_scan_stats_set_root_stale(scan_context->stats, index->path);
+            }
         }
     }
 
-    g_clear_pointer(&dir, closedir);
-    return WALK_OK;
-}
+    bool ret = false;
+    if (!is_cancelled(cancellable)) {
+        ret = g_atomic_int_get(&scan_context->num_roots_scanned) > 0 || g_hash_table_size(kept_indexes) > 0;
 
-static bool
-db_scan_folder(FsearchDatabase *db,
-               const char *dname,
-               bool one_filesystem,
-               GCancellable *cancellable,
-               void (*status_cb)(const char *)) {
-    g_assert(dname);
-    g_assert(dname[0] == G_DIR_SEPARATOR);
-    g_debug("[db_scan] scan path: %s", dname);
+        if (status_cb) {
+            status_cb(_("Sorting…"));
+        }
+        DynamicArray *folder_arrays[] = {db->sorted_folders[DATABASE_INDEX_TYPE_NAME],
+                                         kept_folders[DATABASE_INDEX_TYPE_NAME],
+                                         stale_folders[DATABASE_INDEX_TYPE_NAME]};
+        db_update_folder_ranks(folder_arrays, G_N_ELEMENTS(folder_arrays));
+        db_sort(db, cancellable);
+    }
+    // only the scanned entries were sorted, the kept ones are in order already
+    db_merge_index_entries(db, kept_files, kept_folders);
+    db_merge_index_entries(db, stale_files, stale_folders);
+    db_assign_folder_ids(db, db->sorted_folders[DATABASE_INDEX_TYPE_NAME]);
+    db_update_metadata(db, NULL, 0);
+
+    db_scan_stats_set_duration(scan_context->stats, g_get_monotonic_time() - start_time);
+    g_clear_pointer(&db->scan_stats, db_scan_stats_unref);
+    db->scan_stats = db_scan_stats_ref(scan_context->stats);
+    g_clear_pointer(&scan_context, db_scan_context_unref);
 
-    if (!g_file_test(dname, G_FILE_TEST_IS_DIR)) {
-        g_warning("[db_scan] %s doesn't exist", dname);
+    if (is_cancelled(cancellable)) {
         return false;
     }
+    return ret;
+}
 
-    g_autoptr(GString) path = g_string_new(dname);
-    // remove leading path separator '/' for root directory
-    if (strcmp(path->str, G_DIR_SEPARATOR_S) == 0) {
-        g_string_erase(path, 0, 1);
+typedef struct DatabaseLowImpactScan {
+    FsearchDatabase *db;
+    FsearchDatabase *previous;
+    bool incremental;
+    const char *index_path;
+    GCancellable *cancellable;
+    void (*status_cb)(const char *);
+    bool result;
+} DatabaseLowImpactScan;
+
+static void
+thread_lower_priority(void) {
+#ifdef __linux__
+    // on Linux both priorities are per thread
+    const pid_t tid = (pid_t)syscall(SYS_gettid);
+    if (setpriority(PRIO_PROCESS, tid, 19) != 0) {
+        g_debug("[db_scan] failed to lower the CPU priority");
+    }
+#ifdef SYS_ioprio_set
+    // IOPRIO_WHO_PROCESS, IOPRIO_CLASS_IDLE: only get disk time when no one else needs it
+    const int ioprio_who_process = 1;
+    const int ioprio_class_idle = 3;
+    const int ioprio_class_shift = 13;
+    if (syscall(SYS_ioprio_set, ioprio_who_process, tid, ioprio_class_idle << ioprio_class_shift) != 0) {
+        g_debug("[db_scan] failed to lower the I/O priority");
     }
+#endif
+#endif
+}
 
-    g_autoptr(GTimer) timer = g_timer_new();
-    g_timer_start(timer);
+static gpointer
+db_scan_low_impact_thread(gpointer data) {
+    DatabaseLowImpactScan *scan = data;
+    thread_lower_priority();
+    scan->result =
+        db_scan_run(scan->db, scan->previous, scan->incremental, scan->index_path, scan->cancellable, scan->status_cb);
+    return NULL;
+}
 
-    struct stat root_st;
-    if (lstat(dname, &root_st)) {
-        g_debug("[db_scan] can't stat: %s", dname);
+static bool
+db_scan_internal(FsearchDatabase *db,
+                 FsearchDatabase *previous,
+                 bool incremental,
+                 const char *index_path,
+                 GCancellable *cancellable,
+                 void (*status_cb)(const char *)) {
+    g_assert(db);
+    if (!db->low_impact) {
+        const bool result = db_scan_run(db, previous, incremental, index_path, cancellable, status_cb);
+        db_publish_version(db);
+        return result;
     }
 
-    DatabaseWalkContext walk_context = {
+    // unprivileged threads can't raise their priority again, so the scan gets a thread of its own.
+    // All threads it starts inherit the lowered priorities.
+    DatabaseLowImpactScan scan = {
         .db = db,
-        .path = path,
-        .timer = timer,
+        .previous = previous,
+        .incremental = incremental,
+        .index_path = index_path,
         .cancellable = cancellable,
         .status_cb = status_cb,
-        .root_device_id = root_st.st_dev,
-        .one_filesystem = one_filesystem,
-        .exclude_hidden = db->exclude_hidden,
+        .result = false,
     };
+    g_thread_join(g_thread_new("fsearch_scan", db_scan_low_impact_thread, &scan));
+    db_publish_version(db);
+    return scan.result;
+}
 
-    FsearchDatabaseEntry *entry = fsearch_memory_pool_malloc(db->folder_pool);
-    db_entry_set_name(entry, path->str);
-    db_entry_set_parent(entry, NULL);
-    db_entry_set_type(entry, DATABASE_ENTRY_TYPE_FOLDER);
-
-    darray_add_item(db->sorted_folders[DATABASE_INDEX_TYPE_NAME], entry);
+bool
+db_scan(FsearchDatabase *db, GCancellable *cancellable, void (*status_cb)(const char *)) {
+    return db_scan_internal(db, NULL, false, NULL, cancellable, status_cb);
+}
 
-    uint32_t res = db_folder_scan_recursive(&walk_context, (FsearchDatabaseEntryFolder *)entry);
+bool
+db_scan_incremental(FsearchDatabase *db,
+                    FsearchDatabase *reference,
+                    GCancellable *cancellable,
+                    void (*status_cb)(const char *)) {
+    return db_scan_internal(db, reference, true, NULL, cancellable, status_cb);
+}
 
-    if (res == WALK_OK) {
-        g_debug("[db_scan] scanned: %d files, %d folders -> %d total",
-                db_get_num_files(db),
-                db_get_num_folders(db),
-                db_get_num_entries(db));
-        return true;
-    }
+bool
+db_rescan(FsearchDatabase *db, FsearchDatabase *previous, GCancellable *cancellable, void (*status_cb)(const char *)) {
+    return db_scan_internal(db, previous, false, NULL, cancellable, status_cb);
+}
 
-    if (res == WALK_CANCEL) {
-        g_debug("[db_scan] scan cancelled.");
-    }
-    else {
-        g_warning("[db_scan] walk error: %d", res);
-    }
-    return false;
+bool
+db_rescan_index(FsearchDatabase *db,
+                FsearchDatabase *previous,
+                const char *index_path,
+                GCancellable *cancellable,
+                void (*status_cb)(const char *)) {
+    g_assert(index_path);
+    return db_scan_internal(db, previous, false, index_path, cancellable, status_cb);
 }
 
-static gint
-compare_index_path(FsearchIndex *p1, FsearchIndex *p2) {
-    return strcmp(p1->path, p2->path);
+time_t
+db_get_index_last_updated(FsearchDatabase *db, const char *index_path) {
+    g_assert(db);
+    g_assert(index_path);
+    FsearchIndex *index = db_find_index(db, index_path);
+    return index ? index->last_updated : 0;
 }
 
-static gint
-compare_exclude_path(FsearchExcludePath *p1, FsearchExcludePath *p2) {
-    return strcmp(p1->path, p2->path);
+FsearchDatabaseScanStats *
+db_get_scan_stats(FsearchDatabase *db) {
+    g_assert(db);
+    return db_scan_stats_ref(db->scan_stats);
 }
 
-FsearchDatabase *
-db_new(GList *indexes, GList *excludes, char **exclude_files, bool exclude_hidden) {
-    FsearchDatabase *db = g_new0(FsearchDatabase, 1);
+void
+db_get_memory_stats(FsearchDatabase *db, FsearchDatabaseMemoryStats *stats) {
     g_assert(db);
-    g_mutex_init(&db->mutex);
-    if (indexes) {
-        db->indexes = g_list_copy_deep(indexes, (GCopyFunc)fsearch_index_copy, NULL);
+    g_assert(stats);
 
-        db->indexes = g_list_sort(db->indexes, (GCompareFunc)compare_index_path);
+    stats->folder_pool += fsearch_memory_pool_get_memory_size(db->folder_pool);
+    stats->file_pool += fsearch_memory_pool_get_memory_size(db->file_pool);
+    stats->names += fsearch_string_arena_get_memory_size(db->names);
+    stats->names_used += fsearch_string_arena_get_num_bytes(db->names);
+    stats->file_contents += db->file_contents ? g_bytes_get_size(db->file_contents) : 0;
+    for (uint32_t i = 0; i < NUM_DATABASE_INDEX_TYPES; i++) {
+        stats->sorted_folders[i] += db_memory_stats_count_array(stats, db->sorted_folders[i]);
+        stats->sorted_files[i] += db_memory_stats_count_array(stats, db->sorted_files[i]);
     }
-    if (excludes) {
-        db->excludes = g_list_copy_deep(excludes, (GCopyFunc)fsearch_exclude_path_copy, NULL);
-        db->excludes = g_list_sort(db->excludes, (GCompareFunc)compare_exclude_path);
+    stats->metadata += db_metadata_get_memory_size(db->metadata);
+    stats->columns += db_columns_get_memory_size(db->folder_columns) + db_columns_get_memory_size(db->file_columns);
+    stats->folder_paths += db_folder_paths_get_memory_size(db->folder_paths);
+    for (uint32_t i = 0; i < NUM_DATABASE_INDEX_TYPES; i++) {
+        stats->ranks += db_ranks_get_memory_size(db->folder_ranks[i]) + db_ranks_get_memory_size(db->file_ranks[i]);
     }
-    if (exclude_files) {
-        db->exclude_files = g_strdupv(exclude_files);
+    stats->folded_names += db_folded_names_get_memory_size(db->folded_names);
+    stats->extensions += db_extensions_get_memory_size(db->extensions);
+    stats->file_types += db_file_types_get_memory_size(db->file_types);
+    stats->trigrams += db_trigrams_get_memory_size(db->trigrams);
+    for (uint32_t i = 0; i < db->filter_matches->len; i++) {
+        stats->filter_matches += db_search_filter_matches_get_memory_size(g_ptr_array_index(db->filter_matches, i));
     }
+    db_search_cache_get_memory_stats(db->search_cache, stats);
+    stats->memory_budget = MAX(stats->memory_budget, db->memory_budget);
+}
 
-    for (uint32_t i = 0; i < NUM_DATABASE_INDEX_TYPES; i++) {
-        db->sorted_files[i] = NULL;
-        db->sorted_folders[i] = NULL;
-    }
-    db->file_pool = fsearch_memory_pool_new(NUM_DB_ENTRIES_FOR_POOL_BLOCK,
-                                            db_entry_get_sizeof_file_entry(),
-                                            (GDestroyNotify)db_entry_destroy);
-    db->folder_pool = fsearch_memory_pool_new(NUM_DB_ENTRIES_FOR_POOL_BLOCK,
-                                              db_entry_get_sizeof_folder_entry(),
-                                              (GDestroyNotify)db_entry_destroy);
+static guint
+db_entry_hash_by_parent_and_name(gconstpointer key) {
+    FsearchDatabaseEntry *entry = (FsearchDatabaseEntry *)key;
+    return g_direct_hash(db_entry_get_parent(entry)) ^ g_str_hash(db_entry_get_name_raw(entry));
+}
 
-    db->thread_pool = fsearch_thread_pool_init();
+static gboolean
+db_entry_equal_by_parent_and_name(gconstpointer a, gconstpointer b) {
+    FsearchDatabaseEntry *entry_a = (FsearchDatabaseEntry *)a;
+    FsearchDatabaseEntry *entry_b = (FsearchDatabaseEntry *)b;
+    return db_entry_get_parent(entry_a) == db_entry_get_parent(entry_b)
+        && strcmp(db_entry_get_name_raw(entry_a), db_entry_get_name_raw(entry_b)) == 0;
+}
 
-    db->exclude_hidden = exclude_hidden;
-    db->ref_count = 1;
-    return db;
+static DatabaseChanges *
+db_changes_new(void) {
+    DatabaseChanges *changes = calloc(1, sizeof(DatabaseChanges));
+    g_assert(changes);
+
+    changes->added_files = darray_new(128);
+    changes->added_folders = darray_new(128);
+    changes->added_entries = g_hash_table_new(db_entry_hash_by_parent_and_name, db_entry_equal_by_parent_and_name);
+    changes->updated_files = darray_new(128);
+    changes->updated_folders = darray_new(128);
+    changes->removed_entries = darray_new(128);
+    changes->metadata = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+    return changes;
 }
 
 static void
-db_free(FsearchDatabase *db) {
+db_changes_free(DatabaseChanges *changes) {
+    g_clear_pointer(&changes->added_files, darray_unref);
+    g_clear_pointer(&changes->added_folders, darray_unref);
+    g_clear_pointer(&changes->added_entries, g_hash_table_unref);
+    g_clear_pointer(&changes->updated_files, darray_unref);
+    g_clear_pointer(&changes->updated_folders, darray_unref);
+    g_clear_pointer(&changes->removed_entries, darray_unref);
+    g_clear_pointer(&changes->metadata, g_hash_table_unref);
+    g_clear_pointer(&changes, free);
+}
+
+static DatabaseChanges *
+db_get_changes(FsearchDatabase *db) {
+    if (!db->changes) {
+        db->changes = db_changes_new();
+    }
+    return db->changes;
+}
+
+static bool
+db_entry_is_removed(FsearchDatabaseEntry *entry) {
+    while (entry) {
+        if (db_entry_get_mark(entry) == DATABASE_ENTRY_MARK_REMOVED) {
+            return true;
+        }
+        entry = (FsearchDatabaseEntry *)db_entry_get_parent(entry);
+    }
+    return false;
+}
+
+bool
+db_folder_is_removed(FsearchDatabase *db, FsearchDatabaseEntryFolder *folder) {
     g_assert(db);
+    if (!db->changes || db->changes->num_removed_folders == 0) {
+        return false;
+    }
+    return db_entry_is_removed((FsearchDatabaseEntry *)folder);
+}
 
-    g_debug("[db_free] freeing...");
-    db_lock(db);
-    if (db->ref_count > 0) {
-        g_warning("[db_free] pending references on free: %d", db->ref_count);
+static FsearchDatabaseEntry *
+db_find_entry(FsearchDatabase *db, FsearchDatabaseEntryFolder *parent, const char *name, bool is_dir) {
+    // The path comparison only looks at the name and the parents, so a temporary entry is enough to search for
+    // the real one
+    FsearchDatabaseEntry *key = calloc(1, db_entry_get_sizeof_folder_entry());
+    g_assert(key);
+    // only used for the lookup, so it doesn't need a copy of the name
+    db_entry_set_name_borrowed(key, name);
+    db_entry_set_parent(key, parent);
+    db_entry_set_type(key, is_dir ? DATABASE_ENTRY_TYPE_FOLDER : DATABASE_ENTRY_TYPE_FILE);
+
+    FsearchDatabaseEntry *entry = NULL;
+    if (db->changes) {
+        entry = g_hash_table_lookup(db->changes->added_entries, key);
+        if (entry && db_entry_get_type(entry) != db_entry_get_type(key)) {
+            entry = NULL;
+        }
     }
 
-    db_sorted_entries_free(db);
+    DynamicArray *entries = is_dir ? db->sorted_folders[DATABASE_INDEX_TYPE_PATH] : db->sorted_files[DATABASE_INDEX_TYPE_PATH];
+    DynamicArray *entries_by_name =
+        is_dir ? db->sorted_folders[DATABASE_INDEX_TYPE_NAME] : db->sorted_files[DATABASE_INDEX_TYPE_NAME];
+    uint32_t idx = 0;
+    uint32_t end = 0;
+    if (!entry && entries
+        && darray_binary_search_with_data(entries,
+                                          key,
+                                          (DynamicArrayCompareDataFunc)db_entry_compare_entries_by_path,
+                                          NULL,
+                                          &idx)) {
+        entry = darray_get_item(entries, idx);
+    }
+    else if (!entry && !entries && entries_by_name
+             && darray_binary_search_range_with_data(entries_by_name,
+                                                     key,
+                                                     (DynamicArrayCompareDataFunc)db_entry_compare_entries_by_name,
+                                                     NULL,
+                                                     &idx,
+                                                     &end)) {
+        // without the path order (see db_set_lazy_sort_indexes) the entries with the same name are checked instead
+        for (; idx < end && !entry; idx++) {
+            FsearchDatabaseEntry *candidate = darray_get_item(entries_by_name, idx);
+            if (db_entry_get_parent(candidate) == parent && strcmp(db_entry_get_name_raw(candidate), name) == 0) {
+                entry = candidate;
+            }
+        }
+    }
 
-    g_clear_pointer(&db->file_pool, fsearch_memory_pool_free_pool);
-    g_clear_pointer(&db->folder_pool, fsearch_memory_pool_free_pool);
+    g_clear_pointer(&key, free);
 
-    if (db->indexes) {
-        g_list_free_full(g_steal_pointer(&db->indexes), (GDestroyNotify)fsearch_index_free);
+    if (entry && db_entry_get_mark(entry) == DATABASE_ENTRY_MARK_REMOVED) {
+        return NULL;
     }
-    if (db->excludes) {
-        g_list_free_full(g_steal_pointer(&db->excludes), (GDestroyNotify)fsearch_exclude_path_free);
+    return entry;
+}
+
+static void
+db_remove_entry(FsearchDatabase *db, FsearchDatabaseEntry *entry) {
+    DatabaseChanges *changes = db_get_changes(db);
+
+    // the contents of removed folders are found when the changes get applied
+    db_entry_update_folder_size(db_entry_get_parent(entry), -db_entry_get_size(entry));
+    db_entry_set_mark(entry, DATABASE_ENTRY_MARK_REMOVED);
+    darray_add_item(changes->removed_entries, entry);
+    if (db_entry_is_folder(entry)) {
+        changes->num_removed_folders++;
     }
+    else {
+        changes->num_removed_files++;
+    }
+    changes->folder_sizes_changed = true;
+}
 
-    g_clear_pointer(&db->exclude_files, g_strfreev);
-    g_clear_pointer(&db->thread_pool, fsearch_thread_pool_free);
+static uint32_t
+db_metadata_time_clamp(time_t time) {
+    return (uint32_t)CLAMP((int64_t)time, 0, UINT32_MAX);
+}
 
-    db_unlock(db);
+// Whether values differ from what's known about entry, only the indexed columns are compared
+static bool
+db_entry_metadata_changed(FsearchDatabase *db,
+                          FsearchDatabaseEntry *entry,
+                          const FsearchDatabaseEntryMetadata *values) {
+    if (!db_has_metadata_columns(db)) {
+        return false;
+    }
+    FsearchDatabaseEntryMetadata current = {.uid = DATABASE_METADATA_UNKNOWN_ID, .gid = DATABASE_METADATA_UNKNOWN_ID};
+    const FsearchDatabaseEntryMetadata *pending =
+        db->changes ? g_hash_table_lookup(db->changes->metadata, entry) : NULL;
+    if (pending) {
+        current = *pending;
+    }
+    else if (db->metadata) {
+        db_metadata_lookup(db->metadata, entry, &current);
+    }
+
+    const FsearchDatabaseIndexFlags flags = db->index_flags;
+    return ((flags & DATABASE_INDEX_FLAG_OWNER) != 0 && (current.uid != values->uid || current.gid != values->gid))
+        || ((flags & DATABASE_INDEX_FLAG_PERMISSIONS) != 0 && current.mode != values->mode)
+        || ((flags & DATABASE_INDEX_FLAG_ACCESS_TIME) != 0
+            && db_metadata_time_clamp(current.atime) != db_metadata_time_clamp(values->atime))
+        || ((flags & DATABASE_INDEX_FLAG_STATUS_CHANGE_TIME) != 0
+            && db_metadata_time_clamp(current.ctime) != db_metadata_time_clamp(values->ctime))
+        || ((flags & DATABASE_INDEX_FLAG_CREATION_TIME) != 0
+            && db_metadata_time_clamp(current.btime) != db_metadata_time_clamp(values->btime));
+}
 
-    g_mutex_clear(&db->mutex);
+static void
+db_changes_set_metadata(DatabaseChanges *changes,
+                        FsearchDatabaseEntry *entry,
+                        const FsearchDatabaseEntryMetadata *values) {
+    FsearchDatabaseEntryMetadata *copy = g_new(FsearchDatabaseEntryMetadata, 1);
+    *copy = *values;
+    g_hash_table_replace(changes->metadata, entry, copy);
+}
 
-    g_clear_pointer(&db, free);
+// metadata is NULL if it isn't known, then the metadata columns of entry stay the same
+static void
+db_update_entry(FsearchDatabase *db,
+                FsearchDatabaseEntry *entry,
+                off_t size,
+                time_t mtime,
+                const FsearchDatabaseEntryMetadata *metadata) {
+    const bool is_folder = db_entry_is_folder(entry);
+    // folder sizes are the sum of their contents
+    const off_t size_diff = is_folder ? 0 : size - db_entry_get_size(entry);
+    const bool metadata_changed = metadata && db_entry_metadata_changed(db, entry, metadata);
+    if (size_diff == 0 && mtime == db_entry_get_mtime(entry) && !metadata_changed) {
+        return;
+    }
 
-#ifdef HAVE_MALLOC_TRIM
-    malloc_trim(0);
-#endif
+    DatabaseChanges *changes = db_get_changes(db);
+    if (metadata_changed) {
+        db_changes_set_metadata(changes, entry, metadata);
+    }
+    if (size_diff != 0) {
+        db_entry_set_size(entry, size);
+        db_entry_update_folder_size(db_entry_get_parent(entry), size_diff);
+        changes->folder_sizes_changed = true;
+    }
+    db_entry_set_mtime(entry, mtime);
 
-    g_debug("[db_free] freed");
+    if (g_hash_table_contains(changes->added_entries, entry)) {
+        // not part of the sorted arrays yet, so there's nothing to move
+        return;
+    }
+    if (db_entry_get_mark(entry) == DATABASE_ENTRY_MARK_NONE) {
+        db_entry_set_mark(entry, DATABASE_ENTRY_MARK_UPDATED);
+        darray_add_item(is_folder ? changes->updated_folders : changes->updated_files, entry);
+    }
 }
 
-time_t
-db_get_timestamp(FsearchDatabase *db) {
-    g_assert(db);
-    return db->timestamp;
+static void
+db_add_folder_contents(FsearchDatabase *db,
+                       FsearchDatabaseEntryFolder *folder,
+                       GString *path,
+                       FsearchDatabaseFolderFunc folder_added_func,
+                       gpointer user_data);
+
+// Adds a single entry without looking at the filesystem, the size of folders is ignored. metadata is NULL if it isn't
+// known.
+static FsearchDatabaseEntry *
+db_insert_entry(FsearchDatabase *db,
+                FsearchDatabaseEntryFolder *parent,
+                const char *name,
+                bool is_dir,
+                off_t size,
+                time_t mtime,
+                const FsearchDatabaseEntryMetadata *metadata) {
+    DatabaseChanges *changes = db_get_changes(db);
+    FsearchDatabaseEntry *entry = fsearch_memory_pool_malloc(is_dir ? db->folder_pool : db->file_pool);
+    db_entry_set_name_in_arena(entry, db->names, name);
+    db_entry_set_type(entry, is_dir ? DATABASE_ENTRY_TYPE_FOLDER : DATABASE_ENTRY_TYPE_FILE);
+    db_entry_set_mtime(entry, mtime);
+    db_entry_set_parent(entry, parent);
+
+    darray_add_item(is_dir ? changes->added_folders : changes->added_files, entry);
+    g_hash_table_add(changes->added_entries, entry);
+    if (metadata && db_has_metadata_columns(db)) {
+        db_changes_set_metadata(changes, entry, metadata);
+    }
+
+    if (!is_dir) {
+        db_entry_set_size(entry, size);
+        db_entry_update_parent_size(entry);
+        changes->folder_sizes_changed = true;
+    }
+    return entry;
 }
 
-uint32_t
-db_get_num_files(FsearchDatabase *db) {
-    g_assert(db);
-    return db->sorted_files[DATABASE_INDEX_TYPE_NAME] ? darray_get_num_items(db->sorted_files[DATABASE_INDEX_TYPE_NAME])
-                                                      : 0;
+static FsearchDatabaseEntry *
+db_add_entry(FsearchDatabase *db,
+             FsearchDatabaseEntryFolder *parent,
+             const char *name,
+             GString *path,
+             struct stat *st,
+             FsearchDatabaseFolderFunc folder_added_func,
+             gpointer user_data) {
+    const bool is_dir = S_ISDIR(st->st_mode);
+    if (is_dir && directory_is_excluded(path->str, db->exclude_matcher)) {
+        return NULL;
+    }
+
+    FsearchDatabaseEntryMetadata metadata = {};
+    db_entry_metadata_init(db, &metadata, st, AT_FDCWD, path->str, db_scan_stat_flags());
+    FsearchDatabaseEntry *entry = db_insert_entry(db, parent, name, is_dir, st->st_size, st->st_mtime, &metadata);
+    if (is_dir) {
+        if (folder_added_func) {
+            folder_added_func((FsearchDatabaseEntryFolder *)entry, path->str, user_data);
+        }
+        db_add_folder_contents(db, (FsearchDatabaseEntryFolder *)entry, path, folder_added_func, user_data);
+    }
+    return entry;
 }
 
-uint32_t
-db_get_num_folders(FsearchDatabase *db) {
-    g_assert(db);
-    return db->sorted_folders[DATABASE_INDEX_TYPE_NAME]
-             ? darray_get_num_items(db->sorted_folders[DATABASE_INDEX_TYPE_NAME])
-             : 0;
+static void
+db_add_folder_contents(FsearchDatabase *db,
+                       FsearchDatabaseEntryFolder *folder,
+                       GString *path,
+                       FsearchDatabaseFolderFunc folder_added_func,
+                       gpointer user_data) {
+    DIR *dir = opendir(path->str);
+    if (!dir) {
+        g_debug("[db_sync] failed to open directory: %s", path->str);
+        return;
+    }
+
+    g_string_append_c(path, G_DIR_SEPARATOR);
+    const gsize path_len = path->len;
+
+    struct dirent *dent = NULL;
+    while ((dent = readdir(dir))) {
+        const char *name = dent->d_name;
+        if (name[0] == '.') {
+            if (name[1] == '\0' || (name[1] == '.' && name[2] == '\0') || db->exclude_hidden) {
+                continue;
+            }
+        }
+        if (file_is_excluded(name, db->exclude_matcher)) {
+            continue;
+        }
+
+        struct stat st;
+        if (fstatat(dirfd(dir), name, &st, db_scan_stat_flags())) {
+            continue;
+        }
+        g_string_truncate(path, path_len);
+        g_string_append(path, name);
+        db_add_entry(db, folder, name, path, &st, folder_added_func, user_data);
+    }
+    closedir(dir);
+    g_string_truncate(path, path_len - 1);
 }
 
-uint32_t
-db_get_num_entries(FsearchDatabase *db) {
-    g_assert(db);
-    return db_get_num_files(db) + db_get_num_folders(db);
+void
+db_sync_entry(FsearchDatabase *db,
+              FsearchDatabaseEntryFolder *parent,
+              const char *name,
+              FsearchDatabaseFolderFunc folder_added_func,
+              gpointer user_data) {
+    g_assert(db);
+    g_assert(parent);
+    g_assert(name);
+
+    if (db_folder_is_removed(db, parent)) {
+        return;
+    }
+    if ((db->exclude_hidden && name[0] == '.') || file_is_excluded(name, db->exclude_matcher)) {
+        return;
+    }
+    // the entries are compared with the filesystem and their metadata changes
+    db_load_pending_metadata(db);
+    db_clear_columns(db);
+
+    g_autoptr(GString) path = db_entry_get_path_full((FsearchDatabaseEntry *)parent);
+    if (path->len == 0 || path->str[path->len - 1] != G_DIR_SEPARATOR) {
+        g_string_append_c(path, G_DIR_SEPARATOR);
+    }
+    g_string_append(path, name);
+
+    struct stat st;
+    const bool exists = fstatat(AT_FDCWD, path->str, &st, db_scan_stat_flags()) == 0;
+    const bool is_dir = exists && S_ISDIR(st.st_mode);
+
+    // name might have changed its type, e.g. a file was replaced by a folder
+    FsearchDatabaseEntry *file = db_find_entry(db, parent, name, false);
+    FsearchDatabaseEntry *folder = db_find_entry(db, parent, name, true);
+    if (file && (!exists || is_dir)) {
+        db_remove_entry(db, g_steal_pointer(&file));
+    }
+    if (folder && (!exists || !is_dir)) {
+        db_remove_entry(db, g_steal_pointer(&folder));
+    }
+    if (!exists) {
+        return;
+    }
+
+    FsearchDatabaseEntry *entry = is_dir ? folder : file;
+    if (entry) {
+        FsearchDatabaseEntryMetadata metadata = {};
+        db_entry_metadata_init(db, &metadata, &st, AT_FDCWD, path->str, db_scan_stat_flags());
+        db_update_entry(db, entry, st.st_size, st.st_mtime, &metadata);
+    }
+    else {
+        db_add_entry(db, parent, name, path, &st, folder_added_func, user_data);
+    }
 }
 
 void
-db_unlock(FsearchDatabase *db) {
+db_sync_folder(FsearchDatabase *db, FsearchDatabaseEntryFolder *folder) {
     g_assert(db);
-    g_mutex_unlock(&db->mutex);
+    g_assert(folder);
+
+    if (db_folder_is_removed(db, folder)) {
+        return;
+    }
+
+    g_autoptr(GString) path = db_entry_get_path_full((FsearchDatabaseEntry *)folder);
+    struct stat st;
+    if (fstatat(AT_FDCWD, path->str, &st, db_scan_stat_flags()) || !S_ISDIR(st.st_mode)) {
+        // folder is gone, that's handled when its parent gets synced
+        return;
+    }
+    db_load_pending_metadata(db);
+    db_clear_columns(db);
+    FsearchDatabaseEntryMetadata metadata = {};
+    db_entry_metadata_init(db, &metadata, &st, AT_FDCWD, path->str, db_scan_stat_flags());
+    db_update_entry(db, (FsearchDatabaseEntry *)folder, 0, st.st_mtime, &metadata);
 }
 
-void
-db_lock(FsearchDatabase *db) {
-    g_assert(db);
-    g_mutex_lock(&db->mutex);
+// Returns a copy of entries without the removed and moved entries, with added (which has to be sorted by
+// compare_func) merged in at the right positions.
+static DynamicArray *
+db_merge_changes(DynamicArray *entries, DynamicArray *added, DynamicArrayCompareDataFunc compare_func, bool skip_updated) {
+    const uint32_t num_entries = darray_get_num_items(entries);
+    const uint32_t num_added = added ? darray_get_num_items(added) : 0;
+    DynamicArray *merged = darray_new(MAX(num_entries + num_added, 128));
+
+    uint32_t j = 0;
+    for (uint32_t i = 0; i < num_entries; i++) {
+        void *entry = darray_get_item(entries, i);
+        const uint8_t mark = db_entry_get_mark(entry);
+        if (mark == DATABASE_ENTRY_MARK_REMOVED || (skip_updated && mark == DATABASE_ENTRY_MARK_UPDATED)) {
+            continue;
+        }
+        for (; j < num_added; j++) {
+            void *added_entry = darray_get_item(added, j);
+            if (compare_func(&added_entry, &entry, NULL) >= 0) {
+                break;
+            }
+            darray_add_item(merged, added_entry);
+        }
+        darray_add_item(merged, entry);
+    }
+    for (; j < num_added; j++) {
+        darray_add_item(merged, darray_get_item(added, j));
+    }
+    return merged;
 }
 
-bool
-db_try_lock(FsearchDatabase *db) {
-    g_assert(db);
-    return g_mutex_trylock(&db->mutex);
+static DynamicArray *
+db_get_entries_to_insert(DynamicArray *added,
+                         DynamicArray *updated,
+                         DynamicArrayCompareDataFunc compare_func,
+                         bool include_updated) {
+    DynamicArray *entries = darray_new(128);
+    DynamicArray *sources[2] = {added, include_updated ? updated : NULL};
+    for (uint32_t i = 0; i < G_N_ELEMENTS(sources); i++) {
+        const uint32_t num_items = sources[i] ? darray_get_num_items(sources[i]) : 0;
+        for (uint32_t j = 0; j < num_items; j++) {
+            FsearchDatabaseEntry *entry = darray_get_item(sources[i], j);
+            if (!db_entry_is_removed(entry)) {
+                darray_add_item(entries, entry);
+            }
+        }
+    }
+    darray_sort(entries, compare_func, NULL, NULL);
+    return entries;
 }
 
-static bool
-is_valid_sort_type(FsearchDatabaseIndexType sort_type) {
-    if (0 <= sort_type && sort_type < NUM_DATABASE_INDEX_TYPES) {
-        return true;
+static DynamicArrayCompareDataFunc
+db_get_compare_func(FsearchDatabaseIndexType type) {
+    switch (type) {
+    case DATABASE_INDEX_TYPE_NAME:
+        return (DynamicArrayCompareDataFunc)db_entry_compare_entries_by_name;
+    case DATABASE_INDEX_TYPE_PATH:
+        return (DynamicArrayCompareDataFunc)db_entry_compare_entries_by_path;
+    case DATABASE_INDEX_TYPE_SIZE:
+        return (DynamicArrayCompareDataFunc)db_entry_compare_entries_by_size;
+    case DATABASE_INDEX_TYPE_MODIFICATION_TIME:
+        return (DynamicArrayCompareDataFunc)db_entry_compare_entries_by_modification_time;
+    case DATABASE_INDEX_TYPE_EXTENSION:
+        return (DynamicArrayCompareDataFunc)db_entry_compare_entries_by_extension;
+    default:
+        return NULL;
     }
-    return false;
 }
 
-bool
-db_has_entries_sorted_by_type(FsearchDatabase *db, FsearchDatabaseIndexType sort_type) {
-    g_assert(db);
+static void
+db_journal_add_record(FsearchDatabase *db,
+                      DatabaseChanges *changes,
+                      DatabaseJournalRecordType type,
+                      FsearchDatabaseEntry *entry) {
+    if (!db->journal) {
+        db->journal = g_byte_array_new();
+    }
+    g_autoptr(GString) path = db_entry_get_path_full(entry);
+    DatabaseJournalRecord record = {
+        .type = type,
+        .is_folder = db_entry_is_folder(entry),
+        .path_len = path->len,
+        .size = db_entry_get_size(entry),
+        .mtime = db_entry_get_mtime(entry),
+    };
+    if (type != DATABASE_JOURNAL_RECORD_REMOVE && db_has_metadata_columns(db)) {
+        FsearchDatabaseEntryMetadata values = {
+            .uid = DATABASE_METADATA_UNKNOWN_ID,
+            .gid = DATABASE_METADATA_UNKNOWN_ID,
+        };
+        const FsearchDatabaseEntryMetadata *pending = g_hash_table_lookup(changes->metadata, entry);
+        if (pending) {
+            values = *pending;
+        }
+        else if (db->metadata) {
+            db_metadata_lookup(db->metadata, entry, &values);
+        }
+        record.flags |= DATABASE_JOURNAL_RECORD_FLAG_METADATA;
+        record.uid = values.uid;
+        record.gid = values.gid;
+        record.mode = values.mode;
+        record.atime = values.atime;
+        record.ctime = values.ctime;
+        record.btime = values.btime;
+    }
+    g_byte_array_append(db->journal, (const guint8 *)&record, sizeof(record));
+    g_byte_array_append(db->journal, (const guint8 *)path->str, path->len);
+}
 
-    if (is_valid_sort_type(sort_type)) {
-        return db->sorted_folders[sort_type] ? true : false;
+static void
+db_journal_add_entries(FsearchDatabase *db,
+                       DatabaseChanges *changes,
+                       DatabaseJournalRecordType type,
+                       DynamicArray *entries) {
+    const uint32_t num_entries = entries ? darray_get_num_items(entries) : 0;
+    for (uint32_t i = 0; i < num_entries; i++) {
+        FsearchDatabaseEntry *entry = darray_get_item(entries, i);
+        if (!db_entry_is_removed(entry)) {
+            db_journal_add_record(db, changes, type, entry);
+        }
     }
-    return false;
 }
 
-DynamicArray *
-db_get_folders_sorted_copy(FsearchDatabase *db, FsearchDatabaseIndexType sort_type) {
-    g_assert(db);
-    if (!is_valid_sort_type(sort_type)) {
-        return NULL;
+// Records the changes in the order they have to be replayed: removals, then additions (folders before their
+// contents) and updates
+static void
+db_journal_add_changes(FsearchDatabase *db, DatabaseChanges *changes) {
+    const uint32_t num_removed = darray_get_num_items(changes->removed_entries);
+    for (uint32_t i = 0; i < num_removed; i++) {
+        FsearchDatabaseEntry *entry = darray_get_item(changes->removed_entries, i);
+        // the contents of removed folders and entries which were only added in this batch don't need a record
+        if (!db_entry_is_removed((FsearchDatabaseEntry *)db_entry_get_parent(entry))
+            && !g_hash_table_contains(changes->added_entries, entry)) {
+            db_journal_add_record(db, changes, DATABASE_JOURNAL_RECORD_REMOVE, entry);
+        }
     }
-    DynamicArray *folders = db->sorted_folders[sort_type];
-    return folders ? darray_copy(folders) : NULL;
+    db_journal_add_entries(db, changes, DATABASE_JOURNAL_RECORD_ADD, changes->added_folders);
+    db_journal_add_entries(db, changes, DATABASE_JOURNAL_RECORD_ADD, changes->added_files);
+    db_journal_add_entries(db, changes, DATABASE_JOURNAL_RECORD_UPDATE, changes->updated_folders);
+    db_journal_add_entries(db, changes, DATABASE_JOURNAL_RECORD_UPDATE, changes->updated_files);
 }
 
-DynamicArray *
-db_get_files_sorted_copy(FsearchDatabase *db, FsearchDatabaseIndexType sort_type) {
-    g_assert(db);
-    if (!is_valid_sort_type(sort_type)) {
-        return NULL;
+static void
+db_apply_changes_to_sorted_arrays(DynamicArray **sorted_entries,
+                                  DynamicArray *added,
+                                  DynamicArray *updated,
+                                  bool is_folder) {
+    for (FsearchDatabaseIndexType type = 0; type < NUM_DATABASE_INDEX_TYPES; type++) {
+        if (!sorted_entries[type]) {
+            continue;
+        }
+        if (is_folder && (type == DATABASE_INDEX_TYPE_EXTENSION || type == DATABASE_INDEX_TYPE_FILETYPE)) {
+            // Folders don't have a file extension or type, this is just a reference to the name array
+            g_clear_pointer(&sorted_entries[type], darray_unref);
+            sorted_entries[type] = darray_ref(sorted_entries[DATABASE_INDEX_TYPE_NAME]);
+            continue;
+        }
+        DynamicArrayCompareDataFunc compare_func = db_get_compare_func(type);
+        if (!compare_func) {
+            // The type order can only be extended by looking up the types of the new entries, so it's dropped once
+            // entries get added and built again from the file types when it's needed
+            DynamicArray *merged = added && darray_get_num_items(added) > 0
+                                     ? NULL
+                                     : db_merge_changes(sorted_entries[type], NULL, NULL, false);
+            g_clear_pointer(&sorted_entries[type], darray_unref);
+            sorted_entries[type] = merged;
+            continue;
+        }
+        const bool is_metadata = type == DATABASE_INDEX_TYPE_SIZE || type == DATABASE_INDEX_TYPE_MODIFICATION_TIME;
+
+        DynamicArray *insert = db_get_entries_to_insert(added, updated, compare_func, is_metadata);
+        // Views might still use the old arrays, so they're replaced instead of modified
+        DynamicArray *merged = db_merge_changes(sorted_entries[type], insert, compare_func, is_metadata);
+        g_clear_pointer(&insert, darray_unref);
+        g_clear_pointer(&sorted_entries[type], darray_unref);
+        sorted_entries[type] = merged;
     }
-    DynamicArray *files = db->sorted_files[sort_type];
-    return files ? darray_copy(files) : NULL;
 }
 
-DynamicArray *
-db_get_folders_copy(FsearchDatabase *db) {
-    return db_get_folders_sorted_copy(db, DATABASE_INDEX_TYPE_NAME);
+static void
+db_clear_marks(DynamicArray *entries) {
+    const uint32_t num_entries = entries ? darray_get_num_items(entries) : 0;
+    for (uint32_t i = 0; i < num_entries; i++) {
+        FsearchDatabaseEntry *entry = darray_get_item(entries, i);
+        if (db_entry_get_mark(entry) == DATABASE_ENTRY_MARK_UPDATED) {
+            db_entry_set_mark(entry, DATABASE_ENTRY_MARK_NONE);
+        }
+    }
 }
 
-DynamicArray *
-db_get_files_copy(FsearchDatabase *db) {
-    return db_get_files_sorted_copy(db, DATABASE_INDEX_TYPE_NAME);
+static void
+db_mark_contents_of_removed_folders(DynamicArray *entries) {
+    const uint32_t num_entries = entries ? darray_get_num_items(entries) : 0;
+    for (uint32_t i = 0; i < num_entries; i++) {
+        FsearchDatabaseEntry *entry = darray_get_item(entries, i);
+        if (db_entry_get_mark(entry) != DATABASE_ENTRY_MARK_REMOVED && db_entry_is_removed(entry)) {
+            db_entry_set_mark(entry, DATABASE_ENTRY_MARK_REMOVED);
+        }
+    }
 }
 
 bool
-db_get_entries_sorted(FsearchDatabase *db,
-                      FsearchDatabaseIndexType requested_sort_type,
-                      FsearchDatabaseIndexType *returned_sort_type,
-                      DynamicArray **folders,
-                      DynamicArray **files) {
+db_apply_changes(FsearchDatabase *db) {
     g_assert(db);
-    g_assert(returned_sort_type);
-    g_assert(folders);
-    g_assert(files);
-    if (!is_valid_sort_type(requested_sort_type)) {
+
+    DatabaseChanges *changes = g_steal_pointer(&db->changes);
+    if (!changes) {
         return false;
     }
-
-    FsearchDatabaseIndexType sort_type = requested_sort_type;
-    if (!db_has_entries_sorted_by_type(db, requested_sort_type)) {
-        sort_type = DATABASE_INDEX_TYPE_NAME;
+    if (!db->sorted_files[DATABASE_INDEX_TYPE_NAME] || !db->sorted_folders[DATABASE_INDEX_TYPE_NAME]) {
+        g_clear_pointer(&changes, db_changes_free);
+        return false;
     }
 
-    if (!db_has_entries_sorted_by_type(db, sort_type)) {
-        return false;
+    g_autoptr(GTimer) timer = g_timer_new();
+
+    db_clear_columns(db);
+    // the folded names of the file are kept, so the next ones only have to fold the names of new entries
+    db_load_pending_folded_names(db);
+    g_clear_pointer(&db->trigrams, db_trigrams_unref);
+    db->trigrams_pending = false;
+    db_journal_add_changes(db, changes);
+    if (!db_sorts_lazily(db)) {
+        // the changes can be applied to the loaded orders, which is much cheaper than sorting them again
+        db_load_pending_sorted_sections(db);
+    }
+    // the sorted sections of the file don't know about the changes, those orders have to be sorted again
+    db->sorted_sections_pending = false;
+
+    if (changes->num_removed_folders > 0) {
+        db_mark_contents_of_removed_folders(db->sorted_folders[DATABASE_INDEX_TYPE_NAME]);
+        db_mark_contents_of_removed_folders(db->sorted_files[DATABASE_INDEX_TYPE_NAME]);
+    }
+
+    db_apply_changes_to_sorted_arrays(db->sorted_files, changes->added_files, changes->updated_files, false);
+    db_apply_changes_to_sorted_arrays(db->sorted_folders, changes->added_folders, changes->updated_folders, true);
+
+    if (changes->folder_sizes_changed && db->sorted_folders[DATABASE_INDEX_TYPE_SIZE]) {
+        // the size of all parents of changed entries is different now
+        darray_sort_by_key(db->sorted_folders[DATABASE_INDEX_TYPE_SIZE],
+                           db_get_key_func(DATABASE_INDEX_TYPE_SIZE),
+                           NULL,
+                           false,
+                           NULL);
+    }
+
+    db_clear_marks(changes->updated_files);
+    db_clear_marks(changes->updated_folders);
+    if (db_has_metadata_columns(db)) {
+        GHashTableIter iter;
+        gpointer entry = NULL;
+        gpointer values = NULL;
+        g_hash_table_iter_init(&iter, changes->metadata);
+        while (g_hash_table_iter_next(&iter, &entry, &values)) {
+            if (!db_entry_is_removed(entry)) {
+                db_add_metadata_record(db->metadata_records, entry, values);
+            }
+        }
+        FsearchDatabaseMetadata *metadata_sources[] = {db->metadata};
+        db_update_metadata(db, metadata_sources, G_N_ELEMENTS(metadata_sources));
     }
+    db_entry_update_folder_indices(db);
+    db_assign_folder_ids(db, changes->added_folders);
 
-    *folders = darray_ref(db->sorted_folders[sort_type]);
-    *files = darray_ref(db->sorted_files[sort_type]);
-    *returned_sort_type = sort_type;
+    g_debug("[db_apply_changes] added %d files and %d folders, updated %d entries, removed %d entries in %f s",
+            darray_get_num_items(changes->added_files),
+            darray_get_num_items(changes->added_folders),
+            darray_get_num_items(changes->updated_files) + darray_get_num_items(changes->updated_folders),
+            changes->num_removed_files + changes->num_removed_folders,
+            g_timer_elapsed(timer, NULL));
+
+    g_clear_pointer(&changes, db_changes_free);
     return true;
 }
 
-DynamicArray *
-db_get_folders_sorted(FsearchDatabase *db, FsearchDatabaseIndexType sort_type) {
-    g_assert(db);
-    if (!is_valid_sort_type(sort_type)) {
-        return NULL;
+static void
+db_file_id_init(DatabaseFileId *id, const struct stat *st) {
+    id->ino = st->st_ino;
+    id->size = st->st_size;
+    id->mtime = st->st_mtime;
+}
+
+static bool
+db_file_id_equal(const DatabaseFileId *id1, const DatabaseFileId *id2) {
+    return id1->ino == id2->ino && id1->size == id2->size && id1->mtime == id2->mtime;
+}
+
+static GPtrArray *
+db_journal_get_roots(FsearchDatabase *db) {
+    GPtrArray *roots = g_ptr_array_new();
+    DynamicArray *folders = db->sorted_folders[DATABASE_INDEX_TYPE_NAME];
+    const uint32_t num_folders = folders ? darray_get_num_items(folders) : 0;
+    for (uint32_t i = 0; i < num_folders; i++) {
+        FsearchDatabaseEntry *folder = darray_get_item(folders, i);
+        if (!db_entry_get_parent(folder)) {
+            g_ptr_array_add(roots, folder);
+        }
     }
+    return roots;
+}
 
-    DynamicArray *folders = db->sorted_folders[sort_type];
-    return darray_ref(folders);
+// Returns the root folder whose path is the longest prefix of path, rest is set to the remaining components
+static FsearchDatabaseEntryFolder *
+db_journal_find_root(GPtrArray *roots, const char *path, const char **rest) {
+    FsearchDatabaseEntryFolder *result = NULL;
+    size_t result_len = 0;
+    for (uint32_t i = 0; i < roots->len; i++) {
+        FsearchDatabaseEntry *root = g_ptr_array_index(roots, i);
+        g_autoptr(GString) root_path = db_entry_get_path_full(root);
+        // the path of the root folder "/" already ends with a separator
+        const size_t len = root_path->len > 0 && root_path->str[root_path->len - 1] == G_DIR_SEPARATOR
+                             ? root_path->len - 1
+                             : root_path->len;
+        if (len < result_len && result) {
+            continue;
+        }
+        if (strncmp(path, root_path->str, len) == 0 && (path[len] == '\0' || path[len] == G_DIR_SEPARATOR)) {
+            result = (FsearchDatabaseEntryFolder *)root;
+            result_len = len;
+            *rest = path[len] == G_DIR_SEPARATOR ? path + len + 1 : path + len;
+        }
+    }
+    return result;
 }
 
-DynamicArray *
-db_get_files_sorted(FsearchDatabase *db, FsearchDatabaseIndexType sort_type) {
-    g_assert(db);
-    if (!is_valid_sort_type(sort_type)) {
+static FsearchDatabaseEntry *
+db_journal_find_entry(FsearchDatabase *db, GPtrArray *roots, const char *path, bool is_folder) {
+    const char *rest = NULL;
+    FsearchDatabaseEntryFolder *folder = db_journal_find_root(roots, path, &rest);
+    if (!folder) {
         return NULL;
     }
+    if (rest[0] == '\0') {
+        return is_folder ? (FsearchDatabaseEntry *)folder : NULL;
+    }
 
-    DynamicArray *files = db->sorted_files[sort_type];
-    return darray_ref(files);
+    g_auto(GStrv) names = g_strsplit(rest, G_DIR_SEPARATOR_S, -1);
+    const guint num_names = g_strv_length(names);
+    for (guint i = 0; i < num_names; i++) {
+        const bool is_last = i == num_names - 1;
+        FsearchDatabaseEntry *entry = db_find_entry(db, folder, names[i], is_last ? is_folder : true);
+        if (!entry || is_last) {
+            return entry;
+        }
+        folder = (FsearchDatabaseEntryFolder *)entry;
+    }
+    return NULL;
 }
 
-DynamicArray *
-db_get_files(FsearchDatabase *db) {
+void
+db_sync_paths(FsearchDatabase *db, GPtrArray *paths) {
     g_assert(db);
-    return db_get_files_sorted(db, DATABASE_INDEX_TYPE_NAME);
+    g_assert(paths);
+
+    g_autoptr(GPtrArray) roots = db_journal_get_roots(db);
+    // many paths share their parent, e.g. the contents of a build folder
+    g_autoptr(GHashTable) parents = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    for (uint32_t i = 0; i < paths->len; i++) {
+        const char *path = g_ptr_array_index(paths, i);
+        const char *name = strrchr(path, G_DIR_SEPARATOR);
+        if (!name || name[1] == '\0') {
+            continue;
+        }
+        g_autofree char *parent_path = g_strndup(path, MAX(name - path, 1));
+        gpointer parent = NULL;
+        if (!g_hash_table_lookup_extended(parents, parent_path, NULL, &parent)) {
+            parent = db_journal_find_entry(db, roots, parent_path, true);
+            g_hash_table_insert(parents, g_steal_pointer(&parent_path), parent);
+        }
+        if (parent) {
+            db_sync_entry(db, parent, name + 1, NULL, NULL);
+        }
+    }
+
+    // the folders were modified by removing their contents
+    GHashTableIter iter;
+    gpointer parent = NULL;
+    g_hash_table_iter_init(&iter, parents);
+    while (g_hash_table_iter_next(&iter, NULL, &parent)) {
+        if (parent) {
+            db_sync_folder(db, parent);
+        }
+    }
 }
 
-DynamicArray *
-db_get_folders(FsearchDatabase *db) {
+void
+db_sync_folders(FsearchDatabase *db,
+                GHashTable *folders,
+                FsearchDatabaseFolderFunc folder_added_func,
+                gpointer user_data) {
     g_assert(db);
-    return db_get_folders_sorted(db, DATABASE_INDEX_TYPE_NAME);
+    g_assert(folders);
+
+    if (g_hash_table_size(folders) == 0) {
+        return;
+    }
+
+    // The children which are known already, a single pass over all entries is cheaper than searching for the
+    // children of every folder. They're collected first, so the arrays aren't iterated while they're synced.
+    g_autoptr(GPtrArray) children = g_ptr_array_new();
+    DynamicArray *entries[2] = {
+        db->sorted_files[DATABASE_INDEX_TYPE_NAME],
+        db->sorted_folders[DATABASE_INDEX_TYPE_NAME],
+    };
+    for (uint32_t i = 0; i < G_N_ELEMENTS(entries); i++) {
+        const uint32_t num_entries = entries[i] ? darray_get_num_items(entries[i]) : 0;
+        for (uint32_t j = 0; j < num_entries; j++) {
+            FsearchDatabaseEntry *entry = darray_get_item(entries[i], j);
+            FsearchDatabaseEntryFolder *parent = db_entry_get_parent(entry);
+            if (parent && g_hash_table_contains(folders, parent) && !db_entry_is_removed(entry)) {
+                g_ptr_array_add(children, entry);
+            }
+        }
+    }
+    // removed entries stay in memory, so their names are still valid after they were synced
+    for (uint32_t i = 0; i < children->len; i++) {
+        FsearchDatabaseEntry *entry = g_ptr_array_index(children, i);
+        db_sync_entry(db, db_entry_get_parent(entry), db_entry_get_name_raw(entry), folder_added_func, user_data);
+    }
+
+    // the children which are new
+    GHashTableIter iter;
+    gpointer folder = NULL;
+    g_hash_table_iter_init(&iter, folders);
+    while (g_hash_table_iter_next(&iter, &folder, NULL)) {
+        if (db_folder_is_removed(db, folder)) {
+            continue;
+        }
+        g_autoptr(GString) path = db_entry_get_path_full(folder);
+        g_autoptr(GDir) dir = g_dir_open(path->str, 0, NULL);
+        if (!dir) {
+            g_debug("[db_sync] failed to open directory: %s", path->str);
+            continue;
+        }
+        const char *name = NULL;
+        while ((name = g_dir_read_name(dir))) {
+            if (!db_find_entry(db, folder, name, false) && !db_find_entry(db, folder, name, true)) {
+                db_sync_entry(db, folder, name, folder_added_func, user_data);
+            }
+        }
+        db_sync_folder(db, folder);
+    }
 }
 
-FsearchThreadPool *
-db_get_thread_pool(FsearchDatabase *db) {
+static void
+db_journal_replay_record(FsearchDatabase *db, GPtrArray *roots, const DatabaseJournalRecord *record, const char *path) {
+    const FsearchDatabaseEntryMetadata values = {
+        .uid = record->uid,
+        .gid = record->gid,
+        .mode = (uint16_t)record->mode,
+        .atime = (time_t)record->atime,
+        .ctime = (time_t)record->ctime,
+        .btime = (time_t)record->btime,
+    };
+    const bool has_metadata = (record->flags & DATABASE_JOURNAL_RECORD_FLAG_METADATA) != 0;
+    const FsearchDatabaseEntryMetadata *metadata = has_metadata ? &values : NULL;
+    if (record->type != DATABASE_JOURNAL_RECORD_ADD) {
+        FsearchDatabaseEntry *entry = db_journal_find_entry(db, roots, path, record->is_folder);
+        if (!entry) {
+            g_debug("[db_journal] entry doesn't exist: %s", path);
+        }
+        else if (record->type == DATABASE_JOURNAL_RECORD_REMOVE) {
+            db_remove_entry(db, entry);
+        }
+        else {
+            db_update_entry(db, entry, record->size, record->mtime, metadata);
+        }
+        return;
+    }
+
+    const char *name = strrchr(path, G_DIR_SEPARATOR);
+    g_autofree char *parent_path = name ? g_strndup(path, MAX(name - path, 1)) : NULL;
+    FsearchDatabaseEntry *parent = parent_path ? db_journal_find_entry(db, roots, parent_path, true) : NULL;
+    if (!parent || name[1] == '\0') {
+        g_debug("[db_journal] parent doesn't exist: %s", path);
+        return;
+    }
+    if (db_find_entry(db, (FsearchDatabaseEntryFolder *)parent, name + 1, record->is_folder)) {
+        g_debug("[db_journal] entry already exists: %s", path);
+        return;
+    }
+    db_insert_entry(db,
+                    (FsearchDatabaseEntryFolder *)parent,
+                    name + 1,
+                    record->is_folder,
+                    record->size,
+                    record->mtime,
+                    metadata);
+}
+
+static void
+db_journal_load(FsearchDatabase *db, const char *file_path) {
+    g_autofree char *journal_path = g_strconcat(file_path, DATABASE_JOURNAL_SUFFIX, NULL);
+    g_autofree char *contents = NULL;
+    gsize length = 0;
+    if (!g_file_get_contents(journal_path, &contents, &length, NULL)) {
+        return;
+    }
+
+    const DatabaseJournalHeader *header = (const DatabaseJournalHeader *)contents;
+    if (length < sizeof(DatabaseJournalHeader) || memcmp(header->magic, DATABASE_JOURNAL_MAGIC_NUMBER, 4) != 0
+        || header->version < 1 || header->version > DATABASE_JOURNAL_VERSION
+        || !db_file_id_equal(&header->base_file_id, &db->base_file_id)) {
+        g_debug("[db_journal] journal doesn't belong to the database file, ignoring it");
+        return;
+    }
+    db_load_pending_metadata(db);
+
+    // the records of version 1 end before the metadata columns
+    const uint8_t version = header->version;
+    const gsize record_size = version == 1 ? offsetof(DatabaseJournalRecord, uid) : sizeof(DatabaseJournalRecord);
+    g_autoptr(GTimer) timer = g_timer_new();
+    g_autoptr(GPtrArray) roots = db_journal_get_roots(db);
+    uint32_t num_records = 0;
+    gsize offset = sizeof(DatabaseJournalHeader);
+    while (length - offset >= record_size) {
+        DatabaseJournalRecord record = {};
+        memcpy(&record, contents + offset, record_size);
+        if (version == 1) {
+            record.flags = 0;
+        }
+        if (record.path_len > length - offset - record_size) {
+            // the last record might be incomplete when the application was shut down while writing it
+            g_debug("[db_journal] truncated record at: %" G_GSIZE_FORMAT, offset);
+            break;
+        }
+        g_autofree char *path = g_strndup(contents + offset + record_size, record.path_len);
+        db_journal_replay_record(db, roots, &record, path);
+        offset += record_size + record.path_len;
+        num_records++;
+    }
+    db_apply_changes(db);
+    if (version == DATABASE_JOURNAL_VERSION) {
+        // those changes are part of the journal already
+        g_clear_pointer(&db->journal, g_byte_array_unref);
+    }
+    // otherwise they're written again in the current format, which replaces the old journal
+
+    g_debug("[db_journal] replayed %d records in %f s", num_records, g_timer_elapsed(timer, NULL));
+}
+
+bool
+db_file_was_replaced(FsearchDatabase *db, const char *file_path) {
     g_assert(db);
-    return db->thread_pool;
+    g_assert(file_path);
+
+    db_finish_background_save(db, false);
+    if (db->snapshot) {
+        // that's our own file, which is being written right now
+        return false;
+    }
+    struct stat st;
+    if (stat(file_path, &st) != 0) {
+        return false;
+    }
+    DatabaseFileId file_id = {};
+    db_file_id_init(&file_id, &st);
+    return !db_file_id_equal(&file_id, &db->base_file_id);
 }
 
 bool
-db_scan(FsearchDatabase *db, GCancellable *cancellable, void (*status_cb)(const char *)) {
+db_save_changes(FsearchDatabase *db, const char *path) {
     g_assert(db);
+    g_assert(path);
 
-    bool ret = false;
+    db_finish_background_save(db, false);
+    if (db->snapshot) {
+        // the journal gets replaced along with the database file, the changes are written once that's done
+        return true;
+    }
+    if ((!db->journal || db->journal->len == 0) && !db->sorted_arrays_changed) {
+        return true;
+    }
+    if (db->segments) {
+        // the changes would have to be saved along with the entries of the segments
+        g_clear_pointer(&db->journal, g_byte_array_unref);
+        return false;
+    }
 
-    db_sorted_entries_free(db);
+    g_autofree char *file_path = g_build_filename(path, "fsearch.db", NULL);
+    g_autofree char *journal_path = g_strconcat(file_path, DATABASE_JOURNAL_SUFFIX, NULL);
 
-    db->index_flags |= DATABASE_INDEX_FLAG_NAME;
-    db->index_flags |= DATABASE_INDEX_FLAG_SIZE;
-    db->index_flags |= DATABASE_INDEX_FLAG_MODIFICATION_TIME;
+    struct stat st;
+    DatabaseFileId file_id = {};
+    if (stat(file_path, &st) == 0) {
+        db_file_id_init(&file_id, &st);
+    }
+    if (!db_file_id_equal(&file_id, &db->base_file_id)) {
+        // the changes are relative to a database file which was replaced in the meantime (e.g. by a rescan),
+        // so they can't be applied to it anymore
+        g_debug("[db_journal] database file changed, discarding changes");
+        g_clear_pointer(&db->journal, g_byte_array_unref);
+        return false;
+    }
+    if (db->sorted_arrays_changed) {
+        // the journal only covers entries, new sort orders are only persisted with the database file
+        g_debug("[db_journal] sort orders were added, saving the database file");
+        return db_save_in_background(db, path);
+    }
 
-    db->sorted_files[DATABASE_INDEX_TYPE_NAME] = darray_new(1024);
-    db->sorted_folders[DATABASE_INDEX_TYPE_NAME] = darray_new(1024);
+    struct stat journal_st;
+    const uint64_t journal_size = stat(journal_path, &journal_st) == 0 ? journal_st.st_size : 0;
+    if ((double)(journal_size + db->journal->len) > (double)st.st_size * DATABASE_JOURNAL_MAX_SIZE_RATIO) {
+        g_debug("[db_journal] journal is too large, compacting it into the database file");
+        return db_save_in_background(db, path);
+    }
 
-    for (GList *l = db->indexes; l != NULL; l = l->next) {
-        FsearchIndex *fs_path = l->data;
-        if (!fs_path->path) {
-            continue;
-        }
-        if (!fs_path->enabled) {
-            continue;
-        }
-        if (fs_path->update) {
-            ret = db_scan_folder(db, fs_path->path, fs_path->one_filesystem, cancellable, status_cb) || ret;
-        }
-        if (is_cancelled(cancellable)) {
+    FILE *fp = db_file_open_locked(journal_path, "a+b");
+    if (!fp) {
+        return false;
+    }
+    DatabaseJournalHeader header = {
+        .version = DATABASE_JOURNAL_VERSION,
+        .base_file_id = db->base_file_id,
+    };
+    memcpy(header.magic, DATABASE_JOURNAL_MAGIC_NUMBER, sizeof(header.magic));
+
+    DatabaseJournalHeader current_header = {};
+    rewind(fp);
+    if (fread(&current_header, sizeof(current_header), 1, fp) != 1 || memcmp(&current_header, &header, sizeof(header))) {
+        // empty or left over from a different database file
+        if (ftruncate(fileno(fp), 0) != 0) {
+            g_clear_pointer(&fp, fclose);
             return false;
         }
+        fwrite(&header, sizeof(header), 1, fp);
     }
-    if (status_cb) {
-        status_cb(_("Sorting…"));
-    }
-    db_sort(db, cancellable);
-    if (is_cancelled(cancellable)) {
-        return false;
+    fseek(fp, 0, SEEK_END);
+    const bool res = fwrite(db->journal->data, db->journal->len, 1, fp) == 1 && fflush(fp) == 0;
+    g_clear_pointer(&fp, fclose);
+
+    if (res) {
+        g_debug("[db_journal] saved %d bytes of changes", db->journal->len);
+        g_byte_array_set_size(db->journal, 0);
     }
-    return ret;
+    return res;
+}
+
+void
+db_foreach_view(FsearchDatabase *db, GFunc func, gpointer user_data) {
+    g_assert(db);
+    g_assert(func);
+    g_list_foreach(db->db_views, func, user_data);
 }
 
 FsearchDatabase *
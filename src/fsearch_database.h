@@ -19,7 +19,18 @@
 #pragma once
 
 #include "fsearch_array.h"
+#include "fsearch_database_columns.h"
+#include "fsearch_database_entry.h"
+#include "fsearch_database_extensions.h"
+#include "fsearch_database_folded_names.h"
 #include "fsearch_database_index.h"
+#include "fsearch_database_memory_stats.h"
+#include "fsearch_database_metadata.h"
+#include "fsearch_database_scan_stats.h"
+#include "fsearch_database_search_cache.h"
+#include "fsearch_database_trigrams.h"
+#include "fsearch_database_version.h"
+#include "fsearch_duplicates.h"
 #include "fsearch_thread_pool.h"
 
 #include <gio/gio.h>
@@ -28,6 +39,13 @@
 #include <stdint.h>
 
 typedef struct FsearchDatabase FsearchDatabase;
+// see fsearch_query.h and fsearch_database_search.h
+typedef struct FsearchQuery FsearchQuery;
+typedef struct DatabaseSearchFilterMatches DatabaseSearchFilterMatches;
+typedef struct DatabaseSearchResult DatabaseSearchResult;
+typedef bool (*DatabaseSearchProgressFunc)(DatabaseSearchResult *result, gpointer user_data);
+
+typedef void (*FsearchDatabaseFolderFunc)(FsearchDatabaseEntryFolder *folder, const char *path, gpointer user_data);
 
 bool
 db_register_view(FsearchDatabase *db, gpointer view);
@@ -35,12 +53,53 @@ db_register_view(FsearchDatabase *db, gpointer view);
 bool
 db_unregister_view(FsearchDatabase *db, gpointer view);
 
+// Calls func for every view which is registered for db
+void
+db_foreach_view(FsearchDatabase *db, GFunc func, gpointer user_data);
+
 bool
 db_load(FsearchDatabase *db, const char *path, void (*status_cb)(const char *));
 
 bool
 db_scan(FsearchDatabase *db, GCancellable *cancellable, void (*status_cb)(const char *));
 
+// Scans all indexes like db_scan, but takes the contents of folders which weren't modified since reference
+// was scanned from reference, instead of reading them again. Sub folders of those are still checked for changes.
+// Indexes which have updates disabled are taken from reference as they are.
+bool
+db_scan_incremental(FsearchDatabase *db,
+                    FsearchDatabase *reference,
+                    GCancellable *cancellable,
+                    void (*status_cb)(const char *));
+
+// Scans all indexes which have updates enabled. The entries of the other indexes are taken from previous without
+// accessing the file system and without sorting them again.
+bool
+db_rescan(FsearchDatabase *db, FsearchDatabase *previous, GCancellable *cancellable, void (*status_cb)(const char *));
+
+// Scans only the index at index_path, e.g. when its own update interval is over (see FsearchIndex).
+// Like with db_rescan, all other indexes are taken from previous, whether they have updates enabled or not.
+bool
+db_rescan_index(FsearchDatabase *db,
+                FsearchDatabase *previous,
+                const char *index_path,
+                GCancellable *cancellable,
+                void (*status_cb)(const char *));
+
+// Returns the time the index at index_path was last scanned, 0 if it never was
+time_t
+db_get_index_last_updated(FsearchDatabase *db, const char *index_path);
+
+// Returns the statistics of the last scan, NULL if the database wasn't scanned.
+// Release with db_scan_stats_unref.
+FsearchDatabaseScanStats *
+db_get_scan_stats(FsearchDatabase *db);
+
+// Adds the memory used by the entries, their names, the sorted arrays and the search caches to stats. The lock must
+// be held.
+void
+db_get_memory_stats(FsearchDatabase *db, FsearchDatabaseMemoryStats *stats);
+
 FsearchDatabase *
 db_ref(FsearchDatabase *db);
 
@@ -53,6 +112,120 @@ db_new(GList *includes, GList *excludes, char **exclude_files, bool exclude_hidd
 bool
 db_save(FsearchDatabase *db, const char *path);
 
+// Takes a snapshot of the database and writes it on a low priority thread, so the database only needs to be locked
+// while the snapshot is taken. Requires the database to be locked. Returns false if it's still saving the previous
+// snapshot.
+bool
+db_save_in_background(FsearchDatabase *db, const char *path);
+
+// Waits until the database file was written by db_save_in_background (or db_save_changes). Requires the database
+// to be locked.
+void
+db_wait_for_save(FsearchDatabase *db);
+
+// Appends the changes which were applied since the database was loaded or saved to the journal next to the
+// database file in path, they're replayed by the next db_load. Saves the whole database in the background instead,
+// once the journal gets too large compared to the database file or a sort order was added with
+// db_set_entries_sorted. While the database is saved, the changes are kept until the next call. Changes relative
+// to a database file which was replaced in the meantime are discarded and false is returned.
+bool
+db_save_changes(FsearchDatabase *db, const char *path);
+
+// Returns true if the database file at file_path isn't the one the database was loaded from or saved to last,
+// e.g. because another process replaced it. Requires the database to be locked.
+bool
+db_file_was_replaced(FsearchDatabase *db, const char *file_path);
+
+// Selects the metadata which gets collected by the next db_scan. Names are always indexed.
+void
+db_set_index_flags(FsearchDatabase *db, FsearchDatabaseIndexFlags index_flags);
+
+FsearchDatabaseIndexFlags
+db_get_index_flags(FsearchDatabase *db);
+
+// Makes the next scans run in the background with low CPU and I/O priority: directory reads are rate limited,
+// sorting is done by a single thread and the scan pauses while the system is under memory pressure.
+void
+db_set_low_impact(FsearchDatabase *db, bool low_impact);
+
+// Makes db_save compress the database file with zstd. It's smaller and faster to read from slow storage,
+// but can't be mapped into memory as it is. Has no effect if FSearch was built without zstd support.
+void
+db_set_compress(FsearchDatabase *db, bool compress);
+
+// Only sorts by name when the database is scanned or loaded. All other orders stay in the database file or aren't
+// built at all until db_ensure_entries_sorted asks for them, which saves memory and startup time.
+void
+db_set_lazy_sort_indexes(FsearchDatabase *db, bool lazy_sort_indexes);
+
+// Makes db_load only decode the names and folder structure of the entries, which is all it takes to search them.
+// Their sizes, modification times and all other sort orders are loaded by db_load_remaining.
+// Scans only sort the entries by path and name then, db_load_remaining sorts them by everything else.
+void
+db_set_progressive_load(FsearchDatabase *db, bool progressive_load);
+
+// Keeps the results of recent searches until they'd use more than max_size bytes or the entries change,
+// 0 (the default) disables it
+void
+db_set_search_cache_size(FsearchDatabase *db, size_t max_size);
+
+// Runs the database in its low memory mode, if memory_budget (in bytes) isn't 0: like db_set_lazy_sort_indexes it only
+// keeps the name order, but it also doesn't build any other one on demand (db_ensure_entries_sorted fails for them,
+// so views sort their results instead), no trigram index is kept and the search cache gets at most an eighth of the
+// budget. db_get_memory_stats reports the usage against it.
+void
+db_set_memory_budget(FsearchDatabase *db, size_t memory_budget);
+
+// Keeps a trigram index of all names (disabled by default), which is built when it's first needed and stored with
+// the database. Searches for terms with at least three bytes only check the entries which contain their trigrams.
+void
+db_set_trigram_index(FsearchDatabase *db, bool trigram_index);
+
+// Hides the entries the user can't list (e.g. because they're in someone else's home folder) from the results of
+// db_search_query, for databases which were scanned by someone else. It's checked once per folder, so it's meant for
+// databases which don't change. Set it before the database gets searched.
+void
+db_set_filter_by_access(FsearchDatabase *db, bool filter_by_access);
+
+bool
+db_get_filter_by_access(FsearchDatabase *db);
+
+// Removes the entries which are hidden by db_set_filter_by_access from result
+void
+db_filter_result_by_access(FsearchDatabase *db, DatabaseSearchResult *result);
+
+// Sets the number of threads which scan the indexes (0 by default), otherwise it's the number of threads of the pool
+void
+db_set_num_scan_threads(FsearchDatabase *db, uint32_t num_threads);
+
+// Sets how long (in ms) a single filesystem call of a scan (opening, reading or stat'ing a directory or file) and the
+// scan of a whole index may take, 0 disables the limit. An index which takes longer, e.g. because it's on a network
+// mount which stopped responding, is given up on, so it can't hold back the others. It keeps its entries of the
+// previous database, if the scan has one, and is reported as stale in the scan statistics. Calls may take 30 seconds
+// and indexes as long as they need by default.
+void
+db_set_scan_timeouts(FsearchDatabase *db, uint32_t call_timeout, uint32_t root_timeout);
+
+// Loads what a progressive db_load left in the database file, or sorts what a progressive scan left out, locking
+// the database for short steps only.
+// Returns true if anything was loaded, the views have to be updated then.
+bool
+db_load_remaining(FsearchDatabase *db, GCancellable *cancellable);
+
+// Adds the entries of the database file at file_path as a read-only segment of db, e.g. a database which was built
+// on a file server. They're merged into the sort orders of db, so they're searched and sorted along with its own
+// entries. A database with segments can't be saved anymore. Requires db to be locked.
+bool
+db_add_segment(FsearchDatabase *db, const char *file_path);
+
+// Adds every file of the NULL terminated file_paths with db_add_segment, locking db for each of them.
+// Returns the number of files which could be loaded.
+uint32_t
+db_add_segments(FsearchDatabase *db, char **file_paths);
+
+uint32_t
+db_get_num_segments(FsearchDatabase *db);
+
 time_t
 db_get_timestamp(FsearchDatabase *db);
 
@@ -74,6 +247,20 @@ db_lock(FsearchDatabase *db);
 bool
 db_try_lock(FsearchDatabase *db);
 
+// Locks the database for tasks which only read it, e.g. the searches of several views can run at the same time. The
+// getters which build what they return on demand may be used, the ones which change the database may not.
+void
+db_lock_shared(FsearchDatabase *db);
+
+void
+db_unlock_shared(FsearchDatabase *db);
+
+// The sorted arrays as they were when the lock was released last. It doesn't need the lock, so it's the way to get
+// them for readers which don't need anything else (e.g. the number of entries or the entries to select), those don't
+// have to wait for searches or changes. The entries belong to the database, it must outlive the version.
+FsearchDatabaseVersion *
+db_pin_version(FsearchDatabase *db);
+
 DynamicArray *
 db_get_folders_copy(FsearchDatabase *db);
 
@@ -99,6 +286,85 @@ db_get_entries_sorted(FsearchDatabase *db,
                       DynamicArray **folders,
                       DynamicArray **files);
 
+// The sizes and modification times of entries (one of the arrays returned by db_get_entries_sorted) as columns.
+// They're cached until the entries change. The lock or the shared lock must be held.
+FsearchDatabaseColumns *
+db_get_columns(FsearchDatabase *db, DynamicArray *entries);
+
+// The position of every entry in entries (one of the arrays returned by db_get_entries_sorted) by its index, cached
+// like db_get_columns. NULL if entries isn't one of them. The lock must be held.
+FsearchDatabaseRanks *
+db_get_ranks(FsearchDatabase *db, DynamicArray *entries);
+
+// The full paths of all folders, cached like db_get_columns. The lock or the shared lock must be held.
+FsearchDatabaseFolderPaths *
+db_get_folder_paths(FsearchDatabase *db);
+
+// The folded names of all entries, loaded from the database file or folded on all threads when they're first
+// needed after the entries changed. The lock or the shared lock must be held.
+FsearchDatabaseFoldedNames *
+db_get_folded_names(FsearchDatabase *db);
+
+// The extension ids of all files, interned when the files get sorted or when they're first needed after the files
+// changed. The lock or the shared lock must be held.
+FsearchDatabaseExtensions *
+db_get_extensions(FsearchDatabase *db);
+
+// The files with the same contents, found by reading the files which share their size with others (see
+// fsearch_duplicates_find). That can take hours, so when they're first needed after the entries changed, a thread of
+// their own looks for them without holding any lock and it returns NULL with pending set in the meantime. So does it
+// while the sizes aren't loaded yet. The lock or the shared lock must be held.
+FsearchDuplicates *
+db_get_duplicates(FsearchDatabase *db, bool *pending);
+
+// Waits until db_get_duplicates doesn't have to look for duplicates anymore, for the callers which can't show that
+// they're pending. It returns right away if the sizes aren't loaded yet. The lock must not be held.
+void
+db_wait_for_duplicates(FsearchDatabase *db);
+
+// found_func gets called from the thread which looked for duplicates once it's done, e.g. to search again. Also when
+// it got cancelled because the entries changed, db_get_duplicates starts looking again then. It must not wait for the
+// database.
+void
+db_set_duplicates_found_func(FsearchDatabase *db, void (*found_func)(gpointer), gpointer user_data);
+
+// The trigram index of the name arrays, loaded from the database file or built on all threads when it's first needed
+// after the entries changed. NULL if it's disabled. The lock or the shared lock must be held.
+FsearchDatabaseTrigrams *
+db_get_trigrams(FsearchDatabase *db);
+
+// The owners, permissions and other timestamps of the name arrays, NULL if none of them are indexed. The lock or the
+// shared lock must be held.
+FsearchDatabaseMetadata *
+db_get_metadata(FsearchDatabase *db);
+
+// Which entries of the name arrays the filter of query matches, matched on all threads when the filter is first
+// needed after it or the entries changed. The matches of the last few filters are kept. NULL if query has no filter
+// or it was cancelled. The lock or the shared lock must be held.
+DatabaseSearchFilterMatches *
+db_get_filter_matches(FsearchDatabase *db, FsearchQuery *query, GCancellable *cancellable);
+
+// The results of recent searches, they're dropped when the entries change. The lock or the shared lock must be held
+// while the cache is used.
+FsearchDatabaseSearchCache *
+db_get_search_cache(FsearchDatabase *db);
+
+// Searches folders and files for query with every index of the database which helps, see db_search. They're either
+// the arrays of the database in sort_order (see db_get_entries_sorted) or, if is_refinement is set, the results of a
+// previous query. The filter time of the stats of the result is how long finding the filter matches took. Returns
+// NULL if it was cancelled. The lock or the shared lock must be held.
+DatabaseSearchResult *
+db_search_query(FsearchDatabase *db,
+                FsearchQuery *query,
+                FsearchThreadPool *pool,
+                DynamicArray *folders,
+                DynamicArray *files,
+                FsearchDatabaseIndexType sort_order,
+                bool is_refinement,
+                DatabaseSearchProgressFunc progress_func,
+                gpointer progress_func_data,
+                GCancellable *cancellable);
+
 DynamicArray *
 db_get_folders_sorted_copy(FsearchDatabase *db, FsearchDatabaseIndexType sort_type);
 
@@ -110,3 +376,54 @@ db_get_folders_sorted(FsearchDatabase *db, FsearchDatabaseIndexType sort_type);
 
 DynamicArray *
 db_get_files_sorted(FsearchDatabase *db, FsearchDatabaseIndexType sort_type);
+
+// Loads or sorts the entries by sort_type, if the database doesn't have them in this order yet. Requires the database
+// to be locked. Returns false if the database can't provide this order (e.g. because it wasn't indexed, see
+// db_set_entries_sorted) or it was cancelled.
+bool
+db_ensure_entries_sorted(FsearchDatabase *db, FsearchDatabaseIndexType sort_type, GCancellable *cancellable);
+
+// Stores files sorted by an order which the database can't build by itself (DATABASE_INDEX_TYPE_FILETYPE),
+// so it's available to all views and gets saved with the database. files must contain all files of the database.
+void
+db_set_entries_sorted(FsearchDatabase *db, FsearchDatabaseIndexType sort_type, DynamicArray *files);
+
+// Live updates: The following functions patch the database in place and require it to be locked.
+// Changes are collected and only become visible in the sorted arrays (and therefore to views) with db_apply_changes.
+// Removed entries stay in memory until the database is freed, because views might still reference them.
+
+// Brings the entry called name in parent in sync with the filesystem by adding, updating or removing it.
+// New folders are added with all of their contents, folder_added_func is called for each of them right before
+// their contents are read.
+void
+db_sync_entry(FsearchDatabase *db,
+              FsearchDatabaseEntryFolder *parent,
+              const char *name,
+              FsearchDatabaseFolderFunc folder_added_func,
+              gpointer user_data);
+
+// Updates the metadata of folder itself (modification time), not its contents
+void
+db_sync_folder(FsearchDatabase *db, FsearchDatabaseEntryFolder *folder);
+
+// Brings the entries at the full paths and their folders in sync with the filesystem, e.g. after they were deleted,
+// so they don't need to be rescanned. Paths outside of the database are skipped.
+void
+db_sync_paths(FsearchDatabase *db, GPtrArray *paths);
+
+// Brings the contents of the folders (a set of FsearchDatabaseEntryFolder) and the folders themselves in sync with
+// the filesystem, e.g. after they changed while nothing was watching them. folder_added_func is called like with
+// db_sync_entry.
+void
+db_sync_folders(FsearchDatabase *db,
+                GHashTable *folders,
+                FsearchDatabaseFolderFunc folder_added_func,
+                gpointer user_data);
+
+// Returns true if folder or one of its parents was removed since the last db_apply_changes
+bool
+db_folder_is_removed(FsearchDatabase *db, FsearchDatabaseEntryFolder *folder);
+
+// Applies all changes to the sorted arrays. Returns false if there weren't any.
+bool
+db_apply_changes(FsearchDatabase *db);
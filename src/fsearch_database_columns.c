@@ -0,0 +1,341 @@
+#define G_LOG_DOMAIN "fsearch-database-columns"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "fsearch_database_columns.h"
+
+static void
+db_columns_free(FsearchDatabaseColumns *columns) {
+    g_clear_pointer(&columns->sizes, free);
+    g_clear_pointer(&columns->mtimes, free);
+    g_clear_pointer(&columns->entries, darray_unref);
+    g_clear_pointer(&columns, free);
+}
+
+FsearchDatabaseColumns *
+db_columns_new(DynamicArray *entries, FsearchDatabaseEntryType type) {
+    g_assert(entries);
+
+    FsearchDatabaseColumns *columns = calloc(1, sizeof(FsearchDatabaseColumns));
+    g_assert(columns);
+
+    const uint32_t num_entries = darray_get_num_items(entries);
+    columns->entries = darray_ref(entries);
+    columns->type = type;
+    columns->num_entries = num_entries;
+    columns->sizes = calloc(MAX(num_entries, 1), sizeof(int64_t));
+    g_assert(columns->sizes);
+    columns->mtimes = calloc(MAX(num_entries, 1), sizeof(int64_t));
+    g_assert(columns->mtimes);
+
+    for (uint32_t i = 0; i < num_entries; i++) {
+        FsearchDatabaseEntry *entry = darray_get_item(entries, i);
+        columns->sizes[i] = db_entry_get_size(entry);
+        columns->mtimes[i] = db_entry_get_mtime(entry);
+    }
+
+    columns->ref_count = 1;
+    return columns;
+}
+
+FsearchDatabaseColumns *
+db_columns_ref(FsearchDatabaseColumns *columns) {
+    if (!columns || g_atomic_int_get(&columns->ref_count) <= 0) {
+        return NULL;
+    }
+    g_atomic_int_inc(&columns->ref_count);
+    return columns;
+}
+
+void
+db_columns_unref(FsearchDatabaseColumns *columns) {
+    if (!columns || g_atomic_int_get(&columns->ref_count) <= 0) {
+        return;
+    }
+    if (g_atomic_int_dec_and_test(&columns->ref_count)) {
+        g_clear_pointer(&columns, db_columns_free);
+    }
+}
+
+size_t
+db_columns_get_memory_size(const FsearchDatabaseColumns *columns) {
+    if (!columns) {
+        return 0;
+    }
+    return sizeof(FsearchDatabaseColumns) + 2 * MAX(columns->num_entries, 1) * sizeof(int64_t);
+}
+
+#define RANK_NONE UINT32_MAX
+// results which are more than that part of all entries are sorted by scanning a bitmap of all ranks
+#define RANKS_SCAN_FRACTION 16
+
+static void
+db_ranks_free(FsearchDatabaseRanks *ranks) {
+    g_clear_pointer(&ranks->ranks, free);
+    g_clear_pointer(&ranks->entries, darray_unref);
+    g_clear_pointer(&ranks->names, darray_unref);
+    g_clear_pointer(&ranks, free);
+}
+
+FsearchDatabaseRanks *
+db_ranks_new(DynamicArray *entries, DynamicArray *names) {
+    g_assert(entries);
+    g_assert(names);
+
+    FsearchDatabaseRanks *ranks = calloc(1, sizeof(FsearchDatabaseRanks));
+    g_assert(ranks);
+
+    const uint32_t num_entries = darray_get_num_items(entries);
+    const uint32_t num_names = darray_get_num_items(names);
+    ranks->entries = darray_ref(entries);
+    ranks->names = darray_ref(names);
+    ranks->num_entries = num_entries;
+    ranks->ranks = malloc(MAX(num_names, 1) * sizeof(uint32_t));
+    g_assert(ranks->ranks);
+    memset(ranks->ranks, 0xff, MAX(num_names, 1) * sizeof(uint32_t));
+
+    for (uint32_t i = 0; i < num_entries; i++) {
+        FsearchDatabaseEntry *entry = darray_get_item(entries, i);
+        const uint32_t idx = db_entry_get_idx(entry);
+        if (idx < num_names && darray_get_item(names, idx) == entry) {
+            ranks->ranks[idx] = i;
+        }
+    }
+
+    ranks->ref_count = 1;
+    return ranks;
+}
+
+FsearchDatabaseRanks *
+db_ranks_ref(FsearchDatabaseRanks *ranks) {
+    if (!ranks || g_atomic_int_get(&ranks->ref_count) <= 0) {
+        return NULL;
+    }
+    g_atomic_int_inc(&ranks->ref_count);
+    return ranks;
+}
+
+void
+db_ranks_unref(FsearchDatabaseRanks *ranks) {
+    if (!ranks || g_atomic_int_get(&ranks->ref_count) <= 0) {
+        return;
+    }
+    if (g_atomic_int_dec_and_test(&ranks->ref_count)) {
+        g_clear_pointer(&ranks, db_ranks_free);
+    }
+}
+
+size_t
+db_ranks_get_memory_size(const FsearchDatabaseRanks *ranks) {
+    if (!ranks) {
+        return 0;
+    }
+    return sizeof(FsearchDatabaseRanks) + MAX(darray_get_num_items(ranks->names), 1) * sizeof(uint32_t);
+}
+
+static uint64_t
+get_rank_key(void *rank) {
+    return GPOINTER_TO_UINT(rank);
+}
+
+DynamicArray *
+db_ranks_sort(const FsearchDatabaseRanks *ranks, DynamicArray *results) {
+    g_assert(ranks);
+    g_assert(results);
+
+    const uint32_t num_results = darray_get_num_items(results);
+    const uint32_t num_names = darray_get_num_items(ranks->names);
+    DynamicArray *result_ranks = darray_new(MAX(num_results, 1));
+    for (uint32_t i = 0; i < num_results; i++) {
+        FsearchDatabaseEntry *entry = darray_get_item(results, i);
+        const uint32_t idx = db_entry_get_idx(entry);
+        if (idx >= num_names || darray_get_item(ranks->names, idx) != entry || ranks->ranks[idx] == RANK_NONE) {
+            g_clear_pointer(&result_ranks, darray_unref);
+            return NULL;
+        }
+        darray_add_item(result_ranks, GUINT_TO_POINTER(ranks->ranks[idx]));
+    }
+
+    DynamicArray *sorted = darray_new(MAX(num_results, 1));
+    if (num_results > ranks->num_entries / RANKS_SCAN_FRACTION) {
+        // a bitmap of all ranks is cheaper than sorting that many of them
+        const uint32_t num_words = (ranks->num_entries + 63) / 64;
+        uint64_t *bitmap = calloc(MAX(num_words, 1), sizeof(uint64_t));
+        g_assert(bitmap);
+        for (uint32_t i = 0; i < num_results; i++) {
+            const uint32_t rank = GPOINTER_TO_UINT(darray_get_item(result_ranks, i));
+            bitmap[rank / 64] |= (uint64_t)1 << (rank % 64);
+        }
+        for (uint32_t w = 0; w < num_words; w++) {
+            for (uint64_t bits = bitmap[w]; bits; bits &= bits - 1) {
+                darray_add_item(sorted, darray_get_item(ranks->entries, w * 64 + __builtin_ctzll(bits)));
+            }
+        }
+        g_clear_pointer(&bitmap, free);
+    }
+    else {
+        darray_sort_by_key(result_ranks, get_rank_key, NULL, false, NULL);
+        for (uint32_t i = 0; i < num_results; i++) {
+            darray_add_item(sorted, darray_get_item(ranks->entries, GPOINTER_TO_UINT(darray_get_item(result_ranks, i))));
+        }
+    }
+    g_clear_pointer(&result_ranks, darray_unref);
+    return sorted;
+}
+
+#define FOLDER_PATH_NOT_BUILT UINT32_MAX
+
+static bool
+folder_paths_get_idx(const FsearchDatabaseFolderPaths *paths, FsearchDatabaseEntryFolder *folder, uint32_t *idx) {
+    const uint32_t folder_idx = db_entry_get_idx((FsearchDatabaseEntry *)folder);
+    if (folder_idx >= darray_get_num_items(paths->folders) || darray_get_item(paths->folders, folder_idx) != folder) {
+        return false;
+    }
+    *idx = folder_idx;
+    return true;
+}
+
+static void
+folder_paths_build(FsearchDatabaseFolderPaths *paths, uint32_t idx) {
+    FsearchDatabaseEntry *folder = darray_get_item(paths->folders, idx);
+    FsearchDatabaseEntryFolder *parent = db_entry_get_parent(folder);
+    uint32_t parent_idx = 0;
+    const bool has_parent = parent && folder_paths_get_idx(paths, parent, &parent_idx);
+    if (has_parent && paths->lengths[parent_idx] == FOLDER_PATH_NOT_BUILT) {
+        folder_paths_build(paths, parent_idx);
+    }
+
+    GString *buffer = paths->buffer;
+    const size_t start = buffer->len;
+    const char *name = db_entry_get_name_raw(folder);
+    if (has_parent) {
+        // the buffer might move while it grows, so the path of the parent can't be appended from it directly
+        g_string_set_size(buffer, start + paths->lengths[parent_idx]);
+        memcpy(buffer->str + start, buffer->str + paths->offsets[parent_idx], paths->lengths[parent_idx]);
+        if (name[0] != '\0') {
+            g_string_append(buffer, name);
+        }
+        g_string_append_c(buffer, G_DIR_SEPARATOR);
+    }
+    else {
+        // the full path of folders with an empty name (i.e. the root) already ends with a separator
+        db_entry_append_full_path(folder, buffer);
+        if (name[0] != '\0') {
+            g_string_append_c(buffer, G_DIR_SEPARATOR);
+        }
+    }
+
+    paths->offsets[idx] = start;
+    paths->lengths[idx] = (uint32_t)(buffer->len - start);
+}
+
+FsearchDatabaseFolderPaths *
+db_folder_paths_new(DynamicArray *folders) {
+    g_assert(folders);
+
+    FsearchDatabaseFolderPaths *paths = calloc(1, sizeof(FsearchDatabaseFolderPaths));
+    g_assert(paths);
+
+    const uint32_t num_folders = darray_get_num_items(folders);
+    paths->folders = darray_ref(folders);
+    paths->offsets = calloc(MAX(num_folders, 1), sizeof(uint64_t));
+    g_assert(paths->offsets);
+    paths->lengths = calloc(MAX(num_folders, 1), sizeof(uint32_t));
+    g_assert(paths->lengths);
+    paths->buffer = g_string_sized_new((gsize)num_folders * 32);
+
+    for (uint32_t i = 0; i < num_folders; i++) {
+        paths->lengths[i] = FOLDER_PATH_NOT_BUILT;
+    }
+    for (uint32_t i = 0; i < num_folders; i++) {
+        if (paths->lengths[i] == FOLDER_PATH_NOT_BUILT) {
+            folder_paths_build(paths, i);
+        }
+    }
+
+    paths->ref_count = 1;
+    return paths;
+}
+
+static void
+db_folder_paths_free(FsearchDatabaseFolderPaths *paths) {
+    g_clear_pointer(&paths->offsets, free);
+    g_clear_pointer(&paths->lengths, free);
+    g_string_free(g_steal_pointer(&paths->buffer), TRUE);
+    g_clear_pointer(&paths->folders, darray_unref);
+    g_clear_pointer(&paths, free);
+}
+
+size_t
+db_folder_paths_get_memory_size(const FsearchDatabaseFolderPaths *paths) {
+    if (!paths) {
+        return 0;
+    }
+    const size_t num_folders = MAX(darray_get_num_items(paths->folders), 1);
+    return sizeof(FsearchDatabaseFolderPaths) + sizeof(GString) + paths->buffer->allocated_len
+         + num_folders * (sizeof(uint64_t) + sizeof(uint32_t));
+}
+
+FsearchDatabaseFolderPaths *
+db_folder_paths_ref(FsearchDatabaseFolderPaths *paths) {
+    if (!paths || g_atomic_int_get(&paths->ref_count) <= 0) {
+        return NULL;
+    }
+    g_atomic_int_inc(&paths->ref_count);
+    return paths;
+}
+
+void
+db_folder_paths_unref(FsearchDatabaseFolderPaths *paths) {
+    if (!paths || g_atomic_int_get(&paths->ref_count) <= 0) {
+        return;
+    }
+    if (g_atomic_int_dec_and_test(&paths->ref_count)) {
+        g_clear_pointer(&paths, db_folder_paths_free);
+    }
+}
+
+bool
+db_folder_paths_get_parent_idx(const FsearchDatabaseFolderPaths *paths, FsearchDatabaseEntry *entry, uint32_t *idx) {
+    FsearchDatabaseEntryFolder *parent = db_entry_get_parent(entry);
+    return parent && folder_paths_get_idx(paths, parent, idx);
+}
+
+const char *
+db_folder_paths_get_path(const FsearchDatabaseFolderPaths *paths, uint32_t idx, size_t *len) {
+    g_assert(idx < darray_get_num_items(paths->folders));
+    *len = paths->lengths[idx];
+    return paths->buffer->str + paths->offsets[idx];
+}
+
+static bool
+folder_paths_append_parent(const FsearchDatabaseFolderPaths *paths, FsearchDatabaseEntry *entry, GString *str) {
+    uint32_t idx = 0;
+    if (!db_folder_paths_get_parent_idx(paths, entry, &idx)) {
+        return false;
+    }
+    g_string_append_len(str, paths->buffer->str + paths->offsets[idx], paths->lengths[idx]);
+    return true;
+}
+
+void
+db_folder_paths_append_path(const FsearchDatabaseFolderPaths *paths, FsearchDatabaseEntry *entry, GString *str) {
+    if (!folder_paths_append_parent(paths, entry, str)) {
+        db_entry_append_path(entry, str);
+        return;
+    }
+    if (str->len > 1) {
+        g_string_set_size(str, str->len - 1);
+    }
+}
+
+void
+db_folder_paths_append_full_path(const FsearchDatabaseFolderPaths *paths, FsearchDatabaseEntry *entry, GString *str) {
+    if (!folder_paths_append_parent(paths, entry, str)) {
+        db_entry_append_full_path(entry, str);
+        return;
+    }
+    const char *name = db_entry_get_name_raw(entry);
+    g_string_append(str, name[0] == '\0' ? G_DIR_SEPARATOR_S : name);
+}
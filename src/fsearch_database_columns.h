@@ -0,0 +1,108 @@
+#pragma once
+
+#include <glib.h>
+#include <stdint.h>
+
+#include "fsearch_array.h"
+#include "fsearch_database_entry.h"
+
+// Copies of the sizes and modification times of an array of entries (all of the same type), stored in one array
+// per attribute in the order of the entries. Filters on those attributes can stream over them while searching,
+// instead of visiting every entry.
+typedef struct FsearchDatabaseColumns {
+    // the entries the columns were created from
+    DynamicArray *entries;
+    FsearchDatabaseEntryType type;
+    uint32_t num_entries;
+
+    int64_t *sizes;
+    int64_t *mtimes;
+
+    volatile int ref_count;
+} FsearchDatabaseColumns;
+
+FsearchDatabaseColumns *
+db_columns_new(DynamicArray *entries, FsearchDatabaseEntryType type);
+
+FsearchDatabaseColumns *
+db_columns_ref(FsearchDatabaseColumns *columns);
+
+void
+db_columns_unref(FsearchDatabaseColumns *columns);
+
+// The number of bytes allocated for the columns, without the entries
+size_t
+db_columns_get_memory_size(const FsearchDatabaseColumns *columns);
+
+// The position of every entry of one of the sorted arrays, looked up by the index of the entry (i.e. its position in
+// the name array), so results can be brought into that order without walking the whole array
+typedef struct FsearchDatabaseRanks {
+    // the sorted array and the name array with the same entries
+    DynamicArray *entries;
+    DynamicArray *names;
+    uint32_t num_entries;
+    uint32_t *ranks;
+
+    volatile int ref_count;
+} FsearchDatabaseRanks;
+
+// The indices of the entries of names must be up to date
+FsearchDatabaseRanks *
+db_ranks_new(DynamicArray *entries, DynamicArray *names);
+
+FsearchDatabaseRanks *
+db_ranks_ref(FsearchDatabaseRanks *ranks);
+
+void
+db_ranks_unref(FsearchDatabaseRanks *ranks);
+
+// The number of bytes allocated for the ranks, without the entries
+size_t
+db_ranks_get_memory_size(const FsearchDatabaseRanks *ranks);
+
+// A new array with the entries of results in the order of ranks->entries, in time linear in the number of results.
+// NULL if one of them isn't part of it.
+DynamicArray *
+db_ranks_sort(const FsearchDatabaseRanks *ranks, DynamicArray *results);
+
+// The full paths of folders (with a trailing separator), so the paths of their children can be built with a
+// single copy instead of walking up to the root for every entry
+typedef struct FsearchDatabaseFolderPaths {
+    // sorted by name, so the index of a folder is its position in this array
+    DynamicArray *folders;
+    GString *buffer;
+    // position and length of the path of each folder in buffer
+    uint64_t *offsets;
+    uint32_t *lengths;
+
+    volatile int ref_count;
+} FsearchDatabaseFolderPaths;
+
+FsearchDatabaseFolderPaths *
+db_folder_paths_new(DynamicArray *folders);
+
+FsearchDatabaseFolderPaths *
+db_folder_paths_ref(FsearchDatabaseFolderPaths *paths);
+
+void
+db_folder_paths_unref(FsearchDatabaseFolderPaths *paths);
+
+// The number of bytes allocated for the paths, without the folders
+size_t
+db_folder_paths_get_memory_size(const FsearchDatabaseFolderPaths *paths);
+
+// The position of the parent of entry in the folders of paths, false if it isn't one of them
+bool
+db_folder_paths_get_parent_idx(const FsearchDatabaseFolderPaths *paths, FsearchDatabaseEntry *entry, uint32_t *idx);
+
+// The full path of the folder at idx, with a trailing separator and not NUL terminated
+const char *
+db_folder_paths_get_path(const FsearchDatabaseFolderPaths *paths, uint32_t idx, size_t *len);
+
+// Same as db_entry_append_path and db_entry_append_full_path. Entries whose parent isn't part of paths
+// (e.g. because it was added afterwards) are handled by those.
+void
+db_folder_paths_append_path(const FsearchDatabaseFolderPaths *paths, FsearchDatabaseEntry *entry, GString *str);
+
+void
+db_folder_paths_append_full_path(const FsearchDatabaseFolderPaths *paths, FsearchDatabaseEntry *entry, GString *str);
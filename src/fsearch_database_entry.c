@@ -1,4 +1,5 @@
 #include "fsearch_database_entry.h"
+#include "fsearch_array.h"
 #include "fsearch_file_utils.h"
 #include "fsearch_string_utils.h"
 
@@ -10,16 +11,38 @@
 #include "strverscmp.h"
 #endif
 
+// Larger sizes are clamped, that's 16 PiB, which leaves space for the type, mark, flags and the upper bits of the
+// modification time in the same word
+#define DB_ENTRY_SIZE_BITS 54
+#define DB_ENTRY_SIZE_MAX ((INT64_C(1) << DB_ENTRY_SIZE_BITS) - 1)
+
+// Modification times are signed 34 bit seconds since the Unix epoch, that's the years 1697 to 2242. The lower 32 bits
+// are in mtime, the upper ones in mtime_high, times outside of the range get clamped.
+#define DB_ENTRY_MTIME_HIGH_BITS 2
+#define DB_ENTRY_MTIME_BITS (32 + DB_ENTRY_MTIME_HIGH_BITS)
+#define DB_ENTRY_MTIME_MIN (-(INT64_C(1) << (DB_ENTRY_MTIME_BITS - 1)))
+#define DB_ENTRY_MTIME_MAX ((INT64_C(1) << (DB_ENTRY_MTIME_BITS - 1)) - 1)
+
+// The number of threads which read the start of files to sniff their content type at the same time
+#define MAX_CONTENT_TYPE_SNIFFS 4
+
+// There can be tens of millions of entries, so they're packed into 32 bytes (on 64 bit systems)
 struct FsearchDatabaseEntry {
     FsearchDatabaseEntryFolder *parent;
     char *name;
-    off_t size;
-    time_t mtime;
+    uint64_t size : DB_ENTRY_SIZE_BITS;
+    uint64_t type : 2;
+    uint64_t mark : 4;
+    // the name is owned by someone else (e.g. the mapped database file) and must not be freed
+    uint64_t name_borrowed : 1;
+    // the name only consists of ASCII characters
+    uint64_t name_is_ascii : 1;
+    uint64_t mtime_high : DB_ENTRY_MTIME_HIGH_BITS;
+    // the lower 32 bits of the modification time
+    uint32_t mtime;
 
     // idx: index of this entry in the sorted list at pos DATABASE_INDEX_TYPE_NAME
     uint32_t idx;
-    uint8_t type;
-    uint8_t mark;
 };
 
 struct FsearchDatabaseEntryFile {
@@ -33,8 +56,21 @@ struct FsearchDatabaseEntryFolder {
     uint32_t db_idx;
     uint32_t num_files;
     uint32_t num_folders;
+    // stays the same across rescans and is stored in the database file
+    uint32_t id;
+    // Both are only valid if path_rank isn't 0, see db_entry_folders_update_ranks. The rank is the position + 1 of
+    // the folder among all folders sorted by their full path.
+    uint32_t depth;
+    uint32_t path_rank;
 };
 
+static inline int64_t
+get_mtime(FsearchDatabaseEntry *entry) {
+    // sign extend the upper bits
+    const uint64_t bits = ((uint64_t)entry->mtime_high << 32) | entry->mtime;
+    return (int64_t)(bits << (64 - DB_ENTRY_MTIME_BITS)) >> (64 - DB_ENTRY_MTIME_BITS);
+}
+
 static void
 build_path_recursively(FsearchDatabaseEntryFolder *folder, GString *str) {
     if (G_UNLIKELY(!folder)) {
@@ -78,6 +114,18 @@ db_entry_folder_get_num_folders(FsearchDatabaseEntryFolder *entry) {
     return entry->num_folders;
 }
 
+uint32_t
+db_entry_folder_get_id(FsearchDatabaseEntryFolder *entry) {
+    g_assert(entry->super.type == DATABASE_ENTRY_TYPE_FOLDER);
+    return entry->id;
+}
+
+void
+db_entry_folder_set_id(FsearchDatabaseEntryFolder *entry, uint32_t id) {
+    g_assert(entry->super.type == DATABASE_ENTRY_TYPE_FOLDER);
+    entry->id = id;
+}
+
 size_t
 db_entry_get_sizeof_folder_entry() {
     return sizeof(FsearchDatabaseEntryFolder);
@@ -118,12 +166,12 @@ db_entry_append_full_path(FsearchDatabaseEntry *entry, GString *str) {
 
 time_t
 db_entry_get_mtime(FsearchDatabaseEntry *entry) {
-    return entry ? entry->mtime : 0;
+    return entry ? (time_t)get_mtime(entry) : 0;
 }
 
 off_t
 db_entry_get_size(FsearchDatabaseEntry *entry) {
-    return entry ? entry->size : 0;
+    return entry ? (off_t)entry->size : 0;
 }
 
 const char *
@@ -159,6 +207,11 @@ db_entry_get_name_raw(FsearchDatabaseEntry *entry) {
     return entry ? entry->name : NULL;
 }
 
+bool
+db_entry_name_is_ascii(FsearchDatabaseEntry *entry) {
+    return entry->name_is_ascii;
+}
+
 FsearchDatabaseEntryFolder *
 db_entry_get_parent(FsearchDatabaseEntry *entry) {
     return entry ? entry->parent : NULL;
@@ -169,8 +222,19 @@ db_entry_get_type(FsearchDatabaseEntry *entry) {
     return entry ? entry->type : DATABASE_ENTRY_TYPE_NONE;
 }
 
-void
-db_entry_append_content_type(FsearchDatabaseEntry *entry, GString *str) {
+static GMutex content_type_sniff_mutex;
+static GCond content_type_sniff_cond;
+static uint32_t num_content_type_sniffs;
+
+static void
+append_sniffed_content_type(FsearchDatabaseEntry *entry, GString *str) {
+    g_mutex_lock(&content_type_sniff_mutex);
+    while (num_content_type_sniffs >= MAX_CONTENT_TYPE_SNIFFS) {
+        g_cond_wait(&content_type_sniff_cond, &content_type_sniff_mutex);
+    }
+    num_content_type_sniffs++;
+    g_mutex_unlock(&content_type_sniff_mutex);
+
     g_autoptr(GString) path = db_entry_get_path_full(entry);
     g_autoptr(GFile) file = g_file_new_for_path(path->str);
     g_autoptr(GError) error = NULL;
@@ -181,6 +245,36 @@ db_entry_append_content_type(FsearchDatabaseEntry *entry, GString *str) {
         content_type = g_file_info_get_content_type(info);
     }
     g_string_append(str, content_type ? content_type : "unknown");
+
+    g_mutex_lock(&content_type_sniff_mutex);
+    num_content_type_sniffs--;
+    g_cond_signal(&content_type_sniff_cond);
+    g_mutex_unlock(&content_type_sniff_mutex);
+}
+
+void
+db_entry_append_content_type(FsearchDatabaseEntry *entry, GString *str) {
+    // GIO only reads the file when the type it guesses from the name is uncertain, and it doesn't guess at all for
+    // folders and empty files
+    const char *mime_type = NULL;
+    if (db_entry_is_folder(entry)) {
+        mime_type = "inode/directory";
+    }
+    else if (db_entry_get_size(entry) == 0) {
+        mime_type = "application/x-zerosize";
+    }
+    if (mime_type) {
+        g_autofree char *content_type = g_content_type_from_mime_type(mime_type);
+        g_string_append(str, content_type ? content_type : mime_type);
+        return;
+    }
+    gboolean uncertain = FALSE;
+    g_autofree char *content_type = g_content_type_guess(db_entry_get_name_raw(entry), NULL, 0, &uncertain);
+    if (content_type && !uncertain) {
+        g_string_append(str, content_type);
+        return;
+    }
+    append_sniffed_content_type(entry, str);
 }
 
 uint8_t
@@ -198,13 +292,24 @@ db_entry_destroy(FsearchDatabaseEntry *entry) {
     if (G_UNLIKELY(!entry)) {
         return;
     }
+    if (entry->name_borrowed) {
+        entry->name = NULL;
+        entry->name_borrowed = false;
+        return;
+    }
     g_clear_pointer(&entry->name, free);
 }
 
 uint32_t
 db_entry_get_depth(FsearchDatabaseEntry *entry) {
     uint32_t depth = 0;
-    while (entry && entry->parent) {
+    while (entry) {
+        if (entry->type == DATABASE_ENTRY_TYPE_FOLDER && ((FsearchDatabaseEntryFolder *)entry)->path_rank) {
+            return depth + ((FsearchDatabaseEntryFolder *)entry)->depth;
+        }
+        if (!entry->parent) {
+            break;
+        }
         entry = (FsearchDatabaseEntry *)entry->parent;
         depth++;
     }
@@ -273,7 +378,7 @@ db_entry_compare_entries_by_type(FsearchDatabaseEntry **a, FsearchDatabaseEntry
 
 int
 db_entry_compare_entries_by_modification_time(FsearchDatabaseEntry **a, FsearchDatabaseEntry **b) {
-    return ((*a)->mtime > (*b)->mtime) ? 1 : -1;
+    return (get_mtime(*a) > get_mtime(*b)) ? 1 : -1;
 }
 
 int
@@ -285,6 +390,20 @@ int
 db_entry_compare_entries_by_path(FsearchDatabaseEntry **a, FsearchDatabaseEntry **b) {
     FsearchDatabaseEntry *entry_a = *a;
     FsearchDatabaseEntry *entry_b = *b;
+    FsearchDatabaseEntryFolder *parent_a = entry_a->parent;
+    FsearchDatabaseEntryFolder *parent_b = entry_b->parent;
+    if (parent_a == parent_b) {
+        return db_entry_compare_entries_by_name(a, b);
+    }
+    // The entries are ordered by the full path of their parent folder first, which is what the ranks stand for. The
+    // roots come before everything else.
+    if ((!parent_a || parent_a->path_rank) && (!parent_b || parent_b->path_rank)) {
+        const uint32_t rank_a = parent_a ? parent_a->path_rank : 0;
+        const uint32_t rank_b = parent_b ? parent_b->path_rank : 0;
+        return rank_a < rank_b ? -1 : rank_a > rank_b ? 1 : db_entry_compare_entries_by_name(a, b);
+    }
+
+    // one of the folders was added after the ranks were computed
     const uint32_t a_depth = db_entry_get_depth(entry_a);
     const uint32_t b_depth = db_entry_get_depth(entry_b);
 
@@ -307,11 +426,12 @@ db_entry_compare_entries_by_path(FsearchDatabaseEntry **a, FsearchDatabaseEntry
     }
 }
 
-static void
+void
 db_entry_update_folder_size(FsearchDatabaseEntryFolder *folder, off_t size) {
     if (!folder) {
         return;
     }
+    // the size of a folder can't drop below zero, so this wraps around correctly if size is negative
     folder->super.size += size;
     db_entry_update_folder_size(folder->super.parent, size);
 }
@@ -333,27 +453,77 @@ db_entry_compare_entries_by_name(FsearchDatabaseEntry **a, FsearchDatabaseEntry
     return strverscmp(name_a ? name_a : "", name_b ? name_b : "");
 }
 
+uint64_t
+db_entry_get_name_sort_key(FsearchDatabaseEntry *entry) {
+    const char *name = entry->name ? entry->name : "";
+    uint64_t key = 0;
+    uint32_t i = 0;
+    for (; i < sizeof(key) && name[i]; i++) {
+        if (name[i] >= '0' && name[i] <= '9') {
+            // strverscmp compares numbers as a whole, but all digits sort the same way against the other bytes
+            key = (key << 8) | '0';
+            i++;
+            break;
+        }
+        key = (key << 8) | (unsigned char)name[i];
+    }
+    return i < sizeof(key) ? key << (8 * (sizeof(key) - i)) : key;
+}
+
 void
 db_entry_set_mtime(FsearchDatabaseEntry *entry, time_t mtime) {
-    entry->mtime = mtime;
+    const uint64_t bits = (uint64_t)CLAMP((int64_t)mtime, DB_ENTRY_MTIME_MIN, DB_ENTRY_MTIME_MAX);
+    entry->mtime = (uint32_t)bits;
+    entry->mtime_high = (bits >> 32) & ((1 << DB_ENTRY_MTIME_HIGH_BITS) - 1);
 }
 
 void
 db_entry_set_size(FsearchDatabaseEntry *entry, off_t size) {
-    entry->size = size;
+    entry->size = (uint64_t)CLAMP((int64_t)size, 0, DB_ENTRY_SIZE_MAX);
+}
+
+static bool
+is_ascii(const char *str) {
+    for (const char *c = str; *c; c++) {
+        if ((unsigned char)*c >= 0x80) {
+            return false;
+        }
+    }
+    return true;
 }
 
 void
 db_entry_set_name(FsearchDatabaseEntry *entry, const char *name) {
-    if (entry->name) {
+    if (entry->name && !entry->name_borrowed) {
         free(entry->name);
     }
     entry->name = strdup(name ? name : "");
+    entry->name_borrowed = false;
+    entry->name_is_ascii = is_ascii(entry->name);
+}
+
+void
+db_entry_set_name_borrowed(FsearchDatabaseEntry *entry, const char *name) {
+    if (entry->name && !entry->name_borrowed) {
+        free(entry->name);
+    }
+    entry->name = (char *)name;
+    entry->name_borrowed = true;
+    entry->name_is_ascii = is_ascii(entry->name);
+}
+
+// The depth and rank of a folder are only valid as long as its parent stays the same
+static void
+db_entry_reset_rank(FsearchDatabaseEntry *entry) {
+    if (entry->type == DATABASE_ENTRY_TYPE_FOLDER) {
+        ((FsearchDatabaseEntryFolder *)entry)->path_rank = 0;
+    }
 }
 
 void
 db_entry_set_parent(FsearchDatabaseEntry *entry, FsearchDatabaseEntryFolder *parent) {
     entry->parent = parent;
+    db_entry_reset_rank(entry);
     if (parent) {
         g_assert(parent->super.type == DATABASE_ENTRY_TYPE_FOLDER);
         if (entry->type == DATABASE_ENTRY_TYPE_FOLDER) {
@@ -365,8 +535,24 @@ db_entry_set_parent(FsearchDatabaseEntry *entry, FsearchDatabaseEntryFolder *par
     }
 }
 
+void
+db_entry_set_parent_concurrent(FsearchDatabaseEntry *entry, FsearchDatabaseEntryFolder *parent) {
+    entry->parent = parent;
+    db_entry_reset_rank(entry);
+    if (parent) {
+        g_assert(parent->super.type == DATABASE_ENTRY_TYPE_FOLDER);
+        if (entry->type == DATABASE_ENTRY_TYPE_FOLDER) {
+            g_atomic_int_inc((gint *)&parent->num_folders);
+        }
+        else if (entry->type == DATABASE_ENTRY_TYPE_FILE) {
+            g_atomic_int_inc((gint *)&parent->num_files);
+        }
+    }
+}
+
 void
 db_entry_set_type(FsearchDatabaseEntry *entry, FsearchDatabaseEntryType type) {
+    g_assert(type < NUM_DATABASE_ENTRY_TYPES);
     entry->type = type;
 }
 
@@ -377,6 +563,7 @@ db_entry_set_idx(FsearchDatabaseEntry *entry, uint32_t idx) {
 
 void
 db_entry_set_mark(FsearchDatabaseEntry *entry, uint8_t mark) {
+    g_assert(mark < 16);
     entry->mark = mark;
 }
 
@@ -384,3 +571,171 @@ void
 db_entry_update_parent_size(FsearchDatabaseEntry *entry) {
     db_entry_update_folder_size(entry->parent, entry->size);
 }
+
+void
+db_entry_folders_aggregate(DynamicArray *folders, DynamicArray *files) {
+    const uint32_t num_folders = folders ? darray_get_num_items(folders) : 0;
+    const uint32_t num_files = files ? darray_get_num_items(files) : 0;
+    if (num_folders == 0) {
+        return;
+    }
+
+    uint32_t *depths = malloc(num_folders * sizeof(uint32_t));
+    g_assert(depths);
+    uint32_t max_depth = 0;
+    for (uint32_t i = 0; i < num_folders; i++) {
+        FsearchDatabaseEntryFolder *folder = darray_get_item(folders, i);
+        folder->super.size = 0;
+        folder->num_files = 0;
+        folder->num_folders = 0;
+        depths[i] = db_entry_get_depth((FsearchDatabaseEntry *)folder);
+        max_depth = MAX(max_depth, depths[i]);
+    }
+
+    for (uint32_t i = 0; i < num_files; i++) {
+        FsearchDatabaseEntry *file = darray_get_item(files, i);
+        FsearchDatabaseEntryFolder *parent = file->parent;
+        if (parent) {
+            parent->super.size += file->size;
+            parent->num_files++;
+        }
+    }
+
+    // order the folders from the deepest to the top, so every folder is complete before it's added to its parent
+    uint32_t *offsets = calloc(max_depth + 2, sizeof(uint32_t));
+    g_assert(offsets);
+    for (uint32_t i = 0; i < num_folders; i++) {
+        offsets[max_depth - depths[i] + 1]++;
+    }
+    for (uint32_t i = 1; i <= max_depth + 1; i++) {
+        offsets[i] += offsets[i - 1];
+    }
+    FsearchDatabaseEntryFolder **ordered = malloc(num_folders * sizeof(FsearchDatabaseEntryFolder *));
+    g_assert(ordered);
+    for (uint32_t i = 0; i < num_folders; i++) {
+        ordered[offsets[max_depth - depths[i]]++] = darray_get_item(folders, i);
+    }
+
+    for (uint32_t i = 0; i < num_folders; i++) {
+        FsearchDatabaseEntryFolder *folder = ordered[i];
+        FsearchDatabaseEntryFolder *parent = folder->super.parent;
+        if (parent) {
+            parent->super.size += folder->super.size;
+            parent->num_folders++;
+        }
+    }
+
+    g_clear_pointer(&ordered, free);
+    g_clear_pointer(&offsets, free);
+    g_clear_pointer(&depths, free);
+}
+
+// While the ranks are computed, path_rank is the position + 1 of a folder among those with the same depth
+static int
+compare_folders_by_level_rank(const void *a, const void *b) {
+    FsearchDatabaseEntryFolder *folder_a = *(FsearchDatabaseEntryFolder **)a;
+    FsearchDatabaseEntryFolder *folder_b = *(FsearchDatabaseEntryFolder **)b;
+    const uint32_t rank_a = folder_a->super.parent ? folder_a->super.parent->path_rank : 0;
+    const uint32_t rank_b = folder_b->super.parent ? folder_b->super.parent->path_rank : 0;
+    if (rank_a != rank_b) {
+        return rank_a < rank_b ? -1 : 1;
+    }
+    return strverscmp(folder_a->super.name ? folder_a->super.name : "",
+                      folder_b->super.name ? folder_b->super.name : "");
+}
+
+void
+db_entry_folders_update_ranks(DynamicArray *folders) {
+    const uint32_t num_folders = folders ? darray_get_num_items(folders) : 0;
+    if (num_folders == 0) {
+        return;
+    }
+
+    uint32_t max_depth = 0;
+    for (uint32_t i = 0; i < num_folders; i++) {
+        FsearchDatabaseEntryFolder *folder = darray_get_item(folders, i);
+        folder->path_rank = 0;
+    }
+    for (uint32_t i = 0; i < num_folders; i++) {
+        FsearchDatabaseEntryFolder *folder = darray_get_item(folders, i);
+        folder->depth = db_entry_get_depth((FsearchDatabaseEntry *)folder);
+        max_depth = MAX(max_depth, folder->depth);
+    }
+
+    // group the folders by their depth, the order within a group stays the same
+    uint32_t *level_starts = calloc(max_depth + 2, sizeof(uint32_t));
+    g_assert(level_starts);
+    for (uint32_t i = 0; i < num_folders; i++) {
+        FsearchDatabaseEntryFolder *folder = darray_get_item(folders, i);
+        level_starts[folder->depth + 1]++;
+    }
+    for (uint32_t i = 1; i <= max_depth + 1; i++) {
+        level_starts[i] += level_starts[i - 1];
+    }
+    FsearchDatabaseEntryFolder **ordered = malloc(num_folders * sizeof(FsearchDatabaseEntryFolder *));
+    g_assert(ordered);
+    uint32_t *positions = malloc((max_depth + 1) * sizeof(uint32_t));
+    g_assert(positions);
+    memcpy(positions, level_starts, (max_depth + 1) * sizeof(uint32_t));
+    for (uint32_t i = 0; i < num_folders; i++) {
+        FsearchDatabaseEntryFolder *folder = darray_get_item(folders, i);
+        ordered[positions[folder->depth]++] = folder;
+    }
+
+    // Sort every level by the rank of the parents and the name, which is the order of their full paths. Folders which
+    // come in path order (e.g. those of a database file) don't need to be sorted again.
+    for (uint32_t depth = 0; depth <= max_depth; depth++) {
+        FsearchDatabaseEntryFolder **level = ordered + level_starts[depth];
+        const uint32_t num_level_folders = level_starts[depth + 1] - level_starts[depth];
+        bool is_sorted = true;
+        for (uint32_t i = 1; i < num_level_folders && is_sorted; i++) {
+            is_sorted = compare_folders_by_level_rank(&level[i - 1], &level[i]) <= 0;
+        }
+        if (!is_sorted) {
+            qsort(level, num_level_folders, sizeof(FsearchDatabaseEntryFolder *), compare_folders_by_level_rank);
+        }
+        for (uint32_t i = 0; i < num_level_folders; i++) {
+            level[i]->path_rank = i + 1;
+        }
+    }
+
+    // The children of a folder are next to each other in the following level, in the order of their names. So the
+    // position of the first one of them is the number of children of all folders before it.
+    uint32_t *num_children = calloc(num_folders, sizeof(uint32_t));
+    g_assert(num_children);
+    for (uint32_t depth = 1; depth <= max_depth; depth++) {
+        for (uint32_t i = level_starts[depth]; i < level_starts[depth + 1]; i++) {
+            num_children[level_starts[depth - 1] + ordered[i]->super.parent->path_rank - 1]++;
+        }
+    }
+    uint32_t *first_child = malloc(num_folders * sizeof(uint32_t));
+    g_assert(first_child);
+    uint32_t next_child = level_starts[1];
+    for (uint32_t i = 0; i < num_folders; i++) {
+        first_child[i] = next_child;
+        next_child += num_children[i];
+    }
+
+    // a depth-first walk visits the folders in the order of their full paths
+    uint32_t *stack = malloc(num_folders * sizeof(uint32_t));
+    g_assert(stack);
+    uint32_t stack_size = 0;
+    for (uint32_t i = level_starts[1]; i > 0; i--) {
+        stack[stack_size++] = i - 1;
+    }
+    uint32_t rank = 1;
+    while (stack_size > 0) {
+        const uint32_t pos = stack[--stack_size];
+        ordered[pos]->path_rank = rank++;
+        for (uint32_t i = first_child[pos] + num_children[pos]; i > first_child[pos]; i--) {
+            stack[stack_size++] = i - 1;
+        }
+    }
+
+    g_clear_pointer(&stack, free);
+    g_clear_pointer(&first_child, free);
+    g_clear_pointer(&num_children, free);
+    g_clear_pointer(&positions, free);
+    g_clear_pointer(&ordered, free);
+    g_clear_pointer(&level_starts, free);
+}
@@ -4,6 +4,8 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "fsearch_array.h"
+
 typedef enum {
     DATABASE_ENTRY_TYPE_NONE,
     DATABASE_ENTRY_TYPE_FOLDER,
@@ -41,6 +43,13 @@ db_entry_folder_get_num_files(FsearchDatabaseEntryFolder *entry);
 uint32_t
 db_entry_folder_get_num_folders(FsearchDatabaseEntryFolder *entry);
 
+// The id of a folder identifies it across rescans of the same database, 0 if it hasn't been assigned one yet
+uint32_t
+db_entry_folder_get_id(FsearchDatabaseEntryFolder *entry);
+
+void
+db_entry_folder_set_id(FsearchDatabaseEntryFolder *entry, uint32_t id);
+
 void
 db_entry_set_idx(FsearchDatabaseEntry *entry, uint32_t idx);
 
@@ -56,15 +65,41 @@ db_entry_set_mark(FsearchDatabaseEntry *entry, uint8_t mark);
 void
 db_entry_set_name(FsearchDatabaseEntry *entry, const char *name);
 
+// Like db_entry_set_name, but name isn't copied. It must stay valid for the lifetime of the entry.
+void
+db_entry_set_name_borrowed(FsearchDatabaseEntry *entry, const char *name);
+
 void
 db_entry_set_parent(FsearchDatabaseEntry *entry, FsearchDatabaseEntryFolder *parent);
 
+// Same as db_entry_set_parent, but the counters of the parent are updated atomically,
+// so entries which share a parent can be assigned to it from multiple threads at once
+void
+db_entry_set_parent_concurrent(FsearchDatabaseEntry *entry, FsearchDatabaseEntryFolder *parent);
+
 void
 db_entry_set_type(FsearchDatabaseEntry *entry, FsearchDatabaseEntryType type);
 
 void
 db_entry_update_parent_size(FsearchDatabaseEntry *entry);
 
+// Adds size (which might be negative) to folder and all of its parents
+void
+db_entry_update_folder_size(FsearchDatabaseEntryFolder *folder, off_t size);
+
+// Computes the size and the number of files and folders of all folders from their children, in a single bottom-up
+// pass instead of walking up the parents of every file. folders has to contain the parents of all entries, except for
+// those of the roots.
+void
+db_entry_folders_aggregate(DynamicArray *folders, DynamicArray *files);
+
+// Remembers the depth of all folders and their rank in the order of their full paths, so neither of them has to walk
+// up the parents anymore: db_entry_get_depth is O(1) and db_entry_compare_entries_by_path compares the ranks of
+// the parents and the names. folders has to contain the parents of all of them and nothing may use the ranks in the
+// meantime. Folders which get a (new) parent afterwards have none, comparing them falls back to their parents.
+void
+db_entry_folders_update_ranks(DynamicArray *folders);
+
 uint8_t
 db_entry_get_mark(FsearchDatabaseEntry *entry);
 
@@ -104,12 +139,17 @@ db_entry_get_name_raw_for_display(FsearchDatabaseEntry *entry);
 const char *
 db_entry_get_name_raw(FsearchDatabaseEntry *entry);
 
+// Determined when the name is set
+bool
+db_entry_name_is_ascii(FsearchDatabaseEntry *entry);
+
 FsearchDatabaseEntryFolder *
 db_entry_get_parent(FsearchDatabaseEntry *entry);
 
 FsearchDatabaseEntryType
 db_entry_get_type(FsearchDatabaseEntry *entry);
 
+// Thread safe, but it might have to read the start of the file
 void
 db_entry_append_content_type(FsearchDatabaseEntry *entry, GString *str);
 
@@ -136,3 +176,8 @@ db_entry_compare_entries_by_path(FsearchDatabaseEntry **a, FsearchDatabaseEntry
 
 int
 db_entry_compare_entries_by_name(FsearchDatabaseEntry **a, FsearchDatabaseEntry **b);
+
+// The first bytes of the name up to its first digit packed into a number. Names with different keys are in the order
+// of their keys by db_entry_compare_entries_by_name, those with the same key have to be compared with it.
+uint64_t
+db_entry_get_name_sort_key(FsearchDatabaseEntry *entry);
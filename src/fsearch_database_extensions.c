@@ -0,0 +1,187 @@
+#define G_LOG_DOMAIN "fsearch-database-extensions"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "fsearch_database_extensions.h"
+
+static void
+db_extensions_free(FsearchDatabaseExtensions *extensions) {
+    g_clear_pointer(&extensions->ids, free);
+    g_clear_pointer(&extensions->ranks, free);
+    g_clear_pointer(&extensions->posting_offsets, free);
+    g_clear_pointer(&extensions->postings, free);
+    g_clear_pointer(&extensions->names, g_ptr_array_unref);
+    g_clear_pointer(&extensions->files, darray_unref);
+    g_clear_pointer(&extensions, free);
+}
+
+static gint
+compare_rank(gconstpointer a, gconstpointer b, gpointer data) {
+    GPtrArray *names = data;
+    return strcmp(g_ptr_array_index(names, *(const uint32_t *)a), g_ptr_array_index(names, *(const uint32_t *)b));
+}
+
+FsearchDatabaseExtensions *
+db_extensions_new(DynamicArray *files) {
+    g_assert(files);
+
+    FsearchDatabaseExtensions *extensions = calloc(1, sizeof(FsearchDatabaseExtensions));
+    g_assert(extensions);
+
+    const uint32_t num_files = darray_get_num_items(files);
+    extensions->files = darray_ref(files);
+    extensions->ids = calloc(MAX(num_files, 1), sizeof(uint32_t));
+    g_assert(extensions->ids);
+    extensions->names = g_ptr_array_new_with_free_func(g_free);
+    g_ptr_array_add(extensions->names, g_strdup(""));
+
+    // the keys point into the names array
+    g_autoptr(GHashTable) ids = g_hash_table_new(g_str_hash, g_str_equal);
+    for (uint32_t i = 0; i < num_files; i++) {
+        const char *ext = db_entry_get_extension(darray_get_item(files, i));
+        if (!ext || *ext == '\0') {
+            continue;
+        }
+        gpointer id = NULL;
+        if (!g_hash_table_lookup_extended(ids, ext, NULL, &id)) {
+            char *name = g_strdup(ext);
+            id = GUINT_TO_POINTER(extensions->names->len);
+            g_ptr_array_add(extensions->names, name);
+            g_hash_table_insert(ids, name, id);
+        }
+        extensions->ids[i] = GPOINTER_TO_UINT(id);
+    }
+
+    const uint32_t num_ids = extensions->names->len;
+    g_autoptr(GArray) order = g_array_sized_new(FALSE, FALSE, sizeof(uint32_t), num_ids);
+    for (uint32_t i = 0; i < num_ids; i++) {
+        g_array_append_val(order, i);
+    }
+    g_array_sort_with_data(order, compare_rank, extensions->names);
+    extensions->ranks = calloc(num_ids, sizeof(uint32_t));
+    g_assert(extensions->ranks);
+    for (uint32_t i = 0; i < num_ids; i++) {
+        extensions->ranks[g_array_index(order, uint32_t, i)] = i;
+    }
+
+    // the positions are added in ascending order, so every posting list stays sorted
+    extensions->posting_offsets = calloc(num_ids + 1, sizeof(uint32_t));
+    g_assert(extensions->posting_offsets);
+    for (uint32_t i = 0; i < num_files; i++) {
+        extensions->posting_offsets[extensions->ids[i] + 1]++;
+    }
+    for (uint32_t id = 1; id <= num_ids; id++) {
+        extensions->posting_offsets[id] += extensions->posting_offsets[id - 1];
+    }
+    g_autofree uint32_t *next = calloc(num_ids, sizeof(uint32_t));
+    g_assert(next);
+    memcpy(next, extensions->posting_offsets, num_ids * sizeof(uint32_t));
+    extensions->postings = calloc(MAX(num_files, 1), sizeof(uint32_t));
+    g_assert(extensions->postings);
+    for (uint32_t i = 0; i < num_files; i++) {
+        extensions->postings[next[extensions->ids[i]]++] = i;
+    }
+
+    extensions->ref_count = 1;
+    return extensions;
+}
+
+FsearchDatabaseExtensions *
+db_extensions_ref(FsearchDatabaseExtensions *extensions) {
+    if (!extensions || g_atomic_int_get(&extensions->ref_count) <= 0) {
+        return NULL;
+    }
+    g_atomic_int_inc(&extensions->ref_count);
+    return extensions;
+}
+
+void
+db_extensions_unref(FsearchDatabaseExtensions *extensions) {
+    if (!extensions || g_atomic_int_get(&extensions->ref_count) <= 0) {
+        return;
+    }
+    if (g_atomic_int_dec_and_test(&extensions->ref_count)) {
+        g_clear_pointer(&extensions, db_extensions_free);
+    }
+}
+
+size_t
+db_extensions_get_memory_size(const FsearchDatabaseExtensions *extensions) {
+    if (!extensions) {
+        return 0;
+    }
+    const size_t num_files = MAX(darray_get_num_items(extensions->files), 1);
+    const size_t num_ids = extensions->names->len;
+    size_t size = sizeof(FsearchDatabaseExtensions) + 2 * num_files * sizeof(uint32_t)
+                + (2 * num_ids + 1) * sizeof(uint32_t) + num_ids * sizeof(char *);
+    for (uint32_t id = 0; id < num_ids; id++) {
+        size += strlen(g_ptr_array_index(extensions->names, id)) + 1;
+    }
+    return size;
+}
+
+bool
+db_extensions_lookup(const FsearchDatabaseExtensions *extensions, FsearchDatabaseEntry *entry, uint32_t *id) {
+    g_assert(extensions);
+    g_assert(entry);
+
+    if (db_entry_is_folder(entry)) {
+        return false;
+    }
+    const uint32_t idx = db_entry_get_idx(entry);
+    if (idx >= darray_get_num_items(extensions->files) || darray_get_item(extensions->files, idx) != entry) {
+        return false;
+    }
+    *id = extensions->ids[idx];
+    return true;
+}
+
+uint32_t
+db_extensions_get_num_ids(const FsearchDatabaseExtensions *extensions) {
+    g_assert(extensions);
+    return extensions->names->len;
+}
+
+const char *
+db_extensions_get_name(const FsearchDatabaseExtensions *extensions, uint32_t id) {
+    g_assert(extensions);
+    g_return_val_if_fail(id < extensions->names->len, NULL);
+    return g_ptr_array_index(extensions->names, id);
+}
+
+const uint32_t *
+db_extensions_get_postings(const FsearchDatabaseExtensions *extensions, uint32_t id, uint32_t *num_files) {
+    g_assert(extensions);
+    g_assert(num_files);
+    if (id >= extensions->names->len) {
+        *num_files = 0;
+        return NULL;
+    }
+    *num_files = extensions->posting_offsets[id + 1] - extensions->posting_offsets[id];
+    return extensions->postings + extensions->posting_offsets[id];
+}
+
+DynamicArray *
+db_extensions_sort_files(const FsearchDatabaseExtensions *extensions) {
+    g_assert(extensions);
+
+    const uint32_t num_files = darray_get_num_items(extensions->files);
+    const uint32_t num_ids = extensions->names->len;
+    // rank -> id
+    g_autofree uint32_t *order = calloc(num_ids, sizeof(uint32_t));
+    g_assert(order);
+    for (uint32_t id = 0; id < num_ids; id++) {
+        order[extensions->ranks[id]] = id;
+    }
+
+    DynamicArray *files = darray_new(MAX(num_files, 1));
+    for (uint32_t i = 0; i < num_ids; i++) {
+        uint32_t num_postings = 0;
+        const uint32_t *postings = db_extensions_get_postings(extensions, order[i], &num_postings);
+        for (uint32_t j = 0; j < num_postings; j++) {
+            darray_add_item(files, darray_get_item(extensions->files, postings[j]));
+        }
+    }
+    return files;
+}
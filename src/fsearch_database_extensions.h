@@ -0,0 +1,62 @@
+#pragma once
+
+#include <glib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "fsearch_array.h"
+#include "fsearch_database_entry.h"
+
+// The extensions of all files, interned into a table of small ids. Extension filters can check the id of a file
+// against the ids they match, instead of comparing its extension with every search term, and files can be sorted
+// by extension by bucketing their ids. The posting list of every id lets searches which only match files with
+// certain extensions visit just those files.
+typedef struct FsearchDatabaseExtensions {
+    // sorted by name, so the index of a file is its position in this array
+    DynamicArray *files;
+    // the extension id of every file, 0 is the id of files without an extension
+    uint32_t *ids;
+    // id -> extension
+    GPtrArray *names;
+    // id -> position of the extension when all of them are sorted with strcmp
+    uint32_t *ranks;
+    // the positions of the files with extension id are postings[posting_offsets[id]..posting_offsets[id + 1]],
+    // in ascending order
+    uint32_t *posting_offsets;
+    uint32_t *postings;
+
+    volatile int ref_count;
+} FsearchDatabaseExtensions;
+
+FsearchDatabaseExtensions *
+db_extensions_new(DynamicArray *files);
+
+FsearchDatabaseExtensions *
+db_extensions_ref(FsearchDatabaseExtensions *extensions);
+
+void
+db_extensions_unref(FsearchDatabaseExtensions *extensions);
+
+// The number of bytes allocated for the ids, extensions and posting lists, without the files
+size_t
+db_extensions_get_memory_size(const FsearchDatabaseExtensions *extensions);
+
+// Sets id to the extension id of entry. Returns false if entry isn't part of extensions, e.g. because it's a folder
+// or was added afterwards.
+bool
+db_extensions_lookup(const FsearchDatabaseExtensions *extensions, FsearchDatabaseEntry *entry, uint32_t *id);
+
+uint32_t
+db_extensions_get_num_ids(const FsearchDatabaseExtensions *extensions);
+
+const char *
+db_extensions_get_name(const FsearchDatabaseExtensions *extensions, uint32_t id);
+
+// The positions of all files with the extension id in ascending order, num_files is set to their number
+const uint32_t *
+db_extensions_get_postings(const FsearchDatabaseExtensions *extensions, uint32_t id, uint32_t *num_files);
+
+// Returns the files sorted by extension, files with the same extension stay sorted by name. That's the same order a
+// stable sort with db_entry_compare_entries_by_extension produces, but it only concatenates the posting lists.
+DynamicArray *
+db_extensions_sort_files(const FsearchDatabaseExtensions *extensions);
@@ -0,0 +1,168 @@
+#define G_LOG_DOMAIN "fsearch-database-file-types"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "fsearch_database_file_types.h"
+#include "fsearch_file_utils.h"
+
+static void
+db_file_types_free(FsearchDatabaseFileTypes *types) {
+    g_clear_pointer(&types->ids, free);
+    g_clear_pointer(&types->ranks, free);
+    g_clear_pointer(&types->names, g_ptr_array_unref);
+    g_clear_pointer(&types->extensions, db_extensions_unref);
+    g_clear_pointer(&types, free);
+}
+
+static gint
+compare_rank(gconstpointer a, gconstpointer b, gpointer data) {
+    GPtrArray *names = data;
+    return strcmp(g_ptr_array_index(names, *(const uint32_t *)a), g_ptr_array_index(names, *(const uint32_t *)b));
+}
+
+static uint32_t
+intern_type(FsearchDatabaseFileTypes *types, GHashTable *ids, char *type) {
+    gpointer id = NULL;
+    if (g_hash_table_lookup_extended(ids, type, NULL, &id)) {
+        g_free(type);
+        return GPOINTER_TO_UINT(id);
+    }
+    id = GUINT_TO_POINTER(types->names->len);
+    g_ptr_array_add(types->names, type);
+    g_hash_table_insert(ids, type, id);
+    return GPOINTER_TO_UINT(id);
+}
+
+FsearchDatabaseFileTypes *
+db_file_types_new(FsearchDatabaseExtensions *extensions) {
+    g_assert(extensions);
+
+    FsearchDatabaseFileTypes *types = calloc(1, sizeof(FsearchDatabaseFileTypes));
+    g_assert(types);
+
+    DynamicArray *files = extensions->files;
+    const uint32_t num_files = darray_get_num_items(files);
+    types->extensions = db_extensions_ref(extensions);
+    types->ids = calloc(MAX(num_files, 1), sizeof(uint32_t));
+    g_assert(types->ids);
+    types->names = g_ptr_array_new_with_free_func(g_free);
+
+    // the keys point into the names array
+    g_autoptr(GHashTable) ids = g_hash_table_new(g_str_hash, g_str_equal);
+    // extension id -> type id
+    const uint32_t num_extension_ids = db_extensions_get_num_ids(extensions);
+    g_autofree uint32_t *extension_types = calloc(num_extension_ids, sizeof(uint32_t));
+    g_assert(extension_types);
+    for (uint32_t ext_id = 1; ext_id < num_extension_ids; ext_id++) {
+        g_autofree char *name = g_strconcat("file.", db_extensions_get_name(extensions, ext_id), NULL);
+        extension_types[ext_id] = intern_type(types, ids, fsearch_file_utils_get_file_type_non_localized(name, FALSE));
+    }
+
+    // files without an extension (e.g. Makefile) can still match a pattern for their whole name
+    g_autoptr(GHashTable) name_types = g_hash_table_new(g_str_hash, g_str_equal);
+    for (uint32_t i = 0; i < num_files; i++) {
+        const uint32_t ext_id = extensions->ids[i];
+        if (ext_id != 0) {
+            types->ids[i] = extension_types[ext_id];
+            continue;
+        }
+        const char *name = db_entry_get_name_raw_for_display(darray_get_item(files, i));
+        gpointer id = NULL;
+        if (!g_hash_table_lookup_extended(name_types, name, NULL, &id)) {
+            id = GUINT_TO_POINTER(intern_type(types, ids, fsearch_file_utils_get_file_type_non_localized(name, FALSE)));
+            g_hash_table_insert(name_types, (gpointer)name, id);
+        }
+        types->ids[i] = GPOINTER_TO_UINT(id);
+    }
+
+    const uint32_t num_ids = types->names->len;
+    g_autoptr(GArray) order = g_array_sized_new(FALSE, FALSE, sizeof(uint32_t), num_ids);
+    for (uint32_t i = 0; i < num_ids; i++) {
+        g_array_append_val(order, i);
+    }
+    g_array_sort_with_data(order, compare_rank, types->names);
+    types->ranks = calloc(MAX(num_ids, 1), sizeof(uint32_t));
+    g_assert(types->ranks);
+    for (uint32_t i = 0; i < num_ids; i++) {
+        types->ranks[g_array_index(order, uint32_t, i)] = i;
+    }
+
+    types->ref_count = 1;
+    return types;
+}
+
+FsearchDatabaseFileTypes *
+db_file_types_ref(FsearchDatabaseFileTypes *types) {
+    if (!types || g_atomic_int_get(&types->ref_count) <= 0) {
+        return NULL;
+    }
+    g_atomic_int_inc(&types->ref_count);
+    return types;
+}
+
+void
+db_file_types_unref(FsearchDatabaseFileTypes *types) {
+    if (!types || g_atomic_int_get(&types->ref_count) <= 0) {
+        return;
+    }
+    if (g_atomic_int_dec_and_test(&types->ref_count)) {
+        g_clear_pointer(&types, db_file_types_free);
+    }
+}
+
+size_t
+db_file_types_get_memory_size(const FsearchDatabaseFileTypes *types) {
+    if (!types) {
+        return 0;
+    }
+    const size_t num_files = MAX(darray_get_num_items(types->extensions->files), 1);
+    const size_t num_ids = types->names->len;
+    size_t size = sizeof(FsearchDatabaseFileTypes) + num_files * sizeof(uint32_t)
+                + MAX(num_ids, 1) * sizeof(uint32_t) + num_ids * sizeof(char *);
+    for (uint32_t id = 0; id < num_ids; id++) {
+        size += strlen(g_ptr_array_index(types->names, id)) + 1;
+    }
+    return size;
+}
+
+uint32_t
+db_file_types_get_num_ids(const FsearchDatabaseFileTypes *types) {
+    g_assert(types);
+    return types->names->len;
+}
+
+const char *
+db_file_types_get_name(const FsearchDatabaseFileTypes *types, uint32_t id) {
+    g_assert(types);
+    g_return_val_if_fail(id < types->names->len, NULL);
+    return g_ptr_array_index(types->names, id);
+}
+
+DynamicArray *
+db_file_types_sort_files(const FsearchDatabaseFileTypes *types) {
+    g_assert(types);
+
+    DynamicArray *files = types->extensions->files;
+    const uint32_t num_files = darray_get_num_items(files);
+    const uint32_t num_ids = types->names->len;
+    // the offset of the first file of every rank, the files of a rank are added in name order
+    g_autofree uint32_t *offsets = calloc(num_ids + 1, sizeof(uint32_t));
+    g_assert(offsets);
+    for (uint32_t i = 0; i < num_files; i++) {
+        offsets[types->ranks[types->ids[i]] + 1]++;
+    }
+    for (uint32_t rank = 1; rank <= num_ids; rank++) {
+        offsets[rank] += offsets[rank - 1];
+    }
+
+    DynamicArray *sorted = darray_new(MAX(num_files, 1));
+    void **data = calloc(MAX(num_files, 1), sizeof(void *));
+    g_assert(data);
+    for (uint32_t i = 0; i < num_files; i++) {
+        data[offsets[types->ranks[types->ids[i]]]++] = darray_get_item(files, i);
+    }
+    darray_add_items(sorted, data, num_files);
+    g_clear_pointer(&data, free);
+    return sorted;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <glib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "fsearch_array.h"
+#include "fsearch_database_entry.h"
+#include "fsearch_database_extensions.h"
+
+// The (non-localized) types of all files, interned into a table of small ids. The type of a file comes from its
+// extension, so it's only looked up once per extension id. Only files without an extension are typed by their whole
+// name, once per distinct name. Sorting by type is then a bucket sort of the ids, instead of looking up the type of
+// every file while they're compared.
+typedef struct FsearchDatabaseFileTypes {
+    // the extensions of the files, files are sorted by name, so the index of a file is its position in them
+    FsearchDatabaseExtensions *extensions;
+    // the type id of every file
+    uint32_t *ids;
+    // id -> type
+    GPtrArray *names;
+    // id -> position of the type when all of them are sorted with strcmp
+    uint32_t *ranks;
+
+    volatile int ref_count;
+} FsearchDatabaseFileTypes;
+
+FsearchDatabaseFileTypes *
+db_file_types_new(FsearchDatabaseExtensions *extensions);
+
+FsearchDatabaseFileTypes *
+db_file_types_ref(FsearchDatabaseFileTypes *types);
+
+void
+db_file_types_unref(FsearchDatabaseFileTypes *types);
+
+// The number of bytes allocated for the ids and types, without the extensions
+size_t
+db_file_types_get_memory_size(const FsearchDatabaseFileTypes *types);
+
+uint32_t
+db_file_types_get_num_ids(const FsearchDatabaseFileTypes *types);
+
+const char *
+db_file_types_get_name(const FsearchDatabaseFileTypes *types, uint32_t id);
+
+// Returns the files sorted by type, files with the same type stay sorted by name
+DynamicArray *
+db_file_types_sort_files(const FsearchDatabaseFileTypes *types);
@@ -0,0 +1,123 @@
+#define G_LOG_DOMAIN "fsearch-database-folded-names"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "fsearch_database_folded_names.h"
+
+static void
+db_folded_names_free(FsearchDatabaseFoldedNames *names) {
+    g_clear_pointer(&names->folder_names, free);
+    g_clear_pointer(&names->file_names, free);
+    g_clear_pointer(&names->folders, darray_unref);
+    g_clear_pointer(&names->files, darray_unref);
+    g_clear_pointer(&names->arena, fsearch_string_arena_free);
+    g_clear_pointer(&names->contents, g_bytes_unref);
+    g_clear_pointer(&names, free);
+}
+
+FsearchDatabaseFoldedNames *
+db_folded_names_new(DynamicArray *folders, DynamicArray *files, uint32_t fold_options) {
+    g_assert(folders);
+    g_assert(files);
+
+    FsearchDatabaseFoldedNames *names = calloc(1, sizeof(FsearchDatabaseFoldedNames));
+    g_assert(names);
+
+    names->folders = darray_ref(folders);
+    names->files = darray_ref(files);
+    names->folder_names = calloc(MAX(darray_get_num_items(folders), 1), sizeof(char *));
+    g_assert(names->folder_names);
+    names->file_names = calloc(MAX(darray_get_num_items(files), 1), sizeof(char *));
+    g_assert(names->file_names);
+    names->fold_options = fold_options;
+    names->arena = fsearch_string_arena_new();
+
+    names->ref_count = 1;
+    return names;
+}
+
+FsearchDatabaseFoldedNames *
+db_folded_names_ref(FsearchDatabaseFoldedNames *names) {
+    if (!names || g_atomic_int_get(&names->ref_count) <= 0) {
+        return NULL;
+    }
+    g_atomic_int_inc(&names->ref_count);
+    return names;
+}
+
+void
+db_folded_names_unref(FsearchDatabaseFoldedNames *names) {
+    if (!names || g_atomic_int_get(&names->ref_count) <= 0) {
+        return;
+    }
+    if (g_atomic_int_dec_and_test(&names->ref_count)) {
+        g_clear_pointer(&names, db_folded_names_free);
+    }
+}
+
+size_t
+db_folded_names_get_memory_size(const FsearchDatabaseFoldedNames *names) {
+    if (!names) {
+        return 0;
+    }
+    const size_t num_entries =
+        MAX(darray_get_num_items(names->folders), 1) + MAX(darray_get_num_items(names->files), 1);
+    return sizeof(FsearchDatabaseFoldedNames) + num_entries * sizeof(char *)
+         + fsearch_string_arena_get_memory_size(names->arena);
+}
+
+bool
+db_folded_names_lookup(const FsearchDatabaseFoldedNames *names, FsearchDatabaseEntry *entry, const char **folded_name) {
+    g_assert(names);
+    g_assert(entry);
+
+    const bool is_folder = db_entry_is_folder(entry);
+    DynamicArray *entries = is_folder ? names->folders : names->files;
+    const uint32_t idx = db_entry_get_idx(entry);
+    if (idx >= darray_get_num_items(entries) || darray_get_item(entries, idx) != entry) {
+        return false;
+    }
+    *folded_name = is_folder ? names->folder_names[idx] : names->file_names[idx];
+    return true;
+}
+
+static const char *
+fold_ascii(const char *name, char *buffer, int32_t buffer_size) {
+    bool has_upper = false;
+    int32_t len = 0;
+    for (const char *c = name; *c; c++, len++) {
+        has_upper = has_upper || g_ascii_isupper(*c);
+    }
+    if (!has_upper || len >= buffer_size) {
+        return NULL;
+    }
+    for (int32_t i = 0; i <= len; i++) {
+        buffer[i] = g_ascii_tolower(name[i]);
+    }
+    return buffer;
+}
+
+const char *
+db_folded_names_fold(FsearchUtfBuilder *builder, const char *name, char *buffer, int32_t buffer_size) {
+    g_assert(builder);
+    g_assert(name);
+    g_assert(buffer);
+
+    bool is_ascii = true;
+    bool has_capital_i = false;
+    for (const char *c = name; *c && is_ascii; c++) {
+        is_ascii = (unsigned char)*c < 0x80;
+        has_capital_i = has_capital_i || *c == 'I';
+    }
+    // only the Turkic case mapping folds an ASCII character (I) to a non ASCII one
+    if (is_ascii && (builder->fold_options == U_FOLD_CASE_DEFAULT || !has_capital_i)) {
+        return fold_ascii(name, buffer, buffer_size);
+    }
+
+    if (!fsearch_utf_builder_normalize_and_fold_case(builder, name)
+        || fsearch_utf_builder_get_normalized_folded_utf8(builder, buffer, buffer_size) < 0) {
+        return NULL;
+    }
+    return strcmp(buffer, name) ? buffer : NULL;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <glib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "fsearch_array.h"
+#include "fsearch_database_entry.h"
+#include "fsearch_string_arena.h"
+#include "fsearch_utf.h"
+
+// The case folded and normalized (NFD) names of all entries in UTF8, in the same form as the needles of case
+// insensitive searches for non ASCII terms. Those can compare against them directly, instead of converting every
+// name with ICU again for every query.
+typedef struct FsearchDatabaseFoldedNames {
+    // sorted by name, so the index of an entry is its position in these arrays
+    DynamicArray *folders;
+    DynamicArray *files;
+    // NULL if the folded name is the same as the name
+    const char **folder_names;
+    const char **file_names;
+    // see fsearch_utf_get_fold_options
+    uint32_t fold_options;
+    // holds the names, unless they point into the loaded database file
+    FsearchStringArena *arena;
+    GBytes *contents;
+
+    volatile int ref_count;
+} FsearchDatabaseFoldedNames;
+
+// The names are all NULL, until they get filled in by the caller (stored in the arena of names or contents)
+FsearchDatabaseFoldedNames *
+db_folded_names_new(DynamicArray *folders, DynamicArray *files, uint32_t fold_options);
+
+FsearchDatabaseFoldedNames *
+db_folded_names_ref(FsearchDatabaseFoldedNames *names);
+
+void
+db_folded_names_unref(FsearchDatabaseFoldedNames *names);
+
+// The number of bytes allocated for the folded names, without the entries and the names in the database file
+size_t
+db_folded_names_get_memory_size(const FsearchDatabaseFoldedNames *names);
+
+// Sets folded_name to the folded name of entry (NULL if it's the same as its name). Returns false if entry isn't
+// part of names, e.g. because it was added afterwards.
+bool
+db_folded_names_lookup(const FsearchDatabaseFoldedNames *names, FsearchDatabaseEntry *entry, const char **folded_name);
+
+// Folds name with builder into buffer (NUL terminated) and returns it, or NULL if it's the same as name or
+// can't be folded. Names which only consist of ASCII characters are handled without ICU.
+const char *
+db_folded_names_fold(FsearchUtfBuilder *builder, const char *name, char *buffer, int32_t buffer_size);
@@ -1 +1,28 @@
 #include "fsearch_database_index.h"
+
+#include <glib.h>
+#include <stdint.h>
+#include <string.h>
+
+static const struct {
+    const char *name;
+    FsearchDatabaseIndexType type;
+} short_names[] = {
+    {"name", DATABASE_INDEX_TYPE_NAME},
+    {"path", DATABASE_INDEX_TYPE_PATH},
+    {"size", DATABASE_INDEX_TYPE_SIZE},
+    {"modified", DATABASE_INDEX_TYPE_MODIFICATION_TIME},
+    {"type", DATABASE_INDEX_TYPE_FILETYPE},
+    {"extension", DATABASE_INDEX_TYPE_EXTENSION},
+};
+
+bool
+db_index_type_from_short_name(const char *name, FsearchDatabaseIndexType *type) {
+    for (uint32_t i = 0; i < G_N_ELEMENTS(short_names); i++) {
+        if (!strcmp(name, short_names[i].name)) {
+            *type = short_names[i].type;
+            return true;
+        }
+    }
+    return false;
+}
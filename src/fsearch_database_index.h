@@ -1,5 +1,7 @@
 #pragma once
 
+#include <stdbool.h>
+
 #define DATABASE_INDEX_TYPE_NAME_STRING "Name"
 #define DATABASE_INDEX_TYPE_PATH_STRING "Path"
 #define DATABASE_INDEX_TYPE_SIZE_STRING "Size"
@@ -15,6 +17,10 @@ typedef enum {
     DATABASE_INDEX_FLAG_ACCESS_TIME = 1 << 4,
     DATABASE_INDEX_FLAG_CREATION_TIME = 1 << 5,
     DATABASE_INDEX_FLAG_STATUS_CHANGE_TIME = 1 << 6,
+    // the uid and gid of entries
+    DATABASE_INDEX_FLAG_OWNER = 1 << 7,
+    // the file type and permission bits of entries
+    DATABASE_INDEX_FLAG_PERMISSIONS = 1 << 8,
 } FsearchDatabaseIndexFlags;
 
 typedef enum {
@@ -29,3 +35,8 @@ typedef enum {
     DATABASE_INDEX_TYPE_EXTENSION,
     NUM_DATABASE_INDEX_TYPES,
 } FsearchDatabaseIndexType;
+
+// Finds the sort order with the short lowercase name which is used by the search interfaces for other programs:
+// name, path, size, modified, type or extension
+bool
+db_index_type_from_short_name(const char *name, FsearchDatabaseIndexType *type);
@@ -0,0 +1,128 @@
+#define G_LOG_DOMAIN "fsearch-database-memory-stats"
+
+#include <string.h>
+
+#include "fsearch_database_memory_stats.h"
+
+static const char *index_type_names[NUM_DATABASE_INDEX_TYPES] = {
+    [DATABASE_INDEX_TYPE_NAME] = "name",
+    [DATABASE_INDEX_TYPE_PATH] = "path",
+    [DATABASE_INDEX_TYPE_SIZE] = "size",
+    [DATABASE_INDEX_TYPE_MODIFICATION_TIME] = "modification time",
+    [DATABASE_INDEX_TYPE_ACCESS_TIME] = "access time",
+    [DATABASE_INDEX_TYPE_CREATION_TIME] = "creation time",
+    [DATABASE_INDEX_TYPE_STATUS_CHANGE_TIME] = "status change time",
+    [DATABASE_INDEX_TYPE_FILETYPE] = "type",
+    [DATABASE_INDEX_TYPE_EXTENSION] = "extension",
+};
+
+static void
+append_size(GString *str, const char *name, size_t size) {
+    g_autofree char *size_str = g_format_size_full(size, G_FORMAT_SIZE_IEC_UNITS);
+    g_string_append_printf(str, "  %s: %s\n", name, size_str);
+}
+
+static void
+append_sorted_arrays(GString *str, const char *name, const size_t *sizes) {
+    for (uint32_t i = 0; i < NUM_DATABASE_INDEX_TYPES; i++) {
+        if (sizes[i] == 0) {
+            continue;
+        }
+        g_autofree char *array_name = g_strdup_printf("%s sorted by %s", name, index_type_names[i]);
+        append_size(str, array_name, sizes[i]);
+    }
+}
+
+void
+db_memory_stats_init(FsearchDatabaseMemoryStats *stats) {
+    g_assert(stats);
+    memset(stats, 0, sizeof(FsearchDatabaseMemoryStats));
+    stats->counted_arrays = g_hash_table_new(g_direct_hash, g_direct_equal);
+}
+
+void
+db_memory_stats_clear(FsearchDatabaseMemoryStats *stats) {
+    g_assert(stats);
+    g_clear_pointer(&stats->counted_arrays, g_hash_table_unref);
+    memset(stats, 0, sizeof(FsearchDatabaseMemoryStats));
+}
+
+size_t
+db_memory_stats_count_array(FsearchDatabaseMemoryStats *stats, DynamicArray *array) {
+    g_assert(stats);
+    g_assert(stats->counted_arrays);
+    if (!array || !g_hash_table_add(stats->counted_arrays, array)) {
+        return 0;
+    }
+    // copies of an array share its items until they get changed
+    if (!g_hash_table_add(stats->counted_arrays, (void *)darray_get_items_id(array))) {
+        return sizeof(void *) * 2;
+    }
+    return sizeof(void *) * (MAX(darray_get_size(array), 1) + 2);
+}
+
+size_t
+db_memory_stats_get_total(const FsearchDatabaseMemoryStats *stats) {
+    g_assert(stats);
+    size_t total = stats->folder_pool + stats->file_pool + stats->names + stats->file_contents;
+    for (uint32_t i = 0; i < NUM_DATABASE_INDEX_TYPES; i++) {
+        total += stats->sorted_folders[i] + stats->sorted_files[i];
+    }
+    total += stats->metadata;
+    total += stats->columns + stats->folder_paths + stats->ranks + stats->folded_names + stats->extensions;
+    total += stats->file_types + stats->trigrams + stats->filter_matches + stats->search_results;
+    total += stats->results + stats->selections + stats->match_data + stats->row_cache + stats->icon_cache;
+    return total;
+}
+
+bool
+db_memory_stats_is_over_budget(const FsearchDatabaseMemoryStats *stats) {
+    g_assert(stats);
+    return stats->memory_budget > 0 && db_memory_stats_get_total(stats) > stats->memory_budget;
+}
+
+GString *
+db_memory_stats_to_string(const FsearchDatabaseMemoryStats *stats) {
+    g_assert(stats);
+
+    const size_t total_size = db_memory_stats_get_total(stats);
+    g_autofree char *total = g_format_size_full(total_size, G_FORMAT_SIZE_IEC_UNITS);
+    GString *str = g_string_new(NULL);
+    g_string_append_printf(str, "Memory used: %s\n", total);
+    if (stats->memory_budget > 0) {
+        g_autofree char *budget = g_format_size_full(stats->memory_budget, G_FORMAT_SIZE_IEC_UNITS);
+        g_string_append_printf(str,
+                               "Memory budget: %s (%.0f%% used%s)\n",
+                               budget,
+                               100.0 * (double)total_size / (double)stats->memory_budget,
+                               db_memory_stats_is_over_budget(stats) ? ", exceeded" : "");
+    }
+
+    g_string_append(str, "\nDatabase\n");
+    append_size(str, "folders", stats->folder_pool);
+    append_size(str, "files", stats->file_pool);
+    append_size(str, "names", stats->names);
+    append_size(str, "database file", stats->file_contents);
+    append_sorted_arrays(str, "folders", stats->sorted_folders);
+    append_sorted_arrays(str, "files", stats->sorted_files);
+    append_size(str, "metadata", stats->metadata);
+
+    g_string_append(str, "\nSearch caches\n");
+    append_size(str, "columns", stats->columns);
+    append_size(str, "folder paths", stats->folder_paths);
+    append_size(str, "ranks", stats->ranks);
+    append_size(str, "folded names", stats->folded_names);
+    append_size(str, "extensions", stats->extensions);
+    append_size(str, "file types", stats->file_types);
+    append_size(str, "trigrams", stats->trigrams);
+    append_size(str, "filter matches", stats->filter_matches);
+    append_size(str, "search results", stats->search_results);
+
+    g_string_append_printf(str, "\nViews (%u)\n", stats->num_views);
+    append_size(str, "results", stats->results);
+    append_size(str, "selections", stats->selections);
+    append_size(str, "match data", stats->match_data);
+    append_size(str, "row cache", stats->row_cache);
+    append_size(str, "icon cache", stats->icon_cache);
+    return str;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <glib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fsearch_array.h"
+#include "fsearch_database_index.h"
+
+// Where the memory of a running instance goes, in bytes. The database, its views and the result views of the windows
+// each add their part, see db_get_memory_stats, db_view_get_memory_stats and fsearch_result_view_get_memory_stats.
+typedef struct FsearchDatabaseMemoryStats {
+    // the entries and the names which aren't part of the database file
+    size_t folder_pool;
+    size_t file_pool;
+    size_t names;
+    // the part of names which holds names, the rest is free space of its blocks
+    size_t names_used;
+    // the loaded database file, names of entries and sorted sections can point into it
+    size_t file_contents;
+    size_t sorted_folders[NUM_DATABASE_INDEX_TYPES];
+    size_t sorted_files[NUM_DATABASE_INDEX_TYPES];
+    // the owners, permissions and other timestamps, if they're indexed
+    size_t metadata;
+
+    // the caches of searches
+    size_t columns;
+    size_t folder_paths;
+    size_t ranks;
+    size_t folded_names;
+    size_t extensions;
+    size_t file_types;
+    size_t trigrams;
+    // the entries which the recently used filters match
+    size_t filter_matches;
+    // the results of recent searches, views which show one of them share its arrays
+    size_t search_results;
+
+    uint32_t num_views;
+    // results which aren't one of the sorted arrays of the database
+    size_t results;
+    size_t selections;
+    // the match data of all search threads (while they're searching) and of the cached rows
+    size_t match_data;
+    size_t row_cache;
+    size_t icon_cache;
+
+    // the memory budget of the low memory mode, 0 if it's off
+    size_t memory_budget;
+
+    // the arrays which were already counted, views can share them with the database
+    GHashTable *counted_arrays;
+} FsearchDatabaseMemoryStats;
+
+void
+db_memory_stats_init(FsearchDatabaseMemoryStats *stats);
+
+void
+db_memory_stats_clear(FsearchDatabaseMemoryStats *stats);
+
+// Returns the bytes allocated by array, or 0 if it was already counted
+size_t
+db_memory_stats_count_array(FsearchDatabaseMemoryStats *stats, DynamicArray *array);
+
+size_t
+db_memory_stats_get_total(const FsearchDatabaseMemoryStats *stats);
+
+// Whether more than the memory budget is used, never if there's none
+bool
+db_memory_stats_is_over_budget(const FsearchDatabaseMemoryStats *stats);
+
+// Human readable report of all statistics
+GString *
+db_memory_stats_to_string(const FsearchDatabaseMemoryStats *stats);
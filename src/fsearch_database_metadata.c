@@ -0,0 +1,473 @@
+#define G_LOG_DOMAIN "fsearch-database-metadata"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "fsearch_database_metadata.h"
+
+static uint32_t
+get_num_words(uint32_t num_entries, uint32_t bits) {
+    return (uint32_t)(((uint64_t)num_entries * bits + 63) / 64);
+}
+
+// The values never straddle two words, because bits is a power of two
+static inline uint32_t
+values_get(const FsearchDatabaseMetadataValues *values, uint32_t idx) {
+    const uint64_t bit = (uint64_t)idx * values->bits;
+    const uint64_t mask = values->bits == 32 ? UINT32_MAX : ((uint64_t)1 << values->bits) - 1;
+    return (uint32_t)((values->words[bit / 64] >> (bit % 64)) & mask);
+}
+
+static inline void
+values_set(FsearchDatabaseMetadataValues *values, uint32_t idx, uint32_t value) {
+    const uint64_t bit = (uint64_t)idx * values->bits;
+    const uint64_t mask = values->bits == 32 ? UINT32_MAX : ((uint64_t)1 << values->bits) - 1;
+    uint64_t *word = &values->words[bit / 64];
+    *word = (*word & ~(mask << (bit % 64))) | (((uint64_t)value & mask) << (bit % 64));
+}
+
+static bool
+is_valid_bits(uint32_t bits) {
+    return bits > 0 && bits <= 32 && (bits & (bits - 1)) == 0;
+}
+
+static bool
+is_id_column(FsearchDatabaseMetadataColumn column) {
+    return column == DATABASE_METADATA_COLUMN_UID || column == DATABASE_METADATA_COLUMN_GID;
+}
+
+FsearchDatabaseIndexFlags
+db_metadata_column_get_flag(FsearchDatabaseMetadataColumn column) {
+    switch (column) {
+    case DATABASE_METADATA_COLUMN_UID:
+    case DATABASE_METADATA_COLUMN_GID:
+        return DATABASE_INDEX_FLAG_OWNER;
+    case DATABASE_METADATA_COLUMN_MODE:
+        return DATABASE_INDEX_FLAG_PERMISSIONS;
+    case DATABASE_METADATA_COLUMN_ATIME:
+        return DATABASE_INDEX_FLAG_ACCESS_TIME;
+    case DATABASE_METADATA_COLUMN_CTIME:
+        return DATABASE_INDEX_FLAG_STATUS_CHANGE_TIME;
+    case DATABASE_METADATA_COLUMN_BTIME:
+        return DATABASE_INDEX_FLAG_CREATION_TIME;
+    default:
+        return 0;
+    }
+}
+
+bool
+db_metadata_column_is_time(FsearchDatabaseMetadataColumn column) {
+    return column == DATABASE_METADATA_COLUMN_ATIME || column == DATABASE_METADATA_COLUMN_CTIME
+        || column == DATABASE_METADATA_COLUMN_BTIME;
+}
+
+static uint32_t
+get_num_entries(const FsearchDatabaseMetadata *metadata, bool is_folder) {
+    return darray_get_num_items(is_folder ? metadata->folders : metadata->files);
+}
+
+static void
+values_clear(FsearchDatabaseMetadataValues *values) {
+    g_clear_pointer(&values->words, free);
+    g_clear_pointer(&values->ids, free);
+    g_clear_pointer(&values->block_min, free);
+    g_clear_pointer(&values->block_max, free);
+    g_clear_pointer(&values->id_codes, g_hash_table_unref);
+}
+
+static void
+values_init(FsearchDatabaseMetadataValues *values, FsearchDatabaseMetadataColumn column, uint32_t num_entries) {
+    values->bits = is_id_column(column) ? 1 : column == DATABASE_METADATA_COLUMN_MODE ? 16 : 32;
+    values->words = calloc(MAX(get_num_words(num_entries, values->bits), 1), sizeof(uint64_t));
+    g_assert(values->words);
+    if (is_id_column(column)) {
+        // all entries start out with code 0, the unknown id
+        values->ids = calloc(1, sizeof(uint32_t));
+        g_assert(values->ids);
+        values->ids[0] = DATABASE_METADATA_UNKNOWN_ID;
+        values->num_ids = 1;
+        values->id_codes = g_hash_table_new(g_direct_hash, g_direct_equal);
+        g_hash_table_insert(values->id_codes, GUINT_TO_POINTER(DATABASE_METADATA_UNKNOWN_ID), GUINT_TO_POINTER(1));
+    }
+}
+
+static void
+db_metadata_free(FsearchDatabaseMetadata *metadata) {
+    for (uint32_t i = 0; i < 2; i++) {
+        for (uint32_t column = 0; column < NUM_DATABASE_METADATA_COLUMNS; column++) {
+            values_clear(&metadata->columns[i][column]);
+        }
+    }
+    g_clear_pointer(&metadata->folders, darray_unref);
+    g_clear_pointer(&metadata->files, darray_unref);
+    g_clear_pointer(&metadata, free);
+}
+
+FsearchDatabaseMetadata *
+db_metadata_new(FsearchDatabaseIndexFlags flags, DynamicArray *folders, DynamicArray *files) {
+    g_assert(folders);
+    g_assert(files);
+    if ((flags & DATABASE_INDEX_FLAGS_METADATA) == 0) {
+        return NULL;
+    }
+
+    FsearchDatabaseMetadata *metadata = calloc(1, sizeof(FsearchDatabaseMetadata));
+    g_assert(metadata);
+
+    metadata->folders = darray_ref(folders);
+    metadata->files = darray_ref(files);
+    metadata->flags = flags & DATABASE_INDEX_FLAGS_METADATA;
+    for (uint32_t i = 0; i < 2; i++) {
+        for (uint32_t column = 0; column < NUM_DATABASE_METADATA_COLUMNS; column++) {
+            if ((metadata->flags & db_metadata_column_get_flag(column)) != 0) {
+                values_init(&metadata->columns[i][column], column, get_num_entries(metadata, i == 0));
+            }
+        }
+    }
+
+    metadata->ref_count = 1;
+    return metadata;
+}
+
+FsearchDatabaseMetadata *
+db_metadata_ref(FsearchDatabaseMetadata *metadata) {
+    if (!metadata || g_atomic_int_get(&metadata->ref_count) <= 0) {
+        return NULL;
+    }
+    g_atomic_int_inc(&metadata->ref_count);
+    return metadata;
+}
+
+void
+db_metadata_unref(FsearchDatabaseMetadata *metadata) {
+    if (!metadata || g_atomic_int_get(&metadata->ref_count) <= 0) {
+        return;
+    }
+    if (g_atomic_int_dec_and_test(&metadata->ref_count)) {
+        g_clear_pointer(&metadata, db_metadata_free);
+    }
+}
+
+size_t
+db_metadata_get_memory_size(const FsearchDatabaseMetadata *metadata) {
+    if (!metadata) {
+        return 0;
+    }
+    size_t size = sizeof(FsearchDatabaseMetadata);
+    for (uint32_t i = 0; i < 2; i++) {
+        const uint32_t num_entries = get_num_entries(metadata, i == 0);
+        const uint32_t num_blocks = (num_entries + DATABASE_METADATA_BLOCK_SIZE - 1) / DATABASE_METADATA_BLOCK_SIZE;
+        for (uint32_t column = 0; column < NUM_DATABASE_METADATA_COLUMNS; column++) {
+            const FsearchDatabaseMetadataValues *values = &metadata->columns[i][column];
+            if (!values->words) {
+                continue;
+            }
+            size += (size_t)MAX(get_num_words(num_entries, values->bits), 1) * sizeof(uint64_t);
+            size += (size_t)values->num_ids * sizeof(uint32_t);
+            if (values->block_min) {
+                size += (size_t)num_blocks * 2 * sizeof(uint32_t);
+            }
+        }
+    }
+    return size;
+}
+
+// Packs all values again with twice as many bits, until code fits
+static void
+values_widen(FsearchDatabaseMetadataValues *values, uint32_t num_entries, uint32_t code) {
+    uint32_t bits = values->bits;
+    while (bits < 32 && code >= ((uint32_t)1 << bits)) {
+        bits *= 2;
+    }
+    FsearchDatabaseMetadataValues widened = {.bits = bits};
+    widened.words = calloc(MAX(get_num_words(num_entries, bits), 1), sizeof(uint64_t));
+    g_assert(widened.words);
+    for (uint32_t i = 0; i < num_entries; i++) {
+        values_set(&widened, i, values_get(values, i));
+    }
+    g_clear_pointer(&values->words, free);
+    values->words = widened.words;
+    values->bits = bits;
+}
+
+static uint32_t
+values_get_code(FsearchDatabaseMetadataValues *values, uint32_t num_entries, uint32_t id) {
+    const uint32_t code = GPOINTER_TO_UINT(g_hash_table_lookup(values->id_codes, GUINT_TO_POINTER(id)));
+    if (code > 0) {
+        return code - 1;
+    }
+    // the capacity of ids doubles whenever it's full, which is whenever there's a power of two of them
+    if ((values->num_ids & (values->num_ids - 1)) == 0) {
+        values->ids = realloc(values->ids, (size_t)values->num_ids * 2 * sizeof(uint32_t));
+        g_assert(values->ids);
+    }
+    const uint32_t new_code = values->num_ids++;
+    values->ids[new_code] = id;
+    g_hash_table_insert(values->id_codes, GUINT_TO_POINTER(id), GUINT_TO_POINTER(new_code + 1));
+    if (values->bits < 32 && new_code >= ((uint32_t)1 << values->bits)) {
+        values_widen(values, num_entries, new_code);
+    }
+    return new_code;
+}
+
+static uint32_t
+clamp_time(time_t time) {
+    return (uint32_t)CLAMP((int64_t)time, 0, UINT32_MAX);
+}
+
+static uint32_t
+entry_metadata_get_value(const FsearchDatabaseEntryMetadata *values, FsearchDatabaseMetadataColumn column) {
+    switch (column) {
+    case DATABASE_METADATA_COLUMN_UID:
+        return values->uid;
+    case DATABASE_METADATA_COLUMN_GID:
+        return values->gid;
+    case DATABASE_METADATA_COLUMN_MODE:
+        return values->mode;
+    case DATABASE_METADATA_COLUMN_ATIME:
+        return clamp_time(values->atime);
+    case DATABASE_METADATA_COLUMN_CTIME:
+        return clamp_time(values->ctime);
+    case DATABASE_METADATA_COLUMN_BTIME:
+        return clamp_time(values->btime);
+    default:
+        return 0;
+    }
+}
+
+void
+db_metadata_set(FsearchDatabaseMetadata *metadata,
+                bool is_folder,
+                uint32_t idx,
+                const FsearchDatabaseEntryMetadata *values) {
+    g_assert(metadata);
+    g_assert(values);
+    g_assert(!metadata->sealed);
+
+    const uint32_t num_entries = get_num_entries(metadata, is_folder);
+    g_assert(idx < num_entries);
+    for (uint32_t column = 0; column < NUM_DATABASE_METADATA_COLUMNS; column++) {
+        FsearchDatabaseMetadataValues *column_values = &metadata->columns[!is_folder][column];
+        if (!column_values->words) {
+            continue;
+        }
+        uint32_t value = entry_metadata_get_value(values, column);
+        if (is_id_column(column)) {
+            value = values_get_code(column_values, num_entries, value);
+        }
+        values_set(column_values, idx, value);
+    }
+}
+
+void
+db_metadata_copy(FsearchDatabaseMetadata *metadata, const FsearchDatabaseMetadata *other) {
+    g_assert(metadata);
+    if (!other) {
+        return;
+    }
+    for (uint32_t i = 0; i < 2; i++) {
+        DynamicArray *entries = i == 0 ? metadata->folders : metadata->files;
+        const uint32_t num_entries = darray_get_num_items(entries);
+        for (uint32_t j = 0; j < num_entries; j++) {
+            FsearchDatabaseEntryMetadata values = {};
+            if (db_metadata_lookup(other, darray_get_item(entries, j), &values)) {
+                db_metadata_set(metadata, i == 0, j, &values);
+            }
+        }
+    }
+}
+
+bool
+db_metadata_set_column(FsearchDatabaseMetadata *metadata,
+                       bool is_folder,
+                       FsearchDatabaseMetadataColumn column,
+                       const uint32_t *ids,
+                       uint32_t num_ids,
+                       uint32_t bits,
+                       const uint64_t *words) {
+    g_assert(metadata);
+    g_assert(!metadata->sealed);
+
+    FsearchDatabaseMetadataValues *values = &metadata->columns[!is_folder][column];
+    if (!values->words || !is_valid_bits(bits) || (is_id_column(column) != (num_ids > 0))
+        || (num_ids > 0 && ids[0] != DATABASE_METADATA_UNKNOWN_ID)) {
+        return false;
+    }
+    const uint32_t num_entries = get_num_entries(metadata, is_folder);
+    FsearchDatabaseMetadataValues loaded = {.bits = bits};
+    loaded.words = calloc(MAX(get_num_words(num_entries, bits), 1), sizeof(uint64_t));
+    g_assert(loaded.words);
+    memcpy(loaded.words, words, (size_t)get_num_words(num_entries, bits) * sizeof(uint64_t));
+    for (uint32_t i = 0; i < num_entries && num_ids > 0; i++) {
+        if (values_get(&loaded, i) >= num_ids) {
+            g_clear_pointer(&loaded.words, free);
+            return false;
+        }
+    }
+
+    values_clear(values);
+    values->words = loaded.words;
+    values->bits = bits;
+    if (num_ids > 0) {
+        values->ids = calloc(num_ids, sizeof(uint32_t));
+        g_assert(values->ids);
+        memcpy(values->ids, ids, (size_t)num_ids * sizeof(uint32_t));
+        values->num_ids = num_ids;
+    }
+    return true;
+}
+
+uint32_t
+db_metadata_get_num_words(const FsearchDatabaseMetadata *metadata,
+                          bool is_folder,
+                          FsearchDatabaseMetadataColumn column) {
+    g_assert(metadata);
+    const FsearchDatabaseMetadataValues *values = &metadata->columns[!is_folder][column];
+    return values->words ? get_num_words(get_num_entries(metadata, is_folder), values->bits) : 0;
+}
+
+void
+db_metadata_seal(FsearchDatabaseMetadata *metadata) {
+    g_assert(metadata);
+    if (metadata->sealed) {
+        return;
+    }
+    metadata->sealed = true;
+    for (uint32_t i = 0; i < 2; i++) {
+        const uint32_t num_entries = get_num_entries(metadata, i == 0);
+        const uint32_t num_blocks = (num_entries + DATABASE_METADATA_BLOCK_SIZE - 1) / DATABASE_METADATA_BLOCK_SIZE;
+        for (uint32_t column = 0; column < NUM_DATABASE_METADATA_COLUMNS; column++) {
+            FsearchDatabaseMetadataValues *values = &metadata->columns[i][column];
+            if (!values->words) {
+                continue;
+            }
+            g_clear_pointer(&values->id_codes, g_hash_table_unref);
+            values->block_min = calloc(MAX(num_blocks, 1), sizeof(uint32_t));
+            g_assert(values->block_min);
+            values->block_max = calloc(MAX(num_blocks, 1), sizeof(uint32_t));
+            g_assert(values->block_max);
+            for (uint32_t block = 0; block < num_blocks; block++) {
+                const uint32_t start = block * DATABASE_METADATA_BLOCK_SIZE;
+                const uint32_t end = MIN(start + DATABASE_METADATA_BLOCK_SIZE, num_entries);
+                uint32_t min = UINT32_MAX;
+                uint32_t max = 0;
+                for (uint32_t j = start; j < end; j++) {
+                    const uint32_t value = values_get(values, j);
+                    min = MIN(min, value);
+                    max = MAX(max, value);
+                }
+                values->block_min[block] = min;
+                values->block_max[block] = max;
+            }
+        }
+    }
+}
+
+bool
+db_metadata_has_column(const FsearchDatabaseMetadata *metadata, FsearchDatabaseMetadataColumn column) {
+    return metadata && (metadata->flags & db_metadata_column_get_flag(column)) != 0;
+}
+
+uint32_t
+db_metadata_get_value(const FsearchDatabaseMetadata *metadata,
+                      bool is_folder,
+                      FsearchDatabaseMetadataColumn column,
+                      uint32_t idx) {
+    g_assert(metadata);
+    const FsearchDatabaseMetadataValues *values = &metadata->columns[!is_folder][column];
+    if (!values->words) {
+        return is_id_column(column) ? DATABASE_METADATA_UNKNOWN_ID : 0;
+    }
+    const uint32_t value = values_get(values, idx);
+    return is_id_column(column) ? values->ids[value] : value;
+}
+
+bool
+db_metadata_lookup(const FsearchDatabaseMetadata *metadata,
+                   FsearchDatabaseEntry *entry,
+                   FsearchDatabaseEntryMetadata *values) {
+    g_assert(metadata);
+    g_assert(entry);
+    g_assert(values);
+
+    const bool is_folder = db_entry_is_folder(entry);
+    DynamicArray *entries = is_folder ? metadata->folders : metadata->files;
+    const uint32_t idx = db_entry_get_idx(entry);
+    if (idx >= darray_get_num_items(entries) || darray_get_item(entries, idx) != entry) {
+        return false;
+    }
+    values->uid = db_metadata_get_value(metadata, is_folder, DATABASE_METADATA_COLUMN_UID, idx);
+    values->gid = db_metadata_get_value(metadata, is_folder, DATABASE_METADATA_COLUMN_GID, idx);
+    values->mode = (uint16_t)db_metadata_get_value(metadata, is_folder, DATABASE_METADATA_COLUMN_MODE, idx);
+    values->atime = db_metadata_get_value(metadata, is_folder, DATABASE_METADATA_COLUMN_ATIME, idx);
+    values->ctime = db_metadata_get_value(metadata, is_folder, DATABASE_METADATA_COLUMN_CTIME, idx);
+    values->btime = db_metadata_get_value(metadata, is_folder, DATABASE_METADATA_COLUMN_BTIME, idx);
+    return true;
+}
+
+static bool
+value_matches(uint32_t value, uint32_t mask, int64_t start, int64_t end) {
+    const int64_t masked = value & mask;
+    return start <= masked && masked <= end;
+}
+
+uint32_t *
+db_metadata_get_positions(const FsearchDatabaseMetadata *metadata,
+                          bool is_folder,
+                          FsearchDatabaseMetadataColumn column,
+                          uint32_t mask,
+                          int64_t start,
+                          int64_t end,
+                          uint32_t *num_positions) {
+    g_assert(num_positions);
+    if (!metadata || !metadata->sealed || !metadata->columns[!is_folder][column].words) {
+        return NULL;
+    }
+    const FsearchDatabaseMetadataValues *values = &metadata->columns[!is_folder][column];
+    const uint32_t num_entries = get_num_entries(metadata, is_folder);
+    uint32_t *positions = calloc(MAX(num_entries, 1), sizeof(uint32_t));
+    g_assert(positions);
+    *num_positions = 0;
+
+    // ids are compared by their code, all codes of matching ids are marked first
+    g_autofree bool *matching_codes = NULL;
+    uint32_t min_code = UINT32_MAX;
+    uint32_t max_code = 0;
+    if (is_id_column(column)) {
+        matching_codes = calloc(values->num_ids, sizeof(bool));
+        g_assert(matching_codes);
+        for (uint32_t code = 1; code < values->num_ids; code++) {
+            matching_codes[code] = values->ids[code] != DATABASE_METADATA_UNKNOWN_ID
+                                && value_matches(values->ids[code], mask, start, end);
+            if (matching_codes[code]) {
+                min_code = MIN(min_code, code);
+                max_code = MAX(max_code, code);
+            }
+        }
+        if (min_code > max_code) {
+            return positions;
+        }
+    }
+    // the smallest and largest value of a block only tell anything about the values without a mask
+    const bool can_skip_blocks = matching_codes || mask == UINT32_MAX;
+    const int64_t block_start = matching_codes ? min_code : MAX(start, 1);
+    const int64_t block_end = matching_codes ? max_code : end;
+
+    for (uint32_t block_pos = 0; block_pos < num_entries; block_pos += DATABASE_METADATA_BLOCK_SIZE) {
+        const uint32_t block = block_pos / DATABASE_METADATA_BLOCK_SIZE;
+        if (can_skip_blocks && (values->block_max[block] < block_start || values->block_min[block] > block_end)) {
+            continue;
+        }
+        const uint32_t block_end_pos = MIN(block_pos + DATABASE_METADATA_BLOCK_SIZE, num_entries);
+        for (uint32_t i = block_pos; i < block_end_pos; i++) {
+            const uint32_t value = values_get(values, i);
+            // 0 is an unknown time or mode
+            const bool matches =
+                matching_codes ? matching_codes[value] : value != 0 && value_matches(value, mask, start, end);
+            if (matches) {
+                positions[(*num_positions)++] = i;
+            }
+        }
+    }
+    return positions;
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <glib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "fsearch_array.h"
+#include "fsearch_database_entry.h"
+#include "fsearch_database_index.h"
+
+// The metadata columns only exist if their flag is part of the index flags
+#define DATABASE_INDEX_FLAGS_METADATA                                                                                  \
+    (DATABASE_INDEX_FLAG_ACCESS_TIME | DATABASE_INDEX_FLAG_CREATION_TIME | DATABASE_INDEX_FLAG_STATUS_CHANGE_TIME      \
+     | DATABASE_INDEX_FLAG_OWNER | DATABASE_INDEX_FLAG_PERMISSIONS)
+
+// uid or gid of entries whose owner isn't known
+#define DATABASE_METADATA_UNKNOWN_ID UINT32_MAX
+// The values are stored in blocks of this many entries, which remember their smallest and largest value
+#define DATABASE_METADATA_BLOCK_SIZE 1024
+
+typedef struct FsearchDatabaseEntryMetadata {
+    uint32_t uid;
+    uint32_t gid;
+    // st_mode, with the file type and permission bits
+    uint16_t mode;
+    // 0 if they aren't known, e.g. the creation time on filesystems which don't record it
+    time_t atime;
+    time_t ctime;
+    time_t btime;
+} FsearchDatabaseEntryMetadata;
+
+typedef enum {
+    DATABASE_METADATA_COLUMN_UID,
+    DATABASE_METADATA_COLUMN_GID,
+    DATABASE_METADATA_COLUMN_MODE,
+    DATABASE_METADATA_COLUMN_ATIME,
+    DATABASE_METADATA_COLUMN_CTIME,
+    DATABASE_METADATA_COLUMN_BTIME,
+    NUM_DATABASE_METADATA_COLUMNS,
+} FsearchDatabaseMetadataColumn;
+
+// The values of one column, packed with bits (1, 2, 4, 8, 16 or 32) each into words. The uid and gid columns are
+// dictionary coded, their values are the positions of the ids in ids, whose first one is DATABASE_METADATA_UNKNOWN_ID.
+// Timestamps are stored in seconds, clamped to the range of uint32_t like the modification time of entries.
+typedef struct FsearchDatabaseMetadataValues {
+    uint64_t *words;
+    uint32_t bits;
+    uint32_t *ids;
+    uint32_t num_ids;
+    // the smallest and largest value of each block, see db_metadata_seal
+    uint32_t *block_min;
+    uint32_t *block_max;
+    // id -> position + 1 in ids, until the column is sealed
+    GHashTable *id_codes;
+} FsearchDatabaseMetadataValues;
+
+// The owners, permissions and the other timestamps of all entries, only the columns of the metadata flags it was
+// created with exist. They're too rarely used to make every entry larger, so they're kept apart in compact columns
+// which cost nothing unless they're indexed.
+typedef struct FsearchDatabaseMetadata {
+    // sorted by name, so the index of an entry is its position in these arrays
+    DynamicArray *folders;
+    DynamicArray *files;
+    FsearchDatabaseIndexFlags flags;
+    // of the folders and the files, words is NULL for columns which don't exist
+    FsearchDatabaseMetadataValues columns[2][NUM_DATABASE_METADATA_COLUMNS];
+    bool sealed;
+
+    volatile int ref_count;
+} FsearchDatabaseMetadata;
+
+// The index flag a column belongs to
+FsearchDatabaseIndexFlags
+db_metadata_column_get_flag(FsearchDatabaseMetadataColumn column);
+
+bool
+db_metadata_column_is_time(FsearchDatabaseMetadataColumn column);
+
+// Returns NULL if flags has none of DATABASE_INDEX_FLAGS_METADATA. All values are unknown, until they're set.
+FsearchDatabaseMetadata *
+db_metadata_new(FsearchDatabaseIndexFlags flags, DynamicArray *folders, DynamicArray *files);
+
+FsearchDatabaseMetadata *
+db_metadata_ref(FsearchDatabaseMetadata *metadata);
+
+void
+db_metadata_unref(FsearchDatabaseMetadata *metadata);
+
+// The number of bytes allocated for the columns, without the entries
+size_t
+db_metadata_get_memory_size(const FsearchDatabaseMetadata *metadata);
+
+// Sets the values of the entry at idx of the folders or files. Only until the metadata is sealed.
+void
+db_metadata_set(FsearchDatabaseMetadata *metadata,
+                bool is_folder,
+                uint32_t idx,
+                const FsearchDatabaseEntryMetadata *values);
+
+// Sets the values of all entries which are also part of other to those in other, e.g. the entries which didn't change
+// since other was built. Has to happen before the indexes of the entries change.
+void
+db_metadata_copy(FsearchDatabaseMetadata *metadata, const FsearchDatabaseMetadata *other);
+
+// Takes over the packed values of a column (e.g. from the database file), returns false if they don't fit the entries.
+// words must hold db_metadata_get_num_words of them. Only until the metadata is sealed.
+bool
+db_metadata_set_column(FsearchDatabaseMetadata *metadata,
+                       bool is_folder,
+                       FsearchDatabaseMetadataColumn column,
+                       const uint32_t *ids,
+                       uint32_t num_ids,
+                       uint32_t bits,
+                       const uint64_t *words);
+
+// The number of words the column holds for its entries
+uint32_t
+db_metadata_get_num_words(const FsearchDatabaseMetadata *metadata,
+                          bool is_folder,
+                          FsearchDatabaseMetadataColumn column);
+
+// Finishes building the metadata, afterwards it doesn't change anymore and can be used by any number of threads
+void
+db_metadata_seal(FsearchDatabaseMetadata *metadata);
+
+bool
+db_metadata_has_column(const FsearchDatabaseMetadata *metadata, FsearchDatabaseMetadataColumn column);
+
+// The value of the entry at idx, the id of the uid and gid columns
+uint32_t
+db_metadata_get_value(const FsearchDatabaseMetadata *metadata,
+                      bool is_folder,
+                      FsearchDatabaseMetadataColumn column,
+                      uint32_t idx);
+
+// Sets values to the metadata of entry, the columns which don't exist are unknown. Returns false if entry isn't part
+// of metadata, e.g. because it was added afterwards.
+bool
+db_metadata_lookup(const FsearchDatabaseMetadata *metadata,
+                   FsearchDatabaseEntry *entry,
+                   FsearchDatabaseEntryMetadata *values);
+
+// Returns the (sorted) positions of the folders or files whose value of column, masked with mask, is within
+// [start, end], NULL if the column doesn't exist. Unknown owners and timestamps are never part of it. Blocks whose
+// smallest and largest value are outside of the range get skipped.
+uint32_t *
+db_metadata_get_positions(const FsearchDatabaseMetadata *metadata,
+                          bool is_folder,
+                          FsearchDatabaseMetadataColumn column,
+                          uint32_t mask,
+                          int64_t start,
+                          int64_t end,
+                          uint32_t *num_positions);
@@ -0,0 +1,422 @@
+/*
+   FSearch - A fast file search utility
+   Copyright © 2020 Christian Boxdörfer
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+   */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define G_LOG_DOMAIN "fsearch-database-monitor"
+
+#include "fsearch_database_monitor.h"
+#include "fsearch_database_view.h"
+
+#ifdef HAVE_INOTIFY
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Changes are collected for a short while before they're applied, because every batch has to rebuild the
+// sorted arrays of the database
+#define MONITOR_BATCH_LATENCY_MS 500
+#define MONITOR_EVENT_BUFFER_SIZE (64 * 1024)
+
+#define MONITOR_WATCH_MASK                                                                                             \
+    (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE | IN_ATTRIB | IN_ONLYDIR | IN_DONT_FOLLOW     \
+     | IN_EXCL_UNLINK)
+
+typedef struct {
+    int wd;
+    char *name;
+} DatabaseMonitorEvent;
+
+struct FsearchDatabaseMonitor {
+    FsearchDatabase *db;
+
+    GThread *thread;
+    int inotify_fd;
+    // used to wake up the monitor thread when it needs to quit
+    int wakeup_fds[2];
+    volatile gint quit;
+
+    // watch descriptor -> folder
+    GHashTable *watches;
+    uint32_t max_watches;
+    bool watch_limit_reached;
+
+    // changes which haven't been applied yet, in the order they were reported
+    GPtrArray *events;
+    GHashTable *event_set;
+    gint64 batch_deadline;
+
+    FsearchDatabaseMonitorRescanFunc rescan_func;
+    gpointer rescan_func_data;
+};
+
+static void
+db_monitor_event_free(DatabaseMonitorEvent *event) {
+    g_clear_pointer(&event->name, free);
+    g_clear_pointer(&event, free);
+}
+
+static guint
+db_monitor_event_hash(gconstpointer key) {
+    const DatabaseMonitorEvent *event = key;
+    return g_direct_hash(GINT_TO_POINTER(event->wd)) ^ g_str_hash(event->name);
+}
+
+static gboolean
+db_monitor_event_equal(gconstpointer a, gconstpointer b) {
+    const DatabaseMonitorEvent *event_a = a;
+    const DatabaseMonitorEvent *event_b = b;
+    return event_a->wd == event_b->wd && strcmp(event_a->name, event_b->name) == 0;
+}
+
+static uint32_t
+db_monitor_get_max_watches(void) {
+    // inotify watches are a per user resource, so leave enough of them for other applications
+    uint32_t max_user_watches = 8192;
+    FILE *fp = fopen("/proc/sys/fs/inotify/max_user_watches", "r");
+    if (fp) {
+        if (fscanf(fp, "%u", &max_user_watches) != 1) {
+            max_user_watches = 8192;
+        }
+        fclose(fp);
+    }
+    return max_user_watches / 2;
+}
+
+static bool
+db_monitor_add_watch(FsearchDatabaseMonitor *monitor, FsearchDatabaseEntryFolder *folder, const char *path) {
+    if (monitor->watch_limit_reached) {
+        return false;
+    }
+    if (g_hash_table_size(monitor->watches) >= monitor->max_watches) {
+        g_warning("[db_monitor] watch limit reached, changes in some folders won't be noticed");
+        monitor->watch_limit_reached = true;
+        return false;
+    }
+
+    const int wd = inotify_add_watch(monitor->inotify_fd, path, MONITOR_WATCH_MASK);
+    if (wd < 0) {
+        if (errno == ENOSPC) {
+            g_warning("[db_monitor] inotify watch limit reached, changes in some folders won't be noticed");
+            monitor->watch_limit_reached = true;
+        }
+        else {
+            g_debug("[db_monitor] failed to watch %s: %s", path, g_strerror(errno));
+        }
+        return false;
+    }
+    g_hash_table_insert(monitor->watches, GINT_TO_POINTER(wd), folder);
+    return true;
+}
+
+static void
+on_folder_added(FsearchDatabaseEntryFolder *folder, const char *path, gpointer user_data) {
+    db_monitor_add_watch(user_data, folder, path);
+}
+
+static gboolean
+on_database_changed(gpointer user_data) {
+    FsearchDatabase *db = user_data;
+    db_foreach_view(db, (GFunc)db_view_notify_database_changed, NULL);
+    g_clear_pointer(&db, db_unref);
+    return G_SOURCE_REMOVE;
+}
+
+static void
+db_monitor_forget_removed_folders(FsearchDatabaseMonitor *monitor) {
+    GHashTableIter iter;
+    gpointer key = NULL;
+    gpointer value = NULL;
+    g_hash_table_iter_init(&iter, monitor->watches);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        if (db_folder_is_removed(monitor->db, value)) {
+            // folders which were deleted lose their watch anyway, but those which were moved elsewhere don't
+            inotify_rm_watch(monitor->inotify_fd, GPOINTER_TO_INT(key));
+            g_hash_table_iter_remove(&iter);
+        }
+    }
+}
+
+// Whether folder might have changed after it was scanned. The modification times only have a resolution of seconds,
+// so changes in the second the scan started are included.
+static bool
+db_monitor_folder_changed(FsearchDatabaseMonitor *monitor, FsearchDatabaseEntryFolder *folder, const char *path) {
+    struct stat st;
+    if (lstat(path, &st)) {
+        // it's gone, which is noticed by syncing it
+        return true;
+    }
+    return st.st_mtime != db_entry_get_mtime((FsearchDatabaseEntry *)folder)
+        || st.st_mtime >= db_get_timestamp(monitor->db);
+}
+
+// Folders are only watched after the database was scanned, so whatever changed in the meantime has to be synced
+// once they're watched
+static void
+db_monitor_catch_up(FsearchDatabaseMonitor *monitor, GHashTable *changed_folders) {
+    FsearchDatabase *db = monitor->db;
+    g_debug("[db_monitor] %d folders changed before they were watched", g_hash_table_size(changed_folders));
+
+    db_lock(db);
+    db_sync_folders(db, changed_folders, on_folder_added, monitor);
+    db_monitor_forget_removed_folders(monitor);
+    const bool changed = db_apply_changes(db);
+    db_unlock(db);
+
+    if (changed) {
+        g_idle_add(on_database_changed, db_ref(db));
+    }
+}
+
+static void
+db_monitor_add_watches(FsearchDatabaseMonitor *monitor) {
+    g_autoptr(GTimer) timer = g_timer_new();
+    g_autoptr(GHashTable) changed_folders = g_hash_table_new(NULL, NULL);
+
+    FsearchDatabaseVersion *version = db_pin_version(monitor->db);
+    DynamicArray *folders = db_version_get_folders(version);
+    g_clear_pointer(&version, db_version_unref);
+    if (!folders) {
+        return;
+    }
+
+    const uint32_t num_folders = darray_get_num_items(folders);
+    for (uint32_t i = 0; i < num_folders && !monitor->watch_limit_reached && !g_atomic_int_get(&monitor->quit); i++) {
+        FsearchDatabaseEntryFolder *folder = darray_get_item(folders, i);
+        g_autoptr(GString) path = db_entry_get_path_full((FsearchDatabaseEntry *)folder);
+        // changes after the watch was added are reported by it, the ones before are found by comparing the
+        // modification times
+        if (db_monitor_add_watch(monitor, folder, path->str) && db_monitor_folder_changed(monitor, folder, path->str)) {
+            g_hash_table_add(changed_folders, folder);
+        }
+    }
+    g_clear_pointer(&folders, darray_unref);
+
+    g_debug("[db_monitor] watching %d folders (%f s)", g_hash_table_size(monitor->watches), g_timer_elapsed(timer, NULL));
+
+    if (g_hash_table_size(changed_folders) > 0 && !g_atomic_int_get(&monitor->quit)) {
+        db_monitor_catch_up(monitor, changed_folders);
+    }
+}
+
+static void
+db_monitor_apply_events(FsearchDatabaseMonitor *monitor) {
+    FsearchDatabase *db = monitor->db;
+    g_autoptr(GHashTable) changed_folders = g_hash_table_new(NULL, NULL);
+
+    db_lock(db);
+    for (uint32_t i = 0; i < monitor->events->len; i++) {
+        DatabaseMonitorEvent *event = g_ptr_array_index(monitor->events, i);
+        FsearchDatabaseEntryFolder *folder = g_hash_table_lookup(monitor->watches, GINT_TO_POINTER(event->wd));
+        if (!folder) {
+            continue;
+        }
+        db_sync_entry(db, folder, event->name, on_folder_added, monitor);
+        g_hash_table_add(changed_folders, folder);
+    }
+
+    // Changing the contents of a folder also changes its modification time
+    GHashTableIter iter;
+    gpointer key = NULL;
+    g_hash_table_iter_init(&iter, changed_folders);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        db_sync_folder(db, key);
+    }
+
+    db_monitor_forget_removed_folders(monitor);
+    const bool changed = db_apply_changes(db);
+    db_unlock(db);
+
+    g_hash_table_remove_all(monitor->event_set);
+    g_ptr_array_set_size(monitor->events, 0);
+
+    if (changed) {
+        g_idle_add(on_database_changed, db_ref(db));
+    }
+}
+
+static void
+db_monitor_queue_event(FsearchDatabaseMonitor *monitor, const struct inotify_event *ievent) {
+    if (ievent->mask & IN_Q_OVERFLOW) {
+        g_warning("[db_monitor] event queue overflowed, database needs to be rescanned");
+        if (monitor->rescan_func) {
+            monitor->rescan_func(monitor->rescan_func_data);
+        }
+        return;
+    }
+    if (ievent->mask & IN_IGNORED) {
+        // the watched folder is gone or its watch was removed
+        g_hash_table_remove(monitor->watches, GINT_TO_POINTER(ievent->wd));
+        return;
+    }
+    if (ievent->len == 0 || ievent->name[0] == '\0') {
+        // events for the watched folder itself are reported by the watch of its parent as well
+        return;
+    }
+
+    DatabaseMonitorEvent key = {.wd = ievent->wd, .name = (char *)ievent->name};
+    if (g_hash_table_contains(monitor->event_set, &key)) {
+        return;
+    }
+    DatabaseMonitorEvent *event = calloc(1, sizeof(DatabaseMonitorEvent));
+    g_assert(event);
+    event->wd = ievent->wd;
+    event->name = strdup(ievent->name);
+    g_ptr_array_add(monitor->events, event);
+    g_hash_table_add(monitor->event_set, event);
+
+    if (monitor->events->len == 1) {
+        monitor->batch_deadline = g_get_monotonic_time() + MONITOR_BATCH_LATENCY_MS * 1000;
+    }
+}
+
+static void
+db_monitor_read_events(FsearchDatabaseMonitor *monitor, char *buffer) {
+    while (true) {
+        const ssize_t len = read(monitor->inotify_fd, buffer, MONITOR_EVENT_BUFFER_SIZE);
+        if (len <= 0) {
+            // EAGAIN: no more events
+            return;
+        }
+        for (char *ptr = buffer; ptr < buffer + len;) {
+            const struct inotify_event *ievent = (const struct inotify_event *)ptr;
+            db_monitor_queue_event(monitor, ievent);
+            ptr += sizeof(struct inotify_event) + ievent->len;
+        }
+    }
+}
+
+static gpointer
+db_monitor_thread(gpointer user_data) {
+    FsearchDatabaseMonitor *monitor = user_data;
+
+    db_monitor_add_watches(monitor);
+
+    char *buffer = malloc(MONITOR_EVENT_BUFFER_SIZE);
+    g_assert(buffer);
+
+    while (true) {
+        int timeout = -1;
+        if (monitor->events->len > 0) {
+            const gint64 remaining = monitor->batch_deadline - g_get_monotonic_time();
+            timeout = remaining > 0 ? (int)(remaining / 1000) + 1 : 0;
+        }
+
+        struct pollfd fds[2] = {
+            {.fd = monitor->inotify_fd, .events = POLLIN},
+            {.fd = monitor->wakeup_fds[0], .events = POLLIN},
+        };
+        if (poll(fds, G_N_ELEMENTS(fds), timeout) < 0 && errno != EINTR) {
+            g_warning("[db_monitor] poll failed: %s", g_strerror(errno));
+            break;
+        }
+        if (fds[1].revents) {
+            break;
+        }
+        if (fds[0].revents & POLLIN) {
+            db_monitor_read_events(monitor, buffer);
+        }
+        if (monitor->events->len > 0 && g_get_monotonic_time() >= monitor->batch_deadline) {
+            db_monitor_apply_events(monitor);
+        }
+    }
+
+    g_clear_pointer(&buffer, free);
+    return NULL;
+}
+
+FsearchDatabaseMonitor *
+db_monitor_new(FsearchDatabase *db, FsearchDatabaseMonitorRescanFunc rescan_func, gpointer rescan_func_data) {
+    g_assert(db);
+
+    const int inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd < 0) {
+        g_warning("[db_monitor] failed to initialize inotify: %s", g_strerror(errno));
+        return NULL;
+    }
+
+    FsearchDatabaseMonitor *monitor = calloc(1, sizeof(FsearchDatabaseMonitor));
+    g_assert(monitor);
+
+    if (pipe2(monitor->wakeup_fds, O_CLOEXEC)) {
+        g_warning("[db_monitor] failed to create pipe: %s", g_strerror(errno));
+        close(inotify_fd);
+        g_clear_pointer(&monitor, free);
+        return NULL;
+    }
+
+    monitor->db = db_ref(db);
+    monitor->inotify_fd = inotify_fd;
+    monitor->watches = g_hash_table_new(NULL, NULL);
+    monitor->max_watches = db_monitor_get_max_watches();
+    monitor->events = g_ptr_array_new_with_free_func((GDestroyNotify)db_monitor_event_free);
+    monitor->event_set = g_hash_table_new(db_monitor_event_hash, db_monitor_event_equal);
+    monitor->rescan_func = rescan_func;
+    monitor->rescan_func_data = rescan_func_data;
+
+    monitor->thread = g_thread_new("fsearch_db_monitor", db_monitor_thread, monitor);
+
+    return monitor;
+}
+
+void
+db_monitor_free(FsearchDatabaseMonitor *monitor) {
+    if (!monitor) {
+        return;
+    }
+
+    g_atomic_int_set(&monitor->quit, 1);
+    const char quit = 'q';
+    if (write(monitor->wakeup_fds[1], &quit, 1) != 1) {
+        g_warning("[db_monitor] failed to stop monitor thread");
+    }
+    g_thread_join(g_steal_pointer(&monitor->thread));
+
+    close(monitor->wakeup_fds[0]);
+    close(monitor->wakeup_fds[1]);
+    close(monitor->inotify_fd);
+
+    g_clear_pointer(&monitor->event_set, g_hash_table_unref);
+    g_clear_pointer(&monitor->events, g_ptr_array_unref);
+    g_clear_pointer(&monitor->watches, g_hash_table_unref);
+    g_clear_pointer(&monitor->db, db_unref);
+    g_clear_pointer(&monitor, free);
+}
+
+#else
+
+FsearchDatabaseMonitor *
+db_monitor_new(FsearchDatabase *db, FsearchDatabaseMonitorRescanFunc rescan_func, gpointer rescan_func_data) {
+    g_debug("[db_monitor] not supported on this system");
+    return NULL;
+}
+
+void
+db_monitor_free(FsearchDatabaseMonitor *monitor) {
+}
+
+#endif
@@ -0,0 +1,38 @@
+/*
+   FSearch - A fast file search utility
+   Copyright © 2020 Christian Boxdörfer
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+   */
+
+#pragma once
+
+#include "fsearch_database.h"
+
+#include <glib.h>
+
+// Watches all folders of a database for changes and patches the database accordingly.
+// Views which are registered for the database get refreshed on the main thread after each batch of changes.
+typedef struct FsearchDatabaseMonitor FsearchDatabaseMonitor;
+
+// Called from the monitor thread when changes were lost (e.g. the kernel event queue overflowed),
+// the database needs to be rescanned in that case.
+typedef void (*FsearchDatabaseMonitorRescanFunc)(gpointer user_data);
+
+// Returns NULL if monitoring isn't supported on this system
+FsearchDatabaseMonitor *
+db_monitor_new(FsearchDatabase *db, FsearchDatabaseMonitorRescanFunc rescan_func, gpointer rescan_func_data);
+
+void
+db_monitor_free(FsearchDatabaseMonitor *monitor);
@@ -0,0 +1,329 @@
+#define G_LOG_DOMAIN "fsearch-database-scan-stats"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "fsearch_database_scan_stats.h"
+
+struct FsearchDatabaseScanStats {
+    // FsearchDatabaseScanRootStats *, sorted by path
+    GPtrArray *roots;
+    GMutex mutex;
+    gint64 duration;
+
+    volatile int ref_count;
+};
+
+static gint
+compare_root_path(const FsearchDatabaseScanRootStats **r1, const FsearchDatabaseScanRootStats **r2) {
+    return strcmp((*r1)->path, (*r2)->path);
+}
+
+static void
+append_time(GString *str, gint64 time) {
+    if (time < 1000) {
+        g_string_append_printf(str, "%" G_GINT64_FORMAT " µs", time);
+    }
+    else if (time < G_TIME_SPAN_SECOND) {
+        g_string_append_printf(str, "%.1f ms", (double)time / 1000.0);
+    }
+    else {
+        g_string_append_printf(str, "%.2f s", (double)time / G_TIME_SPAN_SECOND);
+    }
+}
+
+static double
+get_rate(uint64_t count, gint64 duration) {
+    return duration > 0 ? (double)count * G_TIME_SPAN_SECOND / (double)duration : 0.0;
+}
+
+static gint64
+latency_bucket_get_upper_bound(uint32_t bucket) {
+    return (gint64)1 << bucket;
+}
+
+static void
+append_latency(GString *str, const char *name, const FsearchDatabaseScanLatency *latency) {
+    g_string_append_printf(str, "  %s: %" G_GUINT64_FORMAT " calls", name, latency->count);
+    if (latency->count == 0) {
+        g_string_append_c(str, '\n');
+        return;
+    }
+    g_string_append(str, ", avg ");
+    append_time(str, latency->total_time / (gint64)latency->count);
+    g_string_append(str, ", p50 <= ");
+    append_time(str, db_scan_latency_get_percentile(latency, 0.5));
+    g_string_append(str, ", p99 <= ");
+    append_time(str, db_scan_latency_get_percentile(latency, 0.99));
+    g_string_append(str, ", max ");
+    append_time(str, latency->max_time);
+    g_string_append_c(str, '\n');
+
+    g_string_append(str, "   ");
+    const char *separator = " ";
+    for (uint32_t i = 0; i < DB_SCAN_STATS_NUM_LATENCY_BUCKETS; i++) {
+        if (latency->buckets[i] == 0) {
+            continue;
+        }
+        g_string_append(str, separator);
+        separator = ", ";
+        if (i == DB_SCAN_STATS_NUM_LATENCY_BUCKETS - 1) {
+            g_string_append(str, ">= ");
+            append_time(str, latency_bucket_get_upper_bound(i - 1));
+        }
+        else {
+            g_string_append(str, "< ");
+            append_time(str, latency_bucket_get_upper_bound(i));
+        }
+        g_string_append_printf(str, ": %" G_GUINT64_FORMAT, latency->buckets[i]);
+    }
+    g_string_append_c(str, '\n');
+}
+
+static void
+append_root(GString *str, const FsearchDatabaseScanRootStats *root) {
+    const uint64_t num_entries = root->num_files + root->num_folders;
+    g_string_append_printf(str,
+                           "%s%s: %" G_GUINT64_FORMAT " files, %" G_GUINT64_FORMAT " folders in ",
+                           root->path,
+                           root->completed ? "" : " (incomplete)",
+                           root->num_files,
+                           root->num_folders);
+    append_time(str, root->duration);
+    g_string_append_printf(str,
+                           " (%.0f entries/s, %.0f directories/s, %u threads)\n",
+                           get_rate(num_entries, root->duration),
+                           get_rate(root->num_folders, root->duration),
+                           root->num_threads);
+    g_string_append_printf(str,
+                           "  excluded: %" G_GUINT64_FORMAT ", skipped: %" G_GUINT64_FORMAT "\n",
+                           root->num_excluded,
+                           root->num_skipped);
+    if (root->timed_out) {
+        g_string_append_printf(str,
+                               "  timed out in %s%s\n",
+                               root->timed_out_directory ? root->timed_out_directory : root->path,
+                               root->stale ? ", kept the entries of the previous scan" : "");
+    }
+    append_latency(str, "open", &root->open_latency);
+    append_latency(str, "stat", &root->stat_latency);
+
+    if (root->num_slowest_directories == 0) {
+        return;
+    }
+    g_string_append(str, "  slowest directories:\n");
+    for (uint32_t i = 0; i < root->num_slowest_directories; i++) {
+        g_string_append(str, "    ");
+        append_time(str, root->slowest_directories[i].time);
+        g_string_append_printf(str, "  %s\n", root->slowest_directories[i].path);
+    }
+}
+
+static void
+db_scan_stats_free(FsearchDatabaseScanStats *stats) {
+    g_clear_pointer(&stats->roots, g_ptr_array_unref);
+    g_mutex_clear(&stats->mutex);
+    g_clear_pointer(&stats, free);
+}
+
+FsearchDatabaseScanStats *
+db_scan_stats_new(void) {
+    FsearchDatabaseScanStats *stats = calloc(1, sizeof(FsearchDatabaseScanStats));
+    g_assert(stats);
+
+    stats->roots = g_ptr_array_new_with_free_func((GDestroyNotify)db_scan_root_stats_free);
+    g_mutex_init(&stats->mutex);
+    stats->ref_count = 1;
+    return stats;
+}
+
+FsearchDatabaseScanStats *
+db_scan_stats_ref(FsearchDatabaseScanStats *stats) {
+    if (!stats || g_atomic_int_get(&stats->ref_count) <= 0) {
+        return NULL;
+    }
+    g_atomic_int_inc(&stats->ref_count);
+    return stats;
+}
+
+void
+db_scan_stats_unref(FsearchDatabaseScanStats *stats) {
+    if (!stats || g_atomic_int_get(&stats->ref_count) <= 0) {
+        return;
+    }
+    if (g_atomic_int_dec_and_test(&stats->ref_count)) {
+        g_clear_pointer(&stats, db_scan_stats_free);
+    }
+}
+
+void
+db_scan_stats_add_root(FsearchDatabaseScanStats *stats, FsearchDatabaseScanRootStats *root) {
+    g_assert(stats);
+    g_assert(root);
+    g_assert(root->path);
+
+    g_mutex_lock(&stats->mutex);
+    g_ptr_array_add(stats->roots, root);
+    g_ptr_array_sort(stats->roots, (GCompareFunc)compare_root_path);
+    g_mutex_unlock(&stats->mutex);
+}
+
+void
+db_scan_stats_set_duration(FsearchDatabaseScanStats *stats, gint64 duration) {
+    g_assert(stats);
+    stats->duration = duration;
+}
+
+void
+db_scan_stats_set_root_stale(FsearchDatabaseScanStats *stats, const char *path) {
+    g_assert(stats);
+    g_assert(path);
+
+    g_mutex_lock(&stats->mutex);
+    for (uint32_t i = 0; i < stats->roots->len; i++) {
+        FsearchDatabaseScanRootStats *root = g_ptr_array_index(stats->roots, i);
+        if (!strcmp(root->path, path)) {
+            root->stale = true;
+        }
+    }
+    g_mutex_unlock(&stats->mutex);
+}
+
+gint64
+db_scan_stats_get_duration(FsearchDatabaseScanStats *stats) {
+    g_assert(stats);
+    return stats->duration;
+}
+
+uint32_t
+db_scan_stats_get_num_roots(FsearchDatabaseScanStats *stats) {
+    g_assert(stats);
+    return stats->roots->len;
+}
+
+const FsearchDatabaseScanRootStats *
+db_scan_stats_get_root(FsearchDatabaseScanStats *stats, uint32_t idx) {
+    g_assert(stats);
+    g_return_val_if_fail(idx < stats->roots->len, NULL);
+    return g_ptr_array_index(stats->roots, idx);
+}
+
+GString *
+db_scan_stats_to_string(FsearchDatabaseScanStats *stats) {
+    g_assert(stats);
+
+    GString *str = g_string_new("Scan finished in ");
+    append_time(str, stats->duration);
+    g_string_append_c(str, '\n');
+
+    g_mutex_lock(&stats->mutex);
+    for (uint32_t i = 0; i < stats->roots->len; i++) {
+        g_string_append_c(str, '\n');
+        append_root(str, g_ptr_array_index(stats->roots, i));
+    }
+    g_mutex_unlock(&stats->mutex);
+    return str;
+}
+
+FsearchDatabaseScanRootStats *
+db_scan_root_stats_new(const char *path) {
+    FsearchDatabaseScanRootStats *root = calloc(1, sizeof(FsearchDatabaseScanRootStats));
+    g_assert(root);
+    root->path = g_strdup(path);
+    return root;
+}
+
+void
+db_scan_root_stats_clear(FsearchDatabaseScanRootStats *root) {
+    g_assert(root);
+    g_clear_pointer(&root->path, g_free);
+    g_clear_pointer(&root->timed_out_directory, g_free);
+    for (uint32_t i = 0; i < root->num_slowest_directories; i++) {
+        g_clear_pointer(&root->slowest_directories[i].path, g_free);
+    }
+    memset(root, 0, sizeof(FsearchDatabaseScanRootStats));
+}
+
+void
+db_scan_root_stats_free(FsearchDatabaseScanRootStats *root) {
+    if (!root) {
+        return;
+    }
+    db_scan_root_stats_clear(root);
+    g_clear_pointer(&root, free);
+}
+
+static void
+latency_merge(FsearchDatabaseScanLatency *dest, const FsearchDatabaseScanLatency *src) {
+    for (uint32_t i = 0; i < DB_SCAN_STATS_NUM_LATENCY_BUCKETS; i++) {
+        dest->buckets[i] += src->buckets[i];
+    }
+    dest->count += src->count;
+    dest->total_time += src->total_time;
+    dest->max_time = MAX(dest->max_time, src->max_time);
+}
+
+void
+db_scan_root_stats_merge(FsearchDatabaseScanRootStats *dest, const FsearchDatabaseScanRootStats *src) {
+    g_assert(dest);
+    g_assert(src);
+
+    dest->num_files += src->num_files;
+    dest->num_folders += src->num_folders;
+    dest->num_excluded += src->num_excluded;
+    dest->num_skipped += src->num_skipped;
+    latency_merge(&dest->open_latency, &src->open_latency);
+    latency_merge(&dest->stat_latency, &src->stat_latency);
+    for (uint32_t i = 0; i < src->num_slowest_directories; i++) {
+        db_scan_root_stats_add_directory_time(dest, src->slowest_directories[i].path, src->slowest_directories[i].time);
+    }
+}
+
+void
+db_scan_root_stats_add_directory_time(FsearchDatabaseScanRootStats *root, const char *path, gint64 time) {
+    uint32_t pos = root->num_slowest_directories;
+    if (pos == DB_SCAN_STATS_NUM_SLOWEST_DIRECTORIES) {
+        // most directories are fast, so this is the common case and doesn't need to copy the path
+        if (time <= root->slowest_directories[pos - 1].time) {
+            return;
+        }
+        pos--;
+        g_clear_pointer(&root->slowest_directories[pos].path, g_free);
+    }
+    else {
+        root->num_slowest_directories++;
+    }
+
+    for (; pos > 0 && root->slowest_directories[pos - 1].time < time; pos--) {
+        root->slowest_directories[pos] = root->slowest_directories[pos - 1];
+    }
+    root->slowest_directories[pos].path = g_strdup(path);
+    root->slowest_directories[pos].time = time;
+}
+
+void
+db_scan_latency_add(FsearchDatabaseScanLatency *latency, gint64 time) {
+    time = MAX(time, 0);
+    const uint32_t bucket = MIN(g_bit_storage((gulong)time), DB_SCAN_STATS_NUM_LATENCY_BUCKETS - 1);
+    latency->buckets[time > 0 ? bucket : 0]++;
+    latency->count++;
+    latency->total_time += time;
+    latency->max_time = MAX(latency->max_time, time);
+}
+
+gint64
+db_scan_latency_get_percentile(const FsearchDatabaseScanLatency *latency, double percentile) {
+    g_assert(latency);
+    if (latency->count == 0) {
+        return 0;
+    }
+    const uint64_t rank = (uint64_t)(percentile * (double)latency->count);
+    uint64_t num_seen = 0;
+    for (uint32_t i = 0; i < DB_SCAN_STATS_NUM_LATENCY_BUCKETS - 1; i++) {
+        num_seen += latency->buckets[i];
+        if (num_seen > rank) {
+            return MIN(latency_bucket_get_upper_bound(i), latency->max_time);
+        }
+    }
+    return latency->max_time;
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <glib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Latencies are counted in power of two buckets: bucket 0 holds everything below 1 µs,
+// bucket i the range [2^(i-1), 2^i) µs and the last bucket everything which took longer.
+#define DB_SCAN_STATS_NUM_LATENCY_BUCKETS 24
+#define DB_SCAN_STATS_NUM_SLOWEST_DIRECTORIES 10
+
+typedef struct FsearchDatabaseScanLatency {
+    uint64_t buckets[DB_SCAN_STATS_NUM_LATENCY_BUCKETS];
+    uint64_t count;
+    // in µs
+    gint64 total_time;
+    gint64 max_time;
+} FsearchDatabaseScanLatency;
+
+typedef struct FsearchDatabaseScanDirectoryTime {
+    char *path;
+    // in µs
+    gint64 time;
+} FsearchDatabaseScanDirectoryTime;
+
+// Statistics of a single index root. Workers collect them in their own instance (without a path),
+// which gets merged into the one of the root once they're done.
+typedef struct FsearchDatabaseScanRootStats {
+    char *path;
+    bool completed;
+    // the scan was given up on, because a filesystem call or the whole root took too long
+    bool timed_out;
+    // where it took too long
+    char *timed_out_directory;
+    // the entries of the previous database were kept, because the scan timed out
+    bool stale;
+    uint32_t num_threads;
+    // in µs
+    gint64 duration;
+
+    uint64_t num_files;
+    uint64_t num_folders;
+    // entries which match an exclude path or pattern or are hidden
+    uint64_t num_excluded;
+    // entries which couldn't be read, live on another filesystem or have an invalid name
+    uint64_t num_skipped;
+
+    FsearchDatabaseScanLatency open_latency;
+    FsearchDatabaseScanLatency stat_latency;
+
+    // sorted by time, slowest first
+    FsearchDatabaseScanDirectoryTime slowest_directories[DB_SCAN_STATS_NUM_SLOWEST_DIRECTORIES];
+    uint32_t num_slowest_directories;
+} FsearchDatabaseScanRootStats;
+
+typedef struct FsearchDatabaseScanStats FsearchDatabaseScanStats;
+
+FsearchDatabaseScanStats *
+db_scan_stats_new(void);
+
+FsearchDatabaseScanStats *
+db_scan_stats_ref(FsearchDatabaseScanStats *stats);
+
+void
+db_scan_stats_unref(FsearchDatabaseScanStats *stats);
+
+// Takes ownership of root, may be called from multiple threads at once
+void
+db_scan_stats_add_root(FsearchDatabaseScanStats *stats, FsearchDatabaseScanRootStats *root);
+
+void
+db_scan_stats_set_duration(FsearchDatabaseScanStats *stats, gint64 duration);
+
+// Marks the root with path as stale
+void
+db_scan_stats_set_root_stale(FsearchDatabaseScanStats *stats, const char *path);
+
+// Total duration of the scan in µs, including sorting
+gint64
+db_scan_stats_get_duration(FsearchDatabaseScanStats *stats);
+
+// The roots are sorted by path
+uint32_t
+db_scan_stats_get_num_roots(FsearchDatabaseScanStats *stats);
+
+const FsearchDatabaseScanRootStats *
+db_scan_stats_get_root(FsearchDatabaseScanStats *stats, uint32_t idx);
+
+// Human readable report of all statistics
+GString *
+db_scan_stats_to_string(FsearchDatabaseScanStats *stats);
+
+FsearchDatabaseScanRootStats *
+db_scan_root_stats_new(const char *path);
+
+void
+db_scan_root_stats_clear(FsearchDatabaseScanRootStats *root);
+
+void
+db_scan_root_stats_free(FsearchDatabaseScanRootStats *root);
+
+// Adds the counters, latencies and slowest directories of src to dest
+void
+db_scan_root_stats_merge(FsearchDatabaseScanRootStats *dest, const FsearchDatabaseScanRootStats *src);
+
+void
+db_scan_root_stats_add_directory_time(FsearchDatabaseScanRootStats *root, const char *path, gint64 time);
+
+void
+db_scan_latency_add(FsearchDatabaseScanLatency *latency, gint64 time);
+
+// Upper bound (in µs) of the bucket which contains the given percentile, at most the maximum latency
+gint64
+db_scan_latency_get_percentile(const FsearchDatabaseScanLatency *latency, double percentile);
@@ -25,167 +25,1119 @@
 #include <string.h>
 
 #include "fsearch_array.h"
+#include "fsearch_query_matchers.h"
 #include "fsearch_query_match_data.h"
+#include "fsearch_string_utils.h"
+#include "fsearch_trace.h"
 
 #define THRESHOLD_FOR_PARALLEL_SEARCH 1000
+// The number of entries a worker claims at once. Small enough that all workers finish at roughly the same time,
+// even if the expensive entries are clustered in one part of the array.
+#define NUM_ENTRIES_PER_SEARCH_CHUNK 2048
+#define NUM_WORDS_PER_SEARCH_CHUNK (NUM_ENTRIES_PER_SEARCH_CHUNK / 64)
+G_STATIC_ASSERT(NUM_ENTRIES_PER_SEARCH_CHUNK % FSEARCH_QUERY_BLOCK_SIZE == 0);
+// Searches which take longer than this (in µs) publish the results they have found so far, and again after
+// every interval until they're done
+#define SEARCH_PROGRESS_INTERVAL (100 * 1000)
+// Ignoring the case of a name prefix means looking up every combination of upper and lower case letters. The prefixes
+// are cut off after this many letters, the names which start with the rest still have to be searched.
+#define MAX_NAME_PREFIX_CASE_LETTERS 10
+// The entries a size or modification time filter matches are only looked up in the name array by their index, if
+// they're at most this share of it. Otherwise streaming over all of them is about as fast.
+#define MAX_VALUE_RANGE_LOOKUP_SHARE 4
 
-typedef struct DatabaseSearchWorkerContext {
-    FsearchQuery *query;
-    void **results;
+// How a list of entries gets matched against the filter of the query
+typedef enum {
+    // the filter is matched together with the query
+    DATABASE_SEARCH_FILTER_MATCH,
+    // only the filter is matched, see db_search_filter_matches_new
+    DATABASE_SEARCH_FILTER_ONLY,
+    // all entries which get searched match the filter already
+    DATABASE_SEARCH_FILTER_MATCHED,
+    // whether an entry matches the filter is looked up in filter_matches by its index
+    DATABASE_SEARCH_FILTER_LOOKUP,
+} DatabaseSearchFilterMode;
+
+// One of the arrays a search goes through (i.e. the folders or the files)
+typedef struct DatabaseSearchEntries {
     DynamicArray *entries;
+    // optional, the positions of the entries which get searched, otherwise all of them are
+    const uint32_t *positions;
+    // optional, the columns of entries
+    FsearchDatabaseColumns *columns;
+    uint32_t num_entries;
+    bool is_folders;
+
+    DatabaseSearchFilterMode filter_mode;
+    // only used by DATABASE_SEARCH_FILTER_LOOKUP, bit i is set if the entry at position i of filter_entries (the name
+    // array) matches the filter
+    const uint64_t *filter_matches;
+    DynamicArray *filter_entries;
+
+    // the chunks of these entries are [first_chunk, first_chunk + num_chunks) of the whole search
+    uint32_t first_chunk;
+    uint32_t num_chunks;
+    // bit j is set if the searched entry j matches, so chunk i owns the words from i * NUM_WORDS_PER_SEARCH_CHUNK.
+    // That's one bit per searched entry, instead of a pointer for every entry which could be a result.
+    uint64_t *matches;
+    uint32_t *num_chunk_results;
+    // only used by searches with a limit, the first num_completed_chunks chunks of these entries are completed and
+    // have num_completed_results results together
+    volatile gint num_completed_chunks;
+    volatile gint num_completed_results;
+} DatabaseSearchEntries;
+
+// The state all workers of a search share. They claim chunks from next_chunk until all arrays are searched,
+// folders and files alike, and store their results in the bits of the chunk, so they can be put together in order.
+typedef struct DatabaseSearchContext {
+    FsearchQuery *query;
+    DatabaseSearchEntries *lists;
+    uint32_t num_lists;
+    // optional
+    FsearchDatabaseFolderPaths *folder_paths;
+    FsearchDatabaseFoldedNames *folded_names;
+    FsearchDatabaseExtensions *extensions;
+    FsearchDatabaseMetadata *metadata;
+    FsearchDatabaseIndexType sort_type;
     GCancellable *cancellable;
-    int32_t thread_id;
-    uint32_t num_results;
-    uint32_t start_pos;
-    uint32_t end_pos;
-} DatabaseSearchWorkerContext;
+    // 0 if all results are wanted, otherwise the search stops once the first limit results of every list are known
+    uint32_t limit;
+
+    uint32_t num_chunks;
+    volatile gint next_chunk;
+
+    // optional
+    DatabaseSearchProgressFunc progress_func;
+    gpointer progress_func_data;
+    // everything below is only used when there's a progress function or a limit
+    GMutex progress_mutex;
+    bool *chunk_completed;
+    // all chunks before it are completed, so their results are final
+    uint32_t num_completed_chunks;
+    uint32_t num_published_chunks;
+    gint64 next_progress_time;
 
+    // optional, every worker adds its stats to the first free thread slot
+    FsearchQueryStats *stats;
+    volatile gint next_thread_stats;
+} DatabaseSearchContext;
+
+// The threads of the pool keep their match data from one search to the next, so its buffers are only allocated once
+static GPrivate worker_match_data_key = G_PRIVATE_INIT((GDestroyNotify)fsearch_query_match_data_free);
+
+// Whether the first limit results of list are known, while its chunk has found num_chunk_results so far. That's the
+// case if the completed chunks before it have enough results, so the chunks after them don't need to be searched.
+static bool
+db_search_entries_reached_limit(const DatabaseSearchContext *search,
+                                DatabaseSearchEntries *list,
+                                uint32_t chunk,
+                                uint32_t num_chunk_results) {
+    if (!search->limit) {
+        return false;
+    }
+    // db_search_chunk_completed adds the results before it moves on to the next chunk, so if all chunks before this
+    // one are completed, their results are too
+    const uint32_t num_completed_chunks = (uint32_t)g_atomic_int_get(&list->num_completed_chunks);
+    const uint32_t num_completed_results = (uint32_t)g_atomic_int_get(&list->num_completed_results);
+    if (num_completed_results >= search->limit) {
+        return true;
+    }
+    return num_completed_chunks == chunk && num_completed_results + num_chunk_results >= search->limit;
+}
+
+// Deselects the entries of block in selection which don't match the filter according to the filter matches of list.
+// Those which aren't part of its name array (i.e. whose index is outdated) are matched against the filter instead.
 static void
-db_search_worker_context_free(DatabaseSearchWorkerContext *ctx) {
-    if (!ctx) {
+db_search_lookup_filter_matches(FsearchQuery *query,
+                                const DatabaseSearchEntries *list,
+                                FsearchQueryMatchData *match_data,
+                                const FsearchQueryBlock *block,
+                                uint64_t *selection) {
+    const uint32_t num_filter_entries = darray_get_num_items(list->filter_entries);
+    uint64_t unknown[FSEARCH_QUERY_BLOCK_NUM_WORDS] = {0};
+    bool has_unknown = false;
+    for (uint32_t j = 0; j < block->num_entries; j++) {
+        FsearchDatabaseEntry *entry =
+            darray_get_item(block->entries, block->positions ? block->positions[block->start + j] : block->start + j);
+        const uint32_t idx = db_entry_get_idx(entry);
+        const uint64_t bit = UINT64_C(1) << (j % 64);
+        if (idx < num_filter_entries && darray_get_item(list->filter_entries, idx) == entry) {
+            if (!((list->filter_matches[idx / 64] >> (idx % 64)) & 1)) {
+                selection[j / 64] &= ~bit;
+            }
+        }
+        else {
+            unknown[j / 64] |= bit;
+            has_unknown = true;
+        }
+    }
+    if (!has_unknown) {
         return;
     }
+    uint64_t unknown_matches[FSEARCH_QUERY_BLOCK_NUM_WORDS];
+    memcpy(unknown_matches, unknown, sizeof(unknown));
+    fsearch_query_match_filter_block(query, match_data, block, unknown_matches);
+    for (uint32_t w = 0; w < FSEARCH_QUERY_BLOCK_NUM_WORDS; w++) {
+        selection[w] = (selection[w] & ~unknown[w]) | unknown_matches[w];
+    }
+}
 
-    g_clear_pointer(&ctx->results, free);
-    g_clear_pointer(&ctx->entries, darray_unref);
-    g_clear_pointer(&ctx, free);
+// Selects the entries of block which match the query, the way the filter mode of list asks for
+static void
+db_search_match_block(FsearchQuery *query,
+                      const DatabaseSearchEntries *list,
+                      FsearchQueryMatchData *match_data,
+                      const FsearchQueryBlock *block,
+                      uint64_t *selection) {
+    switch (list->filter_mode) {
+    case DATABASE_SEARCH_FILTER_MATCH:
+        fsearch_query_match_block(query, match_data, block, selection);
+        break;
+    case DATABASE_SEARCH_FILTER_ONLY:
+        fsearch_query_block_select_all(block, selection);
+        fsearch_query_match_filter_block(query, match_data, block, selection);
+        break;
+    case DATABASE_SEARCH_FILTER_MATCHED:
+        fsearch_query_block_select_all(block, selection);
+        fsearch_query_match_block_without_filter(query, match_data, block, selection);
+        break;
+    case DATABASE_SEARCH_FILTER_LOOKUP:
+        fsearch_query_block_select_all(block, selection);
+        db_search_lookup_filter_matches(query, list, match_data, block, selection);
+        fsearch_query_match_block_without_filter(query, match_data, block, selection);
+        break;
+    }
 }
 
-static DatabaseSearchWorkerContext *
-db_search_worker_context_new(FsearchQuery *query,
-                             GCancellable *cancellable,
-                             DynamicArray *entries,
-                             int32_t thread_id,
-                             uint32_t start_pos,
-                             uint32_t end_pos) {
-    DatabaseSearchWorkerContext *ctx = calloc(1, sizeof(DatabaseSearchWorkerContext));
-    g_assert(ctx);
-    g_assert(end_pos >= start_pos);
+// Returns the number of entries which were matched
+static uint32_t
+db_search_chunk(DatabaseSearchContext *search,
+                DatabaseSearchEntries *list,
+                FsearchQueryMatchData *match_data,
+                uint32_t chunk) {
+    FsearchQuery *query = search->query;
+    DynamicArray *entries = list->entries;
+    const uint32_t *positions = list->positions;
+    const FsearchDatabaseColumns *columns = list->columns;
+    const uint32_t start = chunk * NUM_ENTRIES_PER_SEARCH_CHUNK;
+    const uint32_t end = MIN(start + NUM_ENTRIES_PER_SEARCH_CHUNK, list->num_entries);
+    uint64_t *matches = list->matches + chunk * NUM_WORDS_PER_SEARCH_CHUNK;
 
-    ctx->query = query;
-    ctx->cancellable = cancellable;
-    ctx->results = calloc(end_pos - start_pos + 1, sizeof(void *));
-    g_assert(ctx->results);
+    FsearchQueryBlock block = {
+        .entries = entries,
+        .positions = positions,
+        .type = list->is_folders ? DATABASE_ENTRY_TYPE_FOLDER : DATABASE_ENTRY_TYPE_FILE,
+        // the entries themselves don't need to be touched if only their sizes and modification times are compared
+        .columns = columns,
+    };
+    uint64_t selection[FSEARCH_QUERY_BLOCK_NUM_WORDS];
 
-    ctx->num_results = 0;
-    ctx->entries = darray_ref(entries);
-    ctx->start_pos = start_pos;
-    ctx->end_pos = end_pos;
-    ctx->thread_id = thread_id;
-    return ctx;
+    uint32_t num_results = 0;
+    uint32_t num_scanned = 0;
+    for (block.start = start; block.start < end; block.start += FSEARCH_QUERY_BLOCK_SIZE) {
+        if (G_UNLIKELY(g_cancellable_is_cancelled(search->cancellable))
+            || db_search_entries_reached_limit(search, list, chunk, num_results)) {
+            break;
+        }
+        block.num_entries = MIN(FSEARCH_QUERY_BLOCK_SIZE, end - block.start);
+        num_scanned += block.num_entries;
+        db_search_match_block(query, list, match_data, &block, selection);
+        uint64_t *block_matches = matches + (block.start - start) / 64;
+        for (uint32_t w = 0; w < FSEARCH_QUERY_BLOCK_NUM_WORDS; w++) {
+            block_matches[w] = selection[w];
+            num_results += __builtin_popcountll(selection[w]);
+        }
+    }
+    list->num_chunk_results[chunk] = num_results;
+    return num_scanned;
+}
+
+// The results of the first num_chunks chunks of list, but at most limit of them if it's not 0
+static DynamicArray *
+db_search_entries_get_results(DatabaseSearchEntries *list, uint32_t num_chunks, uint32_t limit) {
+    // get total number of entries found
+    uint32_t num_results = 0;
+    for (uint32_t i = 0; i < num_chunks; i++) {
+        num_results += list->num_chunk_results[i];
+    }
+    if (limit) {
+        num_results = MIN(num_results, limit);
+    }
+
+    DynamicArray *results = darray_new(num_results);
+    uint32_t num_added = 0;
+    for (uint32_t w = 0; w < num_chunks * NUM_WORDS_PER_SEARCH_CHUNK && num_added < num_results; w++) {
+        uint64_t bits = list->matches[w];
+        while (bits && num_added < num_results) {
+            const uint32_t j = w * 64 + __builtin_ctzll(bits);
+            bits &= bits - 1;
+            darray_add_item(results, darray_get_item(list->entries, list->positions ? list->positions[j] : j));
+            num_added++;
+        }
+    }
+    return results;
+}
+
+static void
+db_search_publish_progress(DatabaseSearchContext *search) {
+    DatabaseSearchResult *result = calloc(1, sizeof(DatabaseSearchResult));
+    g_assert(result);
+    result->sort_type = search->sort_type;
+
+    uint32_t num_results = 0;
+    for (uint32_t i = 0; i < search->num_lists; i++) {
+        DatabaseSearchEntries *list = &search->lists[i];
+        const uint32_t end_chunk =
+            CLAMP(search->num_completed_chunks, list->first_chunk, list->first_chunk + list->num_chunks);
+        DynamicArray *results = db_search_entries_get_results(list, end_chunk - list->first_chunk, search->limit);
+        num_results += darray_get_num_items(results);
+        if (list->is_folders) {
+            result->folders = results;
+        }
+        else {
+            result->files = results;
+        }
+    }
+
+    // the view keeps showing what it has until there's something to replace it with
+    if (num_results > 0 && search->progress_func(result, search->progress_func_data)) {
+        search->num_published_chunks = search->num_completed_chunks;
+        search->next_progress_time = g_get_monotonic_time() + SEARCH_PROGRESS_INTERVAL;
+    }
+    else {
+        g_clear_pointer(&result->folders, darray_unref);
+        g_clear_pointer(&result->files, darray_unref);
+        g_clear_pointer(&result, free);
+    }
+}
+
+static void
+db_search_chunk_completed(DatabaseSearchContext *search, DatabaseSearchEntries *list, uint32_t chunk) {
+    g_mutex_lock(&search->progress_mutex);
+    search->chunk_completed[chunk] = true;
+    while (search->num_completed_chunks < search->num_chunks
+           && search->chunk_completed[search->num_completed_chunks]) {
+        search->num_completed_chunks++;
+    }
+    uint32_t num_list_chunks = (uint32_t)g_atomic_int_get(&list->num_completed_chunks);
+    while (num_list_chunks < list->num_chunks && search->chunk_completed[list->first_chunk + num_list_chunks]) {
+        g_atomic_int_add(&list->num_completed_results, (gint)list->num_chunk_results[num_list_chunks]);
+        g_atomic_int_set(&list->num_completed_chunks, (gint)++num_list_chunks);
+    }
+    if (search->progress_func && search->num_completed_chunks > search->num_published_chunks
+        && search->num_completed_chunks < search->num_chunks && g_get_monotonic_time() >= search->next_progress_time
+        && !g_cancellable_is_cancelled(search->cancellable)) {
+        db_search_publish_progress(search);
+    }
+    g_mutex_unlock(&search->progress_mutex);
 }
 
 static void
 db_search_worker(void *data) {
-    DatabaseSearchWorkerContext *ctx = data;
-    g_assert(ctx);
-    g_assert(ctx->results);
-
-    FsearchQueryMatchData *match_data = fsearch_query_match_data_new();
-
-    fsearch_query_match_data_set_thread_id(match_data, ctx->thread_id);
-    FsearchQuery *query = ctx->query;
-    const uint32_t start = ctx->start_pos;
-    const uint32_t end = ctx->end_pos;
-    FsearchDatabaseEntry **results = (FsearchDatabaseEntry **)ctx->results;
-    DynamicArray *entries = ctx->entries;
-
-    if (!entries) {
-        ctx->num_results = 0;
-        g_debug("[db_search] entries empty");
-        return;
+    DatabaseSearchContext *search = data;
+    g_assert(search);
+
+    FsearchQueryMatchData *match_data = g_private_get(&worker_match_data_key);
+    if (!match_data) {
+        match_data = fsearch_query_match_data_new();
+        g_private_set(&worker_match_data_key, match_data);
     }
+    fsearch_query_match_data_set_folder_paths(match_data, search->folder_paths);
+    fsearch_query_match_data_set_folded_names(match_data, search->folded_names);
+    fsearch_query_match_data_set_extensions(match_data, search->extensions);
+    fsearch_query_match_data_set_metadata(match_data, search->metadata);
 
-    uint32_t num_results = 0;
-    for (uint32_t i = start; i <= end; i++) {
-        if (G_UNLIKELY(g_cancellable_is_cancelled(ctx->cancellable))) {
+    const gint64 start_time = search->stats ? g_get_monotonic_time() : 0;
+    uint64_t num_scanned = 0;
+    uint32_t list_idx = 0;
+    while (!g_cancellable_is_cancelled(search->cancellable)) {
+        const uint32_t chunk = (uint32_t)g_atomic_int_add(&search->next_chunk, 1);
+        if (chunk >= search->num_chunks) {
             break;
         }
-        FsearchDatabaseEntry *entry = darray_get_item(entries, i);
-        fsearch_query_match_data_set_entry(match_data, entry);
-        if (fsearch_query_match(query, match_data)) {
-            results[num_results++] = entry;
+        // chunks are claimed in increasing order, so the list never goes back
+        while (chunk >= search->lists[list_idx].first_chunk + search->lists[list_idx].num_chunks) {
+            list_idx++;
+        }
+        DatabaseSearchEntries *list = &search->lists[list_idx];
+        // the chunks after the first limit results are skipped, their bits stay unset
+        if (!db_search_entries_reached_limit(search, list, chunk - list->first_chunk, 0)) {
+            FSEARCH_TRACE1(search_chunk_start, chunk);
+            const uint32_t num_chunk_scanned = db_search_chunk(search, list, match_data, chunk - list->first_chunk);
+            FSEARCH_TRACE2(search_chunk_end, chunk, num_chunk_scanned);
+            num_scanned += num_chunk_scanned;
+        }
+        if (search->progress_func || search->limit) {
+            db_search_chunk_completed(search, list, chunk);
+        }
+    }
+    if (search->stats) {
+        const uint32_t thread = (uint32_t)g_atomic_int_add(&search->next_thread_stats, 1);
+        if (thread < G_N_ELEMENTS(search->stats->threads)) {
+            search->stats->threads[thread].match_time = (double)(g_get_monotonic_time() - start_time) / 1000;
+            search->stats->threads[thread].num_entries_scanned = num_scanned;
         }
     }
-    g_clear_pointer(&match_data, fsearch_query_match_data_free);
+    // the database might be gone by the next search
+    fsearch_query_match_data_set_entry(match_data, NULL);
+    fsearch_query_match_data_set_folder_paths(match_data, NULL);
+    fsearch_query_match_data_set_folded_names(match_data, NULL);
+    fsearch_query_match_data_set_extensions(match_data, NULL);
+    fsearch_query_match_data_set_metadata(match_data, NULL);
+}
 
-    ctx->num_results = num_results;
+static void
+db_search_entries_init(DatabaseSearchEntries *list,
+                       DynamicArray *entries,
+                       const uint32_t *positions,
+                       uint32_t num_positions,
+                       FsearchDatabaseColumns *columns,
+                       bool is_folders) {
+    g_assert(!columns
+             || (columns->entries == entries && columns->num_entries == darray_get_num_items(entries)));
+    list->entries = entries;
+    list->positions = positions;
+    list->columns = columns;
+    list->num_entries = positions ? num_positions : darray_get_num_items(entries);
+    list->is_folders = is_folders;
 }
 
-static DynamicArray *
+static void
+db_search_entries_clear(DatabaseSearchEntries *list) {
+    g_clear_pointer(&list->matches, free);
+    g_clear_pointer(&list->num_chunk_results, free);
+}
+
+// Searches all lists in one go, with a single wait for the workers. Returns false if the search was cancelled,
+// otherwise the results of every list are in results, with the same order as the lists. If results is NULL, the
+// matches of the lists are kept and have to be cleared by the caller. Stops at the first limit results if it's not 0.
+// If stats isn't NULL, the times of matching and merging and the work of every thread get stored in it.
+static bool
 db_search_entries(FsearchQuery *q,
                   FsearchThreadPool *pool,
                   GCancellable *cancellable,
-                  DynamicArray *entries,
-                  FsearchThreadPoolFunc search_func) {
-    const uint32_t num_entries = darray_get_num_items(entries);
-    if (num_entries == 0) {
+                  DatabaseSearchEntries *lists,
+                  uint32_t num_lists,
+                  uint32_t limit,
+                  FsearchDatabaseFolderPaths *folder_paths,
+                  FsearchDatabaseFoldedNames *folded_names,
+                  FsearchDatabaseExtensions *extensions,
+                  FsearchDatabaseMetadata *metadata,
+                  FsearchDatabaseIndexType sort_type,
+                  DatabaseSearchProgressFunc progress_func,
+                  gpointer progress_func_data,
+                  FsearchThreadPoolFunc search_func,
+                  DynamicArray **results,
+                  FsearchQueryStats *stats) {
+    if (!q->query_tree && !q->filter_tree) {
+        g_assert_not_reached();
+    }
+
+    DatabaseSearchContext search = {
+        .query = q,
+        .lists = lists,
+        .num_lists = num_lists,
+        .folder_paths = folder_paths,
+        .folded_names = folded_names,
+        .extensions = extensions,
+        .metadata = metadata,
+        .sort_type = sort_type,
+        .cancellable = cancellable,
+        .limit = limit,
+        .num_chunks = 0,
+        .next_chunk = 0,
+        .progress_func = progress_func,
+        .progress_func_data = progress_func_data,
+        .next_progress_time = g_get_monotonic_time() + SEARCH_PROGRESS_INTERVAL,
+        .stats = stats,
+    };
+    uint32_t num_entries = 0;
+    for (uint32_t i = 0; i < num_lists; i++) {
+        DatabaseSearchEntries *list = &lists[i];
+        list->first_chunk = search.num_chunks;
+        list->num_chunks = (list->num_entries + NUM_ENTRIES_PER_SEARCH_CHUNK - 1) / NUM_ENTRIES_PER_SEARCH_CHUNK;
+        list->matches = calloc(MAX(list->num_chunks * NUM_WORDS_PER_SEARCH_CHUNK, 1), sizeof(uint64_t));
+        g_assert(list->matches);
+        list->num_chunk_results = calloc(MAX(list->num_chunks, 1), sizeof(uint32_t));
+        g_assert(list->num_chunk_results);
+
+        search.num_chunks += list->num_chunks;
+        num_entries += list->num_entries;
+    }
+    if (progress_func || search.limit) {
+        g_mutex_init(&search.progress_mutex);
+        search.chunk_completed = calloc(MAX(search.num_chunks, 1), sizeof(bool));
+        g_assert(search.chunk_completed);
+    }
+
+    const gint64 match_start = g_get_monotonic_time();
+    if (search.num_chunks > 0) {
+        const uint32_t num_threads = (num_entries < THRESHOLD_FOR_PARALLEL_SEARCH || q->wants_single_threaded_search)
+                                       ? 1
+                                       : MIN(fsearch_thread_pool_get_num_threads(pool), search.num_chunks);
+        fsearch_thread_pool_run(pool, num_threads, search_func, &search);
+    }
+
+    const bool cancelled = g_cancellable_is_cancelled(cancellable);
+    const gint64 merge_start = g_get_monotonic_time();
+    for (uint32_t i = 0; results && i < num_lists; i++) {
+        if (!cancelled) {
+            results[i] = db_search_entries_get_results(&lists[i], lists[i].num_chunks, search.limit);
+        }
+        db_search_entries_clear(&lists[i]);
+    }
+    if (stats) {
+        stats->match_time = (double)(merge_start - match_start) / 1000;
+        stats->merge_time = (double)(g_get_monotonic_time() - merge_start) / 1000;
+        stats->num_threads = MIN((uint32_t)search.next_thread_stats, G_N_ELEMENTS(stats->threads));
+        stats->num_entries_scanned = 0;
+        for (uint32_t i = 0; i < stats->num_threads; i++) {
+            stats->num_entries_scanned += stats->threads[i].num_entries_scanned;
+        }
+    }
+    if (progress_func || search.limit) {
+        g_mutex_clear(&search.progress_mutex);
+        g_clear_pointer(&search.chunk_completed, free);
+    }
+    return !cancelled;
+}
+
+static bool
+db_search_has_filter(FsearchQuery *q) {
+    return q->filter_tree && q->filter && q->filter->query && !fsearch_string_is_empty(q->filter->query);
+}
+
+static uint32_t
+db_search_count_extension_postings(FsearchQueryNode *node, FsearchDatabaseExtensions *extensions) {
+    uint32_t num_postings = 0;
+    for (uint32_t id = 0; id < db_extensions_get_num_ids(extensions); id++) {
+        if ((node->extension_matches[id / 64] >> (id % 64)) & 1) {
+            uint32_t num_files = 0;
+            db_extensions_get_postings(extensions, id, &num_files);
+            num_postings += num_files;
+        }
+    }
+    return num_postings;
+}
+
+static int
+compare_positions(const void *a, const void *b) {
+    const uint32_t pos_a = *(const uint32_t *)a;
+    const uint32_t pos_b = *(const uint32_t *)b;
+    return pos_a < pos_b ? -1 : pos_a > pos_b;
+}
+
+// If every file the query matches needs one of a few extensions, returns the positions (in files) of those which
+// have them, so only they get searched instead of all files. The posting lists are in the order of the name array,
+// the other sort orders search all files.
+static uint32_t *
+db_search_get_extension_positions(FsearchQuery *q,
+                                  DynamicArray *files,
+                                  FsearchDatabaseExtensions *extensions,
+                                  uint32_t *num_positions) {
+    if (!extensions || extensions->files != files) {
+        return NULL;
+    }
+    FsearchQueryNode *nodes[] = {
+        fsearch_query_node_tree_get_required_extension_filter(q->query_tree),
+        db_search_has_filter(q) ? fsearch_query_node_tree_get_required_extension_filter(q->filter_tree) : NULL,
+    };
+    FsearchQueryNode *node = NULL;
+    uint32_t num_postings = 0;
+    for (uint32_t i = 0; i < G_N_ELEMENTS(nodes); i++) {
+        if (!nodes[i] || nodes[i]->extensions != extensions || !nodes[i]->extension_matches) {
+            continue;
+        }
+        const uint32_t num = db_search_count_extension_postings(nodes[i], extensions);
+        if (!node || num < num_postings) {
+            node = nodes[i];
+            num_postings = num;
+        }
+    }
+    if (!node) {
         return NULL;
     }
-    const uint32_t num_threads = (num_entries < THRESHOLD_FOR_PARALLEL_SEARCH || q->wants_single_threaded_search)
-                                   ? 1
-                                   : fsearch_thread_pool_get_num_threads(pool);
-    const uint32_t num_items_per_thread = num_entries / num_threads;
 
-    DatabaseSearchWorkerContext *thread_data[num_threads];
-    memset(thread_data, 0, sizeof(thread_data));
+    uint32_t *positions = calloc(MAX(num_postings, 1), sizeof(uint32_t));
+    g_assert(positions);
+    uint32_t num_lists = 0;
+    *num_positions = 0;
+    for (uint32_t id = 0; id < db_extensions_get_num_ids(extensions); id++) {
+        if ((node->extension_matches[id / 64] >> (id % 64)) & 1) {
+            uint32_t num_files = 0;
+            const uint32_t *postings = db_extensions_get_postings(extensions, id, &num_files);
+            memcpy(positions + *num_positions, postings, num_files * sizeof(uint32_t));
+            *num_positions += num_files;
+            num_lists++;
+        }
+    }
+    if (num_lists > 1) {
+        // the results have to be in the order of files
+        qsort(positions, *num_positions, sizeof(uint32_t), compare_positions);
+    }
+    return positions;
+}
 
-    uint32_t start_pos = 0;
-    uint32_t end_pos = num_items_per_thread - 1;
+// The needles of the name searches every entry the query matches has to contain, NULL if there are none
+static GPtrArray *
+db_search_get_name_needles(FsearchQuery *q) {
+    GPtrArray *needles = g_ptr_array_new();
+    fsearch_query_node_tree_get_required_name_needles(q->query_tree, needles);
+    if (db_search_has_filter(q)) {
+        fsearch_query_node_tree_get_required_name_needles(q->filter_tree, needles);
+    }
+    if (needles->len == 0) {
+        g_clear_pointer(&needles, g_ptr_array_unref);
+    }
+    return needles;
+}
 
-    if (!q->query_tree) {
-        g_assert_not_reached();
+// If the query only matches names which contain some longer terms, returns the positions (in the name array of list)
+// of the entries which contain all of their trigrams, so only they get searched.
+static uint32_t *
+db_search_get_trigram_positions(GPtrArray *needles, const FsearchDatabaseTrigramList *list, uint32_t *num_positions) {
+    if (!needles) {
+        return NULL;
+    }
+    return db_trigram_list_get_candidates(list, (const char **)needles->pdata, needles->len, num_positions);
+}
+
+// The nodes every entry the query matches has to match and which only match names with a certain prefix, NULL if
+// there are none
+static GPtrArray *
+db_search_get_name_prefix_nodes(FsearchQuery *q) {
+    GPtrArray *nodes = g_ptr_array_new();
+    fsearch_query_node_tree_get_required_name_prefix_nodes(q->query_tree, nodes);
+    if (db_search_has_filter(q)) {
+        fsearch_query_node_tree_get_required_name_prefix_nodes(q->filter_tree, nodes);
+    }
+    if (nodes->len == 0) {
+        g_clear_pointer(&nodes, g_ptr_array_unref);
+    }
+    return nodes;
+}
+
+// The size and modification time filters every entry the query matches has to match, NULL if there are none
+static GPtrArray *
+db_search_get_value_range_nodes(FsearchQuery *q) {
+    GPtrArray *nodes = g_ptr_array_new();
+    GNode *trees[] = {q->query_tree, db_search_has_filter(q) ? q->filter_tree : NULL};
+    for (uint32_t i = 0; i < G_N_ELEMENTS(trees); i++) {
+        fsearch_query_node_tree_get_required_nodes(trees[i], fsearch_query_matcher_size, nodes);
+        fsearch_query_node_tree_get_required_nodes(trees[i], fsearch_query_matcher_date_modified, nodes);
+    }
+    if (nodes->len == 0) {
+        g_clear_pointer(&nodes, g_ptr_array_unref);
+    }
+    return nodes;
+}
+
+// The owner, permissions and other timestamp filters every entry the query matches has to match, NULL if there are none
+static GPtrArray *
+db_search_get_metadata_nodes(FsearchQuery *q) {
+    GPtrArray *nodes = g_ptr_array_new();
+    fsearch_query_node_tree_get_required_metadata_nodes(q->query_tree, nodes);
+    if (db_search_has_filter(q)) {
+        fsearch_query_node_tree_get_required_metadata_nodes(q->filter_tree, nodes);
+    }
+    if (nodes->len == 0) {
+        g_clear_pointer(&nodes, g_ptr_array_unref);
+    }
+    return nodes;
+}
+
+typedef struct DatabaseSearchNamePrefix {
+    const char *prefix;
+    size_t prefix_len;
+    bool is_exact;
+} DatabaseSearchNamePrefix;
+
+typedef struct DatabaseSearchRange {
+    uint32_t start;
+    uint32_t end;
+} DatabaseSearchRange;
+
+// Names which start with the prefix compare equal to it, the others in the order of db_entry_compare_entries_by_name
+static int32_t
+compare_entry_to_name_prefix(FsearchDatabaseEntry **entry, DatabaseSearchNamePrefix **prefix, void *data) {
+    const char *name = db_entry_get_name_raw(*entry);
+    if (!name) {
+        name = "";
     }
+    if (!(*prefix)->is_exact && !strncmp(name, (*prefix)->prefix, (*prefix)->prefix_len)) {
+        return 0;
+    }
+    return strverscmp(name, (*prefix)->prefix);
+}
+
+static int
+compare_ranges(const void *a, const void *b) {
+    const DatabaseSearchRange *range_a = a;
+    const DatabaseSearchRange *range_b = b;
+    return range_a->start < range_b->start ? -1 : range_a->start > range_b->start;
+}
 
-    GList *threads = fsearch_thread_pool_get_threads(pool);
-    for (uint32_t i = 0; i < num_threads; i++) {
+// Returns the positions (in entries, which must be sorted by name) of the entries whose names start with the prefix of
+// node (or are equal to it), NULL if node doesn't have one. Each spelling of the prefix is a contiguous range of
+// entries, which is found with two binary searches.
+static uint32_t *
+db_search_get_name_prefix_positions(FsearchQueryNode *node, DynamicArray *entries, uint32_t *num_positions) {
+    bool is_exact = false;
+    g_autofree char *prefix = fsearch_query_node_get_name_prefix(node, &is_exact);
+    if (!prefix) {
+        return NULL;
+    }
+    const bool ignore_case = !(node->flags & QUERY_FLAG_MATCH_CASE);
 
-        thread_data[i] = db_search_worker_context_new(q,
-                                                      cancellable,
-                                                      entries,
-                                                      (int32_t)i,
-                                                      start_pos,
-                                                      i == num_threads - 1 ? num_entries - 1 : end_pos);
+    uint32_t letters[MAX_NAME_PREFIX_CASE_LETTERS] = {0};
+    uint32_t num_letters = 0;
+    for (uint32_t i = 0; ignore_case && prefix[i] != '\0'; i++) {
+        if (!g_ascii_isalpha(prefix[i])) {
+            continue;
+        }
+        if (num_letters == MAX_NAME_PREFIX_CASE_LETTERS) {
+            prefix[i] = '\0';
+            is_exact = false;
+            break;
+        }
+        letters[num_letters++] = i;
+    }
 
-        start_pos = end_pos + 1;
-        end_pos += num_items_per_thread;
+    size_t prefix_len = strlen(prefix);
+    if (!is_exact) {
+        // strverscmp compares whole numbers, so names which start with "a1" aren't next to each other ("a10" comes
+        // after "a2"), but names which start with "a" are
+        while (prefix_len > 0 && g_ascii_isdigit(prefix[prefix_len - 1])) {
+            prefix[--prefix_len] = '\0';
+        }
+        if (prefix_len == 0) {
+            return NULL;
+        }
+    }
 
-        fsearch_thread_pool_push_data(pool, threads, search_func, thread_data[i]);
-        threads = threads->next;
+    const uint32_t num_variants = 1 << num_letters;
+    DatabaseSearchRange *ranges = calloc(num_variants, sizeof(DatabaseSearchRange));
+    g_assert(ranges);
+    uint32_t num_ranges = 0;
+    uint32_t num_entries = 0;
+    DatabaseSearchNamePrefix key = {.prefix = prefix, .prefix_len = prefix_len, .is_exact = is_exact};
+    for (uint32_t variant = 0; variant < num_variants; variant++) {
+        for (uint32_t i = 0; i < num_letters; i++) {
+            const char c = prefix[letters[i]];
+            prefix[letters[i]] = (variant >> i) & 1 ? g_ascii_toupper(c) : g_ascii_tolower(c);
+        }
+        DatabaseSearchRange *range = &ranges[num_ranges];
+        if (darray_binary_search_range_with_data(entries,
+                                                 &key,
+                                                 (DynamicArrayCompareDataFunc)compare_entry_to_name_prefix,
+                                                 NULL,
+                                                 &range->start,
+                                                 &range->end)) {
+            num_entries += range->end - range->start;
+            num_ranges++;
+        }
     }
+    // the spellings don't overlap, so the ranges only have to be put in order
+    qsort(ranges, num_ranges, sizeof(DatabaseSearchRange), compare_ranges);
 
-    threads = fsearch_thread_pool_get_threads(pool);
-    while (threads) {
-        fsearch_thread_pool_wait_for_thread(pool, threads);
-        threads = threads->next;
+    uint32_t *positions = calloc(MAX(num_entries, 1), sizeof(uint32_t));
+    g_assert(positions);
+    *num_positions = 0;
+    for (uint32_t i = 0; i < num_ranges; i++) {
+        for (uint32_t pos = ranges[i].start; pos < ranges[i].end; pos++) {
+            positions[(*num_positions)++] = pos;
+        }
     }
-    if (g_cancellable_is_cancelled(cancellable)) {
-        for (uint32_t i = 0; i < num_threads; i++) {
-            g_clear_pointer(&thread_data[i], db_search_worker_context_free);
+    g_clear_pointer(&ranges, free);
+    return positions;
+}
+
+// Keeps the positions which are part of both (sorted) arrays in positions
+static void
+db_search_intersect_positions(uint32_t *positions,
+                              uint32_t *num_positions,
+                              const uint32_t *other_positions,
+                              uint32_t num_other_positions) {
+    uint32_t num_kept = 0;
+    for (uint32_t i = 0, j = 0; i < *num_positions && j < num_other_positions;) {
+        if (positions[i] < other_positions[j]) {
+            i++;
+        }
+        else if (positions[i] > other_positions[j]) {
+            j++;
         }
+        else {
+            positions[num_kept++] = positions[i];
+            i++;
+            j++;
+        }
+    }
+    *num_positions = num_kept;
+}
+
+// The values of a size or modification time filter, start and end are inclusive
+typedef struct DatabaseSearchValueRange {
+    FsearchDatabaseIndexType type;
+    int64_t start;
+    int64_t end;
+} DatabaseSearchValueRange;
+
+static void
+db_search_value_range_init(DatabaseSearchValueRange *range, FsearchQueryNode *node) {
+    range->type = node->search_func == fsearch_query_matcher_size ? DATABASE_INDEX_TYPE_SIZE
+                                                                  : DATABASE_INDEX_TYPE_MODIFICATION_TIME;
+    range->start = INT64_MIN;
+    range->end = INT64_MAX;
+    switch (node->comparison_type) {
+    case FSEARCH_QUERY_NODE_COMPARISON_EQUAL:
+        range->start = range->end = node->num_start;
+        break;
+    case FSEARCH_QUERY_NODE_COMPARISON_GREATER:
+        // empty (start > end) if nothing is greater
+        range->start = node->num_start == INT64_MAX ? INT64_MAX : node->num_start + 1;
+        range->end = node->num_start == INT64_MAX ? INT64_MAX - 1 : INT64_MAX;
+        break;
+    case FSEARCH_QUERY_NODE_COMPARISON_SMALLER:
+        range->start = node->num_start == INT64_MIN ? INT64_MIN + 1 : INT64_MIN;
+        range->end = node->num_start == INT64_MIN ? INT64_MIN : node->num_start - 1;
+        break;
+    case FSEARCH_QUERY_NODE_COMPARISON_GREATER_EQ:
+        range->start = node->num_start;
+        break;
+    case FSEARCH_QUERY_NODE_COMPARISON_SMALLER_EQ:
+        range->end = node->num_start;
+        break;
+    case FSEARCH_QUERY_NODE_COMPARISON_RANGE:
+        range->start = node->num_start;
+        range->end = node->num_end == INT64_MIN ? INT64_MIN : node->num_end - 1;
+        break;
+    default:
+        range->start = INT64_MAX;
+        range->end = INT64_MIN;
+        break;
+    }
+}
+
+// Values in the range compare equal to it, so the entries with them are the range of the sorted array which compares
+// equal
+static int32_t
+compare_entry_to_value_range(FsearchDatabaseEntry **entry, DatabaseSearchValueRange **range, void *data) {
+    const int64_t value = (*range)->type == DATABASE_INDEX_TYPE_SIZE ? (int64_t)db_entry_get_size(*entry)
+                                                                     : (int64_t)db_entry_get_mtime(*entry);
+    if (value < (*range)->start) {
+        return -1;
+    }
+    return value > (*range)->end ? 1 : 0;
+}
+
+// Returns the positions (in entries) of the entries which size or modification time filter node matches, NULL if they
+// can't be looked up. They're a slice of the array sorted by that attribute, which is only the same as entries if the
+// search is in that order. Otherwise the entries of the slice are mapped to their position in the name array.
+static uint32_t *
+db_search_get_value_range_positions(FsearchQueryNode *node,
+                                    const DatabaseSearchSortedEntries *sorted_entries,
+                                    DynamicArray *entries,
+                                    bool is_folders,
+                                    uint32_t *num_positions) {
+    DatabaseSearchValueRange range = {0};
+    db_search_value_range_init(&range, node);
+
+    DynamicArray *const *arrays = is_folders ? sorted_entries->folders : sorted_entries->files;
+    DynamicArray *sorted = arrays[range.type];
+    const uint32_t num_entries = darray_get_num_items(entries);
+    if (!sorted || (sorted != entries && entries != arrays[DATABASE_INDEX_TYPE_NAME])
+        || darray_get_num_items(sorted) != num_entries) {
         return NULL;
     }
 
-    // get total number of entries found
-    uint32_t num_results = 0;
-    for (uint32_t i = 0; i < num_threads; ++i) {
-        num_results += thread_data[i]->num_results;
+    uint32_t start = 0;
+    uint32_t end = 0;
+    DatabaseSearchValueRange *key = &range;
+    darray_binary_search_range_with_data(sorted,
+                                         key,
+                                         (DynamicArrayCompareDataFunc)compare_entry_to_value_range,
+                                         NULL,
+                                         &start,
+                                         &end);
+    const uint32_t num_matches = end - start;
+    if (sorted != entries && num_matches > num_entries / MAX_VALUE_RANGE_LOOKUP_SHARE) {
+        return NULL;
     }
 
-    DynamicArray *results = darray_new(num_results);
+    uint32_t *positions = calloc(MAX(num_matches, 1), sizeof(uint32_t));
+    g_assert(positions);
+    *num_positions = 0;
+    if (sorted == entries) {
+        for (uint32_t pos = start; pos < end; pos++) {
+            positions[(*num_positions)++] = pos;
+        }
+        return positions;
+    }
 
-    for (uint32_t i = 0; i < num_threads; i++) {
-        DatabaseSearchWorkerContext *ctx = thread_data[i];
-        if (!ctx) {
-            break;
+    // the index of an entry is its position in the name array, the marks put them in that order
+    const uint32_t num_words = (num_entries + 63) / 64;
+    uint64_t *marks = calloc(MAX(num_words, 1), sizeof(uint64_t));
+    g_assert(marks);
+    for (uint32_t pos = start; pos < end; pos++) {
+        FsearchDatabaseEntry *entry = darray_get_item(sorted, pos);
+        const uint32_t idx = db_entry_get_idx(entry);
+        if (idx >= num_entries || darray_get_item(entries, idx) != entry) {
+            // the indices are outdated
+            g_clear_pointer(&marks, free);
+            g_clear_pointer(&positions, free);
+            return NULL;
+        }
+        marks[idx / 64] |= (uint64_t)1 << (idx % 64);
+    }
+    for (uint32_t i = 0; i < num_words; i++) {
+        for (uint64_t word = marks[i]; word != 0; word &= word - 1) {
+            positions[(*num_positions)++] = i * 64 + __builtin_ctzll(word);
         }
+    }
+    g_clear_pointer(&marks, free);
+    return positions;
+}
 
-        darray_add_items(results, (void **)ctx->results, ctx->num_results);
+// Narrows the (sorted) positions down to those which are also part of other_positions, which gets freed. NULL
+// positions stand for all of them.
+static void
+db_search_restrict_positions(uint32_t **positions,
+                             uint32_t *num_positions,
+                             uint32_t *other_positions,
+                             uint32_t num_other_positions) {
+    if (!other_positions) {
+        return;
+    }
+    if (!*positions) {
+        *positions = other_positions;
+        *num_positions = num_other_positions;
+        return;
+    }
+    db_search_intersect_positions(*positions, num_positions, other_positions, num_other_positions);
+    free(other_positions);
+}
 
-        g_clear_pointer(&ctx, db_search_worker_context_free);
+// Restricts positions to the entries which can match all prefix_nodes
+static void
+db_search_restrict_positions_to_name_prefixes(GPtrArray *prefix_nodes,
+                                              DynamicArray *entries,
+                                              uint32_t **positions,
+                                              uint32_t *num_positions) {
+    for (uint32_t i = 0; prefix_nodes && i < prefix_nodes->len; i++) {
+        uint32_t num_prefix_positions = 0;
+        uint32_t *prefix_positions =
+            db_search_get_name_prefix_positions(g_ptr_array_index(prefix_nodes, i), entries, &num_prefix_positions);
+        db_search_restrict_positions(positions, num_positions, prefix_positions, num_prefix_positions);
     }
+}
 
-    return results;
+// Restricts positions to the entries which can match all size and modification time filters of range_nodes
+static void
+db_search_restrict_positions_to_value_ranges(GPtrArray *range_nodes,
+                                             const DatabaseSearchSortedEntries *sorted_entries,
+                                             DynamicArray *entries,
+                                             bool is_folders,
+                                             uint32_t **positions,
+                                             uint32_t *num_positions) {
+    for (uint32_t i = 0; range_nodes && i < range_nodes->len; i++) {
+        uint32_t num_range_positions = 0;
+        uint32_t *range_positions = db_search_get_value_range_positions(g_ptr_array_index(range_nodes, i),
+                                                                        sorted_entries,
+                                                                        entries,
+                                                                        is_folders,
+                                                                        &num_range_positions);
+        db_search_restrict_positions(positions, num_positions, range_positions, num_range_positions);
+    }
+}
+
+// Restricts positions to the entries whose metadata matches all metadata_nodes. The columns are in the order of the
+// name arrays, so metadata has to belong to them.
+static void
+db_search_restrict_positions_to_metadata(GPtrArray *metadata_nodes,
+                                         const FsearchDatabaseMetadata *metadata,
+                                         bool is_folders,
+                                         uint32_t **positions,
+                                         uint32_t *num_positions) {
+    for (uint32_t i = 0; metadata_nodes && i < metadata_nodes->len; i++) {
+        FsearchQueryNode *node = g_ptr_array_index(metadata_nodes, i);
+        FsearchDatabaseMetadataColumn column = 0;
+        if (!fsearch_query_node_get_metadata_column(node, &column)) {
+            continue;
+        }
+        DatabaseSearchValueRange range = {0};
+        db_search_value_range_init(&range, node);
+        uint32_t num_metadata_positions = 0;
+        uint32_t *metadata_positions =
+            db_metadata_get_positions(metadata,
+                                      is_folders,
+                                      column,
+                                      column == DATABASE_METADATA_COLUMN_MODE ? 07777 : UINT32_MAX,
+                                      range.start,
+                                      range.end,
+                                      &num_metadata_positions);
+        db_search_restrict_positions(positions, num_positions, metadata_positions, num_metadata_positions);
+    }
+}
+
+void
+db_search_sorted_entries_clear(DatabaseSearchSortedEntries *sorted_entries) {
+    g_assert(sorted_entries);
+    for (uint32_t i = 0; i < NUM_DATABASE_INDEX_TYPES; i++) {
+        g_clear_pointer(&sorted_entries->folders[i], darray_unref);
+        g_clear_pointer(&sorted_entries->files[i], darray_unref);
+    }
+}
+
+DatabaseSearchFilterMatches *
+db_search_filter_matches_new(FsearchQuery *q,
+                             FsearchThreadPool *pool,
+                             DynamicArray *folders,
+                             DynamicArray *files,
+                             FsearchDatabaseColumns *folder_columns,
+                             FsearchDatabaseColumns *file_columns,
+                             FsearchDatabaseFolderPaths *folder_paths,
+                             FsearchDatabaseFoldedNames *folded_names,
+                             FsearchDatabaseExtensions *extensions,
+                             FsearchDatabaseMetadata *metadata,
+                             GCancellable *cancellable) {
+    g_assert(q);
+    g_assert(folders);
+    g_assert(files);
+    if (!db_search_has_filter(q) || !q->filter_program || !q->compiled_filter) {
+        return NULL;
+    }
+
+    fsearch_query_set_extensions(q, extensions);
+    fsearch_query_set_folder_paths(q, folder_paths);
+
+    DatabaseSearchEntries lists[2] = {0};
+    db_search_entries_init(&lists[0], folders, NULL, 0, folder_columns, true);
+    db_search_entries_init(&lists[1], files, NULL, 0, file_columns, false);
+    for (uint32_t i = 0; i < G_N_ELEMENTS(lists); i++) {
+        lists[i].filter_mode = DATABASE_SEARCH_FILTER_ONLY;
+    }
+    const bool completed = db_search_entries(q,
+                                             pool,
+                                             cancellable,
+                                             lists,
+                                             G_N_ELEMENTS(lists),
+                                             0,
+                                             folder_paths,
+                                             folded_names,
+                                             extensions,
+                                             metadata,
+                                             DATABASE_INDEX_TYPE_NAME,
+                                             NULL,
+                                             NULL,
+                                             db_search_worker,
+                                             NULL,
+                                             NULL);
+    DatabaseSearchFilterMatches *matches = NULL;
+    if (completed) {
+        matches = calloc(1, sizeof(DatabaseSearchFilterMatches));
+        g_assert(matches);
+        matches->filter = fsearch_query_compiled_filter_ref(q->compiled_filter);
+        matches->folders = darray_ref(folders);
+        matches->files = darray_ref(files);
+        // the bits of the chunks are in the order of the entries, since none of them was skipped
+        matches->folder_matches = g_steal_pointer(&lists[0].matches);
+        matches->file_matches = g_steal_pointer(&lists[1].matches);
+        for (uint32_t i = 0; i < lists[0].num_chunks; i++) {
+            matches->num_folder_matches += lists[0].num_chunk_results[i];
+        }
+        for (uint32_t i = 0; i < lists[1].num_chunks; i++) {
+            matches->num_file_matches += lists[1].num_chunk_results[i];
+        }
+        matches->ref_count = 1;
+    }
+    for (uint32_t i = 0; i < G_N_ELEMENTS(lists); i++) {
+        db_search_entries_clear(&lists[i]);
+    }
+    return matches;
+}
+
+DatabaseSearchFilterMatches *
+db_search_filter_matches_ref(DatabaseSearchFilterMatches *matches) {
+    if (!matches || g_atomic_int_get(&matches->ref_count) <= 0) {
+        return NULL;
+    }
+    g_atomic_int_inc(&matches->ref_count);
+    return matches;
+}
+
+void
+db_search_filter_matches_unref(DatabaseSearchFilterMatches *matches) {
+    if (!matches || g_atomic_int_get(&matches->ref_count) <= 0) {
+        return;
+    }
+    if (!g_atomic_int_dec_and_test(&matches->ref_count)) {
+        return;
+    }
+    g_clear_pointer(&matches->filter, fsearch_query_compiled_filter_unref);
+    g_clear_pointer(&matches->folders, darray_unref);
+    g_clear_pointer(&matches->files, darray_unref);
+    g_clear_pointer(&matches->folder_matches, free);
+    g_clear_pointer(&matches->file_matches, free);
+    g_clear_pointer(&matches, free);
+}
+
+size_t
+db_search_filter_matches_get_memory_size(const DatabaseSearchFilterMatches *matches) {
+    if (!matches) {
+        return 0;
+    }
+    const uint32_t num_folder_chunks =
+        (darray_get_num_items(matches->folders) + NUM_ENTRIES_PER_SEARCH_CHUNK - 1) / NUM_ENTRIES_PER_SEARCH_CHUNK;
+    const uint32_t num_file_chunks =
+        (darray_get_num_items(matches->files) + NUM_ENTRIES_PER_SEARCH_CHUNK - 1) / NUM_ENTRIES_PER_SEARCH_CHUNK;
+    return sizeof(DatabaseSearchFilterMatches)
+         + (MAX(num_folder_chunks * NUM_WORDS_PER_SEARCH_CHUNK, 1) + MAX(num_file_chunks * NUM_WORDS_PER_SEARCH_CHUNK, 1))
+               * sizeof(uint64_t);
+}
+
+// The positions of the entries whose bit is set in matches, NULL if all num_entries of them are set
+static uint32_t *
+db_search_get_filter_match_positions(const uint64_t *matches,
+                                     uint32_t num_entries,
+                                     uint32_t num_matches,
+                                     uint32_t *num_positions) {
+    if (num_matches == num_entries) {
+        return NULL;
+    }
+    uint32_t *positions = calloc(MAX(num_matches, 1), sizeof(uint32_t));
+    g_assert(positions);
+    *num_positions = 0;
+    for (uint32_t w = 0; w < (num_entries + 63) / 64; w++) {
+        for (uint64_t word = matches[w]; word != 0; word &= word - 1) {
+            positions[(*num_positions)++] = w * 64 + __builtin_ctzll(word);
+        }
+    }
+    return positions;
+}
+
+// Sets the filter mode of list (of entries) according to filter_matches, which is NULL if the filter has to be matched
+static void
+db_search_entries_set_filter_matches(DatabaseSearchEntries *list,
+                                     DynamicArray *filter_entries,
+                                     const uint64_t *filter_matches,
+                                     bool positions_are_filtered) {
+    if (!filter_matches) {
+        list->filter_mode = DATABASE_SEARCH_FILTER_MATCH;
+    }
+    else if (positions_are_filtered) {
+        list->filter_mode = DATABASE_SEARCH_FILTER_MATCHED;
+    }
+    else {
+        list->filter_mode = DATABASE_SEARCH_FILTER_LOOKUP;
+        list->filter_matches = filter_matches;
+        list->filter_entries = filter_entries;
+    }
+}
+
+static uint32_t
+db_search_get_num_results(DatabaseSearchResult *result) {
+    return (result->folders ? darray_get_num_items(result->folders) : 0)
+         + (result->files ? darray_get_num_items(result->files) : 0);
 }
 
 DatabaseSearchResult *
@@ -195,6 +1147,7 @@ db_search_empty(DynamicArray *folders, DynamicArray *files, FsearchDatabaseIndex
     result->folders = darray_ref(folders);
     result->files = darray_ref(files);
     result->sort_type = sort_type;
+    result->stats.num_results = db_search_get_num_results(result);
     return result;
 }
 
@@ -203,22 +1156,165 @@ db_search(FsearchQuery *q,
           FsearchThreadPool *pool,
           DynamicArray *folders,
           DynamicArray *files,
+          FsearchDatabaseColumns *folder_columns,
+          FsearchDatabaseColumns *file_columns,
+          FsearchDatabaseFolderPaths *folder_paths,
+          FsearchDatabaseFoldedNames *folded_names,
+          FsearchDatabaseExtensions *extensions,
+          FsearchDatabaseMetadata *metadata,
+          FsearchDatabaseTrigrams *trigrams,
+          const DatabaseSearchSortedEntries *sorted_entries,
+          const DatabaseSearchFilterMatches *filter_matches,
           FsearchDatabaseIndexType sort_type,
+          DatabaseSearchProgressFunc progress_func,
+          gpointer progress_func_data,
           GCancellable *cancellable) {
     g_assert(files);
     g_assert(folders);
 
+    // the filter doesn't need to be matched again if it's known which entries it matches. In the name arrays only those
+    // get searched, the entries of other arrays are looked up by their index.
+    if (filter_matches && (!db_search_has_filter(q) || filter_matches->filter != q->compiled_filter)) {
+        filter_matches = NULL;
+    }
+
+    // the posting lists of the trigrams are in the order of the name arrays, the other sort orders search all entries
+    g_autoptr(GPtrArray) needles = NULL;
+    if (trigrams && trigrams->folders == folders && trigrams->files == files) {
+        needles = db_search_get_name_needles(q);
+    }
+    // names with the same prefix are next to each other in arrays which are sorted by name
+    g_autoptr(GPtrArray) prefix_nodes = NULL;
+    if (sort_type == DATABASE_INDEX_TYPE_NAME) {
+        prefix_nodes = db_search_get_name_prefix_nodes(q);
+    }
+    g_autoptr(GPtrArray) range_nodes = NULL;
+    if (sorted_entries) {
+        range_nodes = db_search_get_value_range_nodes(q);
+    }
+    // the metadata columns are in the order of the name arrays too
+    g_autoptr(GPtrArray) metadata_nodes = NULL;
+    if (metadata && metadata->folders == folders && metadata->files == files) {
+        metadata_nodes = db_search_get_metadata_nodes(q);
+    }
+
+    // the extension filters look up which extension ids they match once, before the workers use them
+    fsearch_query_set_extensions(q, extensions);
+    // and the parent filters and path searches remember their results for the folders of these paths
+    fsearch_query_set_folder_paths(q, folder_paths);
+
     DynamicArray *files_res = NULL;
     DynamicArray *folders_res = NULL;
 
+    // folders and files are searched together, so the workers don't have to wait for the last folders
+    DatabaseSearchEntries lists[2] = {0};
+    DynamicArray **lists_res[G_N_ELEMENTS(lists)] = {NULL};
+    uint32_t num_lists = 0;
+
+    // extension filters only match files
+    const bool files_only =
+        fsearch_query_node_tree_get_required_extension_filter(q->query_tree)
+        || (db_search_has_filter(q) && fsearch_query_node_tree_get_required_extension_filter(q->filter_tree));
     const uint32_t num_folders = folders ? darray_get_num_items(folders) : 0;
-    folders_res = num_folders > 0 ? db_search_entries(q, pool, cancellable, folders, db_search_worker) : NULL;
-    if (g_cancellable_is_cancelled(cancellable)) {
-        goto search_was_cancelled;
+    uint32_t *folder_positions = NULL;
+    if (files_only) {
+        folders_res = darray_new(0);
+    }
+    else if (num_folders > 0) {
+        uint32_t num_positions = 0;
+        const bool is_filtered = filter_matches && filter_matches->folders == folders;
+        if (is_filtered) {
+            folder_positions = db_search_get_filter_match_positions(filter_matches->folder_matches,
+                                                                    num_folders,
+                                                                    filter_matches->num_folder_matches,
+                                                                    &num_positions);
+        }
+        uint32_t num_trigram_positions = 0;
+        uint32_t *trigram_positions =
+            db_search_get_trigram_positions(needles, &trigrams->folder_trigrams, &num_trigram_positions);
+        db_search_restrict_positions(&folder_positions, &num_positions, trigram_positions, num_trigram_positions);
+        db_search_restrict_positions_to_name_prefixes(prefix_nodes, folders, &folder_positions, &num_positions);
+        db_search_restrict_positions_to_value_ranges(range_nodes,
+                                                     sorted_entries,
+                                                     folders,
+                                                     true,
+                                                     &folder_positions,
+                                                     &num_positions);
+        db_search_restrict_positions_to_metadata(metadata_nodes, metadata, true, &folder_positions, &num_positions);
+        if (folder_positions && num_positions == 0) {
+            folders_res = darray_new(0);
+        }
+        else {
+            db_search_entries_init(&lists[num_lists], folders, folder_positions, num_positions, folder_columns, true);
+            db_search_entries_set_filter_matches(&lists[num_lists],
+                                                 filter_matches ? filter_matches->folders : NULL,
+                                                 filter_matches ? filter_matches->folder_matches : NULL,
+                                                 is_filtered);
+            lists_res[num_lists++] = &folders_res;
+        }
     }
+
+    uint32_t *positions = NULL;
     const uint32_t num_files = files ? darray_get_num_items(files) : 0;
-    files_res = num_files > 0 ? db_search_entries(q, pool, cancellable, files, db_search_worker) : NULL;
-    if (g_cancellable_is_cancelled(cancellable)) {
+    if (num_files > 0) {
+        uint32_t num_positions = 0;
+        const bool is_filtered = filter_matches && filter_matches->files == files;
+        if (is_filtered) {
+            positions = db_search_get_filter_match_positions(filter_matches->file_matches,
+                                                             num_files,
+                                                             filter_matches->num_file_matches,
+                                                             &num_positions);
+        }
+        uint32_t num_extension_positions = 0;
+        uint32_t *extension_positions =
+            db_search_get_extension_positions(q, files, extensions, &num_extension_positions);
+        db_search_restrict_positions(&positions, &num_positions, extension_positions, num_extension_positions);
+        uint32_t num_trigram_positions = 0;
+        uint32_t *trigram_positions =
+            db_search_get_trigram_positions(needles, &trigrams->file_trigrams, &num_trigram_positions);
+        db_search_restrict_positions(&positions, &num_positions, trigram_positions, num_trigram_positions);
+        db_search_restrict_positions_to_name_prefixes(prefix_nodes, files, &positions, &num_positions);
+        db_search_restrict_positions_to_value_ranges(range_nodes, sorted_entries, files, false, &positions, &num_positions);
+        db_search_restrict_positions_to_metadata(metadata_nodes, metadata, false, &positions, &num_positions);
+        if (positions && num_positions == 0) {
+            // none of the files has a matching extension, all the trigrams or the prefix of the name, or a matching
+            // size, modification time or metadata
+            files_res = darray_new(0);
+        }
+        else {
+            db_search_entries_init(&lists[num_lists], files, positions, num_positions, file_columns, false);
+            db_search_entries_set_filter_matches(&lists[num_lists],
+                                                 filter_matches ? filter_matches->files : NULL,
+                                                 filter_matches ? filter_matches->file_matches : NULL,
+                                                 is_filtered);
+            lists_res[num_lists++] = &files_res;
+        }
+    }
+
+    DynamicArray *results[G_N_ELEMENTS(lists)] = {NULL};
+    FsearchQueryStats stats = {0};
+    const bool completed = db_search_entries(q,
+                                             pool,
+                                             cancellable,
+                                             lists,
+                                             num_lists,
+                                             q->limit,
+                                             folder_paths,
+                                             folded_names,
+                                             extensions,
+                                             metadata,
+                                             sort_type,
+                                             progress_func,
+                                             progress_func_data,
+                                             db_search_worker,
+                                             results,
+                                             &stats);
+    g_clear_pointer(&positions, free);
+    g_clear_pointer(&folder_positions, free);
+    for (uint32_t i = 0; i < num_lists; i++) {
+        *lists_res[i] = results[i];
+    }
+    if (!completed) {
         goto search_was_cancelled;
     }
 
@@ -226,6 +1322,8 @@ db_search(FsearchQuery *q,
     result->files = files_res;
     result->folders = folders_res;
     result->sort_type = sort_type;
+    result->stats = stats;
+    result->stats.num_results = db_search_get_num_results(result);
 
     return result;
 
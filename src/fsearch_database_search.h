@@ -19,9 +19,12 @@
 #pragma once
 
 #include "fsearch_array.h"
+#include "fsearch_database_columns.h"
 #include "fsearch_database_entry.h"
+#include "fsearch_database_trigrams.h"
 #include "fsearch_filter.h"
 #include "fsearch_query.h"
+#include "fsearch_query_stats.h"
 
 #include <gio/gio.h>
 
@@ -29,15 +32,93 @@ typedef struct DatabaseSearchResult {
     DynamicArray *folders;
     DynamicArray *files;
     FsearchDatabaseIndexType sort_type;
+    // the search fills in how long matching and merging took, the parse, filter and sort times are up to the caller
+    FsearchQueryStats stats;
+    // the query filters by dupe: and the duplicates are still being looked for (see db_get_duplicates), so it wasn't
+    // searched yet and the result is empty
+    bool duplicates_pending;
 } DatabaseSearchResult;
 
+// Gets called from one of the search threads with the results found so far, while a search is still running.
+// Returns true if it took ownership of result, otherwise the search frees it and tries again with the next chunk.
+typedef bool (*DatabaseSearchProgressFunc)(DatabaseSearchResult *result, gpointer user_data);
+
+// The arrays of the database in other sort orders (NULL if it doesn't have them), so filters by size or modification
+// time can look up the entries they match with binary searches, instead of checking every entry
+typedef struct DatabaseSearchSortedEntries {
+    DynamicArray *folders[NUM_DATABASE_INDEX_TYPES];
+    DynamicArray *files[NUM_DATABASE_INDEX_TYPES];
+} DatabaseSearchSortedEntries;
+
+void
+db_search_sorted_entries_clear(DatabaseSearchSortedEntries *sorted_entries);
+
+// Which entries of the name arrays the filter of a query matches, one bit per entry in the order of the arrays (i.e.
+// by their index). Searches with the same filter only look at these entries, instead of matching the filter again.
+typedef struct DatabaseSearchFilterMatches {
+    // the compiled filter of the query they were found with
+    FsearchQueryCompiledFilter *filter;
+    DynamicArray *folders;
+    DynamicArray *files;
+    uint64_t *folder_matches;
+    uint64_t *file_matches;
+    uint32_t num_folder_matches;
+    uint32_t num_file_matches;
+
+    volatile int ref_count;
+} DatabaseSearchFilterMatches;
+
+// Matches all folders and files (the name arrays) against the filter of q only, on all threads of pool. Returns NULL
+// if q has no filter or it was cancelled. The optional arguments are the same as those of db_search.
+DatabaseSearchFilterMatches *
+db_search_filter_matches_new(FsearchQuery *q,
+                             FsearchThreadPool *pool,
+                             DynamicArray *folders,
+                             DynamicArray *files,
+                             FsearchDatabaseColumns *folder_columns,
+                             FsearchDatabaseColumns *file_columns,
+                             FsearchDatabaseFolderPaths *folder_paths,
+                             FsearchDatabaseFoldedNames *folded_names,
+                             FsearchDatabaseExtensions *extensions,
+                             FsearchDatabaseMetadata *metadata,
+                             GCancellable *cancellable);
+
+DatabaseSearchFilterMatches *
+db_search_filter_matches_ref(DatabaseSearchFilterMatches *matches);
+
+void
+db_search_filter_matches_unref(DatabaseSearchFilterMatches *matches);
+
+// The number of bytes allocated for the bits, without the entries
+size_t
+db_search_filter_matches_get_memory_size(const DatabaseSearchFilterMatches *matches);
+
 DatabaseSearchResult *
 db_search_empty(DynamicArray *folders, DynamicArray *files, FsearchDatabaseIndexType sort_type);
 
+// folder_columns, file_columns, folder_paths, folded_names, extensions, trigrams and sorted_entries are optional, they
+// make filters by size or modification time, searches in paths, case insensitive searches for non ASCII names,
+// extension filters, searches for longer terms in names and selective size or modification time filters faster.
+// metadata is optional too, the owner, permission and other timestamp filters only match entries which are part of it.
+// filter_matches is optional as well, if it was found with the filter of q, the filter isn't matched again.
+// progress_func is optional too, searches which take a while pass their (sorted) partial results to it.
+// If the limit of q is set, only the first limit folders and files of the arrays which match are returned, and the
+// search stops as soon as they're known.
 DatabaseSearchResult *
 db_search(FsearchQuery *q,
           FsearchThreadPool *pool,
           DynamicArray *folders,
           DynamicArray *files,
+          FsearchDatabaseColumns *folder_columns,
+          FsearchDatabaseColumns *file_columns,
+          FsearchDatabaseFolderPaths *folder_paths,
+          FsearchDatabaseFoldedNames *folded_names,
+          FsearchDatabaseExtensions *extensions,
+          FsearchDatabaseMetadata *metadata,
+          FsearchDatabaseTrigrams *trigrams,
+          const DatabaseSearchSortedEntries *sorted_entries,
+          const DatabaseSearchFilterMatches *filter_matches,
           FsearchDatabaseIndexType sort_type,
+          DatabaseSearchProgressFunc progress_func,
+          gpointer progress_func_data,
           GCancellable *cancellable);
@@ -0,0 +1,251 @@
+#define G_LOG_DOMAIN "fsearch-database-search-cache"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "fsearch_database_search_cache.h"
+
+typedef struct FsearchDatabaseSearchCacheEntry {
+    char *key;
+    DynamicArray *folders;
+    DynamicArray *files;
+    FsearchDatabaseIndexType sort_type;
+    size_t size;
+    // the link in lru
+    GList *link;
+} FsearchDatabaseSearchCacheEntry;
+
+struct FsearchDatabaseSearchCache {
+    // key -> FsearchDatabaseSearchCacheEntry *, the entries own the keys
+    GHashTable *entries;
+    // FsearchDatabaseSearchCacheEntry *, the most recently used first
+    GQueue lru;
+
+    size_t size;
+    size_t max_size;
+
+    // searches of different views can use the cache at the same time
+    GMutex mutex;
+};
+
+static size_t
+get_array_size(DynamicArray *array) {
+    return array ? sizeof(void *) * (MAX(darray_get_size(array), 1) + 2) : 0;
+}
+
+static void
+cache_entry_free(FsearchDatabaseSearchCacheEntry *entry) {
+    g_clear_pointer(&entry->key, g_free);
+    g_clear_pointer(&entry->folders, darray_unref);
+    g_clear_pointer(&entry->files, darray_unref);
+    g_clear_pointer(&entry, free);
+}
+
+static void
+cache_remove_entry(FsearchDatabaseSearchCache *cache, FsearchDatabaseSearchCacheEntry *entry) {
+    g_queue_delete_link(&cache->lru, entry->link);
+    g_hash_table_remove(cache->entries, entry->key);
+    cache->size -= entry->size;
+    g_clear_pointer(&entry, cache_entry_free);
+}
+
+static void
+cache_shrink(FsearchDatabaseSearchCache *cache, size_t max_size) {
+    while (cache->size > max_size && !g_queue_is_empty(&cache->lru)) {
+        cache_remove_entry(cache, g_queue_peek_tail(&cache->lru));
+    }
+}
+
+FsearchDatabaseSearchCache *
+db_search_cache_new(size_t max_size) {
+    FsearchDatabaseSearchCache *cache = calloc(1, sizeof(FsearchDatabaseSearchCache));
+    g_assert(cache);
+
+    cache->entries = g_hash_table_new(g_str_hash, g_str_equal);
+    g_queue_init(&cache->lru);
+    cache->max_size = max_size;
+    g_mutex_init(&cache->mutex);
+    return cache;
+}
+
+void
+db_search_cache_free(FsearchDatabaseSearchCache *cache) {
+    if (!cache) {
+        return;
+    }
+    db_search_cache_clear(cache);
+    g_clear_pointer(&cache->entries, g_hash_table_unref);
+    g_mutex_clear(&cache->mutex);
+    g_clear_pointer(&cache, free);
+}
+
+void
+db_search_cache_set_max_size(FsearchDatabaseSearchCache *cache, size_t max_size) {
+    g_assert(cache);
+    g_mutex_lock(&cache->mutex);
+    cache->max_size = max_size;
+    cache_shrink(cache, max_size);
+    g_mutex_unlock(&cache->mutex);
+}
+
+void
+db_search_cache_clear(FsearchDatabaseSearchCache *cache) {
+    g_assert(cache);
+    g_mutex_lock(&cache->mutex);
+    if (cache->size > 0) {
+        g_debug("[search_cache] drop %u results", g_queue_get_length(&cache->lru));
+    }
+    cache_shrink(cache, 0);
+    g_mutex_unlock(&cache->mutex);
+}
+
+bool
+db_search_cache_lookup(FsearchDatabaseSearchCache *cache,
+                       const char *key,
+                       DynamicArray **folders,
+                       DynamicArray **files,
+                       FsearchDatabaseIndexType *sort_type) {
+    g_assert(cache);
+    g_assert(key);
+    g_assert(folders);
+    g_assert(files);
+    g_assert(sort_type);
+
+    g_mutex_lock(&cache->mutex);
+    FsearchDatabaseSearchCacheEntry *entry = g_hash_table_lookup(cache->entries, key);
+    if (!entry) {
+        g_mutex_unlock(&cache->mutex);
+        return false;
+    }
+    g_queue_unlink(&cache->lru, entry->link);
+    g_queue_push_head_link(&cache->lru, entry->link);
+
+    *folders = entry->folders ? darray_ref(entry->folders) : NULL;
+    *files = entry->files ? darray_ref(entry->files) : NULL;
+    *sort_type = entry->sort_type;
+    g_mutex_unlock(&cache->mutex);
+    return true;
+}
+
+void
+db_search_cache_insert(FsearchDatabaseSearchCache *cache,
+                       const char *key,
+                       DynamicArray *folders,
+                       DynamicArray *files,
+                       FsearchDatabaseIndexType sort_type) {
+    g_assert(cache);
+    g_assert(key);
+
+    g_mutex_lock(&cache->mutex);
+    FsearchDatabaseSearchCacheEntry *old_entry = g_hash_table_lookup(cache->entries, key);
+    if (old_entry) {
+        cache_remove_entry(cache, old_entry);
+    }
+
+    const size_t size = sizeof(FsearchDatabaseSearchCacheEntry) + strlen(key) + 1 + get_array_size(folders)
+                      + get_array_size(files);
+    if (size > cache->max_size) {
+        g_mutex_unlock(&cache->mutex);
+        return;
+    }
+    cache_shrink(cache, cache->max_size - size);
+
+    FsearchDatabaseSearchCacheEntry *entry = calloc(1, sizeof(FsearchDatabaseSearchCacheEntry));
+    g_assert(entry);
+    entry->key = g_strdup(key);
+    entry->folders = folders ? darray_ref(folders) : NULL;
+    entry->files = files ? darray_ref(files) : NULL;
+    entry->sort_type = sort_type;
+    entry->size = size;
+
+    g_queue_push_head(&cache->lru, entry);
+    entry->link = g_queue_peek_head_link(&cache->lru);
+    g_hash_table_insert(cache->entries, entry->key, entry);
+    cache->size += size;
+    g_mutex_unlock(&cache->mutex);
+}
+
+uint32_t
+db_search_cache_get_num_entries(FsearchDatabaseSearchCache *cache) {
+    g_assert(cache);
+    g_mutex_lock(&cache->mutex);
+    const uint32_t num_entries = g_queue_get_length(&cache->lru);
+    g_mutex_unlock(&cache->mutex);
+    return num_entries;
+}
+
+size_t
+db_search_cache_get_memory_size(FsearchDatabaseSearchCache *cache) {
+    g_assert(cache);
+    g_mutex_lock(&cache->mutex);
+    const size_t size = cache->size;
+    g_mutex_unlock(&cache->mutex);
+    return size;
+}
+
+void
+db_search_cache_get_memory_stats(FsearchDatabaseSearchCache *cache, FsearchDatabaseMemoryStats *stats) {
+    g_assert(cache);
+    g_assert(stats);
+
+    g_mutex_lock(&cache->mutex);
+    for (GList *l = cache->lru.head; l; l = l->next) {
+        FsearchDatabaseSearchCacheEntry *entry = l->data;
+        stats->search_results += sizeof(FsearchDatabaseSearchCacheEntry) + strlen(entry->key) + 1;
+        stats->search_results += db_memory_stats_count_array(stats, entry->folders);
+        stats->search_results += db_memory_stats_count_array(stats, entry->files);
+    }
+    g_mutex_unlock(&cache->mutex);
+}
+
+static void
+append_normalized_query_text(GString *key, const char *query_text) {
+    if (strchr(query_text, '"') || strchr(query_text, '\\')) {
+        // whitespace can be part of a quoted or escaped term, so it's kept as it is
+        g_string_append(key, query_text);
+        return;
+    }
+    bool has_text = false;
+    bool pending_space = false;
+    for (const char *c = query_text; *c; c++) {
+        if (g_ascii_isspace(*c)) {
+            pending_space = has_text;
+            continue;
+        }
+        has_text = true;
+        if (pending_space) {
+            g_string_append_c(key, ' ');
+            pending_space = false;
+        }
+        g_string_append_c(key, *c);
+    }
+}
+
+char *
+db_search_cache_key_new(const char *query_text,
+                        FsearchFilter *filter,
+                        FsearchFilterManager *filters,
+                        FsearchQueryFlags flags,
+                        FsearchDatabaseIndexType sort_order) {
+    // the fields are separated by control characters, which a filter definition doesn't contain
+    GString *key = g_string_new(NULL);
+    g_string_append_printf(key, "%u\x1f%u\x1f", (uint32_t)flags, (uint32_t)sort_order);
+    if (filter) {
+        g_string_append_printf(key, "%s\x1f%u\x1f", filter->query ? filter->query : "", (uint32_t)filter->flags);
+    }
+    const guint num_filters = filters ? fsearch_filter_manager_get_num_filters(filters) : 0;
+    for (guint i = 0; i < num_filters; i++) {
+        FsearchFilter *f = fsearch_filter_manager_get_filter(filters, i);
+        if (f && f->macro && f->macro[0] != '\0') {
+            g_string_append_printf(key,
+                                   "%s\x1f%s\x1f%u\x1f",
+                                   f->macro,
+                                   f->query ? f->query : "",
+                                   (uint32_t)f->flags);
+        }
+        g_clear_pointer(&f, fsearch_filter_unref);
+    }
+    g_string_append_c(key, '\x1e');
+    append_normalized_query_text(key, query_text ? query_text : "");
+    return g_string_free(key, FALSE);
+}
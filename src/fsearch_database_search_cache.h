@@ -0,0 +1,71 @@
+#pragma once
+
+#include <glib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fsearch_array.h"
+#include "fsearch_database_index.h"
+#include "fsearch_database_memory_stats.h"
+#include "fsearch_filter.h"
+#include "fsearch_filter_manager.h"
+#include "fsearch_query_flags.h"
+
+// The results of the most recently used searches, so repeating one of them doesn't need to search the database again.
+// The least recently used results get dropped once the cache would use more memory than its maximum size.
+// It's thread safe, searches which only hold the shared lock of the database can use it at the same time.
+typedef struct FsearchDatabaseSearchCache FsearchDatabaseSearchCache;
+
+// A max_size of 0 disables the cache
+FsearchDatabaseSearchCache *
+db_search_cache_new(size_t max_size);
+
+void
+db_search_cache_free(FsearchDatabaseSearchCache *cache);
+
+// Drops the least recently used results until the cache fits into max_size
+void
+db_search_cache_set_max_size(FsearchDatabaseSearchCache *cache, size_t max_size);
+
+void
+db_search_cache_clear(FsearchDatabaseSearchCache *cache);
+
+// Returns true and references to the cached results in folders and files, if there're any for key.
+// sort_type is the order they're sorted by, which isn't necessarily the one in key.
+bool
+db_search_cache_lookup(FsearchDatabaseSearchCache *cache,
+                       const char *key,
+                       DynamicArray **folders,
+                       DynamicArray **files,
+                       FsearchDatabaseIndexType *sort_type);
+
+// The cache takes references to folders and files, results which don't fit into it on their own aren't added.
+// The arrays mustn't be modified afterwards.
+void
+db_search_cache_insert(FsearchDatabaseSearchCache *cache,
+                       const char *key,
+                       DynamicArray *folders,
+                       DynamicArray *files,
+                       FsearchDatabaseIndexType sort_type);
+
+uint32_t
+db_search_cache_get_num_entries(FsearchDatabaseSearchCache *cache);
+
+// The memory accounted to the cached results, which is what max_size limits
+size_t
+db_search_cache_get_memory_size(FsearchDatabaseSearchCache *cache);
+
+// Adds the memory of the cached results to stats, arrays which were counted already (e.g. because a view shows them)
+// are skipped
+void
+db_search_cache_get_memory_stats(FsearchDatabaseSearchCache *cache, FsearchDatabaseMemoryStats *stats);
+
+// Everything which decides about the results of a search: the query text (with redundant whitespace removed),
+// the flags, the filter and the macros of all filters which the query could use, and the requested sort order
+char *
+db_search_cache_key_new(const char *query_text,
+                        FsearchFilter *filter,
+                        FsearchFilterManager *filters,
+                        FsearchQueryFlags flags,
+                        FsearchDatabaseIndexType sort_order);
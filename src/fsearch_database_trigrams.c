@@ -0,0 +1,531 @@
+#define G_LOG_DOMAIN "fsearch-database-trigrams"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "fsearch_database_entry.h"
+#include "fsearch_database_trigrams.h"
+
+// the lists get built in parallel for arrays with at least this many entries per thread
+#define DB_TRIGRAMS_MIN_PARTITION_SIZE (1 << 18)
+#define DB_TRIGRAMS_MAX_PARTITIONS 8
+// the index isn't used if even the shortest posting list of a query contains more than this fraction of all entries,
+// checking the entries one after another is faster then
+#define DB_TRIGRAMS_MAX_CANDIDATES_DIVISOR 8
+// longer posting lists aren't intersected with the candidates, decoding them would take longer than checking the
+// candidates which they'd remove
+#define DB_TRIGRAMS_MAX_INTERSECT_FACTOR 32
+// no position is ever UINT32_MAX, so the first delta of a list is the position + 1
+#define DB_TRIGRAMS_NO_POSITION UINT32_MAX
+
+static inline uint32_t
+trigram_symbol(uint8_t c) {
+    if (c >= 'a' && c <= 'z') {
+        return c - 'a' + 1;
+    }
+    if (c >= 'A' && c <= 'Z') {
+        return c - 'A' + 1;
+    }
+    if (c >= '0' && c <= '9') {
+        return c - '0' + 27;
+    }
+    if (c < 0x80) {
+        return 37 + c % 11;
+    }
+    return 48 + c % 16;
+}
+
+static inline uint32_t
+trigram_key(uint32_t s0, uint32_t s1, uint32_t s2) {
+    return (s0 << 12) | (s1 << 6) | s2;
+}
+
+static inline uint32_t
+varint_size(uint32_t value) {
+    uint32_t size = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        size++;
+    }
+    return size;
+}
+
+static inline uint32_t
+varint_write(uint8_t *dest, uint32_t value) {
+    uint32_t size = 0;
+    while (value >= 0x80) {
+        dest[size++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    dest[size++] = (uint8_t)value;
+    return size;
+}
+
+static inline bool
+varint_read(const uint8_t **src, const uint8_t *end, uint32_t *value) {
+    uint32_t result = 0;
+    for (uint32_t shift = 0; shift < 35 && *src < end; shift += 7) {
+        const uint8_t byte = *(*src)++;
+        result |= (uint32_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Runs the statements for the key of every trigram of name (continue skips to the next one), names with less than
+// three bytes don't have any
+#define TRIGRAMS_FOREACH_KEY(name, key, ...)                                                                           \
+    do {                                                                                                               \
+        const uint8_t *c_ = (const uint8_t *)(name);                                                                  \
+        if (!c_[0] || !c_[1]) {                                                                                        \
+            break;                                                                                                     \
+        }                                                                                                              \
+        uint32_t s0_ = trigram_symbol(c_[0]);                                                                          \
+        uint32_t s1_ = trigram_symbol(c_[1]);                                                                          \
+        for (c_ += 2; *c_; c_++) {                                                                                     \
+            const uint32_t s2_ = trigram_symbol(*c_);                                                                  \
+            const uint32_t key = trigram_key(s0_, s1_, s2_);                                                           \
+            s0_ = s1_;                                                                                                 \
+            s1_ = s2_;                                                                                                 \
+            __VA_ARGS__                                                                                                \
+        }                                                                                                              \
+    } while (0)
+
+typedef struct DatabaseTrigramPartition {
+    uint32_t start;
+    uint32_t end;
+    // the state of the first pass, which measures the posting lists of the partition
+    uint32_t *counts;
+    uint32_t *last;
+    // the size of the posting lists without their first position. After the partitions have been merged, it's
+    // where the partition continues writing the list.
+    uint64_t *sizes;
+    // the first position of the lists, after merging it's the last position of the previous partitions
+    uint32_t *first;
+} DatabaseTrigramPartition;
+
+typedef struct DatabaseTrigramBuildContext {
+    DynamicArray *entries;
+    DatabaseTrigramPartition *partitions;
+    uint32_t num_partitions;
+    uint8_t *postings;
+    void (*partition_func)(struct DatabaseTrigramBuildContext *, DatabaseTrigramPartition *);
+} DatabaseTrigramBuildContext;
+
+static void
+measure_partition(DatabaseTrigramBuildContext *ctx, DatabaseTrigramPartition *part) {
+    part->counts = calloc(DB_TRIGRAMS_NUM_KEYS, sizeof(uint32_t));
+    g_assert(part->counts);
+    part->sizes = calloc(DB_TRIGRAMS_NUM_KEYS, sizeof(uint64_t));
+    g_assert(part->sizes);
+    part->last = malloc(DB_TRIGRAMS_NUM_KEYS * sizeof(uint32_t));
+    g_assert(part->last);
+    part->first = malloc(DB_TRIGRAMS_NUM_KEYS * sizeof(uint32_t));
+    g_assert(part->first);
+
+    for (uint32_t pos = part->start; pos < part->end; pos++) {
+        const char *name = db_entry_get_name_raw_for_display(darray_get_item(ctx->entries, pos));
+        TRIGRAMS_FOREACH_KEY(name, key, {
+            if (part->counts[key] == 0) {
+                part->first[key] = pos;
+            }
+            else if (part->last[key] == pos) {
+                // the same key occurs more than once in this name
+                continue;
+            }
+            else {
+                part->sizes[key] += varint_size(pos - part->last[key]);
+            }
+            part->last[key] = pos;
+            part->counts[key]++;
+        });
+    }
+}
+
+static void
+encode_partition(DatabaseTrigramBuildContext *ctx, DatabaseTrigramPartition *part) {
+    uint64_t *write_offsets = part->sizes;
+    uint32_t *prev = part->first;
+    for (uint32_t pos = part->start; pos < part->end; pos++) {
+        const char *name = db_entry_get_name_raw_for_display(darray_get_item(ctx->entries, pos));
+        TRIGRAMS_FOREACH_KEY(name, key, {
+            if (prev[key] == pos) {
+                continue;
+            }
+            write_offsets[key] += varint_write(ctx->postings + write_offsets[key], pos - prev[key]);
+            prev[key] = pos;
+        });
+    }
+}
+
+static void
+build_partitions(uint32_t start, uint32_t end, void *data) {
+    DatabaseTrigramBuildContext *ctx = data;
+    for (uint32_t i = start; i < end; i++) {
+        ctx->partition_func(ctx, &ctx->partitions[i]);
+    }
+}
+
+static void
+run_on_partitions(DatabaseTrigramBuildContext *ctx,
+                  FsearchThreadPool *pool,
+                  void (*partition_func)(DatabaseTrigramBuildContext *, DatabaseTrigramPartition *)) {
+    ctx->partition_func = partition_func;
+    fsearch_thread_pool_parallel_for(pool, ctx->num_partitions, 1, build_partitions, ctx, NULL);
+}
+
+// Combines the measurements of the partitions into the keys and offsets of the lists and prepares the partitions
+// for encoding their part of the lists. Returns the number of keys.
+static uint32_t
+merge_partitions(DatabaseTrigramBuildContext *ctx, uint32_t *keys, uint32_t *num_postings, uint64_t *offsets) {
+    uint32_t num_keys = 0;
+    uint64_t offset = 0;
+    for (uint32_t key = 0; key < DB_TRIGRAMS_NUM_KEYS; key++) {
+        uint32_t prev = DB_TRIGRAMS_NO_POSITION;
+        uint32_t count = 0;
+        const uint64_t start = offset;
+        for (uint32_t i = 0; i < ctx->num_partitions; i++) {
+            DatabaseTrigramPartition *part = &ctx->partitions[i];
+            if (part->counts[key] == 0) {
+                continue;
+            }
+            const uint64_t size = varint_size(part->first[key] - prev) + part->sizes[key];
+            part->sizes[key] = offset;
+            part->first[key] = prev;
+            offset += size;
+            prev = part->last[key];
+            count += part->counts[key];
+        }
+        if (count > 0) {
+            keys[num_keys] = key;
+            num_postings[num_keys] = count;
+            offsets[num_keys] = start;
+            num_keys++;
+        }
+    }
+    offsets[num_keys] = offset;
+    return num_keys;
+}
+
+static void
+trigram_list_build(FsearchDatabaseTrigramList *list, DynamicArray *entries, FsearchThreadPool *pool) {
+    const uint32_t num_entries = darray_get_num_items(entries);
+    const uint32_t num_threads = pool ? fsearch_thread_pool_get_num_threads(pool) : 1;
+    const uint32_t num_partitions = CLAMP(num_entries / DB_TRIGRAMS_MIN_PARTITION_SIZE,
+                                          1,
+                                          MIN(MAX(num_threads, 1), DB_TRIGRAMS_MAX_PARTITIONS));
+
+    DatabaseTrigramPartition partitions[DB_TRIGRAMS_MAX_PARTITIONS] = {};
+    for (uint32_t i = 0; i < num_partitions; i++) {
+        partitions[i].start = (uint32_t)((uint64_t)num_entries * i / num_partitions);
+        partitions[i].end = (uint32_t)((uint64_t)num_entries * (i + 1) / num_partitions);
+    }
+    DatabaseTrigramBuildContext ctx = {
+        .entries = entries,
+        .partitions = partitions,
+        .num_partitions = num_partitions,
+    };
+    run_on_partitions(&ctx, pool, measure_partition);
+
+    uint32_t *keys = malloc(DB_TRIGRAMS_NUM_KEYS * sizeof(uint32_t));
+    g_assert(keys);
+    uint32_t *num_postings = malloc(DB_TRIGRAMS_NUM_KEYS * sizeof(uint32_t));
+    g_assert(num_postings);
+    uint64_t *offsets = malloc((DB_TRIGRAMS_NUM_KEYS + 1) * sizeof(uint64_t));
+    g_assert(offsets);
+    const uint32_t num_keys = merge_partitions(&ctx, keys, num_postings, offsets);
+    for (uint32_t i = 0; i < num_partitions; i++) {
+        g_clear_pointer(&partitions[i].counts, free);
+        g_clear_pointer(&partitions[i].last, free);
+    }
+
+    ctx.postings = malloc(MAX(offsets[num_keys], 1));
+    g_assert(ctx.postings);
+    run_on_partitions(&ctx, pool, encode_partition);
+    for (uint32_t i = 0; i < num_partitions; i++) {
+        g_clear_pointer(&partitions[i].sizes, free);
+        g_clear_pointer(&partitions[i].first, free);
+    }
+
+    list->num_entries = num_entries;
+    list->num_keys = num_keys;
+    list->keys = realloc(keys, MAX(num_keys, 1) * sizeof(uint32_t));
+    g_assert(list->keys);
+    list->num_postings = realloc(num_postings, MAX(num_keys, 1) * sizeof(uint32_t));
+    g_assert(list->num_postings);
+    list->offsets = realloc(offsets, (num_keys + 1) * sizeof(uint64_t));
+    g_assert(list->offsets);
+    list->postings = ctx.postings;
+}
+
+static bool
+trigram_list_is_valid(const FsearchDatabaseTrigramList *list, uint32_t num_entries) {
+    if (list->num_entries != num_entries || list->num_keys > DB_TRIGRAMS_NUM_KEYS || list->offsets[0] != 0) {
+        return false;
+    }
+    for (uint32_t i = 0; i < list->num_keys; i++) {
+        if (list->keys[i] >= DB_TRIGRAMS_NUM_KEYS || (i > 0 && list->keys[i] <= list->keys[i - 1])
+            || list->num_postings[i] == 0 || list->num_postings[i] > num_entries
+            || list->offsets[i + 1] < list->offsets[i]
+            || list->offsets[i + 1] - list->offsets[i] < list->num_postings[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void
+trigram_list_clear(FsearchDatabaseTrigramList *list) {
+    // the lists are only const for the ones which point into the database file
+    free((void *)list->keys);
+    free((void *)list->num_postings);
+    free((void *)list->offsets);
+    free((void *)list->postings);
+    memset(list, 0, sizeof(FsearchDatabaseTrigramList));
+}
+
+static void
+db_trigrams_free(FsearchDatabaseTrigrams *trigrams) {
+    if (!trigrams->contents) {
+        trigram_list_clear(&trigrams->folder_trigrams);
+        trigram_list_clear(&trigrams->file_trigrams);
+    }
+    g_clear_pointer(&trigrams->folders, darray_unref);
+    g_clear_pointer(&trigrams->files, darray_unref);
+    g_clear_pointer(&trigrams->contents, g_bytes_unref);
+    g_clear_pointer(&trigrams, free);
+}
+
+static FsearchDatabaseTrigrams *
+db_trigrams_alloc(DynamicArray *folders, DynamicArray *files) {
+    FsearchDatabaseTrigrams *trigrams = calloc(1, sizeof(FsearchDatabaseTrigrams));
+    g_assert(trigrams);
+    trigrams->folders = darray_ref(folders);
+    trigrams->files = darray_ref(files);
+    trigrams->ref_count = 1;
+    return trigrams;
+}
+
+FsearchDatabaseTrigrams *
+db_trigrams_new(DynamicArray *folders, DynamicArray *files, FsearchThreadPool *pool) {
+    g_assert(folders);
+    g_assert(files);
+
+    FsearchDatabaseTrigrams *trigrams = db_trigrams_alloc(folders, files);
+    trigram_list_build(&trigrams->folder_trigrams, folders, pool);
+    trigram_list_build(&trigrams->file_trigrams, files, pool);
+    return trigrams;
+}
+
+FsearchDatabaseTrigrams *
+db_trigrams_new_from_lists(DynamicArray *folders,
+                           DynamicArray *files,
+                           const FsearchDatabaseTrigramList *folder_trigrams,
+                           const FsearchDatabaseTrigramList *file_trigrams,
+                           GBytes *contents) {
+    g_assert(folders);
+    g_assert(files);
+    g_assert(contents);
+
+    if (!trigram_list_is_valid(folder_trigrams, darray_get_num_items(folders))
+        || !trigram_list_is_valid(file_trigrams, darray_get_num_items(files))) {
+        return NULL;
+    }
+    FsearchDatabaseTrigrams *trigrams = db_trigrams_alloc(folders, files);
+    trigrams->folder_trigrams = *folder_trigrams;
+    trigrams->file_trigrams = *file_trigrams;
+    trigrams->contents = g_bytes_ref(contents);
+    return trigrams;
+}
+
+FsearchDatabaseTrigrams *
+db_trigrams_ref(FsearchDatabaseTrigrams *trigrams) {
+    if (!trigrams || g_atomic_int_get(&trigrams->ref_count) <= 0) {
+        return NULL;
+    }
+    g_atomic_int_inc(&trigrams->ref_count);
+    return trigrams;
+}
+
+void
+db_trigrams_unref(FsearchDatabaseTrigrams *trigrams) {
+    if (!trigrams || g_atomic_int_get(&trigrams->ref_count) <= 0) {
+        return;
+    }
+    if (g_atomic_int_dec_and_test(&trigrams->ref_count)) {
+        g_clear_pointer(&trigrams, db_trigrams_free);
+    }
+}
+
+static size_t
+trigram_list_get_memory_size(const FsearchDatabaseTrigramList *list) {
+    return (size_t)list->num_keys * (2 * sizeof(uint32_t) + sizeof(uint64_t)) + sizeof(uint64_t)
+         + list->offsets[list->num_keys];
+}
+
+size_t
+db_trigrams_get_memory_size(const FsearchDatabaseTrigrams *trigrams) {
+    if (!trigrams) {
+        return 0;
+    }
+    size_t size = sizeof(FsearchDatabaseTrigrams);
+    if (!trigrams->contents) {
+        size += trigram_list_get_memory_size(&trigrams->folder_trigrams)
+              + trigram_list_get_memory_size(&trigrams->file_trigrams);
+    }
+    return size;
+}
+
+static int
+cmp_uint32(const void *a, const void *b) {
+    const uint32_t aa = *(const uint32_t *)a;
+    const uint32_t bb = *(const uint32_t *)b;
+    return aa < bb ? -1 : aa > bb;
+}
+
+// Returns the index of key in list or -1 if no entry contains it
+static int64_t
+trigram_list_find_key(const FsearchDatabaseTrigramList *list, uint32_t key) {
+    uint32_t *found = bsearch(&key, list->keys, list->num_keys, sizeof(uint32_t), cmp_uint32);
+    return found ? found - list->keys : -1;
+}
+
+static inline bool
+trigram_list_advance(const FsearchDatabaseTrigramList *list, uint32_t *pos, uint32_t delta) {
+    // the first delta wraps around from DB_TRIGRAMS_NO_POSITION
+    const uint64_t next = *pos == DB_TRIGRAMS_NO_POSITION ? (uint64_t)delta - 1 : (uint64_t)*pos + delta;
+    if (delta == 0 || next >= list->num_entries) {
+        return false;
+    }
+    *pos = (uint32_t)next;
+    return true;
+}
+
+static bool
+trigram_list_decode(const FsearchDatabaseTrigramList *list, uint32_t idx, uint32_t *positions) {
+    const uint8_t *src = list->postings + list->offsets[idx];
+    const uint8_t *end = list->postings + list->offsets[idx + 1];
+    uint32_t pos = DB_TRIGRAMS_NO_POSITION;
+    for (uint32_t i = 0; i < list->num_postings[idx]; i++) {
+        uint32_t delta = 0;
+        if (!varint_read(&src, end, &delta) || !trigram_list_advance(list, &pos, delta)) {
+            return false;
+        }
+        positions[i] = pos;
+    }
+    return true;
+}
+
+// Removes all candidates which aren't part of the list idx, returns false if it's damaged
+static bool
+trigram_list_intersect(const FsearchDatabaseTrigramList *list,
+                       uint32_t idx,
+                       uint32_t *candidates,
+                       uint32_t *num_candidates) {
+    const uint8_t *src = list->postings + list->offsets[idx];
+    const uint8_t *end = list->postings + list->offsets[idx + 1];
+    uint32_t remaining = list->num_postings[idx];
+    uint32_t pos = DB_TRIGRAMS_NO_POSITION;
+    uint32_t num_kept = 0;
+    for (uint32_t i = 0; i < *num_candidates; i++) {
+        const uint32_t candidate = candidates[i];
+        while (remaining > 0 && (pos == DB_TRIGRAMS_NO_POSITION || pos < candidate)) {
+            uint32_t delta = 0;
+            if (!varint_read(&src, end, &delta) || !trigram_list_advance(list, &pos, delta)) {
+                return false;
+            }
+            remaining--;
+        }
+        if (pos == candidate) {
+            candidates[num_kept++] = candidate;
+        }
+        else if (pos == DB_TRIGRAMS_NO_POSITION || pos < candidate) {
+            // the list ends before the remaining candidates
+            break;
+        }
+    }
+    *num_candidates = num_kept;
+    return true;
+}
+
+typedef struct TrigramListRef {
+    uint32_t idx;
+    uint32_t num_postings;
+} TrigramListRef;
+
+static int
+cmp_list_ref(const void *a, const void *b) {
+    const TrigramListRef *aa = a;
+    const TrigramListRef *bb = b;
+    return aa->num_postings < bb->num_postings ? -1 : aa->num_postings > bb->num_postings;
+}
+
+uint32_t *
+db_trigram_list_get_candidates(const FsearchDatabaseTrigramList *list,
+                               const char **needles,
+                               uint32_t num_needles,
+                               uint32_t *num_candidates) {
+    g_assert(list);
+    g_assert(needles);
+    g_assert(num_candidates);
+
+    size_t max_keys = 0;
+    for (uint32_t i = 0; i < num_needles; i++) {
+        const size_t len = strlen(needles[i]);
+        max_keys += len >= DB_TRIGRAMS_MIN_NEEDLE_LEN ? len - 2 : 0;
+    }
+    if (max_keys == 0) {
+        return NULL;
+    }
+    g_autofree uint32_t *keys = g_new(uint32_t, max_keys);
+    size_t num_keys = 0;
+    for (uint32_t i = 0; i < num_needles; i++) {
+        TRIGRAMS_FOREACH_KEY(needles[i], key, { keys[num_keys++] = key; });
+    }
+    qsort(keys, num_keys, sizeof(uint32_t), cmp_uint32);
+
+    g_autofree TrigramListRef *lists = g_new(TrigramListRef, num_keys);
+    uint32_t num_lists = 0;
+    for (size_t i = 0; i < num_keys; i++) {
+        if (i > 0 && keys[i] == keys[i - 1]) {
+            continue;
+        }
+        const int64_t idx = trigram_list_find_key(list, keys[i]);
+        if (idx < 0) {
+            // no entry contains this trigram
+            *num_candidates = 0;
+            return calloc(1, sizeof(uint32_t));
+        }
+        lists[num_lists].idx = (uint32_t)idx;
+        lists[num_lists].num_postings = list->num_postings[idx];
+        num_lists++;
+    }
+    qsort(lists, num_lists, sizeof(TrigramListRef), cmp_list_ref);
+    if (lists[0].num_postings > list->num_entries / DB_TRIGRAMS_MAX_CANDIDATES_DIVISOR) {
+        return NULL;
+    }
+
+    uint32_t *candidates = malloc(MAX(lists[0].num_postings, 1) * sizeof(uint32_t));
+    g_assert(candidates);
+    if (!trigram_list_decode(list, lists[0].idx, candidates)) {
+        g_debug("[trigrams] damaged posting list: %u", list->keys[lists[0].idx]);
+        g_clear_pointer(&candidates, free);
+        return NULL;
+    }
+    uint32_t num = lists[0].num_postings;
+    for (uint32_t i = 1; i < num_lists && num > 0; i++) {
+        if ((uint64_t)lists[i].num_postings > (uint64_t)num * DB_TRIGRAMS_MAX_INTERSECT_FACTOR) {
+            break;
+        }
+        if (!trigram_list_intersect(list, lists[i].idx, candidates, &num)) {
+            g_debug("[trigrams] damaged posting list: %u", list->keys[lists[i].idx]);
+            g_clear_pointer(&candidates, free);
+            return NULL;
+        }
+    }
+    *num_candidates = num;
+    return candidates;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <glib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fsearch_array.h"
+#include "fsearch_thread_pool.h"
+
+// Every three consecutive bytes of a name are mapped to one of DB_TRIGRAMS_NUM_KEYS keys, ignoring the case of ASCII
+// letters. Different trigrams can share a key, that only makes the candidates less precise.
+#define DB_TRIGRAMS_NUM_KEYS (1 << 18)
+// needles need at least one trigram to narrow the candidates down
+#define DB_TRIGRAMS_MIN_NEEDLE_LEN 3
+
+// The trigram keys of the names of one entry array (sorted by name) and the positions of the entries which contain
+// each of them. The positions are delta encoded as variable length integers, so the common keys don't need four
+// bytes per entry.
+typedef struct FsearchDatabaseTrigramList {
+    uint32_t num_entries;
+    uint32_t num_keys;
+    // in ascending order
+    const uint32_t *keys;
+    // the number of entries which contain keys[i]
+    const uint32_t *num_postings;
+    // num_keys + 1 offsets, the encoded positions of keys[i] are postings[offsets[i]..offsets[i + 1]]
+    const uint64_t *offsets;
+    const uint8_t *postings;
+} FsearchDatabaseTrigramList;
+
+// The trigram index of the name arrays. Substring searches with terms of at least three bytes only have to check the
+// entries which contain all trigrams of their terms.
+typedef struct FsearchDatabaseTrigrams {
+    // sorted by name, so the positions in the posting lists are positions in these arrays
+    DynamicArray *folders;
+    DynamicArray *files;
+    FsearchDatabaseTrigramList folder_trigrams;
+    FsearchDatabaseTrigramList file_trigrams;
+    // the lists point into the loaded database file, if they were loaded from there, otherwise they're allocated
+    GBytes *contents;
+
+    volatile int ref_count;
+} FsearchDatabaseTrigrams;
+
+// Builds the trigrams of all folders and files on the threads of pool (which is optional)
+FsearchDatabaseTrigrams *
+db_trigrams_new(DynamicArray *folders, DynamicArray *files, FsearchThreadPool *pool);
+
+// Takes the lists as they were stored in the database file, they point into contents.
+// Returns NULL if they're invalid or don't belong to the arrays.
+FsearchDatabaseTrigrams *
+db_trigrams_new_from_lists(DynamicArray *folders,
+                           DynamicArray *files,
+                           const FsearchDatabaseTrigramList *folder_trigrams,
+                           const FsearchDatabaseTrigramList *file_trigrams,
+                           GBytes *contents);
+
+FsearchDatabaseTrigrams *
+db_trigrams_ref(FsearchDatabaseTrigrams *trigrams);
+
+void
+db_trigrams_unref(FsearchDatabaseTrigrams *trigrams);
+
+// The number of bytes allocated for the keys and posting lists, without the entries and the lists in the database file
+size_t
+db_trigrams_get_memory_size(const FsearchDatabaseTrigrams *trigrams);
+
+// Returns the positions (in ascending order) of all entries which might contain every one of the needles, or NULL if
+// the trigrams don't narrow them down enough to be worth it or the list is damaged. num_candidates is set to the
+// number of positions.
+uint32_t *
+db_trigram_list_get_candidates(const FsearchDatabaseTrigramList *list,
+                               const char **needles,
+                               uint32_t num_needles,
+                               uint32_t *num_candidates);
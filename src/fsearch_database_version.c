@@ -0,0 +1,108 @@
+#define G_LOG_DOMAIN "fsearch-database-version"
+
+#include <stdlib.h>
+
+#include "fsearch_database_version.h"
+
+static void
+db_version_free(FsearchDatabaseVersion *version) {
+    for (uint32_t i = 0; i < NUM_DATABASE_INDEX_TYPES; i++) {
+        g_clear_pointer(&version->sorted_folders[i], darray_unref);
+        g_clear_pointer(&version->sorted_files[i], darray_unref);
+    }
+    g_clear_pointer(&version, free);
+}
+
+FsearchDatabaseVersion *
+db_version_new(DynamicArray **sorted_folders, DynamicArray **sorted_files, uint64_t id) {
+    g_assert(sorted_folders);
+    g_assert(sorted_files);
+
+    FsearchDatabaseVersion *version = calloc(1, sizeof(FsearchDatabaseVersion));
+    g_assert(version);
+
+    for (uint32_t i = 0; i < NUM_DATABASE_INDEX_TYPES; i++) {
+        version->sorted_folders[i] = sorted_folders[i] ? darray_ref(sorted_folders[i]) : NULL;
+        version->sorted_files[i] = sorted_files[i] ? darray_ref(sorted_files[i]) : NULL;
+    }
+    DynamicArray *folders = version->sorted_folders[DATABASE_INDEX_TYPE_NAME];
+    DynamicArray *files = version->sorted_files[DATABASE_INDEX_TYPE_NAME];
+    version->num_folders = folders ? darray_get_num_items(folders) : 0;
+    version->num_files = files ? darray_get_num_items(files) : 0;
+    version->id = id;
+
+    version->ref_count = 1;
+    return version;
+}
+
+FsearchDatabaseVersion *
+db_version_ref(FsearchDatabaseVersion *version) {
+    if (!version || g_atomic_int_get(&version->ref_count) <= 0) {
+        return NULL;
+    }
+    g_atomic_int_inc(&version->ref_count);
+    return version;
+}
+
+void
+db_version_unref(FsearchDatabaseVersion *version) {
+    if (!version || g_atomic_int_get(&version->ref_count) <= 0) {
+        return;
+    }
+    if (g_atomic_int_dec_and_test(&version->ref_count)) {
+        g_clear_pointer(&version, db_version_free);
+    }
+}
+
+bool
+db_version_has_arrays(const FsearchDatabaseVersion *version, DynamicArray **sorted_folders, DynamicArray **sorted_files) {
+    g_assert(version);
+    for (uint32_t i = 0; i < NUM_DATABASE_INDEX_TYPES; i++) {
+        if (version->sorted_folders[i] != sorted_folders[i] || version->sorted_files[i] != sorted_files[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool
+db_version_get_entries_sorted(FsearchDatabaseVersion *version,
+                              FsearchDatabaseIndexType requested_sort_type,
+                              FsearchDatabaseIndexType *returned_sort_type,
+                              DynamicArray **folders,
+                              DynamicArray **files) {
+    g_assert(version);
+    g_assert(returned_sort_type);
+    g_assert(folders);
+    g_assert(files);
+    if (requested_sort_type < 0 || requested_sort_type >= NUM_DATABASE_INDEX_TYPES) {
+        return false;
+    }
+
+    FsearchDatabaseIndexType sort_type = requested_sort_type;
+    if (!version->sorted_folders[sort_type] || !version->sorted_files[sort_type]) {
+        sort_type = DATABASE_INDEX_TYPE_NAME;
+    }
+    if (!version->sorted_folders[sort_type] || !version->sorted_files[sort_type]) {
+        return false;
+    }
+
+    *folders = darray_ref(version->sorted_folders[sort_type]);
+    *files = darray_ref(version->sorted_files[sort_type]);
+    *returned_sort_type = sort_type;
+    return true;
+}
+
+DynamicArray *
+db_version_get_folders(FsearchDatabaseVersion *version) {
+    g_assert(version);
+    DynamicArray *folders = version->sorted_folders[DATABASE_INDEX_TYPE_NAME];
+    return folders ? darray_ref(folders) : NULL;
+}
+
+DynamicArray *
+db_version_get_files(FsearchDatabaseVersion *version) {
+    g_assert(version);
+    DynamicArray *files = version->sorted_files[DATABASE_INDEX_TYPE_NAME];
+    return files ? darray_ref(files) : NULL;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <glib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "fsearch_array.h"
+#include "fsearch_database_index.h"
+
+// The sorted arrays of a database at one point in time. The database publishes a new version whenever its arrays
+// get replaced and never changes a published one, so it can be read without holding the lock of the database.
+// It's freed once the last reader is done with it.
+typedef struct FsearchDatabaseVersion {
+    // NULL if the database isn't sorted by the respective type
+    DynamicArray *sorted_folders[NUM_DATABASE_INDEX_TYPES];
+    DynamicArray *sorted_files[NUM_DATABASE_INDEX_TYPES];
+    uint32_t num_folders;
+    uint32_t num_files;
+    // counts up with every version the database publishes
+    uint64_t id;
+
+    volatile int ref_count;
+} FsearchDatabaseVersion;
+
+// Takes a reference to every array
+FsearchDatabaseVersion *
+db_version_new(DynamicArray **sorted_folders, DynamicArray **sorted_files, uint64_t id);
+
+FsearchDatabaseVersion *
+db_version_ref(FsearchDatabaseVersion *version);
+
+void
+db_version_unref(FsearchDatabaseVersion *version);
+
+// Whether the version consists of exactly these arrays
+bool
+db_version_has_arrays(const FsearchDatabaseVersion *version, DynamicArray **sorted_folders, DynamicArray **sorted_files);
+
+// Like db_get_entries_sorted, it falls back to the name order if the version isn't sorted by requested_sort_type
+bool
+db_version_get_entries_sorted(FsearchDatabaseVersion *version,
+                              FsearchDatabaseIndexType requested_sort_type,
+                              FsearchDatabaseIndexType *returned_sort_type,
+                              DynamicArray **folders,
+                              DynamicArray **files);
+
+// References to the arrays sorted by name, NULL if there are none
+DynamicArray *
+db_version_get_folders(FsearchDatabaseVersion *version);
+
+DynamicArray *
+db_version_get_files(FsearchDatabaseVersion *version);
@@ -6,6 +6,7 @@
 #include "fsearch_selection.h"
 #include "fsearch_task.h"
 #include "fsearch_task_ids.h"
+#include "fsearch_trace.h"
 
 #include <string.h>
 
@@ -16,6 +17,11 @@
 // * sorting
 // * selection handling
 
+// Searches are told apart by whether they only search the results of the previous query and by the length of their
+// text up to this, since short queries match the most entries
+#define NUM_SEARCH_LENGTH_CLASSES 4
+#define NUM_SEARCH_CLASSES (2 * NUM_SEARCH_LENGTH_CLASSES)
+
 struct FsearchDatabaseView {
     uint32_t id;
 
@@ -23,10 +29,15 @@ struct FsearchDatabaseView {
     FsearchThreadPool *pool;
 
     FsearchQuery *query;
+    // files and folders hold all results of this query, so they can be searched instead of the whole database for
+    // queries which refine it
+    FsearchQuery *results_query;
 
     DynamicArray *files;
     DynamicArray *folders;
-    GHashTable *selection;
+    FsearchSelection *selection;
+    // the results are empty because the duplicates the query needs are still being looked for
+    bool duplicates_pending;
 
     FsearchDatabaseIndexType sort_order;
     GtkSortType sort_type;
@@ -36,11 +47,17 @@ struct FsearchDatabaseView {
     FsearchFilterManager *filters;
     FsearchQueryFlags query_flags;
     uint32_t query_id;
+    // the moving average of how long the recent searches of each class took in ms, 0 if none finished yet
+    double search_durations[NUM_SEARCH_CLASSES];
+    FsearchDatabaseViewTimes times;
+    FsearchQueryStats query_stats;
 
     FsearchTaskQueue *task_queue;
 
     FsearchDatabaseViewNotifyFunc notify_func;
     gpointer notify_func_data;
+    // the percentage of the running sort which is done
+    volatile int sort_progress;
 
     GMutex mutex;
 
@@ -53,6 +70,16 @@ typedef struct {
     FsearchQuery *query;
     FsearchDatabaseIndexType sort_order;
     bool reset_selection;
+    // optional, the results of a previous query which query refines, they get searched instead of the database
+    DynamicArray *folders;
+    DynamicArray *files;
+    FsearchDatabaseIndexType entries_sort_order;
+    // identifies the results in the search cache of the database, NULL if they're not worth caching
+    char *cache_key;
+    uint32_t search_class;
+    // how long the search took in ms and whether it finished
+    double duration;
+    bool completed;
 } FsearchSearchContext;
 
 static void
@@ -61,6 +88,9 @@ db_view_search(FsearchDatabaseView *view, bool reset_selection);
 static void
 db_view_sort(FsearchDatabaseView *view, FsearchDatabaseIndexType sort_order, GtkSortType sort_type);
 
+static void
+db_view_update_selection_version(FsearchDatabaseView *view);
+
 // Implementation
 
 void
@@ -76,6 +106,7 @@ db_view_free(FsearchDatabaseView *view) {
     g_clear_pointer(&view->query_text, free);
     g_clear_pointer(&view->task_queue, fsearch_task_queue_free);
     g_clear_pointer(&view->query, fsearch_query_unref);
+    g_clear_pointer(&view->results_query, fsearch_query_unref);
     g_clear_pointer(&view->selection, fsearch_selection_free);
 
     db_view_unlock(view);
@@ -112,10 +143,11 @@ db_view_unregister_database(FsearchDatabaseView *view) {
 
     db_view_lock(view);
     if (view->selection) {
-        fsearch_selection_unselect_all(view->selection);
+        fsearch_selection_set_version(view->selection, NULL);
     }
     g_clear_pointer(&view->files, darray_unref);
     g_clear_pointer(&view->folders, darray_unref);
+    g_clear_pointer(&view->results_query, fsearch_query_unref);
     if (view->db) {
         db_unregister_view(view->db, view);
         g_clear_pointer(&view->db, db_unref);
@@ -125,66 +157,14 @@ db_view_unregister_database(FsearchDatabaseView *view) {
     db_view_unlock(view);
 }
 
-static int32_t
-cmp_entries_by_name_and_path(FsearchDatabaseEntry **a, FsearchDatabaseEntry **b, void *data) {
-    const int res = db_entry_compare_entries_by_name(a, b);
-    if (res == 0) {
-        return db_entry_compare_entries_by_path(a, b);
-    }
-    return res;
-}
-
-static void
-copy_selection(DynamicArray *old_entries, DynamicArray *new_entries, GHashTable *old_selection, GHashTable *new_selection) {
-    if (!fsearch_selection_get_num_selected(old_selection) || darray_get_num_items(old_entries) == 0
-        || darray_get_num_items(new_entries) == 0) {
-        goto out;
-    }
-
-    uint32_t num_selected = 0;
-    const uint32_t num_new_entries = darray_get_num_items(new_entries);
-
-    for (uint32_t i = 0; i < darray_get_num_items(old_entries); ++i) {
-        FsearchDatabaseEntry *entry = darray_get_item(old_entries, i);
-        if (fsearch_selection_is_selected(old_selection, entry)) {
-            uint32_t found_idx = 0;
-            // We have to perform a binary search to find the matching item in the new database.
-            // That's not a huge issue for small selections, but when millions of items have been selected
-            // in the old database, it can take quite a few seconds.
-            // We should consider running this in a non-blocking way for the main thread.
-            if (darray_binary_search_with_data(new_entries,
-                                               entry,
-                                               (DynamicArrayCompareDataFunc)cmp_entries_by_name_and_path,
-                                               NULL,
-                                               &found_idx)) {
-                FsearchDatabaseEntry *entry_to_be_selected = darray_get_item(new_entries, found_idx);
-                fsearch_selection_select(new_selection, entry_to_be_selected);
-                num_selected++;
-
-                if (num_selected >= num_new_entries) {
-                    // This should almost never happen, but we've selected every element in new_entries,
-                    // so we're done here. Even when there are still more selected items in old_entries.
-                    break;
-                }
-            }
-        }
-    }
-out:
-    g_clear_pointer(&old_entries, darray_unref);
-    g_clear_pointer(&new_entries, darray_unref);
-}
-
-static GHashTable *
-migrate_selection(FsearchDatabase *db_old, FsearchDatabase *db_new, GHashTable *old_selection) {
-    db_lock(db_old);
-    db_lock(db_new);
-
-    GHashTable *new_selection = fsearch_selection_new();
-    copy_selection(db_get_files(db_old), db_get_files(db_new), old_selection, new_selection);
-    copy_selection(db_get_folders(db_old), db_get_folders(db_new), old_selection, new_selection);
-
-    db_unlock(db_old);
-    db_unlock(db_new);
+static FsearchSelection *
+migrate_selection(FsearchDatabase *db_new, FsearchSelection *old_selection) {
+    // the selection only needs the arrays, so a search which still runs on the old database doesn't hold this up
+    FsearchDatabaseVersion *version_new = db_pin_version(db_new);
+    FsearchSelection *new_selection = fsearch_selection_new(version_new);
+    // folders are found through the ids they keep across rescans, files through their folder and name
+    fsearch_selection_select_same_entries(new_selection, old_selection);
+    g_clear_pointer(&version_new, db_version_unref);
 
     return new_selection;
 }
@@ -204,10 +184,10 @@ db_view_register_database(FsearchDatabaseView *view, FsearchDatabase *db) {
 
     g_autoptr(GTimer) timer = g_timer_new();
     g_timer_start(timer);
-    GHashTable *new_selection = NULL;
+    FsearchSelection *new_selection = NULL;
     if (view->db) {
         db_view_lock(view);
-        new_selection = migrate_selection(view->db, db, view->selection);
+        new_selection = migrate_selection(db, view->selection);
         db_view_unlock(view);
         g_debug("[db_view_register_database] old_selection_count: %d",
                 fsearch_selection_get_num_selected(view->selection));
@@ -227,8 +207,13 @@ db_view_register_database(FsearchDatabaseView *view, FsearchDatabase *db) {
         view->selection = new_selection;
     }
     view->pool = db_get_thread_pool(db);
-    view->files = db_get_files(db);
-    view->folders = db_get_folders(db);
+    FsearchDatabaseVersion *version = db_pin_version(db);
+    // entries which might be hidden aren't shown until the search has filtered them
+    view->files = db_get_filter_by_access(db) ? darray_new(0) : db_version_get_files(version);
+    view->folders = db_get_filter_by_access(db) ? darray_new(0) : db_version_get_folders(version);
+    // the database might have changed since the selection was migrated
+    fsearch_selection_set_version(view->selection, version);
+    g_clear_pointer(&version, db_version_unref);
 
     db_view_search(view, false);
     db_view_sort(view, view->sort_order, view->sort_type);
@@ -236,6 +221,21 @@ db_view_register_database(FsearchDatabaseView *view, FsearchDatabase *db) {
     db_view_unlock(view);
 }
 
+void
+db_view_notify_database_changed(FsearchDatabaseView *view) {
+    g_assert(view);
+
+    db_view_lock(view);
+    // the results might be missing entries which were added to the database
+    g_clear_pointer(&view->results_query, fsearch_query_unref);
+    if (view->db) {
+        db_view_update_selection_version(view);
+        db_view_search(view, false);
+        db_view_sort(view, view->sort_order, view->sort_type);
+    }
+    db_view_unlock(view);
+}
+
 FsearchDatabaseView *
 db_view_new(const char *query_text,
             FsearchQueryFlags flags,
@@ -250,7 +250,7 @@ db_view_new(const char *query_text,
 
     view->task_queue = fsearch_task_queue_new("fsearch_db_task_queue");
 
-    view->selection = fsearch_selection_new();
+    view->selection = fsearch_selection_new(NULL);
 
     view->query_text = strdup(query_text ? query_text : "");
     view->query_flags = flags;
@@ -279,6 +279,9 @@ search_context_free(FsearchSearchContext *ctx) {
     g_clear_pointer(&ctx->db, db_unref);
     g_clear_pointer(&ctx->view, db_view_unref);
     g_clear_pointer(&ctx->query, fsearch_query_unref);
+    g_clear_pointer(&ctx->folders, darray_unref);
+    g_clear_pointer(&ctx->files, darray_unref);
+    g_clear_pointer(&ctx->cache_key, g_free);
     g_clear_pointer(&ctx, free);
 }
 
@@ -292,12 +295,33 @@ db_view_search_task_cancelled(gpointer data) {
     g_clear_pointer(&ctx, search_context_free);
 }
 
+static uint32_t
+get_search_class(const char *query_text, bool is_refinement) {
+    const glong length = query_text ? g_utf8_strlen(query_text, -1) : 0;
+    return (is_refinement ? NUM_SEARCH_LENGTH_CLASSES : 0) + MIN(length, NUM_SEARCH_LENGTH_CLASSES - 1);
+}
+
+// Has to be called with the view lock held
+static void
+db_view_update_search_duration(FsearchDatabaseView *view, uint32_t search_class, double duration, bool completed) {
+    double *average = &view->search_durations[search_class];
+    if (completed) {
+        *average = *average > 0 ? 0.7 * *average + 0.3 * duration : duration;
+    }
+    else if (duration > *average) {
+        // an aborted search only tells that the class takes at least that long
+        *average = duration;
+    }
+}
+
 static void
 db_view_search_task_finished(gpointer result, gpointer data) {
     FsearchSearchContext *ctx = data;
 
     db_view_lock(ctx->view);
 
+    db_view_update_search_duration(ctx->view, ctx->search_class, ctx->duration, ctx->completed);
+
     g_clear_pointer(&ctx->view->query, fsearch_query_unref);
     ctx->view->query = fsearch_query_ref(ctx->query);
 
@@ -315,7 +339,22 @@ db_view_search_task_finished(gpointer result, gpointer data) {
             g_clear_pointer(&ctx->view->folders, darray_unref);
             ctx->view->folders = g_steal_pointer(&res->folders);
 
+            g_clear_pointer(&ctx->view->results_query, fsearch_query_unref);
+            // the next query can't refine what wasn't searched
+            ctx->view->results_query = res->duplicates_pending ? NULL : fsearch_query_ref(ctx->query);
+            ctx->view->duplicates_pending = res->duplicates_pending;
+
+            if (ctx->completed) {
+                ctx->view->times.search = ctx->duration;
+                ctx->view->times.num_searches++;
+                ctx->view->query_stats = res->stats;
+            }
+
             ctx->view->sort_order = res->sort_type;
+            if (res->sort_type != ctx->sort_order) {
+                // the database didn't have the entries in the requested order, so the results need to be sorted
+                db_view_sort(ctx->view, ctx->sort_order, ctx->view->sort_type);
+            }
         }
 
         g_clear_pointer(&res, free);
@@ -338,17 +377,39 @@ typedef struct {
     GtkSortType sort_type;
 } FsearchSortContext;
 
+// The share of the whole sort one of the arrays has, the folders are sorted first
+typedef struct {
+    FsearchDatabaseView *view;
+    uint32_t start_percent;
+    uint32_t num_percent;
+} FsearchSortProgress;
+
+static void
+on_sort_progress(uint32_t percent, FsearchSortProgress *progress) {
+    FsearchDatabaseView *view = progress->view;
+    g_atomic_int_set(&view->sort_progress, (int)(progress->start_percent + percent * progress->num_percent / 100));
+    if (view->notify_func) {
+        view->notify_func(view, DATABASE_VIEW_NOTIFY_SORT_PROGRESS, view->notify_func_data);
+    }
+}
+
 static void
 sort_array(DynamicArray *array,
            DynamicArrayCompareDataFunc sort_func,
            GCancellable *cancellable,
            bool parallel_sort,
+           FsearchSortProgress *progress,
            void *data) {
     if (!array) {
         return;
     }
     if (parallel_sort) {
-        darray_sort_multi_threaded(array, sort_func, cancellable, data);
+        darray_sort_multi_threaded_with_progress(array,
+                                                 sort_func,
+                                                 cancellable,
+                                                 data,
+                                                 (DynamicArrayProgressFunc)on_sort_progress,
+                                                 progress);
     }
     else {
         darray_sort(array, sort_func, cancellable, data);
@@ -404,6 +465,14 @@ get_entries_sorted_from_reference_list(DynamicArray *old_list, DynamicArray *sor
     return new;
 }
 
+static DynamicArray *
+get_entries_sorted_by_ranks(FsearchDatabase *db, DynamicArray *old_list, DynamicArray *sorted_reference_list) {
+    FsearchDatabaseRanks *ranks = db_get_ranks(db, sorted_reference_list);
+    DynamicArray *new = ranks ? db_ranks_sort(ranks, old_list) : NULL;
+    g_clear_pointer(&ranks, db_ranks_unref);
+    return new ? new : get_entries_sorted_from_reference_list(old_list, sorted_reference_list);
+}
+
 static bool
 sort_order_affects_folders(FsearchDatabaseIndexType sort_order) {
     if (sort_order == DATABASE_INDEX_TYPE_EXTENSION || sort_order == DATABASE_INDEX_TYPE_FILETYPE) {
@@ -426,24 +495,31 @@ db_view_sort_task(gpointer data, GCancellable *cancellable) {
     DynamicArray *files = NULL;
     DynamicArray *folders = NULL;
 
+    g_atomic_int_set(&view->sort_progress, 0);
     if (view->notify_func) {
         view->notify_func(view, DATABASE_VIEW_NOTIFY_SORT_STARTED, view->notify_func_data);
     }
+    FSEARCH_TRACE1(view_sort_start, ctx->sort_order);
 
     g_autoptr(GTimer) timer = g_timer_new();
     g_timer_start(timer);
 
+    bool db_locked = false;
     db_view_lock(view);
-    db_lock(view->db);
 
-    if (view->sort_order == ctx->sort_order) {
+    const bool reused_results = view->sort_order == ctx->sort_order;
+    if (reused_results) {
         // Sort order didn't change, use the old results
         files = darray_ref(view->files);
         folders = darray_ref(view->folders);
         goto out;
     }
 
-    if (db_has_entries_sorted_by_type(view->db, ctx->sort_order)) {
+    db_lock(view->db);
+    db_locked = true;
+
+    // the view keeps showing its current order until the database has loaded or sorted the requested one
+    if (db_ensure_entries_sorted(view->db, ctx->sort_order, cancellable)) {
         if (!view->query || fsearch_query_matches_everything(view->query)) {
             // We're matching everything, and we have the entries already sorted in our index.
             // So we can just return references to the sorted indices.
@@ -451,12 +527,12 @@ db_view_sort_task(gpointer data, GCancellable *cancellable) {
             folders = db_get_folders_sorted(view->db, ctx->sort_order);
         }
         else {
-            // Another fast path. First we mark all entries we have currently in the view, then we walk the sorted
-            // index in order and add all marked entries to a new array.
+            // Another fast path. The results are brought into the order of the sorted index by the rank of each entry
+            // in it, or (if they aren't all ranked) by walking the index in order.
             DynamicArray *sorted_folders = db_get_folders_sorted(view->db, ctx->sort_order);
             DynamicArray *sorted_files = db_get_files_sorted(view->db, ctx->sort_order);
-            folders = get_entries_sorted_from_reference_list(view->folders, sorted_folders);
-            files = get_entries_sorted_from_reference_list(view->files, sorted_files);
+            folders = get_entries_sorted_by_ranks(view->db, view->folders, sorted_folders);
+            files = get_entries_sorted_by_ranks(view->db, view->files, sorted_files);
             g_clear_pointer(&sorted_folders, darray_unref);
             g_clear_pointer(&sorted_files, darray_unref);
         }
@@ -466,13 +542,18 @@ db_view_sort_task(gpointer data, GCancellable *cancellable) {
         files = darray_copy(view->files);
         folders = darray_copy(view->folders);
     }
+    // the copies don't need the database, searches and changes can go on while they're sorted
+    FsearchDatabaseVersion *version = db_pin_version(view->db);
+    db_unlock(view->db);
+    db_locked = false;
 
     DynamicArrayCompareDataFunc func = get_sort_func(ctx->sort_order);
     bool parallel_sort = true;
 
     FsearchDatabaseEntryCompareContext *comp_ctx = NULL;
     if (ctx->sort_order == DATABASE_INDEX_TYPE_FILETYPE) {
-        // Sorting by type can be really slow, because it accesses the filesystem to determine the type of files
+        // Only used if the database couldn't build its type order. Sorting by type can be really slow, because it
+        // accesses the filesystem to determine the type of files.
         // To mitigate that issue to a certain degree we cache the filetype for each file
         // To avoid duplicating the filetype in memory for each file, we also store each filetype only once in
         // a separate hash table.
@@ -485,18 +566,45 @@ db_view_sort_task(gpointer data, GCancellable *cancellable) {
 
     g_debug("[sort] started: %d", ctx->sort_order);
 
+    const bool sort_folders = sort_order_affects_folders(ctx->sort_order);
+    const uint64_t num_folders = sort_folders ? darray_get_num_items(folders) : 0;
+    const uint64_t num_entries = MAX(num_folders + darray_get_num_items(files), 1);
+    FsearchSortProgress folders_progress = {
+        .view = view,
+        .start_percent = 0,
+        .num_percent = (uint32_t)(num_folders * 100 / num_entries),
+    };
+    FsearchSortProgress files_progress = {
+        .view = view,
+        .start_percent = folders_progress.num_percent,
+        .num_percent = 100 - folders_progress.num_percent,
+    };
+
     db_view_unlock(view);
-    if (sort_order_affects_folders(ctx->sort_order)) {
-        sort_array(folders, func, cancellable, parallel_sort, comp_ctx);
+    if (sort_folders) {
+        sort_array(folders, func, cancellable, parallel_sort, &folders_progress, comp_ctx);
     }
-    sort_array(files, func, cancellable, parallel_sort, comp_ctx);
+    sort_array(files, func, cancellable, parallel_sort, &files_progress, comp_ctx);
     db_view_lock(view);
 
     if (comp_ctx) {
         g_clear_pointer(&comp_ctx->entry_to_file_type_table, g_hash_table_unref);
         g_clear_pointer(&comp_ctx->file_type_table, g_hash_table_unref);
         g_clear_pointer(&comp_ctx, free);
+
+        if (!g_cancellable_is_cancelled(cancellable) && (!view->query || fsearch_query_matches_everything(view->query))) {
+            // The type lookups are too expensive to repeat, so the database keeps (and saves) the result, unless its
+            // entries changed in the meantime
+            db_lock(view->db);
+            FsearchDatabaseVersion *current = db_pin_version(view->db);
+            if (current->id == version->id) {
+                db_set_entries_sorted(view->db, ctx->sort_order, files);
+            }
+            g_clear_pointer(&current, db_version_unref);
+            db_unlock(view->db);
+        }
     }
+    g_clear_pointer(&version, db_version_unref);
 
 out:
     g_timer_stop(timer);
@@ -509,6 +617,11 @@ out:
         view->files = g_steal_pointer(&files);
         view->sort_order = ctx->sort_order;
         view->sort_type = ctx->sort_type;
+        view->times.sort = seconds * 1000;
+        if (!reused_results) {
+            view->query_stats.sort_time = seconds * 1000;
+        }
+        view->times.num_sorts++;
         g_debug("[sort] finished in %2.fms", seconds * 1000);
     }
     else {
@@ -516,9 +629,12 @@ out:
         g_clear_pointer(&files, darray_unref);
         g_debug("[sort] cancelled after %2.fms", seconds * 1000);
     }
-    db_unlock(view->db);
+    if (db_locked) {
+        db_unlock(view->db);
+    }
     db_view_unlock(view);
 
+    FSEARCH_TRACE2(view_sort_end, ctx->sort_order, g_cancellable_is_cancelled(cancellable));
     if (view->notify_func) {
         view->notify_func(view, DATABASE_VIEW_NOTIFY_SORT_FINISHED, view->notify_func_data);
     }
@@ -548,6 +664,7 @@ db_view_sort(FsearchDatabaseView *view, FsearchDatabaseIndexType sort_order, Gtk
 
     fsearch_task_queue(view->task_queue,
                        FSEARCH_TASK_ID_SORT,
+                       FSEARCH_TASK_PRIORITY_DEFAULT,
                        db_view_sort_task,
                        db_view_sort_task_finished,
                        db_view_sort_task_cancelled,
@@ -555,6 +672,48 @@ db_view_sort(FsearchDatabaseView *view, FsearchDatabaseIndexType sort_order, Gtk
                        g_steal_pointer(&ctx));
 }
 
+// Called by the search threads while the shared lock of the database is held. Views lock the database while they're
+// locked themselves, so this mustn't wait for the view lock, the search tries again later instead.
+static bool
+db_view_search_task_progress(DatabaseSearchResult *result, gpointer data) {
+    FsearchSearchContext *ctx = data;
+    FsearchDatabaseView *view = ctx->view;
+
+    if (!g_mutex_trylock(&view->mutex)) {
+        return false;
+    }
+    if (view->db == ctx->db) {
+        if (view->selection && ctx->reset_selection) {
+            fsearch_selection_unselect_all(view->selection);
+        }
+        g_clear_pointer(&view->query, fsearch_query_unref);
+        view->query = fsearch_query_ref(ctx->query);
+        // the results are incomplete until the search is done
+        g_clear_pointer(&view->results_query, fsearch_query_unref);
+
+        g_clear_pointer(&view->files, darray_unref);
+        view->files = g_steal_pointer(&result->files);
+
+        g_clear_pointer(&view->folders, darray_unref);
+        view->folders = g_steal_pointer(&result->folders);
+
+        view->sort_order = result->sort_type;
+    }
+    db_view_unlock(view);
+
+    g_clear_pointer(&result->files, darray_unref);
+    g_clear_pointer(&result->folders, darray_unref);
+    g_clear_pointer(&result, free);
+
+    if (view->notify_func) {
+        view->notify_func(view, DATABASE_VIEW_NOTIFY_CONTENT_CHANGED, view->notify_func_data);
+        if (ctx->reset_selection) {
+            view->notify_func(view, DATABASE_VIEW_NOTIFY_SELECTION_CHANGED, view->notify_func_data);
+        }
+    }
+    return true;
+}
+
 static gpointer
 db_view_search_task(gpointer data, GCancellable *cancellable) {
     FsearchSearchContext *ctx = data;
@@ -571,22 +730,61 @@ db_view_search_task(gpointer data, GCancellable *cancellable) {
     DynamicArray *files = NULL;
     DynamicArray *folders = NULL;
 
-    db_lock(ctx->db);
-    db_get_entries_sorted(ctx->db, ctx->sort_order, &sort_order, &folders, &files);
+    // searches only read the database, so the ones of other views don't have to wait for this one
+    db_lock_shared(ctx->db);
+    FsearchDatabaseSearchCache *search_cache = db_get_search_cache(ctx->db);
+    const bool is_refinement = ctx->folders && ctx->files;
+    // the cache only holds complete results
+    const bool is_cached = ctx->cache_key && !ctx->query->limit
+                        && db_search_cache_lookup(search_cache, ctx->cache_key, &folders, &files, &sort_order);
+    if (is_cached) {
+        g_debug("[%s] was searched recently, use the cached results", ctx->query->query_id);
+    }
+    else if (is_refinement) {
+        g_debug("[%s] refines the previous query, search its results", ctx->query->query_id);
+        folders = g_steal_pointer(&ctx->folders);
+        files = g_steal_pointer(&ctx->files);
+        sort_order = ctx->entries_sort_order;
+    }
+    else {
+        db_get_entries_sorted(ctx->db, ctx->sort_order, &sort_order, &folders, &files);
+    }
 
-    if (fsearch_query_matches_everything(ctx->query)) {
+    if (is_cached || (fsearch_query_matches_everything(ctx->query) && !ctx->query->limit)) {
         result = db_search_empty(folders, files, sort_order);
+        db_filter_result_by_access(ctx->db, result);
     }
     else {
-        result = db_search(ctx->query, ctx->view->pool, folders, files, sort_order, cancellable);
+        result = db_search_query(ctx->db,
+                                 ctx->query,
+                                 ctx->view->pool,
+                                 folders,
+                                 files,
+                                 sort_order,
+                                 is_refinement,
+                                 // partial results are only useful if they don't need to be sorted afterwards
+                                 sort_order == ctx->sort_order ? db_view_search_task_progress : NULL,
+                                 ctx,
+                                 cancellable);
+
+        if (result && !result->duplicates_pending && ctx->cache_key && !ctx->query->limit
+            && !g_cancellable_is_cancelled(cancellable)) {
+            db_search_cache_insert(search_cache, ctx->cache_key, result->folders, result->files, result->sort_type);
+        }
+    }
+    db_unlock_shared(ctx->db);
+
+    if (result) {
+        result->stats.parse_time = ctx->query->parse_time;
     }
-    db_unlock(ctx->db);
 
     g_clear_pointer(&files, darray_unref);
     g_clear_pointer(&folders, darray_unref);
 
     const char *debug_message = NULL;
     const double seconds = g_timer_elapsed(timer, NULL);
+    ctx->duration = seconds * 1000;
+    ctx->completed = !g_cancellable_is_cancelled(cancellable);
     if (!g_cancellable_is_cancelled(cancellable)) {
         debug_message = "[%s] finished in %.2f ms";
     }
@@ -619,8 +817,21 @@ db_view_search(FsearchDatabaseView *view, bool reset_selection) {
     ctx->query = fsearch_query_new(view->query_text, view->filter, view->filters, view->query_flags, query_id->str);
     g_assert(ctx->query);
 
+    if (!fsearch_query_matches_everything(ctx->query)) {
+        ctx->cache_key =
+            db_search_cache_key_new(view->query_text, view->filter, view->filters, view->query_flags, view->sort_order);
+    }
+
+    if (view->folders && view->files && fsearch_query_is_refinement_of(ctx->query, view->results_query)) {
+        ctx->folders = darray_ref(view->folders);
+        ctx->files = darray_ref(view->files);
+        ctx->entries_sort_order = view->sort_order;
+    }
+    ctx->search_class = get_search_class(view->query_text, ctx->folders && ctx->files);
+
     fsearch_task_queue(view->task_queue,
                        FSEARCH_TASK_ID_SEARCH,
+                       FSEARCH_TASK_PRIORITY_INTERACTIVE,
                        db_view_search_task,
                        db_view_search_task_finished,
                        db_view_search_task_cancelled,
@@ -637,6 +848,8 @@ db_view_set_filters(FsearchDatabaseView *view, FsearchFilterManager *filters) {
 
     g_clear_pointer(&view->filters, fsearch_filter_manager_free);
     view->filters = fsearch_filter_manager_copy(filters);
+    // the macros might have changed
+    g_clear_pointer(&view->results_query, fsearch_query_unref);
 
     db_view_search(view, true);
 
@@ -652,6 +865,8 @@ db_view_set_filter(FsearchDatabaseView *view, FsearchFilter *filter) {
 
     g_clear_pointer(&view->filter, fsearch_filter_unref);
     view->filter = fsearch_filter_ref(filter);
+    // it might have been edited
+    g_clear_pointer(&view->results_query, fsearch_query_unref);
 
     db_view_search(view, true);
 
@@ -704,6 +919,24 @@ db_view_set_query_text(FsearchDatabaseView *view, const char *query_text) {
     db_view_unlock(view);
 }
 
+double
+db_view_get_expected_search_duration(FsearchDatabaseView *view, const char *query_text) {
+    if (!view) {
+        return 0;
+    }
+    db_view_lock(view);
+    bool is_refinement = false;
+    if (view->folders && view->files && view->results_query) {
+        FsearchQuery *query =
+            fsearch_query_new(query_text, view->filter, view->filters, view->query_flags, "query:estimate");
+        is_refinement = fsearch_query_is_refinement_of(query, view->results_query);
+        g_clear_pointer(&query, fsearch_query_unref);
+    }
+    const double duration = view->search_durations[get_search_class(query_text, is_refinement)];
+    db_view_unlock(view);
+    return duration;
+}
+
 void
 db_view_set_sort_order(FsearchDatabaseView *view, FsearchDatabaseIndexType sort_order, GtkSortType sort_type) {
     if (!view) {
@@ -734,6 +967,39 @@ db_view_get_num_entries(FsearchDatabaseView *view) {
     return db_view_get_num_folders(view) + db_view_get_num_files(view);
 }
 
+void
+db_view_get_memory_stats(FsearchDatabaseView *view, FsearchDatabaseMemoryStats *stats) {
+    g_assert(view);
+    g_assert(stats);
+
+    stats->num_views++;
+    stats->results += db_memory_stats_count_array(stats, view->folders);
+    stats->results += db_memory_stats_count_array(stats, view->files);
+    stats->selections += fsearch_selection_get_memory_size(view->selection);
+
+    if (view->pool) {
+        // every search thread has its own match data
+        FsearchQueryMatchData *match_data = fsearch_query_match_data_new();
+        stats->match_data +=
+            fsearch_thread_pool_get_num_threads(view->pool) * fsearch_query_match_data_get_memory_size(match_data);
+        g_clear_pointer(&match_data, fsearch_query_match_data_free);
+    }
+}
+
+void
+db_view_get_times(FsearchDatabaseView *view, FsearchDatabaseViewTimes *times) {
+    g_assert(view);
+    g_assert(times);
+    *times = view->times;
+}
+
+void
+db_view_get_query_stats(FsearchDatabaseView *view, FsearchQueryStats *stats) {
+    g_assert(view);
+    g_assert(stats);
+    *stats = view->query_stats;
+}
+
 GtkSortType
 db_view_get_sort_type(FsearchDatabaseView *view) {
     g_assert(view);
@@ -746,6 +1012,24 @@ db_view_get_sort_order(FsearchDatabaseView *view) {
     return view->sort_order;
 }
 
+FsearchDatabaseIndexFlags
+db_view_get_index_flags(FsearchDatabaseView *view) {
+    g_assert(view);
+    return view->db ? db_get_index_flags(view->db) : 0;
+}
+
+bool
+db_view_get_duplicates_pending(FsearchDatabaseView *view) {
+    g_assert(view);
+    return view->duplicates_pending;
+}
+
+uint32_t
+db_view_get_sort_progress(FsearchDatabaseView *view) {
+    g_assert(view);
+    return (uint32_t)g_atomic_int_get(&view->sort_progress);
+}
+
 static FsearchDatabaseEntry *
 db_view_get_entry_for_idx(FsearchDatabaseView *view, uint32_t idx) {
     const uint32_t num_folders = darray_get_num_items(view->folders);
@@ -857,6 +1141,36 @@ db_view_entry_get_type_for_idx(FsearchDatabaseView *view, uint32_t idx) {
     return entry ? db_entry_get_type(entry) : DATABASE_ENTRY_TYPE_NONE;
 }
 
+// The results can be arrays of a newer version than the one of the selection, e.g. after a sort, which would have to be
+// selected entry by entry
+static void
+db_view_update_selection_version(FsearchDatabaseView *view) {
+    if (!view->db) {
+        return;
+    }
+    FsearchDatabaseVersion *version = db_pin_version(view->db);
+    fsearch_selection_set_version(view->selection, version);
+    g_clear_pointer(&version, db_version_unref);
+}
+
+typedef void (*FsearchSelectionRangeFunc)(FsearchSelection *, DynamicArray *, uint32_t, uint32_t);
+
+// The folders come before the files, so the range is split into one for each of them
+static void
+apply_to_range(FsearchDatabaseView *view, uint32_t start_idx, uint32_t end_idx, FsearchSelectionRangeFunc func) {
+    if (start_idx > end_idx) {
+        return;
+    }
+    db_view_update_selection_version(view);
+    const uint32_t num_folders = view->folders ? darray_get_num_items(view->folders) : 0;
+    if (start_idx < num_folders) {
+        func(view->selection, view->folders, start_idx, MIN(end_idx, num_folders - 1));
+    }
+    if (end_idx >= num_folders && view->files) {
+        func(view->selection, view->files, MAX(start_idx, num_folders) - num_folders, end_idx - num_folders);
+    }
+}
+
 static void
 notify_selection_changed(FsearchDatabaseView *view) {
     if (view->notify_func) {
@@ -907,12 +1221,7 @@ void
 db_view_toggle_range(FsearchDatabaseView *view, uint32_t start_idx, uint32_t end_idx) {
     g_assert(view);
     db_view_lock(view);
-    for (uint32_t i = start_idx; i <= end_idx; i++) {
-        FsearchDatabaseEntry *entry = db_view_get_entry_for_idx(view, i);
-        if (entry) {
-            fsearch_selection_select_toggle(view->selection, entry);
-        }
-    }
+    apply_to_range(view, start_idx, end_idx, fsearch_selection_toggle_range);
     db_view_unlock(view);
 
     notify_selection_changed(view);
@@ -922,12 +1231,7 @@ void
 db_view_select_range(FsearchDatabaseView *view, uint32_t start_idx, uint32_t end_idx) {
     g_assert(view);
     db_view_lock(view);
-    for (uint32_t i = start_idx; i <= end_idx; i++) {
-        FsearchDatabaseEntry *entry = db_view_get_entry_for_idx(view, i);
-        if (entry) {
-            fsearch_selection_select(view->selection, entry);
-        }
-    }
+    apply_to_range(view, start_idx, end_idx, fsearch_selection_select_range);
     db_view_unlock(view);
 
     notify_selection_changed(view);
@@ -937,6 +1241,7 @@ void
 db_view_select_all(FsearchDatabaseView *view) {
     g_assert(view);
     db_view_lock(view);
+    db_view_update_selection_version(view);
     fsearch_selection_select_all(view->selection, view->folders);
     fsearch_selection_select_all(view->selection, view->files);
     db_view_unlock(view);
@@ -958,6 +1263,7 @@ void
 db_view_invert_selection(FsearchDatabaseView *view) {
     g_assert(view);
     db_view_lock(view);
+    db_view_update_selection_version(view);
     fsearch_selection_invert(view->selection, view->folders);
     fsearch_selection_invert(view->selection, view->files);
     db_view_unlock(view);
@@ -978,8 +1284,25 @@ void
 db_view_selection_for_each(FsearchDatabaseView *view, GHFunc func, gpointer user_data) {
     g_assert(view);
     db_view_lock(view);
-    g_hash_table_foreach(view->selection, func, user_data);
+    fsearch_selection_for_each(view->selection, func, user_data);
+    db_view_unlock(view);
+}
+
+static void
+add_selected_entry(gpointer key, gpointer value, gpointer user_data) {
+    darray_add_item(user_data, value);
+}
+
+DynamicArray *
+db_view_get_selected_entries(FsearchDatabaseView *view, FsearchDatabase **db) {
+    g_assert(view);
+    g_assert(db);
+    db_view_lock(view);
+    DynamicArray *entries = darray_new(MAX(fsearch_selection_get_num_selected(view->selection), 1));
+    fsearch_selection_for_each(view->selection, add_selected_entry, entries);
+    *db = db_ref(view->db);
     db_view_unlock(view);
+    return entries;
 }
 
 void
@@ -5,6 +5,7 @@
 #include "fsearch_filter_manager.h"
 #include "fsearch_query.h"
 #include "fsearch_query_flags.h"
+#include "fsearch_query_stats.h"
 
 typedef enum {
     DATABASE_VIEW_NOTIFY_CONTENT_CHANGED,
@@ -12,11 +13,22 @@ typedef enum {
     DATABASE_VIEW_NOTIFY_SEARCH_STARTED,
     DATABASE_VIEW_NOTIFY_SEARCH_FINISHED,
     DATABASE_VIEW_NOTIFY_SORT_STARTED,
+    // a long sort got further, see db_view_get_sort_progress
+    DATABASE_VIEW_NOTIFY_SORT_PROGRESS,
     DATABASE_VIEW_NOTIFY_SORT_FINISHED,
 } FsearchDatabaseViewNotify;
 
 typedef struct FsearchDatabaseView FsearchDatabaseView;
 
+// How long the last finished search and sort took in ms. The counters grow with every finished search and sort, so
+// the times of new ones can be told apart from the ones which were already seen.
+typedef struct {
+    double search;
+    double sort;
+    uint32_t num_searches;
+    uint32_t num_sorts;
+} FsearchDatabaseViewTimes;
+
 typedef void (*FsearchDatabaseViewNotifyFunc)(FsearchDatabaseView *view, FsearchDatabaseViewNotify id, gpointer user_data);
 
 void
@@ -53,6 +65,11 @@ db_view_set_query_flags(FsearchDatabaseView *view, FsearchQueryFlags query_flags
 void
 db_view_set_query_text(FsearchDatabaseView *view, const char *query_text);
 
+// How long a search for query_text is expected to take in ms, judging by the recent searches of the same kind. 0 if
+// none of them finished yet.
+double
+db_view_get_expected_search_duration(FsearchDatabaseView *view, const char *query_text);
+
 void
 db_view_set_sort_order(FsearchDatabaseView *view, FsearchDatabaseIndexType sort_order, GtkSortType sort_type);
 
@@ -66,12 +83,38 @@ db_view_get_num_files(FsearchDatabaseView *view);
 uint32_t
 db_view_get_num_entries(FsearchDatabaseView *view);
 
+// Adds the memory used by the results and the selection to stats, and the match data the search threads use while
+// they're searching
+void
+db_view_get_memory_stats(FsearchDatabaseView *view, FsearchDatabaseMemoryStats *stats);
+
+void
+db_view_get_times(FsearchDatabaseView *view, FsearchDatabaseViewTimes *times);
+
+// The breakdown of the last search which finished, it's up to date when DATABASE_VIEW_NOTIFY_SEARCH_FINISHED is sent.
+// The sort time gets added once the results are sorted, i.e. with DATABASE_VIEW_NOTIFY_SORT_FINISHED.
+void
+db_view_get_query_stats(FsearchDatabaseView *view, FsearchQueryStats *stats);
+
 GtkSortType
 db_view_get_sort_type(FsearchDatabaseView *view);
 
 FsearchDatabaseIndexType
 db_view_get_sort_order(FsearchDatabaseView *view);
 
+// What the database of the view indexes, 0 if it doesn't have one. The view has to be locked.
+FsearchDatabaseIndexFlags
+db_view_get_index_flags(FsearchDatabaseView *view);
+
+// Whether the query filters by dupe: and the view has no results yet, because the duplicates are still being looked
+// for. It searches again once the database notifies it that they're found. The view has to be locked.
+bool
+db_view_get_duplicates_pending(FsearchDatabaseView *view);
+
+// The percentage of the running sort which is done, it can be read without locking the view
+uint32_t
+db_view_get_sort_progress(FsearchDatabaseView *view);
+
 GString *
 db_view_entry_get_path_for_idx(FsearchDatabaseView *view, uint32_t idx);
 
@@ -111,6 +154,10 @@ db_view_register_database(FsearchDatabaseView *view, FsearchDatabase *db);
 void
 db_view_unregister_database(FsearchDatabaseView *view);
 
+// Updates the results after the registered database was modified in place
+void
+db_view_notify_database_changed(FsearchDatabaseView *view);
+
 FsearchQueryFlags
 db_view_get_query_flags(FsearchDatabaseView *view);
 
@@ -148,6 +195,11 @@ db_view_get_num_selected(FsearchDatabaseView *view);
 void
 db_view_selection_for_each(FsearchDatabaseView *view, GHFunc func, gpointer user_data);
 
+// The selected entries in the order of db_view_selection_for_each. db is set to a new reference to the database they
+// belong to (NULL if there's none), which keeps them alive.
+DynamicArray *
+db_view_get_selected_entries(FsearchDatabaseView *view, FsearchDatabase **db);
+
 void
 db_view_unlock(FsearchDatabaseView *view);
 
@@ -0,0 +1,384 @@
+#define G_LOG_DOMAIN "fsearch-dbus-search"
+
+#include "fsearch_dbus_search.h"
+#include "fsearch_config.h"
+#include "fsearch_database_entry.h"
+#include "fsearch_database_view.h"
+#include "fsearch_limits.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define FSEARCH_DBUS_SEARCH_INTERFACE "io.github.cboxdoerfer.FSearch.Search"
+// A client which starts more searches than that loses the oldest ones
+#define MAX_HANDLES_PER_CLIENT 16
+// The most results a single GetResults call returns
+#define MAX_RESULTS_PER_PAGE 10000
+
+static const char introspection_xml[] = "<node>"
+                                        "  <interface name='" FSEARCH_DBUS_SEARCH_INTERFACE "'>"
+                                        "    <method name='Search'>"
+                                        "      <arg type='s' name='query' direction='in'/>"
+                                        "      <arg type='a{sv}' name='options' direction='in'/>"
+                                        "      <arg type='u' name='handle' direction='out'/>"
+                                        "    </method>"
+                                        "    <method name='GetStatus'>"
+                                        "      <arg type='u' name='handle' direction='in'/>"
+                                        "      <arg type='b' name='finished' direction='out'/>"
+                                        "      <arg type='u' name='num_results' direction='out'/>"
+                                        "    </method>"
+                                        "    <method name='GetResults'>"
+                                        "      <arg type='u' name='handle' direction='in'/>"
+                                        "      <arg type='u' name='offset' direction='in'/>"
+                                        "      <arg type='u' name='count' direction='in'/>"
+                                        "      <arg type='a(sbtx)' name='results' direction='out'/>"
+                                        "    </method>"
+                                        "    <method name='Close'>"
+                                        "      <arg type='u' name='handle' direction='in'/>"
+                                        "    </method>"
+                                        "    <signal name='SearchFinished'>"
+                                        "      <arg type='u' name='handle'/>"
+                                        "      <arg type='u' name='num_results'/>"
+                                        "    </signal>"
+                                        "  </interface>"
+                                        "</node>";
+
+struct FsearchDbusSearch {
+    FsearchApplication *app;
+    GDBusConnection *connection;
+    char *object_path;
+    guint registration_id;
+    // FsearchDbusSearchHandle by id, in the order they were started
+    GHashTable *handles;
+    GQueue handle_order;
+    uint32_t next_handle_id;
+};
+
+typedef struct {
+    FsearchDbusSearch *search;
+    uint32_t id;
+    char *sender;
+    FsearchDatabaseView *view;
+    volatile int finished;
+} FsearchDbusSearchHandle;
+
+static void
+handle_free(FsearchDbusSearchHandle *handle) {
+    // waits for the view's tasks, so the notifications are over afterwards
+    g_clear_pointer(&handle->view, db_view_unref);
+    g_clear_pointer(&handle->sender, g_free);
+    g_clear_pointer(&handle, free);
+}
+
+static void
+handle_close(FsearchDbusSearch *search, FsearchDbusSearchHandle *handle) {
+    g_queue_remove(&search->handle_order, handle);
+    g_hash_table_remove(search->handles, GUINT_TO_POINTER(handle->id));
+}
+
+// Makes room for another search of sender
+static void
+close_oldest_client_handles(FsearchDbusSearch *search, const char *sender) {
+    uint32_t num_client_handles = 0;
+    for (GList *h = search->handle_order.head; h; h = h->next) {
+        FsearchDbusSearchHandle *handle = h->data;
+        num_client_handles += g_strcmp0(handle->sender, sender) == 0;
+    }
+    GList *h = search->handle_order.head;
+    while (h && num_client_handles >= MAX_HANDLES_PER_CLIENT) {
+        FsearchDbusSearchHandle *handle = h->data;
+        h = h->next;
+        if (!g_strcmp0(handle->sender, sender)) {
+            g_debug("close search %u of %s, it started too many", handle->id, sender);
+            handle_close(search, handle);
+            num_client_handles--;
+        }
+    }
+}
+
+static void
+on_view_notify(FsearchDatabaseView *view, FsearchDatabaseViewNotify id, gpointer user_data) {
+    FsearchDbusSearchHandle *handle = user_data;
+    // the results are sorted after every search, they're complete once that's done
+    if (id != DATABASE_VIEW_NOTIFY_SORT_FINISHED || g_atomic_int_get(&handle->finished)) {
+        return;
+    }
+    db_view_lock(view);
+    const uint32_t num_results = db_view_get_num_entries(view);
+    db_view_unlock(view);
+    g_atomic_int_set(&handle->finished, 1);
+
+    // emitting signals is thread safe
+    g_dbus_connection_emit_signal(handle->search->connection,
+                                  handle->sender,
+                                  handle->search->object_path,
+                                  FSEARCH_DBUS_SEARCH_INTERFACE,
+                                  "SearchFinished",
+                                  g_variant_new("(uu)", handle->id, num_results),
+                                  NULL);
+}
+
+static FsearchQueryFlags
+get_query_flags(FsearchConfig *config, GVariant *options) {
+    FsearchQueryFlags flags = 0;
+    gboolean match_case = config->match_case;
+    gboolean regex = config->enable_regex;
+    gboolean search_in_path = config->search_in_path;
+    g_variant_lookup(options, "match_case", "b", &match_case);
+    g_variant_lookup(options, "regex", "b", &regex);
+    g_variant_lookup(options, "search_in_path", "b", &search_in_path);
+    if (match_case) {
+        flags |= QUERY_FLAG_MATCH_CASE;
+    }
+    else if (config->auto_match_case) {
+        flags |= QUERY_FLAG_AUTO_MATCH_CASE;
+    }
+    if (regex) {
+        flags |= QUERY_FLAG_REGEX;
+    }
+    if (search_in_path) {
+        flags |= QUERY_FLAG_SEARCH_IN_PATH;
+    }
+    else if (config->auto_search_in_path) {
+        flags |= QUERY_FLAG_AUTO_SEARCH_IN_PATH;
+    }
+    return flags;
+}
+
+static void
+dbus_search_start(FsearchDbusSearch *search,
+                  const char *sender,
+                  GVariant *parameters,
+                  GDBusMethodInvocation *invocation) {
+    const char *query_text = NULL;
+    g_autoptr(GVariant) options = NULL;
+    g_variant_get(parameters, "(&s@a{sv})", &query_text, &options);
+
+    FsearchDatabaseIndexType sort_order = DATABASE_INDEX_TYPE_NAME;
+    const char *sort_name = NULL;
+    if (g_variant_lookup(options, "sort", "&s", &sort_name) && !db_index_type_from_short_name(sort_name, &sort_order)) {
+        g_dbus_method_invocation_return_error(invocation,
+                                              G_DBUS_ERROR,
+                                              G_DBUS_ERROR_INVALID_ARGS,
+                                              "Unknown sort order: %s",
+                                              sort_name);
+        return;
+    }
+    gboolean descending = FALSE;
+    g_variant_lookup(options, "descending", "b", &descending);
+
+    FsearchDatabase *db = fsearch_application_get_db(search->app);
+    if (!db) {
+        g_dbus_method_invocation_return_error(invocation,
+                                              G_DBUS_ERROR,
+                                              G_DBUS_ERROR_FAILED,
+                                              "The database isn't loaded yet");
+        return;
+    }
+
+    FsearchDbusSearchHandle *handle = calloc(1, sizeof(FsearchDbusSearchHandle));
+    g_assert(handle);
+    handle->search = search;
+    handle->id = ++search->next_handle_id;
+    handle->sender = g_strdup(sender);
+
+    FsearchConfig *config = fsearch_application_get_config(search->app);
+    handle->view = db_view_new(query_text,
+                               get_query_flags(config, options),
+                               NULL,
+                               config->filters,
+                               sort_order,
+                               descending ? GTK_SORT_DESCENDING : GTK_SORT_ASCENDING,
+                               on_view_notify,
+                               handle);
+
+    close_oldest_client_handles(search, sender);
+    g_hash_table_insert(search->handles, GUINT_TO_POINTER(handle->id), handle);
+    g_queue_push_tail(&search->handle_order, handle);
+
+    db_view_register_database(handle->view, db);
+    g_clear_pointer(&db, db_unref);
+
+    g_dbus_method_invocation_return_value(invocation, g_variant_new("(u)", handle->id));
+}
+
+static FsearchDbusSearchHandle *
+dbus_search_lookup(FsearchDbusSearch *search, const char *sender, uint32_t id, GDBusMethodInvocation *invocation) {
+    FsearchDbusSearchHandle *handle = g_hash_table_lookup(search->handles, GUINT_TO_POINTER(id));
+    if (!handle || g_strcmp0(handle->sender, sender) != 0) {
+        g_dbus_method_invocation_return_error(invocation,
+                                              G_DBUS_ERROR,
+                                              G_DBUS_ERROR_INVALID_ARGS,
+                                              "Unknown search handle: %u",
+                                              id);
+        return NULL;
+    }
+    return handle;
+}
+
+static void
+dbus_search_get_status(FsearchDbusSearch *search,
+                       const char *sender,
+                       GVariant *parameters,
+                       GDBusMethodInvocation *invocation) {
+    uint32_t id = 0;
+    g_variant_get(parameters, "(u)", &id);
+    FsearchDbusSearchHandle *handle = dbus_search_lookup(search, sender, id, invocation);
+    if (!handle) {
+        return;
+    }
+    const bool finished = g_atomic_int_get(&handle->finished);
+    db_view_lock(handle->view);
+    const uint32_t num_results = finished ? db_view_get_num_entries(handle->view) : 0;
+    db_view_unlock(handle->view);
+    g_dbus_method_invocation_return_value(invocation, g_variant_new("(bu)", finished, num_results));
+}
+
+static void
+dbus_search_get_results(FsearchDbusSearch *search,
+                        const char *sender,
+                        GVariant *parameters,
+                        GDBusMethodInvocation *invocation) {
+    uint32_t id = 0;
+    uint32_t offset = 0;
+    uint32_t count = 0;
+    g_variant_get(parameters, "(uuu)", &id, &offset, &count);
+    FsearchDbusSearchHandle *handle = dbus_search_lookup(search, sender, id, invocation);
+    if (!handle) {
+        return;
+    }
+    if (!g_atomic_int_get(&handle->finished)) {
+        g_dbus_method_invocation_return_error(invocation,
+                                              G_DBUS_ERROR,
+                                              G_DBUS_ERROR_FAILED,
+                                              "The search %u isn't finished yet",
+                                              id);
+        return;
+    }
+
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a(sbtx)"));
+    g_autoptr(GString) path = g_string_sized_new(PATH_MAX);
+
+    db_view_lock(handle->view);
+    const uint32_t num_results = db_view_get_num_entries(handle->view);
+    uint32_t end = 0;
+    if (offset < num_results) {
+        end = offset + MIN(MIN(count, MAX_RESULTS_PER_PAGE), num_results - offset);
+    }
+    for (uint32_t i = offset; i < end; i++) {
+        FsearchDatabaseEntry *entry = db_view_entry_get_for_idx(handle->view, i);
+        if (!entry) {
+            break;
+        }
+        g_string_truncate(path, 0);
+        db_entry_append_full_path(entry, path);
+        g_variant_builder_add(&builder,
+                              "(sbtx)",
+                              path->str,
+                              db_entry_is_folder(entry),
+                              (guint64)db_entry_get_size(entry),
+                              (gint64)db_entry_get_mtime(entry));
+    }
+    db_view_unlock(handle->view);
+
+    g_dbus_method_invocation_return_value(invocation, g_variant_new("(a(sbtx))", &builder));
+}
+
+static void
+dbus_search_close(FsearchDbusSearch *search,
+                  const char *sender,
+                  GVariant *parameters,
+                  GDBusMethodInvocation *invocation) {
+    uint32_t id = 0;
+    g_variant_get(parameters, "(u)", &id);
+    FsearchDbusSearchHandle *handle = dbus_search_lookup(search, sender, id, invocation);
+    if (!handle) {
+        return;
+    }
+    handle_close(search, handle);
+    g_dbus_method_invocation_return_value(invocation, NULL);
+}
+
+static void
+on_method_call(GDBusConnection *connection,
+               const gchar *sender,
+               const gchar *object_path,
+               const gchar *interface_name,
+               const gchar *method_name,
+               GVariant *parameters,
+               GDBusMethodInvocation *invocation,
+               gpointer user_data) {
+    FsearchDbusSearch *search = user_data;
+    if (!strcmp(method_name, "Search")) {
+        dbus_search_start(search, sender, parameters, invocation);
+    }
+    else if (!strcmp(method_name, "GetStatus")) {
+        dbus_search_get_status(search, sender, parameters, invocation);
+    }
+    else if (!strcmp(method_name, "GetResults")) {
+        dbus_search_get_results(search, sender, parameters, invocation);
+    }
+    else if (!strcmp(method_name, "Close")) {
+        dbus_search_close(search, sender, parameters, invocation);
+    }
+    else {
+        g_dbus_method_invocation_return_error(invocation,
+                                              G_DBUS_ERROR,
+                                              G_DBUS_ERROR_UNKNOWN_METHOD,
+                                              "Unknown method: %s",
+                                              method_name);
+    }
+}
+
+static const GDBusInterfaceVTable interface_vtable = {
+    .method_call = on_method_call,
+};
+
+FsearchDbusSearch *
+fsearch_dbus_search_new(FsearchApplication *app, GDBusConnection *connection, const char *object_path) {
+    g_assert(app);
+    g_assert(connection);
+    g_assert(object_path);
+
+    g_autoptr(GError) error = NULL;
+    g_autoptr(GDBusNodeInfo) node_info = g_dbus_node_info_new_for_xml(introspection_xml, &error);
+    g_assert(node_info);
+
+    FsearchDbusSearch *search = calloc(1, sizeof(FsearchDbusSearch));
+    g_assert(search);
+    search->app = app;
+    search->connection = g_object_ref(connection);
+    search->object_path = g_strdup(object_path);
+    search->handles = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)handle_free);
+    g_queue_init(&search->handle_order);
+
+    search->registration_id = g_dbus_connection_register_object(connection,
+                                                                object_path,
+                                                                node_info->interfaces[0],
+                                                                &interface_vtable,
+                                                                search,
+                                                                NULL,
+                                                                &error);
+    if (!search->registration_id) {
+        g_debug("failed to export the search interface: %s", error->message);
+        g_clear_pointer(&search, fsearch_dbus_search_free);
+        return NULL;
+    }
+    return search;
+}
+
+void
+fsearch_dbus_search_free(FsearchDbusSearch *search) {
+    if (!search) {
+        return;
+    }
+    if (search->registration_id) {
+        g_dbus_connection_unregister_object(search->connection, search->registration_id);
+    }
+    g_queue_clear(&search->handle_order);
+    g_clear_pointer(&search->handles, g_hash_table_unref);
+    g_clear_pointer(&search->object_path, g_free);
+    g_clear_object(&search->connection);
+    g_clear_pointer(&search, free);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "fsearch.h"
+
+#include <gio/gio.h>
+
+// Exports the io.github.cboxdoerfer.FSearch.Search interface, which lets other programs (e.g. launchers or file
+// pickers) search the database of the running application:
+//
+//   Search(s query, a{sv} options) -> u handle
+//     options: match_case, regex, search_in_path (b), sort (s, see db_index_type_from_short_name), descending (b)
+//   GetStatus(u handle) -> (b finished, u num_results)
+//   GetResults(u handle, u offset, u count) -> a(sbtx) results: path, is_folder, size, modification time
+//   Close(u handle)
+//   signal SearchFinished(u handle, u num_results)
+//
+// Searches run in database views of their own, like the ones of the windows. Results can be fetched once
+// SearchFinished was emitted for their handle. Handles only work for the client which started the search, and
+// the oldest ones of a client get closed once it has too many of them.
+typedef struct FsearchDbusSearch FsearchDbusSearch;
+
+FsearchDbusSearch *
+fsearch_dbus_search_new(FsearchApplication *app, GDBusConnection *connection, const char *object_path);
+
+void
+fsearch_dbus_search_free(FsearchDbusSearch *search);
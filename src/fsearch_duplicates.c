@@ -0,0 +1,538 @@
+#define G_LOG_DOMAIN "fsearch-duplicates"
+
+#include "fsearch_duplicates.h"
+
+#include "fsearch_thread_pool.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define DUPLICATES_HASH_TYPE G_CHECKSUM_SHA256
+#define DUPLICATES_HASH_LEN 32
+// files are hashed completely with reads of that size
+#define DUPLICATES_READ_SIZE (256 * 1024)
+// the threads take that many files at once
+#define DUPLICATES_BATCH_SIZE 8
+
+struct FsearchDuplicates {
+    // the files of all groups, one group after another
+    FsearchDatabaseEntry **files;
+    uint32_t num_files;
+    // the files of group are files[group_offsets[group]..group_offsets[group + 1]]
+    uint32_t *group_offsets;
+    uint32_t num_groups;
+    // entry -> group + 1
+    GHashTable *groups;
+    FsearchDuplicatesStats stats;
+
+    volatile int ref_count;
+};
+
+typedef struct {
+    // only used as the key of the file in the groups
+    FsearchDatabaseEntry *entry;
+    char *path;
+    uint64_t size;
+    // the position in the files, it keeps the groups in that order
+    uint32_t pos;
+    // the file could be read and still has its indexed size
+    bool valid;
+    bool has_full_hash;
+    uint8_t block_hash[DUPLICATES_HASH_LEN];
+    uint8_t full_hash[DUPLICATES_HASH_LEN];
+} DuplicatesCandidate;
+
+struct FsearchDuplicatesSnapshot {
+    DuplicatesCandidate *candidates;
+    uint32_t num_candidates;
+};
+
+typedef struct {
+    DuplicatesCandidate *candidates;
+    // the positions of the candidates which have to be hashed completely
+    uint32_t *positions;
+    GCancellable *cancellable;
+    volatile gint num_block_hashes;
+    volatile gint num_full_hashes;
+    volatile gint num_cache_hits;
+} DuplicatesContext;
+
+typedef struct {
+    int64_t mtime;
+    int64_t mtime_nsec;
+    int64_t size;
+    bool has_full_hash;
+    uint8_t block_hash[DUPLICATES_HASH_LEN];
+    uint8_t full_hash[DUPLICATES_HASH_LEN];
+} DuplicatesCacheEntry;
+
+static GMutex cache_mutex;
+// path -> DuplicatesCacheEntry
+static GHashTable *cache = NULL;
+
+// Copies the cached hashes of the file at path into candidate, returns false if there aren't any for its current
+// size and modification time
+static bool
+cache_lookup(DuplicatesCandidate *candidate, const struct stat *st) {
+    bool found = false;
+    g_mutex_lock(&cache_mutex);
+    DuplicatesCacheEntry *entry = cache ? g_hash_table_lookup(cache, candidate->path) : NULL;
+    if (entry && entry->mtime == st->st_mtim.tv_sec && entry->mtime_nsec == st->st_mtim.tv_nsec
+        && entry->size == st->st_size) {
+        memcpy(candidate->block_hash, entry->block_hash, DUPLICATES_HASH_LEN);
+        if (entry->has_full_hash) {
+            memcpy(candidate->full_hash, entry->full_hash, DUPLICATES_HASH_LEN);
+            candidate->has_full_hash = true;
+        }
+        found = true;
+    }
+    g_mutex_unlock(&cache_mutex);
+    return found;
+}
+
+static void
+cache_insert(const DuplicatesCandidate *candidate, const struct stat *st) {
+    g_mutex_lock(&cache_mutex);
+    if (!cache) {
+        cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free);
+    }
+    else if (g_hash_table_size(cache) >= FSEARCH_DUPLICATES_MAX_CACHED) {
+        g_hash_table_remove_all(cache);
+    }
+    DuplicatesCacheEntry *entry = calloc(1, sizeof(DuplicatesCacheEntry));
+    g_assert(entry);
+    entry->mtime = st->st_mtim.tv_sec;
+    entry->mtime_nsec = st->st_mtim.tv_nsec;
+    entry->size = st->st_size;
+    entry->has_full_hash = candidate->has_full_hash;
+    memcpy(entry->block_hash, candidate->block_hash, DUPLICATES_HASH_LEN);
+    memcpy(entry->full_hash, candidate->full_hash, DUPLICATES_HASH_LEN);
+    g_hash_table_replace(cache, g_strdup(candidate->path), entry);
+    g_mutex_unlock(&cache_mutex);
+}
+
+void
+fsearch_duplicates_clear_cache(void) {
+    g_mutex_lock(&cache_mutex);
+    g_clear_pointer(&cache, g_hash_table_unref);
+    g_mutex_unlock(&cache_mutex);
+}
+
+uint32_t
+fsearch_duplicates_get_num_cached(void) {
+    g_mutex_lock(&cache_mutex);
+    const uint32_t num_cached = cache ? g_hash_table_size(cache) : 0;
+    g_mutex_unlock(&cache_mutex);
+    return num_cached;
+}
+
+// Reads up to size bytes at offset of fd into data, returns how many it got or -1 on errors
+static ssize_t
+read_at(int fd, uint8_t *data, size_t size, off_t offset) {
+    size_t len = 0;
+    while (len < size) {
+        const ssize_t n = pread(fd, data + len, size - len, offset + (off_t)len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        len += n;
+    }
+    return (ssize_t)len;
+}
+
+// Opens the file of candidate, if it's still a regular file of the indexed size
+static int
+open_candidate(DuplicatesCandidate *candidate, struct stat *st) {
+    // the file could have been replaced with a FIFO, which would block without O_NONBLOCK
+    const int fd = open(candidate->path, O_RDONLY | O_CLOEXEC | O_NONBLOCK | O_NOCTTY);
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, st) != 0 || !S_ISREG(st->st_mode) || (uint64_t)st->st_size != candidate->size) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void
+get_digest(GChecksum *checksum, uint8_t *hash) {
+    gsize len = DUPLICATES_HASH_LEN;
+    g_checksum_get_digest(checksum, hash, &len);
+    g_checksum_reset(checksum);
+}
+
+// Hashes the first and the last block, small files are hashed completely at once
+static void
+hash_blocks(uint32_t start, uint32_t end, void *data) {
+    DuplicatesContext *ctx = data;
+    g_autoptr(GChecksum) checksum = g_checksum_new(DUPLICATES_HASH_TYPE);
+    uint8_t buffer[2 * FSEARCH_DUPLICATES_BLOCK_SIZE];
+    for (uint32_t i = start; i < end && !g_cancellable_is_cancelled(ctx->cancellable); i++) {
+        DuplicatesCandidate *candidate = &ctx->candidates[i];
+        struct stat st;
+        if (stat(candidate->path, &st) == 0 && (uint64_t)st.st_size == candidate->size
+            && cache_lookup(candidate, &st)) {
+            candidate->valid = true;
+            g_atomic_int_inc(&ctx->num_cache_hits);
+            continue;
+        }
+
+        const int fd = open_candidate(candidate, &st);
+        if (fd < 0) {
+            continue;
+        }
+        const bool is_small = candidate->size <= sizeof(buffer);
+        const size_t len = is_small ? candidate->size : sizeof(buffer);
+        bool read_failed = false;
+        if (is_small) {
+            read_failed = read_at(fd, buffer, len, 0) != (ssize_t)len;
+        }
+        else {
+            const off_t last_block = (off_t)(candidate->size - FSEARCH_DUPLICATES_BLOCK_SIZE);
+            read_failed = read_at(fd, buffer, FSEARCH_DUPLICATES_BLOCK_SIZE, 0) != FSEARCH_DUPLICATES_BLOCK_SIZE
+                       || read_at(fd, buffer + FSEARCH_DUPLICATES_BLOCK_SIZE, FSEARCH_DUPLICATES_BLOCK_SIZE, last_block)
+                              != FSEARCH_DUPLICATES_BLOCK_SIZE;
+        }
+        close(fd);
+        if (read_failed) {
+            continue;
+        }
+
+        g_checksum_update(checksum, buffer, len);
+        get_digest(checksum, candidate->block_hash);
+        if (is_small) {
+            memcpy(candidate->full_hash, candidate->block_hash, DUPLICATES_HASH_LEN);
+            candidate->has_full_hash = true;
+        }
+        candidate->valid = true;
+        g_atomic_int_inc(&ctx->num_block_hashes);
+        cache_insert(candidate, &st);
+    }
+}
+
+static void
+hash_contents(uint32_t start, uint32_t end, void *data) {
+    DuplicatesContext *ctx = data;
+    g_autoptr(GChecksum) checksum = g_checksum_new(DUPLICATES_HASH_TYPE);
+    uint8_t *buffer = malloc(DUPLICATES_READ_SIZE);
+    g_assert(buffer);
+    for (uint32_t i = start; i < end && !g_cancellable_is_cancelled(ctx->cancellable); i++) {
+        DuplicatesCandidate *candidate = &ctx->candidates[ctx->positions[i]];
+        struct stat st;
+        const int fd = open_candidate(candidate, &st);
+        if (fd < 0) {
+            candidate->valid = false;
+            continue;
+        }
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        uint64_t offset = 0;
+        while (offset < candidate->size && !g_cancellable_is_cancelled(ctx->cancellable)) {
+            const size_t len = MIN(DUPLICATES_READ_SIZE, candidate->size - offset);
+            if (read_at(fd, buffer, len, (off_t)offset) != (ssize_t)len) {
+                break;
+            }
+            g_checksum_update(checksum, buffer, len);
+            offset += len;
+        }
+        close(fd);
+        if (offset < candidate->size) {
+            // it got shorter, couldn't be read or the search was cancelled
+            g_checksum_reset(checksum);
+            candidate->valid = false;
+            continue;
+        }
+        get_digest(checksum, candidate->full_hash);
+        candidate->has_full_hash = true;
+        g_atomic_int_inc(&ctx->num_full_hashes);
+        cache_insert(candidate, &st);
+    }
+    g_clear_pointer(&buffer, free);
+}
+
+static int
+compare_candidates_by_blocks(const void *a, const void *b) {
+    const DuplicatesCandidate *candidate_a = a;
+    const DuplicatesCandidate *candidate_b = b;
+    if (candidate_a->size != candidate_b->size) {
+        return candidate_a->size < candidate_b->size ? -1 : 1;
+    }
+    const int res = memcmp(candidate_a->block_hash, candidate_b->block_hash, DUPLICATES_HASH_LEN);
+    if (res != 0) {
+        return res;
+    }
+    return candidate_a->pos < candidate_b->pos ? -1 : candidate_a->pos > candidate_b->pos;
+}
+
+static int
+compare_candidates_by_contents(const void *a, const void *b) {
+    const DuplicatesCandidate *candidate_a = a;
+    const DuplicatesCandidate *candidate_b = b;
+    if (candidate_a->size != candidate_b->size) {
+        return candidate_a->size < candidate_b->size ? -1 : 1;
+    }
+    const int res = memcmp(candidate_a->full_hash, candidate_b->full_hash, DUPLICATES_HASH_LEN);
+    if (res != 0) {
+        return res;
+    }
+    return candidate_a->pos < candidate_b->pos ? -1 : candidate_a->pos > candidate_b->pos;
+}
+
+static bool
+candidates_have_same_blocks(const DuplicatesCandidate *a, const DuplicatesCandidate *b) {
+    return a->size == b->size && !memcmp(a->block_hash, b->block_hash, DUPLICATES_HASH_LEN);
+}
+
+static bool
+candidates_have_same_contents(const DuplicatesCandidate *a, const DuplicatesCandidate *b) {
+    return a->size == b->size && !memcmp(a->full_hash, b->full_hash, DUPLICATES_HASH_LEN);
+}
+
+// Moves the valid candidates to the front, returns their number
+static uint32_t
+remove_invalid_candidates(DuplicatesCandidate *candidates, uint32_t num_candidates) {
+    uint32_t num_valid = 0;
+    for (uint32_t i = 0; i < num_candidates; i++) {
+        if (candidates[i].valid) {
+            candidates[num_valid++] = candidates[i];
+        }
+        else {
+            g_clear_pointer(&candidates[i].path, g_free);
+        }
+    }
+    return num_valid;
+}
+
+// The candidates are the files which share their size with others
+static DuplicatesCandidate *
+get_candidates(DynamicArray *files, uint32_t *num_candidates) {
+    const uint32_t num_files = darray_get_num_items(files);
+    GArray *candidates = g_array_new(FALSE, TRUE, sizeof(DuplicatesCandidate));
+    for (uint32_t start = 0; start < num_files;) {
+        FsearchDatabaseEntry *entry = darray_get_item(files, start);
+        const off_t size = db_entry_get_size(entry);
+        uint32_t end = start + 1;
+        while (end < num_files && db_entry_get_size(darray_get_item(files, end)) == size) {
+            end++;
+        }
+        for (uint32_t i = start; i < end && end - start > 1 && size > 0; i++) {
+            FsearchDatabaseEntry *file = darray_get_item(files, i);
+            GString *path = db_entry_get_path_full(file);
+            DuplicatesCandidate candidate = {
+                .entry = file,
+                .path = g_string_free(path, FALSE),
+                .size = size,
+                .pos = i,
+            };
+            g_array_append_val(candidates, candidate);
+        }
+        start = end;
+    }
+    *num_candidates = candidates->len;
+    return (DuplicatesCandidate *)g_array_free(candidates, FALSE);
+}
+
+static void
+free_candidates(DuplicatesCandidate *candidates, uint32_t num_candidates) {
+    for (uint32_t i = 0; i < num_candidates; i++) {
+        g_clear_pointer(&candidates[i].path, g_free);
+    }
+    g_free(candidates);
+}
+
+FsearchDuplicatesSnapshot *
+fsearch_duplicates_snapshot_new(DynamicArray *files) {
+    g_assert(files);
+    FsearchDuplicatesSnapshot *snapshot = calloc(1, sizeof(FsearchDuplicatesSnapshot));
+    g_assert(snapshot);
+    snapshot->candidates = get_candidates(files, &snapshot->num_candidates);
+    return snapshot;
+}
+
+void
+fsearch_duplicates_snapshot_free(FsearchDuplicatesSnapshot *snapshot) {
+    if (!snapshot) {
+        return;
+    }
+    free_candidates(snapshot->candidates, snapshot->num_candidates);
+    g_clear_pointer(&snapshot, free);
+}
+
+static FsearchDuplicates *
+duplicates_new(DuplicatesCandidate *candidates, uint32_t num_candidates) {
+    FsearchDuplicates *duplicates = calloc(1, sizeof(FsearchDuplicates));
+    g_assert(duplicates);
+    duplicates->files = calloc(MAX(num_candidates, 1), sizeof(FsearchDatabaseEntry *));
+    g_assert(duplicates->files);
+    duplicates->group_offsets = calloc(num_candidates / 2 + 1, sizeof(uint32_t));
+    g_assert(duplicates->group_offsets);
+    duplicates->groups = g_hash_table_new(NULL, NULL);
+    duplicates->ref_count = 1;
+
+    for (uint32_t start = 0; start < num_candidates;) {
+        uint32_t end = start + 1;
+        while (end < num_candidates && candidates_have_same_contents(&candidates[start], &candidates[end])) {
+            end++;
+        }
+        if (end - start > 1) {
+            const uint32_t group = duplicates->num_groups++;
+            for (uint32_t i = start; i < end; i++) {
+                duplicates->files[duplicates->num_files++] = candidates[i].entry;
+                g_hash_table_insert(duplicates->groups, candidates[i].entry, GUINT_TO_POINTER(group + 1));
+            }
+            duplicates->group_offsets[group + 1] = duplicates->num_files;
+        }
+        start = end;
+    }
+    return duplicates;
+}
+
+FsearchDuplicates *
+fsearch_duplicates_find(DynamicArray *files, GCancellable *cancellable) {
+    g_assert(files);
+    return fsearch_duplicates_find_in_snapshot(fsearch_duplicates_snapshot_new(files), cancellable);
+}
+
+FsearchDuplicates *
+fsearch_duplicates_find_in_snapshot(FsearchDuplicatesSnapshot *snapshot, GCancellable *cancellable) {
+    g_assert(snapshot);
+
+    g_autoptr(GTimer) timer = g_timer_new();
+    uint32_t num_candidates = snapshot->num_candidates;
+    DuplicatesCandidate *candidates = g_steal_pointer(&snapshot->candidates);
+    const uint32_t num_size_candidates = num_candidates;
+    g_clear_pointer(&snapshot, free);
+
+    DuplicatesContext ctx = {
+        .candidates = candidates,
+        .cancellable = cancellable,
+    };
+    // the pool of the database would be blocked by the filesystem
+    const uint32_t num_batches = (num_candidates + DUPLICATES_BATCH_SIZE - 1) / DUPLICATES_BATCH_SIZE;
+    FsearchThreadPool *pool = fsearch_thread_pool_new(CLAMP(num_batches, 1, FSEARCH_DUPLICATES_NUM_THREADS));
+    bool completed =
+        fsearch_thread_pool_parallel_for(pool, num_candidates, DUPLICATES_BATCH_SIZE, hash_blocks, &ctx, cancellable);
+
+    uint32_t num_positions = 0;
+    if (completed) {
+        num_candidates = remove_invalid_candidates(candidates, num_candidates);
+        qsort(candidates, num_candidates, sizeof(DuplicatesCandidate), compare_candidates_by_blocks);
+
+        // files whose blocks are unique can't have the same contents as others
+        ctx.positions = calloc(MAX(num_candidates, 1), sizeof(uint32_t));
+        g_assert(ctx.positions);
+        for (uint32_t start = 0; start < num_candidates;) {
+            uint32_t end = start + 1;
+            while (end < num_candidates && candidates_have_same_blocks(&candidates[start], &candidates[end])) {
+                end++;
+            }
+            for (uint32_t i = start; i < end; i++) {
+                if (end - start == 1) {
+                    candidates[i].valid = false;
+                }
+                else if (!candidates[i].has_full_hash) {
+                    ctx.positions[num_positions++] = i;
+                }
+            }
+            start = end;
+        }
+        completed = fsearch_thread_pool_parallel_for(pool, num_positions, 1, hash_contents, &ctx, cancellable);
+    }
+    g_clear_pointer(&pool, fsearch_thread_pool_unref);
+    g_clear_pointer(&ctx.positions, free);
+
+    if (!completed || g_cancellable_is_cancelled(cancellable)) {
+        free_candidates(candidates, num_candidates);
+        return NULL;
+    }
+    num_candidates = remove_invalid_candidates(candidates, num_candidates);
+    qsort(candidates, num_candidates, sizeof(DuplicatesCandidate), compare_candidates_by_contents);
+
+    FsearchDuplicates *duplicates = duplicates_new(candidates, num_candidates);
+    duplicates->stats.num_candidates = num_size_candidates;
+    duplicates->stats.num_block_hashes = (uint32_t)g_atomic_int_get(&ctx.num_block_hashes);
+    duplicates->stats.num_full_hashes = (uint32_t)g_atomic_int_get(&ctx.num_full_hashes);
+    duplicates->stats.num_cache_hits = (uint32_t)g_atomic_int_get(&ctx.num_cache_hits);
+    free_candidates(candidates, num_candidates);
+
+    g_debug("found %d duplicates in %d groups among %d candidates (%d read completely) in %f s",
+            duplicates->num_files,
+            duplicates->num_groups,
+            num_size_candidates,
+            duplicates->stats.num_full_hashes,
+            g_timer_elapsed(timer, NULL));
+    return duplicates;
+}
+
+FsearchDuplicates *
+fsearch_duplicates_ref(FsearchDuplicates *duplicates) {
+    if (!duplicates || g_atomic_int_get(&duplicates->ref_count) <= 0) {
+        return NULL;
+    }
+    g_atomic_int_inc(&duplicates->ref_count);
+    return duplicates;
+}
+
+void
+fsearch_duplicates_unref(FsearchDuplicates *duplicates) {
+    if (!duplicates || g_atomic_int_get(&duplicates->ref_count) <= 0) {
+        return;
+    }
+    if (g_atomic_int_dec_and_test(&duplicates->ref_count)) {
+        g_clear_pointer(&duplicates->groups, g_hash_table_unref);
+        g_clear_pointer(&duplicates->group_offsets, free);
+        g_clear_pointer(&duplicates->files, free);
+        g_clear_pointer(&duplicates, free);
+    }
+}
+
+bool
+fsearch_duplicates_lookup(const FsearchDuplicates *duplicates, FsearchDatabaseEntry *entry, uint32_t *group) {
+    g_assert(duplicates);
+    const uint32_t value = GPOINTER_TO_UINT(g_hash_table_lookup(duplicates->groups, entry));
+    if (value == 0) {
+        return false;
+    }
+    if (group) {
+        *group = value - 1;
+    }
+    return true;
+}
+
+uint32_t
+fsearch_duplicates_get_num_groups(const FsearchDuplicates *duplicates) {
+    g_assert(duplicates);
+    return duplicates->num_groups;
+}
+
+uint32_t
+fsearch_duplicates_get_num_files(const FsearchDuplicates *duplicates) {
+    g_assert(duplicates);
+    return duplicates->num_files;
+}
+
+FsearchDatabaseEntry **
+fsearch_duplicates_get_group(const FsearchDuplicates *duplicates, uint32_t group, uint32_t *num_files) {
+    g_assert(duplicates);
+    g_assert(group < duplicates->num_groups);
+    g_assert(num_files);
+    *num_files = duplicates->group_offsets[group + 1] - duplicates->group_offsets[group];
+    return duplicates->files + duplicates->group_offsets[group];
+}
+
+void
+fsearch_duplicates_get_stats(const FsearchDuplicates *duplicates, FsearchDuplicatesStats *stats) {
+    g_assert(duplicates);
+    g_assert(stats);
+    *stats = duplicates->stats;
+}
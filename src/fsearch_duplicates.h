@@ -0,0 +1,87 @@
+#pragma once
+
+#include <gio/gio.h>
+#include <glib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "fsearch_array.h"
+#include "fsearch_database_entry.h"
+
+// The number of threads which read files at once, they mostly wait for the filesystem
+#define FSEARCH_DUPLICATES_NUM_THREADS 8
+// The number of bytes at the start and at the end of a file which are compared before it's read completely
+#define FSEARCH_DUPLICATES_BLOCK_SIZE 4096
+// Once there are more hashes remembered, all of them are dropped
+#define FSEARCH_DUPLICATES_MAX_CACHED (1024 * 1024)
+
+// The groups of files with the same contents
+typedef struct FsearchDuplicates FsearchDuplicates;
+
+// The paths and sizes of the files fsearch_duplicates_find_in_snapshot reads
+typedef struct FsearchDuplicatesSnapshot FsearchDuplicatesSnapshot;
+
+typedef struct {
+    // files which share their size with others
+    uint32_t num_candidates;
+    // files whose first and last blocks were hashed, or all of them if they're small
+    uint32_t num_block_hashes;
+    // files which were hashed completely, because their blocks match the ones of others
+    uint32_t num_full_hashes;
+    // hashes which didn't have to be read again
+    uint32_t num_cache_hits;
+} FsearchDuplicatesStats;
+
+// Finds the files with the same contents among files, which have to be sorted by size (like
+// sorted_files[DATABASE_INDEX_TYPE_SIZE]), so files with the same size are next to each other. Only files which
+// share their size with others are read: first the hashes of their first and last blocks are compared, then the ones
+// of the complete contents of the files whose blocks are still the same. Empty files and files whose size changed
+// since they were indexed are skipped. The files are read in parallel on a pool of its own and the hashes are
+// remembered by path, size and modification time for later calls. The entries must stay around while it runs.
+// Returns NULL if cancellable got cancelled.
+FsearchDuplicates *
+fsearch_duplicates_find(DynamicArray *files, GCancellable *cancellable);
+
+// Takes the paths and sizes of the files among files (sorted by size, see fsearch_duplicates_find) which share their
+// size with others. The entries are only kept to tell which files the groups consist of, they aren't read afterwards.
+FsearchDuplicatesSnapshot *
+fsearch_duplicates_snapshot_new(DynamicArray *files);
+
+void
+fsearch_duplicates_snapshot_free(FsearchDuplicatesSnapshot *snapshot);
+
+// Like fsearch_duplicates_find, but it only needs snapshot, which it takes ownership of. The entries may change or go
+// away while it runs, as long as the result isn't used with them anymore.
+FsearchDuplicates *
+fsearch_duplicates_find_in_snapshot(FsearchDuplicatesSnapshot *snapshot, GCancellable *cancellable);
+
+FsearchDuplicates *
+fsearch_duplicates_ref(FsearchDuplicates *duplicates);
+
+void
+fsearch_duplicates_unref(FsearchDuplicates *duplicates);
+
+// Whether entry has the same contents as another file, group is set to the index of their group if it isn't NULL.
+// Thread safe.
+bool
+fsearch_duplicates_lookup(const FsearchDuplicates *duplicates, FsearchDatabaseEntry *entry, uint32_t *group);
+
+uint32_t
+fsearch_duplicates_get_num_groups(const FsearchDuplicates *duplicates);
+
+// The number of files in all groups
+uint32_t
+fsearch_duplicates_get_num_files(const FsearchDuplicates *duplicates);
+
+// The files of group in the order of the files they were found in, num_files is set to their number
+FsearchDatabaseEntry **
+fsearch_duplicates_get_group(const FsearchDuplicates *duplicates, uint32_t group, uint32_t *num_files);
+
+void
+fsearch_duplicates_get_stats(const FsearchDuplicates *duplicates, FsearchDuplicatesStats *stats);
+
+void
+fsearch_duplicates_clear_cache(void);
+
+uint32_t
+fsearch_duplicates_get_num_cached(void);
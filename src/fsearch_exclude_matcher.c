@@ -0,0 +1,353 @@
+#define G_LOG_DOMAIN "fsearch-exclude-matcher"
+
+#define PCRE2_CODE_UNIT_WIDTH 8
+
+#include <fnmatch.h>
+#include <limits.h>
+#include <pcre2.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fsearch_exclude_matcher.h"
+#include "fsearch_exclude_path.h"
+
+typedef struct FsearchExcludeAffixes {
+    GHashTable *affixes;
+    // the distinct lengths of all affixes, every one of them needs a lookup
+    GArray *lengths;
+} FsearchExcludeAffixes;
+
+struct FsearchExcludeMatcher {
+    // path -> (gpointer)1 if the exclude path is enabled, NULL otherwise
+    GHashTable *paths;
+
+    GHashTable *names;
+    FsearchExcludeAffixes suffixes;
+    FsearchExcludeAffixes prefixes;
+
+    // patterns which can't be answered with a lookup, they're combined into one regex
+    GPtrArray *patterns;
+    pcre2_code *regex;
+    bool regex_jit_available;
+};
+
+// pcre2 match data with a single ovector pair works for every pattern, so one per thread is enough
+static GPrivate match_data_key = G_PRIVATE_INIT((GDestroyNotify)pcre2_match_data_free);
+
+static void
+affixes_init(FsearchExcludeAffixes *affixes) {
+    affixes->affixes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    affixes->lengths = g_array_new(FALSE, FALSE, sizeof(guint));
+}
+
+static void
+affixes_clear(FsearchExcludeAffixes *affixes) {
+    g_clear_pointer(&affixes->affixes, g_hash_table_unref);
+    if (affixes->lengths) {
+        g_array_free(g_steal_pointer(&affixes->lengths), TRUE);
+    }
+}
+
+static void
+affixes_add(FsearchExcludeAffixes *affixes, const char *affix, size_t len) {
+    g_hash_table_add(affixes->affixes, g_strndup(affix, len));
+    for (guint i = 0; i < affixes->lengths->len; i++) {
+        if (g_array_index(affixes->lengths, guint, i) == len) {
+            return;
+        }
+    }
+    const guint affix_len = (guint)len;
+    g_array_append_val(affixes->lengths, affix_len);
+}
+
+static bool
+affixes_match_suffix(FsearchExcludeAffixes *affixes, const char *name, size_t name_len) {
+    for (guint i = 0; i < affixes->lengths->len; i++) {
+        const guint len = g_array_index(affixes->lengths, guint, i);
+        if (len <= name_len && g_hash_table_contains(affixes->affixes, name + name_len - len)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool
+affixes_match_prefix(FsearchExcludeAffixes *affixes, const char *name, size_t name_len) {
+    char prefix[NAME_MAX + 1];
+    for (guint i = 0; i < affixes->lengths->len; i++) {
+        const guint len = g_array_index(affixes->lengths, guint, i);
+        if (len > name_len) {
+            continue;
+        }
+        memcpy(prefix, name, len);
+        prefix[len] = '\0';
+        if (g_hash_table_contains(affixes->affixes, prefix)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool
+is_special_char(char c) {
+    return c == '*' || c == '?' || c == '[' || c == '\\';
+}
+
+static bool
+has_special_chars(const char *str, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (is_special_char(str[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void
+regex_append_literal(GString *regex, char c) {
+    // only ASCII punctuation needs escaping, escaped letters or digits have a special meaning
+    if ((unsigned char)c < 0x80 && !g_ascii_isalnum(c)) {
+        g_string_append_c(regex, '\\');
+    }
+    g_string_append_c(regex, c);
+}
+
+// Appends the bracket expression at pattern (which starts with '[') to regex. Returns the number of bytes
+// of the expression, 0 if there's no closing ']' (the '[' is a literal then)
+// or -1 if the expression can't be translated.
+static ssize_t
+regex_append_bracket(GString *regex, const char *pattern) {
+    size_t i = 1;
+    bool negate = false;
+    if (pattern[i] == '!' || pattern[i] == '^') {
+        negate = true;
+        i++;
+    }
+    g_autoptr(GString) class = g_string_new(NULL);
+    // a ']' right at the start is part of the set
+    for (bool first = true; pattern[i] && (first || pattern[i] != ']'); first = false) {
+        if (pattern[i] == '[' && pattern[i + 1] == ':') {
+            const char *end = strstr(pattern + i + 2, ":]");
+            if (!end) {
+                return -1;
+            }
+            g_string_append_len(class, pattern + i, end + 2 - (pattern + i));
+            i = end + 2 - pattern;
+        }
+        else if (pattern[i] == '[' && (pattern[i + 1] == '.' || pattern[i + 1] == '=')) {
+            // collating symbols and equivalence classes are left to fnmatch
+            return -1;
+        }
+        else if (pattern[i] == '\\' && pattern[i + 1]) {
+            regex_append_literal(class, pattern[i + 1]);
+            i += 2;
+        }
+        else if (pattern[i] == '-') {
+            g_string_append_c(class, '-');
+            i++;
+        }
+        else {
+            regex_append_literal(class, pattern[i]);
+            i++;
+        }
+    }
+    if (!pattern[i]) {
+        return 0;
+    }
+    g_string_append_c(regex, '[');
+    if (negate) {
+        g_string_append_c(regex, '^');
+    }
+    g_string_append_len(regex, class->str, class->len);
+    g_string_append_c(regex, ']');
+    return (ssize_t)i + 1;
+}
+
+// Translates a fnmatch() pattern, as it's used without any flags, into a regex
+static bool
+regex_append_glob(GString *regex, const char *pattern) {
+    for (size_t i = 0; pattern[i];) {
+        const char c = pattern[i];
+        if (c == '*') {
+            g_string_append(regex, ".*");
+            while (pattern[i] == '*') {
+                i++;
+            }
+        }
+        else if (c == '?') {
+            g_string_append_c(regex, '.');
+            i++;
+        }
+        else if (c == '[') {
+            const ssize_t len = regex_append_bracket(regex, pattern + i);
+            if (len < 0) {
+                return false;
+            }
+            if (len == 0) {
+                regex_append_literal(regex, c);
+                i++;
+            }
+            else {
+                i += len;
+            }
+        }
+        else if (c == '\\') {
+            if (!pattern[i + 1]) {
+                return false;
+            }
+            regex_append_literal(regex, pattern[i + 1]);
+            i += 2;
+        }
+        else {
+            regex_append_literal(regex, c);
+            i++;
+        }
+    }
+    return true;
+}
+
+static void
+matcher_compile_patterns(FsearchExcludeMatcher *matcher) {
+    if (matcher->patterns->len == 0) {
+        return;
+    }
+    g_autoptr(GString) regex = g_string_new("^(?:");
+    for (guint i = 0; i < matcher->patterns->len; i++) {
+        const char *pattern = g_ptr_array_index(matcher->patterns, i);
+        g_autoptr(GString) pattern_regex = g_string_new(NULL);
+        if (!regex_append_glob(pattern_regex, pattern)) {
+            g_debug("[exclude_matcher] can't translate pattern: %s", pattern);
+            return;
+        }
+        if (i > 0) {
+            g_string_append_c(regex, '|');
+        }
+        g_string_append_len(regex, pattern_regex->str, pattern_regex->len);
+    }
+    g_string_append(regex, ")\\z");
+
+    uint32_t options = PCRE2_UTF | PCRE2_DOTALL;
+    if (strstr(regex->str, "[:")) {
+        // like fnmatch in a UTF-8 locale, classes like [:alpha:] match non-ASCII characters as well
+        options |= PCRE2_UCP;
+    }
+    int error_code = 0;
+    PCRE2_SIZE error_offset = 0;
+    matcher->regex = pcre2_compile((PCRE2_SPTR)regex->str,
+                                   (PCRE2_SIZE)regex->len,
+                                   options,
+                                   &error_code,
+                                   &error_offset,
+                                   NULL);
+    if (!matcher->regex) {
+        PCRE2_UCHAR buffer[256] = "";
+        pcre2_get_error_message(error_code, buffer, sizeof(buffer));
+        g_debug("[exclude_matcher] compiling %s failed at offset %d: %s", regex->str, (int)error_offset, buffer);
+        return;
+    }
+    matcher->regex_jit_available = pcre2_jit_compile(matcher->regex, PCRE2_JIT_COMPLETE) == 0;
+}
+
+FsearchExcludeMatcher *
+fsearch_exclude_matcher_new(GList *excludes, char **exclude_files) {
+    FsearchExcludeMatcher *matcher = calloc(1, sizeof(FsearchExcludeMatcher));
+    g_assert(matcher);
+
+    matcher->paths = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    for (GList *l = excludes; l != NULL; l = l->next) {
+        FsearchExcludePath *exclude = l->data;
+        // the first entry for a path decides, like a linear search would
+        if (exclude->path && !g_hash_table_contains(matcher->paths, exclude->path)) {
+            g_hash_table_insert(matcher->paths, g_strdup(exclude->path), exclude->enabled ? GINT_TO_POINTER(1) : NULL);
+        }
+    }
+
+    matcher->names = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    affixes_init(&matcher->suffixes);
+    affixes_init(&matcher->prefixes);
+    matcher->patterns = g_ptr_array_new_with_free_func(g_free);
+
+    for (uint32_t i = 0; exclude_files && exclude_files[i]; i++) {
+        const char *pattern = exclude_files[i];
+        const size_t len = strlen(pattern);
+        if (!has_special_chars(pattern, len)) {
+            g_hash_table_add(matcher->names, g_strdup(pattern));
+        }
+        else if (pattern[0] == '*' && !has_special_chars(pattern + 1, len - 1)) {
+            affixes_add(&matcher->suffixes, pattern + 1, len - 1);
+        }
+        else if (len > 1 && len <= NAME_MAX && pattern[len - 1] == '*' && !has_special_chars(pattern, len - 1)) {
+            affixes_add(&matcher->prefixes, pattern, len - 1);
+        }
+        else {
+            g_ptr_array_add(matcher->patterns, g_strdup(pattern));
+        }
+    }
+    matcher_compile_patterns(matcher);
+
+    g_debug("[exclude_matcher] %d names, %d suffixes, %d prefixes, %d patterns (%s)",
+            g_hash_table_size(matcher->names),
+            g_hash_table_size(matcher->suffixes.affixes),
+            g_hash_table_size(matcher->prefixes.affixes),
+            matcher->patterns->len,
+            matcher->regex ? "regex" : "fnmatch");
+    return matcher;
+}
+
+void
+fsearch_exclude_matcher_free(FsearchExcludeMatcher *matcher) {
+    if (!matcher) {
+        return;
+    }
+    g_clear_pointer(&matcher->paths, g_hash_table_unref);
+    g_clear_pointer(&matcher->names, g_hash_table_unref);
+    affixes_clear(&matcher->suffixes);
+    affixes_clear(&matcher->prefixes);
+    g_clear_pointer(&matcher->patterns, g_ptr_array_unref);
+    g_clear_pointer(&matcher->regex, pcre2_code_free);
+    g_clear_pointer(&matcher, free);
+}
+
+bool
+fsearch_exclude_matcher_path_is_excluded(FsearchExcludeMatcher *matcher, const char *path) {
+    g_assert(matcher);
+    return g_hash_table_lookup(matcher->paths, path) != NULL;
+}
+
+static bool
+matcher_match_patterns(FsearchExcludeMatcher *matcher, const char *name, size_t name_len) {
+    // the regex only deals with valid UTF-8, everything else is left to fnmatch
+    if (matcher->regex && g_utf8_validate(name, (gssize)name_len, NULL)) {
+        pcre2_match_data *match_data = g_private_get(&match_data_key);
+        if (!match_data) {
+            match_data = pcre2_match_data_create(1, NULL);
+            g_private_set(&match_data_key, match_data);
+        }
+        const int res = matcher->regex_jit_available
+                          ? pcre2_jit_match(matcher->regex, (PCRE2_SPTR)name, name_len, 0, 0, match_data, NULL)
+                          : pcre2_match(matcher->regex, (PCRE2_SPTR)name, name_len, 0, 0, match_data, NULL);
+        return res >= 0;
+    }
+    for (guint i = 0; i < matcher->patterns->len; i++) {
+        if (!fnmatch(g_ptr_array_index(matcher->patterns, i), name, 0)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool
+fsearch_exclude_matcher_name_is_excluded(FsearchExcludeMatcher *matcher, const char *name) {
+    g_assert(matcher);
+    const size_t name_len = strlen(name);
+    if (g_hash_table_size(matcher->names) > 0 && g_hash_table_contains(matcher->names, name)) {
+        return true;
+    }
+    if (affixes_match_suffix(&matcher->suffixes, name, name_len)) {
+        return true;
+    }
+    if (affixes_match_prefix(&matcher->prefixes, name, name_len)) {
+        return true;
+    }
+    return matcher->patterns->len > 0 && matcher_match_patterns(matcher, name, name_len);
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <glib.h>
+#include <stdbool.h>
+
+// Precompiled form of the exclude paths and exclude file patterns of a database. Literal names, "*suffix" and
+// "prefix*" patterns are answered with hash lookups, all other patterns are combined into a single regex.
+typedef struct FsearchExcludeMatcher FsearchExcludeMatcher;
+
+FsearchExcludeMatcher *
+fsearch_exclude_matcher_new(GList *excludes, char **exclude_files);
+
+void
+fsearch_exclude_matcher_free(FsearchExcludeMatcher *matcher);
+
+// Whether the directory at path is an enabled exclude path
+bool
+fsearch_exclude_matcher_path_is_excluded(FsearchExcludeMatcher *matcher, const char *path);
+
+// Whether name matches one of the exclude file patterns, with the same semantics as fnmatch(pattern, name, 0)
+bool
+fsearch_exclude_matcher_name_is_excluded(FsearchExcludeMatcher *matcher, const char *name);
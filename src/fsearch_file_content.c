@@ -0,0 +1,188 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fsearch_file_content.h"
+
+// the start of a file which gets checked for NUL bytes, like grep does to tell binary files apart
+#define FILE_CONTENT_BINARY_CHECK_SIZE 8192
+// read buffers up to this size are kept by the search threads for the next file
+#define FILE_CONTENT_MAX_KEPT_BUFFER_SIZE (1024 * 1024)
+
+typedef struct {
+    char *data;
+    size_t size;
+} FsearchFileContentBuffer;
+
+typedef struct {
+    int64_t mtime;
+    int64_t mtime_nsec;
+    int64_t size;
+    bool matches;
+} FsearchFileContentCacheEntry;
+
+static void
+file_content_buffer_free(FsearchFileContentBuffer *buffer) {
+    g_clear_pointer(&buffer->data, free);
+    g_clear_pointer(&buffer, free);
+}
+
+static GPrivate file_content_buffer_key = G_PRIVATE_INIT((GDestroyNotify)file_content_buffer_free);
+
+static GMutex cache_mutex;
+// the results for a key and a path, see get_cache_key
+static GHashTable *cache = NULL;
+static uint32_t cache_size = 0;
+
+// The key and path in one string, the length of the key keeps them apart
+static char *
+get_cache_key(const char *key, const char *path) {
+    return g_strdup_printf("%zu:%s%s", strlen(key), key, path);
+}
+
+static bool
+cache_lookup(const char *cache_key, const struct stat *st, bool *matches) {
+    bool found = false;
+    g_mutex_lock(&cache_mutex);
+    FsearchFileContentCacheEntry *entry = cache ? g_hash_table_lookup(cache, cache_key) : NULL;
+    if (entry && entry->mtime == st->st_mtim.tv_sec && entry->mtime_nsec == st->st_mtim.tv_nsec
+        && entry->size == st->st_size) {
+        *matches = entry->matches;
+        found = true;
+    }
+    g_mutex_unlock(&cache_mutex);
+    return found;
+}
+
+static void
+cache_insert(char *cache_key, const struct stat *st, bool matches) {
+    g_mutex_lock(&cache_mutex);
+    if (cache_size == 0) {
+        g_mutex_unlock(&cache_mutex);
+        g_free(cache_key);
+        return;
+    }
+    if (!cache) {
+        cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free);
+    }
+    else if (g_hash_table_size(cache) >= cache_size) {
+        g_hash_table_remove_all(cache);
+    }
+    FsearchFileContentCacheEntry *entry = calloc(1, sizeof(FsearchFileContentCacheEntry));
+    g_assert(entry);
+    entry->mtime = st->st_mtim.tv_sec;
+    entry->mtime_nsec = st->st_mtim.tv_nsec;
+    entry->size = st->st_size;
+    entry->matches = matches;
+    g_hash_table_replace(cache, cache_key, entry);
+    g_mutex_unlock(&cache_mutex);
+}
+
+void
+fsearch_file_content_set_cache_size(uint32_t num_files) {
+    g_mutex_lock(&cache_mutex);
+    cache_size = num_files;
+    if (cache && g_hash_table_size(cache) > cache_size) {
+        g_hash_table_remove_all(cache);
+    }
+    if (cache_size == 0) {
+        g_clear_pointer(&cache, g_hash_table_unref);
+    }
+    g_mutex_unlock(&cache_mutex);
+}
+
+uint32_t
+fsearch_file_content_get_num_cached(void) {
+    g_mutex_lock(&cache_mutex);
+    const uint32_t num_cached = cache ? g_hash_table_size(cache) : 0;
+    g_mutex_unlock(&cache_mutex);
+    return num_cached;
+}
+
+static FsearchFileContentBuffer *
+get_buffer(size_t size) {
+    FsearchFileContentBuffer *buffer = g_private_get(&file_content_buffer_key);
+    if (!buffer) {
+        buffer = calloc(1, sizeof(FsearchFileContentBuffer));
+        g_assert(buffer);
+        g_private_set(&file_content_buffer_key, buffer);
+    }
+    if (buffer->size < size) {
+        g_clear_pointer(&buffer->data, free);
+        buffer->data = malloc(size);
+        g_assert(buffer->data);
+        buffer->size = size;
+    }
+    return buffer;
+}
+
+static void
+release_buffer(FsearchFileContentBuffer *buffer) {
+    // a large buffer would stay allocated for every thread of the pool
+    if (buffer->size > FILE_CONTENT_MAX_KEPT_BUFFER_SIZE) {
+        g_clear_pointer(&buffer->data, free);
+        buffer->size = 0;
+    }
+}
+
+// Reads up to size bytes of fd into data, returns how many it got or -1 on errors
+static ssize_t
+read_contents(int fd, char *data, size_t size) {
+    size_t len = 0;
+    while (len < size) {
+        const ssize_t n = read(fd, data + len, size - len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        len += n;
+    }
+    return (ssize_t)len;
+}
+
+bool
+fsearch_file_content_matches(const char *path, const char *key, FsearchFileContentMatchFunc match_func, gpointer data) {
+    g_assert(path);
+    g_assert(match_func);
+
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0
+        || st.st_size > FSEARCH_FILE_CONTENT_MAX_SIZE) {
+        return false;
+    }
+    bool matches = false;
+    g_autofree char *cache_key = key && cache_size > 0 ? get_cache_key(key, path) : NULL;
+    if (cache_key && cache_lookup(cache_key, &st, &matches)) {
+        return matches;
+    }
+
+    // the file could have been replaced with a FIFO since the stat, which would block without O_NONBLOCK
+    const int fd = open(path, O_RDONLY | O_CLOEXEC | O_NONBLOCK | O_NOCTTY);
+    if (fd < 0) {
+        return false;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    // the whole file gets read in one go, which is as fast as mapping it without the risk of a SIGBUS if it gets
+    // truncated in the meantime
+    FsearchFileContentBuffer *buffer = get_buffer(st.st_size);
+    const ssize_t len = read_contents(fd, buffer->data, st.st_size);
+    close(fd);
+
+    if (len > 0 && !memchr(buffer->data, '\0', MIN((size_t)len, FILE_CONTENT_BINARY_CHECK_SIZE))) {
+        matches = match_func(buffer->data, len, data);
+    }
+    release_buffer(buffer);
+
+    if (cache_key && len >= 0) {
+        cache_insert(g_steal_pointer(&cache_key), &st, matches);
+    }
+    return matches;
+}
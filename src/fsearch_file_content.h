@@ -0,0 +1,27 @@
+#pragma once
+
+#include <glib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Larger files are never read by the content: filter, so a single huge file can't stall a search
+#define FSEARCH_FILE_CONTENT_MAX_SIZE (64 * 1024 * 1024)
+
+// Whether the len bytes of contents match
+typedef bool (*FsearchFileContentMatchFunc)(const char *contents, size_t len, gpointer data);
+
+// Reads the regular file at path and returns what match_func says about its contents. Files which are empty, larger
+// than FSEARCH_FILE_CONTENT_MAX_SIZE, can't be read or look binary (there's a NUL byte at their start) don't match.
+// If key isn't NULL, the result is remembered for key and path (see fsearch_file_content_set_cache_size), as long as
+// the size and modification time of the file stay the same. Can be called from any thread.
+bool
+fsearch_file_content_matches(const char *path, const char *key, FsearchFileContentMatchFunc match_func, gpointer data);
+
+// Sets how many results fsearch_file_content_matches remembers, 0 disables that. Once there are more, all of them
+// are dropped.
+void
+fsearch_file_content_set_cache_size(uint32_t num_files);
+
+uint32_t
+fsearch_file_content_get_num_cached(void);
@@ -0,0 +1,198 @@
+#include "fsearch_file_operation.h"
+
+#include "fsearch_thread_pool.h"
+
+#include <glib/gi18n.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The threads take that many paths at once and report the progress after each of them
+#define FILE_OPERATION_BATCH_SIZE 32
+
+struct FsearchFileOperation {
+    FsearchFileOperationType type;
+    // the deepest paths first, see fsearch_file_operation_run
+    GPtrArray *paths;
+    // whether the path at the same position was removed
+    bool *removed;
+    GPtrArray *removed_paths;
+    GString *error_messages;
+    GMutex error_mutex;
+};
+
+typedef struct {
+    FsearchFileOperation *operation;
+    // the position of the first path of the current depth
+    uint32_t offset;
+    GCancellable *cancellable;
+    FsearchFileOperationProgressFunc progress_func;
+    gpointer user_data;
+    volatile gint num_done;
+} FsearchFileOperationContext;
+
+static uint32_t
+get_depth(const char *path) {
+    uint32_t depth = 0;
+    for (const char *c = path; *c; c++) {
+        if (*c == G_DIR_SEPARATOR) {
+            depth++;
+        }
+    }
+    return depth;
+}
+
+static gint
+compare_paths_by_depth(gconstpointer a, gconstpointer b) {
+    const char *path_a = *(const char **)a;
+    const char *path_b = *(const char **)b;
+    const uint32_t depth_a = get_depth(path_a);
+    const uint32_t depth_b = get_depth(path_b);
+    if (depth_a != depth_b) {
+        return depth_a > depth_b ? -1 : 1;
+    }
+    return strcmp(path_a, path_b);
+}
+
+FsearchFileOperation *
+fsearch_file_operation_new(FsearchFileOperationType type, GPtrArray *paths) {
+    g_assert(paths);
+
+    FsearchFileOperation *operation = calloc(1, sizeof(FsearchFileOperation));
+    g_assert(operation);
+    operation->type = type;
+    operation->paths = g_ptr_array_new_full(paths->len, g_free);
+    for (uint32_t i = 0; i < paths->len; i++) {
+        g_ptr_array_add(operation->paths, g_strdup(g_ptr_array_index(paths, i)));
+    }
+    g_ptr_array_sort(operation->paths, compare_paths_by_depth);
+    operation->removed = calloc(MAX(paths->len, 1), sizeof(bool));
+    g_assert(operation->removed);
+    // the paths are owned by paths
+    operation->removed_paths = g_ptr_array_new();
+    operation->error_messages = g_string_new(NULL);
+    g_mutex_init(&operation->error_mutex);
+    return operation;
+}
+
+void
+fsearch_file_operation_free(FsearchFileOperation *operation) {
+    if (!operation) {
+        return;
+    }
+    g_clear_pointer(&operation->removed_paths, g_ptr_array_unref);
+    g_clear_pointer(&operation->paths, g_ptr_array_unref);
+    g_clear_pointer(&operation->removed, free);
+    g_string_free(g_steal_pointer(&operation->error_messages), TRUE);
+    g_mutex_clear(&operation->error_mutex);
+    g_clear_pointer(&operation, free);
+}
+
+static void
+remove_paths(uint32_t start, uint32_t end, void *data) {
+    FsearchFileOperationContext *ctx = data;
+    FsearchFileOperation *operation = ctx->operation;
+
+    uint32_t num_done = 0;
+    for (uint32_t i = ctx->offset + start; i < ctx->offset + end; i++, num_done++) {
+        if (g_cancellable_is_cancelled(ctx->cancellable)) {
+            break;
+        }
+        g_autoptr(GFile) file = g_file_new_for_path(g_ptr_array_index(operation->paths, i));
+        g_autoptr(GError) error = NULL;
+        if (operation->type == FSEARCH_FILE_OPERATION_DELETE) {
+            g_file_delete(file, ctx->cancellable, &error);
+        }
+        else {
+            g_file_trash(file, ctx->cancellable, &error);
+        }
+
+        if (!error) {
+            operation->removed[i] = true;
+        }
+        else if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+            // the errors of all threads end up in one list, which has to tell which file each of them is about
+            g_mutex_lock(&operation->error_mutex);
+            g_string_append_printf(operation->error_messages,
+                                   "%s \"%s\": %s\n",
+                                   C_("Will be followed by the path of the file.", "Error when removing file"),
+                                   (const char *)g_ptr_array_index(operation->paths, i),
+                                   error->message);
+            g_mutex_unlock(&operation->error_mutex);
+        }
+    }
+
+    const uint32_t num_done_total = g_atomic_int_add(&ctx->num_done, num_done) + num_done;
+    if (ctx->progress_func) {
+        ctx->progress_func(num_done_total, operation->paths->len, ctx->user_data);
+    }
+}
+
+bool
+fsearch_file_operation_run(FsearchFileOperation *operation,
+                           GCancellable *cancellable,
+                           FsearchFileOperationProgressFunc progress_func,
+                           gpointer user_data) {
+    g_assert(operation);
+
+    const uint32_t num_paths = operation->paths->len;
+    const uint32_t num_batches = (num_paths + FILE_OPERATION_BATCH_SIZE - 1) / FILE_OPERATION_BATCH_SIZE;
+    // the pool of the database would be blocked by the filesystem, so the operation gets one of its own
+    FsearchThreadPool *pool = fsearch_thread_pool_new(CLAMP(num_batches, 1, FSEARCH_FILE_OPERATION_NUM_THREADS));
+
+    FsearchFileOperationContext ctx = {
+        .operation = operation,
+        .cancellable = cancellable,
+        .progress_func = progress_func,
+        .user_data = user_data,
+    };
+    bool completed = true;
+    // the paths of one depth are removed in parallel, before any of their parents
+    for (uint32_t start = 0; start < num_paths && completed;) {
+        const uint32_t depth = get_depth(g_ptr_array_index(operation->paths, start));
+        uint32_t end = start + 1;
+        while (end < num_paths && get_depth(g_ptr_array_index(operation->paths, end)) == depth) {
+            end++;
+        }
+        ctx.offset = start;
+        completed = fsearch_thread_pool_parallel_for(pool,
+                                                     end - start,
+                                                     FILE_OPERATION_BATCH_SIZE,
+                                                     remove_paths,
+                                                     &ctx,
+                                                     cancellable);
+        start = end;
+    }
+    g_clear_pointer(&pool, fsearch_thread_pool_unref);
+
+    g_ptr_array_set_size(operation->removed_paths, 0);
+    for (uint32_t i = 0; i < num_paths; i++) {
+        if (operation->removed[i]) {
+            g_ptr_array_add(operation->removed_paths, g_ptr_array_index(operation->paths, i));
+        }
+    }
+    return completed && !g_cancellable_is_cancelled(cancellable);
+}
+
+FsearchFileOperationType
+fsearch_file_operation_get_type(FsearchFileOperation *operation) {
+    g_assert(operation);
+    return operation->type;
+}
+
+uint32_t
+fsearch_file_operation_get_num_paths(FsearchFileOperation *operation) {
+    g_assert(operation);
+    return operation->paths->len;
+}
+
+GPtrArray *
+fsearch_file_operation_get_removed_paths(FsearchFileOperation *operation) {
+    g_assert(operation);
+    return operation->removed_paths;
+}
+
+const char *
+fsearch_file_operation_get_error_messages(FsearchFileOperation *operation) {
+    g_assert(operation);
+    return operation->error_messages->len > 0 ? operation->error_messages->str : NULL;
+}
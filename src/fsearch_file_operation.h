@@ -0,0 +1,51 @@
+#pragma once
+
+#include <gio/gio.h>
+#include <glib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// The number of threads which remove files at once, they mostly wait for the filesystem
+#define FSEARCH_FILE_OPERATION_NUM_THREADS 8
+
+typedef enum {
+    FSEARCH_FILE_OPERATION_TRASH,
+    FSEARCH_FILE_OPERATION_DELETE,
+} FsearchFileOperationType;
+
+// Moves a batch of files and folders to the trash or deletes them on a pool of its own, so a large selection doesn't
+// have to be processed one path after another.
+typedef struct FsearchFileOperation FsearchFileOperation;
+
+// Gets called from the threads of the operation whenever another batch of paths is done
+typedef void (*FsearchFileOperationProgressFunc)(uint32_t num_done, uint32_t num_paths, gpointer user_data);
+
+// Takes a copy of the full paths
+FsearchFileOperation *
+fsearch_file_operation_new(FsearchFileOperationType type, GPtrArray *paths);
+
+void
+fsearch_file_operation_free(FsearchFileOperation *operation);
+
+// Removes all paths and returns when they're done. Deeper paths are removed first, so the contents of a selected
+// folder are gone before the folder itself. Returns false if cancellable got cancelled, the paths which weren't
+// started by then are kept.
+bool
+fsearch_file_operation_run(FsearchFileOperation *operation,
+                           GCancellable *cancellable,
+                           FsearchFileOperationProgressFunc progress_func,
+                           gpointer user_data);
+
+FsearchFileOperationType
+fsearch_file_operation_get_type(FsearchFileOperation *operation);
+
+uint32_t
+fsearch_file_operation_get_num_paths(FsearchFileOperation *operation);
+
+// The paths which were removed by fsearch_file_operation_run
+GPtrArray *
+fsearch_file_operation_get_removed_paths(FsearchFileOperation *operation);
+
+// One line for each path which couldn't be removed, NULL if there weren't any errors
+const char *
+fsearch_file_operation_get_error_messages(FsearchFileOperation *operation);
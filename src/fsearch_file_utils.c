@@ -132,41 +132,6 @@ build_folder_open_cmd(const char *path, const char *path_full, const char *cmd)
     return g_regex_replace_eval(reg, cmd, -1, 0, 0, keyword_eval_cb, keywords, NULL);
 }
 
-static bool
-file_remove_or_trash(const char *path, bool delete, GString *error_messages) {
-    g_autoptr(GFile) file = g_file_new_for_path(path);
-    if (!file) {
-        add_error_message_with_format(error_messages,
-                                      C_("Will be followed by the path of the file.", "Error when removing file"),
-                                      path,
-                                      _("Failed to get path"));
-        return false;
-    }
-    g_autoptr(GError) error = NULL;
-    if (delete) {
-        g_file_delete(file, NULL, &error);
-    }
-    else {
-        g_file_trash(file, NULL, &error);
-    }
-
-    if (error) {
-        add_error_message(error_messages, error->message);
-        return false;
-    }
-    return true;
-}
-
-bool
-fsearch_file_utils_remove(const char *path, GString *error_messages) {
-    return file_remove_or_trash(path, true, error_messages);
-}
-
-bool
-fsearch_file_utils_trash(const char *path, GString *error_messages) {
-    return file_remove_or_trash(path, false, error_messages);
-}
-
 // Structure to store files (`uris`) which should be opened with the application described by `app_info`
 typedef struct {
     GAppInfo *app_info;
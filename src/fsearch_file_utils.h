@@ -29,12 +29,6 @@ fsearch_file_utils_init_data_dir_path(char *path, size_t len);
 bool
 fsearch_file_utils_create_dir(const char *path);
 
-bool
-fsearch_file_utils_trash(const char *path, GString *error_messages);
-
-bool
-fsearch_file_utils_remove(const char *path, GString *error_messages);
-
 void
 fsearch_file_utils_open_path_list(GList *paths,
                                   bool launch_desktop_files,
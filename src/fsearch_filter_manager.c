@@ -5,13 +5,39 @@
 
 struct FsearchFilterManager {
     GList *filters;
+
+    // FsearchFilter -> FilterCompiled, see fsearch_filter_manager_cache_compiled
+    GHashTable *compiled;
+    GMutex compiled_lock;
 };
 
+typedef struct {
+    gpointer data;
+    GDestroyNotify free_func;
+} FilterCompiled;
+
+static void
+filter_compiled_free(FilterCompiled *compiled) {
+    if (compiled->free_func) {
+        g_clear_pointer(&compiled->data, compiled->free_func);
+    }
+    g_clear_pointer(&compiled, free);
+}
+
+static void
+clear_compiled(FsearchFilterManager *manager) {
+    g_mutex_lock(&manager->compiled_lock);
+    g_hash_table_remove_all(manager->compiled);
+    g_mutex_unlock(&manager->compiled_lock);
+}
+
 void
 fsearch_filter_manager_free(FsearchFilterManager *manager) {
     if (!manager) {
         return;
     }
+    g_clear_pointer(&manager->compiled, g_hash_table_destroy);
+    g_mutex_clear(&manager->compiled_lock);
     g_list_free_full(g_steal_pointer(&manager->filters), (GDestroyNotify)fsearch_filter_unref);
     g_clear_pointer(&manager, free);
 }
@@ -22,6 +48,12 @@ fsearch_filter_manager_new(void) {
     g_assert(manager);
 
     manager->filters = NULL;
+    // the keys are referenced, so a filter which gets freed can't be confused with a new one at the same address
+    manager->compiled = g_hash_table_new_full(g_direct_hash,
+                                              g_direct_equal,
+                                              (GDestroyNotify)fsearch_filter_unref,
+                                              (GDestroyNotify)filter_compiled_free);
+    g_mutex_init(&manager->compiled_lock);
     return manager;
 }
 
@@ -77,6 +109,7 @@ update_filter_to_unique_name(GList *filters, FsearchFilter *filter) {
 
 void
 fsearch_filter_manager_append_filter(FsearchFilterManager *manager, FsearchFilter *filter) {
+    clear_compiled(manager);
     update_filter_to_unique_name(manager->filters, filter);
     manager->filters = g_list_append(manager->filters, fsearch_filter_ref(filter));
 }
@@ -86,6 +119,8 @@ fsearch_filter_manager_reorder(FsearchFilterManager *manager, gint *new_order, s
     if (!new_order) {
         return;
     }
+    // the first filter with a macro is the one it refers to
+    clear_compiled(manager);
     GList *reordered_filters = NULL;
     for (uint32_t i = 0; i < new_order_len; ++i) {
         const gint old_pos = new_order[i];
@@ -101,6 +136,7 @@ fsearch_filter_manager_remove(FsearchFilterManager *manager, FsearchFilter *filt
     if (!filter) {
         return;
     }
+    clear_compiled(manager);
     manager->filters = g_list_remove(manager->filters, filter);
     g_clear_pointer(&filter, fsearch_filter_unref);
 }
@@ -115,12 +151,18 @@ fsearch_filter_manager_edit(FsearchFilterManager *manager,
     if (!name) {
         return;
     }
-    g_clear_pointer(&filter->name, g_free);
-    g_clear_pointer(&filter->query, g_free);
+    clear_compiled(manager);
+    // the new values can be the old ones of the filter
+    char *old_name = g_steal_pointer(&filter->name);
+    char *old_macro = g_steal_pointer(&filter->macro);
+    char *old_query = g_steal_pointer(&filter->query);
     filter->name = g_strdup(name);
     filter->query = g_strdup(query ? query : "");
     filter->macro = g_strdup(macro ? macro : "");
     filter->flags = flags;
+    g_clear_pointer(&old_name, g_free);
+    g_clear_pointer(&old_macro, g_free);
+    g_clear_pointer(&old_query, g_free);
     update_filter_to_unique_name(manager->filters, filter);
 }
 
@@ -153,6 +195,46 @@ fsearch_filter_manager_get_filter(FsearchFilterManager *manager, guint idx) {
     return filter ? fsearch_filter_ref(filter) : NULL;
 }
 
+gpointer
+fsearch_filter_manager_lookup_compiled(FsearchFilterManager *manager,
+                                       FsearchFilter *filter,
+                                       FsearchFilterCompiledRefFunc *ref_func) {
+    g_assert(manager);
+    g_assert(ref_func);
+    if (!filter) {
+        return NULL;
+    }
+
+    g_mutex_lock(&manager->compiled_lock);
+    FilterCompiled *compiled = g_hash_table_lookup(manager->compiled, filter);
+    gpointer data = compiled ? ref_func(compiled->data) : NULL;
+    g_mutex_unlock(&manager->compiled_lock);
+    return data;
+}
+
+void
+fsearch_filter_manager_cache_compiled(FsearchFilterManager *manager,
+                                      FsearchFilter *filter,
+                                      gpointer compiled,
+                                      GDestroyNotify free_func) {
+    g_assert(manager);
+    if (!filter || !g_list_find(manager->filters, filter)) {
+        if (free_func) {
+            g_clear_pointer(&compiled, free_func);
+        }
+        return;
+    }
+
+    FilterCompiled *c = calloc(1, sizeof(FilterCompiled));
+    g_assert(c);
+    c->data = compiled;
+    c->free_func = free_func;
+
+    g_mutex_lock(&manager->compiled_lock);
+    g_hash_table_insert(manager->compiled, fsearch_filter_ref(filter), c);
+    g_mutex_unlock(&manager->compiled_lock);
+}
+
 bool
 fsearch_filter_manager_cmp(FsearchFilterManager *manager_1, FsearchFilterManager *manager_2) {
     g_assert(manager_1);
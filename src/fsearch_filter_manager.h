@@ -7,6 +7,8 @@
 
 typedef struct FsearchFilterManager FsearchFilterManager;
 
+typedef gpointer(FsearchFilterCompiledRefFunc)(gpointer);
+
 void
 fsearch_filter_manager_free(FsearchFilterManager *manager);
 
@@ -45,5 +47,22 @@ fsearch_filter_manager_edit(FsearchFilterManager *manager,
                             const char *query,
                             FsearchQueryFlags flags);
 
+// Returns a reference (taken with ref_func) to what was stored for filter with fsearch_filter_manager_cache_compiled,
+// or NULL if nothing was stored since the filters of the manager last changed
+gpointer
+fsearch_filter_manager_lookup_compiled(FsearchFilterManager *manager,
+                                       FsearchFilter *filter,
+                                       FsearchFilterCompiledRefFunc *ref_func);
+
+// Stores what was compiled from the query of filter (e.g. its query tree), so it doesn't have to be compiled again
+// for every query with this filter. The manager owns compiled and frees it with free_func as soon as any of its
+// filters is changed, since filters can refer to each other with macros. Filters which aren't part of the manager
+// aren't cached.
+void
+fsearch_filter_manager_cache_compiled(FsearchFilterManager *manager,
+                                      FsearchFilter *filter,
+                                      gpointer compiled,
+                                      GDestroyNotify free_func);
+
 bool
 fsearch_filter_manager_cmp(FsearchFilterManager *manager_1, FsearchFilterManager *manager_2);
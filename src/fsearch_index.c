@@ -30,12 +30,14 @@ fsearch_index_copy(FsearchIndex *index) {
     if (!index) {
         return NULL;
     }
-    return fsearch_index_new(index->type,
-                             index->path,
-                             index->enabled,
-                             index->update,
-                             index->one_filesystem,
-                             index->last_updated);
+    FsearchIndex *copy = fsearch_index_new(index->type,
+                                           index->path,
+                                           index->enabled,
+                                           index->update,
+                                           index->one_filesystem,
+                                           index->last_updated);
+    copy->update_interval = index->update_interval;
+    return copy;
 }
 
 void
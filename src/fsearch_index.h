@@ -16,6 +16,9 @@ typedef struct _FsearchIndex {
     bool enabled;
     bool update;
     bool one_filesystem;
+    // minutes after which only this index gets scanned again, independent of update and the schedule of the
+    // whole database. 0 if it has no schedule of its own.
+    uint32_t update_interval;
 
     time_t last_updated;
 } FsearchIndex;
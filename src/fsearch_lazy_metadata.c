@@ -0,0 +1,188 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define G_LOG_DOMAIN "fsearch-lazy-metadata"
+
+#include "fsearch_lazy_metadata.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+struct FsearchLazyMetadata {
+    // path -> CachedMetadata
+    GHashTable *cache;
+    uint32_t max_entries;
+    GMutex mutex;
+};
+
+typedef struct {
+    FsearchLazyMetadataValues values;
+    // when it was fetched, in monotonic time
+    gint64 fetch_time;
+} CachedMetadata;
+
+typedef struct {
+    const char *const *paths;
+    // the positions of the paths which get fetched
+    uint32_t *missing;
+    FsearchLazyMetadataValues *values;
+} FsearchLazyMetadataFetchContext;
+
+static bool
+is_fresh(const CachedMetadata *cached, gint64 now) {
+    return now - cached->fetch_time < (gint64)FSEARCH_LAZY_METADATA_MAX_AGE * G_USEC_PER_SEC;
+}
+
+static int
+get_stat_flags(void) {
+    // like the scan, links aren't followed
+    int flags = AT_SYMLINK_NOFOLLOW;
+#ifdef AT_NO_AUTOMOUNT
+    flags |= AT_NO_AUTOMOUNT;
+#endif
+    return flags;
+}
+
+static void
+fetch_values(const char *path, FsearchLazyMetadataValues *values) {
+#ifdef HAVE_STATX
+    struct statx stx;
+    // only asks for what's shown, the attributes don't have to be synced with the server on network filesystems
+    if (statx(AT_FDCWD, path, get_stat_flags() | AT_STATX_DONT_SYNC, STATX_SIZE | STATX_MTIME, &stx) == 0) {
+        values->size = (off_t)stx.stx_size;
+        values->mtime = (time_t)stx.stx_mtime.tv_sec;
+        return;
+    }
+    if (errno != ENOSYS) {
+        values->missing = true;
+        return;
+    }
+#endif
+    struct stat st;
+    if (fstatat(AT_FDCWD, path, &st, get_stat_flags()) == 0) {
+        values->size = st.st_size;
+        values->mtime = st.st_mtime;
+        return;
+    }
+    values->missing = true;
+}
+
+static void
+fetch_range(uint32_t start, uint32_t end, void *data) {
+    FsearchLazyMetadataFetchContext *ctx = data;
+    for (uint32_t i = start; i < end; i++) {
+        fetch_values(ctx->paths[ctx->missing[i]], &ctx->values[i]);
+    }
+}
+
+FsearchLazyMetadata *
+fsearch_lazy_metadata_new(uint32_t max_entries) {
+    FsearchLazyMetadata *metadata = calloc(1, sizeof(FsearchLazyMetadata));
+    g_assert(metadata);
+    metadata->cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free);
+    metadata->max_entries = MAX(max_entries, 1);
+    g_mutex_init(&metadata->mutex);
+    return metadata;
+}
+
+void
+fsearch_lazy_metadata_free(FsearchLazyMetadata *metadata) {
+    g_return_if_fail(metadata);
+    g_clear_pointer(&metadata->cache, g_hash_table_unref);
+    g_mutex_clear(&metadata->mutex);
+    g_clear_pointer(&metadata, free);
+}
+
+bool
+fsearch_lazy_metadata_lookup(FsearchLazyMetadata *metadata, const char *path, FsearchLazyMetadataValues *values) {
+    g_assert(metadata);
+    g_assert(path);
+
+    const gint64 now = g_get_monotonic_time();
+    g_mutex_lock(&metadata->mutex);
+    CachedMetadata *cached = g_hash_table_lookup(metadata->cache, path);
+    const bool found = cached && is_fresh(cached, now);
+    if (found && values) {
+        *values = cached->values;
+    }
+    g_mutex_unlock(&metadata->mutex);
+    return found;
+}
+
+uint32_t
+fsearch_lazy_metadata_fetch(FsearchLazyMetadata *metadata,
+                            FsearchThreadPool *pool,
+                            const char *const *paths,
+                            uint32_t num_paths) {
+    g_assert(metadata);
+    g_assert(pool);
+    if (num_paths == 0) {
+        return 0;
+    }
+    g_assert(paths);
+
+    FsearchLazyMetadataFetchContext ctx = {
+        .paths = paths,
+        .missing = calloc(num_paths, sizeof(uint32_t)),
+        .values = calloc(num_paths, sizeof(FsearchLazyMetadataValues)),
+    };
+    g_assert(ctx.missing);
+    g_assert(ctx.values);
+
+    uint32_t num_missing = 0;
+    const gint64 now = g_get_monotonic_time();
+    g_mutex_lock(&metadata->mutex);
+    for (uint32_t i = 0; i < num_paths; i++) {
+        CachedMetadata *cached = g_hash_table_lookup(metadata->cache, paths[i]);
+        if (!cached || !is_fresh(cached, now)) {
+            ctx.missing[num_missing++] = i;
+        }
+    }
+    g_mutex_unlock(&metadata->mutex);
+
+    // the lookups mostly wait for the filesystem, so they're spread over the threads even for a single viewport
+    if (num_missing > FSEARCH_LAZY_METADATA_BATCH_SIZE) {
+        fsearch_thread_pool_parallel_for(pool, num_missing, FSEARCH_LAZY_METADATA_BATCH_SIZE, fetch_range, &ctx, NULL);
+    }
+    else {
+        fetch_range(0, num_missing, &ctx);
+    }
+
+    const gint64 fetch_time = g_get_monotonic_time();
+    g_mutex_lock(&metadata->mutex);
+    if (g_hash_table_size(metadata->cache) + num_missing > metadata->max_entries) {
+        g_hash_table_remove_all(metadata->cache);
+    }
+    for (uint32_t i = 0; i < num_missing; i++) {
+        CachedMetadata *cached = calloc(1, sizeof(CachedMetadata));
+        g_assert(cached);
+        cached->values = ctx.values[i];
+        cached->fetch_time = fetch_time;
+        g_hash_table_insert(metadata->cache, g_strdup(paths[ctx.missing[i]]), cached);
+    }
+    g_mutex_unlock(&metadata->mutex);
+
+    g_clear_pointer(&ctx.missing, free);
+    g_clear_pointer(&ctx.values, free);
+    return num_missing;
+}
+
+uint32_t
+fsearch_lazy_metadata_get_num_cached(FsearchLazyMetadata *metadata) {
+    g_assert(metadata);
+    g_mutex_lock(&metadata->mutex);
+    const uint32_t num_cached = g_hash_table_size(metadata->cache);
+    g_mutex_unlock(&metadata->mutex);
+    return num_cached;
+}
+
+void
+fsearch_lazy_metadata_clear(FsearchLazyMetadata *metadata) {
+    g_assert(metadata);
+    g_mutex_lock(&metadata->mutex);
+    g_hash_table_remove_all(metadata->cache);
+    g_mutex_unlock(&metadata->mutex);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <glib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include "fsearch_thread_pool.h"
+
+// The metadata is fetched again once it's older than this (in seconds), the files might have changed since
+#define FSEARCH_LAZY_METADATA_MAX_AGE 60
+// The number of paths each thread takes at once
+#define FSEARCH_LAZY_METADATA_BATCH_SIZE 16
+
+// The sizes and modification times of files which aren't part of the index, looked up by their paths when they're
+// needed, e.g. for the rows which are shown
+typedef struct FsearchLazyMetadata FsearchLazyMetadata;
+
+typedef struct {
+    off_t size;
+    time_t mtime;
+    // the file doesn't exist anymore or can't be accessed
+    bool missing;
+} FsearchLazyMetadataValues;
+
+// Remembers the metadata of up to max_entries files, once there are more all of them are dropped
+FsearchLazyMetadata *
+fsearch_lazy_metadata_new(uint32_t max_entries);
+
+void
+fsearch_lazy_metadata_free(FsearchLazyMetadata *metadata);
+
+// Looks up the metadata of path, if it was fetched within FSEARCH_LAZY_METADATA_MAX_AGE seconds. Thread safe.
+bool
+fsearch_lazy_metadata_lookup(FsearchLazyMetadata *metadata, const char *path, FsearchLazyMetadataValues *values);
+
+// Fetches the metadata of those of paths which aren't cached, with batches of statx calls in parallel on pool. Returns
+// the number of files which were fetched. Thread safe.
+uint32_t
+fsearch_lazy_metadata_fetch(FsearchLazyMetadata *metadata,
+                            FsearchThreadPool *pool,
+                            const char *const *paths,
+                            uint32_t num_paths);
+
+uint32_t
+fsearch_lazy_metadata_get_num_cached(FsearchLazyMetadata *metadata);
+
+void
+fsearch_lazy_metadata_clear(FsearchLazyMetadata *metadata);
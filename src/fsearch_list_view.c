@@ -84,6 +84,9 @@ struct _FsearchListView {
     FsearchListViewDrawRowFunc draw_row_func;
     gpointer draw_row_func_data;
 
+    FsearchListViewDrawnFunc drawn_func;
+    gpointer drawn_func_data;
+
     FsearchListViewQueryTooltipFunc query_tooltip_func;
     gpointer query_tooltip_func_data;
 
@@ -575,7 +578,11 @@ fsearch_list_view_draw(GtkWidget *widget, cairo_t *cr) {
     }
 
     if (clip_rec.y + clip_rec.height > view->header_height) {
+        const gint64 start_time = view->drawn_func ? g_get_monotonic_time() : 0;
         fsearch_list_view_draw_list(widget, context, cr);
+        if (view->drawn_func) {
+            view->drawn_func((double)(g_get_monotonic_time() - start_time) / 1000, view->drawn_func_data);
+        }
     }
 
     if (clip_rec.y < view->header_height) {
@@ -2223,6 +2230,15 @@ fsearch_list_view_set_draw_row_func(FsearchListView *view,
     view->draw_row_func_data = draw_row_func_data;
 }
 
+void
+fsearch_list_view_set_drawn_func(FsearchListView *view, FsearchListViewDrawnFunc drawn_func, gpointer drawn_func_data) {
+    if (!view) {
+        return;
+    }
+    view->drawn_func = drawn_func;
+    view->drawn_func_data = drawn_func_data;
+}
+
 void
 fsearch_list_view_set_sort_func(FsearchListView *view, FsearchListViewSortFunc sort_func, gpointer sort_func_data) {
     if (!view) {
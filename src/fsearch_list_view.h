@@ -54,6 +54,9 @@ typedef void (*FsearchListViewDrawRowFunc)(cairo_t *cr,
 
 typedef void (*FsearchListViewSortFunc)(int sort_order, GtkSortType sort_type, gpointer user_data);
 
+// Called after the rows were drawn with how long that took in ms
+typedef void (*FsearchListViewDrawnFunc)(double duration, gpointer user_data);
+
 // selection handlers
 typedef gboolean (*FsearchListViewIsSelectedFunc)(int row_idx, gpointer user_data);
 typedef void (*FsearchListViewSelectFunc)(int row_idx, gpointer user_data);
@@ -137,3 +140,6 @@ fsearch_list_view_set_query_tooltip_func(FsearchListView *view,
 
 void
 fsearch_list_view_set_draw_row_func(FsearchListView *view, FsearchListViewDrawRowFunc func, gpointer func_data);
+
+void
+fsearch_list_view_set_drawn_func(FsearchListView *view, FsearchListViewDrawnFunc func, gpointer func_data);
@@ -2,6 +2,11 @@
 
 #include <glib.h>
 #include <stdio.h>
+#include <sys/mman.h>
+
+// The size of a huge page on x86_64 and most aarch64 kernels. Blocks which are backed by huge pages
+// are rounded up to a multiple of it, so no huge page is shared with other allocations.
+#define FSEARCH_MEMORY_POOL_HUGE_PAGE_SIZE (2 * 1024 * 1024)
 
 typedef struct FsearchMemoryPoolFreed {
     struct FsearchMemoryPoolFreed *next;
@@ -11,6 +16,10 @@ typedef struct {
     uint32_t num_used;
     uint32_t capacity;
     void *items;
+    // the number of bytes items points to
+    size_t size;
+    // items was mmap()ed instead of calloc()ed
+    bool is_mapped;
 } FsearchMemoryPoolBlock;
 
 struct FsearchMemoryPool {
@@ -19,18 +28,58 @@ struct FsearchMemoryPool {
     uint32_t block_size;
     size_t item_size;
     GDestroyNotify item_free_func;
+
+    bool use_huge_pages;
+    // MAP_HUGETLB failed once (usually because no huge pages are reserved), don't try it again
+    bool hugetlb_failed;
 };
 
-void
-fsearch_memory_pool_new_block(FsearchMemoryPool *pool) {
+static void *
+fsearch_memory_pool_map_huge_pages(FsearchMemoryPool *pool, size_t size) {
+    void *items = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (!pool->hugetlb_failed) {
+        items = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (items == MAP_FAILED) {
+            g_debug("[memory_pool] no huge pages available, fall back to transparent huge pages");
+            pool->hugetlb_failed = true;
+        }
+    }
+#endif
+    if (items == MAP_FAILED) {
+        items = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (items == MAP_FAILED) {
+            return NULL;
+        }
+#ifdef MADV_HUGEPAGE
+        madvise(items, size, MADV_HUGEPAGE);
+#endif
+    }
+    return items;
+}
+
+static void
+fsearch_memory_pool_new_block(FsearchMemoryPool *pool, uint32_t capacity) {
     FsearchMemoryPoolBlock *block = calloc(1, sizeof(FsearchMemoryPoolBlock));
     g_assert(block);
 
-    block->items = calloc(pool->block_size + 1, pool->item_size);
+    block->size = ((size_t)capacity + 1) * pool->item_size;
+    if (pool->use_huge_pages) {
+        // fill the last huge page with items instead of leaving it partially unused
+        const size_t page_mask = FSEARCH_MEMORY_POOL_HUGE_PAGE_SIZE - 1;
+        block->size = (block->size + page_mask) & ~page_mask;
+        capacity = MIN(block->size / pool->item_size - 1, UINT32_MAX);
+        // anonymous mappings are zero filled, just like calloc
+        block->items = fsearch_memory_pool_map_huge_pages(pool, block->size);
+        block->is_mapped = block->items != NULL;
+    }
+    if (!block->items) {
+        block->items = calloc(1, block->size);
+    }
     g_assert(block->items);
 
     block->num_used = 0;
-    block->capacity = pool->block_size;
+    block->capacity = capacity;
     pool->blocks = g_list_prepend(pool->blocks, block);
 }
 
@@ -41,14 +90,14 @@ fsearch_memory_pool_new(uint32_t block_size, size_t item_size, GDestroyNotify it
     pool->item_free_func = item_free_func;
     pool->block_size = block_size;
     pool->item_size = MAX(item_size, sizeof(FsearchMemoryPoolFreed));
-    fsearch_memory_pool_new_block(pool);
+    fsearch_memory_pool_new_block(pool, pool->block_size);
 
     return pool;
 }
 
 static void
-fsearch_memory_pool_free_block(FsearchMemoryPool *pool, FsearchMemoryPoolBlock *block) {
-    if (pool->item_free_func) {
+fsearch_memory_pool_free_block(FsearchMemoryPool *pool, FsearchMemoryPoolBlock *block, bool free_items) {
+    if (free_items && pool->item_free_func) {
         for (int i = 0; i < block->num_used; i++) {
             void *data = block->items + i * pool->item_size;
             if (!data) {
@@ -57,27 +106,89 @@ fsearch_memory_pool_free_block(FsearchMemoryPool *pool, FsearchMemoryPoolBlock *
             pool->item_free_func(data);
         }
     }
+    if (block->is_mapped) {
+        munmap(block->items, block->size);
+        block->items = NULL;
+    }
     g_clear_pointer(&block->items, free);
     g_clear_pointer(&block, free);
 }
 
-void
-fsearch_memory_pool_free_pool(FsearchMemoryPool *pool) {
-    if (!pool) {
-        return;
-    }
+static void
+fsearch_memory_pool_free_blocks(FsearchMemoryPool *pool, bool free_items) {
     for (GList *b = pool->blocks; b != NULL; b = b->next) {
         FsearchMemoryPoolBlock *block = b->data;
         g_assert(block);
-        fsearch_memory_pool_free_block(pool, g_steal_pointer(&block));
+        fsearch_memory_pool_free_block(pool, g_steal_pointer(&block), free_items);
     }
     pool->freed_items = NULL;
 
     g_clear_pointer(&pool->blocks, g_list_free);
+}
+
+void
+fsearch_memory_pool_free_pool(FsearchMemoryPool *pool) {
+    if (!pool) {
+        return;
+    }
+    fsearch_memory_pool_free_blocks(pool, true);
     g_clear_pointer(&pool, free);
 }
 
-bool
+void
+fsearch_memory_pool_reset(FsearchMemoryPool *pool) {
+    g_assert(pool);
+    fsearch_memory_pool_free_blocks(pool, false);
+    fsearch_memory_pool_new_block(pool, pool->block_size);
+}
+
+void
+fsearch_memory_pool_set_use_huge_pages(FsearchMemoryPool *pool, bool use_huge_pages) {
+    g_assert(pool);
+    pool->use_huge_pages = use_huge_pages;
+}
+
+void
+fsearch_memory_pool_reserve(FsearchMemoryPool *pool, uint32_t num_items) {
+    g_assert(pool);
+
+    FsearchMemoryPoolBlock *block = pool->blocks ? pool->blocks->data : NULL;
+    if (block && block->capacity - block->num_used >= num_items) {
+        return;
+    }
+    if (block && block->num_used == 0) {
+        // nothing was allocated from the current block yet, replace it with one which is large enough
+        fsearch_memory_pool_free_block(pool, block, false);
+        pool->blocks = g_list_delete_link(pool->blocks, pool->blocks);
+    }
+    fsearch_memory_pool_new_block(pool, MAX(num_items, pool->block_size));
+}
+
+void
+fsearch_memory_pool_merge(FsearchMemoryPool *pool, FsearchMemoryPool *other) {
+    g_assert(pool);
+    if (!other) {
+        return;
+    }
+    g_assert(pool->item_size == other->item_size);
+    g_assert(pool->item_free_func == other->item_free_func);
+
+    // append the blocks, so the head of pool->blocks stays the one which is used for new allocations
+    pool->blocks = g_list_concat(pool->blocks, g_steal_pointer(&other->blocks));
+
+    if (other->freed_items) {
+        FsearchMemoryPoolFreed *last = other->freed_items;
+        while (last->next) {
+            last = last->next;
+        }
+        last->next = pool->freed_items;
+        pool->freed_items = g_steal_pointer(&other->freed_items);
+    }
+
+    g_clear_pointer(&other, free);
+}
+
+static bool
 fsearch_memory_pool_is_block_full(FsearchMemoryPool *pool) {
     FsearchMemoryPoolBlock *block = pool->blocks->data;
     g_assert(block);
@@ -100,6 +211,19 @@ fsearch_memory_pool_free(FsearchMemoryPool *pool, void *item, bool item_clear) {
     pool->freed_items->next = freed_items;
 }
 
+size_t
+fsearch_memory_pool_get_memory_size(FsearchMemoryPool *pool) {
+    if (!pool) {
+        return 0;
+    }
+    size_t size = sizeof(FsearchMemoryPool);
+    for (GList *b = pool->blocks; b != NULL; b = b->next) {
+        FsearchMemoryPoolBlock *block = b->data;
+        size += sizeof(FsearchMemoryPoolBlock) + block->size;
+    }
+    return size;
+}
+
 void *
 fsearch_memory_pool_malloc(FsearchMemoryPool *pool) {
     if (!pool) {
@@ -112,10 +236,25 @@ fsearch_memory_pool_malloc(FsearchMemoryPool *pool) {
     }
 
     if (!pool->blocks || fsearch_memory_pool_is_block_full(pool)) {
-        fsearch_memory_pool_new_block(pool);
+        fsearch_memory_pool_new_block(pool, pool->block_size);
     }
     FsearchMemoryPoolBlock *block = pool->blocks->data;
     g_assert(block);
 
     return block->items + block->num_used++ * pool->item_size;
 }
+
+void *
+fsearch_memory_pool_malloc_items(FsearchMemoryPool *pool, uint32_t num_items) {
+    g_assert(pool);
+
+    // the unused part of a block was never handed out, so it's still zero filled
+    fsearch_memory_pool_reserve(pool, num_items);
+    FsearchMemoryPoolBlock *block = pool->blocks->data;
+    g_assert(block);
+    g_assert(block->capacity - block->num_used >= num_items);
+
+    void *items = block->items + block->num_used * pool->item_size;
+    block->num_used += num_items;
+    return items;
+}
@@ -16,5 +16,33 @@ fsearch_memory_pool_free(FsearchMemoryPool *pool, void *item, bool item_clear);
 void
 fsearch_memory_pool_free_pool(FsearchMemoryPool *pool);
 
+// Releases all items at once, without calling the item free function for each of them.
+// Only use this when the items don't own any memory (i.e. their names live in a string arena).
+void
+fsearch_memory_pool_reset(FsearchMemoryPool *pool);
+
+// Back new blocks with (transparent) huge pages to reduce the TLB misses of walking all items.
+// Blocks get rounded up to a multiple of the huge page size, so this is only worth it for large pools.
+void
+fsearch_memory_pool_set_use_huge_pages(FsearchMemoryPool *pool, bool use_huge_pages);
+
+// Makes sure the next num_items allocations don't need more than one new block
+void
+fsearch_memory_pool_reserve(FsearchMemoryPool *pool, uint32_t num_items);
+
+// Moves all blocks (and the items they hold) of other into pool and frees other.
+// Both pools must have been created with the same item size and free function.
+void
+fsearch_memory_pool_merge(FsearchMemoryPool *pool, FsearchMemoryPool *other);
+
 void *
 fsearch_memory_pool_malloc(FsearchMemoryPool *pool);
+
+// Allocates num_items zero filled items which follow each other in one block, the item at position i is
+// item_size * i bytes after the returned one. They don't reuse freed items, but can be freed one by one.
+void *
+fsearch_memory_pool_malloc_items(FsearchMemoryPool *pool, uint32_t num_items);
+
+// The number of bytes allocated by the pool, including the free items of its blocks
+size_t
+fsearch_memory_pool_get_memory_size(FsearchMemoryPool *pool);
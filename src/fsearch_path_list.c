@@ -0,0 +1,124 @@
+#include "fsearch_path_list.h"
+
+#include "fsearch_limits.h"
+#include "fsearch_thread_pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// The entries are built in chunks of that many, each chunk is built by one task
+#define PATH_LIST_CHUNK_SIZE 8192
+// The characters besides the unreserved ones which g_filename_to_uri doesn't escape
+#define PATH_LIST_URI_ALLOWED_CHARS "!$&'()*+,=:@/"
+
+typedef struct {
+    DynamicArray *entries;
+    const FsearchDatabaseFolderPaths *folder_paths;
+    FsearchPathListFormat format;
+    const char *separator;
+    GString **chunks;
+} FsearchPathListContext;
+
+static void
+append_full_path(FsearchPathListContext *ctx, FsearchDatabaseEntry *entry, GString *str) {
+    if (ctx->folder_paths) {
+        db_folder_paths_append_full_path(ctx->folder_paths, entry, str);
+    }
+    else {
+        db_entry_append_full_path(entry, str);
+    }
+}
+
+static void
+append_entry(FsearchPathListContext *ctx, FsearchDatabaseEntry *entry, GString *path, GString *chunk) {
+    switch (ctx->format) {
+    case FSEARCH_PATH_LIST_FULL_PATHS:
+        append_full_path(ctx, entry, chunk);
+        break;
+    case FSEARCH_PATH_LIST_PATHS:
+        if (ctx->folder_paths) {
+            db_folder_paths_append_path(ctx->folder_paths, entry, chunk);
+        }
+        else {
+            db_entry_append_path(entry, chunk);
+        }
+        break;
+    case FSEARCH_PATH_LIST_NAMES:
+        g_string_append(chunk, db_entry_get_name_raw_for_display(entry));
+        break;
+    case FSEARCH_PATH_LIST_URIS:
+        g_string_truncate(path, 0);
+        append_full_path(ctx, entry, path);
+        g_string_append(chunk, "file://");
+        g_string_append_uri_escaped(chunk, path->str, PATH_LIST_URI_ALLOWED_CHARS, FALSE);
+        break;
+    }
+}
+
+static void
+build_chunks(uint32_t start, uint32_t end, void *data) {
+    FsearchPathListContext *ctx = data;
+    const uint32_t num_entries = darray_get_num_items(ctx->entries);
+    // reused for the paths of all entries of the task
+    g_autoptr(GString) path = g_string_sized_new(PATH_MAX);
+    for (uint32_t c = start; c < end; c++) {
+        const uint32_t first = c * PATH_LIST_CHUNK_SIZE;
+        const uint32_t last = MIN(first + PATH_LIST_CHUNK_SIZE, num_entries);
+        GString *chunk = g_string_sized_new((gsize)(last - first) * 64);
+        for (uint32_t i = first; i < last; i++) {
+            // the separators go in front of the entries, so the chunks only need to be joined
+            if (i > 0) {
+                g_string_append(chunk, ctx->separator);
+            }
+            append_entry(ctx, darray_get_item(ctx->entries, i), path, chunk);
+        }
+        ctx->chunks[c] = chunk;
+    }
+}
+
+void
+fsearch_path_list_append(GString *str,
+                         DynamicArray *entries,
+                         const FsearchDatabaseFolderPaths *folder_paths,
+                         FsearchPathListFormat format,
+                         const char *separator) {
+    g_assert(str);
+    g_assert(entries);
+    g_assert(separator);
+
+    const uint32_t num_entries = darray_get_num_items(entries);
+    const uint32_t num_chunks = (num_entries + PATH_LIST_CHUNK_SIZE - 1) / PATH_LIST_CHUNK_SIZE;
+    if (num_chunks == 0) {
+        return;
+    }
+    FsearchPathListContext ctx = {
+        .entries = entries,
+        .folder_paths = folder_paths,
+        .format = format,
+        .separator = separator,
+        .chunks = calloc(num_chunks, sizeof(GString *)),
+    };
+    g_assert(ctx.chunks);
+    if (num_chunks == 1) {
+        build_chunks(0, 1, &ctx);
+    }
+    else {
+        FsearchThreadPool *pool = fsearch_thread_pool_get_default();
+        fsearch_thread_pool_parallel_for(pool, num_chunks, 1, build_chunks, &ctx, NULL);
+        g_clear_pointer(&pool, fsearch_thread_pool_unref);
+    }
+
+    size_t len = 0;
+    for (uint32_t c = 0; c < num_chunks; c++) {
+        len += ctx.chunks[c]->len;
+    }
+    // str grows only once
+    size_t offset = str->len;
+    g_string_set_size(str, offset + len);
+    for (uint32_t c = 0; c < num_chunks; c++) {
+        memcpy(str->str + offset, ctx.chunks[c]->str, ctx.chunks[c]->len);
+        offset += ctx.chunks[c]->len;
+        g_string_free(g_steal_pointer(&ctx.chunks[c]), TRUE);
+    }
+    g_clear_pointer(&ctx.chunks, free);
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "fsearch_array.h"
+#include "fsearch_database_columns.h"
+#include "fsearch_database_entry.h"
+
+#include <glib.h>
+
+typedef enum {
+    FSEARCH_PATH_LIST_FULL_PATHS,
+    FSEARCH_PATH_LIST_PATHS,
+    FSEARCH_PATH_LIST_NAMES,
+    // file:// URIs of the full paths, like g_filename_to_uri builds them
+    FSEARCH_PATH_LIST_URIS,
+} FsearchPathListFormat;
+
+// Appends the text of all entries in the given format to str, in their order and with separator between them. Large
+// arrays are split into chunks which are built in parallel by the default pool, each task reuses one buffer for the
+// paths and takes the paths of the parents from folder_paths (which can be NULL).
+void
+fsearch_path_list_append(GString *str,
+                         DynamicArray *entries,
+                         const FsearchDatabaseFolderPaths *folder_paths,
+                         FsearchPathListFormat format,
+                         const char *separator);
@@ -0,0 +1,69 @@
+#include "fsearch_path_writer.h"
+
+#include "fsearch_limits.h"
+
+#include <errno.h>
+#include <glib.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// The buffer gets written once it holds that many bytes
+#define PATH_WRITER_BUFFER_SIZE (256 * 1024)
+
+struct FsearchPathWriter {
+    int fd;
+    char separator;
+    bool failed;
+    GString *buffer;
+};
+
+FsearchPathWriter *
+fsearch_path_writer_new(int fd, char separator) {
+    FsearchPathWriter *writer = calloc(1, sizeof(FsearchPathWriter));
+    g_assert(writer);
+    writer->fd = fd;
+    writer->separator = separator;
+    // room for the path which goes past the flush threshold
+    writer->buffer = g_string_sized_new(PATH_WRITER_BUFFER_SIZE + PATH_MAX);
+    return writer;
+}
+
+void
+fsearch_path_writer_free(FsearchPathWriter *writer) {
+    if (!writer) {
+        return;
+    }
+    g_string_free(g_steal_pointer(&writer->buffer), TRUE);
+    g_clear_pointer(&writer, free);
+}
+
+bool
+fsearch_path_writer_flush(FsearchPathWriter *writer) {
+    g_assert(writer);
+    size_t written = 0;
+    while (!writer->failed && written < writer->buffer->len) {
+        const ssize_t res = write(writer->fd, writer->buffer->str + written, writer->buffer->len - written);
+        if (res < 0 && errno != EINTR) {
+            writer->failed = true;
+        }
+        else if (res > 0) {
+            written += res;
+        }
+    }
+    g_string_truncate(writer->buffer, 0);
+    return !writer->failed;
+}
+
+bool
+fsearch_path_writer_append(FsearchPathWriter *writer, FsearchDatabaseEntry *entry) {
+    g_assert(writer);
+    if (writer->failed) {
+        return false;
+    }
+    db_entry_append_full_path(entry, writer->buffer);
+    g_string_append_c(writer->buffer, writer->separator);
+    if (writer->buffer->len >= PATH_WRITER_BUFFER_SIZE) {
+        return fsearch_path_writer_flush(writer);
+    }
+    return true;
+}
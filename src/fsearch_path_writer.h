@@ -0,0 +1,23 @@
+#pragma once
+
+#include "fsearch_database_entry.h"
+
+#include <stdbool.h>
+
+// Writes the full paths of entries to a file descriptor, each followed by a separator (e.g. '\n' or '\0'). The paths
+// are built right in a large buffer which gets written when it's full, so no memory is allocated per entry.
+typedef struct FsearchPathWriter FsearchPathWriter;
+
+FsearchPathWriter *
+fsearch_path_writer_new(int fd, char separator);
+
+// Doesn't flush the buffer
+void
+fsearch_path_writer_free(FsearchPathWriter *writer);
+
+// Returns false once writing failed, e.g. because the reading end of a pipe was closed
+bool
+fsearch_path_writer_append(FsearchPathWriter *writer, FsearchDatabaseEntry *entry);
+
+bool
+fsearch_path_writer_flush(FsearchPathWriter *writer);
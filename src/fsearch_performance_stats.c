@@ -0,0 +1,64 @@
+#include "fsearch_performance_stats.h"
+
+// the weight of a new time in the moving averages
+#define TIMING_AVERAGE_WEIGHT 0.1
+
+void
+fsearch_performance_stats_add_timing(FsearchPerformanceStats *stats, FsearchPerformanceTiming timing, double ms) {
+    g_assert(stats);
+    g_assert(timing >= 0 && timing < NUM_FSEARCH_PERFORMANCE_TIMINGS);
+
+    FsearchPerformanceTimingStats *t = &stats->timings[timing];
+    t->last = ms;
+    t->average = t->count ? (1 - TIMING_AVERAGE_WEIGHT) * t->average + TIMING_AVERAGE_WEIGHT * ms : ms;
+    t->count++;
+}
+
+void
+fsearch_performance_stats_add_row_cache_lookup(FsearchPerformanceStats *stats, bool hit) {
+    g_assert(stats);
+    if (hit) {
+        stats->num_row_cache_hits++;
+    }
+    else {
+        stats->num_row_cache_misses++;
+    }
+}
+
+double
+fsearch_performance_stats_get_row_cache_hit_rate(FsearchPerformanceStats *stats) {
+    g_assert(stats);
+    const uint64_t num_lookups = stats->num_row_cache_hits + stats->num_row_cache_misses;
+    return num_lookups ? (double)stats->num_row_cache_hits / (double)num_lookups : 0;
+}
+
+GString *
+fsearch_performance_stats_to_string(FsearchPerformanceStats *stats) {
+    g_assert(stats);
+
+    const char *names[NUM_FSEARCH_PERFORMANCE_TIMINGS] = {
+        [FSEARCH_PERFORMANCE_TIMING_INPUT_LATENCY] = "Input to results",
+        [FSEARCH_PERFORMANCE_TIMING_SEARCH] = "Search",
+        [FSEARCH_PERFORMANCE_TIMING_MERGE] = "Merge",
+        [FSEARCH_PERFORMANCE_TIMING_SORT] = "Sort",
+        [FSEARCH_PERFORMANCE_TIMING_FRAME] = "Frame",
+    };
+    GString *str = g_string_new(NULL);
+    for (uint32_t i = 0; i < NUM_FSEARCH_PERFORMANCE_TIMINGS; i++) {
+        FsearchPerformanceTimingStats *t = &stats->timings[i];
+        if (str->len) {
+            g_string_append(str, " · ");
+        }
+        if (t->count) {
+            g_string_append_printf(str, "%s %.1f ms (avg %.1f)", names[i], t->last, t->average);
+        }
+        else {
+            g_string_append_printf(str, "%s –", names[i]);
+        }
+    }
+    g_string_append_printf(str,
+                           " · Row cache %.0f%% of %" G_GUINT64_FORMAT,
+                           100 * fsearch_performance_stats_get_row_cache_hit_rate(stats),
+                           stats->num_row_cache_hits + stats->num_row_cache_misses);
+    return str;
+}
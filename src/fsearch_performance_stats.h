@@ -0,0 +1,46 @@
+#pragma once
+
+#include <glib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// How responsive the interface of a window is, for the performance panel of its statusbar. It's only used on the main
+// thread.
+typedef enum {
+    // from a change of the query text until its results are shown
+    FSEARCH_PERFORMANCE_TIMING_INPUT_LATENCY,
+    FSEARCH_PERFORMANCE_TIMING_SEARCH,
+    // collecting the matches of a search into its results, it's part of the search
+    FSEARCH_PERFORMANCE_TIMING_MERGE,
+    FSEARCH_PERFORMANCE_TIMING_SORT,
+    // drawing the list of results once
+    FSEARCH_PERFORMANCE_TIMING_FRAME,
+    NUM_FSEARCH_PERFORMANCE_TIMINGS,
+} FsearchPerformanceTiming;
+
+typedef struct FsearchPerformanceTimingStats {
+    // in ms, the average is a moving one
+    double last;
+    double average;
+    uint64_t count;
+} FsearchPerformanceTimingStats;
+
+typedef struct FsearchPerformanceStats {
+    FsearchPerformanceTimingStats timings[NUM_FSEARCH_PERFORMANCE_TIMINGS];
+    uint64_t num_row_cache_hits;
+    uint64_t num_row_cache_misses;
+} FsearchPerformanceStats;
+
+void
+fsearch_performance_stats_add_timing(FsearchPerformanceStats *stats, FsearchPerformanceTiming timing, double ms);
+
+void
+fsearch_performance_stats_add_row_cache_lookup(FsearchPerformanceStats *stats, bool hit);
+
+// The share of the row lookups which were answered by the row cache, 0 if there were none
+double
+fsearch_performance_stats_get_row_cache_hit_rate(FsearchPerformanceStats *stats);
+
+// A single line with the last and the average time of everything which was measured
+GString *
+fsearch_performance_stats_to_string(FsearchPerformanceStats *stats);
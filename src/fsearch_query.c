@@ -19,9 +19,60 @@
 #include "fsearch_query.h"
 #include "fsearch_database_entry.h"
 #include "fsearch_string_utils.h"
+#include "fsearch_trace.h"
 #include <stdlib.h>
 #include <string.h>
 
+struct FsearchQueryCompiledFilter {
+    GNode *tree;
+    FsearchQueryProgram *program;
+
+    volatile int ref_count;
+};
+
+FsearchQueryCompiledFilter *
+fsearch_query_compiled_filter_ref(FsearchQueryCompiledFilter *compiled) {
+    g_atomic_int_inc(&compiled->ref_count);
+    return compiled;
+}
+
+void
+fsearch_query_compiled_filter_unref(FsearchQueryCompiledFilter *compiled) {
+    if (!g_atomic_int_dec_and_test(&compiled->ref_count)) {
+        return;
+    }
+    g_clear_pointer(&compiled->program, fsearch_query_program_free);
+    g_clear_pointer(&compiled->tree, fsearch_query_node_tree_free);
+    g_clear_pointer(&compiled, free);
+}
+
+// Parsing the filter and compiling its regular expressions again for every key press would be a waste, so the
+// compiled filter is cached by the filter manager until its filters change
+static FsearchQueryCompiledFilter *
+get_compiled_filter(FsearchFilter *filter, FsearchFilterManager *filters) {
+    FsearchQueryCompiledFilter *compiled =
+        filters ? fsearch_filter_manager_lookup_compiled(filters, filter, (FsearchFilterCompiledRefFunc *)fsearch_query_compiled_filter_ref) : NULL;
+    if (compiled) {
+        return compiled;
+    }
+
+    compiled = calloc(1, sizeof(FsearchQueryCompiledFilter));
+    g_assert(compiled);
+    compiled->ref_count = 1;
+    compiled->tree = fsearch_query_node_tree_new(filter->query, filters, filter->flags);
+    fsearch_query_node_tree_plan(compiled->tree);
+    if (compiled->tree) {
+        compiled->program = fsearch_query_program_new(compiled->tree);
+    }
+    if (filters) {
+        fsearch_filter_manager_cache_compiled(filters,
+                                              filter,
+                                              fsearch_query_compiled_filter_ref(compiled),
+                                              (GDestroyNotify)fsearch_query_compiled_filter_unref);
+    }
+    return compiled;
+}
+
 FsearchQuery *
 fsearch_query_new(const char *search_term,
                   FsearchFilter *filter,
@@ -31,22 +82,65 @@ fsearch_query_new(const char *search_term,
     FsearchQuery *q = calloc(1, sizeof(FsearchQuery));
     g_assert(q);
 
+    const gint64 start_time = g_get_monotonic_time();
     q->search_term = search_term ? strdup(search_term) : "";
+    FSEARCH_TRACE1(query_compile_start, q->search_term);
 
     q->query_tree = fsearch_query_node_tree_new(q->search_term, filters, flags);
+    fsearch_query_node_tree_plan(q->query_tree);
     if (q->query_tree) {
         q->triggers_auto_match_case = fsearch_query_node_tree_triggers_auto_match_case(q->query_tree);
         q->triggers_auto_match_path = fsearch_query_node_tree_triggers_auto_match_path(q->query_tree);
         q->wants_single_threaded_search = fsearch_query_node_tree_wants_single_threaded_search(q->query_tree);
+        q->wants_columns = fsearch_query_node_tree_wants_columns(q->query_tree);
+        q->wants_folder_paths = fsearch_query_node_tree_wants_folder_paths(q->query_tree);
+        q->wants_folded_names = fsearch_query_node_tree_wants_folded_names(q->query_tree);
+        q->wants_extensions = fsearch_query_node_tree_wants_extensions(q->query_tree);
+        q->wants_duplicates = fsearch_query_node_tree_wants_duplicates(q->query_tree);
+        q->wants_metadata = fsearch_query_node_tree_wants_metadata(q->query_tree);
+        q->wants_trigrams = fsearch_query_node_tree_wants_trigrams(q->query_tree);
+        q->wants_sorted_entries = fsearch_query_node_tree_wants_sorted_entries(q->query_tree);
     }
 
     if (filter && filter->query) {
-        q->filter_tree = fsearch_query_node_tree_new(filter->query, filters, filter->flags);
+        q->compiled_filter = get_compiled_filter(filter, filters);
+        q->filter_tree = q->compiled_filter->tree;
+        q->filter_program = q->compiled_filter->program;
+        if (q->filter_tree && fsearch_query_node_tree_wants_columns(q->filter_tree)) {
+            q->wants_columns = true;
+        }
+        if (q->filter_tree && fsearch_query_node_tree_wants_folder_paths(q->filter_tree)) {
+            q->wants_folder_paths = true;
+        }
+        if (q->filter_tree && fsearch_query_node_tree_wants_folded_names(q->filter_tree)) {
+            q->wants_folded_names = true;
+        }
+        if (q->filter_tree && fsearch_query_node_tree_wants_extensions(q->filter_tree)) {
+            q->wants_extensions = true;
+        }
+        if (q->filter_tree && fsearch_query_node_tree_wants_duplicates(q->filter_tree)) {
+            q->wants_duplicates = true;
+        }
+        if (q->filter_tree && fsearch_query_node_tree_wants_metadata(q->filter_tree)) {
+            q->wants_metadata = true;
+        }
+        if (q->filter_tree && fsearch_query_node_tree_wants_trigrams(q->filter_tree)) {
+            q->wants_trigrams = true;
+        }
+        if (q->filter_tree && fsearch_query_node_tree_wants_sorted_entries(q->filter_tree)) {
+            q->wants_sorted_entries = true;
+        }
+    }
+
+    if (q->query_tree) {
+        q->query_program = fsearch_query_program_new(q->query_tree);
     }
 
     q->filter = fsearch_filter_ref(filter);
     q->flags = flags;
     q->query_id = strdup(query_id ? query_id : "[missing_id]");
+    q->parse_time = (double)(g_get_monotonic_time() - start_time) / 1000;
+    FSEARCH_TRACE2(query_compile_end, q->search_term, (int64_t)(q->parse_time * 1000));
     q->ref_count = 1;
     return q;
 }
@@ -56,7 +150,11 @@ fsearch_query_free(FsearchQuery *query) {
     g_clear_pointer(&query->query_id, free);
     g_clear_pointer(&query->filter, fsearch_filter_unref);
     g_clear_pointer(&query->search_term, free);
+    g_clear_pointer(&query->query_program, fsearch_query_program_free);
     g_clear_pointer(&query->query_tree, fsearch_query_node_tree_free);
+    query->filter_tree = NULL;
+    query->filter_program = NULL;
+    g_clear_pointer(&query->compiled_filter, fsearch_query_compiled_filter_unref);
     g_clear_pointer(&query, free);
 }
 
@@ -88,43 +186,92 @@ fsearch_query_matches_everything(FsearchQuery *query) {
     return false;
 }
 
+// Whether the query text consists only of words which every entry must contain (separated by spaces). Fields,
+// operators, wildcards, quotes and paths would change the meaning of a word when more characters get appended.
 static bool
-highlight(GNode *node, FsearchDatabaseEntry *entry, FsearchQueryMatchData *match_data, FsearchDatabaseEntryType type) {
-    if (!node) {
-        return true;
-    }
-    FsearchQueryNode *n = node->data;
-    if (!n) {
+is_plain_word_list(const char *text) {
+    if (strpbrk(text, ":=<>()!|&*?\"\\/\t\n")) {
         return false;
     }
-    if (n->type == FSEARCH_QUERY_NODE_TYPE_OPERATOR) {
-        GNode *left = node->children;
-        g_assert(left);
-        GNode *right = left->next;
-        if (n->operator== FSEARCH_QUERY_NODE_OPERATOR_AND) {
-            return highlight(left, entry, match_data, type) && highlight(right, entry, match_data, type);
-        }
-        else if (n->operator== FSEARCH_QUERY_NODE_OPERATOR_OR) {
-            return highlight(left, entry, match_data, type) || highlight(right, entry, match_data, type);
-        }
-        else {
-            return !highlight(left, entry, match_data, type);
-        }
-    }
-    else {
-        if (n->flags & QUERY_FLAG_FOLDERS_ONLY && type != DATABASE_ENTRY_TYPE_FOLDER) {
-            return false;
-        }
-        if (n->flags & QUERY_FLAG_FILES_ONLY && type != DATABASE_ENTRY_TYPE_FILE) {
+    g_auto(GStrv) words = g_strsplit(text, " ", -1);
+    for (uint32_t i = 0; words[i]; i++) {
+        if (!strcmp(words[i], "NOT") || !strcmp(words[i], "AND") || !strcmp(words[i], "OR")) {
             return false;
         }
+    }
+    return true;
+}
 
-        return n->highlight_func ? n->highlight_func(n, match_data) : false;
+bool
+fsearch_query_is_refinement_of(FsearchQuery *query, FsearchQuery *previous) {
+    if (!query || !previous || !query->query_tree || !previous->query_tree) {
+        return false;
+    }
+    if (query->flags != previous->flags || query->filter != previous->filter
+        || (query->flags & (QUERY_FLAG_REGEX | QUERY_FLAG_EXACT_MATCH))) {
+        return false;
+    }
+    // the results of a limited search aren't all entries which match it
+    if (previous->limit) {
+        return false;
+    }
+    if (query->triggers_auto_match_case != previous->triggers_auto_match_case
+        || query->triggers_auto_match_path != previous->triggers_auto_match_path) {
+        return false;
+    }
+    if (fsearch_string_is_empty(previous->search_term) || strlen(query->search_term) <= strlen(previous->search_term)
+        || !g_str_has_prefix(query->search_term, previous->search_term)) {
+        return false;
+    }
+    // Appending characters to the last word or more words to the list can only remove matches:
+    // every entry which contains "foob" (and "bar") also contains "foo".
+    return is_plain_word_list(query->search_term);
+}
+
+void
+fsearch_query_set_extensions(FsearchQuery *query, FsearchDatabaseExtensions *extensions) {
+    g_assert(query);
+    if (!query->wants_extensions) {
+        return;
+    }
+    if (query->query_tree) {
+        fsearch_query_node_tree_set_extensions(query->query_tree, extensions);
+    }
+    if (query->filter_tree) {
+        fsearch_query_node_tree_set_extensions(query->filter_tree, extensions);
+    }
+}
+
+void
+fsearch_query_set_duplicates(FsearchQuery *query, FsearchDuplicates *duplicates) {
+    g_assert(query);
+    if (!query->wants_duplicates) {
+        return;
+    }
+    if (query->query_tree) {
+        fsearch_query_node_tree_set_duplicates(query->query_tree, duplicates);
+    }
+    if (query->filter_tree) {
+        fsearch_query_node_tree_set_duplicates(query->filter_tree, duplicates);
+    }
+}
+
+void
+fsearch_query_set_folder_paths(FsearchQuery *query, FsearchDatabaseFolderPaths *folder_paths) {
+    g_assert(query);
+    if (!query->wants_folder_paths) {
+        return;
+    }
+    if (query->query_tree) {
+        fsearch_query_node_tree_set_folder_paths(query->query_tree, folder_paths);
+    }
+    if (query->filter_tree) {
+        fsearch_query_node_tree_set_folder_paths(query->filter_tree, folder_paths);
     }
 }
 
 static bool
-matches(GNode *node, FsearchDatabaseEntry *entry, FsearchQueryMatchData *match_data, FsearchDatabaseEntryType type) {
+highlight(GNode *node, FsearchDatabaseEntry *entry, FsearchQueryMatchData *match_data, FsearchDatabaseEntryType type) {
     if (!node) {
         return true;
     }
@@ -136,14 +283,19 @@ matches(GNode *node, FsearchDatabaseEntry *entry, FsearchQueryMatchData *match_d
         GNode *left = node->children;
         g_assert(left);
         GNode *right = left->next;
+        if (n->operands_swapped) {
+            GNode *tmp = left;
+            left = right;
+            right = tmp;
+        }
         if (n->operator== FSEARCH_QUERY_NODE_OPERATOR_AND) {
-            return matches(left, entry, match_data, type) && matches(right, entry, match_data, type);
+            return highlight(left, entry, match_data, type) && highlight(right, entry, match_data, type);
         }
         else if (n->operator== FSEARCH_QUERY_NODE_OPERATOR_OR) {
-            return matches(left, entry, match_data, type) || matches(right, entry, match_data, type);
+            return highlight(left, entry, match_data, type) || highlight(right, entry, match_data, type);
         }
         else {
-            return !matches(left, entry, match_data, type);
+            return !highlight(left, entry, match_data, type);
         }
     }
     else {
@@ -154,21 +306,23 @@ matches(GNode *node, FsearchDatabaseEntry *entry, FsearchQueryMatchData *match_d
             return false;
         }
 
-        return n->search_func(n, match_data);
+        return n->highlight_func ? n->highlight_func(n, match_data) : false;
     }
 }
 
 static bool
-filter_entry(FsearchDatabaseEntry *entry, FsearchQueryMatchData *match_data, FsearchQuery *query) {
-    if (!query->filter) {
-        return true;
-    }
-    if (query->filter->query == NULL || fsearch_string_is_empty(query->filter->query)) {
-        return true;
-    }
-    FsearchDatabaseEntryType type = db_entry_get_type(entry);
-    if (query->filter_tree) {
-        return matches(query->filter_tree, entry, match_data, type);
+has_filter(FsearchQuery *query) {
+    return query->filter && query->filter->query && !fsearch_string_is_empty(query->filter->query)
+        && query->filter_program;
+}
+
+static bool
+filter_entry(FsearchDatabaseEntry *entry,
+             FsearchQueryMatchData *match_data,
+             FsearchQuery *query,
+             FsearchDatabaseEntryType type) {
+    if (has_filter(query)) {
+        return fsearch_query_program_run(query->filter_program, match_data, type);
     }
     return true;
 }
@@ -180,10 +334,10 @@ fsearch_query_highlight(FsearchQuery *query, FsearchQueryMatchData *match_data)
         return false;
     }
 
-    FsearchDatabaseEntryType type = db_entry_get_type(entry);
+    FsearchDatabaseEntryType type = fsearch_query_match_data_get_entry_type(match_data);
     GNode *token = query->query_tree;
 
-    if (!filter_entry(entry, match_data, query)) {
+    if (!filter_entry(entry, match_data, query, type)) {
         return false;
     }
 
@@ -197,12 +351,41 @@ fsearch_query_match(FsearchQuery *query, FsearchQueryMatchData *match_data) {
         return false;
     }
 
-    FsearchDatabaseEntryType type = db_entry_get_type(entry);
-    GNode *token = query->query_tree;
+    FsearchDatabaseEntryType type = fsearch_query_match_data_get_entry_type(match_data);
 
-    if (!filter_entry(entry, match_data, query)) {
+    if (!filter_entry(entry, match_data, query, type)) {
         return false;
     }
 
-    return matches(token, entry, match_data, type);
+    return query->query_program ? fsearch_query_program_run(query->query_program, match_data, type) : true;
+}
+
+void
+fsearch_query_match_block(FsearchQuery *query,
+                          FsearchQueryMatchData *match_data,
+                          const FsearchQueryBlock *block,
+                          uint64_t *selection) {
+    fsearch_query_block_select_all(block, selection);
+    fsearch_query_match_filter_block(query, match_data, block, selection);
+    fsearch_query_match_block_without_filter(query, match_data, block, selection);
+}
+
+void
+fsearch_query_match_filter_block(FsearchQuery *query,
+                                 FsearchQueryMatchData *match_data,
+                                 const FsearchQueryBlock *block,
+                                 uint64_t *selection) {
+    if (has_filter(query)) {
+        fsearch_query_program_run_block(query->filter_program, match_data, block, selection);
+    }
+}
+
+void
+fsearch_query_match_block_without_filter(FsearchQuery *query,
+                                         FsearchQueryMatchData *match_data,
+                                         const FsearchQueryBlock *block,
+                                         uint64_t *selection) {
+    if (query->query_program) {
+        fsearch_query_program_run_block(query->query_program, match_data, block, selection);
+    }
 }
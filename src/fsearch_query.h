@@ -29,9 +29,14 @@
 #include "fsearch_query_flags.h"
 #include "fsearch_query_match_data.h"
 #include "fsearch_query_node.h"
+#include "fsearch_query_program.h"
 #include "fsearch_query_tree.h"
 #include "fsearch_thread_pool.h"
 
+// The tree and program of a filter, which is shared by the queries with the same filter, see
+// fsearch_filter_manager_cache_compiled
+typedef struct FsearchQueryCompiledFilter FsearchQueryCompiledFilter;
+
 typedef struct FsearchQuery {
     char *search_term;
 
@@ -40,6 +45,11 @@ typedef struct FsearchQuery {
 
     GNode *query_tree;
     GNode *filter_tree;
+    // the trees compiled for matching entries, the trees are still used for highlighting
+    FsearchQueryProgram *query_program;
+    FsearchQueryProgram *filter_program;
+    // owns filter_tree and filter_program, which are shared with the other queries of the filter
+    FsearchQueryCompiledFilter *compiled_filter;
 
     char *query_id;
 
@@ -48,6 +58,30 @@ typedef struct FsearchQuery {
     bool triggers_auto_match_case;
     bool triggers_auto_match_path;
     bool wants_single_threaded_search;
+    // it filters by size or modification time, which is faster with FsearchDatabaseColumns
+    bool wants_columns;
+    // it searches in paths, which is faster with FsearchDatabaseFolderPaths
+    bool wants_folder_paths;
+    // it searches case insensitive for non ASCII names, which is faster with FsearchDatabaseFoldedNames
+    bool wants_folded_names;
+    // it filters by extension, which is faster with FsearchDatabaseExtensions
+    bool wants_extensions;
+    // it filters by dupe:, which only matches with the FsearchDuplicates of the database
+    bool wants_duplicates;
+    // it filters by owner, permissions or one of the other timestamps, which only works with FsearchDatabaseMetadata
+    bool wants_metadata;
+    // every result has to contain a term of at least three bytes in its name, which is faster with
+    // FsearchDatabaseTrigrams
+    bool wants_trigrams;
+    // every result has to match a size or modification time filter, which is faster with the entries sorted by them
+    bool wants_sorted_entries;
+
+    // if it's not 0, searches only look for the first limit folders and files in the order of the searched arrays
+    // (i.e. the sort order of the results) and stop as soon as they're known
+    uint32_t limit;
+
+    // how long parsing and compiling the query took in ms, a filter which was compiled before doesn't add to it
+    double parse_time;
 
     volatile int ref_count;
 } FsearchQuery;
@@ -65,11 +99,62 @@ fsearch_query_ref(FsearchQuery *query);
 void
 fsearch_query_unref(FsearchQuery *query);
 
+FsearchQueryCompiledFilter *
+fsearch_query_compiled_filter_ref(FsearchQueryCompiledFilter *compiled);
+
+void
+fsearch_query_compiled_filter_unref(FsearchQueryCompiledFilter *compiled);
+
 bool
 fsearch_query_matches_everything(FsearchQuery *query);
 
+// Whether query can only match a subset of the entries previous matches, so it's enough to search the results of
+// previous instead of the whole database. This is the case when text was appended to a simple query, e.g. while
+// typing. False negatives are fine, false positives are not.
+bool
+fsearch_query_is_refinement_of(FsearchQuery *query, FsearchQuery *previous);
+
+// Prepares the extension filters of the query for a search with extensions (or without them if it's NULL). Must not
+// be called while the query, or another one with the same filter, is used for a search with other extensions.
+void
+fsearch_query_set_extensions(FsearchQuery *query, FsearchDatabaseExtensions *extensions);
+
+// Sets the duplicates the dupe: filters of the query match. Like fsearch_query_set_extensions, it must not be called
+// while the query is used for a search with other duplicates.
+void
+fsearch_query_set_duplicates(FsearchQuery *query, FsearchDuplicates *duplicates);
+
+// Lets the parent filters and path searches of the query remember their results for the folders of folder_paths
+// (or stops it if it's NULL), so they only match the path of a folder once. Must not be called while the query, or
+// another one with the same filter, is used for a search with other folder paths.
+void
+fsearch_query_set_folder_paths(FsearchQuery *query, FsearchDatabaseFolderPaths *folder_paths);
+
 bool
 fsearch_query_match(FsearchQuery *queyr, FsearchQueryMatchData *match_data);
 
+// Same as fsearch_query_match for every entry of block, the bits of the matches are set in selection.
+// match_data is left with an arbitrary entry of the block, or none.
+void
+fsearch_query_match_block(FsearchQuery *query,
+                          FsearchQueryMatchData *match_data,
+                          const FsearchQueryBlock *block,
+                          uint64_t *selection);
+
+// Deselects the entries of block which don't match the filter of query in selection
+void
+fsearch_query_match_filter_block(FsearchQuery *query,
+                                 FsearchQueryMatchData *match_data,
+                                 const FsearchQueryBlock *block,
+                                 uint64_t *selection);
+
+// Deselects the entries of block which don't match query in selection, without looking at its filter. That's for
+// searches which know the entries the filter matches already.
+void
+fsearch_query_match_block_without_filter(FsearchQuery *query,
+                                         FsearchQueryMatchData *match_data,
+                                         const FsearchQueryBlock *block,
+                                         uint64_t *selection);
+
 bool
 fsearch_query_highlight(FsearchQuery *query, FsearchQueryMatchData *match_data);
@@ -8,6 +8,12 @@
 
 struct FsearchQueryMatchData {
     FsearchDatabaseEntry *entry;
+    const FsearchDatabaseColumns *columns;
+    uint32_t column_idx;
+    const FsearchDatabaseFolderPaths *folder_paths;
+    const FsearchDatabaseFoldedNames *folded_names;
+    const FsearchDatabaseExtensions *extensions;
+    const FsearchDatabaseMetadata *metadata;
 
     FsearchUtfBuilder *utf_name_builder;
     FsearchUtfBuilder *utf_path_builder;
@@ -15,11 +21,10 @@ struct FsearchQueryMatchData {
     GString *path_buffer;
     GString *parent_path_buffer;
     GString *content_type_buffer;
+    pcre2_match_data *regex_match_data;
 
     PangoAttrList **highlights;
 
-    int32_t thread_id;
-
     bool utf_name_ready;
     bool utf_path_ready;
     bool utf_parent_path_ready;
@@ -72,7 +77,12 @@ fsearch_query_match_data_get_parent_path_str(FsearchQueryMatchData *match_data)
     }
     if (!match_data->parent_path_ready) {
         g_string_truncate(match_data->parent_path_buffer, 0);
-        db_entry_append_path(match_data->entry, match_data->parent_path_buffer);
+        if (match_data->folder_paths) {
+            db_folder_paths_append_path(match_data->folder_paths, match_data->entry, match_data->parent_path_buffer);
+        }
+        else {
+            db_entry_append_path(match_data->entry, match_data->parent_path_buffer);
+        }
 
         match_data->parent_path_ready = true;
     }
@@ -87,7 +97,12 @@ fsearch_query_match_data_get_path_str(FsearchQueryMatchData *match_data) {
     }
     if (!match_data->path_ready) {
         g_string_truncate(match_data->path_buffer, 0);
-        db_entry_append_full_path(match_data->entry, match_data->path_buffer);
+        if (match_data->folder_paths) {
+            db_folder_paths_append_full_path(match_data->folder_paths, match_data->entry, match_data->path_buffer);
+        }
+        else {
+            db_entry_append_full_path(match_data->entry, match_data->path_buffer);
+        }
 
         match_data->path_ready = true;
     }
@@ -115,6 +130,30 @@ fsearch_query_match_data_get_entry(FsearchQueryMatchData *match_data) {
     return match_data->entry;
 }
 
+FsearchDatabaseEntryType
+fsearch_query_match_data_get_entry_type(FsearchQueryMatchData *match_data) {
+    if (match_data->columns) {
+        return match_data->columns->type;
+    }
+    return db_entry_get_type(match_data->entry);
+}
+
+off_t
+fsearch_query_match_data_get_size(FsearchQueryMatchData *match_data) {
+    if (match_data->columns) {
+        return (off_t)match_data->columns->sizes[match_data->column_idx];
+    }
+    return db_entry_get_size(match_data->entry);
+}
+
+time_t
+fsearch_query_match_data_get_mtime(FsearchQueryMatchData *match_data) {
+    if (match_data->columns) {
+        return (time_t)match_data->columns->mtimes[match_data->column_idx];
+    }
+    return db_entry_get_mtime(match_data->entry);
+}
+
 FsearchQueryMatchData *
 fsearch_query_match_data_new(void) {
     FsearchQueryMatchData *match_data = calloc(1, sizeof(FsearchQueryMatchData));
@@ -142,6 +181,19 @@ fsearch_query_match_data_new(void) {
     return match_data;
 }
 
+size_t
+fsearch_query_match_data_get_memory_size(FsearchQueryMatchData *match_data) {
+    if (!match_data) {
+        return 0;
+    }
+    return sizeof(FsearchQueryMatchData) + 3 * sizeof(FsearchUtfBuilder)
+         + fsearch_utf_builder_get_memory_size(match_data->utf_name_builder)
+         + fsearch_utf_builder_get_memory_size(match_data->utf_path_builder)
+         + fsearch_utf_builder_get_memory_size(match_data->utf_parent_path_builder) + 3 * sizeof(GString)
+         + match_data->path_buffer->allocated_len + match_data->parent_path_buffer->allocated_len
+         + match_data->content_type_buffer->allocated_len + NUM_DATABASE_INDEX_TYPES * sizeof(PangoAttrList *);
+}
+
 static void
 free_highlights(FsearchQueryMatchData *match_data) {
     if (!match_data->has_highlights) {
@@ -174,6 +226,7 @@ fsearch_query_match_data_free(FsearchQueryMatchData *match_data) {
     g_string_free(g_steal_pointer(&match_data->path_buffer), TRUE);
     g_string_free(g_steal_pointer(&match_data->parent_path_buffer), TRUE);
     g_string_free(g_steal_pointer(&match_data->content_type_buffer), TRUE);
+    g_clear_pointer(&match_data->regex_match_data, pcre2_match_data_free);
 
     g_clear_pointer(&match_data, free);
 }
@@ -194,6 +247,85 @@ fsearch_query_match_data_set_entry(FsearchQueryMatchData *match_data, FsearchDat
     match_data->content_type_ready = false;
 
     match_data->entry = entry;
+    match_data->columns = NULL;
+}
+
+void
+fsearch_query_match_data_set_columns(FsearchQueryMatchData *match_data,
+                                     const FsearchDatabaseColumns *columns,
+                                     uint32_t idx) {
+    g_assert(!columns || idx < columns->num_entries);
+    match_data->columns = columns;
+    match_data->column_idx = idx;
+}
+
+void
+fsearch_query_match_data_set_folder_paths(FsearchQueryMatchData *match_data, const FsearchDatabaseFolderPaths *paths) {
+    match_data->folder_paths = paths;
+}
+
+const FsearchDatabaseFolderPaths *
+fsearch_query_match_data_get_folder_paths(FsearchQueryMatchData *match_data) {
+    return match_data->folder_paths;
+}
+
+void
+fsearch_query_match_data_set_folded_names(FsearchQueryMatchData *match_data, const FsearchDatabaseFoldedNames *names) {
+    match_data->folded_names = names;
+}
+
+bool
+fsearch_query_match_data_get_folded_name(FsearchQueryMatchData *match_data, const char **folded_name) {
+    if (!match_data->folded_names || !db_folded_names_lookup(match_data->folded_names, match_data->entry, folded_name)) {
+        return false;
+    }
+    if (!*folded_name) {
+        *folded_name = db_entry_get_name_raw_for_display(match_data->entry);
+    }
+    return true;
+}
+
+void
+fsearch_query_match_data_set_extensions(FsearchQueryMatchData *match_data, const FsearchDatabaseExtensions *extensions) {
+    match_data->extensions = extensions;
+}
+
+bool
+fsearch_query_match_data_get_extension_id(FsearchQueryMatchData *match_data,
+                                          const FsearchDatabaseExtensions *extensions,
+                                          uint32_t *id) {
+    if (!match_data->extensions || match_data->extensions != extensions) {
+        return false;
+    }
+    return db_extensions_lookup(extensions, match_data->entry, id);
+}
+
+void
+fsearch_query_match_data_set_metadata(FsearchQueryMatchData *match_data, const FsearchDatabaseMetadata *metadata) {
+    match_data->metadata = metadata;
+}
+
+bool
+fsearch_query_match_data_get_metadata_value(FsearchQueryMatchData *match_data,
+                                            FsearchDatabaseMetadataColumn column,
+                                            uint32_t *value) {
+    const FsearchDatabaseMetadata *metadata = match_data->metadata;
+    FsearchDatabaseEntry *entry = match_data->entry;
+    if (!metadata || !entry || !db_metadata_has_column(metadata, column)) {
+        return false;
+    }
+    const bool is_folder = db_entry_is_folder(entry);
+    DynamicArray *entries = is_folder ? metadata->folders : metadata->files;
+    const uint32_t idx = db_entry_get_idx(entry);
+    if (idx >= darray_get_num_items(entries) || darray_get_item(entries, idx) != entry) {
+        return false;
+    }
+    *value = db_metadata_get_value(metadata, is_folder, column, idx);
+    if (column == DATABASE_METADATA_COLUMN_UID || column == DATABASE_METADATA_COLUMN_GID) {
+        return *value != DATABASE_METADATA_UNKNOWN_ID;
+    }
+    // 0 is an unknown mode or timestamp
+    return *value != 0;
 }
 
 void
@@ -206,14 +338,13 @@ fsearch_query_match_data_get_result(FsearchQueryMatchData *match_data) {
     return match_data->matches;
 }
 
-void
-fsearch_query_match_data_set_thread_id(FsearchQueryMatchData *match_data, int32_t thread_id) {
-    match_data->thread_id = thread_id;
-}
-
-int32_t
-fsearch_query_match_data_get_thread_id(FsearchQueryMatchData *match_data) {
-    return match_data->thread_id;
+pcre2_match_data *
+fsearch_query_match_data_get_regex_match_data(FsearchQueryMatchData *match_data, uint32_t num_pairs) {
+    if (!match_data->regex_match_data || pcre2_get_ovector_count(match_data->regex_match_data) < num_pairs) {
+        g_clear_pointer(&match_data->regex_match_data, pcre2_match_data_free);
+        match_data->regex_match_data = pcre2_match_data_create(MAX(num_pairs, 1), NULL);
+    }
+    return match_data->regex_match_data;
 }
 
 PangoAttrList *
@@ -1,10 +1,17 @@
 #pragma once
 
+#include "fsearch_database_columns.h"
 #include "fsearch_database_entry.h"
+#include "fsearch_database_extensions.h"
+#include "fsearch_database_folded_names.h"
 #include "fsearch_database_index.h"
+#include "fsearch_database_metadata.h"
 #include "fsearch_utf.h"
 
+#define PCRE2_CODE_UNIT_WIDTH 8
+
 #include <pango/pango-attributes.h>
+#include <pcre2.h>
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -16,9 +23,38 @@ fsearch_query_match_data_new(void);
 void
 fsearch_query_match_data_free(FsearchQueryMatchData *match_data);
 
+// The number of bytes allocated for the buffers of match_data
+size_t
+fsearch_query_match_data_get_memory_size(FsearchQueryMatchData *match_data);
+
 void
 fsearch_query_match_data_set_entry(FsearchQueryMatchData *match_data, FsearchDatabaseEntry *entry);
 
+// The entry which was set last is the one at idx in the entries of columns. Has to be set again for every entry.
+void
+fsearch_query_match_data_set_columns(FsearchQueryMatchData *match_data,
+                                     const FsearchDatabaseColumns *columns,
+                                     uint32_t idx);
+
+// Used to build the paths of entries while it's set, see FsearchDatabaseFolderPaths
+void
+fsearch_query_match_data_set_folder_paths(FsearchQueryMatchData *match_data, const FsearchDatabaseFolderPaths *paths);
+
+const FsearchDatabaseFolderPaths *
+fsearch_query_match_data_get_folder_paths(FsearchQueryMatchData *match_data);
+
+// Used for the folded names of entries while it's set, see FsearchDatabaseFoldedNames
+void
+fsearch_query_match_data_set_folded_names(FsearchQueryMatchData *match_data, const FsearchDatabaseFoldedNames *names);
+
+// Used for the extension ids of files while it's set, see FsearchDatabaseExtensions
+void
+fsearch_query_match_data_set_extensions(FsearchQueryMatchData *match_data, const FsearchDatabaseExtensions *extensions);
+
+// Used for the owners, permissions and other timestamps of entries while it's set, see FsearchDatabaseMetadata
+void
+fsearch_query_match_data_set_metadata(FsearchQueryMatchData *match_data, const FsearchDatabaseMetadata *metadata);
+
 void
 fsearch_query_match_data_add_highlight(FsearchQueryMatchData *match_data,
                                        PangoAttribute *attribute,
@@ -27,11 +63,10 @@ fsearch_query_match_data_add_highlight(FsearchQueryMatchData *match_data,
 PangoAttrList *
 fsearch_query_match_get_highlight(FsearchQueryMatchData *match_data, FsearchDatabaseIndexType idx);
 
-void
-fsearch_query_match_data_set_thread_id(FsearchQueryMatchData *match_data, int32_t thread_id);
-
-int32_t
-fsearch_query_match_data_get_thread_id(FsearchQueryMatchData *match_data);
+// The PCRE2 match data of match_data, with at least num_pairs ovector pairs. It's shared by all regexes and only
+// grows when one of them needs more pairs, so it gets allocated once per thread instead of once per regex and query.
+pcre2_match_data *
+fsearch_query_match_data_get_regex_match_data(FsearchQueryMatchData *match_data, uint32_t num_pairs);
 
 void
 fsearch_query_match_data_set_result(FsearchQueryMatchData *match_data, bool result);
@@ -60,5 +95,33 @@ fsearch_query_match_data_get_utf_path_builder(FsearchQueryMatchData *match_data)
 FsearchUtfBuilder *
 fsearch_query_match_data_get_utf_name_builder(FsearchQueryMatchData *match_data);
 
+// The case folded and normalized name of the entry in UTF8, false if there are no folded names for it
+bool
+fsearch_query_match_data_get_folded_name(FsearchQueryMatchData *match_data, const char **folded_name);
+
+// Sets id to the extension id of the entry in extensions, returns false if those aren't set or don't contain it
+bool
+fsearch_query_match_data_get_extension_id(FsearchQueryMatchData *match_data,
+                                          const FsearchDatabaseExtensions *extensions,
+                                          uint32_t *id);
+
+// Sets value to the value of column of the entry (the id for the owner columns), returns false if the metadata isn't
+// set, doesn't have that column or contain the entry, or the value isn't known
+bool
+fsearch_query_match_data_get_metadata_value(FsearchQueryMatchData *match_data,
+                                            FsearchDatabaseMetadataColumn column,
+                                            uint32_t *value);
+
 FsearchDatabaseEntry *
 fsearch_query_match_data_get_entry(FsearchQueryMatchData *match_data);
+
+// The following are read from the columns if they were set, otherwise from the entry
+
+FsearchDatabaseEntryType
+fsearch_query_match_data_get_entry_type(FsearchQueryMatchData *match_data);
+
+off_t
+fsearch_query_match_data_get_size(FsearchQueryMatchData *match_data);
+
+time_t
+fsearch_query_match_data_get_mtime(FsearchQueryMatchData *match_data);
@@ -1,4 +1,6 @@
 #include "fsearch_query_matchers.h"
+#include "fsearch_file_content.h"
+#include "fsearch_limits.h"
 #include "fsearch_query_node.h"
 #include <string.h>
 
@@ -17,6 +19,10 @@ fsearch_query_matcher_extension(FsearchQueryNode *node, FsearchQueryMatchData *m
     if (!node->search_term_list) {
         return 0;
     }
+    uint32_t id = 0;
+    if (node->extension_matches && fsearch_query_match_data_get_extension_id(match_data, node->extensions, &id)) {
+        return (node->extension_matches[id / 64] >> (id % 64)) & 1;
+    }
     FsearchDatabaseEntry *entry = fsearch_query_match_data_get_entry(match_data);
     const char *ext = db_entry_get_extension(entry);
     if (!ext) {
@@ -40,32 +46,54 @@ fsearch_query_matcher_extension(FsearchQueryNode *node, FsearchQueryMatchData *m
     return 0;
 }
 
-static inline uint32_t
-cmp_num(int64_t num, FsearchQueryNode *node) {
-    switch (node->comparison_type) {
-    case FSEARCH_QUERY_NODE_COMPARISON_EQUAL:
-        return num == node->num_start;
-    case FSEARCH_QUERY_NODE_COMPARISON_GREATER:
-        return num > node->num_start;
-    case FSEARCH_QUERY_NODE_COMPARISON_SMALLER:
-        return num < node->num_start;
-    case FSEARCH_QUERY_NODE_COMPARISON_GREATER_EQ:
-        return num >= node->num_start;
-    case FSEARCH_QUERY_NODE_COMPARISON_SMALLER_EQ:
-        return num <= node->num_start;
-    case FSEARCH_QUERY_NODE_COMPARISON_RANGE:
-        return node->num_start <= num && num < node->num_end;
-    default:
-        return 0;
+uint32_t
+fsearch_query_matcher_date_modified(FsearchQueryNode *node, FsearchQueryMatchData *match_data) {
+    if (fsearch_query_match_data_get_entry(match_data)) {
+        const time_t time = fsearch_query_match_data_get_mtime(match_data);
+        return fsearch_query_matcher_cmp_num(time, node);
     }
+    return 0;
+}
+
+static uint32_t
+matcher_metadata(FsearchQueryNode *node, FsearchQueryMatchData *match_data, FsearchDatabaseMetadataColumn column) {
+    uint32_t value = 0;
+    if (fsearch_query_match_data_get_metadata_value(match_data, column, &value)) {
+        return fsearch_query_matcher_cmp_num(value, node);
+    }
+    return 0;
 }
 
 uint32_t
-fsearch_query_matcher_date_modified(FsearchQueryNode *node, FsearchQueryMatchData *match_data) {
-    FsearchDatabaseEntry *entry = fsearch_query_match_data_get_entry(match_data);
-    if (entry) {
-        const time_t time = db_entry_get_mtime(entry);
-        return cmp_num(time, node);
+fsearch_query_matcher_date_accessed(FsearchQueryNode *node, FsearchQueryMatchData *match_data) {
+    return matcher_metadata(node, match_data, DATABASE_METADATA_COLUMN_ATIME);
+}
+
+uint32_t
+fsearch_query_matcher_date_changed(FsearchQueryNode *node, FsearchQueryMatchData *match_data) {
+    return matcher_metadata(node, match_data, DATABASE_METADATA_COLUMN_CTIME);
+}
+
+uint32_t
+fsearch_query_matcher_date_created(FsearchQueryNode *node, FsearchQueryMatchData *match_data) {
+    return matcher_metadata(node, match_data, DATABASE_METADATA_COLUMN_BTIME);
+}
+
+uint32_t
+fsearch_query_matcher_owner(FsearchQueryNode *node, FsearchQueryMatchData *match_data) {
+    return matcher_metadata(node, match_data, DATABASE_METADATA_COLUMN_UID);
+}
+
+uint32_t
+fsearch_query_matcher_group(FsearchQueryNode *node, FsearchQueryMatchData *match_data) {
+    return matcher_metadata(node, match_data, DATABASE_METADATA_COLUMN_GID);
+}
+
+uint32_t
+fsearch_query_matcher_permissions(FsearchQueryNode *node, FsearchQueryMatchData *match_data) {
+    uint32_t mode = 0;
+    if (fsearch_query_match_data_get_metadata_value(match_data, DATABASE_METADATA_COLUMN_MODE, &mode)) {
+        return fsearch_query_matcher_cmp_num(mode & 07777, node);
     }
     return 0;
 }
@@ -75,7 +103,7 @@ fsearch_query_matcher_depth(FsearchQueryNode *node, FsearchQueryMatchData *match
     FsearchDatabaseEntry *entry = fsearch_query_match_data_get_entry(match_data);
     if (entry) {
         const int64_t depth = db_entry_get_depth(entry);
-        return cmp_num(depth, node);
+        return fsearch_query_matcher_cmp_num(depth, node);
     }
     return 0;
 }
@@ -85,7 +113,7 @@ fsearch_query_matcher_childcount(FsearchQueryNode *node, FsearchQueryMatchData *
     FsearchDatabaseEntry *entry = fsearch_query_match_data_get_entry(match_data);
     if (entry && db_entry_is_folder(entry)) {
         const int64_t num_children = db_entry_folder_get_num_children((FsearchDatabaseEntryFolder *)entry);
-        return cmp_num(num_children, node);
+        return fsearch_query_matcher_cmp_num(num_children, node);
     }
     return 0;
 }
@@ -95,7 +123,7 @@ fsearch_query_matcher_childfilecount(FsearchQueryNode *node, FsearchQueryMatchDa
     FsearchDatabaseEntry *entry = fsearch_query_match_data_get_entry(match_data);
     if (entry && db_entry_is_folder(entry)) {
         const int64_t num_files = db_entry_folder_get_num_files((FsearchDatabaseEntryFolder *)entry);
-        return cmp_num(num_files, node);
+        return fsearch_query_matcher_cmp_num(num_files, node);
     }
     return 0;
 }
@@ -105,17 +133,16 @@ fsearch_query_matcher_childfoldercount(FsearchQueryNode *node, FsearchQueryMatch
     FsearchDatabaseEntry *entry = fsearch_query_match_data_get_entry(match_data);
     if (entry && db_entry_is_folder(entry)) {
         const int64_t num_folders = db_entry_folder_get_num_folders((FsearchDatabaseEntryFolder *)entry);
-        return cmp_num(num_folders, node);
+        return fsearch_query_matcher_cmp_num(num_folders, node);
     }
     return 0;
 }
 
 uint32_t
 fsearch_query_matcher_size(FsearchQueryNode *node, FsearchQueryMatchData *match_data) {
-    FsearchDatabaseEntry *entry = fsearch_query_match_data_get_entry(match_data);
-    if (entry) {
-        const int64_t size = db_entry_get_size(entry);
-        return cmp_num(size, node);
+    if (fsearch_query_match_data_get_entry(match_data)) {
+        const int64_t size = fsearch_query_match_data_get_size(match_data);
+        return fsearch_query_matcher_cmp_num(size, node);
     }
     return 0;
 }
@@ -163,8 +190,12 @@ fsearch_query_matcher_regex(FsearchQueryNode *node, FsearchQueryMatchData *match
     if (G_UNLIKELY(!node->regex)) {
         return 0;
     }
-    const int32_t thread_id = fsearch_query_match_data_get_thread_id(match_data);
-    pcre2_match_data *regex_match_data = g_ptr_array_index(node->regex_match_data_for_threads, thread_id);
+    if (node->regex_literal_search.needle
+        && !fsearch_string_search_find(&node->regex_literal_search, haystack, haystack_len)) {
+        return 0;
+    }
+    // the offsets of the match aren't needed, a single pair works for every regex
+    pcre2_match_data *regex_match_data = fsearch_query_match_data_get_regex_match_data(match_data, 1);
     if (G_UNLIKELY(!regex_match_data)) {
         return 0;
     }
@@ -177,7 +208,185 @@ fsearch_query_matcher_regex(FsearchQueryNode *node, FsearchQueryMatchData *match
         num_matches =
             pcre2_match(node->regex, (PCRE2_SPTR)haystack, (PCRE2_SIZE)haystack_len, 0, 0, regex_match_data, NULL);
     }
-    return num_matches > 0 ? 1 : 0;
+    // 0 means it matched, but the ovector is too small for the captured substrings
+    return num_matches >= 0 ? 1 : 0;
+}
+
+typedef struct {
+    FsearchQueryNode *node;
+    FsearchQueryMatchData *match_data;
+} FsearchQueryContentMatch;
+
+static bool
+content_matches(const char *contents, size_t len, gpointer data) {
+    FsearchQueryContentMatch *ctx = data;
+    FsearchQueryNode *node = ctx->node;
+    if (!node->regex) {
+        return fsearch_string_search_find(&node->needle_search, contents, len);
+    }
+    if (node->regex_literal_search.needle && !fsearch_string_search_find(&node->regex_literal_search, contents, len)) {
+        return false;
+    }
+    pcre2_match_data *regex_match_data = fsearch_query_match_data_get_regex_match_data(ctx->match_data, 1);
+    if (G_UNLIKELY(!regex_match_data)) {
+        return false;
+    }
+    const int num_matches =
+        node->regex_jit_available
+            ? pcre2_jit_match(node->regex, (PCRE2_SPTR)contents, (PCRE2_SIZE)len, 0, 0, regex_match_data, NULL)
+            : pcre2_match(node->regex, (PCRE2_SPTR)contents, (PCRE2_SIZE)len, 0, 0, regex_match_data, NULL);
+    return num_matches >= 0;
+}
+
+uint32_t
+fsearch_query_matcher_content(FsearchQueryNode *node, FsearchQueryMatchData *match_data) {
+    if (fsearch_query_match_data_get_entry_type(match_data) != DATABASE_ENTRY_TYPE_FILE) {
+        return 0;
+    }
+    // files which are empty or too large according to the database aren't even opened
+    const off_t size = fsearch_query_match_data_get_size(match_data);
+    if (size <= 0 || size > FSEARCH_FILE_CONTENT_MAX_SIZE) {
+        return 0;
+    }
+    const char *path = node->haystack_func(match_data);
+    if (G_UNLIKELY(!path)) {
+        return 0;
+    }
+    FsearchQueryContentMatch ctx = {.node = node, .match_data = match_data};
+    return fsearch_file_content_matches(path, node->content_key, content_matches, &ctx) ? 1 : 0;
+}
+
+uint32_t
+fsearch_query_matcher_duplicate(FsearchQueryNode *node, FsearchQueryMatchData *match_data) {
+    if (!node->duplicates) {
+        return 0;
+    }
+    return fsearch_duplicates_lookup(node->duplicates, fsearch_query_match_data_get_entry(match_data), NULL) ? 1 : 0;
+}
+
+static inline bool
+wildcard_char_matches(char pattern_char, char c, bool ignore_case) {
+    return pattern_char == (ignore_case ? g_ascii_tolower(c) : c);
+}
+
+static inline bool
+is_utf8_continuation_byte(char c) {
+    return ((unsigned char)c & 0xc0) == 0x80;
+}
+
+// Whether segment matches the text at s, a question mark matches one UTF-8 character. Sets end to the end of the
+// match.
+static bool
+wildcard_segment_matches_at(const FsearchQueryWildcardSegment *segment,
+                            const char *s,
+                            const char *haystack_end,
+                            bool ignore_case,
+                            const char **end) {
+    for (size_t i = 0; i < segment->pattern_len; i++) {
+        if (s >= haystack_end) {
+            return false;
+        }
+        if (segment->pattern[i] == '?') {
+            s++;
+            while (s < haystack_end && is_utf8_continuation_byte(*s)) {
+                s++;
+            }
+        }
+        else if (!wildcard_char_matches(segment->pattern[i], *s, ignore_case)) {
+            return false;
+        }
+        else {
+            s++;
+        }
+    }
+    *end = s;
+    return true;
+}
+
+// Same as above for a match which ends at the end of the haystack, sets start to its start
+static bool
+wildcard_segment_matches_at_end(const FsearchQueryWildcardSegment *segment,
+                                const char *haystack,
+                                const char *haystack_end,
+                                bool ignore_case,
+                                const char **start) {
+    const char *s = haystack_end;
+    for (size_t i = segment->pattern_len; i > 0; i--) {
+        if (s <= haystack) {
+            return false;
+        }
+        s--;
+        if (segment->pattern[i - 1] == '?') {
+            while (s > haystack && is_utf8_continuation_byte(*s)) {
+                s--;
+            }
+        }
+        else if (!wildcard_char_matches(segment->pattern[i - 1], *s, ignore_case)) {
+            return false;
+        }
+    }
+    *start = s;
+    return true;
+}
+
+// Finds the first match of segment at or after s, sets end to its end
+static bool
+wildcard_segment_find(const FsearchQueryWildcardSegment *segment,
+                      const char *s,
+                      const char *haystack_end,
+                      bool ignore_case,
+                      const char **end) {
+    const FsearchStringSearch *prefix_search = &segment->prefix_search;
+    while (s < haystack_end) {
+        if (prefix_search->needle_len > 0) {
+            // skip to the next occurrence of the literal prefix of the segment
+            s = fsearch_string_search_find_first(prefix_search, s, haystack_end - s);
+            if (!s) {
+                return false;
+            }
+        }
+        else if (is_utf8_continuation_byte(*s)) {
+            s++;
+            continue;
+        }
+        if (wildcard_segment_matches_at(segment, s, haystack_end, ignore_case, end)) {
+            return true;
+        }
+        s++;
+    }
+    return false;
+}
+
+uint32_t
+fsearch_query_matcher_wildcard(FsearchQueryNode *node, FsearchQueryMatchData *match_data) {
+    const char *haystack = node->haystack_func(match_data);
+    const char *haystack_end = haystack + strlen(haystack);
+    const bool ignore_case = !(node->flags & QUERY_FLAG_MATCH_CASE);
+    const FsearchQueryWildcardSegment *segments = node->wildcard_segments;
+    const uint32_t num_segments = node->num_wildcard_segments;
+    if (G_UNLIKELY(num_segments == 0)) {
+        return 0;
+    }
+
+    const char *s = NULL;
+    if (!wildcard_segment_matches_at(&segments[0], haystack, haystack_end, ignore_case, &s)) {
+        return 0;
+    }
+    if (num_segments == 1) {
+        return s == haystack_end ? 1 : 0;
+    }
+    // The segments between the stars can match anywhere in between, the earliest match of each one leaves the most
+    // room for the following ones
+    for (uint32_t i = 1; i < num_segments - 1; i++) {
+        if (segments[i].pattern_len > 0 && !wildcard_segment_find(&segments[i], s, haystack_end, ignore_case, &s)) {
+            return 0;
+        }
+    }
+    const char *last_start = NULL;
+    if (!wildcard_segment_matches_at_end(&segments[num_segments - 1], s, haystack_end, ignore_case, &last_start)) {
+        return 0;
+    }
+    return 1;
 }
 
 uint32_t
@@ -211,14 +420,57 @@ fsearch_query_matcher_utf_strcasecmp(FsearchQueryNode *node, FsearchQueryMatchDa
     return 0;
 }
 
+// ASCII names fold to their lower case form (unless the Turkic case mapping is used), so they can be compared
+// with the folded needle byte by byte. Returns NULL if that's not possible.
+static const char *
+get_ascii_name(FsearchQueryNode *node, FsearchQueryMatchData *match_data) {
+    FsearchDatabaseEntry *entry = fsearch_query_match_data_get_entry(match_data);
+    if (!node->needle_folded || node->needle_builder->fold_options != U_FOLD_CASE_DEFAULT
+        || !db_entry_name_is_ascii(entry)) {
+        return NULL;
+    }
+    return db_entry_get_name_raw_for_display(entry);
+}
+
+uint32_t
+fsearch_query_matcher_utf_name_strcasecmp(FsearchQueryNode *node, FsearchQueryMatchData *match_data) {
+    const char *ascii_name = get_ascii_name(node, match_data);
+    if (ascii_name) {
+        return node->needle_folded_is_ascii && !strcasecmp(ascii_name, node->needle_folded) ? 1 : 0;
+    }
+    const char *folded_name = NULL;
+    if (node->needle_folded && fsearch_query_match_data_get_folded_name(match_data, &folded_name)) {
+        return !strcmp(folded_name, node->needle_folded) ? 1 : 0;
+    }
+    return fsearch_query_matcher_utf_strcasecmp(node, match_data);
+}
+
+uint32_t
+fsearch_query_matcher_utf_name_strcasestr(FsearchQueryNode *node, FsearchQueryMatchData *match_data) {
+    const char *ascii_name = get_ascii_name(node, match_data);
+    if (ascii_name) {
+        return node->needle_folded_is_ascii
+                    && fsearch_string_search_find(&node->needle_folded_search, ascii_name, strlen(ascii_name))
+                 ? 1
+                 : 0;
+    }
+    const char *folded_name = NULL;
+    if (node->needle_folded && fsearch_query_match_data_get_folded_name(match_data, &folded_name)) {
+        return strstr(folded_name, node->needle_folded) ? 1 : 0;
+    }
+    return fsearch_query_matcher_utf_strcasestr(node, match_data);
+}
+
 uint32_t
 fsearch_query_matcher_strstr(FsearchQueryNode *node, FsearchQueryMatchData *match_data) {
-    return strstr(node->haystack_func(match_data), node->needle) ? 1 : 0;
+    const char *haystack = node->haystack_func(match_data);
+    return fsearch_string_search_find(&node->needle_search, haystack, strlen(haystack)) ? 1 : 0;
 }
 
 uint32_t
 fsearch_query_matcher_strcasestr(FsearchQueryNode *node, FsearchQueryMatchData *match_data) {
-    return strcasestr(node->haystack_func(match_data), node->needle) ? 1 : 0;
+    // needle_search ignores the case already
+    return fsearch_query_matcher_strstr(node, match_data);
 }
 
 uint32_t
@@ -231,6 +483,78 @@ fsearch_query_matcher_strcasecmp(FsearchQueryNode *node, FsearchQueryMatchData *
     return !strcasecmp(node->haystack_func(match_data), node->needle) ? 1 : 0;
 }
 
+// The position of the parent of the entry in the folder paths the node remembers its results for
+static bool
+get_memoized_folder_idx(FsearchQueryNode *node, FsearchQueryMatchData *match_data, uint32_t *idx) {
+    return node->folder_results && node->folder_paths == fsearch_query_match_data_get_folder_paths(match_data)
+        && db_folder_paths_get_parent_idx(node->folder_paths, fsearch_query_match_data_get_entry(match_data), idx);
+}
+
+// The workers of a search share the results, the result bit is set before the one which says it's known
+static bool
+lookup_folder_result(FsearchQueryNode *node, uint32_t idx, bool *result) {
+    const guint bit = 1u << (idx % 32);
+    if (!(g_atomic_int_get(&node->folder_results_known[idx / 32]) & bit)) {
+        return false;
+    }
+    *result = (g_atomic_int_get(&node->folder_results[idx / 32]) & bit) != 0;
+    return true;
+}
+
+static void
+store_folder_result(FsearchQueryNode *node, uint32_t idx, bool result) {
+    const guint bit = 1u << (idx % 32);
+    if (result) {
+        g_atomic_int_or(&node->folder_results[idx / 32], bit);
+    }
+    g_atomic_int_or(&node->folder_results_known[idx / 32], bit);
+}
+
+uint32_t
+fsearch_query_matcher_parent_memoized(FsearchQueryNode *node, FsearchQueryMatchData *match_data) {
+    uint32_t idx = 0;
+    if (!get_memoized_folder_idx(node, match_data, &idx)) {
+        return node->search_func(node, match_data);
+    }
+    bool result = false;
+    if (!lookup_folder_result(node, idx, &result)) {
+        result = node->search_func(node, match_data) != 0;
+        store_folder_result(node, idx, result);
+    }
+    return result ? 1 : 0;
+}
+
+uint32_t
+fsearch_query_matcher_path_memoized(FsearchQueryNode *node, FsearchQueryMatchData *match_data) {
+    uint32_t idx = 0;
+    if (!get_memoized_folder_idx(node, match_data, &idx)) {
+        return node->search_func(node, match_data);
+    }
+    // the full path is the path of the parent (which ends with a separator) followed by the name
+    size_t parent_path_len = 0;
+    const char *parent_path = db_folder_paths_get_path(node->folder_paths, idx, &parent_path_len);
+    bool in_parent_path = false;
+    if (!lookup_folder_result(node, idx, &in_parent_path)) {
+        in_parent_path = fsearch_string_search_find(&node->needle_search, parent_path, parent_path_len);
+        store_folder_result(node, idx, in_parent_path);
+    }
+    if (in_parent_path) {
+        return 1;
+    }
+
+    // otherwise a match has to end in the name
+    const char *name = db_entry_get_name_raw(fsearch_query_match_data_get_entry(match_data));
+    const size_t name_len = strlen(name);
+    const size_t tail_len = MIN(parent_path_len, node->needle_search.needle_len - 1);
+    char haystack[PATH_MAX];
+    if (name_len == 0 || tail_len + name_len > sizeof(haystack)) {
+        return node->search_func(node, match_data);
+    }
+    memcpy(haystack, parent_path + parent_path_len - tail_len, tail_len);
+    memcpy(haystack + tail_len, name, name_len);
+    return fsearch_string_search_find(&node->needle_search, haystack, tail_len + name_len) ? 1 : 0;
+}
+
 uint32_t
 fsearch_query_matcher_highlight_none(FsearchQueryNode *node, FsearchQueryMatchData *match_data) {
     return 1;
@@ -277,9 +601,8 @@ uint32_t
 fsearch_query_matcher_highlight_regex(FsearchQueryNode *node, FsearchQueryMatchData *match_data) {
     const bool search_in_path = node->flags & QUERY_FLAG_SEARCH_IN_PATH;
     const char *haystack = node->haystack_func(match_data);
-    const int32_t thread_id = fsearch_query_match_data_get_thread_id(match_data);
     const size_t haystack_len = strlen(haystack);
-    pcre2_match_data *regex_match_data = g_ptr_array_index(node->regex_match_data_for_threads, thread_id);
+    pcre2_match_data *regex_match_data = fsearch_query_match_data_get_regex_match_data(match_data, node->regex_num_pairs);
     if (!regex_match_data) {
         return 0;
     }
@@ -6,6 +6,27 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+// Whether num fulfils the comparison of a numeric node
+static inline uint32_t
+fsearch_query_matcher_cmp_num(int64_t num, const FsearchQueryNode *node) {
+    switch (node->comparison_type) {
+    case FSEARCH_QUERY_NODE_COMPARISON_EQUAL:
+        return num == node->num_start;
+    case FSEARCH_QUERY_NODE_COMPARISON_GREATER:
+        return num > node->num_start;
+    case FSEARCH_QUERY_NODE_COMPARISON_SMALLER:
+        return num < node->num_start;
+    case FSEARCH_QUERY_NODE_COMPARISON_GREATER_EQ:
+        return num >= node->num_start;
+    case FSEARCH_QUERY_NODE_COMPARISON_SMALLER_EQ:
+        return num <= node->num_start;
+    case FSEARCH_QUERY_NODE_COMPARISON_RANGE:
+        return node->num_start <= num && num < node->num_end;
+    default:
+        return 0;
+    }
+}
+
 uint32_t
 fsearch_query_matcher_false(FsearchQueryNode *node, FsearchQueryMatchData *match_data);
 
@@ -18,6 +39,27 @@ fsearch_query_matcher_extension(FsearchQueryNode *node, FsearchQueryMatchData *m
 uint32_t
 fsearch_query_matcher_date_modified(FsearchQueryNode *node, FsearchQueryMatchData *match_data);
 
+// The following only match entries whose metadata is indexed, see FsearchDatabaseMetadata
+
+uint32_t
+fsearch_query_matcher_date_accessed(FsearchQueryNode *node, FsearchQueryMatchData *match_data);
+
+uint32_t
+fsearch_query_matcher_date_changed(FsearchQueryNode *node, FsearchQueryMatchData *match_data);
+
+uint32_t
+fsearch_query_matcher_date_created(FsearchQueryNode *node, FsearchQueryMatchData *match_data);
+
+uint32_t
+fsearch_query_matcher_owner(FsearchQueryNode *node, FsearchQueryMatchData *match_data);
+
+uint32_t
+fsearch_query_matcher_group(FsearchQueryNode *node, FsearchQueryMatchData *match_data);
+
+// Compares the permission bits (including setuid, setgid and sticky) of entries
+uint32_t
+fsearch_query_matcher_permissions(FsearchQueryNode *node, FsearchQueryMatchData *match_data);
+
 uint32_t
 fsearch_query_matcher_depth(FsearchQueryNode *node, FsearchQueryMatchData *match_data);
 
@@ -36,12 +78,31 @@ fsearch_query_matcher_size(FsearchQueryNode *node, FsearchQueryMatchData *match_
 uint32_t
 fsearch_query_matcher_regex(FsearchQueryNode *node, FsearchQueryMatchData *match_data);
 
+// Matches the contents of files, see fsearch_query_node_new_content
+uint32_t
+fsearch_query_matcher_content(FsearchQueryNode *node, FsearchQueryMatchData *match_data);
+
+// Matches files which have the same contents as others, see fsearch_query_node_set_duplicates
+uint32_t
+fsearch_query_matcher_duplicate(FsearchQueryNode *node, FsearchQueryMatchData *match_data);
+
+// Matches wildcard patterns without PCRE2, see FsearchQueryNode.wildcard_segments
+uint32_t
+fsearch_query_matcher_wildcard(FsearchQueryNode *node, FsearchQueryMatchData *match_data);
+
 uint32_t
 fsearch_query_matcher_utf_strcasecmp(FsearchQueryNode *node, FsearchQueryMatchData *match_data);
 
 uint32_t
 fsearch_query_matcher_utf_strcasestr(FsearchQueryNode *node, FsearchQueryMatchData *match_data);
 
+// Same as the above for names, but compare against the folded names of the database if they're available
+uint32_t
+fsearch_query_matcher_utf_name_strcasecmp(FsearchQueryNode *node, FsearchQueryMatchData *match_data);
+
+uint32_t
+fsearch_query_matcher_utf_name_strcasestr(FsearchQueryNode *node, FsearchQueryMatchData *match_data);
+
 uint32_t
 fsearch_query_matcher_strstr(FsearchQueryNode *node, FsearchQueryMatchData *match_data);
 
@@ -51,6 +112,16 @@ fsearch_query_matcher_strcasestr(FsearchQueryNode *node, FsearchQueryMatchData *
 uint32_t
 fsearch_query_matcher_strcmp(FsearchQueryNode *node, FsearchQueryMatchData *match_data);
 
+// Same as the search_func of parent filters, but it's only called once per folder when the node and match_data have
+// the same folder paths, see fsearch_query_node_set_folder_paths
+uint32_t
+fsearch_query_matcher_parent_memoized(FsearchQueryNode *node, FsearchQueryMatchData *match_data);
+
+// Same for path substring searches, the parent path is searched once per folder and only the end of it and the name
+// of each entry afterwards
+uint32_t
+fsearch_query_matcher_path_memoized(FsearchQueryNode *node, FsearchQueryMatchData *match_data);
+
 uint32_t
 fsearch_query_matcher_strcasecmp(FsearchQueryNode *node, FsearchQueryMatchData *match_data);
 
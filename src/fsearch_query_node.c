@@ -1,7 +1,6 @@
 #define G_LOG_DOMAIN "fsearch-query-node"
 
 #include "fsearch_query_node.h"
-#include "fsearch_limits.h"
 #include "fsearch_query_matchers.h"
 #include "fsearch_size_utils.h"
 #include "fsearch_string_utils.h"
@@ -26,6 +25,16 @@ node_init_needle(FsearchQueryNode *node, const char *needle) {
     fsearch_utf_builder_init(node->needle_builder, 8 * node->needle_len);
     const bool utf_ready = fsearch_utf_builder_normalize_and_fold_case(node->needle_builder, needle);
     g_assert(utf_ready == true);
+
+    const int32_t folded_size = 3 * node->needle_builder->num_characters + 1;
+    g_autofree char *folded = g_malloc(folded_size);
+    if (fsearch_utf_builder_get_normalized_folded_utf8(node->needle_builder, folded, folded_size) >= 0) {
+        node->needle_folded = g_strdup(folded);
+        node->needle_folded_is_ascii = g_str_is_ascii(folded);
+        if (node->needle_folded_is_ascii) {
+            fsearch_string_search_init(&node->needle_folded_search, folded, true);
+        }
+    }
 }
 
 void
@@ -39,15 +48,342 @@ fsearch_query_node_free(FsearchQueryNode *node) {
     g_clear_pointer(&node->search_term_list, g_ptr_array_unref);
     g_clear_pointer(&node->needle_builder, free);
     g_clear_pointer(&node->needle, g_free);
-
-    if (node->regex_match_data_for_threads) {
-        g_ptr_array_free(g_steal_pointer(&node->regex_match_data_for_threads), TRUE);
+    g_clear_pointer(&node->needle_folded, g_free);
+    g_clear_pointer(&node->content_key, g_free);
+    fsearch_string_search_clear(&node->needle_search);
+    fsearch_string_search_clear(&node->needle_folded_search);
+    fsearch_string_search_clear(&node->regex_literal_search);
+    for (uint32_t i = 0; i < node->num_wildcard_segments; i++) {
+        g_clear_pointer(&node->wildcard_segments[i].pattern, g_free);
+        fsearch_string_search_clear(&node->wildcard_segments[i].prefix_search);
     }
+    g_clear_pointer(&node->wildcard_segments, free);
+    g_clear_pointer(&node->extensions, db_extensions_unref);
+    g_clear_pointer(&node->extension_matches, free);
+    g_clear_pointer(&node->duplicates, fsearch_duplicates_unref);
+    fsearch_query_node_set_folder_paths(node, NULL);
+
     g_clear_pointer(&node->regex, pcre2_code_free);
 
     g_clear_pointer(&node, g_free);
 }
 
+void
+fsearch_query_node_set_duplicates(FsearchQueryNode *node, FsearchDuplicates *duplicates) {
+    g_assert(node);
+
+    if (node->search_func != fsearch_query_matcher_duplicate || node->duplicates == duplicates) {
+        return;
+    }
+    g_clear_pointer(&node->duplicates, fsearch_duplicates_unref);
+    if (duplicates) {
+        node->duplicates = fsearch_duplicates_ref(duplicates);
+    }
+}
+
+void
+fsearch_query_node_set_extensions(FsearchQueryNode *node, FsearchDatabaseExtensions *extensions) {
+    g_assert(node);
+
+    if (node->search_func != fsearch_query_matcher_extension || node->extensions == extensions) {
+        return;
+    }
+    g_clear_pointer(&node->extensions, db_extensions_unref);
+    g_clear_pointer(&node->extension_matches, free);
+    if (!extensions || !node->search_term_list) {
+        return;
+    }
+
+    const uint32_t num_ids = db_extensions_get_num_ids(extensions);
+    node->extension_matches = calloc((num_ids + 63) / 64, sizeof(uint64_t));
+    g_assert(node->extension_matches);
+    for (uint32_t id = 0; id < num_ids; id++) {
+        const char *ext = db_extensions_get_name(extensions, id);
+        for (uint32_t i = 0; i < node->search_term_list->len; i++) {
+            const char *term = g_ptr_array_index(node->search_term_list, i);
+            if ((node->flags & QUERY_FLAG_MATCH_CASE) ? !strcmp(ext, term) : !strcasecmp(ext, term)) {
+                node->extension_matches[id / 64] |= (uint64_t)1 << (id % 64);
+                break;
+            }
+        }
+    }
+    node->extensions = db_extensions_ref(extensions);
+}
+
+bool
+fsearch_query_node_is_regex(const FsearchQueryNode *node) {
+    g_assert(node);
+    return node->search_func == fsearch_query_matcher_regex || node->search_func == fsearch_query_matcher_wildcard;
+}
+
+bool
+fsearch_query_node_is_parent_filter(const FsearchQueryNode *node) {
+    return node->type == FSEARCH_QUERY_NODE_TYPE_QUERY
+        && (node->haystack_func == (FsearchQueryNodeHaystackFunc *)fsearch_query_match_data_get_parent_path_str
+            || node->haystack_func
+                   == (FsearchQueryNodeHaystackFunc *)fsearch_query_match_data_get_utf_parent_path_builder);
+}
+
+bool
+fsearch_query_node_is_path_substring_search(const FsearchQueryNode *node) {
+    return (node->search_func == fsearch_query_matcher_strstr || node->search_func == fsearch_query_matcher_strcasestr)
+        && node->haystack_func == (FsearchQueryNodeHaystackFunc *)fsearch_query_match_data_get_path_str;
+}
+
+void
+fsearch_query_node_set_folder_paths(FsearchQueryNode *node, FsearchDatabaseFolderPaths *folder_paths) {
+    g_assert(node);
+
+    if (node->folder_paths == folder_paths) {
+        return;
+    }
+    g_clear_pointer(&node->folder_paths, db_folder_paths_unref);
+    g_clear_pointer(&node->folder_results_known, free);
+    g_clear_pointer(&node->folder_results, free);
+    if (!folder_paths
+        || !(fsearch_query_node_is_parent_filter(node) || fsearch_query_node_is_path_substring_search(node))) {
+        return;
+    }
+
+    const uint32_t num_words = (darray_get_num_items(folder_paths->folders) + 31) / 32;
+    node->folder_results_known = calloc(MAX(num_words, 1), sizeof(guint));
+    g_assert(node->folder_results_known);
+    node->folder_results = calloc(MAX(num_words, 1), sizeof(guint));
+    g_assert(node->folder_results);
+    node->folder_paths = db_folder_paths_ref(folder_paths);
+}
+
+// The literal text a regex pattern which is anchored at the start requires at the beginning of its matches
+static char *
+regex_get_literal_prefix(const char *pattern, bool ignore_case) {
+    // an alternative could match without the anchor
+    if (pattern[0] != '^' || strchr(pattern, '|')) {
+        return NULL;
+    }
+    GString *prefix = g_string_new(NULL);
+    const char *s = pattern + 1;
+    while (*s != '\0') {
+        const char *c = s;
+        if (*s == '\\') {
+            // escaped special characters stand for themselves, the other escapes are character classes
+            if (!g_ascii_ispunct(s[1])) {
+                break;
+            }
+            c = s + 1;
+        }
+        else if (strchr(".^$*+?()[]{}", *s)) {
+            break;
+        }
+        // in UTF mode a caseless k or s also matches the Kelvin sign or the long s, and the other cases of non ASCII
+        // characters aren't known here
+        if (ignore_case && ((unsigned char)*c >= 0x80 || strchr("kKsS", *c))) {
+            break;
+        }
+        const char *next = g_utf8_next_char(c);
+        // the character could be repeated zero times
+        if (*next != '\0' && strchr("*?{", *next)) {
+            break;
+        }
+        g_string_append_len(prefix, c, next - c);
+        s = next;
+    }
+    return g_string_free(prefix, FALSE);
+}
+
+// The number of characters of the quantifier at s (e.g. "+", "{2,}?"), 0 if there's none and -1 if it's a brace
+// which isn't a quantifier. min_count is set to the lowest number of repetitions it allows.
+static int32_t
+regex_get_quantifier_len(const char *s, uint32_t *min_count) {
+    const char *c = s;
+    if (*c == '*' || *c == '?') {
+        *min_count = 0;
+        c++;
+    }
+    else if (*c == '+') {
+        *min_count = 1;
+        c++;
+    }
+    else if (*c == '{') {
+        c++;
+        *min_count = 0;
+        const char *digits = c;
+        while (g_ascii_isdigit(*c)) {
+            *min_count = MIN(*min_count * 10 + (*c - '0'), 1000);
+            c++;
+        }
+        bool has_digits = c > digits;
+        if (*c == ',') {
+            c++;
+            const char *max_digits = c;
+            while (g_ascii_isdigit(*c)) {
+                c++;
+            }
+            has_digits = has_digits || c > max_digits;
+        }
+        if (!has_digits || *c != '}') {
+            return -1;
+        }
+        c++;
+    }
+    else {
+        return 0;
+    }
+    // lazy or possessive
+    if (*c == '?' || *c == '+') {
+        c++;
+    }
+    return (int32_t)(c - s);
+}
+
+static void
+regex_end_literal_run(GString *run, GString *best) {
+    if (run->len > best->len) {
+        g_string_assign(best, run->str);
+    }
+    g_string_truncate(run, 0);
+}
+
+// Returns the longest literal text every match of a regex pattern contains, NULL if there's none or the pattern uses
+// something which isn't understood here. When the case is ignored only ASCII characters which have no non ASCII case
+// variants are part of it, so it can be searched for with FsearchStringSearch.
+static char *
+regex_get_required_literal(const char *pattern, bool ignore_case) {
+    // options and quoted sequences change how the rest of the pattern is read
+    if (strstr(pattern, "(?") || strstr(pattern, "(*") || strstr(pattern, "\\Q")) {
+        return NULL;
+    }
+    g_autoptr(GString) best = g_string_new(NULL);
+    g_autoptr(GString) run = g_string_new(NULL);
+    // the contents of groups are skipped, they could be optional or have alternatives
+    uint32_t depth = 0;
+    const char *c = pattern;
+    while (*c != '\0') {
+        // the literal character at c, if it is one
+        const char *literal = NULL;
+        const char *next = c + 1;
+        if (*c == '\\') {
+            if (c[1] == '\0') {
+                return NULL;
+            }
+            if (g_ascii_ispunct(c[1])) {
+                literal = c + 1;
+            }
+            else if (!strchr("dDwWsSbBhHvVRXAzZGKnrtfae", c[1])) {
+                // escapes with arguments, like \x{e4} or \p{L}
+                return NULL;
+            }
+            next = c + 2;
+        }
+        else if (*c == '[') {
+            if (*next == '^') {
+                next++;
+            }
+            if (*next == ']') {
+                next++;
+            }
+            while (*next != '\0' && *next != ']') {
+                if (*next == '\\' && next[1] != '\0') {
+                    next += 2;
+                }
+                else if (*next == '[' && next[1] == ':') {
+                    const char *end = strstr(next + 2, ":]");
+                    if (!end) {
+                        return NULL;
+                    }
+                    next = end + 2;
+                }
+                else {
+                    next++;
+                }
+            }
+            if (*next != ']') {
+                return NULL;
+            }
+            next++;
+        }
+        else if (*c == '(') {
+            regex_end_literal_run(run, best);
+            depth++;
+            c = next;
+            continue;
+        }
+        else if (*c == ')') {
+            if (depth == 0) {
+                return NULL;
+            }
+            depth--;
+        }
+        else if (depth == 0 && (*c == '|' || strchr("*+?{", *c))) {
+            // either side of an alternative could match on its own
+            return NULL;
+        }
+        else if (!strchr(".^$|*+?{", *c)) {
+            next = g_utf8_next_char(c);
+            if (!ignore_case || ((unsigned char)*c < 0x80 && !strchr("kKsS", *c))) {
+                literal = c;
+            }
+        }
+
+        if (depth > 0) {
+            c = next;
+            continue;
+        }
+        uint32_t min_count = 1;
+        const int32_t quantifier_len = regex_get_quantifier_len(next, &min_count);
+        if (quantifier_len < 0) {
+            return NULL;
+        }
+        if (!literal) {
+            regex_end_literal_run(run, best);
+        }
+        else if (quantifier_len == 0) {
+            g_string_append_len(run, literal, next - literal);
+        }
+        else {
+            if (min_count > 0) {
+                g_string_append_len(run, literal, next - literal);
+            }
+            regex_end_literal_run(run, best);
+            // the last repetition is followed by the rest of the pattern
+            if (min_count > 0) {
+                g_string_append_len(run, literal, next - literal);
+            }
+        }
+        c = next + quantifier_len;
+    }
+    if (depth > 0) {
+        return NULL;
+    }
+    regex_end_literal_run(run, best);
+    return best->len > 0 ? g_strdup(best->str) : NULL;
+}
+
+char *
+fsearch_query_node_get_name_prefix(FsearchQueryNode *node, bool *is_exact) {
+    g_assert(node);
+    g_assert(is_exact);
+
+    if (node->type != FSEARCH_QUERY_NODE_TYPE_QUERY || !node->needle
+        || node->haystack_func != (FsearchQueryNodeHaystackFunc *)fsearch_query_match_data_get_name_str) {
+        return NULL;
+    }
+    g_autofree char *prefix = NULL;
+    if (node->search_func == fsearch_query_matcher_strcmp || node->search_func == fsearch_query_matcher_strcasecmp) {
+        prefix = g_strdup(node->needle);
+        *is_exact = true;
+    }
+    else if (fsearch_query_node_is_regex(node)) {
+        // even "^name$" isn't an exact match, $ also matches before a newline at the end
+        prefix = regex_get_literal_prefix(node->needle, !(node->flags & QUERY_FLAG_MATCH_CASE));
+        *is_exact = false;
+    }
+    // the haystack of entries without a name (i.e. the root folder) is the separator
+    if (!prefix || prefix[0] == '\0' || strchr(prefix, G_DIR_SEPARATOR)) {
+        return NULL;
+    }
+    return g_steal_pointer(&prefix);
+}
+
 static char *
 get_needle_description_for_comparison_type(int64_t start, int64_t end, FsearchQueryNodeComparison comp_type) {
     switch (comp_type) {
@@ -101,7 +437,10 @@ fsearch_query_node_new_date_modified(FsearchQueryFlags flags,
         // E.g. dm:=january doesn't mean 1 January 00:00 but the whole January
         comp_type = FSEARCH_QUERY_NODE_COMPARISON_RANGE;
     }
-    return new_numeric_node(dm_start, dm_end, comp_type, "date-modified", fsearch_query_matcher_date_modified, NULL, flags);
+    FsearchQueryNode *qnode =
+        new_numeric_node(dm_start, dm_end, comp_type, "date-modified", fsearch_query_matcher_date_modified, NULL, flags);
+    qnode->wants_columns = true;
+    return qnode;
 }
 
 FsearchQueryNode *
@@ -109,15 +448,109 @@ fsearch_query_node_new_size(FsearchQueryFlags flags,
                             int64_t size_start,
                             int64_t size_end,
                             FsearchQueryNodeComparison comp_type) {
-    return new_numeric_node(size_start,
-                            size_end,
+    FsearchQueryNode *qnode = new_numeric_node(size_start,
+                                               size_end,
+                                               comp_type,
+                                               "size",
+                                               fsearch_query_matcher_size,
+                                               fsearch_query_matcher_highlight_size,
+                                               flags);
+    qnode->wants_columns = true;
+    return qnode;
+}
+
+static FsearchQueryNode *
+new_date_node(int64_t start,
+              int64_t end,
+              FsearchQueryNodeComparison comp_type,
+              const char *description,
+              FsearchQueryNodeMatchFunc search_func,
+              FsearchQueryFlags flags) {
+    if (comp_type == FSEARCH_QUERY_NODE_COMPARISON_EQUAL) {
+        // like dm:, equality means the whole interval of the date
+        comp_type = FSEARCH_QUERY_NODE_COMPARISON_RANGE;
+    }
+    return new_numeric_node(start, end, comp_type, description, search_func, NULL, flags);
+}
+
+FsearchQueryNode *
+fsearch_query_node_new_date_accessed(FsearchQueryFlags flags,
+                                     int64_t da_start,
+                                     int64_t da_end,
+                                     FsearchQueryNodeComparison comp_type) {
+    return new_date_node(da_start, da_end, comp_type, "date-accessed", fsearch_query_matcher_date_accessed, flags);
+}
+
+FsearchQueryNode *
+fsearch_query_node_new_date_changed(FsearchQueryFlags flags,
+                                    int64_t dc_start,
+                                    int64_t dc_end,
+                                    FsearchQueryNodeComparison comp_type) {
+    return new_date_node(dc_start, dc_end, comp_type, "date-changed", fsearch_query_matcher_date_changed, flags);
+}
+
+FsearchQueryNode *
+fsearch_query_node_new_date_created(FsearchQueryFlags flags,
+                                    int64_t dc_start,
+                                    int64_t dc_end,
+                                    FsearchQueryNodeComparison comp_type) {
+    return new_date_node(dc_start, dc_end, comp_type, "date-created", fsearch_query_matcher_date_created, flags);
+}
+
+FsearchQueryNode *
+fsearch_query_node_new_owner(FsearchQueryFlags flags,
+                             int64_t uid_start,
+                             int64_t uid_end,
+                             FsearchQueryNodeComparison comp_type) {
+    return new_numeric_node(uid_start, uid_end, comp_type, "owner", fsearch_query_matcher_owner, NULL, flags);
+}
+
+FsearchQueryNode *
+fsearch_query_node_new_group(FsearchQueryFlags flags,
+                             int64_t gid_start,
+                             int64_t gid_end,
+                             FsearchQueryNodeComparison comp_type) {
+    return new_numeric_node(gid_start, gid_end, comp_type, "group", fsearch_query_matcher_group, NULL, flags);
+}
+
+FsearchQueryNode *
+fsearch_query_node_new_permissions(FsearchQueryFlags flags,
+                                   int64_t mode_start,
+                                   int64_t mode_end,
+                                   FsearchQueryNodeComparison comp_type) {
+    return new_numeric_node(mode_start,
+                            mode_end,
                             comp_type,
-                            "size",
-                            fsearch_query_matcher_size,
-                            fsearch_query_matcher_highlight_size,
+                            "permissions",
+                            fsearch_query_matcher_permissions,
+                            NULL,
                             flags);
 }
 
+bool
+fsearch_query_node_get_metadata_column(FsearchQueryNode *node, FsearchDatabaseMetadataColumn *column) {
+    g_assert(node);
+    g_assert(column);
+    const struct {
+        FsearchQueryNodeMatchFunc *search_func;
+        FsearchDatabaseMetadataColumn column;
+    } columns[] = {
+        {fsearch_query_matcher_owner, DATABASE_METADATA_COLUMN_UID},
+        {fsearch_query_matcher_group, DATABASE_METADATA_COLUMN_GID},
+        {fsearch_query_matcher_permissions, DATABASE_METADATA_COLUMN_MODE},
+        {fsearch_query_matcher_date_accessed, DATABASE_METADATA_COLUMN_ATIME},
+        {fsearch_query_matcher_date_changed, DATABASE_METADATA_COLUMN_CTIME},
+        {fsearch_query_matcher_date_created, DATABASE_METADATA_COLUMN_BTIME},
+    };
+    for (uint32_t i = 0; i < G_N_ELEMENTS(columns); i++) {
+        if (node->search_func == columns[i].search_func) {
+            *column = columns[i].column;
+            return true;
+        }
+    }
+    return false;
+}
+
 FsearchQueryNode *
 fsearch_query_node_new_depth(FsearchQueryFlags flags,
                              int64_t child_count_start,
@@ -207,12 +640,13 @@ fsearch_query_node_new_match_everything(FsearchQueryFlags flags) {
     return qnode;
 }
 
-FsearchQueryNode *
-fsearch_query_node_new_regex(const char *search_term, FsearchQueryFlags flags) {
+// Compiles search_term with the PCRE2 options (in addition to the ones flags ask for)
+static FsearchQueryNode *
+query_node_new_regex(const char *search_term, FsearchQueryFlags flags, uint32_t options) {
     int error_code;
 
     PCRE2_SIZE erroroffset;
-    uint32_t regex_options = PCRE2_UTF | (flags & QUERY_FLAG_MATCH_CASE ? 0 : PCRE2_CASELESS);
+    uint32_t regex_options = options | PCRE2_UTF | (flags & QUERY_FLAG_MATCH_CASE ? 0 : PCRE2_CASELESS);
     pcre2_code *regex = pcre2_compile((PCRE2_SPTR)search_term,
                                       (PCRE2_SIZE)strlen(search_term),
                                       regex_options,
@@ -242,10 +676,14 @@ fsearch_query_node_new_regex(const char *search_term, FsearchQueryFlags flags) {
     else {
         qnode->regex_jit_available = true;
     }
-    qnode->regex_match_data_for_threads = g_ptr_array_sized_new(FSEARCH_THREAD_LIMIT);
-    g_ptr_array_set_free_func(qnode->regex_match_data_for_threads, (GDestroyNotify)pcre2_match_data_free);
-    for (int32_t i = 0; i < FSEARCH_THREAD_LIMIT; i++) {
-        g_ptr_array_add(qnode->regex_match_data_for_threads, pcre2_match_data_create_from_pattern(qnode->regex, NULL));
+    uint32_t num_captures = 0;
+    pcre2_pattern_info(regex, PCRE2_INFO_CAPTURECOUNT, &num_captures);
+    qnode->regex_num_pairs = num_captures + 1;
+
+    g_autofree char *literal =
+        options & PCRE2_LITERAL ? NULL : regex_get_required_literal(search_term, !(flags & QUERY_FLAG_MATCH_CASE));
+    if (literal) {
+        fsearch_string_search_init(&qnode->regex_literal_search, literal, !(flags & QUERY_FLAG_MATCH_CASE));
     }
 
     qnode->search_func = fsearch_query_matcher_regex;
@@ -256,6 +694,11 @@ fsearch_query_node_new_regex(const char *search_term, FsearchQueryFlags flags) {
     return qnode;
 }
 
+FsearchQueryNode *
+fsearch_query_node_new_regex(const char *search_term, FsearchQueryFlags flags) {
+    return query_node_new_regex(search_term, flags, 0);
+}
+
 FsearchQueryNode *
 fsearch_query_node_new_parent(const char *search_term, FsearchQueryFlags flags) {
     FsearchQueryNode *qnode = calloc(1, sizeof(FsearchQueryNode));
@@ -323,16 +766,44 @@ fsearch_query_node_new_extension(const char *search_term, FsearchQueryFlags flag
     return qnode;
 }
 
+static void
+node_init_wildcard_segments(FsearchQueryNode *node, const char *pattern) {
+    const bool ignore_case = !(node->flags & QUERY_FLAG_MATCH_CASE);
+    g_auto(GStrv) segments = g_strsplit(pattern, "*", -1);
+    node->num_wildcard_segments = g_strv_length(segments);
+    node->wildcard_segments = calloc(node->num_wildcard_segments, sizeof(FsearchQueryWildcardSegment));
+    g_assert(node->wildcard_segments);
+
+    for (uint32_t i = 0; i < node->num_wildcard_segments; i++) {
+        FsearchQueryWildcardSegment *segment = &node->wildcard_segments[i];
+        segment->pattern = ignore_case ? g_ascii_strdown(segments[i], -1) : g_strdup(segments[i]);
+        segment->pattern_len = strlen(segment->pattern);
+        g_autofree char *prefix = g_strndup(segment->pattern, strcspn(segment->pattern, "?"));
+        fsearch_string_search_init(&segment->prefix_search, prefix, ignore_case);
+    }
+}
+
 FsearchQueryNode *
 fsearch_query_node_new_wildcard(const char *search_term, FsearchQueryFlags flags) {
     // We convert the wildcard pattern to a regex pattern
-    // The regex engine is not only faster than fnmatch, but it also handles utf8 strings better
-    // and it provides matching information, which are useful for the highlighting engine
+    // The regex engine handles utf8 strings better than fnmatch and it provides matching information, which are
+    // useful for the highlighting engine
     g_autofree char *regex_search_term = fsearch_string_convert_wildcard_to_regex_expression(search_term);
     if (!regex_search_term) {
         return fsearch_query_node_new_match_nothing();
     }
-    return fsearch_query_node_new_regex(regex_search_term, flags);
+    FsearchQueryNode *qnode = fsearch_query_node_new_regex(regex_search_term, flags);
+    if (qnode->search_func != fsearch_query_matcher_regex) {
+        return qnode;
+    }
+    // But matching the literal parts between the stars directly is faster, as long as ignoring the case is the
+    // same for the pattern and its lower case form
+    if (flags & QUERY_FLAG_MATCH_CASE || fsearch_string_is_ascii_icase(search_term)) {
+        node_init_wildcard_segments(qnode, search_term);
+        qnode->search_func = fsearch_query_matcher_wildcard;
+        g_string_assign(qnode->description, "wildcard");
+    }
+    return qnode;
 }
 
 static FsearchQueryNode *
@@ -352,6 +823,7 @@ query_node_new_string_comparison(const char *search_term, FsearchQueryFlags flag
         else {
             qnode->search_func = flags & QUERY_FLAG_MATCH_CASE ? fsearch_query_matcher_strstr
                                                                : fsearch_query_matcher_strcasestr;
+            fsearch_string_search_init(&qnode->needle_search, search_term, !(flags & QUERY_FLAG_MATCH_CASE));
         }
         qnode->haystack_func = (FsearchQueryNodeHaystackFunc *)(flags & QUERY_FLAG_SEARCH_IN_PATH
                                                                     ? fsearch_query_match_data_get_path_str
@@ -360,11 +832,16 @@ query_node_new_string_comparison(const char *search_term, FsearchQueryFlags flag
         qnode->description = g_string_new("ascii_icase");
     }
     else {
-        qnode->search_func = flags & QUERY_FLAG_EXACT_MATCH ? fsearch_query_matcher_utf_strcasecmp
-                                                            : fsearch_query_matcher_utf_strcasestr;
-        qnode->haystack_func = (FsearchQueryNodeHaystackFunc *)(flags & QUERY_FLAG_SEARCH_IN_PATH
-                                                                    ? fsearch_query_match_data_get_utf_path_builder
-                                                                    : fsearch_query_match_data_get_utf_name_builder);
+        if (flags & QUERY_FLAG_SEARCH_IN_PATH) {
+            qnode->search_func = flags & QUERY_FLAG_EXACT_MATCH ? fsearch_query_matcher_utf_strcasecmp
+                                                                : fsearch_query_matcher_utf_strcasestr;
+            qnode->haystack_func = (FsearchQueryNodeHaystackFunc *)fsearch_query_match_data_get_utf_path_builder;
+        }
+        else {
+            qnode->search_func = flags & QUERY_FLAG_EXACT_MATCH ? fsearch_query_matcher_utf_name_strcasecmp
+                                                                : fsearch_query_matcher_utf_name_strcasestr;
+            qnode->haystack_func = (FsearchQueryNodeHaystackFunc *)fsearch_query_match_data_get_utf_name_builder;
+        }
         qnode->highlight_func = NULL;
         qnode->description = g_string_new("utf_icase");
     }
@@ -388,12 +865,65 @@ fsearch_query_node_new_contenttype(const char *search_term, FsearchQueryFlags fl
         g_string_prepend(res->description, "contenttype_");
         res->haystack_func = (FsearchQueryNodeHaystackFunc *)fsearch_query_match_data_get_content_type_str;
         res->highlight_func = fsearch_query_matcher_highlight_none;
-        res->wants_single_threaded_search = true;
     }
 
     return res;
 }
 
+// files don't have to be valid UTF-8, older versions of PCRE2 just don't match those which aren't
+#ifdef PCRE2_MATCH_INVALID_UTF
+#define CONTENT_REGEX_OPTIONS PCRE2_MATCH_INVALID_UTF
+#else
+#define CONTENT_REGEX_OPTIONS 0
+#endif
+
+FsearchQueryNode *
+fsearch_query_node_new_duplicates(FsearchQueryFlags flags) {
+    FsearchQueryNode *qnode = calloc(1, sizeof(FsearchQueryNode));
+    g_assert(qnode);
+    qnode->description = g_string_new("dupe");
+    qnode->type = FSEARCH_QUERY_NODE_TYPE_QUERY;
+    qnode->search_func = fsearch_query_matcher_duplicate;
+    qnode->highlight_func = NULL;
+    // folders don't have contents to compare
+    qnode->flags = flags | QUERY_FLAG_FILES_ONLY;
+    return qnode;
+}
+
+FsearchQueryNode *
+fsearch_query_node_new_content(const char *search_term, FsearchQueryFlags flags) {
+    FsearchQueryNode *res = NULL;
+    if (flags & QUERY_FLAG_REGEX) {
+        // ^ and $ match at the lines of the file, not only at its start and end
+        res = query_node_new_regex(search_term, flags, CONTENT_REGEX_OPTIONS | PCRE2_MULTILINE);
+    }
+    else if (!(flags & QUERY_FLAG_MATCH_CASE) && !fsearch_string_is_ascii_icase(search_term)) {
+        // the SIMD search only ignores the case of ASCII letters
+        res = query_node_new_regex(search_term, flags, CONTENT_REGEX_OPTIONS | PCRE2_LITERAL);
+    }
+    else {
+        res = calloc(1, sizeof(FsearchQueryNode));
+        g_assert(res);
+        res->type = FSEARCH_QUERY_NODE_TYPE_QUERY;
+        res->flags = flags;
+        res->description = g_string_new("literal");
+        res->needle = g_strdup(search_term);
+        res->needle_len = strlen(search_term);
+        fsearch_string_search_init(&res->needle_search, search_term, !(flags & QUERY_FLAG_MATCH_CASE));
+    }
+    if (res->search_func == fsearch_query_matcher_false) {
+        // the regex didn't compile
+        return res;
+    }
+
+    g_string_prepend(res->description, "content_");
+    res->search_func = fsearch_query_matcher_content;
+    res->haystack_func = (FsearchQueryNodeHaystackFunc *)fsearch_query_match_data_get_path_str;
+    res->highlight_func = fsearch_query_matcher_highlight_none;
+    res->content_key = g_strdup_printf("%s:%s", res->description->str, search_term);
+    return res;
+}
+
 FsearchQueryNode *
 fsearch_query_node_new(const char *search_term, FsearchQueryFlags flags) {
     const bool has_separator = strchr(search_term, G_DIR_SEPARATOR) ? 1 : 0;
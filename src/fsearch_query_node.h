@@ -10,13 +10,27 @@
 #include <unicode/ucasemap.h>
 #include <unicode/unorm2.h>
 
+#include "fsearch_database_extensions.h"
 #include "fsearch_database_index.h"
+#include "fsearch_database_metadata.h"
+#include "fsearch_duplicates.h"
 #include "fsearch_filter_manager.h"
 #include "fsearch_query_flags.h"
 #include "fsearch_query_match_data.h"
+#include "fsearch_string_utils.h"
 #include "fsearch_utf.h"
 
 typedef struct FsearchQueryNode FsearchQueryNode;
+
+// The text between two stars of a wildcard pattern, question marks stand for any character
+typedef struct FsearchQueryWildcardSegment {
+    // in lower case if the case is ignored
+    char *pattern;
+    size_t pattern_len;
+    // the text of pattern up to the first question mark, if there's any, candidates for the segment are searched
+    // with it
+    FsearchStringSearch prefix_search;
+} FsearchQueryWildcardSegment;
 typedef uint32_t(FsearchQueryNodeMatchFunc)(FsearchQueryNode *, FsearchQueryMatchData *);
 typedef void *(FsearchQueryNodeHaystackFunc)(FsearchQueryMatchData *);
 
@@ -48,11 +62,24 @@ struct FsearchQueryNode {
     GString *description;
 
     FsearchQueryNodeOperator operator;
+    // fsearch_query_node_tree_plan swapped the operands, they're highlighted in the order of the query
+    bool operands_swapped;
 
     char *needle;
     size_t needle_len;
+    // used by the substring matchers
+    FsearchStringSearch needle_search;
 
     GPtrArray *search_term_list;
+    // the extension filter matches the ids of extensions which are set in extension_matches, see
+    // fsearch_query_node_set_extensions
+    FsearchDatabaseExtensions *extensions;
+    uint64_t *extension_matches;
+    // the results of parent filters, and whether the parent path contains the needle of path searches, for every
+    // folder of folder_paths which was the parent of a matched entry already, see fsearch_query_node_set_folder_paths
+    FsearchDatabaseFolderPaths *folder_paths;
+    guint *folder_results_known;
+    guint *folder_results;
 
     int64_t num_start;
     int64_t num_end;
@@ -63,25 +90,76 @@ struct FsearchQueryNode {
     FsearchQueryNodeHaystackFunc *haystack_func;
 
     FsearchUtfBuilder *needle_builder;
+    // the folded needle of needle_builder in UTF8, NULL if it couldn't be converted
+    char *needle_folded;
+    // folding can turn non ASCII needles into ASCII ones (e.g. "ß" into "ss"), which are searched for in ASCII names
+    // with needle_folded_search
+    bool needle_folded_is_ascii;
+    FsearchStringSearch needle_folded_search;
 
     // Using the pcre2_code with multiple threads is safe.
-    // However, pcre2_match_data can't be shared across threads.
-    // So to avoid frequent calls to pcre2_match_data_create_from_pattern during the matching process,
-    // we simply generate an array which holds a unique instance for each thread per regex node.
+    // However, pcre2_match_data can't be shared across threads, so the matchers use the one of the match data, see
+    // fsearch_query_match_data_get_regex_match_data. Highlighting needs regex_num_pairs ovector pairs, matching one.
     pcre2_code *regex;
-    GPtrArray *regex_match_data_for_threads;
+    uint32_t regex_num_pairs;
     bool regex_jit_available;
+    // the longest literal text all matches of regex contain, haystacks without it aren't passed to PCRE2. Its needle
+    // is NULL if there's no such text.
+    FsearchStringSearch regex_literal_search;
+    // wildcard patterns which can be matched without PCRE2 (i.e. the case matters or it's ignored for ASCII letters
+    // only) are split at the stars. The first segment has to match at the start, the last one at the end of the
+    // haystack. regex is still compiled for highlighting.
+    FsearchQueryWildcardSegment *wildcard_segments;
+    uint32_t num_wildcard_segments;
+
+    // identifies what a content: filter searches for, in the cache of fsearch_file_content_matches
+    char *content_key;
+    // the files a dupe: filter matches, see fsearch_query_node_set_duplicates
+    FsearchDuplicates *duplicates;
 
     FsearchQueryFlags flags;
 
     bool triggers_auto_match_case;
     bool triggers_auto_match_path;
     bool wants_single_threaded_search;
+    bool wants_columns;
 };
 
 void
 fsearch_query_node_free(FsearchQueryNode *node);
 
+// Looks up which of the interned extensions match the search terms of an extension filter, so it can match files
+// by their extension id. Must not be called while the node is used for a search.
+void
+fsearch_query_node_set_extensions(FsearchQueryNode *node, FsearchDatabaseExtensions *extensions);
+
+// Sets the duplicates a dupe: filter matches, it doesn't match anything without them. Must not be called while the node
+// is used for a search.
+void
+fsearch_query_node_set_duplicates(FsearchQueryNode *node, FsearchDuplicates *duplicates);
+
+// Whether node matches a regex or wildcard pattern, whose regex is set
+bool
+fsearch_query_node_is_regex(const FsearchQueryNode *node);
+
+// Whether the result of node only depends on the parent folder of an entry (e.g. it's a parent: filter)
+bool
+fsearch_query_node_is_parent_filter(const FsearchQueryNode *node);
+
+// Whether node searches for a substring (with case insensitive ASCII letters or not) of the full path
+bool
+fsearch_query_node_is_path_substring_search(const FsearchQueryNode *node);
+
+// Lets parent filters and path substring searches remember their results for the folders of folder_paths, so the
+// siblings in a folder don't have to match its path again. Must not be called while the node is used for a search.
+void
+fsearch_query_node_set_folder_paths(FsearchQueryNode *node, FsearchDatabaseFolderPaths *folder_paths);
+
+// Returns the text the names of all entries node matches start with (or are equal to, then is_exact is set), if it
+// only matches names, otherwise NULL. Cases are only ignored for ASCII letters.
+char *
+fsearch_query_node_get_name_prefix(FsearchQueryNode *node, bool *is_exact);
+
 FsearchQueryNode *
 fsearch_query_node_new_date_modified(FsearchQueryFlags flags,
                                      int64_t dm_start,
@@ -94,6 +172,50 @@ fsearch_query_node_new_size(FsearchQueryFlags flags,
                             int64_t size_end,
                             FsearchQueryNodeComparison comp_type);
 
+FsearchQueryNode *
+fsearch_query_node_new_date_accessed(FsearchQueryFlags flags,
+                                     int64_t da_start,
+                                     int64_t da_end,
+                                     FsearchQueryNodeComparison comp_type);
+
+// The time the status (e.g. the owner or the permissions) of entries changed last
+FsearchQueryNode *
+fsearch_query_node_new_date_changed(FsearchQueryFlags flags,
+                                    int64_t dc_start,
+                                    int64_t dc_end,
+                                    FsearchQueryNodeComparison comp_type);
+
+FsearchQueryNode *
+fsearch_query_node_new_date_created(FsearchQueryFlags flags,
+                                    int64_t dc_start,
+                                    int64_t dc_end,
+                                    FsearchQueryNodeComparison comp_type);
+
+// Compares the uid of entries
+FsearchQueryNode *
+fsearch_query_node_new_owner(FsearchQueryFlags flags,
+                             int64_t uid_start,
+                             int64_t uid_end,
+                             FsearchQueryNodeComparison comp_type);
+
+// Compares the gid of entries
+FsearchQueryNode *
+fsearch_query_node_new_group(FsearchQueryFlags flags,
+                             int64_t gid_start,
+                             int64_t gid_end,
+                             FsearchQueryNodeComparison comp_type);
+
+// Compares the permission bits of entries, e.g. 0644
+FsearchQueryNode *
+fsearch_query_node_new_permissions(FsearchQueryFlags flags,
+                                   int64_t mode_start,
+                                   int64_t mode_end,
+                                   FsearchQueryNodeComparison comp_type);
+
+// Whether node filters by one of the columns of FsearchDatabaseMetadata, which gets stored in column
+bool
+fsearch_query_node_get_metadata_column(FsearchQueryNode *node, FsearchDatabaseMetadataColumn *column);
+
 FsearchQueryNode *
 fsearch_query_node_new_depth(FsearchQueryFlags flags,
                              int64_t child_folder_count_start,
@@ -141,5 +263,14 @@ fsearch_query_node_new_extension(const char *search_term, FsearchQueryFlags flag
 FsearchQueryNode *
 fsearch_query_node_new_contenttype(const char *search_term, FsearchQueryFlags flags);
 
+// Matches the files whose contents contain search_term (or match it, if it's a regex), see
+// fsearch_file_content_matches
+FsearchQueryNode *
+fsearch_query_node_new_content(const char *search_term, FsearchQueryFlags flags);
+
+// Matches the files which have the same contents as other files, see fsearch_query_node_set_duplicates
+FsearchQueryNode *
+fsearch_query_node_new_duplicates(FsearchQueryFlags flags);
+
 FsearchQueryNode *
 fsearch_query_node_new(const char *search_term, FsearchQueryFlags flags);
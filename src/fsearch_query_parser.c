@@ -5,7 +5,10 @@
 #include "fsearch_string_utils.h"
 #include "fsearch_time_utils.h"
 
+#include <grp.h>
+#include <pwd.h>
 #include <stdbool.h>
+#include <stdlib.h>
 
 typedef FsearchQueryNode *(FsearchQueryComparisonNewNodeFunc)(FsearchQueryFlags,
                                                               int64_t,
@@ -34,6 +37,24 @@ parse_modifier(FsearchQueryParseContext *parse_ctx, bool is_empty_field, Fsearch
 static GList *
 parse_function_date_modified(FsearchQueryParseContext *parse_ctx, bool is_empty_field, FsearchQueryFlags flags);
 
+static GList *
+parse_function_date_accessed(FsearchQueryParseContext *parse_ctx, bool is_empty_field, FsearchQueryFlags flags);
+
+static GList *
+parse_function_date_changed(FsearchQueryParseContext *parse_ctx, bool is_empty_field, FsearchQueryFlags flags);
+
+static GList *
+parse_function_date_created(FsearchQueryParseContext *parse_ctx, bool is_empty_field, FsearchQueryFlags flags);
+
+static GList *
+parse_function_owner(FsearchQueryParseContext *parse_ctx, bool is_empty_field, FsearchQueryFlags flags);
+
+static GList *
+parse_function_group(FsearchQueryParseContext *parse_ctx, bool is_empty_field, FsearchQueryFlags flags);
+
+static GList *
+parse_function_permissions(FsearchQueryParseContext *parse_ctx, bool is_empty_field, FsearchQueryFlags flags);
+
 static GList *
 parse_function_depth(FsearchQueryParseContext *parse_ctx, bool is_empty_field, FsearchQueryFlags flags);
 
@@ -43,6 +64,9 @@ parse_function_size(FsearchQueryParseContext *parse_ctx, bool is_empty_field, Fs
 static GList *
 parse_function_empty(FsearchQueryParseContext *parse_ctx, bool is_empty_field, FsearchQueryFlags flags);
 
+static GList *
+parse_function_dupe(FsearchQueryParseContext *parse_ctx, bool is_empty_field, FsearchQueryFlags flags);
+
 static GList *
 parse_function_childcount(FsearchQueryParseContext *parse_ctx, bool is_empty_field, FsearchQueryFlags flags);
 
@@ -52,6 +76,9 @@ parse_function_childfilecount(FsearchQueryParseContext *parse_ctx, bool is_empty
 static GList *
 parse_function_childfoldercount(FsearchQueryParseContext *parse_ctx, bool is_empty_field, FsearchQueryFlags flags);
 
+static GList *
+parse_function_content(FsearchQueryParseContext *parse_ctx, bool is_empty_field, FsearchQueryFlags flags);
+
 static GList *
 parse_function_contenttype(FsearchQueryParseContext *parse_ctx, bool is_empty_field, FsearchQueryFlags flags);
 
@@ -106,14 +133,24 @@ FsearchTokenFunction supported_functions[] = {
     {"childcount", parse_function_childcount},
     {"childfilecount", parse_function_childfilecount},
     {"childfoldercount", parse_function_childfoldercount},
+    {"content", parse_function_content},
     {"contenttype", parse_function_contenttype},
     {"depth", parse_function_depth},
+    {"da", parse_function_date_accessed},
+    {"dateaccessed", parse_function_date_accessed},
+    {"datechanged", parse_function_date_changed},
+    {"dc", parse_function_date_created},
+    {"datecreated", parse_function_date_created},
     {"dm", parse_function_date_modified},
     {"datemodified", parse_function_date_modified},
+    {"dupe", parse_function_dupe},
     {"empty", parse_function_empty},
     {"ext", parse_function_extension},
+    {"group", parse_function_group},
+    {"owner", parse_function_owner},
     {"parent", parse_function_parent},
     {"parents", parse_function_depth},
+    {"perm", parse_function_permissions},
     {"size", parse_function_size},
 };
 
@@ -214,6 +251,66 @@ parse_integer(const char *str, int64_t *num_out, int64_t *num_2_out) {
     return true;
 }
 
+// Accepts the name of a user or a uid
+static bool
+parse_user(const char *str, int64_t *num_out, int64_t *num_2_out) {
+    if (parse_integer(str, num_out, num_2_out)) {
+        return true;
+    }
+    char buffer[4096];
+    struct passwd pwd;
+    struct passwd *result = NULL;
+    if (getpwnam_r(str, &pwd, buffer, sizeof(buffer), &result) != 0 || !result) {
+        return false;
+    }
+    if (num_out) {
+        *num_out = result->pw_uid;
+    }
+    if (num_2_out) {
+        *num_2_out = result->pw_uid;
+    }
+    return true;
+}
+
+// Accepts the name of a group or a gid
+static bool
+parse_group(const char *str, int64_t *num_out, int64_t *num_2_out) {
+    if (parse_integer(str, num_out, num_2_out)) {
+        return true;
+    }
+    // the members are part of the entry, so it needs more room than a user
+    char buffer[16384];
+    struct group grp;
+    struct group *result = NULL;
+    if (getgrnam_r(str, &grp, buffer, sizeof(buffer), &result) != 0 || !result) {
+        return false;
+    }
+    if (num_out) {
+        *num_out = result->gr_gid;
+    }
+    if (num_2_out) {
+        *num_2_out = result->gr_gid;
+    }
+    return true;
+}
+
+// Permission bits are written in octal, like chmod takes them
+static bool
+parse_octal(const char *str, int64_t *num_out, int64_t *num_2_out) {
+    char *num_suffix = NULL;
+    int64_t num = strtoll(str, &num_suffix, 8);
+    if (num_suffix == str || (num_suffix && num_suffix[0] != '\0')) {
+        return false;
+    }
+    if (num_out) {
+        *num_out = num;
+    }
+    if (num_2_out) {
+        *num_2_out = num;
+    }
+    return true;
+}
+
 static GList *
 parse_numeric_function(FsearchQueryParseContext *parse_ctx,
                        bool is_empty_field,
@@ -275,6 +372,11 @@ parse_function_empty(FsearchQueryParseContext *parse_ctx, bool is_empty_field, F
     return new_list(fsearch_query_node_new_childcount(flags, 0, 0, FSEARCH_QUERY_NODE_COMPARISON_EQUAL));
 }
 
+static GList *
+parse_function_dupe(FsearchQueryParseContext *parse_ctx, bool is_empty_field, FsearchQueryFlags flags) {
+    return new_list(fsearch_query_node_new_duplicates(flags));
+}
+
 static GList *
 parse_function_depth(FsearchQueryParseContext *parse_ctx, bool is_empty_field, FsearchQueryFlags flags) {
     return parse_numeric_function(parse_ctx, is_empty_field, flags, "depth", fsearch_query_node_new_depth, parse_integer);
@@ -320,6 +422,56 @@ parse_function_date_modified(FsearchQueryParseContext *parse_ctx, bool is_empty_
                                   fsearch_date_time_parse_interval);
 }
 
+static GList *
+parse_function_date_accessed(FsearchQueryParseContext *parse_ctx, bool is_empty_field, FsearchQueryFlags flags) {
+    return parse_numeric_function(parse_ctx,
+                                  is_empty_field,
+                                  flags,
+                                  "date-accessed",
+                                  fsearch_query_node_new_date_accessed,
+                                  fsearch_date_time_parse_interval);
+}
+
+static GList *
+parse_function_date_changed(FsearchQueryParseContext *parse_ctx, bool is_empty_field, FsearchQueryFlags flags) {
+    return parse_numeric_function(parse_ctx,
+                                  is_empty_field,
+                                  flags,
+                                  "date-changed",
+                                  fsearch_query_node_new_date_changed,
+                                  fsearch_date_time_parse_interval);
+}
+
+static GList *
+parse_function_date_created(FsearchQueryParseContext *parse_ctx, bool is_empty_field, FsearchQueryFlags flags) {
+    return parse_numeric_function(parse_ctx,
+                                  is_empty_field,
+                                  flags,
+                                  "date-created",
+                                  fsearch_query_node_new_date_created,
+                                  fsearch_date_time_parse_interval);
+}
+
+static GList *
+parse_function_owner(FsearchQueryParseContext *parse_ctx, bool is_empty_field, FsearchQueryFlags flags) {
+    return parse_numeric_function(parse_ctx, is_empty_field, flags, "owner", fsearch_query_node_new_owner, parse_user);
+}
+
+static GList *
+parse_function_group(FsearchQueryParseContext *parse_ctx, bool is_empty_field, FsearchQueryFlags flags) {
+    return parse_numeric_function(parse_ctx, is_empty_field, flags, "group", fsearch_query_node_new_group, parse_group);
+}
+
+static GList *
+parse_function_permissions(FsearchQueryParseContext *parse_ctx, bool is_empty_field, FsearchQueryFlags flags) {
+    return parse_numeric_function(parse_ctx,
+                                  is_empty_field,
+                                  flags,
+                                  "permissions",
+                                  fsearch_query_node_new_permissions,
+                                  parse_octal);
+}
+
 static GList *
 parse_function_extension(FsearchQueryParseContext *parse_ctx, bool is_empty_field, FsearchQueryFlags flags) {
     if (is_empty_field) {
@@ -334,6 +486,19 @@ parse_function_extension(FsearchQueryParseContext *parse_ctx, bool is_empty_fiel
     return new_list(fsearch_query_node_new_match_nothing());
 }
 
+static GList *
+parse_function_content(FsearchQueryParseContext *parse_ctx, bool is_empty_field, FsearchQueryFlags flags) {
+    if (is_empty_field) {
+        return new_list(fsearch_query_node_new_match_everything(flags));
+    }
+
+    g_autoptr(GString) token_value = NULL;
+    if (expect_word(parse_ctx->lexer, &token_value)) {
+        return new_list(fsearch_query_node_new_content(token_value->str, flags));
+    }
+    return new_list(fsearch_query_node_new_match_nothing());
+}
+
 static GList *
 parse_function_contenttype(FsearchQueryParseContext *parse_ctx, bool is_empty_field, FsearchQueryFlags flags) {
     if (is_empty_field) {
@@ -0,0 +1,383 @@
+#define G_LOG_DOMAIN "fsearch-query-program"
+
+#include "fsearch_query_program.h"
+#include "fsearch_query_matchers.h"
+#include "fsearch_string_utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static uint32_t
+emit(GArray *instructions, FsearchQueryOpcode opcode, FsearchQueryNode *node) {
+    FsearchQueryInstruction instruction = {.opcode = opcode, .jump = 0, .node = node};
+    g_array_append_val(instructions, instruction);
+    return instructions->len - 1;
+}
+
+static FsearchQueryOpcode
+get_leaf_opcode(FsearchQueryNode *n, FsearchDatabaseEntryType type) {
+    if ((n->flags & QUERY_FLAG_FOLDERS_ONLY && type != DATABASE_ENTRY_TYPE_FOLDER)
+        || (n->flags & QUERY_FLAG_FILES_ONLY && type != DATABASE_ENTRY_TYPE_FILE)) {
+        return FSEARCH_QUERY_OPCODE_FALSE;
+    }
+    if (n->search_func == fsearch_query_matcher_true) {
+        return FSEARCH_QUERY_OPCODE_TRUE;
+    }
+    if (n->search_func == fsearch_query_matcher_false) {
+        return FSEARCH_QUERY_OPCODE_FALSE;
+    }
+    if (n->search_func == fsearch_query_matcher_size) {
+        return FSEARCH_QUERY_OPCODE_SIZE;
+    }
+    if (n->search_func == fsearch_query_matcher_date_modified) {
+        return FSEARCH_QUERY_OPCODE_DATE_MODIFIED;
+    }
+    if ((n->search_func == fsearch_query_matcher_strstr || n->search_func == fsearch_query_matcher_strcasestr)
+        && n->haystack_func == (FsearchQueryNodeHaystackFunc *)fsearch_query_match_data_get_name_str) {
+        return FSEARCH_QUERY_OPCODE_NAME_SUBSTRING;
+    }
+    if (fsearch_query_node_is_parent_filter(n)) {
+        return FSEARCH_QUERY_OPCODE_PARENT;
+    }
+    if (fsearch_query_node_is_path_substring_search(n)) {
+        return FSEARCH_QUERY_OPCODE_PATH_SUBSTRING;
+    }
+    return FSEARCH_QUERY_OPCODE_MATCH;
+}
+
+// Appends the instructions which set the result to whether an entry of type matches node
+static void
+compile_node(GNode *node, FsearchDatabaseEntryType type, GArray *instructions) {
+    if (!node) {
+        emit(instructions, FSEARCH_QUERY_OPCODE_TRUE, NULL);
+        return;
+    }
+    FsearchQueryNode *n = node->data;
+    if (!n) {
+        emit(instructions, FSEARCH_QUERY_OPCODE_FALSE, NULL);
+        return;
+    }
+    if (n->type != FSEARCH_QUERY_NODE_TYPE_OPERATOR) {
+        emit(instructions, get_leaf_opcode(n, type), n);
+        return;
+    }
+
+    GNode *left = node->children;
+    g_assert(left);
+    compile_node(left, type, instructions);
+    if (n->operator== FSEARCH_QUERY_NODE_OPERATOR_NOT) {
+        emit(instructions, FSEARCH_QUERY_OPCODE_NOT, n);
+        return;
+    }
+    // the right operand is skipped if the left one decides the result already
+    const uint32_t jump = emit(instructions,
+                               n->operator== FSEARCH_QUERY_NODE_OPERATOR_AND ? FSEARCH_QUERY_OPCODE_JUMP_IF_FALSE
+                                                                              : FSEARCH_QUERY_OPCODE_JUMP_IF_TRUE,
+                               n);
+    compile_node(left->next, type, instructions);
+    g_array_index(instructions, FsearchQueryInstruction, jump).jump = instructions->len;
+}
+
+FsearchQueryProgram *
+fsearch_query_program_new(GNode *tree) {
+    g_assert(tree);
+
+    FsearchQueryProgram *program = calloc(1, sizeof(FsearchQueryProgram));
+    g_assert(program);
+    for (uint32_t type = 0; type < NUM_DATABASE_ENTRY_TYPES; type++) {
+        GArray *instructions = g_array_new(FALSE, FALSE, sizeof(FsearchQueryInstruction));
+        compile_node(tree, type, instructions);
+        program->num_instructions[type] = instructions->len;
+        program->instructions[type] = (FsearchQueryInstruction *)g_array_free(instructions, FALSE);
+    }
+    program->tree = tree;
+    return program;
+}
+
+void
+fsearch_query_program_free(FsearchQueryProgram *program) {
+    if (!program) {
+        return;
+    }
+    for (uint32_t type = 0; type < NUM_DATABASE_ENTRY_TYPES; type++) {
+        g_clear_pointer(&program->instructions[type], g_free);
+    }
+    g_clear_pointer(&program, free);
+}
+
+static inline bool
+run_leaf(FsearchQueryOpcode opcode, FsearchQueryNode *node, FsearchQueryMatchData *match_data) {
+    switch (opcode) {
+    case FSEARCH_QUERY_OPCODE_TRUE:
+        return true;
+    case FSEARCH_QUERY_OPCODE_FALSE:
+        return false;
+    case FSEARCH_QUERY_OPCODE_MATCH:
+        return node->search_func(node, match_data) != 0;
+    case FSEARCH_QUERY_OPCODE_NAME_SUBSTRING: {
+        const char *name = fsearch_query_match_data_get_name_str(match_data);
+        return fsearch_string_search_find(&node->needle_search, name, strlen(name));
+    }
+    case FSEARCH_QUERY_OPCODE_PARENT:
+        return fsearch_query_matcher_parent_memoized(node, match_data) != 0;
+    case FSEARCH_QUERY_OPCODE_PATH_SUBSTRING:
+        return fsearch_query_matcher_path_memoized(node, match_data) != 0;
+    case FSEARCH_QUERY_OPCODE_SIZE:
+        return fsearch_query_matcher_cmp_num(fsearch_query_match_data_get_size(match_data), node) != 0;
+    case FSEARCH_QUERY_OPCODE_DATE_MODIFIED:
+        return fsearch_query_matcher_cmp_num(fsearch_query_match_data_get_mtime(match_data), node) != 0;
+    default:
+        g_assert_not_reached();
+    }
+}
+
+bool
+fsearch_query_program_run(const FsearchQueryProgram *program,
+                          FsearchQueryMatchData *match_data,
+                          FsearchDatabaseEntryType type) {
+    const FsearchQueryInstruction *instructions = program->instructions[type];
+    const uint32_t num_instructions = program->num_instructions[type];
+
+    bool result = true;
+    uint32_t pc = 0;
+    while (pc < num_instructions) {
+        const FsearchQueryInstruction *instruction = &instructions[pc++];
+        switch (instruction->opcode) {
+        case FSEARCH_QUERY_OPCODE_NOT:
+            result = !result;
+            break;
+        case FSEARCH_QUERY_OPCODE_JUMP_IF_FALSE:
+            if (!result) {
+                pc = instruction->jump;
+            }
+            break;
+        case FSEARCH_QUERY_OPCODE_JUMP_IF_TRUE:
+            if (result) {
+                pc = instruction->jump;
+            }
+            break;
+        default:
+            result = run_leaf(instruction->opcode, instruction->node, match_data);
+        }
+    }
+    return result;
+}
+
+static inline uint32_t
+block_get_position(const FsearchQueryBlock *block, uint32_t j) {
+    return block->positions ? block->positions[block->start + j] : block->start + j;
+}
+
+static bool
+selection_is_empty(const uint64_t *selection) {
+    uint64_t any = 0;
+    for (uint32_t w = 0; w < FSEARCH_QUERY_BLOCK_NUM_WORDS; w++) {
+        any |= selection[w];
+    }
+    return any == 0;
+}
+
+void
+fsearch_query_block_select_all(const FsearchQueryBlock *block, uint64_t *selection) {
+    g_assert(block->num_entries <= FSEARCH_QUERY_BLOCK_SIZE);
+    for (uint32_t w = 0; w < FSEARCH_QUERY_BLOCK_NUM_WORDS; w++) {
+        const uint32_t first = w * 64;
+        if (block->num_entries >= first + 64) {
+            selection[w] = UINT64_MAX;
+        }
+        else if (block->num_entries > first) {
+            selection[w] = (UINT64_C(1) << (block->num_entries - first)) - 1;
+        }
+        else {
+            selection[w] = 0;
+        }
+    }
+}
+
+// The bits of the values of the block which fulfil cmp, the loops are branch free so the compiler can vectorize them
+#define MATCH_VALUES(cmp)                                                                                             \
+    for (uint32_t w = 0; w < FSEARCH_QUERY_BLOCK_NUM_WORDS; w++) {                                                     \
+        const uint32_t first = w * 64;                                                                                 \
+        const uint32_t last = MIN(first + 64, num_entries);                                                            \
+        uint64_t bits = 0;                                                                                             \
+        for (uint32_t j = first; j < last; j++) {                                                                      \
+            const int64_t num = values[j];                                                                             \
+            bits |= (uint64_t)(cmp) << (j - first);                                                                    \
+        }                                                                                                              \
+        matches[w] = bits;                                                                                             \
+    }
+
+static void
+match_values(const int64_t *values, uint32_t num_entries, const FsearchQueryNode *node, uint64_t *matches) {
+    const int64_t start = node->num_start;
+    const int64_t end = node->num_end;
+    switch (node->comparison_type) {
+    case FSEARCH_QUERY_NODE_COMPARISON_EQUAL:
+        MATCH_VALUES(num == start)
+        break;
+    case FSEARCH_QUERY_NODE_COMPARISON_GREATER:
+        MATCH_VALUES(num > start)
+        break;
+    case FSEARCH_QUERY_NODE_COMPARISON_SMALLER:
+        MATCH_VALUES(num < start)
+        break;
+    case FSEARCH_QUERY_NODE_COMPARISON_GREATER_EQ:
+        MATCH_VALUES(num >= start)
+        break;
+    case FSEARCH_QUERY_NODE_COMPARISON_SMALLER_EQ:
+        MATCH_VALUES(num <= start)
+        break;
+    case FSEARCH_QUERY_NODE_COMPARISON_RANGE:
+        MATCH_VALUES(start <= num && num < end)
+        break;
+    default:
+        memset(matches, 0, FSEARCH_QUERY_BLOCK_NUM_WORDS * sizeof(uint64_t));
+    }
+}
+
+#undef MATCH_VALUES
+
+// Compares a column of the block at once
+static bool
+run_column_leaf(FsearchQueryOpcode opcode,
+                const FsearchQueryNode *node,
+                const FsearchQueryBlock *block,
+                const uint64_t *selection,
+                uint64_t *result) {
+    if ((opcode != FSEARCH_QUERY_OPCODE_SIZE && opcode != FSEARCH_QUERY_OPCODE_DATE_MODIFIED) || !block->columns) {
+        return false;
+    }
+    const int64_t *column = opcode == FSEARCH_QUERY_OPCODE_SIZE ? block->columns->sizes : block->columns->mtimes;
+    if (block->positions) {
+        int64_t values[FSEARCH_QUERY_BLOCK_SIZE];
+        for (uint32_t j = 0; j < block->num_entries; j++) {
+            values[j] = column[block->positions[block->start + j]];
+        }
+        match_values(values, block->num_entries, node, result);
+    }
+    else {
+        match_values(column + block->start, block->num_entries, node, result);
+    }
+    for (uint32_t w = 0; w < FSEARCH_QUERY_BLOCK_NUM_WORDS; w++) {
+        result[w] &= selection[w];
+    }
+    return true;
+}
+
+// Looks up the extension ids of the block at once, if its entries are the files they were interned for
+static bool
+run_extension_leaf(const FsearchQueryNode *node,
+                   const FsearchQueryBlock *block,
+                   const uint64_t *selection,
+                   uint64_t *result) {
+    if (node->search_func != fsearch_query_matcher_extension || !node->search_term_list || !node->extension_matches
+        || !node->extensions || node->extensions->files != block->entries) {
+        return false;
+    }
+    const uint32_t *ids = node->extensions->ids;
+    for (uint32_t w = 0; w < FSEARCH_QUERY_BLOCK_NUM_WORDS; w++) {
+        uint64_t bits = selection[w];
+        uint64_t matches = 0;
+        while (bits) {
+            const uint32_t b = __builtin_ctzll(bits);
+            bits &= bits - 1;
+            const uint32_t id = ids[block_get_position(block, w * 64 + b)];
+            matches |= ((node->extension_matches[id / 64] >> (id % 64)) & 1) << b;
+        }
+        result[w] = matches;
+    }
+    return true;
+}
+
+static void
+run_block_leaf(FsearchQueryNode *node,
+               FsearchQueryMatchData *match_data,
+               const FsearchQueryBlock *block,
+               const uint64_t *selection,
+               uint64_t *result) {
+    const FsearchQueryOpcode opcode = get_leaf_opcode(node, block->type);
+    if (opcode == FSEARCH_QUERY_OPCODE_TRUE || opcode == FSEARCH_QUERY_OPCODE_FALSE) {
+        for (uint32_t w = 0; w < FSEARCH_QUERY_BLOCK_NUM_WORDS; w++) {
+            result[w] = opcode == FSEARCH_QUERY_OPCODE_TRUE ? selection[w] : 0;
+        }
+        return;
+    }
+    if (run_column_leaf(opcode, node, block, selection, result) || run_extension_leaf(node, block, selection, result)) {
+        return;
+    }
+
+    for (uint32_t w = 0; w < FSEARCH_QUERY_BLOCK_NUM_WORDS; w++) {
+        uint64_t bits = selection[w];
+        uint64_t matches = 0;
+        while (bits) {
+            const uint32_t b = __builtin_ctzll(bits);
+            bits &= bits - 1;
+            const uint32_t i = block_get_position(block, w * 64 + b);
+            fsearch_query_match_data_set_entry(match_data, darray_get_item(block->entries, i));
+            if (block->columns) {
+                fsearch_query_match_data_set_columns(match_data, block->columns, i);
+            }
+            if (run_leaf(opcode, node, match_data)) {
+                matches |= UINT64_C(1) << b;
+            }
+        }
+        result[w] = matches;
+    }
+}
+
+// Sets result to the entries of selection which match node
+static void
+run_block_node(GNode *node,
+               FsearchQueryMatchData *match_data,
+               const FsearchQueryBlock *block,
+               const uint64_t *selection,
+               uint64_t *result) {
+    if (!node) {
+        memcpy(result, selection, FSEARCH_QUERY_BLOCK_NUM_WORDS * sizeof(uint64_t));
+        return;
+    }
+    FsearchQueryNode *n = node->data;
+    if (!n || selection_is_empty(selection)) {
+        memset(result, 0, FSEARCH_QUERY_BLOCK_NUM_WORDS * sizeof(uint64_t));
+        return;
+    }
+    if (n->type != FSEARCH_QUERY_NODE_TYPE_OPERATOR) {
+        run_block_leaf(n, match_data, block, selection, result);
+        return;
+    }
+
+    GNode *left = node->children;
+    g_assert(left);
+    uint64_t left_result[FSEARCH_QUERY_BLOCK_NUM_WORDS];
+    run_block_node(left, match_data, block, selection, left_result);
+    if (n->operator== FSEARCH_QUERY_NODE_OPERATOR_NOT) {
+        for (uint32_t w = 0; w < FSEARCH_QUERY_BLOCK_NUM_WORDS; w++) {
+            result[w] = selection[w] & ~left_result[w];
+        }
+        return;
+    }
+    if (n->operator== FSEARCH_QUERY_NODE_OPERATOR_AND) {
+        // the right operand only sees the entries the left one matched
+        run_block_node(left->next, match_data, block, left_result, result);
+        return;
+    }
+    // and for OR the ones it didn't match
+    uint64_t remaining[FSEARCH_QUERY_BLOCK_NUM_WORDS];
+    for (uint32_t w = 0; w < FSEARCH_QUERY_BLOCK_NUM_WORDS; w++) {
+        remaining[w] = selection[w] & ~left_result[w];
+    }
+    run_block_node(left->next, match_data, block, remaining, result);
+    for (uint32_t w = 0; w < FSEARCH_QUERY_BLOCK_NUM_WORDS; w++) {
+        result[w] |= left_result[w];
+    }
+}
+
+void
+fsearch_query_program_run_block(const FsearchQueryProgram *program,
+                                FsearchQueryMatchData *match_data,
+                                const FsearchQueryBlock *block,
+                                uint64_t *selection) {
+    uint64_t result[FSEARCH_QUERY_BLOCK_NUM_WORDS];
+    run_block_node(program->tree, match_data, block, selection, result);
+    memcpy(selection, result, sizeof(result));
+}
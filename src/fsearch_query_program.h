@@ -0,0 +1,89 @@
+#pragma once
+
+#include <glib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "fsearch_array.h"
+#include "fsearch_database_columns.h"
+#include "fsearch_database_entry.h"
+#include "fsearch_query_match_data.h"
+#include "fsearch_query_node.h"
+
+typedef enum FsearchQueryOpcode {
+    FSEARCH_QUERY_OPCODE_TRUE,
+    FSEARCH_QUERY_OPCODE_FALSE,
+    // calls the search_func of the node
+    FSEARCH_QUERY_OPCODE_MATCH,
+    // the substring searches in names, which are the most common leaves
+    FSEARCH_QUERY_OPCODE_NAME_SUBSTRING,
+    // parent filters and path substring searches, which remember their results per folder
+    FSEARCH_QUERY_OPCODE_PARENT,
+    FSEARCH_QUERY_OPCODE_PATH_SUBSTRING,
+    FSEARCH_QUERY_OPCODE_SIZE,
+    FSEARCH_QUERY_OPCODE_DATE_MODIFIED,
+    FSEARCH_QUERY_OPCODE_NOT,
+    // continue with the instruction at jump, if the result so far decides the operator (i.e. it's false for AND or
+    // true for OR)
+    FSEARCH_QUERY_OPCODE_JUMP_IF_FALSE,
+    FSEARCH_QUERY_OPCODE_JUMP_IF_TRUE,
+    NUM_FSEARCH_QUERY_OPCODES,
+} FsearchQueryOpcode;
+
+typedef struct FsearchQueryInstruction {
+    FsearchQueryOpcode opcode;
+    uint32_t jump;
+    FsearchQueryNode *node;
+} FsearchQueryInstruction;
+
+// A query tree compiled into a flat list of instructions, which set a single result one after another. The folder
+// and files only flags of the nodes are resolved when it's compiled, so there's one list per entry type.
+typedef struct FsearchQueryProgram {
+    FsearchQueryInstruction *instructions[NUM_DATABASE_ENTRY_TYPES];
+    uint32_t num_instructions[NUM_DATABASE_ENTRY_TYPES];
+    // the tree the program was compiled from, blocks of entries are matched against it directly
+    GNode *tree;
+} FsearchQueryProgram;
+
+// The number of entries which are matched at once by fsearch_query_program_run_block
+#define FSEARCH_QUERY_BLOCK_SIZE 1024
+#define FSEARCH_QUERY_BLOCK_NUM_WORDS (FSEARCH_QUERY_BLOCK_SIZE / 64)
+
+// Up to FSEARCH_QUERY_BLOCK_SIZE consecutive entries of the same type. Bit j of the selection of a block stands for
+// its entry j.
+typedef struct FsearchQueryBlock {
+    DynamicArray *entries;
+    // optional, entry j of the block is the one at positions[start + j] in entries, otherwise the one at start + j
+    const uint32_t *positions;
+    uint32_t start;
+    uint32_t num_entries;
+    FsearchDatabaseEntryType type;
+    // optional, the columns of entries
+    const FsearchDatabaseColumns *columns;
+} FsearchQueryBlock;
+
+// The nodes are owned by tree, which has to outlive the program
+FsearchQueryProgram *
+fsearch_query_program_new(GNode *tree);
+
+void
+fsearch_query_program_free(FsearchQueryProgram *program);
+
+// Same as matching the entry of match_data (which must be set) against the tree the program was compiled from
+bool
+fsearch_query_program_run(const FsearchQueryProgram *program,
+                          FsearchQueryMatchData *match_data,
+                          FsearchDatabaseEntryType type);
+
+// Selects all entries of block
+void
+fsearch_query_block_select_all(const FsearchQueryBlock *block, uint64_t *selection);
+
+// Deselects the entries of block which don't match, one leaf of the tree after another. Every leaf only looks at the
+// entries which are still selected and could change the result, and size and modification time comparisons
+// are done for the whole block at once if it has columns.
+void
+fsearch_query_program_run_block(const FsearchQueryProgram *program,
+                                FsearchQueryMatchData *match_data,
+                                const FsearchQueryBlock *block,
+                                uint64_t *selection);
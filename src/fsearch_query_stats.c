@@ -0,0 +1,70 @@
+#include "fsearch_query_stats.h"
+
+static void
+append_json_string(GString *str, const char *text) {
+    g_string_append_c(str, '"');
+    for (const char *c = text; *c; c++) {
+        switch (*c) {
+        case '"':
+            g_string_append(str, "\\\"");
+            break;
+        case '\\':
+            g_string_append(str, "\\\\");
+            break;
+        case '\n':
+            g_string_append(str, "\\n");
+            break;
+        case '\t':
+            g_string_append(str, "\\t");
+            break;
+        default:
+            if ((unsigned char)*c < 0x20) {
+                g_string_append_printf(str, "\\u%04x", (unsigned char)*c);
+            }
+            else {
+                g_string_append_c(str, *c);
+            }
+        }
+    }
+    g_string_append_c(str, '"');
+}
+
+// JSON numbers always use a decimal point, whatever the locale is
+static void
+append_json_time(GString *str, const char *name, double ms) {
+    char buffer[G_ASCII_DTOSTR_BUF_SIZE];
+    g_string_append_printf(str, "\"%s\":%s", name, g_ascii_formatd(buffer, sizeof(buffer), "%.3f", ms));
+}
+
+GString *
+fsearch_query_stats_to_json(const FsearchQueryStats *stats, const char *query_text) {
+    g_assert(stats);
+
+    GString *str = g_string_new("{");
+    if (query_text) {
+        g_string_append(str, "\"query\":");
+        append_json_string(str, query_text);
+        g_string_append_c(str, ',');
+    }
+    append_json_time(str, "parse_ms", stats->parse_time);
+    g_string_append_c(str, ',');
+    append_json_time(str, "filter_ms", stats->filter_time);
+    g_string_append_c(str, ',');
+    append_json_time(str, "match_ms", stats->match_time);
+    g_string_append_c(str, ',');
+    append_json_time(str, "merge_ms", stats->merge_time);
+    g_string_append_c(str, ',');
+    append_json_time(str, "sort_ms", stats->sort_time);
+    g_string_append_printf(str,
+                           ",\"entries_scanned\":%" G_GUINT64_FORMAT ",\"results\":%u,\"threads\":[",
+                           stats->num_entries_scanned,
+                           stats->num_results);
+    for (uint32_t i = 0; i < MIN(stats->num_threads, FSEARCH_THREAD_LIMIT); i++) {
+        const FsearchQueryThreadStats *thread = &stats->threads[i];
+        g_string_append(str, i ? ",{" : "{");
+        append_json_time(str, "match_ms", thread->match_time);
+        g_string_append_printf(str, ",\"entries_scanned\":%" G_GUINT64_FORMAT "}", thread->num_entries_scanned);
+    }
+    g_string_append(str, "]}");
+    return str;
+}
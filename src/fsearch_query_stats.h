@@ -0,0 +1,36 @@
+#pragma once
+
+#include "fsearch_limits.h"
+
+#include <glib.h>
+#include <stdint.h>
+
+typedef struct FsearchQueryThreadStats {
+    // in ms, while the thread took part in the search
+    double match_time;
+    uint64_t num_entries_scanned;
+} FsearchQueryThreadStats;
+
+// Where the time of a search went, all times are in ms
+typedef struct FsearchQueryStats {
+    // parsing the query text and compiling its trees
+    double parse_time;
+    // looking up or matching which entries of the database the filter matches, before the search
+    double filter_time;
+    // from starting the search threads until the last of them is done, filters which weren't matched before the
+    // search are part of it
+    double match_time;
+    // collecting the matches of the threads into the results
+    double merge_time;
+    // sorting the results, if the database didn't have them in the requested order
+    double sort_time;
+    // the entries which were matched against the query, the ones ruled out by an index aren't
+    uint64_t num_entries_scanned;
+    uint32_t num_results;
+    uint32_t num_threads;
+    FsearchQueryThreadStats threads[FSEARCH_THREAD_LIMIT];
+} FsearchQueryStats;
+
+// A JSON object with all stats, query_text gets added to it if it's not NULL
+GString *
+fsearch_query_stats_to_json(const FsearchQueryStats *stats, const char *query_text);
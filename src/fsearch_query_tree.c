@@ -1,6 +1,8 @@
 #define G_LOG_DOMAIN "fsearch-query-tree"
 
 #include "fsearch_query_tree.h"
+#include "fsearch_database_trigrams.h"
+#include "fsearch_query_matchers.h"
 #include "fsearch_query_node.h"
 #include "fsearch_query_parser.h"
 #include "fsearch_string_utils.h"
@@ -272,6 +274,440 @@ fsearch_query_node_tree_wants_single_threaded_search(GNode *tree) {
     return wants_single_threaded_search;
 }
 
+static gboolean
+node_wants_columns(GNode *node, gpointer data) {
+    FsearchQueryNode *n = node->data;
+    g_assert(data);
+
+    bool *wants_columns = data;
+    if (n && n->wants_columns) {
+        *wants_columns = true;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+bool
+fsearch_query_node_tree_wants_columns(GNode *tree) {
+    g_assert(tree);
+    bool wants_columns = false;
+
+    g_node_traverse(tree, G_IN_ORDER, G_TRAVERSE_ALL, -1, node_wants_columns, &wants_columns);
+
+    return wants_columns;
+}
+
+static gboolean
+node_wants_folder_paths(GNode *node, gpointer data) {
+    FsearchQueryNode *n = node->data;
+    g_assert(data);
+
+    bool *wants_folder_paths = data;
+    if (n
+        && (n->haystack_func == (FsearchQueryNodeHaystackFunc *)fsearch_query_match_data_get_path_str
+            || n->haystack_func == (FsearchQueryNodeHaystackFunc *)fsearch_query_match_data_get_parent_path_str
+            || n->haystack_func == (FsearchQueryNodeHaystackFunc *)fsearch_query_match_data_get_utf_path_builder
+            || n->haystack_func
+                   == (FsearchQueryNodeHaystackFunc *)fsearch_query_match_data_get_utf_parent_path_builder)) {
+        *wants_folder_paths = true;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+static gboolean
+node_wants_folded_names(GNode *node, gpointer data) {
+    FsearchQueryNode *n = node->data;
+    g_assert(data);
+
+    bool *wants_folded_names = data;
+    if (n && n->haystack_func == (FsearchQueryNodeHaystackFunc *)fsearch_query_match_data_get_utf_name_builder) {
+        *wants_folded_names = true;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+bool
+fsearch_query_node_tree_wants_folded_names(GNode *tree) {
+    g_assert(tree);
+    bool wants_folded_names = false;
+
+    g_node_traverse(tree, G_IN_ORDER, G_TRAVERSE_ALL, -1, node_wants_folded_names, &wants_folded_names);
+
+    return wants_folded_names;
+}
+
+static gboolean
+node_wants_extensions(GNode *node, gpointer data) {
+    FsearchQueryNode *n = node->data;
+    g_assert(data);
+
+    bool *wants_extensions = data;
+    if (n && n->search_func == fsearch_query_matcher_extension) {
+        *wants_extensions = true;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+bool
+fsearch_query_node_tree_wants_extensions(GNode *tree) {
+    g_assert(tree);
+    bool wants_extensions = false;
+
+    g_node_traverse(tree, G_IN_ORDER, G_TRAVERSE_ALL, -1, node_wants_extensions, &wants_extensions);
+
+    return wants_extensions;
+}
+
+static gboolean
+node_wants_duplicates(GNode *node, gpointer data) {
+    FsearchQueryNode *n = node->data;
+    g_assert(data);
+
+    bool *wants_duplicates = data;
+    if (n && n->search_func == fsearch_query_matcher_duplicate) {
+        *wants_duplicates = true;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+bool
+fsearch_query_node_tree_wants_duplicates(GNode *tree) {
+    g_assert(tree);
+    bool wants_duplicates = false;
+
+    g_node_traverse(tree, G_IN_ORDER, G_TRAVERSE_ALL, -1, node_wants_duplicates, &wants_duplicates);
+
+    return wants_duplicates;
+}
+
+static gboolean
+node_wants_metadata(GNode *node, gpointer data) {
+    FsearchQueryNode *n = node->data;
+    g_assert(data);
+
+    bool *wants_metadata = data;
+    FsearchDatabaseMetadataColumn column = 0;
+    if (n && fsearch_query_node_get_metadata_column(n, &column)) {
+        *wants_metadata = true;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+bool
+fsearch_query_node_tree_wants_metadata(GNode *tree) {
+    g_assert(tree);
+    bool wants_metadata = false;
+
+    g_node_traverse(tree, G_IN_ORDER, G_TRAVERSE_ALL, -1, node_wants_metadata, &wants_metadata);
+
+    return wants_metadata;
+}
+
+FsearchQueryNode *
+fsearch_query_node_tree_get_required_extension_filter(GNode *tree) {
+    if (!tree) {
+        return NULL;
+    }
+    FsearchQueryNode *n = tree->data;
+    if (!n) {
+        return NULL;
+    }
+    if (n->type == FSEARCH_QUERY_NODE_TYPE_OPERATOR) {
+        if (n->operator!= FSEARCH_QUERY_NODE_OPERATOR_AND || !tree->children) {
+            return NULL;
+        }
+        FsearchQueryNode *left = fsearch_query_node_tree_get_required_extension_filter(tree->children);
+        return left ? left : fsearch_query_node_tree_get_required_extension_filter(tree->children->next);
+    }
+    return n->search_func == fsearch_query_matcher_extension ? n : NULL;
+}
+
+static bool
+node_is_name_substring_search(FsearchQueryNode *n) {
+    // the other matchers compare folded or normalized names, which can contain different trigrams
+    const bool is_byte_search = n->search_func == fsearch_query_matcher_strstr
+                             || n->search_func == fsearch_query_matcher_strcasestr
+                             || n->search_func == fsearch_query_matcher_strcmp
+                             || n->search_func == fsearch_query_matcher_strcasecmp;
+    return is_byte_search && n->haystack_func == (FsearchQueryNodeHaystackFunc *)fsearch_query_match_data_get_name_str
+        && n->needle && n->needle_len >= DB_TRIGRAMS_MIN_NEEDLE_LEN;
+}
+
+void
+fsearch_query_node_tree_get_required_name_needles(GNode *tree, GPtrArray *needles) {
+    g_assert(needles);
+    if (!tree || !tree->data) {
+        return;
+    }
+    FsearchQueryNode *n = tree->data;
+    if (n->type == FSEARCH_QUERY_NODE_TYPE_OPERATOR) {
+        if (n->operator!= FSEARCH_QUERY_NODE_OPERATOR_AND) {
+            return;
+        }
+        for (GNode *child = tree->children; child; child = child->next) {
+            fsearch_query_node_tree_get_required_name_needles(child, needles);
+        }
+        return;
+    }
+    if (node_is_name_substring_search(n)) {
+        g_ptr_array_add(needles, n->needle);
+    }
+    // and so does the text all matches of a regex contain
+    else if (fsearch_query_node_is_regex(n)
+             && n->haystack_func == (FsearchQueryNodeHaystackFunc *)fsearch_query_match_data_get_name_str
+             && n->regex_literal_search.needle && n->regex_literal_search.needle_len >= DB_TRIGRAMS_MIN_NEEDLE_LEN) {
+        g_ptr_array_add(needles, n->regex_literal_search.needle);
+    }
+}
+
+void
+fsearch_query_node_tree_get_required_name_prefix_nodes(GNode *tree, GPtrArray *nodes) {
+    g_assert(nodes);
+    if (!tree || !tree->data) {
+        return;
+    }
+    FsearchQueryNode *n = tree->data;
+    if (n->type == FSEARCH_QUERY_NODE_TYPE_OPERATOR) {
+        if (n->operator!= FSEARCH_QUERY_NODE_OPERATOR_AND) {
+            return;
+        }
+        for (GNode *child = tree->children; child; child = child->next) {
+            fsearch_query_node_tree_get_required_name_prefix_nodes(child, nodes);
+        }
+        return;
+    }
+    bool is_exact = false;
+    g_autofree char *prefix = fsearch_query_node_get_name_prefix(n, &is_exact);
+    if (prefix) {
+        g_ptr_array_add(nodes, n);
+    }
+}
+
+void
+fsearch_query_node_tree_get_required_nodes(GNode *tree, FsearchQueryNodeMatchFunc *search_func, GPtrArray *nodes) {
+    g_assert(nodes);
+    if (!tree || !tree->data) {
+        return;
+    }
+    FsearchQueryNode *n = tree->data;
+    if (n->type == FSEARCH_QUERY_NODE_TYPE_OPERATOR) {
+        if (n->operator!= FSEARCH_QUERY_NODE_OPERATOR_AND) {
+            return;
+        }
+        for (GNode *child = tree->children; child; child = child->next) {
+            fsearch_query_node_tree_get_required_nodes(child, search_func, nodes);
+        }
+        return;
+    }
+    if (n->search_func == search_func) {
+        g_ptr_array_add(nodes, n);
+    }
+}
+
+void
+fsearch_query_node_tree_get_required_metadata_nodes(GNode *tree, GPtrArray *nodes) {
+    g_assert(nodes);
+    if (!tree || !tree->data) {
+        return;
+    }
+    FsearchQueryNode *n = tree->data;
+    if (n->type == FSEARCH_QUERY_NODE_TYPE_OPERATOR) {
+        if (n->operator!= FSEARCH_QUERY_NODE_OPERATOR_AND) {
+            return;
+        }
+        for (GNode *child = tree->children; child; child = child->next) {
+            fsearch_query_node_tree_get_required_metadata_nodes(child, nodes);
+        }
+        return;
+    }
+    FsearchDatabaseMetadataColumn column = 0;
+    if (fsearch_query_node_get_metadata_column(n, &column)) {
+        g_ptr_array_add(nodes, n);
+    }
+}
+
+bool
+fsearch_query_node_tree_wants_sorted_entries(GNode *tree) {
+    g_assert(tree);
+    g_autoptr(GPtrArray) nodes = g_ptr_array_new();
+    fsearch_query_node_tree_get_required_nodes(tree, fsearch_query_matcher_size, nodes);
+    fsearch_query_node_tree_get_required_nodes(tree, fsearch_query_matcher_date_modified, nodes);
+    return nodes->len > 0;
+}
+
+bool
+fsearch_query_node_tree_wants_trigrams(GNode *tree) {
+    g_assert(tree);
+    g_autoptr(GPtrArray) needles = g_ptr_array_new();
+    fsearch_query_node_tree_get_required_name_needles(tree, needles);
+    return needles->len > 0;
+}
+
+static gboolean
+node_set_extensions(GNode *node, gpointer data) {
+    FsearchQueryNode *n = node->data;
+    if (n) {
+        fsearch_query_node_set_extensions(n, data);
+    }
+    return FALSE;
+}
+
+void
+fsearch_query_node_tree_set_extensions(GNode *tree, FsearchDatabaseExtensions *extensions) {
+    g_assert(tree);
+    g_node_traverse(tree, G_IN_ORDER, G_TRAVERSE_ALL, -1, node_set_extensions, extensions);
+}
+
+static gboolean
+node_set_duplicates(GNode *node, gpointer data) {
+    FsearchQueryNode *n = node->data;
+    if (n) {
+        fsearch_query_node_set_duplicates(n, data);
+    }
+    return FALSE;
+}
+
+void
+fsearch_query_node_tree_set_duplicates(GNode *tree, FsearchDuplicates *duplicates) {
+    g_assert(tree);
+    g_node_traverse(tree, G_IN_ORDER, G_TRAVERSE_ALL, -1, node_set_duplicates, duplicates);
+}
+
+static gboolean
+node_set_folder_paths(GNode *node, gpointer data) {
+    FsearchQueryNode *n = node->data;
+    if (n) {
+        fsearch_query_node_set_folder_paths(n, data);
+    }
+    return FALSE;
+}
+
+void
+fsearch_query_node_tree_set_folder_paths(GNode *tree, FsearchDatabaseFolderPaths *folder_paths) {
+    g_assert(tree);
+    g_node_traverse(tree, G_IN_ORDER, G_TRAVERSE_ALL, -1, node_set_folder_paths, folder_paths);
+}
+
+bool
+fsearch_query_node_tree_wants_folder_paths(GNode *tree) {
+    g_assert(tree);
+    bool wants_folder_paths = false;
+
+    g_node_traverse(tree, G_IN_ORDER, G_TRAVERSE_ALL, -1, node_wants_folder_paths, &wants_folder_paths);
+
+    return wants_folder_paths;
+}
+
+// Rough estimates of what evaluating a node costs per entry (relative to a numeric comparison) and the share of
+// entries it matches
+typedef struct FsearchQueryNodeEstimate {
+    double cost;
+    double selectivity;
+} FsearchQueryNodeEstimate;
+
+static FsearchQueryNodeEstimate
+estimate_leaf(FsearchQueryNode *n) {
+    FsearchQueryNodeHaystackFunc *haystack = n->haystack_func;
+    if (n->search_func == fsearch_query_matcher_true) {
+        return (FsearchQueryNodeEstimate){0, 1};
+    }
+    if (n->search_func == fsearch_query_matcher_false) {
+        return (FsearchQueryNodeEstimate){0, 0};
+    }
+    if (n->search_func == fsearch_query_matcher_content) {
+        // reads and searches the whole file, so everything else should rule out entries first
+        return (FsearchQueryNodeEstimate){100000, 0.05};
+    }
+    if (haystack == (FsearchQueryNodeHaystackFunc *)fsearch_query_match_data_get_content_type_str) {
+        // queries the file system for every entry
+        return (FsearchQueryNodeEstimate){1000, 0.1};
+    }
+    if (n->search_func == fsearch_query_matcher_regex) {
+        return (FsearchQueryNodeEstimate){32, 0.2};
+    }
+    if (n->search_func == fsearch_query_matcher_wildcard) {
+        return (FsearchQueryNodeEstimate){8, 0.2};
+    }
+    if (haystack == (FsearchQueryNodeHaystackFunc *)fsearch_query_match_data_get_path_str
+        || haystack == (FsearchQueryNodeHaystackFunc *)fsearch_query_match_data_get_parent_path_str
+        || haystack == (FsearchQueryNodeHaystackFunc *)fsearch_query_match_data_get_utf_path_builder
+        || haystack == (FsearchQueryNodeHaystackFunc *)fsearch_query_match_data_get_utf_parent_path_builder) {
+        return (FsearchQueryNodeEstimate){16, 0.2};
+    }
+    if (n->search_func == fsearch_query_matcher_strstr || n->search_func == fsearch_query_matcher_strcasestr
+        || n->search_func == fsearch_query_matcher_strcmp || n->search_func == fsearch_query_matcher_strcasecmp) {
+        return (FsearchQueryNodeEstimate){4, 0.1};
+    }
+    if (n->search_func == fsearch_query_matcher_extension) {
+        return (FsearchQueryNodeEstimate){2, 0.1};
+    }
+    if (haystack || n->needle) {
+        // the other string matchers fold or normalize the names
+        return (FsearchQueryNodeEstimate){8, 0.1};
+    }
+    // size, date modified and the other numeric filters
+    return (FsearchQueryNodeEstimate){1, 0.5};
+}
+
+// The cost per entry it doesn't match, the operand with the lower one should decide first
+static double
+get_rank(FsearchQueryNodeEstimate estimate, FsearchQueryNodeOperator operator) {
+    const double decides = operator== FSEARCH_QUERY_NODE_OPERATOR_AND ? 1 - estimate.selectivity : estimate.selectivity;
+    return decides > 0 ? estimate.cost / decides : G_MAXDOUBLE;
+}
+
+static FsearchQueryNodeEstimate
+plan_tree(GNode *tree) {
+    FsearchQueryNode *n = tree->data;
+    if (!n) {
+        return (FsearchQueryNodeEstimate){0, 0};
+    }
+    if (n->type != FSEARCH_QUERY_NODE_TYPE_OPERATOR) {
+        return estimate_leaf(n);
+    }
+    GNode *left = tree->children;
+    if (!left) {
+        return (FsearchQueryNodeEstimate){0, 0};
+    }
+    FsearchQueryNodeEstimate left_estimate = plan_tree(left);
+    if (n->operator== FSEARCH_QUERY_NODE_OPERATOR_NOT || !left->next) {
+        return (FsearchQueryNodeEstimate){left_estimate.cost, 1 - left_estimate.selectivity};
+    }
+    GNode *right = left->next;
+    FsearchQueryNodeEstimate right_estimate = plan_tree(right);
+
+    if (get_rank(right_estimate, n->operator) < get_rank(left_estimate, n->operator)) {
+        g_node_unlink(right);
+        g_node_prepend(tree, right);
+        n->operands_swapped = !n->operands_swapped;
+        const FsearchQueryNodeEstimate tmp = left_estimate;
+        left_estimate = right_estimate;
+        right_estimate = tmp;
+    }
+
+    if (n->operator== FSEARCH_QUERY_NODE_OPERATOR_AND) {
+        // the right operand only gets evaluated for the entries the left one matches
+        return (FsearchQueryNodeEstimate){left_estimate.cost + left_estimate.selectivity * right_estimate.cost,
+                                          left_estimate.selectivity * right_estimate.selectivity};
+    }
+    return (FsearchQueryNodeEstimate){
+        left_estimate.cost + (1 - left_estimate.selectivity) * right_estimate.cost,
+        1 - (1 - left_estimate.selectivity) * (1 - right_estimate.selectivity)};
+}
+
+void
+fsearch_query_node_tree_plan(GNode *tree) {
+    if (!tree) {
+        return;
+    }
+    plan_tree(tree);
+}
+
 GNode *
 fsearch_query_node_tree_new(const char *search_term, FsearchFilterManager *filters, FsearchQueryFlags flags) {
     g_autofree char *query = g_strdup(search_term);
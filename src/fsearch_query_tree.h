@@ -1,6 +1,8 @@
 #pragma once
 
+#include "fsearch_database_extensions.h"
 #include "fsearch_filter_manager.h"
+#include "fsearch_query_node.h"
 
 #include <glib.h>
 
@@ -13,6 +15,75 @@ fsearch_query_node_tree_triggers_auto_match_case(GNode *tree);
 bool
 fsearch_query_node_tree_wants_single_threaded_search(GNode *tree);
 
+bool
+fsearch_query_node_tree_wants_columns(GNode *tree);
+
+bool
+fsearch_query_node_tree_wants_folder_paths(GNode *tree);
+
+bool
+fsearch_query_node_tree_wants_folded_names(GNode *tree);
+
+bool
+fsearch_query_node_tree_wants_extensions(GNode *tree);
+
+bool
+fsearch_query_node_tree_wants_duplicates(GNode *tree);
+
+// Whether tree filters by owner, permissions or one of the other timestamps, see FsearchDatabaseMetadata
+bool
+fsearch_query_node_tree_wants_metadata(GNode *tree);
+
+// The extension filter every entry has to match to match tree (i.e. one which is only combined with others by AND),
+// or NULL if there's none
+FsearchQueryNode *
+fsearch_query_node_tree_get_required_extension_filter(GNode *tree);
+
+// Adds the needles of the substring and exact name searches (and the literal texts of regex name searches) every entry
+// has to match to match tree (i.e. which are only combined with others by AND) and which are long enough to be looked up in FsearchDatabaseTrigrams. They're
+// owned by the nodes of tree.
+void
+fsearch_query_node_tree_get_required_name_needles(GNode *tree, GPtrArray *needles);
+
+// Adds the nodes every entry has to match to match tree, which only match names with a certain prefix, see
+// fsearch_query_node_get_name_prefix
+void
+fsearch_query_node_tree_get_required_name_prefix_nodes(GNode *tree, GPtrArray *nodes);
+
+// Adds the nodes every entry has to match to match tree, which match with search_func
+void
+fsearch_query_node_tree_get_required_nodes(GNode *tree, FsearchQueryNodeMatchFunc *search_func, GPtrArray *nodes);
+
+// Adds the nodes every entry has to match to match tree, which filter by a column of FsearchDatabaseMetadata
+void
+fsearch_query_node_tree_get_required_metadata_nodes(GNode *tree, GPtrArray *nodes);
+
+// Whether every entry has to match a size or modification time filter to match tree, so the entries which do can be
+// looked up in the arrays sorted by that attribute
+bool
+fsearch_query_node_tree_wants_sorted_entries(GNode *tree);
+
+bool
+fsearch_query_node_tree_wants_trigrams(GNode *tree);
+
+// Prepares the extension filters of tree for searches with extensions, see fsearch_query_node_set_extensions
+void
+fsearch_query_node_tree_set_extensions(GNode *tree, FsearchDatabaseExtensions *extensions);
+
+// Sets the duplicates the dupe: filters of tree match, see fsearch_query_node_set_duplicates
+void
+fsearch_query_node_tree_set_duplicates(GNode *tree, FsearchDuplicates *duplicates);
+
+// Lets the parent filters and path searches of tree remember their results per folder, see
+// fsearch_query_node_set_folder_paths
+void
+fsearch_query_node_tree_set_folder_paths(GNode *tree, FsearchDatabaseFolderPaths *folder_paths);
+
+// Reorders the operands of AND and OR, so the ones which are cheap and decide the result for most entries get
+// evaluated first and the others only have to be evaluated when they're needed
+void
+fsearch_query_node_tree_plan(GNode *tree);
+
 GNode *
 fsearch_query_node_tree_new(const char *search_term, FsearchFilterManager *filters, FsearchQueryFlags flags);
 
@@ -6,13 +6,43 @@
 #include "fsearch_config.h"
 #include "fsearch_file_utils.h"
 #include "fsearch_query.h"
+#include "fsearch_task_ids.h"
 
 #include <glib/gi18n.h>
 #include <gtk/gtk.h>
 #include <math.h>
 #include <stdint.h>
+#include <string.h>
 #include <sys/stat.h>
 
+// The number of rows before and after a drawn row whose highlights get computed along with it
+#define HIGHLIGHT_PREFETCH_ROWS 100
+// Once this many entries have highlights, they're dropped before the next rows get highlighted
+#define MAX_CACHED_HIGHLIGHTS 2000
+// The number of rows ahead of a drawn row in the direction of scrolling whose contexts get built in the background
+#define ROW_PREFETCH_ROWS 150
+// The least recently drawn rows are dropped from the row cache beyond this, it holds a few viewports
+#define MAX_CACHED_ROWS 500
+// The rows get redrawn whenever the icons of this many prefetched rows were resolved
+#define ROW_PREFETCH_REDRAW_ROWS 16
+// The least recently drawn icons are dropped from the icon cache beyond this
+#define MAX_CACHED_ICONS 200
+// The limits of the low memory mode, the rows still cover the prefetched ones and a viewport
+#define LOW_MEMORY_MAX_CACHED_HIGHLIGHTS 500
+#define LOW_MEMORY_MAX_CACHED_ROWS (ROW_PREFETCH_ROWS + 50)
+#define LOW_MEMORY_MAX_CACHED_ICONS 50
+// The number of files whose sizes and modification times are remembered, when the database doesn't index them
+#define MAX_CACHED_METADATA 20000
+#define LOW_MEMORY_MAX_CACHED_METADATA 2000
+// What the rows show besides the names, it gets looked up for the shown rows if the database doesn't index all of it
+#define ROW_METADATA_FLAGS (DATABASE_INDEX_FLAG_SIZE | DATABASE_INDEX_FLAG_MODIFICATION_TIME)
+
+static uint32_t
+get_cache_limit(uint32_t limit, uint32_t low_memory_limit) {
+    FsearchConfig *config = fsearch_application_get_config(FSEARCH_APPLICATION_DEFAULT);
+    return config->low_memory_mode ? low_memory_limit : limit;
+}
+
 static int32_t
 get_icon_size_for_height(int32_t height) {
     if (height < 24) {
@@ -27,111 +57,97 @@ get_icon_size_for_height(int32_t height) {
     return 48;
 }
 
-static void
-reset_icon_caches(FsearchResultView *result_view) {
-    g_hash_table_remove_all(result_view->pixbuf_cache);
-    g_hash_table_remove_all(result_view->app_gicon_cache);
-}
+typedef struct {
+    char *key;
+    // NULL if the icon theme doesn't have the icon, so it isn't looked up again
+    GdkPixbuf *pixbuf;
+    // the link of the icon in the least recently used order of the icon cache
+    GList lru_link;
+} CachedIcon;
 
 static void
-maybe_reset_icon_caches(FsearchResultView *result_view) {
-    const uint32_t cached_icon_limit = 200;
-    if (g_hash_table_size(result_view->pixbuf_cache) > cached_icon_limit) {
-        g_hash_table_remove_all(result_view->pixbuf_cache);
-    }
-    if (g_hash_table_size(result_view->app_gicon_cache) > cached_icon_limit) {
-        g_hash_table_remove_all(result_view->app_gicon_cache);
-    }
+cached_icon_free(CachedIcon *cached) {
+    g_clear_pointer(&cached->key, g_free);
+    g_clear_object(&cached->pixbuf);
+    g_clear_pointer(&cached, free);
 }
 
-static GIcon *
-get_desktop_file_icon(FsearchResultView *result_view, const char *path) {
-    GIcon *icon = g_hash_table_lookup(result_view->app_gicon_cache, path);
-    if (!icon) {
-        icon = fsearch_file_utils_get_desktop_file_icon(path);
-        g_hash_table_insert(result_view->app_gicon_cache, g_strdup(path), icon);
-    }
-    return g_object_ref(icon);
+static void
+reset_icon_caches(FsearchResultView *result_view) {
+    g_hash_table_remove_all(result_view->icon_cache);
+    g_queue_init(&result_view->icon_lru);
+    g_hash_table_remove_all(result_view->placeholder_icons);
 }
 
+// Themed icons are loaded on the main thread, since the icon theme may only be used there. They're cached by their
+// names, which for most files are the ones of their content type, and by size and scale.
 static GdkPixbuf *
 get_pixbuf_from_gicon(FsearchResultView *result_view, GIcon *icon, int32_t icon_size, int32_t scale_factor) {
-    GdkPixbuf *pixbuf = g_hash_table_lookup(result_view->pixbuf_cache, icon);
-    if (pixbuf) {
-        return pixbuf;
+    if (!G_IS_THEMED_ICON(icon)) {
+        return NULL;
+    }
+    g_autofree char *icon_string = g_icon_to_string(icon);
+    g_autofree char *key = g_strdup_printf("%s@%dx%d", icon_string ? icon_string : "", icon_size, scale_factor);
+    CachedIcon *cached = g_hash_table_lookup(result_view->icon_cache, key);
+    if (cached) {
+        g_queue_unlink(&result_view->icon_lru, &cached->lru_link);
+        g_queue_push_head_link(&result_view->icon_lru, &cached->lru_link);
+        return cached->pixbuf;
     }
 
     GtkIconTheme *icon_theme = gtk_icon_theme_get_default();
     g_return_val_if_fail(icon_theme, NULL);
 
-    if (G_IS_THEMED_ICON(icon)) {
-        const char *const *names = g_themed_icon_get_names(G_THEMED_ICON(icon));
-        if (!names) {
-            return NULL;
-        }
+    cached = calloc(1, sizeof(CachedIcon));
+    g_assert(cached);
+    cached->key = g_steal_pointer(&key);
+    cached->lru_link.data = cached;
 
+    const char *const *names = g_themed_icon_get_names(G_THEMED_ICON(icon));
+    if (names) {
         g_autoptr(GtkIconInfo) icon_info = gtk_icon_theme_choose_icon_for_scale(icon_theme,
                                                                                 (const char **)names,
                                                                                 icon_size,
                                                                                 scale_factor,
                                                                                 GTK_ICON_LOOKUP_FORCE_SIZE);
-        if (!icon_info) {
-            return NULL;
-        }
-
-        pixbuf = gtk_icon_info_load_icon(icon_info, NULL);
-    }
-    else if (G_IS_LOADABLE_ICON(icon)) {
-        g_autoptr(GInputStream) stream = g_loadable_icon_load(G_LOADABLE_ICON(icon), icon_size, NULL, NULL, NULL);
-        if (stream) {
-            pixbuf = gdk_pixbuf_new_from_stream_at_scale(stream, icon_size, icon_size, TRUE, NULL, NULL);
+        if (icon_info) {
+            cached->pixbuf = gtk_icon_info_load_icon(icon_info, NULL);
         }
     }
 
-    if (pixbuf) {
-        g_hash_table_insert(result_view->pixbuf_cache, g_object_ref(icon), pixbuf);
+    g_hash_table_insert(result_view->icon_cache, cached->key, cached);
+    g_queue_push_head_link(&result_view->icon_lru, &cached->lru_link);
+    while (result_view->icon_lru.length > get_cache_limit(MAX_CACHED_ICONS, LOW_MEMORY_MAX_CACHED_ICONS)) {
+        CachedIcon *oldest = g_queue_pop_tail_link(&result_view->icon_lru)->data;
+        g_hash_table_remove(result_view->icon_cache, oldest->key);
     }
-    return pixbuf;
-}
-
-static cairo_surface_t *
-get_icon_surface(FsearchResultView *result_view,
-                 GdkWindow *win,
-                 const char *name,
-                 const char *path,
-                 FsearchDatabaseEntryType type,
-                 int32_t icon_size,
-                 int32_t scale_factor) {
-    maybe_reset_icon_caches(result_view);
-
-    g_autoptr(GIcon) icon = NULL;
-    struct stat buffer;
-    if (lstat(path, &buffer)) {
-        icon = g_themed_icon_new("edit-delete");
-    }
-    else if (type == DATABASE_ENTRY_TYPE_FILE && fsearch_file_utils_is_desktop_file(path)) {
-        icon = get_desktop_file_icon(result_view, path);
-    }
-    else {
-        icon = fsearch_file_utils_guess_icon(name, path, type == DATABASE_ENTRY_TYPE_FOLDER);
-    }
-
-    GdkPixbuf *pixbuf = get_pixbuf_from_gicon(result_view, icon, icon_size, scale_factor);
-    if (!pixbuf) {
-        return NULL;
-    }
-
-    return gdk_cairo_surface_create_from_pixbuf(pixbuf, scale_factor, win);
+    return cached->pixbuf;
 }
 
 typedef struct {
+    uint32_t row;
+    // the link of the row in the least recently used order of the row cache
+    GList lru_link;
+
     char *display_name;
 
-    FsearchQueryMatchData *match_data;
-    PangoAttrList *highlights[NUM_DATABASE_INDEX_TYPES];
+    // the highlights of entry for query are looked up in the highlight cache
+    FsearchDatabaseEntry *entry;
+    FsearchQuery *query;
 
     FsearchDatabaseEntryType entry_type;
 
+    // The icon is resolved off the main thread, since it needs to look at the file, which can take long on network
+    // mounts. Until then a placeholder for the type of the entry is drawn. Icons which are loaded from files, like
+    // thumbnails, are loaded into icon_pixbuf right away.
+    bool icon_resolved;
+    GIcon *icon;
+    GdkPixbuf *icon_pixbuf;
+
+    // The size or modification time isn't indexed and wasn't looked up yet, so it's empty. It's looked up off the main
+    // thread along with the icon.
+    bool metadata_pending;
+
     GString *name;
     GString *path;
     GString *full_path;
@@ -143,16 +159,13 @@ typedef struct {
 
 static void
 draw_row_ctx_free(DrawRowContext *ctx) {
-    g_clear_pointer(&ctx->match_data, fsearch_query_match_data_free);
+    g_clear_object(&ctx->icon);
+    g_clear_object(&ctx->icon_pixbuf);
+    g_clear_pointer(&ctx->query, fsearch_query_unref);
     g_clear_pointer(&ctx->display_name, g_free);
     g_clear_pointer(&ctx->extension, g_free);
     g_clear_pointer(&ctx->type, g_free);
     g_clear_pointer(&ctx->size, g_free);
-    for (uint32_t i = 0; i < NUM_DATABASE_INDEX_TYPES; i++) {
-        if (ctx->highlights[i]) {
-            g_clear_pointer(&ctx->highlights[i], pango_attr_list_unref);
-        }
-    }
     if (ctx->name) {
         g_string_free(g_steal_pointer(&ctx->name), TRUE);
     }
@@ -165,10 +178,57 @@ draw_row_ctx_free(DrawRowContext *ctx) {
     g_clear_pointer(&ctx, free);
 }
 
+static void
+draw_row_ctx_set_time(DrawRowContext *ctx, time_t mtime) {
+    struct tm mtime_local = {0};
+    strftime(ctx->time,
+             100,
+             "%Y-%m-%d %H:%M", //"%Y-%m-%d %H:%M",
+             localtime_r(&mtime, &mtime_local));
+}
+
+// Takes the size and modification time from the database if it indexes them, otherwise from lazy_metadata
+static void
+draw_row_ctx_set_metadata(DrawRowContext *ctx,
+                          FsearchDatabaseView *view,
+                          FsearchLazyMetadata *lazy_metadata,
+                          bool show_base_2_units) {
+    const FsearchDatabaseIndexFlags index_flags = db_view_get_index_flags(view);
+    FsearchLazyMetadataValues values = {0};
+    bool has_values = false;
+    if ((index_flags & ROW_METADATA_FLAGS) != ROW_METADATA_FLAGS && lazy_metadata) {
+        ctx->metadata_pending = !fsearch_lazy_metadata_lookup(lazy_metadata, ctx->full_path->str, &values);
+        // files which are gone have nothing to show, but they aren't looked up again either
+        has_values = !ctx->metadata_pending && !values.missing;
+    }
+
+    if (index_flags & DATABASE_INDEX_FLAG_SIZE) {
+        off_t size = db_view_entry_get_size_for_idx(view, ctx->row);
+        ctx->size = fsearch_file_utils_get_size_formatted(size, show_base_2_units);
+    }
+    else if (has_values && ctx->entry_type != DATABASE_ENTRY_TYPE_FOLDER) {
+        // the size of a folder is the one of its contents, which only the index knows
+        ctx->size = fsearch_file_utils_get_size_formatted(values.size, show_base_2_units);
+    }
+    else {
+        ctx->size = g_strdup("");
+    }
+
+    if (index_flags & DATABASE_INDEX_FLAG_MODIFICATION_TIME) {
+        draw_row_ctx_set_time(ctx, db_view_entry_get_mtime_for_idx(view, ctx->row));
+    }
+    else if (has_values) {
+        draw_row_ctx_set_time(ctx, values.mtime);
+    }
+}
+
+// Only uses data of the database view, lazy_metadata and the config, so it can run on the row queue too
 static DrawRowContext *
-draw_row_ctx_new(FsearchDatabaseView *view, uint32_t row, GdkWindow *bin_window, int32_t icon_size) {
+draw_row_ctx_new(FsearchDatabaseView *view, FsearchLazyMetadata *lazy_metadata, uint32_t row) {
     DrawRowContext *ctx = calloc(1, sizeof(DrawRowContext));
     g_assert(ctx);
+    ctx->row = row;
+    ctx->lru_link.data = ctx;
 
     FsearchConfig *config = fsearch_application_get_config(FSEARCH_APPLICATION_DEFAULT);
 
@@ -194,16 +254,8 @@ draw_row_ctx_new(FsearchDatabaseView *view, uint32_t row, GdkWindow *bin_window,
 
     ctx->path = db_view_entry_get_path_for_idx(view, row);
 
-    FsearchQuery *query = db_view_get_query(view);
-    if (query) {
-        FsearchDatabaseEntry *entry = db_view_entry_get_for_idx(view, row);
-        ctx->match_data = fsearch_query_match_data_new();
-        fsearch_query_match_data_set_entry(ctx->match_data, entry);
-
-        fsearch_query_highlight(query, ctx->match_data);
-
-        g_clear_pointer(&query, fsearch_query_unref);
-    }
+    ctx->query = db_view_get_query(view);
+    ctx->entry = db_view_entry_get_for_idx(view, row);
 
     ctx->full_path = db_view_entry_get_path_full_for_idx(view, row);
 
@@ -211,14 +263,7 @@ draw_row_ctx_new(FsearchDatabaseView *view, uint32_t row, GdkWindow *bin_window,
     ctx->type = fsearch_file_utils_get_file_type(ctx->name->str,
                                                  ctx->entry_type == DATABASE_ENTRY_TYPE_FOLDER ? TRUE : FALSE);
 
-    off_t size = db_view_entry_get_size_for_idx(view, row);
-    ctx->size = fsearch_file_utils_get_size_formatted(size, config->show_base_2_units);
-
-    const time_t mtime = db_view_entry_get_mtime_for_idx(view, row);
-    strftime(ctx->time,
-             100,
-             "%Y-%m-%d %H:%M", //"%Y-%m-%d %H:%M",
-             localtime(&mtime));
+    draw_row_ctx_set_metadata(ctx, view, lazy_metadata, config->show_base_2_units);
 
 out:
     db_view_unlock(view);
@@ -229,23 +274,347 @@ out:
     return NULL;
 }
 
+static void
+draw_row_ctx_resolve_icon(DrawRowContext *ctx, int32_t icon_size, int32_t scale_factor) {
+    ctx->icon_resolved = true;
+
+    g_autoptr(GIcon) icon = NULL;
+    struct stat buffer;
+    if (lstat(ctx->full_path->str, &buffer)) {
+        icon = g_themed_icon_new("edit-delete");
+    }
+    else {
+        icon = fsearch_file_utils_guess_icon(ctx->name->str,
+                                             ctx->full_path->str,
+                                             ctx->entry_type == DATABASE_ENTRY_TYPE_FOLDER);
+    }
+
+    if (G_IS_LOADABLE_ICON(icon)) {
+        const int32_t size = icon_size * scale_factor;
+        g_autoptr(GInputStream) stream = g_loadable_icon_load(G_LOADABLE_ICON(icon), size, NULL, NULL, NULL);
+        if (stream) {
+            ctx->icon_pixbuf = gdk_pixbuf_new_from_stream_at_scale(stream, size, size, TRUE, NULL, NULL);
+        }
+        // the placeholder is drawn if it couldn't be loaded
+        return;
+    }
+    ctx->icon = g_steal_pointer(&icon);
+}
+
+// The icons by the extension of the name, which are drawn until the actual icon is resolved
+static GIcon *
+get_placeholder_icon(FsearchResultView *result_view, DrawRowContext *ctx) {
+    const bool is_folder = ctx->entry_type == DATABASE_ENTRY_TYPE_FOLDER;
+    // no extension contains a '/'
+    const char *key = is_folder ? "/" : (ctx->extension ? ctx->extension : "");
+    GIcon *icon = g_hash_table_lookup(result_view->placeholder_icons, key);
+    if (icon) {
+        return icon;
+    }
+    if (g_hash_table_size(result_view->placeholder_icons)
+        > get_cache_limit(MAX_CACHED_ICONS, LOW_MEMORY_MAX_CACHED_ICONS)) {
+        g_hash_table_remove_all(result_view->placeholder_icons);
+    }
+    if (is_folder) {
+        icon = g_themed_icon_new("folder");
+    }
+    else {
+        // only guesses by the name, without reading the file
+        g_autofree char *content_type = g_content_type_guess(ctx->name->str, NULL, 0, NULL);
+        icon = content_type ? g_content_type_get_icon(content_type) : NULL;
+        if (!icon) {
+            icon = g_themed_icon_new("text-x-generic");
+        }
+    }
+    g_hash_table_insert(result_view->placeholder_icons, g_strdup(key), icon);
+    return icon;
+}
+
+static cairo_surface_t *
+get_icon_surface(FsearchResultView *result_view,
+                 GdkWindow *win,
+                 DrawRowContext *ctx,
+                 int32_t icon_size,
+                 int32_t scale_factor) {
+    GdkPixbuf *pixbuf = ctx->icon_pixbuf;
+    if (!pixbuf && ctx->icon) {
+        pixbuf = get_pixbuf_from_gicon(result_view, ctx->icon, icon_size, scale_factor);
+    }
+    if (!pixbuf) {
+        pixbuf = get_pixbuf_from_gicon(result_view, get_placeholder_icon(result_view, ctx), icon_size, scale_factor);
+    }
+    if (!pixbuf) {
+        return NULL;
+    }
+
+    return gdk_cairo_surface_create_from_pixbuf(pixbuf, scale_factor, win);
+}
+
+static gboolean
+redraw_list_view_cb(gpointer user_data) {
+    GtkWidget *list_view = user_data;
+    gtk_widget_queue_draw(list_view);
+    g_object_unref(list_view);
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean
+release_list_view_cb(gpointer user_data) {
+    g_object_unref(user_data);
+    return G_SOURCE_REMOVE;
+}
+
+typedef struct {
+    FsearchResultView *result_view;
+    FsearchDatabaseView *database_view;
+    // gets redrawn when icons of rows were resolved, it's only released on the main thread
+    GtkWidget *list_view;
+    // the icons get resolved when icon_size isn't 0
+    int32_t icon_size;
+    int32_t scale_factor;
+    // the rows were queued for this generation of the row cache
+    uint32_t generation;
+    // the rows [start, end) get built, from start on or from end on backwards
+    uint32_t start;
+    uint32_t end;
+    bool backwards;
+    // the number of rows which were built already, a preempted task continues after them
+    uint32_t num_done;
+    // metadata of the rows was looked up, so the rows which were drawn without it get redrawn
+    bool fetched_metadata;
+} RowPrefetchTaskContext;
+
+static void
+row_prefetch_task_ctx_free(RowPrefetchTaskContext *ctx) {
+    g_idle_add(release_list_view_cb, g_steal_pointer(&ctx->list_view));
+    g_clear_pointer(&ctx->database_view, db_view_unref);
+    g_clear_pointer(&ctx, free);
+}
+
+// Looks up the sizes and modification times of the rows at once, if the database doesn't index them
+static void
+row_prefetch_task_fetch_metadata(RowPrefetchTaskContext *ctx) {
+    g_autoptr(GPtrArray) paths = g_ptr_array_new_with_free_func(g_free);
+    db_view_lock(ctx->database_view);
+    if ((db_view_get_index_flags(ctx->database_view) & ROW_METADATA_FLAGS) != ROW_METADATA_FLAGS) {
+        for (uint32_t row = ctx->start; row < ctx->end; row++) {
+            GString *path = db_view_entry_get_path_full_for_idx(ctx->database_view, row);
+            if (path) {
+                g_ptr_array_add(paths, g_string_free(path, FALSE));
+            }
+        }
+    }
+    db_view_unlock(ctx->database_view);
+    if (paths->len == 0) {
+        return;
+    }
+
+    FsearchThreadPool *pool = fsearch_thread_pool_get_default();
+    const uint32_t num_fetched = fsearch_lazy_metadata_fetch(ctx->result_view->lazy_metadata,
+                                                             pool,
+                                                             (const char *const *)paths->pdata,
+                                                             paths->len);
+    ctx->fetched_metadata = num_fetched > 0;
+    g_clear_pointer(&pool, fsearch_thread_pool_unref);
+}
+
+static gpointer
+row_prefetch_task(gpointer data, GCancellable *cancellable) {
+    RowPrefetchTaskContext *ctx = data;
+    FsearchResultView *result_view = ctx->result_view;
+
+    db_view_lock(ctx->database_view);
+    ctx->end = MIN(ctx->end, db_view_get_num_entries(ctx->database_view));
+    db_view_unlock(ctx->database_view);
+    ctx->start = MIN(ctx->start, ctx->end);
+    if (ctx->num_done == 0) {
+        row_prefetch_task_fetch_metadata(ctx);
+    }
+
+    while (ctx->num_done < ctx->end - ctx->start) {
+        if (g_cancellable_is_cancelled(cancellable)) {
+            return NULL;
+        }
+        const uint32_t row = ctx->backwards ? ctx->end - 1 - ctx->num_done : ctx->start + ctx->num_done;
+        ctx->num_done++;
+        DrawRowContext *row_ctx = draw_row_ctx_new(ctx->database_view, result_view->lazy_metadata, row);
+        if (!row_ctx) {
+            continue;
+        }
+        if (ctx->icon_size > 0) {
+            draw_row_ctx_resolve_icon(row_ctx, ctx->icon_size, ctx->scale_factor);
+        }
+        // the contexts are handed over to the main thread, which moves them into the row cache when it draws
+        g_mutex_lock(&result_view->row_lock);
+        const bool is_current = ctx->generation == result_view->row_cache_generation;
+        if (is_current) {
+            g_ptr_array_add(result_view->prefetched_rows, g_steal_pointer(&row_ctx));
+        }
+        g_mutex_unlock(&result_view->row_lock);
+        g_clear_pointer(&row_ctx, draw_row_ctx_free);
+        if (!is_current) {
+            // the rows belong to other results by now
+            break;
+        }
+        const bool is_last = ctx->num_done == ctx->end - ctx->start;
+        if ((ctx->icon_size > 0 || ctx->fetched_metadata)
+            && (ctx->num_done % ROW_PREFETCH_REDRAW_ROWS == 0 || is_last)) {
+            // the first rows are usually visible and were drawn with placeholder icons or without metadata
+            g_idle_add(redraw_list_view_cb, g_object_ref(ctx->list_view));
+        }
+    }
+    return GUINT_TO_POINTER(1);
+}
+
+static void
+row_prefetch_task_finished(gpointer result, gpointer data) {
+    row_prefetch_task_ctx_free(data);
+}
+
+static void
+row_prefetch_task_cancelled(gpointer data) {
+    row_prefetch_task_ctx_free(data);
+}
+
+static void
+row_cache_insert(FsearchResultView *result_view, DrawRowContext *ctx) {
+    g_hash_table_insert(result_view->row_cache, GUINT_TO_POINTER(ctx->row + 1), ctx);
+    g_queue_push_head_link(&result_view->row_lru, &ctx->lru_link);
+    while (result_view->row_lru.length > get_cache_limit(MAX_CACHED_ROWS, LOW_MEMORY_MAX_CACHED_ROWS)) {
+        DrawRowContext *oldest = g_queue_pop_tail_link(&result_view->row_lru)->data;
+        g_hash_table_remove(result_view->row_cache, GUINT_TO_POINTER(oldest->row + 1));
+    }
+}
+
+static void
+row_cache_add_prefetched_rows(FsearchResultView *result_view) {
+    g_mutex_lock(&result_view->row_lock);
+    for (uint32_t i = 0; i < result_view->prefetched_rows->len; i++) {
+        DrawRowContext *ctx = g_ptr_array_index(result_view->prefetched_rows, i);
+        DrawRowContext *drawn = g_hash_table_lookup(result_view->row_cache, GUINT_TO_POINTER(ctx->row + 1));
+        if (!drawn) {
+            row_cache_insert(result_view, ctx);
+            continue;
+        }
+        // the row was drawn before its prefetched context arrived, only its icon and metadata are new
+        if (!drawn->icon_resolved && ctx->icon_resolved) {
+            drawn->icon_resolved = true;
+            drawn->icon = g_steal_pointer(&ctx->icon);
+            drawn->icon_pixbuf = g_steal_pointer(&ctx->icon_pixbuf);
+        }
+        if (drawn->metadata_pending && !ctx->metadata_pending) {
+            drawn->metadata_pending = false;
+            g_clear_pointer(&drawn->size, g_free);
+            drawn->size = g_steal_pointer(&ctx->size);
+            memcpy(drawn->time, ctx->time, sizeof(drawn->time));
+        }
+        draw_row_ctx_free(ctx);
+    }
+    g_ptr_array_set_size(result_view->prefetched_rows, 0);
+    g_mutex_unlock(&result_view->row_lock);
+}
+
+// Has to be called with the row lock held
+static void
+prefetched_rows_clear(FsearchResultView *result_view) {
+    g_ptr_array_foreach(result_view->prefetched_rows, (GFunc)draw_row_ctx_free, NULL);
+    g_ptr_array_set_size(result_view->prefetched_rows, 0);
+}
+
+static bool
+row_is_ready(FsearchResultView *result_view, uint32_t row, int32_t icon_size) {
+    DrawRowContext *ctx = g_hash_table_lookup(result_view->row_cache, GUINT_TO_POINTER(row + 1));
+    return ctx && !ctx->metadata_pending && (ctx->icon_resolved || icon_size == 0);
+}
+
+// Queues the rows ahead of row in the direction the view was scrolled in, once row gets close to the end of the ones
+// which were queued before
+static void
+row_cache_prefetch(FsearchResultView *result_view, uint32_t row, int32_t icon_size, int32_t scale_factor) {
+    const bool backwards = row < result_view->last_drawn_row;
+    result_view->last_drawn_row = row;
+
+    uint32_t start = 0;
+    uint32_t end = 0;
+    if (!backwards) {
+        if (row >= result_view->row_prefetch_start && row + ROW_PREFETCH_ROWS / 2 < result_view->row_prefetch_end) {
+            return;
+        }
+        start = row;
+        end = row + ROW_PREFETCH_ROWS;
+    }
+    else {
+        if (row < result_view->row_prefetch_end && row >= result_view->row_prefetch_start + ROW_PREFETCH_ROWS / 2) {
+            return;
+        }
+        if (row < result_view->row_prefetch_end && result_view->row_prefetch_start == 0) {
+            // everything up to the first row was queued already
+            return;
+        }
+        start = row > ROW_PREFETCH_ROWS ? row - ROW_PREFETCH_ROWS : 0;
+        end = row + 1;
+    }
+    result_view->row_prefetch_start = start;
+    result_view->row_prefetch_end = end;
+
+    // the rows next to the drawn one are usually cached already
+    while (start < end && row_is_ready(result_view, backwards ? end - 1 : start, icon_size)) {
+        if (backwards) {
+            end--;
+        }
+        else {
+            start++;
+        }
+    }
+    if (start == end) {
+        return;
+    }
+
+    RowPrefetchTaskContext *task_ctx = calloc(1, sizeof(RowPrefetchTaskContext));
+    g_assert(task_ctx);
+    task_ctx->result_view = result_view;
+    task_ctx->database_view = db_view_ref(result_view->database_view);
+    task_ctx->list_view = g_object_ref(GTK_WIDGET(result_view->list_view));
+    task_ctx->icon_size = icon_size;
+    task_ctx->scale_factor = scale_factor;
+    g_mutex_lock(&result_view->row_lock);
+    task_ctx->generation = result_view->row_cache_generation;
+    g_mutex_unlock(&result_view->row_lock);
+    task_ctx->start = start;
+    task_ctx->end = end;
+    task_ctx->backwards = backwards;
+    fsearch_task_queue(result_view->row_queue,
+                       FSEARCH_TASK_ID_ROW_PREFETCH,
+                       FSEARCH_TASK_PRIORITY_BACKGROUND,
+                       row_prefetch_task,
+                       row_prefetch_task_finished,
+                       row_prefetch_task_cancelled,
+                       FSEARCH_TASK_CLEAR_SAME_ID,
+                       task_ctx);
+}
+
+// The icons of the rows get resolved when icon_size isn't 0
 static DrawRowContext *
-draw_row_ctx_get(FsearchResultView *result_view, uint32_t row, GdkWindow *bin_window, int32_t icon_size) {
+draw_row_ctx_get(FsearchResultView *result_view, uint32_t row, int32_t icon_size, int32_t scale_factor) {
     g_return_val_if_fail(result_view, NULL);
 
-    if (g_hash_table_size(result_view->row_cache) > 100) {
-        fsearch_result_view_row_cache_reset(result_view);
-    }
+    row_cache_add_prefetched_rows(result_view);
 
-    DrawRowContext *ctx = g_hash_table_lookup(result_view->row_cache, GINT_TO_POINTER(row + 1));
+    DrawRowContext *ctx = g_hash_table_lookup(result_view->row_cache, GUINT_TO_POINTER(row + 1));
+    fsearch_performance_stats_add_row_cache_lookup(&result_view->performance_stats, ctx != NULL);
     if (ctx) {
-        return ctx;
+        g_queue_unlink(&result_view->row_lru, &ctx->lru_link);
+        g_queue_push_head_link(&result_view->row_lru, &ctx->lru_link);
     }
-    ctx = draw_row_ctx_new(result_view->database_view, row, bin_window, icon_size);
-    if (!ctx) {
-        return NULL;
+    else {
+        ctx = draw_row_ctx_new(result_view->database_view, result_view->lazy_metadata, row);
+        if (ctx) {
+            row_cache_insert(result_view, ctx);
+        }
+    }
+    if (result_view->database_view) {
+        row_cache_prefetch(result_view, row, icon_size, scale_factor);
     }
-    g_hash_table_insert(result_view->row_cache, GINT_TO_POINTER(row + 1), ctx);
     return ctx;
 }
 
@@ -324,12 +693,174 @@ fsearch_result_view_query_tooltip(FsearchDatabaseView *view,
     return NULL;
 }
 
+typedef struct {
+    PangoAttrList *attrs[NUM_DATABASE_INDEX_TYPES];
+} RowHighlights;
+
+static void
+row_highlights_free(RowHighlights *highlights) {
+    for (uint32_t i = 0; i < NUM_DATABASE_INDEX_TYPES; i++) {
+        g_clear_pointer(&highlights->attrs[i], pango_attr_list_unref);
+    }
+    g_clear_pointer(&highlights, free);
+}
+
+typedef struct {
+    FsearchResultView *result_view;
+    FsearchDatabaseView *database_view;
+    FsearchQuery *query;
+    // gets redrawn once the highlights are ready, it's only touched on the main thread
+    GtkWidget *list_view;
+    // the rows [start, end) get highlighted, beginning with first and wrapping around to start
+    uint32_t start;
+    uint32_t end;
+    uint32_t first;
+} HighlightTaskContext;
+
+static void
+highlight_task_ctx_free(HighlightTaskContext *ctx, bool highlights_changed) {
+    // the tasks can finish on the queue thread, the widget is released on the main thread
+    g_idle_add(highlights_changed ? redraw_list_view_cb : release_list_view_cb, g_steal_pointer(&ctx->list_view));
+    g_clear_pointer(&ctx->query, fsearch_query_unref);
+    g_clear_pointer(&ctx->database_view, db_view_unref);
+    g_clear_pointer(&ctx, free);
+}
+
+static bool
+has_highlights(FsearchResultView *result_view, FsearchQuery *query, FsearchDatabaseEntry *entry) {
+    g_mutex_lock(&result_view->highlight_lock);
+    const bool res = result_view->highlight_query == query && g_hash_table_contains(result_view->highlight_cache, entry);
+    g_mutex_unlock(&result_view->highlight_lock);
+    return res;
+}
+
+static gpointer
+highlight_task(gpointer data, GCancellable *cancellable) {
+    HighlightTaskContext *ctx = data;
+    FsearchResultView *result_view = ctx->result_view;
+    FsearchQueryMatchData *match_data = result_view->highlight_match_data;
+
+    uint32_t num_highlighted = 0;
+    for (uint32_t i = 0; i < ctx->end - ctx->start && !g_cancellable_is_cancelled(cancellable); i++) {
+        const uint32_t row = ctx->first + i < ctx->end ? ctx->first + i : ctx->start + (ctx->first + i - ctx->end);
+        // the lock is released after every row, so the view doesn't have to wait for all of them
+        db_view_lock(ctx->database_view);
+        FsearchQuery *query = db_view_get_query(ctx->database_view);
+        const bool is_current_query = query == ctx->query;
+        g_clear_pointer(&query, fsearch_query_unref);
+        if (!is_current_query) {
+            // the rows belong to the results of another query now
+            db_view_unlock(ctx->database_view);
+            break;
+        }
+        if (row >= db_view_get_num_entries(ctx->database_view)) {
+            db_view_unlock(ctx->database_view);
+            continue;
+        }
+        FsearchDatabaseEntry *entry = db_view_entry_get_for_idx(ctx->database_view, row);
+        if (!entry || has_highlights(result_view, ctx->query, entry)) {
+            db_view_unlock(ctx->database_view);
+            continue;
+        }
+
+        fsearch_query_match_data_set_entry(match_data, entry);
+        fsearch_query_highlight(ctx->query, match_data);
+        RowHighlights *highlights = calloc(1, sizeof(RowHighlights));
+        g_assert(highlights);
+        for (uint32_t i = 0; i < NUM_DATABASE_INDEX_TYPES; i++) {
+            PangoAttrList *attrs = fsearch_query_match_get_highlight(match_data, i);
+            highlights->attrs[i] = attrs ? pango_attr_list_ref(attrs) : NULL;
+        }
+        fsearch_query_match_data_set_entry(match_data, NULL);
+        db_view_unlock(ctx->database_view);
+
+        g_mutex_lock(&result_view->highlight_lock);
+        if (result_view->highlight_query == ctx->query) {
+            g_hash_table_insert(result_view->highlight_cache, entry, g_steal_pointer(&highlights));
+            num_highlighted++;
+        }
+        g_mutex_unlock(&result_view->highlight_lock);
+        g_clear_pointer(&highlights, row_highlights_free);
+    }
+    return GUINT_TO_POINTER(num_highlighted);
+}
+
+static void
+highlight_task_finished(gpointer result, gpointer data) {
+    highlight_task_ctx_free(data, GPOINTER_TO_UINT(result) > 0);
+}
+
+static void
+highlight_task_cancelled(gpointer data) {
+    highlight_task_ctx_free(data, false);
+}
+
+// Has to be called with the highlight lock held
+static void
+highlight_cache_reset(FsearchResultView *result_view, FsearchQuery *query) {
+    g_hash_table_remove_all(result_view->highlight_cache);
+    g_clear_pointer(&result_view->highlight_query, fsearch_query_unref);
+    result_view->highlight_query = query ? fsearch_query_ref(query) : NULL;
+    result_view->highlight_rows_start = 0;
+    result_view->highlight_rows_end = 0;
+}
+
+// Looks up the highlights of the row of ctx. If they aren't computed yet, the highlights of it and the rows around
+// it get queued, and the row gets drawn again once they're ready.
+static RowHighlights *
+get_row_highlights(FsearchResultView *result_view, DrawRowContext *ctx, uint32_t row) {
+    if (!ctx->query || !ctx->entry) {
+        return NULL;
+    }
+    RowHighlights *res = NULL;
+    g_mutex_lock(&result_view->highlight_lock);
+    if (result_view->highlight_query != ctx->query) {
+        highlight_cache_reset(result_view, ctx->query);
+    }
+    RowHighlights *highlights = g_hash_table_lookup(result_view->highlight_cache, ctx->entry);
+    if (highlights) {
+        res = calloc(1, sizeof(RowHighlights));
+        g_assert(res);
+        for (uint32_t i = 0; i < NUM_DATABASE_INDEX_TYPES; i++) {
+            res->attrs[i] = highlights->attrs[i] ? pango_attr_list_ref(highlights->attrs[i]) : NULL;
+        }
+    }
+    else if (row < result_view->highlight_rows_start || row >= result_view->highlight_rows_end) {
+        if (g_hash_table_size(result_view->highlight_cache)
+            > get_cache_limit(MAX_CACHED_HIGHLIGHTS, LOW_MEMORY_MAX_CACHED_HIGHLIGHTS)) {
+            highlight_cache_reset(result_view, ctx->query);
+        }
+        result_view->highlight_rows_start = row > HIGHLIGHT_PREFETCH_ROWS ? row - HIGHLIGHT_PREFETCH_ROWS : 0;
+        result_view->highlight_rows_end = row + HIGHLIGHT_PREFETCH_ROWS;
+
+        HighlightTaskContext *task_ctx = calloc(1, sizeof(HighlightTaskContext));
+        g_assert(task_ctx);
+        task_ctx->result_view = result_view;
+        task_ctx->database_view = db_view_ref(result_view->database_view);
+        task_ctx->query = fsearch_query_ref(ctx->query);
+        task_ctx->list_view = g_object_ref(GTK_WIDGET(result_view->list_view));
+        task_ctx->start = result_view->highlight_rows_start;
+        task_ctx->end = result_view->highlight_rows_end;
+        // the drawn row and the ones below it are usually the visible ones
+        task_ctx->first = row;
+        fsearch_task_queue(result_view->highlight_queue,
+                           FSEARCH_TASK_ID_HIGHLIGHT,
+                           FSEARCH_TASK_PRIORITY_DEFAULT,
+                           highlight_task,
+                           highlight_task_finished,
+                           highlight_task_cancelled,
+                           FSEARCH_TASK_CLEAR_SAME_ID,
+                           task_ctx);
+    }
+    g_mutex_unlock(&result_view->highlight_lock);
+    return res;
+}
+
 static void
-set_attributes(PangoLayout *layout, FsearchQueryMatchData *match_data, FsearchDatabaseIndexType idx) {
+set_attributes(PangoLayout *layout, RowHighlights *highlights, FsearchDatabaseIndexType idx) {
     g_assert(idx >= 0 && idx < NUM_DATABASE_INDEX_TYPES);
-    PangoAttrList *attrs = fsearch_query_match_get_highlight(match_data, idx);
-    if (attrs) {
-        pango_layout_set_attributes(layout, attrs);
+    if (highlights && highlights->attrs[idx]) {
+        pango_layout_set_attributes(layout, highlights->attrs[idx]);
     }
 }
 
@@ -354,10 +885,15 @@ fsearch_result_view_draw_row(FsearchResultView *result_view,
 
     if (result_view->row_height != rect->height) {
         reset_icon_caches(result_view);
+        // the icons of the rows were loaded for the previous size
+        fsearch_result_view_row_cache_reset(result_view);
     }
     result_view->row_height = rect->height;
 
-    DrawRowContext *ctx = draw_row_ctx_get(result_view, row, bin_window, icon_size);
+    FsearchConfig *config = fsearch_application_get_config(FSEARCH_APPLICATION_DEFAULT);
+    const int32_t scale_factor = gdk_window_get_scale_factor(bin_window);
+    DrawRowContext *ctx =
+        draw_row_ctx_get(result_view, row, config->show_listview_icons ? icon_size : 0, scale_factor);
     if (!ctx) {
         return;
     }
@@ -387,7 +923,7 @@ fsearch_result_view_draw_row(FsearchResultView *result_view,
         cairo_restore(cr);
     }
 
-    FsearchConfig *config = fsearch_application_get_config(FSEARCH_APPLICATION_DEFAULT);
+    RowHighlights *highlights = config->highlight_search_terms ? get_row_highlights(result_view, ctx, row) : NULL;
 
     // Render row foreground
     int32_t x = rect->x;
@@ -409,15 +945,7 @@ fsearch_result_view_draw_row(FsearchResultView *result_view,
         switch (column->type) {
         case DATABASE_INDEX_TYPE_NAME: {
             if (config->show_listview_icons) {
-                cairo_surface_t *icon_surface = config->show_listview_icons
-                                                  ? get_icon_surface(result_view,
-                                                                     bin_window,
-                                                                     ctx->name->str,
-                                                                     ctx->full_path->str,
-                                                                     ctx->entry_type,
-                                                                     icon_size,
-                                                                     gdk_window_get_scale_factor(bin_window))
-                                                  : NULL;
+                cairo_surface_t *icon_surface = get_icon_surface(result_view, bin_window, ctx, icon_size, scale_factor);
                 if (icon_surface) {
                     int32_t x_icon = x;
                     if (right_to_left_text) {
@@ -459,7 +987,7 @@ fsearch_result_view_draw_row(FsearchResultView *result_view,
         }
 
         if (config->highlight_search_terms) {
-            set_attributes(layout, ctx->match_data, column->type);
+            set_attributes(layout, highlights, column->type);
         }
 
         pango_layout_set_text(layout, text ? text : _("Invalid row data"), text_len);
@@ -472,12 +1000,71 @@ fsearch_result_view_draw_row(FsearchResultView *result_view,
         cairo_restore(cr);
     }
     gtk_style_context_restore(context);
+    g_clear_pointer(&highlights, row_highlights_free);
 }
 
 void
 fsearch_result_view_row_cache_reset(FsearchResultView *result_view) {
     g_return_if_fail(result_view);
+    g_mutex_lock(&result_view->row_lock);
+    // contexts which are still being prefetched get dropped
+    result_view->row_cache_generation++;
+    prefetched_rows_clear(result_view);
+    g_mutex_unlock(&result_view->row_lock);
     g_hash_table_remove_all(result_view->row_cache);
+    g_queue_init(&result_view->row_lru);
+    result_view->row_prefetch_start = 0;
+    result_view->row_prefetch_end = 0;
+    // the entries of the rows might be gone
+    g_mutex_lock(&result_view->highlight_lock);
+    highlight_cache_reset(result_view, NULL);
+    g_mutex_unlock(&result_view->highlight_lock);
+}
+
+static size_t
+get_string_memory_size(const char *str) {
+    return str ? strlen(str) + 1 : 0;
+}
+
+static size_t
+get_gstring_memory_size(const GString *str) {
+    return str ? sizeof(GString) + str->allocated_len : 0;
+}
+
+void
+fsearch_result_view_get_memory_stats(FsearchResultView *result_view, FsearchDatabaseMemoryStats *stats) {
+    g_return_if_fail(result_view);
+    g_return_if_fail(stats);
+
+    GHashTableIter iter;
+    gpointer value = NULL;
+    g_hash_table_iter_init(&iter, result_view->row_cache);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        DrawRowContext *ctx = value;
+        stats->row_cache += sizeof(DrawRowContext) + get_string_memory_size(ctx->display_name)
+                          + get_string_memory_size(ctx->size) + get_string_memory_size(ctx->type)
+                          + get_string_memory_size(ctx->extension) + get_gstring_memory_size(ctx->name)
+                          + get_gstring_memory_size(ctx->path) + get_gstring_memory_size(ctx->full_path);
+        if (ctx->icon_pixbuf) {
+            stats->icon_cache += gdk_pixbuf_get_byte_length(ctx->icon_pixbuf);
+        }
+    }
+    g_mutex_lock(&result_view->highlight_lock);
+    stats->row_cache += g_hash_table_size(result_view->highlight_cache) * sizeof(RowHighlights);
+    g_mutex_unlock(&result_view->highlight_lock);
+    stats->match_data += fsearch_query_match_data_get_memory_size(result_view->highlight_match_data);
+
+    for (GList *link = result_view->icon_lru.head; link; link = link->next) {
+        CachedIcon *cached = link->data;
+        stats->icon_cache += sizeof(CachedIcon) + get_string_memory_size(cached->key)
+                           + (cached->pixbuf ? gdk_pixbuf_get_byte_length(cached->pixbuf) : 0);
+    }
+
+    if (result_view->database_view) {
+        db_view_lock(result_view->database_view);
+        db_view_get_memory_stats(result_view->database_view, stats);
+        db_view_unlock(result_view->database_view);
+    }
 }
 
 FsearchResultView *
@@ -486,16 +1073,39 @@ fsearch_result_view_new(void) {
     g_assert(result_view);
 
     result_view->row_cache = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)draw_row_ctx_free);
-    result_view->pixbuf_cache =
-        g_hash_table_new_full(g_icon_hash, (GEqualFunc)g_icon_equal, g_object_unref, g_object_unref);
-    result_view->app_gicon_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_object_unref);
+    g_queue_init(&result_view->row_lru);
+    g_mutex_init(&result_view->row_lock);
+    result_view->prefetched_rows = g_ptr_array_new();
+    result_view->row_queue = fsearch_task_queue_new("fsearch_row_task_queue");
+    result_view->icon_cache = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify)cached_icon_free);
+    g_queue_init(&result_view->icon_lru);
+    result_view->placeholder_icons = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_object_unref);
+    result_view->lazy_metadata =
+        fsearch_lazy_metadata_new(get_cache_limit(MAX_CACHED_METADATA, LOW_MEMORY_MAX_CACHED_METADATA));
+
+    g_mutex_init(&result_view->highlight_lock);
+    result_view->highlight_cache =
+        g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)row_highlights_free);
+    result_view->highlight_match_data = fsearch_query_match_data_new();
+    result_view->highlight_queue = fsearch_task_queue_new("fsearch_highlight_task_queue");
     return result_view;
 }
 
 void
 fsearch_result_view_free(FsearchResultView *result_view) {
-    g_clear_pointer(&result_view->pixbuf_cache, g_hash_table_unref);
-    g_clear_pointer(&result_view->app_gicon_cache, g_hash_table_unref);
+    // waits for the running task, so nothing uses the highlight data anymore
+    g_clear_pointer(&result_view->highlight_queue, fsearch_task_queue_free);
+    g_clear_pointer(&result_view->row_queue, fsearch_task_queue_free);
+    prefetched_rows_clear(result_view);
+    g_clear_pointer(&result_view->prefetched_rows, g_ptr_array_unref);
+    g_mutex_clear(&result_view->row_lock);
+    g_clear_pointer(&result_view->highlight_match_data, fsearch_query_match_data_free);
+    g_clear_pointer(&result_view->highlight_cache, g_hash_table_unref);
+    g_clear_pointer(&result_view->highlight_query, fsearch_query_unref);
+    g_mutex_clear(&result_view->highlight_lock);
+    g_clear_pointer(&result_view->icon_cache, g_hash_table_unref);
+    g_clear_pointer(&result_view->placeholder_icons, g_hash_table_unref);
+    g_clear_pointer(&result_view->lazy_metadata, fsearch_lazy_metadata_free);
     g_clear_pointer(&result_view->row_cache, g_hash_table_unref);
     g_clear_pointer(&result_view, free);
 }
@@ -1,15 +1,52 @@
 #pragma once
 
 #include "fsearch_database_view.h"
+#include "fsearch_lazy_metadata.h"
 #include "fsearch_list_view.h"
+#include "fsearch_performance_stats.h"
+#include "fsearch_query.h"
+#include "fsearch_task.h"
 
 typedef struct {
     FsearchDatabaseView *database_view;
     FsearchListView *list_view;
 
+    // The contexts of the drawn rows, the most recently drawn ones are first in row_lru. Only the main thread uses
+    // them, the contexts of the rows ahead of the drawn ones are built by row_queue and handed over in prefetched_rows.
     GHashTable *row_cache;
-    GHashTable *pixbuf_cache;
-    GHashTable *app_gicon_cache;
+    GQueue row_lru;
+    uint32_t last_drawn_row;
+    // the rows [row_prefetch_start, row_prefetch_end) were queued already
+    uint32_t row_prefetch_start;
+    uint32_t row_prefetch_end;
+    FsearchTaskQueue *row_queue;
+    // protects prefetched_rows and row_cache_generation, which changes whenever the rows belong to other results
+    GMutex row_lock;
+    GPtrArray *prefetched_rows;
+    uint32_t row_cache_generation;
+
+    // the pixbufs of themed icons by their names, size and scale, the most recently drawn ones are first in icon_lru
+    GHashTable *icon_cache;
+    GQueue icon_lru;
+    // the icons which are drawn by the extension of an entry until its own icon is resolved
+    GHashTable *placeholder_icons;
+
+    // the sizes and modification times of the shown rows, if the database doesn't index them. row_queue looks them up
+    // for the rows it prefetches.
+    FsearchLazyMetadata *lazy_metadata;
+
+    // The highlights of the drawn rows and the ones around them are computed by highlight_queue, so drawing only
+    // needs to look them up. highlight_match_data is only used by the tasks of the queue.
+    FsearchTaskQueue *highlight_queue;
+    FsearchQueryMatchData *highlight_match_data;
+    // protects everything below
+    GMutex highlight_lock;
+    // the highlights of the entries for highlight_query
+    GHashTable *highlight_cache;
+    FsearchQuery *highlight_query;
+    // the rows [highlight_rows_start, highlight_rows_end) were queued for highlight_query already
+    uint32_t highlight_rows_start;
+    uint32_t highlight_rows_end;
 
     // remember the row height from the last draw call
     // when it changes we need to reset the icon cache
@@ -17,6 +54,9 @@ typedef struct {
 
     FsearchDatabaseIndexType sort_order;
     GtkSortType sort_type;
+
+    // how many drawn rows were found in the row cache, and the timings the window shows for this view
+    FsearchPerformanceStats performance_stats;
 } FsearchResultView;
 
 FsearchResultView *
@@ -28,6 +68,10 @@ fsearch_result_view_free(FsearchResultView *result_view);
 void
 fsearch_result_view_row_cache_reset(FsearchResultView *result_view);
 
+// Adds the memory used by the cached rows and icons and by the database view to stats
+void
+fsearch_result_view_get_memory_stats(FsearchResultView *result_view, FsearchDatabaseMemoryStats *stats);
+
 char *
 fsearch_result_view_query_tooltip(FsearchDatabaseView *view,
                                   uint32_t row,
@@ -2,92 +2,603 @@
 
 #include "fsearch_selection.h"
 
-void
-fsearch_selection_free(GHashTable *selection) {
-    g_assert(selection);
-    g_clear_pointer(&selection, g_hash_table_destroy);
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_BITS_PER_WORD 64
+
+// One bit for each entry of a name array, bit i belongs to the entry at position i
+typedef struct {
+    DynamicArray *entries;
+    uint64_t *words;
+    uint32_t num_entries;
+    uint32_t num_selected;
+} FsearchSelectionBits;
+
+struct FsearchSelection {
+    FsearchDatabaseVersion *version;
+    FsearchSelectionBits folders;
+    FsearchSelectionBits files;
+};
+
+typedef enum {
+    SELECTION_OP_SELECT,
+    SELECTION_OP_TOGGLE,
+} FsearchSelectionOp;
+
+static inline uint32_t
+get_num_words(uint32_t num_bits) {
+    return (num_bits + NUM_BITS_PER_WORD - 1) / NUM_BITS_PER_WORD;
 }
 
-GHashTable *
-fsearch_selection_new(void) {
-    return g_hash_table_new(g_direct_hash, g_direct_equal);
+static void
+bits_init(FsearchSelectionBits *bits, DynamicArray *entries) {
+    bits->entries = entries;
+    bits->num_entries = entries ? darray_get_num_items(entries) : 0;
+    bits->num_selected = 0;
+    bits->words = calloc(MAX(get_num_words(bits->num_entries), 1), sizeof(uint64_t));
+    g_assert(bits->words);
 }
 
-void
-fsearch_selection_select_toggle(GHashTable *selection, gpointer item) {
+static void
+bits_clear(FsearchSelectionBits *bits) {
+    g_clear_pointer(&bits->words, free);
+    g_clear_pointer(&bits->entries, darray_unref);
+    bits->num_entries = 0;
+    bits->num_selected = 0;
+}
+
+static inline bool
+bits_get(const FsearchSelectionBits *bits, uint32_t pos) {
+    return bits->words[pos / NUM_BITS_PER_WORD] & ((uint64_t)1 << (pos % NUM_BITS_PER_WORD));
+}
+
+static inline void
+bits_apply(FsearchSelectionBits *bits, uint32_t pos, FsearchSelectionOp op) {
+    const uint64_t mask = (uint64_t)1 << (pos % NUM_BITS_PER_WORD);
+    uint64_t *word = &bits->words[pos / NUM_BITS_PER_WORD];
+    if (*word & mask) {
+        if (op == SELECTION_OP_TOGGLE) {
+            *word &= ~mask;
+            bits->num_selected--;
+        }
+        return;
+    }
+    *word |= mask;
+    bits->num_selected++;
+}
+
+static void
+bits_apply_range(FsearchSelectionBits *bits, uint32_t start, uint32_t end, FsearchSelectionOp op) {
+    if (start > end || end >= bits->num_entries) {
+        return;
+    }
+    const uint32_t start_word = start / NUM_BITS_PER_WORD;
+    const uint32_t end_word = end / NUM_BITS_PER_WORD;
+    for (uint32_t w = start_word; w <= end_word; w++) {
+        uint64_t mask = UINT64_MAX;
+        if (w == start_word) {
+            mask &= UINT64_MAX << (start % NUM_BITS_PER_WORD);
+        }
+        if (w == end_word) {
+            mask &= UINT64_MAX >> (NUM_BITS_PER_WORD - 1 - end % NUM_BITS_PER_WORD);
+        }
+        const uint32_t num_before = __builtin_popcountll(bits->words[w] & mask);
+        bits->words[w] = op == SELECTION_OP_TOGGLE ? bits->words[w] ^ mask : bits->words[w] | mask;
+        bits->num_selected = bits->num_selected - num_before + __builtin_popcountll(bits->words[w] & mask);
+    }
+}
+
+static int32_t
+compare_entries(FsearchDatabaseEntry *a, FsearchDatabaseEntry *b) {
+    return db_entry_compare_entries_by_name(&a, &b);
+}
+
+// Looks for entry among the entries with the same name, which are next to each other in the name array
+static bool
+bits_find_among_equal_names(const FsearchDatabaseEntry *entry, DynamicArray *entries, uint32_t start, uint32_t *pos) {
+    FsearchDatabaseEntry *e = (FsearchDatabaseEntry *)entry;
+    const uint32_t num_entries = darray_get_num_items(entries);
+    for (uint32_t i = start; i < num_entries; i++) {
+        FsearchDatabaseEntry *candidate = darray_get_item(entries, i);
+        if (candidate == entry) {
+            *pos = i;
+            return true;
+        }
+        if (compare_entries(candidate, e) != 0) {
+            break;
+        }
+    }
+    for (uint32_t i = start; i > 0; i--) {
+        FsearchDatabaseEntry *candidate = darray_get_item(entries, i - 1);
+        if (candidate == entry) {
+            *pos = i - 1;
+            return true;
+        }
+        if (compare_entries(candidate, e) != 0) {
+            break;
+        }
+    }
+    return false;
+}
+
+static bool
+bits_find(const FsearchSelectionBits *bits, FsearchDatabaseEntry *entry, uint32_t *pos) {
+    if (!bits->entries || bits->num_entries == 0) {
+        return false;
+    }
+    const uint32_t idx = db_entry_get_idx(entry);
+    if (idx < bits->num_entries && darray_get_item(bits->entries, idx) == entry) {
+        *pos = idx;
+        return true;
+    }
+    // the database only updates the indices when it needs them, after changes they might be outdated
+    uint32_t found = 0;
+    if (!darray_binary_search_with_data(bits->entries,
+                                        entry,
+                                        (DynamicArrayCompareDataFunc)db_entry_compare_entries_by_name,
+                                        NULL,
+                                        &found)) {
+        return false;
+    }
+    return bits_find_among_equal_names(entry, bits->entries, found, pos);
+}
+
+static FsearchSelectionBits *
+get_bits(FsearchSelection *selection, FsearchDatabaseEntry *entry) {
+    return db_entry_is_folder(entry) ? &selection->folders : &selection->files;
+}
+
+// The bits which belong to entries if it's one of the orders of all folders or files of the version
+static FsearchSelectionBits *
+get_bits_of_sorted_entries(FsearchSelection *selection, DynamicArray *entries, bool *is_name_order) {
+    if (!selection->version || !entries) {
+        return NULL;
+    }
+    for (uint32_t i = 0; i < NUM_DATABASE_INDEX_TYPES; i++) {
+        if (entries == selection->version->sorted_folders[i]) {
+            *is_name_order = i == DATABASE_INDEX_TYPE_NAME;
+            return &selection->folders;
+        }
+        if (entries == selection->version->sorted_files[i]) {
+            *is_name_order = i == DATABASE_INDEX_TYPE_NAME;
+            return &selection->files;
+        }
+    }
+    return NULL;
+}
+
+static void
+apply_to_entry(FsearchSelection *selection, FsearchDatabaseEntry *entry, FsearchSelectionOp op) {
+    if (!entry) {
+        return;
+    }
+    FsearchSelectionBits *bits = get_bits(selection, entry);
+    uint32_t pos = 0;
+    if (bits_find(bits, entry, &pos)) {
+        bits_apply(bits, pos, op);
+    }
+}
+
+static void
+apply_to_range(FsearchSelection *selection,
+               DynamicArray *entries,
+               uint32_t start_idx,
+               uint32_t end_idx,
+               FsearchSelectionOp op) {
     g_assert(selection);
-    g_assert(item);
+    g_assert(entries);
 
-    if (g_hash_table_steal(selection, item)) {
+    const uint32_t num_entries = darray_get_num_items(entries);
+    if (num_entries == 0 || start_idx > end_idx || start_idx >= num_entries) {
         return;
     }
-    g_hash_table_add(selection, item);
+    end_idx = MIN(end_idx, num_entries - 1);
+
+    bool is_name_order = false;
+    FsearchSelectionBits *bits = get_bits_of_sorted_entries(selection, entries, &is_name_order);
+    if (bits && (is_name_order || (start_idx == 0 && end_idx == num_entries - 1))) {
+        // the range covers the same positions of the name array, or all of it
+        const uint32_t start = is_name_order ? start_idx : 0;
+        const uint32_t end = is_name_order ? end_idx : bits->num_entries - 1;
+        bits_apply_range(bits, start, end, op);
+        return;
+    }
+    for (uint32_t i = start_idx; i <= end_idx; i++) {
+        apply_to_entry(selection, darray_get_item(entries, i), op);
+    }
 }
 
-void
-fsearch_selection_select(GHashTable *selection, gpointer item) {
+// Moves the selected bits of from to the bits of the other name array to, which is sorted the same way.
+static void
+bits_migrate(const FsearchSelectionBits *from, FsearchSelectionBits *to) {
+    if (from->num_selected == 0 || to->num_entries == 0) {
+        return;
+    }
+    // the selected entries are found in the same order, so the search for one starts where the previous one was
+    uint32_t cursor = 0;
+    for (uint32_t w = 0; w < get_num_words(from->num_entries); w++) {
+        uint64_t word = from->words[w];
+        while (word) {
+            const uint32_t i = w * NUM_BITS_PER_WORD + __builtin_ctzll(word);
+            word &= word - 1;
+
+            FsearchDatabaseEntry *entry = darray_get_item(from->entries, i);
+            uint32_t pos = db_entry_get_idx(entry);
+            if (pos >= to->num_entries || darray_get_item(to->entries, pos) != entry) {
+                while (cursor < to->num_entries && compare_entries(darray_get_item(to->entries, cursor), entry) < 0) {
+                    cursor++;
+                }
+                if (cursor >= to->num_entries || !bits_find_among_equal_names(entry, to->entries, cursor, &pos)) {
+                    // it was removed
+                    continue;
+                }
+            }
+            bits_apply(to, pos, SELECTION_OP_SELECT);
+            cursor = MAX(cursor, pos);
+        }
+    }
+}
+
+// Looks up the entries of another database which have the same path as selected ones. Folders are found by their id,
+// which they keep across rescans, everything else by the name and the folder it's in.
+typedef struct {
+    DynamicArray *folders;
+    DynamicArray *files;
+    // position + 1 of the folders by their id, 0 if no folder has the id
+    uint32_t *folder_positions;
+    uint32_t num_folder_positions;
+    // folder of the other database -> folder with the same path or NULL
+    GHashTable *found_folders;
+
+    // the files with the same name as the last one which was looked up
+    uint32_t run_start;
+    uint32_t run_end;
+    // parent -> position + 1 of the files in the run, only used for long runs
+    GHashTable *run_parents;
+} FsearchSelectionMatcher;
+
+// runs with more entries get a table of their parents
+#define MAX_RUN_SCAN_LENGTH 32
+
+// The first position from start on where entry is or would have to be inserted
+static uint32_t
+lower_bound(DynamicArray *entries, uint32_t start, FsearchDatabaseEntry *entry) {
+    uint32_t left = start;
+    uint32_t right = darray_get_num_items(entries);
+    while (left < right) {
+        const uint32_t middle = left + (right - left) / 2;
+        if (compare_entries(darray_get_item(entries, middle), entry) < 0) {
+            left = middle + 1;
+        }
+        else {
+            right = middle;
+        }
+    }
+    return left;
+}
+
+static uint32_t
+get_run_end(DynamicArray *entries, uint32_t start, FsearchDatabaseEntry *entry) {
+    const uint32_t num_entries = darray_get_num_items(entries);
+    uint32_t end = start;
+    while (end < num_entries && compare_entries(darray_get_item(entries, end), entry) == 0) {
+        end++;
+    }
+    return end;
+}
+
+static bool
+find_in_run(DynamicArray *entries, uint32_t start, uint32_t end, FsearchDatabaseEntryFolder *parent, uint32_t *pos) {
+    for (uint32_t i = start; i < end; i++) {
+        if (db_entry_get_parent(darray_get_item(entries, i)) == parent) {
+            *pos = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static FsearchDatabaseEntryFolder *
+matcher_find_folder(FsearchSelectionMatcher *matcher, FsearchDatabaseEntryFolder *folder);
+
+// The parent which an entry with the same path as entry has, false if there's no such folder
+static bool
+matcher_find_parent(FsearchSelectionMatcher *matcher, FsearchDatabaseEntry *entry, FsearchDatabaseEntryFolder **parent) {
+    FsearchDatabaseEntryFolder *other_parent = db_entry_get_parent(entry);
+    *parent = other_parent ? matcher_find_folder(matcher, other_parent) : NULL;
+    return !other_parent || *parent;
+}
+
+static FsearchDatabaseEntryFolder *
+matcher_find_folder_by_id(FsearchSelectionMatcher *matcher, FsearchDatabaseEntryFolder *folder) {
+    const uint32_t id = db_entry_folder_get_id(folder);
+    if (id == 0 || id >= matcher->num_folder_positions || matcher->folder_positions[id] == 0) {
+        return NULL;
+    }
+    FsearchDatabaseEntry *candidate = darray_get_item(matcher->folders, matcher->folder_positions[id] - 1);
+    // databases which were scanned independently can use the same id for other folders
+    if (strcmp(db_entry_get_name_raw(candidate), db_entry_get_name_raw((FsearchDatabaseEntry *)folder)) != 0) {
+        return NULL;
+    }
+    FsearchDatabaseEntryFolder *parent = NULL;
+    if (!matcher_find_parent(matcher, (FsearchDatabaseEntry *)folder, &parent)
+        || db_entry_get_parent(candidate) != parent) {
+        return NULL;
+    }
+    return (FsearchDatabaseEntryFolder *)candidate;
+}
+
+static FsearchDatabaseEntryFolder *
+matcher_find_folder(FsearchSelectionMatcher *matcher, FsearchDatabaseEntryFolder *folder) {
+    gpointer found = NULL;
+    if (g_hash_table_lookup_extended(matcher->found_folders, folder, NULL, &found)) {
+        return found;
+    }
+    found = matcher->folders ? matcher_find_folder_by_id(matcher, folder) : NULL;
+    FsearchDatabaseEntryFolder *parent = NULL;
+    if (!found && matcher->folders && matcher_find_parent(matcher, (FsearchDatabaseEntry *)folder, &parent)) {
+        FsearchDatabaseEntry *entry = (FsearchDatabaseEntry *)folder;
+        const uint32_t start = lower_bound(matcher->folders, 0, entry);
+        uint32_t pos = 0;
+        if (find_in_run(matcher->folders, start, get_run_end(matcher->folders, start, entry), parent, &pos)) {
+            found = darray_get_item(matcher->folders, pos);
+        }
+    }
+    g_hash_table_insert(matcher->found_folders, folder, found);
+    return found;
+}
+
+// Files have to be looked up in the order of their names
+static bool
+matcher_find_file(FsearchSelectionMatcher *matcher, FsearchDatabaseEntry *file, uint32_t *pos) {
+    FsearchDatabaseEntryFolder *parent = NULL;
+    if (!matcher_find_parent(matcher, file, &parent)) {
+        return false;
+    }
+    DynamicArray *files = matcher->files;
+    if (matcher->run_start >= matcher->run_end
+        || compare_entries(darray_get_item(files, matcher->run_start), file) != 0) {
+        g_clear_pointer(&matcher->run_parents, g_hash_table_unref);
+        matcher->run_start = lower_bound(files, matcher->run_end, file);
+        matcher->run_end = get_run_end(files, matcher->run_start, file);
+        if (matcher->run_end - matcher->run_start > MAX_RUN_SCAN_LENGTH) {
+            // many files with the same name (e.g. README.md) are selected one after another
+            matcher->run_parents = g_hash_table_new(NULL, NULL);
+            for (uint32_t i = matcher->run_start; i < matcher->run_end; i++) {
+                g_hash_table_insert(matcher->run_parents,
+                                    db_entry_get_parent(darray_get_item(files, i)),
+                                    GUINT_TO_POINTER(i + 1));
+            }
+        }
+    }
+    if (matcher->run_parents) {
+        const uint32_t found = GPOINTER_TO_UINT(g_hash_table_lookup(matcher->run_parents, parent));
+        *pos = found - 1;
+        return found > 0;
+    }
+    return find_in_run(files, matcher->run_start, matcher->run_end, parent, pos);
+}
+
+static void
+matcher_init(FsearchSelectionMatcher *matcher, DynamicArray *folders, DynamicArray *files) {
+    matcher->folders = folders;
+    matcher->files = files;
+    matcher->found_folders = g_hash_table_new(NULL, NULL);
+
+    const uint32_t num_folders = folders ? darray_get_num_items(folders) : 0;
+    uint32_t max_id = 0;
+    for (uint32_t i = 0; i < num_folders; i++) {
+        max_id = MAX(max_id, db_entry_folder_get_id(darray_get_item(folders, i)));
+    }
+    if (max_id == 0 || max_id / 8 > num_folders) {
+        // the ids are too sparse for a table, the folders are looked up by name
+        return;
+    }
+    matcher->num_folder_positions = max_id + 1;
+    matcher->folder_positions = calloc(matcher->num_folder_positions, sizeof(uint32_t));
+    g_assert(matcher->folder_positions);
+    for (uint32_t i = 0; i < num_folders; i++) {
+        matcher->folder_positions[db_entry_folder_get_id(darray_get_item(folders, i))] = i + 1;
+    }
+}
+
+static void
+matcher_clear(FsearchSelectionMatcher *matcher) {
+    g_clear_pointer(&matcher->folder_positions, free);
+    g_clear_pointer(&matcher->found_folders, g_hash_table_unref);
+    g_clear_pointer(&matcher->run_parents, g_hash_table_unref);
+}
+
+FsearchSelection *
+fsearch_selection_new(FsearchDatabaseVersion *version) {
+    FsearchSelection *selection = calloc(1, sizeof(FsearchSelection));
     g_assert(selection);
-    g_assert(item);
 
-    g_hash_table_add(selection, item);
+    selection->version = db_version_ref(version);
+    bits_init(&selection->folders, version ? db_version_get_folders(version) : NULL);
+    bits_init(&selection->files, version ? db_version_get_files(version) : NULL);
+    return selection;
 }
 
-bool
-fsearch_selection_is_selected(GHashTable *selection, gpointer item) {
+void
+fsearch_selection_free(FsearchSelection *selection) {
     g_assert(selection);
-    g_assert(item);
+    bits_clear(&selection->folders);
+    bits_clear(&selection->files);
+    g_clear_pointer(&selection->version, db_version_unref);
+    g_clear_pointer(&selection, free);
+}
 
-    return g_hash_table_contains(selection, item);
+void
+fsearch_selection_set_version(FsearchSelection *selection, FsearchDatabaseVersion *version) {
+    g_assert(selection);
+    if (version == selection->version) {
+        return;
+    }
+    DynamicArray *folders = version ? version->sorted_folders[DATABASE_INDEX_TYPE_NAME] : NULL;
+    DynamicArray *files = version ? version->sorted_files[DATABASE_INDEX_TYPE_NAME] : NULL;
+    if (folders == selection->folders.entries && files == selection->files.entries) {
+        // only the arrays of other orders differ, the bits are still valid
+        g_clear_pointer(&selection->version, db_version_unref);
+        selection->version = db_version_ref(version);
+        return;
+    }
+
+    FsearchSelection *migrated = fsearch_selection_new(version);
+    bits_migrate(&selection->folders, &migrated->folders);
+    bits_migrate(&selection->files, &migrated->files);
+
+    FsearchSelection previous = *selection;
+    *selection = *migrated;
+    *migrated = previous;
+    g_clear_pointer(&migrated, fsearch_selection_free);
 }
 
 void
-fsearch_selection_select_all(GHashTable *selection, DynamicArray *items) {
+fsearch_selection_select_same_entries(FsearchSelection *selection, FsearchSelection *other) {
     g_assert(selection);
-    g_assert(items);
+    g_assert(other);
+    if (fsearch_selection_get_num_selected(other) == 0 || !selection->version) {
+        return;
+    }
 
-    const uint32_t num_items = darray_get_num_items(items);
+    FsearchSelectionMatcher matcher = {0};
+    matcher_init(&matcher, selection->folders.entries, selection->files.entries);
+    const FsearchSelectionBits *other_bits[] = {&other->folders, &other->files};
+    for (uint32_t b = 0; b < G_N_ELEMENTS(other_bits); b++) {
+        const FsearchSelectionBits *bits = other_bits[b];
+        const bool is_folder = bits == &other->folders;
+        if (!(is_folder ? selection->folders.num_entries : selection->files.num_entries)) {
+            continue;
+        }
+        for (uint32_t w = 0; w < get_num_words(bits->num_entries); w++) {
+            uint64_t word = bits->words[w];
+            while (word) {
+                const uint32_t i = w * NUM_BITS_PER_WORD + __builtin_ctzll(word);
+                word &= word - 1;
 
-    for (uint32_t i = 0; i < num_items; i++) {
-        void *item = darray_get_item(items, i);
-        if (!item) {
-            g_debug("[select_all] item is NULL");
+                FsearchDatabaseEntry *entry = darray_get_item(bits->entries, i);
+                if (is_folder) {
+                    FsearchDatabaseEntryFolder *folder = matcher_find_folder(&matcher, (FsearchDatabaseEntryFolder *)entry);
+                    uint32_t pos = 0;
+                    if (folder && bits_find(&selection->folders, (FsearchDatabaseEntry *)folder, &pos)) {
+                        bits_apply(&selection->folders, pos, SELECTION_OP_SELECT);
+                    }
+                    continue;
+                }
+                uint32_t pos = 0;
+                if (matcher_find_file(&matcher, entry, &pos)) {
+                    bits_apply(&selection->files, pos, SELECTION_OP_SELECT);
+                }
+            }
         }
-        g_hash_table_add(selection, item);
     }
+    matcher_clear(&matcher);
 }
 
 void
-fsearch_selection_unselect_all(GHashTable *selection) {
+fsearch_selection_select_toggle(FsearchSelection *selection, FsearchDatabaseEntry *entry) {
     g_assert(selection);
-    g_hash_table_remove_all(selection);
+    g_assert(entry);
+    apply_to_entry(selection, entry, SELECTION_OP_TOGGLE);
 }
 
 void
-fsearch_selection_invert(GHashTable *selection, DynamicArray *items) {
+fsearch_selection_select(FsearchSelection *selection, FsearchDatabaseEntry *entry) {
     g_assert(selection);
-    g_assert(items);
+    g_assert(entry);
+    apply_to_entry(selection, entry, SELECTION_OP_SELECT);
+}
 
-    const uint32_t num_items = darray_get_num_items(items);
+bool
+fsearch_selection_is_selected(FsearchSelection *selection, FsearchDatabaseEntry *entry) {
+    g_assert(selection);
+    g_assert(entry);
 
-    for (uint32_t i = 0; i < num_items; i++) {
-        void *item = darray_get_item(items, i);
-        if (!item) {
-            g_debug("[select_all] item is NULL");
-        }
-        if (g_hash_table_steal(selection, item)) {
-            continue;
-        }
-        g_hash_table_add(selection, item);
+    FsearchSelectionBits *bits = get_bits(selection, entry);
+    if (bits->num_selected == 0) {
+        return false;
+    }
+    uint32_t pos = 0;
+    return bits_find(bits, entry, &pos) && bits_get(bits, pos);
+}
+
+void
+fsearch_selection_select_range(FsearchSelection *selection,
+                               DynamicArray *entries,
+                               uint32_t start_idx,
+                               uint32_t end_idx) {
+    apply_to_range(selection, entries, start_idx, end_idx, SELECTION_OP_SELECT);
+}
+
+void
+fsearch_selection_toggle_range(FsearchSelection *selection,
+                               DynamicArray *entries,
+                               uint32_t start_idx,
+                               uint32_t end_idx) {
+    apply_to_range(selection, entries, start_idx, end_idx, SELECTION_OP_TOGGLE);
+}
+
+void
+fsearch_selection_select_all(FsearchSelection *selection, DynamicArray *entries) {
+    g_assert(entries);
+    const uint32_t num_entries = darray_get_num_items(entries);
+    if (num_entries > 0) {
+        apply_to_range(selection, entries, 0, num_entries - 1, SELECTION_OP_SELECT);
+    }
+}
+
+void
+fsearch_selection_unselect_all(FsearchSelection *selection) {
+    g_assert(selection);
+    memset(selection->folders.words, 0, get_num_words(selection->folders.num_entries) * sizeof(uint64_t));
+    memset(selection->files.words, 0, get_num_words(selection->files.num_entries) * sizeof(uint64_t));
+    selection->folders.num_selected = 0;
+    selection->files.num_selected = 0;
+}
+
+void
+fsearch_selection_invert(FsearchSelection *selection, DynamicArray *entries) {
+    g_assert(entries);
+    const uint32_t num_entries = darray_get_num_items(entries);
+    if (num_entries > 0) {
+        apply_to_range(selection, entries, 0, num_entries - 1, SELECTION_OP_TOGGLE);
     }
 }
 
 uint32_t
-fsearch_selection_get_num_selected(GHashTable *selection) {
+fsearch_selection_get_num_selected(FsearchSelection *selection) {
     g_assert(selection);
-    return g_hash_table_size(selection);
+    return selection->folders.num_selected + selection->files.num_selected;
+}
+
+static void
+bits_for_each(const FsearchSelectionBits *bits, GHFunc func, gpointer user_data) {
+    const uint32_t num_words = get_num_words(bits->num_entries);
+    for (uint32_t w = 0; w < num_words && bits->num_selected > 0; w++) {
+        uint64_t word = bits->words[w];
+        while (word) {
+            const uint32_t i = w * NUM_BITS_PER_WORD + __builtin_ctzll(word);
+            word &= word - 1;
+            FsearchDatabaseEntry *entry = darray_get_item(bits->entries, i);
+            func(entry, entry, user_data);
+        }
+    }
 }
+
 void
-fsearch_selection_for_each(GHashTable *selection, GHFunc func, gpointer user_data) {
+fsearch_selection_for_each(FsearchSelection *selection, GHFunc func, gpointer user_data) {
+    g_assert(selection);
+    g_assert(func);
+    bits_for_each(&selection->folders, func, user_data);
+    bits_for_each(&selection->files, func, user_data);
+}
+
+size_t
+fsearch_selection_get_memory_size(FsearchSelection *selection) {
     g_assert(selection);
-    g_hash_table_foreach(selection, func, user_data);
+    const size_t num_words = MAX(get_num_words(selection->folders.num_entries), 1)
+                           + MAX(get_num_words(selection->files.num_entries), 1);
+    return sizeof(FsearchSelection) + num_words * sizeof(uint64_t);
 }
@@ -1,37 +1,70 @@
 #pragma once
 
 #include "fsearch_array.h"
+#include "fsearch_database_entry.h"
+#include "fsearch_database_version.h"
 
 #include <glib.h>
 #include <stdbool.h>
 #include <stdint.h>
 
+// The selected entries of a database version. Every entry of its name arrays has one bit, which is found through the
+// index of the entry, so selecting all entries or ranges of the name order only has to fill words of bits.
+typedef struct FsearchSelection FsearchSelection;
+
+// version can be NULL, nothing can be selected then
+FsearchSelection *
+fsearch_selection_new(FsearchDatabaseVersion *version);
+
 void
-fsearch_selection_free(GHashTable *selection);
+fsearch_selection_free(FsearchSelection *selection);
 
-GHashTable *
-fsearch_selection_new(void);
+// Moves the selection to another version of the same database, entries which aren't part of it anymore get unselected
+void
+fsearch_selection_set_version(FsearchSelection *selection, FsearchDatabaseVersion *version);
+
+// Selects the entries which have the same path as the ones selected in other, which can belong to another database,
+// e.g. the result of a rescan
+void
+fsearch_selection_select_same_entries(FsearchSelection *selection, FsearchSelection *other);
 
 void
-fsearch_selection_select_toggle(GHashTable *selection, gpointer item);
+fsearch_selection_select_toggle(FsearchSelection *selection, FsearchDatabaseEntry *entry);
 
 void
-fsearch_selection_select(GHashTable *selection, gpointer item);
+fsearch_selection_select(FsearchSelection *selection, FsearchDatabaseEntry *entry);
 
 bool
-fsearch_selection_is_selected(GHashTable *selection, gpointer item);
+fsearch_selection_is_selected(FsearchSelection *selection, FsearchDatabaseEntry *entry);
 
+// Selects the entries from start_idx to end_idx (inclusive) of entries
 void
-fsearch_selection_select_all(GHashTable *selection, DynamicArray *items);
+fsearch_selection_select_range(FsearchSelection *selection,
+                               DynamicArray *entries,
+                               uint32_t start_idx,
+                               uint32_t end_idx);
 
 void
-fsearch_selection_unselect_all(GHashTable *selection);
+fsearch_selection_toggle_range(FsearchSelection *selection,
+                               DynamicArray *entries,
+                               uint32_t start_idx,
+                               uint32_t end_idx);
 
 void
-fsearch_selection_invert(GHashTable *selection, DynamicArray *items);
+fsearch_selection_select_all(FsearchSelection *selection, DynamicArray *entries);
+
+void
+fsearch_selection_unselect_all(FsearchSelection *selection);
+
+void
+fsearch_selection_invert(FsearchSelection *selection, DynamicArray *entries);
 
 uint32_t
-fsearch_selection_get_num_selected(GHashTable *selection);
+fsearch_selection_get_num_selected(FsearchSelection *selection);
+
+size_t
+fsearch_selection_get_memory_size(FsearchSelection *selection);
 
+// Calls func with every selected entry as key and value, folders first and in the order of their names
 void
-fsearch_selection_for_each(GHashTable *selection, GHFunc func, gpointer user_data);
+fsearch_selection_for_each(FsearchSelection *selection, GHFunc func, gpointer user_data);
@@ -15,6 +15,8 @@ struct _FsearchStatusbar {
     GtkWidget *statusbar_database_updating_label;
     GtkWidget *statusbar_database_updating_spinner;
     GtkWidget *statusbar_match_case_revealer;
+    GtkWidget *statusbar_performance_label;
+    GtkWidget *statusbar_performance_revealer;
     GtkWidget *statusbar_scan_label;
     GtkWidget *statusbar_scan_status_label;
     GtkWidget *statusbar_search_stack;
@@ -34,6 +36,8 @@ struct _FsearchStatusbar {
     GtkWidget *statusbar_smart_path_revealer;
 
     guint statusbar_timeout_id;
+    // the task box shows that the results are sorted
+    gboolean is_sorting;
 };
 
 G_DEFINE_TYPE(FsearchStatusbar, fsearch_statusbar, GTK_TYPE_REVEALER)
@@ -51,6 +55,7 @@ fsearch_statusbar_set_num_search_results(FsearchStatusbar *sb, uint32_t num_resu
     statusbar_remove_status_update_timeout(sb);
     gtk_stack_set_visible_child(GTK_STACK(sb->statusbar_search_stack), sb->statusbar_search_status_box);
     gtk_spinner_stop(GTK_SPINNER(sb->statusbar_search_task_spinner));
+    sb->is_sorting = FALSE;
 
     gchar sb_text[100] = "";
     snprintf(sb_text, sizeof(sb_text), num_results == 1 ? _("%'d Item") : _("%'d Items"), num_results);
@@ -69,6 +74,7 @@ static gboolean
 on_statusbar_set_sort_status(gpointer user_data) {
     FsearchStatusbar *sb = user_data;
     set_task_status(sb, _("Sorting…"));
+    sb->is_sorting = TRUE;
     return G_SOURCE_REMOVE;
 }
 
@@ -76,6 +82,7 @@ static gboolean
 on_statusbar_set_query_status(gpointer user_data) {
     FsearchStatusbar *sb = user_data;
     set_task_status(sb, _("Querying…"));
+    sb->is_sorting = FALSE;
     return G_SOURCE_REMOVE;
 }
 
@@ -85,6 +92,16 @@ fsearch_statusbar_set_sort_status_delayed(FsearchStatusbar *sb) {
     sb->statusbar_timeout_id = g_timeout_add(100, on_statusbar_set_sort_status, sb);
 }
 
+void
+fsearch_statusbar_set_sort_progress(FsearchStatusbar *sb, uint32_t percent) {
+    if (!sb->is_sorting) {
+        // the sort status isn't shown yet or anymore
+        return;
+    }
+    g_autofree char *text = g_strdup_printf(_("Sorting… %u%%"), percent);
+    gtk_label_set_text(GTK_LABEL(sb->statusbar_search_task_label), text);
+}
+
 void
 fsearch_statusbar_set_query_status_delayed(FsearchStatusbar *sb) {
     statusbar_remove_status_update_timeout(sb);
@@ -124,6 +141,14 @@ fsearch_statusbar_set_filter(FsearchStatusbar *sb, const char *filter_name) {
     gtk_revealer_set_reveal_child(GTK_REVEALER(sb->statusbar_search_filter_revealer), filter_name ? TRUE : FALSE);
 }
 
+void
+fsearch_statusbar_set_performance_stats(FsearchStatusbar *sb, const char *text) {
+    if (text) {
+        gtk_label_set_text(GTK_LABEL(sb->statusbar_performance_label), text);
+    }
+    gtk_revealer_set_reveal_child(GTK_REVEALER(sb->statusbar_performance_revealer), text ? TRUE : FALSE);
+}
+
 void
 fsearch_statusbar_set_database_index_text(FsearchStatusbar *sb, const char *text) {
     if (!text) {
@@ -314,6 +339,8 @@ fsearch_statusbar_class_init(FsearchStatusbarClass *klass) {
     gtk_widget_class_bind_template_child(widget_class, FsearchStatusbar, statusbar_database_updating_label);
     gtk_widget_class_bind_template_child(widget_class, FsearchStatusbar, statusbar_database_updating_spinner);
     gtk_widget_class_bind_template_child(widget_class, FsearchStatusbar, statusbar_match_case_revealer);
+    gtk_widget_class_bind_template_child(widget_class, FsearchStatusbar, statusbar_performance_label);
+    gtk_widget_class_bind_template_child(widget_class, FsearchStatusbar, statusbar_performance_revealer);
     gtk_widget_class_bind_template_child(widget_class, FsearchStatusbar, statusbar_scan_label);
     gtk_widget_class_bind_template_child(widget_class, FsearchStatusbar, statusbar_scan_status_label);
     gtk_widget_class_bind_template_child(widget_class, FsearchStatusbar, statusbar_search_filter_label);
@@ -43,12 +43,19 @@ fsearch_statusbar_set_query_status_delayed(FsearchStatusbar *sb);
 void
 fsearch_statusbar_set_sort_status_delayed(FsearchStatusbar *sb);
 
+void
+fsearch_statusbar_set_sort_progress(FsearchStatusbar *sb, uint32_t percent);
+
 void
 fsearch_statusbar_set_revealer_visibility(FsearchStatusbar *sb, FsearchStatusbarRevealer revealer, gboolean visible);
 
 void
 fsearch_statusbar_set_filter(FsearchStatusbar *sb, const char *filter_name);
 
+// Shows text in the performance statistics panel, NULL hides it
+void
+fsearch_statusbar_set_performance_stats(FsearchStatusbar *sb, const char *text);
+
 void
 fsearch_statusbar_set_database_state(FsearchStatusbar *sb,
                                      FsearchStatusbarState state,
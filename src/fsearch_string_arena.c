@@ -0,0 +1,173 @@
+#include "fsearch_string_arena.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define FSEARCH_STRING_ARENA_BLOCK_SIZE (1 << 20)
+
+typedef struct FsearchStringArenaBlock {
+    struct FsearchStringArenaBlock *next;
+    size_t num_used;
+    size_t capacity;
+    char data[];
+} FsearchStringArenaBlock;
+
+struct FsearchStringArena {
+    // the first block is the one new strings are added to
+    FsearchStringArenaBlock *blocks;
+    // the arenas some of the strings which are in use belong to, NULL if there are none
+    GPtrArray *shared;
+
+    volatile int ref_count;
+};
+
+static FsearchStringArenaBlock *
+fsearch_string_arena_block_new(size_t capacity) {
+    FsearchStringArenaBlock *block = malloc(sizeof(FsearchStringArenaBlock) + capacity);
+    g_assert(block);
+    block->next = NULL;
+    block->num_used = 0;
+    block->capacity = capacity;
+    return block;
+}
+
+FsearchStringArena *
+fsearch_string_arena_new(void) {
+    FsearchStringArena *arena = calloc(1, sizeof(FsearchStringArena));
+    g_assert(arena);
+    arena->ref_count = 1;
+    return arena;
+}
+
+FsearchStringArena *
+fsearch_string_arena_ref(FsearchStringArena *arena) {
+    if (!arena || g_atomic_int_get(&arena->ref_count) <= 0) {
+        return NULL;
+    }
+    g_atomic_int_inc(&arena->ref_count);
+    return arena;
+}
+
+void
+fsearch_string_arena_free(FsearchStringArena *arena) {
+    if (!arena || !g_atomic_int_dec_and_test(&arena->ref_count)) {
+        return;
+    }
+    g_clear_pointer(&arena->shared, g_ptr_array_unref);
+    FsearchStringArenaBlock *block = arena->blocks;
+    while (block) {
+        FsearchStringArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    g_clear_pointer(&arena, free);
+}
+
+const char *
+fsearch_string_arena_add(FsearchStringArena *arena, const char *str) {
+    g_assert(arena);
+    g_assert(str);
+
+    const size_t len = strlen(str) + 1;
+    FsearchStringArenaBlock *block = arena->blocks;
+    if (!block || block->capacity - block->num_used < len) {
+        if (len > FSEARCH_STRING_ARENA_BLOCK_SIZE / 4) {
+            // long strings get a block of their own, so the rest of the current one doesn't go to waste
+            block = fsearch_string_arena_block_new(len);
+            if (arena->blocks) {
+                block->next = arena->blocks->next;
+                arena->blocks->next = block;
+            }
+            else {
+                arena->blocks = block;
+            }
+        }
+        else {
+            block = fsearch_string_arena_block_new(FSEARCH_STRING_ARENA_BLOCK_SIZE);
+            block->next = arena->blocks;
+            arena->blocks = block;
+        }
+    }
+
+    char *copy = block->data + block->num_used;
+    memcpy(copy, str, len);
+    block->num_used += len;
+    return copy;
+}
+
+void
+fsearch_string_arena_share(FsearchStringArena *arena, FsearchStringArena *other) {
+    g_assert(arena);
+    g_assert(other);
+    g_assert(arena != other);
+    if (!arena->shared) {
+        arena->shared = g_ptr_array_new_with_free_func((GDestroyNotify)fsearch_string_arena_free);
+    }
+    for (uint32_t i = 0; i < arena->shared->len; i++) {
+        if (g_ptr_array_index(arena->shared, i) == other) {
+            return;
+        }
+    }
+    g_ptr_array_add(arena->shared, fsearch_string_arena_ref(other));
+}
+
+void
+fsearch_string_arena_merge(FsearchStringArena *arena, FsearchStringArena *other) {
+    g_assert(arena);
+    if (!other) {
+        return;
+    }
+    g_assert(other->ref_count == 1);
+    if (other->shared) {
+        for (uint32_t i = 0; i < other->shared->len; i++) {
+            fsearch_string_arena_share(arena, g_ptr_array_index(other->shared, i));
+        }
+        g_clear_pointer(&other->shared, g_ptr_array_unref);
+    }
+    if (other->blocks) {
+        // insert the blocks after the first one, so it stays the one which is used for new strings
+        FsearchStringArenaBlock *last = other->blocks;
+        while (last->next) {
+            last = last->next;
+        }
+        if (arena->blocks) {
+            last->next = arena->blocks->next;
+            arena->blocks->next = other->blocks;
+        }
+        else {
+            arena->blocks = other->blocks;
+        }
+        other->blocks = NULL;
+    }
+    g_clear_pointer(&other, free);
+}
+
+size_t
+fsearch_string_arena_get_memory_size(FsearchStringArena *arena) {
+    if (!arena) {
+        return 0;
+    }
+    size_t size = sizeof(FsearchStringArena);
+    for (FsearchStringArenaBlock *block = arena->blocks; block; block = block->next) {
+        size += sizeof(FsearchStringArenaBlock) + block->capacity;
+    }
+    for (uint32_t i = 0; arena->shared && i < arena->shared->len; i++) {
+        size += fsearch_string_arena_get_memory_size(g_ptr_array_index(arena->shared, i));
+    }
+    return size;
+}
+
+size_t
+fsearch_string_arena_get_num_bytes(FsearchStringArena *arena) {
+    if (!arena) {
+        return 0;
+    }
+    size_t num_bytes = 0;
+    for (FsearchStringArenaBlock *block = arena->blocks; block; block = block->next) {
+        num_bytes += block->num_used;
+    }
+    for (uint32_t i = 0; arena->shared && i < arena->shared->len; i++) {
+        num_bytes += fsearch_string_arena_get_num_bytes(g_ptr_array_index(arena->shared, i));
+    }
+    return num_bytes;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <glib.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Copies strings into large blocks, which are only released all at once when the arena is freed.
+// This avoids the per-allocation overhead (and the fragmentation) of millions of small strings.
+// Not thread safe, except for taking and releasing references.
+typedef struct FsearchStringArena FsearchStringArena;
+
+FsearchStringArena *
+fsearch_string_arena_new(void);
+
+FsearchStringArena *
+fsearch_string_arena_ref(FsearchStringArena *arena);
+
+// Releases a reference, the strings are freed along with the last one
+void
+fsearch_string_arena_free(FsearchStringArena *arena);
+
+// Keeps the strings of other valid for as long as arena exists, so they can be used without copying them. Only
+// adding strings to other stays up to its other owners.
+void
+fsearch_string_arena_share(FsearchStringArena *arena, FsearchStringArena *other);
+
+// Returns a copy of str, which stays valid until the arena is freed
+const char *
+fsearch_string_arena_add(FsearchStringArena *arena, const char *str);
+
+// The number of bytes allocated by the arena, including the unused rest of its blocks and the arenas it shares
+size_t
+fsearch_string_arena_get_memory_size(FsearchStringArena *arena);
+
+// The number of bytes of all strings which were added to the arena and the arenas it shares (with their terminators)
+size_t
+fsearch_string_arena_get_num_bytes(FsearchStringArena *arena);
+
+// Moves all strings of other into arena and frees other, the strings stay where they are. Nothing else may hold a
+// reference to other.
+void
+fsearch_string_arena_merge(FsearchStringArena *arena, FsearchStringArena *other);
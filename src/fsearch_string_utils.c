@@ -21,8 +21,13 @@
 #include "fsearch_string_utils.h"
 #include <ctype.h>
 #include <glib.h>
+#include <stdint.h>
 #include <string.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 bool
 fsearch_string_is_empty(const char *str) {
     // query is considered empty if:
@@ -164,3 +169,97 @@ fsearch_string_starts_with_interval(char *str, char **end_ptr) {
     *end_ptr = str;
     return false;
 }
+
+void
+fsearch_string_search_init(FsearchStringSearch *search, const char *needle, bool ignore_case) {
+    g_assert(search);
+    g_assert(needle);
+
+    search->needle = ignore_case ? g_ascii_strdown(needle, -1) : g_strdup(needle);
+    search->needle_len = strlen(needle);
+    search->ignore_case = ignore_case;
+    if (search->needle_len > 0) {
+        search->first = search->needle[0];
+        search->last = search->needle[search->needle_len - 1];
+    }
+    search->first_alt = ignore_case ? g_ascii_toupper(search->first) : search->first;
+    search->last_alt = ignore_case ? g_ascii_toupper(search->last) : search->last;
+}
+
+void
+fsearch_string_search_clear(FsearchStringSearch *search) {
+    g_assert(search);
+    g_clear_pointer(&search->needle, g_free);
+    search->needle_len = 0;
+}
+
+static bool
+search_matches_at(const FsearchStringSearch *search, const char *str) {
+    if (!search->ignore_case) {
+        return !memcmp(str, search->needle, search->needle_len);
+    }
+    for (size_t i = 0; i < search->needle_len; i++) {
+        if (g_ascii_tolower(str[i]) != search->needle[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static const char *
+search_find_from(const FsearchStringSearch *search, const char *haystack, size_t start, size_t haystack_len) {
+    if (!search->ignore_case) {
+        return memmem(haystack + start, haystack_len - start, search->needle, search->needle_len);
+    }
+    for (size_t i = start; i + search->needle_len <= haystack_len; i++) {
+        if ((haystack[i] == search->first || haystack[i] == search->first_alt) && search_matches_at(search, haystack + i)) {
+            return haystack + i;
+        }
+    }
+    return NULL;
+}
+
+const char *
+fsearch_string_search_find_first(const FsearchStringSearch *search, const char *haystack, size_t haystack_len) {
+    g_assert(search);
+    g_assert(search->needle);
+
+    const size_t needle_len = search->needle_len;
+    if (needle_len == 0) {
+        return haystack;
+    }
+    if (needle_len > haystack_len) {
+        return NULL;
+    }
+
+    size_t pos = 0;
+#ifdef __SSE2__
+    // Compare the first and last character of the needle at 16 positions at once, only where both match the
+    // whole needle needs to be compared
+    const __m128i first = _mm_set1_epi8(search->first);
+    const __m128i first_alt = _mm_set1_epi8(search->first_alt);
+    const __m128i last = _mm_set1_epi8(search->last);
+    const __m128i last_alt = _mm_set1_epi8(search->last_alt);
+    for (; pos + needle_len - 1 + 16 <= haystack_len; pos += 16) {
+        const __m128i block_first = _mm_loadu_si128((const __m128i *)(haystack + pos));
+        const __m128i block_last = _mm_loadu_si128((const __m128i *)(haystack + pos + needle_len - 1));
+        const __m128i eq_first =
+            _mm_or_si128(_mm_cmpeq_epi8(block_first, first), _mm_cmpeq_epi8(block_first, first_alt));
+        const __m128i eq_last = _mm_or_si128(_mm_cmpeq_epi8(block_last, last), _mm_cmpeq_epi8(block_last, last_alt));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_and_si128(eq_first, eq_last));
+        while (mask) {
+            const char *match = haystack + pos + __builtin_ctz(mask);
+            if (search_matches_at(search, match)) {
+                return match;
+            }
+            mask &= mask - 1;
+        }
+    }
+#endif
+    return search_find_from(search, haystack, pos, haystack_len);
+}
+
+bool
+fsearch_string_search_find(const FsearchStringSearch *search, const char *haystack, size_t haystack_len) {
+    return fsearch_string_search_find_first(search, haystack, haystack_len) != NULL;
+}
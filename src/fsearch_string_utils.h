@@ -18,8 +18,24 @@
 
 #pragma once
 #include <stdbool.h>
+#include <stddef.h>
 #include <unistd.h>
 
+// A needle which gets searched for in many strings (e.g. the names of all entries), with everything which only
+// depends on the needle computed up front
+typedef struct FsearchStringSearch {
+    // in lower case if the case is ignored
+    char *needle;
+    size_t needle_len;
+    // the first and last character of the needle, and their upper case form if the case is ignored
+    char first;
+    char last;
+    char first_alt;
+    char last_alt;
+    // only ASCII characters are compared case insensitive
+    bool ignore_case;
+} FsearchStringSearch;
+
 bool
 fsearch_string_is_empty(const char *str);
 
@@ -51,3 +67,17 @@ fsearch_string_convert_wildcard_to_regex_expression(const char *str);
 // If no interval was detected end_ptr will point to str.
 bool
 fsearch_string_starts_with_interval(char *str, char **end_ptr);
+
+void
+fsearch_string_search_init(FsearchStringSearch *search, const char *needle, bool ignore_case);
+
+void
+fsearch_string_search_clear(FsearchStringSearch *search);
+
+// Same as strstr (or strcasestr for ASCII) on a haystack whose length is known already
+bool
+fsearch_string_search_find(const FsearchStringSearch *search, const char *haystack, size_t haystack_len);
+
+// The first occurrence of the needle in haystack, or NULL
+const char *
+fsearch_string_search_find_first(const FsearchStringSearch *search, const char *haystack, size_t haystack_len);
@@ -1,8 +1,10 @@
 #define G_LOG_DOMAIN "fsearch-task"
 
 #include "fsearch_task.h"
+#include "fsearch_trace.h"
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 typedef struct FsearchTask {
@@ -11,6 +13,11 @@ typedef struct FsearchTask {
         FSEARCH_TASK_TYPE_NORMAL,
     } type;
     int id;
+    FsearchTaskPriority priority;
+    // the order in which the tasks were queued
+    uint64_t seq;
+    // the task got cancelled in favor of one with a higher priority and has to run again
+    bool preempted;
     GCancellable *task_cancellable;
     FsearchTaskFunc task_func;
     FsearchTaskFinishedFunc task_finished_func;
@@ -19,10 +26,13 @@ typedef struct FsearchTask {
 } FsearchTask;
 
 struct FsearchTaskQueue {
+    // sorted by priority and seq, its lock is held while the current task changes, so tasks which are queued
+    // meanwhile always see whether they have to cancel it
     GAsyncQueue *queue;
     GThread *queue_thread;
     FsearchTask *current_task;
     GMutex current_task_lock;
+    uint64_t next_seq;
 };
 
 static void
@@ -31,8 +41,23 @@ fsearch_task_free(FsearchTask *task) {
     g_clear_pointer(&task, free);
 }
 
+static gint
+fsearch_task_compare(gconstpointer a, gconstpointer b, gpointer user_data) {
+    const FsearchTask *t1 = a;
+    const FsearchTask *t2 = b;
+    // quitting goes before everything else
+    if (t1->type != t2->type) {
+        return t1->type == FSEARCH_TASK_TYPE_QUIT ? -1 : 1;
+    }
+    if (t1->priority != t2->priority) {
+        return t1->priority > t2->priority ? -1 : 1;
+    }
+    return t1->seq < t2->seq ? -1 : t1->seq > t2->seq ? 1 : 0;
+}
+
 static FsearchTask *
 fsearch_task_new(int id,
+                 FsearchTaskPriority priority,
                  FsearchTaskFunc task_func,
                  FsearchTaskFinishedFunc task_finished_func,
                  FsearchTaskCancelledFunc task_cancelled_func,
@@ -46,6 +71,7 @@ fsearch_task_new(int id,
     task->task_cancelled_func = task_cancelled_func;
     task->data = data;
     task->id = id;
+    task->priority = priority;
 
     return task;
 }
@@ -53,26 +79,45 @@ fsearch_task_new(int id,
 static gpointer
 fsearch_task_queue_thread(FsearchTaskQueue *queue) {
     while (true) {
-        FsearchTask *task = g_async_queue_pop(queue->queue);
+        g_async_queue_lock(queue->queue);
+        FsearchTask *task = g_async_queue_pop_unlocked(queue->queue);
         if (!task) {
+            g_async_queue_unlock(queue->queue);
             continue;
         }
         if (task->type == FSEARCH_TASK_TYPE_QUIT) {
             // quit task queue thread
+            g_async_queue_unlock(queue->queue);
             g_debug("[queue_thread] quit");
             g_clear_pointer(&task, fsearch_task_free);
             break;
         }
         g_mutex_lock(&queue->current_task_lock);
         queue->current_task = task;
+        g_cancellable_reset(task->task_cancellable);
         g_mutex_unlock(&queue->current_task_lock);
+        g_async_queue_unlock(queue->queue);
 
-        g_cancellable_reset(task->task_cancellable);
+        FSEARCH_TRACE1(task_dispatch_start, task->id);
         gpointer result = task->task_func(task->data, task->task_cancellable);
 
+        g_async_queue_lock(queue->queue);
         g_mutex_lock(&queue->current_task_lock);
         queue->current_task = NULL;
+        // a task which finished anyway doesn't need to run again
+        const bool preempted = task->preempted && !result;
+        task->preempted = false;
         g_mutex_unlock(&queue->current_task_lock);
+        FSEARCH_TRACE2(task_dispatch_end, task->id, preempted);
+        if (preempted) {
+            g_debug("[queue_thread] task %d was preempted, run it again later", task->id);
+            // it keeps its seq, so it's still the first one of its priority
+            g_async_queue_push_sorted_unlocked(queue->queue, g_steal_pointer(&task), fsearch_task_compare, NULL);
+        }
+        g_async_queue_unlock(queue->queue);
+        if (preempted) {
+            continue;
+        }
 
         g_cancellable_reset(task->task_cancellable);
         task->task_finished_func(result, task->data);
@@ -87,19 +132,20 @@ fsearch_task_queue_cancel_current(FsearchTaskQueue *queue) {
     g_mutex_lock(&queue->current_task_lock);
     if (queue->current_task) {
         g_cancellable_cancel(queue->current_task->task_cancellable);
+        queue->current_task->preempted = false;
     }
     g_mutex_unlock(&queue->current_task_lock);
 }
 
+// The lock of the async queue must be held
 static void
-fsearch_task_queue_clear(FsearchTaskQueue *queue, FsearchTaskQueueClearPolicy clear_policy, int id) {
+fsearch_task_queue_clear_unlocked(FsearchTaskQueue *queue, FsearchTaskQueueClearPolicy clear_policy, int id) {
     if (clear_policy == FSEARCH_TASK_CLEAR_NONE) {
         return;
     }
 
     GQueue *task_queue = g_queue_new();
 
-    g_async_queue_lock(queue->queue);
     while (true) {
         // clear all queued tasks
         FsearchTask *task = g_async_queue_try_pop_unlocked(queue->queue);
@@ -122,15 +168,13 @@ fsearch_task_queue_clear(FsearchTaskQueue *queue, FsearchTaskQueueClearPolicy cl
     while (true) {
         FsearchTask *task = g_queue_pop_head(task_queue);
         if (task) {
-            g_async_queue_push_unlocked(queue->queue, g_steal_pointer(&task));
+            g_async_queue_push_sorted_unlocked(queue->queue, g_steal_pointer(&task), fsearch_task_compare, NULL);
         }
         else {
             break;
         }
     }
 
-    g_async_queue_unlock(queue->queue);
-
     g_clear_pointer(&task_queue, g_queue_free);
 }
 
@@ -138,14 +182,17 @@ void
 fsearch_task_queue_free(FsearchTaskQueue *queue) {
     g_assert(queue);
 
-    fsearch_task_queue_clear(queue, FSEARCH_TASK_CLEAR_ALL, -1);
+    // all at once, so a preempted task can't be queued again in between
+    g_async_queue_lock(queue->queue);
+    fsearch_task_queue_clear_unlocked(queue, FSEARCH_TASK_CLEAR_ALL, -1);
 
     fsearch_task_queue_cancel_current(queue);
 
     FsearchTask *task = calloc(1, sizeof(FsearchTask));
     g_assert(task);
     task->type = FSEARCH_TASK_TYPE_QUIT;
-    g_async_queue_push(queue->queue, g_steal_pointer(&task));
+    g_async_queue_push_sorted_unlocked(queue->queue, g_steal_pointer(&task), fsearch_task_compare, NULL);
+    g_async_queue_unlock(queue->queue);
 
     g_thread_join(g_steal_pointer(&queue->queue_thread));
 
@@ -171,22 +218,36 @@ fsearch_task_queue_new(const char *name) {
 void
 fsearch_task_queue(FsearchTaskQueue *queue,
                    gint id,
+                   FsearchTaskPriority priority,
                    FsearchTaskFunc task_func,
                    FsearchTaskFinishedFunc task_finished_func,
                    FsearchTaskCancelledFunc task_cancelled_func,
                    FsearchTaskQueueClearPolicy clear_policy,
                    gpointer data) {
-    FsearchTask *task = fsearch_task_new(id, task_func, task_finished_func, task_cancelled_func, data);
-    if (clear_policy != FSEARCH_TASK_CLEAR_NONE) {
-        fsearch_task_queue_clear(queue, clear_policy, task->id);
-        g_mutex_lock(&queue->current_task_lock);
-        if (queue->current_task) {
-            if (clear_policy != FSEARCH_TASK_CLEAR_SAME_ID || queue->current_task->id == task->id) {
-                g_cancellable_cancel(queue->current_task->task_cancellable);
-            }
+    FsearchTask *task = fsearch_task_new(id, priority, task_func, task_finished_func, task_cancelled_func, data);
+
+    g_async_queue_lock(queue->queue);
+    task->seq = queue->next_seq++;
+    fsearch_task_queue_clear_unlocked(queue, clear_policy, task->id);
+
+    g_mutex_lock(&queue->current_task_lock);
+    FsearchTask *current = queue->current_task;
+    if (current) {
+        if (clear_policy != FSEARCH_TASK_CLEAR_NONE
+            && (clear_policy != FSEARCH_TASK_CLEAR_SAME_ID || current->id == task->id)) {
+            // it's replaced by the new task
+            g_cancellable_cancel(current->task_cancellable);
+            current->preempted = false;
+        }
+        else if (current->priority < task->priority && !g_cancellable_is_cancelled(current->task_cancellable)) {
+            g_debug("[queue] task %d preempts task %d", task->id, current->id);
+            g_cancellable_cancel(current->task_cancellable);
+            current->preempted = true;
         }
-        g_mutex_unlock(&queue->current_task_lock);
     }
-    g_async_queue_push(queue->queue, g_steal_pointer(&task));
+    g_mutex_unlock(&queue->current_task_lock);
+
+    g_async_queue_push_sorted_unlocked(queue->queue, g_steal_pointer(&task), fsearch_task_compare, NULL);
+    g_async_queue_unlock(queue->queue);
 }
 
@@ -16,15 +16,28 @@ typedef enum {
     FSEARCH_TASK_CLEAR_ALL,
 } FsearchTaskQueueClearPolicy;
 
+typedef enum {
+    // work nobody is waiting for
+    FSEARCH_TASK_PRIORITY_BACKGROUND,
+    FSEARCH_TASK_PRIORITY_DEFAULT,
+    // work the user is waiting for, e.g. the results of what they're typing
+    FSEARCH_TASK_PRIORITY_INTERACTIVE,
+} FsearchTaskPriority;
+
 void
 fsearch_task_queue_free(FsearchTaskQueue *queue);
 
 FsearchTaskQueue *
 fsearch_task_queue_new(const char *name);
 
+// Queued tasks run by their priority, those with the same priority in the order they were queued. A task with a
+// higher priority than the current one preempts it: the current task gets cancelled and runs again once the tasks
+// before it are done. So tasks must be able to run again after they were cancelled, and only tasks which returned
+// NULL are run again.
 void
 fsearch_task_queue(FsearchTaskQueue *queue,
                    gint id,
+                   FsearchTaskPriority priority,
                    FsearchTaskFunc task_func,
                    FsearchTaskFinishedFunc task_finished_func,
                    FsearchTaskCancelledFunc task_cancelled_func,
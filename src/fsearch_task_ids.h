@@ -3,4 +3,6 @@
 typedef enum FsearchTaskId {
     FSEARCH_TASK_ID_SEARCH,
     FSEARCH_TASK_ID_SORT,
+    FSEARCH_TASK_ID_HIGHLIGHT,
+    FSEARCH_TASK_ID_ROW_PREFETCH,
 } FsearchTaskId;
\ No newline at end of file
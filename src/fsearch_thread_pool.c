@@ -16,218 +16,489 @@
    along with this program; if not, see <http://www.gnu.org/licenses/>.
    */
 
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
 #define G_LOG_DOMAIN "fsearch-thread-pool"
 
+#ifdef HAVE_SCHED_SETAFFINITY
+#include <sched.h>
+#endif
 #include <stdio.h>
 
 #include "fsearch_limits.h"
 #include "fsearch_thread_pool.h"
 
+// how many ranges a parallel for creates per thread
+#define THREAD_POOL_RANGES_PER_THREAD 4
+// how long a waiting thread sleeps before it looks for new tasks it can help with, in microseconds
+#define THREAD_POOL_WAIT_INTERVAL 1000
+
+typedef struct FsearchThreadPoolWorker {
+    FsearchThreadPool *pool;
+    GThread *thread;
+    uint32_t idx;
+
+    // the tasks pushed by this worker, it takes the newest ones while other threads steal the oldest ones
+    GMutex mutex;
+    GQueue tasks;
+} FsearchThreadPoolWorker;
+
 struct FsearchThreadPool {
-    GList *threads;
+    FsearchThreadPoolWorker *workers;
+    uint32_t num_workers;
     uint32_t num_threads;
-};
 
-typedef struct {
-    GThread *thread;
-    FsearchThreadPoolFunc thread_func;
+    // the tasks pushed by threads which don't belong to the pool
+    GMutex queue_mutex;
+    GQueue queue;
+
+    volatile gint num_queued;
+
+    GMutex sleep_mutex;
+    GCond sleep_cond;
+    bool terminate;
 
-    gpointer *thread_data;
+    // the processors the workers are pinned to, the first one is left to the threads which wait for the tasks
+    int *cpus;
+    uint32_t num_cpus;
+
+    volatile gint ref_count;
+};
+
+struct FsearchTaskGroup {
+    FsearchThreadPool *pool;
+    GCancellable *cancellable;
 
     GMutex mutex;
-    GCond start_cond;
     GCond finished_cond;
-    FsearchThreadStatus status;
-    bool terminate;
-} FsearchThreadPoolContext;
+    uint32_t num_pending;
+};
 
-static bool
-thread_pool_has_thread(FsearchThreadPool *pool, GList *thread) {
-    GList *temp = pool->threads;
-    while (temp) {
-        if (temp == thread) {
-            return true;
+typedef struct {
+    FsearchThreadPoolFunc func;
+    void *data;
+    FsearchTaskGroup *group;
+} FsearchThreadPoolTask;
+
+typedef struct {
+    FsearchThreadPoolRangeFunc func;
+    void *data;
+    uint32_t start;
+    uint32_t end;
+} FsearchThreadPoolRange;
+
+static GPrivate current_worker_key = G_PRIVATE_INIT(NULL);
+
+static GMutex default_pool_mutex;
+static FsearchThreadPool *default_pool = NULL;
+static uint32_t default_pool_num_threads = 0;
+static bool default_pool_pin_threads = false;
+
+static FsearchThreadPoolWorker *
+thread_pool_get_current_worker(FsearchThreadPool *pool) {
+    FsearchThreadPoolWorker *worker = g_private_get(&current_worker_key);
+    return worker && worker->pool == pool ? worker : NULL;
+}
+
+static FsearchThreadPoolTask *
+thread_pool_take_task(FsearchThreadPool *pool, FsearchThreadPoolWorker *self) {
+    if (g_atomic_int_get(&pool->num_queued) <= 0) {
+        return NULL;
+    }
+
+    FsearchThreadPoolTask *task = NULL;
+    if (self) {
+        g_mutex_lock(&self->mutex);
+        task = g_queue_pop_tail(&self->tasks);
+        g_mutex_unlock(&self->mutex);
+    }
+    if (!task) {
+        g_mutex_lock(&pool->queue_mutex);
+        task = g_queue_pop_head(&pool->queue);
+        g_mutex_unlock(&pool->queue_mutex);
+    }
+    // the oldest task of another worker is usually the biggest piece of work it has left
+    const uint32_t first_victim = self ? self->idx + 1 : 0;
+    for (uint32_t i = 0; !task && i < pool->num_workers; i++) {
+        FsearchThreadPoolWorker *victim = &pool->workers[(first_victim + i) % pool->num_workers];
+        if (victim == self) {
+            continue;
         }
-        temp = temp->next;
+        g_mutex_lock(&victim->mutex);
+        task = g_queue_pop_head(&victim->tasks);
+        g_mutex_unlock(&victim->mutex);
     }
-    return false;
+
+    if (task) {
+        g_atomic_int_add(&pool->num_queued, -1);
+    }
+    return task;
 }
 
-static gpointer
-fsearch_thread_pool_thread(gpointer user_data) {
-    FsearchThreadPoolContext *ctx = user_data;
-
-    g_mutex_lock(&ctx->mutex);
-    while (!ctx->terminate) {
-        g_cond_wait(&ctx->start_cond, &ctx->mutex);
-        ctx->status = THREAD_BUSY;
-        if (ctx->thread_data) {
-            ctx->thread_func(ctx->thread_data);
-            ctx->status = THREAD_FINISHED;
-            ctx->thread_data = NULL;
-            g_cond_signal(&ctx->finished_cond);
-        }
-        ctx->status = THREAD_IDLE;
+static void
+thread_pool_run_task(FsearchThreadPoolTask *task) {
+    FsearchTaskGroup *group = task->group;
+    if (!group->cancellable || !g_cancellable_is_cancelled(group->cancellable)) {
+        task->func(task->data);
     }
-    g_mutex_unlock(&ctx->mutex);
-    return NULL;
+    g_clear_pointer(&task, g_free);
+
+    // the group might be freed as soon as its last task is done, so it's only touched with its mutex held
+    g_mutex_lock(&group->mutex);
+    if (--group->num_pending == 0) {
+        g_cond_broadcast(&group->finished_cond);
+    }
+    g_mutex_unlock(&group->mutex);
 }
 
 static void
-thread_context_free(FsearchThreadPoolContext *ctx) {
-    g_return_if_fail(ctx);
+thread_pool_init_cpus(FsearchThreadPool *pool) {
+#ifdef HAVE_SCHED_SETAFFINITY
+    // only the processors the process may run on (e.g. restricted by taskset) are used
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        g_debug("[thread_pool] failed to get the processors of the process");
+        return;
+    }
+    pool->cpus = g_new0(int, MAX(CPU_COUNT(&allowed), 1));
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed)) {
+            pool->cpus[pool->num_cpus++] = cpu;
+        }
+    }
+#else
+    g_debug("[thread_pool] pinning threads isn't supported");
+#endif
+}
 
-    g_mutex_lock(&ctx->mutex);
-    if (ctx->thread_data) {
-        g_debug("[thread_pool] search data still there");
+static void
+thread_pool_worker_pin(FsearchThreadPoolWorker *worker) {
+#ifdef HAVE_SCHED_SETAFFINITY
+    FsearchThreadPool *pool = worker->pool;
+    if (pool->num_cpus < 2) {
+        return;
+    }
+    // consecutive processors usually share their caches and memory node
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(pool->cpus[(worker->idx + 1) % pool->num_cpus], &cpus);
+    if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0) {
+        g_debug("[thread_pool] failed to pin worker %d", worker->idx);
     }
+#endif
+}
 
-    // terminate thread
-    ctx->terminate = true;
-    g_cond_signal(&ctx->start_cond);
-    g_mutex_unlock(&ctx->mutex);
-    g_thread_join(g_steal_pointer(&ctx->thread));
+static gpointer
+thread_pool_worker_thread(gpointer user_data) {
+    FsearchThreadPoolWorker *worker = user_data;
+    FsearchThreadPool *pool = worker->pool;
+    g_private_set(&current_worker_key, worker);
+    if (pool->cpus) {
+        thread_pool_worker_pin(worker);
+    }
 
-    g_mutex_clear(&ctx->mutex);
-    g_cond_clear(&ctx->start_cond);
-    g_cond_clear(&ctx->finished_cond);
+    while (true) {
+        FsearchThreadPoolTask *task = thread_pool_take_task(pool, worker);
+        if (task) {
+            thread_pool_run_task(task);
+            continue;
+        }
 
-    g_clear_pointer(&ctx, g_free);
+        g_mutex_lock(&pool->sleep_mutex);
+        while (!pool->terminate && g_atomic_int_get(&pool->num_queued) <= 0) {
+            g_cond_wait(&pool->sleep_cond, &pool->sleep_mutex);
+        }
+        const bool terminate = pool->terminate;
+        g_mutex_unlock(&pool->sleep_mutex);
+        if (terminate) {
+            break;
+        }
+    }
+    return NULL;
 }
 
-static FsearchThreadPoolContext *
-thread_context_new(void) {
-    FsearchThreadPoolContext *ctx = g_new0(FsearchThreadPoolContext, 1);
-    g_assert(ctx);
+static void
+thread_pool_free(FsearchThreadPool *pool) {
+    g_mutex_lock(&pool->sleep_mutex);
+    pool->terminate = true;
+    g_cond_broadcast(&pool->sleep_cond);
+    g_mutex_unlock(&pool->sleep_mutex);
+
+    for (uint32_t i = 0; i < pool->num_workers; i++) {
+        FsearchThreadPoolWorker *worker = &pool->workers[i];
+        g_thread_join(g_steal_pointer(&worker->thread));
+        if (!g_queue_is_empty(&worker->tasks)) {
+            g_debug("[thread_pool] tasks still queued");
+        }
+        g_queue_clear(&worker->tasks);
+        g_mutex_clear(&worker->mutex);
+    }
+    g_clear_pointer(&pool->workers, g_free);
+    g_clear_pointer(&pool->cpus, g_free);
 
-    ctx->thread_data = NULL;
-    ctx->thread_func = NULL;
-    ctx->terminate = false;
-    ctx->status = THREAD_IDLE;
-    g_mutex_init(&ctx->mutex);
-    g_cond_init(&ctx->start_cond);
-    g_cond_init(&ctx->finished_cond);
+    g_queue_clear(&pool->queue);
+    g_mutex_clear(&pool->queue_mutex);
+    g_mutex_clear(&pool->sleep_mutex);
+    g_cond_clear(&pool->sleep_cond);
 
-    ctx->thread = g_thread_new("thread pool", fsearch_thread_pool_thread, ctx);
-    return ctx;
+    g_clear_pointer(&pool, g_free);
 }
 
 FsearchThreadPool *
-fsearch_thread_pool_init(void) {
+fsearch_thread_pool_new(uint32_t num_threads) {
+    return fsearch_thread_pool_new_full(num_threads, false);
+}
+
+FsearchThreadPool *
+fsearch_thread_pool_new_full(uint32_t num_threads, bool pin_threads) {
     FsearchThreadPool *pool = g_new0(FsearchThreadPool, 1);
-    pool->threads = NULL;
-    pool->num_threads = 0;
-
-    uint32_t num_cpus = MIN(g_get_num_processors(), FSEARCH_THREAD_LIMIT);
-    for (uint32_t i = 0; i < num_cpus; i++) {
-        FsearchThreadPoolContext *ctx = thread_context_new();
-        if (ctx) {
-            pool->threads = g_list_prepend(pool->threads, ctx);
-            pool->num_threads++;
+    g_assert(pool);
+
+    pool->num_threads = CLAMP(num_threads, 1, FSEARCH_THREAD_LIMIT);
+    g_mutex_init(&pool->queue_mutex);
+    g_queue_init(&pool->queue);
+    g_mutex_init(&pool->sleep_mutex);
+    g_cond_init(&pool->sleep_cond);
+    pool->ref_count = 1;
+    if (pin_threads) {
+        thread_pool_init_cpus(pool);
+    }
+
+    // the thread which waits for the tasks is the remaining one
+    pool->num_workers = pool->num_threads - 1;
+    pool->workers = g_new0(FsearchThreadPoolWorker, MAX(pool->num_workers, 1));
+    for (uint32_t i = 0; i < pool->num_workers; i++) {
+        FsearchThreadPoolWorker *worker = &pool->workers[i];
+        worker->pool = pool;
+        worker->idx = i;
+        g_mutex_init(&worker->mutex);
+        g_queue_init(&worker->tasks);
+    }
+    // all workers have to be set up before any of them tries to steal from the others
+    for (uint32_t i = 0; i < pool->num_workers; i++) {
+        pool->workers[i].thread = g_thread_new("thread pool", thread_pool_worker_thread, &pool->workers[i]);
+    }
+
+    return pool;
+}
+
+// Takes a reference of pool, unless its last one is already gone
+static bool
+thread_pool_try_ref(FsearchThreadPool *pool) {
+    gint ref_count = 0;
+    do {
+        ref_count = g_atomic_int_get(&pool->ref_count);
+        if (ref_count == 0) {
+            return false;
         }
+    } while (!g_atomic_int_compare_and_exchange(&pool->ref_count, ref_count, ref_count + 1));
+    return true;
+}
+
+FsearchThreadPool *
+fsearch_thread_pool_get_default(void) {
+    g_mutex_lock(&default_pool_mutex);
+    if (!default_pool || !thread_pool_try_ref(default_pool)) {
+        const uint32_t num_threads =
+            default_pool_num_threads ? default_pool_num_threads : MIN(g_get_num_processors(), FSEARCH_THREAD_LIMIT);
+        default_pool = fsearch_thread_pool_new_full(num_threads, default_pool_pin_threads);
+    }
+    FsearchThreadPool *pool = default_pool;
+    g_mutex_unlock(&default_pool_mutex);
+    return pool;
+}
+
+void
+fsearch_thread_pool_set_default_config(uint32_t num_threads, bool pin_threads) {
+    g_mutex_lock(&default_pool_mutex);
+    if (num_threads != default_pool_num_threads || pin_threads != default_pool_pin_threads) {
+        default_pool_num_threads = num_threads;
+        default_pool_pin_threads = pin_threads;
+        // the next one gets created with the new config
+        default_pool = NULL;
     }
+    g_mutex_unlock(&default_pool_mutex);
+}
 
+FsearchThreadPool *
+fsearch_thread_pool_ref(FsearchThreadPool *pool) {
+    g_return_val_if_fail(pool, NULL);
+    g_atomic_int_inc(&pool->ref_count);
     return pool;
 }
 
 void
-fsearch_thread_pool_free(FsearchThreadPool *pool) {
+fsearch_thread_pool_unref(FsearchThreadPool *pool) {
     g_return_if_fail(pool);
 
-    g_list_free_full(g_steal_pointer(&pool->threads), (GDestroyNotify)thread_context_free);
-    g_clear_pointer(&pool, g_free);
+    if (!g_atomic_int_dec_and_test(&pool->ref_count)) {
+        return;
+    }
+    g_mutex_lock(&default_pool_mutex);
+    if (default_pool == pool) {
+        default_pool = NULL;
+    }
+    g_mutex_unlock(&default_pool_mutex);
+    thread_pool_free(pool);
+}
+
+uint32_t
+fsearch_thread_pool_get_num_threads(FsearchThreadPool *pool) {
+    g_return_val_if_fail(pool, 0);
+    return pool->num_threads;
 }
 
-GList *
-fsearch_thread_pool_get_threads(FsearchThreadPool *pool) {
+FsearchTaskGroup *
+fsearch_task_group_new(FsearchThreadPool *pool, GCancellable *cancellable) {
     g_return_val_if_fail(pool, NULL);
-    return pool->threads;
+
+    FsearchTaskGroup *group = g_new0(FsearchTaskGroup, 1);
+    g_assert(group);
+
+    group->pool = pool;
+    group->cancellable = cancellable ? g_object_ref(cancellable) : NULL;
+    g_mutex_init(&group->mutex);
+    g_cond_init(&group->finished_cond);
+    return group;
 }
 
-gpointer
-fsearch_thread_pool_get_data(FsearchThreadPool *pool, GList *thread) {
-    if (!pool || !thread) {
-        return NULL;
-    }
-    if (!thread_pool_has_thread(pool, thread)) {
-        return NULL;
-    }
-    FsearchThreadPoolContext *ctx = thread->data;
-    if (!ctx) {
-        return NULL;
-    }
-    return ctx->thread_data;
+void
+fsearch_task_group_free(FsearchTaskGroup *group) {
+    g_return_if_fail(group);
+
+    fsearch_task_group_wait(group);
+
+    g_clear_object(&group->cancellable);
+    g_mutex_clear(&group->mutex);
+    g_cond_clear(&group->finished_cond);
+    g_clear_pointer(&group, g_free);
 }
 
-bool
-fsearch_thread_pool_task_is_idle(FsearchThreadPool *pool, GList *thread) {
-    bool res = false;
-    if (!thread_pool_has_thread(pool, thread)) {
-        return res;
+void
+fsearch_task_group_push(FsearchTaskGroup *group, FsearchThreadPoolFunc func, void *data) {
+    g_return_if_fail(group);
+    g_return_if_fail(func);
+
+    FsearchThreadPoolTask *task = g_new0(FsearchThreadPoolTask, 1);
+    g_assert(task);
+    task->func = func;
+    task->data = data;
+    task->group = group;
+
+    g_mutex_lock(&group->mutex);
+    group->num_pending++;
+    g_mutex_unlock(&group->mutex);
+
+    FsearchThreadPool *pool = group->pool;
+    FsearchThreadPoolWorker *self = thread_pool_get_current_worker(pool);
+    if (self) {
+        g_mutex_lock(&self->mutex);
+        g_queue_push_tail(&self->tasks, task);
+        g_mutex_unlock(&self->mutex);
     }
-    FsearchThreadPoolContext *ctx = thread->data;
-    if (!ctx) {
-        return res;
+    else {
+        g_mutex_lock(&pool->queue_mutex);
+        g_queue_push_tail(&pool->queue, task);
+        g_mutex_unlock(&pool->queue_mutex);
     }
 
-    res = ctx->status == THREAD_IDLE ? true : false;
-
-    return res;
+    // the workers check the number of queued tasks with the sleep mutex held, so none of them misses this
+    g_atomic_int_inc(&pool->num_queued);
+    g_mutex_lock(&pool->sleep_mutex);
+    g_cond_signal(&pool->sleep_cond);
+    g_mutex_unlock(&pool->sleep_mutex);
 }
 
 bool
-fsearch_thread_pool_task_is_busy(FsearchThreadPool *pool, GList *thread) {
-    bool res = false;
-    if (!thread_pool_has_thread(pool, thread)) {
-        return res;
-    }
-    FsearchThreadPoolContext *ctx = thread->data;
-    if (!ctx) {
-        return res;
-    }
+fsearch_task_group_wait(FsearchTaskGroup *group) {
+    g_return_val_if_fail(group, false);
+
+    FsearchThreadPool *pool = group->pool;
+    FsearchThreadPoolWorker *self = thread_pool_get_current_worker(pool);
+    while (true) {
+        g_mutex_lock(&group->mutex);
+        const bool finished = group->num_pending == 0;
+        g_mutex_unlock(&group->mutex);
+        if (finished) {
+            break;
+        }
+
+        // help with the queued tasks, which might be the ones of this group or the ones they depend on
+        FsearchThreadPoolTask *task = thread_pool_take_task(pool, self);
+        if (task) {
+            thread_pool_run_task(task);
+            continue;
+        }
 
-    res = ctx->status == THREAD_BUSY ? true : false;
+        // the remaining tasks are running on other threads, but those can still push new tasks
+        g_mutex_lock(&group->mutex);
+        if (group->num_pending > 0 && g_atomic_int_get(&pool->num_queued) <= 0) {
+            g_cond_wait_until(&group->finished_cond,
+                              &group->mutex,
+                              g_get_monotonic_time() + THREAD_POOL_WAIT_INTERVAL);
+        }
+        g_mutex_unlock(&group->mutex);
+    }
 
-    return res;
+    return !group->cancellable || !g_cancellable_is_cancelled(group->cancellable);
 }
 
-bool
-fsearch_thread_pool_wait_for_thread(FsearchThreadPool *pool, GList *thread) {
-    FsearchThreadPoolContext *ctx = thread->data;
-    g_mutex_lock(&ctx->mutex);
-    while (fsearch_thread_pool_task_is_busy(pool, thread)) {
-        g_debug("[thread_pool] busy, waiting...");
-        g_cond_wait(&ctx->finished_cond, &ctx->mutex);
-        g_debug("[thread_pool] continue...");
-    }
-    g_mutex_unlock(&ctx->mutex);
-    return true;
+void
+fsearch_thread_pool_run(FsearchThreadPool *pool, uint32_t num_tasks, FsearchThreadPoolFunc func, void *data) {
+    g_return_if_fail(func);
+
+    if (!pool || num_tasks <= 1) {
+        func(data);
+        return;
+    }
+    FsearchTaskGroup *group = fsearch_task_group_new(pool, NULL);
+    for (uint32_t i = 0; i < num_tasks; i++) {
+        fsearch_task_group_push(group, func, data);
+    }
+    g_clear_pointer(&group, fsearch_task_group_free);
 }
 
-uint32_t
-fsearch_thread_pool_get_num_threads(FsearchThreadPool *pool) {
-    g_return_val_if_fail(pool, 0);
-    return pool->num_threads;
+static void
+thread_pool_run_range(void *data) {
+    FsearchThreadPoolRange *range = data;
+    range->func(range->start, range->end, range->data);
 }
 
 bool
-fsearch_thread_pool_push_data(FsearchThreadPool *pool,
-                              GList *thread,
-                              FsearchThreadPoolFunc thread_func,
-                              gpointer thread_data) {
-    if (!pool || !thread || !thread_func || !thread_data) {
-        return false;
-    }
-    if (!thread_pool_has_thread(pool, thread)) {
-        return false;
-    }
-    FsearchThreadPoolContext *ctx = thread->data;
-    g_mutex_lock(&ctx->mutex);
-    ctx->thread_func = thread_func;
-    ctx->thread_data = thread_data;
-    ctx->status = THREAD_BUSY;
-
-    g_cond_signal(&ctx->start_cond);
-    g_mutex_unlock(&ctx->mutex);
-    return true;
+fsearch_thread_pool_parallel_for(FsearchThreadPool *pool,
+                                 uint32_t num_items,
+                                 uint32_t min_range_size,
+                                 FsearchThreadPoolRangeFunc func,
+                                 void *data,
+                                 GCancellable *cancellable) {
+    g_return_val_if_fail(func, false);
+
+    const uint32_t num_threads = pool ? pool->num_threads : 1;
+    const uint32_t max_ranges = num_threads > 1 ? num_threads * THREAD_POOL_RANGES_PER_THREAD : 1;
+    const uint32_t num_ranges = CLAMP(num_items / MAX(min_range_size, 1), 1, max_ranges);
+    if (num_ranges == 1 || num_items < num_ranges) {
+        if (num_items > 0 && !g_cancellable_is_cancelled(cancellable)) {
+            func(0, num_items, data);
+        }
+        return !g_cancellable_is_cancelled(cancellable);
+    }
+
+    FsearchThreadPoolRange *ranges = g_new0(FsearchThreadPoolRange, num_ranges);
+    g_assert(ranges);
+    FsearchTaskGroup *group = fsearch_task_group_new(pool, cancellable);
+    for (uint32_t i = 0; i < num_ranges; i++) {
+        ranges[i].func = func;
+        ranges[i].data = data;
+        ranges[i].start = (uint32_t)((uint64_t)num_items * i / num_ranges);
+        ranges[i].end = (uint32_t)((uint64_t)num_items * (i + 1) / num_ranges);
+        fsearch_task_group_push(group, thread_pool_run_range, &ranges[i]);
+    }
+    const bool finished = fsearch_task_group_wait(group);
+    g_clear_pointer(&group, fsearch_task_group_free);
+    g_clear_pointer(&ranges, g_free);
+
+    return finished;
 }
@@ -18,45 +18,76 @@
 
 #pragma once
 
+#include <gio/gio.h>
 #include <glib.h>
 #include <stdbool.h>
 #include <stdint.h>
 
 typedef struct FsearchThreadPool FsearchThreadPool;
+typedef struct FsearchTaskGroup FsearchTaskGroup;
+
 typedef void (*FsearchThreadPoolFunc)(void *data);
-;
+// Gets called with the items [start, end) of a parallel for
+typedef void (*FsearchThreadPoolRangeFunc)(uint32_t start, uint32_t end, void *data);
+
+// Creates a pool which runs up to num_threads tasks at once. Threads which wait for their tasks take part in running
+// them, so the pool only starts num_threads - 1 threads of its own.
+FsearchThreadPool *
+fsearch_thread_pool_new(uint32_t num_threads);
 
-typedef enum FsearchThreadStatus { THREAD_IDLE, THREAD_BUSY, THREAD_FINISHED } FsearchThreadStatus;
+// Like fsearch_thread_pool_new, but the threads of the pool can be pinned to one processor each. That keeps them close
+// to their caches and the memory they touched first, where the system supports it.
+FsearchThreadPool *
+fsearch_thread_pool_new_full(uint32_t num_threads, bool pin_threads);
 
+// Returns a new reference to the pool which is shared by everything that runs in parallel, by default it has a thread
+// for every processor. The pool gets created when it's needed and freed with its last reference.
 FsearchThreadPool *
-fsearch_thread_pool_init(void);
+fsearch_thread_pool_get_default(void);
 
+// Sets the number of threads of the default pool (0 uses one per processor) and whether they're pinned. A default
+// pool with a different config keeps working for those who hold a reference to it, the next one uses the new config.
 void
-fsearch_thread_pool_free(FsearchThreadPool *pool);
+fsearch_thread_pool_set_default_config(uint32_t num_threads, bool pin_threads);
 
-GList *
-fsearch_thread_pool_get_threads(FsearchThreadPool *pool);
+FsearchThreadPool *
+fsearch_thread_pool_ref(FsearchThreadPool *pool);
+
+void
+fsearch_thread_pool_unref(FsearchThreadPool *pool);
 
 uint32_t
 fsearch_thread_pool_get_num_threads(FsearchThreadPool *pool);
 
-bool
-fsearch_thread_pool_push_data(FsearchThreadPool *pool,
-                              GList *thread,
-                              FsearchThreadPoolFunc thread_func,
-                              gpointer thread_data);
-
-bool
-fsearch_thread_pool_wait_for_thread(FsearchThreadPool *pool, GList *thread);
-
-bool
-fsearch_thread_pool_task_is_busy(FsearchThreadPool *pool, GList *thread);
+// Runs func with data on num_tasks threads at once and returns when all of them are done. The tasks usually take
+// their share of the work from data until there's nothing left.
+void
+fsearch_thread_pool_run(FsearchThreadPool *pool, uint32_t num_tasks, FsearchThreadPoolFunc func, void *data);
 
+// Splits the items [0, num_items) into ranges of at least min_range_size items and runs func on them in parallel.
+// There are a few more ranges than threads, so threads which are done early take over the work of slower ones.
+// Returns false if cancellable got cancelled, the ranges which haven't started by then are skipped.
 bool
-fsearch_thread_pool_task_is_idle(FsearchThreadPool *pool, GList *thread);
+fsearch_thread_pool_parallel_for(FsearchThreadPool *pool,
+                                 uint32_t num_items,
+                                 uint32_t min_range_size,
+                                 FsearchThreadPoolRangeFunc func,
+                                 void *data,
+                                 GCancellable *cancellable);
+
+// Creates a group of tasks which are waited for together. Once cancellable got cancelled, the tasks of the group
+// which haven't started yet are skipped.
+FsearchTaskGroup *
+fsearch_task_group_new(FsearchThreadPool *pool, GCancellable *cancellable);
+
+// Waits for the tasks of the group and frees it
+void
+fsearch_task_group_free(FsearchTaskGroup *group);
 
-gpointer
-fsearch_thread_pool_get_data(FsearchThreadPool *pool, GList *thread);
+// Queues func with data in the group. Tasks can push more tasks, which are preferably run by the same thread.
+void
+fsearch_task_group_push(FsearchTaskGroup *group, FsearchThreadPoolFunc func, void *data);
 
+// Runs queued tasks until all tasks of the group are done. Returns false if the group was cancelled.
 bool
-fsearch_thread_pool_set_task_finished(FsearchThreadPool *pool, GList *thread);
+fsearch_task_group_wait(FsearchTaskGroup *group);
@@ -0,0 +1,31 @@
+#pragma once
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+// Static probes (USDT) in the provider "fsearch", built with -Dtracepoints=true. perf and bpftrace can attach to
+// them, e.g. `bpftrace -l 'usdt:/usr/bin/fsearch:fsearch:*'`. Without the option they expand to nothing and their
+// arguments aren't evaluated, so they mustn't have side effects.
+//
+// The probes come in pairs of *_start and *_end:
+// - query_compile: the search term, then the search term and the time it took in µs
+// - search_chunk (db_search_worker): the chunk, then the chunk and the number of entries matched against the query
+// - db_sort: whether the folders or the files get sorted and their number, then the same flag and whether the sort
+//   was cancelled
+// - view_sort (db_view_sort_task): the sort order, then the sort order and whether the sort was cancelled
+// - scan_directory: the path, then the path and the result of the walk
+// - db_load, db_save: the path, then the path and whether it succeeded
+// - db_load_section, db_save_section: the id of the section, then the id and its size (the number of entries when
+//   loading)
+// - task_dispatch: the id of the task (see fsearch_task_ids.h), then the id and whether it has to run again
+
+#ifdef HAVE_TRACEPOINTS
+#include <sys/sdt.h>
+
+#define FSEARCH_TRACE1(name, a) DTRACE_PROBE1(fsearch, name, a)
+#define FSEARCH_TRACE2(name, a, b) DTRACE_PROBE2(fsearch, name, a, b)
+#else
+#define FSEARCH_TRACE1(name, a) ((void)0)
+#define FSEARCH_TRACE2(name, a, b) ((void)0)
+#endif
@@ -7,18 +7,24 @@
 
 #include <unicode/ustring.h>
 
+uint32_t
+fsearch_utf_get_fold_options(void) {
+    const char *current_locale = setlocale(LC_CTYPE, NULL);
+    if (current_locale && (!strncmp(current_locale, "tr", 2) || !strncmp(current_locale, "az", 2))) {
+        // Use special case mapping for Turkic languages
+        return U_FOLD_CASE_EXCLUDE_SPECIAL_I;
+    }
+    return U_FOLD_CASE_DEFAULT;
+}
+
 void
 fsearch_utf_builder_init(FsearchUtfBuilder *builder, int32_t num_characters) {
     g_return_if_fail(builder);
 
     builder->initialized = true;
 
-    builder->fold_options = U_FOLD_CASE_DEFAULT;
+    builder->fold_options = fsearch_utf_get_fold_options();
     const char *current_locale = setlocale(LC_CTYPE, NULL);
-    if (current_locale && (!strncmp(current_locale, "tr", 2) || !strncmp(current_locale, "az", 2))) {
-        // Use special case mapping for Turkic languages
-        builder->fold_options = U_FOLD_CASE_EXCLUDE_SPECIAL_I;
-    }
 
     UErrorCode status = U_ZERO_ERROR;
     builder->case_map = ucasemap_open(current_locale, builder->fold_options, &status);
@@ -51,6 +57,18 @@ fsearch_utf_builder_clear(FsearchUtfBuilder *builder) {
     g_clear_pointer(&builder->string_normalized_folded, free);
 }
 
+size_t
+fsearch_utf_builder_get_memory_size(const FsearchUtfBuilder *builder) {
+    if (!builder || !builder->initialized) {
+        return 0;
+    }
+    size_t size = (size_t)builder->num_characters * (sizeof(char) + 2 * sizeof(UChar));
+    if (builder->string) {
+        size += strlen(builder->string) + 1;
+    }
+    return size;
+}
+
 bool
 fsearch_utf_fold_case_utf8(UCaseMap *case_map, FsearchUtfBuilder *builder, const char *string) {
     if (!builder || !builder->initialized) {
@@ -81,6 +99,7 @@ fsearch_utf_builder_normalize_and_fold_case(FsearchUtfBuilder *builder,
 
     UErrorCode status = U_ZERO_ERROR;
 
+    g_free(builder->string);
     builder->string = g_strdup(string);
     // first perform case folding (this can be done while our string is still in UTF8 form)
     builder->string_utf8_folded_len =
@@ -145,3 +164,25 @@ fail:
     builder->string_utf8_is_folded = false;
     return false;
 }
+
+int32_t
+fsearch_utf_builder_get_normalized_folded_utf8(FsearchUtfBuilder *builder, char *dest, int32_t dest_size) {
+    g_assert(builder);
+    g_assert(dest);
+    if (!builder->string_is_folded_and_normalized) {
+        return -1;
+    }
+
+    UErrorCode status = U_ZERO_ERROR;
+    int32_t len = 0;
+    u_strToUTF8(dest,
+                dest_size,
+                &len,
+                builder->string_normalized_folded,
+                builder->string_normalized_folded_len,
+                &status);
+    if (G_UNLIKELY(U_FAILURE(status)) || len >= dest_size) {
+        return -1;
+    }
+    return len;
+}
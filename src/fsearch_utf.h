@@ -26,15 +26,28 @@ typedef struct FsearchUtfBuilder {
     bool string_utf8_is_folded;
 } FsearchUtfBuilder;
 
+// The case folding options for the current locale
+uint32_t
+fsearch_utf_get_fold_options(void);
+
 void
 fsearch_utf_builder_init(FsearchUtfBuilder *builder, int32_t num_characters);
 
 void
 fsearch_utf_builder_clear(FsearchUtfBuilder *builder);
 
+// The number of bytes allocated for the buffers of builder
+size_t
+fsearch_utf_builder_get_memory_size(const FsearchUtfBuilder *builder);
+
 bool
 fsearch_utf_fold_case_utf8(UCaseMap *case_map, FsearchUtfBuilder *builder, const char *string);
 
 bool
 fsearch_utf_builder_normalize_and_fold_case(FsearchUtfBuilder *builder,
                                             const char *string);
+
+// Converts the result of fsearch_utf_builder_normalize_and_fold_case back to UTF8 and stores it NUL terminated in
+// dest. Returns its length, or -1 if there's no result or it doesn't fit.
+int32_t
+fsearch_utf_builder_get_normalized_folded_utf8(FsearchUtfBuilder *builder, char *dest, int32_t dest_size);
@@ -51,6 +51,7 @@ struct _FsearchApplicationWindow {
     GtkWidget *overlay_database_empty;
     GtkWidget *overlay_database_loading;
     GtkWidget *overlay_database_updating;
+    GtkWidget *overlay_duplicates_pending;
     GtkWidget *overlay_query_empty;
     GtkWidget *overlay_results_empty;
     GtkWidget *overlay_results_sorting;
@@ -68,13 +69,36 @@ struct _FsearchApplicationWindow {
     char *active_filter_name;
 
     FsearchResultView *result_view;
+
+    // searches which take longer than the time between two keystrokes only start once the user stops typing
+    guint search_timeout_id;
+    gint64 last_search_input_time;
+    // the moving average of the time between two changes of the query text in ms, 0 if not known yet
+    double typing_interval;
+
+    // updates the performance statistics in the statusbar while they're shown
+    guint performance_stats_timeout_id;
+    // when the query text changed last, until the results for it are shown, 0 otherwise
+    gint64 pending_input_time;
+    // the times of the database view which were added to the performance statistics already
+    FsearchDatabaseViewTimes recorded_view_times;
 };
 
+// Searches which are expected to take less than this many ms always start with every keystroke
+#define SEARCH_DURATION_IMMEDIATE 15.0
+// Pauses between changes of the query text which are longer than this many ms don't count as typing
+#define MAX_TYPING_INTERVAL 1000.0
+// A delayed search starts at most this many ms after the last keystroke
+#define MAX_SEARCH_DELAY 300.0
+// How often the performance statistics in the statusbar get updated in ms
+#define PERFORMANCE_STATS_UPDATE_INTERVAL 500
+
 typedef enum {
     OVERLAY_DATABASE,
     OVERLAY_DATABASE_EMPTY,
     OVERLAY_DATABASE_LOADING,
     OVERLAY_DATABASE_UPDATING,
+    OVERLAY_DUPLICATES_PENDING,
     OVERLAY_QUERY_EMPTY,
     OVERLAY_RESULTS,
     OVERLAY_RESULTS_EMPTY,
@@ -260,6 +284,7 @@ fsearch_window_apply_config(FsearchApplicationWindow *self) {
     }
     fsearch_application_window_apply_search_revealer_config(self);
     fsearch_application_window_apply_statusbar_revealer_config(self);
+    fsearch_application_window_apply_performance_stats_config(self);
     apply_filter_config(self);
 
     fsearch_window_set_overlay_for_database_state(self);
@@ -297,6 +322,14 @@ fsearch_application_window_finalize(GObject *object) {
     FsearchApplicationWindow *self = (FsearchApplicationWindow *)object;
     g_assert(FSEARCH_IS_APPLICATION_WINDOW(self));
 
+    if (self->search_timeout_id) {
+        g_source_remove(self->search_timeout_id);
+        self->search_timeout_id = 0;
+    }
+    if (self->performance_stats_timeout_id) {
+        g_source_remove(self->performance_stats_timeout_id);
+        self->performance_stats_timeout_id = 0;
+    }
     g_clear_pointer(&self->active_filter_name, free);
     g_clear_pointer(&self->result_view->database_view, db_view_unref);
     g_clear_pointer(&self->result_view, fsearch_result_view_free);
@@ -325,6 +358,9 @@ show_overlay(FsearchApplicationWindow *win, FsearchOverlay overlay) {
     case OVERLAY_QUERY_EMPTY:
         gtk_stack_set_visible_child(GTK_STACK(win->main_search_overlay_stack), win->overlay_query_empty);
         break;
+    case OVERLAY_DUPLICATES_PENDING:
+        gtk_stack_set_visible_child(GTK_STACK(win->main_search_overlay_stack), win->overlay_duplicates_pending);
+        break;
     case OVERLAY_DATABASE_LOADING:
         gtk_stack_set_visible_child(GTK_STACK(win->main_database_overlay_stack), win->overlay_database_loading);
         break;
@@ -337,15 +373,45 @@ show_overlay(FsearchApplicationWindow *win, FsearchOverlay overlay) {
     }
 }
 
+// Adds the searches and sorts which finished since the last call to the performance statistics, and how long it took
+// until the results for the current query text were shown
+static void
+record_performance_stats(FsearchApplicationWindow *win,
+                         FsearchDatabaseViewTimes *times,
+                         FsearchQueryStats *query_stats,
+                         FsearchQuery *query) {
+    FsearchPerformanceStats *stats = &win->result_view->performance_stats;
+    if (times->num_searches != win->recorded_view_times.num_searches) {
+        fsearch_performance_stats_add_timing(stats, FSEARCH_PERFORMANCE_TIMING_SEARCH, times->search);
+        fsearch_performance_stats_add_timing(stats, FSEARCH_PERFORMANCE_TIMING_MERGE, query_stats->merge_time);
+    }
+    if (times->num_sorts != win->recorded_view_times.num_sorts) {
+        fsearch_performance_stats_add_timing(stats, FSEARCH_PERFORMANCE_TIMING_SORT, times->sort);
+    }
+    win->recorded_view_times = *times;
+
+    if (win->pending_input_time > 0 && query && g_strcmp0(query->search_term, get_query_text(win)) == 0) {
+        const double latency = (double)(g_get_monotonic_time() - win->pending_input_time) / 1000;
+        fsearch_performance_stats_add_timing(stats, FSEARCH_PERFORMANCE_TIMING_INPUT_LATENCY, latency);
+        win->pending_input_time = 0;
+    }
+}
+
 static void
 fsearch_window_db_view_apply_changes(FsearchApplicationWindow *win) {
     db_view_lock(win->result_view->database_view);
     const uint32_t num_rows = is_empty_search(win) ? 0 : db_view_get_num_entries(win->result_view->database_view);
 
+    FsearchDatabaseViewTimes times = {};
+    db_view_get_times(win->result_view->database_view, &times);
+    FsearchQueryStats query_stats = {};
+    db_view_get_query_stats(win->result_view->database_view, &query_stats);
+
     win->result_view->sort_order = db_view_get_sort_order(win->result_view->database_view);
     win->result_view->sort_type = db_view_get_sort_type(win->result_view->database_view);
 
     FsearchQuery *query = db_view_get_query(win->result_view->database_view);
+    record_performance_stats(win, &times, &query_stats, query);
     if (query) {
         fsearch_statusbar_set_revealer_visibility(FSEARCH_STATUSBAR(win->statusbar),
                                                   FSEARCH_STATUSBAR_REVEALER_SMART_MATCH_CASE,
@@ -390,6 +456,18 @@ fsearch_window_db_view_sort_started_cb(gpointer data) {
     return G_SOURCE_REMOVE;
 }
 
+static gboolean
+fsearch_window_db_view_sort_progress_cb(gpointer data) {
+    const guint win_id = GPOINTER_TO_UINT(data);
+    FsearchApplicationWindow *win = get_window_for_id(win_id);
+    if (win && win->result_view && win->result_view->database_view) {
+        fsearch_statusbar_set_sort_progress(FSEARCH_STATUSBAR(win->statusbar),
+                                            db_view_get_sort_progress(win->result_view->database_view));
+    }
+
+    return G_SOURCE_REMOVE;
+}
+
 static gboolean
 fsearch_window_db_view_search_finished_cb(gpointer data) {
     const guint win_id = GPOINTER_TO_UINT(data);
@@ -418,10 +496,57 @@ perform_search(FsearchApplicationWindow *win) {
         return;
     }
 
+    if (win->search_timeout_id) {
+        g_source_remove(win->search_timeout_id);
+        win->search_timeout_id = 0;
+    }
     const gchar *text = get_query_text(win);
     db_view_set_query_text(win->result_view->database_view, text);
 }
 
+static gboolean
+delayed_search_cb(gpointer user_data) {
+    FsearchApplicationWindow *win = get_window_for_id(GPOINTER_TO_UINT(user_data));
+    if (win) {
+        win->search_timeout_id = 0;
+        perform_search(win);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+// Starts searches right away while they're faster than the user types. Slower ones would only be cancelled by the
+// next keystroke, so they're delayed until the user stops typing.
+static void
+perform_search_as_you_type(FsearchApplicationWindow *win) {
+    if (!win || !win->result_view->database_view) {
+        return;
+    }
+
+    const gint64 now = g_get_monotonic_time();
+    const double interval = (double)(now - win->last_search_input_time) / 1000;
+    if (win->last_search_input_time > 0 && interval < MAX_TYPING_INTERVAL) {
+        win->typing_interval = win->typing_interval > 0 ? 0.7 * win->typing_interval + 0.3 * interval : interval;
+    }
+    win->last_search_input_time = now;
+
+    const double expected_duration =
+        db_view_get_expected_search_duration(win->result_view->database_view, get_query_text(win));
+    if (expected_duration < SEARCH_DURATION_IMMEDIATE || win->typing_interval <= 0
+        || expected_duration < win->typing_interval) {
+        perform_search(win);
+        return;
+    }
+
+    if (win->search_timeout_id) {
+        g_source_remove(win->search_timeout_id);
+    }
+    const guint delay = (guint)MIN(1.5 * win->typing_interval, MAX_SEARCH_DELAY);
+    win->search_timeout_id = g_timeout_add(
+        delay,
+        delayed_search_cb,
+        GUINT_TO_POINTER(gtk_application_window_get_id(GTK_APPLICATION_WINDOW(win))));
+}
+
 typedef struct {
     uint32_t num_folders;
     uint32_t num_files;
@@ -542,8 +667,9 @@ on_search_entry_changed(GtkEntry *entry, gpointer user_data) {
 
     FsearchConfig *config = fsearch_application_get_config(FSEARCH_APPLICATION_DEFAULT);
 
+    win->pending_input_time = g_get_monotonic_time();
     if (config->search_as_you_type) {
-        perform_search(win);
+        perform_search_as_you_type(win);
     }
 }
 
@@ -597,6 +723,13 @@ fsearch_list_view_draw_row(cairo_t *cr,
                                  right_to_left_text);
 }
 
+static void
+on_listview_drawn(double duration, gpointer user_data) {
+    FsearchApplicationWindow *win = FSEARCH_APPLICATION_WINDOW(user_data);
+    FsearchPerformanceStats *stats = &win->result_view->performance_stats;
+    fsearch_performance_stats_add_timing(stats, FSEARCH_PERFORMANCE_TIMING_FRAME, duration);
+}
+
 static void
 fsearch_results_sort_func(int sort_order, GtkSortType sort_type, gpointer user_data) {
     FsearchApplicationWindow *win = FSEARCH_APPLICATION_WINDOW(user_data);
@@ -738,6 +871,9 @@ fsearch_application_window_init_overlays(FsearchApplicationWindow *win) {
     // Overlay when no search results are found
     win->overlay_results_empty = GTK_WIDGET(gtk_builder_get_object(builder, "overlay_results_empty"));
 
+    // Overlay when the duplicates a search needs are still being looked for
+    win->overlay_duplicates_pending = GTK_WIDGET(gtk_builder_get_object(builder, "overlay_duplicates_pending"));
+
     // Overlay when database is empty
     win->overlay_database_empty = GTK_WIDGET(gtk_builder_get_object(builder, "overlay_database_empty"));
 
@@ -776,6 +912,7 @@ fsearch_application_window_init_listview(FsearchApplicationWindow *win) {
     gtk_widget_show((GTK_WIDGET(list_view)));
     fsearch_list_view_set_query_tooltip_func(list_view, fsearch_list_view_query_tooltip, win);
     fsearch_list_view_set_draw_row_func(list_view, fsearch_list_view_draw_row, win);
+    fsearch_list_view_set_drawn_func(list_view, on_listview_drawn, win);
     fsearch_list_view_set_sort_func(list_view, fsearch_results_sort_func, win);
     fsearch_list_view_set_selection_handlers(list_view,
                                              on_listview_row_is_selected,
@@ -967,12 +1104,17 @@ fsearch_window_db_view_content_changed_cb(gpointer data) {
 
     db_view_lock(win->result_view->database_view);
     const uint32_t num_rows = is_empty_search(win) ? 0 : db_view_get_num_entries(win->result_view->database_view);
+    const bool duplicates_pending = db_view_get_duplicates_pending(win->result_view->database_view);
     db_view_unlock(win->result_view->database_view);
 
     if (is_empty_search(win)) {
         show_overlay(win, OVERLAY_QUERY_EMPTY);
         gtk_widget_show(win->main_search_overlay_stack);
     }
+    else if (duplicates_pending) {
+        show_overlay(win, OVERLAY_DUPLICATES_PENDING);
+        gtk_widget_show(win->main_search_overlay_stack);
+    }
     else if (num_rows == 0) {
         show_overlay(win, OVERLAY_RESULTS_EMPTY);
         gtk_widget_show(win->main_search_overlay_stack);
@@ -1004,6 +1146,9 @@ fsearch_window_db_view_notify(FsearchDatabaseView *view, FsearchDatabaseViewNoti
     case DATABASE_VIEW_NOTIFY_SORT_STARTED:
         g_idle_add(fsearch_window_db_view_sort_started_cb, user_data);
         break;
+    case DATABASE_VIEW_NOTIFY_SORT_PROGRESS:
+        g_idle_add(fsearch_window_db_view_sort_progress_cb, user_data);
+        break;
     case DATABASE_VIEW_NOTIFY_SORT_FINISHED:
         g_idle_add(fsearch_window_db_view_sort_finished_cb, user_data);
         break;
@@ -1043,6 +1188,37 @@ fsearch_application_window_class_init(FsearchApplicationWindowClass *klass) {
     gtk_widget_class_bind_template_callback(widget_class, on_search_entry_key_press_event);
 }
 
+static gboolean
+update_performance_stats_cb(gpointer user_data) {
+    FsearchApplicationWindow *win = get_window_for_id(GPOINTER_TO_UINT(user_data));
+    if (!win) {
+        return G_SOURCE_REMOVE;
+    }
+    g_autoptr(GString) text = fsearch_performance_stats_to_string(&win->result_view->performance_stats);
+    fsearch_statusbar_set_performance_stats(FSEARCH_STATUSBAR(win->statusbar), text->str);
+    return G_SOURCE_CONTINUE;
+}
+
+void
+fsearch_application_window_apply_performance_stats_config(FsearchApplicationWindow *win) {
+    FsearchConfig *config = fsearch_application_get_config(FSEARCH_APPLICATION_DEFAULT);
+    if (!config->show_performance_stats) {
+        if (win->performance_stats_timeout_id) {
+            g_source_remove(win->performance_stats_timeout_id);
+            win->performance_stats_timeout_id = 0;
+        }
+        fsearch_statusbar_set_performance_stats(FSEARCH_STATUSBAR(win->statusbar), NULL);
+        return;
+    }
+    if (win->performance_stats_timeout_id) {
+        return;
+    }
+    const guint win_id = gtk_application_window_get_id(GTK_APPLICATION_WINDOW(win));
+    update_performance_stats_cb(GUINT_TO_POINTER(win_id));
+    win->performance_stats_timeout_id =
+        g_timeout_add(PERFORMANCE_STATS_UPDATE_INTERVAL, update_performance_stats_cb, GUINT_TO_POINTER(win_id));
+}
+
 void
 fsearch_application_window_apply_statusbar_revealer_config(FsearchApplicationWindow *win) {
     FsearchApplication *app = FSEARCH_APPLICATION_DEFAULT;
@@ -1312,6 +1488,16 @@ fsearch_application_window_selection_for_each(FsearchApplicationWindow *self, GH
     }
 }
 
+DynamicArray *
+fsearch_application_window_get_selected_entries(FsearchApplicationWindow *self, FsearchDatabase **db) {
+    g_assert(FSEARCH_IS_APPLICATION_WINDOW(self));
+    *db = NULL;
+    if (!self->result_view->database_view) {
+        return NULL;
+    }
+    return db_view_get_selected_entries(self->result_view->database_view, db);
+}
+
 void
 fsearch_application_window_focus_search_entry(FsearchApplicationWindow *win) {
     g_assert(FSEARCH_IS_APPLICATION_WINDOW(win));
@@ -1319,6 +1505,17 @@ fsearch_application_window_focus_search_entry(FsearchApplicationWindow *win) {
     gtk_widget_grab_focus(win->search_entry);
 }
 
+void
+fsearch_application_window_find_duplicates(FsearchApplicationWindow *win) {
+    g_assert(FSEARCH_IS_APPLICATION_WINDOW(win));
+    // the largest duplicates come first, they take up the most space
+    if (win->result_view->database_view) {
+        db_view_set_sort_order(win->result_view->database_view, DATABASE_INDEX_TYPE_SIZE, GTK_SORT_DESCENDING);
+    }
+    gtk_entry_set_text(GTK_ENTRY(win->search_entry), "dupe:");
+    gtk_widget_grab_focus(win->search_entry);
+}
+
 GtkEntry *
 fsearch_application_window_get_search_entry(FsearchApplicationWindow *self) {
     g_assert(FSEARCH_IS_APPLICATION_WINDOW(self));
@@ -1382,6 +1579,14 @@ fsearch_application_window_get_listview(FsearchApplicationWindow *self) {
     return self->result_view->list_view;
 }
 
+void
+fsearch_application_window_get_memory_stats(FsearchApplicationWindow *self, FsearchDatabaseMemoryStats *stats) {
+    g_assert(FSEARCH_IS_APPLICATION_WINDOW(self));
+    if (self->result_view) {
+        fsearch_result_view_get_memory_stats(self->result_view, stats);
+    }
+}
+
 FsearchApplicationWindow *
 fsearch_application_window_new(FsearchApplication *app) {
     g_assert(FSEARCH_IS_APPLICATION(app));
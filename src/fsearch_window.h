@@ -43,15 +43,27 @@ fsearch_application_window_prepare_shutdown(gpointer self);
 FsearchListView *
 fsearch_application_window_get_listview(FsearchApplicationWindow *self);
 
+// Adds the memory used by the results, selection and caches of the window to stats
+void
+fsearch_application_window_get_memory_stats(FsearchApplicationWindow *self, FsearchDatabaseMemoryStats *stats);
+
 void
 fsearch_application_window_update_listview_config(FsearchApplicationWindow *self);
 
 void
 fsearch_application_window_apply_statusbar_revealer_config(FsearchApplicationWindow *win);
 
+// Shows or hides the performance statistics in the statusbar
+void
+fsearch_application_window_apply_performance_stats_config(FsearchApplicationWindow *win);
+
 void
 fsearch_application_window_focus_search_entry(FsearchApplicationWindow *win);
 
+// Searches for the files with the same contents as other files, the largest ones first
+void
+fsearch_application_window_find_duplicates(FsearchApplicationWindow *win);
+
 GtkEntry *
 fsearch_application_window_get_search_entry(FsearchApplicationWindow *self);
 
@@ -103,6 +115,10 @@ fsearch_application_window_get_num_selected(FsearchApplicationWindow *self);
 void
 fsearch_application_window_selection_for_each(FsearchApplicationWindow *self, GHFunc func, gpointer user_data);
 
+// See db_view_get_selected_entries, NULL if there are no results
+DynamicArray *
+fsearch_application_window_get_selected_entries(FsearchApplicationWindow *self, FsearchDatabase **db);
+
 void
 fsearch_application_window_toggle_app_menu(FsearchApplicationWindow *self);
 G_END_DECLS
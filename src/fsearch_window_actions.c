@@ -26,6 +26,7 @@
 
 #include <glib/gi18n.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <gdk/gdk.h>
 
 #ifdef GDK_WINDOWING_X11
@@ -34,7 +35,10 @@
 
 #include "fsearch_clipboard.h"
 #include "fsearch_config.h"
+#include "fsearch.h"
 #include "fsearch_database_entry.h"
+#include "fsearch_database_view.h"
+#include "fsearch_file_operation.h"
 #include "fsearch_file_utils.h"
 #include "fsearch_list_view.h"
 #include "fsearch_statusbar.h"
@@ -130,52 +134,170 @@ prepend_string_to_list(GList **string_list,
 }
 
 static void
-append_line(GString *str, const char *text) {
-    if (str->len > 0) {
-        g_string_append_c(str, '\n');
-    }
-    g_string_append(str, text);
+prepend_full_path_to_list(gpointer key, gpointer value, gpointer user_data) {
+    prepend_string_to_list(user_data, value, db_entry_get_path_full);
 }
 
+// The progress dialog of file operations gets updated that often, in ms
+#define FILE_OPERATION_PROGRESS_INTERVAL 100
+
+typedef struct {
+    FsearchApplicationWindow *window;
+    FsearchFileOperation *operation;
+    FsearchDatabase *db;
+    GCancellable *cancellable;
+    // NULL once it's destroyed, e.g. together with the window
+    GtkWidget *dialog;
+    GtkWidget *progress_bar;
+    guint progress_source_id;
+    volatile gint num_done;
+    bool database_changed;
+} FsearchFileOperationContext;
+
 static void
-append_line_to_string(GString *buffer, FsearchDatabaseEntry *entry, GString *(*get_string_func)(FsearchDatabaseEntry *)) {
-    if (!entry || !buffer || !get_string_func) {
-        return;
+file_operation_context_free(FsearchFileOperationContext *ctx) {
+    g_clear_handle_id(&ctx->progress_source_id, g_source_remove);
+    g_clear_pointer(&ctx->dialog, gtk_widget_destroy);
+    g_clear_pointer(&ctx->operation, fsearch_file_operation_free);
+    g_clear_pointer(&ctx->db, db_unref);
+    g_clear_object(&ctx->cancellable);
+    g_clear_object(&ctx->window);
+    g_clear_pointer(&ctx, free);
+}
+
+static void
+on_file_operation_progress(uint32_t num_done, uint32_t num_paths, gpointer user_data) {
+    FsearchFileOperationContext *ctx = user_data;
+    // the threads of the operation report their progress in any order
+    gint current = g_atomic_int_get(&ctx->num_done);
+    while ((uint32_t)current < num_done && !g_atomic_int_compare_and_exchange(&ctx->num_done, current, num_done)) {
+        current = g_atomic_int_get(&ctx->num_done);
     }
+}
 
-    g_autoptr(GString) string = get_string_func(entry);
-    if (!string) {
-        return;
+static gboolean
+on_file_operation_progress_timeout(gpointer user_data) {
+    FsearchFileOperationContext *ctx = user_data;
+    if (!ctx->dialog) {
+        return G_SOURCE_CONTINUE;
     }
-    append_line(buffer, string->str);
+    const uint32_t num_done = g_atomic_int_get(&ctx->num_done);
+    const uint32_t num_paths = fsearch_file_operation_get_num_paths(ctx->operation);
+    g_autofree char *text = g_strdup_printf(_("%u of %u"), num_done, num_paths);
+    const double fraction = num_paths > 0 ? (double)num_done / num_paths : 1.0;
+    gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(ctx->progress_bar), fraction);
+    gtk_progress_bar_set_text(GTK_PROGRESS_BAR(ctx->progress_bar), text);
+    return G_SOURCE_CONTINUE;
 }
 
 static void
-prepend_full_path_to_list(gpointer key, gpointer value, gpointer user_data) {
-    prepend_string_to_list(user_data, value, db_entry_get_path_full);
+on_file_operation_dialog_response(GtkDialog *dialog, gint response_id, gpointer user_data) {
+    FsearchFileOperationContext *ctx = user_data;
+    // the paths which are already being removed are finished
+    g_cancellable_cancel(ctx->cancellable);
+    gtk_dialog_set_response_sensitive(dialog, GTK_RESPONSE_CANCEL, FALSE);
 }
 
-static void
-append_full_path_to_string(gpointer key, gpointer value, gpointer user_data) {
-    append_line_to_string(user_data, value, db_entry_get_path_full);
+static gboolean
+on_file_operation_finished(gpointer user_data) {
+    FsearchFileOperationContext *ctx = user_data;
+    if (ctx->database_changed) {
+        db_foreach_view(ctx->db, (GFunc)db_view_notify_database_changed, NULL);
+    }
+    g_clear_pointer(&ctx->dialog, gtk_widget_destroy);
+
+    const bool delete = fsearch_file_operation_get_type(ctx->operation) == FSEARCH_FILE_OPERATION_DELETE;
+    const char *error_messages = fsearch_file_operation_get_error_messages(ctx->operation);
+    if (error_messages) {
+        ui_utils_run_gtk_dialog_async(GTK_WIDGET(ctx->window),
+                                      GTK_MESSAGE_WARNING,
+                                      GTK_BUTTONS_OK,
+                                      _("Something went wrong."),
+                                      error_messages,
+                                      G_CALLBACK(gtk_widget_destroy),
+                                      NULL);
+    }
+    const uint32_t num_removed = fsearch_file_operation_get_removed_paths(ctx->operation)->len;
+    if (num_removed > 0) {
+        g_autoptr(GString) trashed_or_deleted_message = g_string_new(NULL);
+        g_string_printf(trashed_or_deleted_message,
+                        delete ? _("Deleted %d file(s).") : _("Moved %d file(s) to the trash."),
+                        num_removed);
+        ui_utils_run_gtk_dialog_async(GTK_WIDGET(ctx->window),
+                                      GTK_MESSAGE_INFO,
+                                      GTK_BUTTONS_OK,
+                                      trashed_or_deleted_message->str,
+                                      NULL,
+                                      G_CALLBACK(gtk_widget_destroy),
+                                      NULL);
+    }
+
+    g_clear_pointer(&ctx, file_operation_context_free);
+    return G_SOURCE_REMOVE;
+}
+
+static gpointer
+file_operation_thread(gpointer data) {
+    FsearchFileOperationContext *ctx = data;
+    fsearch_file_operation_run(ctx->operation, ctx->cancellable, on_file_operation_progress, ctx);
+
+    // the removed entries are patched into the database in one go, so it doesn't need to be rescanned
+    GPtrArray *removed_paths = fsearch_file_operation_get_removed_paths(ctx->operation);
+    if (ctx->db && removed_paths->len > 0) {
+        db_lock(ctx->db);
+        db_sync_paths(ctx->db, removed_paths);
+        ctx->database_changed = db_apply_changes(ctx->db);
+        db_unlock(ctx->db);
+    }
+    g_idle_add(on_file_operation_finished, ctx);
+    return NULL;
 }
 
 static void
-append_path_to_string(gpointer key, gpointer value, gpointer user_data) {
-    append_line_to_string(user_data, value, db_entry_get_path);
+file_operation_show_progress(FsearchFileOperationContext *ctx, bool delete) {
+    ctx->dialog = gtk_message_dialog_new(GTK_WINDOW(ctx->window),
+                                         GTK_DIALOG_DESTROY_WITH_PARENT,
+                                         GTK_MESSAGE_OTHER,
+                                         GTK_BUTTONS_CANCEL,
+                                         "%s",
+                                         delete ? _("Deleting files…") : _("Moving files to trash…"));
+    gtk_window_set_title(GTK_WINDOW(ctx->dialog), "");
+    g_signal_connect(ctx->dialog, "destroy", G_CALLBACK(gtk_widget_destroyed), &ctx->dialog);
+    g_signal_connect(ctx->dialog, "response", G_CALLBACK(on_file_operation_dialog_response), ctx);
+
+    ctx->progress_bar = gtk_progress_bar_new();
+    gtk_progress_bar_set_show_text(GTK_PROGRESS_BAR(ctx->progress_bar), TRUE);
+    GtkWidget *message_area = gtk_message_dialog_get_message_area(GTK_MESSAGE_DIALOG(ctx->dialog));
+    gtk_box_pack_start(GTK_BOX(message_area), ctx->progress_bar, FALSE, FALSE, 0);
+    gtk_widget_show_all(ctx->dialog);
+
+    ctx->progress_source_id = g_timeout_add(FILE_OPERATION_PROGRESS_INTERVAL, on_file_operation_progress_timeout, ctx);
+    on_file_operation_progress_timeout(ctx);
 }
 
+// The files are removed on threads of their own, so the window keeps responding during large operations
 static void
-append_name_to_string(gpointer key, gpointer value, gpointer user_data) {
-    append_line_to_string(user_data, value, db_entry_get_name_for_display);
+file_operation_start(FsearchApplicationWindow *self, GList *file_list, bool delete) {
+    g_autoptr(GPtrArray) paths = g_ptr_array_new();
+    for (GList *f = file_list; f != NULL; f = f->next) {
+        g_ptr_array_add(paths, f->data);
+    }
+
+    FsearchFileOperationContext *ctx = calloc(1, sizeof(FsearchFileOperationContext));
+    g_assert(ctx);
+    ctx->window = g_object_ref(self);
+    ctx->operation =
+        fsearch_file_operation_new(delete ? FSEARCH_FILE_OPERATION_DELETE : FSEARCH_FILE_OPERATION_TRASH, paths);
+    ctx->db = fsearch_application_get_db(FSEARCH_APPLICATION_DEFAULT);
+    ctx->cancellable = g_cancellable_new();
+    file_operation_show_progress(ctx, delete);
+    g_thread_unref(g_thread_new("fsearch_file_operation", file_operation_thread, ctx));
 }
 
 static void
 fsearch_delete_selection(GSimpleAction *action, GVariant *variant, bool delete, gpointer user_data) {
     FsearchApplicationWindow *self = user_data;
 
-    g_autoptr(GString) error_message = g_string_new(NULL);
-
     const guint num_selected_rows = fsearch_application_window_get_num_selected(self);
     GList *file_list = NULL;
     fsearch_application_window_selection_for_each(self, prepend_full_path_to_list, &file_list);
@@ -194,43 +316,8 @@ fsearch_delete_selection(GSimpleAction *action, GVariant *variant, bool delete,
         }
     }
 
-    uint32_t num_trashed_or_deleted = 0;
-    for (GList *f = file_list; f != NULL; f = f->next) {
-        char *path = f->data;
-        if (delete) {
-            if (fsearch_file_utils_remove(path, error_message)) {
-                num_trashed_or_deleted++;
-            }
-        }
-        else {
-            if (fsearch_file_utils_trash(path, error_message)) {
-                num_trashed_or_deleted++;
-            }
-        }
-    }
-
-    if (error_message->len > 0) {
-        ui_utils_run_gtk_dialog_async(GTK_WIDGET(self),
-                                      GTK_MESSAGE_WARNING,
-                                      GTK_BUTTONS_OK,
-                                      _("Something went wrong."),
-                                      error_message->str,
-                                      G_CALLBACK(gtk_widget_destroy),
-                                      NULL);
-    }
-    if (num_trashed_or_deleted > 0) {
-        g_autoptr(GString) trashed_or_deleted_message = g_string_new(NULL);
-        g_string_printf(trashed_or_deleted_message,
-                        delete ? _("Deleted %d file(s).") : _("Moved %d file(s) to the trash."),
-                        num_trashed_or_deleted);
-        ui_utils_run_gtk_dialog_async(GTK_WIDGET(self),
-                                      GTK_MESSAGE_INFO,
-                                      GTK_BUTTONS_OK,
-                                      trashed_or_deleted_message->str,
-                                      _("The database needs to be updated before it becomes aware of those changes! "
-                                        "This will be fixed with future updates."),
-                                      G_CALLBACK(gtk_widget_destroy),
-                                      NULL);
+    if (file_list) {
+        file_operation_start(self, file_list, delete);
     }
 
 save_fail:
@@ -326,10 +413,13 @@ fsearch_window_action_select_all(GSimpleAction *action, GVariant *variant, gpoin
 static void
 fsearch_window_action_cut_or_copy(GSimpleAction *action, GVariant *variant, bool copy, gpointer user_data) {
     FsearchApplicationWindow *self = user_data;
-    GList *file_list = NULL;
-    fsearch_application_window_selection_for_each(self, prepend_full_path_to_list, &file_list);
-    file_list = g_list_reverse(file_list);
-    clipboard_copy_file_list(file_list, copy);
+    FsearchDatabase *db = NULL;
+    DynamicArray *entries = fsearch_application_window_get_selected_entries(self, &db);
+    if (db && entries) {
+        clipboard_copy_entries(db, entries, copy);
+    }
+    g_clear_pointer(&entries, darray_unref);
+    g_clear_pointer(&db, db_unref);
 }
 
 static void
@@ -342,31 +432,34 @@ fsearch_window_action_copy(GSimpleAction *action, GVariant *variant, gpointer us
     fsearch_window_action_cut_or_copy(action, variant, true, user_data);
 }
 
+// The text is only built when it gets pasted, so copying doesn't block the window
 static void
-copy_selection_as_text(FsearchApplicationWindow *win, GHFunc text_copy_func) {
-    g_autoptr(GString) file_list_buffer = g_string_sized_new(8192);
-    fsearch_application_window_selection_for_each(win, text_copy_func, file_list_buffer);
-
-    GtkClipboard *clip = gtk_clipboard_get(GDK_SELECTION_CLIPBOARD);
-    gtk_clipboard_set_text(clip, file_list_buffer->str, (gint)file_list_buffer->len);
+copy_selection_as_text(FsearchApplicationWindow *win, FsearchPathListFormat format) {
+    FsearchDatabase *db = NULL;
+    DynamicArray *entries = fsearch_application_window_get_selected_entries(win, &db);
+    if (db && entries) {
+        clipboard_copy_entries_as_text(db, entries, format);
+    }
+    g_clear_pointer(&entries, darray_unref);
+    g_clear_pointer(&db, db_unref);
 }
 
 static void
 fsearch_window_action_copy_full_path(GSimpleAction *action, GVariant *variant, gpointer user_data) {
     FsearchApplicationWindow *win = user_data;
-    copy_selection_as_text(win, append_full_path_to_string);
+    copy_selection_as_text(win, FSEARCH_PATH_LIST_FULL_PATHS);
 }
 
 static void
 fsearch_window_action_copy_path(GSimpleAction *action, GVariant *variant, gpointer user_data) {
     FsearchApplicationWindow *win = user_data;
-    copy_selection_as_text(win, append_path_to_string);
+    copy_selection_as_text(win, FSEARCH_PATH_LIST_PATHS);
 }
 
 static void
 fsearch_window_action_copy_name(GSimpleAction *action, GVariant *variant, gpointer user_data) {
     FsearchApplicationWindow *win = user_data;
-    copy_selection_as_text(win, append_name_to_string);
+    copy_selection_as_text(win, FSEARCH_PATH_LIST_NAMES);
 }
 
 static void
@@ -673,6 +766,12 @@ fsearch_window_action_focus_search(GSimpleAction *action, GVariant *variant, gpo
     gtk_widget_grab_focus(entry);
 }
 
+static void
+fsearch_window_action_find_duplicates(GSimpleAction *action, GVariant *variant, gpointer user_data) {
+    FsearchApplicationWindow *self = user_data;
+    fsearch_application_window_find_duplicates(self);
+}
+
 static void
 fsearch_window_action_hide_window(GSimpleAction *action, GVariant *variant, gpointer user_data) {
     FsearchApplicationWindow *self = user_data;
@@ -706,6 +805,15 @@ fsearch_window_action_show_statusbar(GSimpleAction *action, GVariant *variant, g
     fsearch_application_window_apply_statusbar_revealer_config(self);
 }
 
+static void
+fsearch_window_action_show_performance_stats(GSimpleAction *action, GVariant *variant, gpointer user_data) {
+    FsearchApplicationWindow *self = user_data;
+    g_simple_action_set_state(action, variant);
+    FsearchConfig *config = fsearch_application_get_config(FSEARCH_APPLICATION_DEFAULT);
+    config->show_performance_stats = g_variant_get_boolean(variant);
+    fsearch_application_window_apply_performance_stats_config(self);
+}
+
 static void
 fsearch_window_action_search_in_path(GSimpleAction *action, GVariant *variant, gpointer user_data) {
     FsearchApplicationWindow *self = user_data;
@@ -870,6 +978,7 @@ static GActionEntry FsearchWindowActions[] = {
     {"invert_selection", fsearch_window_action_invert_selection},
     {"toggle_focus", fsearch_window_action_toggle_focus},
     {"focus_search", fsearch_window_action_focus_search},
+    {"find_duplicates", fsearch_window_action_find_duplicates},
     {"hide_window", fsearch_window_action_hide_window},
     {"cancel_task", action_toggle_state_cb, NULL, "true", fsearch_window_action_cancel_current_task},
     // Column popup
@@ -881,6 +990,7 @@ static GActionEntry FsearchWindowActions[] = {
     //{ "update_database",     fsearch_window_action_update_database },
     // View
     {"show_statusbar", action_toggle_state_cb, NULL, "true", fsearch_window_action_show_statusbar},
+    {"show_performance_stats", action_toggle_state_cb, NULL, "false", fsearch_window_action_show_performance_stats},
     {"show_filter", action_toggle_state_cb, NULL, "true", fsearch_window_action_show_filter},
     {"show_search_button", action_toggle_state_cb, NULL, "true", fsearch_window_action_show_search_button},
     // Search
@@ -928,6 +1038,7 @@ fsearch_window_actions_update(FsearchApplicationWindow *self) {
     action_set_enabled(group, "hide_window", TRUE);
     action_set_enabled(group, "update_database", TRUE);
     action_set_enabled(group, "show_statusbar", TRUE);
+    action_set_enabled(group, "show_performance_stats", TRUE);
     action_set_enabled(group, "show_filter", TRUE);
     action_set_enabled(group, "show_search_button", TRUE);
     action_set_enabled(group, "show_name_column", FALSE);
@@ -939,6 +1050,7 @@ fsearch_window_actions_update(FsearchApplicationWindow *self) {
 
     FsearchConfig *config = fsearch_application_get_config(FSEARCH_APPLICATION_DEFAULT);
     action_set_active_bool(group, "show_statusbar", config->show_statusbar);
+    action_set_active_bool(group, "show_performance_stats", config->show_performance_stats);
     action_set_active_bool(group, "show_filter", config->show_filter);
     action_set_active_bool(group, "show_search_button", config->show_search_button);
     action_set_active_bool(group, "search_in_path", config->search_in_path);
@@ -0,0 +1,303 @@
+#include <glib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <src/fsearch_array.h>
+#include <src/fsearch_thread_pool.h>
+#include <src/strverscmp.h>
+
+// the sizes of the small sorts, around the size from which on darray_sort merges instead of inserting
+static const uint32_t bench_small_sizes[] = {8, 16, 32, 48, 63, 64, 96, 128, 256};
+
+typedef struct {
+    char *name;
+    uint64_t size;
+} BenchItem;
+
+typedef enum {
+    BENCH_ORDER_RANDOM,
+    BENCH_ORDER_SORTED,
+    BENCH_ORDER_REVERSED,
+    // sorted, except for 1% of the items which are swapped with random others, like after small changes
+    BENCH_ORDER_NEARLY_SORTED,
+    // only a few different values, in random order
+    BENCH_ORDER_DUPLICATES,
+    NUM_BENCH_ORDERS,
+} BenchOrder;
+
+static const char *bench_order_names[NUM_BENCH_ORDERS] = {"random", "sorted", "reversed", "nearly", "duplicates"};
+
+typedef struct {
+    const char *name;
+    DynamicArrayCompareDataFunc compare_func;
+} BenchComparator;
+
+static int32_t
+compare_name(BenchItem **a, BenchItem **b, void *data) {
+    return strverscmp((*a)->name, (*b)->name);
+}
+
+// Like the size order of the database: the names decide between items of the same size
+static int32_t
+compare_size(BenchItem **a, BenchItem **b, void *data) {
+    if ((*a)->size != (*b)->size) {
+        return (*a)->size < (*b)->size ? -1 : 1;
+    }
+    return compare_name(a, b, data);
+}
+
+static uint64_t
+get_size_key(BenchItem *item) {
+    return item->size;
+}
+
+static const BenchComparator bench_comparators[] = {
+    {"name", (DynamicArrayCompareDataFunc)compare_name},
+    {"size", (DynamicArrayCompareDataFunc)compare_size},
+};
+
+static int num_items = 1000000;
+static int num_runs = 5;
+static int num_threads = 0;
+static int seed = 1;
+
+static GOptionEntry bench_options[] = {
+    {"items", 'n', 0, G_OPTION_ARG_INT, &num_items, "Number of items to sort (1000000)", "N"},
+    {"runs", 'r', 0, G_OPTION_ARG_INT, &num_runs, "Timed runs of every benchmark (5)", "N"},
+    {"threads", 't', 0, G_OPTION_ARG_INT, &num_threads, "Threads of the multi-threaded sorts (all)", "N"},
+    {"seed", 's', 0, G_OPTION_ARG_INT, &seed, "Seed of the generated names and sizes (1)", "N"},
+    {NULL},
+};
+
+static BenchItem *
+bench_items_new(uint32_t n, bool duplicates, GRand *rand) {
+    BenchItem *items = g_new0(BenchItem, n);
+    for (uint32_t i = 0; i < n; i++) {
+        // numbers in the names, so the version sort has something to do
+        const uint32_t number = duplicates ? g_rand_int_range(rand, 0, 16) : g_rand_int(rand);
+        items[i].name = g_strdup_printf("file %u_%u.txt", number % 100000, number / 100000);
+        items[i].size = duplicates ? (uint64_t)g_rand_int_range(rand, 0, 16) * 4096 : g_rand_int(rand) % (1u << 30);
+    }
+    return items;
+}
+
+static void
+bench_items_free(BenchItem *items, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) {
+        g_clear_pointer(&items[i].name, g_free);
+    }
+    g_free(items);
+}
+
+// Returns the pointers to the items in the given order
+static void **
+bench_get_order(BenchItem *items, uint32_t n, BenchOrder order, const BenchComparator *comparator, GRand *rand) {
+    void **data = g_new(void *, MAX(n, 1));
+    for (uint32_t i = 0; i < n; i++) {
+        data[i] = &items[i];
+    }
+    if (order == BENCH_ORDER_RANDOM || order == BENCH_ORDER_DUPLICATES) {
+        return data;
+    }
+
+    DynamicArray *sorted = darray_new(n);
+    darray_add_items(sorted, data, n);
+    darray_sort_multi_threaded(sorted, comparator->compare_func, NULL, NULL);
+    for (uint32_t i = 0; i < n; i++) {
+        data[i] = darray_get_item(sorted, order == BENCH_ORDER_REVERSED ? n - 1 - i : i);
+    }
+    g_clear_pointer(&sorted, darray_unref);
+
+    if (order == BENCH_ORDER_NEARLY_SORTED) {
+        for (uint32_t i = 0; i < n / 100; i++) {
+            const uint32_t a = g_rand_int_range(rand, 0, (gint32)n);
+            const uint32_t b = g_rand_int_range(rand, 0, (gint32)n);
+            void *tmp = data[a];
+            data[a] = data[b];
+            data[b] = tmp;
+        }
+    }
+    return data;
+}
+
+static int
+compare_durations(gconstpointer a, gconstpointer b) {
+    const gint64 da = *(const gint64 *)a;
+    const gint64 db = *(const gint64 *)b;
+    return da < db ? -1 : da > db;
+}
+
+static void
+bench_print(const char *name, const char *comparator, const char *order, gint64 *durations, double num_done) {
+    qsort(durations, num_runs, sizeof(gint64), compare_durations);
+    const gint64 median = durations[num_runs / 2];
+    printf("%-14s %-6s %-10s %11.3f %11.3f %12.1f\n",
+           name,
+           comparator,
+           order,
+           (double)median / 1000.0,
+           (double)durations[num_runs - 1] / 1000.0,
+           median > 0 ? num_done / ((double)median / G_USEC_PER_SEC) / 1e6 : 0.0);
+}
+
+typedef enum {
+    BENCH_SORT_SINGLE,
+    BENCH_SORT_MULTI_THREADED,
+    BENCH_SORT_BY_KEY,
+} BenchSort;
+
+static void
+bench_sort(BenchSort sort, void **data, uint32_t n, const BenchComparator *comparator, BenchOrder order) {
+    gint64 *durations = g_new0(gint64, num_runs);
+    for (int32_t i = 0; i < num_runs; i++) {
+        // every run sorts the items in the same order, the copy isn't part of the time
+        DynamicArray *array = darray_new(n);
+        darray_add_items(array, data, n);
+        const gint64 start = g_get_monotonic_time();
+        if (sort == BENCH_SORT_SINGLE) {
+            darray_sort(array, comparator->compare_func, NULL, NULL);
+        }
+        else if (sort == BENCH_SORT_MULTI_THREADED) {
+            darray_sort_multi_threaded(array, comparator->compare_func, NULL, NULL);
+        }
+        else {
+            darray_sort_by_key(array, (DynamicArrayKeyFunc)get_size_key, comparator->compare_func, true, NULL);
+        }
+        durations[i] = g_get_monotonic_time() - start;
+        g_clear_pointer(&array, darray_unref);
+    }
+    const char *names[] = {"sort", "sort threaded", "sort by key"};
+    bench_print(names[sort], comparator->name, bench_order_names[order], durations, n);
+    g_clear_pointer(&durations, g_free);
+}
+
+// Sorts all items in slices of size items, like the many small arrays of search results and folder contents
+static void
+bench_small_sorts(void **data, uint32_t n, uint32_t size, const BenchComparator *comparator) {
+    const uint32_t num_slices = n / size;
+    gint64 *durations = g_new0(gint64, num_runs);
+    DynamicArray **slices = g_new0(DynamicArray *, MAX(num_slices, 1));
+    for (int32_t i = 0; i < num_runs; i++) {
+        for (uint32_t j = 0; j < num_slices; j++) {
+            slices[j] = darray_new(size);
+            darray_add_items(slices[j], data + (size_t)j * size, size);
+        }
+        const gint64 start = g_get_monotonic_time();
+        for (uint32_t j = 0; j < num_slices; j++) {
+            darray_sort(slices[j], comparator->compare_func, NULL, NULL);
+        }
+        durations[i] = g_get_monotonic_time() - start;
+        for (uint32_t j = 0; j < num_slices; j++) {
+            g_clear_pointer(&slices[j], darray_unref);
+        }
+    }
+    g_autofree char *name = g_strdup_printf("sort %u", size);
+    bench_print(name, comparator->name, bench_order_names[BENCH_ORDER_RANDOM], durations, (double)num_slices * size);
+    g_clear_pointer(&slices, g_free);
+    g_clear_pointer(&durations, g_free);
+}
+
+// Looks up every item of data in sorted, with a single or a range search
+static void
+bench_search(DynamicArray *sorted,
+             void **data,
+             uint32_t n,
+             const BenchComparator *comparator,
+             BenchOrder order,
+             bool range) {
+    gint64 *durations = g_new0(gint64, num_runs);
+    uint32_t num_found = 0;
+    for (int32_t i = 0; i < num_runs; i++) {
+        num_found = 0;
+        const gint64 start = g_get_monotonic_time();
+        for (uint32_t j = 0; j < n; j++) {
+            uint32_t idx = 0;
+            uint32_t end = 0;
+            num_found += range ? darray_binary_search_range_with_data(sorted,
+                                                                      data[j],
+                                                                      comparator->compare_func,
+                                                                      NULL,
+                                                                      &idx,
+                                                                      &end)
+                               : darray_binary_search_with_data(sorted, data[j], comparator->compare_func, NULL, &idx);
+        }
+        durations[i] = g_get_monotonic_time() - start;
+    }
+    if (num_found != n) {
+        g_printerr("only %u of %u items were found\n", num_found, n);
+    }
+    bench_print(range ? "search range" : "search", comparator->name, bench_order_names[order], durations, n);
+    g_clear_pointer(&durations, g_free);
+}
+
+int
+main(int argc, char *argv[]) {
+    g_autoptr(GOptionContext) context = g_option_context_new("- sort and search times of DynamicArray");
+    g_option_context_add_main_entries(context, bench_options, NULL);
+    g_autoptr(GError) error = NULL;
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_printerr("%s\n", error->message);
+        return EXIT_FAILURE;
+    }
+    if (num_items < 1 || num_runs < 1 || num_threads < 0) {
+        g_printerr("the number of items and runs must be positive\n");
+        return EXIT_FAILURE;
+    }
+    // the multi-threaded sorts always use the default thread pool
+    fsearch_thread_pool_set_default_config(num_threads, false);
+
+    const uint32_t n = num_items;
+    g_autoptr(GRand) rand = g_rand_new_with_seed(seed);
+    BenchItem *unique_items = bench_items_new(n, false, rand);
+    BenchItem *duplicate_items = bench_items_new(n, true, rand);
+
+    FsearchThreadPool *pool = fsearch_thread_pool_get_default();
+    printf("%u items, %u threads\n", n, fsearch_thread_pool_get_num_threads(pool));
+    g_clear_pointer(&pool, fsearch_thread_pool_unref);
+    printf("%-14s %-6s %-10s %11s %11s %12s\n", "benchmark", "by", "data", "median ms", "max ms", "Mitems/s");
+
+    for (uint32_t c = 0; c < G_N_ELEMENTS(bench_comparators); c++) {
+        const BenchComparator *comparator = &bench_comparators[c];
+        for (BenchOrder order = 0; order < NUM_BENCH_ORDERS; order++) {
+            BenchItem *items = order == BENCH_ORDER_DUPLICATES ? duplicate_items : unique_items;
+            void **data = bench_get_order(items, n, order, comparator, rand);
+            bench_sort(BENCH_SORT_SINGLE, data, n, comparator, order);
+            bench_sort(BENCH_SORT_MULTI_THREADED, data, n, comparator, order);
+            if (comparator->compare_func == (DynamicArrayCompareDataFunc)compare_size) {
+                bench_sort(BENCH_SORT_BY_KEY, data, n, comparator, order);
+            }
+            g_clear_pointer(&data, g_free);
+        }
+    }
+
+    for (uint32_t c = 0; c < G_N_ELEMENTS(bench_comparators); c++) {
+        void **data = bench_get_order(unique_items, n, BENCH_ORDER_RANDOM, &bench_comparators[c], rand);
+        for (uint32_t i = 0; i < G_N_ELEMENTS(bench_small_sizes); i++) {
+            bench_small_sorts(data, n, bench_small_sizes[i], &bench_comparators[c]);
+        }
+        g_clear_pointer(&data, g_free);
+    }
+
+    // searches for every item in random order, the duplicates with the range search which finds all equal items
+    const BenchOrder search_orders[] = {BENCH_ORDER_RANDOM, BENCH_ORDER_DUPLICATES};
+    for (uint32_t c = 0; c < G_N_ELEMENTS(bench_comparators); c++) {
+        for (uint32_t i = 0; i < G_N_ELEMENTS(search_orders); i++) {
+            BenchItem *items = search_orders[i] == BENCH_ORDER_DUPLICATES ? duplicate_items : unique_items;
+            void **data = bench_get_order(items, n, BENCH_ORDER_RANDOM, &bench_comparators[c], rand);
+            void **sorted_data = bench_get_order(items, n, BENCH_ORDER_SORTED, &bench_comparators[c], rand);
+            DynamicArray *sorted = darray_new(n);
+            darray_add_items(sorted, sorted_data, n);
+            bench_search(sorted, data, n, &bench_comparators[c], search_orders[i], false);
+            bench_search(sorted, data, n, &bench_comparators[c], search_orders[i], true);
+            g_clear_pointer(&sorted, darray_unref);
+            g_clear_pointer(&sorted_data, g_free);
+            g_clear_pointer(&data, g_free);
+        }
+    }
+
+    bench_items_free(unique_items, n);
+    bench_items_free(duplicate_items, n);
+    return EXIT_SUCCESS;
+}
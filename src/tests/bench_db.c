@@ -0,0 +1,375 @@
+#include <config.h>
+
+#include <fcntl.h>
+#include <ftw.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <unistd.h>
+#ifdef HAVE_MALLINFO2
+#include <malloc.h>
+#endif
+
+#include <src/fsearch_database.h>
+#include <src/fsearch_index.h>
+
+// the modification times of the fixture are spread over the ten years before this (2024-01-01)
+#define BENCH_TIME_END 1704067200
+#define BENCH_TIME_SPAN (10 * 365 * 24 * 3600)
+// every folder of the fixture has this many sub folders, until there are enough for all files
+#define BENCH_FOLDER_FANOUT 8
+
+typedef struct {
+    const char *name;
+    // wall time of every run in microseconds
+    gint64 *durations;
+    uint32_t num_runs;
+    // the highest resident set size (KiB) and growth of the heap (bytes) any of the runs reached
+    uint64_t peak_rss;
+    int64_t heap_growth;
+
+    gint64 start_time;
+    int64_t start_heap;
+} BenchPhase;
+
+static const struct {
+    FsearchDatabaseIndexType type;
+    const char *name;
+} bench_sort_types[] = {
+    {DATABASE_INDEX_TYPE_PATH, "sort path"},
+    {DATABASE_INDEX_TYPE_SIZE, "sort size"},
+    {DATABASE_INDEX_TYPE_MODIFICATION_TIME, "sort modified"},
+    {DATABASE_INDEX_TYPE_EXTENSION, "sort extension"},
+    {DATABASE_INDEX_TYPE_FILETYPE, "sort type"},
+};
+
+static const char *bench_extensions[] = {"txt", "jpg", "pdf", "c", "h", "mp3", "tar.gz", NULL};
+
+static int num_files = 100000;
+static int files_per_folder = 32;
+static int num_copies = 10;
+static int num_runs = 3;
+static gboolean compress = FALSE;
+static char **scan_paths = NULL;
+
+static GOptionEntry bench_options[] = {
+    {"files", 'n', 0, G_OPTION_ARG_INT, &num_files, "Number of files of the generated fixture (100000)", "N"},
+    {"files-per-folder", 0, 0, G_OPTION_ARG_INT, &files_per_folder, "Files in every folder of the fixture (32)", "N"},
+    {"copies",
+     'c',
+     0,
+     G_OPTION_ARG_INT,
+     &num_copies,
+     "Index the fixture this many times through symbolic links, e.g. 10, 100 or 500 for 1M, 10M or 50M entries with "
+     "the default number of files (10)",
+     "N"},
+    {"path", 'p', 0, G_OPTION_ARG_FILENAME_ARRAY, &scan_paths, "Scan PATH instead of a fixture (repeatable)", "PATH"},
+    {"runs", 'r', 0, G_OPTION_ARG_INT, &num_runs, "Runs of every phase (3)", "N"},
+    {"compress", 0, 0, G_OPTION_ARG_NONE, &compress, "Compress the database file", NULL},
+    {NULL},
+};
+
+static int64_t
+bench_get_heap_size(void) {
+#ifdef HAVE_MALLINFO2
+    struct mallinfo2 info = mallinfo2();
+    return (int64_t)(info.uordblks + info.hblkhd);
+#else
+    return 0;
+#endif
+}
+
+// Returns the peak resident set size (KiB) since bench_reset_peak_rss, or since the start of the process if it can't
+// be reset
+static uint64_t
+bench_get_peak_rss(void) {
+    FILE *fp = fopen("/proc/self/status", "r");
+    char line[256] = "";
+    uint64_t peak_rss = 0;
+    while (fp && fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, "VmHWM: %" G_GUINT64_FORMAT " kB", &peak_rss) == 1) {
+            break;
+        }
+    }
+    g_clear_pointer(&fp, fclose);
+    if (peak_rss == 0) {
+        struct rusage usage = {};
+        getrusage(RUSAGE_SELF, &usage);
+        peak_rss = usage.ru_maxrss;
+    }
+    return peak_rss;
+}
+
+static void
+bench_reset_peak_rss(void) {
+    // supported since Linux 4.0
+    FILE *fp = fopen("/proc/self/clear_refs", "w");
+    if (fp) {
+        fputs("5", fp);
+        fclose(fp);
+    }
+}
+
+static BenchPhase *
+bench_phase_new(const char *name) {
+    BenchPhase *phase = calloc(1, sizeof(BenchPhase));
+    g_assert(phase);
+    phase->name = name;
+    phase->durations = g_new0(gint64, num_runs);
+    return phase;
+}
+
+static void
+bench_phase_free(BenchPhase *phase) {
+    g_clear_pointer(&phase->durations, g_free);
+    g_clear_pointer(&phase, free);
+}
+
+static void
+bench_phase_start(BenchPhase *phase) {
+    bench_reset_peak_rss();
+    phase->start_heap = bench_get_heap_size();
+    phase->start_time = g_get_monotonic_time();
+}
+
+static void
+bench_phase_stop(BenchPhase *phase) {
+    const gint64 end_time = g_get_monotonic_time();
+    if (phase->num_runs < (uint32_t)num_runs) {
+        phase->durations[phase->num_runs++] = end_time - phase->start_time;
+    }
+    phase->peak_rss = MAX(phase->peak_rss, bench_get_peak_rss());
+    phase->heap_growth = MAX(phase->heap_growth, bench_get_heap_size() - phase->start_heap);
+}
+
+static int
+compare_durations(gconstpointer a, gconstpointer b) {
+    const gint64 da = *(const gint64 *)a;
+    const gint64 db = *(const gint64 *)b;
+    return da < db ? -1 : da > db;
+}
+
+static void
+bench_phase_print(BenchPhase *phase) {
+    if (phase->num_runs == 0) {
+        printf("%-16s %11s\n", phase->name, "failed");
+        return;
+    }
+    qsort(phase->durations, phase->num_runs, sizeof(gint64), compare_durations);
+    printf("%-16s %11.1f %11.1f %12.1f %12.1f\n",
+           phase->name,
+           (double)phase->durations[phase->num_runs / 2] / 1000.0,
+           (double)phase->durations[phase->num_runs - 1] / 1000.0,
+           (double)phase->peak_rss / 1024.0,
+           (double)phase->heap_growth / (1024.0 * 1024.0));
+}
+
+static bool
+bench_create_file(const char *path, uint32_t i) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    // sparse, so the fixture doesn't take any space
+    const bool res = ftruncate(fd, (off_t)((i * 2654435761u) % (1u << 24))) == 0;
+    close(fd);
+
+    const time_t mtime = BENCH_TIME_END - (time_t)((i * 7919u) % BENCH_TIME_SPAN);
+    struct timeval times[2] = {{.tv_sec = mtime}, {.tv_sec = mtime}};
+    return utimes(path, times) == 0 && res;
+}
+
+// Creates the folders and files of the fixture in data_path, it's the same for every run
+static bool
+bench_create_fixture(const char *data_path) {
+    const uint32_t num_folders = MAX((num_files + files_per_folder - 1) / files_per_folder, 1);
+    g_autoptr(GPtrArray) folders = g_ptr_array_new_with_free_func(g_free);
+    g_ptr_array_add(folders, g_strdup(data_path));
+    if (g_mkdir(data_path, 0755) != 0) {
+        return false;
+    }
+    for (uint32_t i = 1; i < num_folders; i++) {
+        const char *parent = g_ptr_array_index(folders, (i - 1) / BENCH_FOLDER_FANOUT);
+        g_autofree char *name = g_strdup_printf("folder%u", i);
+        char *path = g_build_filename(parent, name, NULL);
+        g_ptr_array_add(folders, path);
+        if (g_mkdir(path, 0755) != 0) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < (uint32_t)num_files; i++) {
+        const char *extension = bench_extensions[i % G_N_ELEMENTS(bench_extensions)];
+        g_autofree char *name = g_strdup_printf("file%u%s%s", i, extension ? "." : "", extension ? extension : "");
+        g_autofree char *path = g_build_filename(g_ptr_array_index(folders, i % num_folders), name, NULL);
+        if (!bench_create_file(path, i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int
+bench_remove_path(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+    return remove(path);
+}
+
+static GList *
+bench_get_indexes(const char *work_dir) {
+    GList *indexes = NULL;
+    for (uint32_t i = 0; scan_paths && scan_paths[i]; i++) {
+        indexes = g_list_append(indexes, fsearch_index_new(FSEARCH_INDEX_FOLDER_TYPE, scan_paths[i], true, true, false, 0));
+    }
+    if (indexes) {
+        return indexes;
+    }
+
+    g_autofree char *data_path = g_build_filename(work_dir, "data", NULL);
+    indexes = g_list_append(indexes, fsearch_index_new(FSEARCH_INDEX_FOLDER_TYPE, data_path, true, true, false, 0));
+    for (uint32_t i = 1; i < (uint32_t)num_copies; i++) {
+        // every link is a root of its own, so the database gets another copy of all entries
+        g_autofree char *name = g_strdup_printf("copy%u", i);
+        g_autofree char *copy_path = g_build_filename(work_dir, name, NULL);
+        if (symlink("data", copy_path) == 0) {
+            indexes = g_list_append(indexes, fsearch_index_new(FSEARCH_INDEX_FOLDER_TYPE, copy_path, true, true, false, 0));
+        }
+    }
+    return indexes;
+}
+
+static FsearchDatabase *
+bench_db_new(GList *indexes, bool lazy_sort_indexes) {
+    FsearchDatabase *db = db_new(indexes, NULL, NULL, false);
+    db_set_compress(db, compress);
+    db_set_lazy_sort_indexes(db, lazy_sort_indexes);
+    return db;
+}
+
+int
+main(int argc, char *argv[]) {
+    g_autoptr(GOptionContext) context = g_option_context_new("- scan, load, save and sort times of the database");
+    g_option_context_add_main_entries(context, bench_options, NULL);
+    g_autoptr(GError) error = NULL;
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_printerr("%s\n", error->message);
+        return EXIT_FAILURE;
+    }
+    if (num_files < 0 || files_per_folder < 1 || num_copies < 1 || num_runs < 1) {
+        g_printerr("the number of files, copies and runs must be positive\n");
+        return EXIT_FAILURE;
+    }
+
+    g_autofree char *work_dir = g_dir_make_tmp("fsearch_bench_XXXXXX", NULL);
+    g_autofree char *db_dir = work_dir ? g_build_filename(work_dir, "db", NULL) : NULL;
+    g_autofree char *db_file = db_dir ? g_build_filename(db_dir, "fsearch.db", NULL) : NULL;
+    if (!work_dir || g_mkdir(db_dir, 0755) != 0) {
+        g_printerr("failed to create the working directory\n");
+        return EXIT_FAILURE;
+    }
+
+    if (!scan_paths) {
+        const gint64 start = g_get_monotonic_time();
+        g_autofree char *data_path = g_build_filename(work_dir, "data", NULL);
+        if (!bench_create_fixture(data_path)) {
+            g_printerr("failed to create the fixture in %s\n", work_dir);
+            nftw(work_dir, bench_remove_path, 16, FTW_DEPTH | FTW_PHYS);
+            return EXIT_FAILURE;
+        }
+        printf("fixture of %d files in %s created in %.2f s\n",
+               num_files,
+               work_dir,
+               (double)(g_get_monotonic_time() - start) / G_USEC_PER_SEC);
+    }
+    GList *indexes = bench_get_indexes(work_dir);
+
+    GPtrArray *phases = g_ptr_array_new_with_free_func((GDestroyNotify)bench_phase_free);
+    FsearchDatabase *db = NULL;
+
+    BenchPhase *scan = bench_phase_new("scan");
+    g_ptr_array_add(phases, scan);
+    for (int32_t i = 0; i < num_runs; i++) {
+        g_clear_pointer(&db, db_unref);
+        db = bench_db_new(indexes, false);
+        bench_phase_start(scan);
+        const bool res = db_scan(db, NULL, NULL);
+        res ? bench_phase_stop(scan) : g_printerr("scan failed\n");
+    }
+    printf("%u folders, %u files in %u indexes\n",
+           db_get_num_folders(db),
+           db_get_num_files(db),
+           g_list_length(indexes));
+
+    BenchPhase *rescan = bench_phase_new("rescan");
+    g_ptr_array_add(phases, rescan);
+    for (int32_t i = 0; i < num_runs; i++) {
+        FsearchDatabase *next = bench_db_new(indexes, false);
+        bench_phase_start(rescan);
+        const bool res = db_scan_incremental(next, db, NULL, NULL);
+        res ? bench_phase_stop(rescan) : g_printerr("rescan failed\n");
+        g_clear_pointer(&next, db_unref);
+    }
+
+    BenchPhase *save = bench_phase_new(compress ? "save compressed" : "save");
+    g_ptr_array_add(phases, save);
+    for (int32_t i = 0; i < num_runs; i++) {
+        bench_phase_start(save);
+        const bool res = db_save(db, db_dir);
+        res ? bench_phase_stop(save) : g_printerr("save failed\n");
+    }
+    g_clear_pointer(&db, db_unref);
+
+    const char *load_names[2] = {"load", "load searchable"};
+    for (uint32_t j = 0; j < G_N_ELEMENTS(load_names); j++) {
+        BenchPhase *load = bench_phase_new(load_names[j]);
+        g_ptr_array_add(phases, load);
+        for (int32_t i = 0; i < num_runs; i++) {
+            FsearchDatabase *loaded = bench_db_new(NULL, false);
+            // a progressive load can be searched as soon as the names are loaded
+            db_set_progressive_load(loaded, j == 1);
+            bench_phase_start(load);
+            const bool res = db_load(loaded, db_file, NULL);
+            res ? bench_phase_stop(load) : g_printerr("load failed\n");
+            g_clear_pointer(&loaded, db_unref);
+        }
+    }
+
+    BenchPhase *sorts[G_N_ELEMENTS(bench_sort_types)] = {NULL};
+    for (uint32_t j = 0; j < G_N_ELEMENTS(bench_sort_types); j++) {
+        sorts[j] = bench_phase_new(bench_sort_types[j].name);
+        g_ptr_array_add(phases, sorts[j]);
+    }
+    for (int32_t i = 0; i < num_runs; i++) {
+        // a database which is only sorted by name, so every other order gets sorted on demand
+        FsearchDatabase *unsorted = bench_db_new(indexes, true);
+        if (!db_scan(unsorted, NULL, NULL)) {
+            g_printerr("scan failed\n");
+        }
+        db_lock(unsorted);
+        for (uint32_t j = 0; j < G_N_ELEMENTS(bench_sort_types); j++) {
+            bench_phase_start(sorts[j]);
+            const bool res = db_ensure_entries_sorted(unsorted, bench_sort_types[j].type, NULL);
+            res ? bench_phase_stop(sorts[j]) : g_printerr("%s failed\n", bench_sort_types[j].name);
+        }
+        db_unlock(unsorted);
+        g_clear_pointer(&unsorted, db_unref);
+    }
+
+    struct stat db_file_st = {};
+    if (stat(db_file, &db_file_st) == 0) {
+        printf("database file: %.1f MiB\n", (double)db_file_st.st_size / (1024.0 * 1024.0));
+    }
+    printf("%-16s %11s %11s %12s %12s\n", "phase", "median ms", "max ms", "peak RSS MiB", "heap +MiB");
+    for (uint32_t i = 0; i < phases->len; i++) {
+        bench_phase_print(g_ptr_array_index(phases, i));
+    }
+
+    g_clear_pointer(&phases, g_ptr_array_unref);
+    g_list_free_full(indexes, (GDestroyNotify)fsearch_index_free);
+    nftw(work_dir, bench_remove_path, 16, FTW_DEPTH | FTW_PHYS);
+    g_clear_pointer(&scan_paths, g_strfreev);
+    return EXIT_SUCCESS;
+}
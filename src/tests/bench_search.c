@@ -0,0 +1,398 @@
+#include <glib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <src/fsearch_array.h>
+#include <src/fsearch_database_columns.h>
+#include <src/fsearch_database_entry.h>
+#include <src/fsearch_database_extensions.h>
+#include <src/fsearch_database_folded_names.h>
+#include <src/fsearch_database_search.h>
+#include <src/fsearch_database_trigrams.h>
+#include <src/fsearch_filter_manager.h>
+#include <src/fsearch_memory_pool.h>
+#include <src/fsearch_query.h>
+#include <src/fsearch_thread_pool.h>
+#include <src/fsearch_utf.h>
+
+// the modification times are spread over the ten years before this (2024-01-01), so the date queries always match
+// the same entries
+#define BENCH_TIME_END 1704067200
+#define BENCH_TIME_SPAN (10 * 365 * 24 * 3600)
+
+typedef struct {
+    const char *name;
+    const char *text;
+    FsearchQueryFlags flags;
+} BenchQuery;
+
+// Every kind of search, which should be fast enough for search as you type
+static const BenchQuery bench_queries[] = {
+    {"substring", "report", 0},
+    {"case", "Thesis", QUERY_FLAG_MATCH_CASE},
+    {"path", "src report", QUERY_FLAG_SEARCH_IN_PATH},
+    {"regex", "^photo_[a-z]+_[0-9]+\\.jpg$", QUERY_FLAG_REGEX},
+    {"wildcard", "draft*.pdf", 0},
+    {"extension", "ext:pdf;txt", 0},
+    {"size", "size:>100mb", 0},
+    {"date", "dm:>2023-01-01", 0},
+    {"combined", "notes ext:txt size:<1mb", 0},
+};
+
+// some of them aren't ASCII, so case insensitive searches have to fold them
+static const char *bench_words[] = {
+    "report", "photo", "invoice", "backup", "draft", "notes", "src",  "build",     "music", "video",
+    "Thesis", "readme", "config", "data",  "budget", "café",  "Ärger", "übersicht", "holiday", "scan",
+};
+
+typedef struct {
+    char *name;
+    uint32_t weight;
+} BenchExtension;
+
+typedef struct {
+    FsearchMemoryPool *folder_pool;
+    FsearchMemoryPool *file_pool;
+    DynamicArray *folders;
+    DynamicArray *files;
+    // everything a database passes to db_search along with its entries
+    FsearchDatabaseColumns *folder_columns;
+    FsearchDatabaseColumns *file_columns;
+    FsearchDatabaseFolderPaths *folder_paths;
+    FsearchDatabaseFoldedNames *folded_names;
+    FsearchDatabaseExtensions *extensions;
+    FsearchDatabaseTrigrams *trigrams;
+    DatabaseSearchSortedEntries sorted_entries;
+} BenchDatabase;
+
+static int num_files = 1000000;
+static int num_folders = 0;
+static int max_depth = 8;
+static int num_runs = 20;
+static int seed = 1;
+static gboolean trigram_index = FALSE;
+static char *extension_mix = NULL;
+static char *thread_counts = NULL;
+
+static GOptionEntry bench_options[] = {
+    {"files", 'n', 0, G_OPTION_ARG_INT, &num_files, "Number of files (1000000)", "N"},
+    {"folders", 'd', 0, G_OPTION_ARG_INT, &num_folders, "Number of folders (a tenth of the files)", "N"},
+    {"depth", 0, 0, G_OPTION_ARG_INT, &max_depth, "Maximum depth of the folders (8)", "N"},
+    {"extensions",
+     'e',
+     0,
+     G_OPTION_ARG_STRING,
+     &extension_mix,
+     "Extensions of the files and their weights, - for none (txt:30,jpg:20,pdf:10,c:10,h:10,mp3:10,-:10)",
+     "LIST"},
+    {"threads", 't', 0, G_OPTION_ARG_STRING, &thread_counts, "Thread counts to compare (1,2,4,all)", "LIST"},
+    {"runs", 'r', 0, G_OPTION_ARG_INT, &num_runs, "Timed runs of every query (20)", "N"},
+    {"seed", 's', 0, G_OPTION_ARG_INT, &seed, "Seed of the generated names, sizes and times (1)", "N"},
+    {"trigrams", 0, 0, G_OPTION_ARG_NONE, &trigram_index, "Search with a trigram index of the names", NULL},
+    {NULL},
+};
+
+static GArray *
+bench_parse_extensions(const char *mix) {
+    GArray *extensions = g_array_new(FALSE, TRUE, sizeof(BenchExtension));
+    g_auto(GStrv) items = g_strsplit(mix, ",", -1);
+    for (uint32_t i = 0; items[i]; i++) {
+        g_auto(GStrv) parts = g_strsplit(items[i], ":", 2);
+        if (!parts[0] || parts[0][0] == '\0') {
+            continue;
+        }
+        BenchExtension extension = {
+            .name = strcmp(parts[0], "-") != 0 ? g_strdup(parts[0]) : NULL,
+            .weight = parts[1] ? (uint32_t)MAX(atoi(parts[1]), 0) : 1,
+        };
+        g_array_append_val(extensions, extension);
+    }
+    return extensions;
+}
+
+static const char *
+bench_pick_extension(GArray *extensions, uint32_t total_weight, GRand *rand) {
+    uint32_t pick = total_weight > 0 ? g_rand_int_range(rand, 0, (gint32)total_weight) : 0;
+    for (uint32_t i = 0; i < extensions->len; i++) {
+        BenchExtension *extension = &g_array_index(extensions, BenchExtension, i);
+        if (pick < extension->weight) {
+            return extension->name;
+        }
+        pick -= extension->weight;
+    }
+    return NULL;
+}
+
+static const char *
+bench_pick_word(GRand *rand) {
+    return bench_words[g_rand_int_range(rand, 0, G_N_ELEMENTS(bench_words))];
+}
+
+static void
+bench_init_entry(FsearchDatabaseEntry *entry,
+                 FsearchDatabaseEntryType type,
+                 const char *name,
+                 FsearchDatabaseEntryFolder *parent,
+                 GRand *rand) {
+    db_entry_set_type(entry, type);
+    db_entry_set_name(entry, name);
+    db_entry_set_parent(entry, parent);
+    // most files are small, a few are huge
+    const uint64_t size = ((uint64_t)1 << g_rand_int_range(rand, 0, 34)) + g_rand_int_range(rand, 0, 1024);
+    db_entry_set_size(entry, type == DATABASE_ENTRY_TYPE_FILE ? (off_t)size : 0);
+    db_entry_set_mtime(entry, BENCH_TIME_END - g_rand_int_range(rand, 0, BENCH_TIME_SPAN));
+}
+
+static DynamicArray *
+bench_sort_copy(DynamicArray *entries, DynamicArrayCompareDataFunc compare_func) {
+    DynamicArray *sorted = darray_copy(entries);
+    darray_sort(sorted, compare_func, NULL, NULL);
+    return sorted;
+}
+
+static void
+bench_set_indices(DynamicArray *entries) {
+    for (uint32_t i = 0; i < darray_get_num_items(entries); i++) {
+        db_entry_set_idx(darray_get_item(entries, i), i);
+    }
+}
+
+static void
+bench_database_init(BenchDatabase *db, GArray *extensions, FsearchThreadPool *pool) {
+    g_autoptr(GRand) rand = g_rand_new_with_seed(seed);
+    uint32_t total_weight = 0;
+    for (uint32_t i = 0; i < extensions->len; i++) {
+        total_weight += g_array_index(extensions, BenchExtension, i).weight;
+    }
+
+    db->folder_pool =
+        fsearch_memory_pool_new(4096, db_entry_get_sizeof_folder_entry(), (GDestroyNotify)db_entry_destroy);
+    db->file_pool = fsearch_memory_pool_new(4096, db_entry_get_sizeof_file_entry(), (GDestroyNotify)db_entry_destroy);
+    db->folders = darray_new(num_folders + 1);
+    db->files = darray_new(num_files + 1);
+
+    // the folders which can still have sub folders, with their depth
+    g_autoptr(GArray) parents = g_array_new(FALSE, FALSE, sizeof(uint32_t));
+    g_autoptr(GArray) depths = g_array_new(FALSE, FALSE, sizeof(uint32_t));
+    char name[256] = "";
+
+    FsearchDatabaseEntry *root = fsearch_memory_pool_malloc(db->folder_pool);
+    bench_init_entry(root, DATABASE_ENTRY_TYPE_FOLDER, "", NULL, rand);
+    darray_add_item(db->folders, root);
+    uint32_t depth = 0;
+    g_array_append_val(depths, depth);
+    uint32_t idx = 0;
+    g_array_append_val(parents, idx);
+
+    for (uint32_t i = 1; i < (uint32_t)num_folders; i++) {
+        const uint32_t parent_idx = g_array_index(parents, uint32_t, g_rand_int_range(rand, 0, (gint32)parents->len));
+        FsearchDatabaseEntryFolder *parent = darray_get_item(db->folders, parent_idx);
+        g_snprintf(name, sizeof(name), "%s%u", bench_pick_word(rand), g_rand_int_range(rand, 0, 100));
+
+        FsearchDatabaseEntry *folder = fsearch_memory_pool_malloc(db->folder_pool);
+        bench_init_entry(folder, DATABASE_ENTRY_TYPE_FOLDER, name, parent, rand);
+        darray_add_item(db->folders, folder);
+        depth = g_array_index(depths, uint32_t, parent_idx) + 1;
+        g_array_append_val(depths, depth);
+        if (depth < (uint32_t)max_depth) {
+            g_array_append_val(parents, i);
+        }
+    }
+
+    for (uint32_t i = 0; i < (uint32_t)num_files; i++) {
+        FsearchDatabaseEntryFolder *parent =
+            darray_get_item(db->folders, g_rand_int_range(rand, 0, (gint32)darray_get_num_items(db->folders)));
+        const char *extension = bench_pick_extension(extensions, total_weight, rand);
+        g_snprintf(name,
+                   sizeof(name),
+                   "%s_%s_%u%s%s",
+                   bench_pick_word(rand),
+                   bench_pick_word(rand),
+                   g_rand_int_range(rand, 0, 10000),
+                   extension ? "." : "",
+                   extension ? extension : "");
+
+        FsearchDatabaseEntry *file = fsearch_memory_pool_malloc(db->file_pool);
+        bench_init_entry(file, DATABASE_ENTRY_TYPE_FILE, name, parent, rand);
+        darray_add_item(db->files, file);
+    }
+
+    // the same orders a database has after it was loaded
+    darray_sort(db->folders, (DynamicArrayCompareDataFunc)db_entry_compare_entries_by_name, NULL, NULL);
+    darray_sort(db->files, (DynamicArrayCompareDataFunc)db_entry_compare_entries_by_name, NULL, NULL);
+    bench_set_indices(db->folders);
+    bench_set_indices(db->files);
+
+    db->folder_columns = db_columns_new(db->folders, DATABASE_ENTRY_TYPE_FOLDER);
+    db->file_columns = db_columns_new(db->files, DATABASE_ENTRY_TYPE_FILE);
+    db->folder_paths = db_folder_paths_new(db->folders);
+    db->folded_names = db_folded_names_new(db->folders, db->files, fsearch_utf_get_fold_options());
+    db->extensions = db_extensions_new(db->files);
+    db->trigrams = trigram_index ? db_trigrams_new(db->folders, db->files, pool) : NULL;
+
+    DatabaseSearchSortedEntries *sorted = &db->sorted_entries;
+    sorted->folders[DATABASE_INDEX_TYPE_SIZE] =
+        bench_sort_copy(db->folders, (DynamicArrayCompareDataFunc)db_entry_compare_entries_by_size);
+    sorted->files[DATABASE_INDEX_TYPE_SIZE] =
+        bench_sort_copy(db->files, (DynamicArrayCompareDataFunc)db_entry_compare_entries_by_size);
+    sorted->folders[DATABASE_INDEX_TYPE_MODIFICATION_TIME] =
+        bench_sort_copy(db->folders, (DynamicArrayCompareDataFunc)db_entry_compare_entries_by_modification_time);
+    sorted->files[DATABASE_INDEX_TYPE_MODIFICATION_TIME] =
+        bench_sort_copy(db->files, (DynamicArrayCompareDataFunc)db_entry_compare_entries_by_modification_time);
+}
+
+static void
+bench_database_clear(BenchDatabase *db) {
+    db_search_sorted_entries_clear(&db->sorted_entries);
+    g_clear_pointer(&db->folder_columns, db_columns_unref);
+    g_clear_pointer(&db->file_columns, db_columns_unref);
+    g_clear_pointer(&db->folder_paths, db_folder_paths_unref);
+    g_clear_pointer(&db->folded_names, db_folded_names_unref);
+    g_clear_pointer(&db->extensions, db_extensions_unref);
+    g_clear_pointer(&db->trigrams, db_trigrams_unref);
+    g_clear_pointer(&db->folders, darray_unref);
+    g_clear_pointer(&db->files, darray_unref);
+    g_clear_pointer(&db->folder_pool, fsearch_memory_pool_free_pool);
+    g_clear_pointer(&db->file_pool, fsearch_memory_pool_free_pool);
+}
+
+static GArray *
+bench_parse_thread_counts(const char *counts) {
+    GArray *result = g_array_new(FALSE, FALSE, sizeof(uint32_t));
+    g_auto(GStrv) items = g_strsplit(counts, ",", -1);
+    for (uint32_t i = 0; items[i]; i++) {
+        const uint32_t num_threads = !strcmp(items[i], "all") ? g_get_num_processors() : (uint32_t)atoi(items[i]);
+        bool is_duplicate = false;
+        for (uint32_t j = 0; j < result->len; j++) {
+            is_duplicate |= g_array_index(result, uint32_t, j) == num_threads;
+        }
+        if (num_threads > 0 && !is_duplicate) {
+            g_array_append_val(result, num_threads);
+        }
+    }
+    return result;
+}
+
+static int
+compare_durations(gconstpointer a, gconstpointer b) {
+    const gint64 da = *(const gint64 *)a;
+    const gint64 db = *(const gint64 *)b;
+    return da < db ? -1 : da > db;
+}
+
+// Returns the p-th percentile of the sorted durations (nearest rank)
+static gint64
+bench_percentile(const gint64 *durations, uint32_t num_durations, uint32_t p) {
+    const uint32_t rank = (p * num_durations + 99) / 100;
+    return durations[MAX(rank, 1) - 1];
+}
+
+static void
+bench_run_query(BenchDatabase *db, FsearchThreadPool *pool, FsearchFilterManager *filters, const BenchQuery *bq) {
+    FsearchQuery *q = fsearch_query_new(bq->text, NULL, filters, bq->flags, "[bench]");
+    gint64 *durations = g_new0(gint64, num_runs);
+    uint32_t num_results = 0;
+
+    // the first run only warms up the caches
+    for (int32_t i = -1; i < num_runs; i++) {
+        const gint64 start = g_get_monotonic_time();
+        DatabaseSearchResult *result = db_search(q,
+                                                 pool,
+                                                 db->folders,
+                                                 db->files,
+                                                 db->folder_columns,
+                                                 db->file_columns,
+                                                 db->folder_paths,
+                                                 db->folded_names,
+                                                 db->extensions,
+                                                 NULL,
+                                                 db->trigrams,
+                                                 &db->sorted_entries,
+                                                 NULL,
+                                                 DATABASE_INDEX_TYPE_NAME,
+                                                 NULL,
+                                                 NULL,
+                                                 NULL);
+        const gint64 end = g_get_monotonic_time();
+        if (i >= 0) {
+            durations[i] = end - start;
+        }
+        if (result) {
+            num_results = (result->folders ? darray_get_num_items(result->folders) : 0)
+                        + (result->files ? darray_get_num_items(result->files) : 0);
+            g_clear_pointer(&result->folders, darray_unref);
+            g_clear_pointer(&result->files, darray_unref);
+            g_clear_pointer(&result, free);
+        }
+    }
+    qsort(durations, num_runs, sizeof(gint64), compare_durations);
+
+    const gint64 median = bench_percentile(durations, num_runs, 50);
+    const gint64 p99 = bench_percentile(durations, num_runs, 99);
+    const double num_entries = darray_get_num_items(db->folders) + darray_get_num_items(db->files);
+    printf("%-10s %7u %10u %11.3f %11.3f %12.1f\n",
+           bq->name,
+           fsearch_thread_pool_get_num_threads(pool),
+           num_results,
+           (double)median / 1000.0,
+           (double)p99 / 1000.0,
+           median > 0 ? num_entries / ((double)median / G_USEC_PER_SEC) / 1e6 : 0.0);
+
+    g_clear_pointer(&durations, g_free);
+    g_clear_pointer(&q, fsearch_query_unref);
+}
+
+int
+main(int argc, char *argv[]) {
+    g_autoptr(GOptionContext) context = g_option_context_new("- search throughput and latency");
+    g_option_context_add_main_entries(context, bench_options, NULL);
+    g_autoptr(GError) error = NULL;
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_printerr("%s\n", error->message);
+        return EXIT_FAILURE;
+    }
+    if (num_files < 0 || num_folders < 0 || max_depth < 1 || num_runs < 1) {
+        g_printerr("the number of files, folders, the depth and the number of runs must be positive\n");
+        return EXIT_FAILURE;
+    }
+    if (num_folders == 0) {
+        num_folders = MAX(num_files / 10, 1);
+    }
+
+    g_autoptr(GArray) extensions = bench_parse_extensions(extension_mix ? extension_mix
+                                                                        : "txt:30,jpg:20,pdf:10,c:10,h:10,mp3:10,-:10");
+    g_autoptr(GArray) threads = bench_parse_thread_counts(thread_counts ? thread_counts : "1,2,4,all");
+
+    BenchDatabase db = {};
+    const gint64 start = g_get_monotonic_time();
+    FsearchThreadPool *default_pool = fsearch_thread_pool_get_default();
+    bench_database_init(&db, extensions, default_pool);
+    g_clear_pointer(&default_pool, fsearch_thread_pool_unref);
+    printf("%u folders, %u files, depth %d, seed %d, generated in %.2f s\n",
+           darray_get_num_items(db.folders),
+           darray_get_num_items(db.files),
+           max_depth,
+           seed,
+           (double)(g_get_monotonic_time() - start) / G_USEC_PER_SEC);
+    printf("%-10s %7s %10s %11s %11s %12s\n", "query", "threads", "results", "median ms", "p99 ms", "Mentries/s");
+
+    FsearchFilterManager *filters = fsearch_filter_manager_new_with_defaults();
+    for (uint32_t i = 0; i < threads->len; i++) {
+        FsearchThreadPool *pool = fsearch_thread_pool_new(g_array_index(threads, uint32_t, i));
+        for (uint32_t j = 0; j < G_N_ELEMENTS(bench_queries); j++) {
+            bench_run_query(&db, pool, filters, &bench_queries[j]);
+        }
+        g_clear_pointer(&pool, fsearch_thread_pool_unref);
+    }
+    g_clear_pointer(&filters, fsearch_filter_manager_free);
+
+    bench_database_clear(&db);
+    for (uint32_t i = 0; i < extensions->len; i++) {
+        g_free(g_array_index(extensions, BenchExtension, i).name);
+    }
+    g_clear_pointer(&extension_mix, g_free);
+    g_clear_pointer(&thread_counts, g_free);
+    return EXIT_SUCCESS;
+}
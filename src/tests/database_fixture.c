@@ -0,0 +1,144 @@
+#include "database_fixture.h"
+
+#include <ftw.h>
+#include <stdio.h>
+#include <string.h>
+
+static int
+remove_path(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+    return remove(path);
+}
+
+static void
+remove_tree(const char *path) {
+    if (path) {
+        nftw(path, remove_path, 16, FTW_DEPTH | FTW_PHYS);
+    }
+}
+
+void
+database_fixture_set_up(DatabaseFixture *fixture, gconstpointer user_data) {
+    fixture->root = g_dir_make_tmp("fsearch_test_XXXXXX", NULL);
+    fixture->db_dir = g_dir_make_tmp("fsearch_test_db_XXXXXX", NULL);
+    g_assert_nonnull(fixture->root);
+    g_assert_nonnull(fixture->db_dir);
+    fixture->db_file = g_build_filename(fixture->db_dir, "fsearch.db", NULL);
+    fixture->indexes = NULL;
+}
+
+void
+database_fixture_tear_down(DatabaseFixture *fixture, gconstpointer user_data) {
+    g_list_free_full(g_steal_pointer(&fixture->indexes), (GDestroyNotify)fsearch_index_free);
+    remove_tree(fixture->root);
+    remove_tree(fixture->db_dir);
+    g_clear_pointer(&fixture->db_file, g_free);
+    g_clear_pointer(&fixture->db_dir, g_free);
+    g_clear_pointer(&fixture->root, g_free);
+}
+
+FsearchIndex *
+database_fixture_add_index(DatabaseFixture *fixture, const char *path) {
+    FsearchIndex *index = fsearch_index_new(FSEARCH_INDEX_FOLDER_TYPE, path, true, true, false, 0);
+    fixture->indexes = g_list_append(fixture->indexes, index);
+    return index;
+}
+
+FsearchDatabase *
+database_fixture_new_db(DatabaseFixture *fixture) {
+    return db_new(fixture->indexes, NULL, NULL, false);
+}
+
+FsearchDatabase *
+database_fixture_scan(DatabaseFixture *fixture) {
+    FsearchDatabase *db = database_fixture_new_db(fixture);
+    g_assert_true(db_scan(db, NULL, NULL));
+    return db;
+}
+
+char *
+create_file(const char *dir, const char *name, const char *content) {
+    char *path = g_build_filename(dir, name, NULL);
+    g_assert_true(g_file_set_contents(path, content, -1, NULL));
+    return path;
+}
+
+GHashTable *
+get_entries(FsearchDatabase *db) {
+    GHashTable *entries = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    DynamicArray *arrays[2] = {db_get_files(db), db_get_folders(db)};
+    for (uint32_t i = 0; i < G_N_ELEMENTS(arrays); i++) {
+        for (uint32_t j = 0; j < darray_get_num_items(arrays[i]); j++) {
+            FsearchDatabaseEntry *entry = darray_get_item(arrays[i], j);
+            GString *path = db_entry_get_path_full(entry);
+            g_string_append_printf(path, " %" G_GINT64_FORMAT, (gint64)db_entry_get_size(entry));
+            g_hash_table_add(entries, g_string_free(path, FALSE));
+        }
+        g_clear_pointer(&arrays[i], darray_unref);
+    }
+    return entries;
+}
+
+void
+assert_same_entries(FsearchDatabase *db1, FsearchDatabase *db2) {
+    g_autoptr(GHashTable) entries1 = get_entries(db1);
+    g_autoptr(GHashTable) entries2 = get_entries(db2);
+    g_assert_cmpuint(g_hash_table_size(entries1), ==, g_hash_table_size(entries2));
+    GHashTableIter iter;
+    gpointer key = NULL;
+    g_hash_table_iter_init(&iter, entries1);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        if (!g_hash_table_contains(entries2, key)) {
+            g_print("missing: %s\n", (char *)key);
+        }
+        g_assert_true(g_hash_table_contains(entries2, key));
+    }
+}
+
+FsearchDatabaseEntryFolder *
+get_folder(FsearchDatabase *db, const char *path) {
+    FsearchDatabaseEntryFolder *result = NULL;
+    DynamicArray *folders = db_get_folders(db);
+    for (uint32_t i = 0; i < darray_get_num_items(folders) && !result; i++) {
+        FsearchDatabaseEntry *folder = darray_get_item(folders, i);
+        g_autoptr(GString) folder_path = db_entry_get_path_full(folder);
+        if (!strcmp(folder_path->str, path)) {
+            result = (FsearchDatabaseEntryFolder *)folder;
+        }
+    }
+    g_clear_pointer(&folders, darray_unref);
+    g_assert_nonnull(result);
+    return result;
+}
+
+FsearchDatabaseEntry *
+get_entry(FsearchDatabase *db, const char *name) {
+    FsearchDatabaseEntry *result = NULL;
+    DynamicArray *files = db_get_files(db);
+    for (uint32_t i = 0; i < darray_get_num_items(files) && !result; i++) {
+        FsearchDatabaseEntry *file = darray_get_item(files, i);
+        if (!strcmp(db_entry_get_name_raw(file), name)) {
+            result = file;
+        }
+    }
+    g_clear_pointer(&files, darray_unref);
+    g_assert_nonnull(result);
+    return result;
+}
+
+void
+assert_sorted(DynamicArray *entries, DynamicArrayCompareDataFunc compare_func) {
+    for (uint32_t i = 1; entries && i < darray_get_num_items(entries); i++) {
+        void *a = darray_get_item(entries, i - 1);
+        void *b = darray_get_item(entries, i);
+        g_assert_cmpint(compare_func(&a, &b, NULL), <=, 0);
+    }
+}
+
+void
+assert_file_names(DynamicArray *files, const char **names, uint32_t num_names) {
+    g_assert_nonnull(files);
+    g_assert_cmpuint(darray_get_num_items(files), ==, num_names);
+    for (uint32_t i = 0; i < num_names; i++) {
+        g_assert_cmpstr(db_entry_get_name_raw(darray_get_item(files, i)), ==, names[i]);
+    }
+}
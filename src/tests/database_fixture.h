@@ -0,0 +1,67 @@
+#pragma once
+
+#include <glib.h>
+
+#include <src/fsearch_array.h>
+#include <src/fsearch_database.h>
+#include <src/fsearch_database_entry.h>
+#include <src/fsearch_index.h>
+
+// The folders and indexes of a database test, set up and torn down by g_test_add
+typedef struct {
+    // a temporary folder for the files of the test, it's removed with everything in it on tear down
+    char *root;
+    // a temporary folder for the database files, outside of root so it doesn't end up in the indexes
+    char *db_dir;
+    // the database file which db_save writes to db_dir
+    char *db_file;
+    // the indexes the databases of database_fixture_new_db are created with
+    GList *indexes;
+} DatabaseFixture;
+
+// Adds the test func(DatabaseFixture *fixture, gconstpointer user_data) at path, with a fixture of its own
+#define database_fixture_add(path, user_data, func)                                                                  \
+    g_test_add(path, DatabaseFixture, user_data, database_fixture_set_up, func, database_fixture_tear_down)
+
+void
+database_fixture_set_up(DatabaseFixture *fixture, gconstpointer user_data);
+
+void
+database_fixture_tear_down(DatabaseFixture *fixture, gconstpointer user_data);
+
+// Adds a folder index of path, it can be changed until the next database is created
+FsearchIndex *
+database_fixture_add_index(DatabaseFixture *fixture, const char *path);
+
+// A new database of the indexes, without any excludes
+FsearchDatabase *
+database_fixture_new_db(DatabaseFixture *fixture);
+
+// Like database_fixture_new_db, but it's scanned already
+FsearchDatabase *
+database_fixture_scan(DatabaseFixture *fixture);
+
+// Writes content to the file name in dir and returns its path
+char *
+create_file(const char *dir, const char *name, const char *content);
+
+// The set of "<path> <size>" strings of all entries
+GHashTable *
+get_entries(FsearchDatabase *db);
+
+// Asserts both databases have the same entries with the same sizes
+void
+assert_same_entries(FsearchDatabase *db1, FsearchDatabase *db2);
+
+FsearchDatabaseEntryFolder *
+get_folder(FsearchDatabase *db, const char *path);
+
+// The first file called name, it has to exist
+FsearchDatabaseEntry *
+get_entry(FsearchDatabase *db, const char *name);
+
+void
+assert_sorted(DynamicArray *entries, DynamicArrayCompareDataFunc compare_func);
+
+void
+assert_file_names(DynamicArray *files, const char **names, uint32_t num_names);
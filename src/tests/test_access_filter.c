@@ -0,0 +1,165 @@
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <locale.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <src/fsearch_access_filter.h>
+#include <src/fsearch_database_entry.h>
+#include <src/fsearch_memory_pool.h>
+
+typedef struct {
+    FsearchMemoryPool *folder_pool;
+    FsearchMemoryPool *file_pool;
+} AccessFilterFixture;
+
+static FsearchDatabaseEntry *
+new_entry(AccessFilterFixture *fixture, FsearchDatabaseEntryType type, const char *name, FsearchDatabaseEntry *parent) {
+    FsearchDatabaseEntry *entry =
+        fsearch_memory_pool_malloc(type == DATABASE_ENTRY_TYPE_FOLDER ? fixture->folder_pool : fixture->file_pool);
+    db_entry_set_type(entry, type);
+    db_entry_set_name(entry, name);
+    if (parent) {
+        db_entry_set_parent(entry, (FsearchDatabaseEntryFolder *)parent);
+    }
+    return entry;
+}
+
+// Builds the folders of path, returns the last one
+static FsearchDatabaseEntry *
+new_folders(AccessFilterFixture *fixture, const char *path) {
+    FsearchDatabaseEntry *folder = new_entry(fixture, DATABASE_ENTRY_TYPE_FOLDER, "", NULL);
+    g_auto(GStrv) names = g_strsplit(path, G_DIR_SEPARATOR_S, -1);
+    for (uint32_t i = 0; names[i]; i++) {
+        if (names[i][0] != '\0') {
+            folder = new_entry(fixture, DATABASE_ENTRY_TYPE_FOLDER, names[i], folder);
+        }
+    }
+    return folder;
+}
+
+static void
+fixture_set_up(AccessFilterFixture *fixture) {
+    fixture->folder_pool =
+        fsearch_memory_pool_new(16, db_entry_get_sizeof_folder_entry(), (GDestroyNotify)db_entry_destroy);
+    fixture->file_pool = fsearch_memory_pool_new(16, db_entry_get_sizeof_file_entry(), (GDestroyNotify)db_entry_destroy);
+}
+
+static void
+fixture_tear_down(AccessFilterFixture *fixture) {
+    g_clear_pointer(&fixture->file_pool, fsearch_memory_pool_free_pool);
+    g_clear_pointer(&fixture->folder_pool, fsearch_memory_pool_free_pool);
+}
+
+static void
+test_hides_entries_of_missing_folders(void) {
+    AccessFilterFixture fixture = {0};
+    fixture_set_up(&fixture);
+    g_autofree char *dir = g_dir_make_tmp("fsearch_access_filter_XXXXXX", NULL);
+    g_assert_nonnull(dir);
+
+    // folders which can't be listed, because they don't exist (anymore), and their sub folders hide their entries
+    FsearchDatabaseEntry *listable = new_folders(&fixture, dir);
+    FsearchDatabaseEntry *missing = new_entry(&fixture, DATABASE_ENTRY_TYPE_FOLDER, "missing", listable);
+    FsearchDatabaseEntry *below_missing = new_entry(&fixture, DATABASE_ENTRY_TYPE_FOLDER, "below", missing);
+
+    DynamicArray *entries = darray_new(8);
+    darray_add_item(entries, new_entry(&fixture, DATABASE_ENTRY_TYPE_FILE, "a", listable));
+    darray_add_item(entries, missing);
+    darray_add_item(entries, new_entry(&fixture, DATABASE_ENTRY_TYPE_FILE, "b", missing));
+    darray_add_item(entries, new_entry(&fixture, DATABASE_ENTRY_TYPE_FILE, "c", listable));
+    darray_add_item(entries, new_entry(&fixture, DATABASE_ENTRY_TYPE_FILE, "d", below_missing));
+
+    FsearchAccessFilter *filter = fsearch_access_filter_new();
+    DynamicArray *visible = fsearch_access_filter_apply(filter, entries);
+    g_assert_cmpuint(darray_get_num_items(visible), ==, 3);
+    g_assert_cmpstr(db_entry_get_name_raw(darray_get_item(visible, 0)), ==, "a");
+    g_assert_cmpstr(db_entry_get_name_raw(darray_get_item(visible, 1)), ==, "missing");
+    g_assert_cmpstr(db_entry_get_name_raw(darray_get_item(visible, 2)), ==, "c");
+    g_clear_pointer(&visible, darray_unref);
+
+    // the result of the check is kept, even if the folder shows up
+    g_autofree char *missing_path = g_build_filename(dir, "missing", NULL);
+    g_assert_cmpint(g_mkdir(missing_path, 0700), ==, 0);
+    visible = fsearch_access_filter_apply(filter, entries);
+    g_assert_cmpuint(darray_get_num_items(visible), ==, 3);
+    g_clear_pointer(&visible, darray_unref);
+    // until it gets cleared, only the folder below is still missing
+    fsearch_access_filter_clear(filter);
+    visible = fsearch_access_filter_apply(filter, entries);
+    g_assert_cmpuint(darray_get_num_items(visible), ==, 4);
+    g_assert_cmpstr(db_entry_get_name_raw(darray_get_item(visible, 2)), ==, "b");
+    g_clear_pointer(&visible, darray_unref);
+    g_clear_pointer(&filter, fsearch_access_filter_free);
+
+    // nothing needs to be hidden
+    filter = fsearch_access_filter_new();
+    DynamicArray *listable_entries = darray_new(2);
+    darray_add_item(listable_entries, darray_get_item(entries, 0));
+    darray_add_item(listable_entries, darray_get_item(entries, 2));
+    visible = fsearch_access_filter_apply(filter, listable_entries);
+    g_assert_true(visible == listable_entries);
+    g_clear_pointer(&visible, darray_unref);
+    g_clear_pointer(&listable_entries, darray_unref);
+    g_clear_pointer(&filter, fsearch_access_filter_free);
+
+    filter = fsearch_access_filter_new();
+    g_assert_null(fsearch_access_filter_apply(filter, NULL));
+    g_clear_pointer(&filter, fsearch_access_filter_free);
+
+    g_rmdir(missing_path);
+    g_rmdir(dir);
+    g_clear_pointer(&entries, darray_unref);
+    fixture_tear_down(&fixture);
+}
+
+static void
+test_hides_entries_below_unreadable_folders(void) {
+    if (geteuid() == 0) {
+        g_test_skip("permissions don't apply to root");
+        return;
+    }
+    AccessFilterFixture fixture = {0};
+    fixture_set_up(&fixture);
+    g_autofree char *dir = g_dir_make_tmp("fsearch_access_filter_XXXXXX", NULL);
+    g_assert_nonnull(dir);
+    // the folder can be searched, so the one inside can be listed by everyone who knows its name
+    g_autofree char *secret_path = g_build_filename(dir, "secret", NULL);
+    g_autofree char *inner_path = g_build_filename(secret_path, "inner", NULL);
+    g_assert_cmpint(g_mkdir(secret_path, 0700), ==, 0);
+    g_assert_cmpint(g_mkdir(inner_path, 0700), ==, 0);
+    g_assert_cmpint(g_chmod(secret_path, 0111), ==, 0);
+
+    FsearchDatabaseEntry *listable = new_folders(&fixture, dir);
+    FsearchDatabaseEntry *secret = new_entry(&fixture, DATABASE_ENTRY_TYPE_FOLDER, "secret", listable);
+    FsearchDatabaseEntry *inner = new_entry(&fixture, DATABASE_ENTRY_TYPE_FOLDER, "inner", secret);
+    DynamicArray *entries = darray_new(4);
+    darray_add_item(entries, secret);
+    darray_add_item(entries, inner);
+    darray_add_item(entries, new_entry(&fixture, DATABASE_ENTRY_TYPE_FILE, "a", inner));
+
+    // its path would reveal the contents of the folder which can't be read
+    FsearchAccessFilter *filter = fsearch_access_filter_new();
+    DynamicArray *visible = fsearch_access_filter_apply(filter, entries);
+    g_assert_cmpuint(darray_get_num_items(visible), ==, 1);
+    g_assert_true(darray_get_item(visible, 0) == secret);
+    g_clear_pointer(&visible, darray_unref);
+    g_clear_pointer(&filter, fsearch_access_filter_free);
+
+    g_chmod(secret_path, 0700);
+    g_rmdir(inner_path);
+    g_rmdir(secret_path);
+    g_rmdir(dir);
+    g_clear_pointer(&entries, darray_unref);
+    fixture_tear_down(&fixture);
+}
+
+int
+main(int argc, char *argv[]) {
+    setlocale(LC_ALL, "");
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/FSearch/access_filter/hides_entries_of_missing_folders", test_hides_entries_of_missing_folders);
+    g_test_add_func("/FSearch/access_filter/hides_entries_below_unreadable_folders",
+                    test_hides_entries_below_unreadable_folders);
+    return g_test_run();
+}
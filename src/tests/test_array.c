@@ -178,9 +178,202 @@ test_sort(void) {
     test_single_and_multi_threaded_sort(array, (DynamicArrayCompareDataFunc)sort_version);
 }
 
+static uint64_t
+get_version_major(Version *v) {
+    return v->major;
+}
+
+static int32_t
+sort_version_stable(void **a, void **b, void *data) {
+    // like the database comparators, which keep equal items in order
+    Version *v1 = *a;
+    Version *v2 = *b;
+    return v1->major > v2->major ? 1 : -1;
+}
+
+static void
+test_sort_by_key(void) {
+    // enough items for all threads, and majors which differ in more than one byte
+    const uint32_t num_versions = 600000;
+    Version *versions = calloc(num_versions, sizeof(Version));
+    g_assert(versions);
+    DynamicArray *array = darray_new(num_versions);
+    for (uint32_t i = 0; i < num_versions; i++) {
+        versions[i].major = (int)((i * 2654435761u) % 70000);
+        versions[i].minor = (int)i;
+        darray_add_item(array, &versions[i]);
+    }
+
+    for (uint32_t multi_threaded = 0; multi_threaded < 2; multi_threaded++) {
+        DynamicArray *a1 = darray_copy(array);
+        DynamicArray *a2 = darray_copy(array);
+        darray_sort(a1, (DynamicArrayCompareDataFunc)sort_version_stable, NULL, NULL);
+        darray_sort_by_key(a2, (DynamicArrayKeyFunc)get_version_major, NULL, multi_threaded, NULL);
+        g_assert_cmpuint(darray_get_num_items(a2), ==, num_versions);
+        for (uint32_t i = 0; i < num_versions; ++i) {
+            g_assert(darray_get_item(a1, i) == darray_get_item(a2, i));
+        }
+        g_clear_pointer(&a1, darray_unref);
+        g_clear_pointer(&a2, darray_unref);
+    }
+
+    // a cancelled sort leaves the array as it was
+    GCancellable *cancellable = g_cancellable_new();
+    g_cancellable_cancel(cancellable);
+    DynamicArray *a3 = darray_copy(array);
+    darray_sort_by_key(a3, (DynamicArrayKeyFunc)get_version_major, NULL, true, cancellable);
+    for (uint32_t i = 0; i < num_versions; ++i) {
+        g_assert(darray_get_item(a3, i) == darray_get_item(array, i));
+    }
+    g_clear_object(&cancellable);
+    g_clear_pointer(&a3, darray_unref);
+    g_clear_pointer(&array, darray_unref);
+    g_clear_pointer(&versions, free);
+}
+
+static void
+check_sort_progress(uint32_t percent, uint32_t *last_percent) {
+    g_assert_cmpuint(percent, >, *last_percent);
+    g_assert_cmpuint(percent, <=, 100);
+    *last_percent = percent;
+}
+
+static void
+assert_same_items(DynamicArray *a1, DynamicArray *a2) {
+    g_assert_cmpuint(darray_get_num_items(a1), ==, darray_get_num_items(a2));
+    for (uint32_t i = 0; i < darray_get_num_items(a1); ++i) {
+        g_assert(darray_get_item(a1, i) == darray_get_item(a2, i));
+    }
+}
+
+static void
+test_sort_multi_threaded(void) {
+    // enough items for all runs, which don't have the same size, and lots of equal majors
+    const uint32_t num_versions = 300007;
+    Version *versions = calloc(num_versions, sizeof(Version));
+    g_assert(versions);
+    DynamicArray *array = darray_new(num_versions);
+    for (uint32_t i = 0; i < num_versions; i++) {
+        versions[i].major = (int)((i * 2654435761u) % 1000);
+        versions[i].minor = (int)i;
+        darray_add_item(array, &versions[i]);
+    }
+
+    DynamicArray *expected = darray_copy(array);
+    darray_sort(expected, (DynamicArrayCompareDataFunc)sort_version_stable, NULL, NULL);
+    DynamicArray *sorted = darray_copy(array);
+    uint32_t last_percent = 0;
+    darray_sort_multi_threaded_with_progress(sorted,
+                                             (DynamicArrayCompareDataFunc)sort_version_stable,
+                                             NULL,
+                                             NULL,
+                                             (DynamicArrayProgressFunc)check_sort_progress,
+                                             &last_percent);
+    assert_same_items(expected, sorted);
+    g_assert_cmpuint(last_percent, >, 50);
+    g_clear_pointer(&sorted, darray_unref);
+
+    // all parts of the result come from a single run
+    sorted = darray_copy(expected);
+    darray_sort_multi_threaded(sorted, (DynamicArrayCompareDataFunc)sort_version_stable, NULL, NULL);
+    assert_same_items(expected, sorted);
+    g_clear_pointer(&sorted, darray_unref);
+
+    // a cancelled sort leaves the array as it was
+    GCancellable *cancellable = g_cancellable_new();
+    g_cancellable_cancel(cancellable);
+    sorted = darray_copy(array);
+    darray_sort_multi_threaded(sorted, (DynamicArrayCompareDataFunc)sort_version_stable, cancellable, NULL);
+    assert_same_items(array, sorted);
+    g_clear_pointer(&sorted, darray_unref);
+    g_clear_object(&cancellable);
+
+    g_clear_pointer(&expected, darray_unref);
+    g_clear_pointer(&array, darray_unref);
+    g_clear_pointer(&versions, free);
+}
+
+static void
+test_copy_and_slice(void) {
+    DynamicArray *array = darray_new(4);
+    for (int i = 0; i < 100; i++) {
+        darray_add_item(array, GINT_TO_POINTER(i));
+    }
+
+    DynamicArray *copy = darray_copy(array);
+    DynamicArray *slice = darray_new_slice(array, 10, 20);
+    g_assert(darray_get_items_id(copy) == darray_get_items_id(array));
+    g_assert_cmpuint(darray_get_num_items(slice), ==, 20);
+    for (int i = 0; i < 20; i++) {
+        g_assert_cmpint(GPOINTER_TO_INT(darray_get_item(slice, i)), ==, i + 10);
+    }
+
+    // changing one side doesn't change the others
+    darray_add_item(array, GINT_TO_POINTER(100));
+    darray_add_item(slice, GINT_TO_POINTER(-1));
+    g_assert(darray_get_items_id(copy) != darray_get_items_id(array));
+    g_assert_cmpuint(darray_get_num_items(array), ==, 101);
+    g_assert_cmpuint(darray_get_num_items(copy), ==, 100);
+    g_assert_cmpuint(darray_get_num_items(slice), ==, 21);
+    g_assert_cmpint(GPOINTER_TO_INT(darray_get_item(slice, 20)), ==, -1);
+    g_assert_cmpint(GPOINTER_TO_INT(darray_get_item(copy, 30)), ==, 30);
+
+    DynamicArray *sorted = darray_copy(copy);
+    darray_sort(sorted, (DynamicArrayCompareDataFunc)sort_int_descending, NULL, NULL);
+    for (int i = 0; i < 100; i++) {
+        g_assert_cmpint(GPOINTER_TO_INT(darray_get_item(copy, i)), ==, i);
+        g_assert_cmpint(GPOINTER_TO_INT(darray_get_item(sorted, i)), ==, 99 - i);
+    }
+
+    g_clear_pointer(&sorted, darray_unref);
+    g_clear_pointer(&slice, darray_unref);
+    g_clear_pointer(&copy, darray_unref);
+    g_clear_pointer(&array, darray_unref);
+}
+
+static void
+search_range(void) {
+    const int32_t items[] = {0, 1, 1, 1, 2, 4, 4};
+    DynamicArray *array = darray_new(10);
+    for (uint32_t i = 0; i < G_N_ELEMENTS(items); ++i) {
+        darray_add_item(array, GINT_TO_POINTER(items[i]));
+    }
+
+    const struct {
+        int32_t item;
+        bool found;
+        uint32_t start;
+        uint32_t end;
+    } expected[] = {
+        {0, true, 0, 1},
+        {1, true, 1, 4},
+        {2, true, 4, 5},
+        {3, false, 5, 5},
+        {4, true, 5, 7},
+        {5, false, 7, 7},
+        {-1, false, 0, 0},
+    };
+    for (uint32_t i = 0; i < G_N_ELEMENTS(expected); ++i) {
+        uint32_t start = 0;
+        uint32_t end = 0;
+        g_assert_true(darray_binary_search_range_with_data(array,
+                                                           GINT_TO_POINTER(expected[i].item),
+                                                           (DynamicArrayCompareDataFunc)sort_int_ascending,
+                                                           NULL,
+                                                           &start,
+                                                           &end)
+                      == expected[i].found);
+        g_assert_cmpuint(start, ==, expected[i].start);
+        g_assert_cmpuint(end, ==, expected[i].end);
+    }
+
+    g_clear_pointer(&array, darray_unref);
+}
+
 static void
 test_search(void) {
     same_elements();
+    search_range();
 }
 
 int
@@ -188,6 +381,9 @@ main(int argc, char *argv[]) {
     g_test_init(&argc, &argv, NULL);
     g_test_add_func("/FSearch/array/main", test_main);
     g_test_add_func("/FSearch/array/sort", test_sort);
+    g_test_add_func("/FSearch/array/sort_by_key", test_sort_by_key);
+    g_test_add_func("/FSearch/array/sort_multi_threaded", test_sort_multi_threaded);
+    g_test_add_func("/FSearch/array/copy_and_slice", test_copy_and_slice);
     g_test_add_func("/FSearch/array/search", test_search);
     return g_test_run();
 }
@@ -0,0 +1,106 @@
+#include <glib.h>
+#include <locale.h>
+#include <string.h>
+
+#include <src/fsearch_daemon_protocol.h>
+#include <src/fsearch_memory_pool.h>
+
+static void
+test_parse_search(void) {
+    FsearchDaemonRequest request = {.limit = FSEARCH_DAEMON_DEFAULT_LIMIT, .flags = QUERY_FLAG_AUTO_MATCH_CASE};
+    const char *error_message = NULL;
+    g_assert_true(fsearch_daemon_request_parse(
+        "SEARCH offset=20 limit=5 sort=size order=desc  match_case=1 regex=1\tfoo bar",
+        &request,
+        &error_message));
+    g_assert_cmpint(request.type, ==, FSEARCH_DAEMON_REQUEST_SEARCH);
+    g_assert_cmpstr(request.query_text, ==, "foo bar");
+    g_assert_cmpuint(request.offset, ==, 20);
+    g_assert_cmpuint(request.limit, ==, 5);
+    g_assert_cmpint(request.sort_order, ==, DATABASE_INDEX_TYPE_SIZE);
+    g_assert_true(request.descending);
+    g_assert_cmpint(request.flags, ==, QUERY_FLAG_AUTO_MATCH_CASE | QUERY_FLAG_MATCH_CASE | QUERY_FLAG_REGEX);
+
+    // options which aren't given keep their values
+    g_assert_true(fsearch_daemon_request_parse("SEARCH regex=0\t", &request, &error_message));
+    g_assert_cmpstr(request.query_text, ==, "");
+    g_assert_cmpuint(request.limit, ==, 5);
+    g_assert_cmpint(request.flags, ==, QUERY_FLAG_AUTO_MATCH_CASE | QUERY_FLAG_MATCH_CASE);
+    fsearch_daemon_request_clear(&request);
+    g_assert_null(request.query_text);
+}
+
+static void
+test_parse_ping(void) {
+    FsearchDaemonRequest request = {0};
+    const char *error_message = NULL;
+    g_assert_true(fsearch_daemon_request_parse("PING", &request, &error_message));
+    g_assert_cmpint(request.type, ==, FSEARCH_DAEMON_REQUEST_PING);
+    g_assert_null(request.query_text);
+}
+
+static void
+test_parse_invalid(void) {
+    const char *lines[] = {
+        "",
+        "FIND\tfoo",
+        "SEARCH",
+        "SEARCH foo",
+        "SEARCHING\tfoo",
+        "SEARCH limit\tfoo",
+        "SEARCH limit=-1\tfoo",
+        "SEARCH limit=1000001\tfoo",
+        "SEARCH offset=12x\tfoo",
+        "SEARCH offset=99999999999\tfoo",
+        "SEARCH sort=accessed\tfoo",
+        "SEARCH order=up\tfoo",
+        "SEARCH regex=yes\tfoo",
+        "SEARCH color=red\tfoo",
+    };
+    for (uint32_t i = 0; i < G_N_ELEMENTS(lines); i++) {
+        FsearchDaemonRequest request = {0};
+        const char *error_message = NULL;
+        g_assert_false(fsearch_daemon_request_parse(lines[i], &request, &error_message));
+        g_assert_nonnull(error_message);
+        g_assert_null(request.query_text);
+    }
+}
+
+static void
+test_append_path(void) {
+    FsearchMemoryPool *folder_pool =
+        fsearch_memory_pool_new(16, db_entry_get_sizeof_folder_entry(), (GDestroyNotify)db_entry_destroy);
+    FsearchMemoryPool *file_pool =
+        fsearch_memory_pool_new(16, db_entry_get_sizeof_file_entry(), (GDestroyNotify)db_entry_destroy);
+
+    FsearchDatabaseEntry *root = fsearch_memory_pool_malloc(folder_pool);
+    db_entry_set_type(root, DATABASE_ENTRY_TYPE_FOLDER);
+    db_entry_set_name(root, "");
+    FsearchDatabaseEntry *folder = fsearch_memory_pool_malloc(folder_pool);
+    db_entry_set_type(folder, DATABASE_ENTRY_TYPE_FOLDER);
+    db_entry_set_name(folder, "back\\slash");
+    db_entry_set_parent(folder, (FsearchDatabaseEntryFolder *)root);
+    FsearchDatabaseEntry *file = fsearch_memory_pool_malloc(file_pool);
+    db_entry_set_type(file, DATABASE_ENTRY_TYPE_FILE);
+    db_entry_set_name(file, "line\nbreak\r");
+    db_entry_set_parent(file, (FsearchDatabaseEntryFolder *)folder);
+
+    g_autoptr(GString) response = g_string_new(NULL);
+    fsearch_daemon_append_path(response, root);
+    fsearch_daemon_append_path(response, file);
+    g_assert_cmpstr(response->str, ==, "/\n/back\\\\slash/line\\nbreak\\r\n");
+
+    g_clear_pointer(&file_pool, fsearch_memory_pool_free_pool);
+    g_clear_pointer(&folder_pool, fsearch_memory_pool_free_pool);
+}
+
+int
+main(int argc, char *argv[]) {
+    setlocale(LC_ALL, "");
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/FSearch/daemon_protocol/parse_search", test_parse_search);
+    g_test_add_func("/FSearch/daemon_protocol/parse_ping", test_parse_ping);
+    g_test_add_func("/FSearch/daemon_protocol/parse_invalid", test_parse_invalid);
+    g_test_add_func("/FSearch/daemon_protocol/append_path", test_append_path);
+    return g_test_run();
+}
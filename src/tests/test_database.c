@@ -0,0 +1,229 @@
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdint.h>
+
+#include "database_fixture.h"
+
+static void
+test_sync_entries(DatabaseFixture *fixture, gconstpointer user_data) {
+    const char *root = fixture->root;
+    g_autofree char *sub = g_build_filename(root, "sub", NULL);
+    g_autofree char *moved = g_build_filename(root, "moved", NULL);
+    g_assert_cmpint(g_mkdir(sub, 0755), ==, 0);
+    g_autofree char *file_a = create_file(root, "a.txt", "a");
+    g_autofree char *file_b = create_file(sub, "b.txt", "bb");
+    g_autofree char *file_c = create_file(root, "c.txt", "c");
+
+    database_fixture_add_index(fixture, root);
+    FsearchDatabase *db = database_fixture_scan(fixture);
+    g_assert_cmpuint(db_get_num_files(db), ==, 3);
+    g_assert_cmpuint(db_get_num_folders(db), ==, 2);
+
+    // grow a file, add one, remove one and move a folder
+    g_free(create_file(root, "a.txt", "aaaa"));
+    g_autofree char *file_d = create_file(root, "d.txt", "dddddd");
+    g_assert_cmpint(g_remove(file_c), ==, 0);
+    g_assert_cmpint(g_rename(sub, moved), ==, 0);
+
+    db_lock(db);
+    FsearchDatabaseEntryFolder *root_folder = get_folder(db, root);
+    const char *changed[] = {"a.txt", "d.txt", "c.txt", "sub", "moved"};
+    for (uint32_t i = 0; i < G_N_ELEMENTS(changed); i++) {
+        db_sync_entry(db, root_folder, changed[i], NULL, NULL);
+    }
+    g_assert_true(db_apply_changes(db));
+    g_assert_false(db_apply_changes(db));
+    db_unlock(db);
+
+    FsearchDatabase *db_scanned = database_fixture_scan(fixture);
+    assert_same_entries(db_scanned, db);
+
+    const struct {
+        FsearchDatabaseIndexType type;
+        DynamicArrayCompareDataFunc func;
+    } sort_orders[] = {
+        {DATABASE_INDEX_TYPE_NAME, (DynamicArrayCompareDataFunc)db_entry_compare_entries_by_name},
+        {DATABASE_INDEX_TYPE_PATH, (DynamicArrayCompareDataFunc)db_entry_compare_entries_by_path},
+        {DATABASE_INDEX_TYPE_SIZE, (DynamicArrayCompareDataFunc)db_entry_compare_entries_by_size},
+        {DATABASE_INDEX_TYPE_MODIFICATION_TIME, (DynamicArrayCompareDataFunc)db_entry_compare_entries_by_modification_time},
+    };
+    for (uint32_t i = 0; i < G_N_ELEMENTS(sort_orders); i++) {
+        DynamicArray *files = db_get_files_sorted(db, sort_orders[i].type);
+        DynamicArray *folders = db_get_folders_sorted(db, sort_orders[i].type);
+        g_assert_cmpuint(darray_get_num_items(files), ==, db_get_num_files(db));
+        g_assert_cmpuint(darray_get_num_items(folders), ==, db_get_num_folders(db));
+        assert_sorted(files, sort_orders[i].func);
+        assert_sorted(folders, sort_orders[i].func);
+        g_clear_pointer(&files, darray_unref);
+        g_clear_pointer(&folders, darray_unref);
+    }
+
+    g_clear_pointer(&db, db_unref);
+    g_clear_pointer(&db_scanned, db_unref);
+}
+
+// user_data tells if the sort orders are built lazily, without the path order which is used to find the entries
+static void
+test_sync_paths(DatabaseFixture *fixture, gconstpointer user_data) {
+    const bool lazy = GPOINTER_TO_INT(user_data);
+    const char *root = fixture->root;
+    g_autofree char *sub = g_build_filename(root, "sub", NULL);
+    g_assert_cmpint(g_mkdir(sub, 0755), ==, 0);
+    g_autofree char *file_a = create_file(root, "a.txt", "a");
+    g_autofree char *file_b = create_file(sub, "b.txt", "bb");
+    g_autofree char *file_c = create_file(sub, "c.txt", "c");
+    g_autofree char *file_kept = create_file(root, "kept.txt", "kept");
+
+    database_fixture_add_index(fixture, root);
+    FsearchDatabase *db = database_fixture_new_db(fixture);
+    db_set_lazy_sort_indexes(db, lazy);
+    g_assert_true(db_scan(db, NULL, NULL));
+    g_assert_cmpuint(db_get_num_files(db), ==, 4);
+    g_assert_cmpuint(db_get_num_folders(db), ==, 2);
+    g_assert_true(db_has_entries_sorted_by_type(db, DATABASE_INDEX_TYPE_PATH) == !lazy);
+
+    g_assert_cmpint(g_remove(file_b), ==, 0);
+    g_assert_cmpint(g_remove(file_c), ==, 0);
+    g_assert_cmpint(g_remove(sub), ==, 0);
+    g_assert_cmpint(g_remove(file_a), ==, 0);
+
+    g_autoptr(GPtrArray) paths = g_ptr_array_new();
+    g_ptr_array_add(paths, file_b);
+    g_ptr_array_add(paths, file_c);
+    g_ptr_array_add(paths, sub);
+    g_ptr_array_add(paths, file_a);
+    // outside of the database
+    g_ptr_array_add(paths, "/fsearch_test_missing/a.txt");
+    g_ptr_array_add(paths, "/");
+
+    db_lock(db);
+    db_sync_paths(db, paths);
+    g_assert_true(db_apply_changes(db));
+    db_unlock(db);
+    g_assert_cmpuint(db_get_num_files(db), ==, 1);
+    g_assert_cmpuint(db_get_num_folders(db), ==, 1);
+    g_assert_nonnull(get_entry(db, "kept.txt"));
+
+    g_clear_pointer(&db, db_unref);
+}
+
+static void
+on_folder_added(FsearchDatabaseEntryFolder *folder, const char *path, gpointer user_data) {
+    g_ptr_array_add(user_data, g_strdup(path));
+}
+
+static void
+test_sync_folders(DatabaseFixture *fixture, gconstpointer user_data) {
+    const char *root = fixture->root;
+    g_autofree char *sub = g_build_filename(root, "sub", NULL);
+    g_autofree char *unchanged = g_build_filename(root, "unchanged", NULL);
+    g_autofree char *added = g_build_filename(sub, "added", NULL);
+    g_assert_cmpint(g_mkdir(sub, 0755), ==, 0);
+    g_assert_cmpint(g_mkdir(unchanged, 0755), ==, 0);
+    g_autofree char *file_a = create_file(root, "a.txt", "a");
+    g_autofree char *file_b = create_file(sub, "b.txt", "bb");
+    g_autofree char *file_c = create_file(unchanged, "c.txt", "c");
+
+    database_fixture_add_index(fixture, root);
+    FsearchDatabase *db = database_fixture_scan(fixture);
+    g_assert_cmpuint(db_get_num_files(db), ==, 3);
+    g_assert_cmpuint(db_get_num_folders(db), ==, 3);
+
+    // grow a file, remove one and add a folder with contents
+    g_free(create_file(root, "a.txt", "aaaa"));
+    g_assert_cmpint(g_remove(file_b), ==, 0);
+    g_assert_cmpint(g_mkdir(added, 0755), ==, 0);
+    g_free(create_file(added, "d.txt", "d"));
+
+    g_autoptr(GPtrArray) added_folders = g_ptr_array_new_with_free_func(g_free);
+    g_autoptr(GHashTable) folders = g_hash_table_new(NULL, NULL);
+    db_lock(db);
+    g_hash_table_add(folders, get_folder(db, root));
+    g_hash_table_add(folders, get_folder(db, sub));
+    db_sync_folders(db, folders, on_folder_added, added_folders);
+    g_assert_true(db_apply_changes(db));
+    db_unlock(db);
+
+    g_assert_cmpuint(added_folders->len, ==, 1);
+    g_assert_cmpstr(g_ptr_array_index(added_folders, 0), ==, added);
+    g_assert_cmpuint(db_get_num_files(db), ==, 3);
+    g_assert_cmpuint(db_get_num_folders(db), ==, 4);
+    g_assert_nonnull(get_entry(db, "d.txt"));
+
+    FsearchDatabase *db_scanned = database_fixture_scan(fixture);
+    assert_same_entries(db_scanned, db);
+
+    g_clear_pointer(&db, db_unref);
+    g_clear_pointer(&db_scanned, db_unref);
+}
+
+static void
+test_versions(DatabaseFixture *fixture, gconstpointer user_data) {
+    const char *root = fixture->root;
+    g_autofree char *file_a = create_file(root, "a.txt", "a");
+
+    database_fixture_add_index(fixture, root);
+    FsearchDatabase *db = database_fixture_new_db(fixture);
+    FsearchDatabaseVersion *empty = db_pin_version(db);
+    g_assert_nonnull(empty);
+    g_assert_cmpuint(empty->num_files, ==, 0);
+
+    g_assert_true(db_scan(db, NULL, NULL));
+    FsearchDatabaseVersion *scanned = db_pin_version(db);
+    g_assert_cmpuint(scanned->id, >, empty->id);
+    g_assert_cmpuint(scanned->num_files, ==, 1);
+    g_assert_cmpuint(scanned->num_folders, ==, 1);
+
+    // nothing changed, so there's no new version
+    db_lock(db);
+    db_unlock(db);
+    FsearchDatabaseVersion *unchanged = db_pin_version(db);
+    g_assert_true(unchanged == scanned);
+    g_clear_pointer(&unchanged, db_version_unref);
+
+    g_autofree char *file_b = create_file(root, "b.txt", "b");
+    db_lock(db);
+    DynamicArray *folders = db_get_folders(db);
+    db_sync_entry(db, darray_get_item(folders, 0), "b.txt", NULL, NULL);
+    g_clear_pointer(&folders, darray_unref);
+    g_assert_true(db_apply_changes(db));
+    // changes aren't visible until the lock is released
+    FsearchDatabaseVersion *pending = db_pin_version(db);
+    g_assert_true(pending == scanned);
+    g_clear_pointer(&pending, db_version_unref);
+    db_unlock(db);
+
+    FsearchDatabaseVersion *changed = db_pin_version(db);
+    g_assert_cmpuint(changed->id, >, scanned->id);
+    g_assert_cmpuint(changed->num_files, ==, 2);
+    // the previous version stays as it was
+    DynamicArray *files = db_version_get_files(scanned);
+    g_assert_cmpuint(darray_get_num_items(files), ==, 1);
+    g_clear_pointer(&files, darray_unref);
+
+    FsearchDatabaseIndexType sort_type = DATABASE_INDEX_TYPE_NAME;
+    DynamicArray *sorted_folders = NULL;
+    DynamicArray *sorted_files = NULL;
+    g_assert_true(
+        db_version_get_entries_sorted(changed, DATABASE_INDEX_TYPE_SIZE, &sort_type, &sorted_folders, &sorted_files));
+    g_assert_cmpint(sort_type, ==, DATABASE_INDEX_TYPE_SIZE);
+    g_assert_cmpuint(darray_get_num_items(sorted_files), ==, 2);
+    g_clear_pointer(&sorted_folders, darray_unref);
+    g_clear_pointer(&sorted_files, darray_unref);
+
+    g_clear_pointer(&empty, db_version_unref);
+    g_clear_pointer(&scanned, db_version_unref);
+    g_clear_pointer(&changed, db_version_unref);
+    g_clear_pointer(&db, db_unref);
+}
+
+int
+main(int argc, char *argv[]) {
+    g_test_init(&argc, &argv, NULL);
+    database_fixture_add("/FSearch/database/sync_entries", NULL, test_sync_entries);
+    database_fixture_add("/FSearch/database/sync_paths", GINT_TO_POINTER(false), test_sync_paths);
+    database_fixture_add("/FSearch/database/sync_paths_lazy", GINT_TO_POINTER(true), test_sync_paths);
+    database_fixture_add("/FSearch/database/sync_folders", NULL, test_sync_folders);
+    database_fixture_add("/FSearch/database/versions", NULL, test_versions);
+    return g_test_run();
+}
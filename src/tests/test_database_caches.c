@@ -0,0 +1,612 @@
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <src/fsearch_database_search.h>
+
+#include "database_fixture.h"
+
+static void
+assert_columns_match_entries(FsearchDatabaseColumns *columns, DynamicArray *entries) {
+    g_assert_nonnull(columns);
+    g_assert_cmpuint(columns->num_entries, ==, darray_get_num_items(entries));
+    for (uint32_t i = 0; i < columns->num_entries; i++) {
+        FsearchDatabaseEntry *entry = darray_get_item(entries, i);
+        g_assert_cmpint(columns->type, ==, db_entry_get_type(entry));
+        g_assert_cmpint(columns->sizes[i], ==, db_entry_get_size(entry));
+        g_assert_cmpint(columns->mtimes[i], ==, db_entry_get_mtime(entry));
+    }
+}
+
+static void
+test_columns(DatabaseFixture *fixture, gconstpointer user_data) {
+    const char *root = fixture->root;
+    g_free(create_file(root, "a.txt", "a"));
+    g_free(create_file(root, "b.txt", "bbb"));
+
+    database_fixture_add_index(fixture, root);
+    FsearchDatabase *db = database_fixture_scan(fixture);
+
+    db_lock(db);
+    DynamicArray *files = db_get_files_sorted(db, DATABASE_INDEX_TYPE_SIZE);
+    DynamicArray *folders = db_get_folders_sorted(db, DATABASE_INDEX_TYPE_NAME);
+    FsearchDatabaseColumns *file_columns = db_get_columns(db, files);
+    FsearchDatabaseColumns *folder_columns = db_get_columns(db, folders);
+    assert_columns_match_entries(file_columns, files);
+    assert_columns_match_entries(folder_columns, folders);
+    g_assert_cmpint(file_columns->sizes[1], ==, 3);
+
+    // cached as long as the entries don't change
+    FsearchDatabaseColumns *cached = db_get_columns(db, files);
+    g_assert_true(cached == file_columns);
+    g_clear_pointer(&cached, db_columns_unref);
+
+    g_free(create_file(root, "a.txt", "aaaaa"));
+    db_sync_entry(db, get_folder(db, root), "a.txt", NULL, NULL);
+    g_assert_true(db_apply_changes(db));
+    g_clear_pointer(&files, darray_unref);
+    files = db_get_files_sorted(db, DATABASE_INDEX_TYPE_SIZE);
+    cached = db_get_columns(db, files);
+    g_assert_true(cached != file_columns);
+    assert_columns_match_entries(cached, files);
+    g_assert_cmpint(cached->sizes[1], ==, 5);
+    db_unlock(db);
+
+    g_clear_pointer(&cached, db_columns_unref);
+    g_clear_pointer(&file_columns, db_columns_unref);
+    g_clear_pointer(&folder_columns, db_columns_unref);
+    g_clear_pointer(&files, darray_unref);
+    g_clear_pointer(&folders, darray_unref);
+    g_clear_pointer(&db, db_unref);
+}
+
+static void
+assert_ranks_sort(FsearchDatabaseRanks *ranks, DynamicArray *names, uint32_t step) {
+    DynamicArray *results = darray_new(16);
+    for (uint32_t i = 0; i < darray_get_num_items(names); i += step) {
+        darray_add_item(results, darray_get_item(names, i));
+    }
+    DynamicArray *sorted = db_ranks_sort(ranks, results);
+    g_assert_nonnull(sorted);
+    g_assert_cmpuint(darray_get_num_items(sorted), ==, darray_get_num_items(results));
+    uint32_t j = 0;
+    for (uint32_t i = 0; i < darray_get_num_items(ranks->entries); i++) {
+        void *entry = darray_get_item(ranks->entries, i);
+        if (db_entry_get_idx(entry) % step == 0) {
+            g_assert_true(darray_get_item(sorted, j++) == entry);
+        }
+    }
+    g_assert_cmpuint(j, ==, darray_get_num_items(results));
+    g_clear_pointer(&sorted, darray_unref);
+    g_clear_pointer(&results, darray_unref);
+}
+
+static void
+test_ranks(DatabaseFixture *fixture, gconstpointer user_data) {
+    const char *root = fixture->root;
+    for (uint32_t i = 0; i < 40; i++) {
+        g_autofree char *name = g_strdup_printf("%02u.txt", i);
+        char contents[16] = "";
+        memset(contents, 'x', (i * 7) % 13 + 1);
+        g_free(create_file(root, name, contents));
+    }
+
+    database_fixture_add_index(fixture, root);
+    FsearchDatabase *db = database_fixture_scan(fixture);
+
+    db_lock(db);
+    DynamicArray *files = db_get_files_sorted(db, DATABASE_INDEX_TYPE_SIZE);
+    DynamicArray *names = db_get_files_sorted(db, DATABASE_INDEX_TYPE_NAME);
+    FsearchDatabaseRanks *ranks = db_get_ranks(db, files);
+    g_assert_nonnull(ranks);
+    // small results are sorted by their ranks, large ones by scanning all of them
+    assert_ranks_sort(ranks, names, 1);
+    assert_ranks_sort(ranks, names, 3);
+    assert_ranks_sort(ranks, names, 39);
+
+    // entries which aren't ranked can't be sorted
+    DynamicArray *folders = db_get_folders_sorted(db, DATABASE_INDEX_TYPE_NAME);
+    g_assert_null(db_ranks_sort(ranks, folders));
+
+    // cached as long as the entries don't change
+    FsearchDatabaseRanks *cached = db_get_ranks(db, files);
+    g_assert_true(cached == ranks);
+    g_clear_pointer(&cached, db_ranks_unref);
+
+    g_free(create_file(root, "00.txt", "xxxxxxxxxxxxxxxxxxxx"));
+    db_sync_entry(db, get_folder(db, root), "00.txt", NULL, NULL);
+    g_assert_true(db_apply_changes(db));
+    g_clear_pointer(&files, darray_unref);
+    g_clear_pointer(&names, darray_unref);
+    files = db_get_files_sorted(db, DATABASE_INDEX_TYPE_SIZE);
+    names = db_get_files_sorted(db, DATABASE_INDEX_TYPE_NAME);
+    cached = db_get_ranks(db, files);
+    g_assert_true(cached != ranks);
+    assert_ranks_sort(cached, names, 2);
+    db_unlock(db);
+
+    g_clear_pointer(&cached, db_ranks_unref);
+    g_clear_pointer(&ranks, db_ranks_unref);
+    g_clear_pointer(&files, darray_unref);
+    g_clear_pointer(&names, darray_unref);
+    g_clear_pointer(&folders, darray_unref);
+    g_clear_pointer(&db, db_unref);
+}
+
+static void
+test_search_cache(DatabaseFixture *fixture, gconstpointer user_data) {
+    const char *root = fixture->root;
+    g_free(create_file(root, "a.txt", "a"));
+
+    database_fixture_add_index(fixture, root);
+    FsearchDatabase *db = database_fixture_new_db(fixture);
+    db_set_search_cache_size(db, 1024 * 1024);
+    g_assert_true(db_scan(db, NULL, NULL));
+
+    db_lock(db);
+    FsearchDatabaseSearchCache *cache = db_get_search_cache(db);
+    DynamicArray *files = db_get_files(db);
+    DynamicArray *folders = db_get_folders(db);
+    db_search_cache_insert(cache, "a", folders, files, DATABASE_INDEX_TYPE_NAME);
+    g_clear_pointer(&files, darray_unref);
+    g_clear_pointer(&folders, darray_unref);
+    g_assert_cmpuint(db_search_cache_get_num_entries(cache), ==, 1);
+
+    FsearchDatabaseMemoryStats stats;
+    db_memory_stats_init(&stats);
+    db_get_memory_stats(db, &stats);
+    g_assert_cmpuint(stats.search_results, >, 0);
+    db_memory_stats_clear(&stats);
+
+    // the results are outdated once the entries change
+    g_free(create_file(root, "a.txt", "aaa"));
+    db_sync_entry(db, get_folder(db, root), "a.txt", NULL, NULL);
+    g_assert_true(db_apply_changes(db));
+    g_assert_cmpuint(db_search_cache_get_num_entries(cache), ==, 0);
+    db_unlock(db);
+
+    g_clear_pointer(&db, db_unref);
+}
+
+static void
+assert_folder_paths_match_entries(FsearchDatabaseFolderPaths *paths, DynamicArray *entries) {
+    for (uint32_t i = 0; i < darray_get_num_items(entries); i++) {
+        FsearchDatabaseEntry *entry = darray_get_item(entries, i);
+        g_autoptr(GString) path = db_entry_get_path(entry);
+        g_autoptr(GString) path_full = db_entry_get_path_full(entry);
+        g_autoptr(GString) cached_path = g_string_new(NULL);
+        g_autoptr(GString) cached_path_full = g_string_new(NULL);
+        db_folder_paths_append_path(paths, entry, cached_path);
+        db_folder_paths_append_full_path(paths, entry, cached_path_full);
+        g_assert_cmpstr(cached_path->str, ==, path->str);
+        g_assert_cmpstr(cached_path_full->str, ==, path_full->str);
+    }
+}
+
+static void
+test_folder_paths(DatabaseFixture *fixture, gconstpointer user_data) {
+    const char *root = fixture->root;
+    g_autofree char *sub = g_build_filename(root, "sub", NULL);
+    g_autofree char *sub_sub = g_build_filename(sub, "sub", NULL);
+    g_autofree char *added = g_build_filename(root, "added", NULL);
+    g_assert_cmpint(g_mkdir(sub, 0755), ==, 0);
+    g_assert_cmpint(g_mkdir(sub_sub, 0755), ==, 0);
+    g_free(create_file(root, "a.txt", "a"));
+    g_free(create_file(sub_sub, "b.txt", "b"));
+
+    database_fixture_add_index(fixture, root);
+    FsearchDatabase *db = database_fixture_scan(fixture);
+
+    db_lock(db);
+    DynamicArray *files = db_get_files(db);
+    DynamicArray *folders = db_get_folders(db);
+    FsearchDatabaseFolderPaths *paths = db_get_folder_paths(db);
+    g_assert_nonnull(paths);
+    assert_folder_paths_match_entries(paths, files);
+    assert_folder_paths_match_entries(paths, folders);
+    g_clear_pointer(&paths, db_folder_paths_unref);
+
+    // entries which were added after the paths were created fall back to building the path
+    paths = db_get_folder_paths(db);
+    g_assert_cmpint(g_mkdir(added, 0755), ==, 0);
+    g_free(create_file(added, "c.txt", "c"));
+    db_sync_entry(db, get_folder(db, root), "added", NULL, NULL);
+    FsearchDatabaseEntry *file = calloc(1, db_entry_get_sizeof_file_entry());
+    g_assert_nonnull(file);
+    db_entry_set_type(file, DATABASE_ENTRY_TYPE_FILE);
+    db_entry_set_name(file, "c.txt");
+    DynamicArray *added_files = darray_new(1);
+    darray_add_item(added_files, file);
+    g_assert_true(db_apply_changes(db));
+    db_entry_set_parent(file, get_folder(db, added));
+    assert_folder_paths_match_entries(paths, added_files);
+    db_unlock(db);
+
+    g_clear_pointer(&added_files, darray_unref);
+    db_entry_destroy(file);
+    g_clear_pointer(&file, free);
+    g_clear_pointer(&paths, db_folder_paths_unref);
+    g_clear_pointer(&files, darray_unref);
+    g_clear_pointer(&folders, darray_unref);
+    g_clear_pointer(&db, db_unref);
+}
+
+static const char *
+get_folded_name(FsearchDatabase *db, FsearchDatabaseFoldedNames *names, const char *name) {
+    const char *folded = NULL;
+    DynamicArray *files = db_get_files(db);
+    for (uint32_t i = 0; i < darray_get_num_items(files); i++) {
+        FsearchDatabaseEntry *entry = darray_get_item(files, i);
+        if (!strcmp(db_entry_get_name_raw(entry), name)) {
+            g_assert_true(db_folded_names_lookup(names, entry, &folded));
+            folded = folded ? folded : name;
+        }
+    }
+    g_clear_pointer(&files, darray_unref);
+    g_assert_nonnull(folded);
+    return folded;
+}
+
+static void
+test_folded_names(DatabaseFixture *fixture, gconstpointer user_data) {
+    const char *root = fixture->root;
+    g_free(create_file(root, "plain.txt", "a"));
+    g_free(create_file(root, "\xc3\x84rger.TXT", "b"));
+    g_free(create_file(root, "Stra\xc3\x9f" "e", "c"));
+
+    database_fixture_add_index(fixture, root);
+    FsearchDatabase *db = database_fixture_scan(fixture);
+
+    db_lock(db);
+    FsearchDatabaseFoldedNames *names = db_get_folded_names(db);
+    g_assert_nonnull(names);
+    g_assert_null(names->contents);
+    g_assert_cmpstr(get_folded_name(db, names, "plain.txt"), ==, "plain.txt");
+    // folded and decomposed, like the needles of searches
+    g_assert_cmpstr(get_folded_name(db, names, "\xc3\x84rger.TXT"), ==, "a\xcc\x88rger.txt");
+    g_assert_cmpstr(get_folded_name(db, names, "Stra\xc3\x9f" "e"), ==, "strasse");
+    // they're cached until the entries change
+    FsearchDatabaseFoldedNames *cached = db_get_folded_names(db);
+    g_assert_true(cached == names);
+    g_clear_pointer(&cached, db_folded_names_unref);
+    db_unlock(db);
+    g_assert_true(db_save(db, fixture->db_dir));
+
+    FsearchDatabase *db_loaded = database_fixture_new_db(fixture);
+    g_assert_true(db_load(db_loaded, fixture->db_file, NULL));
+    db_lock(db_loaded);
+    FsearchDatabaseFoldedNames *names_loaded = db_get_folded_names(db_loaded);
+    g_assert_nonnull(names_loaded);
+    g_assert_nonnull(names_loaded->contents);
+    g_assert_cmpstr(get_folded_name(db_loaded, names_loaded, "plain.txt"), ==, "plain.txt");
+    g_assert_cmpstr(get_folded_name(db_loaded, names_loaded, "\xc3\x84rger.TXT"), ==, "a\xcc\x88rger.txt");
+
+    // entries which were added afterwards aren't part of them, the next ones take the rest from them
+    g_free(create_file(root, "NEW", "d"));
+    db_sync_entry(db_loaded, get_folder(db_loaded, root), "NEW", NULL, NULL);
+    g_assert_true(db_apply_changes(db_loaded));
+    FsearchDatabaseFoldedNames *names_changed = db_get_folded_names(db_loaded);
+    g_assert_false(names_changed == names_loaded);
+    g_assert_cmpstr(get_folded_name(db_loaded, names_changed, "NEW"), ==, "new");
+    g_assert_cmpstr(get_folded_name(db_loaded, names_changed, "Stra\xc3\x9f" "e"), ==, "strasse");
+    db_unlock(db_loaded);
+
+    g_clear_pointer(&names, db_folded_names_unref);
+    g_clear_pointer(&names_loaded, db_folded_names_unref);
+    g_clear_pointer(&names_changed, db_folded_names_unref);
+    g_clear_pointer(&db, db_unref);
+    g_clear_pointer(&db_loaded, db_unref);
+}
+
+static void
+test_filter_matches(DatabaseFixture *fixture, gconstpointer user_data) {
+    const char *root = fixture->root;
+    g_free(create_file(root, "report.pdf", "a"));
+    g_free(create_file(root, "notes.txt", "b"));
+    g_free(create_file(root, "draft.pdf", "c"));
+
+    database_fixture_add_index(fixture, root);
+    FsearchDatabase *db = database_fixture_scan(fixture);
+
+    FsearchFilterManager *manager = fsearch_filter_manager_new_with_defaults();
+    FsearchFilter *filter = fsearch_filter_new("PDF", NULL, "ext:pdf", 0);
+    fsearch_filter_manager_append_filter(manager, filter);
+
+    db_lock(db);
+    // queries without a filter don't have any
+    FsearchQuery *unfiltered = fsearch_query_new("report", NULL, manager, 0, "debug_query");
+    g_assert_null(db_get_filter_matches(db, unfiltered, NULL));
+
+    FsearchQuery *q1 = fsearch_query_new("report", filter, manager, 0, "debug_query");
+    DatabaseSearchFilterMatches *matches = db_get_filter_matches(db, q1, NULL);
+    g_assert_nonnull(matches);
+    g_assert_cmpuint(matches->num_folder_matches, ==, 0);
+    g_assert_cmpuint(matches->num_file_matches, ==, 2);
+
+    // other queries with the same filter reuse them
+    FsearchQuery *q2 = fsearch_query_new("notes", filter, manager, 0, "debug_query");
+    DatabaseSearchFilterMatches *cached = db_get_filter_matches(db, q2, NULL);
+    g_assert_true(cached == matches);
+    g_clear_pointer(&cached, db_search_filter_matches_unref);
+
+    DynamicArray *folders = db_get_folders(db);
+    DynamicArray *files = db_get_files(db);
+    DatabaseSearchResult *result = db_search(q1,
+                                             db_get_thread_pool(db),
+                                             folders,
+                                             files,
+                                             NULL,
+                                             NULL,
+                                             NULL,
+                                             NULL,
+                                             NULL,
+                                             NULL,
+                                             NULL,
+                                             NULL,
+                                             matches,
+                                             DATABASE_INDEX_TYPE_NAME,
+                                             NULL,
+                                             NULL,
+                                             NULL);
+    g_assert_nonnull(result);
+    g_assert_cmpuint(darray_get_num_items(result->folders), ==, 0);
+    g_assert_cmpuint(darray_get_num_items(result->files), ==, 1);
+    // only the two files which match the filter had to be matched against the query
+    g_assert_cmpuint(result->stats.num_entries_scanned, ==, 2);
+    g_assert_cmpuint(result->stats.num_results, ==, 1);
+    g_assert_cmpuint(result->stats.num_threads, ==, 1);
+    g_clear_pointer(&result->folders, darray_unref);
+    g_clear_pointer(&result->files, darray_unref);
+    g_clear_pointer(&result, free);
+    g_clear_pointer(&folders, darray_unref);
+    g_clear_pointer(&files, darray_unref);
+
+    FsearchDatabaseMemoryStats stats;
+    db_memory_stats_init(&stats);
+    db_get_memory_stats(db, &stats);
+    g_assert_cmpuint(stats.filter_matches, >, 0);
+    db_memory_stats_clear(&stats);
+
+    // a changed filter is matched again
+    fsearch_filter_manager_edit(manager, filter, filter->name, filter->macro, "ext:txt", filter->flags);
+    FsearchQuery *q3 = fsearch_query_new("notes", filter, manager, 0, "debug_query");
+    DatabaseSearchFilterMatches *changed = db_get_filter_matches(db, q3, NULL);
+    g_assert_nonnull(changed);
+    g_assert_true(changed != matches);
+    g_assert_cmpuint(changed->num_file_matches, ==, 1);
+    g_clear_pointer(&changed, db_search_filter_matches_unref);
+    db_unlock(db);
+
+    g_clear_pointer(&matches, db_search_filter_matches_unref);
+    g_clear_pointer(&unfiltered, fsearch_query_unref);
+    g_clear_pointer(&q1, fsearch_query_unref);
+    g_clear_pointer(&q2, fsearch_query_unref);
+    g_clear_pointer(&q3, fsearch_query_unref);
+    g_clear_pointer(&filter, fsearch_filter_unref);
+    g_clear_pointer(&manager, fsearch_filter_manager_free);
+    g_clear_pointer(&db, db_unref);
+}
+
+static void
+test_trigrams(DatabaseFixture *fixture, gconstpointer user_data) {
+    const char *root = fixture->root;
+    g_free(create_file(root, "report.txt", "a"));
+    g_free(create_file(root, "notes.md", "b"));
+
+    database_fixture_add_index(fixture, root);
+    FsearchDatabase *db = database_fixture_scan(fixture);
+
+    db_lock(db);
+    // it's disabled by default
+    g_assert_null(db_get_trigrams(db));
+    db_set_trigram_index(db, true);
+    FsearchDatabaseTrigrams *trigrams = db_get_trigrams(db);
+    g_assert_nonnull(trigrams);
+    g_assert_null(trigrams->contents);
+    g_assert_cmpuint(trigrams->file_trigrams.num_entries, ==, 2);
+    FsearchDatabaseTrigrams *cached = db_get_trigrams(db);
+    g_assert_true(cached == trigrams);
+    g_clear_pointer(&cached, db_trigrams_unref);
+
+    FsearchDatabaseMemoryStats stats;
+    db_memory_stats_init(&stats);
+    db_get_memory_stats(db, &stats);
+    g_assert_cmpuint(stats.trigrams, >, 0);
+    db_memory_stats_clear(&stats);
+    db_unlock(db);
+    g_assert_true(db_save(db, fixture->db_dir));
+
+    FsearchDatabase *db_loaded = database_fixture_new_db(fixture);
+    db_set_trigram_index(db_loaded, true);
+    g_assert_true(db_load(db_loaded, fixture->db_file, NULL));
+    db_lock(db_loaded);
+    // the index is taken from the file
+    FsearchDatabaseTrigrams *trigrams_loaded = db_get_trigrams(db_loaded);
+    g_assert_nonnull(trigrams_loaded);
+    g_assert_nonnull(trigrams_loaded->contents);
+    const FsearchDatabaseTrigramList *a = &trigrams->file_trigrams;
+    const FsearchDatabaseTrigramList *b = &trigrams_loaded->file_trigrams;
+    g_assert_cmpuint(a->num_keys, ==, b->num_keys);
+    g_assert_cmpmem(a->postings, a->offsets[a->num_keys], b->postings, b->offsets[b->num_keys]);
+
+    // and built again once the entries change
+    g_free(create_file(root, "report_2.txt", "c"));
+    db_sync_entry(db_loaded, get_folder(db_loaded, root), "report_2.txt", NULL, NULL);
+    g_assert_true(db_apply_changes(db_loaded));
+    FsearchDatabaseTrigrams *trigrams_changed = db_get_trigrams(db_loaded);
+    g_assert_false(trigrams_changed == trigrams_loaded);
+    g_assert_null(trigrams_changed->contents);
+    g_assert_cmpuint(trigrams_changed->file_trigrams.num_entries, ==, 3);
+    db_unlock(db_loaded);
+
+    g_clear_pointer(&trigrams, db_trigrams_unref);
+    g_clear_pointer(&trigrams_loaded, db_trigrams_unref);
+    g_clear_pointer(&trigrams_changed, db_trigrams_unref);
+    g_clear_pointer(&db, db_unref);
+    g_clear_pointer(&db_loaded, db_unref);
+}
+
+static uint32_t
+get_extension_id(FsearchDatabase *db, FsearchDatabaseExtensions *extensions, const char *name) {
+    bool found = false;
+    uint32_t id = 0;
+    DynamicArray *files = db_get_files(db);
+    for (uint32_t i = 0; i < darray_get_num_items(files); i++) {
+        FsearchDatabaseEntry *entry = darray_get_item(files, i);
+        if (!strcmp(db_entry_get_name_raw(entry), name)) {
+            found = db_extensions_lookup(extensions, entry, &id);
+        }
+    }
+    g_clear_pointer(&files, darray_unref);
+    g_assert_true(found);
+    return id;
+}
+
+static void
+test_extensions(DatabaseFixture *fixture, gconstpointer user_data) {
+    const char *root = fixture->root;
+    const char *names[] = {"b.txt", "a.png", "c.TXT", "a.txt", "noext", ".hidden", "z.tar.gz", "dot."};
+    for (uint32_t i = 0; i < G_N_ELEMENTS(names); i++) {
+        g_free(create_file(root, names[i], "x"));
+    }
+
+    database_fixture_add_index(fixture, root);
+    FsearchDatabase *db = database_fixture_scan(fixture);
+
+    db_lock(db);
+    FsearchDatabaseExtensions *extensions = db_get_extensions(db);
+    g_assert_nonnull(extensions);
+    // "", "txt", "png", "TXT" and "gz"
+    g_assert_cmpuint(db_extensions_get_num_ids(extensions), ==, 5);
+    g_assert_cmpuint(get_extension_id(db, extensions, "noext"), ==, 0);
+    g_assert_cmpuint(get_extension_id(db, extensions, ".hidden"), ==, 0);
+    g_assert_cmpuint(get_extension_id(db, extensions, "dot."), ==, 0);
+    g_assert_cmpuint(get_extension_id(db, extensions, "a.txt"), ==, get_extension_id(db, extensions, "b.txt"));
+    g_assert_cmpuint(get_extension_id(db, extensions, "a.txt"), !=, get_extension_id(db, extensions, "c.TXT"));
+    g_assert_cmpstr(db_extensions_get_name(extensions, get_extension_id(db, extensions, "z.tar.gz")), ==, "gz");
+    // the posting lists hold the positions of the files with an extension, in ascending order
+    uint32_t num_postings = 0;
+    const uint32_t *postings =
+        db_extensions_get_postings(extensions, get_extension_id(db, extensions, "a.txt"), &num_postings);
+    g_assert_cmpuint(num_postings, ==, 2);
+    g_assert_cmpuint(postings[0], <, postings[1]);
+    DynamicArray *files_by_name = db_get_files(db);
+    g_assert_cmpstr(db_entry_get_name_raw(darray_get_item(files_by_name, postings[0])), ==, "a.txt");
+    g_assert_cmpstr(db_entry_get_name_raw(darray_get_item(files_by_name, postings[1])), ==, "b.txt");
+    g_clear_pointer(&files_by_name, darray_unref);
+    db_extensions_get_postings(extensions, 0, &num_postings);
+    g_assert_cmpuint(num_postings, ==, 3);
+    g_assert_null(db_extensions_get_postings(extensions, db_extensions_get_num_ids(extensions), &num_postings));
+    g_assert_cmpuint(num_postings, ==, 0);
+
+    // folders don't have an extension id
+    uint32_t id = 0;
+    g_assert_false(db_extensions_lookup(extensions, (FsearchDatabaseEntry *)get_folder(db, root), &id));
+
+    // the buckets are in the same order as a stable sort with the comparator
+    DynamicArray *files = db_get_files(db);
+    DynamicArray *expected = darray_copy(files);
+    darray_sort(expected, (DynamicArrayCompareDataFunc)db_entry_compare_entries_by_extension, NULL, NULL);
+    DynamicArray *sorted = db_extensions_sort_files(extensions);
+    g_assert_cmpuint(darray_get_num_items(sorted), ==, darray_get_num_items(expected));
+    for (uint32_t i = 0; i < darray_get_num_items(expected); i++) {
+        g_assert_true(darray_get_item(sorted, i) == darray_get_item(expected, i));
+    }
+    DynamicArray *sorted_by_db = db_get_files_sorted(db, DATABASE_INDEX_TYPE_EXTENSION);
+    for (uint32_t i = 0; i < darray_get_num_items(expected); i++) {
+        g_assert_true(darray_get_item(sorted_by_db, i) == darray_get_item(expected, i));
+    }
+
+    // files which were added afterwards aren't part of them, the next ones are interned again
+    g_free(create_file(root, "new.png", "x"));
+    db_sync_entry(db, get_folder(db, root), "new.png", NULL, NULL);
+    g_assert_true(db_apply_changes(db));
+    DynamicArray *files_changed = db_get_files(db);
+    for (uint32_t i = 0; i < darray_get_num_items(files_changed); i++) {
+        FsearchDatabaseEntry *entry = darray_get_item(files_changed, i);
+        if (!strcmp(db_entry_get_name_raw(entry), "new.png")) {
+            g_assert_false(db_extensions_lookup(extensions, entry, &id));
+        }
+    }
+    FsearchDatabaseExtensions *extensions_changed = db_get_extensions(db);
+    g_assert_false(extensions_changed == extensions);
+    g_assert_cmpuint(get_extension_id(db, extensions_changed, "new.png"),
+                     ==,
+                     get_extension_id(db, extensions_changed, "a.png"));
+    db_unlock(db);
+
+    g_clear_pointer(&files, darray_unref);
+    g_clear_pointer(&files_changed, darray_unref);
+    g_clear_pointer(&expected, darray_unref);
+    g_clear_pointer(&sorted, darray_unref);
+    g_clear_pointer(&sorted_by_db, darray_unref);
+    g_clear_pointer(&extensions, db_extensions_unref);
+    g_clear_pointer(&extensions_changed, db_extensions_unref);
+    g_clear_pointer(&db, db_unref);
+}
+
+static void
+test_file_types(DatabaseFixture *fixture, gconstpointer user_data) {
+    const char *root = fixture->root;
+    const char *names[] = {"b.txt", "a.png", "c.TXT", "a.txt", "Makefile", "z.tar.gz", "d.png", "Makefile.in"};
+    for (uint32_t i = 0; i < G_N_ELEMENTS(names); i++) {
+        g_free(create_file(root, names[i], "x"));
+    }
+
+    database_fixture_add_index(fixture, root);
+    FsearchDatabase *db = database_fixture_scan(fixture);
+
+    db_lock(db);
+    // the type order is built by the database now, in the same order as a stable sort with the comparator
+    g_assert_true(db_ensure_entries_sorted(db, DATABASE_INDEX_TYPE_FILETYPE, NULL));
+    DynamicArray *files = db_get_files(db);
+    DynamicArray *expected = darray_copy(files);
+    FsearchDatabaseEntryCompareContext comp_ctx = {
+        .file_type_table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL),
+        .entry_to_file_type_table = g_hash_table_new(NULL, NULL),
+    };
+    darray_sort(expected, (DynamicArrayCompareDataFunc)db_entry_compare_entries_by_type, NULL, &comp_ctx);
+    DynamicArray *sorted = db_get_files_sorted(db, DATABASE_INDEX_TYPE_FILETYPE);
+    g_assert_nonnull(sorted);
+    g_assert_cmpuint(darray_get_num_items(sorted), ==, darray_get_num_items(expected));
+    for (uint32_t i = 0; i < darray_get_num_items(expected); i++) {
+        g_assert_true(darray_get_item(sorted, i) == darray_get_item(expected, i));
+    }
+    // all folders have the same type
+    DynamicArray *folders = db_get_folders_sorted(db, DATABASE_INDEX_TYPE_FILETYPE);
+    DynamicArray *folders_by_name = db_get_folders(db);
+    g_assert_true(folders == folders_by_name);
+
+    FsearchDatabaseMemoryStats stats;
+    db_memory_stats_init(&stats);
+    db_get_memory_stats(db, &stats);
+    g_assert_cmpuint(stats.file_types, >, 0);
+    db_memory_stats_clear(&stats);
+    db_unlock(db);
+
+    g_clear_pointer(&comp_ctx.entry_to_file_type_table, g_hash_table_unref);
+    g_clear_pointer(&comp_ctx.file_type_table, g_hash_table_unref);
+    g_clear_pointer(&folders, darray_unref);
+    g_clear_pointer(&folders_by_name, darray_unref);
+    g_clear_pointer(&sorted, darray_unref);
+    g_clear_pointer(&expected, darray_unref);
+    g_clear_pointer(&files, darray_unref);
+    g_clear_pointer(&db, db_unref);
+}
+
+int
+main(int argc, char *argv[]) {
+    g_test_init(&argc, &argv, NULL);
+    database_fixture_add("/FSearch/database/columns", NULL, test_columns);
+    database_fixture_add("/FSearch/database/ranks", NULL, test_ranks);
+    database_fixture_add("/FSearch/database/search_cache", NULL, test_search_cache);
+    database_fixture_add("/FSearch/database/folder_paths", NULL, test_folder_paths);
+    database_fixture_add("/FSearch/database/folded_names", NULL, test_folded_names);
+    database_fixture_add("/FSearch/database/filter_matches", NULL, test_filter_matches);
+    database_fixture_add("/FSearch/database/trigrams", NULL, test_trigrams);
+    database_fixture_add("/FSearch/database/extensions", NULL, test_extensions);
+    database_fixture_add("/FSearch/database/file_types", NULL, test_file_types);
+    return g_test_run();
+}
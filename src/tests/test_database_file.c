@@ -0,0 +1,616 @@
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <utime.h>
+
+#include "database_fixture.h"
+
+static void
+test_save_load(DatabaseFixture *fixture, gconstpointer user_data) {
+    g_autofree char *sub = g_build_filename(fixture->root, "sub", NULL);
+    g_assert_cmpint(g_mkdir(sub, 0755), ==, 0);
+    g_free(create_file(fixture->root, "a.txt", "a"));
+    g_free(create_file(sub, "b.txt", "bb"));
+    g_free(create_file(sub, "c.txt", "ccc"));
+
+    database_fixture_add_index(fixture, sub);
+    FsearchDatabase *db = database_fixture_new_db(fixture);
+    db_set_index_flags(db, DATABASE_INDEX_FLAG_SIZE | DATABASE_INDEX_FLAG_MODIFICATION_TIME);
+    g_assert_true(db_scan(db, NULL, NULL));
+    g_assert_true(db_save(db, fixture->db_dir));
+
+    // the timestamp is the time the scan started, not the one the file was written
+    struct utimbuf db_file_times = {.actime = db_get_timestamp(db) + 100, .modtime = db_get_timestamp(db) + 100};
+    g_assert_cmpint(g_utime(fixture->db_file, &db_file_times), ==, 0);
+    FsearchDatabase *db_loaded = database_fixture_new_db(fixture);
+    g_assert_true(db_load(db_loaded, fixture->db_file, NULL));
+    g_assert_cmpuint(db_get_num_files(db_loaded), ==, 2);
+    g_assert_cmpuint(db_get_num_folders(db_loaded), ==, 1);
+    g_assert_cmpuint(db_get_index_flags(db_loaded), ==, db_get_index_flags(db));
+    g_assert_cmpint(db_get_timestamp(db_loaded), ==, db_get_timestamp(db));
+    assert_same_entries(db, db_loaded);
+
+    FsearchDatabaseEntryFolder *folder = get_folder(db_loaded, sub);
+    g_assert_cmpuint(db_entry_folder_get_num_files(folder), ==, 2);
+    DynamicArray *files = db_get_files_sorted(db_loaded, DATABASE_INDEX_TYPE_SIZE);
+    g_assert_cmpuint(darray_get_num_items(files), ==, 2);
+    assert_sorted(files, (DynamicArrayCompareDataFunc)db_entry_compare_entries_by_size);
+    g_assert_cmpint(db_entry_get_mtime(darray_get_item(files, 0)), !=, 0);
+    g_clear_pointer(&files, darray_unref);
+
+    // renaming an entry must not touch the mapped name
+    FsearchDatabaseEntry *entry = (FsearchDatabaseEntry *)folder;
+    db_entry_set_name(entry, "renamed");
+    g_assert_cmpstr(db_entry_get_name_raw(entry), ==, "renamed");
+    // the database only frees the names it owns itself
+    db_entry_destroy(entry);
+
+    // a truncated file must be rejected
+    g_autofree char *contents = NULL;
+    gsize length = 0;
+    g_assert_true(g_file_get_contents(fixture->db_file, &contents, &length, NULL));
+    g_assert_true(g_file_set_contents(fixture->db_file, contents, (gssize)length / 2, NULL));
+    FsearchDatabase *db_truncated = database_fixture_new_db(fixture);
+    g_assert_false(db_load(db_truncated, fixture->db_file, NULL));
+
+    g_clear_pointer(&db, db_unref);
+    g_clear_pointer(&db_loaded, db_unref);
+    g_clear_pointer(&db_truncated, db_unref);
+}
+
+static void
+test_folder_ids(DatabaseFixture *fixture, gconstpointer user_data) {
+    const char *root = fixture->root;
+    database_fixture_add_index(fixture, root);
+    FsearchDatabase *db = database_fixture_scan(fixture);
+    const uint32_t root_id = db_entry_folder_get_id(get_folder(db, root));
+    g_assert_cmpuint(root_id, !=, 0);
+    g_assert_true(db_save(db, fixture->db_dir));
+
+    // the ids are stored in the database file
+    FsearchDatabase *db_loaded = database_fixture_new_db(fixture);
+    g_assert_true(db_load(db_loaded, fixture->db_file, NULL));
+    g_assert_cmpuint(db_entry_folder_get_id(get_folder(db_loaded, root)), ==, root_id);
+
+    // a rescan keeps them and gives new folders ids which weren't used before
+    g_autofree char *new_folder = g_build_filename(root, "new", NULL);
+    g_assert_cmpint(g_mkdir(new_folder, 0755), ==, 0);
+    FsearchDatabase *db_rescanned = database_fixture_new_db(fixture);
+    g_assert_true(db_scan_incremental(db_rescanned, db_loaded, NULL, NULL));
+    g_assert_cmpuint(db_entry_folder_get_id(get_folder(db_rescanned, root)), ==, root_id);
+    const uint32_t new_folder_id = db_entry_folder_get_id(get_folder(db_rescanned, new_folder));
+    g_assert_cmpuint(new_folder_id, !=, 0);
+    g_assert_cmpuint(new_folder_id, !=, root_id);
+
+    g_clear_pointer(&db, db_unref);
+    g_clear_pointer(&db_loaded, db_unref);
+    g_clear_pointer(&db_rescanned, db_unref);
+}
+
+static void
+test_save_load_chunks(DatabaseFixture *fixture, gconstpointer user_data) {
+    const char *root = fixture->root;
+    // enough files for the names to be split into multiple chunks and the compressed file into multiple blocks
+    const uint32_t num_folders = 7;
+    const uint32_t num_files_per_folder = 10000;
+    for (uint32_t i = 0; i < num_folders; i++) {
+        g_autofree char *name = g_strdup_printf("folder_%u", i);
+        g_autofree char *folder = g_build_filename(root, name, NULL);
+        g_assert_cmpint(g_mkdir(folder, 0755), ==, 0);
+        for (uint32_t j = 0; j < num_files_per_folder; j++) {
+            g_autofree char *file_name = g_strdup_printf("file_%u_%u", i, j);
+            g_free(create_file(folder, file_name, ""));
+        }
+    }
+
+    database_fixture_add_index(fixture, root);
+    FsearchDatabase *db = database_fixture_scan(fixture);
+    g_assert_cmpuint(db_get_num_files(db), ==, num_folders * num_files_per_folder);
+
+    for (uint32_t compress = 0; compress <= 1; compress++) {
+        db_set_compress(db, compress);
+        g_assert_true(db_save(db, fixture->db_dir));
+
+        FsearchDatabase *db_loaded = database_fixture_new_db(fixture);
+        g_assert_true(db_load(db_loaded, fixture->db_file, NULL));
+        g_assert_cmpuint(db_get_num_files(db_loaded), ==, db_get_num_files(db));
+        g_assert_cmpuint(db_get_num_folders(db_loaded), ==, db_get_num_folders(db));
+        assert_same_entries(db, db_loaded);
+        for (uint32_t i = 0; i < num_folders; i++) {
+            g_autofree char *name = g_strdup_printf("folder_%u", i);
+            g_autofree char *folder = g_build_filename(root, name, NULL);
+            g_assert_cmpuint(db_entry_folder_get_num_files(get_folder(db_loaded, folder)), ==, num_files_per_folder);
+        }
+        g_clear_pointer(&db_loaded, db_unref);
+    }
+
+    g_clear_pointer(&db, db_unref);
+}
+
+static void
+test_journal(DatabaseFixture *fixture, gconstpointer user_data) {
+    const char *root = fixture->root;
+    // the database file needs to be a lot larger than the changes, otherwise they're not journaled
+    const uint32_t num_files = 500;
+    for (uint32_t i = 0; i < num_files; i++) {
+        g_autofree char *name = g_strdup_printf("file_%u", i);
+        g_free(create_file(root, name, "f"));
+    }
+    g_autofree char *sub = g_build_filename(root, "sub", NULL);
+    g_autofree char *moved = g_build_filename(root, "moved", NULL);
+    g_assert_cmpint(g_mkdir(sub, 0755), ==, 0);
+    g_free(create_file(sub, "b.txt", "bb"));
+
+    database_fixture_add_index(fixture, root);
+    FsearchDatabase *db = database_fixture_scan(fixture);
+    g_assert_true(db_save(db, fixture->db_dir));
+    // nothing changed yet
+    g_assert_true(db_save_changes(db, fixture->db_dir));
+
+    g_autofree char *journal_file = g_build_filename(fixture->db_dir, "fsearch.db.journal", NULL);
+    g_assert_false(g_file_test(journal_file, G_FILE_TEST_EXISTS));
+
+    // grow a file, add one, remove one and move a folder
+    g_free(create_file(root, "file_0", "ffff"));
+    g_free(create_file(root, "d.txt", "dddddd"));
+    g_autofree char *file_1 = g_build_filename(root, "file_1", NULL);
+    g_assert_cmpint(g_remove(file_1), ==, 0);
+    g_assert_cmpint(g_rename(sub, moved), ==, 0);
+
+    db_lock(db);
+    FsearchDatabaseEntryFolder *root_folder = get_folder(db, root);
+    const char *changed[] = {"file_0", "d.txt", "file_1", "sub", "moved"};
+    for (uint32_t i = 0; i < G_N_ELEMENTS(changed); i++) {
+        db_sync_entry(db, root_folder, changed[i], NULL, NULL);
+    }
+    g_assert_true(db_apply_changes(db));
+    db_unlock(db);
+
+    g_autofree char *db_file_contents = NULL;
+    g_assert_true(g_file_get_contents(fixture->db_file, &db_file_contents, NULL, NULL));
+    g_assert_true(db_save_changes(db, fixture->db_dir));
+    g_assert_true(g_file_test(journal_file, G_FILE_TEST_EXISTS));
+
+    // only the journal gets written, the database file stays the same
+    g_autofree char *db_file_contents_after = NULL;
+    g_assert_true(g_file_get_contents(fixture->db_file, &db_file_contents_after, NULL, NULL));
+    g_assert_cmpstr(db_file_contents, ==, db_file_contents_after);
+
+    FsearchDatabase *db_loaded = database_fixture_new_db(fixture);
+    g_assert_true(db_load(db_loaded, fixture->db_file, NULL));
+    assert_same_entries(db, db_loaded);
+    g_assert_cmpuint(db_get_num_files(db_loaded), ==, db_get_num_files(db));
+    g_assert_cmpuint(db_get_num_folders(db_loaded), ==, db_get_num_folders(db));
+    g_clear_pointer(&db_loaded, db_unref);
+
+    // removing most of the files makes the journal too large, so everything gets saved again
+    db_lock(db);
+    for (uint32_t i = 2; i < num_files; i++) {
+        g_autofree char *name = g_strdup_printf("file_%u", i);
+        g_autofree char *file = g_build_filename(root, name, NULL);
+        g_assert_cmpint(g_remove(file), ==, 0);
+        db_sync_entry(db, root_folder, name, NULL, NULL);
+    }
+    g_assert_true(db_apply_changes(db));
+    g_assert_true(db_save_changes(db, fixture->db_dir));
+    db_wait_for_save(db);
+    db_unlock(db);
+    g_assert_false(g_file_test(journal_file, G_FILE_TEST_EXISTS));
+
+    db_loaded = database_fixture_new_db(fixture);
+    g_assert_true(db_load(db_loaded, fixture->db_file, NULL));
+    assert_same_entries(db, db_loaded);
+    g_clear_pointer(&db_loaded, db_unref);
+
+    g_clear_pointer(&db, db_unref);
+}
+
+static void
+test_save_load_type_order(DatabaseFixture *fixture, gconstpointer user_data) {
+    const char *root = fixture->root;
+    const char *names[] = {"a.txt", "b.png", "c.txt", "d.png"};
+    for (uint32_t i = 0; i < G_N_ELEMENTS(names); i++) {
+        g_free(create_file(root, names[i], names[i]));
+    }
+
+    database_fixture_add_index(fixture, root);
+    FsearchDatabase *db = database_fixture_scan(fixture);
+    g_assert_true(db_save(db, fixture->db_dir));
+    g_assert_false(db_has_entries_sorted_by_type(db, DATABASE_INDEX_TYPE_FILETYPE));
+
+    // the database stores whatever order it gets, the view is responsible for sorting by type
+    const char *type_order[] = {"b.png", "d.png", "a.txt", "c.txt"};
+    DynamicArray *files = db_get_files(db);
+    DynamicArray *sorted_files = darray_new(G_N_ELEMENTS(type_order));
+    for (uint32_t i = 0; i < G_N_ELEMENTS(type_order); i++) {
+        for (uint32_t j = 0; j < darray_get_num_items(files); j++) {
+            FsearchDatabaseEntry *entry = darray_get_item(files, j);
+            if (!strcmp(db_entry_get_name_raw(entry), type_order[i])) {
+                darray_add_item(sorted_files, entry);
+            }
+        }
+    }
+    g_clear_pointer(&files, darray_unref);
+
+    db_lock(db);
+    db_set_entries_sorted(db, DATABASE_INDEX_TYPE_FILETYPE, sorted_files);
+    g_clear_pointer(&sorted_files, darray_unref);
+    g_assert_true(db_has_entries_sorted_by_type(db, DATABASE_INDEX_TYPE_FILETYPE));
+    // there are no changes to the entries, but the new order has to be saved anyway
+    g_assert_true(db_save_changes(db, fixture->db_dir));
+    db_wait_for_save(db);
+    db_unlock(db);
+    g_clear_pointer(&db, db_unref);
+
+    db = database_fixture_new_db(fixture);
+    g_assert_true(db_load(db, fixture->db_file, NULL));
+    g_assert_true(db_has_entries_sorted_by_type(db, DATABASE_INDEX_TYPE_FILETYPE));
+    files = db_get_files_sorted(db, DATABASE_INDEX_TYPE_FILETYPE);
+    assert_file_names(files, type_order, G_N_ELEMENTS(type_order));
+    g_clear_pointer(&files, darray_unref);
+
+    // removing a file keeps the order of the others
+    db_lock(db);
+    FsearchDatabaseEntryFolder *root_folder = get_folder(db, root);
+    g_autofree char *file_b = g_build_filename(root, "b.png", NULL);
+    g_assert_cmpint(g_remove(file_b), ==, 0);
+    db_sync_entry(db, root_folder, "b.png", NULL, NULL);
+    g_assert_true(db_apply_changes(db));
+    files = db_get_files_sorted(db, DATABASE_INDEX_TYPE_FILETYPE);
+    assert_file_names(files, type_order + 1, G_N_ELEMENTS(type_order) - 1);
+    g_clear_pointer(&files, darray_unref);
+
+    // the type of a new file is unknown, so the order has to be built again
+    g_free(create_file(root, "e.txt", "e"));
+    db_sync_entry(db, root_folder, "e.txt", NULL, NULL);
+    g_assert_true(db_apply_changes(db));
+    g_assert_false(db_has_entries_sorted_by_type(db, DATABASE_INDEX_TYPE_FILETYPE));
+    db_unlock(db);
+    g_clear_pointer(&db, db_unref);
+}
+
+static void
+assert_same_order(DynamicArray *a, DynamicArray *b) {
+    g_assert_nonnull(a);
+    g_assert_nonnull(b);
+    g_assert_cmpuint(darray_get_num_items(a), ==, darray_get_num_items(b));
+    for (uint32_t i = 0; i < darray_get_num_items(a); i++) {
+        g_autoptr(GString) path_a = db_entry_get_path_full(darray_get_item(a, i));
+        g_autoptr(GString) path_b = db_entry_get_path_full(darray_get_item(b, i));
+        g_assert_cmpstr(path_a->str, ==, path_b->str);
+    }
+}
+
+static void
+test_lazy_sort_indexes(DatabaseFixture *fixture, gconstpointer user_data) {
+    const char *root = fixture->root;
+    const char *names[] = {"c.txt", "a.png", "b", "d.txt"};
+    for (uint32_t i = 0; i < G_N_ELEMENTS(names); i++) {
+        g_free(create_file(root, names[i], names[i]));
+    }
+    const FsearchDatabaseIndexType secondary_types[] = {
+        DATABASE_INDEX_TYPE_PATH,
+        DATABASE_INDEX_TYPE_SIZE,
+        DATABASE_INDEX_TYPE_MODIFICATION_TIME,
+        DATABASE_INDEX_TYPE_EXTENSION,
+    };
+
+    database_fixture_add_index(fixture, root);
+    FsearchDatabase *db = database_fixture_new_db(fixture);
+    db_set_index_flags(db, DATABASE_INDEX_FLAG_SIZE | DATABASE_INDEX_FLAG_MODIFICATION_TIME);
+    g_assert_true(db_scan(db, NULL, NULL));
+    g_assert_true(db_save(db, fixture->db_dir));
+
+    FsearchDatabase *db_lazy = database_fixture_new_db(fixture);
+    db_set_index_flags(db_lazy, DATABASE_INDEX_FLAG_SIZE | DATABASE_INDEX_FLAG_MODIFICATION_TIME);
+    db_set_lazy_sort_indexes(db_lazy, true);
+    g_assert_true(db_scan(db_lazy, NULL, NULL));
+    g_assert_true(db_has_entries_sorted_by_type(db_lazy, DATABASE_INDEX_TYPE_NAME));
+    for (uint32_t i = 0; i < G_N_ELEMENTS(secondary_types); i++) {
+        g_assert_false(db_has_entries_sorted_by_type(db_lazy, secondary_types[i]));
+    }
+    // sorted on demand
+    g_assert_true(db_ensure_entries_sorted(db_lazy, DATABASE_INDEX_TYPE_SIZE, NULL));
+    DynamicArray *files = db_get_files_sorted(db_lazy, DATABASE_INDEX_TYPE_SIZE);
+    g_assert_cmpuint(darray_get_num_items(files), ==, G_N_ELEMENTS(names));
+    assert_sorted(files, (DynamicArrayCompareDataFunc)db_entry_compare_entries_by_size);
+    g_clear_pointer(&files, darray_unref);
+    // the type order is built from the file types of the database
+    g_assert_true(db_ensure_entries_sorted(db_lazy, DATABASE_INDEX_TYPE_FILETYPE, NULL));
+    g_clear_pointer(&db_lazy, db_unref);
+
+    // loaded on demand from the database file
+    db_lazy = database_fixture_new_db(fixture);
+    db_set_lazy_sort_indexes(db_lazy, true);
+    g_assert_true(db_load(db_lazy, fixture->db_file, NULL));
+    for (uint32_t i = 0; i < G_N_ELEMENTS(secondary_types); i++) {
+        g_assert_false(db_has_entries_sorted_by_type(db_lazy, secondary_types[i]));
+    }
+    g_assert_true(db_ensure_entries_sorted(db_lazy, DATABASE_INDEX_TYPE_PATH, NULL));
+
+    // saving keeps the orders which weren't loaded
+    g_assert_true(db_save(db_lazy, fixture->db_dir));
+    g_clear_pointer(&db_lazy, db_unref);
+    FsearchDatabase *db_loaded = database_fixture_new_db(fixture);
+    g_assert_true(db_load(db_loaded, fixture->db_file, NULL));
+    for (uint32_t i = 0; i < G_N_ELEMENTS(secondary_types); i++) {
+        const FsearchDatabaseIndexType type = secondary_types[i];
+        g_assert_true(db_has_entries_sorted_by_type(db_loaded, type));
+        DynamicArray *expected_files = db_get_files_sorted(db, type);
+        DynamicArray *loaded_files = db_get_files_sorted(db_loaded, type);
+        assert_same_order(expected_files, loaded_files);
+        g_clear_pointer(&expected_files, darray_unref);
+        g_clear_pointer(&loaded_files, darray_unref);
+    }
+    g_clear_pointer(&db_loaded, db_unref);
+
+    // after a change the orders of the file are outdated and need to be sorted instead
+    db_lazy = database_fixture_new_db(fixture);
+    db_set_lazy_sort_indexes(db_lazy, true);
+    g_assert_true(db_load(db_lazy, fixture->db_file, NULL));
+    db_lock(db_lazy);
+    g_free(create_file(root, "e.txt", "eeeeeeeeee"));
+    db_sync_entry(db_lazy, get_folder(db_lazy, root), "e.txt", NULL, NULL);
+    g_assert_true(db_apply_changes(db_lazy));
+    g_assert_true(db_ensure_entries_sorted(db_lazy, DATABASE_INDEX_TYPE_SIZE, NULL));
+    files = db_get_files_sorted(db_lazy, DATABASE_INDEX_TYPE_SIZE);
+    g_assert_cmpuint(darray_get_num_items(files), ==, G_N_ELEMENTS(names) + 1);
+    assert_sorted(files, (DynamicArrayCompareDataFunc)db_entry_compare_entries_by_size);
+    g_assert_cmpstr(db_entry_get_name_raw(darray_get_item(files, G_N_ELEMENTS(names))), ==, "e.txt");
+    g_clear_pointer(&files, darray_unref);
+    db_unlock(db_lazy);
+    g_clear_pointer(&db_lazy, db_unref);
+
+    g_clear_pointer(&db, db_unref);
+}
+
+static void
+test_save_in_background(DatabaseFixture *fixture, gconstpointer user_data) {
+    const char *root = fixture->root;
+    const uint32_t num_files = 100;
+    for (uint32_t i = 0; i < num_files; i++) {
+        g_autofree char *name = g_strdup_printf("file_%u", i);
+        g_free(create_file(root, name, "f"));
+    }
+
+    database_fixture_add_index(fixture, root);
+    FsearchDatabase *db = database_fixture_scan(fixture);
+    g_autoptr(GHashTable) entries = get_entries(db);
+
+    db_lock(db);
+    g_assert_true(db_save_in_background(db, fixture->db_dir));
+    // changes made while the snapshot is written aren't part of it, they're kept for the journal
+    FsearchDatabaseEntryFolder *root_folder = get_folder(db, root);
+    g_autofree char *file_0 = g_build_filename(root, "file_0", NULL);
+    g_assert_cmpint(g_remove(file_0), ==, 0);
+    db_sync_entry(db, root_folder, "file_0", NULL, NULL);
+    g_assert_true(db_apply_changes(db));
+    g_assert_true(db_save_changes(db, fixture->db_dir));
+    db_wait_for_save(db);
+    db_unlock(db);
+
+    g_autofree char *journal_file = g_build_filename(fixture->db_dir, "fsearch.db.journal", NULL);
+    g_assert_false(g_file_test(journal_file, G_FILE_TEST_EXISTS));
+    FsearchDatabase *db_loaded = database_fixture_new_db(fixture);
+    g_assert_true(db_load(db_loaded, fixture->db_file, NULL));
+    g_autoptr(GHashTable) entries_loaded = get_entries(db_loaded);
+    g_assert_cmpuint(g_hash_table_size(entries_loaded), ==, g_hash_table_size(entries));
+    GHashTableIter iter;
+    gpointer key = NULL;
+    g_hash_table_iter_init(&iter, entries);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        g_assert_true(g_hash_table_contains(entries_loaded, key));
+    }
+    g_clear_pointer(&db_loaded, db_unref);
+
+    db_lock(db);
+    g_assert_true(db_save_changes(db, fixture->db_dir));
+    db_unlock(db);
+    g_assert_true(g_file_test(journal_file, G_FILE_TEST_EXISTS));
+    db_loaded = database_fixture_new_db(fixture);
+    g_assert_true(db_load(db_loaded, fixture->db_file, NULL));
+    assert_same_entries(db, db_loaded);
+    g_assert_cmpuint(db_get_num_files(db_loaded), ==, num_files - 1);
+    g_clear_pointer(&db_loaded, db_unref);
+
+    g_clear_pointer(&db, db_unref);
+}
+
+static void
+test_progressive_load(DatabaseFixture *fixture, gconstpointer user_data) {
+    const char *root = fixture->root;
+    const char *names[] = {"a.txt", "bb.txt", "ccc.png"};
+    for (uint32_t i = 0; i < G_N_ELEMENTS(names); i++) {
+        g_free(create_file(root, names[i], names[i]));
+    }
+
+    database_fixture_add_index(fixture, root);
+    FsearchDatabase *db = database_fixture_new_db(fixture);
+    db_set_index_flags(db, DATABASE_INDEX_FLAG_SIZE | DATABASE_INDEX_FLAG_MODIFICATION_TIME);
+    g_assert_true(db_scan(db, NULL, NULL));
+    g_assert_true(db_save(db, fixture->db_dir));
+    g_assert_cmpint(db_get_index_last_updated(db, root), !=, 0);
+
+    FsearchDatabase *db_loaded = database_fixture_new_db(fixture);
+    db_set_progressive_load(db_loaded, true);
+    g_assert_true(db_load(db_loaded, fixture->db_file, NULL));
+    g_assert_cmpint(db_get_index_last_updated(db_loaded, root), ==, db_get_index_last_updated(db, root));
+
+    // only the names and parents are there yet
+    g_assert_cmpuint(db_get_num_files(db_loaded), ==, G_N_ELEMENTS(names));
+    g_assert_false(db_has_entries_sorted_by_type(db_loaded, DATABASE_INDEX_TYPE_SIZE));
+    DynamicArray *files = db_get_files(db_loaded);
+    for (uint32_t i = 0; i < darray_get_num_items(files); i++) {
+        g_assert_cmpint(db_entry_get_size(darray_get_item(files, i)), ==, 0);
+    }
+    g_clear_pointer(&files, darray_unref);
+
+    g_assert_true(db_load_remaining(db_loaded, NULL));
+    assert_same_entries(db, db_loaded);
+    g_assert_true(db_has_entries_sorted_by_type(db_loaded, DATABASE_INDEX_TYPE_SIZE));
+    files = db_get_files_sorted(db_loaded, DATABASE_INDEX_TYPE_SIZE);
+    assert_sorted(files, (DynamicArrayCompareDataFunc)db_entry_compare_entries_by_size);
+    g_clear_pointer(&files, darray_unref);
+    g_assert_false(db_load_remaining(db_loaded, NULL));
+    g_clear_pointer(&db_loaded, db_unref);
+
+    // a progressive scan can be searched once it's sorted by name, the other orders are sorted afterwards
+    const FsearchDatabaseIndexType remaining_types[] = {
+        DATABASE_INDEX_TYPE_SIZE,
+        DATABASE_INDEX_TYPE_MODIFICATION_TIME,
+        DATABASE_INDEX_TYPE_EXTENSION,
+    };
+    FsearchDatabase *db_scanned = database_fixture_new_db(fixture);
+    db_set_index_flags(db_scanned, DATABASE_INDEX_FLAG_SIZE | DATABASE_INDEX_FLAG_MODIFICATION_TIME);
+    db_set_progressive_load(db_scanned, true);
+    g_assert_true(db_scan(db_scanned, NULL, NULL));
+    g_assert_true(db_has_entries_sorted_by_type(db_scanned, DATABASE_INDEX_TYPE_PATH));
+    for (uint32_t i = 0; i < G_N_ELEMENTS(remaining_types); i++) {
+        g_assert_false(db_has_entries_sorted_by_type(db_scanned, remaining_types[i]));
+    }
+    g_assert_true(db_load_remaining(db_scanned, NULL));
+    for (uint32_t i = 0; i < G_N_ELEMENTS(remaining_types); i++) {
+        DynamicArray *expected_files = db_get_files_sorted(db, remaining_types[i]);
+        DynamicArray *sorted_files = db_get_files_sorted(db_scanned, remaining_types[i]);
+        assert_same_order(expected_files, sorted_files);
+        g_clear_pointer(&expected_files, darray_unref);
+        g_clear_pointer(&sorted_files, darray_unref);
+    }
+    g_assert_false(db_load_remaining(db_scanned, NULL));
+    g_clear_pointer(&db_scanned, db_unref);
+
+    // the file doesn't match the configuration anymore, so it doesn't know when the index was updated
+    char *exclude_files[] = {"*.png", NULL};
+    db_loaded = db_new(fixture->indexes, NULL, exclude_files, false);
+    g_assert_true(db_load(db_loaded, fixture->db_file, NULL));
+    g_assert_cmpint(db_get_index_last_updated(db_loaded, root), ==, 0);
+    g_clear_pointer(&db_loaded, db_unref);
+
+    g_clear_pointer(&db, db_unref);
+}
+
+static void
+test_file_was_replaced(DatabaseFixture *fixture, gconstpointer user_data) {
+    const char *root = fixture->root;
+    g_free(create_file(root, "a.txt", "a"));
+
+    database_fixture_add_index(fixture, root);
+    FsearchDatabase *db = database_fixture_scan(fixture);
+    db_lock(db);
+    g_assert_true(db_save_in_background(db, fixture->db_dir));
+    // our own file, no matter if it's still being written
+    g_assert_false(db_file_was_replaced(db, fixture->db_file));
+    db_wait_for_save(db);
+    g_assert_false(db_file_was_replaced(db, fixture->db_file));
+    db_unlock(db);
+
+    // another process saves its own database
+    g_free(create_file(root, "b.txt", "bb"));
+    FsearchDatabase *db_other = database_fixture_scan(fixture);
+    g_assert_true(db_save(db_other, fixture->db_dir));
+    db_lock(db);
+    g_assert_true(db_file_was_replaced(db, fixture->db_file));
+    db_unlock(db);
+
+    FsearchDatabase *db_loaded = database_fixture_new_db(fixture);
+    g_assert_true(db_load(db_loaded, fixture->db_file, NULL));
+    db_lock(db_loaded);
+    g_assert_false(db_file_was_replaced(db_loaded, fixture->db_file));
+    db_unlock(db_loaded);
+    g_assert_cmpuint(db_get_num_files(db_loaded), ==, 2);
+
+    g_clear_pointer(&db, db_unref);
+    g_clear_pointer(&db_other, db_unref);
+    g_clear_pointer(&db_loaded, db_unref);
+}
+
+static void
+test_segments(DatabaseFixture *fixture, gconstpointer user_data) {
+    char *hosts[2] = {g_build_filename(fixture->root, "host1", NULL), g_build_filename(fixture->root, "host2", NULL)};
+    char *db_dirs[2] = {g_build_filename(fixture->db_dir, "db1", NULL), g_build_filename(fixture->db_dir, "db2", NULL)};
+    char *db_files[2] = {NULL};
+    for (uint32_t i = 0; i < 2; i++) {
+        g_assert_cmpint(g_mkdir(hosts[i], 0755), ==, 0);
+        g_assert_cmpint(g_mkdir(db_dirs[i], 0755), ==, 0);
+        g_free(create_file(hosts[i], i == 0 ? "a.txt" : "b.txt", i == 0 ? "a" : "bbbb"));
+        g_free(create_file(hosts[i], i == 0 ? "c.txt" : "d.txt", i == 0 ? "ccc" : "dd"));
+
+        // each host has a database of its own
+        FsearchIndex *index = fsearch_index_new(FSEARCH_INDEX_FOLDER_TYPE, hosts[i], true, true, false, 0);
+        GList *indexes = g_list_append(NULL, index);
+        FsearchDatabase *host_db = db_new(indexes, NULL, NULL, false);
+        db_set_index_flags(host_db, DATABASE_INDEX_FLAG_SIZE | DATABASE_INDEX_FLAG_MODIFICATION_TIME);
+        g_assert_true(db_scan(host_db, NULL, NULL));
+        g_assert_true(db_save(host_db, db_dirs[i]));
+        g_clear_pointer(&host_db, db_unref);
+        g_list_free_full(indexes, (GDestroyNotify)fsearch_index_free);
+        db_files[i] = g_build_filename(db_dirs[i], "fsearch.db", NULL);
+    }
+
+    FsearchDatabase *db = db_new(NULL, NULL, NULL, false);
+    g_assert_true(db_load(db, db_files[0], NULL));
+    db_lock(db);
+    g_assert_false(db_add_segment(db, hosts[0]));
+    g_assert_true(db_add_segment(db, db_files[1]));
+    db_unlock(db);
+    g_assert_cmpuint(db_get_num_segments(db), ==, 1);
+    g_assert_cmpuint(db_get_num_files(db), ==, 4);
+    g_assert_cmpuint(db_get_num_folders(db), ==, 2);
+
+    // the entries of both files are merged into the sort orders
+    DynamicArray *names = db_get_files(db);
+    const char *sorted_names[] = {"a.txt", "b.txt", "c.txt", "d.txt"};
+    assert_file_names(names, sorted_names, G_N_ELEMENTS(sorted_names));
+    for (uint32_t i = 0; i < darray_get_num_items(names); i++) {
+        g_assert_cmpuint(db_entry_get_idx(darray_get_item(names, i)), ==, i);
+    }
+    g_clear_pointer(&names, darray_unref);
+    DynamicArray *sizes = db_get_files_sorted(db, DATABASE_INDEX_TYPE_SIZE);
+    const char *sorted_sizes[] = {"a.txt", "d.txt", "c.txt", "b.txt"};
+    assert_file_names(sizes, sorted_sizes, G_N_ELEMENTS(sorted_sizes));
+    g_clear_pointer(&sizes, darray_unref);
+    DynamicArray *paths = db_get_files_sorted(db, DATABASE_INDEX_TYPE_PATH);
+    assert_sorted(paths, (DynamicArrayCompareDataFunc)db_entry_compare_entries_by_path);
+    g_clear_pointer(&paths, darray_unref);
+
+    // the folders of both files had the same id
+    g_assert_cmpuint(db_entry_folder_get_id(get_folder(db, hosts[0])),
+                     !=,
+                     db_entry_folder_get_id(get_folder(db, hosts[1])));
+
+    // the segments would end up in the database file
+    g_assert_false(db_save(db, db_dirs[0]));
+
+    // an empty database takes the sort orders of the segment
+    FsearchDatabase *empty = db_new(NULL, NULL, NULL, false);
+    db_lock(empty);
+    g_assert_true(db_add_segment(empty, db_files[1]));
+    db_unlock(empty);
+    g_assert_cmpuint(db_get_num_files(empty), ==, 2);
+    g_assert_true(db_has_entries_sorted_by_type(empty, DATABASE_INDEX_TYPE_SIZE));
+
+    g_clear_pointer(&db, db_unref);
+    g_clear_pointer(&empty, db_unref);
+    for (uint32_t i = 0; i < 2; i++) {
+        g_free(db_files[i]);
+        g_free(db_dirs[i]);
+        g_free(hosts[i]);
+    }
+}
+
+int
+main(int argc, char *argv[]) {
+    g_test_init(&argc, &argv, NULL);
+    database_fixture_add("/FSearch/database/save_load", NULL, test_save_load);
+    database_fixture_add("/FSearch/database/folder_ids", NULL, test_folder_ids);
+    database_fixture_add("/FSearch/database/save_load_chunks", NULL, test_save_load_chunks);
+    database_fixture_add("/FSearch/database/journal", NULL, test_journal);
+    database_fixture_add("/FSearch/database/save_load_type_order", NULL, test_save_load_type_order);
+    database_fixture_add("/FSearch/database/lazy_sort_indexes", NULL, test_lazy_sort_indexes);
+    database_fixture_add("/FSearch/database/save_in_background", NULL, test_save_in_background);
+    database_fixture_add("/FSearch/database/progressive_load", NULL, test_progressive_load);
+    database_fixture_add("/FSearch/database/file_was_replaced", NULL, test_file_was_replaced);
+    database_fixture_add("/FSearch/database/segments", NULL, test_segments);
+    return g_test_run();
+}
@@ -0,0 +1,341 @@
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <src/fsearch_database_search.h>
+
+#include "database_fixture.h"
+
+static void
+test_memory_stats(DatabaseFixture *fixture, gconstpointer user_data) {
+    const char *root = fixture->root;
+    g_free(create_file(root, "a.txt", "a"));
+    g_free(create_file(root, "b.png", "b"));
+
+    database_fixture_add_index(fixture, root);
+    FsearchDatabase *db = database_fixture_new_db(fixture);
+    g_assert_true(db_scan(db, NULL, NULL));
+
+    db_lock(db);
+    FsearchDatabaseExtensions *extensions = db_get_extensions(db);
+    FsearchDatabaseMemoryStats stats;
+    db_memory_stats_init(&stats);
+    db_get_memory_stats(db, &stats);
+    g_assert_cmpuint(stats.folder_pool, >, 0);
+    g_assert_cmpuint(stats.file_pool, >, 0);
+    g_assert_cmpuint(stats.names, >, 0);
+    g_assert_cmpuint(stats.file_contents, ==, 0);
+    g_assert_cmpuint(stats.sorted_files[DATABASE_INDEX_TYPE_NAME], >, 0);
+    g_assert_cmpuint(stats.extensions, >, 0);
+    g_assert_cmpuint(stats.folded_names, ==, 0);
+
+    // arrays which are shared (e.g. with the results of views) are only counted once
+    DynamicArray *files = db_get_files(db);
+    g_assert_cmpuint(db_memory_stats_count_array(&stats, files), ==, 0);
+    DynamicArray *copy = darray_copy(files);
+    g_assert_cmpuint(db_memory_stats_count_array(&stats, copy), >, 0);
+    g_assert_cmpuint(db_memory_stats_count_array(&stats, copy), ==, 0);
+
+    g_assert_cmpuint(db_memory_stats_get_total(&stats),
+                     >=,
+                     stats.folder_pool + stats.file_pool + stats.names + stats.extensions);
+    g_autoptr(GString) report = db_memory_stats_to_string(&stats);
+    g_assert_nonnull(strstr(report->str, "files sorted by name"));
+    db_memory_stats_clear(&stats);
+    db_unlock(db);
+
+    g_clear_pointer(&files, darray_unref);
+    g_clear_pointer(&copy, darray_unref);
+    g_clear_pointer(&extensions, db_extensions_unref);
+    g_clear_pointer(&db, db_unref);
+}
+
+static void
+test_low_memory_mode(DatabaseFixture *fixture, gconstpointer user_data) {
+    const char *root = fixture->root;
+    g_free(create_file(root, "a.txt", "a"));
+    g_free(create_file(root, "b.png", "bb"));
+
+    database_fixture_add_index(fixture, root);
+    FsearchDatabase *db = database_fixture_new_db(fixture);
+    db_set_index_flags(db, DATABASE_INDEX_FLAG_SIZE);
+    db_set_trigram_index(db, true);
+    db_set_memory_budget(db, 64 * 1024 * 1024);
+    g_assert_true(db_scan(db, NULL, NULL));
+
+    // only the name order is kept and the others aren't built on demand
+    g_assert_true(db_has_entries_sorted_by_type(db, DATABASE_INDEX_TYPE_NAME));
+    g_assert_false(db_has_entries_sorted_by_type(db, DATABASE_INDEX_TYPE_PATH));
+    g_assert_false(db_has_entries_sorted_by_type(db, DATABASE_INDEX_TYPE_SIZE));
+    g_assert_true(db_ensure_entries_sorted(db, DATABASE_INDEX_TYPE_NAME, NULL));
+    g_assert_false(db_ensure_entries_sorted(db, DATABASE_INDEX_TYPE_SIZE, NULL));
+    g_assert_false(db_has_entries_sorted_by_type(db, DATABASE_INDEX_TYPE_SIZE));
+
+    db_lock(db);
+    g_assert_null(db_get_trigrams(db));
+    FsearchDatabaseMemoryStats stats;
+    db_memory_stats_init(&stats);
+    db_get_memory_stats(db, &stats);
+    g_assert_cmpuint(stats.memory_budget, ==, 64 * 1024 * 1024);
+    g_assert_false(db_memory_stats_is_over_budget(&stats));
+    g_autoptr(GString) report = db_memory_stats_to_string(&stats);
+    g_assert_nonnull(strstr(report->str, "Memory budget"));
+    db_memory_stats_clear(&stats);
+
+    db_memory_stats_init(&stats);
+    g_assert_false(db_memory_stats_is_over_budget(&stats));
+    db_get_memory_stats(db, &stats);
+    stats.memory_budget = 1;
+    g_assert_true(db_memory_stats_is_over_budget(&stats));
+    db_memory_stats_clear(&stats);
+    db_unlock(db);
+
+    // without a budget the orders are built on demand again
+    db_set_memory_budget(db, 0);
+    g_assert_true(db_ensure_entries_sorted(db, DATABASE_INDEX_TYPE_SIZE, NULL));
+    DynamicArray *files = db_get_files_sorted(db, DATABASE_INDEX_TYPE_SIZE);
+    assert_sorted(files, (DynamicArrayCompareDataFunc)db_entry_compare_entries_by_size);
+    g_clear_pointer(&files, darray_unref);
+    db_lock(db);
+    FsearchDatabaseTrigrams *trigrams = db_get_trigrams(db);
+    g_assert_nonnull(trigrams);
+    g_clear_pointer(&trigrams, db_trigrams_unref);
+    db_unlock(db);
+
+    g_clear_pointer(&db, db_unref);
+}
+
+// The most each entry of test_memory_per_entry may cost with all sort orders and the results of a search which
+// matches everything, in bytes. They're one pointer above what it takes now, raise them only on purpose. The caches,
+// which are built on demand, aren't part of it.
+#define MAX_BYTES_PER_FOLDER 160
+#define MAX_BYTES_PER_FILE 192
+#define MAX_NAME_BYTES_PER_ENTRY 16
+
+static size_t
+get_sorted_arrays_size(const size_t *sorted) {
+    size_t size = 0;
+    for (uint32_t i = 0; i < NUM_DATABASE_INDEX_TYPES; i++) {
+        size += sorted[i];
+    }
+    return size;
+}
+
+static void
+test_memory_per_entry(DatabaseFixture *fixture, gconstpointer user_data) {
+    const char *root = fixture->root;
+    // the pools allocate entries in blocks of 10000, so neither of them has one which is mostly empty
+    const uint32_t num_folders = 10000;
+    const uint32_t num_files = 20000;
+    for (uint32_t i = 1, file = 0; i < num_folders; i++) {
+        // 99 folders in the root, with 100 sub folders which hold the files
+        g_autofree char *name = i < 100 ? g_strdup_printf("folder%02u", i)
+                                        : g_strdup_printf("folder%02u/sub%04u", (i - 100) / 100 + 1, i);
+        g_autofree char *path = g_build_filename(root, name, NULL);
+        g_assert_cmpint(g_mkdir(path, 0755), ==, 0);
+        for (uint32_t j = 0; i >= 100 && j < (i < 300 ? 3 : 2); j++, file++) {
+            g_autofree char *file_name = g_strdup_printf("report_%05u.txt", file);
+            g_free(create_file(path, file_name, ""));
+        }
+    }
+
+    database_fixture_add_index(fixture, root);
+    FsearchDatabase *db = database_fixture_new_db(fixture);
+    g_assert_true(db_scan(db, NULL, NULL));
+
+    db_lock(db);
+    g_assert_cmpuint(db_get_num_folders(db), ==, num_folders);
+    g_assert_cmpuint(db_get_num_files(db), ==, num_files);
+
+    FsearchQuery *q = fsearch_query_new("*", NULL, NULL, 0, "debug_query");
+    DynamicArray *folders = db_get_folders(db);
+    DynamicArray *files = db_get_files(db);
+    DatabaseSearchResult *result =
+        db_search_query(db, q, db_get_thread_pool(db), folders, files, DATABASE_INDEX_TYPE_NAME, false, NULL, NULL, NULL);
+    g_assert_nonnull(result);
+    g_assert_cmpuint(darray_get_num_items(result->folders), ==, num_folders);
+    g_assert_cmpuint(darray_get_num_items(result->files), ==, num_files);
+
+    FsearchDatabaseMemoryStats stats;
+    db_memory_stats_init(&stats);
+    db_get_memory_stats(db, &stats);
+    const size_t folder_bytes = stats.folder_pool + get_sorted_arrays_size(stats.sorted_folders)
+                              + db_memory_stats_count_array(&stats, result->folders);
+    const size_t file_bytes = stats.file_pool + get_sorted_arrays_size(stats.sorted_files)
+                            + db_memory_stats_count_array(&stats, result->files);
+    g_test_message("%zu bytes per folder, %zu bytes per file, %zu bytes of names per entry",
+                   folder_bytes / num_folders,
+                   file_bytes / num_files,
+                   stats.names_used / (num_folders + num_files));
+    g_assert_cmpuint(folder_bytes / num_folders, <=, MAX_BYTES_PER_FOLDER);
+    g_assert_cmpuint(file_bytes / num_files, <=, MAX_BYTES_PER_FILE);
+    g_assert_cmpuint(stats.names_used / (num_folders + num_files), <=, MAX_NAME_BYTES_PER_ENTRY);
+    db_memory_stats_clear(&stats);
+    db_unlock(db);
+
+    g_clear_pointer(&result->folders, darray_unref);
+    g_clear_pointer(&result->files, darray_unref);
+    g_clear_pointer(&result, free);
+    g_clear_pointer(&folders, darray_unref);
+    g_clear_pointer(&files, darray_unref);
+    g_clear_pointer(&q, fsearch_query_unref);
+    g_clear_pointer(&db, db_unref);
+}
+
+static void
+test_compact_entries(void) {
+    if (sizeof(void *) == 8) {
+        g_assert_cmpuint(db_entry_get_sizeof_file_entry(), ==, 32);
+        g_assert_cmpuint(db_entry_get_sizeof_folder_entry(), ==, 56);
+    }
+
+    FsearchDatabaseEntry *folder = calloc(1, db_entry_get_sizeof_folder_entry());
+    FsearchDatabaseEntry *file = calloc(1, db_entry_get_sizeof_file_entry());
+    g_assert_nonnull(folder);
+    g_assert_nonnull(file);
+    db_entry_set_type(folder, DATABASE_ENTRY_TYPE_FOLDER);
+    db_entry_set_type(file, DATABASE_ENTRY_TYPE_FILE);
+    db_entry_set_parent(file, (FsearchDatabaseEntryFolder *)folder);
+    db_entry_set_mark(file, 3);
+
+    // packing the size doesn't affect the type and mark
+    const off_t size = (off_t)5 << 40;
+    db_entry_set_size(file, size);
+    db_entry_update_parent_size(file);
+    g_assert_cmpint(db_entry_get_size(file), ==, size);
+    g_assert_cmpint(db_entry_get_size(folder), ==, size);
+    g_assert_cmpint(db_entry_get_type(file), ==, DATABASE_ENTRY_TYPE_FILE);
+    g_assert_cmpuint(db_entry_get_mark(file), ==, 3);
+    db_entry_update_folder_size((FsearchDatabaseEntryFolder *)folder, -size);
+    g_assert_cmpint(db_entry_get_size(folder), ==, 0);
+    db_entry_set_size(file, -1);
+    g_assert_cmpint(db_entry_get_size(file), ==, 0);
+
+    db_entry_set_mtime(file, 1700000000);
+    g_assert_cmpint(db_entry_get_mtime(file), ==, 1700000000);
+    db_entry_set_mtime(file, (time_t)UINT32_MAX);
+    g_assert_cmpint(db_entry_get_mtime(file), ==, (time_t)UINT32_MAX);
+    // times which don't fit into 32 bits are kept as well
+    db_entry_set_mtime(file, -100);
+    g_assert_cmpint(db_entry_get_mtime(file), ==, -100);
+    if (sizeof(time_t) == 8) {
+        const time_t after_2106 = (time_t)UINT32_MAX + 100;
+        db_entry_set_mtime(folder, after_2106);
+        g_assert_cmpint(db_entry_get_mtime(folder), ==, after_2106);
+        g_assert_cmpint(db_entry_compare_entries_by_modification_time(&file, &folder), <, 0);
+        g_assert_cmpint(db_entry_compare_entries_by_modification_time(&folder, &file), >, 0);
+        // the years 1697 to 2242, times beyond them are clamped
+        const time_t year_1700 = INT64_C(-8520336000);
+        db_entry_set_mtime(folder, year_1700);
+        g_assert_cmpint(db_entry_get_mtime(folder), ==, year_1700);
+        g_assert_cmpint(db_entry_compare_entries_by_modification_time(&folder, &file), <, 0);
+        const time_t year_2200 = INT64_C(7258118400);
+        db_entry_set_mtime(folder, year_2200);
+        g_assert_cmpint(db_entry_get_mtime(folder), ==, year_2200);
+        db_entry_set_mtime(folder, INT64_MAX);
+        g_assert_cmpint(db_entry_get_mtime(folder), ==, (INT64_C(1) << 33) - 1);
+        db_entry_set_mtime(folder, INT64_MIN);
+        g_assert_cmpint(db_entry_get_mtime(folder), ==, -(INT64_C(1) << 33));
+        // the upper bits of the time don't touch the size, type or mark
+        g_assert_cmpint(db_entry_get_size(folder), ==, 0);
+        g_assert_cmpint(db_entry_get_type(folder), ==, DATABASE_ENTRY_TYPE_FOLDER);
+        g_assert_cmpint(db_entry_get_size(file), ==, 0);
+        g_assert_cmpuint(db_entry_get_mark(file), ==, 3);
+    }
+    db_entry_set_mtime(file, 1700000000);
+    g_assert_cmpint(db_entry_get_mtime(file), ==, 1700000000);
+
+    g_clear_pointer(&file, free);
+    g_clear_pointer(&folder, free);
+}
+
+static void
+test_ascii_names(void) {
+    FsearchDatabaseEntry *file = calloc(1, db_entry_get_sizeof_file_entry());
+    g_assert_nonnull(file);
+    db_entry_set_type(file, DATABASE_ENTRY_TYPE_FILE);
+    db_entry_set_mark(file, 15);
+    g_assert_false(db_entry_name_is_ascii(file));
+
+    db_entry_set_name(file, "a.txt");
+    g_assert_true(db_entry_name_is_ascii(file));
+    db_entry_set_name(file, "\xc3\xa4.txt");
+    g_assert_false(db_entry_name_is_ascii(file));
+    const char *name = "b.txt";
+    db_entry_set_name_borrowed(file, name);
+    g_assert_true(db_entry_name_is_ascii(file));
+    g_assert_cmpuint(db_entry_get_mark(file), ==, 15);
+    g_assert_cmpint(db_entry_get_type(file), ==, DATABASE_ENTRY_TYPE_FILE);
+
+    db_entry_destroy(file);
+    g_clear_pointer(&file, free);
+}
+
+static void
+test_name_sort_keys(void) {
+    const char *names[] = {"item#99", "item#100", "alpha1",  "alpha001", "part1_f012", "part1_f01", "foo.009", "foo.0",
+                           "a!",      "a1",       "a",       "",         "a0",         "a00",       "abcdefgh", "abcdefghi",
+                           "abcdefg", "abcdefg1", "\xc3\xa4", "Z",       "_",          "~1",        "10",       "9"};
+    // plus random names which share prefixes and numbers, enough of them to be sorted by multiple threads. They don't
+    // have numbers with leading zeros, strverscmp isn't transitive for those so different sorts can disagree.
+    const uint32_t num_entries = 200000;
+    const char alphabet[] = "ab129.!_Z";
+    const size_t entry_size = db_entry_get_sizeof_file_entry();
+    uint8_t *entries = calloc(num_entries, entry_size);
+    g_assert_nonnull(entries);
+    GRand *rand = g_rand_new_with_seed(42);
+    DynamicArray *array = darray_new(num_entries);
+    for (uint32_t i = 0; i < num_entries; i++) {
+        FsearchDatabaseEntry *entry = (FsearchDatabaseEntry *)(entries + i * entry_size);
+        db_entry_set_type(entry, DATABASE_ENTRY_TYPE_FILE);
+        if (i < G_N_ELEMENTS(names)) {
+            db_entry_set_name(entry, names[i]);
+        }
+        else {
+            char name[16] = "";
+            const int32_t len = g_rand_int_range(rand, 1, 15);
+            for (int32_t j = 0; j < len; j++) {
+                name[j] = alphabet[g_rand_int_range(rand, 0, (gint32)strlen(alphabet))];
+            }
+            db_entry_set_name(entry, name);
+        }
+        darray_add_item(array, entry);
+    }
+
+    for (uint32_t multi_threaded = 0; multi_threaded < 2; multi_threaded++) {
+        DynamicArray *expected = darray_copy(array);
+        darray_sort(expected, (DynamicArrayCompareDataFunc)db_entry_compare_entries_by_name, NULL, NULL);
+        DynamicArray *sorted = darray_copy(array);
+        darray_sort_by_key(sorted,
+                           (DynamicArrayKeyFunc)db_entry_get_name_sort_key,
+                           (DynamicArrayCompareDataFunc)db_entry_compare_entries_by_name,
+                           multi_threaded,
+                           NULL);
+        for (uint32_t i = 0; i < num_entries; i++) {
+            g_assert_true(darray_get_item(sorted, i) == darray_get_item(expected, i));
+        }
+        g_clear_pointer(&expected, darray_unref);
+        g_clear_pointer(&sorted, darray_unref);
+    }
+
+    for (uint32_t i = 0; i < num_entries; i++) {
+        db_entry_destroy((FsearchDatabaseEntry *)(entries + i * entry_size));
+    }
+    g_clear_pointer(&rand, g_rand_free);
+    g_clear_pointer(&array, darray_unref);
+    g_clear_pointer(&entries, free);
+}
+
+int
+main(int argc, char *argv[]) {
+    g_test_init(&argc, &argv, NULL);
+    database_fixture_add("/FSearch/database/memory_stats", NULL, test_memory_stats);
+    database_fixture_add("/FSearch/database/low_memory_mode", NULL, test_low_memory_mode);
+    database_fixture_add("/FSearch/database/memory_per_entry", NULL, test_memory_per_entry);
+    g_test_add_func("/FSearch/database/compact_entries", test_compact_entries);
+    g_test_add_func("/FSearch/database/ascii_names", test_ascii_names);
+    g_test_add_func("/FSearch/database/name_sort_keys", test_name_sort_keys);
+    return g_test_run();
+}
@@ -0,0 +1,191 @@
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <utime.h>
+
+#include <src/fsearch_database_search.h>
+
+#include "database_fixture.h"
+
+static uint32_t
+count_query_files(FsearchDatabase *db, const char *text) {
+    FsearchQuery *q = fsearch_query_new(text, NULL, NULL, 0, "debug_query");
+    DynamicArray *folders = db_get_folders(db);
+    DynamicArray *files = db_get_files(db);
+    DatabaseSearchResult *result =
+        db_search_query(db, q, db_get_thread_pool(db), folders, files, DATABASE_INDEX_TYPE_NAME, false, NULL, NULL, NULL);
+    g_assert_nonnull(result);
+    const uint32_t num_files = darray_get_num_items(result->files);
+    g_clear_pointer(&result->folders, darray_unref);
+    g_clear_pointer(&result->files, darray_unref);
+    g_clear_pointer(&result, free);
+    g_clear_pointer(&folders, darray_unref);
+    g_clear_pointer(&files, darray_unref);
+    g_clear_pointer(&q, fsearch_query_unref);
+    return num_files;
+}
+
+static void
+test_metadata(DatabaseFixture *fixture, gconstpointer user_data) {
+    const char *root = fixture->root;
+    g_autofree char *sub = g_build_filename(root, "sub", NULL);
+    g_assert_cmpint(g_mkdir(sub, 0755), ==, 0);
+    g_autofree char *file_a = create_file(sub, "a.txt", "a");
+    g_autofree char *file_b = create_file(sub, "b.txt", "b");
+    g_autofree char *file_c = create_file(sub, "c.txt", "c");
+    g_assert_cmpint(g_chmod(file_a, 0600), ==, 0);
+    g_assert_cmpint(g_chmod(file_b, 0640), ==, 0);
+    g_assert_cmpint(g_chmod(file_c, 0640), ==, 0);
+    // 2001-09-09, the modification time is newer
+    struct utimbuf times = {.actime = 1000000000, .modtime = time(NULL)};
+    g_assert_cmpint(utime(file_a, &times), ==, 0);
+
+    database_fixture_add_index(fixture, sub);
+    FsearchDatabase *db = database_fixture_new_db(fixture);
+    db_set_index_flags(db,
+                       DATABASE_INDEX_FLAG_SIZE | DATABASE_INDEX_FLAG_MODIFICATION_TIME | DATABASE_INDEX_FLAG_OWNER
+                           | DATABASE_INDEX_FLAG_PERMISSIONS | DATABASE_INDEX_FLAG_ACCESS_TIME);
+    FsearchDatabase *db_plain = database_fixture_new_db(fixture);
+    g_assert_true(db_scan(db, NULL, NULL));
+    g_assert_true(db_scan(db_plain, NULL, NULL));
+
+    g_autofree char *owner = g_strdup_printf("owner:%u", (uint32_t)getuid());
+    g_autofree char *group = g_strdup_printf("group:%u", (uint32_t)getgid());
+    db_lock(db);
+    g_assert_cmpuint(count_query_files(db, "perm:600"), ==, 1);
+    g_assert_cmpuint(count_query_files(db, "perm:640"), ==, 2);
+    g_assert_cmpuint(count_query_files(db, "perm:755"), ==, 0);
+    g_assert_cmpuint(count_query_files(db, owner), ==, 3);
+    g_assert_cmpuint(count_query_files(db, group), ==, 3);
+    g_assert_cmpuint(count_query_files(db, "da:<2005"), ==, 1);
+    g_assert_cmpuint(count_query_files(db, "b perm:640"), ==, 1);
+    // the creation time wasn't indexed, so it's unknown for all of them
+    g_assert_cmpuint(count_query_files(db, "dc:>2000"), ==, 0);
+
+    FsearchDatabaseMemoryStats stats;
+    db_memory_stats_init(&stats);
+    db_get_memory_stats(db, &stats);
+    g_assert_cmpuint(stats.metadata, >, 0);
+    db_memory_stats_clear(&stats);
+    db_unlock(db);
+
+    // nothing matches if the columns don't exist
+    db_lock(db_plain);
+    g_assert_null(db_get_metadata(db_plain));
+    g_assert_cmpuint(count_query_files(db_plain, "perm:600"), ==, 0);
+    g_assert_cmpuint(count_query_files(db_plain, owner), ==, 0);
+    db_unlock(db_plain);
+
+    // the columns survive saving and loading
+    g_assert_true(db_save(db, fixture->db_dir));
+    FsearchDatabase *db_loaded = database_fixture_new_db(fixture);
+    g_assert_true(db_load(db_loaded, fixture->db_file, NULL));
+    g_assert_cmpuint(db_get_index_flags(db_loaded), ==, db_get_index_flags(db));
+    db_lock(db_loaded);
+    FsearchDatabaseMetadata *metadata = db_get_metadata(db_loaded);
+    g_assert_nonnull(metadata);
+    FsearchDatabaseEntryMetadata values = {};
+    g_assert_true(db_metadata_lookup(metadata, get_entry(db_loaded, "a.txt"), &values));
+    g_assert_cmpuint(values.uid, ==, getuid());
+    g_assert_cmpuint(values.gid, ==, getgid());
+    g_assert_cmpuint(values.mode & 07777, ==, 0600);
+    g_assert_cmpint(values.atime, ==, 1000000000);
+    g_assert_cmpint(values.btime, ==, 0);
+    g_assert_cmpuint(count_query_files(db_loaded, "perm:640"), ==, 2);
+    g_assert_cmpuint(count_query_files(db_loaded, "da:<2005"), ==, 1);
+    g_clear_pointer(&metadata, db_metadata_unref);
+
+    // changed entries get their values from the sync
+    g_assert_cmpint(g_chmod(file_c, 0600), ==, 0);
+    db_sync_entry(db_loaded, get_folder(db_loaded, sub), "c.txt", NULL, NULL);
+    g_assert_true(db_apply_changes(db_loaded));
+    g_assert_cmpuint(count_query_files(db_loaded, "perm:600"), ==, 2);
+    g_assert_cmpuint(count_query_files(db_loaded, "da:<2005"), ==, 1);
+    db_unlock(db_loaded);
+
+    g_clear_pointer(&db_loaded, db_unref);
+    g_clear_pointer(&db_plain, db_unref);
+    g_clear_pointer(&db, db_unref);
+}
+
+static void
+on_duplicates_found(gpointer user_data) {
+    g_atomic_int_inc((volatile gint *)user_data);
+}
+
+// Searches for text and returns the result, the shared lock is taken for it
+static DatabaseSearchResult *
+search_query(FsearchDatabase *db, const char *text) {
+    db_lock_shared(db);
+    FsearchQuery *q = fsearch_query_new(text, NULL, NULL, 0, "debug_query");
+    DynamicArray *folders = db_get_folders(db);
+    DynamicArray *files = db_get_files(db);
+    DatabaseSearchResult *result =
+        db_search_query(db, q, db_get_thread_pool(db), folders, files, DATABASE_INDEX_TYPE_NAME, false, NULL, NULL, NULL);
+    g_assert_nonnull(result);
+    g_clear_pointer(&folders, darray_unref);
+    g_clear_pointer(&files, darray_unref);
+    g_clear_pointer(&q, fsearch_query_unref);
+    db_unlock_shared(db);
+    return result;
+}
+
+static void
+search_result_free(DatabaseSearchResult *result) {
+    g_clear_pointer(&result->folders, darray_unref);
+    g_clear_pointer(&result->files, darray_unref);
+    g_clear_pointer(&result, free);
+}
+
+static void
+test_duplicates(DatabaseFixture *fixture, gconstpointer user_data) {
+    const char *root = fixture->root;
+    g_free(create_file(root, "a.txt", "same"));
+    g_free(create_file(root, "b.txt", "same"));
+    g_free(create_file(root, "c.txt", "SAME"));
+
+    database_fixture_add_index(fixture, root);
+    FsearchDatabase *db = database_fixture_new_db(fixture);
+    g_assert_true(db_scan(db, NULL, NULL));
+    volatile gint num_found = 0;
+    db_set_duplicates_found_func(db, on_duplicates_found, (gpointer)&num_found);
+
+    // the first search only starts looking for them and says so, instead of finding nothing
+    DatabaseSearchResult *result = search_query(db, "dupe:");
+    g_assert_true(result->duplicates_pending);
+    g_assert_cmpuint(darray_get_num_items(result->files), ==, 0);
+    g_clear_pointer(&result, search_result_free);
+    // it doesn't hold any lock while it reads the files
+    g_assert_true(db_try_lock(db));
+    db_unlock(db);
+
+    db_wait_for_duplicates(db);
+    result = search_query(db, "dupe:");
+    g_assert_false(result->duplicates_pending);
+    g_assert_cmpuint(darray_get_num_items(result->files), ==, 2);
+    g_clear_pointer(&result, search_result_free);
+    g_assert_cmpint(g_atomic_int_get(&num_found), ==, 1);
+
+    // changed entries are looked for again
+    g_assert_true(db_scan(db, NULL, NULL));
+    result = search_query(db, "dupe: b.txt");
+    g_assert_true(result->duplicates_pending);
+    g_clear_pointer(&result, search_result_free);
+    db_wait_for_duplicates(db);
+    result = search_query(db, "dupe: b.txt");
+    g_assert_cmpuint(darray_get_num_items(result->files), ==, 1);
+    g_clear_pointer(&result, search_result_free);
+
+    g_clear_pointer(&db, db_unref);
+}
+
+int
+main(int argc, char *argv[]) {
+    g_test_init(&argc, &argv, NULL);
+    database_fixture_add("/FSearch/database/metadata", NULL, test_metadata);
+    database_fixture_add("/FSearch/database/duplicates", NULL, test_duplicates);
+    return g_test_run();
+}
@@ -0,0 +1,445 @@
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <utime.h>
+
+#include <src/fsearch_database_scan_stats.h>
+
+#include "database_fixture.h"
+
+static void
+test_rescan_index(DatabaseFixture *fixture, gconstpointer user_data) {
+    g_autofree char *home = g_build_filename(fixture->root, "home", NULL);
+    g_autofree char *archive = g_build_filename(fixture->root, "archive", NULL);
+    g_assert_cmpint(g_mkdir(home, 0755), ==, 0);
+    g_assert_cmpint(g_mkdir(archive, 0755), ==, 0);
+    g_autofree char *file_a = create_file(home, "a.txt", "a");
+    g_autofree char *file_b = create_file(archive, "b.txt", "bb");
+
+    database_fixture_add_index(fixture, home);
+    database_fixture_add_index(fixture, archive)->update = false;
+    FsearchDatabase *db = database_fixture_scan(fixture);
+    g_assert_cmpuint(db_get_num_files(db), ==, 2);
+    g_assert_cmpint(db_get_index_last_updated(db, archive), !=, 0);
+
+    // archive has updates disabled and keeps its entries, the new file in it must not show up yet
+    g_autofree char *file_c = create_file(home, "c.txt", "ccc");
+    g_autofree char *file_d = create_file(archive, "d.txt", "dddd");
+
+    FsearchDatabase *db_rescanned = database_fixture_new_db(fixture);
+    g_assert_true(db_rescan(db_rescanned, db, NULL, NULL));
+    g_assert_cmpuint(db_get_num_files(db_rescanned), ==, 3);
+    g_assert_cmpuint(db_get_num_folders(db_rescanned), ==, 2);
+    g_assert_cmpint(db_get_index_last_updated(db_rescanned, archive), ==, db_get_index_last_updated(db, archive));
+
+    g_autoptr(GHashTable) entries = get_entries(db_rescanned);
+    g_autofree char *entry_c = g_strdup_printf("%s 3", file_c);
+    g_autofree char *entry_d = g_strdup_printf("%s 4", file_d);
+    g_autofree char *entry_archive = g_strdup_printf("%s 2", archive);
+    g_assert_true(g_hash_table_contains(entries, entry_c));
+    g_assert_false(g_hash_table_contains(entries, entry_d));
+    g_assert_true(g_hash_table_contains(entries, entry_archive));
+
+    const FsearchDatabaseIndexType types[] = {
+        DATABASE_INDEX_TYPE_NAME,
+        DATABASE_INDEX_TYPE_PATH,
+        DATABASE_INDEX_TYPE_SIZE,
+        DATABASE_INDEX_TYPE_MODIFICATION_TIME,
+        DATABASE_INDEX_TYPE_EXTENSION,
+    };
+    for (uint32_t i = 0; i < G_N_ELEMENTS(types); i++) {
+        DynamicArray *files = db_get_files_sorted(db_rescanned, types[i]);
+        DynamicArray *folders = db_get_folders_sorted(db_rescanned, types[i]);
+        g_assert_cmpuint(darray_get_num_items(files), ==, 3);
+        g_assert_cmpuint(darray_get_num_items(folders), ==, 2);
+        g_clear_pointer(&files, darray_unref);
+        g_clear_pointer(&folders, darray_unref);
+    }
+    DynamicArray *files = db_get_files_sorted(db_rescanned, DATABASE_INDEX_TYPE_SIZE);
+    assert_sorted(files, (DynamicArrayCompareDataFunc)db_entry_compare_entries_by_size);
+    g_clear_pointer(&files, darray_unref);
+
+    // the kept entries share their names with the previous database, which outlive it
+    const char *name_b = db_entry_get_name_raw(get_entry(db, "b.txt"));
+    g_assert_true(db_entry_get_name_raw(get_entry(db_rescanned, "b.txt")) == name_b);
+    g_clear_pointer(&db, db_unref);
+    g_autoptr(GHashTable) entries_after_free = get_entries(db_rescanned);
+    g_assert_true(g_hash_table_contains(entries_after_free, entry_archive));
+
+    g_clear_pointer(&db_rescanned, db_unref);
+}
+
+static void
+test_rescan_single_index(DatabaseFixture *fixture, gconstpointer user_data) {
+    g_autofree char *home = g_build_filename(fixture->root, "home", NULL);
+    g_autofree char *archive = g_build_filename(fixture->root, "archive", NULL);
+    g_assert_cmpint(g_mkdir(home, 0755), ==, 0);
+    g_assert_cmpint(g_mkdir(archive, 0755), ==, 0);
+    g_autofree char *file_a = create_file(home, "a.txt", "a");
+    g_autofree char *file_b = create_file(archive, "b.txt", "bb");
+
+    database_fixture_add_index(fixture, home);
+    database_fixture_add_index(fixture, archive)->update = false;
+    FsearchDatabase *db = database_fixture_scan(fixture);
+    g_assert_cmpuint(db_get_num_files(db), ==, 2);
+
+    g_autofree char *file_c = create_file(home, "c.txt", "ccc");
+    g_autofree char *file_d = create_file(archive, "d.txt", "dddd");
+    g_assert_cmpint(g_remove(file_b), ==, 0);
+
+    // archive has updates disabled, but it can still be refreshed on its own. home keeps its entries.
+    FsearchDatabase *db_rescanned = database_fixture_new_db(fixture);
+    g_assert_true(db_rescan_index(db_rescanned, db, archive, NULL, NULL));
+    g_assert_cmpuint(db_get_num_files(db_rescanned), ==, 2);
+    g_assert_cmpuint(db_get_num_folders(db_rescanned), ==, 2);
+    g_assert_cmpint(db_get_index_last_updated(db_rescanned, home), ==, db_get_index_last_updated(db, home));
+    g_assert_cmpint(db_get_index_last_updated(db_rescanned, archive), >=, db_get_index_last_updated(db, archive));
+
+    g_autoptr(GHashTable) entries = get_entries(db_rescanned);
+    g_autofree char *entry_a = g_strdup_printf("%s 1", file_a);
+    g_autofree char *entry_b = g_strdup_printf("%s 2", file_b);
+    g_autofree char *entry_c = g_strdup_printf("%s 3", file_c);
+    g_autofree char *entry_d = g_strdup_printf("%s 4", file_d);
+    g_assert_true(g_hash_table_contains(entries, entry_a));
+    g_assert_false(g_hash_table_contains(entries, entry_b));
+    g_assert_false(g_hash_table_contains(entries, entry_c));
+    g_assert_true(g_hash_table_contains(entries, entry_d));
+
+    DynamicArray *files = db_get_files_sorted(db_rescanned, DATABASE_INDEX_TYPE_SIZE);
+    assert_sorted(files, (DynamicArrayCompareDataFunc)db_entry_compare_entries_by_size);
+    g_clear_pointer(&files, darray_unref);
+
+    g_clear_pointer(&db, db_unref);
+    g_clear_pointer(&db_rescanned, db_unref);
+}
+
+static void
+test_scan_incremental(DatabaseFixture *fixture, gconstpointer user_data) {
+    const char *root = fixture->root;
+    g_autofree char *sub = g_build_filename(root, "sub", NULL);
+    g_assert_cmpint(g_mkdir(sub, 0755), ==, 0);
+    g_autofree char *file_a = create_file(sub, "a.txt", "a");
+    // folders which were modified in the second the previous scan started in are always scanned again
+    const struct utimbuf times = {.actime = time(NULL) - 3600, .modtime = time(NULL) - 3600};
+    g_assert_cmpint(g_utime(sub, &times), ==, 0);
+    g_assert_cmpint(g_utime(root, &times), ==, 0);
+
+    database_fixture_add_index(fixture, root);
+    FsearchDatabase *db = database_fixture_scan(fixture);
+
+    FsearchDatabase *db_rescanned = database_fixture_new_db(fixture);
+    g_assert_true(db_scan_incremental(db_rescanned, db, NULL, NULL));
+    g_assert_cmpuint(db_get_num_files(db_rescanned), ==, 1);
+    g_assert_cmpuint(db_get_num_folders(db_rescanned), ==, 2);
+    // the unchanged entries share their names with the previous database
+    const char *name_a = db_entry_get_name_raw(get_entry(db, "a.txt"));
+    g_assert_true(db_entry_get_name_raw(get_entry(db_rescanned, "a.txt")) == name_a);
+
+    g_clear_pointer(&db, db_unref);
+    g_autoptr(GHashTable) entries = get_entries(db_rescanned);
+    g_autofree char *entry_a = g_strdup_printf("%s 1", file_a);
+    g_assert_true(g_hash_table_contains(entries, entry_a));
+
+    g_clear_pointer(&db_rescanned, db_unref);
+}
+
+static void
+check_folder(FsearchDatabase *db, const char *path, off_t size, uint32_t num_files, uint32_t num_folders) {
+    FsearchDatabaseEntryFolder *folder = get_folder(db, path);
+    g_assert_cmpint(db_entry_get_size((FsearchDatabaseEntry *)folder), ==, size);
+    g_assert_cmpuint(db_entry_folder_get_num_files(folder), ==, num_files);
+    g_assert_cmpuint(db_entry_folder_get_num_folders(folder), ==, num_folders);
+}
+
+static void
+test_folder_sizes(DatabaseFixture *fixture, gconstpointer user_data) {
+    const char *root = fixture->root;
+    g_autofree char *x = g_build_filename(root, "x", NULL);
+    g_autofree char *y = g_build_filename(x, "y", NULL);
+    g_autofree char *z = g_build_filename(root, "z", NULL);
+    g_autofree char *w = g_build_filename(root, "w", NULL);
+    g_assert_cmpint(g_mkdir_with_parents(y, 0755), ==, 0);
+    g_assert_cmpint(g_mkdir(z, 0755), ==, 0);
+    g_assert_cmpint(g_mkdir(w, 0755), ==, 0);
+    g_free(create_file(root, "a", "aaa"));
+    g_free(create_file(x, "b", "bbbbb"));
+    g_free(create_file(y, "c", "ccccccc"));
+    g_free(create_file(y, "d", "ddddddddddd"));
+    // enough folders for the workers to share them
+    const uint32_t num_w_folders = 50;
+    for (uint32_t i = 0; i < num_w_folders; i++) {
+        g_autofree char *name = g_strdup_printf("%u", i);
+        g_autofree char *folder = g_build_filename(w, name, NULL);
+        g_assert_cmpint(g_mkdir(folder, 0755), ==, 0);
+        g_free(create_file(folder, "1", "1"));
+    }
+
+    database_fixture_add_index(fixture, root);
+    FsearchDatabase *db = database_fixture_new_db(fixture);
+    db_set_num_scan_threads(db, 4);
+    g_assert_true(db_scan(db, NULL, NULL));
+
+    FsearchDatabase *db_rescanned = database_fixture_new_db(fixture);
+    db_set_num_scan_threads(db_rescanned, 4);
+    g_assert_true(db_scan_incremental(db_rescanned, db, NULL, NULL));
+
+    FsearchDatabase *dbs[] = {db, db_rescanned};
+    for (uint32_t i = 0; i < G_N_ELEMENTS(dbs); i++) {
+        check_folder(dbs[i], root, 3 + 5 + 7 + 11 + num_w_folders, 1, 3);
+        check_folder(dbs[i], x, 5 + 7 + 11, 1, 1);
+        check_folder(dbs[i], y, 7 + 11, 2, 0);
+        check_folder(dbs[i], z, 0, 0, 0);
+        check_folder(dbs[i], w, num_w_folders, 0, num_w_folders);
+    }
+
+    g_clear_pointer(&db_rescanned, db_unref);
+    g_clear_pointer(&db, db_unref);
+}
+
+// The path order spelled out: the components of the parent paths one by one, a path before those it's a prefix of
+static int
+compare_parent_paths(FsearchDatabaseEntry *a, FsearchDatabaseEntry *b) {
+    g_autoptr(GString) path_a = db_entry_get_path(a);
+    g_autoptr(GString) path_b = db_entry_get_path(b);
+    g_auto(GStrv) components_a = g_strsplit(path_a->str, G_DIR_SEPARATOR_S, -1);
+    g_auto(GStrv) components_b = g_strsplit(path_b->str, G_DIR_SEPARATOR_S, -1);
+    for (uint32_t i = 0;; i++) {
+        if (!components_a[i] || !components_b[i]) {
+            return components_a[i] ? 1 : components_b[i] ? -1 : 0;
+        }
+        const int res = strverscmp(components_a[i], components_b[i]);
+        if (res != 0) {
+            return res;
+        }
+    }
+}
+
+static void
+assert_path_order(FsearchDatabase *db, const char *root) {
+    g_auto(GStrv) root_components = g_strsplit(root, G_DIR_SEPARATOR_S, -1);
+    const uint32_t root_depth = g_strv_length(root_components) - 1;
+    DynamicArray *arrays[] = {db_get_files_sorted(db, DATABASE_INDEX_TYPE_PATH),
+                              db_get_folders_sorted(db, DATABASE_INDEX_TYPE_PATH)};
+    for (uint32_t i = 0; i < G_N_ELEMENTS(arrays); i++) {
+        g_assert_nonnull(arrays[i]);
+        for (uint32_t j = 0; j < darray_get_num_items(arrays[i]); j++) {
+            FsearchDatabaseEntry *entry = darray_get_item(arrays[i], j);
+            g_autoptr(GString) path = db_entry_get_path_full(entry);
+            g_auto(GStrv) components = g_strsplit(path->str, G_DIR_SEPARATOR_S, -1);
+            g_assert_cmpuint(db_entry_get_depth(entry), ==, g_strv_length(components) - 1 - root_depth);
+            if (j == 0) {
+                continue;
+            }
+            FsearchDatabaseEntry *previous = darray_get_item(arrays[i], j - 1);
+            const int res = compare_parent_paths(previous, entry);
+            g_assert_cmpint(res, <=, 0);
+            if (res == 0) {
+                g_assert_cmpint(strverscmp(db_entry_get_name_raw(previous), db_entry_get_name_raw(entry)), <, 0);
+            }
+        }
+        g_clear_pointer(&arrays[i], darray_unref);
+    }
+}
+
+static void
+test_path_ranks(DatabaseFixture *fixture, gconstpointer user_data) {
+    g_autofree char *tree = g_build_filename(fixture->root, "tree", NULL);
+    // versions, prefixes and spaces, which sort differently than the whole paths would
+    const char *names[] = {"a", "a b", "a2", "a10", "b"};
+    for (uint32_t i = 0; i < G_N_ELEMENTS(names); i++) {
+        for (uint32_t j = 0; j < G_N_ELEMENTS(names); j++) {
+            g_autofree char *folder = g_build_filename(tree, names[i], names[j], NULL);
+            g_assert_cmpint(g_mkdir_with_parents(folder, 0755), ==, 0);
+            for (uint32_t k = 0; k < G_N_ELEMENTS(names); k++) {
+                g_free(create_file(folder, names[k], "x"));
+            }
+        }
+    }
+
+    FsearchIndex *tree_index = database_fixture_add_index(fixture, tree);
+    FsearchDatabase *db = database_fixture_new_db(fixture);
+    db_set_num_scan_threads(db, 4);
+    g_assert_true(db_scan(db, NULL, NULL));
+    assert_path_order(db, tree);
+    g_assert_true(db_save(db, fixture->db_dir));
+
+    // the ranks of the loaded folders come from their order in the file
+    FsearchDatabase *db_loaded = database_fixture_new_db(fixture);
+    g_assert_true(db_load(db_loaded, fixture->db_file, NULL));
+    assert_path_order(db_loaded, tree);
+
+    // the kept entries are ranked together with the scanned ones
+    g_autofree char *other = g_build_filename(fixture->root, "other", NULL);
+    g_assert_cmpint(g_mkdir(other, 0755), ==, 0);
+    g_free(create_file(other, "a", "x"));
+    tree_index->update = false;
+    database_fixture_add_index(fixture, other);
+    FsearchDatabase *db_rescanned = database_fixture_new_db(fixture);
+    g_assert_true(db_rescan(db_rescanned, db_loaded, NULL, NULL));
+    assert_path_order(db_rescanned, tree);
+
+    // a folder which is added later has no rank yet, it's still sorted by its path
+    FsearchDatabaseEntryFolder *folder = get_folder(db_loaded, tree);
+    FsearchDatabaseEntry *entries[] = {calloc(1, db_entry_get_sizeof_folder_entry()),
+                                       calloc(1, db_entry_get_sizeof_file_entry())};
+    db_entry_set_type(entries[0], DATABASE_ENTRY_TYPE_FOLDER);
+    db_entry_set_type(entries[1], DATABASE_ENTRY_TYPE_FILE);
+    db_entry_set_name_borrowed(entries[0], "a1");
+    db_entry_set_name_borrowed(entries[1], "a");
+    db_entry_set_parent(entries[0], folder);
+    db_entry_set_parent(entries[1], (FsearchDatabaseEntryFolder *)entries[0]);
+    g_assert_cmpuint(db_entry_get_depth(entries[1]), ==, 2);
+    g_autofree char *path_a_a = g_build_filename(tree, "a", "a", NULL);
+    g_autofree char *path_a2_a = g_build_filename(tree, "a2", "a", NULL);
+    FsearchDatabaseEntry *a_a = (FsearchDatabaseEntry *)get_folder(db_loaded, path_a_a);
+    FsearchDatabaseEntry *a2_a = (FsearchDatabaseEntry *)get_folder(db_loaded, path_a2_a);
+    g_assert_cmpint(db_entry_compare_entries_by_path(&a_a, &entries[1]), <, 0);
+    g_assert_cmpint(db_entry_compare_entries_by_path(&entries[1], &a2_a), <, 0);
+    g_clear_pointer(&entries[1], free);
+    g_clear_pointer(&entries[0], free);
+
+    g_clear_pointer(&db_rescanned, db_unref);
+    g_clear_pointer(&db_loaded, db_unref);
+    g_clear_pointer(&db, db_unref);
+}
+
+static void
+test_scan_stats(DatabaseFixture *fixture, gconstpointer user_data) {
+    const char *root = fixture->root;
+    g_autofree char *sub = g_build_filename(root, "sub", NULL);
+    g_assert_cmpint(g_mkdir(sub, 0755), ==, 0);
+    g_free(create_file(root, "a.txt", "a"));
+    g_free(create_file(sub, "b.txt", "bb"));
+    g_free(create_file(root, ".hidden", "h"));
+    g_free(create_file(sub, "c.tmp", "c"));
+
+    database_fixture_add_index(fixture, root);
+    char *exclude_files[] = {"*.tmp", NULL};
+    FsearchDatabase *db = db_new(fixture->indexes, NULL, exclude_files, true);
+    g_assert_null(db_get_scan_stats(db));
+    g_assert_true(db_scan(db, NULL, NULL));
+
+    FsearchDatabaseScanStats *stats = db_get_scan_stats(db);
+    g_assert_nonnull(stats);
+    g_assert_cmpuint(db_scan_stats_get_num_roots(stats), ==, 1);
+
+    const FsearchDatabaseScanRootStats *root_stats = db_scan_stats_get_root(stats, 0);
+    g_assert_cmpstr(root_stats->path, ==, root);
+    g_assert_true(root_stats->completed);
+    g_assert_cmpuint(root_stats->num_files, ==, 2);
+    g_assert_cmpuint(root_stats->num_folders, ==, 2);
+    g_assert_cmpuint(root_stats->num_excluded, ==, 2);
+    g_assert_cmpuint(root_stats->num_skipped, ==, 0);
+    g_assert_cmpuint(root_stats->open_latency.count, ==, 2);
+    g_assert_cmpuint(root_stats->num_slowest_directories, ==, 2);
+    g_assert_cmpint(root_stats->slowest_directories[0].time, >=, root_stats->slowest_directories[1].time);
+    g_assert_cmpint(db_scan_stats_get_duration(stats), >=, root_stats->duration);
+
+    g_autoptr(GString) report = db_scan_stats_to_string(stats);
+    g_assert_nonnull(strstr(report->str, root));
+
+    g_clear_pointer(&stats, db_scan_stats_unref);
+    g_clear_pointer(&db, db_unref);
+}
+
+static void
+test_scan_stats_latency(void) {
+    FsearchDatabaseScanLatency latency = {};
+    for (gint64 i = 0; i < 99; i++) {
+        db_scan_latency_add(&latency, 3);
+    }
+    db_scan_latency_add(&latency, 5000);
+    g_assert_cmpuint(latency.count, ==, 100);
+    g_assert_cmpuint(latency.buckets[2], ==, 99);
+    g_assert_cmpint(latency.max_time, ==, 5000);
+    g_assert_cmpint(db_scan_latency_get_percentile(&latency, 0.5), ==, 4);
+    g_assert_cmpint(db_scan_latency_get_percentile(&latency, 0.995), ==, 5000);
+
+    FsearchDatabaseScanRootStats root_stats = {};
+    for (gint64 i = 0; i < DB_SCAN_STATS_NUM_SLOWEST_DIRECTORIES * 2; i++) {
+        g_autofree char *path = g_strdup_printf("/dir%" G_GINT64_FORMAT, i);
+        db_scan_root_stats_add_directory_time(&root_stats, path, i);
+    }
+    g_assert_cmpuint(root_stats.num_slowest_directories, ==, DB_SCAN_STATS_NUM_SLOWEST_DIRECTORIES);
+    g_assert_cmpint(root_stats.slowest_directories[0].time, ==, DB_SCAN_STATS_NUM_SLOWEST_DIRECTORIES * 2 - 1);
+    g_assert_cmpint(root_stats.slowest_directories[DB_SCAN_STATS_NUM_SLOWEST_DIRECTORIES - 1].time,
+                    ==,
+                    DB_SCAN_STATS_NUM_SLOWEST_DIRECTORIES);
+    db_scan_root_stats_clear(&root_stats);
+}
+
+static void
+test_scan_timeout(DatabaseFixture *fixture, gconstpointer user_data) {
+    const char *root = fixture->root;
+    // far more directories than one thread can read in a millisecond
+    const uint32_t num_folders = 2000;
+    for (uint32_t i = 0; i < num_folders; i++) {
+        g_autofree char *name = g_strdup_printf("folder_%04u", i);
+        g_autofree char *path = g_build_filename(root, name, NULL);
+        g_assert_cmpint(g_mkdir(path, 0755), ==, 0);
+        g_free(create_file(path, "file", ""));
+    }
+
+    database_fixture_add_index(fixture, root);
+    FsearchDatabase *db = database_fixture_scan(fixture);
+    g_assert_cmpuint(db_get_num_files(db), ==, num_folders);
+    const time_t last_updated = db_get_index_last_updated(db, root);
+    g_usleep(G_USEC_PER_SEC);
+
+    // the index which timed out keeps the entries of the previous database
+    FsearchDatabase *db_rescanned = database_fixture_new_db(fixture);
+    db_set_num_scan_threads(db_rescanned, 1);
+    db_set_scan_timeouts(db_rescanned, 0, 1);
+    g_test_expect_message("fsearch-database", G_LOG_LEVEL_WARNING, "*timed out*");
+    g_assert_true(db_rescan(db_rescanned, db, NULL, NULL));
+    g_test_assert_expected_messages();
+    g_assert_cmpuint(db_get_num_files(db_rescanned), ==, num_folders);
+    g_assert_cmpuint(db_get_num_folders(db_rescanned), ==, num_folders + 1);
+    g_assert_cmpint(db_get_index_last_updated(db_rescanned, root), ==, last_updated);
+
+    FsearchDatabaseScanStats *stats = db_get_scan_stats(db_rescanned);
+    g_assert_cmpuint(db_scan_stats_get_num_roots(stats), ==, 1);
+    const FsearchDatabaseScanRootStats *root_stats = db_scan_stats_get_root(stats, 0);
+    g_assert_false(root_stats->completed);
+    g_assert_true(root_stats->timed_out);
+    g_assert_true(root_stats->stale);
+    g_assert_nonnull(root_stats->timed_out_directory);
+    g_autoptr(GString) report = db_scan_stats_to_string(stats);
+    g_assert_nonnull(strstr(report->str, "timed out"));
+    g_clear_pointer(&stats, db_scan_stats_unref);
+
+    // without a previous database there's nothing to keep
+    FsearchDatabase *db_timed_out = database_fixture_new_db(fixture);
+    db_set_num_scan_threads(db_timed_out, 1);
+    db_set_scan_timeouts(db_timed_out, 0, 1);
+    g_test_expect_message("fsearch-database", G_LOG_LEVEL_WARNING, "*timed out*");
+    g_assert_false(db_scan(db_timed_out, NULL, NULL));
+    g_test_assert_expected_messages();
+    g_assert_cmpuint(db_get_num_files(db_timed_out), ==, 0);
+    stats = db_get_scan_stats(db_timed_out);
+    root_stats = db_scan_stats_get_root(stats, 0);
+    g_assert_true(root_stats->timed_out);
+    g_assert_false(root_stats->stale);
+    g_clear_pointer(&stats, db_scan_stats_unref);
+
+    g_clear_pointer(&db_timed_out, db_unref);
+    g_clear_pointer(&db_rescanned, db_unref);
+    g_clear_pointer(&db, db_unref);
+}
+
+int
+main(int argc, char *argv[]) {
+    g_test_init(&argc, &argv, NULL);
+    database_fixture_add("/FSearch/database/rescan_index", NULL, test_rescan_index);
+    database_fixture_add("/FSearch/database/rescan_single_index", NULL, test_rescan_single_index);
+    database_fixture_add("/FSearch/database/scan_incremental", NULL, test_scan_incremental);
+    database_fixture_add("/FSearch/database/folder_sizes", NULL, test_folder_sizes);
+    database_fixture_add("/FSearch/database/path_ranks", NULL, test_path_ranks);
+    database_fixture_add("/FSearch/database/scan_stats", NULL, test_scan_stats);
+    g_test_add_func("/FSearch/database/scan_stats_latency", test_scan_stats_latency);
+    database_fixture_add("/FSearch/database/scan_timeout", NULL, test_scan_timeout);
+    return g_test_run();
+}
@@ -0,0 +1,162 @@
+#include <glib.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <src/fsearch_database_search_cache.h>
+
+static DynamicArray *
+new_array(uint32_t num_items) {
+    DynamicArray *array = darray_new(num_items);
+    for (uint32_t i = 0; i < num_items; i++) {
+        darray_add_item(array, GUINT_TO_POINTER(i + 1));
+    }
+    return array;
+}
+
+static void
+insert_result(FsearchDatabaseSearchCache *cache, const char *key, uint32_t num_items) {
+    DynamicArray *folders = new_array(num_items);
+    DynamicArray *files = new_array(num_items);
+    db_search_cache_insert(cache, key, folders, files, DATABASE_INDEX_TYPE_NAME);
+    g_clear_pointer(&folders, darray_unref);
+    g_clear_pointer(&files, darray_unref);
+}
+
+static bool
+has_result(FsearchDatabaseSearchCache *cache, const char *key) {
+    DynamicArray *folders = NULL;
+    DynamicArray *files = NULL;
+    FsearchDatabaseIndexType sort_type = NUM_DATABASE_INDEX_TYPES;
+    if (!db_search_cache_lookup(cache, key, &folders, &files, &sort_type)) {
+        return false;
+    }
+    g_assert_nonnull(folders);
+    g_assert_nonnull(files);
+    g_assert_cmpint(sort_type, ==, DATABASE_INDEX_TYPE_NAME);
+    g_clear_pointer(&folders, darray_unref);
+    g_clear_pointer(&files, darray_unref);
+    return true;
+}
+
+static void
+test_lookup(void) {
+    FsearchDatabaseSearchCache *cache = db_search_cache_new(1024 * 1024);
+    g_assert_false(has_result(cache, "a"));
+
+    DynamicArray *folders = new_array(10);
+    DynamicArray *files = new_array(20);
+    db_search_cache_insert(cache, "a", folders, files, DATABASE_INDEX_TYPE_SIZE);
+    g_assert_cmpuint(db_search_cache_get_num_entries(cache), ==, 1);
+
+    DynamicArray *cached_folders = NULL;
+    DynamicArray *cached_files = NULL;
+    FsearchDatabaseIndexType sort_type = DATABASE_INDEX_TYPE_NAME;
+    g_assert_true(db_search_cache_lookup(cache, "a", &cached_folders, &cached_files, &sort_type));
+    // the results aren't copied
+    g_assert_true(cached_folders == folders);
+    g_assert_true(cached_files == files);
+    g_assert_cmpint(sort_type, ==, DATABASE_INDEX_TYPE_SIZE);
+    g_clear_pointer(&cached_folders, darray_unref);
+    g_clear_pointer(&cached_files, darray_unref);
+
+    // inserting the same key again replaces the results
+    insert_result(cache, "a", 5);
+    g_assert_cmpuint(db_search_cache_get_num_entries(cache), ==, 1);
+    g_assert_true(db_search_cache_lookup(cache, "a", &cached_folders, &cached_files, &sort_type));
+    g_assert_cmpuint(darray_get_num_items(cached_folders), ==, 5);
+    g_clear_pointer(&cached_folders, darray_unref);
+    g_clear_pointer(&cached_files, darray_unref);
+
+    db_search_cache_clear(cache);
+    g_assert_false(has_result(cache, "a"));
+    g_assert_cmpuint(db_search_cache_get_memory_size(cache), ==, 0);
+
+    g_clear_pointer(&folders, darray_unref);
+    g_clear_pointer(&files, darray_unref);
+    g_clear_pointer(&cache, db_search_cache_free);
+}
+
+static void
+test_eviction(void) {
+    const size_t max_size = 64 * 1024;
+    FsearchDatabaseSearchCache *cache = db_search_cache_new(max_size);
+
+    // each result takes about a quarter of the cache
+    const uint32_t num_items = max_size / sizeof(void *) / 8;
+    insert_result(cache, "a", num_items);
+    insert_result(cache, "b", num_items);
+    insert_result(cache, "c", num_items);
+    g_assert_cmpuint(db_search_cache_get_num_entries(cache), ==, 3);
+
+    // "a" is the most recently used one now, so "b" has to go
+    g_assert_true(has_result(cache, "a"));
+    insert_result(cache, "d", num_items);
+    insert_result(cache, "e", num_items);
+    g_assert_cmpuint(db_search_cache_get_memory_size(cache), <=, max_size);
+    g_assert_true(has_result(cache, "a"));
+    g_assert_false(has_result(cache, "b"));
+    g_assert_true(has_result(cache, "e"));
+
+    // results which are larger than the whole cache aren't added at all
+    insert_result(cache, "f", num_items * 5);
+    g_assert_false(has_result(cache, "f"));
+    g_assert_true(has_result(cache, "e"));
+
+    db_search_cache_set_max_size(cache, max_size / 2);
+    g_assert_cmpuint(db_search_cache_get_memory_size(cache), <=, max_size / 2);
+    g_assert_true(has_result(cache, "e"));
+
+    // a size of 0 disables the cache
+    db_search_cache_set_max_size(cache, 0);
+    g_assert_cmpuint(db_search_cache_get_num_entries(cache), ==, 0);
+    insert_result(cache, "a", 1);
+    g_assert_false(has_result(cache, "a"));
+
+    g_clear_pointer(&cache, db_search_cache_free);
+}
+
+static void
+test_key(void) {
+    FsearchFilterManager *filters = fsearch_filter_manager_new_with_defaults();
+    FsearchFilter *filter = fsearch_filter_manager_get_filter(filters, 1);
+    g_assert_nonnull(filter);
+
+    g_autofree char *key = db_search_cache_key_new("foo bar", NULL, filters, 0, DATABASE_INDEX_TYPE_NAME);
+
+    // redundant whitespace doesn't change the results
+    g_autofree char *key_spaces = db_search_cache_key_new("  foo   bar ", NULL, filters, 0, DATABASE_INDEX_TYPE_NAME);
+    g_assert_cmpstr(key, ==, key_spaces);
+
+    // ... unless it's quoted
+    g_autofree char *key_quoted = db_search_cache_key_new("\"foo bar\"", NULL, filters, 0, DATABASE_INDEX_TYPE_NAME);
+    g_autofree char *key_quoted_spaces =
+        db_search_cache_key_new("\"foo  bar\"", NULL, filters, 0, DATABASE_INDEX_TYPE_NAME);
+    g_assert_cmpstr(key_quoted, !=, key_quoted_spaces);
+
+    g_autofree char *key_flags =
+        db_search_cache_key_new("foo bar", NULL, filters, QUERY_FLAG_MATCH_CASE, DATABASE_INDEX_TYPE_NAME);
+    g_assert_cmpstr(key, !=, key_flags);
+
+    g_autofree char *key_sort = db_search_cache_key_new("foo bar", NULL, filters, 0, DATABASE_INDEX_TYPE_SIZE);
+    g_assert_cmpstr(key, !=, key_sort);
+
+    g_autofree char *key_filter = db_search_cache_key_new("foo bar", filter, filters, 0, DATABASE_INDEX_TYPE_NAME);
+    g_assert_cmpstr(key, !=, key_filter);
+
+    // the query could use the macros of all filters, so changing them changes the key
+    fsearch_filter_manager_edit(filters, filter, filter->name, "othermacro", filter->query, filter->flags);
+    g_autofree char *key_macro = db_search_cache_key_new("foo bar", NULL, filters, 0, DATABASE_INDEX_TYPE_NAME);
+    g_assert_cmpstr(key, !=, key_macro);
+
+    g_clear_pointer(&filter, fsearch_filter_unref);
+    g_clear_pointer(&filters, fsearch_filter_manager_free);
+}
+
+int
+main(int argc, char *argv[]) {
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/FSearch/database_search_cache/lookup", test_lookup);
+    g_test_add_func("/FSearch/database_search_cache/eviction", test_eviction);
+    g_test_add_func("/FSearch/database_search_cache/key", test_key);
+    return g_test_run();
+}
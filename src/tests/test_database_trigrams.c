@@ -0,0 +1,236 @@
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <src/fsearch_database_entry.h>
+#include <src/fsearch_database_trigrams.h>
+#include <src/fsearch_memory_pool.h>
+
+static DynamicArray *
+new_entries(FsearchMemoryPool *pool, const char **names, uint32_t num_names) {
+    DynamicArray *entries = darray_new(num_names);
+    for (uint32_t i = 0; i < num_names; i++) {
+        FsearchDatabaseEntry *entry = fsearch_memory_pool_malloc(pool);
+        db_entry_set_type(entry, DATABASE_ENTRY_TYPE_FILE);
+        db_entry_set_name(entry, names[i]);
+        darray_add_item(entries, entry);
+    }
+    return entries;
+}
+
+static DynamicArray *
+new_random_entries(FsearchMemoryPool *pool, uint32_t num_entries, uint32_t seed) {
+    static const char chars[] = "abcdefgHIJKLMN0123_.-\xc3\xa4";
+    GRand *rand = g_rand_new_with_seed(seed);
+    DynamicArray *entries = darray_new(num_entries);
+    char name[32];
+    for (uint32_t i = 0; i < num_entries; i++) {
+        const uint32_t len = g_rand_int_range(rand, 1, sizeof(name) - 1);
+        for (uint32_t j = 0; j < len; j++) {
+            name[j] = chars[g_rand_int_range(rand, 0, sizeof(chars) - 1)];
+        }
+        name[len] = '\0';
+        FsearchDatabaseEntry *entry = fsearch_memory_pool_malloc(pool);
+        db_entry_set_type(entry, DATABASE_ENTRY_TYPE_FILE);
+        db_entry_set_name(entry, name);
+        darray_add_item(entries, entry);
+    }
+    g_rand_free(rand);
+    return entries;
+}
+
+static bool
+name_contains(FsearchDatabaseEntry *entry, const char **needles, uint32_t num_needles) {
+    for (uint32_t i = 0; i < num_needles; i++) {
+        if (!strcasestr(db_entry_get_name_raw_for_display(entry), needles[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Every entry which contains the needles must be one of the candidates
+static void
+check_candidates(const FsearchDatabaseTrigramList *list,
+                 DynamicArray *entries,
+                 const char **needles,
+                 uint32_t num_needles,
+                 bool expect_candidates) {
+    uint32_t num_candidates = 0;
+    g_autofree uint32_t *candidates = db_trigram_list_get_candidates(list, needles, num_needles, &num_candidates);
+    if (!expect_candidates) {
+        g_assert_null(candidates);
+        return;
+    }
+    g_assert_nonnull(candidates);
+
+    uint32_t num_matches = 0;
+    uint32_t c = 0;
+    for (uint32_t i = 0; i < darray_get_num_items(entries); i++) {
+        if (!name_contains(darray_get_item(entries, i), needles, num_needles)) {
+            continue;
+        }
+        num_matches++;
+        while (c < num_candidates && candidates[c] < i) {
+            c++;
+        }
+        g_assert_cmpuint(c, <, num_candidates);
+        g_assert_cmpuint(candidates[c], ==, i);
+    }
+    g_assert_cmpuint(num_candidates, >=, num_matches);
+    for (uint32_t i = 1; i < num_candidates; i++) {
+        g_assert_cmpuint(candidates[i - 1], <, candidates[i]);
+    }
+}
+
+static void
+test_candidates(void) {
+    FsearchMemoryPool *pool =
+        fsearch_memory_pool_new(1024, db_entry_get_sizeof_file_entry(), (GDestroyNotify)db_entry_destroy);
+    const char *names[] = {"a", "abc", "Makefile", "make.sh", "README.md", "readme.txt", "\xc3\xa4rger.txt", "xyzzy"};
+    DynamicArray *entries = new_entries(pool, names, G_N_ELEMENTS(names));
+    // the index is only used if it rules out most entries
+    for (uint32_t i = 0; i < 100; i++) {
+        FsearchDatabaseEntry *entry = fsearch_memory_pool_malloc(pool);
+        db_entry_set_type(entry, DATABASE_ENTRY_TYPE_FILE);
+        g_autofree char *name = g_strdup_printf("other_%u", i);
+        db_entry_set_name(entry, name);
+        darray_add_item(entries, entry);
+    }
+    DynamicArray *folders = darray_new(0);
+    FsearchDatabaseTrigrams *trigrams = db_trigrams_new(folders, entries, NULL);
+    const FsearchDatabaseTrigramList *list = &trigrams->file_trigrams;
+    g_assert_cmpuint(list->num_entries, ==, darray_get_num_items(entries));
+    check_candidates(list, entries, (const char *[]){"other"}, 1, false);
+    g_assert_cmpuint(trigrams->folder_trigrams.num_keys, ==, 0);
+
+    // the index ignores the case
+    check_candidates(list, entries, (const char *[]){"MAKE"}, 1, true);
+    check_candidates(list, entries, (const char *[]){"readme", ".txt"}, 2, true);
+    check_candidates(list, entries, (const char *[]){"\xc3\xa4rg"}, 1, true);
+
+    uint32_t num_candidates = 0;
+    g_autofree uint32_t *candidates =
+        db_trigram_list_get_candidates(list, (const char *[]){"xyz"}, 1, &num_candidates);
+    g_assert_cmpuint(num_candidates, ==, 1);
+    g_assert_cmpuint(candidates[0], ==, 7);
+
+    // no name contains this trigram
+    g_autofree uint32_t *no_candidates =
+        db_trigram_list_get_candidates(list, (const char *[]){"qqq"}, 1, &num_candidates);
+    g_assert_nonnull(no_candidates);
+    g_assert_cmpuint(num_candidates, ==, 0);
+
+    // needles without trigrams can't be filtered
+    g_assert_null(db_trigram_list_get_candidates(list, (const char *[]){"ab"}, 1, &num_candidates));
+
+    g_assert_cmpuint(db_trigrams_get_memory_size(trigrams), >, 0);
+    g_clear_pointer(&trigrams, db_trigrams_unref);
+    g_clear_pointer(&folders, darray_unref);
+    g_clear_pointer(&entries, darray_unref);
+    g_clear_pointer(&pool, fsearch_memory_pool_free_pool);
+}
+
+static void
+test_random_names(void) {
+    FsearchMemoryPool *pool =
+        fsearch_memory_pool_new(4096, db_entry_get_sizeof_file_entry(), (GDestroyNotify)db_entry_destroy);
+    DynamicArray *entries = new_random_entries(pool, 20000, 42);
+    DynamicArray *folders = darray_new(0);
+    FsearchDatabaseTrigrams *trigrams = db_trigrams_new(folders, entries, NULL);
+
+    check_candidates(&trigrams->file_trigrams, entries, (const char *[]){"abc"}, 1, true);
+    check_candidates(&trigrams->file_trigrams, entries, (const char *[]){"HIJK", "012"}, 2, true);
+    check_candidates(&trigrams->file_trigrams, entries, (const char *[]){"_.-\xc3\xa4"}, 1, true);
+    check_candidates(&trigrams->file_trigrams, entries, (const char *[]){"n01", "abc", "ggg"}, 3, true);
+
+    g_clear_pointer(&trigrams, db_trigrams_unref);
+    g_clear_pointer(&folders, darray_unref);
+    g_clear_pointer(&entries, darray_unref);
+    g_clear_pointer(&pool, fsearch_memory_pool_free_pool);
+}
+
+static void
+test_parallel_build(void) {
+    FsearchMemoryPool *pool =
+        fsearch_memory_pool_new(4096, db_entry_get_sizeof_file_entry(), (GDestroyNotify)db_entry_destroy);
+    // large enough to be split into multiple partitions
+    DynamicArray *entries = new_random_entries(pool, 600000, 7);
+    DynamicArray *folders = darray_new(0);
+    FsearchThreadPool *thread_pool = fsearch_thread_pool_new(4);
+
+    FsearchDatabaseTrigrams *serial = db_trigrams_new(folders, entries, NULL);
+    FsearchDatabaseTrigrams *parallel = db_trigrams_new(folders, entries, thread_pool);
+    const FsearchDatabaseTrigramList *a = &serial->file_trigrams;
+    const FsearchDatabaseTrigramList *b = &parallel->file_trigrams;
+    g_assert_cmpuint(a->num_keys, ==, b->num_keys);
+    g_assert_cmpmem(a->keys, a->num_keys * sizeof(uint32_t), b->keys, b->num_keys * sizeof(uint32_t));
+    g_assert_cmpmem(a->num_postings,
+                    a->num_keys * sizeof(uint32_t),
+                    b->num_postings,
+                    b->num_keys * sizeof(uint32_t));
+    g_assert_cmpmem(a->offsets,
+                    (a->num_keys + 1) * sizeof(uint64_t),
+                    b->offsets,
+                    (b->num_keys + 1) * sizeof(uint64_t));
+    g_assert_cmpmem(a->postings, a->offsets[a->num_keys], b->postings, b->offsets[b->num_keys]);
+
+    check_candidates(b, entries, (const char *[]){"HIJK", "0123"}, 2, true);
+
+    g_clear_pointer(&serial, db_trigrams_unref);
+    g_clear_pointer(&parallel, db_trigrams_unref);
+    g_clear_pointer(&thread_pool, fsearch_thread_pool_unref);
+    g_clear_pointer(&folders, darray_unref);
+    g_clear_pointer(&entries, darray_unref);
+    g_clear_pointer(&pool, fsearch_memory_pool_free_pool);
+}
+
+static void
+test_from_lists(void) {
+    FsearchMemoryPool *pool =
+        fsearch_memory_pool_new(1024, db_entry_get_sizeof_file_entry(), (GDestroyNotify)db_entry_destroy);
+    DynamicArray *entries = new_random_entries(pool, 1000, 3);
+    DynamicArray *folders = darray_new(0);
+    FsearchDatabaseTrigrams *trigrams = db_trigrams_new(folders, entries, NULL);
+    GBytes *contents = g_bytes_new_static("", 0);
+
+    FsearchDatabaseTrigrams *loaded = db_trigrams_new_from_lists(folders,
+                                                                 entries,
+                                                                 &trigrams->folder_trigrams,
+                                                                 &trigrams->file_trigrams,
+                                                                 contents);
+    g_assert_nonnull(loaded);
+    check_candidates(&loaded->file_trigrams, entries, (const char *[]){"abc"}, 1, true);
+    g_clear_pointer(&loaded, db_trigrams_unref);
+
+    // lists of other arrays are rejected
+    g_assert_null(db_trigrams_new_from_lists(entries,
+                                             folders,
+                                             &trigrams->folder_trigrams,
+                                             &trigrams->file_trigrams,
+                                             contents));
+
+    // as are damaged ones
+    FsearchDatabaseTrigramList damaged = trigrams->file_trigrams;
+    g_autofree uint64_t *offsets = g_new(uint64_t, damaged.num_keys + 1);
+    memcpy(offsets, damaged.offsets, (damaged.num_keys + 1) * sizeof(uint64_t));
+    offsets[1] = offsets[2] + 1;
+    damaged.offsets = offsets;
+    g_assert_null(db_trigrams_new_from_lists(folders, entries, &trigrams->folder_trigrams, &damaged, contents));
+
+    g_clear_pointer(&contents, g_bytes_unref);
+    g_clear_pointer(&trigrams, db_trigrams_unref);
+    g_clear_pointer(&folders, darray_unref);
+    g_clear_pointer(&entries, darray_unref);
+    g_clear_pointer(&pool, fsearch_memory_pool_free_pool);
+}
+
+int
+main(int argc, char *argv[]) {
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/FSearch/database_trigrams/candidates", test_candidates);
+    g_test_add_func("/FSearch/database_trigrams/random_names", test_random_names);
+    g_test_add_func("/FSearch/database_trigrams/parallel_build", test_parallel_build);
+    g_test_add_func("/FSearch/database_trigrams/from_lists", test_from_lists);
+    return g_test_run();
+}
@@ -0,0 +1,201 @@
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <locale.h>
+#include <string.h>
+
+#include <src/fsearch_duplicates.h>
+#include <src/fsearch_memory_pool.h>
+
+#define BIG_FILE_SIZE (3 * FSEARCH_DUPLICATES_BLOCK_SIZE + 100)
+
+typedef struct {
+    char *dir;
+    FsearchMemoryPool *pool;
+    FsearchDatabaseEntry *root;
+    FsearchDatabaseEntry *folder;
+    // sorted by size, like the files in the size order of the database
+    DynamicArray *files;
+    GPtrArray *paths;
+} DuplicatesFixture;
+
+static FsearchDatabaseEntry *
+add_file(DuplicatesFixture *fixture, const char *name, const char *contents, size_t len) {
+    g_autofree char *path = g_build_filename(fixture->dir, name, NULL);
+    g_assert_true(g_file_set_contents(path, contents, (gssize)len, NULL));
+    g_ptr_array_add(fixture->paths, g_steal_pointer(&path));
+
+    FsearchDatabaseEntry *file = fsearch_memory_pool_malloc(fixture->pool);
+    db_entry_set_type(file, DATABASE_ENTRY_TYPE_FILE);
+    db_entry_set_name(file, name);
+    db_entry_set_size(file, (off_t)len);
+    db_entry_set_parent(file, (FsearchDatabaseEntryFolder *)fixture->folder);
+    darray_add_item(fixture->files, file);
+    return file;
+}
+
+static char *
+new_contents(char c) {
+    char *contents = g_malloc(BIG_FILE_SIZE);
+    memset(contents, c, BIG_FILE_SIZE);
+    return contents;
+}
+
+static void
+fixture_set_up(DuplicatesFixture *fixture) {
+    fixture->dir = g_dir_make_tmp("fsearch_test_XXXXXX", NULL);
+    g_assert_nonnull(fixture->dir);
+    fixture->pool = fsearch_memory_pool_new(16, db_entry_get_sizeof_folder_entry(), (GDestroyNotify)db_entry_destroy);
+    fixture->files = darray_new(16);
+    fixture->paths = g_ptr_array_new_with_free_func(g_free);
+
+    fixture->root = fsearch_memory_pool_malloc(fixture->pool);
+    db_entry_set_type(fixture->root, DATABASE_ENTRY_TYPE_FOLDER);
+    db_entry_set_name(fixture->root, "");
+    fixture->folder = fsearch_memory_pool_malloc(fixture->pool);
+    db_entry_set_type(fixture->folder, DATABASE_ENTRY_TYPE_FOLDER);
+    // the path of the temporary directory without its leading separator
+    db_entry_set_name(fixture->folder, fixture->dir + 1);
+    db_entry_set_parent(fixture->folder, (FsearchDatabaseEntryFolder *)fixture->root);
+}
+
+static void
+fixture_tear_down(DuplicatesFixture *fixture) {
+    for (uint32_t i = 0; i < fixture->paths->len; i++) {
+        g_remove(g_ptr_array_index(fixture->paths, i));
+    }
+    g_remove(fixture->dir);
+    g_clear_pointer(&fixture->paths, g_ptr_array_unref);
+    g_clear_pointer(&fixture->files, darray_unref);
+    g_clear_pointer(&fixture->pool, fsearch_memory_pool_free_pool);
+    g_clear_pointer(&fixture->dir, g_free);
+}
+
+static void
+test_find(void) {
+    DuplicatesFixture fixture = {0};
+    fixture_set_up(&fixture);
+    fsearch_duplicates_clear_cache();
+
+    // empty files are never duplicates
+    add_file(&fixture, "empty_a", "", 0);
+    add_file(&fixture, "empty_b", "", 0);
+    add_file(&fixture, "unique", "u", 1);
+    FsearchDatabaseEntry *small_a = add_file(&fixture, "small_a", "small", 5);
+    FsearchDatabaseEntry *small_b = add_file(&fixture, "small_b", "small", 5);
+    FsearchDatabaseEntry *small_c = add_file(&fixture, "small_c", "SMALL", 5);
+
+    g_autofree char *a = new_contents('a');
+    g_autofree char *middle = new_contents('a');
+    middle[BIG_FILE_SIZE / 2] = 'b';
+    g_autofree char *start = new_contents('a');
+    start[0] = 'b';
+    FsearchDatabaseEntry *big_a = add_file(&fixture, "big_a", a, BIG_FILE_SIZE);
+    FsearchDatabaseEntry *big_middle = add_file(&fixture, "big_middle", middle, BIG_FILE_SIZE);
+    FsearchDatabaseEntry *big_start = add_file(&fixture, "big_start", start, BIG_FILE_SIZE);
+    FsearchDatabaseEntry *big_b = add_file(&fixture, "big_b", a, BIG_FILE_SIZE);
+    // it got smaller since it was indexed
+    FsearchDatabaseEntry *big_changed = add_file(&fixture, "big_changed", a, BIG_FILE_SIZE);
+    g_assert_true(g_file_set_contents(g_ptr_array_index(fixture.paths, fixture.paths->len - 1), "a", 1, NULL));
+
+    FsearchDuplicates *duplicates = fsearch_duplicates_find(fixture.files, NULL);
+    g_assert_nonnull(duplicates);
+    g_assert_cmpuint(fsearch_duplicates_get_num_groups(duplicates), ==, 2);
+    g_assert_cmpuint(fsearch_duplicates_get_num_files(duplicates), ==, 4);
+
+    uint32_t small_group = 0;
+    uint32_t group = 0;
+    g_assert_true(fsearch_duplicates_lookup(duplicates, small_a, &small_group));
+    g_assert_true(fsearch_duplicates_lookup(duplicates, small_b, &group));
+    g_assert_cmpuint(group, ==, small_group);
+    g_assert_false(fsearch_duplicates_lookup(duplicates, small_c, NULL));
+
+    uint32_t big_group = 0;
+    g_assert_true(fsearch_duplicates_lookup(duplicates, big_a, &big_group));
+    g_assert_true(fsearch_duplicates_lookup(duplicates, big_b, &group));
+    g_assert_cmpuint(group, ==, big_group);
+    g_assert_cmpuint(big_group, !=, small_group);
+    g_assert_false(fsearch_duplicates_lookup(duplicates, big_middle, NULL));
+    g_assert_false(fsearch_duplicates_lookup(duplicates, big_start, NULL));
+    g_assert_false(fsearch_duplicates_lookup(duplicates, big_changed, NULL));
+    for (uint32_t i = 0; i < 3; i++) {
+        g_assert_false(fsearch_duplicates_lookup(duplicates, darray_get_item(fixture.files, i), NULL));
+    }
+
+    uint32_t num_files = 0;
+    FsearchDatabaseEntry **files = fsearch_duplicates_get_group(duplicates, big_group, &num_files);
+    g_assert_cmpuint(num_files, ==, 2);
+    // in the order of the files
+    g_assert_true(files[0] == big_a);
+    g_assert_true(files[1] == big_b);
+
+    FsearchDuplicatesStats stats = {0};
+    fsearch_duplicates_get_stats(duplicates, &stats);
+    g_assert_cmpuint(stats.num_candidates, ==, 8);
+    g_assert_cmpuint(stats.num_block_hashes, ==, 7);
+    // only the large files with the same first and last blocks are read completely
+    g_assert_cmpuint(stats.num_full_hashes, ==, 3);
+    g_assert_cmpuint(stats.num_cache_hits, ==, 0);
+    g_clear_pointer(&duplicates, fsearch_duplicates_unref);
+
+    // the second time nothing has to be read again
+    g_assert_cmpuint(fsearch_duplicates_get_num_cached(), ==, 7);
+    duplicates = fsearch_duplicates_find(fixture.files, NULL);
+    g_assert_cmpuint(fsearch_duplicates_get_num_groups(duplicates), ==, 2);
+    fsearch_duplicates_get_stats(duplicates, &stats);
+    g_assert_cmpuint(stats.num_block_hashes, ==, 0);
+    g_assert_cmpuint(stats.num_full_hashes, ==, 0);
+    g_assert_cmpuint(stats.num_cache_hits, ==, 7);
+    g_clear_pointer(&duplicates, fsearch_duplicates_unref);
+
+    fsearch_duplicates_clear_cache();
+    fixture_tear_down(&fixture);
+}
+
+static void
+test_snapshot(void) {
+    DuplicatesFixture fixture = {0};
+    fixture_set_up(&fixture);
+    fsearch_duplicates_clear_cache();
+    FsearchDatabaseEntry *a = add_file(&fixture, "a", "same", 4);
+    FsearchDatabaseEntry *b = add_file(&fixture, "b", "same", 4);
+    add_file(&fixture, "c", "other", 5);
+
+    FsearchDuplicatesSnapshot *snapshot = fsearch_duplicates_snapshot_new(fixture.files);
+    // the entries aren't read anymore, they could change or go away while it runs
+    db_entry_set_name(a, "renamed");
+    db_entry_set_size(b, 0);
+
+    FsearchDuplicates *duplicates = fsearch_duplicates_find_in_snapshot(snapshot, NULL);
+    g_assert_nonnull(duplicates);
+    g_assert_cmpuint(fsearch_duplicates_get_num_groups(duplicates), ==, 1);
+    g_assert_true(fsearch_duplicates_lookup(duplicates, a, NULL));
+    g_assert_true(fsearch_duplicates_lookup(duplicates, b, NULL));
+    g_clear_pointer(&duplicates, fsearch_duplicates_unref);
+
+    fsearch_duplicates_clear_cache();
+    fixture_tear_down(&fixture);
+}
+
+static void
+test_cancel(void) {
+    DuplicatesFixture fixture = {0};
+    fixture_set_up(&fixture);
+    add_file(&fixture, "a", "same", 4);
+    add_file(&fixture, "b", "same", 4);
+
+    g_autoptr(GCancellable) cancellable = g_cancellable_new();
+    g_cancellable_cancel(cancellable);
+    g_assert_null(fsearch_duplicates_find(fixture.files, cancellable));
+
+    fixture_tear_down(&fixture);
+}
+
+int
+main(int argc, char *argv[]) {
+    setlocale(LC_ALL, "");
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/FSearch/duplicates/find", test_find);
+    g_test_add_func("/FSearch/duplicates/snapshot", test_snapshot);
+    g_test_add_func("/FSearch/duplicates/cancel", test_cancel);
+    return g_test_run();
+}
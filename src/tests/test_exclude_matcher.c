@@ -0,0 +1,85 @@
+#include <fnmatch.h>
+#include <glib.h>
+#include <locale.h>
+#include <stdlib.h>
+
+#include <src/fsearch_exclude_matcher.h>
+#include <src/fsearch_exclude_path.h>
+
+static void
+check_names(char **patterns, const char **names, uint32_t num_names) {
+    FsearchExcludeMatcher *matcher = fsearch_exclude_matcher_new(NULL, patterns);
+    for (uint32_t i = 0; i < num_names; i++) {
+        bool expected = false;
+        for (uint32_t j = 0; patterns[j] && !expected; j++) {
+            expected = fnmatch(patterns[j], names[i], 0) == 0;
+        }
+        if (expected != fsearch_exclude_matcher_name_is_excluded(matcher, names[i])) {
+            g_printerr("unexpected result for: %s\n", names[i]);
+        }
+        g_assert_true(expected == fsearch_exclude_matcher_name_is_excluded(matcher, names[i]));
+    }
+    g_clear_pointer(&matcher, fsearch_exclude_matcher_free);
+}
+
+static void
+test_exclude_names(void) {
+    char *patterns[] = {
+        ".git",   "node_modules", "*.o",         "*~",    "*.tar.gz",     "cache*", "#*#", "*.[ch]",  "[!a-z]*.bak",
+        "?.tmp",  "a?",           "*[[:digit:]]", "[]x]y", "a\\*b",        "a[",     "*build*", "x*y*z", NULL,
+    };
+    const char *names[] = {
+        ".git",     "git",      "node_modules", "main.o",   "main.c",  "main.h",  "main.cc", "file~",
+        "a.tar.gz", "a.tar",    "cache",        "cachedir", "acache",  "#x#",     "#x",      "Zoo.bak",
+        "zoo.bak",  "1.bak",    "a.tmp",        "ab.tmp",   "file1",   "file",    "]y",      "xy",
+        "a*b",      "axb",      "a[",           "ab",       "rebuild", "builder", "xaybz",   "xzy",
+        "",         "*",        "\xff\xfe.o",   "\xff.tmp", "\xff.bak", "a\xff",
+    };
+    check_names(patterns, names, G_N_ELEMENTS(names));
+
+    // without any patterns nothing gets excluded
+    FsearchExcludeMatcher *matcher = fsearch_exclude_matcher_new(NULL, NULL);
+    g_assert_false(fsearch_exclude_matcher_name_is_excluded(matcher, "file"));
+    g_clear_pointer(&matcher, fsearch_exclude_matcher_free);
+}
+
+static void
+test_exclude_names_utf8(void) {
+    // fnmatch matches characters instead of bytes only in UTF-8 locales
+    if (!setlocale(LC_CTYPE, "C.UTF-8") && !setlocale(LC_CTYPE, "en_US.UTF-8")) {
+        g_test_skip("no UTF-8 locale available");
+        return;
+    }
+    char *patterns[] = {"ü?.txt", "[ä-ö]x", "*ß", "?", "[[:alpha:]]y", "*[[:upper:]]", NULL};
+    const char *names[] = {"üa.txt", "üab.txt", "üä.txt", "äx", "öx", "üx", "straß", "ß",  "a",
+                           "\xff",   "ab",      "äy",     "1y", "zÄ", "zä", "zA",    "z1"};
+    check_names(patterns, names, G_N_ELEMENTS(names));
+    setlocale(LC_CTYPE, "C");
+}
+
+static void
+test_exclude_paths(void) {
+    GList *excludes = NULL;
+    excludes = g_list_append(excludes, fsearch_exclude_path_new("/home/user/.cache", true));
+    excludes = g_list_append(excludes, fsearch_exclude_path_new("/tmp", false));
+    excludes = g_list_append(excludes, fsearch_exclude_path_new("/tmp", true));
+
+    FsearchExcludeMatcher *matcher = fsearch_exclude_matcher_new(excludes, NULL);
+    g_assert_true(fsearch_exclude_matcher_path_is_excluded(matcher, "/home/user/.cache"));
+    g_assert_false(fsearch_exclude_matcher_path_is_excluded(matcher, "/home/user"));
+    g_assert_false(fsearch_exclude_matcher_path_is_excluded(matcher, "/home/user/.cache/sub"));
+    // the first entry for a path decides
+    g_assert_false(fsearch_exclude_matcher_path_is_excluded(matcher, "/tmp"));
+    g_clear_pointer(&matcher, fsearch_exclude_matcher_free);
+
+    g_list_free_full(excludes, (GDestroyNotify)fsearch_exclude_path_free);
+}
+
+int
+main(int argc, char *argv[]) {
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/FSearch/exclude_matcher/names", test_exclude_names);
+    g_test_add_func("/FSearch/exclude_matcher/names_utf8", test_exclude_names_utf8);
+    g_test_add_func("/FSearch/exclude_matcher/paths", test_exclude_paths);
+    return g_test_run();
+}
@@ -0,0 +1,104 @@
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <locale.h>
+#include <string.h>
+
+#include <src/fsearch_file_operation.h>
+
+static char *
+create_file(const char *dir, const char *name) {
+    char *path = g_build_filename(dir, name, NULL);
+    g_assert_true(g_file_set_contents(path, name, -1, NULL));
+    return path;
+}
+
+static void
+on_progress(uint32_t num_done, uint32_t num_paths, gpointer user_data) {
+    volatile gint *max_done = user_data;
+    g_assert_cmpuint(num_done, <=, num_paths);
+    gint current = g_atomic_int_get(max_done);
+    while ((uint32_t)current < num_done && !g_atomic_int_compare_and_exchange(max_done, current, num_done)) {
+        current = g_atomic_int_get(max_done);
+    }
+}
+
+static void
+test_delete(void) {
+    g_autofree char *root = g_dir_make_tmp("fsearch_test_XXXXXX", NULL);
+    g_assert_nonnull(root);
+    g_autofree char *folder = g_build_filename(root, "build", NULL);
+    g_assert_cmpint(g_mkdir(folder, 0700), ==, 0);
+
+    // the folder comes first, but it's only empty once its contents are gone
+    g_autoptr(GPtrArray) paths = g_ptr_array_new_with_free_func(g_free);
+    g_ptr_array_add(paths, g_strdup(folder));
+    for (uint32_t i = 0; i < 200; i++) {
+        g_autofree char *name = g_strdup_printf("%u.o", i);
+        g_ptr_array_add(paths, create_file(folder, name));
+    }
+    g_autofree char *missing = g_build_filename(root, "missing", NULL);
+    g_ptr_array_add(paths, g_strdup(missing));
+    g_autofree char *kept = create_file(root, "kept.txt");
+
+    FsearchFileOperation *operation = fsearch_file_operation_new(FSEARCH_FILE_OPERATION_DELETE, paths);
+    g_assert_cmpuint(fsearch_file_operation_get_num_paths(operation), ==, paths->len);
+    g_assert_null(fsearch_file_operation_get_error_messages(operation));
+    volatile gint max_done = 0;
+    g_assert_true(fsearch_file_operation_run(operation, NULL, on_progress, (gpointer)&max_done));
+    g_assert_cmpuint(max_done, ==, paths->len);
+
+    GPtrArray *removed_paths = fsearch_file_operation_get_removed_paths(operation);
+    g_assert_cmpuint(removed_paths->len, ==, paths->len - 1);
+    for (uint32_t i = 0; i < removed_paths->len; i++) {
+        g_assert_cmpstr(g_ptr_array_index(removed_paths, i), !=, missing);
+    }
+    g_assert_false(g_file_test(folder, G_FILE_TEST_EXISTS));
+    g_assert_true(g_file_test(kept, G_FILE_TEST_EXISTS));
+    // only the path which didn't exist failed
+    const char *error_messages = fsearch_file_operation_get_error_messages(operation);
+    g_assert_nonnull(error_messages);
+    g_auto(GStrv) lines = g_strsplit(error_messages, "\n", -1);
+    // the last line is empty
+    g_assert_cmpuint(g_strv_length(lines), ==, 2);
+    // it tells which file couldn't be removed
+    g_assert_nonnull(strstr(lines[0], missing));
+    g_clear_pointer(&operation, fsearch_file_operation_free);
+
+    g_remove(kept);
+    g_remove(root);
+}
+
+static void
+test_cancel(void) {
+    g_autofree char *root = g_dir_make_tmp("fsearch_test_XXXXXX", NULL);
+    g_assert_nonnull(root);
+    g_autoptr(GPtrArray) paths = g_ptr_array_new_with_free_func(g_free);
+    for (uint32_t i = 0; i < 10; i++) {
+        g_autofree char *name = g_strdup_printf("%u.txt", i);
+        g_ptr_array_add(paths, create_file(root, name));
+    }
+
+    g_autoptr(GCancellable) cancellable = g_cancellable_new();
+    g_cancellable_cancel(cancellable);
+    FsearchFileOperation *operation = fsearch_file_operation_new(FSEARCH_FILE_OPERATION_DELETE, paths);
+    g_assert_false(fsearch_file_operation_run(operation, cancellable, NULL, NULL));
+    g_assert_cmpuint(fsearch_file_operation_get_removed_paths(operation)->len, ==, 0);
+    g_assert_null(fsearch_file_operation_get_error_messages(operation));
+    g_clear_pointer(&operation, fsearch_file_operation_free);
+
+    for (uint32_t i = 0; i < paths->len; i++) {
+        const char *path = g_ptr_array_index(paths, i);
+        g_assert_true(g_file_test(path, G_FILE_TEST_EXISTS));
+        g_remove(path);
+    }
+    g_remove(root);
+}
+
+int
+main(int argc, char *argv[]) {
+    setlocale(LC_ALL, "");
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/FSearch/file_operation/delete", test_delete);
+    g_test_add_func("/FSearch/file_operation/cancel", test_cancel);
+    return g_test_run();
+}
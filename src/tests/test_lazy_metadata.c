@@ -0,0 +1,130 @@
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <locale.h>
+#include <sys/stat.h>
+
+#include <src/fsearch_lazy_metadata.h>
+
+typedef struct {
+    char *dir;
+    GPtrArray *paths;
+} LazyMetadataFixture;
+
+static void
+fixture_set_up(LazyMetadataFixture *fixture, uint32_t num_files) {
+    fixture->dir = g_dir_make_tmp("fsearch_test_XXXXXX", NULL);
+    g_assert_nonnull(fixture->dir);
+    fixture->paths = g_ptr_array_new_with_free_func(g_free);
+    for (uint32_t i = 0; i < num_files; i++) {
+        g_autofree char *name = g_strdup_printf("file_%u", i);
+        char *path = g_build_filename(fixture->dir, name, NULL);
+        // every file has a size of its own
+        g_autofree char *contents = g_strnfill(i, 'x');
+        g_assert_true(g_file_set_contents(path, contents, i, NULL));
+        g_ptr_array_add(fixture->paths, path);
+    }
+}
+
+static void
+fixture_tear_down(LazyMetadataFixture *fixture) {
+    for (uint32_t i = 0; i < fixture->paths->len; i++) {
+        g_remove(g_ptr_array_index(fixture->paths, i));
+    }
+    g_remove(fixture->dir);
+    g_clear_pointer(&fixture->paths, g_ptr_array_unref);
+    g_clear_pointer(&fixture->dir, g_free);
+}
+
+static void
+check_fetch(uint32_t num_files) {
+    LazyMetadataFixture fixture = {0};
+    fixture_set_up(&fixture, num_files);
+    FsearchThreadPool *pool = fsearch_thread_pool_get_default();
+    FsearchLazyMetadata *metadata = fsearch_lazy_metadata_new(10000);
+
+    const char *const *paths = (const char *const *)fixture.paths->pdata;
+    g_assert_false(fsearch_lazy_metadata_lookup(metadata, paths[0], NULL));
+    g_assert_cmpuint(fsearch_lazy_metadata_fetch(metadata, pool, paths, num_files), ==, num_files);
+    g_assert_cmpuint(fsearch_lazy_metadata_get_num_cached(metadata), ==, num_files);
+    for (uint32_t i = 0; i < num_files; i++) {
+        struct stat st;
+        g_assert_cmpint(lstat(paths[i], &st), ==, 0);
+        FsearchLazyMetadataValues values = {0};
+        g_assert_true(fsearch_lazy_metadata_lookup(metadata, paths[i], &values));
+        g_assert_false(values.missing);
+        g_assert_cmpint(values.size, ==, i);
+        g_assert_cmpint(values.mtime, ==, st.st_mtime);
+    }
+    // they're only fetched once
+    g_assert_cmpuint(fsearch_lazy_metadata_fetch(metadata, pool, paths, num_files), ==, 0);
+
+    g_clear_pointer(&metadata, fsearch_lazy_metadata_free);
+    g_clear_pointer(&pool, fsearch_thread_pool_unref);
+    fixture_tear_down(&fixture);
+}
+
+static void
+test_fetch(void) {
+    check_fetch(3);
+}
+
+static void
+test_parallel(void) {
+    // several batches, which are fetched by different threads
+    check_fetch(20 * FSEARCH_LAZY_METADATA_BATCH_SIZE + 3);
+}
+
+static void
+test_missing(void) {
+    LazyMetadataFixture fixture = {0};
+    fixture_set_up(&fixture, 1);
+    FsearchThreadPool *pool = fsearch_thread_pool_get_default();
+    FsearchLazyMetadata *metadata = fsearch_lazy_metadata_new(10);
+
+    g_autofree char *missing_path = g_build_filename(fixture.dir, "missing", NULL);
+    const char *paths[] = {missing_path};
+    g_assert_cmpuint(fsearch_lazy_metadata_fetch(metadata, pool, paths, 1), ==, 1);
+    FsearchLazyMetadataValues values = {0};
+    // it isn't looked up again either
+    g_assert_true(fsearch_lazy_metadata_lookup(metadata, missing_path, &values));
+    g_assert_true(values.missing);
+
+    fsearch_lazy_metadata_clear(metadata);
+    g_assert_cmpuint(fsearch_lazy_metadata_get_num_cached(metadata), ==, 0);
+    g_assert_false(fsearch_lazy_metadata_lookup(metadata, missing_path, NULL));
+
+    g_clear_pointer(&metadata, fsearch_lazy_metadata_free);
+    g_clear_pointer(&pool, fsearch_thread_pool_unref);
+    fixture_tear_down(&fixture);
+}
+
+static void
+test_limit(void) {
+    LazyMetadataFixture fixture = {0};
+    fixture_set_up(&fixture, 5);
+    FsearchThreadPool *pool = fsearch_thread_pool_get_default();
+    FsearchLazyMetadata *metadata = fsearch_lazy_metadata_new(4);
+
+    const char *const *paths = (const char *const *)fixture.paths->pdata;
+    g_assert_cmpuint(fsearch_lazy_metadata_fetch(metadata, pool, paths, 3), ==, 3);
+    // the first ones get dropped to make room for the others
+    g_assert_cmpuint(fsearch_lazy_metadata_fetch(metadata, pool, paths + 3, 2), ==, 2);
+    g_assert_cmpuint(fsearch_lazy_metadata_get_num_cached(metadata), ==, 2);
+    g_assert_false(fsearch_lazy_metadata_lookup(metadata, paths[0], NULL));
+    g_assert_true(fsearch_lazy_metadata_lookup(metadata, paths[4], NULL));
+
+    g_clear_pointer(&metadata, fsearch_lazy_metadata_free);
+    g_clear_pointer(&pool, fsearch_thread_pool_unref);
+    fixture_tear_down(&fixture);
+}
+
+int
+main(int argc, char *argv[]) {
+    setlocale(LC_ALL, "");
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/FSearch/lazy_metadata/fetch", test_fetch);
+    g_test_add_func("/FSearch/lazy_metadata/parallel", test_parallel);
+    g_test_add_func("/FSearch/lazy_metadata/missing", test_missing);
+    g_test_add_func("/FSearch/lazy_metadata/limit", test_limit);
+    return g_test_run();
+}
@@ -0,0 +1,137 @@
+#include <glib.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <src/fsearch_memory_pool.h>
+
+typedef struct Item {
+    uint64_t value;
+    uint64_t padding[3];
+} Item;
+
+static uint32_t num_items_freed = 0;
+
+static void
+item_free(Item *item) {
+    num_items_freed++;
+}
+
+static void
+fill_pool(FsearchMemoryPool *pool, uint32_t num_items) {
+    for (uint32_t i = 0; i < num_items; i++) {
+        Item *item = fsearch_memory_pool_malloc(pool);
+        g_assert_nonnull(item);
+        // new items are zero initialized
+        g_assert_cmpuint(item->value, ==, 0);
+        item->value = i + 1;
+    }
+}
+
+static void
+test_main(void) {
+    FsearchMemoryPool *pool = fsearch_memory_pool_new(10, sizeof(Item), (GDestroyNotify)item_free);
+    fill_pool(pool, 25);
+
+    Item *item = fsearch_memory_pool_malloc(pool);
+    fsearch_memory_pool_free(pool, item, false);
+    // freed items get reused first
+    g_assert_true(fsearch_memory_pool_malloc(pool) == item);
+
+    num_items_freed = 0;
+    g_clear_pointer(&pool, fsearch_memory_pool_free_pool);
+    g_assert_cmpuint(num_items_freed, ==, 26);
+}
+
+static void
+test_reset(void) {
+    FsearchMemoryPool *pool = fsearch_memory_pool_new(10, sizeof(Item), (GDestroyNotify)item_free);
+    fill_pool(pool, 25);
+
+    num_items_freed = 0;
+    fsearch_memory_pool_reset(pool);
+    g_assert_cmpuint(num_items_freed, ==, 0);
+    g_assert_cmpuint(fsearch_memory_pool_get_memory_size(pool), <, sizeof(Item) * 25);
+
+    // the pool stays usable
+    fill_pool(pool, 25);
+    g_clear_pointer(&pool, fsearch_memory_pool_free_pool);
+    g_assert_cmpuint(num_items_freed, ==, 25);
+}
+
+static void
+test_reserve(void) {
+    FsearchMemoryPool *pool = fsearch_memory_pool_new(10, sizeof(Item), NULL);
+    const size_t empty_size = fsearch_memory_pool_get_memory_size(pool);
+
+    // the empty block gets replaced by one which can hold all items
+    fsearch_memory_pool_reserve(pool, 1000);
+    const size_t reserved_size = fsearch_memory_pool_get_memory_size(pool);
+    g_assert_cmpuint(reserved_size, >=, sizeof(Item) * 1000);
+    g_assert_cmpuint(reserved_size, <, sizeof(Item) * 1000 + empty_size);
+
+    Item *first = fsearch_memory_pool_malloc(pool);
+    fill_pool(pool, 998);
+    g_assert_cmpuint(fsearch_memory_pool_get_memory_size(pool), ==, reserved_size);
+    // all items are allocated from the same block
+    Item *last = first + 998;
+    g_assert_cmpuint(last->value, ==, 998);
+
+    // there's still enough space left
+    fsearch_memory_pool_reserve(pool, 1);
+    g_assert_cmpuint(fsearch_memory_pool_get_memory_size(pool), ==, reserved_size);
+
+    g_clear_pointer(&pool, fsearch_memory_pool_free_pool);
+}
+
+static void
+test_malloc_items(void) {
+    FsearchMemoryPool *pool = fsearch_memory_pool_new(10, sizeof(Item), (GDestroyNotify)item_free);
+    fill_pool(pool, 5);
+
+    // more than fit into the current block
+    Item *items = fsearch_memory_pool_malloc_items(pool, 100);
+    g_assert_nonnull(items);
+    for (uint32_t i = 0; i < 100; i++) {
+        g_assert_cmpuint(items[i].value, ==, 0);
+        items[i].value = i + 1;
+    }
+    // the block is full, the next ones get a new one
+    Item *more = fsearch_memory_pool_malloc_items(pool, 2);
+    g_assert_cmpuint(more[0].value, ==, 0);
+    g_assert_cmpuint(more[1].value, ==, 0);
+    fsearch_memory_pool_free(pool, &items[50], false);
+    g_assert_true(fsearch_memory_pool_malloc(pool) == &items[50]);
+
+    num_items_freed = 0;
+    g_clear_pointer(&pool, fsearch_memory_pool_free_pool);
+    g_assert_cmpuint(num_items_freed, ==, 107);
+}
+
+static void
+test_huge_pages(void) {
+    FsearchMemoryPool *pool = fsearch_memory_pool_new(10, sizeof(Item), NULL);
+    fsearch_memory_pool_set_use_huge_pages(pool, true);
+    fsearch_memory_pool_reserve(pool, 100);
+
+    // the block gets rounded up to a full huge page and all of it is used for items
+    const size_t size = fsearch_memory_pool_get_memory_size(pool);
+    g_assert_cmpuint(size, >=, 2 * 1024 * 1024);
+    const uint32_t num_items = 2 * 1024 * 1024 / sizeof(Item) - 1;
+    fill_pool(pool, num_items);
+    g_assert_cmpuint(fsearch_memory_pool_get_memory_size(pool), ==, size);
+
+    fsearch_memory_pool_reset(pool);
+    fill_pool(pool, 100);
+    g_clear_pointer(&pool, fsearch_memory_pool_free_pool);
+}
+
+int
+main(int argc, char *argv[]) {
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/FSearch/memory_pool/main", test_main);
+    g_test_add_func("/FSearch/memory_pool/reset", test_reset);
+    g_test_add_func("/FSearch/memory_pool/reserve", test_reserve);
+    g_test_add_func("/FSearch/memory_pool/malloc_items", test_malloc_items);
+    g_test_add_func("/FSearch/memory_pool/huge_pages", test_huge_pages);
+    return g_test_run();
+}
@@ -0,0 +1,146 @@
+#include <glib.h>
+#include <locale.h>
+#include <string.h>
+
+#include <src/fsearch_database_columns.h>
+#include <src/fsearch_memory_pool.h>
+#include <src/fsearch_path_list.h>
+
+typedef struct {
+    FsearchMemoryPool *folder_pool;
+    FsearchMemoryPool *file_pool;
+    DynamicArray *folders;
+    DynamicArray *entries;
+} PathListFixture;
+
+static FsearchDatabaseEntry *
+add_folder(PathListFixture *fixture, FsearchDatabaseEntry *parent, const char *name) {
+    FsearchDatabaseEntry *folder = fsearch_memory_pool_malloc(fixture->folder_pool);
+    db_entry_set_type(folder, DATABASE_ENTRY_TYPE_FOLDER);
+    db_entry_set_name(folder, name);
+    db_entry_set_parent(folder, (FsearchDatabaseEntryFolder *)parent);
+    // the index is the position in the folders of the folder paths
+    db_entry_set_idx(folder, darray_get_num_items(fixture->folders));
+    darray_add_item(fixture->folders, folder);
+    return folder;
+}
+
+static void
+fixture_set_up(PathListFixture *fixture, uint32_t num_files) {
+    fixture->folder_pool =
+        fsearch_memory_pool_new(16, db_entry_get_sizeof_folder_entry(), (GDestroyNotify)db_entry_destroy);
+    fixture->file_pool =
+        fsearch_memory_pool_new(1024, db_entry_get_sizeof_file_entry(), (GDestroyNotify)db_entry_destroy);
+    fixture->folders = darray_new(16);
+    fixture->entries = darray_new(num_files);
+
+    FsearchDatabaseEntry *root = add_folder(fixture, NULL, "");
+    FsearchDatabaseEntry *home = add_folder(fixture, root, "home");
+    FsearchDatabaseEntry *special = add_folder(fixture, home, "a b#%?");
+    darray_add_item(fixture->entries, root);
+    darray_add_item(fixture->entries, special);
+
+    const char *names[] = {"notes.txt", "x!$&'()*+,;=:@~.txt", "über.txt", "100%.txt"};
+    for (uint32_t i = 0; i < num_files; i++) {
+        FsearchDatabaseEntry *file = fsearch_memory_pool_malloc(fixture->file_pool);
+        db_entry_set_type(file, DATABASE_ENTRY_TYPE_FILE);
+        db_entry_set_name(file, names[i % G_N_ELEMENTS(names)]);
+        db_entry_set_parent(file, (FsearchDatabaseEntryFolder *)(i % 2 ? home : special));
+        darray_add_item(fixture->entries, file);
+    }
+}
+
+static void
+fixture_tear_down(PathListFixture *fixture) {
+    g_clear_pointer(&fixture->entries, darray_unref);
+    g_clear_pointer(&fixture->folders, darray_unref);
+    g_clear_pointer(&fixture->file_pool, fsearch_memory_pool_free_pool);
+    g_clear_pointer(&fixture->folder_pool, fsearch_memory_pool_free_pool);
+}
+
+// What the list is expected to be, built one entry after another
+static GString *
+build_expected(DynamicArray *entries, FsearchPathListFormat format, const char *separator) {
+    GString *expected = g_string_new(NULL);
+    for (uint32_t i = 0; i < darray_get_num_items(entries); i++) {
+        FsearchDatabaseEntry *entry = darray_get_item(entries, i);
+        if (i > 0) {
+            g_string_append(expected, separator);
+        }
+        g_autoptr(GString) full_path = db_entry_get_path_full(entry);
+        if (format == FSEARCH_PATH_LIST_FULL_PATHS) {
+            g_string_append(expected, full_path->str);
+        }
+        else if (format == FSEARCH_PATH_LIST_PATHS) {
+            g_autoptr(GString) path = db_entry_get_path(entry);
+            g_string_append(expected, path->str);
+        }
+        else if (format == FSEARCH_PATH_LIST_NAMES) {
+            g_string_append(expected, db_entry_get_name_raw_for_display(entry));
+        }
+        else {
+            g_autofree char *uri = g_filename_to_uri(full_path->str, NULL, NULL);
+            g_string_append(expected, uri);
+        }
+    }
+    return expected;
+}
+
+static void
+check_formats(uint32_t num_files) {
+    PathListFixture fixture = {0};
+    fixture_set_up(&fixture, num_files);
+    FsearchDatabaseFolderPaths *folder_paths = db_folder_paths_new(fixture.folders);
+
+    const FsearchPathListFormat formats[] = {
+        FSEARCH_PATH_LIST_FULL_PATHS,
+        FSEARCH_PATH_LIST_PATHS,
+        FSEARCH_PATH_LIST_NAMES,
+        FSEARCH_PATH_LIST_URIS,
+    };
+    for (uint32_t i = 0; i < G_N_ELEMENTS(formats); i++) {
+        g_autoptr(GString) expected = build_expected(fixture.entries, formats[i], "\r\n");
+        // with and without the paths of the folders, after what's already in the string
+        g_autoptr(GString) list = g_string_new("copy\n");
+        fsearch_path_list_append(list, fixture.entries, folder_paths, formats[i], "\r\n");
+        g_assert_true(g_str_has_prefix(list->str, "copy\n"));
+        g_assert_cmpstr(list->str + strlen("copy\n"), ==, expected->str);
+
+        g_autoptr(GString) list_without_folder_paths = g_string_new(NULL);
+        fsearch_path_list_append(list_without_folder_paths, fixture.entries, NULL, formats[i], "\r\n");
+        g_assert_cmpstr(list_without_folder_paths->str, ==, expected->str);
+    }
+
+    g_clear_pointer(&folder_paths, db_folder_paths_unref);
+    fixture_tear_down(&fixture);
+}
+
+static void
+test_formats(void) {
+    check_formats(10);
+}
+
+static void
+test_parallel(void) {
+    // several chunks, which are built by different threads
+    check_formats(100000);
+}
+
+static void
+test_empty(void) {
+    g_autoptr(GString) list = g_string_new("x");
+    DynamicArray *entries = darray_new(1);
+    fsearch_path_list_append(list, entries, NULL, FSEARCH_PATH_LIST_URIS, "\n");
+    g_assert_cmpstr(list->str, ==, "x");
+    g_clear_pointer(&entries, darray_unref);
+}
+
+int
+main(int argc, char *argv[]) {
+    setlocale(LC_ALL, "");
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/FSearch/path_list/formats", test_formats);
+    g_test_add_func("/FSearch/path_list/parallel", test_parallel);
+    g_test_add_func("/FSearch/path_list/empty", test_empty);
+    return g_test_run();
+}
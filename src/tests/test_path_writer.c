@@ -0,0 +1,139 @@
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <locale.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <src/fsearch_memory_pool.h>
+#include <src/fsearch_path_writer.h>
+
+typedef struct {
+    FsearchMemoryPool *folder_pool;
+    FsearchMemoryPool *file_pool;
+    FsearchDatabaseEntry *folder;
+    FsearchDatabaseEntry *file;
+    char *file_path;
+    int fd;
+} PathWriterFixture;
+
+static void
+fixture_set_up(PathWriterFixture *fixture) {
+    fixture->folder_pool =
+        fsearch_memory_pool_new(16, db_entry_get_sizeof_folder_entry(), (GDestroyNotify)db_entry_destroy);
+    fixture->file_pool =
+        fsearch_memory_pool_new(16, db_entry_get_sizeof_file_entry(), (GDestroyNotify)db_entry_destroy);
+
+    FsearchDatabaseEntry *root = fsearch_memory_pool_malloc(fixture->folder_pool);
+    db_entry_set_type(root, DATABASE_ENTRY_TYPE_FOLDER);
+    db_entry_set_name(root, "");
+    fixture->folder = fsearch_memory_pool_malloc(fixture->folder_pool);
+    db_entry_set_type(fixture->folder, DATABASE_ENTRY_TYPE_FOLDER);
+    db_entry_set_name(fixture->folder, "home");
+    db_entry_set_parent(fixture->folder, (FsearchDatabaseEntryFolder *)root);
+    fixture->file = fsearch_memory_pool_malloc(fixture->file_pool);
+    db_entry_set_type(fixture->file, DATABASE_ENTRY_TYPE_FILE);
+    db_entry_set_name(fixture->file, "notes.txt");
+    db_entry_set_parent(fixture->file, (FsearchDatabaseEntryFolder *)fixture->folder);
+
+    fixture->fd = g_file_open_tmp("fsearch_path_writer_XXXXXX", &fixture->file_path, NULL);
+    g_assert_cmpint(fixture->fd, >=, 0);
+}
+
+static void
+fixture_tear_down(PathWriterFixture *fixture) {
+    close(fixture->fd);
+    g_unlink(fixture->file_path);
+    g_clear_pointer(&fixture->file_path, g_free);
+    g_clear_pointer(&fixture->file_pool, fsearch_memory_pool_free_pool);
+    g_clear_pointer(&fixture->folder_pool, fsearch_memory_pool_free_pool);
+}
+
+static char *
+read_output(PathWriterFixture *fixture, gsize *length) {
+    char *contents = NULL;
+    g_assert_true(g_file_get_contents(fixture->file_path, &contents, length, NULL));
+    return contents;
+}
+
+static void
+test_separators(void) {
+    PathWriterFixture fixture = {0};
+    fixture_set_up(&fixture);
+
+    FsearchPathWriter *writer = fsearch_path_writer_new(fixture.fd, '\0');
+    g_assert_true(fsearch_path_writer_append(writer, fixture.folder));
+    g_assert_true(fsearch_path_writer_append(writer, fixture.file));
+
+    // nothing gets written until the buffer is full or flushed
+    gsize length = 0;
+    g_autofree char *unflushed = read_output(&fixture, &length);
+    g_assert_cmpuint(length, ==, 0);
+
+    g_assert_true(fsearch_path_writer_flush(writer));
+    g_clear_pointer(&writer, fsearch_path_writer_free);
+
+    g_autofree char *contents = read_output(&fixture, &length);
+    const char expected[] = "/home\0/home/notes.txt";
+    g_assert_cmpuint(length, ==, sizeof(expected));
+    g_assert_cmpmem(contents, length, expected, sizeof(expected));
+    fixture_tear_down(&fixture);
+}
+
+static void
+test_large_output(void) {
+    PathWriterFixture fixture = {0};
+    fixture_set_up(&fixture);
+
+    FsearchPathWriter *writer = fsearch_path_writer_new(fixture.fd, '\n');
+    const uint32_t num_paths = 100000;
+    for (uint32_t i = 0; i < num_paths; i++) {
+        g_assert_true(fsearch_path_writer_append(writer, fixture.file));
+    }
+
+    // full buffers were written on the way
+    gsize length = 0;
+    g_autofree char *unflushed = read_output(&fixture, &length);
+    g_assert_cmpuint(length, >, 0);
+
+    g_assert_true(fsearch_path_writer_flush(writer));
+    g_clear_pointer(&writer, fsearch_path_writer_free);
+
+    g_autofree char *contents = read_output(&fixture, &length);
+    const size_t path_length = strlen("/home/notes.txt\n");
+    g_assert_cmpuint(length, ==, num_paths * path_length);
+    for (uint32_t i = 0; i < num_paths; i++) {
+        g_assert_true(!strncmp(contents + i * path_length, "/home/notes.txt\n", path_length));
+    }
+    fixture_tear_down(&fixture);
+}
+
+static void
+test_write_error(void) {
+    PathWriterFixture fixture = {0};
+    fixture_set_up(&fixture);
+
+    int fds[2] = {-1, -1};
+    g_assert_cmpint(pipe(fds), ==, 0);
+    close(fds[0]);
+
+    // without a reader writing fails instead of killing the process once SIGPIPE is ignored
+    signal(SIGPIPE, SIG_IGN);
+    FsearchPathWriter *writer = fsearch_path_writer_new(fds[1], '\n');
+    g_assert_true(fsearch_path_writer_append(writer, fixture.file));
+    g_assert_false(fsearch_path_writer_flush(writer));
+    g_assert_false(fsearch_path_writer_append(writer, fixture.file));
+    g_clear_pointer(&writer, fsearch_path_writer_free);
+    close(fds[1]);
+    fixture_tear_down(&fixture);
+}
+
+int
+main(int argc, char *argv[]) {
+    setlocale(LC_ALL, "");
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/FSearch/path_writer/separators", test_separators);
+    g_test_add_func("/FSearch/path_writer/large_output", test_large_output);
+    g_test_add_func("/FSearch/path_writer/write_error", test_write_error);
+    return g_test_run();
+}
@@ -0,0 +1,45 @@
+#include <glib.h>
+#include <string.h>
+
+#include <src/fsearch_performance_stats.h>
+
+static void
+test_timings(void) {
+    FsearchPerformanceStats stats = {0};
+    fsearch_performance_stats_add_timing(&stats, FSEARCH_PERFORMANCE_TIMING_SEARCH, 10);
+    g_assert_cmpfloat(stats.timings[FSEARCH_PERFORMANCE_TIMING_SEARCH].average, ==, 10);
+
+    // the average moves towards the new times, the last one is kept as it is
+    fsearch_performance_stats_add_timing(&stats, FSEARCH_PERFORMANCE_TIMING_SEARCH, 20);
+    FsearchPerformanceTimingStats *search = &stats.timings[FSEARCH_PERFORMANCE_TIMING_SEARCH];
+    g_assert_cmpfloat(search->last, ==, 20);
+    g_assert_cmpfloat(search->average, >, 10);
+    g_assert_cmpfloat(search->average, <, 20);
+    g_assert_cmpuint(search->count, ==, 2);
+    g_assert_cmpuint(stats.timings[FSEARCH_PERFORMANCE_TIMING_SORT].count, ==, 0);
+
+    g_autoptr(GString) str = fsearch_performance_stats_to_string(&stats);
+    g_assert_nonnull(strstr(str->str, "Search 20.0 ms"));
+    g_assert_nonnull(strstr(str->str, "Sort –"));
+}
+
+static void
+test_row_cache_hit_rate(void) {
+    FsearchPerformanceStats stats = {0};
+    g_assert_cmpfloat(fsearch_performance_stats_get_row_cache_hit_rate(&stats), ==, 0);
+    for (uint32_t i = 0; i < 4; i++) {
+        fsearch_performance_stats_add_row_cache_lookup(&stats, i != 0);
+    }
+    g_assert_cmpfloat(fsearch_performance_stats_get_row_cache_hit_rate(&stats), ==, 0.75);
+
+    g_autoptr(GString) str = fsearch_performance_stats_to_string(&stats);
+    g_assert_nonnull(strstr(str->str, "Row cache 75% of 4"));
+}
+
+int
+main(int argc, char *argv[]) {
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/FSearch/performance_stats/timings", test_timings);
+    g_test_add_func("/FSearch/performance_stats/row_cache_hit_rate", test_row_cache_hit_rate);
+    return g_test_run();
+}
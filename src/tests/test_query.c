@@ -1,10 +1,14 @@
 #include <glib.h>
+#include <glib/gstdio.h>
 #include <locale.h>
 #include <stdlib.h>
 
+#include <src/fsearch_file_content.h>
 #include <src/fsearch_limits.h>
 #include <src/fsearch_memory_pool.h>
 #include <src/fsearch_query.h>
+#include <src/fsearch_query_matchers.h>
+#include <src/fsearch_query_tree.h>
 
 typedef struct QueryTest {
     const char *needle;
@@ -128,6 +132,10 @@ test_main(void) {
             {"å", "Å", false, 0, 0, true},
             {"É", "é", false, 0, 0, true},
             {"Ó", "Ó", false, 0, 0, true},
+            // non ASCII needles which fold to ASCII ones match ASCII names
+            {"straße", "STRASSE.txt", false, 0, 0, true},
+            {"straße", "strase.txt", false, 0, 0, false},
+            {"é", "e.txt", false, 0, 0, false},
             {"Å", "å", false, 0, 0, true},
 
             {"ﬀ", "affe", false, 0, 0, true},
@@ -207,6 +215,9 @@ test_main(void) {
 
             {"regex:suffix$", "suffix prefix", false, 0, 0, false},
             {"regex:suffix$", "prefix suffix", false, 0, 0, true},
+            // capture groups
+            {"regex:(ab)(c)", "xabc", false, 0, 0, true},
+            {"regex:(ab)(c)", "xacb", false, 0, 0, false},
             {"exact:ABC", "aBc", false, 0, 0, true},
             {"exact:ABC", "aBcd", false, 0, 0, false},
             {"case:exact:ABC", "aBc", false, 0, 0, false},
@@ -349,11 +360,609 @@ test_german_case_mapping(void) {
     }
 }
 
+typedef struct QueryRefinementTest {
+    const char *previous;
+    const char *query;
+    FsearchQueryFlags flags;
+    bool result;
+} QueryRefinementTest;
+
+static void
+test_refinement(void) {
+    QueryRefinementTest tests[] = {
+        {"foo", "foob", 0, true},
+        {"foo", "foo bar", 0, true},
+        {"foo ", "foo b", 0, true},
+        {"foo bar", "foo barz", QUERY_FLAG_MATCH_CASE, true},
+        {"foo", "foob", QUERY_FLAG_SEARCH_IN_PATH, true},
+
+        {"foo", "foo", 0, false},
+        {"foob", "foo", 0, false},
+        {"foo", "bfoo", 0, false},
+        {"", "foo", 0, false},
+        {"foo", "foob", QUERY_FLAG_REGEX, false},
+        {"foo", "foob", QUERY_FLAG_EXACT_MATCH, false},
+        {"foo", "foo*", 0, false},
+        {"foo", "foo|bar", 0, false},
+        {"foo", "foo OR bar", 0, false},
+        {"foo AN", "foo AND", 0, false},
+        {"foo", "foo !bar", 0, false},
+        {"foo", "foo/bar", 0, false},
+        {"foo", "fooB", QUERY_FLAG_AUTO_MATCH_CASE, false},
+        {"ext:jp", "ext:jpg", 0, false},
+        {"size:>1", "size:>10", 0, false},
+        {"foo", "foo \"bar\"", 0, false},
+    };
+
+    FsearchFilterManager *manager = fsearch_filter_manager_new_with_defaults();
+    for (uint32_t i = 0; i < G_N_ELEMENTS(tests); i++) {
+        QueryRefinementTest *t = &tests[i];
+        FsearchQuery *previous = fsearch_query_new(t->previous, NULL, manager, t->flags, "debug_query");
+        FsearchQuery *query = fsearch_query_new(t->query, NULL, manager, t->flags, "debug_query");
+        if (fsearch_query_is_refinement_of(query, previous) != t->result) {
+            g_printerr("[%s] should%s be a refinement of [%s]\n", t->query, t->result ? "" : " NOT", t->previous);
+        }
+        g_assert_true(fsearch_query_is_refinement_of(query, previous) == t->result);
+        g_clear_pointer(&previous, fsearch_query_unref);
+        g_clear_pointer(&query, fsearch_query_unref);
+    }
+    g_clear_pointer(&manager, fsearch_filter_manager_free);
+}
+
+typedef struct QueryNamePrefixTest {
+    const char *query;
+    FsearchQueryFlags flags;
+    // NULL if the query doesn't require a name prefix
+    const char *prefix;
+    bool is_exact;
+} QueryNamePrefixTest;
+
+static void
+test_name_prefix(void) {
+    QueryNamePrefixTest tests[] = {
+        {"foo", QUERY_FLAG_EXACT_MATCH, "foo", true},
+        {"Foo", QUERY_FLAG_EXACT_MATCH | QUERY_FLAG_MATCH_CASE, "Foo", true},
+        {"foo*", 0, "foo", false},
+        {"foo.b?r", 0, "foo.b", false},
+        {"bar foo*", 0, "foo", false},
+        {"^foo\\.bar", QUERY_FLAG_REGEX, "foo.bar", false},
+        {"^foo$", QUERY_FLAG_REGEX, "foo", false},
+        {"^fo?", QUERY_FLAG_REGEX, "f", false},
+        {"^abc", QUERY_FLAG_REGEX, "abc", false},
+        {"^\xc3\xa4rger", QUERY_FLAG_REGEX | QUERY_FLAG_MATCH_CASE, "\xc3\xa4rger", false},
+        // the other cases of them aren't ASCII letters
+        {"^bask", QUERY_FLAG_REGEX, "ba", false},
+        {"^\xc3\xa4rger", QUERY_FLAG_REGEX, NULL, false},
+
+        {"foo", 0, NULL, false},
+        {"*foo", 0, NULL, false},
+        {"^foo|bar", QUERY_FLAG_REGEX, NULL, false},
+        {"foo", QUERY_FLAG_REGEX, NULL, false},
+        {"foo*", QUERY_FLAG_SEARCH_IN_PATH, NULL, false},
+        {"foo* OR bar", 0, NULL, false},
+        {"!foo*", 0, NULL, false},
+        {"ext:foo", 0, NULL, false},
+    };
+
+    FsearchFilterManager *manager = fsearch_filter_manager_new_with_defaults();
+    for (uint32_t i = 0; i < G_N_ELEMENTS(tests); i++) {
+        QueryNamePrefixTest *t = &tests[i];
+        FsearchQuery *q = fsearch_query_new(t->query, NULL, manager, t->flags, "debug_query");
+        g_autoptr(GPtrArray) nodes = g_ptr_array_new();
+        fsearch_query_node_tree_get_required_name_prefix_nodes(q->query_tree, nodes);
+
+        bool is_exact = false;
+        g_autofree char *prefix =
+            nodes->len > 0 ? fsearch_query_node_get_name_prefix(g_ptr_array_index(nodes, 0), &is_exact) : NULL;
+        if (g_strcmp0(prefix, t->prefix) != 0) {
+            g_printerr("[%s] expected prefix [%s], got [%s]\n", t->query, t->prefix, prefix);
+        }
+        g_assert_cmpstr(prefix, ==, t->prefix);
+        g_assert_true(!prefix || is_exact == t->is_exact);
+        g_clear_pointer(&q, fsearch_query_unref);
+    }
+    g_clear_pointer(&manager, fsearch_filter_manager_free);
+}
+
+static void
+test_sorted_entries(void) {
+    const struct {
+        const char *query;
+        bool wants_sorted_entries;
+    } tests[] = {
+        {"size:>1M", true},
+        {"foo dm:today", true},
+        {"foo size:<10 OR bar", false},
+        {"!size:>1M", false},
+        {"foo", false},
+        {"childcount:>2", false},
+    };
+
+    FsearchFilterManager *manager = fsearch_filter_manager_new_with_defaults();
+    for (uint32_t i = 0; i < G_N_ELEMENTS(tests); i++) {
+        FsearchQuery *q = fsearch_query_new(tests[i].query, NULL, manager, 0, "debug_query");
+        if (q->wants_sorted_entries != tests[i].wants_sorted_entries) {
+            g_printerr("[%s] should%s want sorted entries\n", tests[i].query, tests[i].wants_sorted_entries ? "" : " NOT");
+        }
+        g_assert_true(q->wants_sorted_entries == tests[i].wants_sorted_entries);
+        g_clear_pointer(&q, fsearch_query_unref);
+    }
+    g_clear_pointer(&manager, fsearch_filter_manager_free);
+}
+
+static void
+test_plan(void) {
+    const struct {
+        const char *query;
+        // the description of the operand which gets evaluated first
+        const char *first;
+    } tests[] = {
+        {"contenttype:video foo", "ascii_icase"},
+        {"foo contenttype:video", "ascii_icase"},
+        {"regex:fo+ size:>1M", "size"},
+        {"path:foo/bar ext:txt", "ext"},
+        {"foo bar", "ascii_icase"},
+        {"contenttype:video OR foo", "ascii_icase"},
+        {"content:foo ext:txt", "ext"},
+        {"content:foo contenttype:text", "contenttype"},
+    };
+
+    FsearchFilterManager *manager = fsearch_filter_manager_new_with_defaults();
+    for (uint32_t i = 0; i < G_N_ELEMENTS(tests); i++) {
+        FsearchQuery *q = fsearch_query_new(tests[i].query, NULL, manager, 0, "debug_query");
+        g_assert_nonnull(q->query_tree->children);
+        FsearchQueryNode *first = q->query_tree->children->data;
+        if (!g_str_has_prefix(first->description->str, tests[i].first)) {
+            g_printerr("[%s] should evaluate %s first, not %s\n", tests[i].query, tests[i].first, first->description->str);
+        }
+        g_assert_true(g_str_has_prefix(first->description->str, tests[i].first));
+        g_clear_pointer(&q, fsearch_query_unref);
+    }
+    g_clear_pointer(&manager, fsearch_filter_manager_free);
+}
+
+static void
+test_program(void) {
+    QueryTest tests[] = {
+        {"foo OR bar", "bar", false, 0, 0, true},
+        {"foo OR bar", "baz", false, 0, 0, false},
+        {"!foo bar", "foobar", false, 0, 0, false},
+        {"!foo bar", "bar", false, 0, 0, true},
+        {"!(foo OR bar) baz", "baz", false, 0, 0, true},
+        {"!(foo OR bar) baz", "bazfoo", false, 0, 0, false},
+        {"folder:foo OR size:>10", "foo", true, 0, 0, true},
+        {"folder:foo OR size:>10", "foo", false, 0, 0, false},
+        {"folder:foo OR size:>10", "foo", false, 20, 0, true},
+        {"!file: foo", "foo", true, 0, 0, true},
+        {"!file: foo", "foo", false, 0, 0, false},
+        {"(a b) OR (c d) OR e", "cd", false, 0, 0, true},
+        {"(a b) OR (c d) OR e", "ac", false, 0, 0, false},
+    };
+    for (uint32_t i = 0; i < G_N_ELEMENTS(tests); i++) {
+        test_query(&tests[i]);
+    }
+
+    // nodes which can't match an entry type are compiled away
+    FsearchFilterManager *manager = fsearch_filter_manager_new_with_defaults();
+    FsearchQuery *q = fsearch_query_new("folder:foo", NULL, manager, 0, "debug_query");
+    const FsearchQueryProgram *program = q->query_program;
+    g_assert_nonnull(program);
+    g_assert_cmpuint(program->num_instructions[DATABASE_ENTRY_TYPE_FILE], ==, 1);
+    g_assert_cmpint(program->instructions[DATABASE_ENTRY_TYPE_FILE][0].opcode, ==, FSEARCH_QUERY_OPCODE_FALSE);
+    g_assert_cmpint(program->instructions[DATABASE_ENTRY_TYPE_FOLDER][0].opcode,
+                    ==,
+                    FSEARCH_QUERY_OPCODE_NAME_SUBSTRING);
+    g_clear_pointer(&q, fsearch_query_unref);
+    g_clear_pointer(&manager, fsearch_filter_manager_free);
+}
+
+static void
+test_compiled_filter(void) {
+    FsearchFilterManager *manager = fsearch_filter_manager_new_with_defaults();
+    FsearchFilter *documents = fsearch_filter_manager_get_filter_for_name(manager, "Documents");
+    g_assert_nonnull(documents);
+    FsearchFilter *filter = fsearch_filter_new("Documents or folders", NULL, "doc: OR folder:", 0);
+    fsearch_filter_manager_append_filter(manager, filter);
+
+    FsearchMemoryPool *file_pool =
+        fsearch_memory_pool_new(100, db_entry_get_sizeof_file_entry(), (GDestroyNotify)db_entry_destroy);
+    FsearchDatabaseEntry *entry = fsearch_memory_pool_malloc(file_pool);
+    db_entry_set_name(entry, "foo.pdf");
+    db_entry_set_type(entry, DATABASE_ENTRY_TYPE_FILE);
+    FsearchQueryMatchData *match_data = fsearch_query_match_data_new();
+    fsearch_query_match_data_set_entry(match_data, entry);
+
+    // queries with the same filter share its tree
+    FsearchQuery *q1 = fsearch_query_new("foo", filter, manager, 0, "debug_query");
+    FsearchQuery *q2 = fsearch_query_new("foob", filter, manager, 0, "debug_query");
+    g_assert_nonnull(q1->filter_tree);
+    g_assert_true(q1->filter_tree == q2->filter_tree);
+    g_assert_true(q1->filter_program == q2->filter_program);
+    g_assert_true(fsearch_query_match(q1, match_data));
+
+    // until one of the filters changes, here the one whose macro it uses
+    fsearch_filter_manager_edit(manager, documents, documents->name, documents->macro, "ext:txt", documents->flags);
+    FsearchQuery *q3 = fsearch_query_new("foo", filter, manager, 0, "debug_query");
+    g_assert_true(q3->filter_tree != q1->filter_tree);
+    g_assert_false(fsearch_query_match(q3, match_data));
+    // the older queries keep their tree
+    g_assert_true(fsearch_query_match(q1, match_data));
+
+    // filters which aren't part of the manager aren't cached
+    FsearchFilter *other = fsearch_filter_new("Other", NULL, "ext:pdf", 0);
+    FsearchQuery *q4 = fsearch_query_new("foo", other, manager, 0, "debug_query");
+    FsearchQuery *q5 = fsearch_query_new("foo", other, manager, 0, "debug_query");
+    g_assert_true(q4->filter_tree != q5->filter_tree);
+    g_assert_true(fsearch_query_match(q5, match_data));
+
+    g_clear_pointer(&q1, fsearch_query_unref);
+    g_clear_pointer(&q2, fsearch_query_unref);
+    g_clear_pointer(&q3, fsearch_query_unref);
+    g_clear_pointer(&q4, fsearch_query_unref);
+    g_clear_pointer(&q5, fsearch_query_unref);
+    g_clear_pointer(&match_data, fsearch_query_match_data_free);
+    g_clear_pointer(&file_pool, fsearch_memory_pool_free_pool);
+    g_clear_pointer(&other, fsearch_filter_unref);
+    g_clear_pointer(&filter, fsearch_filter_unref);
+    g_clear_pointer(&documents, fsearch_filter_unref);
+    g_clear_pointer(&manager, fsearch_filter_manager_free);
+}
+
+static void
+test_regex_literal(void) {
+    const struct {
+        const char *pattern;
+        FsearchQueryFlags flags;
+        const char *literal;
+    } tests[] = {
+        {"report_\\d+\\.pdf", QUERY_FLAG_MATCH_CASE, "report_"},
+        {"a(bc)?def", QUERY_FLAG_MATCH_CASE, "def"},
+        {"(foo|bar)bazz", QUERY_FLAG_MATCH_CASE, "bazz"},
+        {"colou?r", QUERY_FLAG_MATCH_CASE, "colo"},
+        {"x{2}yz", QUERY_FLAG_MATCH_CASE, "xyz"},
+        {"ab+c", QUERY_FLAG_MATCH_CASE, "ab"},
+        {"[a-c]+\\]def[[:alpha:]]", QUERY_FLAG_MATCH_CASE, "]def"},
+        {"^\xc3\xa4rger$", QUERY_FLAG_MATCH_CASE, "\xc3\xa4rger"},
+        {"task", QUERY_FLAG_MATCH_CASE, "task"},
+        // other letters match k and s, when the case is ignored
+        {"task", 0, "ta"},
+        {"foo|bar", QUERY_FLAG_MATCH_CASE, NULL},
+        {"(?i)abc", QUERY_FLAG_MATCH_CASE, NULL},
+        {"\\x41bcd", QUERY_FLAG_MATCH_CASE, NULL},
+        {".*", QUERY_FLAG_MATCH_CASE, NULL},
+    };
+    for (uint32_t i = 0; i < G_N_ELEMENTS(tests); i++) {
+        FsearchQueryNode *node = fsearch_query_node_new_regex(tests[i].pattern, tests[i].flags);
+        g_assert_cmpstr(node->regex_literal_search.needle, ==, tests[i].literal);
+        g_clear_pointer(&node, fsearch_query_node_free);
+    }
+
+    // the literal of wildcards too
+    FsearchQueryNode *node = fsearch_query_node_new_wildcard("*.txt", 0);
+    g_assert_cmpstr(node->regex_literal_search.needle, ==, ".txt");
+    g_clear_pointer(&node, fsearch_query_node_free);
+
+    QueryTest match_tests[] = {
+        {"regex:report_[0-9]+[.]pdf", "report_12.pdf", false, 0, 0, true},
+        {"regex:report_[0-9]+[.]pdf", "report_.pdf", false, 0, 0, false},
+        {"regex:colou?r", "COLOR", false, 0, 0, true},
+        {"regex:ab+c", "abbbc", false, 0, 0, true},
+        {"regex:ab+c", "ac", false, 0, 0, false},
+    };
+    for (uint32_t i = 0; i < G_N_ELEMENTS(match_tests); i++) {
+        test_query(&match_tests[i]);
+    }
+}
+
+static void
+test_wildcard(void) {
+    // patterns whose case can be ignored for ASCII letters don't need PCRE2
+    const struct {
+        const char *pattern;
+        FsearchQueryFlags flags;
+        bool is_native;
+    } nodes[] = {
+        {"*.log", 0, true},
+        {"IMG_*", QUERY_FLAG_MATCH_CASE, true},
+        {"\xc3\xa4*", QUERY_FLAG_MATCH_CASE, true},
+        {"\xc3\xa4*", 0, false},
+    };
+    for (uint32_t i = 0; i < G_N_ELEMENTS(nodes); i++) {
+        FsearchQueryNode *node = fsearch_query_node_new_wildcard(nodes[i].pattern, nodes[i].flags);
+        g_assert_true((node->search_func == fsearch_query_matcher_wildcard) == nodes[i].is_native);
+        g_assert_true(fsearch_query_node_is_regex(node));
+        g_clear_pointer(&node, fsearch_query_node_free);
+    }
+
+    QueryTest tests[] = {
+        {"*.log", "syslog.LOG", false, 0, 0, true},
+        {"*.log", "syslog.log.1", false, 0, 0, false},
+        {"*.log", ".log", false, 0, 0, true},
+        {"IMG_*", "IMG_0001.jpg", false, 0, QUERY_FLAG_MATCH_CASE, true},
+        {"IMG_*", "img_0001.jpg", false, 0, QUERY_FLAG_MATCH_CASE, false},
+        {"a*b*c", "abc", false, 0, 0, true},
+        {"a*b*c", "axxbyyc", false, 0, 0, true},
+        {"a*b*c", "axxcyyb", false, 0, 0, false},
+        {"a*bc*bd", "abcbcbd", false, 0, 0, true},
+        {"ab*ba", "aba", false, 0, 0, false},
+        {"a**c", "abc", false, 0, 0, true},
+        // a question mark matches a whole UTF-8 character
+        {"?rger.txt", "\xc3\xa4rger.txt", false, 0, 0, true},
+        {"??rger.txt", "\xc3\xa4rger.txt", false, 0, 0, false},
+        {"*?", "\xc3\xa4", false, 0, 0, true},
+        {"*x?y", "x\xc3\xa4y", false, 0, 0, true},
+        {"*x?y", "xy", false, 0, 0, false},
+        {"*b?d*", "abcd", false, 0, 0, true},
+        {"*b?d*", "ab\xc3\xa4\xc3\xa4d", false, 0, 0, false},
+        {"\xc3\xa4*", "\xc3\x84rger", false, 0, 0, true},
+    };
+    for (uint32_t i = 0; i < G_N_ELEMENTS(tests); i++) {
+        test_query(&tests[i]);
+    }
+}
+
+static void
+test_content_type(void) {
+    // folders and empty files don't need to be read
+    QueryTest tests[] = {
+        {"contenttype:directory", "/foo/bar", true, 0, 0, true},
+        {"contenttype:zerosize", "/foo/empty.txt", false, 0, 0, true},
+        {"contenttype:directory", "/foo/bar.txt", false, 10, 0, false},
+        {"contenttype:zerosize", "/foo/bar", true, 0, 0, false},
+    };
+    for (uint32_t i = 0; i < G_N_ELEMENTS(tests); i++) {
+        test_query(&tests[i]);
+    }
+
+    FsearchFilterManager *manager = fsearch_filter_manager_new_with_defaults();
+    FsearchQuery *q = fsearch_query_new("contenttype:image", NULL, manager, 0, "debug_query");
+    g_assert_false(q->wants_single_threaded_search);
+    g_clear_pointer(&q, fsearch_query_unref);
+    g_clear_pointer(&manager, fsearch_filter_manager_free);
+}
+
+static char *
+create_file(const char *dir, const char *name, const char *content, size_t len) {
+    char *path = g_build_filename(dir, name, NULL);
+    g_assert_true(g_file_set_contents(path, content, (gssize)len, NULL));
+    return path;
+}
+
+static void
+test_content(void) {
+    g_autofree char *root = g_dir_make_tmp("fsearch_test_XXXXXX", NULL);
+    g_assert_nonnull(root);
+    const char text[] = "Hello World\nsecond line\nGrüße\n";
+    const char binary[] = "Hello World\0\1\2";
+    g_autofree char *text_path = create_file(root, "a.txt", text, sizeof(text) - 1);
+    g_autofree char *binary_path = create_file(root, "b.bin", binary, sizeof(binary) - 1);
+
+    QueryTest tests[] = {
+        {"content:world", text_path, false, sizeof(text) - 1, 0, true},
+        {"content:World", text_path, false, sizeof(text) - 1, QUERY_FLAG_MATCH_CASE, true},
+        {"content:world", text_path, false, sizeof(text) - 1, QUERY_FLAG_MATCH_CASE, false},
+        {"content:planet", text_path, false, sizeof(text) - 1, 0, false},
+        {"content:GRÜßE", text_path, false, sizeof(text) - 1, 0, true},
+        {"regex:content:^second", text_path, false, sizeof(text) - 1, 0, true},
+        {"regex:content:^line", text_path, false, sizeof(text) - 1, 0, false},
+        {"ext:txt content:world", text_path, false, sizeof(text) - 1, 0, true},
+        {"ext:bin content:world", text_path, false, sizeof(text) - 1, 0, false},
+        // binary files, folders and files which are empty according to the database aren't searched
+        {"content:world", binary_path, false, sizeof(binary) - 1, 0, false},
+        {"content:world", root, true, 0, 0, false},
+        {"content:world", text_path, false, 0, 0, false},
+    };
+    for (uint32_t i = 0; i < G_N_ELEMENTS(tests); i++) {
+        test_query(&tests[i]);
+    }
+
+    // the results are remembered until the file changes
+    fsearch_file_content_set_cache_size(16);
+    test_query(&tests[0]);
+    test_query(&tests[3]);
+    g_assert_cmpuint(fsearch_file_content_get_num_cached(), ==, 2);
+    test_query(&tests[0]);
+    g_assert_cmpuint(fsearch_file_content_get_num_cached(), ==, 2);
+    const char changed[] = "Hello planet";
+    g_free(create_file(root, "a.txt", changed, sizeof(changed) - 1));
+    test_query(&(QueryTest){"content:planet", text_path, false, sizeof(changed) - 1, 0, true});
+    test_query(&(QueryTest){"content:world", text_path, false, sizeof(changed) - 1, 0, false});
+    fsearch_file_content_set_cache_size(0);
+    g_assert_cmpuint(fsearch_file_content_get_num_cached(), ==, 0);
+
+    g_remove(text_path);
+    g_remove(binary_path);
+    g_remove(root);
+}
+
+static void
+test_block(void) {
+    const char *queries[] = {
+        "a",
+        "a b",
+        "a OR size:>500",
+        "!b size:<300",
+        "ext:txt OR dm:<2009",
+        "ext:txt OR ext:md size:>100",
+        "file: a",
+        "folder: a",
+        "!(a OR ext:c) dm:>=2010",
+        "size:100..200 OR regex:^b",
+    };
+    static const char *extensions[] = {"", ".txt", ".md", ".c"};
+
+    FsearchMemoryPool *pool =
+        fsearch_memory_pool_new(1024, db_entry_get_sizeof_file_entry(), (GDestroyNotify)db_entry_destroy);
+    GRand *rand = g_rand_new_with_seed(11);
+    // not a multiple of the block size, so the last block isn't full
+    const uint32_t num_entries = 3 * FSEARCH_QUERY_BLOCK_SIZE + 123;
+    DynamicArray *entries = darray_new(num_entries);
+    for (uint32_t i = 0; i < num_entries; i++) {
+        FsearchDatabaseEntry *entry = fsearch_memory_pool_malloc(pool);
+        g_autofree char *name = g_strdup_printf("%c%c%s",
+                                                'a' + g_rand_int_range(rand, 0, 4),
+                                                'a' + g_rand_int_range(rand, 0, 4),
+                                                extensions[g_rand_int_range(rand, 0, G_N_ELEMENTS(extensions))]);
+        db_entry_set_type(entry, DATABASE_ENTRY_TYPE_FILE);
+        db_entry_set_name(entry, name);
+        db_entry_set_size(entry, g_rand_int_range(rand, 0, 1000));
+        db_entry_set_mtime(entry, g_rand_int_range(rand, 1200000000, 1300000000));
+        db_entry_set_idx(entry, i);
+        darray_add_item(entries, entry);
+    }
+    FsearchDatabaseColumns *columns = db_columns_new(entries, DATABASE_ENTRY_TYPE_FILE);
+    FsearchDatabaseExtensions *db_extensions = db_extensions_new(entries);
+    // every other entry
+    g_autofree uint32_t *positions = g_new(uint32_t, num_entries / 2);
+    for (uint32_t i = 0; i < num_entries / 2; i++) {
+        positions[i] = 2 * i;
+    }
+
+    FsearchFilterManager *manager = fsearch_filter_manager_new_with_defaults();
+    FsearchQueryMatchData *match_data = fsearch_query_match_data_new();
+    fsearch_query_match_data_set_extensions(match_data, db_extensions);
+    for (uint32_t i = 0; i < G_N_ELEMENTS(queries); i++) {
+        FsearchQuery *q = fsearch_query_new(queries[i], NULL, manager, 0, "debug_query");
+        fsearch_query_set_extensions(q, db_extensions);
+        for (uint32_t variant = 0; variant < 4; variant++) {
+            FsearchQueryBlock block = {
+                .entries = entries,
+                .positions = variant & 1 ? positions : NULL,
+                .type = DATABASE_ENTRY_TYPE_FILE,
+                .columns = variant & 2 ? columns : NULL,
+            };
+            const uint32_t num_block_entries = block.positions ? num_entries / 2 : num_entries;
+            for (block.start = 0; block.start < num_block_entries; block.start += FSEARCH_QUERY_BLOCK_SIZE) {
+                block.num_entries = MIN(FSEARCH_QUERY_BLOCK_SIZE, num_block_entries - block.start);
+                uint64_t selection[FSEARCH_QUERY_BLOCK_NUM_WORDS];
+                fsearch_query_match_block(q, match_data, &block, selection);
+
+                for (uint32_t j = 0; j < FSEARCH_QUERY_BLOCK_SIZE; j++) {
+                    bool expected = false;
+                    if (j < block.num_entries) {
+                        const uint32_t idx = block.positions ? block.positions[block.start + j] : block.start + j;
+                        fsearch_query_match_data_set_entry(match_data, darray_get_item(entries, idx));
+                        expected = fsearch_query_match(q, match_data);
+                    }
+                    const bool found = (selection[j / 64] >> (j % 64)) & 1;
+                    if (found != expected) {
+                        g_printerr("[%s] entry %u of block %u: expected %d\n", queries[i], j, block.start, expected);
+                    }
+                    g_assert_true(found == expected);
+                }
+            }
+        }
+        g_clear_pointer(&q, fsearch_query_unref);
+    }
+
+    g_clear_pointer(&match_data, fsearch_query_match_data_free);
+    g_clear_pointer(&manager, fsearch_filter_manager_free);
+    g_clear_pointer(&db_extensions, db_extensions_unref);
+    g_clear_pointer(&columns, db_columns_unref);
+    g_clear_pointer(&entries, darray_unref);
+    g_clear_pointer(&rand, g_rand_free);
+    g_clear_pointer(&pool, fsearch_memory_pool_free_pool);
+}
+
+static void
+test_folder_results(void) {
+    const struct {
+        const char *query;
+        FsearchQueryFlags flags;
+    } tests[] = {
+        {"b/c", QUERY_FLAG_SEARCH_IN_PATH},
+        {"a/", QUERY_FLAG_SEARCH_IN_PATH},
+        {"/ab", QUERY_FLAG_SEARCH_IN_PATH | QUERY_FLAG_MATCH_CASE},
+        {"path:ca", 0},
+        {"parent:/a", 0},
+        {"parent:/B", 0},
+        {"!parent:/a ca", 0},
+    };
+    static const char *names[] = {"a", "b", "c", "ab", "Ba", "cab"};
+
+    FsearchMemoryPool *pool =
+        fsearch_memory_pool_new(1024, db_entry_get_sizeof_folder_entry(), (GDestroyNotify)db_entry_destroy);
+    GRand *rand = g_rand_new_with_seed(5);
+    DynamicArray *folders = darray_new(256);
+    DynamicArray *files = darray_new(4096);
+    for (uint32_t i = 0; i < 256; i++) {
+        FsearchDatabaseEntry *folder = fsearch_memory_pool_malloc(pool);
+        db_entry_set_type(folder, DATABASE_ENTRY_TYPE_FOLDER);
+        db_entry_set_name(folder, i == 0 ? "" : names[g_rand_int_range(rand, 0, G_N_ELEMENTS(names))]);
+        if (i > 0) {
+            db_entry_set_parent(folder, darray_get_item(folders, g_rand_int_range(rand, 0, i)));
+        }
+        db_entry_set_idx(folder, i);
+        darray_add_item(folders, folder);
+    }
+    for (uint32_t i = 0; i < 4096; i++) {
+        FsearchDatabaseEntry *file = fsearch_memory_pool_malloc(pool);
+        db_entry_set_type(file, DATABASE_ENTRY_TYPE_FILE);
+        db_entry_set_name(file, names[g_rand_int_range(rand, 0, G_N_ELEMENTS(names))]);
+        db_entry_set_parent(file, darray_get_item(folders, g_rand_int_range(rand, 0, 256)));
+        darray_add_item(files, file);
+    }
+    FsearchDatabaseFolderPaths *folder_paths = db_folder_paths_new(folders);
+
+    FsearchFilterManager *manager = fsearch_filter_manager_new_with_defaults();
+    FsearchQueryMatchData *match_data = fsearch_query_match_data_new();
+    FsearchQueryMatchData *memoized_match_data = fsearch_query_match_data_new();
+    fsearch_query_match_data_set_folder_paths(memoized_match_data, folder_paths);
+    for (uint32_t i = 0; i < G_N_ELEMENTS(tests); i++) {
+        FsearchQuery *q = fsearch_query_new(tests[i].query, NULL, manager, tests[i].flags, "debug_query");
+        fsearch_query_set_folder_paths(q, folder_paths);
+        uint32_t num_matches = 0;
+        // the second round uses the remembered results
+        for (uint32_t round = 0; round < 2; round++) {
+            for (uint32_t j = 0; j < darray_get_num_items(folders) + darray_get_num_items(files); j++) {
+                FsearchDatabaseEntry *entry = j < darray_get_num_items(folders)
+                                                ? darray_get_item(folders, j)
+                                                : darray_get_item(files, j - darray_get_num_items(folders));
+                fsearch_query_match_data_set_entry(match_data, entry);
+                fsearch_query_match_data_set_entry(memoized_match_data, entry);
+                const bool expected = fsearch_query_match(q, match_data);
+                const bool found = fsearch_query_match(q, memoized_match_data);
+                if (found != expected) {
+                    GString *path = g_string_new(NULL);
+                    db_entry_append_full_path(entry, path);
+                    g_printerr("[%s] should%s match %s\n", tests[i].query, expected ? "" : " NOT", path->str);
+                    g_string_free(path, TRUE);
+                }
+                g_assert_true(found == expected);
+                num_matches += found;
+            }
+        }
+        g_assert_cmpuint(num_matches, >, 0);
+        g_clear_pointer(&q, fsearch_query_unref);
+    }
+
+    g_clear_pointer(&memoized_match_data, fsearch_query_match_data_free);
+    g_clear_pointer(&match_data, fsearch_query_match_data_free);
+    g_clear_pointer(&manager, fsearch_filter_manager_free);
+    g_clear_pointer(&folder_paths, db_folder_paths_unref);
+    g_clear_pointer(&files, darray_unref);
+    g_clear_pointer(&folders, darray_unref);
+    g_clear_pointer(&rand, g_rand_free);
+    g_clear_pointer(&pool, fsearch_memory_pool_free_pool);
+}
+
 int
 main(int argc, char *argv[]) {
     g_test_init(&argc, &argv, NULL);
     g_test_add_func("/FSearch/query/main", test_main);
     g_test_add_func("/FSearch/query/mappings_turkic", test_turkic_case_mapping);
     g_test_add_func("/FSearch/query/mappings_german", test_german_case_mapping);
+    g_test_add_func("/FSearch/query/refinement", test_refinement);
+    g_test_add_func("/FSearch/query/name_prefix", test_name_prefix);
+    g_test_add_func("/FSearch/query/sorted_entries", test_sorted_entries);
+    g_test_add_func("/FSearch/query/plan", test_plan);
+    g_test_add_func("/FSearch/query/program", test_program);
+    g_test_add_func("/FSearch/query/compiled_filter", test_compiled_filter);
+    g_test_add_func("/FSearch/query/regex_literal", test_regex_literal);
+    g_test_add_func("/FSearch/query/wildcard", test_wildcard);
+    g_test_add_func("/FSearch/query/content_type", test_content_type);
+    g_test_add_func("/FSearch/query/content", test_content);
+    g_test_add_func("/FSearch/query/block", test_block);
+    g_test_add_func("/FSearch/query/folder_results", test_folder_results);
     return g_test_run();
 }
\ No newline at end of file
@@ -0,0 +1,41 @@
+#include <glib.h>
+#include <locale.h>
+#include <string.h>
+
+#include <src/fsearch_query_stats.h>
+
+static void
+test_to_json(void) {
+    FsearchQueryStats stats = {
+        .parse_time = 0.25,
+        .match_time = 12.5,
+        .merge_time = 1,
+        .num_entries_scanned = 300,
+        .num_results = 7,
+        .num_threads = 2,
+        .threads = {{.match_time = 12, .num_entries_scanned = 100}, {.match_time = 11.5, .num_entries_scanned = 200}},
+    };
+    g_autoptr(GString) json = fsearch_query_stats_to_json(&stats, NULL);
+    g_assert_cmpstr(json->str,
+                    ==,
+                    "{\"parse_ms\":0.250,\"filter_ms\":0.000,\"match_ms\":12.500,\"merge_ms\":1.000,\"sort_ms\":0.000,"
+                    "\"entries_scanned\":300,\"results\":7,\"threads\":[{\"match_ms\":12.000,\"entries_scanned\":100},"
+                    "{\"match_ms\":11.500,\"entries_scanned\":200}]}");
+}
+
+static void
+test_to_json_query_text(void) {
+    FsearchQueryStats stats = {0};
+    g_autoptr(GString) json = fsearch_query_stats_to_json(&stats, "a\"b\\c\nd");
+    g_assert_true(g_str_has_prefix(json->str, "{\"query\":\"a\\\"b\\\\c\\nd\",\"parse_ms\":0.000,"));
+    g_assert_true(g_str_has_suffix(json->str, "\"threads\":[]}"));
+}
+
+int
+main(int argc, char *argv[]) {
+    setlocale(LC_ALL, "");
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/FSearch/query_stats/to_json", test_to_json);
+    g_test_add_func("/FSearch/query_stats/to_json_query_text", test_to_json_query_text);
+    return g_test_run();
+}
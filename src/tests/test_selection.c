@@ -0,0 +1,391 @@
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <src/fsearch_database_entry.h>
+#include <src/fsearch_database_version.h>
+#include <src/fsearch_memory_pool.h>
+#include <src/fsearch_selection.h>
+
+typedef struct {
+    FsearchMemoryPool *folder_pool;
+    FsearchMemoryPool *file_pool;
+    DynamicArray *sorted_folders[NUM_DATABASE_INDEX_TYPES];
+    DynamicArray *sorted_files[NUM_DATABASE_INDEX_TYPES];
+} SelectionFixture;
+
+static FsearchDatabaseEntry *
+new_entry(SelectionFixture *fixture, FsearchDatabaseEntryType type, const char *name, off_t size) {
+    FsearchDatabaseEntry *entry =
+        fsearch_memory_pool_malloc(type == DATABASE_ENTRY_TYPE_FOLDER ? fixture->folder_pool : fixture->file_pool);
+    db_entry_set_type(entry, type);
+    db_entry_set_name(entry, name);
+    db_entry_set_size(entry, size);
+    return entry;
+}
+
+static void
+set_indices(DynamicArray *entries) {
+    for (uint32_t i = 0; i < darray_get_num_items(entries); i++) {
+        db_entry_set_idx(darray_get_item(entries, i), i);
+    }
+}
+
+// The name arrays hold num_folders folders and num_files files, the size order is the reverse of the name order
+static void
+fixture_init(SelectionFixture *fixture, uint32_t num_folders, uint32_t num_files) {
+    fixture->folder_pool =
+        fsearch_memory_pool_new(1024, db_entry_get_sizeof_folder_entry(), (GDestroyNotify)db_entry_destroy);
+    fixture->file_pool =
+        fsearch_memory_pool_new(1024, db_entry_get_sizeof_file_entry(), (GDestroyNotify)db_entry_destroy);
+
+    fixture->sorted_folders[DATABASE_INDEX_TYPE_NAME] = darray_new(num_folders);
+    for (uint32_t i = 0; i < num_folders; i++) {
+        g_autofree char *name = g_strdup_printf("folder_%05u", i);
+        darray_add_item(fixture->sorted_folders[DATABASE_INDEX_TYPE_NAME],
+                        new_entry(fixture, DATABASE_ENTRY_TYPE_FOLDER, name, 0));
+    }
+    fixture->sorted_files[DATABASE_INDEX_TYPE_NAME] = darray_new(num_files);
+    fixture->sorted_files[DATABASE_INDEX_TYPE_SIZE] = darray_new(num_files);
+    for (uint32_t i = 0; i < num_files; i++) {
+        g_autofree char *name = g_strdup_printf("file_%05u", i);
+        darray_add_item(fixture->sorted_files[DATABASE_INDEX_TYPE_NAME],
+                        new_entry(fixture, DATABASE_ENTRY_TYPE_FILE, name, num_files - i));
+    }
+    for (uint32_t i = num_files; i > 0; i--) {
+        darray_add_item(fixture->sorted_files[DATABASE_INDEX_TYPE_SIZE],
+                        darray_get_item(fixture->sorted_files[DATABASE_INDEX_TYPE_NAME], i - 1));
+    }
+    set_indices(fixture->sorted_folders[DATABASE_INDEX_TYPE_NAME]);
+    set_indices(fixture->sorted_files[DATABASE_INDEX_TYPE_NAME]);
+}
+
+static void
+fixture_clear(SelectionFixture *fixture) {
+    for (uint32_t i = 0; i < NUM_DATABASE_INDEX_TYPES; i++) {
+        g_clear_pointer(&fixture->sorted_folders[i], darray_unref);
+        g_clear_pointer(&fixture->sorted_files[i], darray_unref);
+    }
+    g_clear_pointer(&fixture->folder_pool, fsearch_memory_pool_free_pool);
+    g_clear_pointer(&fixture->file_pool, fsearch_memory_pool_free_pool);
+}
+
+static void
+count_entry(FsearchDatabaseEntry *entry, gpointer value, GPtrArray *entries) {
+    g_assert_true(entry == value);
+    g_ptr_array_add(entries, entry);
+}
+
+static void
+test_select(void) {
+    SelectionFixture fixture = {0};
+    fixture_init(&fixture, 10, 300);
+    FsearchDatabaseVersion *version = db_version_new(fixture.sorted_folders, fixture.sorted_files, 1);
+    FsearchSelection *selection = fsearch_selection_new(version);
+    DynamicArray *files = fixture.sorted_files[DATABASE_INDEX_TYPE_NAME];
+    DynamicArray *folders = fixture.sorted_folders[DATABASE_INDEX_TYPE_NAME];
+
+    FsearchDatabaseEntry *file = darray_get_item(files, 70);
+    FsearchDatabaseEntry *folder = darray_get_item(folders, 3);
+    fsearch_selection_select(selection, file);
+    fsearch_selection_select(selection, file);
+    fsearch_selection_select_toggle(selection, folder);
+    g_assert_true(fsearch_selection_is_selected(selection, file));
+    g_assert_true(fsearch_selection_is_selected(selection, folder));
+    g_assert_false(fsearch_selection_is_selected(selection, darray_get_item(files, 3)));
+    g_assert_cmpuint(fsearch_selection_get_num_selected(selection), ==, 2);
+
+    // the folders come first
+    g_autoptr(GPtrArray) selected = g_ptr_array_new();
+    fsearch_selection_for_each(selection, (GHFunc)count_entry, selected);
+    g_assert_cmpuint(selected->len, ==, 2);
+    g_assert_true(g_ptr_array_index(selected, 0) == folder);
+    g_assert_true(g_ptr_array_index(selected, 1) == file);
+
+    fsearch_selection_select_toggle(selection, folder);
+    g_assert_false(fsearch_selection_is_selected(selection, folder));
+    g_assert_cmpuint(fsearch_selection_get_num_selected(selection), ==, 1);
+
+    // entries are still found when their index is outdated
+    db_entry_set_idx(file, 5);
+    g_assert_true(fsearch_selection_is_selected(selection, file));
+    fsearch_selection_select_toggle(selection, file);
+    g_assert_cmpuint(fsearch_selection_get_num_selected(selection), ==, 0);
+    db_entry_set_idx(file, 70);
+
+    // one bit for each entry
+    g_assert_cmpuint(fsearch_selection_get_memory_size(selection), <, 128);
+
+    g_clear_pointer(&selection, fsearch_selection_free);
+    g_clear_pointer(&version, db_version_unref);
+    fixture_clear(&fixture);
+}
+
+static void
+test_ranges(void) {
+    SelectionFixture fixture = {0};
+    fixture_init(&fixture, 0, 300);
+    FsearchDatabaseVersion *version = db_version_new(fixture.sorted_folders, fixture.sorted_files, 1);
+    FsearchSelection *selection = fsearch_selection_new(version);
+    DynamicArray *files = fixture.sorted_files[DATABASE_INDEX_TYPE_NAME];
+    DynamicArray *files_by_size = fixture.sorted_files[DATABASE_INDEX_TYPE_SIZE];
+
+    // ranges of the name order cover several words
+    fsearch_selection_select_range(selection, files, 60, 200);
+    g_assert_cmpuint(fsearch_selection_get_num_selected(selection), ==, 141);
+    g_assert_false(fsearch_selection_is_selected(selection, darray_get_item(files, 59)));
+    g_assert_true(fsearch_selection_is_selected(selection, darray_get_item(files, 60)));
+    g_assert_true(fsearch_selection_is_selected(selection, darray_get_item(files, 200)));
+    g_assert_false(fsearch_selection_is_selected(selection, darray_get_item(files, 201)));
+
+    fsearch_selection_toggle_range(selection, files, 0, 63);
+    g_assert_cmpuint(fsearch_selection_get_num_selected(selection), ==, 141 - 4 + 60);
+    g_assert_true(fsearch_selection_is_selected(selection, darray_get_item(files, 0)));
+    g_assert_false(fsearch_selection_is_selected(selection, darray_get_item(files, 63)));
+
+    // other orders select the entries at those positions
+    fsearch_selection_unselect_all(selection);
+    fsearch_selection_select_range(selection, files_by_size, 0, 9);
+    g_assert_cmpuint(fsearch_selection_get_num_selected(selection), ==, 10);
+    g_assert_true(fsearch_selection_is_selected(selection, darray_get_item(files, 299)));
+    g_assert_true(fsearch_selection_is_selected(selection, darray_get_item(files, 290)));
+    g_assert_false(fsearch_selection_is_selected(selection, darray_get_item(files, 289)));
+
+    // the range ends with the array
+    fsearch_selection_select_range(selection, files, 295, 1000);
+    g_assert_cmpuint(fsearch_selection_get_num_selected(selection), ==, 10);
+    fsearch_selection_select_range(selection, files, 280, 1000);
+    g_assert_cmpuint(fsearch_selection_get_num_selected(selection), ==, 20);
+
+    g_clear_pointer(&selection, fsearch_selection_free);
+    g_clear_pointer(&version, db_version_unref);
+    fixture_clear(&fixture);
+}
+
+static void
+test_select_all(void) {
+    SelectionFixture fixture = {0};
+    fixture_init(&fixture, 20, 1000);
+    FsearchDatabaseVersion *version = db_version_new(fixture.sorted_folders, fixture.sorted_files, 1);
+    FsearchSelection *selection = fsearch_selection_new(version);
+    DynamicArray *files = fixture.sorted_files[DATABASE_INDEX_TYPE_NAME];
+    DynamicArray *folders = fixture.sorted_folders[DATABASE_INDEX_TYPE_NAME];
+
+    fsearch_selection_select_all(selection, folders);
+    fsearch_selection_select_all(selection, fixture.sorted_files[DATABASE_INDEX_TYPE_SIZE]);
+    g_assert_cmpuint(fsearch_selection_get_num_selected(selection), ==, 1020);
+    g_autoptr(GPtrArray) selected = g_ptr_array_new();
+    fsearch_selection_for_each(selection, (GHFunc)count_entry, selected);
+    g_assert_cmpuint(selected->len, ==, 1020);
+
+    fsearch_selection_select_toggle(selection, darray_get_item(files, 7));
+    fsearch_selection_invert(selection, files);
+    g_assert_cmpuint(fsearch_selection_get_num_selected(selection), ==, 21);
+    g_assert_true(fsearch_selection_is_selected(selection, darray_get_item(files, 7)));
+
+    // results which aren't one of the orders of the version are selected one by one
+    DynamicArray *results = darray_new(3);
+    darray_add_item(results, darray_get_item(files, 500));
+    darray_add_item(results, darray_get_item(files, 7));
+    darray_add_item(results, darray_get_item(files, 999));
+    fsearch_selection_invert(selection, results);
+    g_assert_cmpuint(fsearch_selection_get_num_selected(selection), ==, 22);
+    g_assert_false(fsearch_selection_is_selected(selection, darray_get_item(files, 7)));
+    fsearch_selection_select_all(selection, results);
+    g_assert_cmpuint(fsearch_selection_get_num_selected(selection), ==, 23);
+
+    fsearch_selection_unselect_all(selection);
+    g_assert_cmpuint(fsearch_selection_get_num_selected(selection), ==, 0);
+    g_assert_false(fsearch_selection_is_selected(selection, darray_get_item(folders, 0)));
+
+    g_clear_pointer(&results, darray_unref);
+    g_clear_pointer(&selection, fsearch_selection_free);
+    g_clear_pointer(&version, db_version_unref);
+    fixture_clear(&fixture);
+}
+
+static void
+test_set_version(void) {
+    SelectionFixture fixture = {0};
+    fixture_init(&fixture, 0, 200);
+    FsearchDatabaseVersion *version = db_version_new(fixture.sorted_folders, fixture.sorted_files, 1);
+    FsearchSelection *selection = fsearch_selection_new(version);
+    DynamicArray *files = fixture.sorted_files[DATABASE_INDEX_TYPE_NAME];
+    for (uint32_t i = 0; i < 200; i += 3) {
+        fsearch_selection_select(selection, darray_get_item(files, i));
+    }
+    const uint32_t num_selected = fsearch_selection_get_num_selected(selection);
+    g_assert_cmpuint(num_selected, ==, 67);
+
+    // a version which only has another sort order keeps the bits
+    DynamicArray *sorted_files[NUM_DATABASE_INDEX_TYPES] = {0};
+    sorted_files[DATABASE_INDEX_TYPE_NAME] = files;
+    FsearchDatabaseVersion *name_only = db_version_new(fixture.sorted_folders, sorted_files, 2);
+    fsearch_selection_set_version(selection, name_only);
+    g_assert_cmpuint(fsearch_selection_get_num_selected(selection), ==, num_selected);
+
+    // the entries keep their selection in a new name array, without their outdated indices and the removed entry
+    DynamicArray *changed = darray_new(201);
+    darray_add_item(changed, new_entry(&fixture, DATABASE_ENTRY_TYPE_FILE, "file_", 1));
+    for (uint32_t i = 0; i < 200; i++) {
+        if (i != 99) {
+            darray_add_item(changed, darray_get_item(files, i));
+        }
+    }
+    sorted_files[DATABASE_INDEX_TYPE_NAME] = changed;
+    FsearchDatabaseVersion *changed_version = db_version_new(fixture.sorted_folders, sorted_files, 3);
+    fsearch_selection_set_version(selection, changed_version);
+    g_assert_cmpuint(fsearch_selection_get_num_selected(selection), ==, num_selected - 1);
+    for (uint32_t i = 0; i < 200; i++) {
+        g_assert_true(fsearch_selection_is_selected(selection, darray_get_item(files, i)) == (i % 3 == 0 && i != 99));
+    }
+    g_assert_false(fsearch_selection_is_selected(selection, darray_get_item(changed, 0)));
+
+    // nothing is selected without a version
+    fsearch_selection_set_version(selection, NULL);
+    g_assert_cmpuint(fsearch_selection_get_num_selected(selection), ==, 0);
+    g_assert_false(fsearch_selection_is_selected(selection, darray_get_item(files, 0)));
+
+    g_clear_pointer(&changed, darray_unref);
+    g_clear_pointer(&selection, fsearch_selection_free);
+    g_clear_pointer(&changed_version, db_version_unref);
+    g_clear_pointer(&name_only, db_version_unref);
+    g_clear_pointer(&version, db_version_unref);
+    fixture_clear(&fixture);
+}
+
+// Folders dir_00 to dir_39 with a README and a notes_XX file each and a folder sub in dir_00 and dir_01, all of them get
+// ids through id_func. The folder dir_<skip> is left out.
+typedef uint32_t (*FolderIdFunc)(uint32_t i);
+
+static void
+fixture_init_tree(SelectionFixture *fixture, FolderIdFunc id_func, uint32_t skip) {
+    fixture->folder_pool =
+        fsearch_memory_pool_new(1024, db_entry_get_sizeof_folder_entry(), (GDestroyNotify)db_entry_destroy);
+    fixture->file_pool =
+        fsearch_memory_pool_new(1024, db_entry_get_sizeof_file_entry(), (GDestroyNotify)db_entry_destroy);
+    DynamicArray *folders = darray_new(64);
+    DynamicArray *files = darray_new(128);
+    for (uint32_t i = 0; i < 40; i++) {
+        if (i == skip) {
+            continue;
+        }
+        g_autofree char *name = g_strdup_printf("dir_%02u", i);
+        FsearchDatabaseEntry *folder = new_entry(fixture, DATABASE_ENTRY_TYPE_FOLDER, name, 0);
+        db_entry_folder_set_id((FsearchDatabaseEntryFolder *)folder, id_func(i));
+        darray_add_item(folders, folder);
+        if (i < 2) {
+            FsearchDatabaseEntry *sub = new_entry(fixture, DATABASE_ENTRY_TYPE_FOLDER, "sub", 0);
+            db_entry_set_parent(sub, (FsearchDatabaseEntryFolder *)folder);
+            db_entry_folder_set_id((FsearchDatabaseEntryFolder *)sub, id_func(40 + i));
+            darray_add_item(folders, sub);
+        }
+        g_autofree char *notes = g_strdup_printf("notes_%02u", i);
+        FsearchDatabaseEntry *file = new_entry(fixture, DATABASE_ENTRY_TYPE_FILE, notes, 0);
+        db_entry_set_parent(file, (FsearchDatabaseEntryFolder *)folder);
+        darray_add_item(files, file);
+        file = new_entry(fixture, DATABASE_ENTRY_TYPE_FILE, "README", 0);
+        db_entry_set_parent(file, (FsearchDatabaseEntryFolder *)folder);
+        darray_add_item(files, file);
+    }
+    darray_sort(folders, (DynamicArrayCompareDataFunc)db_entry_compare_entries_by_name, NULL, NULL);
+    darray_sort(files, (DynamicArrayCompareDataFunc)db_entry_compare_entries_by_name, NULL, NULL);
+    set_indices(folders);
+    set_indices(files);
+    fixture->sorted_folders[DATABASE_INDEX_TYPE_NAME] = folders;
+    fixture->sorted_files[DATABASE_INDEX_TYPE_NAME] = files;
+}
+
+static uint32_t
+old_folder_id(uint32_t i) {
+    return i + 1;
+}
+
+// The subfolders swap their ids and the dir_ folders from 20 on get ids which old ones have for other folders, like
+// databases which were scanned independently
+static uint32_t
+new_folder_id(uint32_t i) {
+    if (i >= 40) {
+        return 40 + (i == 40 ? 2 : 1);
+    }
+    return i < 20 ? i + 1 : 20 + (i + 7) % 20 + 1;
+}
+
+static const char *
+get_path_name(FsearchDatabaseEntry *entry, GString *path) {
+    g_string_truncate(path, 0);
+    FsearchDatabaseEntryFolder *parent = db_entry_get_parent(entry);
+    if (parent) {
+        g_string_append(path, db_entry_get_name_raw((FsearchDatabaseEntry *)parent));
+        g_string_append_c(path, '/');
+    }
+    g_string_append(path, db_entry_get_name_raw(entry));
+    return path->str;
+}
+
+static bool
+is_selected_in_old_database(FsearchDatabaseEntry *entry, GString *path) {
+    const char *name = get_path_name(entry, path);
+    uint32_t i = 0;
+    if (sscanf(name, "dir_%02u", &i) == 1) {
+        return db_entry_is_folder(entry) ? i % 2 == 0 : (strstr(name, "README") ? i % 3 == 0 : i % 4 == 0);
+    }
+    return strcmp(name, "dir_01/sub") == 0;
+}
+
+static void
+test_select_same_entries(void) {
+    SelectionFixture old_fixture = {0};
+    fixture_init_tree(&old_fixture, old_folder_id, UINT32_MAX);
+    FsearchDatabaseVersion *old_version = db_version_new(old_fixture.sorted_folders, old_fixture.sorted_files, 1);
+    FsearchSelection *old_selection = fsearch_selection_new(old_version);
+    g_autoptr(GString) path = g_string_new(NULL);
+    DynamicArray *old_entries[] = {old_fixture.sorted_folders[DATABASE_INDEX_TYPE_NAME],
+                                   old_fixture.sorted_files[DATABASE_INDEX_TYPE_NAME]};
+    for (uint32_t a = 0; a < G_N_ELEMENTS(old_entries); a++) {
+        for (uint32_t i = 0; i < darray_get_num_items(old_entries[a]); i++) {
+            FsearchDatabaseEntry *entry = darray_get_item(old_entries[a], i);
+            if (is_selected_in_old_database(entry, path)) {
+                fsearch_selection_select(old_selection, entry);
+            }
+        }
+    }
+    g_assert_cmpuint(fsearch_selection_get_num_selected(old_selection), ==, 20 + 14 + 10 + 1);
+
+    // dir_06 and its files were removed
+    SelectionFixture new_fixture = {0};
+    fixture_init_tree(&new_fixture, new_folder_id, 6);
+    FsearchDatabaseVersion *new_version = db_version_new(new_fixture.sorted_folders, new_fixture.sorted_files, 1);
+    FsearchSelection *new_selection = fsearch_selection_new(new_version);
+    fsearch_selection_select_same_entries(new_selection, old_selection);
+    g_assert_cmpuint(fsearch_selection_get_num_selected(new_selection), ==, 19 + 13 + 10 + 1);
+
+    DynamicArray *new_entries[] = {new_fixture.sorted_folders[DATABASE_INDEX_TYPE_NAME],
+                                   new_fixture.sorted_files[DATABASE_INDEX_TYPE_NAME]};
+    for (uint32_t a = 0; a < G_N_ELEMENTS(new_entries); a++) {
+        for (uint32_t i = 0; i < darray_get_num_items(new_entries[a]); i++) {
+            FsearchDatabaseEntry *entry = darray_get_item(new_entries[a], i);
+            g_assert_true(fsearch_selection_is_selected(new_selection, entry)
+                          == is_selected_in_old_database(entry, path));
+        }
+    }
+
+    g_clear_pointer(&new_selection, fsearch_selection_free);
+    g_clear_pointer(&old_selection, fsearch_selection_free);
+    g_clear_pointer(&new_version, db_version_unref);
+    g_clear_pointer(&old_version, db_version_unref);
+    fixture_clear(&new_fixture);
+    fixture_clear(&old_fixture);
+}
+
+int
+main(int argc, char *argv[]) {
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/FSearch/selection/select", test_select);
+    g_test_add_func("/FSearch/selection/ranges", test_ranges);
+    g_test_add_func("/FSearch/selection/select_all", test_select_all);
+    g_test_add_func("/FSearch/selection/set_version", test_set_version);
+    g_test_add_func("/FSearch/selection/select_same_entries", test_select_same_entries);
+    return g_test_run();
+}
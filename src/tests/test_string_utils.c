@@ -234,6 +234,51 @@ test_str_starts_with_interval(void) {
     }
 }
 
+static void
+test_str_search(void) {
+    typedef struct {
+        const char *needle;
+        const char *haystack;
+        bool ignore_case;
+    } FsearchTestSearchContext;
+
+    FsearchTestSearchContext tests[] = {
+        {"", "", false},
+        {"", "abc", true},
+        {"a", "", false},
+        {"abc", "abc", false},
+        {"abc", "ABC", false},
+        {"abc", "ABC", true},
+        {"Abc", "xxABCxx", true},
+        {"txt", "document.txt", false},
+        {"aab", "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaab", false},
+        {"aab", "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa", false},
+        {"needle", "a long haystack with the needle at the very end of it, needle", false},
+        {"NEEDLE", "a long haystack with the needle somewhere in the middle of it", true},
+        {"needles", "a long haystack with the needle somewhere in the middle of it", true},
+        {"long_needle_in_a_haystack", "a_very_long_needle_in_a_haystack_which_is_longer", true},
+        {"\xc3\xa4", "\xc3\x84\xc3\xa4", true},
+        {"[", "{[", true},
+        {"@", "`@", true},
+    };
+
+    for (gint i = 0; i < G_N_ELEMENTS(tests); ++i) {
+        FsearchStringSearch search = {};
+        fsearch_string_search_init(&search, tests[i].needle, tests[i].ignore_case);
+        const bool expected = tests[i].ignore_case ? strcasestr(tests[i].haystack, tests[i].needle) != NULL
+                                                   : strstr(tests[i].haystack, tests[i].needle) != NULL;
+        // every suffix of the haystack, so the needle is found at all positions of the vectorized blocks
+        for (const char *haystack = tests[i].haystack; *haystack; haystack++) {
+            const bool found = fsearch_string_search_find(&search, haystack, strlen(haystack));
+            g_assert_true(found
+                          == (tests[i].ignore_case ? strcasestr(haystack, tests[i].needle) != NULL
+                                                   : strstr(haystack, tests[i].needle) != NULL));
+        }
+        g_assert_true(fsearch_string_search_find(&search, tests[i].haystack, strlen(tests[i].haystack)) == expected);
+        fsearch_string_search_clear(&search);
+    }
+}
+
 int
 main(int argc, char *argv[]) {
     g_test_init(&argc, &argv, NULL);
@@ -244,5 +289,6 @@ main(int argc, char *argv[]) {
     g_test_add_func("/FSearch/string_utils/is_ascii_icase", test_str_icase_is_ascii);
     g_test_add_func("/FSearch/string_utils/convert_wildcard_to_regex", test_str_wildcard_to_regex);
     g_test_add_func("/FSearch/string_utils/starts_with_interval", test_str_starts_with_interval);
+    g_test_add_func("/FSearch/string_utils/search", test_str_search);
     return g_test_run();
 }
@@ -0,0 +1,177 @@
+#include <gio/gio.h>
+#include <glib.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <src/fsearch_thread_pool.h>
+
+typedef struct {
+    volatile gint *counts;
+    volatile gint num_calls;
+    GCancellable *cancellable;
+    uint32_t cancel_at;
+} RangeContext;
+
+static void
+count_range(uint32_t start, uint32_t end, void *data) {
+    RangeContext *ctx = data;
+    g_atomic_int_inc(&ctx->num_calls);
+    for (uint32_t i = start; i < end; i++) {
+        g_atomic_int_inc(&ctx->counts[i]);
+    }
+    if (ctx->cancellable && start <= ctx->cancel_at && ctx->cancel_at < end) {
+        g_cancellable_cancel(ctx->cancellable);
+    }
+}
+
+static void
+check_parallel_for(FsearchThreadPool *pool, uint32_t num_items, uint32_t min_range_size) {
+    RangeContext ctx = {.counts = calloc(MAX(num_items, 1), sizeof(gint))};
+    g_assert_true(fsearch_thread_pool_parallel_for(pool, num_items, min_range_size, count_range, &ctx, NULL));
+    // every item is handed to exactly one range
+    for (uint32_t i = 0; i < num_items; i++) {
+        g_assert_cmpint(ctx.counts[i], ==, 1);
+    }
+    if (num_items == 0) {
+        g_assert_cmpint(ctx.num_calls, ==, 0);
+    }
+    else {
+        g_assert_cmpint(ctx.num_calls, <=, MAX(num_items / MAX(min_range_size, 1), 1));
+    }
+    free((void *)ctx.counts);
+}
+
+static void
+test_parallel_for(void) {
+    FsearchThreadPool *pool = fsearch_thread_pool_new(4);
+    g_assert_cmpuint(fsearch_thread_pool_get_num_threads(pool), ==, 4);
+    check_parallel_for(pool, 0, 1);
+    check_parallel_for(pool, 1, 1);
+    check_parallel_for(pool, 7, 1);
+    check_parallel_for(pool, 100000, 1000);
+    check_parallel_for(pool, 100001, 0);
+    // without a pool everything runs on the calling thread
+    check_parallel_for(NULL, 1000, 1);
+    g_clear_pointer(&pool, fsearch_thread_pool_unref);
+
+    // pinned threads work just the same, even if there aren't enough processors for all of them
+    pool = fsearch_thread_pool_new_full(4, true);
+    check_parallel_for(pool, 100000, 1000);
+    g_clear_pointer(&pool, fsearch_thread_pool_unref);
+
+    // a single thread runs the tasks while it waits for them
+    pool = fsearch_thread_pool_new(1);
+    check_parallel_for(pool, 1000, 1);
+    g_clear_pointer(&pool, fsearch_thread_pool_unref);
+}
+
+static void
+test_cancel(void) {
+    FsearchThreadPool *pool = fsearch_thread_pool_new(4);
+    RangeContext ctx = {.counts = calloc(1000, sizeof(gint)), .cancellable = g_cancellable_new(), .cancel_at = 0};
+    g_assert_false(fsearch_thread_pool_parallel_for(pool, 1000, 1, count_range, &ctx, ctx.cancellable));
+    // no item is visited twice, but the ones of the ranges which didn't start are skipped
+    uint32_t num_visited = 0;
+    for (uint32_t i = 0; i < 1000; i++) {
+        g_assert_cmpint(ctx.counts[i], <=, 1);
+        num_visited += ctx.counts[i];
+    }
+    g_assert_cmpuint(num_visited, >, 0);
+
+    // nothing runs once the group is cancelled
+    const gint num_calls = ctx.num_calls;
+    g_assert_false(fsearch_thread_pool_parallel_for(pool, 1000, 1, count_range, &ctx, ctx.cancellable));
+    g_assert_cmpint(ctx.num_calls, ==, num_calls);
+
+    g_clear_object(&ctx.cancellable);
+    free((void *)ctx.counts);
+    g_clear_pointer(&pool, fsearch_thread_pool_unref);
+}
+
+typedef struct {
+    FsearchThreadPool *pool;
+    uint32_t depth;
+    volatile gint *num_leaves;
+} TreeTask;
+
+static void
+run_tree_task(void *data) {
+    TreeTask *task = data;
+    if (task->depth == 0) {
+        g_atomic_int_inc(task->num_leaves);
+        return;
+    }
+    // tasks which wait for their own tasks help running them, so this doesn't run out of threads
+    TreeTask children[3] = {};
+    FsearchTaskGroup *group = fsearch_task_group_new(task->pool, NULL);
+    for (uint32_t i = 0; i < G_N_ELEMENTS(children); i++) {
+        children[i] = (TreeTask){.pool = task->pool, .depth = task->depth - 1, .num_leaves = task->num_leaves};
+        fsearch_task_group_push(group, run_tree_task, &children[i]);
+    }
+    g_assert_true(fsearch_task_group_wait(group));
+    g_clear_pointer(&group, fsearch_task_group_free);
+}
+
+static void
+test_nested_groups(void) {
+    FsearchThreadPool *pool = fsearch_thread_pool_new(3);
+    volatile gint num_leaves = 0;
+    TreeTask root = {.pool = pool, .depth = 6, .num_leaves = &num_leaves};
+    run_tree_task(&root);
+    g_assert_cmpint(num_leaves, ==, 729);
+    g_clear_pointer(&pool, fsearch_thread_pool_unref);
+}
+
+static void
+count_task(void *data) {
+    g_atomic_int_inc((volatile gint *)data);
+}
+
+static void
+test_default(void) {
+    FsearchThreadPool *pool = fsearch_thread_pool_get_default();
+    FsearchThreadPool *other = fsearch_thread_pool_get_default();
+    // there's only one
+    g_assert_true(pool == other);
+    g_assert_cmpuint(fsearch_thread_pool_get_num_threads(pool), >=, 1);
+
+    volatile gint num_calls = 0;
+    fsearch_thread_pool_run(pool, 5, count_task, (void *)&num_calls);
+    g_assert_cmpint(num_calls, ==, 5);
+
+    g_clear_pointer(&other, fsearch_thread_pool_unref);
+    g_clear_pointer(&pool, fsearch_thread_pool_unref);
+
+    // a new one gets created once the last reference is gone
+    pool = fsearch_thread_pool_get_default();
+    fsearch_thread_pool_run(pool, 2, count_task, (void *)&num_calls);
+    g_assert_cmpint(num_calls, ==, 7);
+
+    // a new config replaces the default pool, while the old one stays usable for those who still hold it
+    fsearch_thread_pool_set_default_config(3, false);
+    other = fsearch_thread_pool_get_default();
+    g_assert_true(pool != other);
+    g_assert_cmpuint(fsearch_thread_pool_get_num_threads(other), ==, 3);
+    fsearch_thread_pool_run(pool, 2, count_task, (void *)&num_calls);
+    fsearch_thread_pool_run(other, 3, count_task, (void *)&num_calls);
+    g_assert_cmpint(num_calls, ==, 12);
+    g_clear_pointer(&pool, fsearch_thread_pool_unref);
+
+    // the same config keeps the pool
+    fsearch_thread_pool_set_default_config(3, false);
+    pool = fsearch_thread_pool_get_default();
+    g_assert_true(pool == other);
+    g_clear_pointer(&pool, fsearch_thread_pool_unref);
+    g_clear_pointer(&other, fsearch_thread_pool_unref);
+    fsearch_thread_pool_set_default_config(0, false);
+}
+
+int
+main(int argc, char *argv[]) {
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/FSearch/thread_pool/parallel_for", test_parallel_for);
+    g_test_add_func("/FSearch/thread_pool/cancel", test_cancel);
+    g_test_add_func("/FSearch/thread_pool/nested_groups", test_nested_groups);
+    g_test_add_func("/FSearch/thread_pool/default", test_default);
+    return g_test_run();
+}